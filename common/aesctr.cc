@@ -0,0 +1,311 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "aesctr.h"
+
+#include <intrin.h>
+#include <wmmintrin.h>
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+const uint8_t kSbox[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+  0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+  0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+  0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+  0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+  0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+  0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+  0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+  0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+  0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+  0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+  0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+  0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+  0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+  0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+  0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+  0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+const uint8_t kRcon[10] = {
+  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+// Keystream blocks made per batch on the AES-NI path: enough to keep
+// the pipeline of the AES unit full.
+const size_t kBatch = 8;
+
+uint8_t Times2(uint8_t b) {
+  return static_cast<uint8_t>((b << 1) ^ ((b & 0x80) ? 0x1b : 0));
+}
+
+// Sets |block| to the counter block of |iv| and |counter|.
+void MakeCounterBlock(const uint8_t iv[AesCtr::kIvSize], uint64_t counter,
+                      uint8_t block[AesCtr::kBlockSize]) {
+  memcpy(block, iv, AesCtr::kIvSize);
+
+  for (int i = AesCtr::kBlockSize - 1; i >= AesCtr::kIvSize; --i) {
+    block[i] = static_cast<uint8_t>(counter);
+    counter >>= 8;
+  }
+}
+
+}  // namespace
+
+AesCtr::AesCtr() : has_key_(false), aesni_(HasAesNi()) {
+  memset(round_keys_, 0, sizeof round_keys_);
+}
+
+bool AesCtr::HasAesNi() {
+  int info[4];
+  __cpuid(info, 1);
+
+  return (info[2] & (1 << 25)) != 0;  // ECX.AES
+}
+
+void AesCtr::SetKey(const uint8_t key[kKeySize]) {
+  assert(key);
+
+  uint8_t* const w = round_keys_;
+  memcpy(w, key, kKeySize);
+
+  for (int i = 4; i < 44; ++i) {
+    uint8_t t[4];
+    memcpy(t, w + 4 * (i - 1), 4);
+
+    if ((i % 4) == 0) {  // RotWord, SubWord and Rcon
+      const uint8_t t0 = t[0];
+      t[0] = kSbox[t[1]] ^ kRcon[i / 4 - 1];
+      t[1] = kSbox[t[2]];
+      t[2] = kSbox[t[3]];
+      t[3] = kSbox[t0];
+    }
+
+    for (int j = 0; j < 4; ++j)
+      w[4 * i + j] = w[4 * (i - 4) + j] ^ t[j];
+  }
+
+  has_key_ = true;
+}
+
+bool AesCtr::HasKey() const {
+  return has_key_;
+}
+
+void AesCtr::DisableAesNi() {
+  aesni_ = false;
+}
+
+void AesCtr::Transform(const uint8_t iv[kIvSize], const uint8_t* src,
+                       size_t len, uint8_t* dst) const {
+  assert(has_key_);
+  assert(iv);
+  assert(src || (len == 0));
+  assert(dst || (len == 0));
+  assert((dst <= src) || (dst >= src + len));
+
+  if (aesni_)
+    TransformAesNi(iv, src, len, dst);
+  else
+    TransformSoftware(iv, src, len, dst);
+}
+
+void AesCtr::TransformAesNi(const uint8_t iv[kIvSize], const uint8_t* src,
+                            size_t len, uint8_t* dst) const {
+  __m128i k[11];
+
+  for (int i = 0; i < 11; ++i) {
+    const void* const p = round_keys_ + i * kBlockSize;
+    k[i] = _mm_loadu_si128(static_cast<const __m128i*>(p));
+  }
+
+  uint64_t counter = 0;
+  uint8_t ctr[kBatch * kBlockSize];
+
+  while (len > 0) {
+    const size_t bytes = (len < sizeof ctr) ? len : sizeof ctr;
+    const size_t n = (bytes + kBlockSize - 1) / kBlockSize;
+
+    __m128i b[kBatch];
+
+    for (size_t i = 0; i < n; ++i) {
+      uint8_t* const c = ctr + i * kBlockSize;
+      MakeCounterBlock(iv, counter++, c);
+
+      b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)c), k[0]);
+    }
+
+    // Round by round over the batch, so that the blocks are independent
+    // work for the AES unit.
+    for (int r = 1; r < 10; ++r) {
+      for (size_t i = 0; i < n; ++i)
+        b[i] = _mm_aesenc_si128(b[i], k[r]);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+      b[i] = _mm_aesenclast_si128(b[i], k[10]);
+
+    if (bytes == sizeof ctr) {
+      // Read the whole batch before writing any of it, since |dst| may
+      // overlap |src|.
+      __m128i s[kBatch];
+
+      for (size_t i = 0; i < kBatch; ++i)
+        s[i] = _mm_loadu_si128((const __m128i*)(src + i * kBlockSize));
+
+      for (size_t i = 0; i < kBatch; ++i) {
+        __m128i* const d = (__m128i*)(dst + i * kBlockSize);
+        _mm_storeu_si128(d, _mm_xor_si128(s[i], b[i]));
+      }
+    } else {
+      uint8_t ks[kBatch * kBlockSize];
+
+      for (size_t i = 0; i < n; ++i)
+        _mm_storeu_si128((__m128i*)(ks + i * kBlockSize), b[i]);
+
+      for (size_t i = 0; i < bytes; ++i)  // forward, as for memmove
+        dst[i] = src[i] ^ ks[i];
+    }
+
+    src += bytes;
+    dst += bytes;
+    len -= bytes;
+  }
+}
+
+void AesCtr::TransformSoftware(const uint8_t iv[kIvSize], const uint8_t* src,
+                               size_t len, uint8_t* dst) const {
+  uint64_t counter = 0;
+
+  while (len > 0) {
+    uint8_t ctr[kBlockSize];
+    MakeCounterBlock(iv, counter++, ctr);
+
+    uint8_t ks[kBlockSize];
+    EncryptBlock(ctr, ks);
+
+    const size_t bytes = (len < kBlockSize) ? len : kBlockSize;
+
+    for (size_t i = 0; i < bytes; ++i)
+      dst[i] = src[i] ^ ks[i];
+
+    src += bytes;
+    dst += bytes;
+    len -= bytes;
+  }
+}
+
+void AesCtr::EncryptBlock(const uint8_t in[kBlockSize],
+                          uint8_t out[kBlockSize]) const {
+  // The state is column major, as the bytes of the block.
+  uint8_t s[kBlockSize];
+
+  for (int i = 0; i < kBlockSize; ++i)
+    s[i] = in[i] ^ round_keys_[i];
+
+  for (int r = 1; r <= 10; ++r) {
+    uint8_t t[kBlockSize];
+
+    // SubBytes and ShiftRows: row i is rotated left by i.
+    for (int c = 0; c < 4; ++c) {
+      for (int i = 0; i < 4; ++i)
+        t[4 * c + i] = kSbox[s[4 * ((c + i) % 4) + i]];
+    }
+
+    if (r < 10) {  // MixColumns
+      for (int c = 0; c < 4; ++c) {
+        uint8_t* const a = t + 4 * c;
+        const uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+        const uint8_t a0 = a[0];
+
+        a[0] ^= all ^ Times2(a[0] ^ a[1]);
+        a[1] ^= all ^ Times2(a[1] ^ a[2]);
+        a[2] ^= all ^ Times2(a[2] ^ a[3]);
+        a[3] ^= all ^ Times2(a[3] ^ a0);
+      }
+    }
+
+    const uint8_t* const k = round_keys_ + r * kBlockSize;
+
+    for (int i = 0; i < kBlockSize; ++i)
+      s[i] = t[i] ^ k[i];
+  }
+
+  memcpy(out, s, kBlockSize);
+}
+
+long DecryptWebmFrame(const AesCtr& aes, const uint8_t* src, long len,
+                      uint8_t* dst) {
+  assert(src);
+  assert(dst);
+
+  if (len < kWebmSignalSize)
+    return -1;
+
+  if ((src[0] & 1) == 0) {  // sent in the clear
+    const long clear_len = len - kWebmSignalSize;
+    memmove(dst, src + kWebmSignalSize, clear_len);
+
+    return clear_len;
+  }
+
+  if ((len < kWebmEncryptedHeaderSize) || !aes.HasKey())
+    return -1;
+
+  uint8_t iv[AesCtr::kIvSize];
+  memcpy(iv, src + kWebmSignalSize, AesCtr::kIvSize);
+
+  const long clear_len = len - kWebmEncryptedHeaderSize;
+  aes.Transform(iv, src + kWebmEncryptedHeaderSize, clear_len, dst);
+
+  return clear_len;
+}
+
+long EncryptWebmFrame(const AesCtr& aes, uint64_t iv, const uint8_t* src,
+                      long len, uint8_t* dst) {
+  assert(aes.HasKey());
+  assert(src || (len == 0));
+  assert(dst);
+  assert(len >= 0);
+
+  uint8_t* const iv_bytes = dst + kWebmSignalSize;
+
+  dst[0] = 1;  // encrypted
+
+  for (int i = AesCtr::kIvSize - 1; i >= 0; --i) {  // big-endian
+    iv_bytes[i] = static_cast<uint8_t>(iv);
+    iv >>= 8;
+  }
+
+  aes.Transform(iv_bytes, src, len, dst + kWebmEncryptedHeaderSize);
+
+  return kWebmEncryptedHeaderSize + len;
+}
+
+}  // namespace webmdshow
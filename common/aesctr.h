@@ -0,0 +1,80 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_AESCTR_H_
+#define WEBMDSHOW_COMMON_AESCTR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace webmdshow {
+
+// AES-128 in counter mode, as WebM encryption uses it: the counter block
+// is the 8 byte IV of the frame followed by a 64 bit big-endian block
+// counter, from 0. With AES-NI the keystream is made several blocks at
+// a time, so that the rounds of one block overlap those of the next;
+// without it, a byte-wise software AES is used. Thread safe once the
+// key is set.
+class AesCtr {
+ public:
+  enum { kKeySize = 16, kBlockSize = 16, kIvSize = 8 };
+
+  AesCtr();
+
+  // Whether the processor has the AES instructions.
+  static bool HasAesNi();
+
+  void SetKey(const uint8_t key[kKeySize]);
+  bool HasKey() const;
+
+  // Makes the software path be used, even with AES-NI; for tests.
+  void DisableAesNi();
+
+  // Sets |dst| to the |len| bytes of |src| XORed with the keystream of
+  // |iv|. |dst| may be |src|, or lie before it in the same buffer, since
+  // each batch of blocks is read before it is written.
+  void Transform(const uint8_t iv[kIvSize], const uint8_t* src, size_t len,
+                 uint8_t* dst) const;
+
+ private:
+  void TransformAesNi(const uint8_t iv[kIvSize], const uint8_t* src,
+                      size_t len, uint8_t* dst) const;
+  void TransformSoftware(const uint8_t iv[kIvSize], const uint8_t* src,
+                         size_t len, uint8_t* dst) const;
+
+  void EncryptBlock(const uint8_t in[kBlockSize],
+                    uint8_t out[kBlockSize]) const;
+
+  uint8_t round_keys_[11 * kBlockSize];
+  bool has_key_;
+  bool aesni_;
+};
+
+// The frame of an encrypted WebM track begins with a signal byte, whose
+// low bit says whether the frame is encrypted, followed, if it is, by
+// the IV of the frame.
+enum {
+  kWebmSignalSize = 1,
+  kWebmEncryptedHeaderSize = kWebmSignalSize + AesCtr::kIvSize
+};
+
+// Sets |dst| to the clear frame of the |len| bytes of |src|, and returns
+// its length, or -1 if the frame is malformed. |dst| may be |src|, so
+// that a frame read into a sample is decrypted where it lies.
+long DecryptWebmFrame(const AesCtr& aes, const uint8_t* src, long len,
+                      uint8_t* dst);
+
+// Sets |dst|, which must hold kWebmEncryptedHeaderSize + |len| bytes, to
+// the encrypted frame of the |len| bytes of |src|, with IV |iv|, and
+// returns its length. Every frame under a key needs an IV of its own.
+long EncryptWebmFrame(const AesCtr& aes, uint64_t iv, const uint8_t* src,
+                      long len, uint8_t* dst);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_AESCTR_H_
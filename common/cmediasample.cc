@@ -8,11 +8,17 @@
 
 #include "cmediasample.h"
 #include "mediatypeutil.h"
+#include "pagealloc.h"
 #include <new>
 #include <cassert>
 #include <vfwmsgs.h>
 
 
+CMediaSample::Factory::Factory(bool pages) : m_pages(pages)
+{
+}
+
+
 CMediaSample::Factory::~Factory()
 {
 }
@@ -25,7 +31,8 @@ HRESULT CMediaSample::Factory::CreateSample(
     assert(pAllocator);
     pResult = 0;
 
-    CMediaSample* const pSample = new (std::nothrow) CMediaSample(pAllocator);
+    CMediaSample* const pSample =
+        new (std::nothrow) CMediaSample(pAllocator, m_pages);
 
     if (pSample == 0)
         return E_OUTOFMEMORY;
@@ -80,6 +87,18 @@ HRESULT CMediaSample::Factory::Destroy(CMemAllocator*)
 
 
 HRESULT CMediaSample::CreateAllocator(IMemAllocator** pp)
+{
+    return CreateAllocator(pp, false);
+}
+
+
+HRESULT CMediaSample::CreatePageAllocator(IMemAllocator** pp)
+{
+    return CreateAllocator(pp, true);
+}
+
+
+HRESULT CMediaSample::CreateAllocator(IMemAllocator** pp, bool pages)
 {
     if (pp == 0)
         return E_POINTER;
@@ -87,7 +106,7 @@ HRESULT CMediaSample::CreateAllocator(IMemAllocator** pp)
     IMemAllocator*& p = *pp;
     p = 0;
 
-    Factory* const pFactory = new (std::nothrow) Factory;
+    Factory* const pFactory = new (std::nothrow) Factory(pages);
 
     if (pFactory == 0)
         return E_OUTOFMEMORY;
@@ -107,6 +126,18 @@ HRESULT CMediaSample::Create()
     assert(m_buf == 0);
     assert(m_buflen == 0);
 
+    if (m_pages)  //see Initialize
+        return S_OK;
+
+    return CreateBuffer();
+}
+
+
+HRESULT CMediaSample::CreateBuffer()
+{
+    assert(!m_pages);
+    assert(m_buf == 0);
+
     ALLOCATOR_PROPERTIES props;
 
     HRESULT hr = m_pAllocator->GetProperties(&props);
@@ -136,6 +167,53 @@ HRESULT CMediaSample::Create()
 }
 
 
+HRESULT CMediaSample::CreatePages()
+{
+    assert(m_pages);
+    assert(m_buf == 0);
+
+    ALLOCATOR_PROPERTIES props;
+
+    HRESULT hr = m_pAllocator->GetProperties(&props);
+
+    if (FAILED(hr))
+        return hr;
+
+    assert(props.cbAlign >= 1);
+    assert(props.cbPrefix >= 0);
+    assert(props.cbBuffer >= 0);
+
+    const long buflen = props.cbAlign - 1 + props.cbPrefix + props.cbBuffer;
+
+    //On the node of the thread calling GetBuffer, which is the one that
+    //touches the buffer first.
+
+    size_t committed;
+    bool large;
+
+    void* const buf = webmdshow::AllocatePages(
+                        buflen,
+                        webmdshow::GetCurrentNumaNode(),
+                        &committed,
+                        &large);
+
+    if (buf == 0)
+        return E_OUTOFMEMORY;
+
+    m_buf = static_cast<BYTE*>(buf);
+    m_buflen = buflen;
+
+    long off = props.cbPrefix;
+
+    if (intptr_t n = intptr_t(m_buf) % props.cbAlign)
+        off += props.cbAlign - n;
+
+    m_off = off;
+
+    return S_OK;
+}
+
+
 ULONG CMediaSample::GetCount()
 {
     return m_cRef;
@@ -144,6 +222,20 @@ ULONG CMediaSample::GetCount()
 
 HRESULT CMediaSample::Initialize()
 {
+    //The allocator's buffers may have grown since this one was made (see
+    //CMemAllocator::GrowBuffers).
+
+    if (m_buf && (m_buflen - m_off < m_pAllocator->GetBufferSize()))
+        FreeBuffer();
+
+    if (m_buf == 0)
+    {
+        const HRESULT hr = m_pages ? CreatePages() : CreateBuffer();
+
+        if (FAILED(hr))
+            return hr;
+    }
+
     assert(m_buf);
     assert(m_pmt == 0);
 
@@ -177,9 +269,10 @@ HRESULT CMediaSample::Destroy()
 }
 
 
-CMediaSample::CMediaSample(CMemAllocator* p) :
+CMediaSample::CMediaSample(CMemAllocator* p, bool pages) :
     m_pAllocator(p),
     m_cRef(0),  //allocator will adjust
+    m_pages(pages),
     m_buf(0),
     m_buflen(0),
     m_off(0),
@@ -191,7 +284,20 @@ CMediaSample::CMediaSample(CMemAllocator* p) :
 CMediaSample::~CMediaSample()
 {
     Finalize();  //deallocate media type
-    delete[] m_buf;
+    FreeBuffer();
+}
+
+
+void CMediaSample::FreeBuffer()
+{
+    if (m_pages)
+        webmdshow::FreePages(m_buf);
+    else
+        delete[] m_buf;
+
+    m_buf = 0;
+    m_buflen = 0;
+    m_off = 0;
 }
 
 
@@ -270,17 +376,10 @@ long CMediaSample::GetSize()
 {
     assert(m_off <= m_buflen);
 
-    const long size = m_buflen - m_off;
-
-#ifdef _DEBUG
-    ALLOCATOR_PROPERTIES props;
-
-    const HRESULT hr = m_pAllocator->GetProperties(&props);
-    assert(SUCCEEDED(hr));
-    assert(size >= props.cbBuffer);
-#endif
+    //This can be less than the allocator's cbBuffer, if the allocator
+    //grew its buffers after handing out this sample.
 
-    return size;
+    return m_buflen - m_off;
 }
 
 
@@ -18,13 +18,16 @@ class CMediaSample : public IMediaSample,
 
 protected:
 
-    explicit CMediaSample(CMemAllocator*);
+    CMediaSample(CMemAllocator*, bool pages);
     virtual ~CMediaSample();
 
     struct Factory : CMemAllocator::ISampleFactory
     {
+        explicit Factory(bool pages);
         virtual ~Factory();
 
+        const bool m_pages;
+
         HRESULT CreateSample(CMemAllocator*, IMemSample*&);
         HRESULT InitializeSample(IMemSample*);
         HRESULT FinalizeSample(IMemSample*);
@@ -36,6 +39,15 @@ public:
 
     static HRESULT CreateAllocator(IMemAllocator**);
 
+    //As CreateAllocator, but for large frames: each sample's buffer is
+    //committed with VirtualAlloc the first time GetBuffer hands the
+    //sample out, on the NUMA node of the thread calling GetBuffer (the
+    //thread that fills it, and usually the one that then consumes it
+    //downstream).  It comes from large pages if the process has
+    //SeLockMemoryPrivilege, which cuts TLB misses on 4K and 8K frames,
+    //and from ordinary pages if not.
+    static HRESULT CreatePageAllocator(IMemAllocator**);
+
     HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
     ULONG STDMETHODCALLTYPE AddRef();
     ULONG STDMETHODCALLTYPE Release();
@@ -100,7 +112,12 @@ protected:
     CMemAllocator* const m_pAllocator;
     ULONG m_cRef;
 
+    static HRESULT CreateAllocator(IMemAllocator**, bool pages);
+
     HRESULT Create();
+    HRESULT CreateBuffer();
+    HRESULT CreatePages();
+    void FreeBuffer();
 
 private:
 
@@ -113,6 +130,8 @@ private:
     __int64 m_media_stop_time;
     long m_actual_data_length;  //allocated memory holding actual data
 
+    const bool m_pages;  //whether m_buf is from AllocatePages
+
     BYTE* m_buf;
     long m_buflen;  //how much memory was allocated
     long m_off;     //to satisfy alignment requirements
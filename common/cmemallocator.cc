@@ -10,6 +10,7 @@
 #include "cmemallocator.h"
 #include <vfwmsgs.h>
 #include <cassert>
+#include <malloc.h>
 #include <new>
 
 
@@ -39,12 +40,17 @@ HRESULT CMemAllocator::CreateInstance(
 CMemAllocator::CMemAllocator(ISampleFactory* pFactory) :
     m_pSampleFactory(pFactory),
     m_cRef(1),
+    m_bCommitted(0),
     m_cActive(-1),  //means "properties not set"
-    m_bCommitted(false)
+    m_cWaiters(0),
+    m_cContention(0)
 {
     m_hCond = CreateEvent(0, 0, 0, 0);
     assert(m_hCond);  //TODO
 
+    InitializeSListHead(&m_free);
+    InitializeSListHead(&m_nodes);
+
     const HRESULT hr = CLockable::Init();
     hr;
     assert(SUCCEEDED(hr));  //TODO
@@ -54,8 +60,20 @@ CMemAllocator::CMemAllocator(ISampleFactory* pFactory) :
 CMemAllocator::~CMemAllocator()
 {
     assert(m_cActive <= 0);
-    assert(m_samples.empty());
     assert(!m_bCommitted);
+    assert(m_cWaiters == 0);
+
+    //Samples released after the last Decommit are still on the list.
+    DestroySamples();
+
+    SLIST_ENTRY* pEntry = InterlockedFlushSList(&m_nodes);
+
+    while (pEntry)
+    {
+        SLIST_ENTRY* const pNext = pEntry->Next;
+        _aligned_free(pEntry);
+        pEntry = pNext;
+    }
 
     const BOOL b = CloseHandle(m_hCond);
     b;
@@ -111,6 +129,12 @@ ULONG CMemAllocator::GetCount() const
 }
 
 
+LONG CMemAllocator::GetContentionCount() const
+{
+    return m_cContention;
+}
+
+
 HRESULT CMemAllocator::SetProperties(
     ALLOCATOR_PROPERTIES* pPreferred,
     ALLOCATOR_PROPERTIES* pActual)
@@ -155,7 +179,9 @@ HRESULT CMemAllocator::SetProperties(
     if (pActual)
         *pActual = m_props;
 
-    m_cActive = 0;  //means "properties have been set"
+    //Means "properties have been set".  Only from -1: once set, the
+    //count may include a GetBuffer making its way out after a Decommit.
+    InterlockedCompareExchange(&m_cActive, 0, -1);
 
     return S_OK;
 }
@@ -181,6 +207,33 @@ HRESULT CMemAllocator::GetProperties(ALLOCATOR_PROPERTIES* p)
 }
 
 
+HRESULT CMemAllocator::GrowBuffers(long cbBuffer)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_cActive < 0)
+        return VFW_E_SIZENOTSET;
+
+    if (cbBuffer <= m_props.cbBuffer)
+        return S_FALSE;
+
+    InterlockedExchange(&m_props.cbBuffer, cbBuffer);
+
+    return S_OK;
+}
+
+
+long CMemAllocator::GetBufferSize() const
+{
+    return m_props.cbBuffer;
+}
+
+
 HRESULT CMemAllocator::Commit()
 {
     Lock lock;
@@ -199,7 +252,12 @@ HRESULT CMemAllocator::Commit()
     if (m_cActive < 0)
         return VFW_E_SIZENOTSET;
 
-    assert(m_samples.empty());
+    //So that the pool holds exactly cBuffers samples.  With none
+    //outstanding, nothing else can be pushing to the list: a sample
+    //counts as active (see ReserveSample) before it is taken off the
+    //list, and stops counting only once it is back on it, and no
+    //GetBuffer can take one until m_bCommitted is set below.
+    DestroySamples();
 
     for (long i = 0; i < m_props.cBuffers; ++i)
     {
@@ -209,7 +267,7 @@ HRESULT CMemAllocator::Commit()
             return hr;
     }
 
-    m_bCommitted = true;
+    InterlockedExchange(&m_bCommitted, 1);
 
     return S_OK;
 }
@@ -238,22 +296,14 @@ HRESULT CMemAllocator::Decommit()
     if (FAILED(hr))
         return hr;
 
-    m_bCommitted = false;
+    InterlockedExchange(&m_bCommitted, 0);
 
-    while (!m_samples.empty())
-    {
-        IMemSample* const sample = m_samples.front();
-        assert(sample);
-
-        m_samples.pop_front();
+    //A sample released while this runs might still reach the list,
+    //after it has been emptied here; the next Commit, or the dtor,
+    //destroys it.
+    DestroySamples();
 
-        hr = m_pSampleFactory->DestroySample(sample);
-        assert(SUCCEEDED(hr));
-    }
-
-    const BOOL b = SetEvent(m_hCond);
-    b;
-    assert(b);
+    Wake();
 
     return S_OK;
 }
@@ -268,57 +318,83 @@ HRESULT CMemAllocator::GetBuffer(
     if (pp == 0)
         return E_POINTER;
 
-    Lock lock;
+    if (!m_bCommitted)
+        return VFW_E_NOT_COMMITTED;
 
-    if (flags & AM_GBF_NOWAIT)
+    IMemSample* pSample = ReserveSample();
+
+    if (pSample == 0)  //no samples available
     {
-        const HRESULT hr = lock.Seize(this);
+        InterlockedIncrement(&m_cContention);
 
-        if (FAILED(hr))
-            return hr;
+        if (flags & AM_GBF_NOWAIT)
+            return VFW_E_TIMEOUT;
 
-        if (!m_bCommitted)
-            return VFW_E_NOT_COMMITTED;
+        //Once this thread counts as a waiter, every ReleaseBuffer
+        //and Decommit sets the event, so checking again before each
+        //wait cannot miss a sample.
 
-        assert(m_cActive >= 0);
+        InterlockedIncrement(&m_cWaiters);
 
-        if (m_cActive >= m_props.cBuffers)  //no samples available
-            return VFW_E_TIMEOUT;
-    }
-    else
-    {
         for (;;)
         {
-            HRESULT hr = lock.Seize(this);
-
-            if (FAILED(hr))
-                return hr;
-
             if (!m_bCommitted)
-                return VFW_E_NOT_COMMITTED;
+                break;
 
-            assert(m_cActive >= 0);
+            pSample = ReserveSample();
 
-            if (m_cActive < m_props.cBuffers)
+            if (pSample)
                 break;
 
-            lock.Release();
-
             DWORD index;
-            hr = CoWaitForMultipleHandles(
-                    0, //wait all
-                    INFINITE,
-                    1,
-                    &m_hCond,
-                    &index);
-
+            const HRESULT hr = CoWaitForMultipleHandles(
+                                0, //wait all
+                                INFINITE,
+                                1,
+                                &m_hCond,
+                                &index);
+            hr;
             assert(hr == S_OK);
             assert(index == 0);
         }
+
+        //The event is auto-reset, so one wakeup can stand for several
+        //released samples (or for a Decommit); pass it on to the next
+        //waiter, which checks for itself.
+
+        if (InterlockedDecrement(&m_cWaiters) > 0)
+        {
+            const BOOL b = SetEvent(m_hCond);
+            b;
+            assert(b);
+        }
+
+        if (pSample == 0)
+            return VFW_E_NOT_COMMITTED;
+    }
+
+    //A factory may put off getting a sample's buffer until now, when
+    //it knows which thread wants it, so this can fail.
+
+    const HRESULT hr = m_pSampleFactory->InitializeSample(pSample);
+
+    if (FAILED(hr))
+    {
+        if (!PushSample(pSample))
+            m_pSampleFactory->DestroySample(pSample);
+
+        //As in ReleaseBuffer, only after the push.
+
+        const LONG n = InterlockedDecrement(&m_cActive);
+        n;
+        assert(n >= 0);
+
+        Wake();
+        return hr;
     }
 
     IMediaSample*& p = *pp;
-    p = GetSample();
+    p = GetSample(pSample);
 
     AddRef();  //the contribution of this (active) sample
 
@@ -335,49 +411,32 @@ HRESULT CMemAllocator::ReleaseBuffer(IMediaSample* p)
     //assert(p->m_cRef == 0);
     //assert(p->m_pAllocator == this);
 
-    Lock lock;
-
-    HRESULT hr = lock.Seize(this);
-
-    if (FAILED(hr))
-        return hr;
-
-    assert(m_cActive > 0);
-    --m_cActive;
-
     IMemSample* pSample;
 
-    hr = p->QueryInterface(&pSample);
+    HRESULT hr = p->QueryInterface(&pSample);
     assert(SUCCEEDED(hr));
     assert(pSample);
 
     hr = m_pSampleFactory->FinalizeSample(pSample);
     assert(SUCCEEDED(hr));
 
-    if (m_bCommitted)
-        m_samples.push_back(pSample);
-    else
+    if (!m_bCommitted || !PushSample(pSample))
     {
         hr = m_pSampleFactory->DestroySample(pSample);
         assert(SUCCEEDED(hr));
     }
 
-    const BOOL b = SetEvent(m_hCond);
-    b;
-    assert(b);
+    //Only after the push, so that once Commit sees no outstanding
+    //buffers, no sample is still on its way to the list.
 
-    //Release lock now, in case this sample is holding
-    //the last reference to this allocator.
-    lock.Release();
+    const LONG n = InterlockedDecrement(&m_cActive);
+    n;
+    assert(n >= 0);
 
-    //Now it's safe to release the allocator, after
-    //releasing the lock; if this causes the allocator
-    //to be destroyed, then the lock won't attempt to
-    //manipulate the allocator during its own destruction
-    //(another thing to try would be to add a ref to the
-    //allocator in the lock's ctor, and then release the
-    //ref in its dtor.  This would prevent the destruction
-    //of the allocator until the lock itself is destroyed).
+    Wake();
+
+    //This sample might hold the last reference to the
+    //allocator, so this must be the last thing done.
 
     Release();  //the contribution of this sample
 
@@ -397,32 +456,118 @@ HRESULT CMemAllocator::CreateSample()
     assert(pSample);
     assert(pSample->GetCount() == 0);
 
-    m_samples.push_back(pSample);
+    if (!PushSample(pSample))
+    {
+        m_pSampleFactory->DestroySample(pSample);
+        return E_OUTOFMEMORY;
+    }
 
     return S_OK;
 }
 
 
-IMediaSample* CMemAllocator::GetSample()
+bool CMemAllocator::PushSample(IMemSample* pSample)
 {
-    assert(m_cActive >= 0);
-    assert(m_cActive < m_props.cBuffers);
-    assert(!m_samples.empty());
+    assert(pSample);
+
+    SLIST_ENTRY* const pEntry = InterlockedPopEntrySList(&m_nodes);
+    SampleNode* pNode = reinterpret_cast<SampleNode*>(pEntry);
+
+    if (pNode == 0)  //all in use, or in transit in PopSample
+    {
+        void* const pv = _aligned_malloc(
+                            sizeof(SampleNode),
+                            MEMORY_ALLOCATION_ALIGNMENT);
+
+        if (pv == 0)
+            return false;
 
-    IMemSample* const p = m_samples.front();
+        pNode = static_cast<SampleNode*>(pv);
+    }
+
+    pNode->m_pSample = pSample;
+    InterlockedPushEntrySList(&m_free, &pNode->m_entry);
+
+    return true;
+}
+
+
+IMemSample* CMemAllocator::ReserveSample()
+{
+    //The sample counts as active before it leaves the list, so that a
+    //Commit never finds the allocator idle while a sample is in transit,
+    //and refills the pool with it still to come back.
+
+    InterlockedIncrement(&m_cActive);
+
+    //Checked again now that this counts as active: a Commit proceeds
+    //only with none active, and doesn't set m_bCommitted until it has
+    //refilled the pool.
+
+    if (m_bCommitted)
+    {
+        if (IMemSample* const p = PopSample())
+            return p;
+    }
+
+    const LONG n = InterlockedDecrement(&m_cActive);
+    n;
+    assert(n >= 0);
+
+    return 0;
+}
+
+
+IMemSample* CMemAllocator::PopSample()
+{
+    SLIST_ENTRY* const pEntry = InterlockedPopEntrySList(&m_free);
+
+    if (pEntry == 0)
+        return 0;
+
+    SampleNode* const pNode = reinterpret_cast<SampleNode*>(pEntry);
+
+    IMemSample* const p = pNode->m_pSample;
     assert(p);
 
-    m_samples.pop_front();
+    InterlockedPushEntrySList(&m_nodes, &pNode->m_entry);
 
-    HRESULT hr = m_pSampleFactory->InitializeSample(p);
-    assert(SUCCEEDED(hr));
-    assert(p->GetCount() == 0);
+    return p;
+}
+
+
+void CMemAllocator::DestroySamples()
+{
+    while (IMemSample* const p = PopSample())
+    {
+        const HRESULT hr = m_pSampleFactory->DestroySample(p);
+        hr;
+        assert(SUCCEEDED(hr));
+    }
+}
 
-    ++m_cActive;
+
+void CMemAllocator::Wake()
+{
+    if (m_cWaiters <= 0)
+        return;
+
+    const BOOL b = SetEvent(m_hCond);
+    b;
+    assert(b);
+}
+
+
+IMediaSample* CMemAllocator::GetSample(IMemSample* p)
+{
+    assert(p);
+    assert(p->GetCount() == 0);
+    assert(m_cActive > 0);  //counted by ReserveSample
 
     IMediaSample* pSample;
 
-    hr = p->QueryInterface(&pSample);
+    const HRESULT hr = p->QueryInterface(&pSample);
+    hr;
     assert(SUCCEEDED(hr));
     assert(pSample);
     assert(p->GetCount() == 1);
@@ -10,7 +10,6 @@
 #include <strmif.h>
 #include "clockable.h"
 #include "imemsample.h"
-#include <list>
 
 class CMemAllocator : public IMemAllocator,
                       public CLockable
@@ -42,6 +41,20 @@ public:
 
     ULONG GetCount() const;
 
+    //The number of GetBuffer calls that found no free sample, and so
+    //either waited for one or (given AM_GBF_NOWAIT) timed out.
+    LONG GetContentionCount() const;
+
+    //Raises cbBuffer, even while committed, for a stream whose frames
+    //got bigger.  No sample is reallocated now: each one, in the pool or
+    //outstanding, gets a bigger buffer the next time GetBuffer hands it
+    //out, so samples handed out earlier may still be smaller.
+    HRESULT GrowBuffers(long cbBuffer);
+
+    //The cbBuffer of the properties, read without the lock, for a
+    //sample to check its buffer against during GetBuffer.
+    long GetBufferSize() const;
+
     //IUnknown
 
     HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
@@ -71,16 +84,35 @@ public:
 
 private:
 
+    //The free samples are kept on an interlocked (lock-free) singly
+    //linked list, so that GetBuffer and ReleaseBuffer never take the
+    //allocator's mutex.  The nodes are never freed until the allocator
+    //is, which is what makes popping them safe; a node no longer on
+    //m_free is kept on m_nodes for reuse.
+
+    struct SampleNode
+    {
+        SLIST_ENTRY m_entry;  //must be first
+        IMemSample* m_pSample;
+    };
+
     ULONG m_cRef;
-    HANDLE m_hCond;
+    HANDLE m_hCond;  //set only when m_cWaiters is non-zero
     ALLOCATOR_PROPERTIES m_props;
-    bool m_bCommitted;
-    long m_cActive;
+    volatile LONG m_bCommitted;
+    volatile LONG m_cActive;
+    volatile LONG m_cWaiters;
+    volatile LONG m_cContention;
 
-    typedef std::list<IMemSample*> samples_t;
-    samples_t m_samples;
+    SLIST_HEADER m_free;
+    SLIST_HEADER m_nodes;
 
     HRESULT CreateSample();
-    IMediaSample* GetSample();
+    bool PushSample(IMemSample*);
+    IMemSample* ReserveSample();  //pops a sample, counted as active
+    IMemSample* PopSample();
+    void DestroySamples();
+    IMediaSample* GetSample(IMemSample*);
+    void Wake();
 
 };
@@ -0,0 +1,603 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "colorconverter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#include "cpuutil.h"
+#include "libyuv.h"
+#include "taskpool.h"
+
+namespace webmdshow {
+
+// The planes of one frame. For NV12, |u| is the interleaved chroma plane;
+// for the packed and RGB formats only |y| is used.
+struct ColorPlanes {
+  uint8_t* y;
+  int stride_y;
+  uint8_t* u;
+  int stride_u;
+  uint8_t* v;
+  int stride_v;
+};
+
+namespace {
+
+bool IsPlanar(ColorFormat format) {
+  return format == kColorFormatI420 || format == kColorFormatYV12;
+}
+
+bool IsRgb(ColorFormat format) {
+  return format == kColorFormatRGB24 || format == kColorFormatRGB32;
+}
+
+void GetPlanes(ColorFormat format, int stride, int height,
+               const uint8_t* buf, ColorPlanes* planes) {
+  uint8_t* const data = const_cast<uint8_t*>(buf);
+
+  planes->y = data;
+  planes->stride_y = stride;
+  planes->u = NULL;
+  planes->stride_u = 0;
+  planes->v = NULL;
+  planes->stride_v = 0;
+
+  if (IsPlanar(format)) {
+    const int chroma_stride = (stride + 1) / 2;
+    uint8_t* const first = data + stride * height;
+    uint8_t* const second = first + chroma_stride * ((height + 1) / 2);
+
+    planes->u = (format == kColorFormatI420) ? first : second;
+    planes->stride_u = chroma_stride;
+    planes->v = (format == kColorFormatI420) ? second : first;
+    planes->stride_v = chroma_stride;
+  } else if (format == kColorFormatNV12) {
+    planes->u = data + stride * height;
+    planes->stride_u = stride;
+  } else if (stride < 0) {
+    // A bottom-up DIB: start at the last row in memory, which is the top
+    // row of the image.
+    planes->y = data - stride * (height - 1);
+  }
+}
+
+// Moves |planes| down to |first_row|, which is even.
+void OffsetPlanes(int first_row, ColorPlanes* planes) {
+  planes->y += first_row * planes->stride_y;
+
+  if (planes->u != NULL)
+    planes->u += (first_row / 2) * planes->stride_u;
+
+  if (planes->v != NULL)
+    planes->v += (first_row / 2) * planes->stride_v;
+}
+
+// To I420 (or YV12, whose planes GetPlanes has already swapped).
+
+int ConvertI420ToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::I420Copy(src.y, src.stride_y, src.u, src.stride_u,
+                          src.v, src.stride_v,
+                          dst.y, dst.stride_y, dst.u, dst.stride_u,
+                          dst.v, dst.stride_v, width, height);
+}
+
+int ConvertNV12ToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::NV12ToI420(src.y, src.stride_y, src.u, src.stride_u,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            dst.v, dst.stride_v, width, height);
+}
+
+int ConvertYUY2ToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::YUY2ToI420(src.y, src.stride_y,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            dst.v, dst.stride_v, width, height);
+}
+
+int ConvertUYVYToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::UYVYToI420(src.y, src.stride_y,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            dst.v, dst.stride_v, width, height);
+}
+
+int ConvertRGB24ToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::RGB24ToI420(src.y, src.stride_y,
+                             dst.y, dst.stride_y, dst.u, dst.stride_u,
+                             dst.v, dst.stride_v, width, height);
+}
+
+int ConvertRGB32ToI420(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::ARGBToI420(src.y, src.stride_y,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            dst.v, dst.stride_v, width, height);
+}
+
+// From I420.
+
+int ConvertI420ToNV12(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::I420ToNV12(src.y, src.stride_y, src.u, src.stride_u,
+                            src.v, src.stride_v,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            width, height);
+}
+
+int ConvertI420ToYUY2(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::I420ToYUY2(src.y, src.stride_y, src.u, src.stride_u,
+                            src.v, src.stride_v, dst.y, dst.stride_y,
+                            width, height);
+}
+
+int ConvertI420ToUYVY(const ColorPlanes& src, const ColorPlanes& dst,
+                      int width, int height) {
+  return libyuv::I420ToUYVY(src.y, src.stride_y, src.u, src.stride_u,
+                            src.v, src.stride_v, dst.y, dst.stride_y,
+                            width, height);
+}
+
+// Pairs libyuv converts in one pass. Its YUV to RGB32 functions are BT.601
+// limited range only.
+
+int ConvertNV12ToRGB32(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::NV12ToARGB(src.y, src.stride_y, src.u, src.stride_u,
+                            dst.y, dst.stride_y, width, height);
+}
+
+int ConvertYUY2ToRGB32(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::YUY2ToARGB(src.y, src.stride_y, dst.y, dst.stride_y,
+                            width, height);
+}
+
+int ConvertUYVYToRGB32(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::UYVYToARGB(src.y, src.stride_y, dst.y, dst.stride_y,
+                            width, height);
+}
+
+int ConvertRGB24ToRGB32(const ColorPlanes& src, const ColorPlanes& dst,
+                        int width, int height) {
+  return libyuv::RGB24ToARGB(src.y, src.stride_y, dst.y, dst.stride_y,
+                             width, height);
+}
+
+int ConvertRGB32ToRGB24(const ColorPlanes& src, const ColorPlanes& dst,
+                        int width, int height) {
+  return libyuv::ARGBToRGB24(src.y, src.stride_y, dst.y, dst.stride_y,
+                             width, height);
+}
+
+int ConvertRGB32ToNV12(const ColorPlanes& src, const ColorPlanes& dst,
+                       int width, int height) {
+  return libyuv::ARGBToNV12(src.y, src.stride_y,
+                            dst.y, dst.stride_y, dst.u, dst.stride_u,
+                            width, height);
+}
+
+// Copies, for the non-planar formats.
+
+int CopyNV12(const ColorPlanes& src, const ColorPlanes& dst,
+             int width, int height) {
+  libyuv::CopyPlane(src.y, src.stride_y, dst.y, dst.stride_y, width, height);
+  libyuv::CopyPlane(src.u, src.stride_u, dst.u, dst.stride_u,
+                    2 * ((width + 1) / 2), (height + 1) / 2);
+  return 0;
+}
+
+int CopyPacked(const ColorPlanes& src, const ColorPlanes& dst,
+               int width, int height) {
+  libyuv::CopyPlane(src.y, src.stride_y, dst.y, dst.stride_y,
+                    4 * ((width + 1) / 2), height);
+  return 0;
+}
+
+int CopyRGB24(const ColorPlanes& src, const ColorPlanes& dst,
+              int width, int height) {
+  libyuv::CopyPlane(src.y, src.stride_y, dst.y, dst.stride_y,
+                    3 * width, height);
+  return 0;
+}
+
+int CopyRGB32(const ColorPlanes& src, const ColorPlanes& dst,
+              int width, int height) {
+  libyuv::CopyPlane(src.y, src.stride_y, dst.y, dst.stride_y,
+                    4 * width, height);
+  return 0;
+}
+
+typedef int (*ConvertFunc)(const ColorPlanes& src, const ColorPlanes& dst,
+                           int width, int height);
+
+ConvertFunc GetToI420(ColorFormat format) {
+  switch (format) {
+    case kColorFormatI420:
+    case kColorFormatYV12:
+      return &ConvertI420ToI420;
+    case kColorFormatNV12:
+      return &ConvertNV12ToI420;
+    case kColorFormatYUY2:
+      return &ConvertYUY2ToI420;
+    case kColorFormatUYVY:
+      return &ConvertUYVYToI420;
+    case kColorFormatRGB24:
+      return &ConvertRGB24ToI420;
+    case kColorFormatRGB32:
+      return &ConvertRGB32ToI420;
+  }
+
+  return NULL;
+}
+
+ConvertFunc GetFromI420(ColorFormat format) {
+  switch (format) {
+    case kColorFormatI420:
+    case kColorFormatYV12:
+      return &ConvertI420ToI420;
+    case kColorFormatNV12:
+      return &ConvertI420ToNV12;
+    case kColorFormatYUY2:
+      return &ConvertI420ToYUY2;
+    case kColorFormatUYVY:
+      return &ConvertI420ToUYVY;
+    case kColorFormatRGB24:
+    case kColorFormatRGB32:
+      break;  // done by I420ToRgb32 and I420ToRgb24
+  }
+
+  return NULL;
+}
+
+// Returns the function that converts |src| to |dst| in one pass, or NULL
+// if the conversion must go through I420.
+ConvertFunc GetDirect(ColorFormat src, ColorFormat dst) {
+  if (IsPlanar(dst))
+    return GetToI420(src);
+
+  if (IsPlanar(src))
+    return GetFromI420(dst);
+
+  if (src == dst) {
+    switch (src) {
+      case kColorFormatNV12:
+        return &CopyNV12;
+      case kColorFormatRGB24:
+        return &CopyRGB24;
+      case kColorFormatRGB32:
+        return &CopyRGB32;
+      default:
+        return &CopyPacked;
+    }
+  }
+
+  if (dst == kColorFormatRGB32) {
+    switch (src) {
+      case kColorFormatNV12:
+        return &ConvertNV12ToRGB32;
+      case kColorFormatYUY2:
+        return &ConvertYUY2ToRGB32;
+      case kColorFormatUYVY:
+        return &ConvertUYVYToRGB32;
+      case kColorFormatRGB24:
+        return &ConvertRGB24ToRGB32;
+      default:
+        return NULL;
+    }
+  }
+
+  if (src == kColorFormatRGB32) {
+    if (dst == kColorFormatRGB24)
+      return &ConvertRGB32ToRGB24;
+
+    if (dst == kColorFormatNV12)
+      return &ConvertRGB32ToNV12;
+  }
+
+  return NULL;
+}
+
+}  // namespace
+
+ColorConverter::ColorConverter()
+    : src_format_(kColorFormatI420),
+      src_stride_(0),
+      dst_format_(kColorFormatI420),
+      dst_stride_(0),
+      width_(0),
+      height_(0),
+      convert_(NULL),
+      from_i420_(NULL),
+      yuv_to_rgb_(NULL),
+      yuv_matrix_(kYuvMatrixBT601),
+      yuv_range_(kYuvRangeLimited),
+      requested_bands_(0),
+      bands_(1),
+      band_rows_(0),
+      band_src_(NULL),
+      band_dst_(NULL),
+      next_band_(0),
+      failed_bands_(0),
+      frames_(0),
+      last_us_(0),
+      total_us_(0),
+      max_us_(0) {
+}
+
+ColorConverter::~ColorConverter() {
+}
+
+bool ColorConverter::Init(ColorFormat src_format, int src_stride,
+                          ColorFormat dst_format, int dst_stride,
+                          int width, int height) {
+  convert_ = NULL;
+  from_i420_ = NULL;
+  yuv_to_rgb_ = NULL;
+
+  if (width <= 0 || height <= 0)
+    return false;
+
+  if ((src_stride < 0 && !IsRgb(src_format)) ||
+      (dst_stride < 0 && !IsRgb(dst_format)) ||
+      abs(src_stride) < GetStride(src_format, width) ||
+      abs(dst_stride) < GetStride(dst_format, width)) {
+    return false;
+  }
+
+  src_format_ = src_format;
+  src_stride_ = src_stride;
+  dst_format_ = dst_format;
+  dst_stride_ = dst_stride;
+  width_ = width;
+  height_ = height;
+
+  const bool yuv_to_rgb = !IsRgb(src_format) && IsRgb(dst_format);
+
+  if (!yuv_to_rgb ||
+      (yuv_matrix_ == kYuvMatrixBT601 && yuv_range_ == kYuvRangeLimited)) {
+    convert_ = GetDirect(src_format, dst_format);
+  }
+
+  if (convert_ == NULL && yuv_to_rgb) {
+    yuv_to_rgb_ = &GetYuvToRgbConstants(yuv_matrix_, yuv_range_);
+
+    if (!IsPlanar(src_format))
+      convert_ = GetToI420(src_format);
+  } else if (convert_ == NULL) {
+    convert_ = GetToI420(src_format);
+    from_i420_ = GetFromI420(dst_format);
+  }
+
+  if (from_i420_ != NULL || (yuv_to_rgb_ != NULL && convert_ != NULL)) {
+    const int stride = GetStride(kColorFormatI420, width);
+    i420_.resize(GetFrameSize(kColorFormatI420, stride, height));
+  } else {
+    i420_.clear();
+  }
+
+  int bands = requested_bands_;
+
+  if (bands <= 0)
+    bands = GetBandCount(width, height, GetLogicalProcessorCount());
+
+  // Round the band height up to an even number of rows, then drop any
+  // bands left with no rows.
+  band_rows_ = ((height + bands - 1) / bands + 1) & ~1;
+  bands_ = (height + band_rows_ - 1) / band_rows_;
+
+  if (bands_ <= 1)
+    band_rows_ = height;
+
+  frames_ = 0;
+  last_us_ = 0;
+  total_us_ = 0;
+  max_us_ = 0;
+
+  return true;
+}
+
+bool ColorConverter::Convert(const uint8_t* src, uint8_t* dst) {
+  if ((convert_ == NULL && yuv_to_rgb_ == NULL) || src == NULL ||
+      dst == NULL) {
+    assert((convert_ || yuv_to_rgb_) && src && dst);
+    return false;
+  }
+
+  LARGE_INTEGER start;
+  QueryPerformanceCounter(&start);
+
+  bool result;
+
+  if (bands_ <= 1) {
+    result = ConvertRows(src, dst, 0, height_);
+  } else {
+    band_src_ = src;
+    band_dst_ = dst;
+    next_band_ = 0;
+    failed_bands_ = 0;
+
+    // This thread converts bands too, so one fewer task is needed.
+    TaskGroup group(TaskPool::GetShared());
+
+    for (int i = 1; i < bands_; ++i)
+      group.Run([this]() { ConvertBands(); });
+
+    ConvertBands();
+    group.Wait();
+
+    result = (failed_bands_ == 0);
+  }
+
+  LARGE_INTEGER stop, freq;
+  QueryPerformanceCounter(&stop);
+  QueryPerformanceFrequency(&freq);
+
+  const int64_t us = (stop.QuadPart - start.QuadPart) * 1000000 /
+                     freq.QuadPart;
+
+  ++frames_;
+  last_us_ = us;
+  total_us_ += us;
+
+  if (us > max_us_)
+    max_us_ = us;
+
+  return result;
+}
+
+void ColorConverter::GetStats(Stats* stats) const {
+  stats->frames = frames_;
+  stats->last_us = last_us_;
+  stats->total_us = total_us_;
+  stats->max_us = max_us_;
+}
+
+bool ColorConverter::ConvertRows(const uint8_t* src, uint8_t* dst,
+                                 int first_row, int rows) {
+  assert(first_row % 2 == 0);
+
+  ColorPlanes src_planes;
+  GetPlanes(src_format_, src_stride_, height_, src, &src_planes);
+  OffsetPlanes(first_row, &src_planes);
+
+  ColorPlanes dst_planes;
+  GetPlanes(dst_format_, dst_stride_, height_, dst, &dst_planes);
+  OffsetPlanes(first_row, &dst_planes);
+
+  if (yuv_to_rgb_ != NULL)
+    return ConvertRowsToRgb(src_planes, dst_planes, first_row, rows);
+
+  if (from_i420_ == NULL) {
+    const int status = convert_(src_planes, dst_planes, width_, rows);
+    if (status != 0) {
+      assert(status == 0 && "libyuv conversion failed.");
+      return false;
+    }
+
+    return true;
+  }
+
+  // Each band uses its own rows of |i420_|.
+  ColorPlanes i420_planes;
+  GetPlanes(kColorFormatI420, GetStride(kColorFormatI420, width_), height_,
+            &i420_[0], &i420_planes);
+  OffsetPlanes(first_row, &i420_planes);
+
+  int status = convert_(src_planes, i420_planes, width_, rows);
+  if (status != 0) {
+    assert(status == 0 && "libyuv conversion to I420 failed.");
+    return false;
+  }
+
+  status = from_i420_(i420_planes, dst_planes, width_, rows);
+  if (status != 0) {
+    assert(status == 0 && "libyuv conversion from I420 failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool ColorConverter::ConvertRowsToRgb(const ColorPlanes& src,
+                                      const ColorPlanes& dst, int first_row,
+                                      int rows) {
+  ColorPlanes yuv = src;
+
+  if (convert_ != NULL) {
+    GetPlanes(kColorFormatI420, GetStride(kColorFormatI420, width_), height_,
+              &i420_[0], &yuv);
+    OffsetPlanes(first_row, &yuv);
+
+    const int status = convert_(src, yuv, width_, rows);
+    if (status != 0) {
+      assert(status == 0 && "libyuv conversion to I420 failed.");
+      return false;
+    }
+  }
+
+  if (dst_format_ == kColorFormatRGB32) {
+    I420ToRgb32(yuv.y, yuv.stride_y, yuv.u, yuv.stride_u, yuv.v,
+                yuv.stride_v, *yuv_to_rgb_, dst.y, dst.stride_y,
+                width_, rows);
+  } else {
+    I420ToRgb24(yuv.y, yuv.stride_y, yuv.u, yuv.stride_u, yuv.v,
+                yuv.stride_v, *yuv_to_rgb_, dst.y, dst.stride_y,
+                width_, rows);
+  }
+
+  return true;
+}
+
+void ColorConverter::ConvertBands() {
+  for (;;) {
+    const int band = next_band_++;
+
+    if (band >= bands_)
+      return;
+
+    const int first_row = band * band_rows_;
+    const int rows = std::min(band_rows_, height_ - first_row);
+
+    if (!ConvertRows(band_src_, band_dst_, first_row, rows))
+      ++failed_bands_;
+  }
+}
+
+int ColorConverter::GetStride(ColorFormat format, int width) {
+  switch (format) {
+    case kColorFormatYUY2:
+    case kColorFormatUYVY:
+      return 4 * ((width + 1) / 2);
+    case kColorFormatRGB24:
+      return (3 * width + 3) & ~3;
+    case kColorFormatRGB32:
+      return 4 * width;
+    default:
+      return (width + 1) & ~1;
+  }
+}
+
+int ColorConverter::GetFrameSize(ColorFormat format, int stride,
+                                 int height) {
+  const int size = abs(stride) * height;
+
+  if (IsPlanar(format))
+    return size + 2 * ((abs(stride) + 1) / 2) * ((height + 1) / 2);
+
+  if (format == kColorFormatNV12)
+    return size + abs(stride) * ((height + 1) / 2);
+
+  return size;
+}
+
+int ColorConverter::GetBandCount(int width, int height, int processors) {
+  const int64_t kMinBandPixels = 1 << 19;
+  const int kMaxBands = 16;
+
+  if (processors <= 1 || width <= 0 || height <= 0)
+    return 1;
+
+  const int64_t pixels = static_cast<int64_t>(width) * height;
+  int bands = static_cast<int>(std::min<int64_t>(pixels / kMinBandPixels,
+                                                 kMaxBands));
+
+  bands = std::min(bands, processors);
+  bands = std::min(bands, height / 2);
+
+  return std::max(bands, 1);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,165 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_COLORCONVERTER_H_
+#define WEBMDSHOW_COMMON_COLORCONVERTER_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include <atomic>
+#include <vector>
+
+#include "yuvtorgb.h"
+
+namespace webmdshow {
+
+// The uncompressed video formats the converter handles, laid out in a
+// buffer as DirectShow lays them out. The planar and packed YUV formats
+// are stored top-down; RGB may be stored either way.
+enum ColorFormat {
+  kColorFormatI420,   // Y plane, then U, then V
+  kColorFormatYV12,   // Y plane, then V, then U
+  kColorFormatNV12,   // Y plane, then interleaved U and V
+  kColorFormatYUY2,   // Y0 U Y1 V
+  kColorFormatUYVY,   // U Y0 V Y1
+  kColorFormatRGB24,  // B G R
+  kColorFormatRGB32,  // B G R X
+};
+
+struct ColorPlanes;
+
+// Converts frames of one size between any two ColorFormats, using the
+// libyuv row functions (SSE2, SSSE3 or AVX2) libyuv selects for the CPU at
+// run time. Pairs libyuv has no single function for are converted through
+// an I420 frame held by the converter. YUV is converted to RGB by
+// I420ToRgb32/I420ToRgb24, with a selectable matrix and range. Odd widths
+// and heights are allowed: chroma planes are rounded up to cover the last
+// column and row.
+//
+// Large frames can be split into horizontal bands, converted in parallel
+// on the process's shared TaskPool. Convert returns once every band is
+// done, so callers see no difference but the time taken.
+class ColorConverter {
+ public:
+  struct Stats {
+    int64_t frames;    // frames converted since Init
+    int64_t last_us;   // time to convert the last frame, in microseconds
+    int64_t total_us;
+    int64_t max_us;
+  };
+
+  ColorConverter();
+  ~ColorConverter();
+
+  // Sets the number of bands Init splits frames into. Zero, the default,
+  // picks a count with GetBandCount; one converts on the calling thread.
+  void set_band_count(int band_count) { requested_bands_ = band_count; }
+
+  // Returns the number of bands Init chose.
+  int band_count() const { return bands_; }
+
+  // Sets the matrix and range Init uses for YUV to RGB. The default,
+  // BT.601 limited range, is also what RGB to YUV always uses, because
+  // that is what libyuv implements.
+  void set_yuv_matrix(YuvMatrix matrix, YuvRange range) {
+    yuv_matrix_ = matrix;
+    yuv_range_ = range;
+  }
+
+  YuvMatrix yuv_matrix() const { return yuv_matrix_; }
+  YuvRange yuv_range() const { return yuv_range_; }
+
+  // Prepares the conversion of |width|x|height| frames from |src_format|
+  // to |dst_format|. The strides are those of the first plane, in bytes;
+  // for RGB, a negative stride means the rows are stored bottom-up, as in
+  // a DIB. Returns false if the size or either stride is invalid.
+  bool Init(ColorFormat src_format, int src_stride,
+            ColorFormat dst_format, int dst_stride,
+            int width, int height);
+
+  // Converts the frame at |src| to |dst|. Init must have succeeded.
+  // Returns true upon success.
+  bool Convert(const uint8_t* src, uint8_t* dst);
+
+  // Returns the timings of the frames converted since Init. May be called
+  // from any thread.
+  void GetStats(Stats* stats) const;
+
+  // Returns the smallest stride of the first plane of a |width| pixel
+  // |format| frame, as DirectShow computes it: RGB rows are rounded up
+  // to a DWORD, and planar rows to an even number of bytes.
+  static int GetStride(ColorFormat format, int width);
+
+  // Returns the size of a |format| frame of |height| rows whose first
+  // plane has |stride| (whose sign is ignored).
+  static int GetFrameSize(ColorFormat format, int stride, int height);
+
+  // Returns the number of bands to split a |width|x|height| frame into on
+  // a machine with |processors| logical processors: none smaller than
+  // about half a million pixels, which take less time to convert than to
+  // hand to another thread, and none more than processors.
+  static int GetBandCount(int width, int height, int processors);
+
+ private:
+  typedef int (*ConvertFunc)(const ColorPlanes& src, const ColorPlanes& dst,
+                             int width, int height);
+
+  // Converts rows [|first_row|, |first_row| + |rows|); |first_row| is
+  // even, so that bands start on a chroma row.
+  bool ConvertRows(const uint8_t* src, uint8_t* dst, int first_row,
+                   int rows);
+
+  // ConvertRows for YUV to RGB: the planes are those of |first_row|.
+  bool ConvertRowsToRgb(const ColorPlanes& src, const ColorPlanes& dst,
+                        int first_row, int rows);
+
+  // Converts bands of the current frame until none are left. Runs on the
+  // thread calling Convert and on the pool.
+  void ConvertBands();
+
+  ColorFormat src_format_;
+  int src_stride_;
+  ColorFormat dst_format_;
+  int dst_stride_;
+  int width_;
+  int height_;
+
+  // Converts from the source format, either to the destination format or,
+  // if |from_i420_| or |yuv_to_rgb_| is set, to |i420_|. For YUV to RGB,
+  // |convert_| is NULL if the source is already planar.
+  ConvertFunc convert_;
+  ConvertFunc from_i420_;
+  const YuvToRgbConstants* yuv_to_rgb_;
+  std::vector<uint8_t> i420_;
+
+  YuvMatrix yuv_matrix_;
+  YuvRange yuv_range_;
+
+  int requested_bands_;
+  int bands_;
+  int band_rows_;  // rows in each band but the last; even
+
+  // The frame the bands are taken from.
+  const uint8_t* band_src_;
+  uint8_t* band_dst_;
+  std::atomic<int> next_band_;
+  std::atomic<int> failed_bands_;
+
+  std::atomic<int64_t> frames_;
+  std::atomic<int64_t> last_us_;
+  std::atomic<int64_t> total_us_;
+  std::atomic<int64_t> max_us_;
+
+  ColorConverter(const ColorConverter&);
+  ColorConverter& operator=(const ColorConverter&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_COLORCONVERTER_H_
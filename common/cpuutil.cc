@@ -0,0 +1,44 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "cpuutil.h"
+
+#include <windows.h>
+
+#include <algorithm>
+
+namespace webmdshow {
+
+int GetLogicalProcessorCount() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+
+  const int count = static_cast<int>(info.dwNumberOfProcessors);
+  return (count > 0) ? count : 1;
+}
+
+int GetVpxDecoderThreadCount(int thread_count, bool is_vp9, int frame_width) {
+  if (thread_count > 0)
+    return std::min(thread_count, kMaxVpxDecoderThreads);
+
+  const int cpus = GetLogicalProcessorCount();
+
+  if (cpus <= 1 || frame_width <= 0)
+    return 1;
+
+  // VP9 tile columns are never narrower than 256 pixels, so a 1080p stream
+  // has at most 4 of them and a 4K stream at most 16. The VP8 decoder threads
+  // over macroblock rows, which stops paying off beyond roughly one thread per
+  // 320 pixels of width.
+  const int min_width_per_thread = is_vp9 ? 256 : 320;
+  const int useful = std::max(1, frame_width / min_width_per_thread);
+
+  return std::min(std::min(cpus, useful), kMaxVpxDecoderThreads);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,29 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_CPUUTIL_H_
+#define WEBMDSHOW_COMMON_CPUUTIL_H_
+
+namespace webmdshow {
+
+// Upper bound on the number of threads handed to a libvpx decoder instance.
+const int kMaxVpxDecoderThreads = 16;
+
+// Returns the number of logical processors available to the process.
+int GetLogicalProcessorCount();
+
+// Returns the value for |vpx_codec_dec_cfg_t::threads|. A |thread_count|
+// greater than zero is used as is (clamped to kMaxVpxDecoderThreads). Zero
+// selects a count automatically from the number of logical processors and
+// |frame_width|: VP9 threads are assigned per tile column (tile columns are at
+// least 256 pixels wide), and VP8 threads per group of macroblock rows.
+int GetVpxDecoderThreadCount(int thread_count, bool is_vp9, int frame_width);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_CPUUTIL_H_
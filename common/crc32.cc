@@ -0,0 +1,203 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "crc32.h"
+
+#include <emmintrin.h>
+#include <intrin.h>
+#include <wmmintrin.h>
+
+#include <cassert>
+#include <cstring>
+#include <mutex>
+
+namespace webmdshow {
+
+namespace {
+
+const uint32_t kPolynomial = 0xEDB88320;  // reflected 0x04C11DB7
+
+// The shortest run folded with PCLMULQDQ: the four blocks it starts with.
+const size_t kMinFoldSize = 64;
+
+// The folding constants, x^n mod P for the distances folded over, and
+// the Barrett constants of P; each pair is loaded as one vector.
+const uint64_t kK1K2[2] = { 0x0154442bd4, 0x01c6e41596 };  // 512 bits
+const uint64_t kK3K4[2] = { 0x01751997d0, 0x00ccaa009e };  // 128 bits
+const uint64_t kK5K0[2] = { 0x0163cd6124, 0x0000000000 };  // 64 bits
+const uint64_t kPoly[2] = { 0x01db710641, 0x01f7011641 };  // P, and mu
+
+std::once_flag g_once;
+uint32_t g_table[8][256];  // g_table[k][b]: b followed by k zero bytes
+bool g_pclmul;
+
+void Init() {
+  for (uint32_t b = 0; b < 256; ++b) {
+    uint32_t c = b;
+
+    for (int i = 0; i < 8; ++i)
+      c = (c & 1) ? (c >> 1) ^ kPolynomial : (c >> 1);
+
+    g_table[0][b] = c;
+  }
+
+  for (int k = 1; k < 8; ++k) {
+    for (int b = 0; b < 256; ++b) {
+      const uint32_t c = g_table[k - 1][b];
+      g_table[k][b] = (c >> 8) ^ g_table[0][c & 0xFF];
+    }
+  }
+
+  int info[4];
+  __cpuid(info, 1);
+
+  g_pclmul = (info[2] & (1 << 1)) != 0;  // ECX.PCLMULQDQ
+}
+
+__m128i Load(const void* p) {
+  return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+// Folds |x| over 128 bits, onto |next|, with the constants |k| of that
+// distance.
+__m128i Fold(__m128i x, __m128i k, __m128i next) {
+  const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// The CRC state (not yet inverted) |c|, updated by the |len| bytes at
+// |p|, 8 at a time.
+uint32_t UpdateTables(uint32_t c, const uint8_t* p, size_t len) {
+  const uint32_t (*const t)[256] = g_table;
+
+  while (len >= 8) {
+    uint32_t a, b;
+    memcpy(&a, p, 4);  // little-endian, as the processor is
+    memcpy(&b, p + 4, 4);
+
+    a ^= c;
+
+    c = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^
+        t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+        t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^
+        t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+
+    p += 8;
+    len -= 8;
+  }
+
+  while (len-- > 0)
+    c = t[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+
+  return c;
+}
+
+// The CRC state |c|, updated by the |len| bytes at |p|, a multiple of
+// 16 no less than kMinFoldSize. Four blocks of 128 bits are folded over
+// the next four at a time, so that the multiplies of one don't wait on
+// those of another; the four are then folded into one, the rest of the
+// run folded onto it a block at a time, and the 128 bits left reduced
+// to the 32 of the CRC by Barrett reduction.
+uint32_t UpdatePclmul(uint32_t c, const uint8_t* p, size_t len) {
+  assert(len >= kMinFoldSize);
+  assert((len % 16) == 0);
+
+  __m128i x1 = _mm_xor_si128(Load(p), _mm_cvtsi32_si128(c));
+  __m128i x2 = Load(p + 16);
+  __m128i x3 = Load(p + 32);
+  __m128i x4 = Load(p + 48);
+
+  p += 64;
+  len -= 64;
+
+  __m128i k = Load(kK1K2);
+
+  while (len >= 64) {
+    x1 = Fold(x1, k, Load(p));
+    x2 = Fold(x2, k, Load(p + 16));
+    x3 = Fold(x3, k, Load(p + 32));
+    x4 = Fold(x4, k, Load(p + 48));
+
+    p += 64;
+    len -= 64;
+  }
+
+  k = Load(kK3K4);
+
+  x1 = Fold(x1, k, x2);
+  x1 = Fold(x1, k, x3);
+  x1 = Fold(x1, k, x4);
+
+  while (len >= 16) {
+    x1 = Fold(x1, k, Load(p));
+
+    p += 16;
+    len -= 16;
+  }
+
+  // 128 bits to 64.
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x);
+
+  k = _mm_loadl_epi64(static_cast<const __m128i*>(
+          static_cast<const void*>(kK5K0)));
+
+  x = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x);
+
+  // 64 bits to 32.
+  k = Load(kPoly);
+
+  x = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x = _mm_clmulepi64_si128(_mm_and_si128(x, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x);
+
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+}  // namespace
+
+uint32_t Crc32(uint32_t crc, const void* data, size_t len) {
+  assert(data || (len == 0));
+
+  std::call_once(g_once, &Init);
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint32_t c = ~crc;
+
+  if (g_pclmul && (len >= kMinFoldSize)) {
+    const size_t n = len & ~size_t(15);
+
+    c = UpdatePclmul(c, p, n);
+
+    p += n;
+    len -= n;
+  }
+
+  return ~UpdateTables(c, p, len);
+}
+
+uint32_t Crc32Software(uint32_t crc, const void* data, size_t len) {
+  assert(data || (len == 0));
+
+  std::call_once(g_once, &Init);
+
+  return ~UpdateTables(~crc, static_cast<const uint8_t*>(data), len);
+}
+
+bool HasPclmul() {
+  std::call_once(g_once, &Init);
+  return g_pclmul;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,36 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_CRC32_H_
+#define WEBMDSHOW_COMMON_CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace webmdshow {
+
+// The CRC-32 of EBML's CRC-32 element, which is zlib's: the reflected
+// IEEE polynomial, from all ones, inverted at the end. With PCLMULQDQ,
+// runs of 64 bytes are folded at a time by carry-less multiplication;
+// otherwise, and for what's left of a run, 8 bytes are taken at a time
+// with slicing-by-8 tables. Thread safe.
+
+// Returns the CRC of the |len| bytes at |data|, following the bytes
+// whose CRC is |crc| (0 for none), so that a run may be checked in
+// pieces.
+uint32_t Crc32(uint32_t crc, const void* data, size_t len);
+
+// The same, without PCLMULQDQ; for tests.
+uint32_t Crc32Software(uint32_t crc, const void* data, size_t len);
+
+// Whether the processor has the carry-less multiply instruction.
+bool HasPclmul();
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_CRC32_H_
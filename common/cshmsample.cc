@@ -0,0 +1,612 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "cshmsample.h"
+#include "mediatypeutil.h"
+#include <new>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <vfwmsgs.h>
+
+using webmdshow::ShmFrameRing;
+
+
+CShmSample::Factory::Factory(bool producer) :
+    m_producer(producer),
+    m_hAbort(CreateEvent(0, TRUE, FALSE, 0))
+{
+    assert(m_hAbort);
+}
+
+
+CShmSample::Factory::~Factory()
+{
+    const BOOL b = CloseHandle(m_hAbort);
+    b;
+    assert(b);
+}
+
+
+HRESULT CShmSample::Factory::CreateSample(
+    CMemAllocator* pAllocator,
+    IMemSample*& pResult)
+{
+    assert(pAllocator);
+
+    //The samples get their buffers from the ring, one slot at a time, in
+    //GetBuffer; there is nothing to allocate here.
+
+    pResult = new (std::nothrow) CShmSample(pAllocator, this);
+
+    return pResult ? S_OK : E_OUTOFMEMORY;
+}
+
+
+HRESULT CShmSample::Factory::InitializeSample(IMemSample* pSample)
+{
+    assert(pSample);
+    return pSample->Initialize();
+}
+
+
+HRESULT CShmSample::Factory::FinalizeSample(IMemSample* pSample)
+{
+    assert(pSample);
+    return pSample->Finalize();
+}
+
+
+HRESULT CShmSample::Factory::DestroySample(IMemSample* pSample)
+{
+    assert(pSample);
+    return pSample->Destroy();
+}
+
+
+HRESULT CShmSample::Factory::Destroy(CMemAllocator*)
+{
+    delete this;
+    return S_OK;
+}
+
+
+HRESULT CShmSample::CreateAllocator(bool producer, IMemAllocator** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+
+    Factory* const pFactory = new (std::nothrow) Factory(producer);
+
+    if (pFactory == 0)
+        return E_OUTOFMEMORY;
+
+    const HRESULT hr = CMemAllocator::CreateInstance(pFactory, pp);
+
+    if (FAILED(hr))
+        delete pFactory;
+
+    return hr;
+}
+
+
+CShmSample::Factory* CShmSample::GetFactory(IMemAllocator* p)
+{
+    assert(p);
+
+    CMemAllocator* const pAllocator = static_cast<CMemAllocator*>(p);
+    return static_cast<Factory*>(pAllocator->m_pSampleFactory);
+}
+
+
+ShmFrameRing* CShmSample::GetRing(IMemAllocator* p)
+{
+    return &GetFactory(p)->m_ring;
+}
+
+
+void CShmSample::SetAbort(IMemAllocator* p, bool bAbort)
+{
+    const HANDLE h = GetFactory(p)->m_hAbort;
+
+    const BOOL b = bAbort ? SetEvent(h) : ResetEvent(h);
+    b;
+    assert(b);
+}
+
+
+HRESULT CShmSample::Publish(IMediaSample* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    CShmSample* const pSample = static_cast<CShmSample*>(p);
+    Factory* const pFactory = pSample->m_pFactory;
+
+    if (!pFactory->m_producer)
+        return E_UNEXPECTED;
+
+    if (pSample->m_slot < 0)
+        return VFW_E_WRONG_STATE;
+
+    if (pSample->m_published)
+        return S_FALSE;
+
+    ShmFrameRing::SlotInfo info;
+    pSample->GetInfo(info);
+
+    const HRESULT hr = pFactory->m_ring.PublishSlot(pSample->m_slot, info);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The slot is the consumer's now, however long upstream keeps the
+    //sample.
+    pSample->m_published = true;
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::PublishCopy(IMemAllocator* pAllocator, IMediaSample* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    Factory* const pFactory = GetFactory(pAllocator);
+
+    if (!pFactory->m_producer)
+        return E_UNEXPECTED;
+
+    ShmFrameRing& ring = pFactory->m_ring;
+
+    const long len = p->GetActualDataLength();
+
+    if ((len < 0) || (len > ring.slot_size()))
+        return VFW_E_BUFFER_OVERFLOW;
+
+    BYTE* src;
+
+    HRESULT hr = p->GetPointer(&src);
+
+    if (FAILED(hr))
+        return hr;
+
+    ShmFrameRing::SlotInfo info;
+    memset(&info, 0, sizeof info);
+
+    int flags = 0;
+
+    hr = p->GetTime(&info.start, &info.stop);
+
+    if (SUCCEEDED(hr))
+    {
+        if (hr == VFW_S_NO_STOP_TIME)
+            info.stop = info.start;
+
+        flags |= ShmFrameRing::kFlagTime;
+    }
+
+    if (p->GetMediaTime(&info.media_start, &info.media_stop) == S_OK)
+        flags |= ShmFrameRing::kFlagMediaTime;
+
+    if (p->IsSyncPoint() == S_OK)
+        flags |= ShmFrameRing::kFlagSyncPoint;
+
+    if (p->IsPreroll() == S_OK)
+        flags |= ShmFrameRing::kFlagPreroll;
+
+    if (p->IsDiscontinuity() == S_OK)
+        flags |= ShmFrameRing::kFlagDiscontinuity;
+
+    info.flags = flags;
+    info.length = len;
+
+    int slot;
+
+    hr = ring.ClaimSlot(pFactory->m_hAbort, &slot);
+
+    if (FAILED(hr))
+        return hr;
+
+    memcpy(ring.GetSlotData(slot), src, len);
+
+    hr = ring.PublishSlot(slot, info);
+
+    if (FAILED(hr))
+        ring.ReleaseSlot(slot);
+
+    return hr;
+}
+
+
+CShmSample::CShmSample(CMemAllocator* pAllocator, Factory* pFactory) :
+    m_pAllocator(pAllocator),
+    m_pFactory(pFactory),
+    m_cRef(0),  //allocator will adjust
+    m_slot(ShmFrameRing::kEndOfStream),
+    m_published(false),
+    m_pmt(0)
+{
+}
+
+
+CShmSample::~CShmSample()
+{
+    Finalize();
+}
+
+
+ULONG CShmSample::GetCount()
+{
+    return m_cRef;
+}
+
+
+HRESULT CShmSample::Initialize()
+{
+    assert(m_slot < 0);
+    assert(m_pmt == 0);
+
+    ShmFrameRing& ring = m_pFactory->m_ring;
+    const HANDLE hAbort = m_pFactory->m_hAbort;
+
+    if (!ring.is_open())
+        return VFW_E_WRONG_STATE;
+
+    m_cRef = 0;
+    m_published = false;
+
+    ShmFrameRing::SlotInfo info;
+    HRESULT hr;
+
+    if (m_pFactory->m_producer)
+    {
+        hr = ring.ClaimSlot(hAbort, &m_slot);
+
+        memset(&info, 0, sizeof info);
+    }
+    else
+    {
+        hr = ring.TakeSlot(hAbort, &m_slot, &info);
+
+        if (hr == S_FALSE)  //end of stream
+            return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    if (FAILED(hr))
+    {
+        m_slot = ShmFrameRing::kEndOfStream;
+        return hr;
+    }
+
+    SetInfo(info);
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::Finalize()
+{
+    MediaTypeUtil::Free(m_pmt);
+    m_pmt = 0;
+
+    if (m_slot >= 0)
+    {
+        ShmFrameRing& ring = m_pFactory->m_ring;
+
+        if (!m_pFactory->m_producer)
+            ring.FreeSlot(m_slot);
+
+        else if (!m_published)
+            ring.ReleaseSlot(m_slot);
+
+        m_slot = ShmFrameRing::kEndOfStream;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::Destroy()
+{
+    delete this;
+    return S_OK;
+}
+
+
+void CShmSample::SetInfo(const ShmFrameRing::SlotInfo& info)
+{
+    const int flags = info.flags;
+
+    if (flags & ShmFrameRing::kFlagTime)
+    {
+        m_start_time = info.start;
+        m_stop_time = info.stop;
+    }
+    else
+    {
+        m_start_time = LLONG_MAX;
+        m_stop_time = LLONG_MAX;
+    }
+
+    if (flags & ShmFrameRing::kFlagMediaTime)
+    {
+        m_media_start_time = info.media_start;
+        m_media_stop_time = info.media_stop;
+    }
+    else
+    {
+        m_media_start_time = LLONG_MAX;
+        m_media_stop_time = LLONG_MAX;
+    }
+
+    m_sync_point = (flags & ShmFrameRing::kFlagSyncPoint) != 0;
+    m_preroll = (flags & ShmFrameRing::kFlagPreroll) != 0;
+    m_discontinuity = (flags & ShmFrameRing::kFlagDiscontinuity) != 0;
+    m_actual_data_length = info.length;
+}
+
+
+void CShmSample::GetInfo(ShmFrameRing::SlotInfo& info) const
+{
+    int flags = 0;
+
+    //A start time without a stop time is published as both.
+
+    info.start = m_start_time;
+    info.stop = (m_stop_time == LLONG_MAX) ? m_start_time : m_stop_time;
+
+    if (m_start_time != LLONG_MAX)
+        flags |= ShmFrameRing::kFlagTime;
+
+    info.media_start = m_media_start_time;
+    info.media_stop = m_media_stop_time;
+
+    if (m_media_start_time != LLONG_MAX)
+        flags |= ShmFrameRing::kFlagMediaTime;
+
+    if (m_sync_point)
+        flags |= ShmFrameRing::kFlagSyncPoint;
+
+    if (m_preroll)
+        flags |= ShmFrameRing::kFlagPreroll;
+
+    if (m_discontinuity)
+        flags |= ShmFrameRing::kFlagDiscontinuity;
+
+    info.flags = flags;
+    info.length = m_actual_data_length;
+}
+
+
+HRESULT CShmSample::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IMediaSample*>(this);
+
+    else if (iid == __uuidof(IMediaSample))
+        pUnk = static_cast<IMediaSample*>(this);
+
+    else if (iid == __uuidof(IMemSample))
+        pUnk = static_cast<IMemSample*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG CShmSample::AddRef()
+{
+    return InterlockedIncrement((LONG*)&m_cRef);
+}
+
+
+ULONG CShmSample::Release()
+{
+    if (LONG n = InterlockedDecrement((LONG*)&m_cRef))
+        return n;
+
+    m_pAllocator->ReleaseBuffer(this);
+    return 0;
+}
+
+
+HRESULT CShmSample::GetPointer(BYTE** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    assert(m_slot >= 0);
+
+    *pp = m_pFactory->m_ring.GetSlotData(m_slot);
+    return S_OK;
+}
+
+
+long CShmSample::GetSize()
+{
+    return m_pFactory->m_ring.slot_size();
+}
+
+
+HRESULT CShmSample::GetTime(
+    REFERENCE_TIME* pstart,
+    REFERENCE_TIME* pstop)
+{
+    if (m_start_time == LLONG_MAX)
+        return VFW_E_SAMPLE_TIME_NOT_SET;
+
+    if (pstart)
+        *pstart = m_start_time;
+
+    if (m_stop_time == LLONG_MAX)
+        return VFW_S_NO_STOP_TIME;
+
+    if (pstop)
+        *pstop = m_stop_time;
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::SetTime(
+    REFERENCE_TIME* pstart,
+    REFERENCE_TIME* pstop)
+{
+    if (pstart)
+        m_start_time = *pstart;
+    else
+        m_start_time = LLONG_MAX;
+
+    if (pstop)
+        m_stop_time = *pstop;
+    else
+        m_stop_time = LLONG_MAX;
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::IsSyncPoint()
+{
+    return m_sync_point ? S_OK : S_FALSE;
+}
+
+
+HRESULT CShmSample::SetSyncPoint(BOOL b)
+{
+    m_sync_point = bool(b != 0);
+    return S_OK;
+}
+
+
+HRESULT CShmSample::IsPreroll()
+{
+    return m_preroll ? S_OK : S_FALSE;
+}
+
+
+HRESULT CShmSample::SetPreroll(BOOL b)
+{
+    m_preroll = bool(b != 0);
+    return S_OK;
+}
+
+
+long CShmSample::GetActualDataLength()
+{
+    return m_actual_data_length;
+}
+
+
+HRESULT CShmSample::SetActualDataLength(long len)
+{
+    if ((len < 0) || (len > GetSize()))
+        return VFW_E_BUFFER_OVERFLOW;
+
+    m_actual_data_length = len;
+    return S_OK;
+}
+
+
+HRESULT CShmSample::GetMediaType(
+    AM_MEDIA_TYPE** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    AM_MEDIA_TYPE*& p = *pp;
+
+    if (m_pmt)
+        return MediaTypeUtil::Create(*m_pmt, p);
+
+    p = 0;
+    return S_FALSE;  //means "no media type"
+}
+
+
+HRESULT CShmSample::SetMediaType(
+    AM_MEDIA_TYPE* pmt)
+{
+    if (pmt == 0)
+    {
+        MediaTypeUtil::Free(m_pmt);
+        m_pmt = 0;
+
+        return S_OK;
+    }
+
+    return MediaTypeUtil::Create(*pmt, m_pmt);
+}
+
+
+HRESULT CShmSample::IsDiscontinuity()
+{
+    return m_discontinuity ? S_OK : S_FALSE;
+}
+
+
+HRESULT CShmSample::SetDiscontinuity(BOOL b)
+{
+    m_discontinuity = bool(b != 0);
+    return S_OK;
+}
+
+
+HRESULT CShmSample::GetMediaTime(
+    LONGLONG* pstart,
+    LONGLONG* pstop)
+{
+    if (m_media_start_time == LLONG_MAX)
+        return VFW_E_MEDIA_TIME_NOT_SET;
+
+    if (pstart)
+        *pstart = m_media_start_time;
+
+    if (pstop)
+    {
+        if (m_media_stop_time != LLONG_MAX)
+            *pstop = m_media_stop_time;
+        else
+            *pstop = m_media_start_time + 1;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT CShmSample::SetMediaTime(
+    LONGLONG* pstart,
+    LONGLONG* pstop)
+{
+    if (pstart)
+        m_media_start_time = *pstart;
+    else
+        m_media_start_time = LLONG_MAX;
+
+    if (pstop)
+        m_media_stop_time = *pstop;
+    else
+        m_media_stop_time = LLONG_MAX;
+
+    return S_OK;
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "cmemallocator.h"
+#include "imemsample.h"
+#include "shmframering.h"
+
+//A sample whose buffer is a slot of a ShmFrameRing, so that a frame
+//written into it in one process is read in place in another.  The ring
+//belongs to the allocator's sample factory, and so lasts as long as the
+//allocator does, whichever filter or sample releases it last.
+//
+//From a producer's allocator, GetBuffer claims a free slot for the
+//sample, waiting if the consumer holds them all, and Publish hands the
+//slot over with the sample's times and flags; a sample released without
+//being published gives its slot back.  From a consumer's allocator,
+//GetBuffer takes the next published slot, and releasing the sample
+//frees it.  At the end of the stream, the consumer's GetBuffer fails with
+//HRESULT_FROM_WIN32(ERROR_HANDLE_EOF).
+//
+//Either GetBuffer may wait on the other process, which Decommit doesn't
+//interrupt: SetAbort does, failing that GetBuffer (and later ones, until
+//it is cleared) with E_ABORT.
+
+class CShmSample : public IMediaSample,
+                   public IMemSample
+{
+    CShmSample(const CShmSample&);
+    CShmSample& operator=(const CShmSample&);
+
+public:
+
+    static HRESULT CreateAllocator(bool producer, IMemAllocator**);
+
+    //The ring of an allocator made by CreateAllocator, for the filter to
+    //create or open while the allocator is decommitted.
+    static webmdshow::ShmFrameRing* GetRing(IMemAllocator*);
+
+    static void SetAbort(IMemAllocator*, bool);
+
+    //Hands the slot of a sample from a producer's allocator to the
+    //consumer.
+    static HRESULT Publish(IMediaSample*);
+
+    //Copies a sample from some other allocator into a slot claimed from
+    //the producer's allocator, and publishes that.
+    static HRESULT PublishCopy(IMemAllocator*, IMediaSample*);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IMemSample interface:
+
+    ULONG STDMETHODCALLTYPE GetCount();
+    HRESULT STDMETHODCALLTYPE Initialize();
+    HRESULT STDMETHODCALLTYPE Finalize();
+    HRESULT STDMETHODCALLTYPE Destroy();
+
+    //IMediaSample interface:
+
+    HRESULT STDMETHODCALLTYPE GetPointer(
+        BYTE** ppBuffer);
+
+    long STDMETHODCALLTYPE GetSize();
+
+    HRESULT STDMETHODCALLTYPE GetTime(
+        REFERENCE_TIME* pTimeStart,
+        REFERENCE_TIME* pTimeEnd);
+
+    HRESULT STDMETHODCALLTYPE SetTime(
+        REFERENCE_TIME* pTimeStart,
+        REFERENCE_TIME* pTimeEnd);
+
+    HRESULT STDMETHODCALLTYPE IsSyncPoint();
+
+    HRESULT STDMETHODCALLTYPE SetSyncPoint(
+        BOOL bIsSyncPoint);
+
+    HRESULT STDMETHODCALLTYPE IsPreroll();
+
+    HRESULT STDMETHODCALLTYPE SetPreroll(
+        BOOL bIsPreroll);
+
+    long STDMETHODCALLTYPE GetActualDataLength();
+
+    HRESULT STDMETHODCALLTYPE SetActualDataLength(long);
+
+    HRESULT STDMETHODCALLTYPE GetMediaType(
+        AM_MEDIA_TYPE** ppMediaType);
+
+    HRESULT STDMETHODCALLTYPE SetMediaType(
+        AM_MEDIA_TYPE* pMediaType);
+
+    HRESULT STDMETHODCALLTYPE IsDiscontinuity();
+
+    HRESULT STDMETHODCALLTYPE SetDiscontinuity(
+        BOOL bDiscontinuity);
+
+    HRESULT STDMETHODCALLTYPE GetMediaTime(
+        LONGLONG* pTimeStart,
+        LONGLONG* pTimeEnd);
+
+    HRESULT STDMETHODCALLTYPE SetMediaTime(
+        LONGLONG* pTimeStart,
+        LONGLONG* pTimeStop);
+
+protected:
+
+    struct Factory : CMemAllocator::ISampleFactory
+    {
+    private:
+        Factory(const Factory&);
+        Factory& operator=(const Factory&);
+
+    public:
+        explicit Factory(bool producer);
+        virtual ~Factory();
+
+        const bool m_producer;
+        webmdshow::ShmFrameRing m_ring;
+        HANDLE m_hAbort;  //manual-reset
+
+        HRESULT CreateSample(CMemAllocator*, IMemSample*&);
+        HRESULT InitializeSample(IMemSample*);
+        HRESULT FinalizeSample(IMemSample*);
+        HRESULT DestroySample(IMemSample*);
+        HRESULT Destroy(CMemAllocator*);
+    };
+
+    CShmSample(CMemAllocator*, Factory*);
+    virtual ~CShmSample();
+
+    static Factory* GetFactory(IMemAllocator*);
+
+    CMemAllocator* const m_pAllocator;
+    Factory* const m_pFactory;
+    ULONG m_cRef;
+
+private:
+
+    int m_slot;  //kEndOfStream while the sample has none
+    bool m_published;
+
+    bool m_sync_point;
+    bool m_preroll;
+    bool m_discontinuity;
+    __int64 m_start_time;
+    __int64 m_stop_time;
+    __int64 m_media_start_time;
+    __int64 m_media_stop_time;
+    long m_actual_data_length;
+
+    AM_MEDIA_TYPE* m_pmt;
+
+    void SetInfo(const webmdshow::ShmFrameRing::SlotInfo&);
+    void GetInfo(webmdshow::ShmFrameRing::SlotInfo&) const;
+
+};
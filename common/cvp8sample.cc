@@ -9,6 +9,7 @@
 #include "CVP8Sample.h"
 #include <new>
 #include <cassert>
+#include <climits>
 #include <vfwmsgs.h>
 
 
@@ -37,57 +38,60 @@ HRESULT CVP8Sample::CreateAllocator(IMemAllocator** pp)
 }
 
 
-HRESULT CVP8Sample::GetFrame(CMemAllocator* pAlloc, IVP8Sample::Frame& f)
+HRESULT CVP8Sample::GetFrame(
+    CMemAllocator* pAlloc,
+    long len,
+    IVP8Sample::Frame& f)
 {
-    CMemAllocator::Lock lock;
+    assert(len >= 0);
 
-    HRESULT hr = lock.Seize(pAlloc);
+    ALLOCATOR_PROPERTIES props;
+
+    HRESULT hr = pAlloc->GetProperties(&props);
 
     if (FAILED(hr))
         return hr;
 
-    ALLOCATOR_PROPERTIES props;
-
-    hr = pAlloc->GetProperties(&props);
-    assert(SUCCEEDED(hr));
     assert(props.cBuffers > 0);
     assert(props.cbBuffer > 0);
     assert(props.cbAlign >= 1);
     assert(props.cbPrefix >= 0);
 
-    const long buflen = props.cbAlign - 1 + props.cbPrefix + props.cbBuffer;
+    //The pool aligns buffers to FramePool::kAlignment, which covers
+    //any cbAlign that divides it without padding.
+
+    long pad = props.cbAlign - 1;
+
+    if ((webmdshow::FramePool::kAlignment % props.cbAlign) == 0)
+        pad = 0;
+
+    const long cbBuffer = (len > props.cbBuffer) ? len : props.cbBuffer;
+    const size_t buflen = pad + props.cbPrefix + cbBuffer;
 
     CMemAllocator::ISampleFactory* const pFactory_ = pAlloc->m_pSampleFactory;
     assert(pFactory_);
 
     SampleFactory* const pFactory = static_cast<SampleFactory*>(pFactory_);
-    SampleFactory::frames_t& pool = pFactory->m_pool;
 
-    if (!pool.empty())
-    {
-        f = pool.front();
-        assert(f.buf);
-        assert(f.buflen >= buflen);
+    size_t capacity;
+    BYTE* const buf = pFactory->m_pool.Acquire(buflen, &capacity);
 
-        pool.pop_front();
-    }
-    else
-    {
-        BYTE* const buf = new (std::nothrow) BYTE[buflen];
+    if (buf == 0)
+        return E_OUTOFMEMORY;
 
-        if (buf == 0)
-            return E_OUTOFMEMORY;
+    assert(capacity >= buflen);
+    assert(capacity <= LONG_MAX);
 
-        f.buf = buf;
-        f.buflen = buflen;
+    f.buf = buf;
+    f.buflen = static_cast<long>(capacity);
+    f.layer = -1;
 
-        long off = props.cbPrefix;
+    long off = props.cbPrefix;
 
-        if (intptr_t n = intptr_t(buf) % props.cbAlign)
-            off += props.cbAlign - n;
+    if (intptr_t n = intptr_t(buf) % props.cbAlign)
+        off += props.cbAlign - static_cast<long>(n);
 
-        f.off = off;
-    }
+    f.off = off;
 
     BYTE* const ptr = f.buf + f.off;
     ptr;
@@ -97,6 +101,45 @@ HRESULT CVP8Sample::GetFrame(CMemAllocator* pAlloc, IVP8Sample::Frame& f)
 }
 
 
+void CVP8Sample::ReleaseFrame(CMemAllocator* pAlloc, IVP8Sample::Frame& f)
+{
+    //For a frame got from GetFrame that won't be sent downstream after
+    //all: its buffer goes back to the pool, as if a sample had held it.
+
+    assert(f.buf);
+
+    CMemAllocator::ISampleFactory* const pFactory_ = pAlloc->m_pSampleFactory;
+    assert(pFactory_);
+
+    SampleFactory* const pFactory = static_cast<SampleFactory*>(pFactory_);
+
+    pFactory->m_pool.Release(f.buf, f.buflen);
+    f.buf = 0;
+}
+
+
+void CVP8Sample::FreeFrame(IVP8Sample::Frame& f)
+{
+    assert(f.buf);
+
+    webmdshow::FramePool::Free(f.buf);
+    f.buf = 0;
+}
+
+
+void CVP8Sample::GetPoolStats(
+    CMemAllocator* pAlloc,
+    webmdshow::FramePool::Stats& stats)
+{
+    CMemAllocator::ISampleFactory* const pFactory_ = pAlloc->m_pSampleFactory;
+    assert(pFactory_);
+
+    SampleFactory* const pFactory = static_cast<SampleFactory*>(pFactory_);
+
+    pFactory->m_pool.GetStats(&stats);
+}
+
+
 CVP8Sample::SampleFactory::SampleFactory()
 {
 }
@@ -104,7 +147,6 @@ CVP8Sample::SampleFactory::SampleFactory()
 
 CVP8Sample::SampleFactory::~SampleFactory()
 {
-    PurgePool();
 }
 
 HRESULT CVP8Sample::SampleFactory::CreateSample(
@@ -144,10 +186,9 @@ HRESULT CVP8Sample::SampleFactory::FinalizeSample(IMemSample* p)
 {
     assert(p);
 
-    //Note that FinalizeSample is called by the allocator while
-    //it holds its own lock.  There's no special locking we need
-    //to here, because the allocator owns the sample factory
-    //object it was given when it (the allocator) was created.
+    //Note that FinalizeSample is called by the allocator without
+    //any lock held, possibly on several threads at once; the pool
+    //does its own locking.
 
     IVP8Sample* pSample;
 
@@ -163,7 +204,7 @@ HRESULT CVP8Sample::SampleFactory::FinalizeSample(IMemSample* p)
     IVP8Sample::Frame& f = pSample->GetFrame();
     assert(f.buf);
 
-    m_pool.push_back(f);
+    m_pool.Release(f.buf, f.buflen);
 
     f.buf = 0;
 
@@ -188,20 +229,6 @@ HRESULT CVP8Sample::SampleFactory::Destroy(CMemAllocator*)
 }
 
 
-void CVP8Sample::SampleFactory::PurgePool()
-{
-    while (!m_pool.empty())
-    {
-        IVP8Sample::Frame& f = m_pool.front();
-        assert(f.buf);
-
-        delete[] f.buf;
-
-        m_pool.pop_front();
-    }
-}
-
-
 HRESULT CVP8Sample::CreateInstance(
     CMemAllocator* pAllocator,
     CVP8Sample*& pSample)
@@ -248,6 +275,9 @@ HRESULT CVP8Sample::QueryInterface(const IID& iid, void** ppv)
     else if (iid == __uuidof(IVP8Sample))
         pUnk = static_cast<IVP8Sample*>(this);
 
+    else if (iid == __uuidof(IVPXSampleLayer))
+        pUnk = static_cast<IVPXSampleLayer*>(this);
+
     else
     {
         pUnk = 0;
@@ -283,6 +313,20 @@ CVP8Sample::Frame& CVP8Sample::GetFrame()
 }
 
 
+HRESULT CVP8Sample::GetTemporalLayer(int* pLayer)
+{
+    if (pLayer == 0)
+        return E_POINTER;
+
+    const Frame& f = m_frame;
+    assert(f.buf);
+
+    *pLayer = f.layer;
+
+    return (f.layer < 0) ? S_FALSE : S_OK;
+}
+
+
 ULONG CVP8Sample::GetCount()
 {
     return m_cRef;
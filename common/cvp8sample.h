@@ -8,13 +8,15 @@
 
 #pragma once
 #include "cmemallocator.h"
+#include "framepool.h"
 #include "imemsample.h"
 #include "ivp8sample.h"
-#include <list>
+#include "ivpxsamplelayer.h"
 
 class CVP8Sample : public IMediaSample,
                    public IMemSample,
-                   public IVP8Sample
+                   public IVP8Sample,
+                   public IVPXSampleLayer
 {
     CVP8Sample(const CVP8Sample&);
     CVP8Sample& operator=(const CVP8Sample&);
@@ -27,7 +29,15 @@ protected:
 public:
 
     static HRESULT CreateAllocator(IMemAllocator**);
-    static HRESULT GetFrame(CMemAllocator*, IVP8Sample::Frame&);
+    //Gets a frame from the allocator's pool, with room for the larger
+    //of len bytes and the allocator's cbBuffer.
+    static HRESULT GetFrame(CMemAllocator*, long len, IVP8Sample::Frame&);
+    static void ReleaseFrame(CMemAllocator*, IVP8Sample::Frame&);
+
+    //For a frame whose allocator is gone.
+    static void FreeFrame(IVP8Sample::Frame&);
+
+    static void GetPoolStats(CMemAllocator*, webmdshow::FramePool::Stats&);
 
     HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
     ULONG STDMETHODCALLTYPE AddRef();
@@ -37,6 +47,10 @@ public:
 
     Frame& GetFrame();
 
+    //IVPXSampleLayer interface:
+
+    HRESULT STDMETHODCALLTYPE GetTemporalLayer(int*);
+
     //IMemSample interface:
 
     ULONG STDMETHODCALLTYPE GetCount();
@@ -115,11 +129,7 @@ protected:
         HRESULT DestroySample(IMemSample*);
         HRESULT Destroy(CMemAllocator*);
 
-        typedef std::list<IVP8Sample::Frame> frames_t;
-        frames_t m_pool;  //for reuse
-
-    private:
-        void PurgePool();
+        webmdshow::FramePool m_pool;  //for reuse
 
     };
 
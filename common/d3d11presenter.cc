@@ -0,0 +1,684 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <d3dcompiler.h>
+#include <dxgi.h>
+#include <mfobjects.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "d3d11presenter.h"
+#include "debugutil.h"
+#include "memutil.h"
+
+namespace WebmDirectX
+{
+
+// The vertex shader draws a single triangle that covers the viewport, so
+// there is no vertex buffer or input layout. The pixel shaders sample the
+// planes and convert with the BT.601 studio range matrix, as VP8 frames
+// are coded.
+const char kShaderSource[] =
+    "Texture2D plane0 : register(t0);\n"
+    "Texture2D plane1 : register(t1);\n"
+    "Texture2D plane2 : register(t2);\n"
+    "SamplerState linear_clamp : register(s0);\n"
+    "struct VsOut {\n"
+    "  float4 pos : SV_Position;\n"
+    "  float2 uv : TEXCOORD0;\n"
+    "};\n"
+    "VsOut VsMain(uint id : SV_VertexID) {\n"
+    "  VsOut o;\n"
+    "  o.uv = float2((id << 1) & 2, id & 2);\n"
+    "  o.pos = float4(o.uv * float2(2, -2) + float2(-1, 1), 0, 1);\n"
+    "  return o;\n"
+    "}\n"
+    "float4 YuvToRgb(float y, float u, float v) {\n"
+    "  y = 1.164383 * (y - 0.062745);\n"
+    "  u -= 0.501961;\n"
+    "  v -= 0.501961;\n"
+    "  return float4(saturate(float3(y + 1.596027 * v,\n"
+    "                                y - 0.391762 * u - 0.812968 * v,\n"
+    "                                y + 2.017232 * u)), 1);\n"
+    "}\n"
+    "float4 PsI420(VsOut i) : SV_Target {\n"
+    "  return YuvToRgb(plane0.Sample(linear_clamp, i.uv).r,\n"
+    "                  plane1.Sample(linear_clamp, i.uv).r,\n"
+    "                  plane2.Sample(linear_clamp, i.uv).r);\n"
+    "}\n"
+    "float4 PsNV12(VsOut i) : SV_Target {\n"
+    "  const float2 uv = plane1.Sample(linear_clamp, i.uv).rg;\n"
+    "  return YuvToRgb(plane0.Sample(linear_clamp, i.uv).r, uv.x, uv.y);\n"
+    "}\n";
+
+namespace
+{
+
+HRESULT CompileShader(const char* entry_point, const char* target,
+                      ID3DBlob** ptr_code)
+{
+    ID3DBlob* ptr_errors = NULL;
+    HRESULT hr = D3DCompile(kShaderSource, sizeof(kShaderSource) - 1, NULL,
+                            NULL, NULL, entry_point, target,
+                            D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, ptr_code,
+                            &ptr_errors);
+    if (FAILED(hr))
+    {
+        DBGLOG("ERROR D3DCompile failed, entry_point=" << entry_point
+            << HRLOG(hr));
+        if (ptr_errors)
+        {
+            DBGLOG(static_cast<const char*>(ptr_errors->GetBufferPointer()));
+        }
+    }
+    WebmUtil::safe_rel(ptr_errors);
+    return hr;
+}
+
+// Copies |rows| rows of |row_bytes| each from |ptr_src| into |ptr_texture|,
+// a dynamic texture, in place of what it held.
+HRESULT WritePlane(ID3D11DeviceContext* ptr_context,
+                   ID3D11Texture2D* ptr_texture,
+                   const BYTE* ptr_src, UINT stride,
+                   UINT row_bytes, UINT rows)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr;
+    CHK(hr, ptr_context->Map(ptr_texture, 0, D3D11_MAP_WRITE_DISCARD, 0,
+                             &mapped));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    BYTE* ptr_dst = static_cast<BYTE*>(mapped.pData);
+    if (stride == row_bytes && mapped.RowPitch == row_bytes)
+    {
+        memcpy(ptr_dst, ptr_src, row_bytes * rows);
+    }
+    else
+    {
+        for (UINT row = 0; row < rows; ++row)
+        {
+            memcpy(ptr_dst, ptr_src, row_bytes);
+            ptr_dst += mapped.RowPitch;
+            ptr_src += stride;
+        }
+    }
+    ptr_context->Unmap(ptr_texture, 0);
+    return S_OK;
+}
+
+} // anonymous namespace
+
+D3D11Presenter::D3D11Presenter():
+  hwnd_(NULL),
+  ptr_device_(NULL),
+  ptr_context_(NULL),
+  ptr_swap_chain_(NULL),
+  ptr_render_target_(NULL),
+  target_width_(0),
+  target_height_(0),
+  ptr_vertex_shader_(NULL),
+  ptr_i420_shader_(NULL),
+  ptr_nv12_shader_(NULL),
+  ptr_sampler_(NULL),
+  planes_width_(0),
+  planes_height_(0),
+  planes_nv12_(false),
+  ptr_copy_texture_(NULL),
+  frames_presented_(0)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        ptr_planes_[i] = NULL;
+        ptr_plane_views_[i] = NULL;
+    }
+}
+
+D3D11Presenter::~D3D11Presenter()
+{
+    Close();
+}
+
+HRESULT D3D11Presenter::Open(HWND hwnd, ID3D11Device* ptr_device)
+{
+    if (!hwnd)
+    {
+        DBGLOG("ERROR NULL hwnd");
+        return E_INVALIDARG;
+    }
+    if (ptr_swap_chain_)
+    {
+        DBGLOG("ERROR Already open.");
+        return E_UNEXPECTED;
+    }
+    HRESULT hr;
+    if (ptr_device)
+    {
+        ptr_device_ = ptr_device;
+        ptr_device_->AddRef();
+        ptr_device_->GetImmediateContext(&ptr_context_);
+    }
+    else
+    {
+        const D3D_FEATURE_LEVEL levels[] = {
+            D3D_FEATURE_LEVEL_11_0,
+            D3D_FEATURE_LEVEL_10_1,
+            D3D_FEATURE_LEVEL_10_0
+        };
+        const UINT level_count = sizeof(levels) / sizeof(levels[0]);
+        hr = D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, 0,
+                               levels, level_count, D3D11_SDK_VERSION,
+                               &ptr_device_, NULL, &ptr_context_);
+        if (FAILED(hr))
+        {
+            DBGLOG("no hardware device, trying WARP" << HRLOG(hr));
+            CHK(hr, D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_WARP, NULL, 0,
+                                      levels, level_count,
+                                      D3D11_SDK_VERSION, &ptr_device_, NULL,
+                                      &ptr_context_));
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+    }
+    // The swap chain must come from the factory that made the device.
+    IDXGIDevice* ptr_dxgi_device = NULL;
+    CHK(hr, ptr_device_->QueryInterface(
+                __uuidof(IDXGIDevice),
+                reinterpret_cast<void**>(&ptr_dxgi_device)));
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+    IDXGIAdapter* ptr_adapter = NULL;
+    CHK(hr, ptr_dxgi_device->GetAdapter(&ptr_adapter));
+    ptr_dxgi_device->Release();
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+    IDXGIFactory* ptr_factory = NULL;
+    CHK(hr, ptr_adapter->GetParent(__uuidof(IDXGIFactory),
+                                   reinterpret_cast<void**>(&ptr_factory)));
+    ptr_adapter->Release();
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+    DXGI_SWAP_CHAIN_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    // A width and height of 0 take the size of the client area.
+    desc.BufferDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    desc.BufferCount = 1;
+    desc.OutputWindow = hwnd;
+    desc.Windowed = TRUE;
+    desc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+    CHK(hr, ptr_factory->CreateSwapChain(ptr_device_, &desc,
+                                         &ptr_swap_chain_));
+    if (SUCCEEDED(hr))
+    {
+        ptr_factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
+    }
+    ptr_factory->Release();
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+    hwnd_ = hwnd;
+    CHK(hr, CreatePipeline_());
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+    return S_OK;
+}
+
+void D3D11Presenter::Close()
+{
+    if (ptr_context_)
+    {
+        ptr_context_->ClearState();
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        WebmUtil::safe_rel(ptr_plane_views_[i]);
+        WebmUtil::safe_rel(ptr_planes_[i]);
+    }
+    planes_width_ = 0;
+    planes_height_ = 0;
+    WebmUtil::safe_rel(ptr_copy_texture_);
+    WebmUtil::safe_rel(ptr_sampler_);
+    WebmUtil::safe_rel(ptr_nv12_shader_);
+    WebmUtil::safe_rel(ptr_i420_shader_);
+    WebmUtil::safe_rel(ptr_vertex_shader_);
+    WebmUtil::safe_rel(ptr_render_target_);
+    target_width_ = 0;
+    target_height_ = 0;
+    WebmUtil::safe_rel(ptr_swap_chain_);
+    WebmUtil::safe_rel(ptr_context_);
+    WebmUtil::safe_rel(ptr_device_);
+    hwnd_ = NULL;
+}
+
+HRESULT D3D11Presenter::PresentI420(UINT width, UINT height,
+                                    const BYTE* ptr_y, UINT stride_y,
+                                    const BYTE* ptr_u, UINT stride_u,
+                                    const BYTE* ptr_v, UINT stride_v)
+{
+    if (!ptr_y || !ptr_u || !ptr_v)
+    {
+        DBGLOG("ERROR NULL plane");
+        return E_POINTER;
+    }
+    HRESULT hr;
+    CHK(hr, CreatePlaneTextures_(width, height, false));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const UINT chroma_width = (width + 1) / 2;
+    const UINT chroma_height = (height + 1) / 2;
+    CHK(hr, WritePlane(ptr_context_, ptr_planes_[0], ptr_y, stride_y, width,
+                       height));
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, WritePlane(ptr_context_, ptr_planes_[1], ptr_u, stride_u,
+                           chroma_width, chroma_height));
+    }
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, WritePlane(ptr_context_, ptr_planes_[2], ptr_v, stride_v,
+                           chroma_width, chroma_height));
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    return Draw_(width, height, ptr_i420_shader_, ptr_plane_views_, 3);
+}
+
+HRESULT D3D11Presenter::PresentNV12(UINT width, UINT height,
+                                    const BYTE* ptr_y, UINT stride_y,
+                                    const BYTE* ptr_uv, UINT stride_uv)
+{
+    if (!ptr_y || !ptr_uv)
+    {
+        DBGLOG("ERROR NULL plane");
+        return E_POINTER;
+    }
+    HRESULT hr;
+    CHK(hr, CreatePlaneTextures_(width, height, true));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, WritePlane(ptr_context_, ptr_planes_[0], ptr_y, stride_y, width,
+                       height));
+    if (SUCCEEDED(hr))
+    {
+        // Each row of the second plane holds a U and a V byte per pair of
+        // columns.
+        CHK(hr, WritePlane(ptr_context_, ptr_planes_[1], ptr_uv, stride_uv,
+                           ((width + 1) / 2) * 2, (height + 1) / 2));
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    return Draw_(width, height, ptr_nv12_shader_, ptr_plane_views_, 2);
+}
+
+HRESULT D3D11Presenter::PresentTexture(ID3D11Texture2D* ptr_texture,
+                                       UINT subresource)
+{
+    if (!ptr_texture)
+    {
+        DBGLOG("ERROR NULL texture");
+        return E_POINTER;
+    }
+    if (!ptr_swap_chain_)
+    {
+        DBGLOG("ERROR Not open.");
+        return E_UNEXPECTED;
+    }
+    ID3D11Device* ptr_device = NULL;
+    ptr_texture->GetDevice(&ptr_device);
+    const bool same_device = (ptr_device == ptr_device_);
+    WebmUtil::safe_rel(ptr_device);
+    D3D11_TEXTURE2D_DESC desc;
+    ptr_texture->GetDesc(&desc);
+    if (!same_device || DXGI_FORMAT_NV12 != desc.Format)
+    {
+        DBGLOG("ERROR not an NV12 texture on the presenter's device");
+        return E_INVALIDARG;
+    }
+    HRESULT hr;
+    ID3D11Texture2D* ptr_source = ptr_texture;
+    const bool in_place = (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE) &&
+                          desc.ArraySize == 1 && subresource == 0;
+    if (!in_place)
+    {
+        if (ptr_copy_texture_)
+        {
+            D3D11_TEXTURE2D_DESC copy_desc;
+            ptr_copy_texture_->GetDesc(&copy_desc);
+            if (copy_desc.Width != desc.Width ||
+                copy_desc.Height != desc.Height)
+            {
+                WebmUtil::safe_rel(ptr_copy_texture_);
+            }
+        }
+        if (!ptr_copy_texture_)
+        {
+            D3D11_TEXTURE2D_DESC copy_desc = desc;
+            copy_desc.MipLevels = 1;
+            copy_desc.ArraySize = 1;
+            copy_desc.Usage = D3D11_USAGE_DEFAULT;
+            copy_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            copy_desc.CPUAccessFlags = 0;
+            copy_desc.MiscFlags = 0;
+            CHK(hr, ptr_device_->CreateTexture2D(&copy_desc, NULL,
+                                                 &ptr_copy_texture_));
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        ptr_context_->CopySubresourceRegion(ptr_copy_texture_, 0, 0, 0, 0,
+                                            ptr_texture, subresource, NULL);
+        ptr_source = ptr_copy_texture_;
+    }
+    // The planes of an NV12 texture are viewed as an R8 texture of the
+    // full size and an R8G8 texture of half the size.
+    ID3D11ShaderResourceView* ptr_views[2] = { NULL, NULL };
+    D3D11_SHADER_RESOURCE_VIEW_DESC view_desc;
+    ZeroMemory(&view_desc, sizeof(view_desc));
+    view_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    view_desc.Texture2D.MipLevels = 1;
+    view_desc.Format = DXGI_FORMAT_R8_UNORM;
+    CHK(hr, ptr_device_->CreateShaderResourceView(ptr_source, &view_desc,
+                                                  &ptr_views[0]));
+    if (SUCCEEDED(hr))
+    {
+        view_desc.Format = DXGI_FORMAT_R8G8_UNORM;
+        CHK(hr, ptr_device_->CreateShaderResourceView(ptr_source,
+                                                      &view_desc,
+                                                      &ptr_views[1]));
+    }
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, Draw_(desc.Width, desc.Height, ptr_nv12_shader_, ptr_views,
+                      2));
+    }
+    WebmUtil::safe_rel(ptr_views[1]);
+    WebmUtil::safe_rel(ptr_views[0]);
+    return hr;
+}
+
+HRESULT D3D11Presenter::PresentSample(IMFSample* ptr_sample)
+{
+    if (!ptr_sample)
+    {
+        DBGLOG("ERROR NULL sample");
+        return E_POINTER;
+    }
+    IMFMediaBuffer* ptr_buffer = NULL;
+    HRESULT hr;
+    CHK(hr, ptr_sample->GetBufferByIndex(0, &ptr_buffer));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    IMFDXGIBuffer* ptr_dxgi_buffer = NULL;
+    hr = ptr_buffer->QueryInterface(
+        __uuidof(IMFDXGIBuffer),
+        reinterpret_cast<void**>(&ptr_dxgi_buffer));
+    ptr_buffer->Release();
+    if (FAILED(hr))
+    {
+        return E_NOINTERFACE;
+    }
+    ID3D11Texture2D* ptr_texture = NULL;
+    UINT subresource = 0;
+    CHK(hr, ptr_dxgi_buffer->GetResource(
+                __uuidof(ID3D11Texture2D),
+                reinterpret_cast<void**>(&ptr_texture)));
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, ptr_dxgi_buffer->GetSubresourceIndex(&subresource));
+    }
+    ptr_dxgi_buffer->Release();
+    if (SUCCEEDED(hr))
+    {
+        hr = PresentTexture(ptr_texture, subresource);
+    }
+    WebmUtil::safe_rel(ptr_texture);
+    return hr;
+}
+
+HRESULT D3D11Presenter::CreatePipeline_()
+{
+    ID3DBlob* ptr_code = NULL;
+    HRESULT hr;
+    CHK(hr, CompileShader("VsMain", "vs_4_0", &ptr_code));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_device_->CreateVertexShader(ptr_code->GetBufferPointer(),
+                                            ptr_code->GetBufferSize(), NULL,
+                                            &ptr_vertex_shader_));
+    WebmUtil::safe_rel(ptr_code);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, CompileShader("PsI420", "ps_4_0", &ptr_code));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_device_->CreatePixelShader(ptr_code->GetBufferPointer(),
+                                           ptr_code->GetBufferSize(), NULL,
+                                           &ptr_i420_shader_));
+    WebmUtil::safe_rel(ptr_code);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, CompileShader("PsNV12", "ps_4_0", &ptr_code));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_device_->CreatePixelShader(ptr_code->GetBufferPointer(),
+                                           ptr_code->GetBufferSize(), NULL,
+                                           &ptr_nv12_shader_));
+    WebmUtil::safe_rel(ptr_code);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    D3D11_SAMPLER_DESC sampler_desc;
+    ZeroMemory(&sampler_desc, sizeof(sampler_desc));
+    sampler_desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    sampler_desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler_desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler_desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    sampler_desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    sampler_desc.MaxLOD = D3D11_FLOAT32_MAX;
+    CHK(hr, ptr_device_->CreateSamplerState(&sampler_desc, &ptr_sampler_));
+    return hr;
+}
+
+HRESULT D3D11Presenter::CreatePlaneTextures_(UINT width, UINT height,
+                                             bool nv12)
+{
+    if (!ptr_swap_chain_)
+    {
+        DBGLOG("ERROR Not open.");
+        return E_UNEXPECTED;
+    }
+    if (!width || !height)
+    {
+        DBGLOG("ERROR empty frame");
+        return E_INVALIDARG;
+    }
+    if (width == planes_width_ && height == planes_height_ &&
+        nv12 == planes_nv12_)
+    {
+        return S_OK;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        WebmUtil::safe_rel(ptr_plane_views_[i]);
+        WebmUtil::safe_rel(ptr_planes_[i]);
+    }
+    planes_width_ = 0;
+    planes_height_ = 0;
+    D3D11_TEXTURE2D_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    const int plane_count = nv12 ? 2 : 3;
+    HRESULT hr = S_OK;
+    for (int i = 0; i < plane_count && SUCCEEDED(hr); ++i)
+    {
+        desc.Width = i ? (width + 1) / 2 : width;
+        desc.Height = i ? (height + 1) / 2 : height;
+        desc.Format = (i && nv12) ? DXGI_FORMAT_R8G8_UNORM :
+                                    DXGI_FORMAT_R8_UNORM;
+        CHK(hr, ptr_device_->CreateTexture2D(&desc, NULL, &ptr_planes_[i]));
+        if (SUCCEEDED(hr))
+        {
+            CHK(hr, ptr_device_->CreateShaderResourceView(
+                        ptr_planes_[i], NULL, &ptr_plane_views_[i]));
+        }
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    planes_width_ = width;
+    planes_height_ = height;
+    planes_nv12_ = nv12;
+    return S_OK;
+}
+
+HRESULT D3D11Presenter::UpdateRenderTarget_()
+{
+    RECT rect;
+    if (!GetClientRect(hwnd_, &rect))
+    {
+        DBGLOG("ERROR GetClientRect failed");
+        return E_FAIL;
+    }
+    const UINT width = (std::max)(1L, rect.right - rect.left);
+    const UINT height = (std::max)(1L, rect.bottom - rect.top);
+    if (ptr_render_target_ && width == target_width_ &&
+        height == target_height_)
+    {
+        return S_OK;
+    }
+    // The swap chain's buffer can't be resized while a view of it exists.
+    ptr_context_->OMSetRenderTargets(0, NULL, NULL);
+    WebmUtil::safe_rel(ptr_render_target_);
+    HRESULT hr;
+    CHK(hr, ptr_swap_chain_->ResizeBuffers(0, width, height,
+                                           DXGI_FORMAT_UNKNOWN, 0));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    ID3D11Texture2D* ptr_back_buffer = NULL;
+    CHK(hr, ptr_swap_chain_->GetBuffer(
+                0, __uuidof(ID3D11Texture2D),
+                reinterpret_cast<void**>(&ptr_back_buffer)));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_device_->CreateRenderTargetView(ptr_back_buffer, NULL,
+                                                &ptr_render_target_));
+    ptr_back_buffer->Release();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    target_width_ = width;
+    target_height_ = height;
+    return S_OK;
+}
+
+HRESULT D3D11Presenter::Draw_(UINT width, UINT height,
+                              ID3D11PixelShader* ptr_shader,
+                              ID3D11ShaderResourceView* const* ptr_views,
+                              UINT view_count)
+{
+    assert(view_count <= 3);
+    HRESULT hr;
+    CHK(hr, UpdateRenderTarget_());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    ptr_context_->OMSetRenderTargets(1, &ptr_render_target_, NULL);
+    ptr_context_->ClearRenderTargetView(ptr_render_target_, black);
+    // Scale the frame to fit the window, keeping its aspect ratio.
+    const float scale =
+        (std::min)(static_cast<float>(target_width_) / width,
+                   static_cast<float>(target_height_) / height);
+    D3D11_VIEWPORT viewport;
+    viewport.Width = width * scale;
+    viewport.Height = height * scale;
+    viewport.TopLeftX = (target_width_ - viewport.Width) / 2;
+    viewport.TopLeftY = (target_height_ - viewport.Height) / 2;
+    viewport.MinDepth = 0.0f;
+    viewport.MaxDepth = 1.0f;
+    ptr_context_->RSSetViewports(1, &viewport);
+    ptr_context_->IASetInputLayout(NULL);
+    ptr_context_->IASetPrimitiveTopology(
+        D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ptr_context_->VSSetShader(ptr_vertex_shader_, NULL, 0);
+    ptr_context_->PSSetShader(ptr_shader, NULL, 0);
+    ptr_context_->PSSetShaderResources(0, view_count, ptr_views);
+    ptr_context_->PSSetSamplers(0, 1, &ptr_sampler_);
+    ptr_context_->Draw(3, 0);
+    // Unbind the planes, so that a decoder's texture isn't held bound after
+    // it has been handed back to the decoder's pool.
+    ID3D11ShaderResourceView* const null_views[3] = { NULL, NULL, NULL };
+    ptr_context_->PSSetShaderResources(0, view_count, null_views);
+    hr = ptr_swap_chain_->Present(0, 0);
+    if (FAILED(hr))
+    {
+        DBGLOG("ERROR Present failed" << HRLOG(hr));
+        return hr;
+    }
+    ++frames_presented_;
+    // DXGI_STATUS_OCCLUDED is a success: the window is hidden.
+    return S_OK;
+}
+
+} // WebmDirectX
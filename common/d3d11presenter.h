@@ -0,0 +1,103 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_D3D11PRESENTER_HPP__
+#define __WEBMDSHOW_COMMON_D3D11PRESENTER_HPP__
+
+#include <d3d11.h>
+#include <mfobjects.h>
+
+#include "chromium/base/basictypes.h"
+
+namespace WebmDirectX
+{
+
+// Presents decoded video frames in a window with Direct3D 11. The planes
+// of a system memory frame are written straight into dynamic textures,
+// each mapped with |D3D11_MAP_WRITE_DISCARD|, so a frame is copied once,
+// from the decoder's buffer to the GPU's; a pixel shader converts it to
+// RGB (BT.601, studio range) as it is drawn. An NV12 texture, such as
+// those WebmMfVp8Dec outputs when it is given an IMFDXGIDeviceManager, is
+// drawn in place, with no copy at all.
+//
+// A presenter is not thread safe: open it, present, and close it on the
+// same thread. The caller paces the frames; presenting one does not wait
+// for the vertical blank.
+class D3D11Presenter
+{
+public:
+    D3D11Presenter();
+    ~D3D11Presenter();
+    // Creates the swap chain for |hwnd|. If |ptr_device| is NULL a
+    // hardware device is created (or a WARP device, when there is no
+    // hardware one); to draw the decoder's textures in place, pass the
+    // device of the decoder's IMFDXGIDeviceManager.
+    HRESULT Open(HWND hwnd, ID3D11Device* ptr_device);
+    void Close();
+    // Presents a frame whose U and V planes are each a quarter the size of
+    // its Y plane (as vpx_image_t's are). For YV12, swap |ptr_u| and
+    // |ptr_v|.
+    HRESULT PresentI420(UINT width, UINT height,
+                        const BYTE* ptr_y, UINT stride_y,
+                        const BYTE* ptr_u, UINT stride_u,
+                        const BYTE* ptr_v, UINT stride_v);
+    // Presents a frame whose second plane interleaves U and V.
+    HRESULT PresentNV12(UINT width, UINT height,
+                        const BYTE* ptr_y, UINT stride_y,
+                        const BYTE* ptr_uv, UINT stride_uv);
+    // Presents subresource |subresource| of |ptr_texture|, an NV12 texture
+    // on the presenter's device. A texture created with
+    // |D3D11_BIND_SHADER_RESOURCE| and no array slices is sampled in place;
+    // any other is first copied to one that is.
+    HRESULT PresentTexture(ID3D11Texture2D* ptr_texture, UINT subresource);
+    // Presents the texture behind the first buffer of |ptr_sample|, which
+    // must be an IMFDXGIBuffer; returns E_NOINTERFACE if it is not, in
+    // which case lock the buffer and use |PresentNV12| or |PresentI420|.
+    HRESULT PresentSample(IMFSample* ptr_sample);
+    UINT64 GetFramesPresented() const
+    {
+        return frames_presented_;
+    };
+    ID3D11Device* GetDevice() const
+    {
+        return ptr_device_;
+    };
+private:
+    HRESULT CreatePipeline_();
+    HRESULT CreatePlaneTextures_(UINT width, UINT height, bool nv12);
+    HRESULT UpdateRenderTarget_();
+    HRESULT Draw_(UINT width, UINT height, ID3D11PixelShader* ptr_shader,
+                  ID3D11ShaderResourceView* const* ptr_views,
+                  UINT view_count);
+    HWND hwnd_;
+    ID3D11Device* ptr_device_;
+    ID3D11DeviceContext* ptr_context_;
+    IDXGISwapChain* ptr_swap_chain_;
+    ID3D11RenderTargetView* ptr_render_target_;
+    UINT target_width_;
+    UINT target_height_;
+    ID3D11VertexShader* ptr_vertex_shader_;
+    ID3D11PixelShader* ptr_i420_shader_;
+    ID3D11PixelShader* ptr_nv12_shader_;
+    ID3D11SamplerState* ptr_sampler_;
+    // The dynamic textures that |PresentI420| and |PresentNV12| write; one
+    // per plane. They are recreated when the frame size or layout changes.
+    ID3D11Texture2D* ptr_planes_[3];
+    ID3D11ShaderResourceView* ptr_plane_views_[3];
+    UINT planes_width_;
+    UINT planes_height_;
+    bool planes_nv12_;
+    // Where |PresentTexture| copies a texture it cannot sample in place.
+    ID3D11Texture2D* ptr_copy_texture_;
+    UINT64 frames_presented_;
+    DISALLOW_COPY_AND_ASSIGN(D3D11Presenter);
+};
+
+} // WebmDirectX
+
+#endif // __WEBMDSHOW_COMMON_D3D11PRESENTER_HPP__
@@ -0,0 +1,95 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "duplicateframe.h"
+
+#include <emmintrin.h>
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+size_t FindFirstDifference(const uint8_t* a, const uint8_t* b, size_t len) {
+  size_t i = 0;
+
+  // Four vectors per step, so that one branch covers 64 bytes.
+  for (; i + 64 <= len; i += 64) {
+    const __m128i e0 =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+                       _mm_loadu_si128((const __m128i*)(b + i)));
+    const __m128i e1 =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)),
+                       _mm_loadu_si128((const __m128i*)(b + i + 16)));
+    const __m128i e2 =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 32)),
+                       _mm_loadu_si128((const __m128i*)(b + i + 32)));
+    const __m128i e3 =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 48)),
+                       _mm_loadu_si128((const __m128i*)(b + i + 48)));
+
+    const __m128i e = _mm_and_si128(_mm_and_si128(e0, e1),
+                                    _mm_and_si128(e2, e3));
+
+    if (_mm_movemask_epi8(e) != 0xFFFF)
+      break;  // the byte is found below
+  }
+
+  for (; i + 16 <= len; i += 16) {
+    const __m128i e =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+                       _mm_loadu_si128((const __m128i*)(b + i)));
+
+    const int mask = _mm_movemask_epi8(e);
+
+    if (mask != 0xFFFF) {
+      int bit = 0;
+
+      while (mask & (1 << bit))
+        ++bit;
+
+      return i + bit;
+    }
+  }
+
+  for (; i < len; ++i) {
+    if (a[i] != b[i])
+      return i;
+  }
+
+  return len;
+}
+
+DuplicateFrameDetector::DuplicateFrameDetector() : has_last_(false) {}
+
+bool DuplicateFrameDetector::IsDuplicate(const uint8_t* frame, size_t len) {
+  assert(frame || (len == 0));
+
+  if (!has_last_ || (last_.size() != len)) {
+    last_.assign(frame, frame + len);
+    has_last_ = true;
+    return false;
+  }
+
+  if (len == 0)
+    return true;
+
+  const size_t pos = FindFirstDifference(frame, &last_[0], len);
+
+  if (pos == len)
+    return true;
+
+  memcpy(&last_[pos], frame + pos, len - pos);
+  return false;
+}
+
+void DuplicateFrameDetector::Reset() {
+  has_last_ = false;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,49 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_DUPLICATEFRAME_H_
+#define WEBMDSHOW_COMMON_DUPLICATEFRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace webmdshow {
+
+// Finds the frames that are byte-identical to the frame before them, as
+// a capture of a mostly static screen sends. The detector keeps a copy
+// of the last frame it was shown, and compares the next one against it
+// 16 bytes at a time with SSE2. Where the frames first differ, it copies
+// the rest of the new frame over the old one in the same pass, so that a
+// changed frame costs one read of each frame plus the write of what
+// changed, and a repeated frame costs the reads only. Not thread safe.
+class DuplicateFrameDetector {
+ public:
+  DuplicateFrameDetector();
+
+  // Returns whether the |len| bytes of |frame| are those of the last
+  // frame passed in, and remembers them as the last frame either way.
+  // The first frame after construction or Reset is never a duplicate.
+  bool IsDuplicate(const uint8_t* frame, size_t len);
+
+  // Forgets the last frame, as for a seek or a change of format.
+  void Reset();
+
+ private:
+  std::vector<uint8_t> last_;
+  bool has_last_;
+};
+
+// Returns the offset of the first byte where the |len| bytes of |a| and
+// |b| differ, or |len| when they are equal.
+size_t FindFirstDifference(const uint8_t* a, const uint8_t* b, size_t len);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_DUPLICATEFRAME_H_
@@ -0,0 +1,145 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_EBMLELEMENT_H_
+#define WEBMDSHOW_COMMON_EBMLELEMENT_H_
+
+#include <stdint.h>
+
+#include <cassert>
+
+namespace WebmUtil {
+
+// Element headers whose ID (and often size) is known at compile time.
+// An EBML ID carries its own length marker, so the number of bytes it
+// takes follows from its value: EbmlIDSize computes it as a constant,
+// and EbmlWriteID stores the bytes of the ID as constants, without the
+// tests of WriteID4/3/2/1 and GetSerializeUIntSize. The header of an
+// element of fixed ID and size, such as CueTime, is then a run of
+// constant bytes.
+//
+// Each Write function stores at |p| and returns |p| past what it stored,
+// so that a caller can assemble several elements in a local buffer and
+// hand them to the stream in one write.
+
+template <uint32_t id>
+struct EbmlIDSize {
+  enum {
+    value = (id > 0xFFFFFF) ? 4 : (id > 0xFFFF) ? 3 : (id > 0xFF) ? 2 : 1
+  };
+
+  // The top byte holds the length marker: 1 for 1 byte, 01 for 2, and so
+  // on. An ID of all 1s after the marker is reserved.
+  static_assert((id >> (8 * (value - 1))) >= (0x80u >> (value - 1)) &&
+                (id >> (8 * (value - 1))) < (0x100u >> (value - 1)),
+                "not a valid EBML ID");
+  static_assert(id != 0xFF && id != 0x7FFF && id != 0x3FFFFF &&
+                id != 0x1FFFFFFF, "reserved EBML ID");
+};
+
+template <uint32_t id>
+inline uint8_t* EbmlWriteID(uint8_t* p) {
+  // The size is a constant, so the switch folds away.
+  switch (static_cast<int>(EbmlIDSize<id>::value)) {
+    case 4:
+      *p++ = static_cast<uint8_t>(id >> 24);  // fall through
+    case 3:
+      *p++ = static_cast<uint8_t>(id >> 16);  // fall through
+    case 2:
+      *p++ = static_cast<uint8_t>(id >> 8);  // fall through
+    default:
+      *p++ = static_cast<uint8_t>(id);
+  }
+
+  return p;
+}
+
+// Stores |val| in |len| bytes, big-endian: the payload of an unsigned
+// integer (or, as two's complement, a signed one).
+inline uint8_t* EbmlWriteBytes(uint8_t* p, uint64_t val, int len) {
+  assert(len >= 1 && len <= 8);
+
+  for (int i = len - 1; i >= 0; --i) {
+    p[i] = static_cast<uint8_t>(val);
+    val >>= 8;
+  }
+
+  return p + len;
+}
+
+// Stores |size| as a size field of a fixed |len| bytes, whatever its
+// value, so that the size may be patched later without moving what
+// follows.
+template <int len>
+inline uint8_t* EbmlWriteSize(uint8_t* p, uint64_t size) {
+  static_assert(len >= 1 && len <= 8, "EBML size fields are 1 to 8 bytes");
+
+  // All 1s means the size is unknown (see EbmlWriteUnknownSize).
+  assert(len == 8 || size < (uint64_t(1) << (7 * len)) - 1);
+
+  uint8_t* const end = EbmlWriteBytes(p, size, len);
+  *p |= static_cast<uint8_t>(0x80 >> (len - 1));
+
+  return end;
+}
+
+// A size field of |len| bytes that says the size is unknown: for an
+// element that is never patched, or as a placeholder until it is.
+template <int len>
+inline uint8_t* EbmlWriteUnknownSize(uint8_t* p) {
+  static_assert(len >= 1 && len <= 8, "EBML size fields are 1 to 8 bytes");
+
+  *p++ = static_cast<uint8_t>(0xFF >> (len - 1));
+
+  for (int i = 1; i < len; ++i)
+    *p++ = 0xFF;
+
+  return p;
+}
+
+// The ID and 1-byte size of an element whose payload is |size| bytes,
+// a constant less than 127.
+template <uint32_t id, int size>
+inline uint8_t* EbmlWriteHeader(uint8_t* p) {
+  static_assert(size >= 0 && size < 0x7F, "payload too large for 1 byte");
+
+  p = EbmlWriteID<id>(p);
+  *p++ = static_cast<uint8_t>(0x80 | size);
+
+  return p;
+}
+
+template <uint32_t id, int size>
+struct EbmlHeaderSize {
+  enum { value = EbmlIDSize<id>::value + 1 + size };
+};
+
+// An unsigned integer element whose payload is a fixed |len| bytes.
+template <uint32_t id, int len>
+inline uint8_t* EbmlWriteUIntElement(uint8_t* p, uint64_t val) {
+  static_assert(len >= 1 && len <= 8, "EBML integers are 1 to 8 bytes");
+  assert(((val >> (8 * len - 1)) >> 1) == 0);  // fits in len bytes
+
+  p = EbmlWriteHeader<id, len>(p);
+  return EbmlWriteBytes(p, val, len);
+}
+
+// The same, with a payload of |len| bytes known only at run time.
+template <uint32_t id>
+inline uint8_t* EbmlWriteUIntElement(uint8_t* p, uint64_t val, int len) {
+  assert(len >= 1 && len <= 8);
+
+  p = EbmlWriteID<id>(p);
+  *p++ = static_cast<uint8_t>(0x80 | len);
+
+  return EbmlWriteBytes(p, val, len);
+}
+
+}  // namespace WebmUtil
+
+#endif  // WEBMDSHOW_COMMON_EBMLELEMENT_H_
@@ -0,0 +1,203 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "encoderlookahead.h"
+
+#include <cassert>
+
+namespace webmdshow {
+
+namespace {
+
+// libvpx pads each plane of its frame buffers by this many pixels of the
+// luma (VP8BORDERINPIXELS), and aligns the luma to 16.
+const int kBorder = 32;
+
+std::once_flag g_lookahead_once;
+EncoderLookahead* g_lookahead;
+
+}  // namespace
+
+EncoderLookahead& EncoderLookahead::Get() {
+  std::call_once(g_lookahead_once, &EncoderLookahead::Create);
+  return *g_lookahead;
+}
+
+void EncoderLookahead::Create() {
+  // Never deleted, so that an encoder may leave while the process exits.
+  g_lookahead = new EncoderLookahead;
+}
+
+EncoderLookahead::EncoderLookahead() : next_id_(1), generation_(0) {
+  stats_.lookahead_bytes = 0;
+  stats_.cuts = 0;
+
+  account_.Open(MemoryBudget::GetProcess(), true);
+}
+
+int64_t EncoderLookahead::GetFrameBytes(int width, int height) {
+  assert(width > 0);
+  assert(height > 0);
+
+  const int64_t w = ((width + 15) & ~15) + 2 * kBorder;
+  const int64_t h = ((height + 15) & ~15) + 2 * kBorder;
+
+  return w * h * 3 / 2;  // 4:2:0
+}
+
+void EncoderLookahead::SetBudget(MemoryBudget* budget) {
+  assert(budget);
+
+  image_pool_.SetBudget(budget);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  account_.Open(budget, true);
+  account_.Charge(stats_.lookahead_bytes);
+}
+
+int EncoderLookahead::Join(const Demand& demand) {
+  assert(demand.frame_bytes >= 0);
+  assert(demand.lag >= 0);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Encoder e;
+  e.id = next_id_++;
+  e.demand = demand;
+  e.lag = demand.lag;
+
+  if (next_id_ <= 0)  // wrapped
+    next_id_ = 1;
+
+  while ((e.lag > 0) && !account_.TryCharge(e.lag * demand.frame_bytes))
+    e.lag /= 2;
+
+  stats_.lookahead_bytes += e.lag * demand.frame_bytes;
+
+  encoders_.push_back(e);
+
+  return e.id;
+}
+
+void EncoderLookahead::Leave(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (encoders_t::iterator i = encoders_.begin(); i != encoders_.end(); ++i) {
+    if (i->id == id) {
+      const int64_t bytes = i->lag * i->demand.frame_bytes;
+
+      account_.Release(bytes);
+      stats_.lookahead_bytes -= bytes;
+
+      encoders_.erase(i);
+      return;
+    }
+  }
+}
+
+int EncoderLookahead::GetLag(int id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (encoders_t::const_iterator i = encoders_.begin();
+       i != encoders_.end(); ++i) {
+    if (i->id == id)
+      return i->lag;
+  }
+
+  return -1;
+}
+
+void EncoderLookahead::Service() {
+  const int64_t request = account_.TakePurgeRequest();  // lock free
+
+  if (request <= 0)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const size_t count = encoders_.size();
+
+  std::vector<Demand> demands(count);
+  std::vector<int> lags(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    demands[i] = encoders_[i].demand;
+    lags[i] = encoders_[i].lag;
+  }
+
+  const int64_t bytes = Cut(request, demands, &lags);
+
+  if (bytes <= 0)
+    return;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (lags[i] != encoders_[i].lag) {
+      encoders_[i].lag = lags[i];
+      ++stats_.cuts;
+    }
+  }
+
+  account_.Release(bytes);
+  stats_.lookahead_bytes -= bytes;
+
+  generation_.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t EncoderLookahead::GetGeneration() const {
+  return generation_.load(std::memory_order_acquire);
+}
+
+void EncoderLookahead::GetStats(Stats* stats) const {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  *stats = stats_;
+}
+
+int EncoderLookahead::encoder_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<int>(encoders_.size());
+}
+
+int64_t EncoderLookahead::Cut(int64_t bytes,
+                              const std::vector<Demand>& demands,
+                              std::vector<int>* lags) {
+  assert(lags);
+  assert(lags->size() == demands.size());
+
+  const size_t count = demands.size();
+  int64_t freed = 0;
+
+  while (freed < bytes) {
+    size_t largest = count;
+    int64_t most = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const int64_t held = (*lags)[i] * demands[i].frame_bytes;
+
+      if (held > most) {
+        most = held;
+        largest = i;
+      }
+    }
+
+    if (largest == count)  // no lag left
+      break;
+
+    int& lag = (*lags)[largest];
+    const int cut = lag - lag / 2;
+
+    lag -= cut;
+    freed += cut * demands[largest].frame_bytes;
+  }
+
+  return freed;
+}
+
+}  // namespace webmdshow
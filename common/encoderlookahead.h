@@ -0,0 +1,120 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_ENCODERLOOKAHEAD_H_
+#define WEBMDSHOW_COMMON_ENCODERLOOKAHEAD_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "framepool.h"
+#include "memorybudget.h"
+
+namespace webmdshow {
+
+// The raw frames the process's encoders hold: the images their input is
+// converted into, and the frames libvpx keeps in its lookahead for
+// lag_in_frames (which the alt-ref filter, ARNR, draws on), at 4K and a
+// lag of 25 some 300 MB an encoder. The images come from a FramePool of
+// size classes shared by all the encoders, so that an encode that stops
+// leaves its image to the next. Each encoder joins as it starts, with the
+// size of its frames and its lag, and its lookahead is charged to the
+// memory budget as what that lag holds.
+//
+// The lookahead is purgeable: when the budget asks for memory back (past
+// its soft limit), the lags are cut, the largest lookahead's halved first,
+// until what was asked for is given back or no lag is left; and an encoder
+// that would take the budget past its hard limit joins with as much of
+// its lag as fits. GetGeneration changes when lags are cut, so that a
+// running encoder can take its new lag at its next frame. A cut lag is
+// not restored until the encoder starts again. There is one pool for
+// each module linked with common.lib. Thread safe.
+class EncoderLookahead {
+ public:
+  struct Demand {
+    int64_t frame_bytes;  // of one frame of the lookahead
+    int lag;              // frames, as vpx_codec_enc_cfg_t::g_lag_in_frames
+  };
+
+  struct Stats {
+    int64_t lookahead_bytes;  // charged for the lags granted
+    int64_t cuts;             // lags cut for the budget
+  };
+
+  // Returns the pool of this module.
+  static EncoderLookahead& Get();
+
+  // The bytes a lookahead frame of |width| by |height| takes in libvpx,
+  // with its borders.
+  static int64_t GetFrameBytes(int width, int height);
+
+  // Charges the lookahead and the images to |budget| instead of the
+  // process budget.
+  void SetBudget(MemoryBudget* budget);
+
+  // The pool of the encoders' input images.
+  FramePool* image_pool() { return &image_pool_; }
+
+  // Adds an encoder, and returns its id, which is never 0.
+  int Join(const Demand& demand);
+  void Leave(int id);
+
+  // Returns the lag granted encoder |id|, or -1 if there is no such
+  // encoder.
+  int GetLag(int id) const;
+
+  // Takes the purge request of the budget, if any, and cuts lags for it.
+  // Encoders call this at each frame; it takes no lock unless there is a
+  // request.
+  void Service();
+
+  // Changes whenever lags are cut.
+  uint32_t GetGeneration() const;
+
+  void GetStats(Stats* stats) const;
+
+  int encoder_count() const;
+
+  // Cuts |lags|, those granted encoders of |demands| in order, until
+  // |bytes| of lookahead are given back or no lag is left. Returns the
+  // bytes given back, which may overshoot |bytes| by part of a cut.
+  static int64_t Cut(int64_t bytes, const std::vector<Demand>& demands,
+                     std::vector<int>* lags);
+
+ private:
+  struct Encoder {
+    int id;
+    Demand demand;
+    int lag;
+  };
+
+  typedef std::vector<Encoder> encoders_t;
+
+  EncoderLookahead();
+  static void Create();
+
+  mutable std::mutex mutex_;  // for the below
+  encoders_t encoders_;
+  int next_id_;
+  Stats stats_;
+  MemoryBudget::Account account_;
+
+  std::atomic<uint32_t> generation_;
+
+  FramePool image_pool_;
+
+  EncoderLookahead(const EncoderLookahead&);
+  EncoderLookahead& operator=(const EncoderLookahead&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_ENCODERLOOKAHEAD_H_
@@ -0,0 +1,223 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "encoderthreadbudget.h"
+
+#include <windows.h>
+
+#include <cassert>
+
+namespace webmdshow {
+
+namespace {
+
+std::once_flag g_budget_once;
+EncoderThreadBudget* g_budget;
+
+}  // namespace
+
+const wchar_t EncoderThreadBudget::kPolicyKey[] =
+    L"Software\\WebM\\EncoderThreads";
+const wchar_t EncoderThreadBudget::kPolicyLimitValue[] = L"Limit";
+
+EncoderThreadBudget& EncoderThreadBudget::Get() {
+  std::call_once(g_budget_once, &EncoderThreadBudget::Create);
+  return *g_budget;
+}
+
+void EncoderThreadBudget::Create() {
+  // Never deleted, so that an encoder may leave while the process exits.
+  g_budget = new EncoderThreadBudget;
+}
+
+EncoderThreadBudget::EncoderThreadBudget()
+    : limit_(0), next_id_(1), generation_(0) {
+}
+
+void EncoderThreadBudget::SetLimit(int threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limit_ = (threads > 0) ? threads : 0;
+  Rebalance();
+}
+
+int EncoderThreadBudget::GetLimit() const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (limit_ > 0)
+      return limit_;
+  }
+
+  return GetPolicyLimit();
+}
+
+int EncoderThreadBudget::Join(const Demand& demand) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Encoder e;
+  e.id = next_id_++;
+  e.demand = demand;
+  e.grant.threads = 1;
+  e.grant.token_partitions = 0;
+
+  if (next_id_ <= 0)  // wrapped
+    next_id_ = 1;
+
+  encoders_.push_back(e);
+  Rebalance();
+
+  return e.id;
+}
+
+void EncoderThreadBudget::Leave(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (encoders_t::iterator i = encoders_.begin(); i != encoders_.end(); ++i) {
+    if (i->id == id) {
+      encoders_.erase(i);
+      Rebalance();
+      return;
+    }
+  }
+}
+
+bool EncoderThreadBudget::GetGrant(int id, Grant* grant) const {
+  assert(grant);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (encoders_t::const_iterator i = encoders_.begin();
+       i != encoders_.end(); ++i) {
+    if (i->id == id) {
+      *grant = i->grant;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint32_t EncoderThreadBudget::GetGeneration() const {
+  return generation_.load(std::memory_order_acquire);
+}
+
+int EncoderThreadBudget::encoder_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<int>(encoders_.size());
+}
+
+void EncoderThreadBudget::Allocate(int limit,
+                                   const std::vector<Demand>& demands,
+                                   std::vector<Grant>* grants) {
+  assert(grants);
+
+  const size_t count = demands.size();
+
+  const Grant one = { 1, 0 };
+  grants->assign(count, one);
+
+  std::vector<int> caps(count);
+  std::vector<double> weights(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const Demand& d = demands[i];
+
+    int cap = d.height / kRowsPerThread;
+
+    if (cap < 1)
+      cap = 1;
+    else if (cap > kMaxThreadsPerEncoder)
+      cap = kMaxThreadsPerEncoder;
+
+    caps[i] = cap;
+
+    double weight = double(d.width) * double(d.height);
+
+    if (weight <= 0)
+      weight = 1;
+
+    weights[i] = d.realtime ? 2 * weight : weight;
+  }
+
+  // One at a time, to the encoder with the most pixels for each of the
+  // threads it has.
+
+  for (int left = limit - static_cast<int>(count); left > 0; --left) {
+    size_t best = count;
+    double best_load = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const int threads = (*grants)[i].threads;
+
+      if (threads >= caps[i])
+        continue;
+
+      const double load = weights[i] / threads;
+
+      if (best == count || load > best_load) {
+        best = i;
+        best_load = load;
+      }
+    }
+
+    if (best == count)  // every encoder has all it can use
+      break;
+
+    ++(*grants)[best].threads;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    Grant& g = (*grants)[i];
+
+    while (g.token_partitions < kMaxTokenPartitions &&
+           (2 << g.token_partitions) <= g.threads) {
+      ++g.token_partitions;
+    }
+  }
+}
+
+int EncoderThreadBudget::GetPolicyLimit() {
+  DWORD limit = 0;
+  DWORD size = sizeof(limit);
+
+  const LONG status = RegGetValueW(HKEY_CURRENT_USER, kPolicyKey,
+                                   kPolicyLimitValue, RRF_RT_REG_DWORD, NULL,
+                                   &limit, &size);
+
+  if (status == ERROR_SUCCESS && limit > 0 && limit <= 1024)
+    return static_cast<int>(limit);
+
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+
+  return (info.dwNumberOfProcessors > 0)
+             ? static_cast<int>(info.dwNumberOfProcessors)
+             : 1;
+}
+
+void EncoderThreadBudget::Rebalance() {
+  const int limit = (limit_ > 0) ? limit_ : GetPolicyLimit();
+
+  std::vector<Demand> demands;
+  demands.reserve(encoders_.size());
+
+  for (encoders_t::const_iterator i = encoders_.begin();
+       i != encoders_.end(); ++i) {
+    demands.push_back(i->demand);
+  }
+
+  std::vector<Grant> grants;
+  Allocate(limit, demands, &grants);
+
+  for (size_t i = 0; i < encoders_.size(); ++i)
+    encoders_[i].grant = grants[i];
+
+  generation_.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,114 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_ENCODERTHREADBUDGET_H_
+#define WEBMDSHOW_COMMON_ENCODERTHREADBUDGET_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace webmdshow {
+
+// The threads of the process's encoders, shared out among those running,
+// so that eight concurrent encodes (simulcast renditions, or several jobs
+// in one process) don't each ask libvpx for as many threads as the
+// machine has, and oversubscribe it. Each encoder joins as it starts,
+// with the size of its frames and whether it has a real-time deadline,
+// and leaves as it stops; the shares are worked out again each time, and
+// GetGeneration changes, so that a running encoder can take its new
+// share at its next frame.
+//
+// Every encoder gets a thread, and the rest of the limit goes to those
+// with the most pixels per thread, a real-time encoder counting double,
+// up to what an encoder of that height can use. The token partitions of
+// a grant are as many as its threads, so that the decoder can use as
+// many. The limit is the policy's, or the number of logical processors.
+// There is one budget for each module linked with common.lib. Thread
+// safe.
+class EncoderThreadBudget {
+ public:
+  enum { kMaxThreadsPerEncoder = 16 };
+  enum { kRowsPerThread = 64 };  // of the frame, for each thread it uses
+  enum { kMaxTokenPartitions = 3 };  // log2, as VP8E_SET_TOKEN_PARTITIONS
+
+  struct Demand {
+    int width;
+    int height;
+    bool realtime;
+  };
+
+  struct Grant {
+    int threads;           // vpx_codec_enc_cfg_t::g_threads
+    int token_partitions;  // log2
+  };
+
+  // The registry value, under HKEY_CURRENT_USER, that sets the policy's
+  // limit: a DWORD, 0 (or none) for the number of logical processors.
+  static const wchar_t kPolicyKey[];
+  static const wchar_t kPolicyLimitValue[];
+
+  // Returns the budget of this module.
+  static EncoderThreadBudget& Get();
+
+  // Sets the threads shared out, overriding the policy, and rebalances.
+  // 0 restores the policy's limit.
+  void SetLimit(int threads);
+  int GetLimit() const;
+
+  // Adds an encoder, and returns its id, which is never 0.
+  int Join(const Demand& demand);
+  void Leave(int id);
+
+  // Sets |grant| to the share of encoder |id|. Returns false if there is
+  // no such encoder.
+  bool GetGrant(int id, Grant* grant) const;
+
+  // Changes whenever the shares are worked out again.
+  uint32_t GetGeneration() const;
+
+  int encoder_count() const;
+
+  // Shares |limit| threads out among encoders of |demands|, in order.
+  static void Allocate(int limit, const std::vector<Demand>& demands,
+                       std::vector<Grant>* grants);
+
+ private:
+  struct Encoder {
+    int id;
+    Demand demand;
+    Grant grant;
+  };
+
+  typedef std::vector<Encoder> encoders_t;
+
+  EncoderThreadBudget();
+  static void Create();
+
+  // Returns the limit of the policy.
+  static int GetPolicyLimit();
+
+  // Works out the grants of |encoders_| again. The mutex must be held.
+  void Rebalance();
+
+  mutable std::mutex mutex_;  // for the below
+  encoders_t encoders_;
+  int limit_;                 // set by SetLimit, or 0
+  int next_id_;
+
+  std::atomic<uint32_t> generation_;
+
+  EncoderThreadBudget(const EncoderThreadBudget&);
+  EncoderThreadBudget& operator=(const EncoderThreadBudget&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_ENCODERTHREADBUDGET_H_
@@ -0,0 +1,233 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "framepool.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace webmdshow {
+
+FramePool::FramePool() {
+  for (int i = 0; i < kClassCount; ++i) {
+    SizeClass& c = classes_[i];
+    c.in_use = 0;
+    c.peak = 0;
+    c.last_peak = 0;
+    c.acquires = 0;
+  }
+
+  stats_.allocations = 0;
+  stats_.reuses = 0;
+  stats_.bytes_resident = 0;
+
+  account_.Open(MemoryBudget::GetProcess(), true);
+}
+
+FramePool::~FramePool() {
+  for (int i = 0; i < kClassCount; ++i) {
+    std::vector<uint8_t*>& free = classes_[i].free;
+
+    for (size_t j = 0; j < free.size(); ++j)
+      Free(free[j]);
+  }
+}
+
+void FramePool::SetBudget(MemoryBudget* budget) {
+  assert(budget);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  account_.Open(budget, true);
+  account_.Charge(stats_.bytes_resident);
+}
+
+uint8_t* FramePool::Acquire(size_t size, size_t* capacity) {
+  assert(capacity);
+
+  const size_t class_capacity = GetCapacity(size);
+  const int index = GetClass(class_capacity);
+
+  if (index >= 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ServicePurge();
+
+    SizeClass& c = classes_[index];
+    uint8_t* buffer = NULL;
+
+    if (!c.free.empty()) {
+      buffer = c.free.back();
+      c.free.pop_back();
+    }
+
+    ++c.in_use;
+    c.peak = std::max(c.peak, c.in_use);
+
+    if (++c.acquires >= kWindow) {
+      c.last_peak = c.peak;
+      c.peak = c.in_use;
+      c.acquires = 0;
+      Trim(c);
+    }
+
+    if (buffer) {
+      ++stats_.reuses;
+      *capacity = class_capacity;
+      return buffer;
+    }
+  }
+
+  // Nothing to reuse; allocate outside the lock.
+  const bool charged = Charge(class_capacity);
+  void* const p = charged ? _aligned_malloc(class_capacity, kAlignment) : NULL;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (p == NULL) {
+    if (index >= 0)
+      --classes_[index].in_use;
+
+    if (charged)
+      account_.Release(class_capacity);
+
+    return NULL;
+  }
+
+  ++stats_.allocations;
+  stats_.bytes_resident += class_capacity;
+
+  *capacity = class_capacity;
+  return static_cast<uint8_t*>(p);
+}
+
+void FramePool::Release(uint8_t* buffer, size_t capacity) {
+  assert(buffer);
+  assert(capacity == GetCapacity(capacity));
+
+  const int index = GetClass(capacity);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (index >= 0) {
+      SizeClass& c = classes_[index];
+      assert(c.in_use > 0);
+      --c.in_use;
+
+      const int limit = std::max(c.peak, c.last_peak);
+
+      if (c.in_use + static_cast<int>(c.free.size()) < limit) {
+        c.free.push_back(buffer);
+        return;
+      }
+    }
+
+    stats_.bytes_resident -= capacity;
+    account_.Release(capacity);
+  }
+
+  Free(buffer);
+}
+
+void FramePool::Free(uint8_t* buffer) {
+  _aligned_free(buffer);
+}
+
+void FramePool::GetStats(Stats* stats) const {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  *stats = stats_;
+}
+
+size_t FramePool::GetCapacity(size_t size) {
+  size_t capacity = size_t(1) << kMinShift;
+
+  for (int i = 0; i < kClassCount; ++i) {
+    if (size <= capacity)
+      return capacity;
+
+    capacity <<= 1;
+  }
+
+  // Too large to pool: just round up to the alignment.
+  return (size + kAlignment - 1) & ~size_t(kAlignment - 1);
+}
+
+int FramePool::GetClass(size_t capacity) {
+  size_t class_capacity = size_t(1) << kMinShift;
+
+  for (int i = 0; i < kClassCount; ++i) {
+    if (capacity == class_capacity)
+      return i;
+
+    class_capacity <<= 1;
+  }
+
+  return -1;
+}
+
+void FramePool::Trim(SizeClass& c) {
+  const int limit = std::max(c.peak, c.last_peak);
+  const size_t capacity = GetCapacity(0) << (&c - classes_);
+
+  while (!c.free.empty() &&
+         c.in_use + static_cast<int>(c.free.size()) > limit) {
+    Free(c.free.back());
+    c.free.pop_back();
+    stats_.bytes_resident -= capacity;
+    account_.Release(capacity);
+  }
+}
+
+int64_t FramePool::PurgeFree(int64_t bytes) {
+  int64_t freed = 0;
+
+  for (int i = kClassCount - 1; (i >= 0) && (freed < bytes); --i) {
+    std::vector<uint8_t*>& free = classes_[i].free;
+    const size_t capacity = GetCapacity(0) << i;
+
+    while (!free.empty() && (freed < bytes)) {
+      Free(free.back());
+      free.pop_back();
+      stats_.bytes_resident -= capacity;
+      account_.Release(capacity);
+      freed += capacity;
+    }
+  }
+
+  return freed;
+}
+
+void FramePool::ServicePurge() {
+  const int64_t bytes = account_.TakePurgeRequest();
+
+  if (bytes > 0)
+    PurgeFree(bytes);
+}
+
+bool FramePool::Charge(size_t capacity) {
+  const int64_t bytes = static_cast<int64_t>(capacity);
+
+  if (account_.TryCharge(bytes))
+    return true;
+
+  // Out of budget: give back what we hold for reuse, and try again.
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PurgeFree(bytes);
+  }
+
+  return account_.TryCharge(bytes);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,109 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_FRAMEPOOL_H_
+#define WEBMDSHOW_COMMON_FRAMEPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "memorybudget.h"
+
+namespace webmdshow {
+
+// Hands out buffers for compressed frames from power-of-two size classes,
+// so that a buffer given back by one frame serves any later frame of the
+// same class, however its size varies. Each class keeps no more buffers
+// than the most it has had in use over its last two windows of acquires,
+// so the memory a burst of large keyframes needed is given back once the
+// burst is over. Buffers are aligned to kAlignment bytes.
+//
+// The pool charges what it allocates to a MemoryBudget, the process
+// budget unless set otherwise, and gives back its free buffers when the
+// budget asks it to purge. Past the hard limit of the budget, Acquire
+// fails rather than allocating. Thread safe.
+class FramePool {
+ public:
+  enum { kAlignment = 64 };
+
+  struct Stats {
+    int64_t allocations;     // buffers allocated from the heap
+    int64_t reuses;          // buffers handed out again
+    int64_t bytes_resident;  // allocated and not yet freed, in use or not
+  };
+
+  FramePool();
+
+  // Frees the buffers the pool holds; buffers still out must be freed
+  // with Free.
+  ~FramePool();
+
+  // Charges the buffers the pool has allocated to |budget| instead.
+  void SetBudget(MemoryBudget* budget);
+
+  // Returns a buffer of at least |size| bytes, and its true size in
+  // |capacity|. Returns NULL if out of memory, or out of budget.
+  uint8_t* Acquire(size_t size, size_t* capacity);
+
+  // Gives back |buffer|, of the |capacity| Acquire returned.
+  void Release(uint8_t* buffer, size_t capacity);
+
+  // Frees a buffer from Acquire whose pool is gone.
+  static void Free(uint8_t* buffer);
+
+  void GetStats(Stats* stats) const;
+
+  // Returns the capacity of the buffer returned for a |size| byte request.
+  static size_t GetCapacity(size_t size);
+
+ private:
+  enum {
+    kMinShift = 12,  // the smallest class, 4 KB
+    kClassCount = 19,  // up to 1 GB; larger buffers are not pooled
+    kWindow = 64,  // acquires per class between trims
+  };
+
+  struct SizeClass {
+    std::vector<uint8_t*> free;
+    int in_use;
+    int peak;       // most in use in the current window
+    int last_peak;  // in the previous window
+    int acquires;   // in the current window
+  };
+
+  // Returns the class of |capacity|, or -1 if it is too large for one.
+  static int GetClass(size_t capacity);
+
+  // Frees the class's buffers beyond what the high-water mark allows.
+  void Trim(SizeClass& c);
+
+  // Frees free buffers, the largest first, until |bytes| are freed or
+  // there are none; returns the bytes freed.
+  int64_t PurgeFree(int64_t bytes);
+
+  // Takes the purge request of the budget, if any.
+  void ServicePurge();
+
+  // Charges |capacity|, purging the free buffers if the budget is out.
+  bool Charge(size_t capacity);
+
+  mutable std::mutex mutex_;
+  SizeClass classes_[kClassCount];
+  Stats stats_;
+  MemoryBudget::Account account_;
+
+  FramePool(const FramePool&);
+  FramePool& operator=(const FramePool&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_FRAMEPOOL_H_
@@ -0,0 +1,575 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "gpucolorconverter.h"
+
+#include <d3dcompiler.h>
+#include <dxgi1_2.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+// Each thread writes four pixels of a row, which for RGB24 make three
+// whole words of the raw buffer; the rows are stored top-down or, for a
+// bottom-up DIB, flipped. Sampling at the centre of each output pixel
+// with a bilinear sampler both scales the frame and, for the half size
+// chroma planes, interpolates the chroma up to full size.
+const char kShaderSource[] =
+    "Texture2D plane0 : register(t0);\n"
+    "Texture2D plane1 : register(t1);\n"
+    "Texture2D plane2 : register(t2);\n"
+    "SamplerState linear_clamp : register(s0);\n"
+    "RWByteAddressBuffer dst : register(u0);\n"
+    "cbuffer Params : register(b0) {\n"
+    "  float2 scale;\n"
+    "  uint dst_width;\n"
+    "  uint dst_height;\n"
+    "  uint dst_stride;\n"
+    "  uint dst_flip;\n"
+    "  uint rgb24;\n"
+    "  uint nv12;\n"
+    "  float y_offset;\n"
+    "  float y_gain;\n"
+    "  float vr;\n"
+    "  float ug;\n"
+    "  float vg;\n"
+    "  float ub;\n"
+    "};\n"
+    "uint ToRgb32(float2 uv) {\n"
+    "  const float y =\n"
+    "      (plane0.SampleLevel(linear_clamp, uv, 0).r - y_offset) * y_gain;\n"
+    "  float2 c;\n"
+    "  if (nv12)\n"
+    "    c = plane1.SampleLevel(linear_clamp, uv, 0).rg;\n"
+    "  else\n"
+    "    c = float2(plane1.SampleLevel(linear_clamp, uv, 0).r,\n"
+    "               plane2.SampleLevel(linear_clamp, uv, 0).r);\n"
+    "  c -= 128.0 / 255.0;\n"
+    "  const uint3 rgb = uint3(saturate(float3(y + vr * c.y,\n"
+    "                                          y + ug * c.x + vg * c.y,\n"
+    "                                          y + ub * c.x)) * 255 + 0.5);\n"
+    "  return rgb.b | (rgb.g << 8) | (rgb.r << 16) | 0xff000000;\n"
+    "}\n"
+    "[numthreads(8, 8, 1)]\n"
+    "void CsMain(uint3 id : SV_DispatchThreadID) {\n"
+    "  const uint x0 = id.x * 4;\n"
+    "  const uint row = id.y;\n"
+    "  if (x0 >= dst_width || row >= dst_height)\n"
+    "    return;\n"
+    "  const uint offset = (dst_flip ? dst_height - 1 - row : row) *\n"
+    "                      dst_stride;\n"
+    "  const uint end = offset + dst_stride;\n"
+    "  const float v = (row + 0.5) * scale.y;\n"
+    "  uint px[4];\n"
+    "  [unroll] for (uint i = 0; i < 4; ++i) {\n"
+    "    const uint x = min(x0 + i, dst_width - 1);\n"
+    "    px[i] = ToRgb32(float2((x + 0.5) * scale.x, v));\n"
+    "  }\n"
+    "  if (rgb24) {\n"
+    "    const uint base = offset + x0 * 3;\n"
+    "    dst.Store(base, (px[0] & 0xffffff) | (px[1] << 24));\n"
+    "    if (base + 4 < end)\n"
+    "      dst.Store(base + 4, ((px[1] >> 8) & 0xffff) | (px[2] << 16));\n"
+    "    if (base + 8 < end)\n"
+    "      dst.Store(base + 8, ((px[2] >> 16) & 0xff) | (px[3] << 8));\n"
+    "  } else {\n"
+    "    [unroll] for (uint i = 0; i < 4; ++i) {\n"
+    "      if (x0 + i < dst_width)\n"
+    "        dst.Store(offset + (x0 + i) * 4, px[i]);\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+// Mirrors the shader's constant buffer, which packs into four registers.
+struct ShaderConstants {
+  float scale[2];
+  uint32_t dst_width;
+  uint32_t dst_height;
+  uint32_t dst_stride;
+  uint32_t dst_flip;
+  uint32_t rgb24;
+  uint32_t nv12;
+  float y_offset;
+  float y_gain;
+  float vr;
+  float ug;
+  float vg;
+  float ub;
+  float unused[2];
+};
+
+enum { kThreadsX = 8, kThreadsY = 8, kPixelsPerThread = 4 };
+
+// The vendor and device of the Basic Render Driver, which D3D11 offers as
+// a hardware adapter on machines without one.
+enum { kBasicRenderVendor = 0x1414, kBasicRenderDevice = 0x8c };
+
+template <typename T>
+void SafeRelease(T** ptr) {
+  if (*ptr) {
+    (*ptr)->Release();
+    *ptr = NULL;
+  }
+}
+
+int64_t GetElapsedUs(const LARGE_INTEGER& start) {
+  LARGE_INTEGER stop, freq;
+  QueryPerformanceCounter(&stop);
+  QueryPerformanceFrequency(&freq);
+
+  return (stop.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+}  // namespace
+
+GpuColorConverter::GpuColorConverter()
+    : device_(NULL),
+      context_(NULL),
+      shader_(NULL),
+      sampler_(NULL),
+      constants_(NULL),
+      output_(NULL),
+      output_view_(NULL),
+      next_(0),
+      pending_(0),
+      src_format_(kColorFormatI420),
+      src_stride_(0),
+      src_width_(0),
+      src_height_(0),
+      dst_width_(0),
+      dst_height_(0),
+      output_size_(0),
+      yuv_matrix_(kYuvMatrixBT601),
+      yuv_range_(kYuvRangeLimited),
+      frames_(0),
+      last_us_(0),
+      total_us_(0),
+      max_us_(0) {
+  memset(slots_, 0, sizeof slots_);
+}
+
+GpuColorConverter::~GpuColorConverter() {
+  Close();
+}
+
+bool GpuColorConverter::IsSupported(ColorFormat src_format,
+                                    ColorFormat dst_format) {
+  const bool src_ok = src_format == kColorFormatI420 ||
+                      src_format == kColorFormatYV12 ||
+                      src_format == kColorFormatNV12;
+  const bool dst_ok = dst_format == kColorFormatRGB32 ||
+                      dst_format == kColorFormatRGB24;
+
+  return src_ok && dst_ok;
+}
+
+bool GpuColorConverter::Init(ColorFormat src_format, int src_stride,
+                             int src_width, int src_height,
+                             ColorFormat dst_format, int dst_stride,
+                             int dst_width, int dst_height) {
+  const int max_size = D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+
+  if (!IsSupported(src_format, dst_format) || src_width <= 0 ||
+      src_height <= 0 || dst_width <= 0 || dst_height <= 0 ||
+      src_width > max_size || src_height > max_size ||
+      src_stride < ColorConverter::GetStride(src_format, src_width) ||
+      abs(dst_stride) < ColorConverter::GetStride(dst_format, dst_width) ||
+      abs(dst_stride) % 4 != 0) {
+    return false;
+  }
+
+  pending_ = 0;
+  next_ = 0;
+  ReleaseSlots();
+
+  if (device_ == NULL && (!CreateDevice() || !CreatePipeline())) {
+    Close();
+    return false;
+  }
+
+  src_format_ = src_format;
+  src_stride_ = src_stride;
+  src_width_ = src_width;
+  src_height_ = src_height;
+  dst_width_ = dst_width;
+  dst_height_ = dst_height;
+  output_size_ = abs(dst_stride) * dst_height;
+
+  const YuvToRgbConstants& yuv = GetYuvToRgbConstants(yuv_matrix_,
+                                                      yuv_range_);
+  const float kCoefficientScale = 8192.0f;
+
+  ShaderConstants constants;
+  memset(&constants, 0, sizeof constants);
+
+  constants.scale[0] = 1.0f / dst_width;
+  constants.scale[1] = 1.0f / dst_height;
+  constants.dst_width = dst_width;
+  constants.dst_height = dst_height;
+  constants.dst_stride = abs(dst_stride);
+  constants.dst_flip = (dst_stride < 0);
+  constants.rgb24 = (dst_format == kColorFormatRGB24);
+  constants.nv12 = (src_format == kColorFormatNV12);
+  constants.y_offset = yuv.y_offset / 255.0f;
+  constants.y_gain = yuv.y / kCoefficientScale;
+  constants.vr = yuv.vr / kCoefficientScale;
+  constants.ug = yuv.ug / kCoefficientScale;
+  constants.vg = yuv.vg / kCoefficientScale;
+  constants.ub = yuv.ub / kCoefficientScale;
+
+  context_->UpdateSubresource(constants_, 0, NULL, &constants, 0, 0);
+
+  if (!CreateSlots()) {
+    ReleaseSlots();
+    return false;
+  }
+
+  frames_ = 0;
+  last_us_ = 0;
+  total_us_ = 0;
+  max_us_ = 0;
+
+  return true;
+}
+
+void GpuColorConverter::Close() {
+  pending_ = 0;
+  next_ = 0;
+
+  ReleaseSlots();
+
+  if (context_)
+    context_->ClearState();
+
+  SafeRelease(&shader_);
+  SafeRelease(&sampler_);
+  SafeRelease(&constants_);
+  SafeRelease(&context_);
+  SafeRelease(&device_);
+}
+
+bool GpuColorConverter::CreateDevice() {
+  IDXGIFactory1* factory = NULL;
+
+  HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1),
+                                  reinterpret_cast<void**>(&factory));
+  if (FAILED(hr))
+    return false;
+
+  const D3D_FEATURE_LEVEL level = D3D_FEATURE_LEVEL_11_0;
+  IDXGIAdapter1* adapter = NULL;
+
+  // The first adapter that is more than a software rasterizer, which
+  // would convert more slowly than ColorConverter.
+  for (UINT i = 0; factory->EnumAdapters1(i, &adapter) == S_OK; ++i) {
+    DXGI_ADAPTER_DESC1 desc;
+    hr = adapter->GetDesc1(&desc);
+
+    const bool software =
+        FAILED(hr) || (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) ||
+        (desc.VendorId == kBasicRenderVendor &&
+         desc.DeviceId == kBasicRenderDevice);
+
+    if (!software) {
+      hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0,
+                             &level, 1, D3D11_SDK_VERSION, &device_, NULL,
+                             &context_);
+    }
+
+    SafeRelease(&adapter);
+
+    if (device_)
+      break;
+  }
+
+  factory->Release();
+
+  return device_ != NULL;
+}
+
+bool GpuColorConverter::CreatePipeline() {
+  ID3DBlob* code = NULL;
+  ID3DBlob* errors = NULL;
+
+  HRESULT hr = D3DCompile(kShaderSource, sizeof(kShaderSource) - 1, NULL,
+                          NULL, NULL, "CsMain", "cs_5_0",
+                          D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code,
+                          &errors);
+  SafeRelease(&errors);
+
+  if (FAILED(hr))
+    return false;
+
+  hr = device_->CreateComputeShader(code->GetBufferPointer(),
+                                    code->GetBufferSize(), NULL, &shader_);
+  code->Release();
+
+  if (FAILED(hr))
+    return false;
+
+  D3D11_SAMPLER_DESC sampler;
+  memset(&sampler, 0, sizeof sampler);
+
+  sampler.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+  sampler.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+  sampler.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+  sampler.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+  sampler.ComparisonFunc = D3D11_COMPARISON_NEVER;
+  sampler.MaxLOD = D3D11_FLOAT32_MAX;
+
+  hr = device_->CreateSamplerState(&sampler, &sampler_);
+
+  if (FAILED(hr))
+    return false;
+
+  D3D11_BUFFER_DESC desc;
+  memset(&desc, 0, sizeof desc);
+
+  desc.ByteWidth = sizeof(ShaderConstants);
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+  hr = device_->CreateBuffer(&desc, NULL, &constants_);
+
+  return SUCCEEDED(hr);
+}
+
+bool GpuColorConverter::CreateSlots() {
+  D3D11_BUFFER_DESC buffer;
+  memset(&buffer, 0, sizeof buffer);
+
+  buffer.ByteWidth = output_size_;
+  buffer.Usage = D3D11_USAGE_DEFAULT;
+  buffer.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+  buffer.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+
+  HRESULT hr = device_->CreateBuffer(&buffer, NULL, &output_);
+
+  if (FAILED(hr))
+    return false;
+
+  D3D11_UNORDERED_ACCESS_VIEW_DESC view;
+  memset(&view, 0, sizeof view);
+
+  view.Format = DXGI_FORMAT_R32_TYPELESS;
+  view.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+  view.Buffer.NumElements = output_size_ / 4;
+  view.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+  hr = device_->CreateUnorderedAccessView(output_, &view, &output_view_);
+
+  if (FAILED(hr))
+    return false;
+
+  buffer.Usage = D3D11_USAGE_STAGING;
+  buffer.BindFlags = 0;
+  buffer.MiscFlags = 0;
+  buffer.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+  const bool nv12 = (src_format_ == kColorFormatNV12);
+  const int planes = nv12 ? 2 : 3;
+
+  D3D11_TEXTURE2D_DESC texture;
+  memset(&texture, 0, sizeof texture);
+
+  texture.MipLevels = 1;
+  texture.ArraySize = 1;
+  texture.SampleDesc.Count = 1;
+  texture.Usage = D3D11_USAGE_DYNAMIC;
+  texture.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  texture.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+  for (int i = 0; i < kSlots; ++i) {
+    Slot& slot = slots_[i];
+
+    hr = device_->CreateBuffer(&buffer, NULL, &slot.staging);
+
+    if (FAILED(hr))
+      return false;
+
+    for (int p = 0; p < planes; ++p) {
+      if (p == 0) {
+        texture.Width = src_width_;
+        texture.Height = src_height_;
+        texture.Format = DXGI_FORMAT_R8_UNORM;
+      } else {
+        texture.Width = (src_width_ + 1) / 2;
+        texture.Height = (src_height_ + 1) / 2;
+        texture.Format = nv12 ? DXGI_FORMAT_R8G8_UNORM : DXGI_FORMAT_R8_UNORM;
+      }
+
+      hr = device_->CreateTexture2D(&texture, NULL, &slot.planes[p]);
+
+      if (FAILED(hr))
+        return false;
+
+      hr = device_->CreateShaderResourceView(slot.planes[p], NULL,
+                                             &slot.views[p]);
+
+      if (FAILED(hr))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void GpuColorConverter::ReleaseSlots() {
+  for (int i = 0; i < kSlots; ++i) {
+    Slot& slot = slots_[i];
+
+    for (int p = 0; p < 3; ++p) {
+      SafeRelease(&slot.views[p]);
+      SafeRelease(&slot.planes[p]);
+    }
+
+    SafeRelease(&slot.staging);
+  }
+
+  SafeRelease(&output_view_);
+  SafeRelease(&output_);
+}
+
+bool GpuColorConverter::WritePlane(ID3D11Texture2D* texture,
+                                   const uint8_t* src, int stride,
+                                   int row_bytes, int rows) {
+  D3D11_MAPPED_SUBRESOURCE mapped;
+
+  const HRESULT hr = context_->Map(texture, 0, D3D11_MAP_WRITE_DISCARD, 0,
+                                   &mapped);
+  if (FAILED(hr))
+    return false;
+
+  uint8_t* dst = static_cast<uint8_t*>(mapped.pData);
+
+  if (stride == row_bytes && mapped.RowPitch == static_cast<UINT>(stride)) {
+    memcpy(dst, src, row_bytes * rows);
+  } else {
+    for (int row = 0; row < rows; ++row) {
+      memcpy(dst, src, row_bytes);
+      dst += mapped.RowPitch;
+      src += stride;
+    }
+  }
+
+  context_->Unmap(texture, 0);
+  return true;
+}
+
+bool GpuColorConverter::Submit(const uint8_t* src) {
+  if (output_ == NULL || src == NULL || pending_ >= kSlots) {
+    assert(output_ && src && pending_ < kSlots);
+    return false;
+  }
+
+  LARGE_INTEGER start;
+  QueryPerformanceCounter(&start);
+
+  Slot& slot = slots_[next_];
+
+  const int chroma_width = (src_width_ + 1) / 2;
+  const int chroma_height = (src_height_ + 1) / 2;
+  const uint8_t* const chroma = src + src_stride_ * src_height_;
+
+  bool b = WritePlane(slot.planes[0], src, src_stride_, src_width_,
+                      src_height_);
+
+  if (src_format_ == kColorFormatNV12) {
+    b = b && WritePlane(slot.planes[1], chroma, src_stride_,
+                        2 * chroma_width, chroma_height);
+  } else {
+    const int chroma_stride = (src_stride_ + 1) / 2;
+    const uint8_t* const first = chroma;
+    const uint8_t* const second = first + chroma_stride * chroma_height;
+    const bool i420 = (src_format_ == kColorFormatI420);
+
+    b = b && WritePlane(slot.planes[1], i420 ? first : second,
+                        chroma_stride, chroma_width, chroma_height);
+    b = b && WritePlane(slot.planes[2], i420 ? second : first,
+                        chroma_stride, chroma_width, chroma_height);
+  }
+
+  if (!b)
+    return false;
+
+  const UINT columns = (dst_width_ + kPixelsPerThread - 1) /
+                       kPixelsPerThread;
+
+  context_->CSSetShader(shader_, NULL, 0);
+  context_->CSSetConstantBuffers(0, 1, &constants_);
+  context_->CSSetSamplers(0, 1, &sampler_);
+  context_->CSSetShaderResources(0, 3, slot.views);
+  context_->CSSetUnorderedAccessViews(0, 1, &output_view_, NULL);
+
+  context_->Dispatch((columns + kThreadsX - 1) / kThreadsX,
+                     (dst_height_ + kThreadsY - 1) / kThreadsY, 1);
+
+  ID3D11UnorderedAccessView* const no_view = NULL;
+  context_->CSSetUnorderedAccessViews(0, 1, &no_view, NULL);
+
+  context_->CopyResource(slot.staging, output_);
+
+  // Start the GPU now, rather than when the readback maps the staging
+  // buffer, which would then wait for all of the frame's work.
+  context_->Flush();
+
+  slot.submit_us = GetElapsedUs(start);
+
+  next_ = (next_ + 1) % kSlots;
+  ++pending_;
+
+  return true;
+}
+
+bool GpuColorConverter::Retrieve(uint8_t* dst) {
+  if (pending_ <= 0 || dst == NULL) {
+    assert(pending_ > 0 && dst);
+    return false;
+  }
+
+  LARGE_INTEGER start;
+  QueryPerformanceCounter(&start);
+
+  Slot& slot = slots_[(next_ + kSlots - pending_) % kSlots];
+  --pending_;
+
+  D3D11_MAPPED_SUBRESOURCE mapped;
+
+  const HRESULT hr = context_->Map(slot.staging, 0, D3D11_MAP_READ, 0,
+                                   &mapped);
+  if (FAILED(hr))
+    return false;
+
+  memcpy(dst, mapped.pData, output_size_);
+  context_->Unmap(slot.staging, 0);
+
+  const int64_t us = slot.submit_us + GetElapsedUs(start);
+
+  ++frames_;
+  last_us_ = us;
+  total_us_ += us;
+
+  if (us > max_us_)
+    max_us_ = us;
+
+  return true;
+}
+
+void GpuColorConverter::GetStats(ColorConverter::Stats* stats) const {
+  stats->frames = frames_;
+  stats->last_us = last_us_;
+  stats->total_us = total_us_;
+  stats->max_us = max_us_;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,141 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_GPUCOLORCONVERTER_H_
+#define WEBMDSHOW_COMMON_GPUCOLORCONVERTER_H_
+
+#include <stdint.h>
+#include <windows.h>
+#include <d3d11.h>
+
+#include <atomic>
+
+#include "colorconverter.h"
+#include "yuvtorgb.h"
+
+namespace webmdshow {
+
+// Converts and scales frames with a Direct3D 11 compute shader, for frames
+// too large for ColorConverter to keep up with on the CPU. The planes of
+// each frame are written into dynamic textures, a set for each frame in
+// flight, and one dispatch samples them bilinearly at the output size,
+// converts to RGB and writes the rows to a raw buffer, laid out as
+// DirectShow lays them out. That buffer is copied to one of a ring of
+// staging buffers, which is read back kLatency frames later: by then the
+// GPU is done with it, so neither the upload nor the readback waits.
+//
+// A caller submits a frame, and once more than kLatency are pending,
+// retrieves the oldest; at the end of the stream, it retrieves the rest.
+//
+// Only I420, YV12 and NV12 to RGB32 or RGB24 are converted. Init fails for
+// other pairs, and on a machine with no hardware adapter of feature level
+// 11_0, so that the caller can fall back to ColorConverter. Not thread
+// safe, but a converter may be initialized on one thread and used on
+// another.
+class GpuColorConverter {
+ public:
+  enum {
+    kLatency = 2,            // frames submitted before a readback
+    kSlots = kLatency + 1,   // frames that may be pending at once
+  };
+
+  GpuColorConverter();
+  ~GpuColorConverter();
+
+  // As ColorConverter::set_yuv_matrix; takes effect at the next Init.
+  void set_yuv_matrix(YuvMatrix matrix, YuvRange range) {
+    yuv_matrix_ = matrix;
+    yuv_range_ = range;
+  }
+
+  // Whether Init can convert |src_format| to |dst_format|, given a device.
+  static bool IsSupported(ColorFormat src_format, ColorFormat dst_format);
+
+  // Prepares the conversion of |src_width|x|src_height| frames of
+  // |src_format| to |dst_width|x|dst_height| frames of |dst_format|,
+  // scaling the whole picture. The strides are those of the first plane,
+  // as for ColorConverter::Init; the RGB stride must be a multiple of 4.
+  // Creates the device the first time. Pending frames are discarded.
+  // Returns false if the pair, a size or a stride is unsupported, or if no
+  // suitable adapter is present.
+  bool Init(ColorFormat src_format, int src_stride, int src_width,
+            int src_height, ColorFormat dst_format, int dst_stride,
+            int dst_width, int dst_height);
+
+  // Releases the device and everything made on it.
+  void Close();
+
+  // Uploads the frame at |src| and dispatches its conversion. Returns
+  // false, and leaves the frame out, if kSlots frames are pending or the
+  // device fails.
+  bool Submit(const uint8_t* src);
+
+  // Copies the oldest pending frame to |dst|, waiting for the GPU if it
+  // is not done yet. Returns false if none is pending or the device fails.
+  bool Retrieve(uint8_t* dst);
+
+  // Forgets the pending frames, as at a flush.
+  void Discard() { pending_ = 0; }
+
+  int pending() const { return pending_; }
+
+  // As ColorConverter::GetStats, timing the CPU's part of each frame: its
+  // upload, dispatch and readback. May be called from any thread.
+  void GetStats(ColorConverter::Stats* stats) const;
+
+ private:
+  // The staging buffer and plane textures of one frame in flight.
+  struct Slot {
+    ID3D11Texture2D* planes[3];
+    ID3D11ShaderResourceView* views[3];
+    ID3D11Buffer* staging;
+    int64_t submit_us;  // the CPU time taken by Submit
+  };
+
+  bool CreateDevice();
+  bool CreatePipeline();
+  bool CreateSlots();
+  void ReleaseSlots();
+  bool WritePlane(ID3D11Texture2D* texture, const uint8_t* src, int stride,
+                  int row_bytes, int rows);
+
+  ID3D11Device* device_;
+  ID3D11DeviceContext* context_;
+  ID3D11ComputeShader* shader_;
+  ID3D11SamplerState* sampler_;
+  ID3D11Buffer* constants_;
+  ID3D11Buffer* output_;
+  ID3D11UnorderedAccessView* output_view_;
+
+  Slot slots_[kSlots];
+  int next_;     // the slot the next Submit writes
+  int pending_;
+
+  ColorFormat src_format_;
+  int src_stride_;
+  int src_width_;
+  int src_height_;
+  int dst_width_;
+  int dst_height_;
+  int output_size_;  // bytes in an output frame
+
+  YuvMatrix yuv_matrix_;
+  YuvRange yuv_range_;
+
+  std::atomic<int64_t> frames_;
+  std::atomic<int64_t> last_us_;
+  std::atomic<int64_t> total_us_;
+  std::atomic<int64_t> max_us_;
+
+  GpuColorConverter(const GpuColorConverter&);
+  GpuColorConverter& operator=(const GpuColorConverter&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_GPUCOLORCONVERTER_H_
@@ -30,6 +30,7 @@ namespace GraphUtil
     _COM_SMARTPTR_TYPEDEF(IFileSourceFilter, __uuidof(IFileSourceFilter));
     _COM_SMARTPTR_TYPEDEF(IFileSinkFilter, __uuidof(IFileSinkFilter));
     _COM_SMARTPTR_TYPEDEF(IEnumPins, __uuidof(IEnumPins));
+    _COM_SMARTPTR_TYPEDEF(IEnumFilters, __uuidof(IEnumFilters));
     _COM_SMARTPTR_TYPEDEF(IEnumMediaTypes, __uuidof(IEnumMediaTypes));
     _COM_SMARTPTR_TYPEDEF(IFilterMapper2, __uuidof(IFilterMapper2));
     _COM_SMARTPTR_TYPEDEF(IAsyncReader, __uuidof(IAsyncReader));
@@ -42,6 +43,7 @@ namespace GraphUtil
     _COM_SMARTPTR_TYPEDEF(IMediaSeeking, __uuidof(IMediaSeeking));
     _COM_SMARTPTR_TYPEDEF(IMediaSample, __uuidof(IMediaSample));
     _COM_SMARTPTR_TYPEDEF(IMediaEventSink, __uuidof(IMediaEventSink));
+    _COM_SMARTPTR_TYPEDEF(IQualityControl, __uuidof(IQualityControl));
 
     IPinPtr FindPin(IBaseFilter*, PIN_DIRECTION);
     IPinPtr FindPin(
@@ -0,0 +1,350 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "highbitdepth.h"
+
+#include <cassert>
+#include <cstddef>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || \
+    defined(__SSE2__)
+#define WEBMDSHOW_HIGHBITDEPTH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace webmdshow {
+
+namespace {
+
+// The 4x4 Bayer matrix, in sixteenths of a step of the output.
+const uint8_t kBayer[4][4] = {
+  { 0, 8, 2, 10 },
+  { 12, 4, 14, 6 },
+  { 3, 11, 1, 9 },
+  { 15, 7, 13, 5 },
+};
+
+// Fills |thresholds| with what is added to the samples of row |y| before
+// they are shifted down by |shift|, for eight pixels from a multiple of
+// four.
+void GetDitherRow(int y, int shift, uint16_t thresholds[8]) {
+  for (int x = 0; x < 8; ++x) {
+    thresholds[x] =
+        static_cast<uint16_t>((kBayer[y & 3][x & 3] << shift) >> 4);
+  }
+}
+
+const uint16_t* Row16(const vpx_image_t* image, int plane, int y) {
+  return reinterpret_cast<const uint16_t*>(image->planes[plane] +
+                                           y * image->stride[plane]);
+}
+
+uint16_t* Row16(uint8_t* dst, int stride, int y) {
+  return reinterpret_cast<uint16_t*>(dst + y * stride);
+}
+
+void ShiftRow(const uint16_t* src, uint16_t* dst, int n, int shift) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i count = _mm_cvtsi32_si128(shift);
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i s =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_sll_epi16(s, count));
+  }
+#endif
+
+  for (; x < n; ++x)
+    dst[x] = static_cast<uint16_t>(src[x] << shift);
+}
+
+void WidenRow(const uint8_t* src, uint16_t* dst, int n) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i s =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_unpacklo_epi8(zero, s));  // s << 8
+  }
+#endif
+
+  for (; x < n; ++x)
+    dst[x] = static_cast<uint16_t>(src[x] << 8);
+}
+
+void InterleaveRow(const uint16_t* u, const uint16_t* v, uint16_t* dst,
+                   int n, int shift) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i count = _mm_cvtsi32_si128(shift);
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i a = _mm_sll_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x)), count);
+    const __m128i b = _mm_sll_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x)), count);
+
+    __m128i* const out = reinterpret_cast<__m128i*>(dst + 2 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(a, b));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(a, b));
+  }
+#endif
+
+  for (; x < n; ++x) {
+    dst[2 * x] = static_cast<uint16_t>(u[x] << shift);
+    dst[2 * x + 1] = static_cast<uint16_t>(v[x] << shift);
+  }
+}
+
+void WidenInterleaveRow(const uint8_t* u, const uint8_t* v, uint16_t* dst,
+                        int n) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i a = _mm_unpacklo_epi8(
+        zero, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x)));
+    const __m128i b = _mm_unpacklo_epi8(
+        zero, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x)));
+
+    __m128i* const out = reinterpret_cast<__m128i*>(dst + 2 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(a, b));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(a, b));
+  }
+#endif
+
+  for (; x < n; ++x) {
+    dst[2 * x] = static_cast<uint16_t>(u[x] << 8);
+    dst[2 * x + 1] = static_cast<uint16_t>(v[x] << 8);
+  }
+}
+
+inline uint8_t DitherSample(uint16_t s, uint16_t threshold, int shift) {
+  const int d = (s + threshold) >> shift;
+  return static_cast<uint8_t>(d > 255 ? 255 : d);
+}
+
+void DitherRow(const uint16_t* src, uint8_t* dst, int n, int shift,
+               const uint16_t thresholds[8]) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  const __m128i t =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(thresholds));
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i s = _mm_srl_epi16(
+        _mm_adds_epu16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)), t),
+        count);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_packus_epi16(s, s));
+  }
+#endif
+
+  for (; x < n; ++x)
+    dst[x] = DitherSample(src[x], thresholds[x & 7], shift);
+}
+
+void DitherInterleaveRow(const uint16_t* u, const uint16_t* v, uint8_t* dst,
+                         int n, int shift, const uint16_t thresholds[8]) {
+  int x = 0;
+
+#ifdef WEBMDSHOW_HIGHBITDEPTH_SSE2
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  const __m128i t =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(thresholds));
+
+  for (; x + 8 <= n; x += 8) {
+    const __m128i a = _mm_srl_epi16(
+        _mm_adds_epu16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x)), t),
+        count);
+    const __m128i b = _mm_srl_epi16(
+        _mm_adds_epu16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x)), t),
+        count);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * x),
+                     _mm_unpacklo_epi8(_mm_packus_epi16(a, a),
+                                       _mm_packus_epi16(b, b)));
+  }
+#endif
+
+  for (; x < n; ++x) {
+    dst[2 * x] = DitherSample(u[x], thresholds[x & 7], shift);
+    dst[2 * x + 1] = DitherSample(v[x], thresholds[x & 7], shift);
+  }
+}
+
+bool IsI420(const vpx_image_t* image) {
+  return (image->fmt == VPX_IMG_FMT_I420) || (image->fmt == VPX_IMG_FMT_YV12);
+}
+
+}  // namespace
+
+bool IsHighBitDepthI420(const vpx_image_t* image) {
+  return (image->fmt == VPX_IMG_FMT_I42016) && (image->bit_depth >= 8) &&
+         (image->bit_depth <= 16);
+}
+
+bool VpxImageToP010(const vpx_image_t* f,
+                    uint8_t* dst_y, int dst_stride_y,
+                    uint8_t* dst_uv, int dst_stride_uv) {
+  const bool high = IsHighBitDepthI420(f);
+
+  if (!high && !IsI420(f)) {
+    assert(high || IsI420(f));
+    return false;
+  }
+
+  const int width = f->d_w;
+  const int height = f->d_h;
+  const int width_uv = (width + 1) / 2;
+  const int height_uv = (height + 1) / 2;
+
+  if (high) {
+    const int shift = 16 - f->bit_depth;
+
+    for (int y = 0; y < height; ++y) {
+      ShiftRow(Row16(f, VPX_PLANE_Y, y), Row16(dst_y, dst_stride_y, y),
+               width, shift);
+    }
+
+    for (int y = 0; y < height_uv; ++y) {
+      InterleaveRow(Row16(f, VPX_PLANE_U, y), Row16(f, VPX_PLANE_V, y),
+                    Row16(dst_uv, dst_stride_uv, y), width_uv, shift);
+    }
+
+    return true;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    WidenRow(f->planes[VPX_PLANE_Y] + y * f->stride[VPX_PLANE_Y],
+             Row16(dst_y, dst_stride_y, y), width);
+  }
+
+  for (int y = 0; y < height_uv; ++y) {
+    WidenInterleaveRow(f->planes[VPX_PLANE_U] + y * f->stride[VPX_PLANE_U],
+                       f->planes[VPX_PLANE_V] + y * f->stride[VPX_PLANE_V],
+                       Row16(dst_uv, dst_stride_uv, y), width_uv);
+  }
+
+  return true;
+}
+
+bool DitherVpxImageToI420(const vpx_image_t* f,
+                          uint8_t* dst_y, int dst_stride_y,
+                          uint8_t* dst_u, int dst_stride_u,
+                          uint8_t* dst_v, int dst_stride_v) {
+  if (!IsHighBitDepthI420(f)) {
+    assert(IsHighBitDepthI420(f));
+    return false;
+  }
+
+  const int shift = f->bit_depth - 8;
+  const int width = f->d_w;
+  const int height = f->d_h;
+  const int width_uv = (width + 1) / 2;
+  const int height_uv = (height + 1) / 2;
+
+  uint16_t thresholds[8];
+
+  for (int y = 0; y < height; ++y) {
+    GetDitherRow(y, shift, thresholds);
+    DitherRow(Row16(f, VPX_PLANE_Y, y), dst_y + y * dst_stride_y, width,
+              shift, thresholds);
+  }
+
+  for (int y = 0; y < height_uv; ++y) {
+    GetDitherRow(y, shift, thresholds);
+    DitherRow(Row16(f, VPX_PLANE_U, y), dst_u + y * dst_stride_u, width_uv,
+              shift, thresholds);
+    DitherRow(Row16(f, VPX_PLANE_V, y), dst_v + y * dst_stride_v, width_uv,
+              shift, thresholds);
+  }
+
+  return true;
+}
+
+bool DitherVpxImageToNV12(const vpx_image_t* f,
+                          uint8_t* dst_y, int dst_stride_y,
+                          uint8_t* dst_uv, int dst_stride_uv) {
+  if (!IsHighBitDepthI420(f)) {
+    assert(IsHighBitDepthI420(f));
+    return false;
+  }
+
+  const int shift = f->bit_depth - 8;
+  const int width = f->d_w;
+  const int height = f->d_h;
+  const int width_uv = (width + 1) / 2;
+  const int height_uv = (height + 1) / 2;
+
+  uint16_t thresholds[8];
+
+  for (int y = 0; y < height; ++y) {
+    GetDitherRow(y, shift, thresholds);
+    DitherRow(Row16(f, VPX_PLANE_Y, y), dst_y + y * dst_stride_y, width,
+              shift, thresholds);
+  }
+
+  for (int y = 0; y < height_uv; ++y) {
+    GetDitherRow(y, shift, thresholds);
+    DitherInterleaveRow(Row16(f, VPX_PLANE_U, y), Row16(f, VPX_PLANE_V, y),
+                        dst_uv + y * dst_stride_uv, width_uv, shift,
+                        thresholds);
+  }
+
+  return true;
+}
+
+bool DitherVpxImage(const vpx_image_t* f, vpx_image_t** target_image) {
+  if (!IsHighBitDepthI420(f)) {
+    assert(IsHighBitDepthI420(f));
+    return false;
+  }
+
+  vpx_image_t* target = *target_image;
+
+  if (target != NULL && (target->d_w != f->d_w || target->d_h != f->d_h)) {
+    vpx_img_free(target);
+    target = NULL;
+    *target_image = NULL;
+  }
+
+  if (target == NULL) {
+    target = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, f->d_w, f->d_h, 16);
+
+    if (target == NULL) {
+      assert(target && "Out of memory.");
+      return false;
+    }
+
+    *target_image = target;
+  }
+
+  return DitherVpxImageToI420(
+      f,
+      target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+      target->planes[VPX_PLANE_U], target->stride[VPX_PLANE_U],
+      target->planes[VPX_PLANE_V], target->stride[VPX_PLANE_V]);
+}
+
+}  // namespace webmdshow
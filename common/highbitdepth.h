@@ -0,0 +1,58 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_HIGHBITDEPTH_H_
+#define WEBMDSHOW_COMMON_HIGHBITDEPTH_H_
+
+#include <stdint.h>
+
+#include "vpx/vpx_image.h"
+
+// The output of high bit depth frames, as libvpx decodes VP9 profile 2:
+// VPX_IMG_FMT_I42016, one 16-bit sample (of |bit_depth| bits, in the low
+// bits) per pixel of each plane. The rows are converted eight pixels at a
+// time with SSE2 where the build targets it, and in C otherwise, which
+// gives the same output.
+
+namespace webmdshow {
+
+// Returns whether |image| is 4:2:0 of 16-bit samples.
+bool IsHighBitDepthI420(const vpx_image_t* image);
+
+// Writes the visible area of |image| as P010 or P016: a plane of 16-bit Y,
+// then one of interleaved 16-bit U and V, each sample in the most
+// significant bits, so 10 and 12 bits are written the same way. |image|
+// may be VPX_IMG_FMT_I42016, or 8-bit I420 or YV12, which is widened. The
+// strides are in bytes. Returns false for any other format.
+bool VpxImageToP010(const vpx_image_t* image,
+                    uint8_t* dst_y, int dst_stride_y,
+                    uint8_t* dst_uv, int dst_stride_uv);
+
+// Writes the visible area of |image|, which must be VPX_IMG_FMT_I42016, as
+// 8-bit I420 planes, with an ordered (4x4 Bayer) dither instead of
+// truncation so that gradients don't band. Returns false for any other
+// format.
+bool DitherVpxImageToI420(const vpx_image_t* image,
+                          uint8_t* dst_y, int dst_stride_y,
+                          uint8_t* dst_u, int dst_stride_u,
+                          uint8_t* dst_v, int dst_stride_v);
+
+// As DitherVpxImageToI420, to NV12: U and V interleaved in one plane.
+bool DitherVpxImageToNV12(const vpx_image_t* image,
+                          uint8_t* dst_y, int dst_stride_y,
+                          uint8_t* dst_uv, int dst_stride_uv);
+
+// As DitherVpxImageToI420, into |*target|, an I420 image the size of
+// |image|, which is allocated (or reallocated, when the size changed) if
+// necessary. Caller owns any allocated memory. For the outputs that only
+// have 8-bit kernels: scaling, packed 4:2:2 and RGB.
+bool DitherVpxImage(const vpx_image_t* image, vpx_image_t** target);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_HIGHBITDEPTH_H_
@@ -0,0 +1,31 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+//Exposed by the source filter when it reads from a URL, to report what
+//its range requests fetched, and how much its disk cache saved.  Returns
+//S_FALSE (and zeroes) for a local file.
+
+[
+    uuid(ED311124-5211-11DF-94AF-0026B977EEAA)
+]
+interface IHttpSourceStats : IUnknown
+{
+    struct HttpStats
+    {
+        LONGLONG bytes_fetched;  //over the network
+        LONGLONG requests;  //range requests made
+        LONGLONG cache_hits;  //reads served from the disk cache
+        LONGLONG cache_misses;  //reads that had to fetch first
+        LONGLONG bytes_cached;  //in the cache file, for this URL
+    };
+
+    virtual HRESULT STDMETHODCALLTYPE GetHttpStats(HttpStats*) = 0;
+};
@@ -0,0 +1,25 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "pipelinecounters.h"
+
+//Exposed by the webmdshow filters, to read their PipelineCounters from
+//within the process: one stage per filter, or per stream for the splitter.
+
+[
+    uuid(ED31111A-5211-11DF-94AF-0026B977EEAA)
+]
+interface IPipelineCounters : IUnknown
+{
+    typedef webmdshow::PipelineCounters::Stats Stats;
+
+    virtual HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*) = 0;
+    virtual HRESULT STDMETHODCALLTYPE ResetStages() = 0;
+};
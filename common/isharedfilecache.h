@@ -0,0 +1,28 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "sharedfilecache.h"
+
+//Exposed by the splitter, to control the webmdshow::SharedFileCache of
+//its module.  The limit is for the module, not the filter instance: set
+//it before the inpins of the splitters that are to share a file connect.
+
+[
+    uuid(ED311139-5211-11DF-94AF-0026B977EEAA)
+]
+interface ISharedFileCache : IUnknown
+{
+    typedef webmdshow::SharedFileCache::Stats SharedCacheStats;
+
+    //0 turns the cache off (the default), and empties it.
+    virtual HRESULT STDMETHODCALLTYPE SetSharedCacheLimit(LONGLONG) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetSharedCacheLimit(LONGLONG*) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetSharedCacheStats(
+                                        SharedCacheStats*) = 0;
+};
@@ -23,6 +23,7 @@ interface IVP8Sample : IUnknown
         bool key;
         REFERENCE_TIME start;
         REFERENCE_TIME stop;
+        int layer;  //temporal layer, or -1 when the stream has none
     };
 
     virtual Frame& GetFrame() = 0;
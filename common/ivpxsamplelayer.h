@@ -0,0 +1,25 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+
+//Exposed by the samples of a VPx encoder whose stream has temporal layers
+//(the samples of the VP8 encoder filter do), so that the muxer can record
+//the layer of each frame.  A frame of layer N refers only to frames of
+//layers 0 to N, so that the frames of the layers above some layer may be
+//dropped without decoding the rest.
+
+[
+    uuid(ED311128-5211-11DF-94AF-0026B977EEAA)
+]
+interface IVPXSampleLayer : IUnknown
+{
+    //Returns S_OK and the layer of the frame, 0 for the base layer, or
+    //S_FALSE when the stream has no temporal layers.
+    virtual HRESULT STDMETHODCALLTYPE GetTemporalLayer(int* pLayer) = 0;
+};
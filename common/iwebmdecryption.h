@@ -0,0 +1,30 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+
+//Exposed by the splitter, to give it the keys of encrypted WebM tracks
+//(ContentEncryption, AES-128 in CTR mode).  The splitter decrypts the
+//frames as it reads them into its samples, so downstream sees clear
+//frames.  A key is for the tracks whose ContentEncKeyID is key_id, and
+//is kept by the filter for the streams it creates later, so it can be
+//set before the inpin connects.  Set keys while the filter is stopped.
+
+[
+    uuid(ED311126-5211-11DF-94AF-0026B977EEAA)
+]
+interface IWebmDecryption : IUnknown
+{
+    enum { kKeySize = 16 };
+
+    //key is kKeySize bytes.
+    virtual HRESULT STDMETHODCALLTYPE SetDecryptionKey(
+                                        const BYTE* key_id,
+                                        ULONG key_id_len,
+                                        const BYTE* key) = 0;
+};
@@ -0,0 +1,29 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+
+//Exposed by the muxer, to encrypt the video track (ContentEncryption,
+//AES-128 in CTR mode) with the key named key_id, which the splitter's
+//IWebmDecryption is then given.  Each frame is encrypted as its block is
+//written.  A key of 0 turns encryption off.  Set while the filter is
+//stopped.
+
+[
+    uuid(ED311127-5211-11DF-94AF-0026B977EEAA)
+]
+interface IWebmEncryption : IUnknown
+{
+    enum { kKeySize = 16, kMaxKeyIdSize = 64 };
+
+    //key is kKeySize bytes.
+    virtual HRESULT STDMETHODCALLTYPE SetEncryptionKey(
+                                        const BYTE* key_id,
+                                        ULONG key_id_len,
+                                        const BYTE* key) = 0;
+};
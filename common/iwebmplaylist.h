@@ -0,0 +1,31 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+//Exposed by the source filter, to play local files one after another
+//without rebuilding the graph.  While a file plays, the filter opens the
+//next one queued in the background, and parses its headers and first
+//cluster.  As each outpin reaches the end of the file, it carries on
+//with the matching track of the next, with times that continue from the
+//first, and with no flush, reconnect or end of stream in between.  If
+//the next file's tracks don't match the connections (in number, type and
+//media type), the pins report end of stream as before, and the file
+//stays queued, for the application to Load in a new graph.  Seeking and
+//positions apply to the file playing.
+
+[
+    uuid(ED311125-5211-11DF-94AF-0026B977EEAA)
+]
+interface IWebmPlaylist : IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE QueueFile(LPCOLESTR) = 0;
+    virtual HRESULT STDMETHODCALLTYPE ClearQueue() = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetQueueLength(ULONG*) = 0;
+};
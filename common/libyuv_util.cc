@@ -8,24 +8,71 @@
 
 #include "libyuv_util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 
+#include "cpuutil.h"
 #include "libyuv.h"
+#include "taskpool.h"
 
 namespace webmdshow {
 
-bool LibyuvScaleI420(uint32_t width, uint32_t height,
-                     const vpx_image_t* source, vpx_image_t** target_image) {
-  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
-    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+namespace {
+
+libyuv::FilterMode GetFilterMode(ScaleFilter filter) {
+  switch (filter) {
+    case kScaleFilterNone:
+      return libyuv::kFilterNone;
+    case kScaleFilterBilinear:
+      return libyuv::kFilterBilinear;
+    case kScaleFilterBox:
+    default:
+      return libyuv::kFilterBox;
+  }
+}
+
+// Scales |src_rows| rows of |source| from |src_y|, which must be even, to
+// |dst_rows| rows of the destination from |dst_y|, also even.
+bool ScaleRows(const vpx_image_t* source, int src_y, int src_rows,
+               uint8_t* dst_y, int dst_stride_y,
+               uint8_t* dst_u, int dst_stride_u,
+               uint8_t* dst_v, int dst_stride_v,
+               int width, int dst_row, int dst_rows, ScaleFilter filter) {
+  assert(src_y % 2 == 0 && dst_row % 2 == 0);
+
+  const int src_stride_y = source->stride[VPX_PLANE_Y];
+  const int src_stride_u = source->stride[VPX_PLANE_U];
+  const int src_stride_v = source->stride[VPX_PLANE_V];
+
+  const int scale_status = libyuv::I420Scale(
+      source->planes[VPX_PLANE_Y] + src_y * src_stride_y, src_stride_y,
+      source->planes[VPX_PLANE_U] + src_y / 2 * src_stride_u, src_stride_u,
+      source->planes[VPX_PLANE_V] + src_y / 2 * src_stride_v, src_stride_v,
+      source->d_w, src_rows,
+      dst_y + dst_row * dst_stride_y, dst_stride_y,
+      dst_u + dst_row / 2 * dst_stride_u, dst_stride_u,
+      dst_v + dst_row / 2 * dst_stride_v, dst_stride_v,
+      width, dst_rows,
+      GetFilterMode(filter));
+  if (scale_status != 0) {
+    assert(scale_status == 0 && "libyuv::I420Scale failed.");
     return false;
   }
 
+  return true;
+}
+
+// Allocates |*target_image| for |source| scaled to |width|x|height|, unless
+// it is already that size.
+bool AllocateTarget(uint32_t width, uint32_t height,
+                    const vpx_image_t* source, vpx_image_t** target_image) {
   vpx_image_t* target = *target_image;
   if (target != NULL && (target->d_h != height || target->d_w != width)) {
     // The libvpx output image size changed; realloc needed.
     vpx_img_free(target);
     target = NULL;
+    *target_image = NULL;
   }
 
   if (target == NULL) {
@@ -36,22 +83,437 @@ bool LibyuvScaleI420(uint32_t width, uint32_t height,
     }
   }
 
-  const int scale_status = libyuv::I420Scale(
+  *target_image = target;
+  return true;
+}
+
+int Gcd(int a, int b) {
+  while (b != 0) {
+    const int r = a % b;
+    a = b;
+    b = r;
+  }
+
+  return a;
+}
+
+}  // namespace
+
+ScaleFilter GetPlaybackScaleFilter(int src_width, int src_height,
+                                   int width, int height) {
+  if (width * 2 <= src_width && height * 2 <= src_height)
+    return kScaleFilterBox;
+
+  return kScaleFilterBilinear;
+}
+
+bool LibyuvScaleI420(uint32_t width, uint32_t height,
+                     const vpx_image_t* source, vpx_image_t** target_image,
+                     ScaleFilter filter) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (!AllocateTarget(width, height, source, target_image))
+    return false;
+
+  vpx_image_t* const target = *target_image;
+
+  return LibyuvScaleI420ToPlanes(
+      source,
+      target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+      target->planes[VPX_PLANE_U], target->stride[VPX_PLANE_U],
+      target->planes[VPX_PLANE_V], target->stride[VPX_PLANE_V],
+      target->d_w, target->d_h, filter);
+}
+
+bool LibyuvScaleI420ToPlanes(const vpx_image_t* source,
+                             uint8_t* dst_y, int dst_stride_y,
+                             uint8_t* dst_u, int dst_stride_u,
+                             uint8_t* dst_v, int dst_stride_v,
+                             int width, int height, ScaleFilter filter) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  return ScaleRows(source, 0, source->d_h,
+                   dst_y, dst_stride_y, dst_u, dst_stride_u,
+                   dst_v, dst_stride_v, width, 0, height, filter);
+}
+
+bool LibyuvScaleLuma(const vpx_image_t* source,
+                     uint8_t* dst_y, int dst_stride_y,
+                     int width, int height, ScaleFilter filter) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (width <= 0 || height <= 0)
+    return false;
+
+  libyuv::ScalePlane(source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+                     source->d_w, source->d_h,
+                     dst_y, dst_stride_y, width, height,
+                     GetFilterMode(filter));
+
+  return true;
+}
+
+LibyuvScaler::LibyuvScaler()
+    : filter_(kScaleFilterBox),
+      requested_bands_(0),
+      src_width_(0),
+      src_height_(0),
+      width_(0),
+      height_(0) {
+}
+
+void LibyuvScaler::set_band_count(int band_count) {
+  requested_bands_ = band_count;
+  bands_.clear();  // so that Prepare works them out again
+}
+
+bool LibyuvScaler::Scale(uint32_t width, uint32_t height,
+                         const vpx_image_t* source, vpx_image_t** target) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (!AllocateTarget(width, height, source, target))
+    return false;
+
+  vpx_image_t* const t = *target;
+
+  return ScaleToPlanes(source,
+                       t->planes[VPX_PLANE_Y], t->stride[VPX_PLANE_Y],
+                       t->planes[VPX_PLANE_U], t->stride[VPX_PLANE_U],
+                       t->planes[VPX_PLANE_V], t->stride[VPX_PLANE_V],
+                       t->d_w, t->d_h);
+}
+
+bool LibyuvScaler::ScaleToPlanes(const vpx_image_t* source,
+                                 uint8_t* dst_y, int dst_stride_y,
+                                 uint8_t* dst_u, int dst_stride_u,
+                                 uint8_t* dst_v, int dst_stride_v,
+                                 int width, int height) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (width <= 0 || height <= 0) {
+    assert(width > 0 && height > 0);
+    return false;
+  }
+
+  Prepare(source->d_w, source->d_h, width, height);
+
+  if (bands_.size() <= 1) {
+    return ScaleRows(source, 0, source->d_h,
+                     dst_y, dst_stride_y, dst_u, dst_stride_u,
+                     dst_v, dst_stride_v, width, 0, height, filter_);
+  }
+
+  std::atomic<int> failed_bands(0);
+  const ScaleFilter filter = filter_;
+
+  // This thread scales the first band, so one fewer task is needed.
+  TaskGroup group(TaskPool::GetShared());
+
+  for (size_t i = 1; i < bands_.size(); ++i) {
+    const Band band = bands_[i];
+
+    group.Run([=, &failed_bands]() {
+      if (!ScaleRows(source, band.src_y, band.src_rows,
+                     dst_y, dst_stride_y, dst_u, dst_stride_u,
+                     dst_v, dst_stride_v,
+                     width, band.dst_y, band.dst_rows, filter)) {
+        ++failed_bands;
+      }
+    });
+  }
+
+  const Band& first = bands_[0];
+
+  if (!ScaleRows(source, first.src_y, first.src_rows,
+                 dst_y, dst_stride_y, dst_u, dst_stride_u,
+                 dst_v, dst_stride_v,
+                 width, first.dst_y, first.dst_rows, filter)) {
+    ++failed_bands;
+  }
+
+  group.Wait();
+
+  return failed_bands == 0;
+}
+
+int LibyuvScaler::GetBandCount(int src_width, int src_height, int width,
+                               int height, int processors) {
+  const int64_t kMinBandPixels = 1 << 19;
+  const int kMaxBands = 16;
+
+  if (processors <= 1 || src_width <= 0 || src_height <= 0 || width <= 0 ||
+      height <= 0) {
+    return 1;
+  }
+
+  const int64_t pixels =
+      std::max(static_cast<int64_t>(src_width) * src_height,
+               static_cast<int64_t>(width) * height);
+
+  int bands = static_cast<int>(std::min<int64_t>(pixels / kMinBandPixels,
+                                                 kMaxBands));
+
+  bands = std::min(bands, processors);
+  bands = std::min(bands, height / 2);
+
+  return std::max(bands, 1);
+}
+
+void LibyuvScaler::Prepare(int src_width, int src_height, int width,
+                           int height) {
+  if (!bands_.empty() && src_width == src_width_ &&
+      src_height == src_height_ && width == width_ && height == height_) {
+    return;
+  }
+
+  src_width_ = src_width;
+  src_height_ = src_height;
+  width_ = width;
+  height_ = height;
+
+  bands_.clear();
+
+  int count = requested_bands_;
+
+  if (count <= 0) {
+    count = GetBandCount(src_width, src_height, width, height,
+                         GetLogicalProcessorCount());
+  }
+
+  // The fewest output rows that are scaled from a whole number of source
+  // rows, both even, so that the chroma rows line up as well.
+  const int gcd = Gcd(src_height, height);
+
+  int dst_step = height / gcd;
+  int src_step = src_height / gcd;
+
+  if (dst_step % 2 != 0 || src_step % 2 != 0) {
+    dst_step *= 2;
+    src_step *= 2;
+  }
+
+  const int steps = height / dst_step;
+  count = std::min(count, steps);
+
+  if (count <= 1) {
+    const Band band = { 0, src_height, 0, height };
+    bands_.push_back(band);
+    return;
+  }
+
+  const int band_steps = (steps + count - 1) / count;
+
+  for (int step = 0; step < steps; step += band_steps) {
+    Band band;
+    band.src_y = step * src_step;
+    band.dst_y = step * dst_step;
+
+    if (step + band_steps >= steps) {
+      // The last band takes the rest, odd rows included.
+      band.src_rows = src_height - band.src_y;
+      band.dst_rows = height - band.dst_y;
+    } else {
+      band.src_rows = band_steps * src_step;
+      band.dst_rows = band_steps * dst_step;
+    }
+
+    bands_.push_back(band);
+  }
+}
+
+bool LibyuvI420ToNV12(const vpx_image_t* source,
+                      uint8_t* dst_y, int dst_stride_y,
+                      uint8_t* dst_uv, int dst_stride_uv) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  const int status = libyuv::I420ToNV12(
       source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
       source->planes[VPX_PLANE_U], source->stride[VPX_PLANE_U],
       source->planes[VPX_PLANE_V], source->stride[VPX_PLANE_V],
-      source->d_w, source->d_h,
-      target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+      dst_y, dst_stride_y,
+      dst_uv, dst_stride_uv,
+      source->d_w, source->d_h);
+  if (status != 0) {
+    assert(status == 0 && "libyuv::I420ToNV12 failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool LibyuvNV12ChromaToI420(const uint8_t* src_uv, int src_stride_uv,
+                            int width, int height, vpx_image_t* target) {
+  if (target->fmt != VPX_IMG_FMT_I420 && target->fmt != VPX_IMG_FMT_YV12) {
+    assert(target->fmt == VPX_IMG_FMT_I420 || target->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (width <= 0 || height <= 0 ||
+      static_cast<unsigned int>(width) > target->d_w ||
+      static_cast<unsigned int>(height) > target->d_h) {
+    assert(false && "Bad NV12 frame size.");
+    return false;
+  }
+
+  libyuv::SplitUVPlane(
+      src_uv, src_stride_uv,
       target->planes[VPX_PLANE_U], target->stride[VPX_PLANE_U],
       target->planes[VPX_PLANE_V], target->stride[VPX_PLANE_V],
-      target->d_w, target->d_h,
-      libyuv::kFilterBox);
-  if (scale_status != 0) {
-    assert(scale_status == 0 && "libyuv::I420Scale failed.");
+      (width + 1) / 2, (height + 1) / 2);
+
+  return true;
+}
+
+bool LibyuvI420ToPacked(const vpx_image_t* source, PackedYuvFormat format,
+                        uint8_t* dst, int dst_stride) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  const uint8_t* src_u = source->planes[VPX_PLANE_U];
+  int src_stride_u = source->stride[VPX_PLANE_U];
+
+  const uint8_t* src_v = source->planes[VPX_PLANE_V];
+  int src_stride_v = source->stride[VPX_PLANE_V];
+
+  if (format == kPackedYuvYVYU) {
+    // YVYU is YUY2 with the chroma samples swapped.
+    std::swap(src_u, src_v);
+    std::swap(src_stride_u, src_stride_v);
+  }
+
+  int status;
+
+  if (format == kPackedYuvUYVY) {
+    status = libyuv::I420ToUYVY(
+        source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+        src_u, src_stride_u, src_v, src_stride_v,
+        dst, dst_stride, source->d_w, source->d_h);
+  } else {
+    status = libyuv::I420ToYUY2(
+        source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+        src_u, src_stride_u, src_v, src_stride_v,
+        dst, dst_stride, source->d_w, source->d_h);
+  }
+
+  if (status != 0) {
+    assert(status == 0 && "libyuv::I420ToYUY2/I420ToUYVY failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool LibyuvPackedToI420(const uint8_t* src, int src_stride,
+                        PackedYuvFormat format, int width, int height,
+                        vpx_image_t* target) {
+  if (target->fmt != VPX_IMG_FMT_I420 && target->fmt != VPX_IMG_FMT_YV12) {
+    assert(target->fmt == VPX_IMG_FMT_I420 || target->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (width <= 0 || height <= 0 ||
+      static_cast<unsigned int>(width) > target->d_w ||
+      static_cast<unsigned int>(height) > target->d_h) {
+    assert(false && "Bad packed frame size.");
+    return false;
+  }
+
+  uint8_t* dst_u = target->planes[VPX_PLANE_U];
+  int dst_stride_u = target->stride[VPX_PLANE_U];
+
+  uint8_t* dst_v = target->planes[VPX_PLANE_V];
+  int dst_stride_v = target->stride[VPX_PLANE_V];
+
+  if (format == kPackedYuvYVYU) {
+    // YVYU is YUY2 with the chroma samples swapped.
+    std::swap(dst_u, dst_v);
+    std::swap(dst_stride_u, dst_stride_v);
+  }
+
+  int status;
+
+  if (format == kPackedYuvUYVY) {
+    status = libyuv::UYVYToI420(
+        src, src_stride,
+        target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+        dst_u, dst_stride_u, dst_v, dst_stride_v,
+        width, height);
+  } else {
+    status = libyuv::YUY2ToI420(
+        src, src_stride,
+        target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+        dst_u, dst_stride_u, dst_v, dst_stride_v,
+        width, height);
+  }
+
+  if (status != 0) {
+    assert(status == 0 && "libyuv::YUY2ToI420/UYVYToI420 failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool LibyuvRgbToI420(const uint8_t* src, int src_stride, RgbFormat format,
+                     int width, int height, vpx_image_t* target) {
+  if (target->fmt != VPX_IMG_FMT_I420 && target->fmt != VPX_IMG_FMT_YV12) {
+    assert(target->fmt == VPX_IMG_FMT_I420 || target->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  const int abs_height = (height < 0) ? -height : height;
+
+  if (width <= 0 || abs_height == 0 ||
+      static_cast<unsigned int>(width) > target->d_w ||
+      static_cast<unsigned int>(abs_height) > target->d_h) {
+    assert(false && "Bad RGB frame size.");
+    return false;
+  }
+
+  // libyuv reads the rows in reverse when the height is negative.
+  int status;
+
+  if (format == kRgbFormatRGB24) {
+    status = libyuv::RGB24ToI420(
+        src, src_stride,
+        target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+        target->planes[VPX_PLANE_U], target->stride[VPX_PLANE_U],
+        target->planes[VPX_PLANE_V], target->stride[VPX_PLANE_V],
+        width, height);
+  } else {
+    status = libyuv::ARGBToI420(
+        src, src_stride,
+        target->planes[VPX_PLANE_Y], target->stride[VPX_PLANE_Y],
+        target->planes[VPX_PLANE_U], target->stride[VPX_PLANE_U],
+        target->planes[VPX_PLANE_V], target->stride[VPX_PLANE_V],
+        width, height);
+  }
+
+  if (status != 0) {
+    assert(status == 0 && "libyuv::ARGBToI420/RGB24ToI420 failed.");
     return false;
   }
 
-  *target_image = target;
   return true;
 }
 
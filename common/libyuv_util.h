@@ -11,15 +11,165 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include "vpx/vpx_image.h"
 
 namespace webmdshow {
 
+enum ScaleFilter {
+  kScaleFilterNone,      // point sampling: the fastest, and aliases
+  kScaleFilterBilinear,  // for upscales, and downscales by less than half
+  kScaleFilterBox,       // averages every source pixel; the best downscale
+};
+
+// Returns the filter for scaling frames for playback from
+// |src_width|x|src_height| to |width|x|height|: box for downscales by half
+// or more, for which libyuv has fast paths, and bilinear otherwise, which
+// costs little more than point sampling.
+ScaleFilter GetPlaybackScaleFilter(int src_width, int src_height,
+                                   int width, int height);
+
 // Scales |source| to |width|x|height|. |source| must be VPX_IMG_FMT_I420 or
 // VPX_IMG_FMT_YV12. |target| will be allocated if necessary. Caller owns
 // any allocated memory. Returns true upon success.
 bool LibyuvScaleI420(uint32_t width, uint32_t height,
-                     const vpx_image_t* source, vpx_image_t** target);
+                     const vpx_image_t* source, vpx_image_t** target,
+                     ScaleFilter filter = kScaleFilterBox);
+
+// Scales |source| to |width|x|height| straight into the caller's planes,
+// which saves a copy when the result is wanted in a buffer the caller
+// already has, such as a media sample. |dst_u| and |dst_v| are
+// (|width| + 1) / 2 by (|height| + 1) / 2. Same requirements as
+// LibyuvScaleI420.
+bool LibyuvScaleI420ToPlanes(const vpx_image_t* source,
+                             uint8_t* dst_y, int dst_stride_y,
+                             uint8_t* dst_u, int dst_stride_u,
+                             uint8_t* dst_v, int dst_stride_v,
+                             int width, int height,
+                             ScaleFilter filter = kScaleFilterBox);
+
+// Scales the Y plane of |source| alone to |width|x|height| at |dst_y|, for
+// outputs with no chroma. Same requirements as LibyuvScaleI420.
+bool LibyuvScaleLuma(const vpx_image_t* source,
+                     uint8_t* dst_y, int dst_stride_y,
+                     int width, int height,
+                     ScaleFilter filter = kScaleFilterBox);
+
+// Scales I420 frames as LibyuvScaleI420 does, for a caller that scales
+// many frames: what depends only on the sizes is worked out when they
+// change, not for each frame.
+//
+// Large frames are split into horizontal bands of output rows, scaled in
+// parallel on the process's shared TaskPool. A scale returns once every
+// band is done. The bands start where a source row and an output row
+// line up (chroma rows too), so each band is scaled as the same rows of
+// the whole frame would be; only the bilinear filter, which clamps at the
+// edges of what it is given, can differ by a level in the rows next to a
+// band edge. Sizes whose rows never line up are scaled in one band.
+class LibyuvScaler {
+ public:
+  LibyuvScaler();
+
+  void set_filter(ScaleFilter filter) { filter_ = filter; }
+  ScaleFilter filter() const { return filter_; }
+
+  // Sets the number of bands frames are split into at most. Zero, the
+  // default, picks a count with GetBandCount; one scales on the calling
+  // thread.
+  void set_band_count(int band_count);
+
+  // Returns the number of bands the last frame was split into.
+  int band_count() const { return static_cast<int>(bands_.size()); }
+
+  // As LibyuvScaleI420, with the scaler's filter.
+  bool Scale(uint32_t width, uint32_t height, const vpx_image_t* source,
+             vpx_image_t** target);
+
+  // As LibyuvScaleI420ToPlanes, with the scaler's filter.
+  bool ScaleToPlanes(const vpx_image_t* source,
+                     uint8_t* dst_y, int dst_stride_y,
+                     uint8_t* dst_u, int dst_stride_u,
+                     uint8_t* dst_v, int dst_stride_v,
+                     int width, int height);
+
+  // Returns the number of bands to split a scale between the sizes given
+  // into on a machine with |processors| logical processors: as many as
+  // processors, but none that reads or writes fewer than about half a
+  // million pixels, which take less time to scale than to hand to another
+  // thread.
+  static int GetBandCount(int src_width, int src_height, int width,
+                          int height, int processors);
+
+ private:
+  struct Band {
+    int src_y;
+    int src_rows;
+    int dst_y;
+    int dst_rows;
+  };
+
+  void Prepare(int src_width, int src_height, int width, int height);
+
+  ScaleFilter filter_;
+  int requested_bands_;
+
+  // The sizes |bands_| were worked out for.
+  int src_width_;
+  int src_height_;
+  int width_;
+  int height_;
+  std::vector<Band> bands_;
+
+  LibyuvScaler(const LibyuvScaler&);
+  LibyuvScaler& operator=(const LibyuvScaler&);
+};
+
+// Writes the visible area of |source| as NV12: the Y plane to |dst_y|, and
+// the interleaved U and V samples to |dst_uv|. |source| must be
+// VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12. Uses the SSE2/AVX2 row functions
+// libyuv selects for the CPU. Returns true upon success.
+bool LibyuvI420ToNV12(const vpx_image_t* source,
+                      uint8_t* dst_y, int dst_stride_y,
+                      uint8_t* dst_uv, int dst_stride_uv);
+
+// Deinterleaves the chroma of a |width|x|height| NV12 frame, the UV plane
+// at |src_uv|, into the U and V planes of |target|, which must be
+// VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12 and at least that size. The Y plane
+// of |target| is not written, so a caller can point it at the frame's own
+// luma instead of copying it. Returns true upon success.
+bool LibyuvNV12ChromaToI420(const uint8_t* src_uv, int src_stride_uv,
+                            int width, int height, vpx_image_t* target);
+
+enum PackedYuvFormat {
+  kPackedYuvYUY2,  // Y0 U Y1 V; also known as YUYV
+  kPackedYuvUYVY,  // U Y0 V Y1
+  kPackedYuvYVYU,  // Y0 V Y1 U
+};
+
+// Writes the visible area of |source| as packed 4:2:2 |format| to |dst|.
+// Chroma rows are duplicated vertically. Same requirements as
+// LibyuvI420ToNV12.
+bool LibyuvI420ToPacked(const vpx_image_t* source, PackedYuvFormat format,
+                        uint8_t* dst, int dst_stride);
+
+// Converts the |width|x|height| packed 4:2:2 |format| frame at |src| into
+// |target|, which must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12 and at
+// least that size. Chroma is averaged over pairs of rows. Odd sizes are
+// allowed. Returns true upon success.
+bool LibyuvPackedToI420(const uint8_t* src, int src_stride,
+                        PackedYuvFormat format, int width, int height,
+                        vpx_image_t* target);
+
+enum RgbFormat {
+  kRgbFormatRGB32,  // B G R X in memory; DirectShow's RGB32 and ARGB32
+  kRgbFormatRGB24,  // B G R
+};
+
+// As LibyuvPackedToI420, for RGB, using BT.601 coefficients. A negative
+// |height| means the rows of |src| are stored bottom-up, as in a DIB.
+bool LibyuvRgbToI420(const uint8_t* src, int src_stride, RgbFormat format,
+                     int width, int height, vpx_image_t* target);
 
 }  // namespace webmdshow
 
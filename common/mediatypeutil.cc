@@ -75,3 +75,38 @@ void MediaTypeUtil::Destroy(AM_MEDIA_TYPE& tgt)
     tgt.pbFormat = 0;
     tgt.cbFormat = 0;
 }
+
+
+bool MediaTypeUtil::Equal(
+    const AM_MEDIA_TYPE& lhs,
+    const AM_MEDIA_TYPE& rhs)
+{
+    if (lhs.majortype != rhs.majortype)
+        return false;
+
+    if (lhs.subtype != rhs.subtype)
+        return false;
+
+    if (lhs.formattype != rhs.formattype)
+        return false;
+
+    if (lhs.bFixedSizeSamples != rhs.bFixedSizeSamples)
+        return false;
+
+    if (lhs.bTemporalCompression != rhs.bTemporalCompression)
+        return false;
+
+    if (lhs.lSampleSize != rhs.lSampleSize)
+        return false;
+
+    if (lhs.cbFormat != rhs.cbFormat)
+        return false;
+
+    if (lhs.cbFormat == 0)
+        return true;
+
+    if ((lhs.pbFormat == 0) || (rhs.pbFormat == 0))
+        return (lhs.pbFormat == rhs.pbFormat);
+
+    return (memcmp(lhs.pbFormat, rhs.pbFormat, lhs.cbFormat) == 0);
+}
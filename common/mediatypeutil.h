@@ -16,6 +16,10 @@ namespace MediaTypeUtil
     HRESULT Create(const AM_MEDIA_TYPE& src, AM_MEDIA_TYPE*& ptgt);
     void Free(AM_MEDIA_TYPE*);
 
+    //Compares the types and the format blocks, but not pUnk, so that a
+    //pin can tell a type it has already vetted without vetting it again.
+    bool Equal(const AM_MEDIA_TYPE&, const AM_MEDIA_TYPE&);
+
 }  //end namespace MediaTypeUtil
 
 
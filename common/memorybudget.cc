@@ -0,0 +1,270 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "memorybudget.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <mutex>
+
+namespace webmdshow {
+
+namespace {
+
+// Guards all budgets and accounts, other than purge requests. Defined
+// before the process budget, so that it is constructed first.
+std::mutex g_mutex;
+
+void StoreMax(std::atomic<int64_t>* value, int64_t x) {
+  int64_t old = value->load();
+
+  while (old < x && !value->compare_exchange_weak(old, x)) {
+  }
+}
+
+}  // namespace
+
+MemoryBudget MemoryBudget::process_;
+
+MemoryBudget* MemoryBudget::GetProcess() {
+  return &process_;
+}
+
+MemoryBudget::MemoryBudget() : parent_(NULL), purgeable_bytes_(0) {
+  limits_.soft = 0;
+  limits_.hard = 0;
+
+  stats_.bytes = 0;
+  stats_.peak = 0;
+  stats_.purges = 0;
+  stats_.denials = 0;
+}
+
+MemoryBudget::MemoryBudget(MemoryBudget* parent)
+    : parent_(parent ? parent : &process_), purgeable_bytes_(0) {
+  limits_.soft = 0;
+  limits_.hard = 0;
+
+  stats_.bytes = 0;
+  stats_.peak = 0;
+  stats_.purges = 0;
+  stats_.denials = 0;
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  parent_->sessions_.push_back(this);
+}
+
+MemoryBudget::~MemoryBudget() {
+  if (parent_ == NULL)  // the process budget, as the module unloads
+    return;
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  assert(accounts_.empty());
+  assert(sessions_.empty());
+
+  std::vector<MemoryBudget*>& sessions = parent_->sessions_;
+  sessions.erase(std::remove(sessions.begin(), sessions.end(), this),
+                 sessions.end());
+}
+
+void MemoryBudget::SetLimits(const Limits& limits) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  limits_.soft = std::max<int64_t>(limits.soft, 0);
+  limits_.hard = std::max<int64_t>(limits.hard, 0);
+}
+
+void MemoryBudget::GetLimits(Limits* limits) const {
+  assert(limits);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  *limits = limits_;
+}
+
+void MemoryBudget::GetStats(Stats* stats) const {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  *stats = stats_;
+}
+
+struct MemoryBudget::Walk {
+  static void AddBytes(Account* account, int64_t bytes) {
+    account->bytes_ += bytes;
+    assert(account->bytes_ >= 0);
+
+    for (MemoryBudget* b = account->budget_; b; b = b->parent_) {
+      b->stats_.bytes += bytes;
+      b->stats_.peak = std::max(b->stats_.peak, b->stats_.bytes);
+
+      if (account->purgeable_)
+        b->purgeable_bytes_ += bytes;
+    }
+  }
+
+  // Asks each purgeable account under |budget| for its share of |over|
+  // bytes, in proportion to what it holds.
+  static void Purge(MemoryBudget* budget, int64_t over) {
+    const int64_t total = budget->purgeable_bytes_;
+
+    if (total <= 0)
+      return;
+
+    Purge(budget, over, total);
+  }
+
+  static void Purge(MemoryBudget* budget, int64_t over, int64_t total) {
+    typedef std::vector<Account*>::const_iterator account_iter;
+
+    for (account_iter i = budget->accounts_.begin();
+         i != budget->accounts_.end(); ++i) {
+      Account* const account = *i;
+
+      if (!account->purgeable_ || (account->bytes_ <= 0))
+        continue;
+
+      const double share =
+          static_cast<double>(over) * account->bytes_ / total;
+
+      const int64_t request =
+          std::min(static_cast<int64_t>(std::ceil(share)), account->bytes_);
+
+      StoreMax(&account->purge_request_, request);
+    }
+
+    typedef std::vector<MemoryBudget*>::const_iterator session_iter;
+
+    for (session_iter i = budget->sessions_.begin();
+         i != budget->sessions_.end(); ++i) {
+      Purge(*i, over, total);
+    }
+  }
+
+  // Asks for purges from each budget whose soft limit is passed.
+  static void CheckSoft(Account* account) {
+    for (MemoryBudget* b = account->budget_; b; b = b->parent_) {
+      const int64_t soft = b->limits_.soft;
+
+      if ((soft > 0) && (b->stats_.bytes > soft)) {
+        ++b->stats_.purges;
+        Purge(b, b->stats_.bytes - soft);
+      }
+    }
+  }
+
+  // Returns false, and asks for purges, if |bytes| would take a budget
+  // past its hard limit.
+  static bool CheckHard(Account* account, int64_t bytes) {
+    for (MemoryBudget* b = account->budget_; b; b = b->parent_) {
+      const int64_t hard = b->limits_.hard;
+
+      if ((hard > 0) && (b->stats_.bytes + bytes > hard)) {
+        ++b->stats_.denials;
+        Purge(b, b->stats_.bytes + bytes - hard);
+        return false;
+      }
+    }
+
+    return true;
+  }
+};
+
+MemoryBudget::Account::Account()
+    : budget_(NULL), purgeable_(false), bytes_(0), purge_request_(0) {
+}
+
+MemoryBudget::Account::~Account() {
+  Close();
+}
+
+void MemoryBudget::Account::Open(MemoryBudget* budget, bool purgeable) {
+  assert(budget);
+
+  Close();
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  budget_ = budget;
+  purgeable_ = purgeable;
+  budget_->accounts_.push_back(this);
+}
+
+void MemoryBudget::Account::Close() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (budget_ == NULL)
+    return;
+
+  Walk::AddBytes(this, -bytes_);
+
+  std::vector<Account*>& accounts = budget_->accounts_;
+  accounts.erase(std::remove(accounts.begin(), accounts.end(), this),
+                 accounts.end());
+
+  budget_ = NULL;
+  purge_request_ = 0;
+}
+
+bool MemoryBudget::Account::IsOpen() const {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return (budget_ != NULL);
+}
+
+void MemoryBudget::Account::Charge(int64_t bytes) {
+  assert(bytes >= 0);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (budget_ == NULL)
+    return;
+
+  Walk::AddBytes(this, bytes);
+  Walk::CheckSoft(this);
+}
+
+bool MemoryBudget::Account::TryCharge(int64_t bytes) {
+  assert(bytes >= 0);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (budget_ == NULL)
+    return true;
+
+  if (!Walk::CheckHard(this, bytes))
+    return false;
+
+  Walk::AddBytes(this, bytes);
+  Walk::CheckSoft(this);
+
+  return true;
+}
+
+void MemoryBudget::Account::Release(int64_t bytes) {
+  assert(bytes >= 0);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (budget_ == NULL)
+    return;
+
+  assert(bytes <= bytes_);
+  Walk::AddBytes(this, -std::min(bytes, bytes_));
+}
+
+int64_t MemoryBudget::Account::GetBytes() const {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return bytes_;
+}
+
+int64_t MemoryBudget::Account::TakePurgeRequest() {
+  return purge_request_.exchange(0);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,133 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_MEMORYBUDGET_H_
+#define WEBMDSHOW_COMMON_MEMORYBUDGET_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace webmdshow {
+
+// Memory held by the pools and caches of the process, against soft and
+// hard limits. There is one budget for the process, and a budget for
+// each session (a graph, say) that an application creates under it. A
+// pool opens an Account with a budget, and charges it what it allocates.
+//
+// Past a soft limit, of the budget or of any budget it is under, the
+// purgeable accounts under that budget are asked to give back what is
+// over, in proportion to what each holds. Past a hard limit, TryCharge
+// fails, so that a pool purges or fails an allocation rather than grow
+// or block.
+//
+// The budget never calls into a pool: a pool takes its purge request
+// when convenient, under its own lock, so that no order among the locks
+// of the pools is imposed. The limits are 0 (none) until set. The
+// budget is shared by the pools of one module: each DLL linked with
+// common.lib has a budget of its own. Thread safe.
+class MemoryBudget {
+ public:
+  class Account;
+
+  struct Limits {
+    int64_t soft;  // purges are asked for past this; 0 for none
+    int64_t hard;  // TryCharge fails past this; 0 for none
+  };
+
+  struct Stats {
+    int64_t bytes;     // charged, by this budget's accounts and sessions
+    int64_t peak;      // most bytes charged
+    int64_t purges;    // charges that went past the soft limit
+    int64_t denials;   // TryCharge calls that failed at the hard limit
+  };
+
+  // The budget of the process, which every session is under.
+  static MemoryBudget* GetProcess();
+
+  // A session under |parent|, which is the process budget if NULL. The
+  // accounts of a session must be closed before it is destroyed.
+  explicit MemoryBudget(MemoryBudget* parent);
+  ~MemoryBudget();
+
+  void SetLimits(const Limits& limits);
+  void GetLimits(Limits* limits) const;
+  void GetStats(Stats* stats) const;
+
+ private:
+  friend class Account;
+  struct Walk;  // of the budgets, with the lock held
+
+  MemoryBudget();  // the process budget
+
+  MemoryBudget* const parent_;
+  Limits limits_;
+  Stats stats_;
+  int64_t purgeable_bytes_;  // of the purgeable accounts, in stats_.bytes
+
+  std::vector<Account*> accounts_;
+  std::vector<MemoryBudget*> sessions_;
+
+  static MemoryBudget process_;
+
+  MemoryBudget(const MemoryBudget&);
+  MemoryBudget& operator=(const MemoryBudget&);
+};
+
+// What one pool holds of a budget. Open and Close must not race the
+// other calls; TakePurgeRequest is lock free.
+class MemoryBudget::Account {
+ public:
+  Account();
+
+  // Closes the account.
+  ~Account();
+
+  // |purgeable| says the pool holds memory it can do without, such as
+  // a cache or a free list, and so is asked to purge. Opening an open
+  // account closes it first.
+  void Open(MemoryBudget* budget, bool purgeable);
+
+  // Gives back all that the account has charged.
+  void Close();
+
+  bool IsOpen() const;
+
+  // Charges memory the pool has to have. Does nothing if not open.
+  void Charge(int64_t bytes);
+
+  // Charges memory the pool can do without. Charges nothing, and
+  // returns false, if |bytes| would take a budget past its hard limit.
+  // Returns true if not open.
+  bool TryCharge(int64_t bytes);
+
+  void Release(int64_t bytes);
+
+  int64_t GetBytes() const;
+
+  // Returns how many bytes the budget has asked the pool to give back
+  // since the last call, or 0. The pool frees what it can, and calls
+  // Release for what it freed.
+  int64_t TakePurgeRequest();
+
+ private:
+  friend struct MemoryBudget::Walk;
+
+  MemoryBudget* budget_;
+  bool purgeable_;
+  int64_t bytes_;
+  std::atomic<int64_t> purge_request_;
+
+  Account(const Account&);
+  Account& operator=(const Account&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_MEMORYBUDGET_H_
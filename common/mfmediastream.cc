@@ -14,6 +14,9 @@
 #include <mfidl.h>
 #include <shlwapi.h>
 
+#include <algorithm>
+#include <deque>
+
 #include "debugutil.h"
 #include "eventutil.h"
 #include "mfmediastream.h"
@@ -23,15 +26,25 @@ namespace WebmMfUtil
 {
 
 MfMediaStream::MfMediaStream():
-  expected_event_(0),
-  ref_count_(0),
+  queue_event_(NULL),
   stream_event_error_(S_OK),
-  stream_event_recvd_(0)
+  prefetch_count_(kDefaultSamplePrefetch),
+  requests_outstanding_(0),
+  end_of_stream_(false),
+  pumping_(false),
+  ref_count_(0)
 {
+    InitializeCriticalSection(&lock_);
 }
 
 MfMediaStream::~MfMediaStream()
 {
+    if (queue_event_)
+    {
+        CloseHandle(queue_event_);
+        queue_event_ = NULL;
+    }
+    DeleteCriticalSection(&lock_);
 }
 
 HRESULT MfMediaStream::QueryInterface(REFIID riid, void** ppv)
@@ -83,11 +96,13 @@ HRESULT MfMediaStream::Create_(IMFMediaStreamPtr& ptr_stream)
         DBGLOG("ERROR, get_media_type failed" << HRLOG(hr));
         return hr;
     }
-    hr = stream_event_.Create();
-    if (FAILED(hr))
+    // Not an |EventWaiter|: its events share a name, so the audio and video
+    // streams would wake each other.
+    queue_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!queue_event_)
     {
-        DBGLOG("ERROR, stream event creation failed" << HRLOG(hr));
-        return hr;
+        DBGLOG("ERROR, queue event creation failed");
+        return E_OUTOFMEMORY;
     }
     return hr;
 }
@@ -102,13 +117,13 @@ STDMETHODIMP MfMediaStream::GetParameters(DWORD*, DWORD*)
 // IMFAsyncCallback method
 STDMETHODIMP MfMediaStream::Invoke(IMFAsyncResult* pAsyncResult)
 {
-    stream_event_error_ = E_FAIL;
     MediaEventType event_type = MEError;
     IMFMediaEventPtr ptr_event;
     HRESULT hr = ptr_event_queue_->EndGetEvent(pAsyncResult, &ptr_event);
     if (FAILED(hr))
     {
-        DBGLOG("ERROR, EndGetEvent failed" << HRLOG(hr));
+        // MF_E_SHUTDOWN, once the source has shut down.
+        DBGLOG("EndGetEvent failed, event pump stopping" << HRLOG(hr));
     }
     else
     {
@@ -117,68 +132,81 @@ STDMETHODIMP MfMediaStream::Invoke(IMFAsyncResult* pAsyncResult)
         {
             DBGLOG("ERROR, cannot get event type" << HRLOG(hr));
         }
-        if (0 != expected_event_ && event_type != expected_event_)
+        HRESULT event_status = S_OK;
+        if (SUCCEEDED(hr))
         {
-            DBGLOG("ERROR, unexpected event type, expected "
-              << expected_event_ << " got " << event_type);
-            stream_event_error_ = E_UNEXPECTED;
+            hr = ptr_event->GetStatus(&event_status);
         }
-        else
+        if (SUCCEEDED(hr) && FAILED(event_status))
         {
-            switch (event_type)
+            DBGLOG("ERROR, event " << event_type << " failed"
+                << HRLOG(event_status));
+            hr = event_status;
+        }
+    }
+    EnterCriticalSection(&lock_);
+    if (SUCCEEDED(hr))
+    {
+        switch (event_type)
+        {
+        case MEMediaSample:
+            hr = OnMediaSample_(ptr_event);
+            if (requests_outstanding_ > 0)
             {
-            case MEMediaSample:
-                DBGLOG("MEMediaSample");
-                stream_event_error_ = OnMediaSample_(ptr_event);
-                if (FAILED(stream_event_error_))
-                {
-                    DBGLOG("MEMediaSample handling failed");
-                }
-                break;
-            case MEStreamPaused:
-                DBGLOG("MEStreamPaused");
-                stream_event_error_ = OnStreamPaused_(ptr_event);
-                if (FAILED(stream_event_error_))
-                {
-                    DBGLOG("MEStreamSeeked handling failed");
-                }
-                break;
-            case MEStreamSeeked:
-                DBGLOG("MEStreamSeeked");
-                stream_event_error_ = OnStreamSeeked_(ptr_event);
-                if (FAILED(stream_event_error_))
-                {
-                    DBGLOG("MEStreamSeeked handling failed");
-                }
-                break;
-            case MEStreamStarted:
-                DBGLOG("MEStreamStarted");
-                stream_event_error_ = OnStreamStarted_(ptr_event);
-                if (FAILED(stream_event_error_))
-                {
-                    DBGLOG("MEStreamStarted handling failed");
-                }
-                break;
-            case MEStreamStopped:
-                DBGLOG("MEStreamStopped");
-                stream_event_error_ = OnStreamStopped_(ptr_event);
-                if (FAILED(stream_event_error_))
-                {
-                    DBGLOG("MEStreamStopped handling failed");
-                }
-                break;
-            default:
-                stream_event_error_ = E_UNEXPECTED;
-                DBGLOG("unhandled event_type=" << event_type);
-                break;
+                --requests_outstanding_;
             }
+            break;
+        case MEEndOfStream:
+            DBGLOG("MEEndOfStream");
+            end_of_stream_ = true;
+            break;
+        case MEStreamPaused:
+            DBGLOG("MEStreamPaused");
+            hr = OnStreamPaused_(ptr_event);
+            break;
+        case MEStreamSeeked:
+            DBGLOG("MEStreamSeeked");
+            hr = OnStreamSeeked_(ptr_event);
+            break;
+        case MEStreamStarted:
+            DBGLOG("MEStreamStarted");
+            hr = OnStreamStarted_(ptr_event);
+            break;
+        case MEStreamStopped:
+            DBGLOG("MEStreamStopped");
+            hr = OnStreamStopped_(ptr_event);
+            break;
+        default:
+            DBGLOG("unhandled event_type=" << event_type);
+            break;
+        }
+        if (MEMediaSample != event_type && MEEndOfStream != event_type)
+        {
+            stream_events_.push_back(event_type);
         }
     }
-    expected_event_ = 0;
-    stream_event_recvd_ = event_type;
-    return stream_event_.Set();
+    if (SUCCEEDED(hr))
+    {
+        hr = ptr_event_queue_->BeginGetEvent(this, NULL);
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, BeginGetEvent failed" << HRLOG(hr));
+        }
+    }
+    if (FAILED(hr))
+    {
+        pumping_ = false;
+        if (SUCCEEDED(stream_event_error_))
+        {
+            stream_event_error_ = hr;
+        }
+    }
+    LeaveCriticalSection(&lock_);
+    SetEvent(queue_event_);
+    return S_OK;
 }
 
+// The OnXxx_ handlers are called from |Invoke| with |lock_| held.
 HRESULT MfMediaStream::OnMediaSample_(IMFMediaEventPtr& ptr_event)
 {
     IUnknownPtr ptr_iunk;
@@ -188,36 +216,43 @@ HRESULT MfMediaStream::OnMediaSample_(IMFMediaEventPtr& ptr_event)
         DBGLOG("ERROR, could not obtain IUnknown from event" << HRLOG(hr));
         return hr;
     }
-    ptr_sample_ = ptr_iunk;
-    if (!ptr_sample_)
+    IMFSamplePtr ptr_sample = ptr_iunk;
+    if (!ptr_sample)
     {
         DBGLOG("ERROR, sample pointer null");
         return E_POINTER;
     }
+    samples_.push_back(ptr_sample);
     return S_OK;
 }
 
 HRESULT MfMediaStream::OnStreamPaused_(IMFMediaEventPtr&)
 {
-    // no-op for now
+    // Requests made while paused are delivered once the stream restarts.
     return S_OK;
 }
 
 HRESULT MfMediaStream::OnStreamSeeked_(IMFMediaEventPtr&)
 {
-    // no-op for now
+    // The queued samples are from before the seek; the outstanding requests
+    // are satisfied from the new position.
+    samples_.clear();
+    end_of_stream_ = false;
     return S_OK;
 }
 
 HRESULT MfMediaStream::OnStreamStarted_(IMFMediaEventPtr&)
 {
-    // no-op for now
+    end_of_stream_ = false;
     return S_OK;
 }
 
 HRESULT MfMediaStream::OnStreamStopped_(IMFMediaEventPtr&)
 {
-    // no-op for now
+    // A stopped stream discards its outstanding requests.
+    samples_.clear();
+    requests_outstanding_ = 0;
+    end_of_stream_ = false;
     return S_OK;
 }
 
@@ -256,71 +291,208 @@ HRESULT MfMediaStream::GetMediaType(IMFMediaType **ptr_type)
     return copy_media_type(ptr_media_type_, ptr_type);
 }
 
-HRESULT MfMediaStream::WaitForStreamEvent(MediaEventType event_type)
+void MfMediaStream::SetPrefetchCount(UINT prefetch_count)
+{
+    EnterCriticalSection(&lock_);
+    prefetch_count_ = prefetch_count;
+    LeaveCriticalSection(&lock_);
+}
+
+HRESULT MfMediaStream::StartEventPump_()
+{
+    EnterCriticalSection(&lock_);
+    HRESULT hr = stream_event_error_;
+    if (SUCCEEDED(hr) && !pumping_)
+    {
+        hr = ptr_event_queue_->BeginGetEvent(this, NULL);
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, BeginGetEvent failed" << HRLOG(hr));
+        }
+        else
+        {
+            pumping_ = true;
+        }
+    }
+    LeaveCriticalSection(&lock_);
+    return hr;
+}
+
+HRESULT MfMediaStream::WaitForQueue_()
 {
-    expected_event_ = event_type;
-    HRESULT hr = ptr_stream_->BeginGetEvent(this, NULL);
+    HRESULT hr = infinite_cowait(queue_event_);
     if (FAILED(hr))
     {
-        DBGLOG("ERROR, BeginGetEvent failed" << HRLOG(hr));
-        return hr;
+        DBGLOG("ERROR, queue event wait failed" << HRLOG(hr));
     }
-    hr = stream_event_.Wait();
+    return hr;
+}
+
+HRESULT MfMediaStream::WaitForStreamEvent(MediaEventType event_type)
+{
+    HRESULT hr = StartEventPump_();
     if (FAILED(hr))
     {
-        DBGLOG("ERROR, stream event wait failed" << HRLOG(hr));
         return hr;
     }
-    if (FAILED(stream_event_error_))
+    for (;;)
     {
-        // when event handling fails the last error is stored in
-        // |media_event_type_recvd_|, just return it to the caller
-        DBGLOG("ERROR, stream event handling failed"
-            << HRLOG(stream_event_error_));
-        return stream_event_error_;
+        EnterCriticalSection(&lock_);
+        bool found = false;
+        while (!found && !stream_events_.empty())
+        {
+            found = (stream_events_.front() == event_type);
+            if (!found)
+            {
+                DBGLOG("skipping stream event " << stream_events_.front()
+                    << " while waiting for " << event_type);
+            }
+            stream_events_.pop_front();
+        }
+        hr = stream_event_error_;
+        LeaveCriticalSection(&lock_);
+        if (found)
+        {
+            return S_OK;
+        }
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, stream event handling failed" << HRLOG(hr));
+            return hr;
+        }
+        hr = WaitForQueue_();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
     }
-    return hr;
 }
 
-HRESULT MfMediaStream::GetSample(IMFSample **ptr_sample)
+// Brings the requests outstanding up to |needed|, less the samples already
+// queued, plus |prefetch_count_|.
+HRESULT MfMediaStream::RequestSamples_(UINT needed)
 {
-    if (!ptr_stream_)
+    EnterCriticalSection(&lock_);
+    UINT request_count = 0;
+    if (!end_of_stream_)
     {
-        DBGLOG("ERROR, stream not set, E_UNEXPECTED");
-        return E_UNEXPECTED;
+        const UINT queued = static_cast<UINT>(samples_.size());
+        const UINT target = (needed > queued ? needed - queued : 0) +
+                            prefetch_count_;
+        if (target > requests_outstanding_)
+        {
+            request_count = target - requests_outstanding_;
+            requests_outstanding_ = target;
+        }
     }
+    LeaveCriticalSection(&lock_);
+    // RequestSample is called without |lock_|, so that |Invoke| isn't held
+    // up by a source that delivers as it is asked.
+    HRESULT hr = S_OK;
+    UINT requested = 0;
     // TODO(tomfinegan): need to handle pause; RequestSample will succeed while
     //                   paused, but the stream won't deliver the sample.
-    //                   This means we'll block in |WaitForStreamEvent|...?
+    //                   This means we'll block waiting for it...?
     //                   Curse you for not being specific MSDN.  I guess I have
     //                   to return a wrong state error when paused to avoid the
     //                   situation altogether.
-    HRESULT hr = ptr_stream_->RequestSample(NULL);
-    // MF_E_MEDIA_SOURCE_WRONGSTATE is not treated as an error by the pipeline
+    for (; requested < request_count; ++requested)
+    {
+        hr = ptr_stream_->RequestSample(NULL);
+        if (FAILED(hr))
+        {
+            break;
+        }
+    }
+    if (requested < request_count)
+    {
+        EnterCriticalSection(&lock_);
+        const UINT unmade = request_count - requested;
+        requests_outstanding_ -= (std::min)(unmade, requests_outstanding_);
+        if (MF_E_END_OF_STREAM == hr)
+        {
+            end_of_stream_ = true;
+            hr = S_OK;
+        }
+        LeaveCriticalSection(&lock_);
+        // MF_E_MEDIA_SOURCE_WRONGSTATE is not treated as an error by the
+        // pipeline
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, RequestSample failed" << HRLOG(hr));
+        }
+    }
+    return hr;
+}
+
+HRESULT MfMediaStream::GetSamples(UINT count, IMFSample** ptr_samples,
+                                  UINT* ptr_count)
+{
+    if (!ptr_samples || !ptr_count)
+    {
+        DBGLOG("ERROR, NULL out param, E_POINTER");
+        return E_POINTER;
+    }
+    *ptr_count = 0;
+    if (!ptr_stream_)
+    {
+        DBGLOG("ERROR, stream not set, E_UNEXPECTED");
+        return E_UNEXPECTED;
+    }
+    HRESULT hr = StartEventPump_();
     if (FAILED(hr))
     {
-        DBGLOG("ERROR, RequestSample failed" << HRLOG(hr));
         return hr;
     }
-    hr = WaitForStreamEvent(MEMediaSample);
-    if (FAILED(hr))
+    UINT got = 0;
+    while (got < count)
+    {
+        hr = RequestSamples_(count - got);
+        if (FAILED(hr))
+        {
+            break;
+        }
+        EnterCriticalSection(&lock_);
+        while (got < count && !samples_.empty())
+        {
+            ptr_samples[got++] = samples_.front().Detach();
+            samples_.pop_front();
+        }
+        const bool ended = end_of_stream_ && samples_.empty();
+        hr = stream_event_error_;
+        LeaveCriticalSection(&lock_);
+        if (got == count || ended || FAILED(hr))
+        {
+            break;
+        }
+        hr = WaitForQueue_();
+        if (FAILED(hr))
+        {
+            break;
+        }
+    }
+    *ptr_count = got;
+    if (!got && FAILED(hr))
     {
-        DBGLOG("WaitForStreamEvent MEMediaSample failed" << HRLOG(hr));
+        DBGLOG("ERROR, no samples" << HRLOG(hr));
         return hr;
     }
-    if (FAILED(stream_event_error_))
+    if (got < count)
     {
-        DBGLOG("MEMediaSample event handling failed"
-            << HRLOG(stream_event_error_));
-        return stream_event_error_;
+        // Return what arrived; an error is reported on the next call.
+        return got ? S_FALSE : MF_E_END_OF_STREAM;
     }
-    if (!ptr_sample_)
+    return S_OK;
+}
+
+HRESULT MfMediaStream::GetSample(IMFSample** ptr_sample)
+{
+    UINT count = 0;
+    HRESULT hr = GetSamples(1, ptr_sample, &count);
+    if (FAILED(hr))
     {
-        // TODO(tomfinegan):
-        DBGLOG("ERROR, null sample");
-        return E_OUTOFMEMORY;
+        DBGLOG("GetSamples failed" << HRLOG(hr));
     }
-    *ptr_sample = ptr_sample_.Detach();
     return hr;
 }
 
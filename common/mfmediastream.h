@@ -9,9 +9,24 @@
 #ifndef __WEBMDSHOW_COMMON_MFMEDIASTREAM_HPP__
 #define __WEBMDSHOW_COMMON_MFMEDIASTREAM_HPP__
 
+#include <deque>
+
 namespace WebmMfUtil
 {
 
+// The number of sample requests |MfMediaStream| keeps outstanding beyond
+// those its caller is waiting for, unless told otherwise.
+const UINT kDefaultSamplePrefetch = 4;
+
+// Pulls samples from an IMFMediaStream. Once the first sample or stream
+// event is asked for, the stream's event queue is read continuously:
+// delivered samples and stream events are queued here as they arrive, and
+// |prefetch_count_| more sample requests than the caller is waiting for
+// are kept outstanding, so the source is never idle waiting for the next
+// RequestSample and a caller doesn't wait on a round trip through the MF
+// event queue per sample. Reading stops when the stream shuts down. One
+// thread at a time may call |GetSample|, |GetSamples| and
+// |WaitForStreamEvent|.
 class MfMediaStream : public IMFAsyncCallback
 {
 public:
@@ -19,7 +34,18 @@ public:
     static HRESULT Create(IMFMediaStreamPtr& ptr_stream,
                           MfMediaStream** ptr_instance);
     HRESULT GetMediaType(IMFMediaType** ptr_type);
+    // Returns the next sample, waiting for it if none is queued. Returns
+    // MF_E_END_OF_STREAM once the stream has ended and every sample it
+    // delivered has been returned.
     HRESULT GetSample(IMFSample** ptr_sample);
+    // Stores up to |count| samples in |ptr_samples|, and their number in
+    // |ptr_count|; the caller releases them. Waits until |count| samples
+    // have arrived, or the stream ends: returns S_FALSE if it ended before
+    // |count|, and MF_E_END_OF_STREAM if it had no samples left at all.
+    HRESULT GetSamples(UINT count, IMFSample** ptr_samples, UINT* ptr_count);
+    // Sets the number of requests kept outstanding beyond those a caller
+    // is waiting for. 0 requests samples only as they are asked for.
+    void SetPrefetchCount(UINT prefetch_count);
     HRESULT WaitForStreamEvent(MediaEventType event_type);
     // IUnknown methods
     STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
@@ -40,20 +66,33 @@ private:
     MfMediaStream();
     ~MfMediaStream();
     HRESULT Create_(IMFMediaStreamPtr& ptr_stream);
+    HRESULT RequestSamples_(UINT needed);
+    HRESULT StartEventPump_();
+    HRESULT WaitForQueue_();
     HRESULT OnMediaSample_(IMFMediaEventPtr& ptr_event);
     HRESULT OnStreamPaused_(IMFMediaEventPtr& ptr_event);
     HRESULT OnStreamSeeked_(IMFMediaEventPtr& ptr_event);
     HRESULT OnStreamStarted_(IMFMediaEventPtr& ptr_event);
     HRESULT OnStreamStopped_(IMFMediaEventPtr& ptr_event);
 
-    EventWaiter stream_event_;
+    // Guards the members below it, which |Invoke| changes on an MF work
+    // queue thread.
+    CRITICAL_SECTION lock_;
+    // Auto-reset; set by |Invoke| each time it queues something.
+    HANDLE queue_event_;
+    std::deque<IMFSamplePtr> samples_;
+    // Stream events other than MEMediaSample, in the order received.
+    std::deque<MediaEventType> stream_events_;
+    // The first failure of the event pump, or of a stream event.
     HRESULT stream_event_error_;
+    UINT prefetch_count_;
+    UINT requests_outstanding_;
+    bool end_of_stream_;
+    bool pumping_;
+
     IMFMediaEventGeneratorPtr ptr_event_queue_;
     IMFMediaStreamPtr ptr_stream_;
     IMFMediaTypePtr ptr_media_type_;
-    MediaEventType expected_event_;
-    IMFSamplePtr ptr_sample_;
-    MediaEventType stream_event_recvd_;
     ULONG ref_count_;
 
     DISALLOW_COPY_AND_ASSIGN(MfMediaStream);
@@ -31,6 +31,7 @@ namespace WebmMfUtil
 
 MfByteStreamHandlerWrapper::MfByteStreamHandlerWrapper():
   audio_stream_count_(0),
+  sample_prefetch_(kDefaultSamplePrefetch),
   event_type_recvd_(0),
   expected_event_type_(0),
   media_event_error_(0),
@@ -138,6 +139,23 @@ HRESULT MfByteStreamHandlerWrapper::GetAudioSample(IMFSample** ptr_sample)
     return ptr_audio_stream_->GetSample(ptr_sample);
 }
 
+HRESULT MfByteStreamHandlerWrapper::GetAudioSamples(UINT count,
+                                                    IMFSample** ptr_samples,
+                                                    UINT* ptr_count)
+{
+    if (0 == audio_stream_count_)
+    {
+        DBGLOG("no audio streams");
+        return E_INVALIDARG;
+    }
+    if (NULL == ptr_audio_stream_)
+    {
+        DBGLOG("ERROR, audio stream not created, E_UNEXPECTED");
+        return E_UNEXPECTED;
+    }
+    return ptr_audio_stream_->GetSamples(count, ptr_samples, ptr_count);
+}
+
 HRESULT MfByteStreamHandlerWrapper::GetAudioMediaType(
     IMFMediaType **ptr_type) const
 {
@@ -174,6 +192,36 @@ HRESULT MfByteStreamHandlerWrapper::GetVideoSample(IMFSample** ptr_sample)
     return ptr_video_stream_->GetSample(ptr_sample);
 }
 
+HRESULT MfByteStreamHandlerWrapper::GetVideoSamples(UINT count,
+                                                    IMFSample** ptr_samples,
+                                                    UINT* ptr_count)
+{
+    if (0 == video_stream_count_)
+    {
+        DBGLOG("no video streams");
+        return E_INVALIDARG;
+    }
+    if (NULL == ptr_video_stream_)
+    {
+        DBGLOG("ERROR, video stream not created, E_UNEXPECTED");
+        return E_UNEXPECTED;
+    }
+    return ptr_video_stream_->GetSamples(count, ptr_samples, ptr_count);
+}
+
+void MfByteStreamHandlerWrapper::SetSamplePrefetch(UINT prefetch_count)
+{
+    sample_prefetch_ = prefetch_count;
+    if (ptr_audio_stream_)
+    {
+        ptr_audio_stream_->SetPrefetchCount(prefetch_count);
+    }
+    if (ptr_video_stream_)
+    {
+        ptr_video_stream_->SetPrefetchCount(prefetch_count);
+    }
+}
+
 HRESULT MfByteStreamHandlerWrapper::GetVideoMediaType(
     IMFMediaType **ptr_type) const
 {
@@ -459,6 +507,10 @@ HRESULT MfByteStreamHandlerWrapper::OnNewStream_(IMFMediaEventPtr &ptr_event)
         {
             DBGLOG("audio MfMediaStream creation failed" << HRLOG(hr));
         }
+        else
+        {
+            ptr_audio_stream_->SetPrefetchCount(sample_prefetch_);
+        }
     }
     else
     {
@@ -467,6 +519,10 @@ HRESULT MfByteStreamHandlerWrapper::OnNewStream_(IMFMediaEventPtr &ptr_event)
         {
             DBGLOG("video MfMediaStream creation failed" << HRLOG(hr));
         }
+        else
+        {
+            ptr_video_stream_->SetPrefetchCount(sample_prefetch_);
+        }
     }
     return hr;
 }
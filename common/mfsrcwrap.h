@@ -31,8 +31,18 @@ public:
     virtual ~MfByteStreamHandlerWrapper();
     HRESULT GetAudioMediaType(IMFMediaType** ptr_type) const;
     HRESULT GetAudioSample(IMFSample** ptr_sample);
+    // See |MfMediaStream::GetSamples|.
+    HRESULT GetAudioSamples(UINT count, IMFSample** ptr_samples,
+                            UINT* ptr_count);
     HRESULT GetVideoMediaType(IMFMediaType** ptr_type) const;
     HRESULT GetVideoSample(IMFSample** ptr_sample);
+    HRESULT GetVideoSamples(UINT count, IMFSample** ptr_samples,
+                            UINT* ptr_count);
+    // Sets the number of sample requests each stream keeps outstanding
+    // beyond those a caller is waiting for; see |MfMediaStream|. Applies to
+    // the streams loaded after it is called, as well as to those loaded
+    // before.
+    void SetSamplePrefetch(UINT prefetch_count);
     HRESULT LoadMediaStreams();
     HRESULT OpenURL(std::wstring url);
     HRESULT Pause();
@@ -91,6 +101,7 @@ private:
     MfMediaStream* ptr_video_stream_;
     MfState state_;
     UINT audio_stream_count_;
+    UINT sample_prefetch_;
     UINT selected_stream_count_;
     UINT video_stream_count_;
     ULONG ref_count_;
@@ -0,0 +1,754 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <windowsx.h>
+#include <comdef.h>
+#include <mfapi.h>
+#include <mferror.h>
+#include <mfidl.h>
+#include <process.h>
+#include <shlwapi.h>
+
+#include <cassert>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "debugutil.h"
+#include "mftransdriver.h"
+#include "mftranswrap.h"
+
+namespace WebmMfUtil
+{
+
+MfTransformDriver::MfTransformDriver():
+  ptr_transform_(NULL),
+  queue_depth_(0),
+  ref_count_(0),
+  pool_size_(0),
+  output_size_(0),
+  output_alignment_(0),
+  mft_provides_samples_(false),
+  type_changed_(false),
+  input_ended_(false),
+  draining_(false),
+  drained_(false),
+  error_(S_OK),
+  stop_event_(NULL),
+  input_queued_(NULL),
+  input_space_(NULL),
+  input_accepted_(NULL),
+  output_taken_(NULL),
+  output_queued_(NULL),
+  sample_freed_(NULL)
+{
+    threads_[0] = NULL;
+    threads_[1] = NULL;
+    InitializeCriticalSection(&lock_);
+    InitializeCriticalSection(&mft_lock_);
+}
+
+MfTransformDriver::~MfTransformDriver()
+{
+    Stop();
+    HANDLE* const events[] = {
+        &stop_event_, &input_queued_, &input_space_, &input_accepted_,
+        &output_taken_, &output_queued_, &sample_freed_
+    };
+    for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i)
+    {
+        if (*events[i])
+        {
+            CloseHandle(*events[i]);
+            *events[i] = NULL;
+        }
+    }
+    if (ptr_transform_)
+    {
+        ptr_transform_->Release();
+        ptr_transform_ = NULL;
+    }
+    DeleteCriticalSection(&mft_lock_);
+    DeleteCriticalSection(&lock_);
+}
+
+HRESULT MfTransformDriver::QueryInterface(REFIID riid, void** ppv)
+{
+    static const QITAB qit[] =
+    {
+        QITABENT(MfTransformDriver, IMFAsyncCallback),
+        { 0 }
+    };
+    return QISearch(this, qit, riid, ppv);
+}
+
+ULONG MfTransformDriver::AddRef()
+{
+    return InterlockedIncrement(&ref_count_);
+}
+
+ULONG MfTransformDriver::Release()
+{
+    UINT ref_count = InterlockedDecrement(&ref_count_);
+    if (ref_count == 0)
+    {
+        delete this;
+    }
+    return ref_count;
+}
+
+HRESULT MfTransformDriver::Create(MfTransformWrapper* ptr_transform,
+                                  UINT queue_depth,
+                                  MfTransformDriver** ptr_instance)
+{
+    if (!ptr_transform || 0 == queue_depth || !ptr_instance)
+    {
+        DBGLOG("ERROR, bad arg, E_INVALIDARG");
+        return E_INVALIDARG;
+    }
+    MfTransformDriver* ptr_driver = new (std::nothrow) MfTransformDriver();
+    if (!ptr_driver)
+    {
+        DBGLOG("null MfTransformDriver, returning E_OUTOFMEMORY");
+        return E_OUTOFMEMORY;
+    }
+    ptr_driver->AddRef();
+    HRESULT hr = ptr_driver->Create_(ptr_transform, queue_depth);
+    if (FAILED(hr))
+    {
+        DBGLOG("ERROR, Create_ failed" << HRLOG(hr));
+        ptr_driver->Release();
+        return hr;
+    }
+    *ptr_instance = ptr_driver;
+    return hr;
+}
+
+HRESULT MfTransformDriver::Create_(MfTransformWrapper* ptr_transform,
+                                   UINT queue_depth)
+{
+    if (!ptr_transform->ptr_transform_ || !ptr_transform->ptr_output_type_)
+    {
+        DBGLOG("ERROR, transform types not set, E_UNEXPECTED");
+        return E_UNEXPECTED;
+    }
+    ptr_transform_ = ptr_transform;
+    ptr_transform_->AddRef();
+    queue_depth_ = queue_depth;
+    stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    input_queued_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    input_space_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    input_accepted_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    output_taken_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    output_queued_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    sample_freed_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!stop_event_ || !input_queued_ || !input_space_ ||
+        !input_accepted_ || !output_taken_ || !output_queued_ ||
+        !sample_freed_)
+    {
+        DBGLOG("ERROR, CreateEvent failed");
+        return E_OUTOFMEMORY;
+    }
+    HRESULT hr;
+    CHK(hr, GetOutputStreamInfo_());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    IMFTransform* const ptr_mft = ptr_transform_->ptr_transform_;
+    CHK(hr, ptr_mft->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0));
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, ptr_mft->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM,
+                                        0));
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    unsigned (__stdcall* const thread_funcs[2])(void*) = {
+        InputThread_, OutputThread_
+    };
+    for (int i = 0; i < 2; ++i)
+    {
+        const uintptr_t h = _beginthreadex(NULL, 0, thread_funcs[i], this, 0,
+                                           NULL);
+        if (0 == h)
+        {
+            DBGLOG("ERROR, _beginthreadex failed");
+            Stop();
+            return E_FAIL;
+        }
+        threads_[i] = reinterpret_cast<HANDLE>(h);
+    }
+    return S_OK;
+}
+
+HRESULT MfTransformDriver::QueueInput(IMFSample* ptr_sample)
+{
+    if (!ptr_sample)
+    {
+        DBGLOG("ERROR, NULL sample, E_INVALIDARG");
+        return E_INVALIDARG;
+    }
+    for (;;)
+    {
+        EnterCriticalSection(&lock_);
+        HRESULT hr = error_;
+        if (SUCCEEDED(hr) && input_ended_)
+        {
+            DBGLOG("ERROR, input already ended, E_UNEXPECTED");
+            hr = E_UNEXPECTED;
+        }
+        const bool queued = SUCCEEDED(hr) && inputs_.size() < queue_depth_;
+        if (queued)
+        {
+            ptr_sample->AddRef();
+            inputs_.push_back(ptr_sample);
+        }
+        LeaveCriticalSection(&lock_);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        if (queued)
+        {
+            SetEvent(input_queued_);
+            return S_OK;
+        }
+        if (!Wait_(input_space_))
+        {
+            EnterCriticalSection(&lock_);
+            hr = FAILED(error_) ? error_ : MF_E_SHUTDOWN;
+            LeaveCriticalSection(&lock_);
+            return hr;
+        }
+    }
+}
+
+HRESULT MfTransformDriver::EndOfInput()
+{
+    EnterCriticalSection(&lock_);
+    HRESULT hr = error_;
+    if (SUCCEEDED(hr) && !input_ended_)
+    {
+        input_ended_ = true;
+        inputs_.push_back(NULL);
+    }
+    LeaveCriticalSection(&lock_);
+    SetEvent(input_queued_);
+    return hr;
+}
+
+HRESULT MfTransformDriver::GetOutput(IMFSample** ptr_sample)
+{
+    if (!ptr_sample)
+    {
+        DBGLOG("ERROR, NULL out param, E_POINTER");
+        return E_POINTER;
+    }
+    for (;;)
+    {
+        EnterCriticalSection(&lock_);
+        HRESULT hr = E_PENDING;
+        if (!outputs_.empty())
+        {
+            Output& output = outputs_.front();
+            *ptr_sample = output.ptr_sample.Detach();
+            hr = output.type_changed ? S_FALSE : S_OK;
+            outputs_.pop_front();
+        }
+        else if (FAILED(error_))
+        {
+            hr = error_;
+        }
+        else if (drained_)
+        {
+            hr = MF_E_END_OF_STREAM;
+        }
+        LeaveCriticalSection(&lock_);
+        if (E_PENDING != hr)
+        {
+            return hr;
+        }
+        if (!Wait_(output_queued_))
+        {
+            EnterCriticalSection(&lock_);
+            hr = FAILED(error_) ? error_ : MF_E_SHUTDOWN;
+            LeaveCriticalSection(&lock_);
+            return hr;
+        }
+    }
+}
+
+HRESULT MfTransformDriver::Stop()
+{
+    if (stop_event_)
+    {
+        SetEvent(stop_event_);
+    }
+    HANDLE running[2];
+    DWORD running_count = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        if (threads_[i])
+        {
+            running[running_count++] = threads_[i];
+        }
+    }
+    if (running_count)
+    {
+        WaitForMultipleObjects(running_count, running, TRUE, INFINITE);
+        for (DWORD i = 0; i < running_count; ++i)
+        {
+            CloseHandle(running[i]);
+        }
+        threads_[0] = NULL;
+        threads_[1] = NULL;
+        EnterCriticalSection(&mft_lock_);
+        IMFTransform* const ptr_mft = ptr_transform_->ptr_transform_;
+        ptr_mft->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
+        ptr_mft->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+        LeaveCriticalSection(&mft_lock_);
+    }
+    // Take the samples out under the lock, and release them after it: a
+    // tracked sample calls |Invoke| as it goes, which takes the lock.
+    std::deque<IMFSample*> inputs;
+    std::deque<Output> outputs;
+    std::vector<IMFSample*> free_samples;
+    EnterCriticalSection(&lock_);
+    inputs.swap(inputs_);
+    outputs.swap(outputs_);
+    free_samples.swap(free_samples_);
+    pool_size_ = 0;
+    LeaveCriticalSection(&lock_);
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        if (inputs[i])
+        {
+            inputs[i]->Release();
+        }
+    }
+    for (size_t i = 0; i < free_samples.size(); ++i)
+    {
+        free_samples[i]->Release();
+    }
+    outputs.clear();
+    return S_OK;
+}
+
+// IMFAsyncCallback method
+STDMETHODIMP MfTransformDriver::GetParameters(DWORD*, DWORD*)
+{
+    // Implementation of this method is optional.
+    return E_NOTIMPL;
+}
+
+// IMFAsyncCallback method
+STDMETHODIMP MfTransformDriver::Invoke(IMFAsyncResult* pAsyncResult)
+{
+    IUnknownPtr ptr_iunk;
+    HRESULT hr = pAsyncResult->GetObject(&ptr_iunk);
+    if (FAILED(hr))
+    {
+        DBGLOG("ERROR, released sample missing" << HRLOG(hr));
+        return hr;
+    }
+    IMFSamplePtr ptr_sample = ptr_iunk;
+    if (!ptr_sample)
+    {
+        DBGLOG("ERROR, released object is not a sample");
+        return E_NOINTERFACE;
+    }
+    IMFMediaBufferPtr ptr_buffer;
+    DWORD max_length = 0;
+    if (SUCCEEDED(ptr_sample->GetBufferByIndex(0, &ptr_buffer)))
+    {
+        ptr_buffer->GetMaxLength(&max_length);
+    }
+    // Its time, duration and flags are those of the frame it last held.
+    ptr_sample->DeleteAllItems();
+    bool pooled = false;
+    EnterCriticalSection(&lock_);
+    if (WAIT_OBJECT_0 != WaitForSingleObject(stop_event_, 0) &&
+        max_length >= output_size_)
+    {
+        free_samples_.push_back(ptr_sample.Detach());
+        pooled = true;
+    }
+    else if (pool_size_ > 0)
+    {
+        // Stopped, or made too small by a change of output type.
+        --pool_size_;
+    }
+    LeaveCriticalSection(&lock_);
+    if (pooled)
+    {
+        SetEvent(sample_freed_);
+    }
+    return S_OK;
+}
+
+unsigned __stdcall MfTransformDriver::InputThread_(void* ptr_this)
+{
+    MfTransformDriver* const ptr_driver =
+        static_cast<MfTransformDriver*>(ptr_this);
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (SUCCEEDED(hr))
+    {
+        hr = ptr_driver->FeedInput_();
+        CoUninitialize();
+    }
+    if (FAILED(hr))
+    {
+        ptr_driver->Fail_(hr);
+    }
+    return 0;
+}
+
+unsigned __stdcall MfTransformDriver::OutputThread_(void* ptr_this)
+{
+    MfTransformDriver* const ptr_driver =
+        static_cast<MfTransformDriver*>(ptr_this);
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (SUCCEEDED(hr))
+    {
+        hr = ptr_driver->DrainOutput_();
+        CoUninitialize();
+    }
+    if (FAILED(hr))
+    {
+        ptr_driver->Fail_(hr);
+    }
+    return 0;
+}
+
+HRESULT MfTransformDriver::FeedInput_()
+{
+    IMFTransform* const ptr_mft = ptr_transform_->ptr_transform_;
+    HRESULT hr;
+    for (;;)
+    {
+        IMFSample* ptr_sample = NULL;
+        bool have_input = false;
+        EnterCriticalSection(&lock_);
+        if (!inputs_.empty())
+        {
+            ptr_sample = inputs_.front();
+            inputs_.pop_front();
+            have_input = true;
+        }
+        LeaveCriticalSection(&lock_);
+        if (!have_input)
+        {
+            if (!Wait_(input_queued_))
+            {
+                return S_OK;
+            }
+            continue;
+        }
+        SetEvent(input_space_);
+        if (!ptr_sample)
+        {
+            // The end of the input: have the MFT give up what it holds.
+            EnterCriticalSection(&mft_lock_);
+            CHK(hr, ptr_mft->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM,
+                                            0));
+            if (SUCCEEDED(hr))
+            {
+                CHK(hr, ptr_mft->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN,
+                                                0));
+            }
+            LeaveCriticalSection(&mft_lock_);
+            EnterCriticalSection(&lock_);
+            draining_ = true;
+            LeaveCriticalSection(&lock_);
+            SetEvent(input_accepted_);
+            return hr;
+        }
+        for (;;)
+        {
+            EnterCriticalSection(&mft_lock_);
+            hr = ptr_mft->ProcessInput(0, ptr_sample, 0);
+            LeaveCriticalSection(&mft_lock_);
+            if (MF_E_NOTACCEPTING != hr)
+            {
+                break;
+            }
+            // The MFT is full: wait until the output thread takes a sample.
+            if (!Wait_(output_taken_))
+            {
+                ptr_sample->Release();
+                return S_OK;
+            }
+        }
+        ptr_sample->Release();
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, ProcessInput failed" << HRLOG(hr));
+            return hr;
+        }
+        SetEvent(input_accepted_);
+    }
+}
+
+HRESULT MfTransformDriver::DrainOutput_()
+{
+    IMFTransform* const ptr_mft = ptr_transform_->ptr_transform_;
+    HRESULT hr;
+    for (;;)
+    {
+        EnterCriticalSection(&lock_);
+        const bool provides_samples = mft_provides_samples_;
+        // Read before ProcessOutput: once the drain was asked for, a
+        // request for more input means the MFT is empty.
+        const bool draining = draining_;
+        LeaveCriticalSection(&lock_);
+        IMFSamplePtr ptr_sample;
+        if (!provides_samples)
+        {
+            hr = GetPoolSample_(&ptr_sample);
+            if (MF_E_SHUTDOWN == hr)
+            {
+                return S_OK;
+            }
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        MFT_OUTPUT_DATA_BUFFER output = {0};
+        output.pSample = ptr_sample;
+        DWORD status = 0;
+        // can't use CHK: MF_E_TRANSFORM_NEED_MORE_INPUT and
+        // MF_E_TRANSFORM_STREAM_CHANGE are expected
+        EnterCriticalSection(&mft_lock_);
+        hr = ptr_mft->ProcessOutput(0, 1, &output, &status);
+        LeaveCriticalSection(&mft_lock_);
+        if (output.pEvents)
+        {
+            output.pEvents->Release();
+        }
+        if (provides_samples && output.pSample)
+        {
+            ptr_sample.Attach(output.pSample);
+        }
+        if (MF_E_TRANSFORM_NEED_MORE_INPUT == hr)
+        {
+            if (draining)
+            {
+                EnterCriticalSection(&lock_);
+                drained_ = true;
+                LeaveCriticalSection(&lock_);
+                SetEvent(output_queued_);
+                return S_OK;
+            }
+            // Releasing an unfilled pool sample returns it to the pool.
+            ptr_sample = NULL;
+            if (!Wait_(input_accepted_))
+            {
+                return S_OK;
+            }
+            continue;
+        }
+        if (MF_E_TRANSFORM_STREAM_CHANGE == hr)
+        {
+            ptr_sample = NULL;
+            CHK(hr, OnStreamChange_());
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            continue;
+        }
+        if (FAILED(hr))
+        {
+            DBGLOG("ERROR, ProcessOutput failed" << HRLOG(hr));
+            return hr;
+        }
+        SetEvent(output_taken_);
+        if (!ptr_sample)
+        {
+            continue;
+        }
+        Output queued;
+        queued.ptr_sample = ptr_sample;
+        EnterCriticalSection(&lock_);
+        queued.type_changed = type_changed_;
+        type_changed_ = false;
+        outputs_.push_back(queued);
+        LeaveCriticalSection(&lock_);
+        SetEvent(output_queued_);
+    }
+}
+
+HRESULT MfTransformDriver::GetOutputStreamInfo_()
+{
+    MFT_OUTPUT_STREAM_INFO stream_info = {0};
+    HRESULT hr;
+    EnterCriticalSection(&mft_lock_);
+    CHK(hr, ptr_transform_->ptr_transform_->GetOutputStreamInfo(
+                0, &stream_info));
+    LeaveCriticalSection(&mft_lock_);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const DWORD provides = MFT_OUTPUT_STREAM_PROVIDES_SAMPLES |
+                           MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES;
+    EnterCriticalSection(&lock_);
+    output_size_ = stream_info.cbSize;
+    output_alignment_ = stream_info.cbAlignment ?
+                        stream_info.cbAlignment - 1 : 0;
+    mft_provides_samples_ = (stream_info.dwFlags & provides) != 0;
+    LeaveCriticalSection(&lock_);
+    return S_OK;
+}
+
+HRESULT MfTransformDriver::GetPoolSample_(IMFSample** ptr_sample)
+{
+    HRESULT hr;
+    for (;;)
+    {
+        IMFSamplePtr ptr_pooled;
+        bool allocate = false;
+        DWORD size = 0;
+        DWORD alignment = 0;
+        EnterCriticalSection(&lock_);
+        if (!free_samples_.empty())
+        {
+            ptr_pooled.Attach(free_samples_.back());
+            free_samples_.pop_back();
+        }
+        else if (pool_size_ < queue_depth_ + 2)
+        {
+            ++pool_size_;
+            allocate = true;
+            size = output_size_;
+            alignment = output_alignment_;
+        }
+        LeaveCriticalSection(&lock_);
+        if (allocate)
+        {
+            IMFTrackedSamplePtr ptr_tracked;
+            IMFMediaBufferPtr ptr_buffer;
+            CHK(hr, MFCreateTrackedSample(&ptr_tracked));
+            if (SUCCEEDED(hr))
+            {
+                ptr_pooled = ptr_tracked;
+                hr = ptr_pooled ? S_OK : E_NOINTERFACE;
+            }
+            if (SUCCEEDED(hr))
+            {
+                CHK(hr, MFCreateAlignedMemoryBuffer(size, alignment,
+                                                    &ptr_buffer));
+            }
+            if (SUCCEEDED(hr))
+            {
+                CHK(hr, ptr_pooled->AddBuffer(ptr_buffer));
+            }
+            if (FAILED(hr))
+            {
+                EnterCriticalSection(&lock_);
+                --pool_size_;
+                LeaveCriticalSection(&lock_);
+                return hr;
+            }
+        }
+        if (ptr_pooled)
+        {
+            // Each release of a tracked sample calls the allocator once; set
+            // it again for this use.
+            IMFTrackedSamplePtr ptr_tracked = ptr_pooled;
+            if (!ptr_tracked)
+            {
+                DBGLOG("ERROR, pool sample not tracked");
+                return E_NOINTERFACE;
+            }
+            CHK(hr, ptr_tracked->SetAllocator(this, NULL));
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            *ptr_sample = ptr_pooled.Detach();
+            return S_OK;
+        }
+        // Every sample is queued, or with the caller.
+        if (!Wait_(sample_freed_))
+        {
+            return MF_E_SHUTDOWN;
+        }
+    }
+}
+
+HRESULT MfTransformDriver::OnStreamChange_()
+{
+    IMFTransform* const ptr_mft = ptr_transform_->ptr_transform_;
+    IMFMediaTypePtr ptr_type;
+    HRESULT hr;
+    EnterCriticalSection(&mft_lock_);
+    CHK(hr, ptr_mft->GetOutputAvailableType(0, 0, &ptr_type));
+    if (SUCCEEDED(hr))
+    {
+        CHK(hr, ptr_mft->SetOutputType(0, ptr_type, 0));
+    }
+    if (SUCCEEDED(hr))
+    {
+        ptr_transform_->ptr_output_type_ = ptr_type;
+    }
+    LeaveCriticalSection(&mft_lock_);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, GetOutputStreamInfo_());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    // The free samples may be too small for the new type; the rest are
+    // checked as they come back.
+    std::vector<IMFSample*> free_samples;
+    EnterCriticalSection(&lock_);
+    free_samples.swap(free_samples_);
+    pool_size_ -= static_cast<UINT>(free_samples.size());
+    type_changed_ = true;
+    LeaveCriticalSection(&lock_);
+    for (size_t i = 0; i < free_samples.size(); ++i)
+    {
+        free_samples[i]->Release();
+    }
+    return S_OK;
+}
+
+void MfTransformDriver::Fail_(HRESULT hr)
+{
+    EnterCriticalSection(&lock_);
+    if (SUCCEEDED(error_))
+    {
+        error_ = hr;
+    }
+    LeaveCriticalSection(&lock_);
+    // The other thread, and a caller that is waiting, stop with the error.
+    SetEvent(stop_event_);
+}
+
+// Waits for |event_handle|, or for |stop_event_|; returns false for the
+// latter. Neither thread, nor a caller on an STA thread, blocks COM calls
+// while it waits.
+bool MfTransformDriver::Wait_(HANDLE event_handle)
+{
+    HANDLE handles[2] = { stop_event_, event_handle };
+    DWORD index = 0;
+    const HRESULT hr = CoWaitForMultipleHandles(0, INFINITE, 2, handles,
+                                                &index);
+    return SUCCEEDED(hr) && 1 == index;
+}
+
+} // WebmMfUtil namespace
@@ -0,0 +1,140 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_MFTRANSDRIVER_HPP__
+#define __WEBMDSHOW_COMMON_MFTRANSDRIVER_HPP__
+
+#include <deque>
+#include <vector>
+
+#include "debugutil.h"
+#include "memutilfwd.h"
+
+namespace WebmMfUtil
+{
+
+class MfTransformWrapper;
+
+// Drives the MFT of an |MfTransformWrapper| from two threads of its own:
+// one feeds it the samples passed to |QueueInput|, the other takes its
+// output for |GetOutput|. The MFT is called by one of them at a time, but
+// neither waits on the caller, so the MFT works while the caller reads its
+// next input or handles its last output. MF_E_NOTACCEPTING and
+// MF_E_TRANSFORM_NEED_MORE_INPUT make a thread wait for the other to make
+// progress, not poll; MF_E_TRANSFORM_STREAM_CHANGE is handled by the
+// output thread, which sets the MFT's first available output type.
+//
+// Unless the MFT provides its own, the output samples come from a pool:
+// each is an IMFTrackedSample that returns to the pool when its last
+// reference is released, so a steady stream allocates nothing. The pool
+// holds at most |queue_depth| + 2 samples (the queued outputs, the one in
+// the MFT and the one the caller last took), so a caller that keeps its
+// outputs stalls the output thread, and in time |QueueInput|: feed and
+// drain from different threads, or interleave the calls.
+//
+// The wrapper's types must be set before |Create|, and the wrapper must
+// not be used otherwise until |Stop|. Call |Stop| before the last
+// |Release|: queued outputs hold references to the driver.
+class MfTransformDriver : public IMFAsyncCallback
+{
+public:
+    static HRESULT Create(MfTransformWrapper* ptr_transform,
+                          UINT queue_depth,
+                          MfTransformDriver** ptr_instance);
+    // Queues |ptr_sample| for the MFT, waiting while |queue_depth| samples
+    // are queued.
+    HRESULT QueueInput(IMFSample* ptr_sample);
+    // Ends the input: the MFT is drained once it has the queued samples.
+    HRESULT EndOfInput();
+    // Returns the next output, waiting for it. Returns S_FALSE (with the
+    // sample) if the output type changed since the last one; use
+    // |MfTransformWrapper::GetOutputType| for the new type. Returns
+    // MF_E_END_OF_STREAM once the MFT has been drained and every output
+    // has been returned, and the first error of either thread otherwise.
+    HRESULT GetOutput(IMFSample** ptr_sample);
+    // Stops both threads, and flushes the MFT. Called on destruction.
+    HRESULT Stop();
+    // IUnknown methods
+    STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
+    STDMETHODIMP_(ULONG) AddRef();
+    STDMETHODIMP_(ULONG) Release();
+    // IMFAsyncCallback methods; |Invoke| is called as a tracked output
+    // sample is released.
+    STDMETHODIMP GetParameters(DWORD*, DWORD*);
+    STDMETHODIMP Invoke(IMFAsyncResult* pAsyncResult);
+
+private:
+    _COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, IID_IMFMediaBuffer);
+    _COM_SMARTPTR_TYPEDEF(IMFMediaType, IID_IMFMediaType);
+    _COM_SMARTPTR_TYPEDEF(IMFSample, IID_IMFSample);
+    _COM_SMARTPTR_TYPEDEF(IMFTrackedSample, __uuidof(IMFTrackedSample));
+
+    struct Output
+    {
+        IMFSamplePtr ptr_sample;
+        bool type_changed;
+    };
+
+    MfTransformDriver();
+    ~MfTransformDriver();
+    HRESULT Create_(MfTransformWrapper* ptr_transform, UINT queue_depth);
+    static unsigned __stdcall InputThread_(void* ptr_this);
+    static unsigned __stdcall OutputThread_(void* ptr_this);
+    HRESULT FeedInput_();
+    HRESULT DrainOutput_();
+    HRESULT GetOutputStreamInfo_();
+    HRESULT GetPoolSample_(IMFSample** ptr_sample);
+    HRESULT OnStreamChange_();
+    void Fail_(HRESULT hr);
+    bool Wait_(HANDLE event_handle);
+
+    MfTransformWrapper* ptr_transform_;
+    UINT queue_depth_;
+    ULONG ref_count_;
+
+    // Guards the members below it.
+    CRITICAL_SECTION lock_;
+    // A NULL sample marks the end of the input.
+    std::deque<IMFSample*> inputs_;
+    std::deque<Output> outputs_;
+    // Released output samples, ready to be passed to ProcessOutput.
+    std::vector<IMFSample*> free_samples_;
+    UINT pool_size_;  // samples allocated, and not yet dropped
+    // The size of the output buffers the MFT wants; the pool drops samples
+    // that are smaller.
+    DWORD output_size_;
+    DWORD output_alignment_;
+    bool mft_provides_samples_;
+    bool type_changed_;
+    bool input_ended_;  // by |EndOfInput|
+    bool draining_;     // the MFT has been told to drain
+    bool drained_;
+    HRESULT error_;
+
+    // Serializes the calls to the MFT, which need not be thread safe.
+    CRITICAL_SECTION mft_lock_;
+
+    // Manual-reset; stops both threads, and fails any caller waiting.
+    HANDLE stop_event_;
+    // Auto-reset; each is set after the change of state it names, and
+    // waited on only by the side that needs it.
+    HANDLE input_queued_;     // |inputs_| grew, for the input thread
+    HANDLE input_space_;      // |inputs_| shrank, for |QueueInput|
+    HANDLE input_accepted_;   // ProcessInput succeeded, for the output thread
+    HANDLE output_taken_;     // ProcessOutput gave a sample, for the input
+                              // thread
+    HANDLE output_queued_;    // |outputs_| grew or ended, for |GetOutput|
+    HANDLE sample_freed_;     // |free_samples_| grew, for the output thread
+    HANDLE threads_[2];
+
+    DISALLOW_COPY_AND_ASSIGN(MfTransformDriver);
+};
+
+} // WebmMfUtil namespace
+
+#endif // __WEBMDSHOW_COMMON_MFTRANSDRIVER_HPP__
@@ -35,6 +35,8 @@ public:
     STDMETHODIMP_(ULONG) AddRef();
     STDMETHODIMP_(ULONG) Release();
 private:
+    friend class MfTransformDriver;
+
     _COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, IID_IMFMediaBuffer);
     _COM_SMARTPTR_TYPEDEF(IMFTransform, IID_IMFTransform);
 
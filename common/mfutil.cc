@@ -368,9 +368,25 @@ HRESULT setup_webm_vp8_decoder(const std::wstring& url,
         DBGLOG("ERROR no video streams.");
         return E_INVALIDARG;
     }
-    using WebmTypes::CLSID_WebmMfVp8Dec;
+    // The VP8 decoder dll holds the VP9 decoder transform too; pick the one
+    // for the stream's subtype.
+    _COM_SMARTPTR_TYPEDEF(IMFMediaType, IID_IMFMediaType);
+    IMFMediaTypePtr ptr_type;
+    CHK(hr, ptr_source->GetVideoMediaType(&ptr_type));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    GUID subtype = GUID_NULL;
+    CHK(hr, ptr_type->GetGUID(MF_MT_SUBTYPE, &subtype));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const GUID& clsid = (subtype == WebmTypes::MEDIASUBTYPE_VP90) ?
+        WebmTypes::CLSID_WebmMfVp9Dec : WebmTypes::CLSID_WebmMfVp8Dec;
     auto_ref_counted_obj_ptr<MfTransformWrapper> ptr_decoder(NULL);
-    CHK(hr, open_webm_decoder(VP8DEC_PATH, CLSID_WebmMfVp8Dec, &ptr_decoder));
+    CHK(hr, open_webm_decoder(VP8DEC_PATH, clsid, &ptr_decoder));
     if (FAILED(hr))
     {
         return hr;
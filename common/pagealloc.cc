@@ -0,0 +1,133 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pagealloc.h"
+
+#include <windows.h>
+
+#include <cassert>
+
+namespace webmdshow {
+
+namespace {
+
+INIT_ONCE g_large_pages_once = INIT_ONCE_STATIC_INIT;
+size_t g_large_page_size;
+
+BOOL CALLBACK InitLargePages(INIT_ONCE*, void*, void**) {
+  const SIZE_T minimum = GetLargePageMinimum();
+
+  if (minimum == 0)
+    return TRUE;
+
+  HANDLE token;
+
+  if (!OpenProcessToken(GetCurrentProcess(),
+                        TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+    return TRUE;
+  }
+
+  TOKEN_PRIVILEGES privileges;
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+  // AdjustTokenPrivileges succeeds even if the token does not hold the
+  // privilege; only the last error says whether it was enabled.
+  if (LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME,
+                            &privileges.Privileges[0].Luid) &&
+      AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+      GetLastError() == ERROR_SUCCESS) {
+    g_large_page_size = minimum;
+  }
+
+  CloseHandle(token);
+  return TRUE;
+}
+
+size_t RoundUp(size_t size, size_t page_size) {
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+void* Commit(size_t size, int node, DWORD type) {
+  if (node < 0)
+    return VirtualAlloc(NULL, size, type, PAGE_READWRITE);
+
+  return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, type,
+                            PAGE_READWRITE, static_cast<DWORD>(node));
+}
+
+}  // namespace
+
+size_t GetLargePageSize() {
+  const BOOL b =
+      InitOnceExecuteOnce(&g_large_pages_once, InitLargePages, NULL, NULL);
+  b;
+  assert(b);
+
+  return g_large_page_size;
+}
+
+int GetCurrentNumaNode() {
+  ULONG highest_node;
+
+  if (!GetNumaHighestNodeNumber(&highest_node) || highest_node == 0)
+    return -1;
+
+  PROCESSOR_NUMBER processor;
+  GetCurrentProcessorNumberEx(&processor);
+
+  USHORT node;
+
+  if (!GetNumaProcessorNodeEx(&processor, &node))
+    return -1;
+
+  return node;
+}
+
+void* AllocatePages(size_t size, int node, size_t* committed, bool* large) {
+  assert(committed);
+  assert(large);
+
+  const size_t large_page_size = GetLargePageSize();
+
+  if (large_page_size > 0 && size >= large_page_size / 2) {
+    const size_t rounded = RoundUp(size, large_page_size);
+    void* const pages =
+        Commit(rounded, node, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES);
+
+    if (pages) {
+      *committed = rounded;
+      *large = true;
+      return pages;
+    }
+  }
+
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+
+  const size_t rounded = RoundUp(size, info.dwPageSize);
+  void* const pages = Commit(rounded, node, MEM_RESERVE | MEM_COMMIT);
+
+  if (pages == NULL)
+    return NULL;
+
+  *committed = rounded;
+  *large = false;
+  return pages;
+}
+
+void FreePages(void* pages) {
+  if (pages == NULL)
+    return;
+
+  const BOOL b = VirtualFree(pages, 0, MEM_RELEASE);
+  b;
+  assert(b);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,40 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_PAGEALLOC_H_
+#define WEBMDSHOW_COMMON_PAGEALLOC_H_
+
+#include <stddef.h>
+
+namespace webmdshow {
+
+// Returns the size of a large page, or 0 if the process cannot allocate
+// them: either the system does not support them, or the process token
+// lacks SeLockMemoryPrivilege. The first call enables the privilege if
+// the token holds it.
+size_t GetLargePageSize();
+
+// Returns the NUMA node of the processor the calling thread is running
+// on, or -1 if the system has a single node.
+int GetCurrentNumaNode();
+
+// Commits |size| bytes of zeroed pages with VirtualAlloc, on NUMA node
+// |node| (or anywhere, if |node| is -1). Buffers of at least half a large
+// page are taken from large pages when GetLargePageSize allows it, and
+// from ordinary pages if the system has no contiguous large pages left.
+// Sets |*committed| to the size committed, rounded up to the page size,
+// and |*large| to whether large pages were used. Returns NULL if out of
+// memory.
+void* AllocatePages(size_t size, int node, size_t* committed, bool* large);
+
+// Frees a buffer from AllocatePages.
+void FreePages(void* pages);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_PAGEALLOC_H_
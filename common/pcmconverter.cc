@@ -0,0 +1,486 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pcmconverter.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define WEBMDSHOW_PCMCONVERTER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace webmdshow {
+
+namespace {
+
+enum Speaker { FL, FR, FC, LFE, BL, BR, SL, SR, BC };
+
+const int kMaxChannels = 8;
+
+const Speaker kLayouts[kMaxChannels][kMaxChannels] = {
+  { FC },
+  { FL, FR },
+  { FL, FR, FC },
+  { FL, FR, BL, BR },
+  { FL, FR, FC, BL, BR },
+  { FL, FR, FC, LFE, BL, BR },
+  { FL, FR, FC, LFE, BC, SL, SR },
+  { FL, FR, FC, LFE, BL, BR, SL, SR },
+};
+
+const float kMinus3dB = 0.70710678f;
+
+// Half the taps of a phase when the rate goes up; with the Kaiser window
+// below, the stopband is down 80dB, and the transition is about a tenth
+// of the band.
+const int kHalfTaps = 32;
+const double kKaiserBeta = 8.0;
+
+// The cutoff, as a fraction of the lower of the two Nyquist rates.
+const double kPassband = 0.9;
+
+// Bounds on the filter table, which rates with a large common multiple
+// would make huge.
+const int kMaxPhases = 1024;
+const int kMaxCoefs = 1 << 20;
+
+int Gcd(int a, int b) {
+  while (b != 0) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
+
+bool IsSupportedLayout(int in_channels, int out_channels) {
+  if (in_channels < 1 || in_channels > kMaxChannels)
+    return false;
+
+  if (out_channels == in_channels || out_channels == 1 || out_channels == 2)
+    return true;
+
+  return out_channels == 6 && in_channels > 6;
+}
+
+// Sets the phases and taps of the filter from |in_rate| to |out_rate|;
+// the rates are equal when |up| and |down| are 1.
+bool GetFilterSize(int in_rate, int out_rate, int* up, int* down, int* taps) {
+  if (in_rate < PcmConverter::kMinRate || in_rate > PcmConverter::kMaxRate)
+    return false;
+
+  if (out_rate < PcmConverter::kMinRate || out_rate > PcmConverter::kMaxRate)
+    return false;
+
+  const int g = Gcd(in_rate, out_rate);
+
+  *up = out_rate / g;
+  *down = in_rate / g;
+
+  if (*up == *down) {
+    *taps = 0;
+    return true;
+  }
+
+  if (*up > kMaxPhases)
+    return false;
+
+  // The filter stretches with the cutoff; half is kept a multiple of 4,
+  // so that the taps are a multiple of 8.
+  int half = kHalfTaps;
+
+  if (*down > *up)
+    half = static_cast<int>(ceil(double(kHalfTaps) * *down / *up));
+
+  half = (half + 3) & ~3;
+  *taps = 2 * half;
+
+  return *taps <= kMaxCoefs / *up;
+}
+
+float GetGain(Speaker in, Speaker out, int in_channels, int out_channels) {
+  if (in == out)
+    return 1.0f;
+
+  if (in == LFE)
+    return 0.0f;
+
+  if (out_channels == 1) {
+    if (in == FL || in == FR)
+      return kMinus3dB;
+
+    return 0.5f;  // the surrounds
+  }
+
+  if (out_channels == 2) {
+    if (in_channels == 1)
+      return 1.0f;  // mono to both
+
+    switch (in) {
+      case FC:
+        return kMinus3dB;
+      case BL:
+      case SL:
+        return (out == FL) ? kMinus3dB : 0.0f;
+      case BR:
+      case SR:
+        return (out == FR) ? kMinus3dB : 0.0f;
+      case BC:
+        return 0.5f;
+      default:
+        return 0.0f;
+    }
+  }
+
+  // To 5.1, from 6.1 or 7.1: the sides and the back centre fold into the
+  // back pair.
+  switch (in) {
+    case SL:
+      return (out == BL) ? kMinus3dB : 0.0f;
+    case SR:
+      return (out == BR) ? kMinus3dB : 0.0f;
+    case BC:
+      return (out == BL || out == BR) ? kMinus3dB : 0.0f;
+    default:
+      return 0.0f;
+  }
+}
+
+// The zeroth order modified Bessel function of the first kind, which
+// the Kaiser window is made of.
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+
+  for (int k = 1; k < 64; ++k) {
+    const double t = x / (2.0 * k);
+    term *= t * t;
+    sum += term;
+
+    if (term < sum * 1e-12)
+      break;
+  }
+
+  return sum;
+}
+
+// Sets |coefs| to |up| phases of |taps| coefficients, phase p filtering
+// the input p / up of a sample after the centre tap. Each phase sums to 1.
+void MakeFilter(int up, int down, int taps, std::vector<float>* coefs) {
+  const double pi = 3.14159265358979323846;
+
+  // In cycles per input sample.
+  const double ratio = (down > up) ? double(up) / down : 1.0;
+  const double fc = 0.5 * kPassband * ratio;
+
+  const double half = taps / 2;
+  const double i0_beta = BesselI0(kKaiserBeta);
+
+  coefs->resize(static_cast<size_t>(up) * taps);
+
+  std::vector<double> row(taps);
+
+  for (int p = 0; p < up; ++p) {
+    double sum = 0.0;
+
+    for (int j = 0; j < taps; ++j) {
+      const double x = (j - (half - 1)) - double(p) / up;
+      const double u = x / half;
+
+      double w = 0.0;
+
+      if (u > -1.0 && u < 1.0)
+        w = BesselI0(kKaiserBeta * sqrt(1.0 - u * u)) / i0_beta;
+
+      const double y = 2.0 * fc * x;
+      const double sinc = (y == 0.0) ? 1.0 : sin(pi * y) / (pi * y);
+
+      row[j] = 2.0 * fc * sinc * w;
+      sum += row[j];
+    }
+
+    float* const dst = &(*coefs)[static_cast<size_t>(p) * taps];
+
+    for (int j = 0; j < taps; ++j)
+      dst[j] = static_cast<float>(row[j] / sum);
+  }
+}
+
+// Sets |dst| to |gain| times |src|, or adds that to it.
+void MixPlane(const float* src, float gain, bool add, int count, float* dst) {
+  int i = 0;
+
+#ifdef WEBMDSHOW_PCMCONVERTER_SSE
+  const __m128 g = _mm_set1_ps(gain);
+
+  if (add) {
+    for (; i + 4 <= count; i += 4) {
+      const __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+      _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+    }
+  } else {
+    for (; i + 4 <= count; i += 4)
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+  }
+#endif
+
+  if (add) {
+    for (; i < count; ++i)
+      dst[i] += src[i] * gain;
+  } else {
+    for (; i < count; ++i)
+      dst[i] = src[i] * gain;
+  }
+}
+
+// |taps| is a multiple of 8.
+float Dot(const float* x, const float* h, int taps) {
+#ifdef WEBMDSHOW_PCMCONVERTER_SSE
+  __m128 a0 = _mm_setzero_ps();
+  __m128 a1 = _mm_setzero_ps();
+
+  for (int j = 0; j < taps; j += 8) {
+    a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(h + j)));
+    a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + j + 4),
+                                   _mm_loadu_ps(h + j + 4)));
+  }
+
+  __m128 a = _mm_add_ps(a0, a1);
+  a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+
+  return _mm_cvtss_f32(a);
+#else
+  float sum = 0.0f;
+
+  for (int j = 0; j < taps; ++j)
+    sum += x[j] * h[j];
+
+  return sum;
+#endif
+}
+
+}  // namespace
+
+PcmConverter::PcmConverter()
+    : in_channels_(0),
+      out_channels_(0),
+      passthrough_(false),
+      up_(1),
+      down_(1),
+      taps_(0),
+      held_count_(0),
+      pos_(0),
+      phase_(0) {
+}
+
+bool PcmConverter::IsSupported(int in_channels, int in_rate,
+                               int out_channels, int out_rate) {
+  if (!IsSupportedLayout(in_channels, out_channels))
+    return false;
+
+  int up, down, taps;
+  return GetFilterSize(in_rate, out_rate, &up, &down, &taps);
+}
+
+bool PcmConverter::Init(int in_channels, const int* order, int in_rate,
+                        int out_channels, int out_rate) {
+  in_channels_ = 0;
+  out_channels_ = 0;
+  passthrough_ = false;
+  coefs_.clear();
+  held_.clear();
+  output_.clear();
+  output_ptrs_.clear();
+
+  if (!IsSupportedLayout(in_channels, out_channels))
+    return false;
+
+  if (!GetFilterSize(in_rate, out_rate, &up_, &down_, &taps_))
+    return false;
+
+  in_channels_ = in_channels;
+  out_channels_ = out_channels;
+
+  order_.resize(in_channels);
+
+  bool in_order = true;
+
+  for (int i = 0; i < in_channels; ++i) {
+    order_[i] = order ? order[i] : i;
+    in_order = in_order && (order_[i] == i);
+  }
+
+  matrix_.assign(static_cast<size_t>(out_channels) * in_channels, 0.0f);
+
+  const Speaker* const in_layout = kLayouts[in_channels - 1];
+  const Speaker* const out_layout = kLayouts[out_channels - 1];
+
+  float max_sum = 0.0f;
+
+  for (int o = 0; o < out_channels; ++o) {
+    float* const row = &matrix_[static_cast<size_t>(o) * in_channels];
+    float sum = 0.0f;
+
+    for (int i = 0; i < in_channels; ++i) {
+      row[i] = (in_channels == out_channels) ?
+               ((i == o) ? 1.0f : 0.0f) :
+               GetGain(in_layout[i], out_layout[o], in_channels,
+                       out_channels);
+      sum += row[i];
+    }
+
+    if (sum > max_sum)
+      max_sum = sum;
+  }
+
+  if (max_sum > 1.0f) {
+    for (size_t k = 0; k < matrix_.size(); ++k)
+      matrix_[k] /= max_sum;
+  }
+
+  passthrough_ = (in_channels == out_channels) && in_order && (up_ == down_);
+
+  if (up_ != down_) {
+    MakeFilter(up_, down_, taps_, &coefs_);
+    held_.resize(out_channels);
+  }
+
+  output_.resize(out_channels);
+  output_ptrs_.resize(out_channels);
+
+  Reset();
+
+  return true;
+}
+
+void PcmConverter::Reset() {
+  pos_ = 0;
+  phase_ = 0;
+
+  // The first output is centred on the first input sample.
+  held_count_ = (taps_ > 0) ? taps_ / 2 - 1 : 0;
+
+  for (size_t o = 0; o < held_.size(); ++o)
+    held_[o].assign(held_count_, 0.0f);
+}
+
+int PcmConverter::Process(const float* const* src, int count) {
+  assert(src || count <= 0);
+
+  if (in_channels_ <= 0 || count <= 0)
+    return 0;
+
+  if (up_ == down_) {
+    for (int o = 0; o < out_channels_; ++o) {
+      if (output_[o].size() < static_cast<size_t>(count))
+        output_[o].resize(count);
+    }
+
+    Mix(src, count, 0, &output_[0]);
+
+    for (int o = 0; o < out_channels_; ++o)
+      output_ptrs_[o] = &output_[o][0];
+
+    return count;
+  }
+
+  for (int o = 0; o < out_channels_; ++o) {
+    const size_t size = static_cast<size_t>(held_count_) + count;
+
+    if (held_[o].size() < size)
+      held_[o].resize(size);
+  }
+
+  Mix(src, count, held_count_, &held_[0]);
+  held_count_ += count;
+
+  return Resample();
+}
+
+void PcmConverter::Mix(const float* const* src, int count, int offset,
+                       std::vector<float>* dst) {
+  for (int o = 0; o < out_channels_; ++o) {
+    const float* const row = &matrix_[static_cast<size_t>(o) * in_channels_];
+    float* const d = &dst[o][offset];
+
+    bool mixed = false;
+
+    for (int i = 0; i < in_channels_; ++i) {
+      const float gain = row[i];
+
+      if (gain == 0.0f)
+        continue;
+
+      const float* const s = src[order_[i]];
+
+      if (!mixed && gain == 1.0f)
+        memcpy(d, s, count * sizeof(float));
+      else
+        MixPlane(s, gain, mixed, count, d);
+
+      mixed = true;
+    }
+
+    if (!mixed)
+      memset(d, 0, count * sizeof(float));
+  }
+}
+
+int PcmConverter::Resample() {
+  const long long max_count =
+      static_cast<long long>(held_count_) * up_ / down_ + 2;
+
+  for (int o = 0; o < out_channels_; ++o) {
+    if (output_[o].size() < static_cast<size_t>(max_count))
+      output_[o].resize(static_cast<size_t>(max_count));
+
+    output_ptrs_[o] = &output_[o][0];
+  }
+
+  int count = 0;
+
+  while (pos_ + taps_ <= held_count_) {
+    const float* const h = &coefs_[static_cast<size_t>(phase_) * taps_];
+
+    for (int o = 0; o < out_channels_; ++o)
+      output_[o][count] = Dot(&held_[o][pos_], h, taps_);
+
+    ++count;
+
+    phase_ += down_;
+    pos_ += phase_ / up_;
+    phase_ %= up_;
+  }
+
+  assert(count <= max_count);
+
+  // Keep what the next output reaches back to.  A large step down can
+  // put the next output past what is held, and so skip input yet to come.
+  const int drop = (pos_ < held_count_) ? pos_ : held_count_;
+
+  if (drop > 0) {
+    const int kept = held_count_ - drop;
+
+    for (int o = 0; o < out_channels_; ++o) {
+      float* const h = &held_[o][0];
+      memmove(h, h + drop, kept * sizeof(float));
+    }
+
+    held_count_ = kept;
+    pos_ -= drop;
+  }
+
+  return count;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,102 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_PCMCONVERTER_H_
+#define WEBMDSHOW_COMMON_PCMCONVERTER_H_
+
+#include <vector>
+
+namespace webmdshow {
+
+// Converts planar float PCM to another channel count and sample rate, so
+// that a decoder can deliver the format of the device instead of leaving
+// the conversion to a mixer filter downstream.
+//
+// The channels of each layout are those of the default WAVE channel mask
+// for the count, in WAVE order:
+//   1: FC   2: FL FR   3: FL FR FC   4: FL FR BL BR   5: FL FR FC BL BR
+//   6: FL FR FC LFE BL BR   7: FL FR FC LFE BC SL SR
+//   8: FL FR FC LFE BL BR SL SR
+// The supported conversions are to the same count, to stereo or mono from
+// any count, and to 5.1 from 6.1 and 7.1. The downmix drops the LFE and
+// mixes the centre and surround channels in at -3dB, then scales the
+// matrix so that no output can be louder than full scale.
+//
+// The resampler is a polyphase windowed-sinc filter, with a phase for
+// each output position between two input samples, and a Kaiser window;
+// when the rate goes down, the cutoff, and with it the filter, scales to
+// the output rate. Mixing happens as the input is read, once per sample,
+// so the resampler filters the output channels only.
+class PcmConverter {
+ public:
+  enum {
+    kMinRate = 8000,
+    kMaxRate = 192000,
+  };
+
+  PcmConverter();
+
+  // Whether Init would accept the arguments.
+  static bool IsSupported(int in_channels, int in_rate, int out_channels,
+                          int out_rate);
+
+  // Sets up the conversion, and returns false, the converter then being
+  // empty, for an unsupported one. WAVE channel i of the input is read
+  // from src[order[i]] by Process; pass NULL for |order| to keep the
+  // source order.
+  bool Init(int in_channels, const int* order, int in_rate, int out_channels,
+            int out_rate);
+
+  int in_channels() const { return in_channels_; }
+  int out_channels() const { return out_channels_; }
+
+  // Whether the conversion is a copy: the caller may skip Process.
+  bool passthrough() const { return passthrough_; }
+
+  // Converts |count| frames of |src|, an array of in_channels() planes,
+  // and returns the number of frames made, at output(). The resampler
+  // holds back the input its filter reaches past, so the output of a
+  // call can be a little short of |count| times the rate ratio; it is
+  // made up by the next call.
+  int Process(const float* const* src, int count);
+
+  // The out_channels() planes that the last Process wrote.
+  const float* const* output() const { return &output_ptrs_[0]; }
+
+  // Discards the input the resampler holds, at a flush.
+  void Reset();
+
+ private:
+  void Mix(const float* const* src, int count, int offset,
+           std::vector<float>* dst);
+  int Resample();
+
+  int in_channels_;
+  int out_channels_;
+  bool passthrough_;
+
+  std::vector<int> order_;
+  std::vector<float> matrix_;  // out_channels_ rows of in_channels_
+
+  int up_;  // output rate / gcd
+  int down_;  // input rate / gcd
+  int taps_;  // per phase; a multiple of 4
+  std::vector<float> coefs_;  // up_ phases of taps_
+
+  std::vector<std::vector<float> > held_;  // input, per output channel
+  int held_count_;
+  int pos_;  // of the first tap of the next output, in held_
+  int phase_;
+
+  std::vector<std::vector<float> > output_;
+  std::vector<const float*> output_ptrs_;
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_PCMCONVERTER_H_
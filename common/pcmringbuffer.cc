@@ -0,0 +1,152 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pcmringbuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+// Frames per chunk converted by ReadInt16.
+const int kInt16ChunkFrames = 256;
+
+}  // namespace
+
+PcmRingBuffer::PcmRingBuffer()
+    : channels_(0), capacity_(0), head_(0), size_(0) {
+}
+
+void PcmRingBuffer::Reset(int channels, int capacity) {
+  assert(channels >= 0);
+  assert(capacity >= 0);
+
+  channels_ = channels;
+  capacity_ = capacity;
+  head_ = 0;
+  size_ = 0;
+
+  samples_.assign(static_cast<size_t>(channels) * capacity, 0.0f);
+  planes_.resize(channels);
+  scratch_.clear();
+}
+
+void PcmRingBuffer::Clear() {
+  head_ = 0;
+  size_ = 0;
+}
+
+void PcmRingBuffer::Write(const float* const* src, int count) {
+  assert(src || count <= 0);
+
+  if (count <= 0 || channels_ <= 0)
+    return;
+
+  if (size_ + count > capacity_) {
+    const int doubled = 2 * capacity_;
+    Grow((doubled > size_ + count) ? doubled : size_ + count);
+  }
+
+  int tail = head_ + size_;
+
+  if (tail >= capacity_)
+    tail -= capacity_;
+
+  const int first = (count < capacity_ - tail) ? count : capacity_ - tail;
+  const int second = count - first;
+
+  for (int c = 0; c < channels_; ++c) {
+    float* const ring = &samples_[static_cast<size_t>(c) * capacity_];
+
+    memcpy(ring + tail, src[c], first * sizeof(float));
+
+    if (second > 0)
+      memcpy(ring, src[c] + first, second * sizeof(float));
+  }
+
+  size_ += count;
+}
+
+void PcmRingBuffer::ReadFloat(int count, float* dst) {
+  assert(count >= 0);
+  assert(count <= size_);
+  assert(dst || count == 0);
+
+  for (int done = 0; done < count;) {
+    const int n = GetRun(done, count - done, &planes_[0]);
+    InterleavePcm(&planes_[0], NULL, channels_, n, dst + done * channels_);
+    done += n;
+  }
+
+  head_ += count;
+
+  if (head_ >= capacity_)
+    head_ -= capacity_;
+
+  size_ -= count;
+}
+
+void PcmRingBuffer::ReadInt16(int count, PcmDither dither,
+                              PcmDitherState* state, int16_t* dst) {
+  assert(count >= 0);
+  assert(count <= size_);
+  assert(dst || count == 0);
+
+  scratch_.resize(static_cast<size_t>(kInt16ChunkFrames) * channels_);
+
+  while (count > 0) {
+    const int n = (count < kInt16ChunkFrames) ? count : kInt16ChunkFrames;
+    const int samples = n * channels_;
+
+    ReadFloat(n, &scratch_[0]);
+    ConvertFloatToInt16(&scratch_[0], samples, dither, state, dst);
+
+    dst += samples;
+    count -= n;
+  }
+}
+
+int PcmRingBuffer::GetRun(int offset, int count, const float** planes) const {
+  assert(offset + count <= size_);
+
+  int pos = head_ + offset;
+
+  if (pos >= capacity_)
+    pos -= capacity_;
+
+  for (int c = 0; c < channels_; ++c)
+    planes[c] = &samples_[static_cast<size_t>(c) * capacity_ + pos];
+
+  return (count < capacity_ - pos) ? count : capacity_ - pos;
+}
+
+void PcmRingBuffer::Grow(int capacity) {
+  assert(capacity > capacity_);
+
+  std::vector<float> samples(static_cast<size_t>(channels_) * capacity);
+
+  // Unwraps the stored frames to the start of each new ring.
+  for (int done = 0; done < size_;) {
+    const int n = GetRun(done, size_ - done, &planes_[0]);
+
+    for (int c = 0; c < channels_; ++c) {
+      float* const ring = &samples[static_cast<size_t>(c) * capacity];
+      memcpy(ring + done, planes_[c], n * sizeof(float));
+    }
+
+    done += n;
+  }
+
+  samples_.swap(samples);
+  capacity_ = capacity;
+  head_ = 0;
+}
+
+}  // namespace webmdshow
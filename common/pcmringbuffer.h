@@ -0,0 +1,69 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_PCMRINGBUFFER_H_
+#define WEBMDSHOW_COMMON_PCMRINGBUFFER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "pcmutil.h"
+
+namespace webmdshow {
+
+// A FIFO of planar float PCM. Each channel is a ring of the same capacity
+// in one allocation, so writes are a memcpy or two per channel and reads
+// interleave whole runs of frames at a time. The capacity is fixed by
+// Reset; a write that does not fit grows the rings, which a caller that
+// sizes them for its largest read plus its largest write never sees.
+class PcmRingBuffer {
+ public:
+  PcmRingBuffer();
+
+  // Discards the samples, and sizes the buffer for |channels| channels of
+  // |capacity| frames each.
+  void Reset(int channels, int capacity);
+
+  // Discards the samples, keeping the layout.
+  void Clear();
+
+  int channels() const { return channels_; }
+  int capacity() const { return capacity_; }
+  int size() const { return size_; }
+
+  // Appends |count| frames from |src|, an array of channels() planes.
+  void Write(const float* const* src, int count);
+
+  // Removes the first |count| frames, which must be stored, and
+  // interleaves them into |dst|.
+  void ReadFloat(int count, float* dst);
+
+  // As ReadFloat, converting to 16-bit PCM on the way out.
+  void ReadInt16(int count, PcmDither dither, PcmDitherState* state,
+                 int16_t* dst);
+
+ private:
+  // Points |planes| at the |offset|th stored frame of each channel, and
+  // returns how many of the next |count| frames are contiguous from there.
+  int GetRun(int offset, int count, const float** planes) const;
+
+  void Grow(int capacity);
+
+  std::vector<float> samples_;  // channels_ rings of capacity_ frames
+  std::vector<const float*> planes_;  // per channel, for GetRun
+  std::vector<float> scratch_;  // interleaved floats for ReadInt16
+  int channels_;
+  int capacity_;
+  int head_;  // ring index of the first stored frame
+  int size_;
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_PCMRINGBUFFER_H_
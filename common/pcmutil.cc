@@ -0,0 +1,534 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pcmutil.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define WEBMDSHOW_PCMUTIL_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || \
+    defined(__SSE2__)
+#define WEBMDSHOW_PCMUTIL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace webmdshow {
+
+namespace {
+
+// Writes channels [first, first + n) of frames [begin, end).
+void InterleaveScalar(const float* const* in, int first, int n, int channels,
+                      int begin, int end, float* dst) {
+  for (int c = first; c < first + n; ++c) {
+    const float* const s = in[c];
+    float* d = dst + begin * channels + c;
+
+    for (int i = begin; i < end; ++i, d += channels)
+      *d = s[i];
+  }
+}
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+
+// Writes channels [first, first + 4) of frames [0, count), where count is
+// a multiple of 4: each group of four frames is a 4x4 transpose.
+void InterleaveQuad(const float* const* in, int first, int channels,
+                    int count, float* dst) {
+  const float* const s0 = in[first];
+  const float* const s1 = in[first + 1];
+  const float* const s2 = in[first + 2];
+  const float* const s3 = in[first + 3];
+
+  for (int i = 0; i < count; i += 4) {
+    __m128 r0 = _mm_loadu_ps(s0 + i);
+    __m128 r1 = _mm_loadu_ps(s1 + i);
+    __m128 r2 = _mm_loadu_ps(s2 + i);
+    __m128 r3 = _mm_loadu_ps(s3 + i);
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    float* const d = dst + i * channels + first;
+
+    _mm_storeu_ps(d, r0);
+    _mm_storeu_ps(d + channels, r1);
+    _mm_storeu_ps(d + 2 * channels, r2);
+    _mm_storeu_ps(d + 3 * channels, r3);
+  }
+}
+
+// Writes channels [first, first + 2) of frames [0, count), where count is
+// a multiple of 4.
+void InterleavePair(const float* const* in, int first, int channels,
+                    int count, float* dst) {
+  const float* const s0 = in[first];
+  const float* const s1 = in[first + 1];
+
+  for (int i = 0; i < count; i += 4) {
+    const __m128 a = _mm_loadu_ps(s0 + i);
+    const __m128 b = _mm_loadu_ps(s1 + i);
+
+    const __m128 lo = _mm_unpacklo_ps(a, b);  // a0 b0 a1 b1
+    const __m128 hi = _mm_unpackhi_ps(a, b);  // a2 b2 a3 b3
+
+    float* const d = dst + i * channels + first;
+
+    if (channels == 2) {
+      _mm_storeu_ps(d, lo);
+      _mm_storeu_ps(d + 4, hi);
+    } else {
+      _mm_storel_pi(reinterpret_cast<__m64*>(d), lo);
+      _mm_storeh_pi(reinterpret_cast<__m64*>(d + channels), lo);
+      _mm_storel_pi(reinterpret_cast<__m64*>(d + 2 * channels), hi);
+      _mm_storeh_pi(reinterpret_cast<__m64*>(d + 3 * channels), hi);
+    }
+  }
+}
+
+#endif  // WEBMDSHOW_PCMUTIL_SSE
+
+// The sample types DeinterleavePcm reads. Load converts one sample, and
+// Load4 four consecutive samples.
+
+struct Float32Sample {
+  enum { kBytes = 4 };
+
+  static float Load(const uint8_t* p) {
+    float x;
+    memcpy(&x, p, sizeof x);
+    return x;
+  }
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+  static __m128 Load4(const uint8_t* p) {
+    return _mm_loadu_ps(reinterpret_cast<const float*>(p));
+  }
+#endif
+};
+
+struct Int16Sample {
+  enum { kBytes = 2 };
+
+  static float Load(const uint8_t* p) {
+    int16_t x;
+    memcpy(&x, p, sizeof x);
+    return x * (1.0f / 32768.0f);
+  }
+
+#if defined(WEBMDSHOW_PCMUTIL_SSE2)
+  static __m128 Load4(const uint8_t* p) {
+    const __m128i s =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+
+    // each sample to the top of a 32-bit lane, then sign-extended down
+    const __m128i x = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / 32768.0f));
+  }
+#elif defined(WEBMDSHOW_PCMUTIL_SSE)
+  static __m128 Load4(const uint8_t* p) {
+    return _mm_setr_ps(Load(p), Load(p + 2), Load(p + 4), Load(p + 6));
+  }
+#endif
+};
+
+struct Int24Sample {
+  enum { kBytes = 3 };
+
+  static float Load(const uint8_t* p) {
+    // assemble in the top 24 bits, so that the shift sign-extends
+    const int32_t x = static_cast<int32_t>(
+        (uint32_t(p[0]) << 8) | (uint32_t(p[1]) << 16) |
+        (uint32_t(p[2]) << 24)) >> 8;
+
+    return x * (1.0f / 8388608.0f);
+  }
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+  static __m128 Load4(const uint8_t* p) {
+    return _mm_setr_ps(Load(p), Load(p + 3), Load(p + 6), Load(p + 9));
+  }
+#endif
+};
+
+struct Int32Sample {
+  enum { kBytes = 4 };
+
+  static float Load(const uint8_t* p) {
+    int32_t x;
+    memcpy(&x, p, sizeof x);
+    return x * (1.0f / 2147483648.0f);
+  }
+
+#if defined(WEBMDSHOW_PCMUTIL_SSE2)
+  static __m128 Load4(const uint8_t* p) {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(x),
+                      _mm_set1_ps(1.0f / 2147483648.0f));
+  }
+#elif defined(WEBMDSHOW_PCMUTIL_SSE)
+  static __m128 Load4(const uint8_t* p) {
+    return _mm_setr_ps(Load(p), Load(p + 4), Load(p + 8), Load(p + 12));
+  }
+#endif
+};
+
+// Reads channels [first, first + n) of frames [begin, end).
+template <typename Sample>
+void DeinterleaveScalar(const uint8_t* src, int first, int n, int channels,
+                        int begin, int end, float* const* out) {
+  const int stride = channels * Sample::kBytes;
+
+  for (int c = first; c < first + n; ++c) {
+    const uint8_t* s = src + (begin * channels + c) * Sample::kBytes;
+    float* const d = out[c];
+
+    for (int i = begin; i < end; ++i, s += stride)
+      d[i] = Sample::Load(s);
+  }
+}
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+
+// Reads frames [0, count) of a single channel, where count is a multiple
+// of 4.
+template <typename Sample>
+void DeinterleaveMono(const uint8_t* src, int count, float* const* out) {
+  float* const d = out[0];
+
+  for (int i = 0; i < count; i += 4)
+    _mm_storeu_ps(d + i, Sample::Load4(src + i * Sample::kBytes));
+}
+
+// Reads frames [0, count) of two channels, where count is a multiple of 4.
+template <typename Sample>
+void DeinterleaveStereo(const uint8_t* src, int count, float* const* out) {
+  float* const d0 = out[0];
+  float* const d1 = out[1];
+
+  for (int i = 0; i < count; i += 4) {
+    const uint8_t* const s = src + 2 * i * Sample::kBytes;
+
+    const __m128 a = Sample::Load4(s);                        // frames 0, 1
+    const __m128 b = Sample::Load4(s + 4 * Sample::kBytes);  // frames 2, 3
+
+    _mm_storeu_ps(d0 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(d1 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+}
+
+// Reads channels [first, first + 4) of frames [0, count), where count is
+// a multiple of 4: each group of four frames is a 4x4 transpose.
+template <typename Sample>
+void DeinterleaveQuad(const uint8_t* src, int first, int channels,
+                      int count, float* const* out) {
+  const int stride = channels * Sample::kBytes;
+
+  float* const d0 = out[first];
+  float* const d1 = out[first + 1];
+  float* const d2 = out[first + 2];
+  float* const d3 = out[first + 3];
+
+  for (int i = 0; i < count; i += 4) {
+    const uint8_t* const s = src + (i * channels + first) * Sample::kBytes;
+
+    __m128 r0 = Sample::Load4(s);
+    __m128 r1 = Sample::Load4(s + stride);
+    __m128 r2 = Sample::Load4(s + 2 * stride);
+    __m128 r3 = Sample::Load4(s + 3 * stride);
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    _mm_storeu_ps(d0 + i, r0);
+    _mm_storeu_ps(d1 + i, r1);
+    _mm_storeu_ps(d2 + i, r2);
+    _mm_storeu_ps(d3 + i, r3);
+  }
+}
+
+#endif  // WEBMDSHOW_PCMUTIL_SSE
+
+template <typename Sample>
+void Deinterleave(const uint8_t* src, int channels, int count,
+                  float* const* out) {
+  int done = 0;
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+  const int vector_count = count & ~3;
+
+  if (channels == 1) {
+    DeinterleaveMono<Sample>(src, vector_count, out);
+  } else if (channels == 2) {
+    DeinterleaveStereo<Sample>(src, vector_count, out);
+  } else {
+    int c = 0;
+
+    for (; channels - c >= 4; c += 4)
+      DeinterleaveQuad<Sample>(src, c, channels, vector_count, out);
+
+    if (c < channels) {
+      DeinterleaveScalar<Sample>(src, c, channels - c, channels, 0,
+                                 vector_count, out);
+    }
+  }
+
+  done = vector_count;
+#endif
+
+  DeinterleaveScalar<Sample>(src, 0, channels, channels, done, count, out);
+}
+
+const float kInt16Scale = 32768.0f;
+
+// Scales a difference of two 16-bit uniform values to (-1, 1) LSB.
+const float kDitherScale = 1.0f / 65536.0f;
+
+uint32_t NextLane(uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+float TriangularNoise(uint32_t x) {
+  const int a = static_cast<int>(x & 0xFFFF);
+  const int b = static_cast<int>(x >> 16);
+  return static_cast<float>(a - b) * kDitherScale;
+}
+
+int16_t FloatToInt16(float x) {
+  if (x >= 32767.0f)
+    return 32767;
+
+  if (x <= -32768.0f)
+    return -32768;
+
+  return static_cast<int16_t>(floor(x + 0.5f));
+}
+
+// Converts samples [begin, end), four at a time, stepping the noise lanes
+// once for each group of four exactly as the vector path does.
+void ConvertScalar(const float* src, int begin, int end, PcmDither dither,
+                   PcmDitherState* state, int16_t* dst) {
+  for (int i = begin; i < end; i += 4) {
+    const int n = (end - i < 4) ? end - i : 4;
+
+    if (dither == kPcmDitherNone) {
+      for (int j = 0; j < n; ++j)
+        dst[i + j] = FloatToInt16(src[i + j] * kInt16Scale);
+
+      continue;
+    }
+
+    for (int j = 0; j < 4; ++j)
+      state->lanes[j] = NextLane(state->lanes[j]);
+
+    for (int j = 0; j < n; ++j) {
+      const float noise = TriangularNoise(state->lanes[j]);
+      dst[i + j] = FloatToInt16(src[i + j] * kInt16Scale + noise);
+    }
+  }
+}
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE2
+
+__m128i NextLanes(__m128i x) {
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  return x;
+}
+
+__m128 TriangularNoise(__m128i x) {
+  const __m128i a = _mm_and_si128(x, _mm_set1_epi32(0xFFFF));
+  const __m128i b = _mm_srli_epi32(x, 16);
+  const __m128 d = _mm_cvtepi32_ps(_mm_sub_epi32(a, b));
+  return _mm_mul_ps(d, _mm_set1_ps(kDitherScale));
+}
+
+// Rounds to nearest, saturating. Clamping first keeps large input from
+// converting to the integer indefinite value.
+__m128i ToInt32(__m128 x) {
+  x = _mm_max_ps(x, _mm_set1_ps(-32768.0f));
+  x = _mm_min_ps(x, _mm_set1_ps(32767.0f));
+  return _mm_cvtps_epi32(x);
+}
+
+// Converts samples [0, count), where count is a multiple of 8, and returns
+// the noise lanes in |state| as the scalar path would leave them.
+void ConvertVector(const float* src, int count, PcmDither dither,
+                   PcmDitherState* state, int16_t* dst) {
+  const __m128 scale = _mm_set1_ps(kInt16Scale);
+
+  if (dither == kPcmDitherNone) {
+    for (int i = 0; i < count; i += 8) {
+      const __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+      const __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+
+      const __m128i s = _mm_packs_epi32(ToInt32(a), ToInt32(b));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+    }
+
+    return;
+  }
+
+  __m128i lanes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state->lanes));
+
+  for (int i = 0; i < count; i += 8) {
+    lanes = NextLanes(lanes);
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+    a = _mm_add_ps(a, TriangularNoise(lanes));
+
+    lanes = NextLanes(lanes);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+    b = _mm_add_ps(b, TriangularNoise(lanes));
+
+    const __m128i s = _mm_packs_epi32(ToInt32(a), ToInt32(b));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state->lanes), lanes);
+}
+
+#endif  // WEBMDSHOW_PCMUTIL_SSE2
+
+}  // namespace
+
+void InterleavePcm(const float* const* src, const int* order, int channels,
+                   int count, float* dst) {
+  assert(src);
+  assert(dst);
+
+  if (channels <= 0 || count <= 0)
+    return;
+
+  if (channels > kMaxReorderedPcmChannels) {
+    assert(order == NULL);
+    InterleaveScalar(src, 0, channels, channels, 0, count, dst);
+    return;
+  }
+
+  const float* in[kMaxReorderedPcmChannels];
+
+  for (int c = 0; c < channels; ++c)
+    in[c] = src[order ? order[c] : c];
+
+  if (channels == 1) {
+    memcpy(dst, in[0], count * sizeof(float));
+    return;
+  }
+
+  int done = 0;
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE
+  const int vector_count = count & ~3;
+  int c = 0;
+
+  for (; channels - c >= 4; c += 4)
+    InterleaveQuad(in, c, channels, vector_count, dst);
+
+  if (channels - c >= 2) {
+    InterleavePair(in, c, channels, vector_count, dst);
+    c += 2;
+  }
+
+  if (c < channels)
+    InterleaveScalar(in, c, channels - c, channels, 0, vector_count, dst);
+
+  done = vector_count;
+#endif
+
+  InterleaveScalar(in, 0, channels, channels, done, count, dst);
+}
+
+void DeinterleavePcm(const void* src, PcmFormat format, const int* order,
+                     int channels, int count, float* const* dst) {
+  assert(src);
+  assert(dst);
+
+  if (channels <= 0 || count <= 0)
+    return;
+
+  float* const* out = dst;
+  float* reordered[kMaxReorderedPcmChannels];
+
+  if (order) {
+    assert(channels <= kMaxReorderedPcmChannels);
+
+    for (int c = 0; c < channels; ++c)
+      reordered[c] = dst[order[c]];
+
+    out = reordered;
+  }
+
+  const uint8_t* const s = static_cast<const uint8_t*>(src);
+
+  switch (format) {
+    case kPcmFloat32:
+    default:
+      Deinterleave<Float32Sample>(s, channels, count, out);
+      break;
+
+    case kPcmInt16:
+      Deinterleave<Int16Sample>(s, channels, count, out);
+      break;
+
+    case kPcmInt24:
+      Deinterleave<Int24Sample>(s, channels, count, out);
+      break;
+
+    case kPcmInt32:
+      Deinterleave<Int32Sample>(s, channels, count, out);
+      break;
+  }
+}
+
+void InitPcmDitherState(uint32_t seed, PcmDitherState* state) {
+  assert(state);
+
+  // splitmix-style spreading, so that nearby seeds give unrelated lanes
+  for (int i = 0; i < 4; ++i) {
+    uint32_t x = seed + 0x9E3779B9u * (i + 1);
+    x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+    x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+    x ^= x >> 16;
+
+    state->lanes[i] = x ? x : 0x6D2B79F5u;
+  }
+}
+
+void ConvertFloatToInt16(const float* src, int count, PcmDither dither,
+                         PcmDitherState* state, int16_t* dst) {
+  assert(src);
+  assert(dst);
+  assert(dither == kPcmDitherNone || state);
+
+  if (count <= 0)
+    return;
+
+  int done = 0;
+
+#ifdef WEBMDSHOW_PCMUTIL_SSE2
+  done = count & ~7;
+  ConvertVector(src, done, dither, state, dst);
+#endif
+
+  ConvertScalar(src, done, count, dither, state, dst);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,69 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_PCMUTIL_H_
+#define WEBMDSHOW_COMMON_PCMUTIL_H_
+
+#include <stdint.h>
+
+namespace webmdshow {
+
+// Interleaves |count| frames of planar float PCM from |channels| channels
+// into |dst|, which must hold |channels| * |count| floats. Output channel i
+// is read from src[order[i]], so the copy also reorders the channels; pass
+// NULL for |order| to keep the source order. Reordering is supported for up
+// to kMaxReorderedPcmChannels channels. Up to 8 channels are interleaved
+// four frames at a time with SSE when it is available.
+void InterleavePcm(const float* const* src, const int* order, int channels,
+                   int count, float* dst);
+
+const int kMaxReorderedPcmChannels = 8;
+
+enum PcmFormat {
+  kPcmFloat32,  // IEEE float in [-1, 1]
+  kPcmInt16,
+  kPcmInt24,    // packed in 3 bytes, little-endian
+  kPcmInt32,    // also 24 valid bits in a 32-bit container
+};
+
+// The inverse of InterleavePcm: splits |count| frames of |channels|
+// interleaved |format| samples at |src| into planar float PCM, converting
+// integer samples to [-1, 1) on the way. Input channel i is written to
+// dst[order[i]]; pass NULL for |order| to keep the source order. As with
+// InterleavePcm, reordering is supported for up to kMaxReorderedPcmChannels
+// channels, and groups of four frames are transposed with SSE (integer
+// samples are converted with SSE2) when it is available.
+void DeinterleavePcm(const void* src, PcmFormat format, const int* order,
+                     int channels, int count, float* const* dst);
+
+enum PcmDither {
+  kPcmDitherNone,
+  // Triangular (TPDF) noise of up to one LSB, which decorrelates the
+  // quantization error from the signal.
+  kPcmDitherTriangular,
+};
+
+// The noise generator used by ConvertFloatToInt16: four xorshift32 lanes,
+// stepped together, so that the SSE2 and scalar paths produce the same
+// noise. Seed it once per stream; it must never be all zero.
+struct PcmDitherState {
+  uint32_t lanes[4];
+};
+
+void InitPcmDitherState(uint32_t seed, PcmDitherState* state);
+
+// Converts |count| float samples in [-1, 1] to 16-bit PCM, rounding to
+// nearest and saturating out of range input. |state| may be NULL when
+// |dither| is kPcmDitherNone. Eight samples at a time are converted with
+// SSE2 when it is available.
+void ConvertFloatToInt16(const float* src, int count, PcmDither dither,
+                         PcmDitherState* state, int16_t* dst);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_PCMUTIL_H_
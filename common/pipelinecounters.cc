@@ -0,0 +1,217 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pipelinecounters.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cwchar>
+#include <mutex>
+
+#include "webmtrace.h"
+
+namespace webmdshow {
+
+namespace {
+
+// The stages of the process. Only registration takes the lock; the
+// counters themselves are updated without it.
+std::mutex g_registry_mutex;
+std::vector<PipelineCounters*> g_registry;
+
+#ifdef _WIN32
+int64_t GetFrequency() {
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return frequency.QuadPart;
+}
+
+const int64_t g_frequency = GetFrequency();
+#endif
+
+int GetBucket(int64_t us) {
+  int bucket = 0;
+
+  while (us > 0 && bucket < PipelineCounters::kHistogramBuckets - 1) {
+    us >>= 1;
+    ++bucket;
+  }
+
+  return bucket;
+}
+
+void TraceStats(const PipelineCounters::Stats& s) {
+  wchar_t text[512];
+
+  int n = swprintf(text, sizeof text / sizeof text[0],
+                   L"stage=%ls in=%lld out=%lld bytes_in=%lld "
+                   L"bytes_out=%lld dropped=%lld busy_us=%lld queue=%d "
+                   L"queue_peak=%d histogram=",
+                   s.name, s.samples_in, s.samples_out, s.bytes_in,
+                   s.bytes_out, s.dropped, s.busy_us, s.queue_depth,
+                   s.queue_peak);
+
+  for (int i = 0; n > 0 && i < PipelineCounters::kHistogramBuckets; ++i) {
+    const int size = static_cast<int>(sizeof text / sizeof text[0]);
+    const int m = swprintf(text + n, size - n, (i == 0) ? L"%lld" : L",%lld",
+                           s.histogram[i]);
+
+    if (m < 0)
+      break;
+
+    n += m;
+  }
+
+  TraceString(kTraceLevelInformation, kTraceKeywordCounters, text);
+}
+
+}  // namespace
+
+PipelineCounters::Timer::Timer(PipelineCounters& counters)
+    : counters_(counters), start_(Now()) {
+}
+
+PipelineCounters::Timer::~Timer() {
+  counters_.AddProcessingTime(Now() - start_);
+}
+
+PipelineCounters::PipelineCounters(const wchar_t* name) {
+  assert(name);
+
+  size_t i = 0;
+
+  while (name[i] != L'\0' && i < kNameLength - 1) {
+    name_[i] = name[i];
+    ++i;
+  }
+
+  name_[i] = L'\0';
+
+  Reset();
+
+  // Before taking the registry lock: registering may call back into
+  // TraceAll, which takes it.
+  RegisterTraceProvider();
+
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  g_registry.push_back(this);
+}
+
+PipelineCounters::~PipelineCounters() {
+  Trace();
+
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_registry.erase(std::remove(g_registry.begin(), g_registry.end(), this),
+                     g_registry.end());
+  }
+
+  UnregisterTraceProvider();
+}
+
+void PipelineCounters::SetQueueDepth(int depth) {
+  queue_depth_.store(depth, std::memory_order_relaxed);
+
+  // The stage serializes its calls, so a plain compare is enough.
+  if (depth > queue_peak_.load(std::memory_order_relaxed))
+    queue_peak_.store(depth, std::memory_order_relaxed);
+}
+
+void PipelineCounters::AddProcessingTime(int64_t us) {
+  if (us < 0)
+    us = 0;
+
+  busy_us_.fetch_add(us, std::memory_order_relaxed);
+  histogram_[GetBucket(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineCounters::GetStats(Stats* stats) const {
+  assert(stats);
+
+  std::copy(name_, name_ + kNameLength, stats->name);
+
+  stats->samples_in = samples_in_.load(std::memory_order_relaxed);
+  stats->samples_out = samples_out_.load(std::memory_order_relaxed);
+  stats->bytes_in = bytes_in_.load(std::memory_order_relaxed);
+  stats->bytes_out = bytes_out_.load(std::memory_order_relaxed);
+  stats->dropped = dropped_.load(std::memory_order_relaxed);
+  stats->busy_us = busy_us_.load(std::memory_order_relaxed);
+  stats->queue_depth = queue_depth_.load(std::memory_order_relaxed);
+  stats->queue_peak = queue_peak_.load(std::memory_order_relaxed);
+
+  for (int i = 0; i < kHistogramBuckets; ++i)
+    stats->histogram[i] = histogram_[i].load(std::memory_order_relaxed);
+}
+
+void PipelineCounters::Reset() {
+  samples_in_ = 0;
+  samples_out_ = 0;
+  bytes_in_ = 0;
+  bytes_out_ = 0;
+  dropped_ = 0;
+  busy_us_ = 0;
+  queue_depth_ = 0;
+  queue_peak_ = 0;
+
+  for (int i = 0; i < kHistogramBuckets; ++i)
+    histogram_[i] = 0;
+}
+
+void PipelineCounters::Trace() const {
+  if (!IsTraceEnabled(kTraceLevelInformation, kTraceKeywordCounters))
+    return;
+
+  Stats stats;
+  GetStats(&stats);
+  TraceStats(stats);
+}
+
+void PipelineCounters::TraceAll() {
+  if (!IsTraceEnabled(kTraceLevelInformation, kTraceKeywordCounters))
+    return;
+
+  std::vector<Stats> stats;
+  GetAllStats(&stats);
+
+  for (size_t i = 0; i < stats.size(); ++i)
+    TraceStats(stats[i]);
+}
+
+void PipelineCounters::GetAllStats(std::vector<Stats>* stats) {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+
+  stats->resize(g_registry.size());
+
+  for (size_t i = 0; i < g_registry.size(); ++i)
+    g_registry[i]->GetStats(&(*stats)[i]);
+}
+
+int64_t PipelineCounters::Now() {
+#ifdef _WIN32
+  // steady_clock has only the resolution of the system clock with this
+  // toolset; the performance counter resolves single microseconds.
+  LARGE_INTEGER count;
+  QueryPerformanceCounter(&count);
+
+  return count.QuadPart / g_frequency * 1000000 +
+         count.QuadPart % g_frequency * 1000000 / g_frequency;
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,119 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_PIPELINECOUNTERS_H_
+#define WEBMDSHOW_COMMON_PIPELINECOUNTERS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace webmdshow {
+
+// Throughput and latency counters for one stage of a graph: a splitter
+// output pin, a decoder, an encoder, a colour converter or a muxer. The
+// stage's streaming thread records them without taking a lock, with
+// relaxed atomic adds; any other thread may read them at any time, through
+// IPipelineCounters or the WebM-DirectShow ETW provider. A reading is not
+// a consistent snapshot of every field, which does not matter for finding
+// the stage that is the bottleneck.
+class PipelineCounters {
+ public:
+  // Bucket 0 counts samples processed in under 1 us; bucket i counts those
+  // taking from 2^(i-1) us to 2^i us, and the last bucket everything above.
+  enum { kHistogramBuckets = 20 };
+  enum { kNameLength = 32 };
+
+  struct Stats {
+    wchar_t name[kNameLength];
+    int64_t samples_in;
+    int64_t samples_out;
+    int64_t bytes_in;
+    int64_t bytes_out;
+    int64_t dropped;      // samples received and not delivered
+    int64_t busy_us;      // processing time, summed over samples
+    int32_t queue_depth;  // samples waiting, when last set
+    int32_t queue_peak;   // highest |queue_depth| set
+    int64_t histogram[kHistogramBuckets];
+  };
+
+  // Measures the time from construction to destruction as the processing
+  // time of one sample.
+  class Timer {
+   public:
+    explicit Timer(PipelineCounters& counters);
+    ~Timer();
+
+   private:
+    PipelineCounters& counters_;
+    const int64_t start_;
+
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+  };
+
+  // |name| identifies the stage in a reading, e.g. "vpxdec" or
+  // "webmsplit.video"; it is truncated to kNameLength - 1 characters. The
+  // counters are readable by the ETW provider for as long as they exist.
+  explicit PipelineCounters(const wchar_t* name);
+  ~PipelineCounters();
+
+  void OnSampleIn(int64_t bytes) {
+    samples_in_.fetch_add(1, std::memory_order_relaxed);
+    bytes_in_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void OnSampleOut(int64_t bytes) {
+    samples_out_.fetch_add(1, std::memory_order_relaxed);
+    bytes_out_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void OnDrop() { dropped_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Calls must be serialized by the stage: made from one thread, or under
+  // a lock of its own.
+  void SetQueueDepth(int depth);
+  void AddProcessingTime(int64_t us);
+
+  void GetStats(Stats* stats) const;
+
+  // Zeroes every counter; the name is kept.
+  void Reset();
+
+  // Writes the current reading of these counters, or of every stage in the
+  // process, to the ETW provider, if a session is listening.
+  void Trace() const;
+  static void TraceAll();
+
+  // Returns a reading of every stage in the process.
+  static void GetAllStats(std::vector<Stats>* stats);
+
+  // Returns a timestamp in microseconds, from an arbitrary origin.
+  static int64_t Now();
+
+ private:
+  wchar_t name_[kNameLength];
+
+  std::atomic<int64_t> samples_in_;
+  std::atomic<int64_t> samples_out_;
+  std::atomic<int64_t> bytes_in_;
+  std::atomic<int64_t> bytes_out_;
+  std::atomic<int64_t> dropped_;
+  std::atomic<int64_t> busy_us_;
+  std::atomic<int32_t> queue_depth_;
+  std::atomic<int32_t> queue_peak_;
+  std::atomic<int64_t> histogram_[kHistogramBuckets];
+
+  PipelineCounters(const PipelineCounters&);
+  PipelineCounters& operator=(const PipelineCounters&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_PIPELINECOUNTERS_H_
@@ -0,0 +1,48 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "qualityladder.h"
+
+namespace webmdshow {
+
+QualityLadder::QualityLadder() : level_(kLevelFull), late_(0), on_time_(0) {}
+
+void QualityLadder::Reset() {
+  level_.store(kLevelFull, std::memory_order_relaxed);
+  late_ = 0;
+  on_time_ = 0;
+}
+
+bool QualityLadder::OnQuality(long proportion, int64_t late) {
+  const int level = level_.load(std::memory_order_relaxed);
+
+  if ((late > kLateThreshold) || (proportion < 1000)) {
+    on_time_ = 0;
+
+    if ((++late_ < kLateCount) || (level >= kLevelMax))
+      return false;
+
+    late_ = 0;
+    level_.store(level + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  late_ = 0;
+
+  if (late > 0)  // late, but within the threshold: hold the level
+    return false;
+
+  if ((++on_time_ < kOnTimeCount) || (level <= kLevelFull))
+    return false;
+
+  on_time_ = 0;
+  level_.store(level - 1, std::memory_order_relaxed);
+  return true;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,66 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_QUALITYLADDER_H_
+#define WEBMDSHOW_COMMON_QUALITYLADDER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace webmdshow {
+
+// How far a decoder has degraded its output to keep up with the renderer,
+// driven by the renderer's IQualityControl::Notify messages. The level
+// steps up one rung when the renderer has reported late frames for a few
+// messages running, and back down when it has been on time for a good
+// while longer, so that playback on a weak machine settles on the highest
+// quality it can sustain instead of falling further behind.
+class QualityLadder {
+ public:
+  enum Level {
+    kLevelFull = 0,
+    kLevelNoPostproc = 1,        // postprocessing off
+    kLevelDropNonReference = 2,  // also drop frames nothing refers to
+    kLevelMax = kLevelDropNonReference
+  };
+
+  // Late by more than this, in 100 ns units, counts as late.
+  static const int64_t kLateThreshold = 400000;  // 40 ms
+
+  // Consecutive late messages to step up, and on-time ones to step down.
+  enum { kLateCount = 4, kOnTimeCount = 120 };
+
+  QualityLadder();
+
+  // Back to kLevelFull, as when streaming starts.
+  void Reset();
+
+  // Feeds one quality message: |proportion| is in thousandths of the rate
+  // the renderer can sustain, and |late| is how late (negative: early) the
+  // last frame was, in 100 ns units. Returns true if the level changed.
+  // Calls must be serialized, as the renderer's messages are.
+  bool OnQuality(long proportion, int64_t late);
+
+  // Safe to call from any thread.
+  Level GetLevel() const {
+    return static_cast<Level>(level_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  std::atomic<int> level_;
+  int late_;
+  int on_time_;
+
+  QualityLadder(const QualityLadder&);
+  QualityLadder& operator=(const QualityLadder&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_QUALITYLADDER_H_
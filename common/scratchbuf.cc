@@ -65,6 +65,8 @@ void EbmlSerializeNum(std::vector<uint8>& buf_, const Val* ptr, int32 size)
     }
 }
 
+// |offset| is an index into |buf_|, and so must include the head of the
+// ScratchBuf.
 template <typename Val>
 void EbmlSerializeNumAtOffset(std::vector<uint8>& buf_, const Val* ptr,
                               int32 size, uint32 offset)
@@ -96,7 +98,7 @@ void EbmlSerializeFloat(std::vector<uint8>& buf_, float val)
 
 }
 
-WebmUtil::ScratchBuf::ScratchBuf()
+WebmUtil::ScratchBuf::ScratchBuf() : head_(0)
 {
 }
 
@@ -106,24 +108,47 @@ WebmUtil::ScratchBuf::~ScratchBuf()
 
 int WebmUtil::ScratchBuf::Fill(uint8 val, int32 length)
 {
-    for (int32 i = 0; i < length; ++i)
-    {
-        buf_.push_back(val);
-    }
+    assert(length >= 0);
+    buf_.insert(buf_.end(), length, val);
     return length;
 }
 
 int WebmUtil::ScratchBuf::Erase(uint32 offset, int32 length)
 {
     // no erasing past the end!
-    assert(buf_.size() >= (offset + length));
-    // erase range using iterators
-    typedef std::vector<uint8>::iterator viter_t;
-    viter_t start_ptr = buf_.begin() + offset;
-    viter_t end_ptr = start_ptr + length;
-    buf_.erase(start_ptr, end_ptr);
+    assert(buf_.size() - head_ >= (offset + length));
+
+    if (offset == 0)
+    {
+        // consume from the front: just advance the head
+        head_ += length;
+
+        const size_t remaining = buf_.size() - head_;
+
+        if (remaining == 0)
+        {
+            Reset();
+        }
+        else if (head_ >= remaining)
+        {
+            // the erased space dominates, so compact now; the cost of
+            // the move is no more than the bytes erased since the last
+            // time
+            buf_.erase(buf_.begin(), buf_.begin() + head_);
+            head_ = 0;
+        }
+    }
+    else
+    {
+        // erase range using iterators
+        typedef std::vector<uint8>::iterator viter_t;
+        viter_t start_ptr = buf_.begin() + head_ + offset;
+        viter_t end_ptr = start_ptr + length;
+        buf_.erase(start_ptr, end_ptr);
+    }
+
     // return the new size of the buffer
-    return static_cast<int>(buf_.size());
+    return static_cast<int>(buf_.size() - head_);
 }
 
 int WebmUtil::ScratchBuf::Erase(uint64 offset, int32 length)
@@ -135,11 +160,11 @@ int WebmUtil::ScratchBuf::Rewrite(uint32 offset, const uint8* read_ptr,
                                   int32 length)
 {
     assert(read_ptr);
-    assert(offset <= buf_.size());
-    assert(offset + length <= buf_.size());
+    assert(head_ + offset <= buf_.size());
+    assert(head_ + offset + length <= buf_.size());
     typedef std::vector<uint8>::iterator BufIterator;
 
-    BufIterator write_ptr = buf_.begin() + offset;
+    BufIterator write_ptr = buf_.begin() + head_ + offset;
 
     int num_bytes = 0;
     for (; num_bytes < length; ++num_bytes)
@@ -157,10 +182,12 @@ int WebmUtil::ScratchBuf::Rewrite(uint64 offset, const uint8* read_ptr,
 
 void WebmUtil::ScratchBuf::Write(const uint8* read_ptr, int32 length)
 {
-    int64 slen = length;
-    for (int64 i = 0; i < slen; ++i)
+    assert(length >= 0);
+
+    if (length > 0)
     {
-        buf_.push_back(*read_ptr++);
+        assert(read_ptr);
+        buf_.insert(buf_.end(), read_ptr, read_ptr + length);
     }
 }
 
@@ -257,17 +284,40 @@ void WebmUtil::ScratchBuf::WriteUInt(uint64 val, int32 size)
 
 const uint8* WebmUtil::ScratchBuf::GetBufferPtr() const
 {
-    return &buf_[0];
+    if (head_ >= buf_.size())
+        return NULL;
+
+    return &buf_[head_];
 }
 
 uint64 WebmUtil::ScratchBuf::GetBufferLength() const
 {
-    return buf_.size();
+    return buf_.size() - head_;
+}
+
+void WebmUtil::ScratchBuf::Reserve(uint64 length)
+{
+    const uint64 needed = head_ + length;
+
+    if (needed <= buf_.capacity())
+        return;
+
+    // the vector has to grow anyway, so drop the erased space first
+    if (head_ > 0)
+    {
+        buf_.erase(buf_.begin(), buf_.begin() + head_);
+        head_ = 0;
+    }
+
+    buf_.reserve(static_cast<size_t>(length));
 }
 
 void WebmUtil::ScratchBuf::Reset()
 {
+    // clear() keeps the capacity, so the buffer does not have to grow
+    // again the next time it is filled
     buf_.clear();
+    head_ = 0;
 }
 
 WebmUtil::EbmlScratchBuf::EbmlScratchBuf()
@@ -304,7 +354,7 @@ void WebmUtil::EbmlScratchBuf::Serialize1UInt(uint8 val)
 int WebmUtil::EbmlScratchBuf::RewriteID(uint32 offset, uint32 val, int32 size)
 {
     assert(size > 0 && size <= 4);
-    assert(offset + size <= buf_.size());
+    assert(head_ + offset + size <= buf_.size());
 
     switch (size)
     {
@@ -324,7 +374,7 @@ int WebmUtil::EbmlScratchBuf::RewriteID(uint32 offset, uint32 val, int32 size)
         assert(0);
     }
 
-    EbmlSerializeNumAtOffset(buf_, &val, size, offset);
+    EbmlSerializeNumAtOffset(buf_, &val, size, head_ + offset);
     return size;
 }
 
@@ -343,7 +393,7 @@ int WebmUtil::EbmlScratchBuf::RewriteUInt(uint32 offset, uint64 val,
         assert(val <= (bits - 2));
 
         val |= bits;
-        EbmlSerializeNumAtOffset(buf_, &val, size, offset);
+        EbmlSerializeNumAtOffset(buf_, &val, size, head_ + offset);
     }
     else
     {
@@ -364,7 +414,7 @@ int WebmUtil::EbmlScratchBuf::RewriteUInt(uint32 offset, uint64 val,
         assert(size <= 8);
         val |= bit;
 
-        EbmlSerializeNumAtOffset(buf_, &val, size, offset);
+        EbmlSerializeNumAtOffset(buf_, &val, size, head_ + offset);
     }
 
     return size;
@@ -26,6 +26,10 @@ public:
 
     int32 Fill(uint8 val, int32 length);
 
+    // Erasing from the front of the buffer (offset 0) does not move the
+    // remaining bytes; they are moved down only once the erased space
+    // exceeds what is left, so consuming the buffer from the front costs
+    // O(1) amortized per byte.  Erasing elsewhere shifts the tail.
     int32 Erase(uint32 offset, int32 length);
     int32 Erase(uint64 offset, int32 length);
 
@@ -46,11 +50,20 @@ public:
     const uint8* GetBufferPtr() const;
     uint64 GetBufferLength() const;
 
+    // Makes room for at least |length| bytes of content, so that writes
+    // up to that length do not reallocate.
+    void Reserve(uint64 length);
+
     void Reset();
 
 protected:
     std::vector<uint8> buf_;
 
+    // Bytes at the front of |buf_| that have been erased.  Content
+    // starts at |buf_[head_]|, and offsets passed in by callers are
+    // relative to it.
+    uint32 head_;
+
 private:
     DISALLOW_COPY_AND_ASSIGN(ScratchBuf);
 };
@@ -0,0 +1,278 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "sharedfilecache.h"
+
+#include <windows.h>
+
+#include <cassert>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "webmindex.h"
+
+namespace webmdshow {
+
+namespace {
+
+struct Key {
+  std::wstring path;  // full, and lower case
+  int64_t size;
+  int64_t time;
+
+  bool operator<(const Key& rhs) const {
+    if (size != rhs.size)
+      return size < rhs.size;
+
+    if (time != rhs.time)
+      return time < rhs.time;
+
+    return path < rhs.path;
+  }
+};
+
+std::wstring GetKeyPath(const wchar_t* path) {
+  std::wstring result;
+
+  const DWORD size = GetFullPathNameW(path, 0, NULL, NULL);
+
+  if (size > 0) {
+    std::vector<wchar_t> buf(size);
+    const DWORD len = GetFullPathNameW(path, size, &buf[0], NULL);
+
+    if ((len > 0) && (len < size))
+      result.assign(&buf[0], len);
+  }
+
+  if (result.empty())
+    result = path;
+
+  if (!result.empty())
+    CharLowerBuffW(&result[0], static_cast<DWORD>(result.size()));
+
+  return result;
+}
+
+}  // namespace
+
+class SharedFileCache::File {
+ public:
+  // Every cached page, of every file, least recently used first.
+  typedef std::list<std::pair<File*, int64_t> > lru_t;
+
+  struct Page {
+    std::vector<uint8_t> data;
+    lru_t::iterator lru;
+  };
+
+  typedef std::map<int64_t, Page> pages_t;
+
+  explicit File(const Key& k) : key(k), refs(0) {}
+
+  const Key key;
+  int refs;
+  pages_t pages;
+
+ private:
+  File(const File&);
+  File& operator=(const File&);
+};
+
+namespace {
+
+typedef SharedFileCache::File File;
+typedef std::map<Key, File*> files_t;
+
+// Guards all of the below.
+std::mutex g_mutex;
+
+int64_t g_limit;
+int64_t g_bytes;
+int64_t g_hits;
+int64_t g_misses;
+files_t g_files;
+File::lru_t g_lru;
+
+// Forgets |file| if nobody has it open and it has no pages left.
+void RemoveIfUnused(File* file) {
+  if ((file->refs > 0) || !file->pages.empty())
+    return;
+
+  g_files.erase(file->key);
+  delete file;
+}
+
+void Evict(int64_t limit) {
+  while ((g_bytes > limit) && !g_lru.empty()) {
+    File* const file = g_lru.front().first;
+    const int64_t pos = g_lru.front().second;
+
+    const File::pages_t::iterator page = file->pages.find(pos);
+    assert(page != file->pages.end());
+
+    g_bytes -= page->second.data.size();
+    file->pages.erase(page);
+    g_lru.pop_front();
+
+    RemoveIfUnused(file);
+  }
+
+  assert(g_bytes >= 0);
+}
+
+}  // namespace
+
+void SharedFileCache::SetLimit(int64_t bytes) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  g_limit = (bytes > 0) ? bytes : 0;
+  Evict(g_limit);
+}
+
+int64_t SharedFileCache::GetLimit() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return g_limit;
+}
+
+void SharedFileCache::GetStats(Stats* stats) {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  stats->hits = g_hits;
+  stats->misses = g_misses;
+  stats->bytes = g_bytes;
+  stats->limit = g_limit;
+  stats->files = static_cast<int64_t>(g_files.size());
+}
+
+void SharedFileCache::ResetStats() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  g_hits = 0;
+  g_misses = 0;
+}
+
+SharedFileCache::File* SharedFileCache::Open(const wchar_t* path) {
+  if (path == NULL)
+    return NULL;
+
+  if (GetLimit() == 0)  // don't touch the file for nothing
+    return NULL;
+
+  int64_t file_size, file_time;
+
+  const HRESULT hr = WebmIndex::GetFileStamp(path, &file_size, &file_time);
+
+  if (FAILED(hr))
+    return NULL;
+
+  return Open(path, file_size, file_time);
+}
+
+SharedFileCache::File* SharedFileCache::Open(const wchar_t* path,
+                                             int64_t file_size,
+                                             int64_t file_time) {
+  if (path == NULL)
+    return NULL;
+
+  Key key;
+  key.path = GetKeyPath(path);
+  key.size = file_size;
+  key.time = file_time;
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (g_limit == 0)
+    return NULL;
+
+  File*& file = g_files[key];
+
+  if (file == NULL)
+    file = new (std::nothrow) File(key);
+
+  if (file == NULL) {
+    g_files.erase(key);
+    return NULL;
+  }
+
+  ++file->refs;
+  return file;
+}
+
+void SharedFileCache::Close(File* file) {
+  if (file == NULL)
+    return;
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  assert(file->refs > 0);
+  --file->refs;
+
+  RemoveIfUnused(file);
+}
+
+long SharedFileCache::Read(File* file, int64_t pos, void* buf, long size) {
+  assert(file);
+  assert(file->refs > 0);
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  const File::pages_t::iterator i = file->pages.find(pos);
+
+  if ((i == file->pages.end()) || (i->second.data.size() > size_t(size))) {
+    ++g_misses;
+    return -1;
+  }
+
+  File::Page& page = i->second;
+  const size_t len = page.data.size();
+
+  memcpy(buf, &page.data[0], len);
+
+  g_lru.splice(g_lru.end(), g_lru, page.lru);  // now most recently used
+  ++g_hits;
+
+  return static_cast<long>(len);
+}
+
+void SharedFileCache::Write(File* file, int64_t pos, const void* buf,
+                            long len) {
+  assert(file);
+  assert(file->refs > 0);
+
+  if (len <= 0)
+    return;
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (len > g_limit)
+    return;
+
+  if (file->pages.count(pos))
+    return;
+
+  File::Page& page = file->pages[pos];
+
+  const uint8_t* const ptr = static_cast<const uint8_t*>(buf);
+  page.data.assign(ptr, ptr + len);
+  page.lru = g_lru.insert(g_lru.end(), std::make_pair(file, pos));
+
+  g_bytes += len;
+
+  // The file is open, so evicting its pages doesn't remove it.
+  Evict(g_limit);
+}
+
+}  // namespace webmdshow
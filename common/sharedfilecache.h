@@ -0,0 +1,77 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_SHAREDFILECACHE_H_
+#define WEBMDSHOW_COMMON_SHAREDFILECACHE_H_
+
+#include <stdint.h>
+
+namespace webmdshow {
+
+// The pages of media files, shared by all of the readers of a file in the
+// process, so that when several graphs open the same file at once (a
+// player, a thumbnail strip and a waveform generator, say) its headers,
+// cues and clusters are read from the disk only once. Each reader keeps
+// the pages it is using in its own cache, as before, and looks here
+// before it issues a read; each page it reads is copied here for the
+// others. Pages are never changed once cached.
+//
+// A file is known by its full path, its size and its last write time, so
+// a file that has been rewritten is a different file. The pages of all
+// files together are held to a limit, the least recently used going
+// first. A file stays known while a reader has it open or any of its
+// pages is cached.
+//
+// The cache is off (its limit is 0) until an application opts in through
+// SetLimit. It is shared by the filters of one module: each DLL linked
+// with common.lib has a cache of its own. Thread safe.
+class SharedFileCache {
+ public:
+  class File;
+
+  struct Stats {
+    int64_t hits;    // pages found by Read
+    int64_t misses;  // pages Read didn't find
+    int64_t bytes;   // in the pages cached now
+    int64_t limit;
+    int64_t files;   // open, or with pages cached
+  };
+
+  // Evicts pages as needed to fit the new limit. 0 turns the cache off,
+  // and empties it; open files stay valid, but Read finds nothing.
+  static void SetLimit(int64_t bytes);
+  static int64_t GetLimit();
+
+  static void GetStats(Stats* stats);
+  static void ResetStats();
+
+  // Returns the file named |path|, which must be a local file, or NULL if
+  // the cache is off or |path| can't be opened. Close the result.
+  static File* Open(const wchar_t* path);
+
+  // The same, with the size and last write time already known.
+  static File* Open(const wchar_t* path, int64_t file_size,
+                    int64_t file_time);
+
+  static void Close(File* file);
+
+  // Copies the page cached at |pos| to |buf|, and returns its length.
+  // Returns -1 if there is no such page, or it's longer than |size|.
+  static long Read(File* file, int64_t pos, void* buf, long size);
+
+  // Caches a copy of the |len| bytes at |pos|, unless a page is cached
+  // there already.
+  static void Write(File* file, int64_t pos, const void* buf, long len);
+
+ private:
+  SharedFileCache();
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_SHAREDFILECACHE_H_
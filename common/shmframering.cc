@@ -0,0 +1,504 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "shmframering.h"
+
+#include <objbase.h>
+#include <vfwmsgs.h>
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+const uint32_t kMagic = 0x474e5253;  // "SRNG"
+const uint32_t kVersion = 1;
+
+// Slots, and the first of them, start on a page of their own.
+const size_t kPageSize = 4096;
+
+// Room for a published index of every slot, and for ends of the stream
+// queued behind them.
+enum { kQueueSize = 64 };
+
+enum SlotState {
+  kSlotFree = 0,
+  kSlotWriting,   // claimed by the producer
+  kSlotReady,     // published, not yet taken
+  kSlotReading,   // taken by the consumer
+};
+
+size_t RoundUp(size_t n, size_t unit) {
+  return (n + unit - 1) / unit * unit;
+}
+
+}  // namespace
+
+// Laid out identically by the 32-bit and 64-bit builds, so that either
+// may be at each end.
+struct ShmFrameRing::Header {
+  uint32_t magic;  // written last by the producer
+  uint32_t version;
+  int32_t slot_count;
+  int32_t slot_size;
+  uint32_t slot_stride;  // slot_size rounded up to a page
+  uint32_t data_offset;  // of the first slot
+
+  // The media type, less its pUnk.
+  GUID majortype;
+  GUID subtype;
+  GUID formattype;
+  int32_t fixed_size_samples;
+  int32_t temporal_compression;
+  uint32_t sample_size;
+  uint32_t format_size;
+  uint8_t format[kMaxFormatSize];
+
+  volatile LONG state[kMaxSlots];
+  SlotInfo info[kMaxSlots];
+
+  // The published slots, in order. The producer alone writes
+  // write_count, and the consumer read_count; each is on a cache line of
+  // its own so that the two sides don't contend for it.
+  volatile LONG write_count;
+  LONG pad0[15];
+  volatile LONG read_count;
+  LONG pad1[15];
+  volatile LONG queue[kQueueSize];
+};
+
+ShmFrameRing::ShmFrameRing()
+    : producer_(false),
+      mapping_(NULL),
+      header_(NULL),
+      slots_(NULL),
+      slot_stride_(0),
+      ready_(NULL),
+      free_(NULL) {}
+
+ShmFrameRing::~ShmFrameRing() {
+  Close();
+}
+
+HRESULT ShmFrameRing::Create(const wchar_t* name, int slot_count,
+                             int slot_size, const AM_MEDIA_TYPE& mt) {
+  if (name == NULL || name[0] == L'\0')
+    return E_INVALIDARG;
+
+  if (slot_count <= 0 || slot_count > kMaxSlots || slot_size <= 0)
+    return E_INVALIDARG;
+
+  if (mt.cbFormat > kMaxFormatSize || (mt.cbFormat && mt.pbFormat == NULL))
+    return E_INVALIDARG;
+
+  Close();
+
+  const size_t data_offset = RoundUp(sizeof(Header), kPageSize);
+  const size_t slot_stride = RoundUp(slot_size, kPageSize);
+  const size_t size = data_offset + slot_count * slot_stride;
+
+  HRESULT hr = Map(name, true, size);
+
+  if (FAILED(hr))
+    return hr;
+
+  producer_ = true;
+
+  hr = OpenEvents();
+
+  if (FAILED(hr)) {
+    Close();
+    return hr;
+  }
+
+  // A new mapping is zeroed: every slot is free and the queue is empty.
+  Header& h = *header_;
+
+  h.version = kVersion;
+  h.slot_count = slot_count;
+  h.slot_size = slot_size;
+  h.slot_stride = static_cast<uint32_t>(slot_stride);
+  h.data_offset = static_cast<uint32_t>(data_offset);
+
+  h.majortype = mt.majortype;
+  h.subtype = mt.subtype;
+  h.formattype = mt.formattype;
+  h.fixed_size_samples = mt.bFixedSizeSamples;
+  h.temporal_compression = mt.bTemporalCompression;
+  h.sample_size = mt.lSampleSize;
+  h.format_size = mt.cbFormat;
+
+  if (mt.cbFormat)
+    memcpy(h.format, mt.pbFormat, mt.cbFormat);
+
+  slots_ = reinterpret_cast<uint8_t*>(header_) + data_offset;
+  slot_stride_ = slot_stride;
+
+  // Last, so that a consumer opening the mapping meanwhile rejects it
+  // rather than reading half a header.
+  InterlockedExchange(reinterpret_cast<volatile LONG*>(&h.magic), kMagic);
+
+  return S_OK;
+}
+
+HRESULT ShmFrameRing::Open(const wchar_t* name) {
+  if (name == NULL || name[0] == L'\0')
+    return E_INVALIDARG;
+
+  Close();
+
+  HRESULT hr = Map(name, false, 0);
+
+  if (FAILED(hr))
+    return hr;
+
+  producer_ = false;
+
+  MEMORY_BASIC_INFORMATION mbi;
+
+  if (VirtualQuery(header_, &mbi, sizeof mbi) != sizeof mbi) {
+    Close();
+    return E_FAIL;
+  }
+
+  const Header& h = *header_;
+  MemoryBarrier();
+
+  const bool valid =
+      (mbi.RegionSize >= sizeof(Header)) && (h.magic == kMagic) &&
+      (h.version == kVersion) && (h.slot_count > 0) &&
+      (h.slot_count <= kMaxSlots) && (h.slot_size > 0) &&
+      (h.slot_stride >= static_cast<uint32_t>(h.slot_size)) &&
+      (h.data_offset >= sizeof(Header)) &&
+      (h.format_size <= kMaxFormatSize) &&
+      (h.data_offset + static_cast<size_t>(h.slot_count) * h.slot_stride <=
+       mbi.RegionSize);
+
+  if (!valid) {
+    Close();
+    return VFW_E_INVALID_FILE_FORMAT;
+  }
+
+  hr = OpenEvents();
+
+  if (FAILED(hr)) {
+    Close();
+    return hr;
+  }
+
+  slots_ = reinterpret_cast<uint8_t*>(header_) + h.data_offset;
+  slot_stride_ = h.slot_stride;
+
+  return S_OK;
+}
+
+void ShmFrameRing::Close() {
+  if (free_) {
+    CloseHandle(free_);
+    free_ = NULL;
+  }
+
+  if (ready_) {
+    CloseHandle(ready_);
+    ready_ = NULL;
+  }
+
+  if (header_) {
+    UnmapViewOfFile(header_);
+    header_ = NULL;
+  }
+
+  if (mapping_) {
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+  }
+
+  slots_ = NULL;
+  slot_stride_ = 0;
+  producer_ = false;
+  name_.clear();
+}
+
+int ShmFrameRing::slot_count() const {
+  return header_ ? header_->slot_count : 0;
+}
+
+int ShmFrameRing::slot_size() const {
+  return header_ ? header_->slot_size : 0;
+}
+
+HRESULT ShmFrameRing::GetMediaType(AM_MEDIA_TYPE* mt) const {
+  if (mt == NULL)
+    return E_POINTER;
+
+  if (header_ == NULL)
+    return VFW_E_WRONG_STATE;
+
+  const Header& h = *header_;
+
+  mt->majortype = h.majortype;
+  mt->subtype = h.subtype;
+  mt->bFixedSizeSamples = h.fixed_size_samples ? TRUE : FALSE;
+  mt->bTemporalCompression = h.temporal_compression ? TRUE : FALSE;
+  mt->lSampleSize = h.sample_size;
+  mt->formattype = h.formattype;
+  mt->pUnk = NULL;
+  mt->cbFormat = 0;
+  mt->pbFormat = NULL;
+
+  if (h.format_size) {
+    mt->pbFormat = static_cast<BYTE*>(CoTaskMemAlloc(h.format_size));
+
+    if (mt->pbFormat == NULL)
+      return E_OUTOFMEMORY;
+
+    memcpy(mt->pbFormat, h.format, h.format_size);
+    mt->cbFormat = h.format_size;
+  }
+
+  return S_OK;
+}
+
+uint8_t* ShmFrameRing::GetSlotData(int slot) const {
+  assert(header_);
+  assert(slot >= 0 && slot < header_->slot_count);
+
+  return slots_ + slot * slot_stride_;
+}
+
+HRESULT ShmFrameRing::ClaimSlot(HANDLE abort, int* slot) {
+  if (slot == NULL)
+    return E_POINTER;
+
+  *slot = kEndOfStream;
+
+  if (header_ == NULL || !producer_)
+    return VFW_E_WRONG_STATE;
+
+  Header& h = *header_;
+  bool waited = false;
+
+  for (;;) {
+    for (int i = 0; i < h.slot_count; ++i) {
+      if (InterlockedCompareExchange(&h.state[i], kSlotWriting,
+                                     kSlotFree) == kSlotFree) {
+        // The event is auto-reset, so one wakeup can stand for several
+        // freed slots; pass it on to any other claiming thread, which
+        // checks for itself.
+        if (waited)
+          SetEvent(free_);
+
+        *slot = i;
+        return S_OK;
+      }
+    }
+
+    const HRESULT hr = Wait(free_, abort);
+
+    if (FAILED(hr))
+      return hr;
+
+    waited = true;
+  }
+}
+
+HRESULT ShmFrameRing::PublishSlot(int slot, const SlotInfo& info) {
+  if (header_ == NULL || !producer_)
+    return VFW_E_WRONG_STATE;
+
+  Header& h = *header_;
+
+  if (slot < 0 || slot >= h.slot_count || h.state[slot] != kSlotWriting)
+    return E_INVALIDARG;
+
+  if (info.length < 0 || info.length > h.slot_size)
+    return E_INVALIDARG;
+
+  const LONG w = h.write_count;
+
+  // At most one index of each slot is queued, so only queued ends of the
+  // stream can fill the queue.
+  if (static_cast<ULONG>(w - h.read_count) >= kQueueSize)
+    return VFW_E_BUFFER_OVERFLOW;
+
+  h.info[slot] = info;
+  InterlockedExchange(&h.state[slot], kSlotReady);
+
+  h.queue[w % kQueueSize] = slot;
+
+  // A full barrier: the consumer sees the index and the info before the
+  // count that covers them.
+  InterlockedExchange(&h.write_count, w + 1);
+
+  SetEvent(ready_);
+  return S_OK;
+}
+
+HRESULT ShmFrameRing::PublishEndOfStream() {
+  if (header_ == NULL || !producer_)
+    return VFW_E_WRONG_STATE;
+
+  Header& h = *header_;
+  const LONG w = h.write_count;
+
+  if (static_cast<ULONG>(w - h.read_count) >= kQueueSize)
+    return VFW_E_BUFFER_OVERFLOW;
+
+  h.queue[w % kQueueSize] = kEndOfStream;
+  InterlockedExchange(&h.write_count, w + 1);
+
+  SetEvent(ready_);
+  return S_OK;
+}
+
+void ShmFrameRing::ReleaseSlot(int slot) {
+  assert(header_ && producer_);
+  assert(slot >= 0 && slot < header_->slot_count);
+
+  const LONG state =
+      InterlockedCompareExchange(&header_->state[slot], kSlotFree,
+                                 kSlotWriting);
+  assert(state == kSlotWriting);
+  (void)state;
+
+  SetEvent(free_);  // for another thread waiting in ClaimSlot
+}
+
+HRESULT ShmFrameRing::TakeSlot(HANDLE abort, int* slot, SlotInfo* info) {
+  if (slot == NULL || info == NULL)
+    return E_POINTER;
+
+  *slot = kEndOfStream;
+
+  if (header_ == NULL || producer_)
+    return VFW_E_WRONG_STATE;
+
+  Header& h = *header_;
+
+  for (;;) {
+    const LONG r = h.read_count;
+    const LONG w = h.write_count;
+    MemoryBarrier();  // read the queue only after the count covering it
+
+    if (r != w) {
+      const LONG index = h.queue[r % kQueueSize];
+
+      if (index == kEndOfStream) {
+        InterlockedExchange(&h.read_count, r + 1);
+        return S_FALSE;
+      }
+
+      if (index < 0 || index >= h.slot_count)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+      *info = h.info[index];
+      InterlockedExchange(&h.state[index], kSlotReading);
+      InterlockedExchange(&h.read_count, r + 1);
+
+      *slot = index;
+      return S_OK;
+    }
+
+    const HRESULT hr = Wait(ready_, abort);
+
+    if (FAILED(hr))
+      return hr;
+  }
+}
+
+void ShmFrameRing::FreeSlot(int slot) {
+  assert(header_ && !producer_);
+  assert(slot >= 0 && slot < header_->slot_count);
+
+  const LONG state =
+      InterlockedCompareExchange(&header_->state[slot], kSlotFree,
+                                 kSlotReading);
+  assert(state == kSlotReading);
+  (void)state;
+
+  SetEvent(free_);
+}
+
+HRESULT ShmFrameRing::Map(const wchar_t* name, bool create, size_t size) {
+  assert(mapping_ == NULL);
+
+  if (create) {
+    const ULONGLONG n = size;
+
+    mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                  static_cast<DWORD>(n >> 32),
+                                  static_cast<DWORD>(n), name);
+
+    if (mapping_ && GetLastError() == ERROR_ALREADY_EXISTS) {
+      CloseHandle(mapping_);
+      mapping_ = NULL;
+
+      return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    }
+  } else {
+    mapping_ = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name);
+  }
+
+  if (mapping_ == NULL)
+    return HRESULT_FROM_WIN32(GetLastError());
+
+  void* const view = MapViewOfFile(mapping_, FILE_MAP_READ | FILE_MAP_WRITE,
+                                   0, 0, size);
+
+  if (view == NULL) {
+    const DWORD e = GetLastError();
+
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  header_ = static_cast<Header*>(view);
+  name_ = name;
+
+  return S_OK;
+}
+
+HRESULT ShmFrameRing::OpenEvents() {
+  assert(ready_ == NULL && free_ == NULL);
+
+  // Whichever side gets here first creates them.
+  ready_ = CreateEventW(NULL, FALSE, FALSE, (name_ + L".ready").c_str());
+
+  if (ready_ == NULL)
+    return HRESULT_FROM_WIN32(GetLastError());
+
+  free_ = CreateEventW(NULL, FALSE, FALSE, (name_ + L".free").c_str());
+
+  if (free_ == NULL)
+    return HRESULT_FROM_WIN32(GetLastError());
+
+  return S_OK;
+}
+
+HRESULT ShmFrameRing::Wait(HANDLE event, HANDLE abort) {
+  HANDLE handles[2] = { abort, event };
+
+  const DWORD n = abort ? 2 : 1;
+  HANDLE* const h = abort ? handles : handles + 1;
+
+  const DWORD dw = WaitForMultipleObjects(n, h, FALSE, INFINITE);
+
+  if (abort && dw == WAIT_OBJECT_0)
+    return E_ABORT;
+
+  if (dw == WAIT_OBJECT_0 + n - 1)
+    return S_OK;
+
+  return HRESULT_FROM_WIN32(GetLastError());
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,143 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_SHMFRAMERING_H_
+#define WEBMDSHOW_COMMON_SHMFRAMERING_H_
+
+#include <stdint.h>
+#include <windows.h>
+#include <strmif.h>
+
+#include <string>
+
+namespace webmdshow {
+
+// A ring of frame slots in a named file mapping, through which one process
+// hands frames to another without copying them. The producer claims a free
+// slot, writes a frame into it, and publishes it with its times and flags;
+// the consumer takes the published slots in order, reads them in place,
+// and frees them for the producer to claim again.
+//
+// A slot changes hands by a compare-and-swap on its state in the mapping,
+// and the published slot indices pass through a single-producer,
+// single-consumer queue there too, so neither side takes a lock, and
+// neither waits on the other unless it has to: the producer only if every
+// slot is taken, the consumer only if none is published. Then each waits
+// on a named auto-reset event that the other sets, and on an abort event
+// of its own.
+//
+// The producer may claim and release slots from several threads, but
+// publishes from one; the consumer takes slots on one thread, and may free
+// them on any. A side that dies holding slots keeps them, so the other
+// should be stopped (by its abort event) rather than left waiting.
+class ShmFrameRing {
+ public:
+  enum {
+    kMaxSlots = 32,
+    kMaxFormatSize = 4096,  // bytes of the media type's format block
+  };
+
+  // The slot taken in place of a frame at the end of the stream.
+  enum { kEndOfStream = -1 };
+
+  // The timestamps and flags of a published frame, as in IMediaSample.
+  enum {
+    kFlagTime = 1,            // start and stop are set
+    kFlagMediaTime = 2,       // media_start and media_stop are set
+    kFlagSyncPoint = 4,
+    kFlagPreroll = 8,
+    kFlagDiscontinuity = 16,
+  };
+
+  struct SlotInfo {
+    int64_t start;
+    int64_t stop;
+    int64_t media_start;
+    int64_t media_stop;
+    int32_t flags;
+    int32_t length;  // bytes of the frame
+  };
+
+  ShmFrameRing();
+  ~ShmFrameRing();
+
+  // Creates the mapping |name| as the producer, with |slot_count| slots of
+  // at least |slot_size| bytes each, and records |mt| as the type of the
+  // frames. Fails with HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS) if there is
+  // a mapping of that name already, and with E_INVALIDARG if the count,
+  // the size or the format block is out of range.
+  HRESULT Create(const wchar_t* name, int slot_count, int slot_size,
+                 const AM_MEDIA_TYPE& mt);
+
+  // Opens the mapping |name| as the consumer. Fails with
+  // HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if no producer has created
+  // it, and with VFW_E_INVALID_FILE_FORMAT if it is not a ring.
+  HRESULT Open(const wchar_t* name);
+
+  // Unmaps the ring. The mapping lasts while either side has it open.
+  void Close();
+
+  bool is_open() const { return header_ != NULL; }
+  bool is_producer() const { return producer_; }
+  const std::wstring& name() const { return name_; }
+  int slot_count() const;
+  int slot_size() const;
+
+  // Copies the type of the frames to |mt|, its format block allocated with
+  // CoTaskMemAlloc (free it with MediaTypeUtil::Destroy).
+  HRESULT GetMediaType(AM_MEDIA_TYPE* mt) const;
+
+  uint8_t* GetSlotData(int slot) const;
+
+  // Producer side: claims a free slot, waiting for the consumer to free
+  // one if need be. Returns E_ABORT if |abort| is set first.
+  HRESULT ClaimSlot(HANDLE abort, int* slot);
+
+  // Producer side: hands the claimed |slot| to the consumer, with |info|.
+  HRESULT PublishSlot(int slot, const SlotInfo& info);
+
+  // Producer side: queues the end of the stream after the published
+  // slots. Returns VFW_E_BUFFER_OVERFLOW if the consumer is so far behind
+  // that there is no room in the queue.
+  HRESULT PublishEndOfStream();
+
+  // Producer side: gives back a claimed slot that was not published.
+  void ReleaseSlot(int slot);
+
+  // Consumer side: takes the oldest published slot, waiting for the
+  // producer to publish one if need be, and copies its |info|. At the end
+  // of the stream, |slot| is kEndOfStream and the result is S_FALSE.
+  // Returns E_ABORT if |abort| is set first.
+  HRESULT TakeSlot(HANDLE abort, int* slot, SlotInfo* info);
+
+  // Consumer side: frees a taken slot for the producer to claim again.
+  void FreeSlot(int slot);
+
+ private:
+  struct Header;
+
+  HRESULT Map(const wchar_t* name, bool create, size_t size);
+  HRESULT OpenEvents();
+  HRESULT Wait(HANDLE event, HANDLE abort);
+
+  std::wstring name_;
+  bool producer_;
+  HANDLE mapping_;
+  Header* header_;
+  uint8_t* slots_;
+  size_t slot_stride_;
+  HANDLE ready_;  // set when a slot (or the end) is published
+  HANDLE free_;   // set when a slot is freed
+
+  ShmFrameRing(const ShmFrameRing&);
+  ShmFrameRing& operator=(const ShmFrameRing&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_SHMFRAMERING_H_
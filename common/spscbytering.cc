@@ -0,0 +1,127 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "spscbytering.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+SpscByteRing::SpscByteRing() : mask_(size_t(-1)), read_(0), write_(0) {
+}
+
+void SpscByteRing::Reset(size_t capacity) {
+  size_t n = 1;
+
+  while (n < capacity)
+    n <<= 1;
+
+  buf_.assign(n, 0);
+  mask_ = n - 1;
+
+  Clear();
+}
+
+void SpscByteRing::Clear() {
+  read_.store(0, std::memory_order_relaxed);
+  write_.store(0, std::memory_order_relaxed);
+}
+
+size_t SpscByteRing::size() const {
+  const size_t r = read_.load(std::memory_order_acquire);
+  const size_t w = write_.load(std::memory_order_acquire);
+
+  return w - r;
+}
+
+size_t SpscByteRing::Write(const void* src, size_t count) {
+  assert(src || count == 0);
+
+  if (buf_.empty())
+    return 0;
+
+  const size_t w = write_.load(std::memory_order_relaxed);
+  const size_t r = read_.load(std::memory_order_acquire);
+
+  const size_t space = capacity() - (w - r);
+
+  if (count > space)
+    count = space;
+
+  if (count == 0)
+    return 0;
+
+  const size_t pos = w & mask_;
+  const size_t first = (count < capacity() - pos) ? count : capacity() - pos;
+
+  const uint8_t* const s = static_cast<const uint8_t*>(src);
+
+  memcpy(&buf_[pos], s, first);
+
+  if (count > first)
+    memcpy(&buf_[0], s + first, count - first);
+
+  write_.store(w + count, std::memory_order_release);
+  return count;
+}
+
+size_t SpscByteRing::Peek(const uint8_t** data) const {
+  assert(data);
+
+  const size_t r = read_.load(std::memory_order_relaxed);
+  const size_t w = write_.load(std::memory_order_acquire);
+
+  const size_t stored = w - r;
+
+  if (stored == 0) {
+    *data = NULL;
+    return 0;
+  }
+
+  const size_t pos = r & mask_;
+  *data = &buf_[pos];
+
+  return (stored < capacity() - pos) ? stored : capacity() - pos;
+}
+
+void SpscByteRing::Consume(size_t count) {
+  const size_t r = read_.load(std::memory_order_relaxed);
+
+  assert(count <= write_.load(std::memory_order_acquire) - r);
+
+  read_.store(r + count, std::memory_order_release);
+}
+
+size_t SpscByteRing::Read(void* dst, size_t count) {
+  assert(dst || count == 0);
+
+  uint8_t* d = static_cast<uint8_t*>(dst);
+  size_t done = 0;
+
+  // At most two runs: up to the end of the buffer, then from its start.
+  while (done < count) {
+    const uint8_t* s;
+    size_t n = Peek(&s);
+
+    if (n == 0)
+      break;
+
+    if (n > count - done)
+      n = count - done;
+
+    memcpy(d + done, s, n);
+    Consume(n);
+
+    done += n;
+  }
+
+  return done;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,71 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_SPSCBYTERING_H_
+#define WEBMDSHOW_COMMON_SPSCBYTERING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace webmdshow {
+
+// A fixed-capacity byte FIFO shared by one producer thread and one consumer
+// thread, without a lock. Each side owns one of the two running byte
+// counts, and publishes it with a release store only after it is done
+// with the bytes it covers, so the other side never sees a half-copied
+// run. Waiting for data or for space is up to the caller.
+class SpscByteRing {
+ public:
+  SpscByteRing();
+
+  // Discards the bytes, and sizes the ring for at least |capacity| bytes
+  // (rounded up to a power of two). Neither side may be using the ring.
+  void Reset(size_t capacity);
+
+  // Discards the bytes. Neither side may be using the ring.
+  void Clear();
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // The number of bytes stored. Exact on the consumer side; from the
+  // producer side the ring may have drained since.
+  size_t size() const;
+
+  // Producer side: copies as much of |src| as fits, and returns how many
+  // bytes that was.
+  size_t Write(const void* src, size_t count);
+
+  // Consumer side: points |data| at the first stored byte, and returns how
+  // many bytes are contiguous from there (0 when the ring is empty). The
+  // bytes stay stored until Consume.
+  size_t Peek(const uint8_t** data) const;
+
+  // Consumer side: removes the first |count| bytes, which must be stored.
+  void Consume(size_t count);
+
+  // Consumer side: removes up to |count| bytes into |dst|, and returns how
+  // many there were.
+  size_t Read(void* dst, size_t count);
+
+ private:
+  std::vector<uint8_t> buf_;
+  size_t mask_;  // capacity - 1; the counts are taken modulo capacity
+
+  std::atomic<size_t> read_;   // bytes consumed, written by the consumer
+  std::atomic<size_t> write_;  // bytes produced, written by the producer
+
+  SpscByteRing(const SpscByteRing&);
+  SpscByteRing& operator=(const SpscByteRing&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_SPSCBYTERING_H_
@@ -0,0 +1,111 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_SPSCQUEUE_H_
+#define WEBMDSHOW_COMMON_SPSCQUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+namespace webmdshow {
+
+// A fixed-capacity FIFO of values (typically pointers) shared by one
+// producer thread and one consumer thread, without a lock: the element
+// counterpart of SpscByteRing. Each side owns one of the two running
+// counts, and publishes it with a release store once the slot it covers
+// has been written or read. Waiting for a value or for space is up to the
+// caller.
+template <typename T>
+class SpscQueue {
+ public:
+  // Sizes the queue for at least |capacity| values (rounded up to a power
+  // of two).
+  explicit SpscQueue(size_t capacity) : read_(0), write_(0) {
+    size_t n = 1;
+
+    while (n < capacity)
+      n <<= 1;
+
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // The number of values stored. Exact on neither side, since the other
+  // side may have moved since; use it for reporting, not for control.
+  size_t size() const {
+    const size_t r = read_.load(std::memory_order_acquire);
+    const size_t w = write_.load(std::memory_order_acquire);
+
+    return w - r;
+  }
+
+  // Producer side: stores |value|, and returns false if the queue is full.
+  bool TryPush(const T& value) {
+    const size_t w = write_.load(std::memory_order_relaxed);
+    const size_t r = read_.load(std::memory_order_acquire);
+
+    if (w - r > mask_)
+      return false;
+
+    slots_[w & mask_] = value;
+    write_.store(w + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  // Consumer side: removes the first value into |value|, and returns false
+  // if the queue is empty.
+  bool TryPop(T* value) {
+    assert(value);
+
+    const size_t r = read_.load(std::memory_order_relaxed);
+    const size_t w = write_.load(std::memory_order_acquire);
+
+    if (r == w)
+      return false;
+
+    *value = slots_[r & mask_];
+    read_.store(r + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  // Consumer side: points |value| at the first value, which stays stored,
+  // or returns false if the queue is empty.
+  bool Peek(const T** value) const {
+    assert(value);
+
+    const size_t r = read_.load(std::memory_order_relaxed);
+    const size_t w = write_.load(std::memory_order_acquire);
+
+    if (r == w)
+      return false;
+
+    *value = &slots_[r & mask_];
+    return true;
+  }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_;  // capacity - 1; the counts are taken modulo capacity
+
+  std::atomic<size_t> read_;   // values consumed, written by the consumer
+  std::atomic<size_t> write_;  // values produced, written by the producer
+
+  SpscQueue(const SpscQueue&);
+  SpscQueue& operator=(const SpscQueue&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_SPSCQUEUE_H_
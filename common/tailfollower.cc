@@ -0,0 +1,257 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "tailfollower.h"
+
+#include <cassert>
+#include <vector>
+
+namespace webmdshow {
+
+namespace {
+
+// The directory of |path|, or empty if it can't be resolved.
+std::wstring GetDirectory(const wchar_t* path) {
+  const DWORD size = GetFullPathNameW(path, 0, NULL, NULL);
+
+  if (size == 0)
+    return std::wstring();
+
+  std::vector<wchar_t> buf(size);
+  wchar_t* name = NULL;
+
+  const DWORD len = GetFullPathNameW(path, size, &buf[0], &name);
+
+  if ((len == 0) || (len >= size) || (name == NULL) || (name == &buf[0]))
+    return std::wstring();
+
+  return std::wstring(&buf[0], name);
+}
+
+}  // namespace
+
+TailFollower::TailFollower()
+    : file_(INVALID_HANDLE_VALUE),
+      change_(INVALID_HANDLE_VALUE),
+      cancel_(CreateEvent(NULL, TRUE, FALSE, NULL)),
+      finished_(false),
+      probed_(false),
+      probe_time_(0) {
+  assert(cancel_);
+  stats_.waits = 0;
+  stats_.notifications = 0;
+  stats_.rechecks = 0;
+}
+
+TailFollower::~TailFollower() {
+  Close();
+  CloseHandle(cancel_);
+}
+
+bool TailFollower::IsBeingWritten(const wchar_t* path) {
+  // Sharing only reads, the open fails if some handle has write access.
+  const HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (h == INVALID_HANDLE_VALUE)
+    return GetLastError() == ERROR_SHARING_VIOLATION;
+
+  CloseHandle(h);
+  return false;
+}
+
+bool TailFollower::Open(const wchar_t* path) {
+  Close();
+
+  const std::wstring dir = GetDirectory(path);
+
+  if (dir.empty())
+    return false;
+
+  file_ = CreateFileW(path, GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file_ == INVALID_HANDLE_VALUE)
+    return false;
+
+  change_ = FindFirstChangeNotificationW(
+      dir.c_str(), FALSE,
+      FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+
+  if (change_ == INVALID_HANDLE_VALUE) {
+    Close();
+    return false;
+  }
+
+  path_ = path;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = false;
+  probed_ = false;
+
+  return true;
+}
+
+void TailFollower::Close() {
+  if (change_ != INVALID_HANDLE_VALUE) {
+    FindCloseChangeNotification(change_);
+    change_ = INVALID_HANDLE_VALUE;
+  }
+
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+
+  path_.clear();
+}
+
+int64_t TailFollower::GetSize() {
+  if (!is_open())
+    return -1;
+
+  LARGE_INTEGER size;
+
+  if (!GetFileSizeEx(file_, &size))
+    return -1;
+
+  return size.QuadPart;
+}
+
+bool TailFollower::IsFinished() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (finished_ || !is_open())
+      return finished_;
+
+    const DWORD now = GetTickCount();
+
+    if (probed_ && ((now - probe_time_) < kRecheckMs))
+      return false;
+
+    probed_ = true;
+    probe_time_ = now;
+  }
+
+  if (IsBeingWritten(path_.c_str()))
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = true;
+
+  return true;
+}
+
+long TailFollower::Read(int64_t pos, long len, void* buf) {
+  if (!is_open() || (pos < 0) || (len < 0))
+    return -1;
+
+  if (len == 0)
+    return 0;
+
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = static_cast<DWORD>(pos);
+  overlapped.OffsetHigh = static_cast<DWORD>(pos >> 32);
+
+  DWORD read = 0;
+
+  if (!ReadFile(file_, buf, len, &read, &overlapped)) {
+    if (GetLastError() == ERROR_HANDLE_EOF)
+      return 0;
+
+    return -1;
+  }
+
+  return static_cast<long>(read);
+}
+
+TailFollower::WaitResult TailFollower::WaitForSize(int64_t size,
+                                                   DWORD timeout_ms) {
+  if (!is_open())
+    return kFailed;
+
+  const DWORD start = GetTickCount();
+  bool blocked = false;
+
+  for (;;) {
+    if (WaitForSingleObject(cancel_, 0) == WAIT_OBJECT_0)
+      return kCancelled;
+
+    // Finished first, so that the size we then get is final.
+    const bool finished = IsFinished();
+    const int64_t curr = GetSize();
+
+    if (curr < 0)
+      return kFailed;
+
+    if (curr >= size)
+      return kReached;
+
+    if (finished)
+      return kFinished;
+
+    DWORD wait = kRecheckMs;
+
+    if (timeout_ms != INFINITE) {
+      const DWORD elapsed = GetTickCount() - start;
+
+      if (elapsed >= timeout_ms)
+        return kTimedOut;
+
+      if ((timeout_ms - elapsed) < wait)
+        wait = timeout_ms - elapsed;
+    }
+
+    if (!blocked) {
+      blocked = true;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.waits;
+    }
+
+    const HANDLE handles[] = { cancel_, change_ };
+    const DWORD dw = WaitForMultipleObjects(2, handles, FALSE, wait);
+
+    if (dw == WAIT_OBJECT_0)
+      return kCancelled;
+
+    if (dw == WAIT_OBJECT_0 + 1) {
+      if (!FindNextChangeNotification(change_))
+        return kFailed;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.notifications;
+    } else if (dw == WAIT_TIMEOUT) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.rechecks;
+    } else {
+      return kFailed;
+    }
+  }
+}
+
+void TailFollower::Cancel() {
+  const BOOL b = SetEvent(cancel_);
+  assert(b);
+  (void)b;
+}
+
+void TailFollower::Resume() {
+  const BOOL b = ResetEvent(cancel_);
+  assert(b);
+  (void)b;
+}
+
+void TailFollower::GetStats(Stats* stats) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  *stats = stats_;
+}
+
+}  // namespace webmdshow
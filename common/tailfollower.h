@@ -0,0 +1,104 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_TAILFOLLOWER_H_
+#define WEBMDSHOW_COMMON_TAILFOLLOWER_H_
+
+#include <windows.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+
+namespace webmdshow {
+
+// Follows the end of a local file that another handle (webmmux in live
+// mode, typically) is still appending to, so that a reader can play it
+// back while it grows. WaitForSize blocks until the file has grown to a
+// given size, woken by change notifications on the file's directory
+// rather than by polling. NTFS updates the size reported to other
+// handles lazily when the writer's data is cached, so a waiter also
+// looks again every kRecheckMs whether or not it was notified.
+//
+// The file is finished once no handle has it open for writing any more;
+// its size is then final. All of the methods are thread safe, but only
+// one thread should wait at a time.
+class TailFollower {
+ public:
+  enum WaitResult {
+    kReached,    // the file is at least the size waited for
+    kFinished,   // the writer closed the file before it got there
+    kCancelled,  // by Cancel, before or during the wait
+    kTimedOut,
+    kFailed      // not open, or the file or directory went away
+  };
+
+  enum { kRecheckMs = 250 };
+
+  struct Stats {
+    int64_t waits;          // calls to WaitForSize that had to block
+    int64_t notifications;  // directory changes that woke a waiter
+    int64_t rechecks;       // wakes with no notification
+  };
+
+  TailFollower();
+  ~TailFollower();
+
+  // Returns whether some handle has the file at |path| open for writing,
+  // so that it may still grow.
+  static bool IsBeingWritten(const wchar_t* path);
+
+  // Opens the file at |path| for reading, sharing it with its writer.
+  // Returns false if it can't be opened, or its directory watched.
+  bool Open(const wchar_t* path);
+  void Close();
+  bool is_open() const { return file_ != INVALID_HANDLE_VALUE; }
+
+  // The size of the file now, or -1 if it isn't open.
+  int64_t GetSize();
+
+  // Whether the writer has closed the file. Once true, stays true. The
+  // file is opened again to find out, no more than once per kRecheckMs;
+  // in between, the last answer is given.
+  bool IsFinished();
+
+  // Reads up to |len| bytes at |pos| into |buf|. Returns the number of
+  // bytes read (less than |len| at the end of the file), or -1 on error.
+  long Read(int64_t pos, long len, void* buf);
+
+  // Waits until the file is at least |size| bytes, the writer finishes
+  // it, or |timeout_ms| (INFINITE for no limit) elapses.
+  WaitResult WaitForSize(int64_t size, DWORD timeout_ms);
+
+  // Makes the waits, current and future, return kCancelled until Resume
+  // is called. Called during a flush, so the thread waiting for more of
+  // the file can be stopped.
+  void Cancel();
+  void Resume();
+
+  void GetStats(Stats* stats) const;
+
+ private:
+  TailFollower(const TailFollower&);
+  TailFollower& operator=(const TailFollower&);
+
+  std::wstring path_;
+  HANDLE file_;
+  HANDLE change_;  // the directory's change notification
+  HANDLE cancel_;  // manual-reset
+  bool finished_;
+  bool probed_;
+  DWORD probe_time_;  // of the last look for the writer
+
+  mutable std::mutex mutex_;  // for the above, and stats_
+  Stats stats_;
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_TAILFOLLOWER_H_
@@ -0,0 +1,279 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "taskpool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <cassert>
+
+#include "cpuutil.h"
+
+namespace webmdshow {
+
+namespace {
+
+std::once_flag g_shared_once;
+TaskPool* g_shared;
+std::atomic<int> g_shared_thread_count(0);
+
+void CreateShared() {
+#ifdef _WIN32
+  // The pool lives as long as the process, and its threads run code
+  // of this module, so the module must not be unloaded under them.
+  HMODULE module;
+  GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                         GET_MODULE_HANDLE_EX_FLAG_PIN,
+                     reinterpret_cast<LPCWSTR>(&CreateShared), &module);
+#endif
+
+  // Never deleted: joining threads while the process exits, or from
+  // DllMain, could deadlock.
+  g_shared = new TaskPool(g_shared_thread_count);
+}
+
+}  // namespace
+
+TaskPool::TaskPool(int thread_count)
+    : stopping_(false),
+      queued_(0),
+      next_worker_(0),
+      tasks_(0),
+      steals_(0),
+      busy_us_(0),
+      start_(std::chrono::steady_clock::now()) {
+  if (thread_count <= 0)
+    thread_count = GetLogicalProcessorCount();
+
+  for (int i = 0; i < thread_count; ++i)
+    workers_.push_back(new Worker);
+
+  // The workers look each other up by thread id, so every id must be
+  // known before any of them takes a task.
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+
+  for (int i = 0; i < thread_count; ++i) {
+    threads_.push_back(std::thread(&TaskPool::Run, this, i));
+    workers_[i]->id = threads_[i].get_id();
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stopping_ = true;
+  }
+
+  idle_.notify_all();
+
+  for (size_t i = 0; i < threads_.size(); ++i)
+    threads_[i].join();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    assert(workers_[i]->tasks.empty());
+    delete workers_[i];
+  }
+}
+
+void TaskPool::Submit(const Task& task) {
+  int index = GetWorkerIndex();
+
+  if (index < 0)
+    index = next_worker_++ % workers_.size();
+
+  Worker& worker = *workers_[index];
+
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(task);
+  }
+
+  // Under the idle mutex, so that a worker about to sleep either sees the
+  // task counted or is woken.
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    ++queued_;
+  }
+
+  idle_.notify_one();
+}
+
+bool TaskPool::RunOne() {
+  Task task;
+
+  if (!TakeTask(GetWorkerIndex(), &task))
+    return false;
+
+  RunTask(task);
+  return true;
+}
+
+void TaskPool::GetStats(Stats* stats) const {
+  assert(stats);
+
+  stats->threads = thread_count();
+  stats->tasks = tasks_;
+  stats->steals = steals_;
+  stats->busy_us = busy_us_;
+  stats->elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_).count();
+}
+
+double TaskPool::GetUtilization() const {
+  Stats stats;
+  GetStats(&stats);
+
+  if (stats.elapsed_us <= 0 || stats.threads <= 0)
+    return 0;
+
+  const double busy = double(stats.busy_us) /
+                      (double(stats.elapsed_us) * stats.threads);
+
+  return (busy > 1) ? 1 : busy;
+}
+
+TaskPool& TaskPool::GetShared() {
+  std::call_once(g_shared_once, &CreateShared);
+  return *g_shared;
+}
+
+void TaskPool::SetSharedThreadCount(int thread_count) {
+  g_shared_thread_count = thread_count;
+}
+
+int TaskPool::GetWorkerIndex() const {
+  const std::thread::id id = std::this_thread::get_id();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->id == id)
+      return static_cast<int>(i);
+  }
+
+  return -1;
+}
+
+bool TaskPool::TakeTask(int index, Task* task) {
+  if (queued_ <= 0)
+    return false;
+
+  if (index >= 0) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (!worker.tasks.empty()) {
+      task->swap(worker.tasks.back());
+      worker.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  const int count = thread_count();
+  const int first = (index >= 0) ? index + 1 : 0;
+
+  for (int i = 0; i < count; ++i) {
+    const int victim = (first + i) % count;
+
+    if (victim == index)
+      continue;
+
+    Worker& worker = *workers_[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (!worker.tasks.empty()) {
+      task->swap(worker.tasks.front());
+      worker.tasks.pop_front();
+      --queued_;
+
+      if (index >= 0)
+        ++steals_;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void TaskPool::RunTask(const Task& task) {
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  task();
+
+  busy_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  ++tasks_;
+}
+
+void TaskPool::Run(int index) {
+  // Wait for the constructor to record the ids.
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+  }
+
+  for (;;) {
+    Task task;
+
+    if (TakeTask(index, &task)) {
+      RunTask(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+
+    if (queued_ > 0)
+      continue;
+
+    if (stopping_)
+      return;
+
+    idle_.wait(lock);
+  }
+}
+
+TaskGroup::TaskGroup(TaskPool& pool) : pool_(pool), pending_(0) {
+}
+
+TaskGroup::~TaskGroup() {
+  Wait();
+}
+
+void TaskGroup::Run(const TaskPool::Task& task) {
+  ++pending_;
+
+  pool_.Submit([this, task]() {
+    task();
+
+    // Under the mutex, so that Wait cannot miss the last one.
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (--pending_ == 0)
+      done_.notify_all();
+  });
+}
+
+void TaskGroup::Wait() {
+  while (pending_ > 0) {
+    if (pool_.RunOne())
+      continue;
+
+    // The rest are running on the workers.
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (pending_ > 0)
+      done_.wait(lock);
+  }
+
+  // The last task may still hold the mutex.
+  std::lock_guard<std::mutex> lock(mutex_);
+}
+
+}  // namespace webmdshow
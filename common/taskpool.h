@@ -0,0 +1,140 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_TASKPOOL_H_
+#define WEBMDSHOW_COMMON_TASKPOOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace webmdshow {
+
+// A fixed set of worker threads running short tasks (colour conversion,
+// decoding, prefetch), meant to be shared by every filter in a process
+// instead of each of them starting threads of its own. Each worker has its
+// own queue: a task submitted by a worker goes on that worker's queue,
+// which it takes from newest first, while the cache is warm; tasks from
+// other threads are spread over the queues in turn. A worker whose queue
+// is empty steals the oldest task from another's. Tasks must not block
+// for long: a graph's streaming threads stay threads of their own.
+class TaskPool {
+ public:
+  typedef std::function<void()> Task;
+
+  struct Stats {
+    int threads;
+    int64_t tasks;       // tasks run
+    int64_t steals;      // tasks a worker took from another worker's queue
+    int64_t busy_us;     // time spent running tasks, summed over workers
+    int64_t elapsed_us;  // since the pool started
+  };
+
+  // Starts |thread_count| workers, or one per logical processor if zero.
+  explicit TaskPool(int thread_count);
+
+  // Runs the tasks still queued, then stops the workers.
+  ~TaskPool();
+
+  // Queues |task| to run on one of the workers.
+  void Submit(const Task& task);
+
+  // Runs one queued task on the calling thread, if there is one. Returns
+  // whether it did.
+  bool RunOne();
+
+  int thread_count() const { return static_cast<int>(workers_.size()); }
+
+  void GetStats(Stats* stats) const;
+
+  // Returns the fraction of the workers' time spent running tasks since
+  // the pool started, from 0 to 1.
+  double GetUtilization() const;
+
+  // Returns the pool shared by the process, started on first use with
+  // the thread count given to SetSharedThreadCount, or with one worker per
+  // logical processor.
+  static TaskPool& GetShared();
+
+  // Sets the thread count of the shared pool. Has no effect once the pool
+  // has started.
+  static void SetSharedThreadCount(int thread_count);
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread::id id;
+  };
+
+  // Returns the index of the worker the calling thread is, or -1.
+  int GetWorkerIndex() const;
+
+  // Takes a task from worker |index|'s queue, newest first, or failing
+  // that, the oldest from another's. |index| may be -1, for a thread that
+  // is not a worker.
+  bool TakeTask(int index, Task* task);
+
+  void RunTask(const Task& task);
+  void Run(int index);
+
+  std::vector<Worker*> workers_;
+  std::vector<std::thread> threads_;
+
+  // Guards sleeping: a worker checks |queued_| and sleeps under it.
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  bool stopping_;
+
+  std::atomic<int> queued_;
+  std::atomic<unsigned int> next_worker_;
+
+  std::atomic<int64_t> tasks_;
+  std::atomic<int64_t> steals_;
+  std::atomic<int64_t> busy_us_;
+  const std::chrono::steady_clock::time_point start_;
+
+  TaskPool(const TaskPool&);
+  TaskPool& operator=(const TaskPool&);
+};
+
+// Tasks submitted to a pool together, and waited for together.
+class TaskGroup {
+ public:
+  explicit TaskGroup(TaskPool& pool);
+
+  // Waits for the tasks still running.
+  ~TaskGroup();
+
+  void Run(const TaskPool::Task& task);
+
+  // Waits until every task Run so far is done. Meanwhile the calling
+  // thread runs queued tasks of the pool itself, so that Wait can be called
+  // from a worker without tying it up.
+  void Wait();
+
+ private:
+  TaskPool& pool_;
+  std::atomic<int> pending_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+
+  TaskGroup(const TaskGroup&);
+  TaskGroup& operator=(const TaskGroup&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_TASKPOOL_H_
@@ -0,0 +1,367 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "tensorexport.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || \
+    defined(__SSE2__)
+#define WEBMDSHOW_TENSOREXPORT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace webmdshow {
+
+namespace {
+
+// The YuvToRgbConstants as floats, scaled to give colours in [0, 1], and
+// the normalization as a multiply and an add.
+struct FloatConstants {
+  float y_offset;
+  float y;
+  float vr;
+  float ug;
+  float vg;
+  float ub;
+  float scale[3];
+  float bias[3];
+};
+
+void GetFloatConstants(const TensorParams& params, FloatConstants* f) {
+  const YuvToRgbConstants& k =
+      GetYuvToRgbConstants(params.matrix, params.range);
+
+  const float unit = 1.0f / (8192.0f * 255.0f);
+
+  f->y_offset = k.y_offset;
+  f->y = k.y * unit;
+  f->vr = k.vr * unit;
+  f->ug = k.ug * unit;
+  f->vg = k.vg * unit;
+  f->ub = k.ub * unit;
+
+  for (int c = 0; c < 3; ++c) {
+    f->scale[c] = 1.0f / params.std[c];
+    f->bias[c] = -params.mean[c] * f->scale[c];
+  }
+}
+
+inline float Clamp01(float x) {
+  return (x < 0.0f) ? 0.0f : (x > 1.0f) ? 1.0f : x;
+}
+
+// Converts pixels [begin, width) of one output row.
+void ConvertRowC(const uint8_t* row_y, const uint8_t* row_u,
+                 const uint8_t* row_v, const FloatConstants& k, int begin,
+                 int width, float* r, float* g, float* b) {
+  for (int x = begin; x < width; ++x) {
+    const float y = k.y * (row_y[x] - k.y_offset);
+    const float u = static_cast<float>(row_u[x] - 128);
+    const float v = static_cast<float>(row_v[x] - 128);
+
+    r[x] = Clamp01(y + k.vr * v) * k.scale[0] + k.bias[0];
+    g[x] = Clamp01((y + k.ug * u) + k.vg * v) * k.scale[1] + k.bias[1];
+    b[x] = Clamp01(y + k.ub * u) * k.scale[2] + k.bias[2];
+  }
+}
+
+// Blends two source rows: |frac| / 256 of the way from |r0| to |r1|.
+void BlendRowC(const uint8_t* r0, const uint8_t* r1, int frac, int begin,
+               int width, uint8_t* dst) {
+  const int f0 = 256 - frac;
+
+  for (int x = begin; x < width; ++x)
+    dst[x] = static_cast<uint8_t>((r0[x] * f0 + r1[x] * frac + 128) >> 8);
+}
+
+#ifdef WEBMDSHOW_TENSOREXPORT_SSE2
+
+// Returns how many pixels of the row it converted.
+int ConvertRowSse2(const uint8_t* row_y, const uint8_t* row_u,
+                   const uint8_t* row_v, const FloatConstants& k, int width,
+                   float* r, float* g, float* b) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i y_offset = _mm_set1_epi16(static_cast<int16_t>(k.y_offset));
+  const __m128i c128 = _mm_set1_epi16(128);
+
+  const __m128 ky = _mm_set1_ps(k.y);
+  const __m128 kvr = _mm_set1_ps(k.vr);
+  const __m128 kug = _mm_set1_ps(k.ug);
+  const __m128 kvg = _mm_set1_ps(k.vg);
+  const __m128 kub = _mm_set1_ps(k.ub);
+  const __m128 lo = _mm_setzero_ps();
+  const __m128 hi = _mm_set1_ps(1.0f);
+
+  __m128 scale[3], bias[3];
+
+  for (int c = 0; c < 3; ++c) {
+    scale[c] = _mm_set1_ps(k.scale[c]);
+    bias[c] = _mm_set1_ps(k.bias[c]);
+  }
+
+  int x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    const __m128i y16 = _mm_sub_epi16(
+        _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_y + x)),
+            zero),
+        y_offset);
+    const __m128i u16 = _mm_sub_epi16(
+        _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_u + x)),
+            zero),
+        c128);
+    const __m128i v16 = _mm_sub_epi16(
+        _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_v + x)),
+            zero),
+        c128);
+
+    for (int half = 0; half < 2; ++half) {
+      // Sign-extends four words to dwords: the word into the top half,
+      // then an arithmetic shift down.
+      const __m128i y32 = _mm_srai_epi32(
+          half ? _mm_unpackhi_epi16(zero, y16) : _mm_unpacklo_epi16(zero, y16),
+          16);
+      const __m128i u32 = _mm_srai_epi32(
+          half ? _mm_unpackhi_epi16(zero, u16) : _mm_unpacklo_epi16(zero, u16),
+          16);
+      const __m128i v32 = _mm_srai_epi32(
+          half ? _mm_unpackhi_epi16(zero, v16) : _mm_unpacklo_epi16(zero, v16),
+          16);
+
+      const __m128 y = _mm_mul_ps(ky, _mm_cvtepi32_ps(y32));
+      const __m128 u = _mm_cvtepi32_ps(u32);
+      const __m128 v = _mm_cvtepi32_ps(v32);
+
+      const __m128 rf = _mm_add_ps(y, _mm_mul_ps(kvr, v));
+      const __m128 gf = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(kug, u)),
+                                   _mm_mul_ps(kvg, v));
+      const __m128 bf = _mm_add_ps(y, _mm_mul_ps(kub, u));
+
+      const int i = x + 4 * half;
+
+      _mm_storeu_ps(r + i, _mm_add_ps(
+          _mm_mul_ps(_mm_min_ps(_mm_max_ps(rf, lo), hi), scale[0]), bias[0]));
+      _mm_storeu_ps(g + i, _mm_add_ps(
+          _mm_mul_ps(_mm_min_ps(_mm_max_ps(gf, lo), hi), scale[1]), bias[1]));
+      _mm_storeu_ps(b + i, _mm_add_ps(
+          _mm_mul_ps(_mm_min_ps(_mm_max_ps(bf, lo), hi), scale[2]), bias[2]));
+    }
+  }
+
+  return x;
+}
+
+// Returns how many pixels of the row it blended. The weighted sum of two
+// bytes with weights summing to 256 fits an unsigned word.
+int BlendRowSse2(const uint8_t* r0, const uint8_t* r1, int frac, int width,
+                 uint8_t* dst) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i w0 = _mm_set1_epi16(static_cast<int16_t>(256 - frac));
+  const __m128i w1 = _mm_set1_epi16(static_cast<int16_t>(frac));
+  const __m128i round = _mm_set1_epi16(128);
+
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+
+    const __m128i lo = _mm_srli_epi16(
+        _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                          _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)),
+            round),
+        8);
+    const __m128i hi = _mm_srli_epi16(
+        _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                          _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)),
+            round),
+        8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_packus_epi16(lo, hi));
+  }
+
+  return x;
+}
+
+#endif  // WEBMDSHOW_TENSOREXPORT_SSE2
+
+// Returns the source row for a tap, blended into |blend| if it falls
+// between two rows.
+const uint8_t* GetSourceRow(const uint8_t* plane, int stride, int width,
+                            int pos, int frac, uint8_t* blend) {
+  const uint8_t* const r0 = plane + pos * stride;
+
+  if (frac == 0)
+    return r0;
+
+  const uint8_t* const r1 = r0 + stride;
+
+#ifdef WEBMDSHOW_TENSOREXPORT_SSE2
+  const int done = BlendRowSse2(r0, r1, frac, width, blend);
+#else
+  const int done = 0;
+#endif
+
+  BlendRowC(r0, r1, frac, done, width, blend);
+  return blend;
+}
+
+}  // namespace
+
+TensorParams::TensorParams()
+    : width(224),
+      height(224),
+      matrix(kYuvMatrixBT601),
+      range(kYuvRangeLimited) {
+  for (int c = 0; c < 3; ++c) {
+    mean[c] = 0.0f;
+    std[c] = 1.0f;
+  }
+}
+
+size_t GetTensorFrameSize(const TensorParams& params) {
+  return 3 * static_cast<size_t>(params.width) * params.height;
+}
+
+TensorExporter::TensorExporter() : src_width_(0), src_height_(0) {}
+
+void TensorExporter::set_params(const TensorParams& params) {
+  assert(params.width > 0 && params.height > 0);
+
+  params_ = params;
+  src_width_ = 0;  // map the taps again
+  src_height_ = 0;
+}
+
+void TensorExporter::MapTaps(int src_size, int dst_size,
+                             std::vector<Tap>* taps) {
+  assert(src_size > 0 && dst_size > 0);
+  taps->resize(dst_size);
+
+  for (int i = 0; i < dst_size; ++i) {
+    // The centre of output sample i in source samples, in 1/256ths:
+    // (i + 0.5) * src_size / dst_size - 0.5.
+    int64_t pos = (int64_t(2 * i + 1) * src_size * 256) / (2 * dst_size);
+    pos -= 128;
+
+    if (pos < 0)
+      pos = 0;
+
+    Tap& t = (*taps)[i];
+    t.pos = static_cast<int>(pos >> 8);
+    t.frac = static_cast<int>(pos & 255);
+
+    if (t.pos >= src_size - 1) {
+      t.pos = src_size - 1;
+      t.frac = 0;
+    }
+  }
+}
+
+void TensorExporter::Prepare(int src_width, int src_height) {
+  if ((src_width == src_width_) && (src_height == src_height_))
+    return;
+
+  const int uv_width = (src_width + 1) / 2;
+  const int uv_height = (src_height + 1) / 2;
+
+  MapTaps(src_width, params_.width, &x_taps_);
+  MapTaps(src_height, params_.height, &y_taps_);
+  MapTaps(uv_width, params_.width, &cx_taps_);
+  MapTaps(uv_height, params_.height, &cy_taps_);
+
+  blend_.resize(src_width);
+  rows_.resize(3 * params_.width);
+
+  src_width_ = src_width;
+  src_height_ = src_height;
+}
+
+bool TensorExporter::Export(const vpx_image_t* f, float* batch, int index) {
+  assert(f);
+  assert(batch);
+  assert(index >= 0);
+
+  if ((f->fmt != VPX_IMG_FMT_I420) && (f->fmt != VPX_IMG_FMT_YV12))
+    return false;
+
+  if ((f->d_w == 0) || (f->d_h == 0))
+    return false;
+
+  const int src_width = f->d_w;
+  const int uv_width = (src_width + 1) / 2;
+
+  Prepare(src_width, f->d_h);
+
+  FloatConstants k;
+  GetFloatConstants(params_, &k);
+
+  const int width = params_.width;
+  const size_t plane = static_cast<size_t>(width) * params_.height;
+
+  float* const dst = batch + index * GetTensorFrameSize(params_);
+
+  uint8_t* const row_y = &rows_[0];
+  uint8_t* const row_u = row_y + width;
+  uint8_t* const row_v = row_u + width;
+
+  const uint8_t* const src_planes[3] = {
+    f->planes[VPX_PLANE_Y], f->planes[VPX_PLANE_U], f->planes[VPX_PLANE_V]
+  };
+  const int src_strides[3] = {
+    f->stride[VPX_PLANE_Y], f->stride[VPX_PLANE_U], f->stride[VPX_PLANE_V]
+  };
+  uint8_t* const rows[3] = { row_y, row_u, row_v };
+
+  for (int oy = 0; oy < params_.height; ++oy) {
+    for (int p = 0; p < 3; ++p) {
+      const Tap& ty = (p == 0) ? y_taps_[oy] : cy_taps_[oy];
+      const std::vector<Tap>& tx = (p == 0) ? x_taps_ : cx_taps_;
+
+      const uint8_t* const src =
+          GetSourceRow(src_planes[p], src_strides[p],
+                       (p == 0) ? src_width : uv_width, ty.pos, ty.frac,
+                       &blend_[0]);
+
+      uint8_t* const out = rows[p];
+
+      for (int ox = 0; ox < width; ++ox) {
+        const Tap& t = tx[ox];
+        const int a = src[t.pos];
+        const int b = src[t.pos + (t.frac != 0)];
+
+        out[ox] = static_cast<uint8_t>((a * (256 - t.frac) + b * t.frac +
+                                        128) >> 8);
+      }
+    }
+
+    float* const r = dst + oy * width;
+    float* const g = r + plane;
+    float* const b = g + plane;
+
+#ifdef WEBMDSHOW_TENSOREXPORT_SSE2
+    const int done = ConvertRowSse2(row_y, row_u, row_v, k, width, r, g, b);
+#else
+    const int done = 0;
+#endif
+
+    ConvertRowC(row_y, row_u, row_v, k, done, width, r, g, b);
+  }
+
+  return true;
+}
+
+}  // namespace webmdshow
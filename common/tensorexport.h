@@ -0,0 +1,97 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_TENSOREXPORT_H_
+#define WEBMDSHOW_COMMON_TENSOREXPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "vpx/vpx_image.h"
+#include "yuvtorgb.h"
+
+namespace webmdshow {
+
+// How decoded frames become the input of a model: the size of each
+// channel plane, and the normalization of each of R, G and B,
+//   out = (c / 255 - mean) / std
+// with the colour c in [0, 255] after conversion with the matrix and range.
+struct TensorParams {
+  TensorParams();  // 224x224, BT.601 limited range, mean 0 and std 1
+
+  int width;
+  int height;
+  YuvMatrix matrix;
+  YuvRange range;
+  float mean[3];  // R, G, B
+  float std[3];
+};
+
+// Returns the floats of one frame of |params|: three planes of
+// width * height.
+size_t GetTensorFrameSize(const TensorParams& params);
+
+// Writes decoded I420 frames as planar float RGB: for each frame, the R
+// plane, then G, then B, so that frames written at consecutive indexes of
+// a batch buffer are the NCHW tensor of the batch. The scale (bilinear,
+// from the pixel centres), the conversion and the normalization are one
+// pass over the output rows: each row is resampled from the two source
+// rows around it into a few rows of bytes that stay in the cache, and
+// then converted to float four pixels at a time with SSE2 where the build
+// targets it, and in C otherwise, which rounds the same way. The source
+// rows and columns are mapped once per frame size. Not thread safe; use
+// one per thread (the frame server's callbacks, say).
+class TensorExporter {
+ public:
+  TensorExporter();
+
+  void set_params(const TensorParams& params);
+  const TensorParams& params() const { return params_; }
+
+  // Writes |image|, which must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12, as
+  // frame |index| of the batch at |batch|, which the caller sizes for at
+  // least index + 1 frames of GetTensorFrameSize. Returns false for any
+  // other format.
+  bool Export(const vpx_image_t* image, float* batch, int index);
+
+ private:
+  // Where an output column (or row) samples the source: between |pos|
+  // and pos + 1, |frac| / 256 of the way.
+  struct Tap {
+    int pos;
+    int frac;
+  };
+
+  static void MapTaps(int src_size, int dst_size, std::vector<Tap>* taps);
+
+  void Prepare(int src_width, int src_height);
+
+  TensorParams params_;
+
+  // The source size the taps were mapped for.
+  int src_width_;
+  int src_height_;
+  std::vector<Tap> x_taps_;   // luma columns
+  std::vector<Tap> y_taps_;   // luma rows
+  std::vector<Tap> cx_taps_;  // chroma
+  std::vector<Tap> cy_taps_;
+
+  // Rows: one source row blended vertically, then Y, U and V of one
+  // output row.
+  std::vector<uint8_t> blend_;
+  std::vector<uint8_t> rows_;
+
+  TensorExporter(const TensorExporter&);
+  TensorExporter& operator=(const TensorExporter&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_TENSOREXPORT_H_
@@ -0,0 +1,154 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstring>
+#include <vector>
+
+#include "aesctr.h"
+#include "gtest/gtest.h"
+
+using webmdshow::AesCtr;
+
+namespace {
+
+// With a key and IV of 0, the counter blocks are those of the GCM test
+// case 2 of McGrew and Viega, so the keystream is E(K, 0), E(K, Y0) and
+// E(K, Y1) there.
+const uint8_t kZeroKeystream[3 * AesCtr::kBlockSize] = {
+  0x66, 0xe9, 0x4b, 0xd4, 0xef, 0x8a, 0x2c, 0x3b,
+  0x88, 0x4c, 0xfa, 0x59, 0xca, 0x34, 0x2b, 0x2e,
+  0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61,
+  0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a,
+  0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92,
+  0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78
+};
+
+const uint8_t kKey[AesCtr::kKeySize] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+std::vector<uint8_t> MakeData(size_t len) {
+  std::vector<uint8_t> data(len);
+
+  for (size_t i = 0; i < len; ++i)
+    data[i] = static_cast<uint8_t>(i * 7 + 3);
+
+  return data;
+}
+
+class AesCtrTest : public ::testing::TestWithParam<bool> {
+ protected:
+  void SetKey(const uint8_t* key) {
+    aes_.SetKey(key);
+
+    if (!GetParam())
+      aes_.DisableAesNi();
+  }
+
+  AesCtr aes_;
+};
+
+TEST_P(AesCtrTest, ZeroKeystream) {
+  if (GetParam() && !AesCtr::HasAesNi())
+    return;
+
+  const uint8_t zero[AesCtr::kKeySize] = {0};
+  SetKey(zero);
+
+  uint8_t buf[sizeof kZeroKeystream] = {0};
+  aes_.Transform(zero, buf, sizeof buf, buf);
+
+  EXPECT_EQ(0, memcmp(buf, kZeroKeystream, sizeof buf));
+}
+
+TEST_P(AesCtrTest, MatchesOtherPath) {
+  if (!AesCtr::HasAesNi())
+    return;
+
+  SetKey(kKey);
+
+  AesCtr other;
+  other.SetKey(kKey);
+
+  if (GetParam())
+    other.DisableAesNi();
+
+  const uint8_t iv[AesCtr::kIvSize] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  // Whole batches, partial batches and partial blocks.
+  const size_t lens[] = {1, 15, 16, 17, 127, 128, 129, 1000, 4096};
+
+  for (size_t i = 0; i < sizeof lens / sizeof lens[0]; ++i) {
+    const std::vector<uint8_t> data = MakeData(lens[i]);
+    std::vector<uint8_t> a(lens[i]), b(lens[i]);
+
+    aes_.Transform(iv, &data[0], lens[i], &a[0]);
+    other.Transform(iv, &data[0], lens[i], &b[0]);
+
+    EXPECT_TRUE(a == b) << lens[i];
+    EXPECT_FALSE(a == data) << lens[i];
+  }
+}
+
+TEST_P(AesCtrTest, RoundTripsWebmFrame) {
+  if (GetParam() && !AesCtr::HasAesNi())
+    return;
+
+  SetKey(kKey);
+
+  const long len = 1000;
+  const std::vector<uint8_t> clear = MakeData(len);
+
+  std::vector<uint8_t> frame(webmdshow::kWebmEncryptedHeaderSize + len);
+
+  EXPECT_EQ(static_cast<long>(frame.size()),
+            webmdshow::EncryptWebmFrame(aes_, 0x0102030405060708ULL,
+                                        &clear[0], len, &frame[0]));
+
+  EXPECT_EQ(1, frame[0]);
+  EXPECT_EQ(1, frame[1]);
+  EXPECT_EQ(8, frame[8]);
+
+  // Decrypted where it lies, as the splitter does.
+  const long frame_len = static_cast<long>(frame.size());
+  EXPECT_EQ(len, webmdshow::DecryptWebmFrame(aes_, &frame[0], frame_len,
+                                             &frame[0]));
+
+  EXPECT_EQ(0, memcmp(&frame[0], &clear[0], len));
+}
+
+TEST_P(AesCtrTest, ClearWebmFrame) {
+  SetKey(kKey);
+
+  uint8_t frame[] = {0, 10, 20, 30};
+  EXPECT_EQ(3, webmdshow::DecryptWebmFrame(aes_, frame, 4, frame));
+
+  EXPECT_EQ(10, frame[0]);
+  EXPECT_EQ(30, frame[2]);
+}
+
+TEST_P(AesCtrTest, MalformedWebmFrame) {
+  SetKey(kKey);
+
+  uint8_t frame[] = {1, 0, 0, 0};
+  EXPECT_EQ(-1, webmdshow::DecryptWebmFrame(aes_, frame, 0, frame));
+  EXPECT_EQ(-1, webmdshow::DecryptWebmFrame(aes_, frame, 4, frame));
+}
+
+TEST(AesCtr, NoKey) {
+  AesCtr aes;
+  EXPECT_FALSE(aes.HasKey());
+
+  uint8_t frame[webmdshow::kWebmEncryptedHeaderSize + 1] = {1};
+  EXPECT_EQ(-1, webmdshow::DecryptWebmFrame(aes, frame, sizeof frame, frame));
+}
+
+INSTANTIATE_TEST_CASE_P(AesNi, AesCtrTest, ::testing::Bool());
+
+}  // namespace
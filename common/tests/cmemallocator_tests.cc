@@ -0,0 +1,209 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <vfwmsgs.h>
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "cmediasample.h"
+#include "cmemallocator.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+double GetSeconds() {
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return double(count.QuadPart) / double(freq.QuadPart);
+}
+
+// Creates a committed allocator of |buffers| samples of 64 bytes.
+CMemAllocator* CreateCommitted(long buffers) {
+  IMemAllocator* allocator;
+
+  if (FAILED(CMediaSample::CreateAllocator(&allocator)))
+    return NULL;
+
+  ALLOCATOR_PROPERTIES props = {buffers, 64, 1, 0};
+  ALLOCATOR_PROPERTIES actual;
+
+  if (FAILED(allocator->SetProperties(&props, &actual)) ||
+      FAILED(allocator->Commit())) {
+    allocator->Release();
+    return NULL;
+  }
+
+  return static_cast<CMemAllocator*>(allocator);
+}
+
+}  // namespace
+
+TEST(CMemAllocator, NoWaitTimesOut) {
+  CMemAllocator* const allocator = CreateCommitted(2);
+  ASSERT_TRUE(allocator != NULL);
+
+  IMediaSample* samples[3];
+  ASSERT_EQ(S_OK, allocator->GetBuffer(&samples[0], 0, 0, AM_GBF_NOWAIT));
+  ASSERT_EQ(S_OK, allocator->GetBuffer(&samples[1], 0, 0, AM_GBF_NOWAIT));
+  EXPECT_EQ(0, allocator->GetContentionCount());
+
+  EXPECT_EQ(VFW_E_TIMEOUT,
+            allocator->GetBuffer(&samples[2], 0, 0, AM_GBF_NOWAIT));
+  EXPECT_EQ(1, allocator->GetContentionCount());
+
+  samples[0]->Release();
+  ASSERT_EQ(S_OK, allocator->GetBuffer(&samples[2], 0, 0, AM_GBF_NOWAIT));
+
+  samples[1]->Release();
+  samples[2]->Release();
+
+  EXPECT_EQ(S_OK, allocator->Decommit());
+  EXPECT_EQ(0u, allocator->Release());
+}
+
+TEST(CMemAllocator, DecommitWakesEveryWaiter) {
+  CMemAllocator* const allocator = CreateCommitted(1);
+  ASSERT_TRUE(allocator != NULL);
+
+  IMediaSample* sample;
+  ASSERT_EQ(S_OK, allocator->GetBuffer(&sample, 0, 0, 0));
+
+  const int kWaiters = 4;
+  HRESULT results[kWaiters];
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < kWaiters; ++i) {
+    threads.push_back(std::thread([allocator, &results, i]() {
+      IMediaSample* p;
+      results[i] = allocator->GetBuffer(&p, 0, 0, 0);
+    }));
+  }
+
+  while (allocator->GetContentionCount() < kWaiters)
+    Sleep(1);
+
+  EXPECT_EQ(S_OK, allocator->Decommit());
+
+  for (int i = 0; i < kWaiters; ++i) {
+    threads[i].join();
+    EXPECT_EQ(VFW_E_NOT_COMMITTED, results[i]);
+  }
+
+  // Released after Decommit, so destroyed rather than pooled.
+  sample->Release();
+  EXPECT_EQ(0u, allocator->Release());
+}
+
+// Not a pass/fail test beyond every sample coming back: reports how fast
+// threads taking and releasing samples from one pool can go, and how
+// often they found it empty.
+TEST(CMemAllocator, ContendedSpeed) {
+  const int iterations = 200000;
+  const int thread_counts[] = {1, 2, 4, 8};
+
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]);
+       ++t) {
+    const int thread_count = thread_counts[t];
+
+    // Fewer samples than threads, so that some of them wait.
+    CMemAllocator* const allocator = CreateCommitted(thread_count / 2 + 1);
+    ASSERT_TRUE(allocator != NULL);
+
+    const double t0 = GetSeconds();
+
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < thread_count; ++i) {
+      threads.push_back(std::thread([allocator, iterations]() {
+        for (int n = 0; n < iterations; ++n) {
+          IMediaSample* sample;
+
+          if (allocator->GetBuffer(&sample, 0, 0, 0) != S_OK)
+            return;
+
+          sample->SetActualDataLength(n & 63);
+          sample->Release();
+        }
+      }));
+    }
+
+    for (int i = 0; i < thread_count; ++i)
+      threads[i].join();
+
+    const double t1 = GetSeconds();
+
+    printf("%d threads: %.0f ns per GetBuffer/Release, %ld contended\n",
+           thread_count, (t1 - t0) * 1e9 / (thread_count * iterations),
+           allocator->GetContentionCount());
+
+    // No sample still holds a reference to the allocator.
+    EXPECT_EQ(1u, allocator->GetCount());
+
+    EXPECT_EQ(S_OK, allocator->Decommit());
+    EXPECT_EQ(0u, allocator->Release());
+  }
+}
+
+// Commits again and again while threads take samples, so that a Commit
+// often lands while a GetBuffer is taking a sample off the list; the pool
+// must still hold only as many samples as were asked for.
+TEST(CMemAllocator, RecommitKeepsBufferCount) {
+  const long kBuffers = 2;
+
+  CMemAllocator* const allocator = CreateCommitted(kBuffers);
+  ASSERT_TRUE(allocator != NULL);
+
+  volatile LONG stop = 0;
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([allocator, &stop]() {
+      while (!stop) {
+        IMediaSample* sample;
+
+        if (allocator->GetBuffer(&sample, 0, 0, AM_GBF_NOWAIT) == S_OK)
+          sample->Release();
+      }
+    }));
+  }
+
+  for (int n = 0; n < 2000; ++n) {
+    EXPECT_EQ(S_OK, allocator->Decommit());
+
+    // A GetBuffer that is still on its way out holds off the Commit.
+    HRESULT hr;
+
+    while ((hr = allocator->Commit()) == VFW_E_BUFFERS_OUTSTANDING)
+      Sleep(0);
+
+    ASSERT_EQ(S_OK, hr);
+  }
+
+  InterlockedExchange(&stop, 1);
+
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  IMediaSample* samples[kBuffers + 1];
+
+  for (long i = 0; i < kBuffers; ++i)
+    ASSERT_EQ(S_OK, allocator->GetBuffer(&samples[i], 0, 0, AM_GBF_NOWAIT));
+
+  EXPECT_EQ(VFW_E_TIMEOUT,
+            allocator->GetBuffer(&samples[kBuffers], 0, 0, AM_GBF_NOWAIT));
+
+  for (long i = 0; i < kBuffers; ++i)
+    samples[i]->Release();
+
+  EXPECT_EQ(S_OK, allocator->Decommit());
+  EXPECT_EQ(0u, allocator->Release());
+}
@@ -0,0 +1,402 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "colorconverter.h"
+#include "gtest/gtest.h"
+#include "libyuv/cpu_id.h"
+#include "on2_codec/on2_image.h"
+
+using webmdshow::ColorConverter;
+using webmdshow::ColorFormat;
+
+namespace {
+
+const ColorFormat kFormats[] = {
+  webmdshow::kColorFormatI420,
+  webmdshow::kColorFormatYV12,
+  webmdshow::kColorFormatNV12,
+  webmdshow::kColorFormatYUY2,
+  webmdshow::kColorFormatUYVY,
+  webmdshow::kColorFormatRGB24,
+  webmdshow::kColorFormatRGB32,
+};
+
+const int kNumFormats = sizeof(kFormats) / sizeof(kFormats[0]);
+
+bool IsRgb(ColorFormat format) {
+  return format == webmdshow::kColorFormatRGB24 ||
+         format == webmdshow::kColorFormatRGB32;
+}
+
+// An I420 frame of smooth gradients, which survive the trip through RGB
+// with little loss.
+std::vector<uint8_t> CreateI420(int w, int h) {
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatI420, w);
+  std::vector<uint8_t> buf(
+      ColorConverter::GetFrameSize(webmdshow::kColorFormatI420, stride, h));
+
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x)
+      buf[y * stride + x] = static_cast<uint8_t>(32 + (x + y) * 160 / (w + h));
+  }
+
+  const int uv_stride = (stride + 1) / 2;
+  const int uv_h = (h + 1) / 2;
+  uint8_t* const u = &buf[stride * h];
+  uint8_t* const v = u + uv_stride * uv_h;
+
+  for (int y = 0; y < uv_h; ++y) {
+    for (int x = 0; x < uv_stride; ++x) {
+      u[y * uv_stride + x] = static_cast<uint8_t>(112 + x % 32);
+      v[y * uv_stride + x] = static_cast<uint8_t>(144 - y % 32);
+    }
+  }
+
+  return buf;
+}
+
+// Converts the |w|x|h| frame |src| from |src_format| to |dst_format|.
+std::vector<uint8_t> Convert(const std::vector<uint8_t>& src,
+                             ColorFormat src_format, ColorFormat dst_format,
+                             int w, int h) {
+  const int src_stride = ColorConverter::GetStride(src_format, w);
+  const int dst_stride = ColorConverter::GetStride(dst_format, w);
+
+  std::vector<uint8_t> dst(
+      ColorConverter::GetFrameSize(dst_format, dst_stride, h));
+
+  ColorConverter converter;
+  EXPECT_TRUE(converter.Init(src_format, src_stride, dst_format, dst_stride,
+                             w, h));
+  EXPECT_TRUE(converter.Convert(&src[0], &dst[0]));
+
+  return dst;
+}
+
+int MaxLumaDiff(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b,
+                int w, int h) {
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatI420, w);
+  int max_diff = 0;
+
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const int diff = abs(a[y * stride + x] - b[y * stride + x]);
+
+      if (diff > max_diff)
+        max_diff = diff;
+    }
+  }
+
+  return max_diff;
+}
+
+double GetSeconds() {
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return double(count.QuadPart) / double(freq.QuadPart);
+}
+
+}  // namespace
+
+TEST(ColorConverter, FrameSizes) {
+  EXPECT_EQ(34, ColorConverter::GetStride(webmdshow::kColorFormatI420, 33));
+  EXPECT_EQ(68, ColorConverter::GetStride(webmdshow::kColorFormatYUY2, 33));
+  EXPECT_EQ(100, ColorConverter::GetStride(webmdshow::kColorFormatRGB24, 33));
+  EXPECT_EQ(132, ColorConverter::GetStride(webmdshow::kColorFormatRGB32, 33));
+
+  EXPECT_EQ(34 * 17 + 2 * 17 * 9,
+            ColorConverter::GetFrameSize(webmdshow::kColorFormatYV12, 34, 17));
+  EXPECT_EQ(34 * 17 + 34 * 9,
+            ColorConverter::GetFrameSize(webmdshow::kColorFormatNV12, 34, 17));
+  EXPECT_EQ(100 * 17, ColorConverter::GetFrameSize(
+                          webmdshow::kColorFormatRGB24, -100, 17));
+}
+
+TEST(ColorConverter, RejectsBadStrides) {
+  ColorConverter converter;
+
+  EXPECT_FALSE(converter.Init(webmdshow::kColorFormatRGB32, 4 * 32,
+                              webmdshow::kColorFormatI420, 30, 32, 16));
+  EXPECT_FALSE(converter.Init(webmdshow::kColorFormatYUY2, -64,
+                              webmdshow::kColorFormatI420, 32, 32, 16));
+  EXPECT_TRUE(converter.Init(webmdshow::kColorFormatRGB32, -4 * 32,
+                             webmdshow::kColorFormatI420, 32, 32, 16));
+}
+
+// Every pair, at odd and even sizes: I420 is converted to the source
+// format, then to the destination format, then back to I420, and the luma
+// compared with the original. Pairs libyuv has no one function for go
+// through the converter's own I420 frame.
+TEST(ColorConverter, AllPairs) {
+  const int sizes[][2] = {{2, 2}, {33, 17}, {64, 48}, {1, 1}};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const int w = sizes[i][0];
+    const int h = sizes[i][1];
+
+    const std::vector<uint8_t> i420 = CreateI420(w, h);
+
+    for (int s = 0; s < kNumFormats; ++s) {
+      const ColorFormat src_format = kFormats[s];
+      const std::vector<uint8_t> src =
+          Convert(i420, webmdshow::kColorFormatI420, src_format, w, h);
+
+      for (int d = 0; d < kNumFormats; ++d) {
+        const ColorFormat dst_format = kFormats[d];
+        const std::vector<uint8_t> dst =
+            Convert(src, src_format, dst_format, w, h);
+        const std::vector<uint8_t> out =
+            Convert(dst, dst_format, webmdshow::kColorFormatI420, w, h);
+
+        const int tolerance =
+            (IsRgb(src_format) || IsRgb(dst_format)) ? 4 : 0;
+
+        EXPECT_LE(MaxLumaDiff(i420, out, w, h), tolerance)
+            << w << "x" << h << " from " << src_format
+            << " to " << dst_format;
+      }
+    }
+  }
+}
+
+TEST(ColorConverter, FlipsBottomUpRgb) {
+  const int w = 7;
+  const int h = 5;
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatRGB24, w);
+
+  std::vector<uint8_t> src(stride * h);
+
+  for (size_t i = 0; i < src.size(); ++i)
+    src[i] = static_cast<uint8_t>(i);
+
+  std::vector<uint8_t> dst(src.size());
+
+  ColorConverter converter;
+  ASSERT_TRUE(converter.Init(webmdshow::kColorFormatRGB24, -stride,
+                             webmdshow::kColorFormatRGB24, stride, w, h));
+  ASSERT_TRUE(converter.Convert(&src[0], &dst[0]));
+
+  for (int y = 0; y < h; ++y) {
+    EXPECT_EQ(0, memcmp(&dst[y * stride], &src[(h - 1 - y) * stride], 3 * w))
+        << "row " << y;
+  }
+}
+
+// Packed YUV takes libyuv's one-pass BT.601 path to RGB32 by default, and
+// goes through I420ToRgb32 for any other matrix.
+TEST(ColorConverter, YuvMatrix) {
+  const int w = 34;
+  const int h = 6;
+  const std::vector<uint8_t> i420 = CreateI420(w, h);
+  const std::vector<uint8_t> yuy2 = Convert(i420, webmdshow::kColorFormatI420,
+                                            webmdshow::kColorFormatYUY2, w, h);
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatRGB32, w);
+
+  std::vector<uint8_t> bt709(stride * h);
+
+  ColorConverter converter;
+  converter.set_yuv_matrix(webmdshow::kYuvMatrixBT709,
+                           webmdshow::kYuvRangeFull);
+  ASSERT_TRUE(converter.Init(webmdshow::kColorFormatYUY2,
+                             ColorConverter::GetStride(
+                                 webmdshow::kColorFormatYUY2, w),
+                             webmdshow::kColorFormatRGB32, stride, w, h));
+  ASSERT_TRUE(converter.Convert(&yuy2[0], &bt709[0]));
+
+  // I420 to YUY2 repeats each chroma row, and YUY2 to I420 averages the
+  // pair back, so the expected frame can be converted from |i420|.
+  const int i420_stride = ColorConverter::GetStride(webmdshow::kColorFormatI420,
+                                                    w);
+  const uint8_t* const u = &i420[i420_stride * h];
+  const uint8_t* const v = u + (i420_stride / 2) * (h / 2);
+
+  std::vector<uint8_t> expected(stride * h);
+  webmdshow::I420ToRgb32(&i420[0], i420_stride, u, i420_stride / 2,
+                         v, i420_stride / 2,
+                         webmdshow::GetYuvToRgbConstants(
+                             webmdshow::kYuvMatrixBT709,
+                             webmdshow::kYuvRangeFull),
+                         &expected[0], stride, w, h);
+
+  EXPECT_TRUE(expected == bt709);
+
+  const std::vector<uint8_t> bt601 = Convert(yuy2, webmdshow::kColorFormatYUY2,
+                                             webmdshow::kColorFormatRGB32,
+                                             w, h);
+  EXPECT_FALSE(bt601 == bt709);
+}
+
+TEST(ColorConverter, BandCounts) {
+  EXPECT_EQ(1, ColorConverter::GetBandCount(1920, 1080, 1));
+  EXPECT_EQ(1, ColorConverter::GetBandCount(640, 480, 8));
+  EXPECT_EQ(3, ColorConverter::GetBandCount(1920, 1080, 8));
+  EXPECT_EQ(8, ColorConverter::GetBandCount(3840, 2160, 8));
+  EXPECT_EQ(15, ColorConverter::GetBandCount(3840, 2160, 64));
+}
+
+// Converting in bands on the thread pool gives the same bytes as
+// converting on one thread, including for pairs that go through I420 and
+// for bands that end on an odd row.
+TEST(ColorConverter, BandsMatchOneThread) {
+  const int w = 35;
+  const int h = 47;
+
+  const std::vector<uint8_t> i420 = CreateI420(w, h);
+
+  for (int s = 0; s < kNumFormats; ++s) {
+    const ColorFormat src_format = kFormats[s];
+    const std::vector<uint8_t> src =
+        Convert(i420, webmdshow::kColorFormatI420, src_format, w, h);
+    const int src_stride = ColorConverter::GetStride(src_format, w);
+
+    for (int d = 0; d < kNumFormats; ++d) {
+      const ColorFormat dst_format = kFormats[d];
+      const int dst_stride = ColorConverter::GetStride(dst_format, w);
+      const int size = ColorConverter::GetFrameSize(dst_format, dst_stride, h);
+
+      std::vector<uint8_t> expected(size);
+      std::vector<uint8_t> actual(size);
+
+      ColorConverter one;
+      one.set_band_count(1);
+      ASSERT_TRUE(one.Init(src_format, src_stride, dst_format, dst_stride,
+                           w, h));
+      ASSERT_TRUE(one.Convert(&src[0], &expected[0]));
+
+      ColorConverter banded;
+      banded.set_band_count(5);
+      ASSERT_TRUE(banded.Init(src_format, src_stride, dst_format,
+                              dst_stride, w, h));
+      EXPECT_EQ(5, banded.band_count());
+      ASSERT_TRUE(banded.Convert(&src[0], &actual[0]));
+
+      EXPECT_TRUE(expected == actual)
+          << "from " << src_format << " to " << dst_format;
+
+      ColorConverter::Stats stats;
+      banded.GetStats(&stats);
+      EXPECT_EQ(1, stats.frames);
+      EXPECT_EQ(stats.last_us, stats.total_us);
+    }
+  }
+}
+
+// Not a pass/fail test: reports how the converter compares to the on2
+// function webmcc used for RGB32 to YV12 on a 1080p frame, and what each
+// of the instruction sets libyuv dispatches to contributes.
+TEST(ColorConverter, ConversionSpeed) {
+  const int w = 1920;
+  const int h = 1080;
+  const int iterations = 100;
+
+  const int src_stride = 4 * w;
+  std::vector<uint8_t> src(src_stride * h);
+
+  for (size_t i = 0; i < src.size(); ++i)
+    src[i] = static_cast<uint8_t>(rand());
+
+  const int dst_stride = w;
+  std::vector<uint8_t> dst(
+      ColorConverter::GetFrameSize(webmdshow::kColorFormatYV12, w, h));
+
+  uint8_t* const y = &dst[0];
+  uint8_t* const v = y + w * h;
+  uint8_t* const u = v + (w / 2) * (h / 2);
+
+  const on2_rgb_to_yuv_t rgb_to_yuv =
+      on2_get_rgb_to_yuv(IMG_FMT_YV12, IMG_FMT_RGB32);
+  ASSERT_TRUE(rgb_to_yuv != NULL);
+
+  double t0 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i) {
+    (*rgb_to_yuv)(&src[src_stride * (h - 1)], w, h, y, u, v, -src_stride,
+                  dst_stride);
+  }
+
+  double t1 = GetSeconds();
+
+  printf("RGB32 to YV12: on2 %.3f ms/frame\n",
+         (t1 - t0) * 1000 / iterations);
+
+  ColorConverter converter;
+  ASSERT_TRUE(converter.Init(webmdshow::kColorFormatRGB32, -src_stride,
+                             webmdshow::kColorFormatYV12, dst_stride, w, h));
+
+  const struct {
+    const char* name;
+    int flags;
+  } cpus[] = {
+    {"C", 0},
+    {"SSE2", libyuv::kCpuHasX86 | libyuv::kCpuHasSSE2},
+    {"SSSE3", libyuv::kCpuHasX86 | libyuv::kCpuHasSSE2 |
+              libyuv::kCpuHasSSSE3 | libyuv::kCpuHasSSE41 |
+              libyuv::kCpuHasSSE42},
+    {"AVX2", -1},
+  };
+
+  for (size_t c = 0; c < sizeof(cpus) / sizeof(cpus[0]); ++c) {
+    libyuv::MaskCpuFlags(cpus[c].flags);
+
+    t0 = GetSeconds();
+
+    for (int i = 0; i < iterations; ++i)
+      converter.Convert(&src[0], &dst[0]);
+
+    t1 = GetSeconds();
+
+    printf("RGB32 to YV12: libyuv %s %.3f ms/frame\n", cpus[c].name,
+           (t1 - t0) * 1000 / iterations);
+  }
+
+  libyuv::MaskCpuFlags(-1);
+}
+
+// Not a pass/fail test: reports what splitting a 4K frame into bands on
+// the thread pool saves.
+TEST(ColorConverter, BandSpeed) {
+  const int w = 3840;
+  const int h = 2160;
+  const int iterations = 50;
+
+  const int src_stride = 4 * w;
+  std::vector<uint8_t> src(src_stride * h);
+
+  for (size_t i = 0; i < src.size(); ++i)
+    src[i] = static_cast<uint8_t>(rand());
+
+  std::vector<uint8_t> dst(
+      ColorConverter::GetFrameSize(webmdshow::kColorFormatNV12, w, h));
+
+  const int band_counts[] = {1, 2, 4, 0};
+
+  for (size_t b = 0; b < sizeof(band_counts) / sizeof(band_counts[0]); ++b) {
+    ColorConverter converter;
+    converter.set_band_count(band_counts[b]);
+    ASSERT_TRUE(converter.Init(webmdshow::kColorFormatRGB32, -src_stride,
+                               webmdshow::kColorFormatNV12, w, w, h));
+
+    for (int i = 0; i < iterations; ++i)
+      converter.Convert(&src[0], &dst[0]);
+
+    ColorConverter::Stats stats;
+    converter.GetStats(&stats);
+
+    printf("4K RGB32 to NV12, %d bands: %.3f ms/frame (max %.3f)\n",
+           converter.band_count(),
+           stats.total_us / 1000.0 / stats.frames, stats.max_us / 1000.0);
+  }
+}
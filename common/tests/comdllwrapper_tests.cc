@@ -24,6 +24,7 @@
 
 using WebmTypes::CLSID_WebmMfVorbisDec;
 using WebmTypes::CLSID_WebmMfVp8Dec;
+using WebmTypes::CLSID_WebmMfVp9Dec;
 using WebmMfUtil::ComDllWrapper;
 
 TEST(ComDllWrapperBasic, FailPathDoesNotExist)
@@ -75,4 +76,21 @@ TEST(ComDllWrapperBasic, CreateVp8Dec)
         ptr_mftransform->Release();
     }
     ptr_dll_wrapper->Release();
+}
+
+TEST(ComDllWrapperBasic, CreateVp9Dec)
+{
+    ComDllWrapper* ptr_dll_wrapper = NULL;
+    ASSERT_EQ(S_OK,
+              ComDllWrapper::Create(VP8DEC_PATH, CLSID_WebmMfVp9Dec,
+                                    &ptr_dll_wrapper));
+    IMFTransform* ptr_mftransform = NULL;
+    void* ptr_transform = reinterpret_cast<void*>(ptr_mftransform);
+    ASSERT_EQ(S_OK, ptr_dll_wrapper->CreateInstance(IID_IMFTransform,
+                                                    &ptr_transform));
+    if (ptr_mftransform)
+    {
+        ptr_mftransform->Release();
+    }
+    ptr_dll_wrapper->Release();
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "crc32.h"
+#include "gtest/gtest.h"
+
+using webmdshow::Crc32;
+using webmdshow::Crc32Software;
+
+namespace {
+
+std::vector<uint8_t> MakeBytes(size_t len) {
+  std::vector<uint8_t> bytes(len);
+  uint32_t x = 12345;
+
+  for (size_t i = 0; i < len; ++i) {
+    x = x * 1103515245 + 12345;
+    bytes[i] = static_cast<uint8_t>(x >> 16);
+  }
+
+  return bytes;
+}
+
+}  // namespace
+
+TEST(Crc32Test, MatchesKnownValues) {
+  EXPECT_EQ(0u, Crc32(0, NULL, 0));
+  EXPECT_EQ(0xCBF43926u, Crc32(0, "123456789", 9));
+  EXPECT_EQ(0x414FA339u,
+            Crc32(0, "The quick brown fox jumps over the lazy dog", 43));
+
+  const std::vector<uint8_t> zeros(4096, 0);
+  EXPECT_EQ(0xC71C0011u, Crc32(0, &zeros[0], zeros.size()));
+  EXPECT_EQ(0xC71C0011u, Crc32Software(0, &zeros[0], zeros.size()));
+}
+
+TEST(Crc32Test, PclmulMatchesTables) {
+  if (!webmdshow::HasPclmul())
+    return;
+
+  const std::vector<uint8_t> bytes = MakeBytes(4096 + 16);
+
+  // Every length around the fold sizes, at every alignment of a block.
+  for (size_t len = 0; len <= 4096; len += (len < 300) ? 1 : 61) {
+    for (size_t offset = 0; offset < 16; offset += 5) {
+      const uint8_t* const p = &bytes[offset];
+      EXPECT_EQ(Crc32Software(0, p, len), Crc32(0, p, len))
+          << "len=" << len << " offset=" << offset;
+    }
+  }
+}
+
+TEST(Crc32Test, ContinuesAcrossPieces) {
+  const std::vector<uint8_t> bytes = MakeBytes(10000);
+  const uint32_t whole = Crc32(0, &bytes[0], bytes.size());
+
+  const size_t splits[] = { 1, 7, 64, 100, 4095, 9999 };
+
+  for (int i = 0; i < 6; ++i) {
+    const size_t n = splits[i];
+
+    uint32_t crc = Crc32(0, &bytes[0], n);
+    crc = Crc32(crc, &bytes[n], bytes.size() - n);
+
+    EXPECT_EQ(whole, crc) << "split=" << n;
+  }
+}
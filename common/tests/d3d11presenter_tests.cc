@@ -0,0 +1,123 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <d3d11.h>
+
+#include <vector>
+
+#include "d3d11presenter.h"
+#include "gtest/gtest.h"
+
+using WebmDirectX::D3D11Presenter;
+
+namespace {
+
+const UINT kWidth = 64;
+const UINT kHeight = 48;
+
+// A hidden window for the swap chain: it is never shown, so presents to it
+// are occluded, which the presenter counts as presented.
+class HiddenWindow {
+ public:
+  HiddenWindow()
+      : hwnd_(CreateWindowW(L"STATIC", L"", WS_OVERLAPPEDWINDOW, 0, 0,
+                            kWidth * 2, kHeight * 2, NULL, NULL,
+                            GetModuleHandle(NULL), NULL)) {}
+  ~HiddenWindow() {
+    if (hwnd_)
+      DestroyWindow(hwnd_);
+  }
+  HWND get() const { return hwnd_; }
+
+ private:
+  HWND hwnd_;
+};
+
+TEST(D3D11Presenter, PresentsI420AndNV12Planes) {
+  HiddenWindow window;
+  ASSERT_TRUE(window.get() != NULL);
+
+  D3D11Presenter presenter;
+  ASSERT_HRESULT_SUCCEEDED(presenter.Open(window.get(), NULL));
+
+  // Grey, with a stride wider than the frame, as a decoder's would be.
+  const UINT stride = kWidth + 32;
+  const std::vector<BYTE> y(stride * kHeight, 128);
+  const std::vector<BYTE> chroma(stride * kHeight / 2, 128);
+
+  EXPECT_HRESULT_SUCCEEDED(presenter.PresentI420(
+      kWidth, kHeight, &y[0], stride, &chroma[0], stride / 2, &chroma[0],
+      stride / 2));
+  EXPECT_HRESULT_SUCCEEDED(presenter.PresentNV12(
+      kWidth, kHeight, &y[0], stride, &chroma[0], stride));
+
+  // An odd size rounds the chroma planes up.
+  EXPECT_HRESULT_SUCCEEDED(presenter.PresentI420(
+      kWidth - 1, kHeight - 1, &y[0], stride, &chroma[0], stride / 2,
+      &chroma[0], stride / 2));
+
+  EXPECT_EQ(3U, presenter.GetFramesPresented());
+}
+
+TEST(D3D11Presenter, PresentsNV12Textures) {
+  HiddenWindow window;
+  ASSERT_TRUE(window.get() != NULL);
+
+  D3D11Presenter presenter;
+  ASSERT_HRESULT_SUCCEEDED(presenter.Open(window.get(), NULL));
+  ID3D11Device* const ptr_device = presenter.GetDevice();
+
+  UINT support = 0;
+  ptr_device->CheckFormatSupport(DXGI_FORMAT_NV12, &support);
+  if (!(support & D3D11_FORMAT_SUPPORT_SHADER_SAMPLE))
+    return;  // The device can't sample NV12 (before the 11.1 runtime).
+
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Width = kWidth;
+  desc.Height = kHeight;
+  desc.MipLevels = 1;
+  desc.ArraySize = 1;
+  desc.Format = DXGI_FORMAT_NV12;
+  desc.SampleDesc.Count = 1;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+
+  // Sampled in place, as WebmMfVp8Dec's textures are.
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  ID3D11Texture2D* ptr_texture = NULL;
+  ASSERT_HRESULT_SUCCEEDED(
+      ptr_device->CreateTexture2D(&desc, NULL, &ptr_texture));
+  EXPECT_HRESULT_SUCCEEDED(presenter.PresentTexture(ptr_texture, 0));
+  ptr_texture->Release();
+
+  // Copied first.
+  desc.BindFlags = 0;
+  ASSERT_HRESULT_SUCCEEDED(
+      ptr_device->CreateTexture2D(&desc, NULL, &ptr_texture));
+  EXPECT_HRESULT_SUCCEEDED(presenter.PresentTexture(ptr_texture, 0));
+  ptr_texture->Release();
+
+  EXPECT_EQ(2U, presenter.GetFramesPresented());
+
+  // Not NV12.
+  desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  ASSERT_HRESULT_SUCCEEDED(
+      ptr_device->CreateTexture2D(&desc, NULL, &ptr_texture));
+  EXPECT_EQ(E_INVALIDARG, presenter.PresentTexture(ptr_texture, 0));
+  ptr_texture->Release();
+}
+
+TEST(D3D11Presenter, RejectsPresentBeforeOpen) {
+  D3D11Presenter presenter;
+  const BYTE plane[4] = { 0 };
+  EXPECT_EQ(E_UNEXPECTED,
+            presenter.PresentNV12(2, 2, plane, 2, plane, 2));
+}
+
+}  // namespace
@@ -0,0 +1,86 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "duplicateframe.h"
+#include "gtest/gtest.h"
+
+using webmdshow::DuplicateFrameDetector;
+using webmdshow::FindFirstDifference;
+
+namespace {
+
+std::vector<uint8_t> MakeFrame(size_t len) {
+  std::vector<uint8_t> frame(len);
+
+  for (size_t i = 0; i < len; ++i)
+    frame[i] = static_cast<uint8_t>(i * 13 + 5);
+
+  return frame;
+}
+
+TEST(DuplicateFrameTest, FindsEachPosition) {
+  // Covers the 64 and 16 byte steps and the tail.
+  const size_t len = 200;
+  const std::vector<uint8_t> a = MakeFrame(len);
+
+  EXPECT_EQ(len, FindFirstDifference(&a[0], &a[0], len));
+
+  for (size_t pos = 0; pos < len; ++pos) {
+    std::vector<uint8_t> b = a;
+    b[pos] ^= 1;
+
+    if (pos + 1 < len)
+      b[len - 1] ^= 1;  // a later difference must not be found first
+
+    EXPECT_EQ(pos, FindFirstDifference(&a[0], &b[0], len)) << pos;
+  }
+}
+
+TEST(DuplicateFrameTest, FirstFrameIsNotDuplicate) {
+  DuplicateFrameDetector d;
+  const std::vector<uint8_t> frame = MakeFrame(1000);
+
+  EXPECT_FALSE(d.IsDuplicate(&frame[0], frame.size()));
+  EXPECT_TRUE(d.IsDuplicate(&frame[0], frame.size()));
+  EXPECT_TRUE(d.IsDuplicate(&frame[0], frame.size()));
+}
+
+TEST(DuplicateFrameTest, RemembersChangedFrame) {
+  DuplicateFrameDetector d;
+  const std::vector<uint8_t> a = MakeFrame(1000);
+
+  std::vector<uint8_t> b = a;
+  b[700] ^= 0x80;
+
+  EXPECT_FALSE(d.IsDuplicate(&a[0], a.size()));
+  EXPECT_FALSE(d.IsDuplicate(&b[0], b.size()));
+  EXPECT_TRUE(d.IsDuplicate(&b[0], b.size()));
+  EXPECT_FALSE(d.IsDuplicate(&a[0], a.size()));
+}
+
+TEST(DuplicateFrameTest, SizeChangeIsNotDuplicate) {
+  DuplicateFrameDetector d;
+  const std::vector<uint8_t> frame = MakeFrame(1000);
+
+  EXPECT_FALSE(d.IsDuplicate(&frame[0], 1000));
+  EXPECT_FALSE(d.IsDuplicate(&frame[0], 999));
+  EXPECT_TRUE(d.IsDuplicate(&frame[0], 999));
+}
+
+TEST(DuplicateFrameTest, Reset) {
+  DuplicateFrameDetector d;
+  const std::vector<uint8_t> frame = MakeFrame(100);
+
+  EXPECT_FALSE(d.IsDuplicate(&frame[0], frame.size()));
+  d.Reset();
+  EXPECT_FALSE(d.IsDuplicate(&frame[0], frame.size()));
+}
+
+}  // namespace
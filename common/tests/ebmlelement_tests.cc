@@ -0,0 +1,90 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "ebmlelement.h"
+#include "webmconstants.h"
+
+using namespace WebmUtil;
+
+namespace {
+
+std::vector<uint8_t> Bytes(const uint8_t* begin, const uint8_t* end) {
+  return std::vector<uint8_t>(begin, end);
+}
+
+}  // namespace
+
+TEST(EbmlElement, IDSizes) {
+  EXPECT_EQ(1, EbmlIDSize<kEbmlTimeCodeID>::value);
+  EXPECT_EQ(2, EbmlIDSize<kEbmlCueBlockNumberID>::value);
+  EXPECT_EQ(3, EbmlIDSize<kEbmlTimeCodeScaleID>::value);
+  EXPECT_EQ(4, EbmlIDSize<kEbmlClusterID>::value);
+
+  EXPECT_EQ(7, (EbmlHeaderSize<kEbmlCueBlockNumberID, 4>::value));
+}
+
+TEST(EbmlElement, WritesIDs) {
+  uint8_t buf[16];
+  uint8_t* p = buf;
+
+  p = EbmlWriteID<kEbmlClusterID>(p);
+  p = EbmlWriteID<kEbmlTimeCodeScaleID>(p);
+  p = EbmlWriteID<kEbmlCueBlockNumberID>(p);
+  p = EbmlWriteID<kEbmlSimpleBlockID>(p);
+
+  const uint8_t expected[] = {
+    0x1F, 0x43, 0xB6, 0x75, 0x2A, 0xD7, 0xB1, 0x53, 0x78, 0xA3
+  };
+
+  EXPECT_EQ(Bytes(expected, expected + sizeof expected), Bytes(buf, p));
+}
+
+TEST(EbmlElement, WritesSizes) {
+  uint8_t buf[16];
+  uint8_t* p = buf;
+
+  p = EbmlWriteSize<1>(p, 5);
+  p = EbmlWriteSize<3>(p, 0x1234);
+  p = EbmlWriteUnknownSize<1>(p);
+  p = EbmlWriteUnknownSize<4>(p);
+
+  const uint8_t expected[] = {
+    0x85, 0x20, 0x12, 0x34, 0xFF, 0x1F, 0xFF, 0xFF, 0xFF
+  };
+
+  EXPECT_EQ(Bytes(expected, expected + sizeof expected), Bytes(buf, p));
+}
+
+TEST(EbmlElement, WritesUIntElements) {
+  uint8_t buf[32];
+  uint8_t* p = buf;
+
+  p = EbmlWriteUIntElement<kEbmlTimeCodeID, 2>(p, 0x1234);
+  p = EbmlWriteUIntElement<kEbmlCueClusterPositionID, 8>(p, 0x0102);
+  p = EbmlWriteUIntElement<kEbmlCueBlockNumberID>(p, 7, 1);
+
+  const uint8_t expected[] = {
+    0xE7, 0x82, 0x12, 0x34,
+    0xF1, 0x88, 0, 0, 0, 0, 0, 0, 0x01, 0x02,
+    0x53, 0x78, 0x81, 0x07
+  };
+
+  EXPECT_EQ(Bytes(expected, expected + sizeof expected), Bytes(buf, p));
+}
+
+TEST(EbmlElement, WritesHeaders) {
+  uint8_t buf[8];
+  uint8_t* const p = EbmlWriteHeader<kEbmlCuePointID, 34>(buf);
+
+  ASSERT_EQ(2, p - buf);
+  EXPECT_EQ(0xBB, buf[0]);
+  EXPECT_EQ(0xA2, buf[1]);
+}
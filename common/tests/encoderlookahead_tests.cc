@@ -0,0 +1,124 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "encoderlookahead.h"
+#include "gtest/gtest.h"
+
+using webmdshow::EncoderLookahead;
+using webmdshow::MemoryBudget;
+
+namespace {
+
+const int64_t kFrameBytes = 1000;
+
+EncoderLookahead::Demand MakeDemand(int64_t frame_bytes, int lag) {
+  const EncoderLookahead::Demand demand = { frame_bytes, lag };
+  return demand;
+}
+
+}  // namespace
+
+TEST(EncoderLookaheadTest, CutsTheLargestFirst) {
+  std::vector<EncoderLookahead::Demand> demands;
+  demands.push_back(MakeDemand(4 * kFrameBytes, 16));  // 4K
+  demands.push_back(MakeDemand(kFrameBytes, 16));      // 1080p
+
+  std::vector<int> lags;
+  lags.push_back(16);
+  lags.push_back(16);
+
+  const int64_t freed =
+      EncoderLookahead::Cut(40 * kFrameBytes, demands, &lags);
+
+  EXPECT_EQ(48 * kFrameBytes, freed);  // 12 frames of the 4K
+  EXPECT_EQ(4, lags[0]);
+  EXPECT_EQ(16, lags[1]);
+}
+
+TEST(EncoderLookaheadTest, StopsWhenNoLagIsLeft) {
+  std::vector<EncoderLookahead::Demand> demands;
+  demands.push_back(MakeDemand(kFrameBytes, 3));
+  demands.push_back(MakeDemand(kFrameBytes, 0));
+
+  std::vector<int> lags;
+  lags.push_back(3);
+  lags.push_back(0);
+
+  const int64_t freed =
+      EncoderLookahead::Cut(100 * kFrameBytes, demands, &lags);
+
+  EXPECT_EQ(3 * kFrameBytes, freed);
+  EXPECT_EQ(0, lags[0]);
+  EXPECT_EQ(0, lags[1]);
+}
+
+TEST(EncoderLookaheadTest, JoinsWithWhatFitsUnderTheHardLimit) {
+  MemoryBudget session(NULL);
+
+  MemoryBudget::Limits limits = { 0, 10 * kFrameBytes };
+  session.SetLimits(limits);
+
+  EncoderLookahead& lookahead = EncoderLookahead::Get();
+  lookahead.SetBudget(&session);
+
+  const int id = lookahead.Join(MakeDemand(kFrameBytes, 25));
+  EXPECT_NE(0, id);
+  EXPECT_EQ(6, lookahead.GetLag(id));  // 25, 12, 6
+
+  MemoryBudget::Stats stats;
+  session.GetStats(&stats);
+  EXPECT_EQ(6 * kFrameBytes, stats.bytes);
+
+  lookahead.Leave(id);
+  EXPECT_EQ(-1, lookahead.GetLag(id));
+
+  session.GetStats(&stats);
+  EXPECT_EQ(0, stats.bytes);
+
+  lookahead.SetBudget(MemoryBudget::GetProcess());
+}
+
+TEST(EncoderLookaheadTest, CutsLagsPastTheSoftLimit) {
+  MemoryBudget session(NULL);
+
+  MemoryBudget::Limits limits = { 20 * kFrameBytes, 0 };
+  session.SetLimits(limits);
+
+  EncoderLookahead& lookahead = EncoderLookahead::Get();
+  lookahead.SetBudget(&session);
+
+  const int count = lookahead.encoder_count();
+
+  const int first = lookahead.Join(MakeDemand(kFrameBytes, 16));
+  EXPECT_EQ(16, lookahead.GetLag(first));
+
+  const uint32_t generation = lookahead.GetGeneration();
+
+  // Past the soft limit, so the budget asks for 12 frames back.
+  const int second = lookahead.Join(MakeDemand(kFrameBytes, 16));
+  EXPECT_EQ(16, lookahead.GetLag(second));
+
+  lookahead.Service();
+  EXPECT_NE(generation, lookahead.GetGeneration());
+
+  const int lag = lookahead.GetLag(first) + lookahead.GetLag(second);
+  EXPECT_LE(lag, 20);
+  EXPECT_GE(lag, 8);
+
+  MemoryBudget::Stats stats;
+  session.GetStats(&stats);
+  EXPECT_EQ(lag * kFrameBytes, stats.bytes);
+
+  lookahead.Leave(first);
+  lookahead.Leave(second);
+  EXPECT_EQ(count, lookahead.encoder_count());
+
+  lookahead.SetBudget(MemoryBudget::GetProcess());
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "encoderthreadbudget.h"
+#include "gtest/gtest.h"
+
+using webmdshow::EncoderThreadBudget;
+
+namespace {
+
+EncoderThreadBudget::Demand MakeDemand(int width, int height,
+                                       bool realtime) {
+  const EncoderThreadBudget::Demand demand = { width, height, realtime };
+  return demand;
+}
+
+}  // namespace
+
+TEST(EncoderThreadBudgetTest, SharesInProportionToPixels) {
+  std::vector<EncoderThreadBudget::Demand> demands;
+  demands.push_back(MakeDemand(1920, 1080, false));
+  demands.push_back(MakeDemand(960, 540, false));
+
+  std::vector<EncoderThreadBudget::Grant> grants;
+  EncoderThreadBudget::Allocate(10, demands, &grants);
+
+  ASSERT_EQ(2u, grants.size());
+  EXPECT_EQ(8, grants[0].threads);
+  EXPECT_EQ(2, grants[1].threads);
+}
+
+TEST(EncoderThreadBudgetTest, RealtimeCountsDouble) {
+  std::vector<EncoderThreadBudget::Demand> demands;
+  demands.push_back(MakeDemand(1280, 720, false));
+  demands.push_back(MakeDemand(1280, 720, true));
+
+  std::vector<EncoderThreadBudget::Grant> grants;
+  EncoderThreadBudget::Allocate(6, demands, &grants);
+
+  ASSERT_EQ(2u, grants.size());
+  EXPECT_EQ(2, grants[0].threads);
+  EXPECT_EQ(4, grants[1].threads);
+}
+
+TEST(EncoderThreadBudgetTest, EveryEncoderGetsAThread) {
+  std::vector<EncoderThreadBudget::Demand> demands;
+
+  for (int i = 0; i < 8; ++i)
+    demands.push_back(MakeDemand(1920, 1080, false));
+
+  std::vector<EncoderThreadBudget::Grant> grants;
+  EncoderThreadBudget::Allocate(4, demands, &grants);
+
+  ASSERT_EQ(8u, grants.size());
+
+  for (size_t i = 0; i < grants.size(); ++i) {
+    EXPECT_EQ(1, grants[i].threads);
+    EXPECT_EQ(0, grants[i].token_partitions);
+  }
+}
+
+TEST(EncoderThreadBudgetTest, NoMoreThanTheFrameCanUse) {
+  std::vector<EncoderThreadBudget::Demand> demands;
+  demands.push_back(MakeDemand(320, 180, false));  // 2 threads' rows
+  demands.push_back(MakeDemand(3840, 2160, false));
+
+  std::vector<EncoderThreadBudget::Grant> grants;
+  EncoderThreadBudget::Allocate(64, demands, &grants);
+
+  ASSERT_EQ(2u, grants.size());
+  EXPECT_EQ(2, grants[0].threads);
+  EXPECT_EQ(EncoderThreadBudget::kMaxThreadsPerEncoder, grants[1].threads);
+}
+
+TEST(EncoderThreadBudgetTest, TokenPartitionsFollowThreads) {
+  const int threads[] = { 1, 2, 3, 4, 7, 8, 16 };
+  const int partitions[] = { 0, 1, 1, 2, 2, 3, 3 };
+
+  for (int i = 0; i < 7; ++i) {
+    std::vector<EncoderThreadBudget::Demand> demands;
+    demands.push_back(MakeDemand(3840, 2160, false));
+
+    std::vector<EncoderThreadBudget::Grant> grants;
+    EncoderThreadBudget::Allocate(threads[i], demands, &grants);
+
+    ASSERT_EQ(1u, grants.size());
+    EXPECT_EQ(threads[i], grants[0].threads);
+    EXPECT_EQ(partitions[i], grants[0].token_partitions);
+  }
+}
+
+TEST(EncoderThreadBudgetTest, RebalancesAsEncodersComeAndGo) {
+  EncoderThreadBudget& budget = EncoderThreadBudget::Get();
+  budget.SetLimit(8);
+
+  const int count = budget.encoder_count();
+  uint32_t generation = budget.GetGeneration();
+
+  const int first = budget.Join(MakeDemand(1920, 1080, false));
+  EXPECT_NE(0, first);
+  EXPECT_NE(generation, budget.GetGeneration());
+
+  EncoderThreadBudget::Grant grant;
+  ASSERT_TRUE(budget.GetGrant(first, &grant));
+  const int alone = grant.threads;
+
+  generation = budget.GetGeneration();
+  const int second = budget.Join(MakeDemand(1920, 1080, false));
+  EXPECT_NE(first, second);
+  EXPECT_NE(generation, budget.GetGeneration());
+
+  ASSERT_TRUE(budget.GetGrant(first, &grant));
+  EXPECT_LT(grant.threads, alone);
+
+  budget.Leave(second);
+  EXPECT_FALSE(budget.GetGrant(second, &grant));
+
+  ASSERT_TRUE(budget.GetGrant(first, &grant));
+  EXPECT_EQ(alone, grant.threads);
+
+  budget.Leave(first);
+  EXPECT_EQ(count, budget.encoder_count());
+
+  budget.SetLimit(0);
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "framepool.h"
+#include "gtest/gtest.h"
+
+using webmdshow::FramePool;
+
+TEST(FramePool, Capacities) {
+  EXPECT_EQ(4096u, FramePool::GetCapacity(0));
+  EXPECT_EQ(4096u, FramePool::GetCapacity(4096));
+  EXPECT_EQ(8192u, FramePool::GetCapacity(4097));
+  EXPECT_EQ(1u << 20, FramePool::GetCapacity(1000000));
+}
+
+TEST(FramePool, ReusesWithinAClass) {
+  FramePool pool;
+
+  size_t capacity;
+  uint8_t* const a = pool.Acquire(5000, &capacity);
+  ASSERT_TRUE(a != NULL);
+  EXPECT_EQ(8192u, capacity);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(a) % FramePool::kAlignment);
+
+  pool.Release(a, capacity);
+
+  // Any size of the same class gets the same buffer back.
+  uint8_t* const b = pool.Acquire(7000, &capacity);
+  EXPECT_EQ(a, b);
+  pool.Release(b, capacity);
+
+  FramePool::Stats stats;
+  pool.GetStats(&stats);
+  EXPECT_EQ(1, stats.allocations);
+  EXPECT_EQ(1, stats.reuses);
+  EXPECT_EQ(8192, stats.bytes_resident);
+}
+
+TEST(FramePool, TrimsAfterABurst) {
+  FramePool pool;
+
+  // A burst of 32 buffers in use at once...
+  std::vector<uint8_t*> burst;
+  size_t capacity;
+
+  for (int i = 0; i < 32; ++i)
+    burst.push_back(pool.Acquire(100000, &capacity));
+
+  for (size_t i = 0; i < burst.size(); ++i)
+    pool.Release(burst[i], capacity);
+
+  FramePool::Stats stats;
+  pool.GetStats(&stats);
+  EXPECT_EQ(32 * static_cast<int64_t>(capacity), stats.bytes_resident);
+
+  // ...then a long run of one at a time: the pool falls back to one.
+  for (int i = 0; i < 1000; ++i) {
+    uint8_t* const p = pool.Acquire(100000, &capacity);
+    ASSERT_TRUE(p != NULL);
+    pool.Release(p, capacity);
+  }
+
+  pool.GetStats(&stats);
+  EXPECT_EQ(static_cast<int64_t>(capacity), stats.bytes_resident);
+  EXPECT_EQ(32, stats.allocations);
+}
+
+TEST(FramePool, KeepsToItsBudget) {
+  webmdshow::MemoryBudget session(NULL);
+
+  webmdshow::MemoryBudget::Limits limits;
+  limits.soft = 0;
+  limits.hard = 3 * 8192;
+  session.SetLimits(limits);
+
+  FramePool pool;
+  pool.SetBudget(&session);
+
+  size_t capacity;
+  uint8_t* const a = pool.Acquire(8192, &capacity);
+  uint8_t* const b = pool.Acquire(8192, &capacity);
+  uint8_t* const c = pool.Acquire(8000, &capacity);
+
+  ASSERT_TRUE(a != NULL);
+  ASSERT_TRUE(b != NULL);
+  ASSERT_TRUE(c != NULL);
+
+  // Out of budget, and nothing free to give back.
+  EXPECT_TRUE(pool.Acquire(5000, &capacity) == NULL);
+
+  // The free 8 KB buffer is given back to make room for a 4 KB one.
+  pool.Release(b, 8192);
+  uint8_t* const d = pool.Acquire(4000, &capacity);
+  ASSERT_TRUE(d != NULL);
+
+  FramePool::Stats stats;
+  pool.GetStats(&stats);
+  EXPECT_EQ(8192 + 8192 + 4096, stats.bytes_resident);
+
+  pool.Release(a, 8192);
+  pool.Release(c, 8192);
+  pool.Release(d, 4096);
+}
@@ -0,0 +1,185 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "colorconverter.h"
+#include "gpucolorconverter.h"
+#include "gtest/gtest.h"
+
+using webmdshow::ColorConverter;
+using webmdshow::GpuColorConverter;
+
+namespace {
+
+const int kWidth = 64;
+const int kHeight = 48;
+
+// An I420 frame with a luma ramp across it and one colour of chroma.
+std::vector<uint8_t> MakeI420(int width, int height, uint8_t u, uint8_t v) {
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatI420,
+                                               width);
+  std::vector<uint8_t> frame(ColorConverter::GetFrameSize(
+      webmdshow::kColorFormatI420, stride, height));
+
+  for (int row = 0; row < height; ++row) {
+    for (int x = 0; x < width; ++x)
+      frame[row * stride + x] = static_cast<uint8_t>(16 + x * 219 / width);
+  }
+
+  const int chroma = ((stride + 1) / 2) * ((height + 1) / 2);
+  std::fill(frame.begin() + stride * height,
+            frame.begin() + stride * height + chroma, u);
+  std::fill(frame.begin() + stride * height + chroma, frame.end(), v);
+
+  return frame;
+}
+
+// Initializes |gpu| for frames of the same size, or returns false if the
+// machine has no adapter it can use.
+bool InitSameSize(GpuColorConverter* gpu, webmdshow::ColorFormat format,
+                  int stride) {
+  return gpu->Init(webmdshow::kColorFormatI420, kWidth, kWidth, kHeight,
+                   format, stride, kWidth, kHeight);
+}
+
+}  // namespace
+
+TEST(GpuColorConverter, Support) {
+  EXPECT_TRUE(GpuColorConverter::IsSupported(webmdshow::kColorFormatI420,
+                                             webmdshow::kColorFormatRGB32));
+  EXPECT_TRUE(GpuColorConverter::IsSupported(webmdshow::kColorFormatNV12,
+                                             webmdshow::kColorFormatRGB24));
+  EXPECT_FALSE(GpuColorConverter::IsSupported(webmdshow::kColorFormatYUY2,
+                                              webmdshow::kColorFormatRGB32));
+  EXPECT_FALSE(GpuColorConverter::IsSupported(webmdshow::kColorFormatI420,
+                                              webmdshow::kColorFormatNV12));
+
+  // RGB24 rows must be stored in whole words.
+  GpuColorConverter gpu;
+  EXPECT_FALSE(gpu.Init(webmdshow::kColorFormatI420, 8, 6, 4,
+                        webmdshow::kColorFormatRGB24, 22, 6, 4));
+  EXPECT_FALSE(gpu.Init(webmdshow::kColorFormatI420, 0, 0, 4,
+                        webmdshow::kColorFormatRGB32, 0, 0, 4));
+}
+
+TEST(GpuColorConverter, MatchesColorConverter) {
+  const std::vector<uint8_t> src = MakeI420(kWidth, kHeight, 90, 200);
+
+  const webmdshow::ColorFormat formats[] = {
+    webmdshow::kColorFormatRGB32,
+    webmdshow::kColorFormatRGB24,
+  };
+
+  for (int i = 0; i < 2; ++i) {
+    const webmdshow::ColorFormat format = formats[i];
+
+    // Bottom-up, as a DIB.
+    const int stride = -ColorConverter::GetStride(format, kWidth);
+    const int size = ColorConverter::GetFrameSize(format, stride, kHeight);
+
+    ColorConverter cpu;
+    ASSERT_TRUE(cpu.Init(webmdshow::kColorFormatI420, kWidth, format,
+                         stride, kWidth, kHeight));
+
+    std::vector<uint8_t> expected(size);
+    ASSERT_TRUE(cpu.Convert(&src[0], &expected[0]));
+
+    GpuColorConverter gpu;
+
+    if (!InitSameSize(&gpu, format, stride))
+      return;  // No adapter that can run the shader.
+
+    ASSERT_TRUE(gpu.Submit(&src[0]));
+    EXPECT_EQ(1, gpu.pending());
+
+    std::vector<uint8_t> actual(size);
+    ASSERT_TRUE(gpu.Retrieve(&actual[0]));
+    EXPECT_EQ(0, gpu.pending());
+
+    // Only the rows' visible bytes, not their padding.
+    const int row_bytes = (format == webmdshow::kColorFormatRGB24) ?
+                          3 * kWidth : 4 * kWidth;
+
+    for (int row = 0; row < kHeight; ++row) {
+      for (int x = 0; x < row_bytes; ++x) {
+        const int offset = row * abs(stride) + x;
+        ASSERT_NEAR(expected[offset], actual[offset], 2)
+            << "format " << format << " row " << row << " byte " << x;
+      }
+    }
+  }
+}
+
+TEST(GpuColorConverter, ReturnsFramesInOrder) {
+  GpuColorConverter gpu;
+
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatRGB32,
+                                               kWidth);
+
+  if (!InitSameSize(&gpu, webmdshow::kColorFormatRGB32, stride))
+    return;
+
+  std::vector<std::vector<uint8_t> > frames;
+
+  for (int i = 0; i < GpuColorConverter::kSlots; ++i) {
+    frames.push_back(MakeI420(kWidth, kHeight, 128, 128));
+    frames.back()[0] = static_cast<uint8_t>(16 + 100 * i);
+
+    ASSERT_TRUE(gpu.Submit(&frames.back()[0]));
+  }
+
+  EXPECT_EQ(GpuColorConverter::kSlots, gpu.pending());
+
+  std::vector<uint8_t> out(stride * kHeight);
+  int last = -1;
+
+  for (int i = 0; i < GpuColorConverter::kSlots; ++i) {
+    ASSERT_TRUE(gpu.Retrieve(&out[0]));
+    EXPECT_GT(out[0], last);  // the blue of the first pixel
+    last = out[0];
+  }
+
+  gpu.Submit(&frames[0][0]);
+  gpu.Discard();
+  EXPECT_EQ(0, gpu.pending());
+}
+
+TEST(GpuColorConverter, Scales) {
+  std::vector<uint8_t> src = MakeI420(kWidth, kHeight, 128, 128);
+
+  // Black on the left, white on the right.
+  for (int row = 0; row < kHeight; ++row) {
+    for (int x = 0; x < kWidth; ++x)
+      src[row * kWidth + x] = (x < kWidth / 2) ? 16 : 235;
+  }
+
+  const int w = kWidth / 2;
+  const int h = kHeight / 3;
+  const int stride = ColorConverter::GetStride(webmdshow::kColorFormatRGB32,
+                                               w);
+
+  GpuColorConverter gpu;
+
+  if (!gpu.Init(webmdshow::kColorFormatI420, kWidth, kWidth, kHeight,
+                webmdshow::kColorFormatRGB32, stride, w, h)) {
+    return;
+  }
+
+  ASSERT_TRUE(gpu.Submit(&src[0]));
+
+  std::vector<uint8_t> out(stride * h);
+  ASSERT_TRUE(gpu.Retrieve(&out[0]));
+
+  for (int row = 0; row < h; ++row) {
+    EXPECT_NEAR(0, out[row * stride], 2);
+    EXPECT_NEAR(255, out[row * stride + 4 * (w - 1)], 2);
+  }
+}
@@ -0,0 +1,235 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "highbitdepth.h"
+#include "vpx/vpx_image.h"
+
+namespace {
+
+// Odd sizes, so that the rows have tails past the eight-pixel kernels.
+const int kWidth = 37;
+const int kHeight = 21;
+
+const int kBayer[4][4] = {
+  { 0, 8, 2, 10 },
+  { 12, 4, 14, 6 },
+  { 3, 11, 1, 9 },
+  { 15, 7, 13, 5 },
+};
+
+uint16_t* Sample16(const vpx_image_t* f, int plane, int x, int y) {
+  return reinterpret_cast<uint16_t*>(f->planes[plane] +
+                                     y * f->stride[plane]) + x;
+}
+
+// A frame of random samples of |bit_depth| bits, or one of |value| if it
+// isn't negative.
+vpx_image_t* MakeFrame(int bit_depth, int value) {
+  vpx_image_t* const f =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I42016, kWidth, kHeight, 16);
+
+  if (f == NULL)
+    return NULL;
+
+  f->bit_depth = bit_depth;
+
+  const int max = (1 << bit_depth) - 1;
+
+  for (int plane = 0; plane < 3; ++plane) {
+    const int w = (plane == VPX_PLANE_Y) ? kWidth : (kWidth + 1) / 2;
+    const int h = (plane == VPX_PLANE_Y) ? kHeight : (kHeight + 1) / 2;
+
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        const int s = (value >= 0) ? value : rand() & max;
+        *Sample16(f, plane, x, y) = static_cast<uint16_t>(s);
+      }
+    }
+  }
+
+  return f;
+}
+
+int ScalarDither(int s, int x, int y, int bit_depth) {
+  const int shift = bit_depth - 8;
+  const int d = (s + ((kBayer[y & 3][x & 3] << shift) >> 4)) >> shift;
+  return (d > 255) ? 255 : d;
+}
+
+TEST(HighBitDepthTest, P010MatchesScalar) {
+  for (int bit_depth = 10; bit_depth <= 12; bit_depth += 2) {
+    vpx_image_t* const f = MakeFrame(bit_depth, -1);
+    ASSERT_TRUE(f != NULL);
+
+    const int stride = 2 * (kWidth + 1);
+    const int uv_h = (kHeight + 1) / 2;
+    std::vector<uint8_t> buf(stride * (kHeight + uv_h));
+
+    uint8_t* const y_plane = &buf[0];
+    uint8_t* const uv_plane = y_plane + stride * kHeight;
+
+    ASSERT_TRUE(webmdshow::VpxImageToP010(f, y_plane, stride,
+                                          uv_plane, stride));
+
+    const int shift = 16 - bit_depth;
+
+    for (int y = 0; y < kHeight; ++y) {
+      const uint16_t* const row =
+          reinterpret_cast<const uint16_t*>(y_plane + y * stride);
+
+      for (int x = 0; x < kWidth; ++x)
+        ASSERT_EQ(*Sample16(f, VPX_PLANE_Y, x, y) << shift, row[x]);
+    }
+
+    for (int y = 0; y < uv_h; ++y) {
+      const uint16_t* const row =
+          reinterpret_cast<const uint16_t*>(uv_plane + y * stride);
+
+      for (int x = 0; x < (kWidth + 1) / 2; ++x) {
+        ASSERT_EQ(*Sample16(f, VPX_PLANE_U, x, y) << shift, row[2 * x]);
+        ASSERT_EQ(*Sample16(f, VPX_PLANE_V, x, y) << shift, row[2 * x + 1]);
+      }
+    }
+
+    vpx_img_free(f);
+  }
+}
+
+TEST(HighBitDepthTest, P010Widens8Bit) {
+  vpx_image_t* const f =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I420, kWidth, kHeight, 16);
+  ASSERT_TRUE(f != NULL);
+
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x)
+      f->planes[VPX_PLANE_Y][y * f->stride[VPX_PLANE_Y] + x] =
+          static_cast<uint8_t>(rand());
+  }
+
+  const int stride = 2 * (kWidth + 1);
+  std::vector<uint8_t> buf(stride * (kHeight + (kHeight + 1) / 2));
+
+  ASSERT_TRUE(webmdshow::VpxImageToP010(f, &buf[0], stride,
+                                        &buf[stride * kHeight], stride));
+
+  for (int y = 0; y < kHeight; ++y) {
+    const uint16_t* const row =
+        reinterpret_cast<const uint16_t*>(&buf[y * stride]);
+
+    for (int x = 0; x < kWidth; ++x) {
+      const int s = f->planes[VPX_PLANE_Y][y * f->stride[VPX_PLANE_Y] + x];
+      ASSERT_EQ(s << 8, row[x]);
+    }
+  }
+
+  vpx_img_free(f);
+}
+
+TEST(HighBitDepthTest, DitherMatchesScalar) {
+  for (int bit_depth = 10; bit_depth <= 12; bit_depth += 2) {
+    vpx_image_t* const f = MakeFrame(bit_depth, -1);
+    ASSERT_TRUE(f != NULL);
+
+    const int stride = kWidth + 1;
+    const int uv_w = (kWidth + 1) / 2;
+    const int uv_h = (kHeight + 1) / 2;
+
+    std::vector<uint8_t> y_plane(stride * kHeight);
+    std::vector<uint8_t> u_plane(stride * uv_h);
+    std::vector<uint8_t> v_plane(stride * uv_h);
+    std::vector<uint8_t> y_nv12(stride * kHeight);
+    std::vector<uint8_t> uv_nv12(stride * uv_h);
+
+    ASSERT_TRUE(webmdshow::DitherVpxImageToI420(f,
+                                                &y_plane[0], stride,
+                                                &u_plane[0], stride,
+                                                &v_plane[0], stride));
+
+    ASSERT_TRUE(webmdshow::DitherVpxImageToNV12(f,
+                                                &y_nv12[0], stride,
+                                                &uv_nv12[0], stride));
+
+    for (int y = 0; y < kHeight; ++y) {
+      for (int x = 0; x < kWidth; ++x) {
+        const int s = *Sample16(f, VPX_PLANE_Y, x, y);
+        ASSERT_EQ(ScalarDither(s, x, y, bit_depth), y_plane[y * stride + x]);
+        ASSERT_EQ(y_plane[y * stride + x], y_nv12[y * stride + x]);
+      }
+    }
+
+    for (int y = 0; y < uv_h; ++y) {
+      for (int x = 0; x < uv_w; ++x) {
+        const int u = ScalarDither(*Sample16(f, VPX_PLANE_U, x, y), x, y,
+                                   bit_depth);
+        const int v = ScalarDither(*Sample16(f, VPX_PLANE_V, x, y), x, y,
+                                   bit_depth);
+
+        ASSERT_EQ(u, u_plane[y * stride + x]);
+        ASSERT_EQ(v, v_plane[y * stride + x]);
+        ASSERT_EQ(u, uv_nv12[y * stride + 2 * x]);
+        ASSERT_EQ(v, uv_nv12[y * stride + 2 * x + 1]);
+      }
+    }
+
+    vpx_img_free(f);
+  }
+}
+
+// The point of the dither: a flat 10-bit level between two 8-bit ones
+// comes out at the right level on average, where truncation would lose it.
+TEST(HighBitDepthTest, DitherKeepsLevel) {
+  const int level = 4 * 100 + 1;  // 100.25 in 8 bits
+  vpx_image_t* const f = MakeFrame(10, level);
+  ASSERT_TRUE(f != NULL);
+
+  vpx_image_t* target = NULL;
+  ASSERT_TRUE(webmdshow::DitherVpxImage(f, &target));
+  ASSERT_TRUE(target != NULL);
+  EXPECT_EQ(VPX_IMG_FMT_I420, target->fmt);
+
+  // Whole 4x4 tiles only, over which the dither is exact.
+  const int w = kWidth & ~3;
+  const int h = kHeight & ~3;
+  int sum = 0;
+
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x)
+      sum += target->planes[VPX_PLANE_Y][y * target->stride[VPX_PLANE_Y] + x];
+  }
+
+  EXPECT_EQ(100 * w * h + w * h / 4, sum);
+
+  // The target is reused for frames of the same size.
+  const vpx_image_t* const first = target;
+  ASSERT_TRUE(webmdshow::DitherVpxImage(f, &target));
+  EXPECT_EQ(first, target);
+
+  vpx_img_free(target);
+  vpx_img_free(f);
+}
+
+TEST(HighBitDepthTest, RejectsOtherFormats) {
+  vpx_image_t* const f =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I420, kWidth, kHeight, 16);
+  ASSERT_TRUE(f != NULL);
+
+  EXPECT_FALSE(webmdshow::IsHighBitDepthI420(f));
+
+  vpx_image_t* const f16 = MakeFrame(10, 0);
+  ASSERT_TRUE(f16 != NULL);
+  EXPECT_TRUE(webmdshow::IsHighBitDepthI420(f16));
+
+  vpx_img_free(f16);
+  vpx_img_free(f);
+}
+
+}  // namespace
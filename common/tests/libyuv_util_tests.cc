@@ -0,0 +1,501 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "libyuv_util.h"
+#include "vpx/vpx_image.h"
+
+using webmdshow::PackedYuvFormat;
+
+namespace {
+
+// The per-byte loops the decoders used before switching to libyuv. They
+// define the expected output, and are the baseline for the speed test.
+
+void ScalarI420ToNV12(const vpx_image_t* f, uint8_t* dst, int stride) {
+  const uint8_t* src_y = f->planes[VPX_PLANE_Y];
+
+  for (unsigned int y = 0; y < f->d_h; ++y) {
+    memcpy(dst, src_y, f->d_w);
+    src_y += f->stride[VPX_PLANE_Y];
+    dst += stride;
+  }
+
+  const uint8_t* src_u = f->planes[VPX_PLANE_U];
+  const uint8_t* src_v = f->planes[VPX_PLANE_V];
+
+  const unsigned int uv_w = (f->d_w + 1) / 2;
+  const unsigned int uv_h = (f->d_h + 1) / 2;
+
+  for (unsigned int y = 0; y < uv_h; ++y) {
+    const uint8_t* u = src_u;
+    const uint8_t* v = src_v;
+    uint8_t* uv = dst;
+
+    for (unsigned int x = 0; x < uv_w; ++x) {
+      *uv++ = *u++;
+      *uv++ = *v++;
+    }
+
+    src_u += f->stride[VPX_PLANE_U];
+    src_v += f->stride[VPX_PLANE_V];
+    dst += stride;
+  }
+}
+
+void ScalarI420ToPacked(const vpx_image_t* f, PackedYuvFormat format,
+                        uint8_t* dst, int stride) {
+  int u_off, v_off, y_off;
+
+  if (format == webmdshow::kPackedYuvUYVY) {
+    u_off = 0;
+    v_off = 2;
+    y_off = 1;
+  } else if (format == webmdshow::kPackedYuvYUY2) {
+    u_off = 1;
+    v_off = 3;
+    y_off = 0;
+  } else {
+    u_off = 3;
+    v_off = 1;
+    y_off = 0;
+  }
+
+  for (unsigned int y = 0; y < f->d_h; ++y) {
+    const uint8_t* src_y = f->planes[VPX_PLANE_Y] + y * f->stride[VPX_PLANE_Y];
+    const uint8_t* src_u =
+        f->planes[VPX_PLANE_U] + (y / 2) * f->stride[VPX_PLANE_U];
+    const uint8_t* src_v =
+        f->planes[VPX_PLANE_V] + (y / 2) * f->stride[VPX_PLANE_V];
+
+    uint8_t* const row = dst + y * stride;
+
+    for (unsigned int x = 0; x < f->d_w / 2; ++x) {
+      uint8_t* const out = row + 4 * x;
+
+      out[u_off] = src_u[x];
+      out[v_off] = src_v[x];
+      out[y_off] = src_y[2 * x];
+      out[y_off + 2] = src_y[2 * x + 1];
+    }
+  }
+}
+
+// YUY2 to I420 as the encoder did it, but rounding the chroma average the
+// way libyuv does, and using the last row alone when the height is odd.
+void ScalarYUY2ToI420(const uint8_t* src, int stride, unsigned int width,
+                      unsigned int height, vpx_image_t* f) {
+  for (unsigned int y = 0; y < height; ++y) {
+    const uint8_t* const row = src + y * stride;
+    uint8_t* const dst_y = f->planes[VPX_PLANE_Y] + y * f->stride[VPX_PLANE_Y];
+
+    for (unsigned int x = 0; x < width; ++x)
+      dst_y[x] = row[2 * x];
+  }
+
+  for (unsigned int y = 0; y < (height + 1) / 2; ++y) {
+    const uint8_t* const row0 = src + 2 * y * stride;
+    const uint8_t* const row1 = (2 * y + 1 < height) ? row0 + stride : row0;
+
+    uint8_t* const dst_u = f->planes[VPX_PLANE_U] + y * f->stride[VPX_PLANE_U];
+    uint8_t* const dst_v = f->planes[VPX_PLANE_V] + y * f->stride[VPX_PLANE_V];
+
+    for (unsigned int x = 0; x < (width + 1) / 2; ++x) {
+      const int u = row0[4 * x + 1] + row1[4 * x + 1];
+      const int v = row0[4 * x + 3] + row1[4 * x + 3];
+
+      dst_u[x] = static_cast<uint8_t>((u + 1) / 2);
+      dst_v[x] = static_cast<uint8_t>((v + 1) / 2);
+    }
+  }
+}
+
+bool SameVisiblePlanes(const vpx_image_t* a, const vpx_image_t* b) {
+  for (int plane = VPX_PLANE_Y; plane <= VPX_PLANE_V; ++plane) {
+    const unsigned int w = (plane == VPX_PLANE_Y) ? a->d_w : (a->d_w + 1) / 2;
+    const unsigned int h = (plane == VPX_PLANE_Y) ? a->d_h : (a->d_h + 1) / 2;
+
+    for (unsigned int y = 0; y < h; ++y) {
+      if (memcmp(a->planes[plane] + y * a->stride[plane],
+                 b->planes[plane] + y * b->stride[plane], w) != 0)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+vpx_image_t* CreateTestImage(unsigned int width, unsigned int height) {
+  vpx_image_t* const img =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width, height, 16);
+
+  if (img == NULL)
+    return NULL;
+
+  srand(width * 65537 + height);
+
+  for (int plane = VPX_PLANE_Y; plane <= VPX_PLANE_V; ++plane) {
+    const unsigned int w = (plane == VPX_PLANE_Y) ? width : (width + 1) / 2;
+    const unsigned int h = (plane == VPX_PLANE_Y) ? height : (height + 1) / 2;
+
+    for (unsigned int y = 0; y < h; ++y) {
+      uint8_t* const row = img->planes[plane] + y * img->stride[plane];
+
+      for (unsigned int x = 0; x < w; ++x)
+        row[x] = static_cast<uint8_t>(rand());
+    }
+  }
+
+  return img;
+}
+
+double GetSeconds() {
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return double(count.QuadPart) / double(freq.QuadPart);
+}
+
+}  // namespace
+
+TEST(LibyuvUtil, I420ToNV12MatchesScalar) {
+  const unsigned int sizes[][2] = {{2, 2}, {64, 48}, {33, 17}, {1920, 1080}};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const unsigned int w = sizes[i][0];
+    const unsigned int h = sizes[i][1];
+
+    vpx_image_t* const img = CreateTestImage(w, h);
+    ASSERT_TRUE(img != NULL);
+
+    const int stride = (w + 31) & ~31;
+    const size_t size = stride * (h + (h + 1) / 2);
+
+    std::vector<uint8_t> expected(size, 0);
+    std::vector<uint8_t> actual(size, 0);
+
+    ScalarI420ToNV12(img, &expected[0], stride);
+    ASSERT_TRUE(webmdshow::LibyuvI420ToNV12(img, &actual[0], stride,
+                                            &actual[0] + stride * h, stride));
+
+    EXPECT_TRUE(expected == actual) << w << "x" << h;
+
+    vpx_img_free(img);
+  }
+}
+
+TEST(LibyuvUtil, NV12ChromaToI420RoundTrips) {
+  const unsigned int sizes[][2] = {{2, 2}, {64, 48}, {33, 17}, {1920, 1080}};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const unsigned int w = sizes[i][0];
+    const unsigned int h = sizes[i][1];
+
+    vpx_image_t* const img = CreateTestImage(w, h);
+    ASSERT_TRUE(img != NULL);
+
+    const int stride = (w + 31) & ~31;
+    std::vector<uint8_t> nv12(stride * (h + (h + 1) / 2), 0);
+    uint8_t* const uv = &nv12[0] + stride * h;
+
+    ASSERT_TRUE(webmdshow::LibyuvI420ToNV12(img, &nv12[0], stride,
+                                            uv, stride));
+
+    vpx_image_t* const out = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, w, h, 16);
+    ASSERT_TRUE(out != NULL);
+
+    ASSERT_TRUE(webmdshow::LibyuvNV12ChromaToI420(uv, stride, w, h, out));
+
+    const unsigned int uv_w = (w + 1) / 2;
+    const unsigned int uv_h = (h + 1) / 2;
+
+    for (unsigned int y = 0; y < uv_h; ++y) {
+      for (int p = VPX_PLANE_U; p <= VPX_PLANE_V; ++p) {
+        const uint8_t* const src = img->planes[p] + y * img->stride[p];
+        const uint8_t* const dst = out->planes[p] + y * out->stride[p];
+        ASSERT_EQ(0, memcmp(src, dst, uv_w))
+            << w << "x" << h << " plane " << p << " row " << y;
+      }
+    }
+
+    vpx_img_free(out);
+    vpx_img_free(img);
+  }
+}
+
+TEST(LibyuvUtil, I420ToPackedMatchesScalar) {
+  const PackedYuvFormat formats[] = {webmdshow::kPackedYuvYUY2,
+                                     webmdshow::kPackedYuvUYVY,
+                                     webmdshow::kPackedYuvYVYU};
+
+  const unsigned int sizes[][2] = {{2, 2}, {64, 48}, {32, 17}, {1920, 1080}};
+
+  for (size_t j = 0; j < sizeof(formats) / sizeof(formats[0]); ++j) {
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+      const unsigned int w = sizes[i][0];
+      const unsigned int h = sizes[i][1];
+
+      vpx_image_t* const img = CreateTestImage(w, h);
+      ASSERT_TRUE(img != NULL);
+
+      const int stride = 2 * w;
+      const size_t size = stride * h;
+
+      std::vector<uint8_t> expected(size, 0);
+      std::vector<uint8_t> actual(size, 0);
+
+      ScalarI420ToPacked(img, formats[j], &expected[0], stride);
+      ASSERT_TRUE(webmdshow::LibyuvI420ToPacked(img, formats[j], &actual[0],
+                                                stride));
+
+      EXPECT_TRUE(expected == actual) << "format " << formats[j] << " "
+                                      << w << "x" << h;
+
+      vpx_img_free(img);
+    }
+  }
+}
+
+TEST(LibyuvUtil, YUY2ToI420MatchesScalar) {
+  const unsigned int sizes[][2] = {{2, 2}, {64, 48}, {33, 17}, {1920, 1080}};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const unsigned int w = sizes[i][0];
+    const unsigned int h = sizes[i][1];
+
+    // A DIB stride, with the last pair of an odd width filled in.
+    const int stride = (4 * ((w + 1) / 2) + 3) & ~3;
+
+    std::vector<uint8_t> src(stride * h);
+    srand(w * 65537 + h);
+
+    for (size_t j = 0; j < src.size(); ++j)
+      src[j] = static_cast<uint8_t>(rand());
+
+    vpx_image_t* const expected =
+        vpx_img_alloc(NULL, VPX_IMG_FMT_I420, w, h, 16);
+    ASSERT_TRUE(expected != NULL);
+
+    vpx_image_t* const actual = vpx_img_alloc(NULL, VPX_IMG_FMT_YV12, w, h, 16);
+    ASSERT_TRUE(actual != NULL);
+
+    ScalarYUY2ToI420(&src[0], stride, w, h, expected);
+    ASSERT_TRUE(webmdshow::LibyuvPackedToI420(
+        &src[0], stride, webmdshow::kPackedYuvYUY2, w, h, actual));
+
+    EXPECT_TRUE(SameVisiblePlanes(expected, actual)) << w << "x" << h;
+
+    vpx_img_free(actual);
+    vpx_img_free(expected);
+  }
+}
+
+TEST(LibyuvUtil, RgbToI420FlipsBottomUpRows) {
+  const int w = 17;
+  const int h = 9;
+  const int stride = (3 * w + 3) & ~3;
+
+  // Black on top, white below, stored bottom-up.
+  std::vector<uint8_t> src(stride * h, 0);
+
+  for (int y = 0; y < h / 2; ++y)
+    memset(&src[y * stride], 255, 3 * w);
+
+  vpx_image_t* const img = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, w, h, 16);
+  ASSERT_TRUE(img != NULL);
+
+  ASSERT_TRUE(webmdshow::LibyuvRgbToI420(&src[0], stride,
+                                         webmdshow::kRgbFormatRGB24, w, -h,
+                                         img));
+
+  const uint8_t* const top = img->planes[VPX_PLANE_Y];
+  const uint8_t* const bottom =
+      img->planes[VPX_PLANE_Y] + (h - 1) * img->stride[VPX_PLANE_Y];
+
+  for (int x = 0; x < w; ++x) {
+    EXPECT_NEAR(16, top[x], 1);
+    EXPECT_NEAR(235, bottom[x], 1);
+  }
+
+  for (int x = 0; x < (w + 1) / 2; ++x) {
+    EXPECT_NEAR(128, img->planes[VPX_PLANE_U][x], 1);
+    EXPECT_NEAR(128, img->planes[VPX_PLANE_V][x], 1);
+  }
+
+  vpx_img_free(img);
+}
+
+// Not a pass/fail test: reports how the libyuv kernels compare to the
+// scalar loops on a 1080p frame.
+TEST(LibyuvUtil, ConversionSpeed) {
+  const unsigned int w = 1920;
+  const unsigned int h = 1080;
+  const int iterations = 100;
+
+  vpx_image_t* const img = CreateTestImage(w, h);
+  ASSERT_TRUE(img != NULL);
+
+  std::vector<uint8_t> buf(2 * w * h);
+  uint8_t* const dst = &buf[0];
+
+  double t0 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    ScalarI420ToNV12(img, dst, w);
+
+  double t1 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    webmdshow::LibyuvI420ToNV12(img, dst, w, dst + w * h, w);
+
+  double t2 = GetSeconds();
+
+  printf("NV12: scalar %.3f ms/frame, libyuv %.3f ms/frame\n",
+         (t1 - t0) * 1000 / iterations, (t2 - t1) * 1000 / iterations);
+
+  t0 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    ScalarI420ToPacked(img, webmdshow::kPackedYuvYUY2, dst, 2 * w);
+
+  t1 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    webmdshow::LibyuvI420ToPacked(img, webmdshow::kPackedYuvYUY2, dst, 2 * w);
+
+  t2 = GetSeconds();
+
+  printf("YUY2: scalar %.3f ms/frame, libyuv %.3f ms/frame\n",
+         (t1 - t0) * 1000 / iterations, (t2 - t1) * 1000 / iterations);
+
+  vpx_image_t* const target = CreateTestImage(w, h);
+  ASSERT_TRUE(target != NULL);
+
+  t0 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    ScalarYUY2ToI420(dst, 2 * w, w, h, target);
+
+  t1 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i) {
+    webmdshow::LibyuvPackedToI420(dst, 2 * w, webmdshow::kPackedYuvYUY2, w, h,
+                                  target);
+  }
+
+  t2 = GetSeconds();
+
+  printf("YUY2 to I420: scalar %.3f ms/frame, libyuv %.3f ms/frame\n",
+         (t1 - t0) * 1000 / iterations, (t2 - t1) * 1000 / iterations);
+
+  vpx_img_free(target);
+
+  vpx_img_free(img);
+}
+
+TEST(LibyuvUtil, BandedScaleMatchesWhole) {
+  const unsigned int sizes[][4] = {
+      {3840, 2160, 1920, 1080}, {1920, 1080, 1280, 720}, {641, 479, 320, 240}};
+  const webmdshow::ScaleFilter filters[] = {webmdshow::kScaleFilterNone,
+                                            webmdshow::kScaleFilterBox};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    vpx_image_t* const img = CreateTestImage(sizes[i][0], sizes[i][1]);
+    ASSERT_TRUE(img != NULL);
+
+    for (size_t j = 0; j < sizeof(filters) / sizeof(filters[0]); ++j) {
+      vpx_image_t* expected = NULL;
+      ASSERT_TRUE(webmdshow::LibyuvScaleI420(sizes[i][2], sizes[i][3], img,
+                                             &expected, filters[j]));
+
+      webmdshow::LibyuvScaler scaler;
+      scaler.set_filter(filters[j]);
+      scaler.set_band_count(8);
+
+      vpx_image_t* actual = NULL;
+      ASSERT_TRUE(scaler.Scale(sizes[i][2], sizes[i][3], img, &actual));
+
+      // 641x479 to 320x240 has no rows that line up.
+      EXPECT_EQ(i < 2 ? 8 : 1, scaler.band_count());
+      EXPECT_TRUE(SameVisiblePlanes(expected, actual))
+          << sizes[i][0] << "x" << sizes[i][1] << ", filter " << filters[j];
+
+      vpx_img_free(actual);
+      vpx_img_free(expected);
+    }
+
+    vpx_img_free(img);
+  }
+}
+
+TEST(LibyuvUtil, ScaleLumaMatchesI420Scale) {
+  const unsigned int w = 641, h = 479, out_w = 320, out_h = 240;
+
+  vpx_image_t* const img = CreateTestImage(w, h);
+  ASSERT_TRUE(img != NULL);
+
+  vpx_image_t* expected = NULL;
+  ASSERT_TRUE(webmdshow::LibyuvScaleI420(out_w, out_h, img, &expected));
+
+  const int stride = out_w + 32;
+  std::vector<uint8_t> luma(stride * out_h);
+  ASSERT_TRUE(webmdshow::LibyuvScaleLuma(img, &luma[0], stride, out_w, out_h));
+
+  for (unsigned int y = 0; y < out_h; ++y) {
+    ASSERT_EQ(0, memcmp(&luma[y * stride],
+                        expected->planes[VPX_PLANE_Y] +
+                            y * expected->stride[VPX_PLANE_Y],
+                        out_w))
+        << "row " << y;
+  }
+
+  vpx_img_free(expected);
+  vpx_img_free(img);
+}
+
+// Not a pass/fail test: reports what the bands save on a 4K to 1080p
+// downscale.
+TEST(LibyuvUtil, BandedScaleSpeed) {
+  const int iterations = 20;
+
+  vpx_image_t* const img = CreateTestImage(3840, 2160);
+  ASSERT_TRUE(img != NULL);
+
+  vpx_image_t* target = NULL;
+
+  webmdshow::LibyuvScaler scaler;
+  scaler.set_band_count(1);
+
+  double t0 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    ASSERT_TRUE(scaler.Scale(1920, 1080, img, &target));
+
+  scaler.set_band_count(0);
+
+  double t1 = GetSeconds();
+
+  for (int i = 0; i < iterations; ++i)
+    ASSERT_TRUE(scaler.Scale(1920, 1080, img, &target));
+
+  double t2 = GetSeconds();
+
+  printf("4K to 1080p box: 1 band %.3f ms/frame, %d bands %.3f ms/frame\n",
+         (t1 - t0) * 1000 / iterations, scaler.band_count(),
+         (t2 - t1) * 1000 / iterations);
+
+  vpx_img_free(target);
+  vpx_img_free(img);
+}
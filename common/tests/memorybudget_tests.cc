@@ -0,0 +1,131 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "gtest/gtest.h"
+#include "memorybudget.h"
+
+using webmdshow::MemoryBudget;
+
+namespace {
+
+void SetLimits(MemoryBudget* budget, int64_t soft, int64_t hard) {
+  MemoryBudget::Limits limits;
+  limits.soft = soft;
+  limits.hard = hard;
+  budget->SetLimits(limits);
+}
+
+int64_t GetBytes(const MemoryBudget& budget) {
+  MemoryBudget::Stats stats;
+  budget.GetStats(&stats);
+  return stats.bytes;
+}
+
+}  // namespace
+
+TEST(MemoryBudget, ChargesSessionAndProcess) {
+  const int64_t process_bytes = GetBytes(*MemoryBudget::GetProcess());
+
+  MemoryBudget session(NULL);
+  MemoryBudget::Account account;
+
+  account.Open(&session, false);
+  account.Charge(1000);
+  account.Release(400);
+
+  EXPECT_EQ(600, account.GetBytes());
+  EXPECT_EQ(600, GetBytes(session));
+  EXPECT_EQ(process_bytes + 600, GetBytes(*MemoryBudget::GetProcess()));
+
+  account.Close();
+
+  EXPECT_EQ(0, GetBytes(session));
+  EXPECT_EQ(process_bytes, GetBytes(*MemoryBudget::GetProcess()));
+}
+
+TEST(MemoryBudget, AsksPurgeablePoolsPastSoftLimit) {
+  MemoryBudget session(NULL);
+  SetLimits(&session, 1000, 0);
+
+  MemoryBudget::Account cache1, cache2, allocator;
+
+  cache1.Open(&session, true);
+  cache2.Open(&session, true);
+  allocator.Open(&session, false);
+
+  cache1.Charge(300);
+  cache2.Charge(100);
+  allocator.Charge(500);
+
+  EXPECT_EQ(0, cache1.TakePurgeRequest());
+
+  // 200 over, shared 3:1 by the caches; no request of the allocator.
+  allocator.Charge(300);
+
+  EXPECT_EQ(150, cache1.TakePurgeRequest());
+  EXPECT_EQ(50, cache2.TakePurgeRequest());
+  EXPECT_EQ(0, allocator.TakePurgeRequest());
+  EXPECT_EQ(0, cache1.TakePurgeRequest());
+
+  MemoryBudget::Stats stats;
+  session.GetStats(&stats);
+
+  EXPECT_EQ(1, stats.purges);
+  EXPECT_EQ(1200, stats.peak);
+}
+
+TEST(MemoryBudget, DeniesTryChargePastHardLimit) {
+  MemoryBudget session(NULL);
+  SetLimits(&session, 0, 1000);
+
+  MemoryBudget::Account cache, allocator;
+
+  cache.Open(&session, true);
+  allocator.Open(&session, false);
+
+  cache.Charge(600);
+
+  EXPECT_TRUE(allocator.TryCharge(300));
+  EXPECT_FALSE(allocator.TryCharge(300));
+  EXPECT_EQ(300, allocator.GetBytes());
+
+  // The cache is asked for what the denied charge was over by.
+  EXPECT_EQ(200, cache.TakePurgeRequest());
+
+  cache.Release(200);
+  EXPECT_TRUE(allocator.TryCharge(300));
+
+  MemoryBudget::Stats stats;
+  session.GetStats(&stats);
+
+  EXPECT_EQ(1, stats.denials);
+}
+
+TEST(MemoryBudget, ProcessLimitCoversSessions) {
+  MemoryBudget* const process = MemoryBudget::GetProcess();
+
+  MemoryBudget::Limits old_limits;
+  process->GetLimits(&old_limits);
+
+  const int64_t process_bytes = GetBytes(*process);
+  SetLimits(process, 0, process_bytes + 1000);
+
+  MemoryBudget session1(NULL), session2(NULL);
+  MemoryBudget::Account account1, account2;
+
+  account1.Open(&session1, true);
+  account2.Open(&session2, false);
+
+  EXPECT_TRUE(account1.TryCharge(800));
+  EXPECT_FALSE(account2.TryCharge(300));
+  EXPECT_GT(account1.TakePurgeRequest(), 0);
+
+  account1.Close();
+  account2.Close();
+  process->SetLimits(old_limits);
+}
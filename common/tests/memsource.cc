@@ -0,0 +1,761 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "memsource.h"
+
+#include <uuids.h>
+#include <vfwmsgs.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+
+#include "cmediasample.h"
+#include "pipelinecounters.h"
+#include "webmconstants.h"
+
+namespace webmdshow {
+
+namespace {
+
+void WaitUntil(int64_t due_us) {
+  for (;;) {
+    const int64_t left = due_us - PipelineCounters::Now();
+
+    if (left <= 0)
+      return;
+
+    if (left > 2000)
+      Sleep(1);
+    else
+      YieldProcessor();
+  }
+}
+
+typedef std::vector<uint8_t> Bytes;
+
+void PutId(uint32_t id, Bytes* out) {
+  int shift = 24;
+
+  while (shift > 0 && ((id >> shift) & 0xFF) == 0)
+    shift -= 8;
+
+  for (; shift >= 0; shift -= 8)
+    out->push_back(static_cast<uint8_t>(id >> shift));
+}
+
+// Sizes are always coded in 8 bytes, so that the size of an element does
+// not depend on the values of the positions in it.
+void PutSize(uint64_t size, Bytes* out) {
+  out->push_back(0x01);
+
+  for (int shift = 48; shift >= 0; shift -= 8)
+    out->push_back(static_cast<uint8_t>(size >> shift));
+}
+
+void PutElement(uint32_t id, const Bytes& payload, Bytes* out) {
+  PutId(id, out);
+  PutSize(payload.size(), out);
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+void PutUInt(uint32_t id, uint64_t value, Bytes* out) {
+  PutId(id, out);
+  PutSize(8, out);
+
+  for (int shift = 56; shift >= 0; shift -= 8)
+    out->push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void PutFloat(uint32_t id, double value, Bytes* out) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof bits);
+
+  PutUInt(id, bits, out);
+}
+
+void PutString(uint32_t id, const char* str, Bytes* out) {
+  const size_t len = strlen(str);
+
+  PutId(id, out);
+  PutSize(len, out);
+  out->insert(out->end(), str, str + len);
+}
+
+void PutSeekEntry(uint32_t id, uint64_t pos, Bytes* out) {
+  Bytes seek_id;
+  PutId(id, &seek_id);
+
+  Bytes entry;
+  PutElement(WebmUtil::kEbmlSeekIDID, seek_id, &entry);
+  PutUInt(WebmUtil::kEbmlSeekPositionID, pos, &entry);
+
+  PutElement(WebmUtil::kEbmlSeekEntryID, entry, out);
+}
+
+// Appends a frame of |len| random bytes behind the frame tag of a shown
+// VP8 frame, and for a keyframe the start code and the frame size.
+void PutFrame(bool key, int len, int width, int height, uint32_t* state,
+              Bytes* out) {
+  const size_t start = out->size();
+  out->resize(start + len);
+
+  uint8_t* const p = &(*out)[start];
+
+  for (int i = 0; i < len; ++i) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    p[i] = static_cast<uint8_t>(x);
+  }
+
+  const uint32_t first_part = std::min<uint32_t>(len / 2, 0x7FFFF);
+  const uint32_t tag = (key ? 0 : 1) | (1 << 4) | (first_part << 5);
+
+  p[0] = static_cast<uint8_t>(tag);
+  p[1] = static_cast<uint8_t>(tag >> 8);
+  p[2] = static_cast<uint8_t>(tag >> 16);
+
+  if (key) {
+    p[3] = 0x9D;
+    p[4] = 0x01;
+    p[5] = 0x2A;
+    p[6] = static_cast<uint8_t>(width);
+    p[7] = static_cast<uint8_t>(width >> 8) & 0x3F;
+    p[8] = static_cast<uint8_t>(height);
+    p[9] = static_cast<uint8_t>(height >> 8) & 0x3F;
+  }
+}
+
+struct CueEntry {
+  int64_t time_ms;
+  uint64_t pos;  // of the cluster, within the clusters
+};
+
+}  // namespace
+
+void WaitUs(int64_t us) {
+  WaitUntil(PipelineCounters::Now() + us);
+}
+
+MemFile::MemFile(const std::vector<uint8_t>& data)
+    : data_(data),
+      link_free_us_(0) {
+  InitializeCriticalSection(&lock_);
+  ResetStats();
+}
+
+MemFile::~MemFile() {
+  DeleteCriticalSection(&lock_);
+}
+
+void MemFile::set_link(const LinkModel& link) {
+  EnterCriticalSection(&lock_);
+  link_ = link;
+  link_free_us_ = 0;
+  LeaveCriticalSection(&lock_);
+}
+
+int64_t MemFile::Schedule(int64_t len) {
+  EnterCriticalSection(&lock_);
+
+  int64_t transfer_us = 0;
+
+  if (link_.bytes_per_s > 0)
+    transfer_us = len * 1000000 / link_.bytes_per_s;
+
+  const int64_t first_us = PipelineCounters::Now() + link_.latency_us;
+  const int64_t due_us = std::max(first_us, link_free_us_) + transfer_us;
+
+  link_free_us_ = due_us;
+
+  ++stats_.reads;
+  stats_.bytes += len;
+
+  LeaveCriticalSection(&lock_);
+
+  return due_us;
+}
+
+int64_t MemFile::Copy(int64_t pos, int64_t len, uint8_t* buf) {
+  const int64_t size = data_.size();
+  int64_t n = 0;
+
+  if (pos < size)
+    n = std::min(len, size - pos);
+
+  if (n > 0)
+    memcpy(buf, &data_[static_cast<size_t>(pos)], static_cast<size_t>(n));
+
+  memset(buf + n, 0, static_cast<size_t>(len - n));
+
+  return n;
+}
+
+void MemFile::GetStats(ReadStats* stats) const {
+  EnterCriticalSection(&lock_);
+  *stats = stats_;
+  LeaveCriticalSection(&lock_);
+}
+
+void MemFile::ResetStats() {
+  EnterCriticalSection(&lock_);
+  stats_.reads = 0;
+  stats_.bytes = 0;
+  LeaveCriticalSection(&lock_);
+}
+
+MemMkvReader::MemMkvReader(MemFile* file) : file_(file) {
+}
+
+MemMkvReader::~MemMkvReader() {
+}
+
+int MemMkvReader::Read(long long pos, long len, unsigned char* buf) {
+  if (pos < 0 || len < 0)
+    return -1;
+
+  if (len == 0)
+    return 0;
+
+  if (pos + len > file_->size())
+    return -1;
+
+  WaitUntil(file_->Schedule(len));
+  file_->Copy(pos, len, buf);
+
+  return 0;
+}
+
+int MemMkvReader::Length(long long* total, long long* available) {
+  if (total)
+    *total = file_->size();
+
+  if (available)
+    *available = file_->size();
+
+  return 0;
+}
+
+MemAsyncReader* MemAsyncReader::Create(MemFile* file) {
+  return new (std::nothrow) MemAsyncReader(file);
+}
+
+MemAsyncReader::MemAsyncReader(MemFile* file)
+    : file_(file),
+      ref_count_(1),
+      flushing_(false) {
+  InitializeCriticalSection(&lock_);
+}
+
+MemAsyncReader::~MemAsyncReader() {
+  for (size_t i = 0; i < pending_.size(); ++i)
+    pending_[i].sample->Release();
+
+  DeleteCriticalSection(&lock_);
+}
+
+HRESULT MemAsyncReader::QueryInterface(const IID& iid, void** ppv) {
+  if (ppv == NULL)
+    return E_POINTER;
+
+  IUnknown*& unk = reinterpret_cast<IUnknown*&>(*ppv);
+
+  if (iid == __uuidof(IUnknown) || iid == __uuidof(IPin)) {
+    unk = static_cast<IPin*>(this);
+  } else if (iid == __uuidof(IAsyncReader)) {
+    unk = static_cast<IAsyncReader*>(this);
+  } else {
+    unk = NULL;
+    return E_NOINTERFACE;
+  }
+
+  unk->AddRef();
+  return S_OK;
+}
+
+ULONG MemAsyncReader::AddRef() {
+  return InterlockedIncrement(&ref_count_);
+}
+
+ULONG MemAsyncReader::Release() {
+  const LONG n = InterlockedDecrement(&ref_count_);
+
+  if (n == 0)
+    delete this;
+
+  return n;
+}
+
+HRESULT MemAsyncReader::Connect(IPin*, const AM_MEDIA_TYPE*) {
+  return E_UNEXPECTED;  // the splitter's inpin connects to us
+}
+
+HRESULT MemAsyncReader::ReceiveConnection(IPin*, const AM_MEDIA_TYPE*) {
+  return E_UNEXPECTED;  // we're an output pin
+}
+
+HRESULT MemAsyncReader::Disconnect() {
+  return S_FALSE;
+}
+
+HRESULT MemAsyncReader::ConnectedTo(IPin** pin) {
+  if (pin == NULL)
+    return E_POINTER;
+
+  *pin = NULL;
+  return VFW_E_NOT_CONNECTED;
+}
+
+HRESULT MemAsyncReader::ConnectionMediaType(AM_MEDIA_TYPE* mt) {
+  if (mt == NULL)
+    return E_POINTER;
+
+  memset(mt, 0, sizeof(*mt));
+  return VFW_E_NOT_CONNECTED;
+}
+
+HRESULT MemAsyncReader::QueryPinInfo(PIN_INFO* info) {
+  if (info == NULL)
+    return E_POINTER;
+
+  info->pFilter = NULL;  // no filter, so no file for the shared cache
+  info->dir = PINDIR_OUTPUT;
+  wcscpy_s(info->achName, L"Output");
+
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::QueryDirection(PIN_DIRECTION* dir) {
+  if (dir == NULL)
+    return E_POINTER;
+
+  *dir = PINDIR_OUTPUT;
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::QueryId(LPWSTR* id) {
+  if (id == NULL)
+    return E_POINTER;
+
+  *id = NULL;
+  return E_NOTIMPL;
+}
+
+HRESULT MemAsyncReader::QueryAccept(const AM_MEDIA_TYPE* mt) {
+  if (mt == NULL)
+    return E_INVALIDARG;
+
+  return (mt->majortype == MEDIATYPE_Stream) ? S_OK : S_FALSE;
+}
+
+HRESULT MemAsyncReader::EnumMediaTypes(IEnumMediaTypes** types) {
+  if (types == NULL)
+    return E_POINTER;
+
+  *types = NULL;
+  return E_NOTIMPL;
+}
+
+HRESULT MemAsyncReader::QueryInternalConnections(IPin**, ULONG*) {
+  return E_NOTIMPL;
+}
+
+HRESULT MemAsyncReader::EndOfStream() {
+  return E_UNEXPECTED;
+}
+
+HRESULT MemAsyncReader::BeginFlush() {
+  EnterCriticalSection(&lock_);
+  flushing_ = true;
+  LeaveCriticalSection(&lock_);
+
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::EndFlush() {
+  EnterCriticalSection(&lock_);
+  flushing_ = false;
+  LeaveCriticalSection(&lock_);
+
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::NewSegment(REFERENCE_TIME, REFERENCE_TIME, double) {
+  return E_UNEXPECTED;
+}
+
+HRESULT MemAsyncReader::RequestAllocator(IMemAllocator* preferred,
+                                         ALLOCATOR_PROPERTIES* props,
+                                         IMemAllocator** actual) {
+  if (props == NULL || actual == NULL)
+    return E_POINTER;
+
+  *actual = NULL;
+
+  IMemAllocator* allocator = preferred;
+  HRESULT hr;
+
+  if (allocator) {
+    allocator->AddRef();
+  } else {
+    hr = CMediaSample::CreateAllocator(&allocator);
+
+    if (FAILED(hr))
+      return hr;
+  }
+
+  ALLOCATOR_PROPERTIES want = *props;
+  ALLOCATOR_PROPERTIES got;
+
+  if (want.cbAlign < 1)
+    want.cbAlign = 1;
+
+  hr = allocator->SetProperties(&want, &got);
+
+  if (FAILED(hr)) {
+    allocator->Release();
+    return hr;
+  }
+
+  *actual = allocator;
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::Request(IMediaSample* sample, DWORD_PTR user) {
+  if (sample == NULL)
+    return E_POINTER;
+
+  LONGLONG st, sp;
+
+  HRESULT hr = sample->GetTime(&st, &sp);
+
+  if (FAILED(hr))
+    return hr;
+
+  const int64_t len = (sp - st) / 10000000;
+
+  if (len <= 0 || len > sample->GetSize())
+    return E_INVALIDARG;
+
+  EnterCriticalSection(&lock_);
+
+  if (flushing_) {
+    LeaveCriticalSection(&lock_);
+    return VFW_E_WRONG_STATE;
+  }
+
+  Pending p;
+  p.sample = sample;
+  p.user = user;
+  p.due_us = file_->Schedule(len);
+
+  sample->AddRef();
+  pending_.push_back(p);
+
+  LeaveCriticalSection(&lock_);
+
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::WaitForNext(DWORD timeout_ms, IMediaSample** sample,
+                                    DWORD_PTR* user) {
+  if (sample == NULL || user == NULL)
+    return E_POINTER;
+
+  *sample = NULL;
+  *user = 0;
+
+  const int64_t deadline_us = (timeout_ms == INFINITE) ?
+                              LLONG_MAX :
+                              PipelineCounters::Now() + timeout_ms * 1000LL;
+
+  for (;;) {
+    EnterCriticalSection(&lock_);
+
+    const bool flushing = flushing_;
+    int64_t wait_us = deadline_us;
+
+    if (!pending_.empty()) {
+      const Pending p = pending_.front();
+
+      if (flushing || p.due_us <= PipelineCounters::Now()) {
+        pending_.pop_front();
+        LeaveCriticalSection(&lock_);
+
+        *sample = p.sample;  // our reference goes to the caller
+        *user = p.user;
+
+        if (flushing)
+          return VFW_E_WRONG_STATE;
+
+        return ReadSample(p.sample);
+      }
+
+      wait_us = std::min(wait_us, p.due_us);
+    } else if (flushing) {
+      LeaveCriticalSection(&lock_);
+      return VFW_E_WRONG_STATE;
+    }
+
+    LeaveCriticalSection(&lock_);
+
+    const int64_t now_us = PipelineCounters::Now();
+
+    if (now_us >= deadline_us)
+      return VFW_E_TIMEOUT;
+
+    // Another thread may queue a request that completes sooner.
+    WaitUntil(std::min(wait_us, now_us + 1000));
+  }
+}
+
+HRESULT MemAsyncReader::SyncReadAligned(IMediaSample* sample) {
+  if (sample == NULL)
+    return E_POINTER;
+
+  LONGLONG st, sp;
+
+  const HRESULT hr = sample->GetTime(&st, &sp);
+
+  if (FAILED(hr))
+    return hr;
+
+  WaitUntil(file_->Schedule((sp - st) / 10000000));
+
+  return ReadSample(sample);
+}
+
+HRESULT MemAsyncReader::SyncRead(LONGLONG pos, LONG len, BYTE* buf) {
+  if (buf == NULL)
+    return E_POINTER;
+
+  if (pos < 0 || len < 0)
+    return E_INVALIDARG;
+
+  WaitUntil(file_->Schedule(len));
+
+  const int64_t n = file_->Copy(pos, len, buf);
+  return (n < len) ? S_FALSE : S_OK;
+}
+
+HRESULT MemAsyncReader::Length(LONGLONG* total, LONGLONG* available) {
+  if (total == NULL || available == NULL)
+    return E_POINTER;
+
+  *total = file_->size();
+  *available = file_->size();
+
+  return S_OK;
+}
+
+HRESULT MemAsyncReader::ReadSample(IMediaSample* sample) {
+  LONGLONG st, sp;
+
+  HRESULT hr = sample->GetTime(&st, &sp);
+
+  if (FAILED(hr))
+    return hr;
+
+  const int64_t pos = st / 10000000;
+  const int64_t len = (sp - st) / 10000000;
+
+  if (pos < 0 || len <= 0 || len > sample->GetSize())
+    return E_INVALIDARG;
+
+  BYTE* ptr;
+
+  hr = sample->GetPointer(&ptr);
+
+  if (FAILED(hr))
+    return hr;
+
+  const int64_t n = file_->Copy(pos, len, ptr);
+
+  hr = sample->SetActualDataLength(static_cast<long>(n));
+
+  if (FAILED(hr))
+    return hr;
+
+  return (n < len) ? S_FALSE : S_OK;  // S_FALSE: the end of the file
+}
+
+SyntheticWebmParams::SyntheticWebmParams()
+    : width(640),
+      height(360),
+      fps(30),
+      frames(30 * 60),
+      gop(60),
+      key_size(40000),
+      frame_size(6000),
+      cluster_frames(0),
+      cues(true) {
+}
+
+void BuildSyntheticWebm(const SyntheticWebmParams& params,
+                        std::vector<uint8_t>* file) {
+  using namespace WebmUtil;
+
+  Bytes info;
+  PutUInt(kEbmlTimeCodeScaleID, 1000000, &info);  // ms
+  PutFloat(kEbmlDurationID, params.frames * 1000.0 / params.fps, &info);
+  PutString(kEbmlMuxingAppID, "memsource", &info);
+  PutString(kEbmlWritingAppID, "memsource", &info);
+
+  Bytes video;
+  PutUInt(kEbmlVideoWidth, params.width, &video);
+  PutUInt(kEbmlVideoHeight, params.height, &video);
+
+  Bytes entry;
+  PutUInt(kEbmlTrackNumberID, 1, &entry);
+  PutUInt(kEbmlTrackUIDID, 1, &entry);
+  PutUInt(kEbmlTrackTypeID, kEbmlTrackTypeVideo, &entry);
+  PutString(kEbmlCodecIDID, "V_VP8", &entry);
+  PutElement(kEbmlVideoSettingsID, video, &entry);
+
+  Bytes tracks;
+  PutElement(kEbmlTrackEntryID, entry, &tracks);
+
+  Bytes clusters;
+  Bytes cluster;
+  int cluster_count = 0;  // frames in |cluster|
+  int64_t cluster_ms = 0;
+  std::vector<CueEntry> cue_entries;
+  uint32_t state = 0x9E3779B9;
+
+  for (int i = 0; i <= params.frames; ++i) {
+    const bool last = (i == params.frames);
+    const bool key = !last && (i % params.gop) == 0;
+    const int64_t time_ms = i * 1000LL / params.fps;
+
+    const bool full = params.cluster_frames > 0 &&
+                      cluster_count >= params.cluster_frames;
+
+    // The block's time, relative to its cluster's, is 16 bits.
+    const bool too_long = time_ms - cluster_ms > SHRT_MAX;
+
+    if (cluster_count > 0 && (last || key || full || too_long)) {
+      PutElement(kEbmlClusterID, cluster, &clusters);
+      cluster.clear();
+      cluster_count = 0;
+    }
+
+    if (last)
+      break;
+
+    if (cluster_count == 0) {
+      if (key) {
+        const CueEntry cue = { time_ms, clusters.size() };
+        cue_entries.push_back(cue);
+      }
+
+      cluster_ms = time_ms;
+      PutUInt(kEbmlTimeCodeID, cluster_ms, &cluster);
+    }
+
+    const int mean = key ? params.key_size : params.frame_size;
+    const int len = std::max(
+        16, mean - mean / 4 + static_cast<int>(state % (mean / 2 + 1)));
+
+    Bytes block;
+    block.push_back(0x81);  // track 1
+
+    const int16_t rel = static_cast<int16_t>(time_ms - cluster_ms);
+    block.push_back(static_cast<uint8_t>(rel >> 8));
+    block.push_back(static_cast<uint8_t>(rel));
+    block.push_back(key ? 0x80 : 0x00);
+
+    PutFrame(key, len, params.width, params.height, &state, &block);
+    PutElement(kEbmlSimpleBlockID, block, &cluster);
+
+    ++cluster_count;
+  }
+
+  Bytes info_element;
+  PutElement(kEbmlSegmentInfoID, info, &info_element);
+
+  Bytes tracks_element;
+  PutElement(kEbmlTracksID, tracks, &tracks_element);
+
+  // The seek head and the cues have the same sizes whatever the positions
+  // in them are, so a first pass sizes them for the second.
+  Bytes seek_head;
+  Bytes cues_element;
+
+  for (int pass = 0; pass < 2; ++pass) {
+    const uint64_t info_pos = seek_head.size();
+    const uint64_t tracks_pos = info_pos + info_element.size();
+    const uint64_t clusters_pos = tracks_pos + tracks_element.size();
+    const uint64_t cues_pos = clusters_pos + clusters.size();
+
+    Bytes entries;
+    PutSeekEntry(kEbmlSegmentInfoID, info_pos, &entries);
+    PutSeekEntry(kEbmlTracksID, tracks_pos, &entries);
+
+    if (params.cues)
+      PutSeekEntry(kEbmlCuesID, cues_pos, &entries);
+
+    seek_head.clear();
+    PutElement(kEbmlSeekHeadID, entries, &seek_head);
+
+    if (!params.cues)
+      continue;
+
+    Bytes points;
+
+    for (size_t i = 0; i < cue_entries.size(); ++i) {
+      const CueEntry& cue = cue_entries[i];
+
+      Bytes positions;
+      PutUInt(kEbmlCueTrackID, 1, &positions);
+      PutUInt(kEbmlCueClusterPositionID, clusters_pos + cue.pos, &positions);
+
+      Bytes point;
+      PutUInt(kEbmlCueTimeID, cue.time_ms, &point);
+      PutElement(kEbmlCueTrackPositionsID, positions, &point);
+
+      PutElement(kEbmlCuePointID, point, &points);
+    }
+
+    cues_element.clear();
+    PutElement(kEbmlCuesID, points, &cues_element);
+  }
+
+  Bytes header;
+  PutUInt(kEbmlVersionID, 1, &header);
+  PutUInt(kEbmlReadVersionID, 1, &header);
+  PutUInt(kEbmlMaxIDLengthID, 4, &header);
+  PutUInt(kEbmlMaxSizeLengthID, 8, &header);
+  PutString(kEbmlDocTypeID, "webm", &header);
+  PutUInt(kEbmlDocTypeVersionID, 2, &header);
+  PutUInt(kEbmlDocTypeReadVersionID, 2, &header);
+
+  const uint64_t segment_size = seek_head.size() + info_element.size() +
+                                tracks_element.size() + clusters.size() +
+                                cues_element.size();
+
+  file->clear();
+  file->reserve(static_cast<size_t>(segment_size) + 64);
+
+  PutElement(kEbmlID, header, file);
+
+  PutId(kEbmlSegmentID, file);
+  PutSize(segment_size, file);
+
+  file->insert(file->end(), seek_head.begin(), seek_head.end());
+  file->insert(file->end(), info_element.begin(), info_element.end());
+  file->insert(file->end(), tracks_element.begin(), tracks_element.end());
+  file->insert(file->end(), clusters.begin(), clusters.end());
+  file->insert(file->end(), cues_element.begin(), cues_element.end());
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,185 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_TESTS_MEMSOURCE_H_
+#define WEBMDSHOW_COMMON_TESTS_MEMSOURCE_H_
+
+#include <windows.h>
+#include <strmif.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+#include "mkvparser.hpp"
+
+namespace webmdshow {
+
+// How long a read takes: |latency_us| before the first byte, then the
+// bytes at |bytes_per_s| (0 means as fast as memcpy). Reads that overlap
+// share the link, so the second of two reads issued together finishes a
+// transfer time after the first, as on a disk or a network.
+struct LinkModel {
+  LinkModel() : latency_us(0), bytes_per_s(0) {}
+
+  int64_t latency_us;
+  int64_t bytes_per_s;
+};
+
+// What a source has been asked for.
+struct ReadStats {
+  int64_t reads;
+  int64_t bytes;
+};
+
+// Busy-waits for |us| microseconds, for a read (or a consumer's work) to
+// take its time with more precision than Sleep has.
+void WaitUs(int64_t us);
+
+// A file held in memory, which an IMkvReader or an IAsyncReader reads
+// through a LinkModel. Thread safe.
+class MemFile {
+ public:
+  explicit MemFile(const std::vector<uint8_t>& data);
+  ~MemFile();
+
+  int64_t size() const { return data_.size(); }
+
+  void set_link(const LinkModel& link);
+
+  // Returns when a read of |len| bytes issued now would complete, in
+  // PipelineCounters::Now time, and takes the link until then.
+  int64_t Schedule(int64_t len);
+
+  // Copies the bytes at [pos, pos + len) within the file to |buf|, and
+  // zeroes the rest. Returns the number copied.
+  int64_t Copy(int64_t pos, int64_t len, uint8_t* buf);
+
+  void GetStats(ReadStats* stats) const;
+  void ResetStats();
+
+ private:
+  const std::vector<uint8_t> data_;
+  LinkModel link_;
+  int64_t link_free_us_;  // when the link has sent what it was asked for
+  ReadStats stats_;
+  mutable CRITICAL_SECTION lock_;
+
+  MemFile(const MemFile&);
+  MemFile& operator=(const MemFile&);
+};
+
+// An mkvparser::IMkvReader over a MemFile, each Read taking as long as
+// the link says.
+class MemMkvReader : public mkvparser::IMkvReader {
+ public:
+  explicit MemMkvReader(MemFile* file);
+  virtual ~MemMkvReader();
+
+  virtual int Read(long long pos, long len, unsigned char* buf);
+  virtual int Length(long long* total, long long* available);
+
+ private:
+  MemFile* const file_;
+
+  MemMkvReader(const MemMkvReader&);
+  MemMkvReader& operator=(const MemMkvReader&);
+};
+
+// The output pin of a file source over a MemFile: the IAsyncReader the
+// splitter's inpin asks its connection for, with the IPin around it. The
+// pin is never connected itself; the splitter keeps a reference to it.
+// A request completes once the link says it has arrived, when the reader
+// calls WaitForNext for it. Created with a reference count of 1.
+class MemAsyncReader : public IPin, public IAsyncReader {
+ public:
+  static MemAsyncReader* Create(MemFile* file);
+
+  // IUnknown
+  HRESULT STDMETHODCALLTYPE QueryInterface(const IID& iid, void** ppv);
+  ULONG STDMETHODCALLTYPE AddRef();
+  ULONG STDMETHODCALLTYPE Release();
+
+  // IPin
+  HRESULT STDMETHODCALLTYPE Connect(IPin*, const AM_MEDIA_TYPE*);
+  HRESULT STDMETHODCALLTYPE ReceiveConnection(IPin*, const AM_MEDIA_TYPE*);
+  HRESULT STDMETHODCALLTYPE Disconnect();
+  HRESULT STDMETHODCALLTYPE ConnectedTo(IPin** pin);
+  HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE* mt);
+  HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO* info);
+  HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION* dir);
+  HRESULT STDMETHODCALLTYPE QueryId(LPWSTR* id);
+  HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE* mt);
+  HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes** types);
+  HRESULT STDMETHODCALLTYPE QueryInternalConnections(IPin**, ULONG*);
+  HRESULT STDMETHODCALLTYPE EndOfStream();
+  HRESULT STDMETHODCALLTYPE BeginFlush();
+  HRESULT STDMETHODCALLTYPE EndFlush();
+  HRESULT STDMETHODCALLTYPE NewSegment(REFERENCE_TIME, REFERENCE_TIME,
+                                       double);
+
+  // IAsyncReader
+  HRESULT STDMETHODCALLTYPE RequestAllocator(IMemAllocator* preferred,
+                                             ALLOCATOR_PROPERTIES* props,
+                                             IMemAllocator** actual);
+  HRESULT STDMETHODCALLTYPE Request(IMediaSample* sample, DWORD_PTR user);
+  HRESULT STDMETHODCALLTYPE WaitForNext(DWORD timeout_ms,
+                                        IMediaSample** sample,
+                                        DWORD_PTR* user);
+  HRESULT STDMETHODCALLTYPE SyncReadAligned(IMediaSample* sample);
+  HRESULT STDMETHODCALLTYPE SyncRead(LONGLONG pos, LONG len, BYTE* buf);
+  HRESULT STDMETHODCALLTYPE Length(LONGLONG* total, LONGLONG* available);
+
+ private:
+  struct Pending {
+    IMediaSample* sample;
+    DWORD_PTR user;
+    int64_t due_us;
+  };
+
+  explicit MemAsyncReader(MemFile* file);
+  ~MemAsyncReader();
+
+  // Reads the sample's span, as its times give it.
+  HRESULT ReadSample(IMediaSample* sample);
+
+  MemFile* const file_;
+  LONG ref_count_;
+  bool flushing_;
+  std::deque<Pending> pending_;
+  CRITICAL_SECTION lock_;
+
+  MemAsyncReader(const MemAsyncReader&);
+  MemAsyncReader& operator=(const MemAsyncReader&);
+};
+
+// The shape of a WebM file of one VP8 track, built in memory for the
+// splitter tests. The frames are of random bytes behind a VP8 frame
+// header, as webmbench -synth makes them; they do not decode. The file
+// has a SeekHead, and Cues (a cue point per cluster) unless |cues| is
+// false.
+struct SyntheticWebmParams {
+  SyntheticWebmParams();  // 640x360 at 30 fps for 60 s
+
+  int width;
+  int height;
+  int fps;
+  int frames;
+  int gop;              // frames from a keyframe to the next
+  int key_size;         // bytes
+  int frame_size;
+  int cluster_frames;   // at most; 0 means a cluster per GOP
+  bool cues;
+};
+
+void BuildSyntheticWebm(const SyntheticWebmParams& params,
+                        std::vector<uint8_t>* file);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_TESTS_MEMSOURCE_H_
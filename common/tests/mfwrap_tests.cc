@@ -23,6 +23,7 @@
 #include "gtest/gtest.h"
 #include "memutil.h"
 #include "mfsrcwrap.h"
+#include "mftransdriver.h"
 #include "mftranswrap.h"
 #include "mfutil.h"
 #include "tests/mfdllpaths.h"
@@ -32,6 +33,7 @@ using WebmTypes::CLSID_WebmMfByteStreamHandler;
 using WebmTypes::CLSID_WebmMfVp8Dec;
 using WebmTypes::CLSID_WebmMfVorbisDec;
 using WebmMfUtil::MfByteStreamHandlerWrapper;
+using WebmMfUtil::MfTransformDriver;
 using WebmMfUtil::MfTransformWrapper;
 using WebmMfUtil::mf_startup;
 using WebmMfUtil::mf_shutdown;
@@ -125,6 +127,42 @@ TEST(MfByteStreamHandlerWrapper, GetVideoSample)
     ASSERT_HRESULT_SUCCEEDED(mf_shutdown());
 }
 
+TEST(MfByteStreamHandlerWrapper, GetVideoSamples)
+{
+    ASSERT_HRESULT_SUCCEEDED(mf_startup());
+    MfByteStreamHandlerWrapper* ptr_mf_bsh = NULL;
+    ASSERT_HRESULT_SUCCEEDED(
+        MfByteStreamHandlerWrapper::Create(WEBM_SOURCE_PATH,
+                                           CLSID_WebmMfByteStreamHandler,
+                                           &ptr_mf_bsh));
+    ASSERT_HRESULT_SUCCEEDED(ptr_mf_bsh->OpenURL(g_test_input_file));
+    ASSERT_HRESULT_SUCCEEDED(ptr_mf_bsh->LoadMediaStreams());
+    ptr_mf_bsh->SetSamplePrefetch(8);
+    ASSERT_HRESULT_SUCCEEDED(ptr_mf_bsh->Start(false, 0LL));
+    if (ptr_mf_bsh->GetVideoStreamCount() > 0)
+    {
+        const UINT kBatchSize = 16;
+        IMFSample* samples[kBatchSize] = { NULL };
+        UINT count = 0;
+        ASSERT_HRESULT_SUCCEEDED(
+            ptr_mf_bsh->GetVideoSamples(kBatchSize, samples, &count));
+        ASSERT_GT(count, 0U);
+        LONGLONG last_time = -1;
+        for (UINT i = 0; i < count; ++i)
+        {
+            ASSERT_TRUE(samples[i] != NULL);
+            LONGLONG time = 0;
+            ASSERT_HRESULT_SUCCEEDED(samples[i]->GetSampleTime(&time));
+            // Queued in the order the stream delivered them.
+            ASSERT_GE(time, last_time);
+            last_time = time;
+            samples[i]->Release();
+        }
+    }
+    ptr_mf_bsh->Release();
+    ASSERT_HRESULT_SUCCEEDED(mf_shutdown());
+}
+
 TEST(MfByteStreamHandlerWrapper, Start)
 {
     ASSERT_HRESULT_SUCCEEDED(mf_startup());
@@ -523,6 +561,54 @@ TEST(MfBasicPipeline, TransformVideoSample)
     ASSERT_HRESULT_SUCCEEDED(mf_shutdown());
 }
 
+TEST(MfBasicPipeline, DriveVideoDecoder)
+{
+    ASSERT_HRESULT_SUCCEEDED(mf_startup());
+    MfByteStreamHandlerWrapper* ptr_mf_bsh = NULL;
+    MfTransformWrapper* ptr_transform = NULL;
+    ASSERT_HRESULT_SUCCEEDED(
+        WebmMfUtil::setup_webm_vp8_decoder(g_test_input_file, &ptr_mf_bsh,
+                                           &ptr_transform));
+    MfTransformDriver* ptr_driver = NULL;
+    ASSERT_HRESULT_SUCCEEDED(
+        MfTransformDriver::Create(ptr_transform, 4, &ptr_driver));
+    // Fewer inputs than the pool and the queue hold together, so that this
+    // thread can feed them all before it drains.
+    const int kInputCount = 3;
+    _COM_SMARTPTR_TYPEDEF(IMFSample, IID_IMFSample);
+    for (int i = 0; i < kInputCount; ++i)
+    {
+        IMFSamplePtr ptr_cx_sample; // compressed sample
+        ASSERT_HRESULT_SUCCEEDED(
+            WebmMfUtil::get_webm_vp8_sample(ptr_mf_bsh, &ptr_cx_sample));
+        ASSERT_HRESULT_SUCCEEDED(ptr_driver->QueueInput(ptr_cx_sample));
+    }
+    ASSERT_HRESULT_SUCCEEDED(ptr_driver->EndOfInput());
+    int output_count = 0;
+    for (;;)
+    {
+        IMFSamplePtr ptr_dx_sample; // decompressed sample
+        const HRESULT hr = ptr_driver->GetOutput(&ptr_dx_sample);
+        if (MF_E_END_OF_STREAM == hr)
+        {
+            break;
+        }
+        ASSERT_HRESULT_SUCCEEDED(hr);
+        DWORD buffer_count = 0;
+        ASSERT_HRESULT_SUCCEEDED(ptr_dx_sample->GetBufferCount(&buffer_count));
+        ASSERT_GT(buffer_count, 0UL);
+        ++output_count;
+    }
+    // An invisible (alt-ref) frame gives no output.
+    EXPECT_GT(output_count, 0);
+    EXPECT_LE(output_count, kInputCount);
+    ASSERT_HRESULT_SUCCEEDED(ptr_driver->Stop());
+    ptr_driver->Release();
+    ptr_transform->Release();
+    ptr_mf_bsh->Release();
+    ASSERT_HRESULT_SUCCEEDED(mf_shutdown());
+}
+
 TEST(BSHBasicFuzz, PauseWithoutStart)
 {
     ASSERT_HRESULT_SUCCEEDED(mf_startup());
@@ -0,0 +1,264 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pcmconverter.h"
+
+using webmdshow::PcmConverter;
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+class Planes {
+ public:
+  Planes(int channels, int count)
+      : planes_(channels, std::vector<float>(count)) {
+    for (int c = 0; c < channels; ++c)
+      ptrs_.push_back(&planes_[c][0]);
+  }
+
+  std::vector<float>& operator[](int c) { return planes_[c]; }
+  const float* const* get() const { return &ptrs_[0]; }
+
+ private:
+  std::vector<std::vector<float> > planes_;
+  std::vector<const float*> ptrs_;
+};
+
+void FillSine(double freq, int rate, std::vector<float>* plane) {
+  for (size_t i = 0; i < plane->size(); ++i)
+    (*plane)[i] = static_cast<float>(0.5 * sin(2 * kPi * freq * i / rate));
+}
+
+// Runs |count| frames of |in| through |conv| in chunks of |chunk|, and
+// appends output channel |c| to |out|.
+void Convert(PcmConverter* conv, const Planes& in, int count, int chunk,
+             int c, std::vector<float>* out) {
+  std::vector<const float*> ptrs(conv->in_channels());
+
+  for (int done = 0; done < count; done += chunk) {
+    const int n = (count - done < chunk) ? count - done : chunk;
+
+    for (int i = 0; i < conv->in_channels(); ++i)
+      ptrs[i] = in.get()[i] + done;
+
+    const int made = conv->Process(&ptrs[0], n);
+    out->insert(out->end(), conv->output()[c], conv->output()[c] + made);
+  }
+}
+
+}  // namespace
+
+TEST(PcmConverter, Support) {
+  EXPECT_TRUE(PcmConverter::IsSupported(6, 44100, 2, 48000));
+  EXPECT_TRUE(PcmConverter::IsSupported(8, 48000, 6, 48000));
+  EXPECT_TRUE(PcmConverter::IsSupported(1, 8000, 2, 192000));
+  EXPECT_TRUE(PcmConverter::IsSupported(2, 192000, 1, 8000));
+
+  EXPECT_FALSE(PcmConverter::IsSupported(6, 44100, 4, 44100));
+  EXPECT_FALSE(PcmConverter::IsSupported(9, 44100, 2, 44100));
+  EXPECT_FALSE(PcmConverter::IsSupported(2, 4000, 2, 44100));
+  EXPECT_FALSE(PcmConverter::IsSupported(2, 44100, 2, 384000));
+
+  // 44099 and 48000 share no factor, which would take 48000 phases.
+  EXPECT_FALSE(PcmConverter::IsSupported(2, 44099, 2, 48000));
+
+  PcmConverter conv;
+  EXPECT_FALSE(conv.Init(6, NULL, 44100, 4, 44100));
+  EXPECT_EQ(0, conv.out_channels());
+}
+
+TEST(PcmConverter, Passthrough) {
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(2, NULL, 48000, 2, 48000));
+  EXPECT_TRUE(conv.passthrough());
+
+  const int order[] = { 1, 0 };
+  ASSERT_TRUE(conv.Init(2, order, 48000, 2, 48000));
+  EXPECT_FALSE(conv.passthrough());
+
+  Planes in(2, 5);
+
+  for (int i = 0; i < 5; ++i) {
+    in[0][i] = static_cast<float>(i);
+    in[1][i] = static_cast<float>(-i);
+  }
+
+  ASSERT_EQ(5, conv.Process(in.get(), 5));
+
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(-i, conv.output()[0][i]);
+    EXPECT_EQ(i, conv.output()[1][i]);
+  }
+}
+
+TEST(PcmConverter, DownmixesToStereo) {
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(6, NULL, 48000, 2, 48000));
+  ASSERT_EQ(2, conv.out_channels());
+
+  Planes in(6, 7);
+
+  // FL FR FC LFE BL BR, one at a time.
+  for (int c = 0; c < 6; ++c)
+    in[c][c] = 1.0f;
+
+  // The full scale input on every channel at once.
+  for (int c = 0; c < 6; ++c)
+    in[c][6] = 1.0f;
+
+  ASSERT_EQ(7, conv.Process(in.get(), 7));
+
+  const float* const l = conv.output()[0];
+  const float* const r = conv.output()[1];
+
+  EXPECT_GT(l[0], 0.0f);
+  EXPECT_EQ(0.0f, r[0]);
+  EXPECT_EQ(0.0f, l[1]);
+  EXPECT_FLOAT_EQ(l[0], r[1]);
+
+  EXPECT_GT(l[2], 0.0f);
+  EXPECT_FLOAT_EQ(l[2], r[2]);
+  EXPECT_LT(l[2], l[0]);
+
+  EXPECT_EQ(0.0f, l[3]);  // the LFE is dropped
+  EXPECT_EQ(0.0f, r[3]);
+
+  EXPECT_GT(l[4], 0.0f);
+  EXPECT_EQ(0.0f, r[4]);
+  EXPECT_EQ(0.0f, l[5]);
+
+  EXPECT_NEAR(1.0f, l[6], 1e-6);
+  EXPECT_NEAR(1.0f, r[6], 1e-6);
+}
+
+TEST(PcmConverter, FoldsToFivePointOne) {
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(8, NULL, 48000, 6, 48000));
+
+  Planes in(8, 1);
+
+  for (int c = 0; c < 8; ++c)
+    in[c][0] = 1.0f;
+
+  ASSERT_EQ(1, conv.Process(in.get(), 1));
+
+  // The back pair takes the sides, and is the loudest but full scale.
+  EXPECT_NEAR(1.0f, conv.output()[4][0], 1e-6);
+  EXPECT_NEAR(1.0f, conv.output()[5][0], 1e-6);
+  EXPECT_LT(conv.output()[0][0], 1.0f);
+  EXPECT_GT(conv.output()[3][0], 0.0f);  // the LFE stays
+}
+
+TEST(PcmConverter, ResamplesDc) {
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(1, NULL, 44100, 1, 48000));
+
+  const int count = 44100;
+  Planes in(1, count);
+
+  for (int i = 0; i < count; ++i)
+    in[0][i] = 0.25f;
+
+  std::vector<float> out;
+  Convert(&conv, in, count, 1024, 0, &out);
+
+  // Short by the half of the filter that is still held.
+  const int expected = count * 160 / 147;
+  EXPECT_LE(out.size(), static_cast<size_t>(expected) + 1);
+  EXPECT_GE(out.size(), static_cast<size_t>(expected) - 40);
+
+  for (size_t i = 40; i < out.size(); ++i)
+    ASSERT_NEAR(0.25f, out[i], 1e-4) << i;
+}
+
+TEST(PcmConverter, ResamplesSine) {
+  const int rates[][2] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 22050, 48000 },
+    { 96000, 44100 },
+  };
+
+  for (size_t k = 0; k < sizeof rates / sizeof rates[0]; ++k) {
+    const int in_rate = rates[k][0];
+    const int out_rate = rates[k][1];
+
+    PcmConverter conv;
+    ASSERT_TRUE(conv.Init(1, NULL, in_rate, 1, out_rate));
+
+    const int count = in_rate / 4;
+    Planes in(1, count);
+    FillSine(1000.0, in_rate, &in[0]);
+
+    std::vector<float> out;
+    Convert(&conv, in, count, 999, 0, &out);
+
+    ASSERT_GT(out.size(), 1000u);
+
+    // Output n is input time n / out_rate, with no delay; away from the
+    // start, where the filter reaches before the first sample, it is the
+    // sine at the output rate.
+    double max_error = 0.0;
+
+    for (size_t n = 200; n < out.size(); ++n) {
+      const double ideal = 0.5 * sin(2 * kPi * 1000.0 * n / out_rate);
+      max_error = std::max(max_error, fabs(out[n] - ideal));
+    }
+
+    EXPECT_LT(max_error, 1e-3) << in_rate << " to " << out_rate;
+  }
+}
+
+TEST(PcmConverter, FiltersAboveTheOutputBand) {
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(1, NULL, 48000, 1, 44100));
+
+  // Above the Nyquist rate of the output, so it would alias.
+  const int count = 48000;
+  Planes in(1, count);
+  FillSine(23000.0, 48000, &in[0]);
+
+  std::vector<float> out;
+  Convert(&conv, in, count, 4096, 0, &out);
+
+  double energy = 0.0;
+
+  for (size_t n = 200; n < out.size(); ++n)
+    energy += out[n] * out[n];
+
+  const double rms = sqrt(energy / (out.size() - 200));
+  EXPECT_LT(rms, 1e-3);
+}
+
+TEST(PcmConverter, ChunkingDoesNotMatter) {
+  Planes in(2, 10000);
+  FillSine(440.0, 44100, &in[0]);
+  FillSine(660.0, 44100, &in[1]);
+
+  PcmConverter conv;
+  ASSERT_TRUE(conv.Init(2, NULL, 44100, 1, 48000));
+
+  std::vector<float> whole;
+  Convert(&conv, in, 10000, 10000, 0, &whole);
+
+  conv.Reset();
+
+  std::vector<float> pieces;
+  Convert(&conv, in, 10000, 37, 0, &pieces);
+
+  ASSERT_EQ(whole.size(), pieces.size());
+
+  for (size_t i = 0; i < whole.size(); ++i)
+    ASSERT_EQ(whole[i], pieces[i]) << i;
+}
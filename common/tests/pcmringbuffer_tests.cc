@@ -0,0 +1,185 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pcmringbuffer.h"
+
+using webmdshow::PcmRingBuffer;
+
+namespace {
+
+// Planar PCM where sample i of channel c is c * 100000 + i, so that any
+// frame read back identifies where it came from.
+class CountingPcm {
+ public:
+  CountingPcm(int channels, int count) : planes_(channels) {
+    for (int c = 0; c < channels; ++c) {
+      for (int i = 0; i < count; ++i)
+        planes_[c].push_back(static_cast<float>(c * 100000 + i));
+
+      ptrs_.push_back(&planes_[c][0]);
+    }
+  }
+
+  const float* const* get() const { return &ptrs_[0]; }
+
+ private:
+  std::vector<std::vector<float> > planes_;
+  std::vector<const float*> ptrs_;
+};
+
+// The per-sample deque buffering the ring buffer replaces, for comparison.
+void ReadDeques(std::vector<std::deque<float> >* channels, int count,
+                float* dst) {
+  for (int i = 0; i < count; ++i) {
+    for (size_t c = 0; c < channels->size(); ++c) {
+      std::deque<float>& ss = (*channels)[c];
+      *dst++ = ss.front();
+      ss.pop_front();
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PcmRingBuffer, ReadsBackAcrossTheWrap) {
+  const int channels = 3;
+  const int count = 56;
+  const CountingPcm pcm(channels, count);
+
+  PcmRingBuffer ring;
+  ring.Reset(channels, 16);
+
+  std::vector<float> dst(channels * count);
+  int written = 0;
+  int read = 0;
+
+  // Uneven write and read sizes walk the head all the way around the ring,
+  // and the larger writes force it to grow while wrapped.
+  const int writes[] = {5, 9, 8, 13, 7, 14};
+  const int reads[] = {3, 8, 6, 10, 11, 12};
+
+  for (int k = 0; k < 6; ++k) {
+    const float* src[channels];
+
+    for (int c = 0; c < channels; ++c)
+      src[c] = pcm.get()[c] + written;
+
+    ring.Write(src, writes[k]);
+    written += writes[k];
+    ASSERT_EQ(written - read, ring.size());
+
+    ring.ReadFloat(reads[k], &dst[read * channels]);
+    read += reads[k];
+    ASSERT_EQ(written - read, ring.size());
+  }
+
+  for (int i = 0; i < read; ++i) {
+    for (int c = 0; c < channels; ++c)
+      ASSERT_EQ(c * 100000 + i, dst[i * channels + c]) << "frame " << i;
+  }
+}
+
+TEST(PcmRingBuffer, ReadInt16) {
+  const float left[] = {0.5f, -0.5f, 0.0f};
+  const float right[] = {1.0f, -1.0f, 0.25f};
+  const float* const src[] = {left, right};
+
+  PcmRingBuffer ring;
+  ring.Reset(2, 2);  // grows on the write
+  ring.Write(src, 3);
+
+  int16_t dst[6];
+  ring.ReadInt16(3, webmdshow::kPcmDitherNone, NULL, dst);
+
+  const int16_t expected[] = {16384, 32767, -16384, -32768, 0, 8192};
+
+  for (int i = 0; i < 6; ++i)
+    EXPECT_EQ(expected[i], dst[i]);
+
+  EXPECT_EQ(0, ring.size());
+}
+
+TEST(PcmRingBuffer, ReadSpeed) {
+  // A Vorbis packet's worth in, an output buffer's worth out, as the
+  // DirectShow decoder does at 48 kHz.
+  const int write_frames = 1024;
+  const int read_frames = 6000;
+  const int total_frames = 48000 * 60;
+
+  const int channel_counts[] = {2, 8};
+
+  for (int k = 0; k < 2; ++k) {
+    const int channels = channel_counts[k];
+    const CountingPcm pcm(channels, write_frames);
+
+    std::vector<float> dst(read_frames * channels);
+    std::vector<int16_t> dst16(read_frames * channels);
+
+    std::vector<std::deque<float> > deques(channels);
+    clock_t t0 = clock();
+
+    for (int done = 0; done < total_frames;) {
+      for (int c = 0; c < channels; ++c) {
+        const float* const first = pcm.get()[c];
+        deques[c].insert(deques[c].end(), first, first + write_frames);
+      }
+
+      if (static_cast<int>(deques[0].size()) >= read_frames) {
+        ReadDeques(&deques, read_frames, &dst[0]);
+        done += read_frames;
+      }
+    }
+
+    clock_t t1 = clock();
+
+    PcmRingBuffer ring;
+    ring.Reset(channels, read_frames + write_frames);
+
+    for (int done = 0; done < total_frames;) {
+      ring.Write(pcm.get(), write_frames);
+
+      if (ring.size() >= read_frames) {
+        ring.ReadFloat(read_frames, &dst[0]);
+        done += read_frames;
+      }
+    }
+
+    clock_t t2 = clock();
+
+    ring.Clear();
+
+    webmdshow::PcmDitherState state;
+    webmdshow::InitPcmDitherState(0, &state);
+
+    for (int done = 0; done < total_frames;) {
+      ring.Write(pcm.get(), write_frames);
+
+      if (ring.size() >= read_frames) {
+        ring.ReadInt16(read_frames, webmdshow::kPcmDitherTriangular, &state,
+                       &dst16[0]);
+        done += read_frames;
+      }
+    }
+
+    clock_t t3 = clock();
+
+    const double ms = 1000.0 / CLOCKS_PER_SEC;
+
+    printf("%d channels, 60 s: deque %.1f ms, ring %.1f ms, "
+           "ring to int16 with dither %.1f ms\n",
+           channels, (t1 - t0) * ms, (t2 - t1) * ms, (t3 - t2) * ms);
+
+    EXPECT_EQ(read_frames + write_frames, ring.capacity());
+  }
+}
@@ -0,0 +1,238 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pcmutil.h"
+
+namespace {
+
+class PlanarPcm {
+ public:
+  PlanarPcm(int channels, int count) : planes_(channels) {
+    srand(channels * 65537 + count);
+
+    for (int c = 0; c < channels; ++c) {
+      planes_[c].resize(count);
+
+      for (int i = 0; i < count; ++i)
+        planes_[c][i] = static_cast<float>(rand()) / RAND_MAX - 0.5f;
+
+      ptrs_.push_back(&planes_[c][0]);
+    }
+  }
+
+  const float* const* get() const { return &ptrs_[0]; }
+  float at(int channel, int i) const { return planes_[channel][i]; }
+
+ private:
+  std::vector<std::vector<float> > planes_;
+  std::vector<const float*> ptrs_;
+};
+
+}  // namespace
+
+TEST(PcmUtil, InterleaveMatchesScalar) {
+  const int counts[] = {1, 3, 4, 7, 64, 1021};
+
+  for (int channels = 1; channels <= 8; ++channels) {
+    for (size_t j = 0; j < sizeof(counts) / sizeof(counts[0]); ++j) {
+      const int count = counts[j];
+      const PlanarPcm pcm(channels, count);
+
+      // a rotation, so that every output channel comes from another one
+      int order[webmdshow::kMaxReorderedPcmChannels];
+
+      for (int c = 0; c < channels; ++c)
+        order[c] = (c + 1) % channels;
+
+      std::vector<float> plain(channels * count + 1, -9.0f);
+      std::vector<float> reordered(channels * count + 1, -9.0f);
+
+      webmdshow::InterleavePcm(pcm.get(), NULL, channels, count, &plain[0]);
+      webmdshow::InterleavePcm(pcm.get(), order, channels, count,
+                               &reordered[0]);
+
+      for (int i = 0; i < count; ++i) {
+        for (int c = 0; c < channels; ++c) {
+          ASSERT_EQ(pcm.at(c, i), plain[i * channels + c])
+              << channels << " channels, frame " << i;
+          ASSERT_EQ(pcm.at(order[c], i), reordered[i * channels + c])
+              << channels << " channels, frame " << i;
+        }
+      }
+
+      // nothing written past the end
+      EXPECT_EQ(-9.0f, plain.back());
+      EXPECT_EQ(-9.0f, reordered.back());
+    }
+  }
+}
+
+TEST(PcmUtil, InterleaveManyChannels) {
+  const int channels = 11;
+  const int count = 37;
+  const PlanarPcm pcm(channels, count);
+
+  std::vector<float> dst(channels * count);
+  webmdshow::InterleavePcm(pcm.get(), NULL, channels, count, &dst[0]);
+
+  for (int i = 0; i < count; ++i) {
+    for (int c = 0; c < channels; ++c)
+      ASSERT_EQ(pcm.at(c, i), dst[i * channels + c]);
+  }
+}
+
+TEST(PcmUtil, DeinterleaveInvertsInterleave) {
+  const int counts[] = {1, 3, 4, 7, 64, 1021};
+
+  for (int channels = 1; channels <= 8; ++channels) {
+    for (size_t j = 0; j < sizeof(counts) / sizeof(counts[0]); ++j) {
+      const int count = counts[j];
+      const PlanarPcm pcm(channels, count);
+
+      int order[webmdshow::kMaxReorderedPcmChannels];
+
+      for (int c = 0; c < channels; ++c)
+        order[c] = (c + 1) % channels;
+
+      std::vector<float> interleaved(channels * count);
+      webmdshow::InterleavePcm(pcm.get(), order, channels, count,
+                               &interleaved[0]);
+
+      // Interleaved channel c came from plane order[c], so deinterleaving
+      // with the same order puts every sample back where it started.
+      std::vector<std::vector<float> > planes(channels);
+      std::vector<float*> dst(channels);
+
+      for (int c = 0; c < channels; ++c) {
+        planes[c].assign(count + 1, -9.0f);
+        dst[c] = &planes[c][0];
+      }
+
+      webmdshow::DeinterleavePcm(&interleaved[0], webmdshow::kPcmFloat32,
+                                 order, channels, count, &dst[0]);
+
+      for (int c = 0; c < channels; ++c) {
+        for (int i = 0; i < count; ++i) {
+          ASSERT_EQ(pcm.at(c, i), planes[c][i])
+              << channels << " channels, frame " << i;
+        }
+
+        EXPECT_EQ(-9.0f, planes[c].back());
+      }
+    }
+  }
+}
+
+TEST(PcmUtil, DeinterleaveIntegers) {
+  const int channels = 3;
+  const int count = 9;  // two vector groups and a tail
+
+  std::vector<int16_t> s16(channels * count);
+  std::vector<uint8_t> s24(3 * channels * count);
+  std::vector<int32_t> s32(channels * count);
+
+  for (int k = 0; k < channels * count; ++k) {
+    const int x = (k * 7919) % 65536 - 32768;
+
+    s16[k] = static_cast<int16_t>(x);
+    s32[k] = x * 65536;
+
+    // the same value, shifted to 24 bits
+    const int32_t y = x * 256;
+    s24[3 * k] = static_cast<uint8_t>(y);
+    s24[3 * k + 1] = static_cast<uint8_t>(y >> 8);
+    s24[3 * k + 2] = static_cast<uint8_t>(y >> 16);
+  }
+
+  const void* const src[] = {&s16[0], &s24[0], &s32[0]};
+  const webmdshow::PcmFormat formats[] = {
+      webmdshow::kPcmInt16, webmdshow::kPcmInt24, webmdshow::kPcmInt32};
+
+  for (int f = 0; f < 3; ++f) {
+    std::vector<float> planes(channels * count);
+    float* const dst[] = {&planes[0], &planes[count], &planes[2 * count]};
+
+    webmdshow::DeinterleavePcm(src[f], formats[f], NULL, channels, count,
+                               dst);
+
+    for (int c = 0; c < channels; ++c) {
+      for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(s16[i * channels + c] / 32768.0f, dst[c][i])
+            << "format " << f << ", channel " << c << ", frame " << i;
+      }
+    }
+  }
+}
+
+TEST(PcmUtil, ConvertToInt16) {
+  const float src[] = {0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 0.5f, -0.5f,
+                       0.25f / 32768, 1.0f / 32768, -3.0f / 32768, 1e30f};
+  const int16_t expected[] = {0, 32767, -32768, 32767, -32768, 16384, -16384,
+                              0, 1, -3, 32767};
+  const int count = sizeof(src) / sizeof(src[0]);
+
+  // Odd sizes exercise both the vector and the scalar path.
+  for (int n = 1; n <= count; ++n) {
+    std::vector<int16_t> dst(n + 1, 77);
+    webmdshow::ConvertFloatToInt16(src, n, webmdshow::kPcmDitherNone, NULL,
+                                   &dst[0]);
+
+    for (int i = 0; i < n; ++i)
+      ASSERT_EQ(expected[i], dst[i]) << "sample " << i << " of " << n;
+
+    EXPECT_EQ(77, dst[n]);
+  }
+}
+
+TEST(PcmUtil, DitherStaysWithinOneLsb) {
+  const int count = 4099;
+  const PlanarPcm pcm(1, count);
+  const float* const src = pcm.get()[0];
+
+  std::vector<int16_t> plain(count);
+  webmdshow::ConvertFloatToInt16(src, count, webmdshow::kPcmDitherNone, NULL,
+                                 &plain[0]);
+
+  webmdshow::PcmDitherState state;
+  webmdshow::InitPcmDitherState(1, &state);
+
+  std::vector<int16_t> dithered(count);
+  webmdshow::ConvertFloatToInt16(src, count, webmdshow::kPcmDitherTriangular,
+                                 &state, &dithered[0]);
+
+  int changed = 0;
+
+  for (int i = 0; i < count; ++i) {
+    const int d = dithered[i] - plain[i];
+    ASSERT_LE(abs(d), 1) << "sample " << i;
+
+    if (d != 0)
+      ++changed;
+  }
+
+  EXPECT_GT(changed, 0);
+
+  // The noise is stepped in lanes of four, so converting in pieces of any
+  // size that keeps the lanes aligned gives the same result.
+  webmdshow::InitPcmDitherState(1, &state);
+
+  std::vector<int16_t> pieces(count);
+
+  for (int i = 0; i < count; i += 12) {
+    const int n = (count - i < 12) ? count - i : 12;
+    webmdshow::ConvertFloatToInt16(src + i, n,
+                                   webmdshow::kPcmDitherTriangular, &state,
+                                   &pieces[i]);
+  }
+
+  EXPECT_TRUE(pieces == dithered);
+}
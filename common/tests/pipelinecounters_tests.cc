@@ -0,0 +1,140 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cwchar>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pipelinecounters.h"
+
+using webmdshow::PipelineCounters;
+
+namespace {
+
+bool FindStage(const wchar_t* name, PipelineCounters::Stats* stats) {
+  std::vector<PipelineCounters::Stats> all;
+  PipelineCounters::GetAllStats(&all);
+
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (wcscmp(all[i].name, name) == 0) {
+      *stats = all[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace
+
+TEST(PipelineCounters, CountsSamples) {
+  PipelineCounters counters(L"test.counts");
+
+  counters.OnSampleIn(100);
+  counters.OnSampleIn(200);
+  counters.OnSampleOut(50);
+  counters.OnDrop();
+  counters.SetQueueDepth(3);
+  counters.SetQueueDepth(1);
+
+  PipelineCounters::Stats stats;
+  counters.GetStats(&stats);
+
+  EXPECT_STREQ(L"test.counts", stats.name);
+  EXPECT_EQ(2, stats.samples_in);
+  EXPECT_EQ(300, stats.bytes_in);
+  EXPECT_EQ(1, stats.samples_out);
+  EXPECT_EQ(50, stats.bytes_out);
+  EXPECT_EQ(1, stats.dropped);
+  EXPECT_EQ(1, stats.queue_depth);
+  EXPECT_EQ(3, stats.queue_peak);
+
+  counters.Reset();
+  counters.GetStats(&stats);
+
+  EXPECT_STREQ(L"test.counts", stats.name);
+  EXPECT_EQ(0, stats.samples_in);
+  EXPECT_EQ(0, stats.queue_peak);
+}
+
+TEST(PipelineCounters, HistogramBuckets) {
+  PipelineCounters counters(L"test.histogram");
+
+  counters.AddProcessingTime(0);         // bucket 0
+  counters.AddProcessingTime(1);         // bucket 1: [1, 2)
+  counters.AddProcessingTime(3);         // bucket 2: [2, 4)
+  counters.AddProcessingTime(1000);      // bucket 10: [512, 1024)
+  counters.AddProcessingTime(1 << 30);   // the last bucket
+
+  PipelineCounters::Stats stats;
+  counters.GetStats(&stats);
+
+  EXPECT_EQ(1, stats.histogram[0]);
+  EXPECT_EQ(1, stats.histogram[1]);
+  EXPECT_EQ(1, stats.histogram[2]);
+  EXPECT_EQ(1, stats.histogram[10]);
+  EXPECT_EQ(1, stats.histogram[PipelineCounters::kHistogramBuckets - 1]);
+  EXPECT_EQ(1004 + (1 << 30), stats.busy_us);
+}
+
+TEST(PipelineCounters, RegistersWhileAlive) {
+  PipelineCounters::Stats stats;
+
+  {
+    PipelineCounters counters(L"test.registry");
+    counters.OnSampleIn(7);
+
+    ASSERT_TRUE(FindStage(L"test.registry", &stats));
+    EXPECT_EQ(7, stats.bytes_in);
+  }
+
+  EXPECT_FALSE(FindStage(L"test.registry", &stats));
+}
+
+TEST(PipelineCounters, TruncatesName) {
+  PipelineCounters counters(
+      L"a.stage.name.that.is.much.longer.than.the.limit");
+
+  PipelineCounters::Stats stats;
+  counters.GetStats(&stats);
+
+  EXPECT_EQ(size_t(PipelineCounters::kNameLength - 1), wcslen(stats.name));
+}
+
+TEST(PipelineCounters, ConcurrentUpdates) {
+  PipelineCounters counters(L"test.concurrent");
+
+  enum { kThreads = 4, kSamples = 100000 };
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(std::thread([&counters]() {
+      for (int j = 0; j < kSamples; ++j) {
+        counters.OnSampleIn(2);
+        PipelineCounters::Timer timer(counters);
+      }
+    }));
+  }
+
+  for (int i = 0; i < kThreads; ++i)
+    threads[i].join();
+
+  PipelineCounters::Stats stats;
+  counters.GetStats(&stats);
+
+  EXPECT_EQ(kThreads * kSamples, stats.samples_in);
+  EXPECT_EQ(2 * kThreads * kSamples, stats.bytes_in);
+
+  int64_t timed = 0;
+
+  for (int i = 0; i < PipelineCounters::kHistogramBuckets; ++i)
+    timed += stats.histogram[i];
+
+  EXPECT_EQ(kThreads * kSamples, timed);
+}
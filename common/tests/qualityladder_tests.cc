@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "gtest/gtest.h"
+#include "qualityladder.h"
+
+using webmdshow::QualityLadder;
+
+namespace {
+
+const int64_t kLate = QualityLadder::kLateThreshold + 1;
+const int64_t kEarly = -10000;
+
+}  // namespace
+
+TEST(QualityLadder, StepsUpAfterConsecutiveLateFrames) {
+  QualityLadder ladder;
+
+  for (int i = 1; i < QualityLadder::kLateCount; ++i)
+    EXPECT_FALSE(ladder.OnQuality(1000, kLate));
+
+  EXPECT_EQ(QualityLadder::kLevelFull, ladder.GetLevel());
+  EXPECT_TRUE(ladder.OnQuality(1000, kLate));
+  EXPECT_EQ(QualityLadder::kLevelNoPostproc, ladder.GetLevel());
+}
+
+TEST(QualityLadder, OnTimeFrameRestartsTheLateCount) {
+  QualityLadder ladder;
+
+  for (int i = 1; i < QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(1000, kLate);
+
+  ladder.OnQuality(1000, kEarly);
+
+  for (int i = 1; i < QualityLadder::kLateCount; ++i)
+    EXPECT_FALSE(ladder.OnQuality(1000, kLate));
+
+  EXPECT_EQ(QualityLadder::kLevelFull, ladder.GetLevel());
+}
+
+TEST(QualityLadder, LowProportionCountsAsLate) {
+  QualityLadder ladder;
+
+  for (int i = 0; i < QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(800, 0);
+
+  EXPECT_EQ(QualityLadder::kLevelNoPostproc, ladder.GetLevel());
+}
+
+TEST(QualityLadder, StopsAtTheTopRung) {
+  QualityLadder ladder;
+
+  for (int i = 0; i < 10 * QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(1000, kLate);
+
+  EXPECT_EQ(QualityLadder::kLevelMax, ladder.GetLevel());
+}
+
+TEST(QualityLadder, StepsDownAfterSustainedOnTimeFrames) {
+  QualityLadder ladder;
+
+  for (int i = 0; i < 2 * QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(1000, kLate);
+
+  ASSERT_EQ(QualityLadder::kLevelDropNonReference, ladder.GetLevel());
+
+  for (int i = 1; i < QualityLadder::kOnTimeCount; ++i)
+    EXPECT_FALSE(ladder.OnQuality(1000, kEarly));
+
+  EXPECT_TRUE(ladder.OnQuality(1000, kEarly));
+  EXPECT_EQ(QualityLadder::kLevelNoPostproc, ladder.GetLevel());
+}
+
+TEST(QualityLadder, SlightlyLateFramesHoldTheLevel) {
+  QualityLadder ladder;
+
+  for (int i = 0; i < QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(1000, kLate);
+
+  for (int i = 0; i < 2 * QualityLadder::kOnTimeCount; ++i)
+    EXPECT_FALSE(ladder.OnQuality(1000, QualityLadder::kLateThreshold));
+
+  EXPECT_EQ(QualityLadder::kLevelNoPostproc, ladder.GetLevel());
+}
+
+TEST(QualityLadder, ResetReturnsToFullQuality) {
+  QualityLadder ladder;
+
+  for (int i = 0; i < QualityLadder::kLateCount; ++i)
+    ladder.OnQuality(1000, kLate);
+
+  ladder.Reset();
+  EXPECT_EQ(QualityLadder::kLevelFull, ladder.GetLevel());
+}
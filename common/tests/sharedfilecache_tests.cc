@@ -0,0 +1,146 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "sharedfilecache.h"
+
+using webmdshow::SharedFileCache;
+
+namespace {
+
+const wchar_t kPath[] = L"c:\\media\\movie.webm";
+const int64_t kFileSize = 123456789;
+const int64_t kFileTime = 130000000000000000LL;
+
+class SharedFileCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    SharedFileCache::SetLimit(16 * 1024);
+    SharedFileCache::ResetStats();
+  }
+
+  virtual void TearDown() {
+    SharedFileCache::SetLimit(0);
+  }
+};
+
+std::vector<uint8_t> CreatePage(int value, size_t size) {
+  return std::vector<uint8_t>(size, static_cast<uint8_t>(value));
+}
+
+}  // namespace
+
+TEST_F(SharedFileCacheTest, OffUntilEnabled) {
+  SharedFileCache::SetLimit(0);
+  EXPECT_TRUE(SharedFileCache::Open(kPath, kFileSize, kFileTime) == NULL);
+}
+
+TEST_F(SharedFileCacheTest, SharesPagesBetweenReaders) {
+  SharedFileCache::File* const a =
+      SharedFileCache::Open(kPath, kFileSize, kFileTime);
+  SharedFileCache::File* const b =
+      SharedFileCache::Open(L"C:\\Media\\Movie.webm", kFileSize, kFileTime);
+
+  ASSERT_TRUE(a != NULL);
+  EXPECT_EQ(a, b);
+
+  const std::vector<uint8_t> page = CreatePage(7, 4096);
+  SharedFileCache::Write(a, 8192, &page[0], 4096);
+
+  std::vector<uint8_t> buf(4096);
+  EXPECT_EQ(4096, SharedFileCache::Read(b, 8192, &buf[0], 4096));
+  EXPECT_EQ(page, buf);
+
+  EXPECT_EQ(-1, SharedFileCache::Read(b, 0, &buf[0], 4096));
+  EXPECT_EQ(-1, SharedFileCache::Read(b, 8192, &buf[0], 1024));  // too small
+
+  SharedFileCache::Stats stats;
+  SharedFileCache::GetStats(&stats);
+
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(4096, stats.bytes);
+  EXPECT_EQ(1, stats.files);
+
+  SharedFileCache::Close(a);
+  SharedFileCache::Close(b);
+}
+
+TEST_F(SharedFileCacheTest, RewrittenFileIsAnotherFile) {
+  SharedFileCache::File* const a =
+      SharedFileCache::Open(kPath, kFileSize, kFileTime);
+  SharedFileCache::File* const b =
+      SharedFileCache::Open(kPath, kFileSize, kFileTime + 1);
+
+  ASSERT_TRUE(a != NULL);
+  ASSERT_TRUE(b != NULL);
+  EXPECT_NE(a, b);
+
+  const std::vector<uint8_t> page = CreatePage(1, 100);
+  SharedFileCache::Write(a, 0, &page[0], 100);
+
+  std::vector<uint8_t> buf(100);
+  EXPECT_EQ(-1, SharedFileCache::Read(b, 0, &buf[0], 100));
+
+  SharedFileCache::Close(a);
+  SharedFileCache::Close(b);
+}
+
+TEST_F(SharedFileCacheTest, EvictsLeastRecentlyUsed) {
+  SharedFileCache::File* const f =
+      SharedFileCache::Open(kPath, kFileSize, kFileTime);
+  ASSERT_TRUE(f != NULL);
+
+  std::vector<uint8_t> buf(4096);
+
+  for (int i = 0; i < 4; ++i) {
+    const std::vector<uint8_t> page = CreatePage(i, 4096);
+    SharedFileCache::Write(f, i * 4096, &page[0], 4096);
+  }
+
+  EXPECT_EQ(4096, SharedFileCache::Read(f, 0, &buf[0], 4096));  // touch 0
+
+  const std::vector<uint8_t> page = CreatePage(4, 4096);
+  SharedFileCache::Write(f, 4 * 4096, &page[0], 4096);  // evicts page 1
+
+  EXPECT_EQ(4096, SharedFileCache::Read(f, 0, &buf[0], 4096));
+  EXPECT_EQ(-1, SharedFileCache::Read(f, 4096, &buf[0], 4096));
+  EXPECT_EQ(4096, SharedFileCache::Read(f, 4 * 4096, &buf[0], 4096));
+
+  SharedFileCache::SetLimit(4096);
+
+  SharedFileCache::Stats stats;
+  SharedFileCache::GetStats(&stats);
+  EXPECT_EQ(4096, stats.bytes);
+
+  SharedFileCache::Close(f);
+}
+
+TEST_F(SharedFileCacheTest, ForgetsFileWithNoReadersOrPages) {
+  SharedFileCache::File* const f =
+      SharedFileCache::Open(kPath, kFileSize, kFileTime);
+  ASSERT_TRUE(f != NULL);
+
+  const std::vector<uint8_t> page = CreatePage(3, 100);
+  SharedFileCache::Write(f, 0, &page[0], 100);
+  SharedFileCache::Close(f);
+
+  SharedFileCache::Stats stats;
+  SharedFileCache::GetStats(&stats);
+  EXPECT_EQ(1, stats.files);  // its page is still cached
+
+  SharedFileCache::SetLimit(0);
+
+  SharedFileCache::GetStats(&stats);
+  EXPECT_EQ(0, stats.files);
+  EXPECT_EQ(0, stats.bytes);
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <uuids.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "shmframering.h"
+
+using webmdshow::ShmFrameRing;
+
+namespace {
+
+// A name no other process is using.
+std::wstring MakeName(const wchar_t* test) {
+  std::wostringstream os;
+  os << L"webmdshow.shmframering." << test << L"." << GetCurrentProcessId();
+  return os.str();
+}
+
+AM_MEDIA_TYPE MakeMediaType(BYTE* format, ULONG format_size) {
+  AM_MEDIA_TYPE mt;
+  memset(&mt, 0, sizeof mt);
+
+  mt.majortype = MEDIATYPE_Video;
+  mt.subtype = MEDIASUBTYPE_YV12;
+  mt.formattype = FORMAT_VideoInfo;
+  mt.bFixedSizeSamples = TRUE;
+  mt.lSampleSize = 4096;
+  mt.cbFormat = format_size;
+  mt.pbFormat = format;
+
+  return mt;
+}
+
+ShmFrameRing::SlotInfo MakeInfo(int i, int length) {
+  ShmFrameRing::SlotInfo info;
+
+  info.start = 1000 * i;
+  info.stop = 1000 * (i + 1);
+  info.media_start = info.media_stop = 0;
+  info.flags = ShmFrameRing::kFlagTime | ShmFrameRing::kFlagSyncPoint;
+  info.length = length;
+
+  return info;
+}
+
+}  // namespace
+
+TEST(ShmFrameRing, OpenNeedsProducer) {
+  ShmFrameRing consumer;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            consumer.Open(MakeName(L"none").c_str()));
+  EXPECT_FALSE(consumer.is_open());
+}
+
+TEST(ShmFrameRing, SharesMediaType) {
+  BYTE format[100];
+
+  for (int i = 0; i < 100; ++i)
+    format[i] = static_cast<BYTE>(i);
+
+  const std::wstring name = MakeName(L"type");
+
+  ShmFrameRing producer;
+  ASSERT_EQ(S_OK, producer.Create(name.c_str(), 4, 5000,
+                                  MakeMediaType(format, 100)));
+
+  // One producer to a name.
+  ShmFrameRing other;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS),
+            other.Create(name.c_str(), 4, 5000, MakeMediaType(format, 100)));
+
+  ShmFrameRing consumer;
+  ASSERT_EQ(S_OK, consumer.Open(name.c_str()));
+  EXPECT_EQ(4, consumer.slot_count());
+  EXPECT_EQ(5000, consumer.slot_size());
+
+  AM_MEDIA_TYPE mt;
+  ASSERT_EQ(S_OK, consumer.GetMediaType(&mt));
+
+  EXPECT_TRUE(mt.majortype == MEDIATYPE_Video);
+  EXPECT_TRUE(mt.subtype == MEDIASUBTYPE_YV12);
+  EXPECT_TRUE(mt.formattype == FORMAT_VideoInfo);
+  EXPECT_EQ(4096u, mt.lSampleSize);
+  ASSERT_EQ(100u, mt.cbFormat);
+  EXPECT_EQ(0, memcmp(format, mt.pbFormat, 100));
+
+  CoTaskMemFree(mt.pbFormat);
+}
+
+TEST(ShmFrameRing, HandsFramesOverInOrder) {
+  const std::wstring name = MakeName(L"order");
+
+  ShmFrameRing producer;
+  ASSERT_EQ(S_OK, producer.Create(name.c_str(), 3, 64,
+                                  MakeMediaType(0, 0)));
+
+  ShmFrameRing consumer;
+  ASSERT_EQ(S_OK, consumer.Open(name.c_str()));
+
+  for (int i = 0; i < 3; ++i) {
+    int slot;
+    ASSERT_EQ(S_OK, producer.ClaimSlot(0, &slot));
+
+    memset(producer.GetSlotData(slot), 'a' + i, 64);
+    ASSERT_EQ(S_OK, producer.PublishSlot(slot, MakeInfo(i, 10 + i)));
+  }
+
+  ASSERT_EQ(S_OK, producer.PublishEndOfStream());
+
+  for (int i = 0; i < 3; ++i) {
+    int slot;
+    ShmFrameRing::SlotInfo info;
+    ASSERT_EQ(S_OK, consumer.TakeSlot(0, &slot, &info));
+
+    EXPECT_EQ(1000 * i, info.start);
+    EXPECT_EQ(10 + i, info.length);
+    EXPECT_EQ('a' + i, consumer.GetSlotData(slot)[63]);
+
+    consumer.FreeSlot(slot);
+  }
+
+  int slot;
+  ShmFrameRing::SlotInfo info;
+  EXPECT_EQ(S_FALSE, consumer.TakeSlot(0, &slot, &info));
+  EXPECT_EQ(ShmFrameRing::kEndOfStream, slot);
+}
+
+TEST(ShmFrameRing, AbortsWaits) {
+  const std::wstring name = MakeName(L"abort");
+
+  ShmFrameRing producer;
+  ASSERT_EQ(S_OK, producer.Create(name.c_str(), 2, 64,
+                                  MakeMediaType(0, 0)));
+
+  ShmFrameRing consumer;
+  ASSERT_EQ(S_OK, consumer.Open(name.c_str()));
+
+  const HANDLE abort = CreateEvent(0, TRUE, TRUE, 0);
+
+  // Nothing published.
+  int slot;
+  ShmFrameRing::SlotInfo info;
+  EXPECT_EQ(E_ABORT, consumer.TakeSlot(abort, &slot, &info));
+
+  // Every slot claimed.
+  int a, b;
+  ASSERT_EQ(S_OK, producer.ClaimSlot(abort, &a));
+  ASSERT_EQ(S_OK, producer.ClaimSlot(abort, &b));
+  EXPECT_NE(a, b);
+  EXPECT_EQ(E_ABORT, producer.ClaimSlot(abort, &slot));
+
+  // A released slot can be claimed again.
+  producer.ReleaseSlot(b);
+  EXPECT_EQ(S_OK, producer.ClaimSlot(abort, &slot));
+  EXPECT_EQ(b, slot);
+
+  CloseHandle(abort);
+}
+
+TEST(ShmFrameRing, ProducerWaitsForConsumer) {
+  const std::wstring name = MakeName(L"threads");
+  const int kFrames = 500;
+
+  ShmFrameRing producer;
+  ASSERT_EQ(S_OK, producer.Create(name.c_str(), 3, 4096,
+                                  MakeMediaType(0, 0)));
+
+  ShmFrameRing consumer;
+  ASSERT_EQ(S_OK, consumer.Open(name.c_str()));
+
+  std::thread thread([&producer, kFrames] {
+    for (int i = 0; i < kFrames; ++i) {
+      int slot;
+
+      if (producer.ClaimSlot(0, &slot) != S_OK)
+        return;
+
+      memcpy(producer.GetSlotData(slot), &i, sizeof i);
+      producer.PublishSlot(slot, MakeInfo(i, sizeof i));
+    }
+
+    producer.PublishEndOfStream();
+  });
+
+  int frames = 0;
+
+  for (;;) {
+    int slot;
+    ShmFrameRing::SlotInfo info;
+    const HRESULT hr = consumer.TakeSlot(0, &slot, &info);
+
+    EXPECT_TRUE(SUCCEEDED(hr));
+
+    if (hr != S_OK)
+      break;
+
+    int value;
+    memcpy(&value, consumer.GetSlotData(slot), sizeof value);
+
+    EXPECT_EQ(frames, value);
+    EXPECT_EQ(1000 * frames, info.start);
+    ++frames;
+
+    consumer.FreeSlot(slot);
+  }
+
+  thread.join();
+  EXPECT_EQ(kFrames, frames);
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "spscbytering.h"
+
+using webmdshow::SpscByteRing;
+
+TEST(SpscByteRing, RoundsCapacityUp) {
+  SpscByteRing ring;
+  ring.Reset(1000);
+
+  EXPECT_EQ(1024u, ring.capacity());
+  EXPECT_EQ(0u, ring.size());
+}
+
+TEST(SpscByteRing, WrapsAround) {
+  SpscByteRing ring;
+  ring.Reset(16);
+
+  uint8_t src[40];
+
+  for (int i = 0; i < 40; ++i)
+    src[i] = static_cast<uint8_t>(i);
+
+  // More than fits: the write is cut short.
+  EXPECT_EQ(16u, ring.Write(src, 40));
+  EXPECT_EQ(0u, ring.Write(src, 1));
+
+  uint8_t dst[40];
+  EXPECT_EQ(10u, ring.Read(dst, 10));
+
+  for (int i = 0; i < 10; ++i)
+    ASSERT_EQ(i, dst[i]);
+
+  // The next write straddles the end of the buffer, so the first peek
+  // stops there.
+  EXPECT_EQ(10u, ring.Write(src + 16, 10));
+  EXPECT_EQ(16u, ring.size());
+
+  const uint8_t* p;
+  EXPECT_EQ(6u, ring.Peek(&p));
+  EXPECT_EQ(10, p[0]);
+
+  EXPECT_EQ(16u, ring.Read(dst, 40));
+
+  for (int i = 0; i < 16; ++i)
+    ASSERT_EQ(10 + i, dst[i]);
+
+  EXPECT_EQ(0u, ring.Peek(&p));
+}
+
+TEST(SpscByteRing, TwoThreads) {
+  SpscByteRing ring;
+  ring.Reset(64);
+
+  const size_t total = 1 << 20;
+  std::vector<uint8_t> received;
+  received.reserve(total);
+
+  std::thread consumer([&ring, &received, total]() {
+    uint8_t buf[37];
+
+    while (received.size() < total) {
+      const size_t n = ring.Read(buf, sizeof buf);
+      received.insert(received.end(), buf, buf + n);
+
+      if (n == 0)
+        std::this_thread::yield();
+    }
+  });
+
+  uint8_t chunk[23];
+  size_t sent = 0;
+
+  while (sent < total) {
+    size_t n = sizeof chunk;
+
+    if (n > total - sent)
+      n = total - sent;
+
+    for (size_t i = 0; i < n; ++i)
+      chunk[i] = static_cast<uint8_t>((sent + i) * 7);
+
+    for (size_t done = 0; done < n;) {
+      const size_t m = ring.Write(chunk + done, n - done);
+      done += m;
+
+      if (m == 0)
+        std::this_thread::yield();
+    }
+
+    sent += n;
+  }
+
+  consumer.join();
+
+  ASSERT_EQ(total, received.size());
+
+  for (size_t i = 0; i < total; ++i)
+    ASSERT_EQ(static_cast<uint8_t>(i * 7), received[i]) << "byte " << i;
+}
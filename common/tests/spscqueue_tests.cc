@@ -0,0 +1,86 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "spscqueue.h"
+
+using webmdshow::SpscQueue;
+
+TEST(SpscQueue, RoundsCapacityUp) {
+  SpscQueue<int> queue(5);
+
+  EXPECT_EQ(8u, queue.capacity());
+  EXPECT_EQ(0u, queue.size());
+}
+
+TEST(SpscQueue, FillsAndWrapsAround) {
+  SpscQueue<int> queue(4);
+
+  for (int i = 0; i < 4; ++i)
+    EXPECT_TRUE(queue.TryPush(i));
+
+  EXPECT_FALSE(queue.TryPush(4));
+  EXPECT_EQ(4u, queue.size());
+
+  int value;
+
+  for (int n = 0; n < 10; ++n) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(n, value);
+    EXPECT_TRUE(queue.TryPush(n + 4));
+  }
+
+  const int* first;
+  ASSERT_TRUE(queue.Peek(&first));
+  EXPECT_EQ(10, *first);
+  EXPECT_EQ(4u, queue.size());
+
+  for (int n = 10; n < 14; ++n) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(n, value);
+  }
+
+  EXPECT_FALSE(queue.TryPop(&value));
+  EXPECT_FALSE(queue.Peek(&first));
+}
+
+TEST(SpscQueue, ProducerAndConsumerThreads) {
+  SpscQueue<int> queue(64);
+  enum { kCount = 1000000 };
+
+  std::thread producer([&queue]() {
+    for (int i = 0; i < kCount; ++i) {
+      while (!queue.TryPush(i))
+        std::this_thread::yield();
+    }
+  });
+
+  int expected = 0;
+  bool in_order = true;
+
+  while (expected < kCount) {
+    int value;
+
+    if (!queue.TryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (value != expected)
+      in_order = false;
+
+    ++expected;
+  }
+
+  producer.join();
+
+  EXPECT_TRUE(in_order);
+  EXPECT_EQ(0u, queue.size());
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tailfollower.h"
+
+using webmdshow::TailFollower;
+
+namespace {
+
+// A file in the temp directory, written as webmmux writes a live file:
+// appended to through a handle that shares reads and writes.
+class TailFollowerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    wchar_t dir[MAX_PATH];
+    ASSERT_NE(0u, GetTempPathW(MAX_PATH, dir));
+
+    wchar_t path[MAX_PATH];
+    ASSERT_NE(0u, GetTempFileNameW(dir, L"tf", 0, path));
+    path_ = path;
+
+    writer_ = CreateFileW(path, GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ASSERT_NE(INVALID_HANDLE_VALUE, writer_);
+  }
+
+  virtual void TearDown() {
+    CloseWriter();
+    DeleteFileW(path_.c_str());
+  }
+
+  void Append(int value, DWORD size) {
+    const std::vector<char> buf(size, static_cast<char>(value));
+    DWORD written;
+    ASSERT_TRUE(WriteFile(writer_, &buf[0], size, &written, NULL) != 0);
+    ASSERT_EQ(size, written);
+  }
+
+  void CloseWriter() {
+    if (writer_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(writer_);
+      writer_ = INVALID_HANDLE_VALUE;
+    }
+  }
+
+  std::wstring path_;
+  HANDLE writer_;
+};
+
+}  // namespace
+
+TEST_F(TailFollowerTest, KnowsWhetherTheFileIsBeingWritten) {
+  EXPECT_TRUE(TailFollower::IsBeingWritten(path_.c_str()));
+
+  CloseWriter();
+  EXPECT_FALSE(TailFollower::IsBeingWritten(path_.c_str()));
+}
+
+TEST_F(TailFollowerTest, ReadsWhatHasBeenWritten) {
+  Append(1, 4096);
+
+  TailFollower follower;
+  ASSERT_TRUE(follower.Open(path_.c_str()));
+  EXPECT_EQ(4096, follower.GetSize());
+  EXPECT_FALSE(follower.IsFinished());
+
+  Append(2, 100);
+  EXPECT_EQ(4196, follower.GetSize());
+
+  std::vector<char> buf(200);
+  EXPECT_EQ(100, follower.Read(4096, 200, &buf[0]));
+  EXPECT_EQ(2, buf[0]);
+  EXPECT_EQ(2, buf[99]);
+
+  EXPECT_EQ(1, follower.Read(4095, 1, &buf[0]));
+  EXPECT_EQ(1, buf[0]);
+}
+
+TEST_F(TailFollowerTest, WaitsForTheFileToGrow) {
+  TailFollower follower;
+  ASSERT_TRUE(follower.Open(path_.c_str()));
+
+  EXPECT_EQ(TailFollower::kTimedOut, follower.WaitForSize(1000, 50));
+
+  std::thread writer([this]() {
+    Sleep(50);
+    Append(3, 1000);
+  });
+
+  EXPECT_EQ(TailFollower::kReached, follower.WaitForSize(1000, 10000));
+  writer.join();
+
+  TailFollower::Stats stats;
+  follower.GetStats(&stats);
+  EXPECT_EQ(2, stats.waits);
+}
+
+TEST_F(TailFollowerTest, FinishesWhenTheWriterCloses) {
+  Append(4, 10);
+
+  TailFollower follower;
+  ASSERT_TRUE(follower.Open(path_.c_str()));
+
+  std::thread writer([this]() {
+    Sleep(50);
+    CloseWriter();
+  });
+
+  EXPECT_EQ(TailFollower::kFinished, follower.WaitForSize(1000, 10000));
+  writer.join();
+
+  EXPECT_TRUE(follower.IsFinished());
+  EXPECT_EQ(TailFollower::kReached, follower.WaitForSize(10, 0));
+}
+
+TEST_F(TailFollowerTest, CancelEndsWaitsUntilResumed) {
+  TailFollower follower;
+  ASSERT_TRUE(follower.Open(path_.c_str()));
+
+  std::thread canceller([&follower]() {
+    Sleep(50);
+    follower.Cancel();
+  });
+
+  EXPECT_EQ(TailFollower::kCancelled, follower.WaitForSize(1, INFINITE));
+  canceller.join();
+
+  EXPECT_EQ(TailFollower::kCancelled, follower.WaitForSize(1, 0));
+
+  follower.Resume();
+  EXPECT_EQ(TailFollower::kTimedOut, follower.WaitForSize(1, 0));
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <atomic>
+#include <cstdio>
+
+#include "gtest/gtest.h"
+#include "taskpool.h"
+
+using webmdshow::TaskGroup;
+using webmdshow::TaskPool;
+
+TEST(TaskPool, RunsEveryTask) {
+  TaskPool pool(4);
+  EXPECT_EQ(4, pool.thread_count());
+
+  std::atomic<int> sum(0);
+
+  {
+    TaskGroup group(pool);
+
+    for (int i = 1; i <= 1000; ++i)
+      group.Run([&sum, i]() { sum += i; });
+
+    group.Wait();
+    EXPECT_EQ(500500, sum);
+  }
+
+  TaskPool::Stats stats;
+  pool.GetStats(&stats);
+  EXPECT_EQ(4, stats.threads);
+  EXPECT_EQ(1000, stats.tasks);
+}
+
+// A task that waits on a group of its own must not tie up its worker,
+// even in a pool of one.
+TEST(TaskPool, NestedGroups) {
+  TaskPool pool(1);
+  std::atomic<int> count(0);
+
+  TaskGroup outer(pool);
+
+  for (int i = 0; i < 8; ++i) {
+    outer.Run([&pool, &count]() {
+      TaskGroup inner(pool);
+
+      for (int j = 0; j < 8; ++j)
+        inner.Run([&count]() { ++count; });
+
+      inner.Wait();
+    });
+  }
+
+  outer.Wait();
+  EXPECT_EQ(64, count);
+}
+
+TEST(TaskPool, DestructorRunsQueuedTasks) {
+  std::atomic<int> count(0);
+
+  {
+    TaskPool pool(2);
+
+    for (int i = 0; i < 100; ++i)
+      pool.Submit([&count]() { ++count; });
+  }
+
+  EXPECT_EQ(100, count);
+}
+
+// Not a pass/fail test: reports how busy the workers were kept by many
+// small tasks, and how many of them moved between queues.
+TEST(TaskPool, Utilization) {
+  TaskPool pool(0);
+  TaskGroup group(pool);
+
+  for (int i = 0; i < 2000; ++i) {
+    group.Run([]() {
+      volatile double x = 0;
+      for (int n = 0; n < 20000; ++n)
+        x += n * 0.5;
+    });
+  }
+
+  group.Wait();
+
+  TaskPool::Stats stats;
+  pool.GetStats(&stats);
+
+  printf("%d threads: %lld tasks, %lld stolen, %.0f%% busy\n",
+         stats.threads, static_cast<long long>(stats.tasks),
+         static_cast<long long>(stats.steals),
+         pool.GetUtilization() * 100);
+}
@@ -0,0 +1,198 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tensorexport.h"
+#include "vpx/vpx_image.h"
+#include "yuvtorgb.h"
+
+using webmdshow::TensorExporter;
+using webmdshow::TensorParams;
+
+namespace {
+
+// Odd sizes, so that the rows have tails past the SIMD kernels.
+const int kWidth = 75;
+const int kHeight = 41;
+
+vpx_image_t* MakeFrame(bool flat_chroma) {
+  vpx_image_t* const f =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I420, kWidth, kHeight, 16);
+
+  if (f == NULL)
+    return NULL;
+
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x) {
+      f->planes[VPX_PLANE_Y][y * f->stride[VPX_PLANE_Y] + x] =
+          static_cast<uint8_t>(rand());
+    }
+  }
+
+  for (int y = 0; y < (kHeight + 1) / 2; ++y) {
+    for (int x = 0; x < (kWidth + 1) / 2; ++x) {
+      f->planes[VPX_PLANE_U][y * f->stride[VPX_PLANE_U] + x] =
+          static_cast<uint8_t>(flat_chroma ? 100 : rand());
+      f->planes[VPX_PLANE_V][y * f->stride[VPX_PLANE_V] + x] =
+          static_cast<uint8_t>(flat_chroma ? 150 : rand());
+    }
+  }
+
+  return f;
+}
+
+// At the frame's own size, with chroma that doesn't vary, the export is the
+// RGB32 conversion over 255, up to the rounding of the fixed-point one.
+TEST(TensorExportTest, MatchesRgbConversion) {
+  vpx_image_t* const f = MakeFrame(true);
+  ASSERT_TRUE(f != NULL);
+
+  TensorParams params;
+  params.width = kWidth;
+  params.height = kHeight;
+
+  TensorExporter exporter;
+  exporter.set_params(params);
+
+  std::vector<float> tensor(webmdshow::GetTensorFrameSize(params));
+  ASSERT_TRUE(exporter.Export(f, &tensor[0], 0));
+
+  std::vector<uint8_t> rgb(4 * kWidth * kHeight);
+  webmdshow::I420ToRgb32(
+      f->planes[VPX_PLANE_Y], f->stride[VPX_PLANE_Y],
+      f->planes[VPX_PLANE_U], f->stride[VPX_PLANE_U],
+      f->planes[VPX_PLANE_V], f->stride[VPX_PLANE_V],
+      webmdshow::GetYuvToRgbConstants(params.matrix, params.range),
+      &rgb[0], 4 * kWidth, kWidth, kHeight);
+
+  const size_t plane = kWidth * kHeight;
+
+  for (size_t i = 0; i < plane; ++i) {
+    ASSERT_NEAR(rgb[4 * i + 2] / 255.0f, tensor[i], 1.01f / 255);
+    ASSERT_NEAR(rgb[4 * i + 1] / 255.0f, tensor[plane + i], 1.01f / 255);
+    ASSERT_NEAR(rgb[4 * i + 0] / 255.0f, tensor[2 * plane + i], 1.01f / 255);
+  }
+
+  vpx_img_free(f);
+}
+
+// Scaled, the output stays within the colours of the source, and a frame
+// of one colour stays that colour.
+TEST(TensorExportTest, ScalesFlatFrame) {
+  vpx_image_t* const f = MakeFrame(true);
+  ASSERT_TRUE(f != NULL);
+
+  for (int y = 0; y < kHeight; ++y)
+    memset(f->planes[VPX_PLANE_Y] + y * f->stride[VPX_PLANE_Y], 120, kWidth);
+
+  TensorParams params;
+  params.width = 32;
+  params.height = 17;
+
+  TensorExporter exporter;
+  exporter.set_params(params);
+
+  std::vector<float> tensor(webmdshow::GetTensorFrameSize(params));
+  ASSERT_TRUE(exporter.Export(f, &tensor[0], 0));
+
+  const size_t plane = params.width * params.height;
+
+  for (int c = 0; c < 3; ++c) {
+    for (size_t i = 1; i < plane; ++i)
+      ASSERT_EQ(tensor[c * plane], tensor[c * plane + i]);
+  }
+
+  vpx_img_free(f);
+}
+
+TEST(TensorExportTest, Normalizes) {
+  vpx_image_t* const f = MakeFrame(false);
+  ASSERT_TRUE(f != NULL);
+
+  TensorParams params;
+  params.width = 40;
+  params.height = 30;
+
+  TensorExporter plain;
+  plain.set_params(params);
+
+  const float kMean[3] = { 0.485f, 0.456f, 0.406f };
+  const float kStd[3] = { 0.229f, 0.224f, 0.225f };
+
+  for (int c = 0; c < 3; ++c) {
+    params.mean[c] = kMean[c];
+    params.std[c] = kStd[c];
+  }
+
+  TensorExporter normalized;
+  normalized.set_params(params);
+
+  const size_t size = webmdshow::GetTensorFrameSize(params);
+  std::vector<float> a(size), b(size);
+
+  ASSERT_TRUE(plain.Export(f, &a[0], 0));
+  ASSERT_TRUE(normalized.Export(f, &b[0], 0));
+
+  const size_t plane = size / 3;
+
+  for (size_t i = 0; i < size; ++i) {
+    const int c = static_cast<int>(i / plane);
+    ASSERT_NEAR((a[i] - kMean[c]) / kStd[c], b[i], 1e-4f);
+  }
+
+  vpx_img_free(f);
+}
+
+// Frames of a batch go at consecutive offsets, without touching the rest.
+TEST(TensorExportTest, WritesBatchFrame) {
+  vpx_image_t* const f = MakeFrame(false);
+  ASSERT_TRUE(f != NULL);
+
+  TensorParams params;
+  params.width = 16;
+  params.height = 12;
+
+  TensorExporter exporter;
+  exporter.set_params(params);
+
+  const size_t size = webmdshow::GetTensorFrameSize(params);
+  std::vector<float> batch(3 * size, -7.0f);
+  std::vector<float> single(size);
+
+  ASSERT_TRUE(exporter.Export(f, &batch[0], 1));
+  ASSERT_TRUE(exporter.Export(f, &single[0], 0));
+
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_EQ(-7.0f, batch[i]);
+    ASSERT_EQ(single[i], batch[size + i]);
+    ASSERT_EQ(-7.0f, batch[2 * size + i]);
+  }
+
+  vpx_img_free(f);
+}
+
+TEST(TensorExportTest, RejectsOtherFormats) {
+  vpx_image_t* const f =
+      vpx_img_alloc(NULL, VPX_IMG_FMT_I42016, kWidth, kHeight, 16);
+  ASSERT_TRUE(f != NULL);
+
+  TensorExporter exporter;
+  std::vector<float> tensor(
+      webmdshow::GetTensorFrameSize(exporter.params()));
+
+  EXPECT_FALSE(exporter.Export(f, &tensor[0], 0));
+
+  vpx_img_free(f);
+}
+
+}  // namespace
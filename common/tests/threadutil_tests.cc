@@ -0,0 +1,75 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include "gtest/gtest.h"
+#include "threadutil.h"
+
+using WebmMfUtil::ThreadPolicyScope;
+
+TEST(ThreadUtilTest, ParsesClassNames) {
+  EXPECT_EQ(WebmMfUtil::kThreadClassPlayback,
+            WebmMfUtil::ParseThreadClass(L"Playback",
+                                         WebmMfUtil::kThreadClassNormal));
+  EXPECT_EQ(WebmMfUtil::kThreadClassProAudio,
+            WebmMfUtil::ParseThreadClass(L"pro audio",
+                                         WebmMfUtil::kThreadClassNormal));
+  EXPECT_EQ(WebmMfUtil::kThreadClassBackground,
+            WebmMfUtil::ParseThreadClass(L"BACKGROUND",
+                                         WebmMfUtil::kThreadClassNormal));
+  EXPECT_EQ(WebmMfUtil::kThreadClassCapture,
+            WebmMfUtil::ParseThreadClass(L"Games",
+                                         WebmMfUtil::kThreadClassCapture));
+  EXPECT_EQ(WebmMfUtil::kThreadClassNormal,
+            WebmMfUtil::ParseThreadClass(NULL,
+                                         WebmMfUtil::kThreadClassNormal));
+}
+
+TEST(ThreadUtilTest, UnconfiguredComponentGetsTheDefault) {
+  EXPECT_EQ(WebmMfUtil::kThreadClassPlayback,
+            WebmMfUtil::GetThreadClass(L"threadutil_tests.unconfigured",
+                                       WebmMfUtil::kThreadClassPlayback));
+}
+
+TEST(ThreadUtilTest, NormalClassLeavesTheThreadAlone) {
+  const int priority = GetThreadPriority(GetCurrentThread());
+  {
+    const ThreadPolicyScope policy(L"threadutil_tests.unconfigured",
+                                   WebmMfUtil::kThreadClassNormal);
+    EXPECT_EQ(WebmMfUtil::kThreadClassNormal, policy.thread_class());
+    EXPECT_FALSE(policy.mmcss_registered());
+    EXPECT_EQ(priority, GetThreadPriority(GetCurrentThread()));
+  }
+  EXPECT_EQ(priority, GetThreadPriority(GetCurrentThread()));
+}
+
+TEST(ThreadUtilTest, MediaClassRevertsWhenTheScopeEnds) {
+  const int priority = GetThreadPriority(GetCurrentThread());
+  {
+    const ThreadPolicyScope policy(L"threadutil_tests.unconfigured",
+                                   WebmMfUtil::kThreadClassPlayback);
+    EXPECT_EQ(WebmMfUtil::kThreadClassPlayback, policy.thread_class());
+
+    // Either MMCSS took the thread, or its priority was raised.
+    if (!policy.mmcss_registered())
+      EXPECT_LT(priority, GetThreadPriority(GetCurrentThread()));
+  }
+  EXPECT_EQ(priority, GetThreadPriority(GetCurrentThread()));
+}
+
+TEST(ThreadUtilTest, BackgroundClassRevertsWhenTheScopeEnds) {
+  const int priority = GetThreadPriority(GetCurrentThread());
+  {
+    const ThreadPolicyScope policy(L"threadutil_tests.unconfigured",
+                                   WebmMfUtil::kThreadClassBackground);
+    EXPECT_EQ(WebmMfUtil::kThreadClassBackground, policy.thread_class());
+    EXPECT_FALSE(policy.mmcss_registered());
+  }
+  EXPECT_EQ(priority, GetThreadPriority(GetCurrentThread()));
+}
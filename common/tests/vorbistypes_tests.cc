@@ -0,0 +1,140 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <vector>
+
+#include "vorbistypes.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+const long kMaxPackets = 256;
+
+// Laces |sizes.size()| packets, each filled with its index, the way the
+// splitter does.
+std::vector<BYTE> Lace(const std::vector<long>& sizes) {
+  std::vector<BYTE> buf;
+  buf.push_back(static_cast<BYTE>(sizes.size() - 1));
+
+  for (size_t i = 0; i + 1 < sizes.size(); ++i) {
+    long len = sizes[i];
+
+    while (len >= 255) {
+      buf.push_back(255);
+      len -= 255;
+    }
+
+    buf.push_back(static_cast<BYTE>(len));
+  }
+
+  for (size_t i = 0; i < sizes.size(); ++i)
+    buf.insert(buf.end(), sizes[i], static_cast<BYTE>(i));
+
+  return buf;
+}
+
+TEST(VorbisTypesTest, SplitsLacedPackets) {
+  std::vector<long> sizes;
+  sizes.push_back(100);
+  sizes.push_back(255);  // needs a trailing zero byte
+  sizes.push_back(600);
+  sizes.push_back(40);   // last: its size is implied
+
+  const std::vector<BYTE> buf = Lace(sizes);
+
+  const BYTE* packets[kMaxPackets];
+  long lengths[kMaxPackets];
+
+  const long n = VorbisTypes::GetXiphLacedPackets(
+      &buf[0], static_cast<long>(buf.size()), packets, lengths, kMaxPackets);
+
+  ASSERT_EQ(4, n);
+
+  for (long i = 0; i < n; ++i) {
+    EXPECT_EQ(sizes[i], lengths[i]);
+    EXPECT_EQ(static_cast<BYTE>(i), packets[i][0]);
+    EXPECT_EQ(static_cast<BYTE>(i), packets[i][lengths[i] - 1]);
+  }
+
+  EXPECT_EQ(&buf[0] + buf.size(), packets[3] + lengths[3]);
+}
+
+TEST(VorbisTypesTest, SinglePacketHasNoSizes) {
+  const BYTE buf[] = { 0, 7, 8, 9 };
+
+  const BYTE* packets[kMaxPackets];
+  long lengths[kMaxPackets];
+
+  ASSERT_EQ(1, VorbisTypes::GetXiphLacedPackets(
+                   buf, sizeof(buf), packets, lengths, kMaxPackets));
+  EXPECT_EQ(3, lengths[0]);
+  EXPECT_EQ(buf + 1, packets[0]);
+}
+
+TEST(VorbisTypesTest, RejectsMalformedSamples) {
+  const BYTE* packets[kMaxPackets];
+  long lengths[kMaxPackets];
+
+  // Sizes run past the end of the sample.
+  const BYTE truncated[] = { 1, 255, 255 };
+  EXPECT_EQ(-1, VorbisTypes::GetXiphLacedPackets(
+                    truncated, sizeof(truncated), packets, lengths,
+                    kMaxPackets));
+
+  // The sizes add up to more than the sample holds.
+  const BYTE short_data[] = { 1, 10, 1, 2, 3 };
+  EXPECT_EQ(-1, VorbisTypes::GetXiphLacedPackets(
+                    short_data, sizeof(short_data), packets, lengths,
+                    kMaxPackets));
+
+  // More packets than the caller has room for.
+  std::vector<long> sizes(3, 1);
+  const std::vector<BYTE> buf = Lace(sizes);
+  EXPECT_EQ(-1, VorbisTypes::GetXiphLacedPackets(
+                    &buf[0], static_cast<long>(buf.size()), packets, lengths,
+                    2));
+
+  EXPECT_EQ(-1, VorbisTypes::GetXiphLacedPackets(
+                    0, 0, packets, lengths, kMaxPackets));
+}
+
+TEST(VorbisTypesTest, MapsChannelsToWaveOrder) {
+  EXPECT_TRUE(VorbisTypes::GetWaveChannelOrder(1) == NULL);
+  EXPECT_TRUE(VorbisTypes::GetWaveChannelOrder(2) == NULL);
+  EXPECT_TRUE(VorbisTypes::GetWaveChannelOrder(4) == NULL);
+  EXPECT_TRUE(VorbisTypes::GetWaveChannelOrder(9) == NULL);
+
+  // Vorbis 5.1 is FL FC FR BL BR LFE; WAVE is FL FR FC LFE BL BR.
+  const int* const order = VorbisTypes::GetWaveChannelOrder(6);
+  ASSERT_TRUE(order != NULL);
+
+  const int expected[] = { 0, 2, 1, 5, 3, 4 };
+
+  for (int i = 0; i < 6; ++i)
+    EXPECT_EQ(expected[i], order[i]) << i;
+
+  // Each Vorbis channel is read once.
+  for (long channels = 3; channels <= 8; ++channels) {
+    const int* const p = VorbisTypes::GetWaveChannelOrder(channels);
+
+    if (p == NULL)
+      continue;
+
+    std::vector<bool> seen(channels, false);
+
+    for (long i = 0; i < channels; ++i) {
+      ASSERT_TRUE(p[i] >= 0 && p[i] < channels);
+      EXPECT_FALSE(seen[p[i]]);
+      seen[p[i]] = true;
+    }
+  }
+}
+
+}  // namespace
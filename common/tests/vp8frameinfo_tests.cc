@@ -0,0 +1,272 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "vp8frameinfo.h"
+
+using webmdshow::Vp8FrameInfo;
+
+namespace {
+
+// The boolean entropy encoder of RFC 6386, section 7.3, for building frame
+// headers to parse.
+class BoolEncoder {
+ public:
+  BoolEncoder() : range_(255), bottom_(0), bit_count_(24) {}
+
+  void WriteBool(int prob, bool bit) {
+    const uint32_t split = 1 + (((range_ - 1) * prob) >> 8);
+
+    if (bit) {
+      bottom_ += split;
+      range_ -= split;
+    } else {
+      range_ = split;
+    }
+
+    while (range_ < 128) {
+      range_ <<= 1;
+
+      if (bottom_ & (1u << 31))
+        AddOneToOutput();
+
+      bottom_ <<= 1;
+
+      if (!--bit_count_) {
+        out_.push_back(static_cast<uint8_t>(bottom_ >> 24));
+        bottom_ &= (1 << 24) - 1;
+        bit_count_ = 8;
+      }
+    }
+  }
+
+  void WriteLiteral(uint32_t v, int bits) {
+    while (bits-- > 0)
+      WriteBool(128, ((v >> bits) & 1) != 0);
+  }
+
+  std::vector<uint8_t> Finish() {
+    int c = bit_count_;
+    uint32_t v = bottom_;
+
+    if (v & (1u << (32 - c)))
+      AddOneToOutput();
+
+    v <<= c & 7;
+    c >>= 3;
+
+    while (--c >= 0)
+      v <<= 8;
+
+    for (c = 0; c < 4; ++c) {
+      out_.push_back(static_cast<uint8_t>(v >> 24));
+      v <<= 8;
+    }
+
+    return out_;
+  }
+
+ private:
+  void AddOneToOutput() {
+    size_t i = out_.size();
+
+    while (i > 0 && out_[i - 1] == 255)
+      out_[--i] = 0;
+
+    if (i > 0)
+      ++out_[i - 1];
+  }
+
+  std::vector<uint8_t> out_;
+  uint32_t range_;
+  uint32_t bottom_;
+  int bit_count_;
+};
+
+struct InterHeader {
+  bool update_map;
+  bool lf_delta_update;
+  bool refresh_golden;
+  bool refresh_alt;
+  uint32_t copy_to_golden;
+  bool refresh_entropy_probs;
+  bool refresh_last;
+};
+
+std::vector<uint8_t> MakeInterFrame(const InterHeader& h) {
+  BoolEncoder e;
+
+  e.WriteLiteral(h.update_map ? 1 : 0, 1);  // segmentation_enabled
+
+  if (h.update_map) {
+    e.WriteLiteral(1, 1);  // update_mb_segmentation_map
+    e.WriteLiteral(0, 1);  // update_segment_feature_data
+    e.WriteLiteral(1, 1);  // segment_prob_update
+    e.WriteLiteral(200, 8);
+    e.WriteLiteral(0, 1);
+    e.WriteLiteral(0, 1);
+  }
+
+  e.WriteLiteral(0, 1);   // filter_type
+  e.WriteLiteral(32, 6);  // loop_filter_level
+  e.WriteLiteral(0, 3);   // sharpness_level
+
+  e.WriteLiteral(1, 1);  // loop_filter_adj_enable
+  e.WriteLiteral(h.lf_delta_update ? 1 : 0, 1);
+
+  if (h.lf_delta_update) {
+    for (int i = 0; i < 8; ++i) {
+      e.WriteLiteral(1, 1);
+      e.WriteLiteral(i, 6);
+      e.WriteLiteral(i & 1, 1);
+    }
+  }
+
+  e.WriteLiteral(0, 2);   // log2_nbr_of_dct_partitions
+  e.WriteLiteral(60, 7);  // y_ac_qi
+
+  for (int i = 0; i < 5; ++i) {
+    e.WriteLiteral(1, 1);
+    e.WriteLiteral(i + 1, 4);
+    e.WriteLiteral(1, 1);
+  }
+
+  e.WriteLiteral(h.refresh_golden ? 1 : 0, 1);
+  e.WriteLiteral(h.refresh_alt ? 1 : 0, 1);
+
+  if (!h.refresh_golden)
+    e.WriteLiteral(h.copy_to_golden, 2);
+
+  if (!h.refresh_alt)
+    e.WriteLiteral(0, 2);  // copy_buffer_to_alternate
+
+  e.WriteLiteral(1, 1);  // sign_bias_golden
+  e.WriteLiteral(0, 1);  // sign_bias_alternate
+  e.WriteLiteral(h.refresh_entropy_probs ? 1 : 0, 1);
+  e.WriteLiteral(h.refresh_last ? 1 : 0, 1);
+
+  // Some of what follows in a real frame, to pad the partition.
+  for (int i = 0; i < 64; ++i)
+    e.WriteBool(200, (i % 3) == 0);
+
+  const std::vector<uint8_t> part = e.Finish();
+
+  const uint32_t tag = 1 |                     // inter frame
+                       (1 << 4) |              // show_frame
+                       (static_cast<uint32_t>(part.size()) << 5);
+
+  std::vector<uint8_t> frame;
+  frame.push_back(static_cast<uint8_t>(tag));
+  frame.push_back(static_cast<uint8_t>(tag >> 8));
+  frame.push_back(static_cast<uint8_t>(tag >> 16));
+  frame.insert(frame.end(), part.begin(), part.end());
+  frame.resize(frame.size() + 16, 0);  // residual partition
+
+  return frame;
+}
+
+InterHeader NonReferenceHeader() {
+  const InterHeader h = {false, false, false, false, 0, false, false};
+  return h;
+}
+
+bool IsDroppable(const InterHeader& h) {
+  const std::vector<uint8_t> frame = MakeInterFrame(h);
+
+  Vp8FrameInfo info;
+  EXPECT_TRUE(webmdshow::ParseVp8FrameInfo(&frame[0], frame.size(), &info));
+  EXPECT_FALSE(info.key_frame);
+  EXPECT_TRUE(info.show_frame);
+
+  return info.droppable;
+}
+
+}  // namespace
+
+TEST(Vp8FrameInfo, KeyFrame) {
+  // first partition of 4 bytes, show_frame set
+  const uint8_t frame[] = {0x90, 0x00, 0x00, 0x9D, 0x01, 0x2A, 0x40, 0x01,
+                           0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+  Vp8FrameInfo info;
+  ASSERT_TRUE(webmdshow::ParseVp8FrameInfo(frame, sizeof(frame), &info));
+  EXPECT_TRUE(info.key_frame);
+  EXPECT_TRUE(info.show_frame);
+  EXPECT_FALSE(info.droppable);
+  EXPECT_EQ(0, info.filter_level);
+}
+
+TEST(Vp8FrameInfo, FilterLevel) {
+  const std::vector<uint8_t> frame = MakeInterFrame(NonReferenceHeader());
+
+  Vp8FrameInfo info;
+  ASSERT_TRUE(webmdshow::ParseVp8FrameInfo(&frame[0], frame.size(), &info));
+  EXPECT_EQ(32, info.filter_level);
+
+  InterHeader h = NonReferenceHeader();
+  h.update_map = true;
+  const std::vector<uint8_t> segmented = MakeInterFrame(h);
+
+  ASSERT_TRUE(webmdshow::ParseVp8FrameInfo(&segmented[0], segmented.size(),
+                                           &info));
+  EXPECT_EQ(32, info.filter_level);
+}
+
+TEST(Vp8FrameInfo, RejectsBadInput) {
+  Vp8FrameInfo info;
+
+  const uint8_t short_frame[] = {0x51, 0x00};
+  EXPECT_FALSE(webmdshow::ParseVp8FrameInfo(short_frame, sizeof(short_frame),
+                                            &info));
+
+  // key frame with a bad start code
+  const uint8_t bad_key[] = {0x10, 0x00, 0x00, 0x9D, 0x01, 0x2B,
+                             0x40, 0x01, 0xF0, 0x00};
+  EXPECT_FALSE(webmdshow::ParseVp8FrameInfo(bad_key, sizeof(bad_key), &info));
+
+  // inter frame whose first partition is larger than the frame
+  const uint8_t truncated[] = {0x31, 0x02, 0x00, 0x00, 0x00};
+  EXPECT_FALSE(webmdshow::ParseVp8FrameInfo(truncated, sizeof(truncated),
+                                            &info));
+}
+
+TEST(Vp8FrameInfo, NonReferenceInterFrameIsDroppable) {
+  EXPECT_TRUE(IsDroppable(NonReferenceHeader()));
+}
+
+TEST(Vp8FrameInfo, StateChangesAreNotDroppable) {
+  InterHeader h = NonReferenceHeader();
+  h.refresh_last = true;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.refresh_golden = true;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.refresh_alt = true;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.copy_to_golden = 1;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.refresh_entropy_probs = true;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.update_map = true;
+  EXPECT_FALSE(IsDroppable(h));
+
+  h = NonReferenceHeader();
+  h.lf_delta_update = true;
+  EXPECT_FALSE(IsDroppable(h));
+}
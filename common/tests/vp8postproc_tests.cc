@@ -0,0 +1,155 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "vp8postproc.h"
+
+using webmdshow::Vp8Postprocessor;
+
+namespace {
+
+// An I420 frame in a buffer of its own.
+class Frame {
+ public:
+  Frame(int w, int h) : buf_(w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2)) {
+    memset(&image_, 0, sizeof image_);
+
+    image_.fmt = VPX_IMG_FMT_I420;
+    image_.w = image_.d_w = w;
+    image_.h = image_.d_h = h;
+
+    image_.planes[VPX_PLANE_Y] = &buf_[0];
+    image_.planes[VPX_PLANE_U] = &buf_[w * h];
+    image_.planes[VPX_PLANE_V] =
+        image_.planes[VPX_PLANE_U] + ((w + 1) / 2) * ((h + 1) / 2);
+
+    image_.stride[VPX_PLANE_Y] = w;
+    image_.stride[VPX_PLANE_U] = (w + 1) / 2;
+    image_.stride[VPX_PLANE_V] = (w + 1) / 2;
+  }
+
+  vpx_image_t* get() { return &image_; }
+
+  uint8_t& y(int x, int row) {
+    return image_.planes[VPX_PLANE_Y][row * image_.stride[VPX_PLANE_Y] + x];
+  }
+
+  const std::vector<uint8_t>& buf() const { return buf_; }
+
+ private:
+  std::vector<uint8_t> buf_;
+  vpx_image_t image_;
+};
+
+vp8_postproc_cfg_t MakeConfig(int flags, int deblock, int noise) {
+  vp8_postproc_cfg_t cfg;
+  cfg.post_proc_flag = flags;
+  cfg.deblocking_level = deblock;
+  cfg.noise_level = noise;
+  return cfg;
+}
+
+// Blocks of 8 by 8 pixels, alternately |a| and |b|.
+void FillBlocks(Frame* f, int w, int h, uint8_t a, uint8_t b) {
+  for (int row = 0; row < h; ++row) {
+    for (int x = 0; x < w; ++x)
+      f->y(x, row) = (((x / 8) + (row / 8)) & 1) ? b : a;
+  }
+}
+
+}  // namespace
+
+TEST(Vp8Postprocessor, IsEnabled) {
+  EXPECT_FALSE(Vp8Postprocessor::IsEnabled(MakeConfig(0, 8, 8)));
+  EXPECT_TRUE(Vp8Postprocessor::IsEnabled(MakeConfig(VP8_DEBLOCK, 0, 0)));
+  EXPECT_TRUE(Vp8Postprocessor::IsEnabled(MakeConfig(VP8_ADDNOISE, 0, 4)));
+}
+
+TEST(Vp8Postprocessor, DeblockSmoothsBlockEdges) {
+  Frame f(32, 32);
+  FillBlocks(&f, 32, 32, 100, 104);
+
+  Vp8Postprocessor pp;
+  pp.Process(MakeConfig(VP8_DEBLOCK, 0, 0), 40, f.get());
+
+  // Either side of the edge between two blocks moves towards the other.
+  EXPECT_GT(f.y(7, 3), 100);
+  EXPECT_LT(f.y(8, 3), 104);
+
+  // Away from the edges, the blocks keep their level.
+  EXPECT_EQ(100, f.y(3, 3));
+  EXPECT_EQ(104, f.y(11, 3));
+}
+
+TEST(Vp8Postprocessor, DeblockKeepsRealEdges) {
+  Frame f(32, 32);
+  FillBlocks(&f, 32, 32, 40, 200);
+
+  const std::vector<uint8_t> before = f.buf();
+
+  Vp8Postprocessor pp;
+  pp.Process(MakeConfig(VP8_DEBLOCK, 0, 0), 40, f.get());
+
+  EXPECT_TRUE(before == f.buf());
+}
+
+TEST(Vp8Postprocessor, NoLoopFilterNoDeblock) {
+  Frame f(32, 16);
+  FillBlocks(&f, 32, 16, 100, 104);
+
+  const std::vector<uint8_t> before = f.buf();
+
+  Vp8Postprocessor pp;
+  pp.Process(MakeConfig(VP8_DEBLOCK, 0, 0), 0, f.get());
+
+  EXPECT_TRUE(before == f.buf());
+
+  // The deblocking level strengthens VP8_DEMACROBLOCK past that.
+  pp.Process(MakeConfig(VP8_DEMACROBLOCK, 16, 0), 0, f.get());
+
+  EXPECT_FALSE(before == f.buf());
+}
+
+TEST(Vp8Postprocessor, NoiseIsBounded) {
+  const int w = 64;
+  const int h = 16;
+
+  Frame f(w, h);
+
+  for (int row = 0; row < h; ++row) {
+    for (int x = 0; x < w; ++x)
+      f.y(x, row) = (row < h / 2) ? 128 : 0;
+  }
+
+  Vp8Postprocessor pp;
+  pp.Process(MakeConfig(VP8_ADDNOISE, 0, 4), 20, f.get());
+
+  int changed = 0;
+
+  for (int row = 0; row < h / 2; ++row) {
+    for (int x = 0; x < w; ++x) {
+      EXPECT_NEAR(128, f.y(x, row), 32);
+      changed += (f.y(x, row) != 128);
+    }
+  }
+
+  EXPECT_GT(changed, w);
+
+  // Black is lifted first, so the noise can't wrap it round to white.
+  for (int row = h / 2; row < h; ++row) {
+    for (int x = 0; x < w; ++x)
+      EXPECT_LE(f.y(x, row), 64);
+  }
+
+  // Chroma is left alone.
+  EXPECT_EQ(0, f.get()->planes[VPX_PLANE_U][0]);
+}
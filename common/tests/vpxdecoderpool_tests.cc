@@ -0,0 +1,135 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "gtest/gtest.h"
+#include "vpx/vp8dx.h"
+#include "vpx/vpx_decoder.h"
+#include "vpxdecoderpool.h"
+
+using webmdshow::VpxDecoderPool;
+
+namespace {
+
+VpxDecoderPool::Key MakeKey(int threads, int width, int height) {
+  const VpxDecoderPool::Key key = {
+    &vpx_codec_vp8_dx_algo, 0, threads, width, height
+  };
+
+  return key;
+}
+
+// The pool is shared by the tests, so each starts it empty.
+class VpxDecoderPoolTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    VpxDecoderPool::Get().Clear();
+    VpxDecoderPool::Get().GetStats(&start_);
+  }
+
+  virtual void TearDown() { VpxDecoderPool::Get().Clear(); }
+
+  VpxDecoderPool::Stats GetDelta() const {
+    VpxDecoderPool::Stats stats;
+    VpxDecoderPool::Get().GetStats(&stats);
+
+    stats.borrowed -= start_.borrowed;
+    stats.reused -= start_.reused;
+    stats.returned -= start_.returned;
+    stats.destroyed -= start_.destroyed;
+
+    return stats;
+  }
+
+  VpxDecoderPool::Stats start_;
+};
+
+}  // namespace
+
+TEST_F(VpxDecoderPoolTest, ReusesAReturnedDecoder) {
+  VpxDecoderPool& pool = VpxDecoderPool::Get();
+  const VpxDecoderPool::Key key = MakeKey(1, 640, 360);
+
+  vpx_codec_ctx_t ctx;
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(key, &ctx));
+
+  pool.Return(key, &ctx);
+  EXPECT_TRUE(ctx.iface == NULL);
+  EXPECT_EQ(1, GetDelta().idle);
+
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(key, &ctx));
+  EXPECT_TRUE(ctx.iface == &vpx_codec_vp8_dx_algo);
+
+  const VpxDecoderPool::Stats stats = GetDelta();
+  EXPECT_EQ(2, stats.borrowed);
+  EXPECT_EQ(1, stats.reused);
+  EXPECT_EQ(0, stats.idle);
+
+  pool.Return(key, &ctx);
+}
+
+TEST_F(VpxDecoderPoolTest, MatchesOnlyTheSameKind) {
+  VpxDecoderPool& pool = VpxDecoderPool::Get();
+
+  vpx_codec_ctx_t ctx;
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(MakeKey(1, 640, 360), &ctx));
+  pool.Return(MakeKey(1, 640, 360), &ctx);
+
+  // Another thread count, and another size class.
+  vpx_codec_ctx_t threads;
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(MakeKey(2, 640, 360), &threads));
+
+  vpx_codec_ctx_t large;
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(MakeKey(1, 1920, 1080), &large));
+
+  EXPECT_EQ(0, GetDelta().reused);
+
+  // The same size class.
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(MakeKey(1, 320, 240), &ctx));
+  EXPECT_EQ(1, GetDelta().reused);
+
+  pool.Return(MakeKey(2, 640, 360), &threads);
+  pool.Return(MakeKey(1, 1920, 1080), &large);
+  pool.Return(MakeKey(1, 320, 240), &ctx);
+  EXPECT_EQ(3, GetDelta().idle);
+}
+
+TEST_F(VpxDecoderPoolTest, KeepsNoMoreThanItsLimit) {
+  VpxDecoderPool& pool = VpxDecoderPool::Get();
+  const VpxDecoderPool::Key key = MakeKey(1, 0, 0);
+
+  enum { kCount = VpxDecoderPool::kMaxIdlePerKey + 1 };
+  vpx_codec_ctx_t ctx[kCount];
+
+  for (int i = 0; i < kCount; ++i)
+    ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(key, &ctx[i]));
+
+  for (int i = 0; i < kCount; ++i) {
+    pool.Return(key, &ctx[i]);
+    EXPECT_TRUE(ctx[i].iface == NULL);
+  }
+
+  const VpxDecoderPool::Stats stats = GetDelta();
+  EXPECT_EQ(VpxDecoderPool::kMaxIdlePerKey, stats.idle);
+  EXPECT_EQ(VpxDecoderPool::kMaxIdlePerKey, stats.returned);
+  EXPECT_EQ(1, stats.destroyed);
+}
+
+TEST_F(VpxDecoderPoolTest, ClearDestroysTheIdleDecoders) {
+  VpxDecoderPool& pool = VpxDecoderPool::Get();
+  const VpxDecoderPool::Key key = MakeKey(1, 0, 0);
+
+  vpx_codec_ctx_t ctx;
+  ASSERT_EQ(VPX_CODEC_OK, pool.Borrow(key, &ctx));
+  pool.Return(key, &ctx);
+
+  pool.Clear();
+
+  const VpxDecoderPool::Stats stats = GetDelta();
+  EXPECT_EQ(0, stats.idle);
+  EXPECT_EQ(1, stats.destroyed);
+}
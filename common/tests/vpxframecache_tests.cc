@@ -0,0 +1,132 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+#include "vpx/vpx_image.h"
+#include "vpxframecache.h"
+
+using webmdshow::VpxFrameCache;
+
+namespace {
+
+// A w x h I420 frame, every byte of which is |value|.
+vpx_image_t* CreateFrame(unsigned int w, unsigned int h, uint8_t value) {
+  vpx_image_t* const img = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, w, h, 16);
+
+  for (unsigned int y = 0; y < h; ++y)
+    memset(img->planes[VPX_PLANE_Y] + y * img->stride[VPX_PLANE_Y], value, w);
+
+  for (unsigned int y = 0; y < (h + 1) / 2; ++y) {
+    memset(img->planes[VPX_PLANE_U] + y * img->stride[VPX_PLANE_U], value,
+           (w + 1) / 2);
+    memset(img->planes[VPX_PLANE_V] + y * img->stride[VPX_PLANE_V], value,
+           (w + 1) / 2);
+  }
+
+  return img;
+}
+
+}  // namespace
+
+TEST(VpxFrameCache, OffUntilEnabled) {
+  VpxFrameCache cache;
+  vpx_image_t* const f = CreateFrame(64, 48, 1);
+
+  cache.Insert(0, f);
+  EXPECT_FALSE(cache.Lookup(0));
+
+  vpx_img_free(f);
+}
+
+TEST(VpxFrameCache, CopiesFrames) {
+  VpxFrameCache cache;
+  cache.SetLimit(1 << 20);
+
+  vpx_image_t* const f = CreateFrame(33, 17, 7);
+  cache.Insert(400000, f);
+  vpx_img_free(f);
+
+  ASSERT_TRUE(cache.Lookup(400000));
+  EXPECT_FALSE(cache.Lookup(400001));
+
+  const vpx_image_t* const copy = cache.Get(400000);
+  ASSERT_TRUE(copy != NULL);
+
+  EXPECT_EQ(33u, copy->d_w);
+  EXPECT_EQ(17u, copy->d_h);
+  EXPECT_EQ(7, copy->planes[VPX_PLANE_Y][16 * copy->stride[VPX_PLANE_Y] + 32]);
+  EXPECT_EQ(7, copy->planes[VPX_PLANE_V][8 * copy->stride[VPX_PLANE_V] + 16]);
+
+  VpxFrameCache::Stats stats;
+  cache.GetStats(&stats);
+
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(1, stats.frames);
+  EXPECT_EQ(static_cast<int64_t>(webmdshow::GetVpxImageI420Size(copy)),
+            stats.bytes);
+}
+
+TEST(VpxFrameCache, EvictsLeastRecentlyUsed) {
+  vpx_image_t* const f = CreateFrame(64, 64, 0);
+  const size_t size = webmdshow::GetVpxImageI420Size(f);
+
+  VpxFrameCache cache;
+  cache.SetLimit(3 * size);
+
+  cache.Insert(0, f);
+  cache.Insert(1, f);
+  cache.Insert(2, f);
+
+  EXPECT_TRUE(cache.Get(0) != NULL);  // now 1 is the least recently used
+
+  cache.Insert(3, f);
+
+  EXPECT_TRUE(cache.Lookup(0));
+  EXPECT_FALSE(cache.Lookup(1));
+  EXPECT_TRUE(cache.Lookup(2));
+  EXPECT_TRUE(cache.Lookup(3));
+
+  cache.SetLimit(size);
+
+  VpxFrameCache::Stats stats;
+  cache.GetStats(&stats);
+  EXPECT_EQ(1, stats.frames);
+  EXPECT_TRUE(cache.Lookup(3));
+
+  vpx_img_free(f);
+}
+
+TEST(VpxFrameCache, PurgesForItsBudget) {
+  vpx_image_t* const f = CreateFrame(64, 64, 0);
+  const int64_t size = webmdshow::GetVpxImageI420Size(f);
+
+  webmdshow::MemoryBudget session(NULL);
+
+  webmdshow::MemoryBudget::Limits limits;
+  limits.soft = 2 * size;
+  limits.hard = 0;
+  session.SetLimits(limits);
+
+  VpxFrameCache cache;
+  cache.SetBudget(&session);
+  cache.SetLimit(1 << 20);
+
+  for (int i = 0; i < 4; ++i)
+    cache.Insert(i, f);
+
+  // Each insert past the soft limit asks for the excess back, which the
+  // next insert gives.
+  VpxFrameCache::Stats stats;
+  cache.GetStats(&stats);
+  EXPECT_EQ(3, stats.frames);
+
+  vpx_img_free(f);
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "waveform.h"
+
+using webmdshow::WaveformBins;
+using webmdshow::WaveformCache;
+using webmdshow::WaveformPeak;
+using webmdshow::WaveformSummary;
+
+namespace {
+
+const int kChannels = 2;
+const int kFrames = 1000;
+const int kColumns = 7;  // not a divisor of kFrames
+
+const int64_t kFileSize = 123456789;
+const int64_t kFileTime = 130000000000000000LL;
+
+// A ramp on the left channel and its negation on the right.
+std::vector<float> CreateSamples() {
+  std::vector<float> samples(kFrames * kChannels);
+
+  for (int i = 0; i < kFrames; ++i) {
+    samples[i * kChannels] = i / float(kFrames);
+    samples[i * kChannels + 1] = -i / float(kFrames);
+  }
+
+  return samples;
+}
+
+TEST(WaveformBins, GetsPeaksOfColumns) {
+  const std::vector<float> samples = CreateSamples();
+
+  WaveformBins bins(kChannels, kFrames, kColumns);
+  bins.Add(0, &samples[0], kFrames);
+
+  std::vector<WaveformPeak> peaks;
+  bins.GetPeaks(&peaks);
+  ASSERT_EQ(size_t(kColumns * kChannels), peaks.size());
+
+  int first = 0;
+
+  for (int c = 0; c < kColumns; ++c) {
+    // The first frame of the next column.
+    const int next = ((c + 1) * kFrames + kColumns - 1) / kColumns;
+
+    double sum = 0;
+
+    for (int i = first; i < next; ++i)
+      sum += double(samples[i * kChannels]) * samples[i * kChannels];
+
+    const WaveformPeak& left = peaks[c * kChannels];
+    const WaveformPeak& right = peaks[c * kChannels + 1];
+
+    EXPECT_EQ(samples[first * kChannels], left.min);
+    EXPECT_EQ(samples[(next - 1) * kChannels], left.max);
+    EXPECT_NEAR(sqrt(sum / (next - first)), left.rms, 1e-6);
+
+    EXPECT_EQ(-left.max, right.min);
+    EXPECT_EQ(-left.min, right.max);
+    EXPECT_FLOAT_EQ(left.rms, right.rms);
+
+    first = next;
+  }
+
+  EXPECT_EQ(kFrames, first);
+}
+
+// Ranges added to separate bins, and merged, give the peaks of one pass,
+// wherever the ranges split the columns; frames past either end of the
+// track are dropped.
+TEST(WaveformBins, MergesRanges) {
+  const std::vector<float> samples = CreateSamples();
+
+  WaveformBins whole(kChannels, kFrames, kColumns);
+  whole.Add(0, &samples[0], kFrames);
+
+  WaveformBins merged(kChannels, kFrames, kColumns);
+
+  const int kSplits[] = {0, 99, 100, 463, 700, kFrames};
+  const int n = sizeof kSplits / sizeof kSplits[0];
+
+  for (int i = n - 1; i > 0; --i) {
+    WaveformBins part(kChannels, kFrames, kColumns);
+
+    const int count = kSplits[i] - kSplits[i - 1];
+    part.Add(kSplits[i - 1], &samples[kSplits[i - 1] * kChannels], count);
+
+    merged.Merge(part);
+  }
+
+  const float kLoud[] = {5.0f, -5.0f};
+  merged.Add(-1, kLoud, 1);
+  merged.Add(kFrames, kLoud, 1);
+
+  std::vector<WaveformPeak> expected, actual;
+  whole.GetPeaks(&expected);
+  merged.GetPeaks(&actual);
+
+  ASSERT_EQ(expected.size(), actual.size());
+
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].min, actual[i].min);
+    EXPECT_EQ(expected[i].max, actual[i].max);
+    EXPECT_NEAR(expected[i].rms, actual[i].rms, 1e-6);
+  }
+}
+
+TEST(WaveformBins, LeavesEmptyColumnsZero) {
+  const float kFrame[] = {0.5f, -0.25f};
+
+  WaveformBins bins(kChannels, kFrames, kColumns);
+  bins.Add(kFrames - 1, kFrame, 1);
+
+  std::vector<WaveformPeak> peaks;
+  bins.GetPeaks(&peaks);
+
+  for (int i = 0; i < (kColumns - 1) * kChannels; ++i) {
+    EXPECT_EQ(0.0f, peaks[i].min);
+    EXPECT_EQ(0.0f, peaks[i].max);
+    EXPECT_EQ(0.0f, peaks[i].rms);
+  }
+
+  EXPECT_EQ(0.5f, peaks[(kColumns - 1) * kChannels].max);
+  EXPECT_EQ(0.25f, peaks[(kColumns - 1) * kChannels + 1].rms);
+}
+
+TEST(WaveformCache, BuildAndParse) {
+  WaveformSummary summary;
+  summary.track_number = 2;
+  summary.channels = kChannels;
+  summary.rate = 48000;
+  summary.duration_ns = 7200000000000LL;
+  summary.columns = kColumns;
+
+  const std::vector<float> samples = CreateSamples();
+
+  WaveformBins bins(kChannels, kFrames, kColumns);
+  bins.Add(0, &samples[0], kFrames);
+  bins.GetPeaks(&summary.peaks);
+
+  std::vector<uint8_t> image;
+  WaveformCache::Build(kFileSize, kFileTime, summary, &image);
+
+  WaveformSummary parsed;
+  ASSERT_TRUE(WaveformCache::Parse(&image[0], image.size(), kFileSize,
+                                   kFileTime, &parsed));
+
+  EXPECT_EQ(summary.track_number, parsed.track_number);
+  EXPECT_EQ(summary.channels, parsed.channels);
+  EXPECT_EQ(summary.rate, parsed.rate);
+  EXPECT_EQ(summary.duration_ns, parsed.duration_ns);
+  EXPECT_EQ(summary.columns, parsed.columns);
+  ASSERT_EQ(summary.peaks.size(), parsed.peaks.size());
+
+  for (size_t i = 0; i < summary.peaks.size(); ++i) {
+    EXPECT_EQ(summary.peaks[i].min, parsed.peaks[i].min);
+    EXPECT_EQ(summary.peaks[i].max, parsed.peaks[i].max);
+    EXPECT_EQ(summary.peaks[i].rms, parsed.peaks[i].rms);
+  }
+
+  // Stale, or cut short.
+  EXPECT_FALSE(WaveformCache::Parse(&image[0], image.size(), kFileSize + 1,
+                                    kFileTime, &parsed));
+  EXPECT_FALSE(WaveformCache::Parse(&image[0], image.size(), kFileSize,
+                                    kFileTime + 1, &parsed));
+  EXPECT_FALSE(WaveformCache::Parse(&image[0], image.size() - 1, kFileSize,
+                                    kFileTime, &parsed));
+}
+
+}  // namespace
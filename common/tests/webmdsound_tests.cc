@@ -26,6 +26,7 @@
 extern wchar_t* g_test_input_file;
 
 using WebmDirectX::AudioPlaybackDevice;
+using WebmDirectX::WasapiPlaybackDevice;
 
 void init_wfextensible(WORD format_tag, WORD channels, DWORD sample_rate,
                        WORD bits_per_sample, WORD reserved, DWORD channel_mask,
@@ -66,3 +67,17 @@ TEST(WebmDirectSound, AudioPlaybackDevice_InitIEEEFloat)
                       GUID_NULL, &wfx);
     ASSERT_EQ(S_OK, apd.Open(NULL, &wfx));
 }
+
+TEST(WebmDirectSound, WasapiPlaybackDevice_InitSharedIEEEFloat)
+{
+    // Shared mode takes the engine's rate; 48 kHz float is the usual one.
+    WasapiPlaybackDevice wpd(WebmDirectX::WASAPI_SHARED);
+    WAVEFORMATEXTENSIBLE wfx = {0};
+    init_wfextensible(WAVE_FORMAT_IEEE_FLOAT, 2, 48000, sizeof(float)*8, 0, 0,
+                      GUID_NULL, &wfx);
+    ASSERT_EQ(S_OK, wpd.Open(NULL, &wfx));
+    REFERENCE_TIME latency = 0;
+    ASSERT_EQ(S_OK, wpd.GetLatency(&latency));
+    EXPECT_GT(latency, 0);
+    EXPECT_EQ(0u, wpd.GetGlitchCount());
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "webmindex.h"
+
+using webmdshow::WebmIndex;
+using webmdshow::WebmIndexEntry;
+
+namespace {
+
+const int64_t kFileSize = 123456789;
+const int64_t kFileTime = 130000000000000000LL;
+const int64_t kTrackNumber = 1;
+
+// Clusters one second apart, each starting with a keyframe.
+std::vector<WebmIndexEntry> CreateEntries(int count) {
+  std::vector<WebmIndexEntry> entries(count);
+
+  for (int i = 0; i < count; ++i) {
+    entries[i].pos = 4096 + i * 100000;
+    entries[i].time_ns = i * 1000000000LL;
+  }
+
+  return entries;
+}
+
+}  // namespace
+
+TEST(WebmIndex, BuildAndAttach) {
+  const std::vector<WebmIndexEntry> entries = CreateEntries(10);
+
+  std::vector<uint8_t> image;
+  WebmIndex::Build(kTrackNumber, kFileSize, kFileTime, entries, &image);
+
+  WebmIndex index;
+  ASSERT_TRUE(index.Attach(&image[0], image.size(), kFileSize, kFileTime));
+  ASSERT_TRUE(index.IsOpen());
+
+  EXPECT_EQ(kTrackNumber, index.track_number());
+  ASSERT_EQ(10, index.count());
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(entries[i].pos, index.entry(i).pos);
+    EXPECT_EQ(entries[i].time_ns, index.entry(i).time_ns);
+  }
+}
+
+TEST(WebmIndex, RejectsStaleOrDamagedImage) {
+  std::vector<uint8_t> image;
+  WebmIndex::Build(kTrackNumber, kFileSize, kFileTime, CreateEntries(4),
+                   &image);
+
+  WebmIndex index;
+
+  // The media file has changed since the index was built.
+  EXPECT_FALSE(index.Attach(&image[0], image.size(), kFileSize + 1,
+                            kFileTime));
+  EXPECT_FALSE(index.Attach(&image[0], image.size(), kFileSize,
+                            kFileTime + 1));
+
+  // Truncated.
+  EXPECT_FALSE(index.Attach(&image[0], image.size() - 1, kFileSize,
+                            kFileTime));
+  EXPECT_FALSE(index.Attach(&image[0], 16, kFileSize, kFileTime));
+
+  // Wrong magic.
+  std::vector<uint8_t> damaged(image);
+  damaged[0] = 'X';
+  EXPECT_FALSE(index.Attach(&damaged[0], damaged.size(), kFileSize,
+                            kFileTime));
+
+  EXPECT_FALSE(index.IsOpen());
+}
+
+TEST(WebmIndex, Find) {
+  std::vector<uint8_t> image;
+  WebmIndex::Build(kTrackNumber, kFileSize, kFileTime, CreateEntries(100),
+                   &image);
+
+  WebmIndex index;
+  ASSERT_TRUE(index.Attach(&image[0], image.size(), kFileSize, kFileTime));
+
+  // Before and at the first keyframe.
+  EXPECT_EQ(&index.entry(0), index.Find(-1));
+  EXPECT_EQ(&index.entry(0), index.Find(0));
+
+  // Exactly on, and just either side of, a keyframe.
+  EXPECT_EQ(&index.entry(41), index.Find(42000000000LL - 1));
+  EXPECT_EQ(&index.entry(42), index.Find(42000000000LL));
+  EXPECT_EQ(&index.entry(42), index.Find(42000000000LL + 1));
+
+  // Past the last keyframe.
+  EXPECT_EQ(&index.entry(99), index.Find(1000000000000LL));
+}
+
+TEST(WebmIndex, Empty) {
+  std::vector<uint8_t> image;
+  WebmIndex::Build(kTrackNumber, kFileSize, kFileTime,
+                   std::vector<WebmIndexEntry>(), &image);
+
+  WebmIndex index;
+  ASSERT_TRUE(index.Attach(&image[0], image.size(), kFileSize, kFileTime));
+
+  EXPECT_EQ(0, index.count());
+  EXPECT_TRUE(index.Find(0) == NULL);
+}
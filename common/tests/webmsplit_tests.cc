@@ -0,0 +1,606 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+// Performance regression tests for the splitter, over the in-memory
+// sources of memsource.h. The budgets are generous: they catch a change
+// that makes opening, seeking or streaming an order of magnitude slower
+// (a read per byte, a seek that walks the file, a prefetcher that stopped
+// prefetching), not noise, so they should hold on any machine the tests
+// run on, debug builds included.
+
+#include <windows.h>
+#include <uuids.h>
+#include <vfwmsgs.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "memsource.h"
+#include "mkvparser.hpp"
+#include "pipelinecounters.h"
+#include "webmsplitfilter.h"
+#include "webmsplitoutpin.h"
+
+namespace WebmSplit {
+HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+}  // namespace WebmSplit
+
+using webmdshow::BuildSyntheticWebm;
+using webmdshow::LinkModel;
+using webmdshow::MemAsyncReader;
+using webmdshow::MemFile;
+using webmdshow::MemMkvReader;
+using webmdshow::PipelineCounters;
+using webmdshow::ReadStats;
+using webmdshow::SyntheticWebmParams;
+using webmdshow::WaitUs;
+
+namespace {
+
+// Sequential reads through the page cache, from a source with no latency.
+const double kMinReadMegabytesPerSecond = 100;
+
+// Added to what the reads of an open or a seek must take, for the parsing.
+const int64_t kOpenSlackUs = 250000;
+const int64_t kSeekBudgetUs = 50000;
+
+// Reads the splitter's open may issue beyond those mkvparser itself asks
+// for to parse the headers.
+const int64_t kOpenReadSlack = 16;
+
+// Streaming a file of 60 s, as a multiple of real time.
+const double kMinRealTimeFactor = 20;
+const DWORD kDeliveryTimeoutMs = 30000;
+
+class NullClassFactory : public IClassFactory {
+ public:
+  HRESULT STDMETHODCALLTYPE QueryInterface(const IID& iid, void** ppv) {
+    if (ppv == NULL)
+      return E_POINTER;
+
+    if (iid != __uuidof(IUnknown) && iid != __uuidof(IClassFactory)) {
+      *ppv = NULL;
+      return E_NOINTERFACE;
+    }
+
+    *ppv = static_cast<IClassFactory*>(this);
+    return S_OK;
+  }
+
+  ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+  ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+  HRESULT STDMETHODCALLTYPE CreateInstance(IUnknown*, const IID&, void**) {
+    return E_NOTIMPL;
+  }
+
+  HRESULT STDMETHODCALLTYPE LockServer(BOOL) { return S_OK; }
+};
+
+// An input pin that takes any type, counts what it receives, and drops
+// it. It lives on the stack of a test, declared before the splitter, so
+// it ignores its reference count and holds no reference to the outpin
+// connected to it, which the splitter destroys first.
+class NullSinkPin : public IPin, public IMemInputPin {
+ public:
+  NullSinkPin()
+      : connection_(NULL),
+        samples_(0),
+        bytes_(0),
+        eos_(CreateEvent(NULL, TRUE, FALSE, NULL)) {
+  }
+
+  ~NullSinkPin() {
+    CloseHandle(eos_);
+  }
+
+  LONG samples() const { return samples_; }
+  LONGLONG bytes() const { return bytes_; }
+
+  // Returns whether the outpin sent its EndOfStream within |timeout_ms|.
+  bool WaitForEndOfStream(DWORD timeout_ms) const {
+    return WaitForSingleObject(eos_, timeout_ms) == WAIT_OBJECT_0;
+  }
+
+  // IUnknown
+  HRESULT STDMETHODCALLTYPE QueryInterface(const IID& iid, void** ppv) {
+    if (ppv == NULL)
+      return E_POINTER;
+
+    if (iid == __uuidof(IUnknown) || iid == __uuidof(IPin)) {
+      *ppv = static_cast<IPin*>(this);
+    } else if (iid == __uuidof(IMemInputPin)) {
+      *ppv = static_cast<IMemInputPin*>(this);
+    } else {
+      *ppv = NULL;
+      return E_NOINTERFACE;
+    }
+
+    return S_OK;
+  }
+
+  ULONG STDMETHODCALLTYPE AddRef() { return 1; }
+  ULONG STDMETHODCALLTYPE Release() { return 1; }
+
+  // IPin
+  HRESULT STDMETHODCALLTYPE Connect(IPin*, const AM_MEDIA_TYPE*) {
+    return E_UNEXPECTED;
+  }
+
+  HRESULT STDMETHODCALLTYPE ReceiveConnection(IPin* pin,
+                                              const AM_MEDIA_TYPE*) {
+    if (pin == NULL)
+      return E_POINTER;
+
+    if (connection_)
+      return VFW_E_ALREADY_CONNECTED;
+
+    connection_ = pin;
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE Disconnect() {
+    if (connection_ == NULL)
+      return S_FALSE;
+
+    connection_ = NULL;
+
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE ConnectedTo(IPin** pin) {
+    if (pin == NULL)
+      return E_POINTER;
+
+    *pin = connection_;
+
+    if (connection_ == NULL)
+      return VFW_E_NOT_CONNECTED;
+
+    connection_->AddRef();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE*) {
+    return E_NOTIMPL;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO* info) {
+    if (info == NULL)
+      return E_POINTER;
+
+    info->pFilter = NULL;
+    info->dir = PINDIR_INPUT;
+    wcscpy_s(info->achName, L"Input");
+
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION* dir) {
+    if (dir == NULL)
+      return E_POINTER;
+
+    *dir = PINDIR_INPUT;
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryId(LPWSTR*) { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE*) { return S_OK; }
+
+  HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes**) {
+    return E_NOTIMPL;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryInternalConnections(IPin**, ULONG*) {
+    return E_NOTIMPL;
+  }
+
+  HRESULT STDMETHODCALLTYPE EndOfStream() {
+    SetEvent(eos_);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE BeginFlush() { return S_OK; }
+  HRESULT STDMETHODCALLTYPE EndFlush() { return S_OK; }
+
+  HRESULT STDMETHODCALLTYPE NewSegment(REFERENCE_TIME, REFERENCE_TIME,
+                                       double) {
+    return S_OK;
+  }
+
+  // IMemInputPin
+  HRESULT STDMETHODCALLTYPE GetAllocator(IMemAllocator**) {
+    return VFW_E_NO_ALLOCATOR;  // the outpin makes its own
+  }
+
+  HRESULT STDMETHODCALLTYPE NotifyAllocator(IMemAllocator*, BOOL) {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE GetAllocatorRequirements(ALLOCATOR_PROPERTIES*) {
+    return E_NOTIMPL;
+  }
+
+  HRESULT STDMETHODCALLTYPE Receive(IMediaSample* sample) {
+    if (sample == NULL)
+      return E_POINTER;
+
+    InterlockedIncrement(&samples_);
+    InterlockedExchangeAdd64(&bytes_, sample->GetActualDataLength());
+
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE ReceiveMultiple(IMediaSample** samples, long n,
+                                            long* processed) {
+    if (samples == NULL || processed == NULL)
+      return E_POINTER;
+
+    for (*processed = 0; *processed < n; ++*processed) {
+      const HRESULT hr = Receive(samples[*processed]);
+
+      if (hr != S_OK)
+        return hr;
+    }
+
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE ReceiveCanBlock() { return S_FALSE; }
+
+ private:
+  IPin* connection_;
+  volatile LONG samples_;
+  volatile LONGLONG bytes_;
+  const HANDLE eos_;
+
+  NullSinkPin(const NullSinkPin&);
+  NullSinkPin& operator=(const NullSinkPin&);
+};
+
+// The synthetic shapes the splitter has to open quickly: those of
+// webmbench -synth that the video-only corpus of memsource.h can take.
+struct Shape {
+  const char* name;
+  SyntheticWebmParams params;
+};
+
+std::vector<Shape> GetShapes() {
+  std::vector<Shape> shapes;
+  Shape shape;
+
+  shape.name = "default";
+  shapes.push_back(shape);
+
+  shape.name = "tiny_clusters";
+  shape.params = SyntheticWebmParams();
+  shape.params.cluster_frames = 1;
+  shapes.push_back(shape);
+
+  shape.name = "huge_clusters";
+  shape.params = SyntheticWebmParams();
+  shape.params.width = 1280;
+  shape.params.height = 720;
+  shape.params.frames = 30 * 30;
+  shape.params.gop = 30 * 30;
+  shapes.push_back(shape);
+
+  shape.name = "no_cues";
+  shape.params = SyntheticWebmParams();
+  shape.params.cues = false;
+  shapes.push_back(shape);
+
+  shape.name = "long";
+  shape.params = SyntheticWebmParams();
+  shape.params.width = 320;
+  shape.params.height = 180;
+  shape.params.fps = 10;
+  shape.params.frames = 10 * 3 * 3600;
+  shape.params.gop = 100;
+  shape.params.key_size = 2000;
+  shape.params.frame_size = 400;
+  shapes.push_back(shape);
+
+  return shapes;
+}
+
+// The reads mkvparser itself issues to parse the file's headers, as the
+// splitter's Open does.
+int64_t CountHeaderReads(MemFile* file) {
+  MemMkvReader reader(file);
+  file->ResetStats();
+
+  long long pos = 0;
+  mkvparser::EBMLHeader header;
+
+  if (header.Parse(&reader, pos) != 0)
+    return -1;
+
+  mkvparser::Segment* segment;
+
+  if (mkvparser::Segment::CreateInstance(&reader, pos, segment) != 0)
+    return -1;
+
+  const long status = segment->ParseHeaders();
+  delete segment;
+
+  if (status != 0)
+    return -1;
+
+  ReadStats stats;
+  file->GetStats(&stats);
+
+  return stats.reads;
+}
+
+// The splitter, its inpin connected to a MemAsyncReader over |file|.
+class Splitter {
+ public:
+  explicit Splitter(MemFile* file)
+      : source_(MemAsyncReader::Create(file)),
+        filter_(NULL),
+        open_us_(-1) {
+    IBaseFilter* filter;
+
+    if (FAILED(WebmSplit::CreateInstance(&factory_, NULL,
+                                         __uuidof(IBaseFilter),
+                                         reinterpret_cast<void**>(&filter))))
+      return;
+
+    filter_ = static_cast<WebmSplit::Filter*>(filter);
+
+    AM_MEDIA_TYPE mt = AM_MEDIA_TYPE();
+    mt.majortype = MEDIATYPE_Stream;
+
+    const int64_t start_us = PipelineCounters::Now();
+
+    if (SUCCEEDED(filter_->m_inpin.ReceiveConnection(source_, &mt)))
+      open_us_ = PipelineCounters::Now() - start_us;
+  }
+
+  ~Splitter() {
+    if (filter_) {
+      filter_->Stop();
+
+      for (size_t i = 0; i < filter_->m_outpins.size(); ++i)
+        filter_->m_outpins[i]->Disconnect();
+
+      filter_->m_inpin.Disconnect();
+
+      static_cast<IBaseFilter*>(filter_)->Release();
+    }
+
+    source_->Release();
+  }
+
+  bool is_open() const { return open_us_ >= 0; }
+  int64_t open_us() const { return open_us_; }
+  WebmSplit::Filter* filter() const { return filter_; }
+
+ private:
+  NullClassFactory factory_;
+  MemAsyncReader* const source_;
+  WebmSplit::Filter* filter_;
+  int64_t open_us_;
+
+  Splitter(const Splitter&);
+  Splitter& operator=(const Splitter&);
+};
+
+}  // namespace
+
+TEST(WebmSplitPerf, SequentialReadThroughput) {
+  std::vector<uint8_t> data;
+  BuildSyntheticWebm(SyntheticWebmParams(), &data);
+
+  MemFile file(data);
+  MemAsyncReader* const source = MemAsyncReader::Create(&file);
+
+  {
+    WebmSplit::MkvReader reader;
+    ASSERT_HRESULT_SUCCEEDED(reader.SetSource(source));
+    reader.m_sync_read = false;
+
+    const long kReadSize = 16384;
+    std::vector<uint8_t> buf(kReadSize);
+
+    const long long size = file.size() - file.size() % kReadSize;
+    const int64_t start_us = PipelineCounters::Now();
+
+    for (long long pos = 0; pos < size; pos += kReadSize)
+      ASSERT_EQ(0, reader.Read(pos, kReadSize, &buf[0]));
+
+    const int64_t elapsed_us = PipelineCounters::Now() - start_us;
+    const double mbps = elapsed_us > 0 ? double(size) / elapsed_us : 1e9;
+
+    EXPECT_GE(mbps, kMinReadMegabytesPerSecond)
+        << size << " bytes in " << elapsed_us << " us";
+
+    reader.SetSource(NULL);
+  }
+
+  source->Release();
+}
+
+TEST(WebmSplitPerf, PrefetchHidesLatency) {
+  std::vector<uint8_t> data;
+  BuildSyntheticWebm(SyntheticWebmParams(), &data);
+
+  // A disk with a seek time of 2 ms, read by a consumer that takes 50 us
+  // for each 16 KB: with the read-ahead, only the first reads wait.
+  MemFile file(data);
+  LinkModel link;
+  link.latency_us = 2000;
+  link.bytes_per_s = 400 * 1000 * 1000;
+  file.set_link(link);
+
+  MemAsyncReader* const source = MemAsyncReader::Create(&file);
+
+  {
+    WebmSplit::MkvReader reader;
+    ASSERT_HRESULT_SUCCEEDED(reader.SetSource(source));
+    reader.m_sync_read = false;
+    reader.ResetCacheStats();
+
+    const long kReadSize = 16384;
+    const int64_t kWorkUs = 50;
+    std::vector<uint8_t> buf(kReadSize);
+
+    const long long size = file.size() - file.size() % kReadSize;
+    const int64_t start_us = PipelineCounters::Now();
+
+    for (long long pos = 0; pos < size; pos += kReadSize) {
+      ASSERT_EQ(0, reader.Read(pos, kReadSize, &buf[0]));
+      WaitUs(kWorkUs);
+    }
+
+    const int64_t elapsed_us = PipelineCounters::Now() - start_us;
+    const int64_t work_us = (size / kReadSize) * kWorkUs;
+
+    WebmSplit::MkvReader::CacheStats stats;
+    reader.GetCacheStats(stats);
+
+    EXPECT_GT(stats.prefetches, 0);
+    EXPECT_LE(stats.misses * 20, stats.hits + stats.misses)
+        << stats.misses << " misses, " << stats.hits << " hits";
+
+    // Without the read-ahead each page would wait 2 ms, and this would
+    // take seconds.
+    EXPECT_LE(elapsed_us, 2 * work_us + kOpenSlackUs);
+
+    reader.SetSource(NULL);
+  }
+
+  source->Release();
+}
+
+TEST(WebmSplitPerf, OpenBudget) {
+  const std::vector<Shape> shapes = GetShapes();
+
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    const Shape& shape = shapes[i];
+    SCOPED_TRACE(shape.name);
+
+    std::vector<uint8_t> data;
+    BuildSyntheticWebm(shape.params, &data);
+
+    MemFile file(data);
+    LinkModel link;
+    link.latency_us = 200;
+    file.set_link(link);
+
+    const int64_t header_reads = CountHeaderReads(&file);
+    ASSERT_GT(header_reads, 0);
+
+    file.ResetStats();
+
+    Splitter splitter(&file);
+    ASSERT_TRUE(splitter.is_open());
+
+    ReadStats stats;
+    file.GetStats(&stats);
+
+    // Open reads no more than the headers, whatever the file's length or
+    // shape; in particular, it neither walks the clusters nor loads the
+    // cues.
+    EXPECT_LE(stats.reads, header_reads + kOpenReadSlack);
+    EXPECT_LE(splitter.open_us(),
+              stats.reads * link.latency_us * 2 + kOpenSlackUs);
+  }
+}
+
+TEST(WebmSplitPerf, SeekBudget) {
+  const std::vector<Shape> shapes = GetShapes();
+
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    const Shape& shape = shapes[i];
+
+    if (!shape.params.cues)
+      continue;  // a seek has to parse up to its cluster
+
+    SCOPED_TRACE(shape.name);
+
+    std::vector<uint8_t> data;
+    BuildSyntheticWebm(shape.params, &data);
+
+    MemFile file(data);
+    LinkModel link;
+    link.latency_us = 200;
+    file.set_link(link);
+
+    NullSinkPin sink;
+    Splitter splitter(&file);
+    ASSERT_TRUE(splitter.is_open());
+
+    WebmSplit::Outpin* const outpin = splitter.filter()->m_outpins[0];
+    ASSERT_HRESULT_SUCCEEDED(outpin->Connect(&sink, NULL));
+
+    LONGLONG duration;
+    ASSERT_HRESULT_SUCCEEDED(outpin->GetDuration(&duration));
+
+    uint32_t state = 12345;
+
+    for (int j = 0; j < 16; ++j) {
+      state = state * 1103515245 + 12345;
+
+      LONGLONG pos = LONGLONG((state >> 8) % 1000) * duration / 1000;
+      const int64_t start_us = PipelineCounters::Now();
+
+      ASSERT_HRESULT_SUCCEEDED(
+          outpin->SetPositions(&pos, AM_SEEKING_AbsolutePositioning, NULL,
+                               AM_SEEKING_NoPositioning));
+
+      EXPECT_LE(PipelineCounters::Now() - start_us, kSeekBudgetUs)
+          << "seek to " << pos;
+    }
+
+    outpin->Disconnect();
+    sink.Disconnect();
+  }
+}
+
+TEST(WebmSplitPerf, DeliveryThroughput) {
+  const SyntheticWebmParams params;
+
+  std::vector<uint8_t> data;
+  BuildSyntheticWebm(params, &data);
+
+  // A network share: 1 ms to the first byte, then 50 MB/s.
+  MemFile file(data);
+  LinkModel link;
+  link.latency_us = 1000;
+  link.bytes_per_s = 50 * 1000 * 1000;
+  file.set_link(link);
+
+  NullSinkPin sink;
+  Splitter splitter(&file);
+  ASSERT_TRUE(splitter.is_open());
+
+  WebmSplit::Filter* const filter = splitter.filter();
+  ASSERT_EQ(1u, filter->m_outpins.size());
+
+  WebmSplit::Outpin* const outpin = filter->m_outpins[0];
+  ASSERT_HRESULT_SUCCEEDED(outpin->Connect(&sink, NULL));
+
+  const int64_t start_us = PipelineCounters::Now();
+  ASSERT_HRESULT_SUCCEEDED(filter->Pause());
+
+  ASSERT_TRUE(sink.WaitForEndOfStream(kDeliveryTimeoutMs));
+  const int64_t elapsed_us = PipelineCounters::Now() - start_us;
+
+  EXPECT_EQ(params.frames, sink.samples());
+
+  const double media_us = params.frames * 1e6 / params.fps;
+
+  EXPECT_GE(media_us, kMinRealTimeFactor * elapsed_us)
+      << sink.samples() << " frames in " << elapsed_us << " us";
+
+  ASSERT_HRESULT_SUCCEEDED(filter->Stop());
+  outpin->Disconnect();
+  sink.Disconnect();
+}
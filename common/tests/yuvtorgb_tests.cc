@@ -0,0 +1,159 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "yuvtorgb.h"
+
+namespace {
+
+using webmdshow::YuvToRgbConstants;
+
+struct Kr {
+  double r;
+  double b;
+};
+
+const Kr kKr[2] = { { 0.299, 0.114 }, { 0.2126, 0.0722 } };
+
+struct Frame {
+  Frame(int width, int height)
+      : w(width),
+        h(height),
+        y(width * height),
+        u(((width + 1) / 2) * ((height + 1) / 2)),
+        v(u.size()) {
+    for (size_t i = 0; i < y.size(); ++i)
+      y[i] = static_cast<uint8_t>(rand());
+    for (size_t i = 0; i < u.size(); ++i) {
+      u[i] = static_cast<uint8_t>(rand());
+      v[i] = static_cast<uint8_t>(rand());
+    }
+  }
+
+  int w;
+  int h;
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> u;
+  std::vector<uint8_t> v;
+};
+
+void Convert(const Frame& f, const YuvToRgbConstants& k, int bytes_per_pixel,
+             uint8_t* dst, int dst_stride) {
+  const int chroma_stride = (f.w + 1) / 2;
+  if (bytes_per_pixel == 4) {
+    webmdshow::I420ToRgb32(&f.y[0], f.w, &f.u[0], chroma_stride,
+                           &f.v[0], chroma_stride, k, dst, dst_stride,
+                           f.w, f.h);
+  } else {
+    webmdshow::I420ToRgb24(&f.y[0], f.w, &f.u[0], chroma_stride,
+                           &f.v[0], chroma_stride, k, dst, dst_stride,
+                           f.w, f.h);
+  }
+}
+
+int Reference(double x) {
+  const int i = static_cast<int>(floor(x + 0.5));
+  return (i < 0) ? 0 : (i > 255) ? 255 : i;
+}
+
+TEST(YuvToRgb, MatchesFloatingPoint) {
+  for (int m = 0; m < 2; ++m) {
+    for (int r = 0; r < 2; ++r) {
+      const bool limited = (r == webmdshow::kYuvRangeLimited);
+      const YuvToRgbConstants& k = webmdshow::GetYuvToRgbConstants(
+          static_cast<webmdshow::YuvMatrix>(m),
+          static_cast<webmdshow::YuvRange>(r));
+      const double ys = limited ? 255.0 / 219 : 1;
+      const double cs = limited ? 255.0 / 224 : 1;
+      const double kg = 1 - kKr[m].r - kKr[m].b;
+
+      const Frame f(37, 5);
+      std::vector<uint8_t> rgb(3 * f.w * f.h);
+      Convert(f, k, 3, &rgb[0], 3 * f.w);
+
+      for (int row = 0; row < f.h; ++row) {
+        for (int x = 0; x < f.w; ++x) {
+          const int c = (row / 2) * ((f.w + 1) / 2) + x / 2;
+          const double y = ys * (f.y[row * f.w + x] - k.y_offset);
+          const double u = cs * (f.u[c] - 128);
+          const double v = cs * (f.v[c] - 128);
+          const uint8_t* const p = &rgb[3 * (row * f.w + x)];
+
+          EXPECT_NEAR(Reference(y + 2 * (1 - kKr[m].b) * u), p[0], 1);
+          EXPECT_NEAR(Reference(y - 2 * (1 - kKr[m].b) * kKr[m].b / kg * u -
+                                2 * (1 - kKr[m].r) * kKr[m].r / kg * v),
+                      p[1], 1);
+          EXPECT_NEAR(Reference(y + 2 * (1 - kKr[m].r) * v), p[2], 1);
+        }
+      }
+    }
+  }
+}
+
+TEST(YuvToRgb, Rgb24MatchesRgb32) {
+  const YuvToRgbConstants& k = webmdshow::GetYuvToRgbConstants(
+      webmdshow::kYuvMatrixBT709, webmdshow::kYuvRangeLimited);
+
+  for (int w = 1; w <= 40; ++w) {
+    const Frame f(w, 3);
+    std::vector<uint8_t> rgb24(3 * w * f.h + 1, 0xA5);
+    std::vector<uint8_t> rgb32(4 * w * f.h);
+    Convert(f, k, 3, &rgb24[0], 3 * w);
+    Convert(f, k, 4, &rgb32[0], 4 * w);
+
+    for (int i = 0; i < w * f.h; ++i) {
+      EXPECT_EQ(0, memcmp(&rgb24[3 * i], &rgb32[4 * i], 3)) << w;
+      EXPECT_EQ(255, rgb32[4 * i + 3]);
+    }
+
+    // Nothing is written past the frame.
+    EXPECT_EQ(0xA5, rgb24.back()) << w;
+  }
+}
+
+TEST(YuvToRgb, BottomUp) {
+  const YuvToRgbConstants& k = webmdshow::GetYuvToRgbConstants(
+      webmdshow::kYuvMatrixBT601, webmdshow::kYuvRangeLimited);
+  const Frame f(20, 6);
+  const int stride = 4 * f.w;
+
+  std::vector<uint8_t> top_down(stride * f.h);
+  std::vector<uint8_t> bottom_up(stride * f.h);
+  Convert(f, k, 4, &top_down[0], stride);
+  Convert(f, k, 4, &bottom_up[stride * (f.h - 1)], -stride);
+
+  for (int row = 0; row < f.h; ++row) {
+    EXPECT_EQ(0, memcmp(&top_down[row * stride],
+                        &bottom_up[(f.h - 1 - row) * stride], stride));
+  }
+}
+
+TEST(YuvToRgb, Extremes) {
+  const YuvToRgbConstants& k = webmdshow::GetYuvToRgbConstants(
+      webmdshow::kYuvMatrixBT601, webmdshow::kYuvRangeLimited);
+  const uint8_t y[8] = { 16, 16, 235, 235, 0, 0, 255, 255 };
+  const uint8_t u[4] = { 128, 128, 128, 128 };
+  const uint8_t v[4] = { 128, 128, 128, 128 };
+  uint8_t rgb[32];
+
+  webmdshow::I420ToRgb32(y, 8, u, 4, v, 4, k, rgb, 32, 8, 1);
+
+  const uint8_t expected[8] = { 0, 0, 255, 255, 0, 0, 255, 255 };
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(expected[i], rgb[4 * i]);
+    EXPECT_EQ(expected[i], rgb[4 * i + 1]);
+    EXPECT_EQ(expected[i], rgb[4 * i + 2]);
+  }
+}
+
+}  // namespace
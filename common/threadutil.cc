@@ -8,6 +8,7 @@
 
 #include <windows.h>
 #include <windowsx.h>
+#include <avrt.h>
 #include <process.h>
 
 #include <memory>
@@ -16,9 +17,49 @@
 #include "eventutil.h"
 #include "threadutil.h"
 
+#pragma comment(lib, "avrt.lib")
+
 namespace WebmMfUtil
 {
 
+namespace
+{
+
+const wchar_t kThreadPolicyKey[] = L"Software\\WebM\\ThreadPolicy";
+
+struct ThreadClassName
+{
+    const wchar_t* name;
+    ThreadClass thread_class;
+};
+
+const ThreadClassName kThreadClassNames[] =
+{
+    { L"Normal", kThreadClassNormal },
+    { L"Playback", kThreadClassPlayback },
+    { L"Capture", kThreadClassCapture },
+    { L"Pro Audio", kThreadClassProAudio },
+    { L"Background", kThreadClassBackground }
+};
+
+// The MMCSS task of a media class, or NULL.
+const wchar_t* GetTaskName(ThreadClass thread_class)
+{
+    switch (thread_class)
+    {
+    case kThreadClassPlayback:
+        return L"Playback";
+    case kThreadClassCapture:
+        return L"Capture";
+    case kThreadClassProAudio:
+        return L"Pro Audio";
+    default:
+        return NULL;
+    }
+}
+
+} // anonymous namespace
+
 SimpleThread::SimpleThread():
   ptr_user_thread_data_(NULL),
   ptr_thread_func_(NULL),
@@ -169,4 +210,86 @@ bool StoppableThread::StopRequested()
     return true;
 }
 
+ThreadClass ParseThreadClass(const wchar_t* name, ThreadClass default_class)
+{
+    if (!name)
+        return default_class;
+
+    const size_t count =
+        sizeof(kThreadClassNames) / sizeof(kThreadClassNames[0]);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (0 == _wcsicmp(name, kThreadClassNames[i].name))
+            return kThreadClassNames[i].thread_class;
+    }
+    return default_class;
+}
+
+ThreadClass GetThreadClass(const wchar_t* component,
+                           ThreadClass default_class)
+{
+    if (!component)
+        return default_class;
+
+    wchar_t name[32];
+    DWORD size = sizeof(name);
+
+    const LONG status = RegGetValueW(HKEY_CURRENT_USER, kThreadPolicyKey,
+                                     component, RRF_RT_REG_SZ, NULL, name,
+                                     &size);
+    if (ERROR_SUCCESS != status)
+        return default_class;
+
+    return ParseThreadClass(name, default_class);
+}
+
+ThreadPolicyScope::ThreadPolicyScope(const wchar_t* component,
+                                     ThreadClass default_class):
+  thread_class_(GetThreadClass(component, default_class)),
+  mmcss_handle_(NULL),
+  old_priority_(GetThreadPriority(GetCurrentThread())),
+  priority_set_(false)
+{
+    const HANDLE thread = GetCurrentThread();
+
+    if (kThreadClassBackground == thread_class_)
+    {
+        priority_set_ =
+            SetThreadPriority(thread, THREAD_MODE_BACKGROUND_BEGIN) != FALSE;
+        return;
+    }
+
+    const wchar_t* const task_name = GetTaskName(thread_class_);
+    if (!task_name)
+        return;
+
+    DWORD task_index = 0;
+    mmcss_handle_ = AvSetMmThreadCharacteristicsW(task_name, &task_index);
+    if (mmcss_handle_)
+        return;
+
+    DBGLOG("AvSetMmThreadCharacteristics failed; raising priority instead");
+    const int priority = (kThreadClassProAudio == thread_class_) ?
+        THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_ABOVE_NORMAL;
+    priority_set_ = SetThreadPriority(thread, priority) != FALSE;
+}
+
+ThreadPolicyScope::~ThreadPolicyScope()
+{
+    if (mmcss_handle_)
+    {
+        AvRevertMmThreadCharacteristics(mmcss_handle_);
+    }
+    if (!priority_set_)
+        return;
+
+    const HANDLE thread = GetCurrentThread();
+
+    if (kThreadClassBackground == thread_class_)
+        SetThreadPriority(thread, THREAD_MODE_BACKGROUND_END);
+    else
+        SetThreadPriority(thread, old_priority_);
+}
+
 } // WebmMfUtil namespace
@@ -9,6 +9,10 @@
 #ifndef __WEBMDSHOW_COMMON_THREADUTIL_HPP__
 #define __WEBMDSHOW_COMMON_THREADUTIL_HPP__
 
+#include <windows.h>
+
+#include <memory>
+
 #include "debugutil.h"
 #include "eventutil.h"
 
@@ -63,6 +67,57 @@ private:
     DISALLOW_COPY_AND_ASSIGN(StoppableThread);
 };
 
+// How a thread is scheduled.  The media classes join an MMCSS task, so
+// that a streaming thread keeps to its schedule when the system is under
+// load; a background thread (prefetch, indexing) runs in background mode,
+// at low CPU and I/O priority, so that it takes no time from them.
+enum ThreadClass
+{
+    kThreadClassNormal,     // left as it was created
+    kThreadClassPlayback,   // MMCSS "Playback"
+    kThreadClassCapture,    // MMCSS "Capture"
+    kThreadClassProAudio,   // MMCSS "Pro Audio"
+    kThreadClassBackground
+};
+
+// Returns the class named by |name| ("Normal", "Playback", "Capture",
+// "Pro Audio" or "Background", in any case), or |default_class| if it
+// names none.
+ThreadClass ParseThreadClass(const wchar_t* name, ThreadClass default_class);
+
+// Returns the class the threads of |component| (the module name, such as
+// L"webmsplit") run in: the one named by the REG_SZ value |component|
+// under HKEY_CURRENT_USER\Software\WebM\ThreadPolicy, if there is one,
+// or else |default_class|.
+ThreadClass GetThreadClass(const wchar_t* component,
+                           ThreadClass default_class);
+
+// Puts the calling thread in the class configured for |component| for
+// the life of the scope, which must end on the same thread.  If MMCSS
+// won't take the thread, a media thread is raised above normal priority
+// instead.
+class ThreadPolicyScope
+{
+public:
+    ThreadPolicyScope(const wchar_t* component, ThreadClass default_class);
+    ~ThreadPolicyScope();
+    ThreadClass thread_class() const
+    {
+        return thread_class_;
+    }
+    // True if the thread joined an MMCSS task.
+    bool mmcss_registered() const
+    {
+        return NULL != mmcss_handle_;
+    }
+private:
+    const ThreadClass thread_class_;
+    HANDLE mmcss_handle_;
+    const int old_priority_;
+    bool priority_set_;
+    DISALLOW_COPY_AND_ASSIGN(ThreadPolicyScope);
+};
+
 } // WebmMfUtil namespace
 
 #endif // __WEBMDSHOW_COMMON_THREADUTIL_HPP__
\ No newline at end of file
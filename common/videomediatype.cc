@@ -0,0 +1,151 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "videomediatype.h"
+
+#include <amvideo.h>
+#include <dvdmedia.h>
+#include <uuids.h>
+
+#include <cassert>
+#include <cstdlib>
+
+#include "cmediatypes.h"
+#include "webmtypes.h"
+
+namespace webmdshow {
+
+namespace {
+
+BITMAPINFOHEADER* GetBitmap(AM_MEDIA_TYPE& mt, RECT** rc_source,
+                            RECT** rc_target) {
+  if (mt.pbFormat == NULL)
+    return NULL;
+
+  if (mt.formattype == FORMAT_VideoInfo) {
+    if (mt.cbFormat < sizeof(VIDEOINFOHEADER))
+      return NULL;
+
+    VIDEOINFOHEADER& vih = reinterpret_cast<VIDEOINFOHEADER&>(*mt.pbFormat);
+    *rc_source = &vih.rcSource;
+    *rc_target = &vih.rcTarget;
+
+    return &vih.bmiHeader;
+  }
+
+  if (mt.formattype == FORMAT_VideoInfo2) {
+    if (mt.cbFormat < sizeof(VIDEOINFOHEADER2))
+      return NULL;
+
+    VIDEOINFOHEADER2& vih2 =
+        reinterpret_cast<VIDEOINFOHEADER2&>(*mt.pbFormat);
+    *rc_source = &vih2.rcSource;
+    *rc_target = &vih2.rcTarget;
+
+    return &vih2.bmiHeader;
+  }
+
+  return NULL;
+}
+
+}  // namespace
+
+bool GetVideoBitmap(const AM_MEDIA_TYPE& mt, const BITMAPINFOHEADER** bmih,
+                    const RECT** rc_source) {
+  assert(bmih);
+  assert(rc_source);
+
+  RECT* rc;
+  RECT* rc_target;
+
+  *bmih = GetBitmap(const_cast<AM_MEDIA_TYPE&>(mt), &rc, &rc_target);
+
+  if (*bmih == NULL)
+    return false;
+
+  *rc_source = rc;
+  return true;
+}
+
+bool GetVideoFrameSize(const AM_MEDIA_TYPE& mt, LONG* width, LONG* height) {
+  assert(width);
+  assert(height);
+
+  const BITMAPINFOHEADER* bmih;
+  const RECT* rc;
+
+  if (!GetVideoBitmap(mt, &bmih, &rc))
+    return false;
+
+  if (IsRectEmpty(rc)) {
+    *width = bmih->biWidth;
+    *height = labs(bmih->biHeight);
+  } else {
+    *width = rc->right - rc->left;
+    *height = rc->bottom - rc->top;
+  }
+
+  return true;
+}
+
+HRESULT ResizeVideoMediaType(const AM_MEDIA_TYPE& mt, LONG width,
+                             LONG height, CMediaTypes* mtv) {
+  assert(mtv);
+
+  if ((width <= 0) || (height <= 0))
+    return E_INVALIDARG;
+
+  HRESULT hr = mtv->Add(mt);
+
+  if (FAILED(hr))
+    return hr;
+
+  AM_MEDIA_TYPE& mt_new = (*mtv)[mtv->Size() - 1];
+
+  RECT* rc_source;
+  RECT* rc_target;
+
+  BITMAPINFOHEADER* const bmih = GetBitmap(mt_new, &rc_source, &rc_target);
+
+  if (bmih == NULL)
+    return E_INVALIDARG;
+
+  const LONG stride = (width + 1) & ~1;
+
+  bmih->biWidth = stride;
+  bmih->biHeight = (bmih->biHeight < 0) ? -height : height;
+
+  if (bmih->biBitCount == 12) {  // planar 4:2:0
+    const LONG uv_height = (height + 1) / 2;
+    bmih->biSizeImage = stride * height + stride * uv_height;
+  } else if ((mt_new.subtype == WebmTypes::MEDIASUBTYPE_P010) ||
+             (mt_new.subtype == WebmTypes::MEDIASUBTYPE_P016)) {
+    const LONG uv_height = (height + 1) / 2;  // planar 4:2:0, 16-bit
+    bmih->biSizeImage = 2 * (stride * height + stride * uv_height);
+  } else {  // packed, with rows of whole DWORDs, as DIBs have
+    const LONG row = ((stride * bmih->biBitCount + 31) & ~31) / 8;
+    bmih->biSizeImage = row * height;
+  }
+
+  SetRect(rc_source, 0, 0, width, height);
+  *rc_target = *rc_source;
+
+  if (mt_new.formattype == FORMAT_VideoInfo2) {
+    VIDEOINFOHEADER2& vih2 =
+        reinterpret_cast<VIDEOINFOHEADER2&>(*mt_new.pbFormat);
+
+    vih2.dwPictAspectRatioX = width;
+    vih2.dwPictAspectRatioY = height;
+  }
+
+  mt_new.lSampleSize = bmih->biSizeImage;
+
+  return S_OK;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,40 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VIDEOMEDIATYPE_H_
+#define WEBMDSHOW_COMMON_VIDEOMEDIATYPE_H_
+
+#include <strmif.h>
+
+class CMediaTypes;
+
+namespace webmdshow {
+
+// Gets the bitmap and the source rectangle of a FORMAT_VideoInfo or
+// FORMAT_VideoInfo2 media type. Returns false for any other format, or a
+// format block too small for its type.
+bool GetVideoBitmap(const AM_MEDIA_TYPE& mt, const BITMAPINFOHEADER** bmih,
+                    const RECT** rc_source);
+
+// Gets the size of the frames of a FORMAT_VideoInfo or FORMAT_VideoInfo2
+// media type: that of its source rectangle, or of its bitmap when the
+// rectangle is empty. Returns false for any other format.
+bool GetVideoFrameSize(const AM_MEDIA_TYPE& mt, LONG* width, LONG* height);
+
+// Adds to |mtv| a copy of the uncompressed video type |mt|, for frames of
+// |width| x |height|. The bitmap is as wide as the frame (rounded up to
+// even) and keeps the sign of its height, the rectangles cover the frame,
+// and the image and sample sizes are those of the new bitmap. This is the
+// type a decoder attaches to its next sample when the stream changes
+// resolution.
+HRESULT ResizeVideoMediaType(const AM_MEDIA_TYPE& mt, LONG width,
+                             LONG height, CMediaTypes* mtv);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VIDEOMEDIATYPE_H_
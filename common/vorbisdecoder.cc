@@ -25,14 +25,19 @@ typedef long HRESULT;
 #endif
 
 #include "debugutil.h"
+#include "pcmutil.h"
 #include "vorbisdecoder.h"
+#include "vorbistypes.h"
 
 namespace WebmMfVorbisDecLib
 {
 
 VorbisDecoder::VorbisDecoder() :
   m_ogg_packet_count(0),
-  m_bytes_per_sample(sizeof(float))
+  m_synthesis_init(false),
+  m_converting(false),
+  m_bytes_per_sample(sizeof(float)),
+  m_output_read(0)
 {
     ::memset(&m_vorbis_info, 0, sizeof vorbis_info);
     ::memset(&m_vorbis_comment, 0, sizeof vorbis_comment);
@@ -96,19 +101,33 @@ int VorbisDecoder::CreateDecoder(const BYTE** const ptr_headers,
             return E_INVALIDARG;
     }
 
-    // final init steps, setup decoder state...
-    status = vorbis_synthesis_init(&m_vorbis_state, &m_vorbis_info);
+    assert(m_vorbis_info.rate > 0);
+    assert(m_vorbis_info.channels > 0);
+
+    // The decoder state is set up by the first call to Decode (see
+    // InitSynthesis_).
+    return S_OK;
+}
+
+int VorbisDecoder::InitSynthesis_()
+{
+    assert(!m_synthesis_init);
+
+    // final init steps, setup decoder state (this builds the MDCT and
+    // codebook lookup tables, which is the bulk of the work)...
+    int status = vorbis_synthesis_init(&m_vorbis_state, &m_vorbis_info);
     if (status != 0)
-        return E_INVALIDARG;
+        return E_FAIL;
 
     // ... and vorbis block structs
     status = vorbis_block_init(&m_vorbis_state, &m_vorbis_block);
     if (status != 0)
-        return E_INVALIDARG;
-
-    assert(m_vorbis_info.rate > 0);
-    assert(m_vorbis_info.channels > 0);
+    {
+        vorbis_dsp_clear(&m_vorbis_state);
+        return E_FAIL;
+    }
 
+    m_synthesis_init = true;
     return S_OK;
 }
 
@@ -144,19 +163,34 @@ void VorbisDecoder::DestroyDecoder()
 {
     m_ogg_packet_count = 0;
 
-    vorbis_block_clear(&m_vorbis_block);
-    vorbis_dsp_clear(&m_vorbis_state);
+    if (m_synthesis_init)
+    {
+        vorbis_block_clear(&m_vorbis_block);
+        vorbis_dsp_clear(&m_vorbis_state);
+        m_synthesis_init = false;
+    }
+
     vorbis_comment_clear(&m_vorbis_comment);
 
     // note, from vorbis decoder sample: vorbis_info_clear must be last call
     vorbis_info_clear(&m_vorbis_info);
 
-    m_output_samples.clear();
+    ClearOutputSamples_();
+    m_converting = false;
 }
 
 int VorbisDecoder::Decode(BYTE* ptr_samples, UINT32 length)
 {
-    int status = NextOggPacket_(ptr_samples, length);
+    int status;
+
+    if (!m_synthesis_init)
+    {
+        status = InitSynthesis_();
+        if (FAILED(status))
+            return status;
+    }
+
+    status = NextOggPacket_(ptr_samples, length);
     if (FAILED(status))
         return E_FAIL;
 
@@ -172,10 +206,7 @@ int VorbisDecoder::Decode(BYTE* ptr_samples, UINT32 length)
       return E_FAIL;
 
     // Consume all PCM samples from libvorbis
-    // Notes:
-    // - channel reordering is performed only when necessary
-    // - all streams w/>2 channels require inteleaving
-    return ReorderAndInterleave_();
+    return StoreOutputSamples_();
 }
 
 int VorbisDecoder::GetOutputSamplesAvailable(UINT32* ptr_num_samples_available)
@@ -183,23 +214,34 @@ int VorbisDecoder::GetOutputSamplesAvailable(UINT32* ptr_num_samples_available)
     if (!ptr_num_samples_available)
         return E_INVALIDARG;
 
-    const pcm_samples_t::size_type samples_size = m_output_samples.size();
-    const UINT32 total_samples_available = static_cast<UINT32>(samples_size);
-    const UINT32 channels = m_vorbis_info.channels;
+    *ptr_num_samples_available = GetStoredBlocks_();
+    return S_OK;
+}
+
+UINT32 VorbisDecoder::GetBlocksToConsume_(UINT32 blocks_requested) const
+{
+    const UINT32 blocks_available = GetStoredBlocks_();
 
-    if (channels > 1)
-    {
-        // caller wants the total samples, not the size of the sample vector
-        *ptr_num_samples_available =
-            (total_samples_available + (channels - 1)) / channels;
-    }
-    else
-    {
-        // for mono the size of the samples vector is the number of samples
-        *ptr_num_samples_available = total_samples_available;
-    }
+    assert(blocks_requested <= blocks_available);
 
-    return S_OK;
+    if (blocks_requested > blocks_available)
+        return blocks_available;
+
+    return blocks_requested;
+}
+
+void VorbisDecoder::SetOutputPtrs_()
+{
+    const int channels = GetOutputChannels();
+
+    for (int channel = 0; channel < channels; ++channel)
+        m_output_ptrs[channel] = &m_output_samples[channel][m_output_read];
+}
+
+void VorbisDecoder::ReleaseConsumedSamples_()
+{
+    if (m_output_read >= m_output_samples[0].size())
+        ClearOutputSamples_();  // keeps capacity
 }
 
 int VorbisDecoder::ConsumeOutputSamples(float* ptr_out_sample_buffer,
@@ -208,148 +250,189 @@ int VorbisDecoder::ConsumeOutputSamples(float* ptr_out_sample_buffer,
     if (!ptr_out_sample_buffer || !blocks_to_consume)
         return E_INVALIDARG;
 
-    if (m_output_samples.empty())
+    if (GetStoredBlocks_() == 0)
+        return MF_E_TRANSFORM_NEED_MORE_INPUT;
+
+    blocks_to_consume = GetBlocksToConsume_(blocks_to_consume);
+
+    SetOutputPtrs_();
+
+    webmdshow::InterleavePcm(&m_output_ptrs[0], GetChannelOrder_(),
+                             GetOutputChannels(), blocks_to_consume,
+                             ptr_out_sample_buffer);
+
+    m_output_read += blocks_to_consume;
+    ReleaseConsumedSamples_();
+
+    return S_OK;
+}
+
+int VorbisDecoder::ConsumeOutputSamples(int16_t* ptr_out_sample_buffer,
+                                        UINT32 blocks_to_consume)
+{
+    if (!ptr_out_sample_buffer || !blocks_to_consume)
+        return E_INVALIDARG;
+
+    if (GetStoredBlocks_() == 0)
         return MF_E_TRANSFORM_NEED_MORE_INPUT;
 
-    const UINT32 samples_to_consume = blocks_to_consume *
-                                      m_vorbis_info.channels;
+    blocks_to_consume = GetBlocksToConsume_(blocks_to_consume);
+
+    const int channels = GetOutputChannels();
+
+    // 16KB of floats: a slice is still in the cache when it is converted.
+    const UINT32 slice_samples = 4096;
+    const UINT32 slice_blocks = (channels < static_cast<int>(slice_samples)) ?
+                                slice_samples / channels : 1;
+
+    if (m_int16_slice.size() < slice_blocks * channels)
+        m_int16_slice.resize(slice_blocks * channels);
 
-    const UINT32 bytes_to_copy = samples_to_consume * m_bytes_per_sample;
-    ::memcpy(ptr_out_sample_buffer, &m_output_samples[0], bytes_to_copy);
+    const int* const order = GetChannelOrder_();
 
-    typedef pcm_samples_t::const_iterator pcm_iterator;
-    pcm_iterator pcm_begin = m_output_samples.begin();
+    while (blocks_to_consume > 0)
+    {
+        const UINT32 blocks = (blocks_to_consume < slice_blocks) ?
+                              blocks_to_consume : slice_blocks;
+        const int samples = static_cast<int>(blocks) * channels;
+
+        SetOutputPtrs_();
 
-    assert(samples_to_consume <= m_output_samples.size());
-    const pcm_iterator pcm_end = pcm_begin + samples_to_consume;
+        webmdshow::InterleavePcm(&m_output_ptrs[0], order, channels, blocks,
+                                 &m_int16_slice[0]);
 
-    m_output_samples.erase(pcm_begin, pcm_end);
+        webmdshow::ConvertFloatToInt16(&m_int16_slice[0], samples,
+                                       webmdshow::kPcmDitherNone, NULL,
+                                       ptr_out_sample_buffer);
+
+        ptr_out_sample_buffer += samples;
+        m_output_read += blocks;
+        blocks_to_consume -= blocks;
+    }
+
+    ReleaseConsumedSamples_();
 
     return S_OK;
 }
 
 void VorbisDecoder::Flush()
 {
-    vorbis_synthesis_restart(&m_vorbis_state);
-    m_output_samples.clear();
+    if (m_synthesis_init)
+        vorbis_synthesis_restart(&m_vorbis_state);
+
+    if (m_converting)
+        m_converter.Reset();
+
+    ClearOutputSamples_();
 }
 
-void VorbisDecoder::ReorderAndInterleaveBlock_(float** ptr_blocks, int sample)
+int VorbisDecoder::SetOutputFormat(int channels, int rate)
 {
     const int vorbis_channels = m_vorbis_info.channels;
-    assert(vorbis_channels > 0);
-
-    // On channel ordering, from the vorbis spec:
-    // http://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
-    // one channel
-    //   the stream is monophonic
-    // two channels
-    //   the stream is stereo. channel order: left, right
-    // three channels
-    //   the stream is a 1d-surround encoding. channel order: left, center,
-    //   right
-    // four channels
-    //   the stream is quadraphonic surround. channel order: front left, front
-    //   right, rear left, rear right
-    // five channels
-    //   the stream is five-channel surround. channel order: front left,
-    //   center, front right, rear left, rear right
-    // six channels
-    //   the stream is 5.1 surround. channel order: front left, center,
-    //   front right, rear left, rear right, LFE
-    // seven channels
-    //   the stream is 6.1 surround. channel order: front left, center,
-    //   front right, side left, side right, rear center, LFE
-    // eight channels
-    //   the stream is 7.1 surround. channel order: front left, center,
-    //   front right, side left, side right, rear left, rear right, LFE
-    // greater than eight channels
-    //   channel use and order is defined by the application
+    const int vorbis_rate = m_vorbis_info.rate;
 
-    switch (vorbis_channels)
+    if (vorbis_channels <= 0)
+        return E_FAIL;  // no stream
+
+    ClearOutputSamples_();
+
+    if (channels == vorbis_channels && rate == vorbis_rate)
     {
-        case 3:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            break;
-        case 5:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[3][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // BR
-            break;
-        case 6:
-            // WebM Vorbis decode multi-channel ordering
-            // 5.1 Vorbis to PCM (Decoding)
-            // Vorbis                PCM
-            // 0 Front Left   => 0 Front Left
-            // 1 Front Center => 2 Front Right
-            // 2 Front Right  => 1 Front Center
-            // 3 Back Left    => 5 LFE
-            // 4 Back Right   => 3 Back Left
-            // 5 LFE          => 4 Back Right
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[5][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[3][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // BR
-            break;
-        case 7:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[6][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[5][sample]); // BC
-            m_output_samples.push_back(ptr_blocks[3][sample]); // SL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // SR
-            break;
-        case 8:
-            // 7.1 Vorbis to PCM (Decoding)
-            // Vorbis             PCM
-            // 0 Front Left   => 0 Front Left
-            // 1 Front Center => 2 Front Right
-            // 2 Front Right  => 1 Front Center
-            // 3 Side Left    => 7 LFE
-            // 4 Side Right   => 5 Back Left
-            // 5 Back Left    => 6 Back Right
-            // 6 Back Right   => 3 Side Left
-            // 7 LFE          => 4 Side Right
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[7][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[5][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[6][sample]); // BR
-            m_output_samples.push_back(ptr_blocks[3][sample]); // SL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // SR
-            break;
-        case 1:
-        case 2:
-        case 4:
-        default:
-            // For mono/stereo/quadrophonic stereo/>8 channels: output in the
-            // order libvorbis uses.  It's correct for the formats named, and
-            // at present the Vorbis spec says streams w/>8 channels have user
-            // defined channel order.
-            for (int channel = 0; channel < vorbis_channels; ++channel)
-                m_output_samples.push_back(ptr_blocks[channel][sample]);
+        m_converting = false;
+        return S_OK;
     }
 
+    // The converter takes WAVE order, as it comes from the Vorbis order.
+    const int* const order = VorbisTypes::GetWaveChannelOrder(vorbis_channels);
+
+    m_converting = m_converter.Init(vorbis_channels, order, vorbis_rate,
+                                    channels, rate);
+
+    return m_converting ? S_OK : E_INVALIDARG;
+}
+
+int VorbisDecoder::GetOutputChannels() const
+{
+    if (m_converting)
+        return m_converter.out_channels();
 
+    return m_vorbis_info.channels;
 }
 
-int VorbisDecoder::ReorderAndInterleave_()
+const int* VorbisDecoder::GetChannelOrder_() const
 {
+    // The converter writes WAVE order already.
+    if (m_converting)
+        return NULL;
+
+    return VorbisTypes::GetWaveChannelOrder(m_vorbis_info.channels);
+}
+
+UINT32 VorbisDecoder::GetStoredBlocks_() const
+{
+    if (m_output_samples.empty())
+        return 0;
+
+    const pcm_samples_t::size_type size = m_output_samples[0].size();
+    return static_cast<UINT32>(size) - m_output_read;
+}
+
+void VorbisDecoder::ClearOutputSamples_()
+{
+    typedef pcm_channels_t::iterator iter_t;
+
+    for (iter_t i = m_output_samples.begin(); i != m_output_samples.end(); ++i)
+        i->clear();
+
+    m_output_read = 0;
+}
+
+int VorbisDecoder::StoreOutputSamples_()
+{
+    const int channels = GetOutputChannels();
+    assert(channels > 0);
+
+    if (m_output_samples.size() != static_cast<size_t>(channels))
+    {
+        m_output_samples.resize(channels);
+        m_output_ptrs.resize(channels);
+    }
+
     int samples = 0;
     float** pp_pcm;
     vorbis_dsp_state* const ptr_state = &m_vorbis_state;
     while ((samples = vorbis_synthesis_pcmout(ptr_state, &pp_pcm)) > 0)
     {
-        for (int sample = 0; sample < samples; ++sample)
-            ReorderAndInterleaveBlock_(pp_pcm, sample);
+        // Drop the consumed blocks once they are the larger part of the
+        // store, so that the move is amortized over many reads.
+        if (m_output_read > 0 && m_output_read >= GetStoredBlocks_())
+        {
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                pcm_samples_t& pcm = m_output_samples[channel];
+                pcm.erase(pcm.begin(), pcm.begin() + m_output_read);
+            }
+
+            m_output_read = 0;
+        }
+
+        // The conversion is the one pass over the decoded samples; its
+        // output is what is stored.
+        const float* const* ptr_planes = pp_pcm;
+        int count = samples;
+
+        if (m_converting)
+        {
+            count = m_converter.Process(pp_pcm, samples);
+            ptr_planes = m_converter.output();
+        }
+
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            pcm_samples_t& pcm = m_output_samples[channel];
+            const float* const ptr_pcm = ptr_planes[channel];
+            pcm.insert(pcm.end(), ptr_pcm, ptr_pcm + count);
+        }
 
         vorbis_synthesis_read(ptr_state, samples);
     }
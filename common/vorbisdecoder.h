@@ -9,6 +9,9 @@
 #ifndef _MEDIAFOUNDATION_WEBMMFVORBISDEC_VORBISDECODER_HPP_
 #define _MEDIAFOUNDATION_WEBMMFVORBISDEC_VORBISDECODER_HPP_
 
+#include <stdint.h>
+
+#include "pcmconverter.h"
 #include "vorbis/codec.h"
 
 namespace WebmMfVorbisDecLib
@@ -21,6 +24,10 @@ class VorbisDecoder
 public:
     VorbisDecoder();
     ~VorbisDecoder();
+    // Parses the headers, after which the rate and channels of the stream
+    // are known; the decoder state itself is set up by the first Decode,
+    // so that a decoder that is only asked about its formats (as the shell
+    // does, to show the properties of a file) never pays for it.
     int CreateDecoder(const BYTE** const ptr_headers,
                       const DWORD* const header_lengths,
                       unsigned int num_headers /* must be == 3 */);
@@ -31,8 +38,18 @@ public:
     int Decode(BYTE* ptr_samples, UINT32 length);
 
     int GetOutputSamplesAvailable(UINT32* ptr_num_samples_available);
+
+    // Writes |blocks_to_consume| interleaved sample blocks, in WAVE channel
+    // order, straight into |ptr_out_sample_buffer| (typically the locked
+    // output buffer).
     int ConsumeOutputSamples(float* ptr_out_sample_buffer,
                              UINT32 blocks_to_consume);
+
+    // As above, but as 16-bit PCM, rounded and saturated, for clients that
+    // take integer samples; this saves them a float buffer and a second
+    // pass over it.
+    int ConsumeOutputSamples(int16_t* ptr_out_sample_buffer,
+                             UINT32 blocks_to_consume);
     void Flush();
 
     int GetVorbisRate() const
@@ -44,13 +61,26 @@ public:
         return m_vorbis_info.channels;
     };
 
+    // Mixes and resamples the decoded samples to |channels| at |rate| as
+    // they are stored, so that they are consumed in that format; see
+    // webmdshow::PcmConverter for the conversions supported.  The stream's
+    // own format turns the conversion off.  Discards the stored samples.
+    int SetOutputFormat(int channels, int rate);
+    int GetOutputChannels() const;
+
     UINT32 GetChannelMask() const;
 
 private:
     int NextOggPacket_(const BYTE* ptr_packet, DWORD packet_size);
+    int InitSynthesis_();
 
-    void ReorderAndInterleaveBlock_(float** ptr_blocks, int sample);
-    int ReorderAndInterleave_();
+    int StoreOutputSamples_();
+    UINT32 GetBlocksToConsume_(UINT32 blocks_requested) const;
+    void SetOutputPtrs_();
+    void ReleaseConsumedSamples_();
+    const int* GetChannelOrder_() const;
+    UINT32 GetStoredBlocks_() const;
+    void ClearOutputSamples_();
 
     ogg_packet m_ogg_packet;
     DWORD m_ogg_packet_count;
@@ -59,13 +89,30 @@ private:
     vorbis_comment m_vorbis_comment; // contains user comments
     vorbis_dsp_state m_vorbis_state; // decoder state
     vorbis_block m_vorbis_block; // working space for packet->PCM decode
+    bool m_synthesis_init; // m_vorbis_state and m_vorbis_block are set up
 
     const int m_bytes_per_sample;
 
     WAVEFORMATEX m_wave_format;
 
+    // Decoded samples are kept planar, in Vorbis channel order, as
+    // libvorbis returns them; reordering and interleaving happen in one
+    // pass as the samples are consumed.  Blocks before m_output_read have
+    // been consumed.
     typedef std::vector<float> pcm_samples_t;
-    pcm_samples_t m_output_samples;
+    typedef std::vector<pcm_samples_t> pcm_channels_t;
+    pcm_channels_t m_output_samples;
+    UINT32 m_output_read;
+
+    typedef std::vector<const float*> pcm_ptrs_t;
+    pcm_ptrs_t m_output_ptrs;
+
+    webmdshow::PcmConverter m_converter;
+    bool m_converting;
+
+    // 16-bit output is interleaved a slice at a time into this buffer,
+    // which stays in the cache, and converted from there.
+    pcm_samples_t m_int16_slice;
 
     // disallow copy and assign
     DISALLOW_COPY_AND_ASSIGN(VorbisDecoder);
@@ -73,3 +73,132 @@ const GUID VorbisTypes::FORMAT_Vorbis =
     0x4de1,
     { 0x9b, 0xaa, 0x89, 0x1, 0xf8, 0x52, 0xda, 0xe4 }
 };
+
+
+long VorbisTypes::GetXiphLacedPackets(
+    const BYTE* buf,
+    long len,
+    const BYTE** packets,
+    long* lengths,
+    long max)
+{
+    if ((buf == 0) || (len <= 0))
+        return -1;
+
+    const BYTE* p = buf;
+    const BYTE* const end = buf + len;
+
+    const long count = long(*p++) + 1;
+
+    if (count > max)
+        return -1;
+
+    long total = 0;
+
+    for (long i = 0; i < (count - 1); ++i)
+    {
+        long size = 0;
+
+        for (;;)
+        {
+            if (p >= end)
+                return -1;
+
+            const BYTE b = *p++;
+            size += b;
+
+            if (b < 255)
+                break;
+        }
+
+        lengths[i] = size;
+        total += size;
+    }
+
+    const long remaining = static_cast<long>(end - p);
+
+    if (total > remaining)
+        return -1;
+
+    lengths[count - 1] = remaining - total;
+
+    for (long i = 0; i < count; ++i)
+    {
+        packets[i] = p;
+        p += lengths[i];
+    }
+
+    return count;
+}
+
+
+const int* VorbisTypes::GetWaveChannelOrder(long channels)
+{
+    // On channel ordering, from the vorbis spec:
+    // http://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
+    // one channel
+    //   the stream is monophonic
+    // two channels
+    //   the stream is stereo. channel order: left, right
+    // three channels
+    //   the stream is a 1d-surround encoding. channel order: left, center,
+    //   right
+    // four channels
+    //   the stream is quadraphonic surround. channel order: front left, front
+    //   right, rear left, rear right
+    // five channels
+    //   the stream is five-channel surround. channel order: front left,
+    //   center, front right, rear left, rear right
+    // six channels
+    //   the stream is 5.1 surround. channel order: front left, center,
+    //   front right, rear left, rear right, LFE
+    // seven channels
+    //   the stream is 6.1 surround. channel order: front left, center,
+    //   front right, side left, side right, rear center, LFE
+    // eight channels
+    //   the stream is 7.1 surround. channel order: front left, center,
+    //   front right, side left, side right, rear left, rear right, LFE
+    // greater than eight channels
+    //   channel use and order is defined by the application
+    //
+    // Each table lists, for each WAVE (PCM) channel, the Vorbis channel it
+    // is read from.
+
+    // FL FR FC
+    static const int order3[] = { 0, 2, 1 };
+
+    // FL FR FC BL BR
+    static const int order5[] = { 0, 2, 1, 3, 4 };
+
+    // FL FR FC LFE BL BR
+    static const int order6[] = { 0, 2, 1, 5, 3, 4 };
+
+    // FL FR FC LFE BC SL SR
+    static const int order7[] = { 0, 2, 1, 6, 5, 3, 4 };
+
+    // FL FR FC LFE BL BR SL SR
+    static const int order8[] = { 0, 2, 1, 7, 5, 6, 3, 4 };
+
+    switch (channels)
+    {
+        case 3:
+            return order3;
+        case 5:
+            return order5;
+        case 6:
+            return order6;
+        case 7:
+            return order7;
+        case 8:
+            return order8;
+        case 1:
+        case 2:
+        case 4:
+        default:
+            // For mono/stereo/quadrophonic stereo/>8 channels: output in the
+            // order libvorbis uses.  It's correct for the formats named, and
+            // at present the Vorbis spec says streams w/>8 channels have user
+            // defined channel order.
+            return NULL;
+    }
+}
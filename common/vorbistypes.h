@@ -41,4 +41,21 @@ namespace VorbisTypes
     extern const GUID MEDIASUBTYPE_Vorbis;
     extern const GUID FORMAT_Vorbis;
 
+    //Splits a sample of MEDIASUBTYPE_Vorbis2_Xiph_Lacing into its packets.
+    //The sample is a byte with the packet count less one, then the size
+    //of each packet but the last (as a run of 255s and a final byte less
+    //than 255), then the packets themselves.  Returns the packet count,
+    //or -1 if the sample is malformed or has more than max packets.
+    long GetXiphLacedPackets(
+        const BYTE* buf,
+        long len,
+        const BYTE** packets,
+        long* lengths,
+        long max);
+
+    //The Vorbis channel that each WAVE channel is read from, for streams
+    //of 3, 5, 6, 7 or 8 channels, whose Vorbis order is not the WAVE one;
+    //NULL for the other counts, which need no reordering.
+    const int* GetWaveChannelOrder(long channels);
+
 }  //end namespace VorbisTypes
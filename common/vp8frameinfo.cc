@@ -0,0 +1,197 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "vp8frameinfo.h"
+
+namespace webmdshow {
+
+namespace {
+
+// The boolean entropy decoder of RFC 6386, section 7.3. Reading past the
+// end of the buffer shifts in zeros, as libvpx does.
+class BoolDecoder {
+ public:
+  BoolDecoder(const uint8_t* data, size_t size)
+      : ptr_(data), end_(data + size), value_(0), range_(255), bit_count_(0) {
+    value_ = (NextByte() << 8);
+    value_ |= NextByte();
+  }
+
+  bool ReadBool(int prob) {
+    const uint32_t split = 1 + (((range_ - 1) * prob) >> 8);
+    const uint32_t big_split = split << 8;
+    bool bit;
+
+    if (value_ >= big_split) {
+      bit = true;
+      range_ -= split;
+      value_ -= big_split;
+    } else {
+      bit = false;
+      range_ = split;
+    }
+
+    while (range_ < 128) {
+      value_ <<= 1;
+      range_ <<= 1;
+
+      if (++bit_count_ == 8) {
+        bit_count_ = 0;
+        value_ |= NextByte();
+      }
+    }
+
+    return bit;
+  }
+
+  bool ReadBit() { return ReadBool(128); }
+
+  uint32_t ReadLiteral(int bits) {
+    uint32_t v = 0;
+
+    while (bits-- > 0)
+      v = (v << 1) | (ReadBit() ? 1 : 0);
+
+    return v;
+  }
+
+  // An optional field: a flag, and when it is set, a magnitude of |bits|
+  // bits followed by a sign bit. Only the syntax matters here.
+  void SkipOptionalSigned(int bits) {
+    if (ReadBit())
+      ReadLiteral(bits + 1);
+  }
+
+ private:
+  uint32_t NextByte() { return (ptr_ < end_) ? *ptr_++ : 0; }
+
+  const uint8_t* ptr_;
+  const uint8_t* const end_;
+  uint32_t value_;
+  uint32_t range_;
+  int bit_count_;
+};
+
+// Reads the frame header up to refresh_last, or for a key frame up to the
+// loop filter level, into |info|.
+void ParseFrameHeader(BoolDecoder* d, bool key_frame, Vp8FrameInfo* info) {
+  bool persistent = false;
+
+  if (key_frame)
+    d->ReadLiteral(2);  // color_space, clamping_type
+
+  if (d->ReadBit()) {  // segmentation_enabled
+    const bool update_map = d->ReadBit();
+    const bool update_data = d->ReadBit();
+
+    if (update_data) {
+      d->ReadBit();  // segment_feature_mode
+
+      for (int i = 0; i < 4; ++i)
+        d->SkipOptionalSigned(7);  // quantizer
+
+      for (int i = 0; i < 4; ++i)
+        d->SkipOptionalSigned(6);  // loop filter level
+    }
+
+    if (update_map) {
+      for (int i = 0; i < 3; ++i) {
+        if (d->ReadBit())
+          d->ReadLiteral(8);  // segment_prob
+      }
+    }
+
+    persistent = update_map || update_data;
+  }
+
+  d->ReadBit();  // filter_type
+  info->filter_level = static_cast<int>(d->ReadLiteral(6));
+  d->ReadLiteral(3);  // sharpness_level
+
+  // A key frame resets everything, so it is never droppable.
+  if (key_frame)
+    return;
+
+  if (d->ReadBit()) {  // loop_filter_adj_enable
+    if (d->ReadBit()) {  // mode_ref_lf_delta_update
+      for (int i = 0; i < 8; ++i)
+        d->SkipOptionalSigned(6);  // ref_frame and mb_mode deltas
+
+      persistent = true;
+    }
+  }
+
+  d->ReadLiteral(2);  // log2_nbr_of_dct_partitions
+  d->ReadLiteral(7);  // y_ac_qi
+
+  for (int i = 0; i < 5; ++i)
+    d->SkipOptionalSigned(4);  // y_dc, y2_dc, y2_ac, uv_dc, uv_ac deltas
+
+  const bool refresh_golden = d->ReadBit();
+  const bool refresh_alt = d->ReadBit();
+
+  const uint32_t copy_to_golden = refresh_golden ? 0 : d->ReadLiteral(2);
+  const uint32_t copy_to_alt = refresh_alt ? 0 : d->ReadLiteral(2);
+
+  d->ReadLiteral(2);  // sign_bias_golden, sign_bias_alternate
+
+  const bool refresh_entropy_probs = d->ReadBit();
+  const bool refresh_last = d->ReadBit();
+
+  info->droppable = !persistent && !refresh_golden && !refresh_alt &&
+                    (copy_to_golden == 0) && (copy_to_alt == 0) &&
+                    !refresh_entropy_probs && !refresh_last;
+}
+
+}  // namespace
+
+bool ParseVp8FrameInfo(const uint8_t* data, size_t size, Vp8FrameInfo* info) {
+  if (data == NULL || info == NULL || size < 3)
+    return false;
+
+  const uint32_t tag = data[0] | (data[1] << 8) | (data[2] << 16);
+
+  const bool key_frame = (tag & 1) == 0;
+  const uint32_t version = (tag >> 1) & 7;
+  const bool show_frame = ((tag >> 4) & 1) != 0;
+  const size_t first_part_size = tag >> 5;
+
+  if (version > 3)
+    return false;
+
+  data += 3;
+  size -= 3;
+
+  if (key_frame) {
+    if (size < 7)
+      return false;
+
+    if (data[0] != 0x9D || data[1] != 0x01 || data[2] != 0x2A)
+      return false;  // start code
+
+    data += 7;
+    size -= 7;
+  }
+
+  if (first_part_size > size)
+    return false;
+
+  Vp8FrameInfo result;
+  result.key_frame = key_frame;
+  result.show_frame = show_frame;
+  result.droppable = false;
+  result.filter_level = 0;
+
+  BoolDecoder d(data, first_part_size);
+  ParseFrameHeader(&d, key_frame, &result);
+
+  *info = result;
+  return true;
+}
+
+}  // namespace webmdshow
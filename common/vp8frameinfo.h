@@ -0,0 +1,41 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VP8FRAMEINFO_H_
+#define WEBMDSHOW_COMMON_VP8FRAMEINFO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace webmdshow {
+
+struct Vp8FrameInfo {
+  bool key_frame;
+  bool show_frame;
+
+  // True for an inter frame that leaves no state behind in the decoder: it
+  // refreshes none of the last, golden and altref buffers, does not copy
+  // into golden or altref, keeps its probability updates frame-local, and
+  // does not update the segmentation map, segment features or loop filter
+  // deltas. Such a frame can be skipped without affecting later frames.
+  bool droppable;
+
+  // The frame's loop_filter_level, before segment and mode adjustments,
+  // which is what libvpx bases its postprocessing strength on.
+  int filter_level;
+};
+
+// Parses the frame tag and the start of the first partition of the VP8
+// frame in |data| (RFC 6386, sections 9.1 to 9.11), up to the refresh_last
+// flag. Nothing is decoded. Returns false when |data| is too short or is
+// not a VP8 frame; |info| is then unchanged.
+bool ParseVp8FrameInfo(const uint8_t* data, size_t size, Vp8FrameInfo* info);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VP8FRAMEINFO_H_
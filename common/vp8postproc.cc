@@ -0,0 +1,195 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "vp8postproc.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// The noise table is read from a random offset of up to 255 on each row.
+enum { kNoiseOffsets = 256, kMinNoiseSize = 3072 };
+
+// The [1 1 4 1 1] / 8 filter of the centre tap |c|, unless a tap differs
+// from it by more than |limit|.
+inline uint8_t Smooth(int a, int b, int c, int d, int e, int limit) {
+  if (abs(a - c) > limit || abs(b - c) > limit || abs(d - c) > limit ||
+      abs(e - c) > limit) {
+    return static_cast<uint8_t>(c);
+  }
+
+  return static_cast<uint8_t>((a + b + 4 * c + d + e + 4) >> 3);
+}
+
+// The limit vp8_deblock derives from the quantizer-like |q|.
+int GetDeblockLimit(int q) {
+  const double level =
+      6.0e-05 * q * q * q - .0067 * q * q + .306 * q + .0065;
+
+  return static_cast<int>(level + .5);
+}
+
+}  // namespace
+
+Vp8Postprocessor::Vp8Postprocessor()
+    : noise_q_(-1), noise_level_(-1), noise_clamp_(0), random_(1) {}
+
+bool Vp8Postprocessor::IsEnabled(const vp8_postproc_cfg_t& cfg) {
+  const int flags = VP8_DEBLOCK | VP8_DEMACROBLOCK | VP8_ADDNOISE;
+  return (cfg.post_proc_flag & flags) != 0;
+}
+
+void Vp8Postprocessor::Process(const vp8_postproc_cfg_t& cfg,
+                               int filter_level, vpx_image_t* frame) {
+  assert(frame);
+
+  const int flags = cfg.post_proc_flag;
+
+  // As vp8_post_proc_frame.
+  const int q = filter_level * 10 / 6;
+
+  const int w = frame->d_w;
+  const int h = frame->d_h;
+
+  if (flags & (VP8_DEBLOCK | VP8_DEMACROBLOCK)) {
+    int deblock_q = q;
+
+    if (flags & VP8_DEMACROBLOCK)
+      deblock_q += (cfg.deblocking_level - 5) * 10;
+
+    const int limit = GetDeblockLimit(deblock_q);
+
+    if (limit > 0) {
+      const int uv_w = (w + 1) / 2;
+      const int uv_h = (h + 1) / 2;
+
+      Deblock(limit, frame->planes[VPX_PLANE_Y], frame->stride[VPX_PLANE_Y],
+              w, h);
+      Deblock(limit, frame->planes[VPX_PLANE_U], frame->stride[VPX_PLANE_U],
+              uv_w, uv_h);
+      Deblock(limit, frame->planes[VPX_PLANE_V], frame->stride[VPX_PLANE_V],
+              uv_w, uv_h);
+    }
+  }
+
+  if (flags & VP8_ADDNOISE) {
+    AddNoise(63 - q, cfg.noise_level, frame->planes[VPX_PLANE_Y],
+             frame->stride[VPX_PLANE_Y], w, h);
+  }
+}
+
+void Vp8Postprocessor::Deblock(int limit, uint8_t* plane, int stride, int w,
+                               int h) {
+  if (w <= 0 || h <= 0)
+    return;
+
+  rows_.resize(3 * w + 4);
+
+  uint8_t* above2 = &rows_[0];
+  uint8_t* above1 = above2 + w;
+  uint8_t* const line = above1 + w + 2;  // line[-2] to line[w + 1]
+
+  // The edge rows and columns stand in for those past them.
+  memcpy(above2, plane, w);
+  memcpy(above1, plane, w);
+
+  for (int y = 0; y < h; ++y) {
+    uint8_t* const row = plane + y * stride;
+    const uint8_t* const below1 = (y + 1 < h) ? row + stride : row;
+    const uint8_t* const below2 = (y + 2 < h) ? below1 + stride : below1;
+
+    for (int x = 0; x < w; ++x)
+      line[x] = Smooth(above2[x], above1[x], row[x], below1[x], below2[x],
+                       limit);
+
+    // The next row's taps above are this one's unfiltered pixels.
+    uint8_t* const t = above2;
+    above2 = above1;
+    above1 = t;
+    memcpy(above1, row, w);
+
+    line[-2] = line[-1] = line[0];
+    line[w] = line[w + 1] = line[w - 1];
+
+    for (int x = 0; x < w; ++x)
+      row[x] = Smooth(line[x - 2], line[x - 1], line[x], line[x + 1],
+                      line[x + 2], limit);
+  }
+}
+
+void Vp8Postprocessor::AddNoise(int q, int level, uint8_t* plane, int stride,
+                                int w, int h) {
+  if (w <= 0 || h <= 0)
+    return;
+
+  const size_t size = (w + kNoiseOffsets > kMinNoiseSize) ?
+                      w + kNoiseOffsets : kMinNoiseSize;
+
+  if ((q != noise_q_) || (level != noise_level_) || (noise_.size() < size)) {
+    // As fillrd: 256 values distributed as a Gaussian whose sigma grows
+    // with the level and the quantizer, and the table drawn from them.
+    const double sigma = level + .5 + .6 * (63 - q) / 63.0;
+
+    int8_t dist[256];
+    int next = 0;
+
+    for (int i = -32; (i < 32) && (next < 256); ++i) {
+      const double g = exp(-(i * i) / (2 * sigma * sigma)) /
+                       (sigma * sqrt(2 * kPi));
+
+      for (int n = static_cast<int>(.5 + 256 * g); n > 0 && next < 256; --n)
+        dist[next++] = static_cast<int8_t>(i);
+    }
+
+    while (next < 256)
+      dist[next++] = 0;
+
+    noise_.resize(size);
+
+    for (size_t i = 0; i < size; ++i)
+      noise_[i] = dist[Random() & 0xff];
+
+    noise_q_ = q;
+    noise_level_ = level;
+    noise_clamp_ = -dist[0];
+  }
+
+  // Pixels are first clamped so that the noise can't wrap them.
+  const int lo = noise_clamp_;
+  const int hi = 255 - noise_clamp_;
+
+  for (int y = 0; y < h; ++y) {
+    uint8_t* const row = plane + y * stride;
+    const int8_t* const ref = &noise_[Random() & 0xff];
+
+    for (int x = 0; x < w; ++x) {
+      int p = row[x];
+
+      if (p < lo)
+        p = lo;
+      else if (p > hi)
+        p = hi;
+
+      row[x] = static_cast<uint8_t>(p + ref[x]);
+    }
+  }
+}
+
+uint32_t Vp8Postprocessor::Random() {
+  random_ = random_ * 1103515245 + 12345;
+  return random_ >> 16;
+}
+
+}  // namespace webmdshow
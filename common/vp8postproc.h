@@ -0,0 +1,67 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VP8POSTPROC_H_
+#define WEBMDSHOW_COMMON_VP8POSTPROC_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "vpx/vp8.h"
+
+namespace webmdshow {
+
+// The deblocking and noise of VP8 postprocessing, applied to a decoded
+// frame outside libvpx. libvpx postprocesses only within
+// vpx_codec_get_frame, on the thread that decodes, whereas this can run
+// on another thread, on one frame while the next is decoded.
+//
+// The filters are those of vp8/common/postproc.c: VP8_DEBLOCK and
+// VP8_DEMACROBLOCK run a [1 1 4 1 1] filter down and then across each
+// plane, which leaves a pixel alone where any tap differs from it by more
+// than a limit that grows with the frame's loop filter level;
+// VP8_DEMACROBLOCK raises the limit by the deblocking level. VP8_ADDNOISE
+// adds Gaussian noise of the noise level to the luma. Unlike libvpx, the
+// limit is the same across the frame, since the macroblock modes aren't
+// known here, and VP8_DEMACROBLOCK adds no filter of its own across the
+// macroblock edges. Not thread safe.
+class Vp8Postprocessor {
+ public:
+  Vp8Postprocessor();
+
+  // Whether |cfg| turns on any filter that Process applies.
+  static bool IsEnabled(const vp8_postproc_cfg_t& cfg);
+
+  // Filters |frame|, an I420 or YV12 frame that was decoded with a loop
+  // filter level of |filter_level|, in place.
+  void Process(const vp8_postproc_cfg_t& cfg, int filter_level,
+               vpx_image_t* frame);
+
+ private:
+  void Deblock(int limit, uint8_t* plane, int stride, int w, int h);
+  void AddNoise(int q, int level, uint8_t* plane, int stride, int w, int h);
+  uint32_t Random();
+
+  // Two unfiltered rows above the one being filtered, and its vertically
+  // filtered copy, with room for the horizontal taps past its ends.
+  std::vector<uint8_t> rows_;
+
+  std::vector<int8_t> noise_;
+  int noise_q_;
+  int noise_level_;
+  int noise_clamp_;
+  uint32_t random_;
+
+  Vp8Postprocessor(const Vp8Postprocessor&);
+  Vp8Postprocessor& operator=(const Vp8Postprocessor&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VP8POSTPROC_H_
@@ -0,0 +1,222 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "vpxdecoderpool.h"
+
+#include <windows.h>
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+namespace {
+
+std::once_flag g_pool_once;
+VpxDecoderPool* g_pool;
+
+// The largest frames of each size class but the last, which is larger.
+const int kSizeClasses[][2] = {
+  { 640, 480 },
+  { 1280, 720 },
+  { 1920, 1088 },
+  { 4096, 2304 }
+};
+
+}  // namespace
+
+VpxDecoderPool& VpxDecoderPool::Get() {
+  std::call_once(g_pool_once, &VpxDecoderPool::Create);
+  return *g_pool;
+}
+
+void VpxDecoderPool::Create() {
+  // Never deleted: see the class comment.
+  g_pool = new VpxDecoderPool;
+}
+
+VpxDecoderPool::VpxDecoderPool() : pinned_(false) {
+  memset(&stats_, 0, sizeof stats_);
+}
+
+vpx_codec_err_t VpxDecoderPool::Borrow(const Key& key, vpx_codec_ctx_t* ctx) {
+  assert(key.iface);
+  assert(ctx);
+
+  idle_t expired;
+  bool reused = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Expire(GetTickCount(), &expired);
+
+    // The most recently returned first, as the likeliest to be warm.
+    for (idle_t::iterator i = idle_.end(); i != idle_.begin();) {
+      --i;
+
+      if (Matches(i->key, key)) {
+        *ctx = i->ctx;
+        idle_.erase(i);
+        reused = true;
+        break;
+      }
+    }
+
+    if (reused) {
+      ++stats_.borrowed;
+      ++stats_.reused;
+      stats_.idle = static_cast<int>(idle_.size());
+    }
+  }
+
+  for (idle_t::iterator i = expired.begin(); i != expired.end(); ++i)
+    Destroy(&i->ctx);
+
+  if (reused)
+    return VPX_CODEC_OK;
+
+  vpx_codec_dec_cfg_t cfg = {0};
+  cfg.threads = key.threads;
+  cfg.w = key.width;
+  cfg.h = key.height;
+
+  const vpx_codec_err_t err =
+      vpx_codec_dec_init(ctx, key.iface, &cfg, key.flags);
+
+  if (err == VPX_CODEC_OK) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.borrowed;
+  }
+
+  return err;
+}
+
+void VpxDecoderPool::Return(const Key& key, vpx_codec_ctx_t* ctx) {
+  assert(ctx);
+
+  if (ctx->iface == NULL)  // never initialized, or already destroyed
+    return;
+
+  // Flush, and throw away any frames still to be had. The next stream
+  // starts at a keyframe, which needs nothing from the last.
+  bool flushed =
+      (vpx_codec_decode(ctx, NULL, 0, NULL, 0) == VPX_CODEC_OK);
+
+  vpx_codec_iter_t iter = NULL;
+
+  while (flushed && vpx_codec_get_frame(ctx, &iter) != NULL) {
+  }
+
+  idle_t expired;
+  bool kept = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t now = GetTickCount();
+    Expire(now, &expired);
+
+    int count = 0;
+
+    for (idle_t::const_iterator i = idle_.begin(); i != idle_.end(); ++i) {
+      if (Matches(i->key, key))
+        ++count;
+    }
+
+    if (flushed && count < kMaxIdlePerKey) {
+      if (idle_.size() >= kMaxIdle) {  // make room: the oldest goes
+        expired.splice(expired.end(), idle_, idle_.begin());
+        ++stats_.destroyed;
+      }
+
+      if (!pinned_) {
+        // The decoder's threads run code of this module, so the module
+        // must not be unloaded under them.
+        HMODULE module;
+        pinned_ = GetModuleHandleExW(
+            GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                GET_MODULE_HANDLE_EX_FLAG_PIN,
+            reinterpret_cast<LPCWSTR>(&VpxDecoderPool::Get), &module) != 0;
+      }
+
+      const Idle idle = { key, *ctx, now };
+      idle_.push_back(idle);
+
+      ++stats_.returned;
+      kept = true;
+    } else {
+      ++stats_.destroyed;
+    }
+
+    stats_.idle = static_cast<int>(idle_.size());
+  }
+
+  for (idle_t::iterator i = expired.begin(); i != expired.end(); ++i)
+    Destroy(&i->ctx);
+
+  if (kept)
+    memset(ctx, 0, sizeof *ctx);  // as vpx_codec_destroy leaves it
+  else
+    Destroy(ctx);
+}
+
+void VpxDecoderPool::Clear() {
+  idle_t expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.destroyed += idle_.size();
+    stats_.idle = 0;
+    expired.swap(idle_);
+  }
+
+  for (idle_t::iterator i = expired.begin(); i != expired.end(); ++i)
+    Destroy(&i->ctx);
+}
+
+void VpxDecoderPool::GetStats(Stats* stats) const {
+  assert(stats);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  *stats = stats_;
+}
+
+bool VpxDecoderPool::Matches(const Key& idle, const Key& key) {
+  return idle.iface == key.iface &&
+         idle.flags == key.flags &&
+         idle.threads == key.threads &&
+         GetSizeClass(idle.width, idle.height) ==
+             GetSizeClass(key.width, key.height);
+}
+
+int VpxDecoderPool::GetSizeClass(int width, int height) {
+  if (width <= 0 || height <= 0)
+    return 0;
+
+  const int count = sizeof kSizeClasses / sizeof kSizeClasses[0];
+
+  for (int i = 0; i < count; ++i) {
+    if (width <= kSizeClasses[i][0] && height <= kSizeClasses[i][1])
+      return i + 1;
+  }
+
+  return count + 1;
+}
+
+void VpxDecoderPool::Expire(uint32_t now, idle_t* expired) {
+  while (!idle_.empty() && (now - idle_.front().time) > kIdleMs) {
+    expired->splice(expired->end(), idle_, idle_.begin());
+    ++stats_.destroyed;
+  }
+
+  stats_.idle = static_cast<int>(idle_.size());
+}
+
+void VpxDecoderPool::Destroy(vpx_codec_ctx_t* ctx) {
+  const vpx_codec_err_t err = vpx_codec_destroy(ctx);
+  err;
+  assert(err == VPX_CODEC_OK);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,114 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VPXDECODERPOOL_H_
+#define WEBMDSHOW_COMMON_VPXDECODERPOOL_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <mutex>
+
+#include "vpx/vpx_decoder.h"
+
+namespace webmdshow {
+
+// Initialized libvpx decoders, kept once the streams that had them are
+// done with them, for the streams that follow: a thumbnailer or a preview
+// graph decodes a few frames of a file and is torn down, thousands of
+// times a minute, and each vpx_codec_dec_init would otherwise start the
+// decoder's threads and allocate its frame buffers again.
+//
+// A decoder is borrowed for a Key, and matches only a Key of the same
+// codec, flags and thread count, for frames of the same size class. It is
+// flushed when it is returned, but keeps its reference frames, so a
+// stream must start at a keyframe, as it would have to anyway. A decoder
+// given frame buffer functions, or a decryptor, would still call them,
+// and must be destroyed rather than returned. Decoders idle for longer
+// than kIdleMs are destroyed as the pool is next used.
+//
+// There is one pool for each module linked with common.lib, never
+// destroyed, since destroying a decoder joins its threads, which could
+// deadlock while the process exits. Thread safe.
+class VpxDecoderPool {
+ public:
+  enum { kMaxIdle = 8 };         // decoders kept, of all kinds
+  enum { kMaxIdlePerKey = 2 };   // of one kind
+  enum { kIdleMs = 30000 };
+
+  struct Key {
+    vpx_codec_iface_t* iface;
+    vpx_codec_flags_t flags;
+    int threads;  // vpx_codec_dec_cfg_t::threads
+    int width;    // of the stream's frames, or 0 if not known
+    int height;
+  };
+
+  struct Stats {
+    int64_t borrowed;   // Borrow calls that succeeded
+    int64_t reused;     // of those, that got an idle decoder
+    int64_t returned;   // Return calls that kept the decoder
+    int64_t destroyed;  // by Return, Clear or the idle timeout
+    int idle;           // decoders kept now
+  };
+
+  // Returns the pool of this module.
+  static VpxDecoderPool& Get();
+
+  // Sets |ctx| to a decoder of the kind |key| describes: an idle one of
+  // the pool's if there is one, or else one from vpx_codec_dec_init.
+  // Returns the result of vpx_codec_dec_init, or VPX_CODEC_OK.
+  vpx_codec_err_t Borrow(const Key& key, vpx_codec_ctx_t* ctx);
+
+  // Takes back the decoder in |ctx|, which was borrowed for |key|, and
+  // flushes it. It is destroyed instead if the pool has as many of its
+  // kind as it keeps, or if it fails to flush. |ctx| is left as
+  // vpx_codec_destroy leaves it either way.
+  void Return(const Key& key, vpx_codec_ctx_t* ctx);
+
+  // Destroys the idle decoders.
+  void Clear();
+
+  void GetStats(Stats* stats) const;
+
+ private:
+  struct Idle {
+    Key key;
+    vpx_codec_ctx_t ctx;  // moved from the borrower's, by value
+    uint32_t time;        // returned at, in GetTickCount units
+  };
+
+  typedef std::list<Idle> idle_t;
+
+  VpxDecoderPool();
+  static void Create();
+
+  // Whether a decoder made for |idle| will do for |key|.
+  static bool Matches(const Key& idle, const Key& key);
+
+  // Returns the size class of frames of |width| x |height|, 0 if unknown.
+  static int GetSizeClass(int width, int height);
+
+  // Moves the decoders idle for longer than kIdleMs from |idle_| to
+  // |expired|, to be destroyed once the lock is released.
+  void Expire(uint32_t now, idle_t* expired);
+
+  static void Destroy(vpx_codec_ctx_t* ctx);
+
+  mutable std::mutex mutex_;  // for the below
+  idle_t idle_;               // least recently returned first
+  Stats stats_;
+  bool pinned_;               // the module, once a decoder is kept
+
+  VpxDecoderPool(const VpxDecoderPool&);
+  VpxDecoderPool& operator=(const VpxDecoderPool&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VPXDECODERPOOL_H_
@@ -0,0 +1,197 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "vpxframecache.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace webmdshow {
+
+size_t GetVpxImageI420Size(const vpx_image_t* image) {
+  assert(image);
+
+  const size_t stride = (image->d_w + 1) & ~1;
+  const size_t uv_h = (image->d_h + 1) / 2;
+
+  return stride * image->d_h + stride * uv_h;  // two planes of stride / 2
+}
+
+void CopyVpxImageI420(const vpx_image_t* f, std::vector<uint8_t>* buf,
+                      vpx_image_t* copy) {
+  assert(f);
+  assert(buf);
+  assert(copy);
+
+  const unsigned int w = f->d_w;
+  const unsigned int h = f->d_h;
+
+  const unsigned int stride = (w + 1) & ~1;
+  const unsigned int uv_stride = stride / 2;
+  const unsigned int uv_w = (w + 1) / 2;
+  const unsigned int uv_h = (h + 1) / 2;
+
+  buf->resize(GetVpxImageI420Size(f));
+
+  vpx_image_t& img = *copy;
+  img = *f;
+
+  img.fmt = VPX_IMG_FMT_I420;
+
+  img.planes[VPX_PLANE_Y] = &(*buf)[0];
+  img.planes[VPX_PLANE_U] = img.planes[VPX_PLANE_Y] + stride * h;
+  img.planes[VPX_PLANE_V] = img.planes[VPX_PLANE_U] + uv_stride * uv_h;
+  img.planes[VPX_PLANE_ALPHA] = 0;
+
+  img.stride[VPX_PLANE_Y] = stride;
+  img.stride[VPX_PLANE_U] = uv_stride;
+  img.stride[VPX_PLANE_V] = uv_stride;
+  img.stride[VPX_PLANE_ALPHA] = 0;
+
+  img.img_data = 0;
+  img.img_data_owner = 0;
+  img.self_allocd = 0;
+
+  // YV12 has its chroma planes the other way round.
+  const bool yv12 = (f->fmt == VPX_IMG_FMT_YV12);
+  const int u = yv12 ? VPX_PLANE_V : VPX_PLANE_U;
+  const int v = yv12 ? VPX_PLANE_U : VPX_PLANE_V;
+
+  for (unsigned int y = 0; y < h; ++y) {
+    memcpy(img.planes[VPX_PLANE_Y] + y * stride,
+           f->planes[VPX_PLANE_Y] + y * f->stride[VPX_PLANE_Y], w);
+  }
+
+  for (unsigned int y = 0; y < uv_h; ++y) {
+    memcpy(img.planes[VPX_PLANE_U] + y * uv_stride,
+           f->planes[u] + y * f->stride[u], uv_w);
+    memcpy(img.planes[VPX_PLANE_V] + y * uv_stride,
+           f->planes[v] + y * f->stride[v], uv_w);
+  }
+}
+
+VpxFrameCache::VpxFrameCache()
+    : limit_(0), bytes_(0), hits_(0), misses_(0) {
+  account_.Open(MemoryBudget::GetProcess(), true);
+}
+
+VpxFrameCache::~VpxFrameCache() {
+}
+
+void VpxFrameCache::SetLimit(size_t bytes) {
+  limit_ = bytes;
+  Evict(limit_);
+}
+
+size_t VpxFrameCache::GetLimit() const {
+  return limit_;
+}
+
+void VpxFrameCache::SetBudget(MemoryBudget* budget) {
+  assert(budget);
+
+  account_.Open(budget, true);
+  account_.Charge(bytes_);
+}
+
+bool VpxFrameCache::Lookup(int64_t time) {
+  if (frames_.count(time)) {
+    ++hits_;
+    return true;
+  }
+
+  ++misses_;
+  return false;
+}
+
+const vpx_image_t* VpxFrameCache::Get(int64_t time) {
+  const frames_t::iterator i = frames_.find(time);
+
+  if (i == frames_.end())
+    return NULL;
+
+  Frame& frame = i->second;
+  lru_.splice(lru_.end(), lru_, frame.lru);  // now most recently used
+
+  return &frame.image;
+}
+
+void VpxFrameCache::Insert(int64_t time, const vpx_image_t* image) {
+  assert(image);
+
+  ServicePurge();
+
+  const size_t size = GetVpxImageI420Size(image);
+
+  if (size > limit_)
+    return;
+
+  const frames_t::iterator old = frames_.find(time);
+
+  if (old != frames_.end())
+    Erase(old);
+
+  Evict(limit_ - size);
+
+  if (!account_.TryCharge(size))  // out of budget: do without
+    return;
+
+  // The map doesn't move its elements, so the planes stay valid.
+  Frame& frame = frames_[time];
+
+  CopyVpxImageI420(image, &frame.buf, &frame.image);
+  frame.lru = lru_.insert(lru_.end(), time);
+
+  bytes_ += size;
+}
+
+void VpxFrameCache::Clear() {
+  Evict(0);
+}
+
+void VpxFrameCache::GetStats(Stats* stats) const {
+  assert(stats);
+
+  stats->hits = hits_;
+  stats->misses = misses_;
+  stats->bytes = bytes_;
+  stats->frames = static_cast<int64_t>(frames_.size());
+}
+
+void VpxFrameCache::ResetStats() {
+  hits_ = 0;
+  misses_ = 0;
+}
+
+void VpxFrameCache::Erase(frames_t::iterator i) {
+  const size_t size = i->second.buf.size();
+  assert(bytes_ >= size);
+
+  bytes_ -= size;
+  account_.Release(size);
+
+  lru_.erase(i->second.lru);
+  frames_.erase(i);
+}
+
+void VpxFrameCache::Evict(size_t limit) {
+  while ((bytes_ > limit) && !lru_.empty())
+    Erase(frames_.find(lru_.front()));
+}
+
+void VpxFrameCache::ServicePurge() {
+  const int64_t request = account_.TakePurgeRequest();
+
+  if (request <= 0)
+    return;
+
+  const size_t bytes = static_cast<size_t>(request);
+  Evict((bytes < bytes_) ? bytes_ - bytes : 0);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,107 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VPXFRAMECACHE_H_
+#define WEBMDSHOW_COMMON_VPXFRAMECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "memorybudget.h"
+#include "vpx/vpx_image.h"
+
+namespace webmdshow {
+
+// Returns the bytes CopyVpxImageI420 needs for the visible area of
+// |image|.
+size_t GetVpxImageI420Size(const vpx_image_t* image);
+
+// Copies the visible area of |image|, which must be I420 or YV12, to
+// |buf|, and sets |copy| to describe it, in I420, with planes in |buf|.
+// The copy is valid while |buf| is neither changed nor destroyed.
+void CopyVpxImageI420(const vpx_image_t* image, std::vector<uint8_t>* buf,
+                      vpx_image_t* copy);
+
+// Decoded frames of one stream, keyed by time, so that a decoder can
+// present a frame it has decoded before, as an editor scrubs back and
+// forth over the same few seconds, without decoding again. The least
+// recently used frames are evicted to keep within the limit. The cache
+// is charged to a MemoryBudget, the process budget unless set
+// otherwise, and purges when the budget asks. Not thread safe.
+class VpxFrameCache {
+ public:
+  struct Stats {
+    int64_t hits;    // Lookup calls that found the frame
+    int64_t misses;  // Lookup calls that didn't
+    int64_t bytes;   // in the frames cached now
+    int64_t frames;
+  };
+
+  VpxFrameCache();
+  ~VpxFrameCache();
+
+  // Evicts frames as needed to fit the new limit. 0 (the default) turns
+  // the cache off, and empties it.
+  void SetLimit(size_t bytes);
+  size_t GetLimit() const;
+
+  void SetBudget(MemoryBudget* budget);
+
+  // Returns whether the frame at |time| is cached, and counts a hit or a
+  // miss.
+  bool Lookup(int64_t time);
+
+  // Returns the frame at |time|, now the most recently used, or NULL.
+  // The frame is valid until the cache is next changed.
+  const vpx_image_t* Get(int64_t time);
+
+  // Caches a copy of |image| at |time|, replacing any frame there.
+  void Insert(int64_t time, const vpx_image_t* image);
+
+  void Clear();
+
+  void GetStats(Stats* stats) const;
+  void ResetStats();
+
+ private:
+  typedef std::list<int64_t> lru_t;
+
+  struct Frame {
+    std::vector<uint8_t> buf;
+    vpx_image_t image;  // points into buf
+    lru_t::iterator lru;
+  };
+
+  typedef std::map<int64_t, Frame> frames_t;
+
+  void Erase(frames_t::iterator i);
+
+  // Evicts the least recently used frames until |limit| is met.
+  void Evict(size_t limit);
+
+  void ServicePurge();
+
+  size_t limit_;
+  size_t bytes_;
+  frames_t frames_;
+  lru_t lru_;  // least recently used first
+  int64_t hits_;
+  int64_t misses_;
+  MemoryBudget::Account account_;
+
+  VpxFrameCache(const VpxFrameCache&);
+  VpxFrameCache& operator=(const VpxFrameCache&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VPXFRAMECACHE_H_
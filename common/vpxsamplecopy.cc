@@ -0,0 +1,381 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "vpxsamplecopy.h"
+
+#include <dvdmedia.h>
+#include <uuids.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "highbitdepth.h"
+#include "libyuv_util.h"
+#include "videomediatype.h"
+#include "webmtypes.h"
+#include "yuvtorgb.h"
+
+namespace webmdshow {
+
+void CopyVpxImageToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
+                          const GUID& subtype_out,
+                          const BITMAPINFOHEADER& bmih_out) {
+  // Y
+
+  const BYTE* pInY = f->planes[VPX_PLANE_Y];
+  assert(pInY);
+
+  unsigned int width_in = f->d_w;
+  unsigned int height_in = f->d_h;
+
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  BYTE* pOut = pOutBuf;
+
+  const int strideInY = f->stride[VPX_PLANE_Y];
+
+  LONG strideOut = bmih_out.biWidth;
+  assert(strideOut);
+  assert((strideOut % 2) == 0);
+
+  if (IsHighBitDepthI420(f)) {
+    BYTE* const pOutC = pOutBuf + strideOut * height_in;
+    const long sizeC = (strideOut / 2) * ((height_in + 1) / 2);
+    bool ok;
+
+    if (subtype_out == MEDIASUBTYPE_NV12) {
+      ok = DitherVpxImageToNV12(f, pOutBuf, strideOut, pOutC, strideOut);
+    } else if (subtype_out == MEDIASUBTYPE_YV12) {
+      ok = DitherVpxImageToI420(f, pOutBuf, strideOut,
+                                pOutC + sizeC, strideOut / 2,
+                                pOutC, strideOut / 2);
+    } else {
+      assert(subtype_out == WebmTypes::MEDIASUBTYPE_I420);
+      ok = DitherVpxImageToI420(f, pOutBuf, strideOut,
+                                pOutC, strideOut / 2,
+                                pOutC + sizeC, strideOut / 2);
+    }
+
+    ok;
+    assert(ok);
+
+    const long lenOut = strideOut * height_in + 2 * sizeC;
+
+    hr = pOutSample->SetActualDataLength(lenOut);
+    assert(SUCCEEDED(hr));
+
+    return;
+  }
+
+  if (subtype_out == MEDIASUBTYPE_NV12) {
+    // Note that while NV12 is considered a planar format,
+    // the chroma plane packs the UV samples.
+    BYTE* const pOutUV = pOutBuf + strideOut * height_in;
+
+    const bool ok = LibyuvI420ToNV12(f, pOutBuf, strideOut,
+                                                pOutUV, strideOut);
+    ok;
+    assert(ok);
+
+    const long lenOut = strideOut * (height_in + (height_in + 1) / 2);
+
+    hr = pOutSample->SetActualDataLength(lenOut);
+    assert(SUCCEEDED(hr));
+
+    return;
+  }
+
+  for (unsigned int y = 0; y < height_in; ++y) {
+    memcpy(pOut, pInY, width_in);
+    pInY += strideInY;
+    pOut += strideOut;
+  }
+
+  width_in = (width_in + 1) / 2;
+  height_in = (height_in + 1) / 2;
+
+  const BYTE* pInV = f->planes[VPX_PLANE_V];
+  assert(pInV);
+
+  const int strideInV = f->stride[VPX_PLANE_V];
+
+  const BYTE* pInU = f->planes[VPX_PLANE_U];
+  assert(pInU);
+
+  const int strideInU = f->stride[VPX_PLANE_U];
+
+  if (subtype_out == MEDIASUBTYPE_YV12) {
+    strideOut /= 2;
+
+    // V
+
+    for (unsigned int y = 0; y < height_in; ++y) {
+      memcpy(pOut, pInV, width_in);
+      pInV += strideInV;
+      pOut += strideOut;
+    }
+
+    // U
+
+    for (unsigned int y = 0; y < height_in; ++y) {
+      memcpy(pOut, pInU, width_in);
+      pInU += strideInU;
+      pOut += strideOut;
+    }
+  } else {
+    assert(subtype_out == WebmTypes::MEDIASUBTYPE_I420);
+    strideOut /= 2;
+
+    // U
+
+    for (unsigned int y = 0; y < height_in; ++y) {
+      memcpy(pOut, pInU, width_in);
+      pInU += strideInU;
+      pOut += strideOut;
+    }
+
+    // V
+
+    for (unsigned int y = 0; y < height_in; ++y) {
+      memcpy(pOut, pInV, width_in);
+      pInV += strideInV;
+      pOut += strideOut;
+    }
+  }
+
+  const ptrdiff_t lenOut_ = pOut - pOutBuf;
+  const long lenOut = static_cast<long>(lenOut_);
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+}
+
+void CopyVpxImageToP010(const vpx_image_t* f, IMediaSample* pOutSample,
+                        const BITMAPINFOHEADER& bmih_out) {
+  const unsigned int height_in = f->d_h;
+
+  assert(bmih_out.biWidth >= LONG(f->d_w));
+  assert(labs(bmih_out.biHeight) == LONG(height_in));
+
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  const LONG strideOut = 2 * bmih_out.biWidth;
+  BYTE* const pOutUV = pOutBuf + strideOut * height_in;
+
+  const bool ok = VpxImageToP010(f, pOutBuf, strideOut, pOutUV, strideOut);
+  ok;
+  assert(ok);
+
+  const long lenOut = strideOut * (height_in + (height_in + 1) / 2);
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+}
+
+void CopyVpxImageToPacked(const vpx_image_t* f, IMediaSample* pOutSample,
+                          const GUID& subtype_out, const RECT& rc_out,
+                          const BITMAPINFOHEADER& bmih_out) {
+  const LONG rect_width_out = rc_out.right - rc_out.left;
+  assert(rect_width_out >= 0);
+
+  const LONG width_out =
+      (rect_width_out > 0) ? rect_width_out : bmih_out.biWidth;
+  assert(width_out > 0);
+
+  const LONG rect_height_out = rc_out.bottom - rc_out.top;
+  assert(rect_height_out >= 0);
+
+  const LONG height_out =
+      (rect_height_out > 0) ? rect_height_out : labs(bmih_out.biHeight);
+
+  const unsigned int width_in = f->d_w;
+  assert(LONG(width_in) == width_out);
+
+  const unsigned int height_in = f->d_h;
+  assert(LONG(height_in) == height_out);
+
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  const LONG strideOut_ = 2 * width_in;
+  LONG strideOut;
+
+  if (bmih_out.biWidth < strideOut_)
+    strideOut = strideOut_;
+  else
+    strideOut = bmih_out.biWidth;
+
+  PackedYuvFormat format;
+
+  if (subtype_out == MEDIASUBTYPE_UYVY) {
+    format = kPackedYuvUYVY;
+  } else if ((subtype_out == MEDIASUBTYPE_YUY2) ||
+             (subtype_out == MEDIASUBTYPE_YUYV)) {
+    format = kPackedYuvYUY2;
+  } else {
+    assert(subtype_out == MEDIASUBTYPE_YVYU);
+    format = kPackedYuvYVYU;
+  }
+
+  const bool ok =
+      LibyuvI420ToPacked(f, format, pOutBuf, strideOut);
+  ok;
+  assert(ok);
+
+  const long lenOut = strideOut * height_in;
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+}
+
+void CopyVpxImageToRgb(const vpx_image_t* f, IMediaSample* pOutSample,
+                       const GUID& subtype_out,
+                       const BITMAPINFOHEADER& bmih_out) {
+  const unsigned int width_in = f->d_w;
+  const unsigned int height_in = f->d_h;
+
+  assert(bmih_out.biWidth >= LONG(width_in));
+  assert(labs(bmih_out.biHeight) == LONG(height_in));
+
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  const bool rgb32 = (subtype_out == MEDIASUBTYPE_RGB32);
+  const LONG bytes_per_pixel = rgb32 ? 4 : 3;
+  const LONG strideOut = (bytes_per_pixel * bmih_out.biWidth + 3) & ~3;
+
+  // A DIB is stored bottom-up unless biHeight is negative.
+  BYTE* pOut = pOutBuf;
+  LONG strideRow = strideOut;
+
+  if (bmih_out.biHeight > 0) {
+    pOut += strideOut * (height_in - 1);
+    strideRow = -strideOut;
+  }
+
+  // VP8, and VP9 profile 0 as the decoders take it, is BT.601, limited
+  // range.
+  const YuvToRgbConstants& k = GetYuvToRgbConstants(
+      kYuvMatrixBT601, kYuvRangeLimited);
+
+  const uint8_t* const y = f->planes[VPX_PLANE_Y];
+  const uint8_t* const u = f->planes[VPX_PLANE_U];
+  const uint8_t* const v = f->planes[VPX_PLANE_V];
+
+  if (rgb32) {
+    I420ToRgb32(y, f->stride[VPX_PLANE_Y],
+                           u, f->stride[VPX_PLANE_U],
+                           v, f->stride[VPX_PLANE_V],
+                           k, pOut, strideRow, width_in, height_in);
+  } else {
+    I420ToRgb24(y, f->stride[VPX_PLANE_Y],
+                           u, f->stride[VPX_PLANE_U],
+                           v, f->stride[VPX_PLANE_V],
+                           k, pOut, strideRow, width_in, height_in);
+  }
+
+  const long lenOut = strideOut * height_in;
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+}
+
+void CopyVpxImageToLuma(const vpx_image_t* f, IMediaSample* pOutSample,
+                        const RECT& rc_out,
+                        const BITMAPINFOHEADER& bmih_out) {
+  const LONG strideOut = bmih_out.biWidth;
+  assert(strideOut > 0);
+
+  const LONG rect_width_out = rc_out.right - rc_out.left;
+  assert(rect_width_out >= 0);
+
+  const LONG width_out = (rect_width_out > 0) ? rect_width_out : strideOut;
+  const LONG height_out = labs(bmih_out.biHeight);
+
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  if ((LONG(f->d_w) != width_out) || (LONG(f->d_h) != height_out)) {
+    const bool ok = LibyuvScaleLuma(
+        f, pOutBuf, strideOut, width_out, height_out,
+        GetPlaybackScaleFilter(f->d_w, f->d_h, width_out, height_out));
+    ok;
+    assert(ok);
+  } else {
+    const BYTE* pInY = f->planes[VPX_PLANE_Y];
+    assert(pInY);
+
+    const int strideInY = f->stride[VPX_PLANE_Y];
+    BYTE* pOut = pOutBuf;
+
+    for (LONG y = 0; y < height_out; ++y) {
+      memcpy(pOut, pInY, width_out);
+      pInY += strideInY;
+      pOut += strideOut;
+    }
+  }
+
+  const long lenOut = strideOut * height_out;
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+}
+
+HRESULT CopyVpxImageToSample(const vpx_image_t* f, const AM_MEDIA_TYPE& mt,
+                             IMediaSample* pOutSample) {
+  const BITMAPINFOHEADER* bmih_ptr;
+  const RECT* rc_ptr;
+
+  if (!GetVideoBitmap(mt, &bmih_ptr, &rc_ptr))
+    return E_FAIL;
+
+  if ((mt.subtype == MEDIASUBTYPE_NV12) ||
+      (mt.subtype == MEDIASUBTYPE_YV12) ||
+      (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)) {
+    CopyVpxImageToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  } else if ((mt.subtype == WebmTypes::MEDIASUBTYPE_P010) ||
+             (mt.subtype == WebmTypes::MEDIASUBTYPE_P016)) {
+    CopyVpxImageToP010(f, pOutSample, *bmih_ptr);
+  } else if (IsHighBitDepthI420(f)) {
+    return E_FAIL;  // the caller dithers it for these
+  } else if ((mt.subtype == MEDIASUBTYPE_UYVY) ||
+             (mt.subtype == MEDIASUBTYPE_YUY2) ||
+             (mt.subtype == MEDIASUBTYPE_YUYV) ||
+             (mt.subtype == MEDIASUBTYPE_YVYU)) {
+    CopyVpxImageToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  } else if ((mt.subtype == MEDIASUBTYPE_RGB32) ||
+             (mt.subtype == MEDIASUBTYPE_RGB24)) {
+    CopyVpxImageToRgb(f, pOutSample, mt.subtype, *bmih_ptr);
+  } else if (mt.subtype == WebmTypes::MEDIASUBTYPE_Y800) {
+    CopyVpxImageToLuma(f, pOutSample, *rc_ptr, *bmih_ptr);
+  } else {
+    return E_FAIL;
+  }
+
+  return S_OK;
+}
+
+}  // namespace webmdshow
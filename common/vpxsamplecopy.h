@@ -0,0 +1,63 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_VPXSAMPLECOPY_H_
+#define WEBMDSHOW_COMMON_VPXSAMPLECOPY_H_
+
+#include <strmif.h>
+#include <amvideo.h>
+
+#include "vpx/vpx_image.h"
+
+// The conversion of decoded frames into output samples, which the
+// vp8decoder, vp9decoder and vpxdecoder filters share, so that the kernels
+// are written (and made faster) once. Each writes the visible area of
+// |image|, which must be I420 or YV12 and of the frame size of the output
+// type, and sets the sample's actual data length. The planar and P010
+// copies also take the 16-bit frames of high bit depth VP9 (see
+// highbitdepth.h); the others need them dithered to 8 bits first.
+
+namespace webmdshow {
+
+// NV12, YV12 or I420, with a luma stride of bmih_out.biWidth. A high bit
+// depth frame is dithered.
+void CopyVpxImageToPlanar(const vpx_image_t* image, IMediaSample* sample,
+                          const GUID& subtype_out,
+                          const BITMAPINFOHEADER& bmih_out);
+
+// P010 or P016, with a luma stride of 2 * bmih_out.biWidth bytes.
+void CopyVpxImageToP010(const vpx_image_t* image, IMediaSample* sample,
+                        const BITMAPINFOHEADER& bmih_out);
+
+// UYVY, YUY2 (or YUYV) or YVYU.
+void CopyVpxImageToPacked(const vpx_image_t* image, IMediaSample* sample,
+                          const GUID& subtype_out, const RECT& rc_out,
+                          const BITMAPINFOHEADER& bmih_out);
+
+// RGB32 or RGB24, with no lookup tables.
+void CopyVpxImageToRgb(const vpx_image_t* image, IMediaSample* sample,
+                       const GUID& subtype_out,
+                       const BITMAPINFOHEADER& bmih_out);
+
+// Y800: the Y plane alone, with a stride of bmih_out.biWidth, for
+// consumers (motion detection, OCR) that have no use for chroma. Unlike
+// the others, |image| may be of another size than the output type, when
+// only its luma is scaled.
+void CopyVpxImageToLuma(const vpx_image_t* image, IMediaSample* sample,
+                        const RECT& rc_out,
+                        const BITMAPINFOHEADER& bmih_out);
+
+// Writes |image| to |sample| as |mt|, a FORMAT_VideoInfo or
+// FORMAT_VideoInfo2 type of one of the subtypes above. Returns E_FAIL for
+// any other type.
+HRESULT CopyVpxImageToSample(const vpx_image_t* image,
+                             const AM_MEDIA_TYPE& mt, IMediaSample* sample);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_VPXSAMPLECOPY_H_
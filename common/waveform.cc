@@ -0,0 +1,354 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include "waveform.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "webmindex.h"
+
+namespace {
+
+const char kMagic[4] = {'W', 'W', 'A', 'V'};
+
+// The cache starts with this header, followed by the peaks. Both are
+// stored in native (little-endian) byte order.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  int64_t file_size;
+  int64_t file_time;
+  int64_t track_number;
+  int64_t duration_ns;
+  int32_t channels;
+  int32_t rate;
+  int32_t columns;
+  int32_t reserved;
+};
+
+}  // namespace
+
+namespace webmdshow {
+
+WaveformBins::WaveformBins(int channels, int64_t total_frames, int columns)
+    : channels_(channels),
+      total_frames_(total_frames),
+      columns_(columns),
+      first_column_(0) {
+  assert(channels_ > 0);
+}
+
+void WaveformBins::Add(int64_t first, const float* samples, int count) {
+  if (total_frames_ <= 0 || columns_ <= 0 || count <= 0)
+    return;
+
+  int64_t frame = (std::max)(first, int64_t(0));
+  const int64_t end = (std::min)(first + count, total_frames_);
+
+  while (frame < end) {
+    const int column = static_cast<int>(frame * columns_ / total_frames_);
+
+    // The first frame of the next column.
+    const int64_t next =
+        ((column + 1) * total_frames_ + columns_ - 1) / columns_;
+    const int64_t stop = (std::min)(next, end);
+
+    Bin* const bins = GetBins(column);
+    const float* const src = samples + (frame - first) * channels_;
+    const int n = static_cast<int>(stop - frame);
+
+    for (int c = 0; c < channels_; ++c) {
+      Bin& b = bins[c];
+
+      float lo = (b.count > 0) ? b.min : src[c];
+      float hi = (b.count > 0) ? b.max : src[c];
+      double sum = 0.0;
+
+      for (int i = 0; i < n; ++i) {
+        const float s = src[i * channels_ + c];
+
+        lo = (std::min)(lo, s);
+        hi = (std::max)(hi, s);
+        sum += double(s) * s;
+      }
+
+      b.min = lo;
+      b.max = hi;
+      b.sum_squares += sum;
+      b.count += n;
+    }
+
+    frame = stop;
+  }
+}
+
+void WaveformBins::Merge(const WaveformBins& other) {
+  assert(other.channels_ == channels_);
+  assert(other.columns_ == columns_);
+
+  const int held = static_cast<int>(other.bins_.size()) / channels_;
+
+  for (int i = 0; i < held; ++i) {
+    const Bin* const src = &other.bins_[i * channels_];
+
+    if (src[0].count == 0)
+      continue;
+
+    Bin* const dst = GetBins(other.first_column_ + i);
+
+    for (int c = 0; c < channels_; ++c) {
+      if (dst[c].count == 0) {
+        dst[c] = src[c];
+        continue;
+      }
+
+      dst[c].min = (std::min)(dst[c].min, src[c].min);
+      dst[c].max = (std::max)(dst[c].max, src[c].max);
+      dst[c].sum_squares += src[c].sum_squares;
+      dst[c].count += src[c].count;
+    }
+  }
+}
+
+void WaveformBins::GetPeaks(std::vector<WaveformPeak>* peaks) const {
+  assert(peaks);
+
+  const WaveformPeak zero = {0.0f, 0.0f, 0.0f};
+  peaks->assign(size_t(columns_) * channels_, zero);
+
+  const int held = static_cast<int>(bins_.size()) / channels_;
+
+  for (int i = 0; i < held; ++i) {
+    const int column = first_column_ + i;
+
+    if (column < 0 || column >= columns_)
+      continue;
+
+    for (int c = 0; c < channels_; ++c) {
+      const Bin& b = bins_[i * channels_ + c];
+
+      if (b.count == 0)
+        continue;
+
+      WaveformPeak& p = (*peaks)[size_t(column) * channels_ + c];
+      p.min = b.min;
+      p.max = b.max;
+      p.rms = static_cast<float>(sqrt(b.sum_squares / b.count));
+    }
+  }
+}
+
+WaveformBins::Bin* WaveformBins::GetBins(int column) {
+  const Bin empty = {0.0f, 0.0f, 0.0, 0};
+
+  if (bins_.empty()) {
+    first_column_ = column;
+    bins_.assign(channels_, empty);
+  } else if (column < first_column_) {
+    const size_t n = size_t(first_column_ - column) * channels_;
+    bins_.insert(bins_.begin(), n, empty);
+    first_column_ = column;
+  } else {
+    const size_t n = size_t(column - first_column_ + 1) * channels_;
+
+    if (bins_.size() < n)
+      bins_.resize(n, empty);
+  }
+
+  return &bins_[size_t(column - first_column_) * channels_];
+}
+
+WaveformSummary::WaveformSummary()
+    : track_number(0),
+      channels(0),
+      rate(0),
+      duration_ns(0),
+      columns(0) {
+}
+
+void WaveformCache::Build(int64_t file_size, int64_t file_time,
+                          const WaveformSummary& summary,
+                          std::vector<uint8_t>* image) {
+  assert(image);
+
+  Header h;
+  memcpy(h.magic, kMagic, sizeof kMagic);
+  h.version = kVersion;
+  h.file_size = file_size;
+  h.file_time = file_time;
+  h.track_number = summary.track_number;
+  h.duration_ns = summary.duration_ns;
+  h.channels = summary.channels;
+  h.rate = summary.rate;
+  h.columns = summary.columns;
+  h.reserved = 0;
+
+  const size_t cb = summary.peaks.size() * sizeof(WaveformPeak);
+
+  image->resize(sizeof h + cb);
+  memcpy(&(*image)[0], &h, sizeof h);
+
+  if (cb > 0)
+    memcpy(&(*image)[sizeof h], &summary.peaks[0], cb);
+}
+
+bool WaveformCache::Parse(const void* data, size_t size, int64_t file_size,
+                          int64_t file_time, WaveformSummary* summary) {
+  assert(summary);
+
+  if (data == NULL || size < sizeof(Header))
+    return false;
+
+  Header h;
+  memcpy(&h, data, sizeof h);
+
+  if (memcmp(h.magic, kMagic, sizeof kMagic) != 0 ||
+      h.version != kVersion ||
+      h.file_size != file_size ||
+      h.file_time != file_time ||
+      h.channels <= 0 ||
+      h.columns <= 0) {
+    return false;
+  }
+
+  const size_t count = size_t(h.columns) * h.channels;
+
+  if (size - sizeof(Header) != count * sizeof(WaveformPeak))
+    return false;
+
+  const uint8_t* const p = static_cast<const uint8_t*>(data);
+
+  summary->track_number = h.track_number;
+  summary->channels = h.channels;
+  summary->rate = h.rate;
+  summary->duration_ns = h.duration_ns;
+  summary->columns = h.columns;
+  summary->peaks.resize(count);
+
+  memcpy(&summary->peaks[0], p + sizeof(Header),
+         count * sizeof(WaveformPeak));
+
+  return true;
+}
+
+HRESULT WaveformCache::Read(const wchar_t* media_file,
+                            WaveformSummary* summary) {
+  if (summary == NULL)
+    return E_POINTER;
+
+  int64_t file_size, file_time;
+  HRESULT hr = WebmIndex::GetFileStamp(media_file, &file_size, &file_time);
+
+  if (FAILED(hr))
+    return hr;
+
+  const std::wstring name = GetFileName(media_file);
+
+  const HANDLE file = CreateFileW(name.c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    const DWORD e = GetLastError();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  LARGE_INTEGER size;
+  std::vector<uint8_t> image;
+
+  if (!GetFileSizeEx(file, &size) ||
+      size.QuadPart < LONGLONG(sizeof(Header)) || size.HighPart != 0) {
+    hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  } else {
+    image.resize(size.LowPart);
+
+    DWORD cb_read;
+
+    if (!ReadFile(file, &image[0], size.LowPart, &cb_read, NULL))
+      hr = HRESULT_FROM_WIN32(GetLastError());
+    else if (cb_read != size.LowPart)
+      hr = E_FAIL;
+  }
+
+  CloseHandle(file);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (!Parse(&image[0], image.size(), file_size, file_time, summary))
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+  return S_OK;
+}
+
+HRESULT WaveformCache::Write(const wchar_t* media_file,
+                             const WaveformSummary& summary) {
+  int64_t file_size, file_time;
+  HRESULT hr = WebmIndex::GetFileStamp(media_file, &file_size, &file_time);
+
+  if (FAILED(hr))
+    return hr;
+
+  std::vector<uint8_t> image;
+  Build(file_size, file_time, summary, &image);
+
+  if (image.size() > MAXDWORD)
+    return E_INVALIDARG;
+
+  // Write a temporary file and move it into place, so that a reader never
+  // sees a partial summary.
+  const std::wstring name = GetFileName(media_file);
+  const std::wstring temp_name = name + L".tmp";
+
+  const HANDLE file = CreateFileW(temp_name.c_str(), GENERIC_WRITE, 0, NULL,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    const DWORD e = GetLastError();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  const DWORD cb = static_cast<DWORD>(image.size());
+  DWORD cb_written;
+
+  const BOOL written = WriteFile(file, &image[0], cb, &cb_written, NULL);
+  hr = written ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+
+  CloseHandle(file);
+
+  if (SUCCEEDED(hr) && cb_written != cb)
+    hr = E_FAIL;
+
+  if (FAILED(hr)) {
+    DeleteFileW(temp_name.c_str());
+    return hr;
+  }
+
+  if (!MoveFileExW(temp_name.c_str(), name.c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    const DWORD e = GetLastError();
+    DeleteFileW(temp_name.c_str());
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  return S_OK;
+}
+
+std::wstring WaveformCache::GetFileName(const wchar_t* media_file) {
+  std::wstring name(media_file ? media_file : L"");
+  name += L".webmwave";
+
+  return name;
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,110 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_WAVEFORM_H_
+#define WEBMDSHOW_COMMON_WAVEFORM_H_
+
+#include <windows.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace webmdshow {
+
+// The samples of one channel over one column of a waveform view.
+struct WaveformPeak {
+  float min;
+  float max;
+  float rms;
+};
+
+// Accumulates the peaks of interleaved float samples into |columns|
+// columns of equal length over the |total_frames| sample frames of a
+// track. Bins fed from different ranges of the track (on different
+// threads, say) merge into the bins of the whole; each holds only the
+// columns its samples fell in.
+class WaveformBins {
+ public:
+  WaveformBins(int channels, int64_t total_frames, int columns);
+
+  // Adds |count| sample frames, the first of which is frame |first| of the
+  // track. Frames outside the track are dropped.
+  void Add(int64_t first, const float* samples, int count);
+
+  void Merge(const WaveformBins& other);
+
+  // Gets the peak of each channel in each column: columns * channels of
+  // them, by column. A column with no samples is all zero.
+  void GetPeaks(std::vector<WaveformPeak>* peaks) const;
+
+ private:
+  struct Bin {
+    float min;
+    float max;
+    double sum_squares;
+    int64_t count;
+  };
+
+  // Returns the bins of |column|, growing the range held to include it.
+  Bin* GetBins(int column);
+
+  int channels_;
+  int64_t total_frames_;
+  int columns_;
+
+  int first_column_;        // of bins_
+  std::vector<Bin> bins_;   // channels_ per column, from first_column_
+};
+
+// The waveform of an audio track, as the editor draws it.
+struct WaveformSummary {
+  WaveformSummary();
+
+  int64_t track_number;
+  int channels;
+  int rate;
+  int64_t duration_ns;
+  int columns;
+  std::vector<WaveformPeak> peaks;  // columns * channels, by column
+};
+
+// The summary, cached next to the media file as "<media file>.webmwave".
+// As with the sidecar seek index, it is only used when the size and last
+// write time recorded in it match the media file.
+class WaveformCache {
+ public:
+  enum { kVersion = 1 };
+
+  // Serializes |summary| into |image|.
+  static void Build(int64_t file_size, int64_t file_time,
+                    const WaveformSummary& summary,
+                    std::vector<uint8_t>* image);
+
+  // Gets the summary stored in |data|. Returns false if it is damaged or
+  // does not match |file_size| and |file_time|.
+  static bool Parse(const void* data, size_t size, int64_t file_size,
+                    int64_t file_time, WaveformSummary* summary);
+
+  // Gets the cached summary of |media_file|. Fails if there is none, or it
+  // is stale.
+  static HRESULT Read(const wchar_t* media_file, WaveformSummary* summary);
+
+  // Writes the cached summary of |media_file|, replacing any existing one.
+  static HRESULT Write(const wchar_t* media_file,
+                       const WaveformSummary& summary);
+
+  static std::wstring GetFileName(const wchar_t* media_file);
+
+ private:
+  WaveformCache();
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_WAVEFORM_H_
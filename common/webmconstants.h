@@ -15,16 +15,41 @@ namespace WebmUtil
 {
     enum EbmlID
     {
+        kEbmlAESSettingsCipherModeID = 0x47E8,
         kEbmlAudioSettingsID = 0xE1,
+        kEbmlBlockAddIDID = 0xEE,
+        kEbmlBlockAdditionalID = 0xA5,
+        kEbmlBlockAdditionsID = 0x75A1,
         kEbmlBlockGroupID = 0xA0,
+        kEbmlBlockID = 0xA1,
         kEbmlBlockDurationID = 0x9B,
+        kEbmlBlockMoreID = 0xA6,
         kEbmlChannelsID = 0x9F,
         kEbmlClusterID = 0x1F43B675,
         kEbmlCodecIDID = 0x86,
         kEbmlCodecNameID = 0x258688,
         kEbmlCodecPrivateID = 0x63A2,
-        kEbmlCrc32ID = 0xC3,
+        kEbmlContentCompAlgoID = 0x4254,
+        kEbmlContentCompressionID = 0x5034,
+        kEbmlContentCompSettingsID = 0x4255,
+        kEbmlContentEncAESSettingsID = 0x47E7,
+        kEbmlContentEncAlgoID = 0x47E1,
+        kEbmlContentEncKeyIDID = 0x47E2,
+        kEbmlContentEncodingID = 0x6240,
+        kEbmlContentEncodingOrderID = 0x5031,
+        kEbmlContentEncodingScopeID = 0x5032,
+        kEbmlContentEncodingsID = 0x6D80,
+        kEbmlContentEncodingTypeID = 0x5033,
+        kEbmlContentEncryptionID = 0x5035,
+        kEbmlCrc32ID = 0xBF,
+        kEbmlCueBlockNumberID = 0x5378,
+        kEbmlCueClusterPositionID = 0xF1,
+        kEbmlCuePointID = 0xBB,
+        kEbmlCueRelativePositionID = 0xF0,
         kEbmlCuesID = 0x1C53BB6B,
+        kEbmlCueTimeID = 0xB3,
+        kEbmlCueTrackID = 0xF7,
+        kEbmlCueTrackPositionsID = 0xB7,
         kEbmlDocTypeID = 0x4282,
         kEbmlDocTypeVersionID = 0x4287,
         kEbmlDocTypeReadVersionID = 0x4285,
@@ -42,6 +67,7 @@ namespace WebmUtil
         kEbmlSeekPositionID = 0x53AC,
         kEbmlSegmentID = 0x18538067,
         kEbmlSegmentInfoID = 0x1549A966,
+        kEbmlSimpleBlockID = 0xA3,
         kEbmlTimeCodeID = 0xE7,
         kEbmlTimeCodeScaleID = 0x2AD7B1,
         kEbmlTrackEntryID = 0xAE,
@@ -71,6 +97,11 @@ namespace WebmUtil
         kEbmlTrackTypeVideo = 1,
         kEbmlTrackTypeAudio = 2,
     };
+
+    //The BlockAddID under which the muxer records the temporal layer of
+    //a VPx frame, as a BlockAdditional of one byte (1 is the alpha
+    //channel of WebM).
+    enum { kWebmTemporalLayerBlockAddID = 2 };
 }
 
 #endif // __WEBMDSHOW_COMMON_WEBMCONSTANTS_HPP__
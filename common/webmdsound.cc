@@ -7,6 +7,7 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #include <windows.h>
+#include <ksmedia.h>
 #include <mmreg.h>
 
 #include <cassert>
@@ -27,60 +28,13 @@ const UINT32 kF32BitsPerSample = kF32BytesPerSample * 8;
 const UINT32 kS16BytesPerSample = sizeof(INT16);
 const UINT32 kS16BitsPerSample = kS16BytesPerSample * 8;
 
-// Note: AudioBufferTemplate is not in use!!
-template <class SampleType>
-AudioBufferTemplate<SampleType>::AudioBufferTemplate():
-  sample_size_(sizeof SampleType)
-{
-    DBGLOG("ctor, sample_size_=" << sample_size_);
-}
-
-template <class SampleType>
-AudioBufferTemplate<SampleType>::~AudioBufferTemplate()
-{
-    DBGLOG("dtor");
-}
-
-template <class SampleType>
-HRESULT AudioBufferTemplate<SampleType>::Read(UINT32 out_buf_size,
-                                              UINT32* ptr_bytes_written,
-                                              SampleType* ptr_samples)
-{
-    if (!out_buf_size || !ptr_bytes_written || !ptr_samples)
-    {
-        return E_INVALIDARG;
-    }
-    if (audio_buf_.empty())
-    {
-        DBGLOG("buffer empty");
-        return S_FALSE;
-    }
-    UINT32 aud_bytes_available = SamplesToBytes(audio_buf_.size());
-    UINT32 bytes_to_copy = out_buf_size >= aud_bytes_available ?
-        aud_bytes_available : out_buf_size;
-    void* ptr_out_data = reinterpret_cast<void*>(ptr_samples);
-    HRESULT hr = ::memcpy_s(ptr_out_data, max_bytes, &audio_buf_[0],
-                            bytes_to_copy);
-    if (SUCCEEDED(hr))
-    {
-        UINT32 samples_to_erase = BytesToSamples(bytes_to_copy);
-        audio_buf_.erase(audio_buf_[0], audio_buf_[samples_to_erase]);
-    }
-    return hr;
-}
+// |ptr_dsound_buf_| holds a second of audio; |ptr_audio_buf_| holds two, so
+// that a decoder delivering a large buffer at a time can stay ahead of it.
+const UINT32 kAudioBufferSeconds = 2;
 
-template <class SampleType>
-HRESULT AudioBufferTemplate<SampleType>::Write(SampleType* ptr_samples,
-                                               UINT32 length_in_bytes)
-{
-    if (!ptr_samples || !length_in_bytes)
-    {
-        return E_INVALIDARG;
-    }
-    UINT32 num_samples = BytesToSamples(length_in_bytes);
-    audio_buf_.insert(audio_buf_.end(), num_samples, ptr_samples);
-    return hr;
-}
+// |DSoundWriterThread_| is woken each time this fraction of
+// |ptr_dsound_buf_| has been played.
+const DWORD kNotifyCount = 4;
 
 AudioBuffer::AudioBuffer():
   sample_size_(0)
@@ -93,118 +47,96 @@ AudioBuffer::~AudioBuffer()
     DBGLOG("dtor");
 }
 
-F32AudioBuffer::F32AudioBuffer()
+void AudioBuffer::Reset(UINT32 capacity_in_bytes)
 {
-    AudioBuffer::sample_size_ = kF32BytesPerSample;
-    assert(kF32BytesPerSample == 4);
-    DBGLOG("ctor");
+    ring_.Reset(capacity_in_bytes);
 }
 
-F32AudioBuffer::~F32AudioBuffer()
+HRESULT AudioBuffer::Available(UINT32* ptr_num_samples,
+                               UINT32* ptr_num_bytes)
 {
-    DBGLOG("dtor");
+    if (!ptr_num_samples || !ptr_num_bytes)
+    {
+        return E_INVALIDARG;
+    }
+    *ptr_num_bytes = static_cast<UINT32>(ring_.size());
+    *ptr_num_samples = *ptr_num_bytes / sample_size_;
+    return S_OK;
 }
 
-HRESULT F32AudioBuffer::Read(UINT32 out_buf_size, UINT32* ptr_bytes_written,
-                             void* ptr_samples)
+HRESULT AudioBuffer::Read(UINT32 out_buf_size, UINT32* ptr_bytes_written,
+                          void* ptr_samples)
 {
     if (!out_buf_size || !ptr_bytes_written || !ptr_samples)
     {
         return E_INVALIDARG;
     }
-    if (audio_buf_.empty())
+    *ptr_bytes_written = 0;
+    // whole samples only: the producer only ever stores whole samples
+    const UINT32 bytes_to_copy = out_buf_size - (out_buf_size % sample_size_);
+    if (!bytes_to_copy)
     {
-        DBGLOG("buffer empty");
-        return S_FALSE;
+        return E_INVALIDARG;
     }
-    UINT64 aud_bytes_available = SamplesToBytes(audio_buf_.size());
-    UINT64 bytes_to_copy = out_buf_size >= aud_bytes_available ?
-        aud_bytes_available : out_buf_size;
-    void* ptr_out_data = reinterpret_cast<void*>(ptr_samples);
-    HRESULT hr = ::memcpy_s(ptr_out_data, out_buf_size, &audio_buf_[0],
-                            bytes_to_copy);
-    if (SUCCEEDED(hr))
+    const size_t bytes_read = ring_.Read(ptr_samples, bytes_to_copy);
+    if (!bytes_read)
     {
-        UINT64 samples_to_erase = BytesToSamples(bytes_to_copy);
-        audio_buf_.erase(audio_buf_.begin(), audio_buf_.begin()+samples_to_erase);
+        DBGLOG("buffer empty");
+        return S_FALSE;
     }
-    return hr;
+    *ptr_bytes_written = static_cast<UINT32>(bytes_read);
+    return S_OK;
 }
 
-HRESULT F32AudioBuffer::Write(const void* const ptr_samples,
-                              UINT32 length_in_bytes,
-                              UINT32* ptr_samples_written)
+HRESULT AudioBuffer::Write(const void* const ptr_samples,
+                           UINT32 length_in_bytes,
+                           UINT32* ptr_samples_written)
 {
     if (!ptr_samples || !length_in_bytes || !ptr_samples_written)
     {
         return E_INVALIDARG;
     }
-    UINT64 num_samples = BytesToSamples(length_in_bytes);
-    typedef const float* const f32_read_ptr;
-    f32_read_ptr ptr_fp_samples = reinterpret_cast<f32_read_ptr>(ptr_samples);
-    audio_buf_.insert(audio_buf_.end(), num_samples, *ptr_fp_samples);
-    *ptr_samples_written = static_cast<UINT32>(num_samples);
-    return S_OK;
-}
-
-S16AudioBuffer::S16AudioBuffer()
-{
-    AudioBuffer::sample_size_ = kS16BytesPerSample;
-    assert(kS16BytesPerSample == 2);
-    DBGLOG("ctor");
-}
-
-S16AudioBuffer::~S16AudioBuffer()
-{
-    DBGLOG("dtor");
+    // The ring's capacity is a power of two, and every write and read is a
+    // whole number of samples, so the free space is too: SpscByteRing never
+    // stores part of a sample.
+    const UINT32 bytes_to_copy =
+        length_in_bytes - (length_in_bytes % sample_size_);
+    const size_t bytes_written = ring_.Write(ptr_samples, bytes_to_copy);
+    *ptr_samples_written = static_cast<UINT32>(bytes_written / sample_size_);
+    return (bytes_written < bytes_to_copy) ? S_FALSE : S_OK;
 }
 
-HRESULT S16AudioBuffer::Read(UINT32 out_buf_size, UINT32* ptr_bytes_written,
-                             void* ptr_samples)
+// Creates the buffer for the sample type |fmt_tag| and |bits| describe (we
+// support only S16 and float samples).
+HRESULT CreateAudioBuffer(WORD fmt_tag, WORD bits,
+                          std::auto_ptr<AudioBuffer>& audio_buf)
 {
-    if (!out_buf_size || !ptr_bytes_written || !ptr_samples)
+    if (WAVE_FORMAT_PCM != fmt_tag && WAVE_FORMAT_IEEE_FLOAT != fmt_tag)
     {
+        DBGLOG("ERROR unsupported format tag");
         return E_INVALIDARG;
     }
-    if (audio_buf_.empty())
+    if (WAVE_FORMAT_PCM == fmt_tag && kS16BitsPerSample == bits)
     {
-        DBGLOG("buffer empty");
-        return S_FALSE;
+        audio_buf.reset(new (std::nothrow) S16AudioBuffer());
     }
-    UINT64 aud_bytes_available = SamplesToBytes(audio_buf_.size());
-    UINT64 bytes_to_copy = out_buf_size >= aud_bytes_available ?
-        aud_bytes_available : out_buf_size;
-    void* ptr_out_data = reinterpret_cast<void*>(ptr_samples);
-    HRESULT hr = ::memcpy_s(ptr_out_data, out_buf_size, &audio_buf_[0],
-                            bytes_to_copy);
-    if (SUCCEEDED(hr))
+    else if (WAVE_FORMAT_IEEE_FLOAT == fmt_tag && kF32BitsPerSample == bits)
     {
-        UINT64 samples_to_erase = BytesToSamples(bytes_to_copy);
-        audio_buf_.erase(audio_buf_.begin(),
-                         audio_buf_.begin()+samples_to_erase);
+        audio_buf.reset(new (std::nothrow) F32AudioBuffer());
     }
-    return hr;
-}
-
-HRESULT S16AudioBuffer::Write(const void* const ptr_samples,
-                              UINT32 length_in_bytes,
-                              UINT32* ptr_samples_written)
-{
-    if (!ptr_samples || !length_in_bytes || !ptr_samples_written)
+    else
     {
+        DBGLOG("ERROR unsupported sample size");
         return E_INVALIDARG;
     }
-    UINT64 num_samples = BytesToSamples(length_in_bytes);
-    typedef const INT16* const s16_read_ptr;
-    s16_read_ptr ptr_s16_samples = reinterpret_cast<s16_read_ptr>(ptr_samples);
-    audio_buf_.insert(audio_buf_.end(), num_samples, *ptr_s16_samples);
-    *ptr_samples_written = (UINT32)num_samples;
-    return S_OK;
+    return audio_buf.get() ? S_OK : E_OUTOFMEMORY;
 }
 
 AudioPlaybackDevice::AudioPlaybackDevice():
+  block_align_(0),
   dsound_buffer_size_(0),
   hwnd_(NULL),
+  notify_event_(NULL),
   play_cursor_(0),
   ptr_dsound_(NULL),
   ptr_dsound_buf_(NULL),
@@ -212,19 +144,41 @@ AudioPlaybackDevice::AudioPlaybackDevice():
   ptr_dsound_thread_(NULL),
   samples_buffered_(0),
   samples_played_(0),
-  state_(STATE_STOPPED)
+  state_(STATE_STOPPED),
+  stop_event_(NULL),
+  write_offset_(0)
 {
 }
 
 AudioPlaybackDevice::~AudioPlaybackDevice()
 {
-    WebmUtil::safe_rel(ptr_dsound_);
     WebmUtil::safe_rel(ptr_dsound_buf_);
+    WebmUtil::safe_rel(ptr_dsound_);
+    if (notify_event_)
+    {
+        CloseHandle(notify_event_);
+    }
+    if (stop_event_)
+    {
+        CloseHandle(stop_event_);
+    }
 }
 
 HRESULT AudioPlaybackDevice::Open(HWND hwnd,
                                   const WAVEFORMATEXTENSIBLE* const ptr_wfx)
 {
+    if (!ptr_wfx)
+    {
+        DBGLOG("ERROR NULL WAVEFORMATEXTENSIBLE");
+        return E_INVALIDARG;
+    }
+    notify_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!notify_event_ || !stop_event_)
+    {
+        DBGLOG("ERROR CreateEvent failed");
+        return E_OUTOFMEMORY;
+    }
     HRESULT hr;
     CHK(hr, DirectSoundCreate8(NULL /* same as DSDEVID_DefaultPlayback */,
                                &ptr_dsound_, NULL));
@@ -258,6 +212,7 @@ HRESULT AudioPlaybackDevice::Open(HWND hwnd,
     {
         return hr;
     }
+    ptr_audio_buf_->Reset(kAudioBufferSeconds * dsound_buffer_size_);
     return hr;
 }
 
@@ -282,6 +237,7 @@ HRESULT AudioPlaybackDevice::Start()
     {
         return hr;
     }
+    ResetEvent(stop_event_);
     // Create the thread, |ptr_dsound_thread_|
     using WebmMfUtil::SimpleThread;
     ptr_dsound_thread_.reset(new (std::nothrow) WebmMfUtil::SimpleThread());
@@ -319,10 +275,10 @@ HRESULT AudioPlaybackDevice::Stop()
     if (ptr_dsound_thread_->Running())
     {
         // tell the |DSoundWriterThread_| to stop
-        CHK(hr, ptr_dsound_thread_event_->Set());
-        if (FAILED(hr))
+        if (!SetEvent(stop_event_))
         {
-            return hr;
+            DBGLOG("ERROR SetEvent failed");
+            return E_FAIL;
         }
         // wait for |DSoundWriterThread_| to signal
         CHK(hr, ptr_dsound_thread_event_->Wait());
@@ -364,6 +320,8 @@ HRESULT AudioPlaybackDevice::Play()
     if (SUCCEEDED(hr))
     {
         state_ = STATE_PLAY;
+        // fill |ptr_dsound_buf_| now, rather than at the first notification
+        SetEvent(notify_event_);
     }
     return hr;
 }
@@ -386,13 +344,9 @@ HRESULT AudioPlaybackDevice::WriteAudioBuffer(const void* const ptr_samples,
         DBGLOG("ERROR less than 1 sample in user input buffer");
         return E_INVALIDARG;
     }
-    Lock lock;
+    // No lock: this thread is the only producer of |ptr_audio_buf_|, and
+    // |DSoundWriterThread_| the only consumer.
     HRESULT hr = S_OK;
-    CHK(hr, lock.Seize(this));
-    if (FAILED(hr))
-    {
-        return hr;
-    }
     UINT32 samples_written = 0;
     CHK(hr, ptr_audio_buf_->Write(ptr_samples, length_in_bytes,
                                   &samples_written));
@@ -410,13 +364,25 @@ HRESULT AudioPlaybackDevice::WriteDSoundBuffer_()
         DBGLOG("ERROR not configured");
         return E_UNEXPECTED;
     }
-    Lock lock;
     HRESULT hr = S_OK;
-    CHK(hr, lock.Seize(this));
+    DWORD play_cursor = 0, write_cursor = 0;
+    CHK(hr, ptr_dsound_buf_->GetCurrentPosition(&play_cursor, &write_cursor));
     if (FAILED(hr))
     {
         return hr;
     }
+    UpdateSamplesPlayed_(play_cursor);
+    // We may write from where we stopped last time up to the play cursor,
+    // less a block, so that |write_offset_| only equals |play_cursor| when
+    // nothing we wrote is left to play.
+    DWORD bytes_free =
+        (play_cursor + dsound_buffer_size_ - write_offset_) %
+        dsound_buffer_size_;
+    if (!bytes_free)
+    {
+        bytes_free = dsound_buffer_size_;
+    }
+    bytes_free -= block_align_;
     UINT32 bytes_available = 0;
     UINT32 samples_available = 0;
     CHK(hr, ptr_audio_buf_->Available(&samples_available, &bytes_available));
@@ -424,76 +390,57 @@ HRESULT AudioPlaybackDevice::WriteDSoundBuffer_()
     {
         return hr;
     }
-    if (!samples_available)
+    UINT32 bytes_to_write = bytes_available < bytes_free ?
+        bytes_available : bytes_free;
+    bytes_to_write -= bytes_to_write % block_align_;
+    if (!bytes_to_write)
     {
-        DBGLOG("no samples in buffer");
+        // nothing to write, or |ptr_dsound_buf_| is full
         return S_FALSE;
     }
-    // adjust |bytes_available| to ensure we avoid trying to lock a portion
-    // of |ptr_dsound_buf_| that's larger than the entire buffer
-    bytes_available = bytes_available > dsound_buffer_size_ ?
-        dsound_buffer_size_ : bytes_available;
-    // We own our internal lock, try to lock the dsound buffer...
-    DWORD write_offset = 0; // ignored by dsound because we set the
-                            // DSBLOCK_FROMWRITECURSOR flag
     // DirectSound buffers are circular, so we might get two write pointers
-    // back.  When we do, we must write to both if Lock gives us two non-null
-    // pointers to satisfy our |length_in_bytes| requirement.
+    // back.  When we do, we must write to both.
     void* ptr_write1 = NULL;
     void* ptr_write2 = NULL;
     DWORD write_space1 = 0;
     DWORD write_space2 = 0;
-    // Always lock the dsound buffer at the current write cursor position
-    DWORD lock_flags = DSBLOCK_FROMWRITECURSOR;
-    CHK(hr, ptr_dsound_buf_->Lock(write_offset, bytes_available, &ptr_write1,
+    CHK(hr, ptr_dsound_buf_->Lock(write_offset_, bytes_to_write, &ptr_write1,
                                   &write_space1, &ptr_write2, &write_space2,
-                                  lock_flags));
+                                  0));
     if (FAILED(hr))
     {
         DBGLOG("ERROR Lock failed.");
         return hr;
     }
-    bool buffer_full = (write_space1 + write_space2) == 0;
-    if (buffer_full)
-    {
-        UpdateSamplesPlayed_();
-        return S_FALSE;
-    }
     UINT32 bytes_written1 = 0;
-    if (ptr_write1)
+    if (ptr_write1 && write_space1)
     {
-        const UINT32 bytes_to_write =
-            write_space1 > bytes_available ? bytes_available : write_space1;
-        CHK(hr, ptr_audio_buf_->Read(bytes_to_write, &bytes_written1,
+        CHK(hr, ptr_audio_buf_->Read(write_space1, &bytes_written1,
                                      ptr_write1));
     }
     UINT32 bytes_written2 = 0;
-    UINT32 bytes_left = bytes_available - write_space1;
-    if (ptr_write2 && bytes_available > write_space1 && bytes_left)
+    if (ptr_write2 && write_space2 && bytes_written1 == write_space1)
     {
         CHK(hr, ptr_audio_buf_->Read(write_space2, &bytes_written2,
                                      ptr_write2));
     }
     CHK(hr, ptr_dsound_buf_->Unlock(ptr_write1, bytes_written1, ptr_write2,
                                     bytes_written2));
-    UpdateSamplesPlayed_();
+    write_offset_ = (write_offset_ + bytes_written1 + bytes_written2) %
+        dsound_buffer_size_;
     //DBGLOG("bytes_written1=" << bytes_written1
     //    << "bytes_written2=" << bytes_written2
     //    << "total bytes written=" << bytes_written1 + bytes_written2);
     return hr;
 }
 
-void AudioPlaybackDevice::UpdateSamplesPlayed_()
+void AudioPlaybackDevice::UpdateSamplesPlayed_(DWORD play_cursor)
 {
-    DWORD play_cursor = 0, write_cursor = 0;
-    // get |ptr_dsound_buf_| cursor positions
-    HRESULT hr;
-    CHK(hr, ptr_dsound_buf_->GetCurrentPosition(&play_cursor, &write_cursor));
     UINT64 bytes_played = 0;
     if (play_cursor < play_cursor_)
     {
         // wrapped
-        bytes_played = play_cursor + play_cursor_ - dsound_buffer_size_;
+        bytes_played = play_cursor + dsound_buffer_size_ - play_cursor_;
     }
     else
     {
@@ -520,66 +467,39 @@ DWORD AudioPlaybackDevice::DSoundWriterThread_(void* ptr_this)
     }
     AudioPlaybackDevice* ptr_apd =
         reinterpret_cast<AudioPlaybackDevice*>(ptr_this);
+    const WebmMfUtil::ThreadPolicyScope policy(
+        L"webmdsound", WebmMfUtil::kThreadClassProAudio);
     WebmMfUtil::EventWaiter* apd_event =
         ptr_apd->ptr_dsound_thread_event_.get();
+    // |stop_event_| first, so that a stop request wins over a notification.
+    const HANDLE events[2] = { ptr_apd->stop_event_, ptr_apd->notify_event_ };
     HRESULT hr;
     for (;;)
     {
-        if (S_OK == apd_event->ZeroWait())
-        {
-            // received a message, at present that means it's time to stop
-            CHK(hr, apd_event->Set());
-            break;
-        }
         if (STATE_PLAY == ptr_apd->state_)
         {
-            // we intentionally ignore the return values other than S_FALSE from
-            // |WriteDsoundBuffer_|, though we log failures for sanity's sake in
-            // debug mode
+            // we intentionally ignore the return value of
+            // |WriteDsoundBuffer_|, though we log failures for sanity's sake
+            // in debug mode
             CHK(hr, ptr_apd->WriteDSoundBuffer_());
-            // and now we yield
-            if (S_FALSE == hr)
-            {
-                // direct sound buffer full, let it play out for a bit
-                Sleep(1);
-            }
-            else
-            {
-                Sleep(0);
-            }
         }
-        else
+        // Sleep until |ptr_dsound_buf_| has played another part of itself.
+        // No notifications arrive while it's paused, so then we sleep until
+        // |Play| or |Stop|.
+        const DWORD wr = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+        if (WAIT_OBJECT_0 + 1 != wr)
         {
-            // paused or stopping, just sleep for a millisecond
-            Sleep(1);
+            // at present that means it's time to stop
+            break;
         }
     }
+    CHK(hr, apd_event->Set());
     return EXIT_SUCCESS;
 }
 
 HRESULT AudioPlaybackDevice::CreateAudioBuffer_(WORD fmt_tag, WORD bits)
 {
-    if (WAVE_FORMAT_PCM != fmt_tag && WAVE_FORMAT_IEEE_FLOAT != fmt_tag)
-    {
-        DBGLOG("ERROR unsupported format tag");
-        return E_INVALIDARG;
-    }
-    // Create our internal audio buffer based on input sample type
-    // (we support only S16 and float samples)
-    if (WAVE_FORMAT_PCM == fmt_tag && kS16BitsPerSample == bits)
-    {
-        ptr_audio_buf_.reset(new (std::nothrow) S16AudioBuffer());
-    }
-    else if (WAVE_FORMAT_IEEE_FLOAT == fmt_tag && kF32BitsPerSample == bits)
-    {
-        ptr_audio_buf_.reset(new (std::nothrow) F32AudioBuffer());
-    }
-    else
-    {
-        DBGLOG("ERROR unsupported sample size");
-        return E_INVALIDARG;
-    }
-    return ptr_audio_buf_.get() ? S_OK : E_OUTOFMEMORY;
+    return CreateAudioBuffer(fmt_tag, bits, ptr_audio_buf_);
 }
 
 HRESULT AudioPlaybackDevice::CreateDirectSoundBuffer_(
@@ -606,8 +526,15 @@ HRESULT AudioPlaybackDevice::CreateDirectSoundBuffer_(
     aud_buffer_desc.guid3DAlgorithm = DS3DALG_DEFAULT;
     aud_buffer_desc.lpwfxFormat = (WAVEFORMATEX*)ptr_wfx;
     dsound_buffer_size_ = ptr_wfx->Format.nAvgBytesPerSec;
+    block_align_ = ptr_wfx->Format.nBlockAlign;
+    if (!block_align_ || !dsound_buffer_size_)
+    {
+        DBGLOG("bad nBlockAlign or nAvgBytesPerSec!");
+        return E_INVALIDARG;
+    }
     aud_buffer_desc.dwBufferBytes = dsound_buffer_size_;
-    aud_buffer_desc.dwFlags = DSBCAPS_GETCURRENTPOSITION2;
+    aud_buffer_desc.dwFlags =
+        DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_CTRLPOSITIONNOTIFY;
     // Obtain our IDirectSoundBuffer8 interface pointer, |ptr_dsound_buf_|, by:
     // 1. Create an IDirectSoundBuffer.
     // 2. Call QueryInterface on the IDirectSoundBuffer instance to obtain the
@@ -619,14 +546,503 @@ HRESULT AudioPlaybackDevice::CreateDirectSoundBuffer_(
     {
         return hr;
     }
-    void* ptr_dsound_buf8 = reinterpret_cast<void*>(ptr_dsound_buf_);
+    void** ptr_dsound_buf8 = reinterpret_cast<void**>(&ptr_dsound_buf_);
     CHK(hr, ptr_dsbuf->QueryInterface(IID_IDirectSoundBuffer8,
-                                      &ptr_dsound_buf8));
+                                      ptr_dsound_buf8));
+    ptr_dsbuf->Release();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, SetNotificationPositions_());
+    return hr;
+}
+
+HRESULT AudioPlaybackDevice::SetNotificationPositions_()
+{
+    // Have |ptr_dsound_buf_| signal |notify_event_| at the end of each
+    // |kNotifyCount|th of itself, so that |DSoundWriterThread_| wakes only
+    // when there's room to write, instead of polling.
+    IDirectSoundNotify8* ptr_notify = NULL;
+    HRESULT hr;
+    CHK(hr, ptr_dsound_buf_->QueryInterface(
+        IID_IDirectSoundNotify8, reinterpret_cast<void**>(&ptr_notify)));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    DSBPOSITIONNOTIFY positions[kNotifyCount];
+    for (DWORD i = 0; i < kNotifyCount; ++i)
+    {
+        DWORD offset = (dsound_buffer_size_ / kNotifyCount) * (i + 1);
+        offset -= offset % block_align_;
+        positions[i].dwOffset = offset - 1;
+        positions[i].hEventNotify = notify_event_;
+    }
+    CHK(hr, ptr_notify->SetNotificationPositions(kNotifyCount, positions));
+    ptr_notify->Release();
+    return hr;
+}
+
+WasapiPlaybackDevice::WasapiPlaybackDevice(WasapiShareMode share_mode):
+  block_align_(0),
+  buffer_event_(NULL),
+  buffer_frames_(0),
+  channels_(0),
+  glitch_count_(0),
+  ptr_audio_client_(NULL),
+  ptr_device_(NULL),
+  ptr_render_client_(NULL),
+  ptr_thread_event_(NULL),
+  ptr_thread_(NULL),
+  samples_buffered_(0),
+  samples_per_sec_(0),
+  samples_played_(0),
+  samples_to_endpoint_(0),
+  share_mode_(share_mode),
+  state_(STATE_STOPPED),
+  stop_event_(NULL),
+  stream_latency_(0)
+{
+}
+
+WasapiPlaybackDevice::~WasapiPlaybackDevice()
+{
+    WebmUtil::safe_rel(ptr_render_client_);
+    WebmUtil::safe_rel(ptr_audio_client_);
+    WebmUtil::safe_rel(ptr_device_);
+    if (buffer_event_)
+    {
+        CloseHandle(buffer_event_);
+    }
+    if (stop_event_)
+    {
+        CloseHandle(stop_event_);
+    }
+}
+
+HRESULT WasapiPlaybackDevice::Open(HWND,
+                                   const WAVEFORMATEXTENSIBLE* const ptr_wfx)
+{
+    if (!ptr_wfx)
+    {
+        DBGLOG("ERROR NULL WAVEFORMATEXTENSIBLE");
+        return E_INVALIDARG;
+    }
+    if (ptr_audio_client_)
+    {
+        DBGLOG("ERROR Already open.");
+        return E_UNEXPECTED;
+    }
+    const WAVEFORMATEX& wfx = ptr_wfx->Format;
+    WORD fmt_tag = wfx.wFormatTag;
+    if (WAVE_FORMAT_EXTENSIBLE == fmt_tag)
+    {
+        if (KSDATAFORMAT_SUBTYPE_PCM == ptr_wfx->SubFormat)
+        {
+            fmt_tag = WAVE_FORMAT_PCM;
+        }
+        else if (KSDATAFORMAT_SUBTYPE_IEEE_FLOAT == ptr_wfx->SubFormat)
+        {
+            fmt_tag = WAVE_FORMAT_IEEE_FLOAT;
+        }
+    }
+    HRESULT hr;
+    CHK(hr, CreateAudioBuffer(fmt_tag, wfx.wBitsPerSample, ptr_audio_buf_));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    block_align_ = wfx.nBlockAlign;
+    channels_ = wfx.nChannels;
+    samples_per_sec_ = wfx.nSamplesPerSec;
+    if (!block_align_ || !channels_ || !samples_per_sec_)
+    {
+        DBGLOG("ERROR bad format");
+        return E_INVALIDARG;
+    }
+    buffer_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+    stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!buffer_event_ || !stop_event_)
+    {
+        DBGLOG("ERROR CreateEvent failed");
+        return E_OUTOFMEMORY;
+    }
+    IMMDeviceEnumerator* ptr_enumerator = NULL;
+    CHK(hr, CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL,
+                             CLSCTX_INPROC_SERVER,
+                             __uuidof(IMMDeviceEnumerator),
+                             reinterpret_cast<void**>(&ptr_enumerator)));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_enumerator->GetDefaultAudioEndpoint(eRender, eConsole,
+                                                    &ptr_device_));
+    ptr_enumerator->Release();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, InitializeAudioClient_(&wfx));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_audio_client_->SetEventHandle(buffer_event_));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_audio_client_->GetService(
+        __uuidof(IAudioRenderClient),
+        reinterpret_cast<void**>(&ptr_render_client_)));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    // The latency doesn't count the endpoint buffer; GetLatency adds that.
+    CHK(hr, ptr_audio_client_->GetStreamLatency(&stream_latency_));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    ptr_audio_buf_->Reset(kAudioBufferSeconds * wfx.nAvgBytesPerSec);
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::InitializeAudioClient_(
+    const WAVEFORMATEX* ptr_wfx)
+{
+    HRESULT hr;
+    CHK(hr, ptr_device_->Activate(
+        __uuidof(IAudioClient), CLSCTX_INPROC_SERVER, NULL,
+        reinterpret_cast<void**>(&ptr_audio_client_)));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const DWORD stream_flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+    if (WASAPI_SHARED == share_mode_)
+    {
+        // The engine picks the period; a buffer duration of 0 asks for the
+        // smallest buffer it allows.
+        CHK(hr, ptr_audio_client_->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                                              stream_flags, 0, 0, ptr_wfx,
+                                              NULL));
+    }
+    else
+    {
+        REFERENCE_TIME default_period = 0, min_period = 0;
+        CHK(hr, ptr_audio_client_->GetDevicePeriod(&default_period,
+                                                   &min_period));
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        // In exclusive event-driven mode the buffer is one period, which
+        // must equal the buffer duration.
+        REFERENCE_TIME period = min_period;
+        CHK(hr, ptr_audio_client_->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                              stream_flags, period, period,
+                                              ptr_wfx, NULL));
+        if (AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED == hr)
+        {
+            // Retry with the period rounded to the size the device wants,
+            // which takes a new IAudioClient.
+            UINT32 frames = 0;
+            CHK(hr, ptr_audio_client_->GetBufferSize(&frames));
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            WebmUtil::safe_rel(ptr_audio_client_);
+            period = static_cast<REFERENCE_TIME>(
+                10000000.0 * frames / ptr_wfx->nSamplesPerSec + 0.5);
+            CHK(hr, ptr_device_->Activate(
+                __uuidof(IAudioClient), CLSCTX_INPROC_SERVER, NULL,
+                reinterpret_cast<void**>(&ptr_audio_client_)));
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            CHK(hr, ptr_audio_client_->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                                  stream_flags, period,
+                                                  period, ptr_wfx, NULL));
+        }
+    }
     if (FAILED(hr))
     {
         return hr;
     }
+    CHK(hr, ptr_audio_client_->GetBufferSize(&buffer_frames_));
     return hr;
 }
 
+HRESULT WasapiPlaybackDevice::Start()
+{
+    if (STATE_STOPPED != state_)
+    {
+        DBGLOG("ERROR Already started.");
+        return E_UNEXPECTED;
+    }
+    if (!ptr_audio_client_)
+    {
+        DBGLOG("ERROR not open");
+        return E_UNEXPECTED;
+    }
+    using WebmMfUtil::EventWaiter;
+    ptr_thread_event_.reset(new (std::nothrow) EventWaiter());
+    if (!ptr_thread_event_.get())
+    {
+        DBGLOG("ERROR no memory for thread event.");
+        return E_OUTOFMEMORY;
+    }
+    HRESULT hr;
+    CHK(hr, ptr_thread_event_->Create());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    ResetEvent(stop_event_);
+    using WebmMfUtil::SimpleThread;
+    ptr_thread_.reset(new (std::nothrow) SimpleThread());
+    if (!ptr_thread_.get())
+    {
+        DBGLOG("ERROR no memory for thread.");
+        return E_OUTOFMEMORY;
+    }
+    CHK(hr, ptr_thread_->Run(WasapiWriterThread_,
+                             reinterpret_cast<void*>(this)));
+    if (SUCCEEDED(hr))
+    {
+        state_ = STATE_STARTED;
+    }
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::Stop()
+{
+    if (state_ == STATE_STOPPED)
+    {
+        DBGLOG("ERROR Already stopped.");
+        return E_UNEXPECTED;
+    }
+    HRESULT hr = S_OK;
+    if (STATE_PLAY == state_)
+    {
+        CHK(hr, Pause());
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    if (ptr_thread_->Running())
+    {
+        if (!SetEvent(stop_event_))
+        {
+            DBGLOG("ERROR SetEvent failed");
+            return E_FAIL;
+        }
+        CHK(hr, ptr_thread_event_->Wait());
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    state_ = STATE_STOPPED;
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::Pause()
+{
+    if (STATE_PLAY != state_)
+    {
+        DBGLOG("ERROR wrong state, not playing.");
+        return E_UNEXPECTED;
+    }
+    HRESULT hr;
+    CHK(hr, ptr_audio_client_->Stop());
+    if (SUCCEEDED(hr))
+    {
+        state_ = STATE_PAUSE;
+    }
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::Play()
+{
+    bool wrong_state = (STATE_PAUSE != state_ && STATE_STARTED != state_);
+    if (wrong_state)
+    {
+        DBGLOG("ERROR wrong state.");
+        return E_UNEXPECTED;
+    }
+    // Fill the endpoint buffer before starting the stream, as WASAPI
+    // requires, so the first period isn't silence.  The writer thread only
+    // runs while |state_| is STATE_PLAY, so it isn't writing at the same
+    // time.
+    HRESULT hr;
+    CHK(hr, FillEndpointBuffer_(false));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    CHK(hr, ptr_audio_client_->Start());
+    if (SUCCEEDED(hr))
+    {
+        state_ = STATE_PLAY;
+    }
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::WriteAudioBuffer(const void* const ptr_samples,
+                                               UINT32 length_in_bytes)
+{
+    if (!ptr_audio_buf_.get() || !ptr_audio_buf_->GetSampleSize())
+    {
+        DBGLOG("ERROR not configured");
+        return E_UNEXPECTED;
+    }
+    if (!ptr_samples || !length_in_bytes)
+    {
+        DBGLOG("ERROR bad arg(s)");
+        return E_INVALIDARG;
+    }
+    if (length_in_bytes < ptr_audio_buf_->GetSampleSize())
+    {
+        DBGLOG("ERROR less than 1 sample in user input buffer");
+        return E_INVALIDARG;
+    }
+    // As for AudioPlaybackDevice, no lock: one producer, one consumer.
+    HRESULT hr = S_OK;
+    UINT32 samples_written = 0;
+    CHK(hr, ptr_audio_buf_->Write(ptr_samples, length_in_bytes,
+                                  &samples_written));
+    if (SUCCEEDED(hr))
+    {
+        samples_buffered_ += samples_written;
+    }
+    return hr;
+}
+
+HRESULT WasapiPlaybackDevice::GetLatency(REFERENCE_TIME* ptr_latency)
+{
+    if (!ptr_latency)
+    {
+        return E_POINTER;
+    }
+    if (!ptr_audio_client_ || !ptr_audio_buf_.get())
+    {
+        DBGLOG("ERROR not open");
+        return E_UNEXPECTED;
+    }
+    UINT32 padding = buffer_frames_;  // exclusive: always a full buffer
+    HRESULT hr = S_OK;
+    if (WASAPI_SHARED == share_mode_)
+    {
+        CHK(hr, ptr_audio_client_->GetCurrentPadding(&padding));
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    UINT32 bytes_queued = 0, samples_queued = 0;
+    CHK(hr, ptr_audio_buf_->Available(&samples_queued, &bytes_queued));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const UINT64 frames = padding + bytes_queued / block_align_;
+    *ptr_latency = stream_latency_ +
+        static_cast<REFERENCE_TIME>(frames * 10000000 / samples_per_sec_);
+    return S_OK;
+}
+
+HRESULT WasapiPlaybackDevice::FillEndpointBuffer_(bool count_glitches)
+{
+    // Shared mode: the free part of the endpoint buffer.  Exclusive mode:
+    // the device has finished with the whole buffer (one period) each time
+    // it signals.
+    UINT32 padding = 0;
+    HRESULT hr = S_OK;
+    if (WASAPI_SHARED == share_mode_)
+    {
+        CHK(hr, ptr_audio_client_->GetCurrentPadding(&padding));
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    const UINT64 samples_in_endpoint =
+        static_cast<UINT64>(padding) * channels_;
+    if (samples_to_endpoint_ > samples_in_endpoint)
+    {
+        samples_played_ = samples_to_endpoint_ - samples_in_endpoint;
+    }
+    const UINT32 frames = buffer_frames_ - padding;
+    if (!frames)
+    {
+        return S_FALSE;
+    }
+    BYTE* ptr_data = NULL;
+    CHK(hr, ptr_render_client_->GetBuffer(frames, &ptr_data));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const UINT32 bytes = frames * block_align_;
+    UINT32 bytes_read = 0;
+    CHK(hr, ptr_audio_buf_->Read(bytes, &bytes_read, ptr_data));
+    if (FAILED(hr))
+    {
+        bytes_read = 0;
+    }
+    if (bytes_read < bytes)
+    {
+        // Underflow: play silence for the rest of the period.
+        memset(ptr_data + bytes_read, 0, bytes - bytes_read);
+        if (count_glitches)
+        {
+            ++glitch_count_;
+        }
+    }
+    samples_to_endpoint_ += bytes_read / ptr_audio_buf_->GetSampleSize();
+    const DWORD flags = bytes_read ? 0 : AUDCLNT_BUFFERFLAGS_SILENT;
+    CHK(hr, ptr_render_client_->ReleaseBuffer(frames, flags));
+    return hr;
+}
+
+DWORD WasapiPlaybackDevice::WasapiWriterThread_(void* ptr_this)
+{
+    if (!ptr_this)
+    {
+        DBGLOG("ERROR NULL thread data pointer");
+        return EXIT_FAILURE;
+    }
+    WasapiPlaybackDevice* ptr_wpd =
+        reinterpret_cast<WasapiPlaybackDevice*>(ptr_this);
+    // Ask MMCSS to schedule us as a pro audio thread, so that we're not
+    // late for a period under load.
+    const WebmMfUtil::ThreadPolicyScope policy(
+        L"webmdsound", WebmMfUtil::kThreadClassProAudio);
+    // |stop_event_| first, so that a stop request wins over a period.
+    const HANDLE events[2] = { ptr_wpd->stop_event_, ptr_wpd->buffer_event_ };
+    HRESULT hr;
+    for (;;)
+    {
+        const DWORD wr = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+        if (WAIT_OBJECT_0 + 1 != wr)
+        {
+            break;
+        }
+        if (STATE_PLAY == ptr_wpd->state_)
+        {
+            CHK(hr, ptr_wpd->FillEndpointBuffer_(true));
+        }
+    }
+    CHK(hr, ptr_wpd->ptr_thread_event_->Set());
+    return EXIT_SUCCESS;
+}
+
 } // WebmDirectX namespace
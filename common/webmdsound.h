@@ -9,7 +9,11 @@
 #ifndef __WEBMDSHOW_COMMON_WEBDSOUND_HPP__
 #define __WEBMDSHOW_COMMON_WEBDSOUND_HPP__
 
+#include <audioclient.h>
 #include <dsound.h>
+#include <mmdeviceapi.h>
+
+#include "spscbytering.h"
 
 namespace WebmDirectX
 {
@@ -22,50 +26,35 @@ enum AudioPlaybackState
     STATE_PAUSE = 3
 };
 
-// Note: AudioBufferTemplate is not in use!!
-template <class SampleType>
-class AudioBufferTemplate
-{
-public:
-    AudioBufferTemplate();
-    ~AudioBufferTemplate();
-    HRESULT Read(UINT32 max_bytes, UINT32* ptr_bytes_written,
-                 SampleType* ptr_out_data);
-    HRESULT Write(SampleType* ptr_data, UINT32 length_in_bytes);
-    UINT32 BytesToSamples(UINT32 num_bytes)
-    {
-        return num_bytes + (sample_size_ - 1) / sample_size;
-    };
-    UINT32 SamplesToBytes(UINT32 num_samples)
-    {
-        return num_samples * sample_size_;
-    };
-private:
-    const UINT32 sample_size_;
-    typedef std::vector<SampleType> SampleBuffer;
-    SampleBuffer audio_buf_;
-    DISALLOW_COPY_AND_ASSIGN(AudioBufferTemplate);
-};
-
+// A fixed-capacity PCM FIFO between the thread that calls
+// |AudioPlaybackDevice::WriteAudioBuffer| and the DirectSound writer thread.
+// It is a |webmdshow::SpscByteRing|, so neither side takes a lock, and reads
+// and writes are a memcpy or two. Both sides move whole samples only.
 class AudioBuffer
 {
 public:
     AudioBuffer();
     virtual ~AudioBuffer();
-    virtual HRESULT Available(UINT32* ptr_num_samples, 
-                              UINT32* ptr_num_bytes) = 0;
+    // Discards the samples, and sizes the buffer for at least
+    // |capacity_in_bytes|. Neither thread may be using the buffer.
+    void Reset(UINT32 capacity_in_bytes);
+    HRESULT Available(UINT32* ptr_num_samples, UINT32* ptr_num_bytes);
     UINT32 GetSampleSize()
     {
         return sample_size_;
     };
-    virtual HRESULT Read(UINT32 max_bytes, UINT32* ptr_bytes_written,
-                         void* ptr_out_data) = 0;
-    virtual HRESULT Write(const void* const ptr_data,
-                          UINT32 length_in_bytes,
-                          UINT32* ptr_samples_written) = 0;
+    // Consumer side: copies up to |max_bytes| of samples to |ptr_out_data|.
+    // Returns S_FALSE when the buffer is empty.
+    HRESULT Read(UINT32 max_bytes, UINT32* ptr_bytes_written,
+                 void* ptr_out_data);
+    // Producer side: copies as many samples from |ptr_data| as fit. Returns
+    // S_FALSE when the buffer filled up before all of them were stored.
+    HRESULT Write(const void* const ptr_data,
+                  UINT32 length_in_bytes,
+                  UINT32* ptr_samples_written);
     UINT64 BytesToSamples(UINT64 num_bytes)
     {
-        return num_bytes + (sample_size_ - 1) / sample_size_;
+        return (num_bytes + sample_size_ - 1) / sample_size_;
     };
     UINT64 SamplesToBytes(UINT64 num_samples)
     {
@@ -73,76 +62,25 @@ public:
     };
     UINT32 sample_size_;
 private:
+    webmdshow::SpscByteRing ring_;
     DISALLOW_COPY_AND_ASSIGN(AudioBuffer);
 };
 
-class F32AudioBuffer : public AudioBuffer
+// The buffer is byte-oriented; the sample type only fixes the sample size.
+template <class SampleType>
+class AudioBufferTemplate : public AudioBuffer
 {
 public:
-    F32AudioBuffer();
-    virtual ~F32AudioBuffer();
-    virtual HRESULT Available(UINT32* ptr_num_samples, 
-                              UINT32* ptr_num_bytes)
+    AudioBufferTemplate()
     {
-        if (!ptr_num_samples || !ptr_num_bytes)
-        {
-            return E_INVALIDARG;
-        }
-        *ptr_num_samples = (UINT32)audio_buf_.size();
-        if (*ptr_num_samples)
-        {
-            *ptr_num_bytes = (UINT32)SamplesToBytes(*ptr_num_samples);
-        }
-        else
-        {
-            *ptr_num_bytes = 0;
-        }
-        return S_OK;
+        AudioBuffer::sample_size_ = sizeof(SampleType);
     };
-    virtual HRESULT Read(UINT32 max_bytes, UINT32* ptr_bytes_written,
-                         void* ptr_out_data);
-    virtual HRESULT Write(const void* const ptr_data,
-                          UINT32 length_in_bytes,
-                          UINT32* ptr_samples_written);
 private:
-    typedef std::vector<float> SampleBuffer;
-    SampleBuffer audio_buf_;
-    DISALLOW_COPY_AND_ASSIGN(F32AudioBuffer);
+    DISALLOW_COPY_AND_ASSIGN(AudioBufferTemplate);
 };
 
-class S16AudioBuffer : public AudioBuffer
-{
-public:
-    S16AudioBuffer();
-    virtual ~S16AudioBuffer();
-    virtual HRESULT Available(UINT32* ptr_num_samples, 
-                              UINT32* ptr_num_bytes)
-    {
-        if (!ptr_num_samples || !ptr_num_bytes)
-        {
-            return E_INVALIDARG;
-        }
-        *ptr_num_samples = (UINT32)audio_buf_.size();
-        if (*ptr_num_samples)
-        {
-            *ptr_num_bytes = (UINT32)SamplesToBytes(*ptr_num_samples);
-        }
-        else
-        {
-            *ptr_num_bytes = 0;
-        }
-        return S_OK;
-    };
-    virtual HRESULT Read(UINT32 max_bytes, UINT32* ptr_bytes_written,
-                         void* ptr_out_data);
-    virtual HRESULT Write(const void* const ptr_data,
-                          UINT32 length_in_bytes,
-                          UINT32* ptr_samples_written);
-private:
-    typedef std::vector<INT16> SampleBuffer;
-    SampleBuffer audio_buf_;
-    DISALLOW_COPY_AND_ASSIGN(S16AudioBuffer);
-};
+typedef AudioBufferTemplate<float> F32AudioBuffer;
+typedef AudioBufferTemplate<INT16> S16AudioBuffer;
 
 class AudioPlaybackDevice : public CLockable
 {
@@ -154,6 +92,8 @@ public:
     HRESULT Play();
     HRESULT Start();
     HRESULT Stop();
+    // Queues samples for playback. Returns S_FALSE when only part of them
+    // fit; the caller should offer the rest again later.
     HRESULT WriteAudioBuffer(const void* const ptr_samples,
                              UINT32 length_in_bytes);
     HRESULT GetMediaTimePlayed(INT64* ptr_100ns_ticks_played);
@@ -172,16 +112,23 @@ private:
     HRESULT CreateAudioBuffer_(WORD fmt_tag, WORD bits);
     HRESULT CreateDirectSoundBuffer_(
         const WAVEFORMATEXTENSIBLE* const ptr_wfx);
+    HRESULT SetNotificationPositions_();
     HRESULT WriteDSoundBuffer_();
-    void UpdateSamplesPlayed_();
+    void UpdateSamplesPlayed_(DWORD play_cursor);
     AudioPlaybackState state_;
     DWORD play_cursor_;
+    DWORD write_offset_;  // where |ptr_dsound_buf_| was last written up to
+    DWORD block_align_;
     HWND hwnd_;
     IDirectSound8* ptr_dsound_;
     IDirectSoundBuffer8* ptr_dsound_buf_;
     std::auto_ptr<AudioBuffer> ptr_audio_buf_;
-    // TODO(tomfinegan): add a thread util w/stop event-- we could get rid of
-    //                   |ptr_dsound_thread_event_|
+    // Signalled by |ptr_dsound_buf_| each time it has played another
+    // |kNotifyCount|th of itself, and by |Play|; wakes |DSoundWriterThread_|.
+    HANDLE notify_event_;
+    // Manual-reset; set by |Stop| to end |DSoundWriterThread_|.
+    HANDLE stop_event_;
+    // Set by |DSoundWriterThread_| as it exits.
     std::auto_ptr<WebmMfUtil::EventWaiter> ptr_dsound_thread_event_;
     std::auto_ptr<WebmMfUtil::SimpleThread> ptr_dsound_thread_;
     UINT32 dsound_buffer_size_;
@@ -190,6 +137,83 @@ private:
     DISALLOW_COPY_AND_ASSIGN(AudioPlaybackDevice);
 };
 
+enum WasapiShareMode
+{
+    WASAPI_SHARED = 0,
+    WASAPI_EXCLUSIVE = 1
+};
+
+// A WASAPI counterpart of |AudioPlaybackDevice|, with the same interface,
+// for low-latency monitoring.  The endpoint runs event-driven: it signals
+// |buffer_event_| once per device period, and |WasapiWriterThread_| then
+// moves what fits from |ptr_audio_buf_| into the endpoint buffer.  Shared
+// mode goes through the audio engine, so |Open| needs the engine's sample
+// rate.  Exclusive mode bypasses the engine, and uses the device's minimum
+// period.
+class WasapiPlaybackDevice
+{
+public:
+    explicit WasapiPlaybackDevice(WasapiShareMode share_mode);
+    ~WasapiPlaybackDevice();
+    // Opens the default render endpoint.  |hwnd| is unused; it's there so
+    // that callers treat both devices alike.  COM must be initialized on the
+    // calling thread.
+    HRESULT Open(HWND hwnd, const WAVEFORMATEXTENSIBLE* const ptr_wfx);
+    HRESULT Pause();
+    HRESULT Play();
+    HRESULT Start();
+    HRESULT Stop();
+    // Queues samples for playback. Returns S_FALSE when only part of them
+    // fit; the caller should offer the rest again later.
+    HRESULT WriteAudioBuffer(const void* const ptr_samples,
+                             UINT32 length_in_bytes);
+    // Gets how long a sample written now will take to be heard: the
+    // samples queued ahead of it in |ptr_audio_buf_| and in the endpoint
+    // buffer, plus the stream latency the endpoint reports.
+    HRESULT GetLatency(REFERENCE_TIME* ptr_latency);
+    UINT64 GetSamplesBuffered() const
+    {
+        return samples_buffered_;
+    };
+    UINT64 GetSamplesPlayed() const
+    {
+        return samples_played_;
+    };
+    // The number of device periods in which |ptr_audio_buf_| ran dry while
+    // playing, so that silence was played instead.
+    UINT64 GetGlitchCount() const
+    {
+        return glitch_count_;
+    };
+private:
+    static DWORD WasapiWriterThread_(void* ptr_this);
+    HRESULT InitializeAudioClient_(const WAVEFORMATEX* ptr_wfx);
+    HRESULT FillEndpointBuffer_(bool count_glitches);
+    const WasapiShareMode share_mode_;
+    AudioPlaybackState state_;
+    IMMDevice* ptr_device_;
+    IAudioClient* ptr_audio_client_;
+    IAudioRenderClient* ptr_render_client_;
+    std::auto_ptr<AudioBuffer> ptr_audio_buf_;
+    // Signalled by the endpoint once per device period.
+    HANDLE buffer_event_;
+    // Manual-reset; set by |Stop| to end |WasapiWriterThread_|.
+    HANDLE stop_event_;
+    // Set by |WasapiWriterThread_| as it exits.
+    std::auto_ptr<WebmMfUtil::EventWaiter> ptr_thread_event_;
+    std::auto_ptr<WebmMfUtil::SimpleThread> ptr_thread_;
+    UINT32 buffer_frames_;  // of the endpoint buffer
+    UINT32 block_align_;
+    UINT32 channels_;
+    UINT32 samples_per_sec_;
+    REFERENCE_TIME stream_latency_;
+    UINT64 samples_buffered_;
+    UINT64 samples_played_;
+    UINT64 samples_to_endpoint_;  // samples (not silence) written to it
+    UINT64 glitch_count_;
+    DISALLOW_COPY_AND_ASSIGN(WasapiPlaybackDevice);
+};
+
 } // WebmDirectX
 
 #endif // __WEBMDSHOW_COMMON_WEBDSOUND_HPP__
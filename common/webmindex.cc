@@ -0,0 +1,283 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include "webmindex.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = {'W', 'I', 'D', 'X'};
+
+// The sidecar starts with this header, followed by |count| entries. Both
+// are stored in native (little-endian) byte order.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  int64_t file_size;
+  int64_t file_time;
+  int64_t track_number;
+  int64_t count;
+};
+
+}  // namespace
+
+namespace webmdshow {
+
+WebmIndex::WebmIndex()
+    : file_(INVALID_HANDLE_VALUE),
+      map_(NULL),
+      view_(NULL),
+      track_number_(0),
+      count_(0),
+      entries_(NULL) {
+}
+
+WebmIndex::~WebmIndex() {
+  Close();
+}
+
+HRESULT WebmIndex::Open(const wchar_t* media_file) {
+  Close();
+
+  int64_t file_size, file_time;
+  HRESULT hr = GetFileStamp(media_file, &file_size, &file_time);
+
+  if (FAILED(hr))
+    return hr;
+
+  const std::wstring name = GetFileName(media_file);
+
+  file_ = CreateFileW(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file_ == INVALID_HANDLE_VALUE) {
+    const DWORD e = GetLastError();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  LARGE_INTEGER size;
+
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart < LONGLONG(sizeof(Header)) ||
+      size.HighPart != 0) {
+    Close();
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  map_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+
+  if (map_ != NULL)
+    view_ = MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0);
+
+  if (view_ == NULL) {
+    const DWORD e = GetLastError();
+    Close();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  if (!Attach(view_, size.LowPart, file_size, file_time)) {
+    Close();
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  return S_OK;
+}
+
+void WebmIndex::Close() {
+  entries_ = NULL;
+  count_ = 0;
+  track_number_ = 0;
+
+  if (view_ != NULL) {
+    UnmapViewOfFile(view_);
+    view_ = NULL;
+  }
+
+  if (map_ != NULL) {
+    CloseHandle(map_);
+    map_ = NULL;
+  }
+
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+}
+
+bool WebmIndex::Attach(const void* data, size_t size, int64_t file_size,
+                       int64_t file_time) {
+  entries_ = NULL;
+  count_ = 0;
+  track_number_ = 0;
+
+  if (data == NULL || size < sizeof(Header))
+    return false;
+
+  Header h;
+  memcpy(&h, data, sizeof h);
+
+  if (memcmp(h.magic, kMagic, sizeof kMagic) != 0 ||
+      h.version != kVersion ||
+      h.file_size != file_size ||
+      h.file_time != file_time ||
+      h.track_number <= 0 ||
+      h.count < 0) {
+    return false;
+  }
+
+  const size_t cb = size - sizeof(Header);
+
+  if ((cb % sizeof(WebmIndexEntry)) != 0 ||
+      int64_t(cb / sizeof(WebmIndexEntry)) != h.count) {
+    return false;
+  }
+
+  // The header is a multiple of 8 bytes, so the entries of a mapped view
+  // (or of any heap block) are suitably aligned.
+  const uint8_t* const p = static_cast<const uint8_t*>(data);
+
+  track_number_ = h.track_number;
+  count_ = h.count;
+  entries_ = reinterpret_cast<const WebmIndexEntry*>(p + sizeof(Header));
+
+  return true;
+}
+
+const WebmIndexEntry* WebmIndex::Find(int64_t time_ns) const {
+  if (count_ <= 0)
+    return NULL;
+
+  // Find the first entry after |time_ns|; the one before it is the result.
+  int64_t lo = 0;
+  int64_t hi = count_;
+
+  while (lo < hi) {
+    const int64_t mid = lo + (hi - lo) / 2;
+
+    if (entries_[mid].time_ns <= time_ns)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (lo > 0) ? &entries_[lo - 1] : &entries_[0];
+}
+
+void WebmIndex::Build(int64_t track_number, int64_t file_size,
+                      int64_t file_time,
+                      const std::vector<WebmIndexEntry>& entries,
+                      std::vector<uint8_t>* image) {
+  assert(image);
+
+  Header h;
+  memcpy(h.magic, kMagic, sizeof kMagic);
+  h.version = kVersion;
+  h.file_size = file_size;
+  h.file_time = file_time;
+  h.track_number = track_number;
+  h.count = entries.size();
+
+  const size_t cb = entries.size() * sizeof(WebmIndexEntry);
+
+  image->resize(sizeof h + cb);
+  memcpy(&(*image)[0], &h, sizeof h);
+
+  if (cb > 0)
+    memcpy(&(*image)[sizeof h], &entries[0], cb);
+}
+
+HRESULT WebmIndex::Write(const wchar_t* media_file, int64_t track_number,
+                         const std::vector<WebmIndexEntry>& entries) {
+  int64_t file_size, file_time;
+  HRESULT hr = GetFileStamp(media_file, &file_size, &file_time);
+
+  if (FAILED(hr))
+    return hr;
+
+  std::vector<uint8_t> image;
+  Build(track_number, file_size, file_time, entries, &image);
+
+  if (image.size() > MAXDWORD)
+    return E_INVALIDARG;
+
+  // Write a temporary file and move it into place, so that a reader never
+  // sees a partial sidecar.
+  const std::wstring name = GetFileName(media_file);
+  const std::wstring temp_name = name + L".tmp";
+
+  const HANDLE file = CreateFileW(temp_name.c_str(), GENERIC_WRITE, 0, NULL,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    const DWORD e = GetLastError();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  const DWORD cb = static_cast<DWORD>(image.size());
+  DWORD cb_written;
+
+  const BOOL written = WriteFile(file, &image[0], cb, &cb_written, NULL);
+  hr = written ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+
+  CloseHandle(file);
+
+  if (SUCCEEDED(hr) && cb_written != cb)
+    hr = E_FAIL;
+
+  if (FAILED(hr)) {
+    DeleteFileW(temp_name.c_str());
+    return hr;
+  }
+
+  if (!MoveFileExW(temp_name.c_str(), name.c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    const DWORD e = GetLastError();
+    DeleteFileW(temp_name.c_str());
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  return S_OK;
+}
+
+std::wstring WebmIndex::GetFileName(const wchar_t* media_file) {
+  std::wstring name(media_file ? media_file : L"");
+  name += L".webmidx";
+
+  return name;
+}
+
+HRESULT WebmIndex::GetFileStamp(const wchar_t* media_file,
+                                int64_t* file_size, int64_t* file_time) {
+  if (media_file == NULL || file_size == NULL || file_time == NULL)
+    return E_POINTER;
+
+  WIN32_FILE_ATTRIBUTE_DATA data;
+
+  if (!GetFileAttributesExW(media_file, GetFileExInfoStandard, &data)) {
+    const DWORD e = GetLastError();
+    return HRESULT_FROM_WIN32(e);
+  }
+
+  ULARGE_INTEGER size;
+  size.LowPart = data.nFileSizeLow;
+  size.HighPart = data.nFileSizeHigh;
+
+  ULARGE_INTEGER time;
+  time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+  time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+  *file_size = size.QuadPart;
+  *file_time = time.QuadPart;
+
+  return S_OK;
+}
+
+}  // namespace webmdshow
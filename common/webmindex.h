@@ -0,0 +1,92 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_WEBMINDEX_H_
+#define WEBMDSHOW_COMMON_WEBMINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace webmdshow {
+
+// One cluster that holds a keyframe of the indexed track.
+struct WebmIndexEntry {
+  int64_t pos;      // cluster position, relative to the segment
+  int64_t time_ns;  // time of the first keyframe in the cluster
+};
+
+// A sidecar seek index, stored next to the media file as
+// "<media file>.webmidx". It lists, in time order, the position of each
+// cluster holding a keyframe of one track, along with the time of that
+// keyframe. The sidecar is memory-mapped and searched in place, so opening
+// it costs nothing per entry. It is only used when the size and last write
+// time recorded in it match the media file.
+class WebmIndex {
+ public:
+  enum { kVersion = 1 };
+
+  WebmIndex();
+  ~WebmIndex();
+
+  // Maps the sidecar of |media_file|. Fails, leaving the index closed, if
+  // there is no sidecar or it does not match |media_file|.
+  HRESULT Open(const wchar_t* media_file);
+  void Close();
+
+  // Uses the sidecar image at |data| (which must stay valid until Close),
+  // after checking it against the media file's |file_size| and |file_time|.
+  // Returns false, leaving the index closed, if it does not match.
+  bool Attach(const void* data, size_t size, int64_t file_size,
+              int64_t file_time);
+
+  bool IsOpen() const { return entries_ != NULL; }
+
+  int64_t track_number() const { return track_number_; }
+  int64_t count() const { return count_; }
+  const WebmIndexEntry& entry(int64_t i) const { return entries_[i]; }
+
+  // Returns the last entry whose keyframe is at or before |time_ns|, or the
+  // first entry if |time_ns| precedes them all. Returns NULL if the index
+  // is empty.
+  const WebmIndexEntry* Find(int64_t time_ns) const;
+
+  // Serializes an index of |track_number| into |image|.
+  static void Build(int64_t track_number, int64_t file_size,
+                    int64_t file_time,
+                    const std::vector<WebmIndexEntry>& entries,
+                    std::vector<uint8_t>* image);
+
+  // Writes the sidecar of |media_file|, replacing any existing one.
+  static HRESULT Write(const wchar_t* media_file, int64_t track_number,
+                       const std::vector<WebmIndexEntry>& entries);
+
+  static std::wstring GetFileName(const wchar_t* media_file);
+
+  // Gets the size and last write time the sidecar is validated against.
+  static HRESULT GetFileStamp(const wchar_t* media_file, int64_t* file_size,
+                              int64_t* file_time);
+
+ private:
+  HANDLE file_;
+  HANDLE map_;
+  const void* view_;
+
+  int64_t track_number_;
+  int64_t count_;
+  const WebmIndexEntry* entries_;
+
+  WebmIndex(const WebmIndex&);
+  WebmIndex& operator=(const WebmIndex&);
+};
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_WEBMINDEX_H_
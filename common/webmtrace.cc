@@ -0,0 +1,145 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "webmtrace.h"
+
+#include <windows.h>
+#include <evntprov.h>
+#include <strmif.h>
+
+#include <cassert>
+#include <cwchar>
+#include <mutex>
+
+#include "pipelinecounters.h"
+
+namespace webmdshow {
+
+namespace internal {
+std::atomic<int> g_trace_level(0);
+std::atomic<uint64_t> g_trace_keywords(0);
+}  // namespace internal
+
+namespace {
+
+// {ED31111B-5211-11DF-94AF-0026B977EEAA}
+const GUID kProviderId = {
+  0xED31111B, 0x5211, 0x11DF,
+  {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+std::mutex g_mutex;
+int g_refs;
+REGHANDLE g_handle;
+
+const wchar_t* const kFrameEventNames[] = {
+  L"read",
+  L"populate",
+  L"decode_begin",
+  L"decode_end",
+  L"copy",
+  L"mux_receive",
+  L"write",
+};
+
+void NTAPI OnEnable(const GUID*, ULONG control_code, UCHAR level,
+                    ULONGLONG match_any_keyword, ULONGLONG, void*, void*) {
+  using internal::g_trace_level;
+  using internal::g_trace_keywords;
+
+  switch (control_code) {
+    case EVENT_CONTROL_CODE_ENABLE_PROVIDER:
+      // Zero means everything, for both.
+      g_trace_level = (level == 0) ? 0xFF : level;
+      g_trace_keywords = (match_any_keyword == 0) ? ~0ULL : match_any_keyword;
+      PipelineCounters::TraceAll();
+      break;
+
+    case EVENT_CONTROL_CODE_DISABLE_PROVIDER:
+      g_trace_level = 0;
+      g_trace_keywords = 0;
+      break;
+
+    case EVENT_CONTROL_CODE_CAPTURE_STATE:
+      PipelineCounters::TraceAll();
+      break;
+  }
+}
+
+}  // namespace
+
+void RegisterTraceProvider() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  if (g_refs++ > 0)
+    return;
+
+  // Registration fails only if the process is out of resources; tracing
+  // is then off, and the filters run as before.
+  if (EventRegister(&kProviderId, OnEnable, NULL, &g_handle) != ERROR_SUCCESS)
+    g_handle = 0;
+}
+
+void UnregisterTraceProvider() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  assert(g_refs > 0);
+
+  if (--g_refs > 0)
+    return;
+
+  // Waits for a callback in progress, which takes no lock of ours.
+  if (g_handle)
+    EventUnregister(g_handle);
+
+  g_handle = 0;
+  internal::g_trace_level = 0;
+  internal::g_trace_keywords = 0;
+}
+
+void TraceString(int level, uint64_t keywords, const wchar_t* text) {
+  assert(text);
+
+  if (!IsTraceEnabled(level, keywords) || g_handle == 0)
+    return;
+
+  EventWriteString(g_handle, static_cast<UCHAR>(level), keywords, text);
+}
+
+void WriteFrameEvent(TraceFrameEvent event, int track, int64_t time,
+                     int64_t size) {
+  assert(size_t(event) <
+         sizeof kFrameEventNames / sizeof kFrameEventNames[0]);
+
+  const uint64_t keyword =
+      (event == kTraceFrameRead || event == kTraceFrameWrite)
+          ? kTraceKeywordIo
+          : kTraceKeywordFrames;
+
+  wchar_t text[128];
+
+  const int n = swprintf(text, sizeof text / sizeof text[0],
+                         L"frame=%ls track=%d time=%lld size=%lld",
+                         kFrameEventNames[event], track, time, size);
+
+  if (n > 0)
+    TraceString(kTraceLevelVerbose, keyword, text);
+}
+
+void WriteSampleEvent(TraceFrameEvent event, int track, IMediaSample* sample) {
+  assert(sample);
+
+  REFERENCE_TIME start, stop;
+
+  if (FAILED(sample->GetTime(&start, &stop)))
+    start = -1;
+
+  WriteFrameEvent(event, track, start, sample->GetActualDataLength());
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,104 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_WEBMTRACE_H_
+#define WEBMDSHOW_COMMON_WEBMTRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+struct IMediaSample;
+
+namespace webmdshow {
+
+// The WebM-DirectShow ETW provider, {ED31111B-5211-11DF-94AF-0026B977EEAA}.
+// Its events carry no manifest: they are written as strings, which any
+// consumer can show, e.g.
+//   xperf -start webm -on ED31111B-5211-11DF-94AF-0026B977EEAA
+// Enabling the provider, or asking it to capture state, writes a reading
+// of every stage's PipelineCounters. At the verbose level the provider also
+// writes an event per frame at each stage, so that a frame can be followed
+// through the graph by its timestamp.
+
+enum TraceKeyword {
+  kTraceKeywordCounters = 0x1,
+  kTraceKeywordFrames = 0x2,  // per-frame events of the filters
+  kTraceKeywordIo = 0x4,      // per-read and per-write events
+};
+
+// The ETW levels used, as in evntrace.h.
+enum TraceLevel {
+  kTraceLevelInformation = 4,
+  kTraceLevelVerbose = 5,
+};
+
+namespace internal {
+extern std::atomic<int> g_trace_level;
+extern std::atomic<uint64_t> g_trace_keywords;
+}  // namespace internal
+
+// Registers the provider, which stays registered until the matching call
+// to UnregisterTraceProvider. Calls nest. The provider must be unregistered
+// before the module is unloaded.
+void RegisterTraceProvider();
+void UnregisterTraceProvider();
+
+// Returns whether a session is listening to events of |level| with any of
+// |keywords|. Costs two relaxed loads, so that call sites can test it per
+// sample.
+inline bool IsTraceEnabled(int level, uint64_t keywords) {
+  return level <= internal::g_trace_level.load(std::memory_order_relaxed) &&
+         (keywords &
+          internal::g_trace_keywords.load(std::memory_order_relaxed)) != 0;
+}
+
+// Writes |text| as an event, if a session is listening.
+void TraceString(int level, uint64_t keywords, const wchar_t* text);
+
+enum TraceFrameEvent {
+  kTraceFrameRead,         // the splitter's reader read from the file
+  kTraceFramePopulate,     // the splitter populated a sample from a block
+  kTraceFrameDecodeBegin,  // the decoder passed a frame to libvpx
+  kTraceFrameDecodeEnd,    // ...and libvpx returned
+  kTraceFrameCopy,         // the decoder wrote the frame to its output
+  kTraceFrameMuxReceive,   // the muxer received a frame
+  kTraceFrameWrite,        // the muxer's IStream::Write returned
+};
+
+void WriteFrameEvent(TraceFrameEvent event, int track, int64_t time,
+                     int64_t size);
+void WriteSampleEvent(TraceFrameEvent event, int track, IMediaSample* sample);
+
+// Writes a frame event at the verbose level. |time| is the frame's start
+// time, in 100 ns units, and |size| its length in bytes; the read and write
+// events give the file position and the length read or written instead.
+// |track| is the track number, or 0 where the stage does not know it (the
+// decoder), in which case the timestamp alone identifies the frame.
+inline void TraceFrame(TraceFrameEvent event, int track, int64_t time,
+                       int64_t size) {
+  const uint64_t keyword =
+      (event == kTraceFrameRead || event == kTraceFrameWrite)
+          ? kTraceKeywordIo
+          : kTraceKeywordFrames;
+
+  if (IsTraceEnabled(kTraceLevelVerbose, keyword))
+    WriteFrameEvent(event, track, time, size);
+}
+
+// The same, taking the time and size from |sample|. Its time is -1 if it
+// has none.
+inline void TraceSample(TraceFrameEvent event, int track,
+                        IMediaSample* sample) {
+  if (IsTraceEnabled(kTraceLevelVerbose, kTraceKeywordFrames))
+    WriteSampleEvent(event, track, sample);
+}
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_WEBMTRACE_H_
@@ -27,6 +27,24 @@ const GUID WebmTypes::MEDIASUBTYPE_VP8_STATS =
 };
 
 
+const GUID WebmTypes::MEDIASUBTYPE_WEBM_TEXT =
+{ /* ED311137-5211-11DF-94AF-0026B977EEAA */
+    0xED311137,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::FORMAT_WEBM_TEXT =
+{ /* ED311138-5211-11DF-94AF-0026B977EEAA */
+    0xED311138,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
 // 30385056-0000-0010-8000-00AA00389B71 'VP80'
 const GUID WebmTypes::MEDIASUBTYPE_VP80 =
 {
@@ -54,6 +72,33 @@ const GUID WebmTypes::MEDIASUBTYPE_I420 =
     { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 }
 };
 
+// 30313050-0000-0010-8000-00AA00389B71 'P010'
+const GUID WebmTypes::MEDIASUBTYPE_P010 =
+{
+    0x30313050,
+    0x0000,
+    0x0010,
+    { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 }
+};
+
+// 36313050-0000-0010-8000-00AA00389B71 'P016'
+const GUID WebmTypes::MEDIASUBTYPE_P016 =
+{
+    0x36313050,
+    0x0000,
+    0x0010,
+    { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 }
+};
+
+// 30303859-0000-0010-8000-00AA00389B71 'Y800'
+const GUID WebmTypes::MEDIASUBTYPE_Y800 =
+{
+    0x30303859,
+    0x0000,
+    0x0010,
+    { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 }
+};
+
 //now defined in type library
 //const CLSID WebmTypes::CLSID_WebmMux =
 //{ /* ED3110F0-5211-11DF-94AF-0026B977EEAA */
@@ -109,6 +154,15 @@ const CLSID WebmTypes::CLSID_WebmMfVp8Dec =
 };
 
 
+const CLSID WebmTypes::CLSID_WebmMfVp9Dec =
+{  /* ED311122-5211-11DF-94AF-0026B977EEAA */
+    0xED311122,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
 const GUID WebmTypes::WebMSample_Preroll =
 {  /* ED311121-5211-11DF-94AF-0026B977EEAA */
     0xED311121,
@@ -118,6 +172,222 @@ const GUID WebmTypes::WebMSample_Preroll =
 };
 
 
+const GUID WebmTypes::WebmMfVp8Dec_ThreadCount =
+{  /* ED31111E-5211-11DF-94AF-0026B977EEAA */
+    0xED31111E,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfVp8Dec_FramesDecoded =
+{  /* ED31111F-5211-11DF-94AF-0026B977EEAA */
+    0xED31111F,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfVp8Dec_FramesSkipped =
+{  /* ED31110D-5211-11DF-94AF-0026B977EEAA */
+    0xED31110D,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_PrefetchDuration =
+{  /* ED31110E-5211-11DF-94AF-0026B977EEAA */
+    0xED31110E,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_PrefetchBytes =
+{  /* ED31110F-5211-11DF-94AF-0026B977EEAA */
+    0xED31110F,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CacheStats =
+{  /* ED311112-5211-11DF-94AF-0026B977EEAA */
+    0xED311112,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CacheHits =
+{  /* ED311113-5211-11DF-94AF-0026B977EEAA */
+    0xED311113,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CacheMisses =
+{  /* ED311114-5211-11DF-94AF-0026B977EEAA */
+    0xED311114,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CacheResidentBytes =
+{  /* ED311115-5211-11DF-94AF-0026B977EEAA */
+    0xED311115,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_FastOpen =
+{  /* ED311116-5211-11DF-94AF-0026B977EEAA */
+    0xED311116,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_OpenStats =
+{  /* ED311117-5211-11DF-94AF-0026B977EEAA */
+    0xED311117,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LoadDuration =
+{  /* ED311118-5211-11DF-94AF-0026B977EEAA */
+    0xED311118,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_TimeToFirstFrame =
+{  /* ED311119-5211-11DF-94AF-0026B977EEAA */
+    0xED311119,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_SharedCacheBytes =
+{  /* ED31113A-5211-11DF-94AF-0026B977EEAA */
+    0xED31113A,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LowLatency =
+{  /* ED31112B-5211-11DF-94AF-0026B977EEAA */
+    0xED31112B,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LatencyStats =
+{  /* ED31112C-5211-11DF-94AF-0026B977EEAA */
+    0xED31112C,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LatencyLast =
+{  /* ED31112D-5211-11DF-94AF-0026B977EEAA */
+    0xED31112D,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LatencyMean =
+{  /* ED31112E-5211-11DF-94AF-0026B977EEAA */
+    0xED31112E,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_LatencyMax =
+{  /* ED31112F-5211-11DF-94AF-0026B977EEAA */
+    0xED31112F,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_OpenDeadline =
+{  /* ED311131-5211-11DF-94AF-0026B977EEAA */
+    0xED311131,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CheckCrc =
+{  /* ED311133-5211-11DF-94AF-0026B977EEAA */
+    0xED311133,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CrcStats =
+{  /* ED311134-5211-11DF-94AF-0026B977EEAA */
+    0xED311134,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CrcChecked =
+{  /* ED311135-5211-11DF-94AF-0026B977EEAA */
+    0xED311135,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const GUID WebmTypes::WebmMfSource_CrcFailed =
+{  /* ED311136-5211-11DF-94AF-0026B977EEAA */
+    0xED311136,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
 const CLSID WebmTypes::CLSID_WebmMfVorbisDec =
 { /* ED311130-5211-11DF-94AF-0026B977EEAA */
     0xED311130,
@@ -127,6 +397,15 @@ const CLSID WebmTypes::CLSID_WebmMfVorbisDec =
 };
 
 
+const GUID WebmTypes::WebmMfVorbisDec_OutputDuration =
+{  /* ED311132-5211-11DF-94AF-0026B977EEAA */
+    0xED311132,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
 const CLSID WebmTypes::CLSID_WebmVorbisDecoder =
 {  /* ED311103-5211-11DF-94AF-0026B977EEAA */
     0xED311103,
@@ -170,3 +449,21 @@ const CLSID WebmTypes::CLSID_WebmColorConversion =
     0x11DF,
     {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
 };
+
+
+const CLSID WebmTypes::CLSID_WebmShmSink =
+{ /* ED311129-5211-11DF-94AF-0026B977EEAA */
+    0xED311129,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
+
+
+const CLSID WebmTypes::CLSID_WebmShmSource =
+{ /* ED31112A-5211-11DF-94AF-0026B977EEAA */
+    0xED31112A,
+    0x5211,
+    0x11DF,
+    {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+};
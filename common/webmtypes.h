@@ -14,8 +14,17 @@ namespace WebmTypes
     extern const GUID MEDIASUBTYPE_VP80;
     extern const GUID MEDIASUBTYPE_VP90;
     extern const GUID MEDIASUBTYPE_I420;
+    extern const GUID MEDIASUBTYPE_P010;  //4:2:0, 16-bit, 10 bits used
+    extern const GUID MEDIASUBTYPE_P016;
+    extern const GUID MEDIASUBTYPE_Y800;  //luma only, 8-bit; also the MF type
     extern const GUID MEDIASUBTYPE_VP8_STATS;
 
+    //A subtitle or metadata track of a WebM file (MEDIATYPE_Text).  The
+    //format block is the track's codec ID ("D_WEBVTT/SUBTITLES", say),
+    //in UTF-8 and terminated, followed by its codec private data, if any.
+    extern const GUID MEDIASUBTYPE_WEBM_TEXT;
+    extern const GUID FORMAT_WEBM_TEXT;
+
     //extern const CLSID CLSID_WebmMux;
     extern const CLSID CLSID_WebmSource;  //DirectShow
     extern const CLSID CLSID_WebmSplit;
@@ -23,14 +32,42 @@ namespace WebmTypes
     extern const CLSID CLSID_WebmVorbisEncoder;
     extern const CLSID CLSID_WebmOggSource;
     extern const CLSID CLSID_WebmColorConversion;
+    extern const CLSID CLSID_WebmShmSink;
+    extern const CLSID CLSID_WebmShmSource;
 
 
     extern const GUID APPID_WebmMf;         //Media Foundation Application ID
     extern const CLSID CLSID_WebmMfSource;  //Media Foundation
     extern const CLSID CLSID_WebmMfByteStreamHandler;
+    extern const GUID WebmMfSource_PrefetchDuration;  //fmtid, VT_UI8 reftime
+    extern const GUID WebmMfSource_PrefetchBytes;     //fmtid, VT_UI8
+    extern const GUID WebmMfSource_CacheStats;  //service, IMFAttributes
+    extern const GUID WebmMfSource_CacheHits;           //UINT64, pages
+    extern const GUID WebmMfSource_CacheMisses;         //UINT64, pages
+    extern const GUID WebmMfSource_CacheResidentBytes;  //UINT64
+    extern const GUID WebmMfSource_FastOpen;  //fmtid, VT_UI4 (nonzero=on)
+    extern const GUID WebmMfSource_OpenStats;  //service, IMFAttributes
+    extern const GUID WebmMfSource_LoadDuration;     //UINT64 reftime
+    extern const GUID WebmMfSource_TimeToFirstFrame; //UINT64 reftime
+    extern const GUID WebmMfSource_SharedCacheBytes;  //fmtid, VT_UI8
+    extern const GUID WebmMfSource_LowLatency;  //fmtid, VT_UI4 (nonzero=on)
+    extern const GUID WebmMfSource_LatencyStats;  //service, IMFAttributes
+    extern const GUID WebmMfSource_LatencyLast;  //UINT64 reftime
+    extern const GUID WebmMfSource_LatencyMean;  //UINT64 reftime
+    extern const GUID WebmMfSource_LatencyMax;   //UINT64 reftime
+    extern const GUID WebmMfSource_OpenDeadline;  //fmtid, VT_UI8 reftime
+    extern const GUID WebmMfSource_CheckCrc;  //fmtid, VT_UI4 (nonzero=on)
+    extern const GUID WebmMfSource_CrcStats;  //service, IMFAttributes
+    extern const GUID WebmMfSource_CrcChecked;  //UINT64, clusters
+    extern const GUID WebmMfSource_CrcFailed;   //UINT64, clusters
 
     extern const CLSID CLSID_WebmMfVp8Dec;  //Media Foundation
+    extern const CLSID CLSID_WebmMfVp9Dec;  //Media Foundation
     extern const GUID WebMSample_Preroll;
+    extern const GUID WebmMfVp8Dec_ThreadCount;  //UINT32 MFT attribute
+    extern const GUID WebmMfVp8Dec_FramesDecoded;  //UINT64, read-only
+    extern const GUID WebmMfVp8Dec_FramesSkipped;  //UINT64, read-only
 
     extern const CLSID CLSID_WebmMfVorbisDec; //Media Foundation
+    extern const GUID WebmMfVorbisDec_OutputDuration;  //UINT64 reftime
 }
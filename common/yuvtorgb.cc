@@ -0,0 +1,246 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "yuvtorgb.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || \
+    defined(__SSE2__)
+#define WEBMDSHOW_YUVTORGB_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace webmdshow {
+
+namespace {
+
+const int kShift = 13;
+const int kRound = 1 << (kShift - 1);
+
+// Indexed by YuvMatrix, then YuvRange. Limited range scales Y by 255/219
+// and U and V by 255/224; Kr and Kb are 0.299 and 0.114 for BT.601, and
+// 0.2126 and 0.0722 for BT.709.
+const YuvToRgbConstants kConstants[2][2] = {
+  { { 16, 9539, 13075, -3209, -6660, 16525 },
+    { 0, 8192, 11485, -2819, -5850, 14516 } },
+  { { 16, 9539, 14686, -1747, -4366, 17305 },
+    { 0, 8192, 12901, -1535, -3835, 15201 } },
+};
+
+uint8_t Clamp(int x) {
+  return static_cast<uint8_t>((x < 0) ? 0 : (x > 255) ? 255 : x);
+}
+
+// Converts pixels [begin, width) of one row; |begin| is even.
+void ConvertRowC(const uint8_t* src_y, const uint8_t* src_u,
+                 const uint8_t* src_v, const YuvToRgbConstants& k,
+                 int bytes_per_pixel, int begin, int width, uint8_t* dst) {
+  assert(begin % 2 == 0);
+  dst += begin * bytes_per_pixel;
+
+  for (int x = begin; x < width; ++x) {
+    const int y = k.y * (src_y[x] - k.y_offset) + kRound;
+    const int u = src_u[x / 2] - 128;
+    const int v = src_v[x / 2] - 128;
+
+    dst[0] = Clamp((y + k.ub * u) >> kShift);
+    dst[1] = Clamp((y + k.ug * u + k.vg * v) >> kShift);
+    dst[2] = Clamp((y + k.vr * v) >> kShift);
+
+    if (bytes_per_pixel == 4)
+      dst[3] = 255;
+
+    dst += bytes_per_pixel;
+  }
+}
+
+#ifdef WEBMDSHOW_YUVTORGB_SSE2
+
+// The constants as pmaddwd operands: Y pairs with a constant 1 to add the
+// rounding term, and the chroma terms apply to interleaved U and V.
+struct Sse2Constants {
+  __m128i y_offset;
+  __m128i y_round;
+  __m128i r;
+  __m128i g;
+  __m128i b;
+};
+
+void GetSse2Constants(const YuvToRgbConstants& k, Sse2Constants* sse2) {
+  sse2->y_offset = _mm_set1_epi16(k.y_offset);
+  sse2->y_round = _mm_setr_epi16(k.y, kRound, k.y, kRound,
+                                 k.y, kRound, k.y, kRound);
+  sse2->r = _mm_setr_epi16(0, k.vr, 0, k.vr, 0, k.vr, 0, k.vr);
+  sse2->g = _mm_setr_epi16(k.ug, k.vg, k.ug, k.vg, k.ug, k.vg, k.ug, k.vg);
+  sse2->b = _mm_setr_epi16(k.ub, 0, k.ub, 0, k.ub, 0, k.ub, 0);
+}
+
+// Returns one channel of 8 pixels as words, from the Y terms |y_lo| and
+// |y_hi| and the interleaved chroma |uv_lo| and |uv_hi|.
+__m128i Channel8(__m128i y_lo, __m128i y_hi, __m128i uv_lo, __m128i uv_hi,
+                 __m128i coefs) {
+  const __m128i lo = _mm_add_epi32(y_lo, _mm_madd_epi16(uv_lo, coefs));
+  const __m128i hi = _mm_add_epi32(y_hi, _mm_madd_epi16(uv_hi, coefs));
+  return _mm_packs_epi32(_mm_srai_epi32(lo, kShift),
+                         _mm_srai_epi32(hi, kShift));
+}
+
+__m128i LoadChroma4(const uint8_t* src) {
+  int32_t four;
+  memcpy(&four, src, sizeof four);
+
+  const __m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128(four),
+                                      _mm_setzero_si128());
+
+  // Each sample covers two pixels.
+  return _mm_sub_epi16(_mm_unpacklo_epi16(c, c), _mm_set1_epi16(128));
+}
+
+// Converts 8 pixels to BGRX: pixels 0-3 to |lo| and 4-7 to |hi|.
+void Convert8(const uint8_t* src_y, const uint8_t* src_u,
+              const uint8_t* src_v, const Sse2Constants& k,
+              __m128i* lo, __m128i* hi) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+
+  const __m128i y = _mm_sub_epi16(
+      _mm_unpacklo_epi8(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src_y)), zero),
+      k.y_offset);
+  const __m128i y_lo = _mm_madd_epi16(_mm_unpacklo_epi16(y, one), k.y_round);
+  const __m128i y_hi = _mm_madd_epi16(_mm_unpackhi_epi16(y, one), k.y_round);
+
+  const __m128i u = LoadChroma4(src_u);
+  const __m128i v = LoadChroma4(src_v);
+  const __m128i uv_lo = _mm_unpacklo_epi16(u, v);
+  const __m128i uv_hi = _mm_unpackhi_epi16(u, v);
+
+  const __m128i b = Channel8(y_lo, y_hi, uv_lo, uv_hi, k.b);
+  const __m128i g = Channel8(y_lo, y_hi, uv_lo, uv_hi, k.g);
+  const __m128i r = Channel8(y_lo, y_hi, uv_lo, uv_hi, k.r);
+
+  const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b),
+                                       _mm_packus_epi16(g, g));
+  const __m128i rx = _mm_unpacklo_epi8(_mm_packus_epi16(r, r),
+                                       _mm_set1_epi8(-1));
+
+  *lo = _mm_unpacklo_epi16(bg, rx);
+  *hi = _mm_unpackhi_epi16(bg, rx);
+}
+
+// Drops the X bytes of 4 BGRX pixels, leaving 12 bytes of BGR at the
+// bottom.
+__m128i PackBgr(__m128i bgrx) {
+  // Within each 64-bit half: the first pixel, then the second after it.
+  const __m128i first = _mm_setr_epi32(0xFFFFFF, 0, 0xFFFFFF, 0);
+  const __m128i second = _mm_setr_epi32(static_cast<int>(0xFF000000u), 0xFFFF,
+                                        static_cast<int>(0xFF000000u), 0xFFFF);
+  const __m128i halves = _mm_or_si128(
+      _mm_and_si128(bgrx, first),
+      _mm_and_si128(_mm_srli_epi64(bgrx, 8), second));
+
+  // Then the upper half's 6 bytes down against the lower half's.
+  const __m128i lower = _mm_setr_epi32(-1, 0xFFFF, 0, 0);
+  const __m128i upper = _mm_setr_epi32(0, static_cast<int>(0xFFFF0000u), -1,
+                                       0);
+  return _mm_or_si128(_mm_and_si128(halves, lower),
+                      _mm_and_si128(_mm_srli_si128(halves, 2), upper));
+}
+
+// Converts as many pixels of the row as the SSE2 loop can, and returns
+// how many.
+int ConvertRowSse2(const uint8_t* src_y, const uint8_t* src_u,
+                   const uint8_t* src_v, const Sse2Constants& k,
+                   int bytes_per_pixel, int width, uint8_t* dst) {
+  int x = 0;
+  __m128i lo, hi;
+
+  if (bytes_per_pixel == 4) {
+    for (; x + 8 <= width; x += 8) {
+      Convert8(src_y + x, src_u + x / 2, src_v + x / 2, k, &lo, &hi);
+
+      __m128i* const d = reinterpret_cast<__m128i*>(dst + 4 * x);
+      _mm_storeu_si128(d, lo);
+      _mm_storeu_si128(d + 1, hi);
+    }
+  } else {
+    // The second store of each 8 pixels writes 4 bytes past them, which
+    // the next 8 overwrite; stop while that is still inside the row.
+    for (; x + 10 <= width; x += 8) {
+      Convert8(src_y + x, src_u + x / 2, src_v + x / 2, k, &lo, &hi);
+
+      uint8_t* const d = dst + 3 * x;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d), PackBgr(lo));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 12), PackBgr(hi));
+    }
+  }
+
+  return x;
+}
+
+#endif  // WEBMDSHOW_YUVTORGB_SSE2
+
+void I420ToRgb(const uint8_t* src_y, int stride_y,
+               const uint8_t* src_u, int stride_u,
+               const uint8_t* src_v, int stride_v,
+               const YuvToRgbConstants& constants, int bytes_per_pixel,
+               uint8_t* dst, int dst_stride, int width, int height) {
+  assert(src_y && src_u && src_v && dst);
+  assert(width >= 0 && height >= 0);
+
+#ifdef WEBMDSHOW_YUVTORGB_SSE2
+  Sse2Constants sse2;
+  GetSse2Constants(constants, &sse2);
+#endif
+
+  for (int row = 0; row < height; ++row) {
+    const uint8_t* const y = src_y + row * stride_y;
+    const uint8_t* const u = src_u + (row / 2) * stride_u;
+    const uint8_t* const v = src_v + (row / 2) * stride_v;
+    uint8_t* const d = dst + row * dst_stride;
+
+#ifdef WEBMDSHOW_YUVTORGB_SSE2
+    const int done = ConvertRowSse2(y, u, v, sse2, bytes_per_pixel, width, d);
+#else
+    const int done = 0;
+#endif
+
+    ConvertRowC(y, u, v, constants, bytes_per_pixel, done, width, d);
+  }
+}
+
+}  // namespace
+
+const YuvToRgbConstants& GetYuvToRgbConstants(YuvMatrix matrix,
+                                              YuvRange range) {
+  assert(matrix == kYuvMatrixBT601 || matrix == kYuvMatrixBT709);
+  assert(range == kYuvRangeLimited || range == kYuvRangeFull);
+  return kConstants[matrix][range];
+}
+
+void I420ToRgb32(const uint8_t* src_y, int stride_y,
+                 const uint8_t* src_u, int stride_u,
+                 const uint8_t* src_v, int stride_v,
+                 const YuvToRgbConstants& constants,
+                 uint8_t* dst, int dst_stride, int width, int height) {
+  I420ToRgb(src_y, stride_y, src_u, stride_u, src_v, stride_v, constants, 4,
+            dst, dst_stride, width, height);
+}
+
+void I420ToRgb24(const uint8_t* src_y, int stride_y,
+                 const uint8_t* src_u, int stride_u,
+                 const uint8_t* src_v, int stride_v,
+                 const YuvToRgbConstants& constants,
+                 uint8_t* dst, int dst_stride, int width, int height) {
+  I420ToRgb(src_y, stride_y, src_u, stride_u, src_v, stride_v, constants, 3,
+            dst, dst_stride, width, height);
+}
+
+}  // namespace webmdshow
@@ -0,0 +1,64 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_COMMON_YUVTORGB_H_
+#define WEBMDSHOW_COMMON_YUVTORGB_H_
+
+#include <stdint.h>
+
+namespace webmdshow {
+
+enum YuvMatrix {
+  kYuvMatrixBT601,  // SD video, and VP8
+  kYuvMatrixBT709,  // HD video
+};
+
+enum YuvRange {
+  kYuvRangeLimited,  // Y in [16, 235], U and V in [16, 240]
+  kYuvRangeFull,     // all three in [0, 255]
+};
+
+// The coefficients of one matrix and range, scaled by 2^13 so that every
+// one fits a signed 16-bit lane:
+//   R = y * (Y - y_offset) + vr * (V - 128)
+//   G = y * (Y - y_offset) + ug * (U - 128) + vg * (V - 128)
+//   B = y * (Y - y_offset) + ub * (U - 128)
+struct YuvToRgbConstants {
+  int16_t y_offset;
+  int16_t y;
+  int16_t vr;
+  int16_t ug;
+  int16_t vg;
+  int16_t ub;
+};
+
+const YuvToRgbConstants& GetYuvToRgbConstants(YuvMatrix matrix,
+                                              YuvRange range);
+
+// Converts a |width|x|height| I420 frame to RGB32 (B G R X, with X set to
+// 255) or to RGB24 (B G R) at |dst|. Nothing is looked up in tables: the
+// rows are converted eight pixels at a time with SSE2 where the build
+// targets it, and in the same fixed-point arithmetic in C otherwise, so
+// both give the same output. For a bottom-up DIB, pass the address of
+// its last row (the top of the picture) and a negative |dst_stride|. Odd
+// sizes are allowed.
+void I420ToRgb32(const uint8_t* src_y, int stride_y,
+                 const uint8_t* src_u, int stride_u,
+                 const uint8_t* src_v, int stride_v,
+                 const YuvToRgbConstants& constants,
+                 uint8_t* dst, int dst_stride, int width, int height);
+
+void I420ToRgb24(const uint8_t* src_y, int stride_y,
+                 const uint8_t* src_u, int stride_u,
+                 const uint8_t* src_v, int stride_v,
+                 const YuvToRgbConstants& constants,
+                 uint8_t* dst, int dst_stride, int width, int height);
+
+}  // namespace webmdshow
+
+#endif  // WEBMDSHOW_COMMON_YUVTORGB_H_
@@ -1,24 +1,10 @@
 //#include "on2_ports/config.h"
 #include "on2_blit/on2_blit_internal.h"
 #include "on2_ports/x86.h"
+#include "rgbtoyv12_simd.h"
 #include <windows.h>
+#include <intrin.h>
 
-extern void
-CC_RGB24toYV12_MMX_INLINE(unsigned char *src_buf, int w, int h,
-                          unsigned char *y, unsigned char *u, unsigned char *v,
-                          int src_pitch, int dst_pitch);
-extern void
-CC_RGB32toYV12_MMX_INLINE(unsigned char *src_buf, int w, int h,
-                          unsigned char *y, unsigned char *u, unsigned char *v,
-                          int src_pitch, int dst_pitch);
-extern void
-CC_RGB24toYV12_XMM_INLINE(unsigned char *src_buf, int w, int h,
-                          unsigned char *y, unsigned char *u, unsigned char *v,
-                          int src_pitch, int dst_pitch);
-extern void
-CC_RGB32toYV12_XMM_INLINE(unsigned char *src_buf, int w, int h,
-                          unsigned char *y, unsigned char *u, unsigned char *v,
-                          int src_pitch, int dst_pitch);
 //extern void
 //CC_UYVYtoYV12_MMX(unsigned char *src_buf, int w, int h,
 //                  unsigned char *y, unsigned char *u, unsigned char *v,
@@ -224,84 +210,69 @@ on2_blit_x86(on2_image_t *dst, const on2_image_t *src, int *info) {
 #endif
 
 
-//#define cpuid(func,a,b,c,d)\
-//	__asm mov eax, func;\
-//	__asm cpuid;\
-//	__asm mov a, eax;\
-//	__asm mov b, ebx;\
-//	__asm mov c, ecx;\
-//	__asm mov [d], edx;
-//#endif
-//#endif
-//
-//#define HAS_MMX   0x01
-//#define HAS_SSE   0x02
-//#define HAS_SSE2  0x04
-//#define HAS_SSE3  0x08
-//#ifndef BIT
-//#define BIT(n) (1<<n)
-//#endif
-//
-
-static DWORD
-x86_simd_caps(void) {
-    DWORD reg_eax, /* reg_ebx, */ reg_ecx, reg_edx;
+static DWORD
+x86_simd_caps(void) {
+    int regs[4];  /* eax, ebx, ecx, edx */
+    int max_leaf;
     DWORD flags;
 
-	__asm mov eax, 0;
-	__asm cpuid;
-	__asm mov [reg_eax], eax;
-
-	if(reg_eax == 0)
-	    return 0;
-
-	__asm mov eax, 1;
-	__asm cpuid;
-	__asm mov [reg_eax], eax;
-	//__asm mov [reg_ebx], ebx;
-	__asm mov [reg_ecx], ecx;
-	__asm mov [reg_edx], edx;
-
-	flags = 0;
-	if(reg_edx & (1 << 23)) flags |= HAS_MMX;
-	if(reg_edx & (1 << 25)) flags |= HAS_SSE;
-	if(reg_edx & (1 << 26)) flags |= HAS_SSE2;
-	if(reg_ecx & (1 << 0)) flags |= HAS_SSE3;
-
-	return flags;
-}
-
+    __cpuid(regs, 0);
+    max_leaf = regs[0];
+
+    if (max_leaf == 0)
+        return 0;
+
+    __cpuid(regs, 1);
+
+    flags = 0;
+    if (regs[3] & (1 << 23)) flags |= HAS_MMX;
+    if (regs[3] & (1 << 25)) flags |= HAS_SSE;
+    if (regs[3] & (1 << 26)) flags |= HAS_SSE2;
+    if (regs[2] & (1 << 0)) flags |= HAS_SSE3;
+
+    /* AVX2 also needs the OS to save the YMM registers (OSXSAVE, and
+     * XCR0 with the SSE and AVX state bits set).
+     */
+    if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) &&
+        (_xgetbv(0) & 6) == 6 && max_leaf >= 7) {
+        __cpuidex(regs, 7, 0);
+        if (regs[1] & (1 << 5)) flags |= HAS_AVX2;
+    }
+
+    return flags;
+}
+
+
+/* The converters to YV12, best first.  The first whose format matches
+ * and whose instruction sets the CPU has is used; the C versions need
+ * none, so every format ends up with one.
+ */
+static const struct {
+    img_fmt_t src;
+    DWORD caps;
+    on2_rgb_to_yuv_t func;
+} rgb_to_yv12[] = {
+    { IMG_FMT_RGB24, HAS_AVX2, CC_RGB24toYV12_AVX2 },
+    { IMG_FMT_RGB24, HAS_SSE2, CC_RGB24toYV12_SSE2 },
+    { IMG_FMT_RGB24, 0,        CC_RGB24toYV12_C },
+    { IMG_FMT_RGB32, HAS_AVX2, CC_RGB32toYV12_AVX2 },
+    { IMG_FMT_RGB32, HAS_SSE2, CC_RGB32toYV12_SSE2 },
+    { IMG_FMT_RGB32, 0,        CC_RGB32toYV12_C },
+};
+
 
 on2_rgb_to_yuv_t on2_get_rgb_to_yuv(img_fmt_t dst, img_fmt_t src) {
     const DWORD caps = x86_simd_caps();
+    int i;
 
     if (dst != IMG_FMT_YV12)  //TODO: liberalize?
         return NULL;
 
-    switch(src) {
-    case IMG_FMT_RGB24:
-#if HAVE_SSE
-        if(caps & HAS_SSE)
-            return CC_RGB24toYV12_XMM_INLINE;
-#endif
-#if HAVE_MMX
-        if(caps & HAS_MMX)
-            return CC_RGB24toYV12_MMX_INLINE;
-#endif
-        return CC_RGB24toYV12_C;
-
-    case IMG_FMT_RGB32:
-#if HAVE_SSE
-        if(caps & HAS_SSE)
-            return CC_RGB32toYV12_XMM_INLINE;
-#endif
-#if HAVE_MMX
-        if(caps & HAS_MMX)
-            return CC_RGB32toYV12_MMX_INLINE;
-#endif
-        return CC_RGB32toYV12_C;
-
-    default:
-        return NULL;
+    for (i = 0; i < (int)(sizeof(rgb_to_yv12) / sizeof(rgb_to_yv12[0])); ++i) {
+        if (rgb_to_yv12[i].src == src &&
+            (caps & rgb_to_yv12[i].caps) == rgb_to_yv12[i].caps)
+            return rgb_to_yv12[i].func;
     }
+
+    return NULL;
 }
@@ -0,0 +1,184 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <assert.h>
+#include <immintrin.h>
+#include "on2_blit/colorconversions.h"
+#include "rgbtoyv12_simd.h"
+
+/* The SSE2 converters' arithmetic (see rgbtoyv12_sse2.c), on 16 pixels of
+ * two rows at a time.  The AVX2 unpacks and packs work within each 128-bit
+ * lane, so the results of the two lanes are interleaved back into column
+ * order before they are stored.
+ */
+
+#define COEFS(b, g, r) _mm256_setr_epi16(b, g, r, 0, b, g, r, 0, \
+                                         b, g, r, 0, b, g, r, 0)
+
+static __m256i
+sum_pairs(__m256i a, __m256i b) {
+    const __m256 fa = _mm256_castsi256_ps(a);
+    const __m256 fb = _mm256_castsi256_ps(b);
+    const __m256i even = _mm256_castps_si256(
+        _mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    const __m256i odd = _mm256_castps_si256(
+        _mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm256_add_epi32(even, odd);
+}
+
+/* Returns the Y of the 8 BGRX pixels of px, as 32-bit values. */
+static __m256i
+luma8(__m256i px) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i coefs = COEFS(CC_YB, CC_YG, CC_YR);
+    const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero),
+                                         coefs);
+    const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero),
+                                         coefs);
+    const __m256i sum = _mm256_add_epi32(sum_pairs(lo, hi),
+                                         _mm256_set1_epi32(CC_YOFFSET));
+    return _mm256_srai_epi32(sum, ShiftFactor);
+}
+
+/* Returns the averages of the four 2x2 blocks of the 8 BGRX pixels of px1
+ * and of px2 below them, as B G R X words: blocks 0 and 1 in the low lane,
+ * 2 and 3 in the high.
+ */
+static __m256i
+average_blocks(__m256i px1, __m256i px2) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(px1, zero),
+                                        _mm256_unpacklo_epi8(px2, zero));
+    const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(px1, zero),
+                                        _mm256_unpackhi_epi8(px2, zero));
+    const __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi),
+                                         _mm256_unpackhi_epi64(lo, hi));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+/* Returns the U or V of 8 blocks, in column order. */
+static __m256i
+chroma8(__m256i avg1, __m256i avg2, __m256i coefs) {
+    const __m256i sum = _mm256_add_epi32(
+        sum_pairs(_mm256_madd_epi16(avg1, coefs),
+                  _mm256_madd_epi16(avg2, coefs)),
+        _mm256_set1_epi32(CC_UVOFFSET));
+    return _mm256_permute4x64_epi64(_mm256_srai_epi32(sum, ShiftFactor),
+                                    _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* Packs the 32-bit values of a (columns 0-3 and 4-7) and b (8-11 and
+ * 12-15) to 16 bytes in column order.
+ */
+static __m128i
+pack16(__m256i a, __m256i b) {
+    const __m256i x = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                          _mm256_setzero_si256());
+    return _mm_unpacklo_epi32(_mm256_castsi256_si128(x),
+                              _mm256_extracti128_si256(x, 1));
+}
+
+/* Converts the 16 BGRX pixels p1[0..1] and p2[0..1] below them. */
+static void
+convert16(const __m256i *p1, const __m256i *p2,
+          unsigned char *y1, unsigned char *y2,
+          unsigned char *u, unsigned char *v) {
+    __m256i avg1, avg2;
+    __m128i uv;
+
+    _mm_storeu_si128((__m128i *)y1, pack16(luma8(p1[0]), luma8(p1[1])));
+    _mm_storeu_si128((__m128i *)y2, pack16(luma8(p2[0]), luma8(p2[1])));
+
+    avg1 = average_blocks(p1[0], p2[0]);
+    avg2 = average_blocks(p1[1], p2[1]);
+    uv = pack16(chroma8(avg1, avg2, COEFS(CC_UB, CC_UG, CC_UR)),
+                chroma8(avg1, avg2, COEFS(CC_VB, CC_VG, CC_UB)));
+    _mm_storel_epi64((__m128i *)u, uv);
+    _mm_storel_epi64((__m128i *)v, _mm_srli_si128(uv, 8));
+}
+
+/* Loads 8 BGR pixels, 4 from each of s and s + 12, as BGRX. */
+static __m256i
+load_bgr8(const unsigned char *s) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i x = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+        _mm_loadu_si128((const __m128i *)(s + 12)), 1);
+    return _mm256_shuffle_epi8(x, shuffle);
+}
+
+void
+CC_RGB32toYV12_AVX2(unsigned char *src_buf, int w, int h,
+                    unsigned char *y, unsigned char *u, unsigned char *v,
+                    int src_pitch, int dst_pitch) {
+    const int simd_w = w & ~15;
+    int row, x;
+
+    assert(!(w & 1) && !(h & 1));
+
+    for (row = 0; row < h; row += 2) {
+        const unsigned char *const src1 = src_buf + row * src_pitch;
+        const unsigned char *const src2 = src1 + src_pitch;
+        unsigned char *const y1 = y + row * dst_pitch;
+        unsigned char *const y2 = y1 + dst_pitch;
+        unsigned char *const u1 = u + (row >> 1) * (dst_pitch >> 1);
+        unsigned char *const v1 = v + (row >> 1) * (dst_pitch >> 1);
+
+        for (x = 0; x < simd_w; x += 16) {
+            __m256i p1[2], p2[2];
+
+            p1[0] = _mm256_loadu_si256((const __m256i *)(src1 + x * 4));
+            p1[1] = _mm256_loadu_si256((const __m256i *)(src1 + x * 4 + 32));
+            p2[0] = _mm256_loadu_si256((const __m256i *)(src2 + x * 4));
+            p2[1] = _mm256_loadu_si256((const __m256i *)(src2 + x * 4 + 32));
+            convert16(p1, p2, y1 + x, y2 + x, u1 + x / 2, v1 + x / 2);
+        }
+    }
+
+    if (simd_w < w)
+        CC_RGB32toYV12_SSE2(src_buf + simd_w * 4, w - simd_w, h,
+                            y + simd_w, u + simd_w / 2, v + simd_w / 2,
+                            src_pitch, dst_pitch);
+}
+
+void
+CC_RGB24toYV12_AVX2(unsigned char *src_buf, int w, int h,
+                    unsigned char *y, unsigned char *u, unsigned char *v,
+                    int src_pitch, int dst_pitch) {
+    /* The last load of each 16 pixels reads 4 bytes past them. */
+    const int simd_w = (w >= 2) ? ((w - 2) & ~15) : 0;
+    int row, x;
+
+    assert(!(w & 1) && !(h & 1));
+
+    for (row = 0; row < h; row += 2) {
+        const unsigned char *const src1 = src_buf + row * src_pitch;
+        const unsigned char *const src2 = src1 + src_pitch;
+        unsigned char *const y1 = y + row * dst_pitch;
+        unsigned char *const y2 = y1 + dst_pitch;
+        unsigned char *const u1 = u + (row >> 1) * (dst_pitch >> 1);
+        unsigned char *const v1 = v + (row >> 1) * (dst_pitch >> 1);
+
+        for (x = 0; x < simd_w; x += 16) {
+            __m256i p1[2], p2[2];
+
+            p1[0] = load_bgr8(src1 + x * 3);
+            p1[1] = load_bgr8(src1 + x * 3 + 24);
+            p2[0] = load_bgr8(src2 + x * 3);
+            p2[1] = load_bgr8(src2 + x * 3 + 24);
+            convert16(p1, p2, y1 + x, y2 + x, u1 + x / 2, v1 + x / 2);
+        }
+    }
+
+    if (simd_w < w)
+        CC_RGB24toYV12_SSE2(src_buf + simd_w * 3, w - simd_w, h,
+                            y + simd_w, u + simd_w / 2, v + simd_w / 2,
+                            src_pitch, dst_pitch);
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef RGBTOYV12_SIMD_H
+#define RGBTOYV12_SIMD_H
+
+/* The lutbl.c tables are exact multiples of these coefficients (plus, for
+ * YRMult, URMult and VGMult, the offsets below), so the SIMD converters
+ * compute what CC_RGB*toYV12_C look up, and their output is bit-exact.
+ * Every coefficient fits in a signed 16-bit lane.
+ */
+#define CC_YR     8421
+#define CC_YG    16515
+#define CC_YB     3211
+#define CC_UR    -4849
+#define CC_UG    -9535
+#define CC_UB    14385   /* also VR: UBVRMult */
+#define CC_VG   -12058
+#define CC_VB    -2326
+
+#define CC_YOFFSET  540672    /* (16 * ScaleFactor) + (ScaleFactor / 2) */
+#define CC_UVOFFSET 4210688   /* (128 * ScaleFactor) + (ScaleFactor / 2) */
+
+/* Each converts as its CC_*_C counterpart does, with the same arguments;
+ * the SSE2 versions need a CPU with SSE2, the AVX2 ones AVX2 and an OS
+ * that saves the YMM registers.  Columns left over from the vector loop
+ * are converted by the C versions.
+ */
+void CC_RGB24toYV12_SSE2(unsigned char *src_buf, int w, int h,
+                         unsigned char *y, unsigned char *u, unsigned char *v,
+                         int src_pitch, int dst_pitch);
+void CC_RGB32toYV12_SSE2(unsigned char *src_buf, int w, int h,
+                         unsigned char *y, unsigned char *u, unsigned char *v,
+                         int src_pitch, int dst_pitch);
+void CC_RGB24toYV12_AVX2(unsigned char *src_buf, int w, int h,
+                         unsigned char *y, unsigned char *u, unsigned char *v,
+                         int src_pitch, int dst_pitch);
+void CC_RGB32toYV12_AVX2(unsigned char *src_buf, int w, int h,
+                         unsigned char *y, unsigned char *u, unsigned char *v,
+                         int src_pitch, int dst_pitch);
+
+#endif /* RGBTOYV12_SIMD_H */
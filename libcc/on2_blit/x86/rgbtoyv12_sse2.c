@@ -0,0 +1,168 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <assert.h>
+#include <emmintrin.h>
+#include "on2_blit/colorconversions.h"
+#include "rgbtoyv12_simd.h"
+
+/* Both converters take 8 pixels of two rows at a time, unpacked to
+ * B G R X words, X being alpha or (for RGB24) a byte of the next pixel,
+ * which the zero coefficient drops.  pmaddwd yields B*cb+G*cg and R*cr
+ * for each pixel, and these are then summed in pairs.
+ */
+
+#define COEFS(b, g, r) _mm_setr_epi16(b, g, r, 0, b, g, r, 0)
+
+static __m128i
+sum_pairs(__m128i a, __m128i b) {
+    const __m128 fa = _mm_castsi128_ps(a);
+    const __m128 fb = _mm_castsi128_ps(b);
+    const __m128i even = _mm_castps_si128(
+        _mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    const __m128i odd = _mm_castps_si128(
+        _mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi32(even, odd);
+}
+
+/* Returns the Y of the 4 BGRX pixels of px, as 32-bit values. */
+static __m128i
+luma4(__m128i px) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coefs = COEFS(CC_YB, CC_YG, CC_YR);
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coefs);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coefs);
+    const __m128i sum = _mm_add_epi32(sum_pairs(lo, hi),
+                                      _mm_set1_epi32(CC_YOFFSET));
+    return _mm_srai_epi32(sum, ShiftFactor);
+}
+
+/* Returns the averages, as B G R X words, of the two 2x2 blocks of the
+ * 4 BGRX pixels of px1 and of px2 below them.
+ */
+static __m128i
+average_blocks(__m128i px1, __m128i px2) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(px1, zero),
+                                     _mm_unpacklo_epi8(px2, zero));
+    const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(px1, zero),
+                                     _mm_unpackhi_epi8(px2, zero));
+    const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                                      _mm_unpackhi_epi64(lo, hi));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+static __m128i
+chroma4(__m128i avg1, __m128i avg2, __m128i coefs) {
+    const __m128i sum = _mm_add_epi32(
+        sum_pairs(_mm_madd_epi16(avg1, coefs), _mm_madd_epi16(avg2, coefs)),
+        _mm_set1_epi32(CC_UVOFFSET));
+    return _mm_srai_epi32(sum, ShiftFactor);
+}
+
+/* Converts the 8 BGRX pixels p1[0..1] and p2[0..1] below them. */
+static void
+convert8(const __m128i *p1, const __m128i *p2,
+         unsigned char *y1, unsigned char *y2,
+         unsigned char *u, unsigned char *v) {
+    __m128i avg1, avg2, uv;
+
+    _mm_storel_epi64((__m128i *)y1, _mm_packus_epi16(
+        _mm_packs_epi32(luma4(p1[0]), luma4(p1[1])), _mm_setzero_si128()));
+    _mm_storel_epi64((__m128i *)y2, _mm_packus_epi16(
+        _mm_packs_epi32(luma4(p2[0]), luma4(p2[1])), _mm_setzero_si128()));
+
+    avg1 = average_blocks(p1[0], p2[0]);
+    avg2 = average_blocks(p1[1], p2[1]);
+    uv = _mm_packus_epi16(
+        _mm_packs_epi32(chroma4(avg1, avg2, COEFS(CC_UB, CC_UG, CC_UR)),
+                        chroma4(avg1, avg2, COEFS(CC_VB, CC_VG, CC_UB))),
+        _mm_setzero_si128());
+    *(int *)u = _mm_cvtsi128_si32(uv);
+    *(int *)v = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+}
+
+/* Spreads the 4 BGR pixels in the low 12 bytes of x to BGRX. */
+static __m128i
+bgr_to_bgrx(__m128i x) {
+    const __m128i p01 = _mm_unpacklo_epi32(x, _mm_srli_si128(x, 3));
+    const __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(x, 6),
+                                           _mm_srli_si128(x, 9));
+    return _mm_unpacklo_epi64(p01, p23);
+}
+
+void
+CC_RGB32toYV12_SSE2(unsigned char *src_buf, int w, int h,
+                    unsigned char *y, unsigned char *u, unsigned char *v,
+                    int src_pitch, int dst_pitch) {
+    const int simd_w = w & ~7;
+    int row, x;
+
+    assert(!(w & 1) && !(h & 1));
+
+    for (row = 0; row < h; row += 2) {
+        const unsigned char *const src1 = src_buf + row * src_pitch;
+        const unsigned char *const src2 = src1 + src_pitch;
+        unsigned char *const y1 = y + row * dst_pitch;
+        unsigned char *const y2 = y1 + dst_pitch;
+        unsigned char *const u1 = u + (row >> 1) * (dst_pitch >> 1);
+        unsigned char *const v1 = v + (row >> 1) * (dst_pitch >> 1);
+
+        for (x = 0; x < simd_w; x += 8) {
+            __m128i p1[2], p2[2];
+
+            p1[0] = _mm_loadu_si128((const __m128i *)(src1 + x * 4));
+            p1[1] = _mm_loadu_si128((const __m128i *)(src1 + x * 4 + 16));
+            p2[0] = _mm_loadu_si128((const __m128i *)(src2 + x * 4));
+            p2[1] = _mm_loadu_si128((const __m128i *)(src2 + x * 4 + 16));
+            convert8(p1, p2, y1 + x, y2 + x, u1 + x / 2, v1 + x / 2);
+        }
+    }
+
+    if (simd_w < w)
+        CC_RGB32toYV12_C(src_buf + simd_w * 4, w - simd_w, h,
+                         y + simd_w, u + simd_w / 2, v + simd_w / 2,
+                         src_pitch, dst_pitch);
+}
+
+void
+CC_RGB24toYV12_SSE2(unsigned char *src_buf, int w, int h,
+                    unsigned char *y, unsigned char *u, unsigned char *v,
+                    int src_pitch, int dst_pitch) {
+    /* The last load of each 8 pixels reads 4 bytes past them. */
+    const int simd_w = (w >= 2) ? ((w - 2) & ~7) : 0;
+    int row, x;
+
+    assert(!(w & 1) && !(h & 1));
+
+    for (row = 0; row < h; row += 2) {
+        const unsigned char *const src1 = src_buf + row * src_pitch;
+        const unsigned char *const src2 = src1 + src_pitch;
+        unsigned char *const y1 = y + row * dst_pitch;
+        unsigned char *const y2 = y1 + dst_pitch;
+        unsigned char *const u1 = u + (row >> 1) * (dst_pitch >> 1);
+        unsigned char *const v1 = v + (row >> 1) * (dst_pitch >> 1);
+
+        for (x = 0; x < simd_w; x += 8) {
+            const unsigned char *const s1 = src1 + x * 3;
+            const unsigned char *const s2 = src2 + x * 3;
+            __m128i p1[2], p2[2];
+
+            p1[0] = bgr_to_bgrx(_mm_loadu_si128((const __m128i *)s1));
+            p1[1] = bgr_to_bgrx(_mm_loadu_si128((const __m128i *)(s1 + 12)));
+            p2[0] = bgr_to_bgrx(_mm_loadu_si128((const __m128i *)s2));
+            p2[1] = bgr_to_bgrx(_mm_loadu_si128((const __m128i *)(s2 + 12)));
+            convert8(p1, p2, y1 + x, y2 + x, u1 + x / 2, v1 + x / 2);
+        }
+    }
+
+    if (simd_w < w)
+        CC_RGB24toYV12_C(src_buf + simd_w * 3, w - simd_w, h,
+                         y + simd_w, u + simd_w / 2, v + simd_w / 2,
+                         src_pitch, dst_pitch);
+}
@@ -42,6 +42,7 @@ void __cpuid(int CPUInfo[4], int InfoType);
 #define HAS_SSE   0x02
 #define HAS_SSE2  0x04
 #define HAS_SSE3  0x08
+#define HAS_AVX2  0x10
 //#ifndef BIT
 //#define BIT(n) (1<<n)
 //#endif
@@ -0,0 +1,470 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "mkvparserblockscanner.h"
+#include "mkvparserelementreader.h"
+#include "mkvparser.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+typedef ElementReader::Element Element;
+typedef BlockScanner::Record Record;
+
+//The buffer, and what a read fills of it: all of it while the headers
+//are close together, or a probe of the few kilobytes at a header once
+//they are far enough apart that reading the payloads between them would
+//cost more than a read per header.
+
+const LONG kBufferSize = 1024 * 1024;
+const LONG kProbeSize = 4 * 1024;
+const LONGLONG kSkipGap = 16 * 1024;
+
+
+//An IMkvReader that serves reads from a buffer of another.
+
+class BufferedReader : public IMkvReader
+{
+    BufferedReader(const BufferedReader&);
+    BufferedReader& operator=(const BufferedReader&);
+
+public:
+    BufferedReader(IMkvReader*, LONGLONG available);
+    virtual ~BufferedReader();
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+    LONGLONG m_reads;
+    LONGLONG m_bytes;
+
+private:
+    IMkvReader* const m_pReader;
+    const LONGLONG m_available;
+
+    std::vector<unsigned char> m_buf;
+    LONGLONG m_start;  //of the bytes in m_buf
+    LONG m_len;
+
+    LONGLONG m_last;  //position of the last read
+    LONGLONG m_gap;   //average forward distance between reads
+
+};
+
+
+BufferedReader::BufferedReader(IMkvReader* pReader, LONGLONG available) :
+    m_reads(0),
+    m_bytes(0),
+    m_pReader(pReader),
+    m_available(available),
+    m_buf(kBufferSize),
+    m_start(0),
+    m_len(0),
+    m_last(0),
+    m_gap(0)
+{
+}
+
+
+BufferedReader::~BufferedReader()
+{
+}
+
+
+int BufferedReader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0))
+        return -1;
+
+    if (pos > m_last)
+    {
+        m_gap = (7 * m_gap + (pos - m_last)) / 8;
+        m_last = pos;
+    }
+
+    if ((pos < m_start) || ((pos + len) > (m_start + m_len)))
+    {
+        if ((pos + len) > m_available)
+            return -1;
+
+        LONG size = (m_gap > kSkipGap) ? kProbeSize : kBufferSize;
+        size = (std::max)(size, LONG(len));
+
+        if (size > LONG(m_buf.size()))
+            m_buf.resize(size);
+
+        size = static_cast<LONG>(
+            (std::min)(LONGLONG(size), m_available - pos));
+
+        if (m_pReader->Read(pos, size, &m_buf[0]) != 0)
+        {
+            m_len = 0;
+            return -1;
+        }
+
+        ++m_reads;
+        m_bytes += size;
+
+        m_start = pos;
+        m_len = size;
+    }
+
+    memcpy(buf, &m_buf[0] + (pos - m_start), len);
+    return 0;
+}
+
+
+int BufferedReader::Length(long long* total, long long* available)
+{
+    return m_pReader->Length(total, available);
+}
+
+
+//Gets the record of the Block or SimpleBlock e, except for the
+//flags only a BlockGroup knows.
+
+bool ReadBlock(
+    IMkvReader* pReader,
+    const Element& e,
+    LONGLONG cluster_timecode,
+    LONGLONG scale,
+    Record& r)
+{
+    BYTE b;
+
+    if (pReader->Read(e.pos, 1, &b) != 0)
+        return false;
+
+    LONG n = 1;  //of the track number
+
+    for (BYTE m = 0x80; (m != 0) && ((b & m) == 0); m >>= 1)
+        ++n;
+
+    LONGLONG track, timecode;
+    BYTE flags;
+
+    if (!ElementReader::ReadBlockHeader(pReader, e, track, timecode, flags))
+        return false;
+
+    r.time_ns = (cluster_timecode + timecode) * scale;
+    r.pos = e.start;
+    r.size = static_cast<ULONG>(e.size - n - 3);
+    r.track = static_cast<USHORT>(track);
+    r.flags = 0;
+
+    if (flags & 0x08)
+        r.flags |= BlockScanner::kFlagInvisible;
+
+    if (flags & 0x06)
+        r.flags |= BlockScanner::kFlagLaced;
+
+    if (e.id == ElementReader::kSimpleBlockID)
+    {
+        if (flags & 0x80)
+            r.flags |= BlockScanner::kFlagKey;
+
+        if (flags & 0x01)
+            r.flags |= BlockScanner::kFlagDiscardable;
+    }
+
+    return true;
+}
+
+
+//Gets the record of the BlockGroup g: its Block, a keyframe unless the
+//group has a ReferenceBlock.
+
+bool ReadBlockGroup(
+    IMkvReader* pReader,
+    const Element& g,
+    LONGLONG cluster_timecode,
+    LONGLONG scale,
+    Record& r)
+{
+    LONGLONG pos = g.pos;
+    const LONGLONG stop = g.pos + g.size;
+
+    bool bBlock = false;
+    bool bKey = true;
+
+    while (pos < stop)
+    {
+        Element c;
+
+        if (!ElementReader::ReadHeader(pReader, pos, stop, c) || (c.size < 0))
+            return false;
+
+        if (c.id == ElementReader::kReferenceBlockID)
+            bKey = false;
+
+        else if (c.id == ElementReader::kBlockID)
+        {
+            if (!ReadBlock(pReader, c, cluster_timecode, scale, r))
+                return false;
+
+            bBlock = true;
+        }
+
+        pos = c.pos + c.size;
+    }
+
+    if (!bBlock)
+        return false;
+
+    r.pos = g.start;
+    r.flags |= BlockScanner::kFlagBlockGroup;
+
+    if (bKey)
+        r.flags |= BlockScanner::kFlagKey;
+
+    return true;
+}
+
+
+//Walks the children of the cluster c, adding a record for each block.
+//Without a size, the cluster ends at the first element that can't be its
+//child.  Gets the position just past the cluster.
+
+bool ScanCluster(
+    IMkvReader* pReader,
+    const Element& c,
+    LONGLONG stop,
+    LONGLONG scale,
+    std::vector<Record>& records,
+    LONGLONG& next)
+{
+    const bool bKnown = (c.size >= 0);
+    const LONGLONG end = bKnown ? (c.pos + c.size) : stop;
+
+    LONGLONG pos = c.pos;
+    LONGLONG cluster_timecode = -1;
+
+    while (pos < end)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(pReader, pos, end, e))
+            return false;
+
+        if (!ElementReader::IsClusterChild(e.id))
+        {
+            if (bKnown)
+                return false;
+
+            break;  //the next level 1 element
+        }
+
+        if (e.size < 0)
+            return false;
+
+        if (e.id == ElementReader::kTimecodeID)
+        {
+            if (!ElementReader::ReadUInt(pReader, e, cluster_timecode))
+                return false;
+        }
+        else if (cluster_timecode < 0)
+        {
+            //No time yet for the blocks before it; skip them.
+        }
+        else if (e.id == ElementReader::kSimpleBlockID)
+        {
+            Record r;
+
+            if (!ReadBlock(pReader, e, cluster_timecode, scale, r))
+                return false;
+
+            records.push_back(r);
+        }
+        else if (e.id == ElementReader::kBlockGroupID)
+        {
+            Record r;
+
+            if (!ReadBlockGroup(pReader, e, cluster_timecode, scale, r))
+                return false;
+
+            records.push_back(r);
+        }
+
+        pos = e.pos + e.size;
+    }
+
+    next = bKnown ? end : pos;
+    return true;
+}
+
+
+void Put(BYTE*& p, ULONGLONG value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        *p++ = static_cast<BYTE>(value >> (8 * i));
+}
+
+}  //end unnamed namespace
+
+
+HRESULT BlockScanner::Scan(
+    IMkvReader* pReader,
+    const Segment* pSegment,
+    std::vector<Record>& records,
+    Stats* pStats)
+{
+    records.clear();
+
+    if ((pReader == 0) || (pSegment == 0))
+        return E_POINTER;
+
+    const SegmentInfo* const pInfo = pSegment->GetInfo();
+
+    if (pInfo == 0)
+        return E_INVALIDARG;
+
+    LONGLONG total, available;
+
+    if (pReader->Length(&total, &available) < 0)
+        return E_FAIL;
+
+    LONGLONG stop = available;
+
+    if (pSegment->m_size >= 0)
+        stop = (std::min)(stop, pSegment->m_start + pSegment->m_size);
+
+    const LONGLONG scale = pInfo->GetTimeCodeScale();
+
+    BufferedReader reader(pReader, available);
+
+    LONGLONG clusters = 0;
+    LONGLONG pos = pSegment->m_start;
+    HRESULT hr = S_OK;
+
+    while (pos < stop)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(&reader, pos, stop, e))
+        {
+            hr = S_FALSE;
+            break;
+        }
+
+        if (e.id == ElementReader::kClusterID)
+        {
+            LONGLONG next;
+
+            if (!ScanCluster(&reader, e, stop, scale, records, next))
+            {
+                hr = S_FALSE;
+                break;
+            }
+
+            ++clusters;
+            pos = next;
+        }
+        else if (e.size < 0)
+        {
+            hr = S_FALSE;
+            break;
+        }
+        else
+            pos = e.pos + e.size;
+    }
+
+    if (pStats)
+    {
+        pStats->clusters = clusters;
+        pStats->reads = reader.m_reads;
+        pStats->bytes_read = reader.m_bytes;
+    }
+
+    return hr;
+}
+
+
+HRESULT BlockScanner::WriteCsv(FILE* f, const std::vector<Record>& records)
+{
+    if (f == 0)
+        return E_POINTER;
+
+    fprintf(f, "time_ns,pos,size,track,key,invisible,discardable\n");
+
+    typedef std::vector<Record>::const_iterator iter_t;
+
+    for (iter_t i = records.begin(); i != records.end(); ++i)
+    {
+        const Record& r = *i;
+
+        fprintf(
+            f,
+            "%lld,%lld,%lu,%u,%d,%d,%d\n",
+            r.time_ns,
+            r.pos,
+            r.size,
+            unsigned(r.track),
+            (r.flags & kFlagKey) ? 1 : 0,
+            (r.flags & kFlagInvisible) ? 1 : 0,
+            (r.flags & kFlagDiscardable) ? 1 : 0);
+    }
+
+    return ferror(f) ? E_FAIL : S_OK;
+}
+
+
+HRESULT BlockScanner::WriteBinary(FILE* f, const std::vector<Record>& records)
+{
+    if (f == 0)
+        return E_POINTER;
+
+    BYTE header[16];
+    BYTE* p = header;
+
+    memcpy(p, "WBSR", 4);
+    p += 4;
+
+    Put(p, 1, 4);
+    Put(p, records.size(), 8);
+
+    fwrite(header, sizeof header, 1, f);
+
+    //In batches, so that a two-hour file is a few hundred writes.
+
+    const size_t kBatch = 4096;
+    const size_t kRecordSize = 24;
+
+    std::vector<BYTE> buf(kBatch * kRecordSize);
+
+    for (size_t first = 0; first < records.size(); first += kBatch)
+    {
+        const size_t n = (std::min)(kBatch, records.size() - first);
+
+        p = &buf[0];
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const Record& r = records[first + i];
+
+            Put(p, r.time_ns, 8);
+            Put(p, r.pos, 8);
+            Put(p, r.size, 4);
+            Put(p, r.track, 2);
+            Put(p, r.flags, 1);
+            Put(p, 0, 1);
+        }
+
+        fwrite(&buf[0], kRecordSize, n, f);
+    }
+
+    return ferror(f) ? E_FAIL : S_OK;
+}
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,88 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <cstdio>
+#include <vector>
+
+namespace mkvparser
+{
+
+class IMkvReader;
+class Segment;
+
+//Lists the blocks of a segment, for bitrate graphs and keyframe maps,
+//without loading its clusters into the Segment or reading any frame.
+//The walk goes from the first level 1 element to the next by their
+//sizes, and from one block to the next in each cluster, reading only the
+//element headers and the block headers.
+//
+//The headers are read through a buffer of the reader.  Where the blocks
+//are small (or audio interleaves them), a read fills the buffer with
+//the next megabyte, and the headers within it cost no more reads.
+//Where they are large, the buffer holds just the few kilobytes at each
+//header, and the payloads in between are skipped, never read.
+
+class BlockScanner
+{
+    BlockScanner();
+    BlockScanner(const BlockScanner&);
+    BlockScanner& operator=(const BlockScanner&);
+
+public:
+
+    enum
+    {
+        kFlagKey = 0x01,          //a keyframe
+        kFlagInvisible = 0x02,
+        kFlagDiscardable = 0x04,
+        kFlagLaced = 0x08,        //size is that of all of its frames
+        kFlagBlockGroup = 0x10    //not a SimpleBlock
+    };
+
+    struct Record
+    {
+        LONGLONG time_ns;
+        LONGLONG pos;   //of the block element, in the file
+        ULONG size;     //of its frame data: the payload less its header
+        USHORT track;
+        BYTE flags;
+    };
+
+    struct Stats
+    {
+        LONGLONG clusters;
+        LONGLONG reads;       //of the reader
+        LONGLONG bytes_read;  //by those reads
+    };
+
+    //Gets a record for each block of the segment, in file order.  The
+    //segment need only have parsed its headers.  The result is S_FALSE
+    //if the walk stopped early on a damaged or truncated cluster; the
+    //records found before it are kept.
+    static HRESULT Scan(
+        IMkvReader*,
+        const Segment*,
+        std::vector<Record>& records,
+        Stats* = 0);
+
+    //Writes the records as CSV, with a header line:
+    //  time_ns,pos,size,track,key,invisible,discardable
+    static HRESULT WriteCsv(FILE*, const std::vector<Record>&);
+
+    //Writes the records in 24 bytes each, after a 16-byte header: the
+    //tag "WBSR", a version (1) and the record count (each little-endian,
+    //of 4 and 8 bytes), then for each record time_ns and pos (8 bytes
+    //each), size (4), track (2), flags and a zero byte.
+    static HRESULT WriteBinary(FILE*, const std::vector<Record>&);
+
+};
+
+
+}  //end namespace mkvparser
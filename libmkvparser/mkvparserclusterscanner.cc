@@ -0,0 +1,432 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <process.h>
+#include "mkvparserclusterscanner.h"
+#include "mkvparserelementreader.h"
+#include "mkvparser.hpp"
+#include "cpuutil.h"
+#include "threadutil.h"
+#include <algorithm>
+#include <cassert>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+typedef ElementReader::Element Element;
+
+//A range smaller than this isn't worth a thread of its own.
+const LONGLONG kMinRange = 8 * 1024 * 1024;
+
+
+//Whether the BlockGroup e holds a keyframe of track: a Block of the
+//track without a ReferenceBlock.
+
+bool IsKeyGroup(
+    IMkvReader* pReader,
+    const Element& e,
+    LONGLONG track,
+    LONGLONG& timecode)
+{
+    LONGLONG pos = e.pos;
+    const LONGLONG stop = e.pos + e.size;
+
+    bool bBlock = false;
+
+    while (pos < stop)
+    {
+        Element c;
+
+        if (!ElementReader::ReadHeader(pReader, pos, stop, c) || (c.size < 0))
+            return false;
+
+        if (c.id == ElementReader::kReferenceBlockID)
+            return false;
+
+        if (c.id == ElementReader::kBlockID)
+        {
+            LONGLONG t;
+            BYTE flags;
+
+            if (!ElementReader::ReadBlockHeader(pReader, c, t, timecode, flags))
+                return false;
+
+            if (t != track)
+                return false;
+
+            bBlock = true;
+        }
+
+        pos = c.pos + c.size;
+    }
+
+    return bBlock;
+}
+
+
+//Walks the children of the cluster c, up to the first keyframe of
+//track, which it adds to entries.  Without a size, the cluster ends at
+//the first element that can't be its child, so all of it is walked.
+//Gets the position just past the cluster.
+
+bool ScanCluster(
+    IMkvReader* pReader,
+    LONGLONG start,
+    const Element& c,
+    LONGLONG stop,
+    LONGLONG segment_start,
+    LONGLONG track,
+    LONGLONG scale,
+    std::vector<webmdshow::WebmIndexEntry>& entries,
+    LONGLONG& next)
+{
+    const bool bKnown = (c.size >= 0);
+    const LONGLONG end = bKnown ? (c.pos + c.size) : stop;
+
+    LONGLONG pos = c.pos;
+    LONGLONG cluster_timecode = -1;
+
+    while (pos < end)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(pReader, pos, end, e))
+            return false;
+
+        if (!ElementReader::IsClusterChild(e.id))
+        {
+            if (bKnown)
+                return false;
+
+            break;  //the next level 1 element
+        }
+
+        if (e.size < 0)
+            return false;
+
+        if (e.id == ElementReader::kTimecodeID)
+        {
+            if (!ElementReader::ReadUInt(pReader, e, cluster_timecode))
+                return false;
+        }
+        else if (cluster_timecode < 0)
+            __noop;  //no time for blocks yet
+        else if (e.id == ElementReader::kSimpleBlockID)
+        {
+            LONGLONG t, timecode;
+            BYTE flags;
+
+            if (!ElementReader::ReadBlockHeader(pReader, e, t, timecode, flags))
+                return false;
+
+            if ((t == track) && (flags & 0x80))
+            {
+                webmdshow::WebmIndexEntry entry;
+
+                entry.pos = start - segment_start;
+                entry.time_ns = (cluster_timecode + timecode) * scale;
+
+                entries.push_back(entry);
+
+                if (bKnown)
+                    break;
+
+                cluster_timecode = -1;  //just walk the rest
+            }
+        }
+        else if (e.id == ElementReader::kBlockGroupID)
+        {
+            LONGLONG timecode;
+
+            if (IsKeyGroup(pReader, e, track, timecode))
+            {
+                webmdshow::WebmIndexEntry entry;
+
+                entry.pos = start - segment_start;
+                entry.time_ns = (cluster_timecode + timecode) * scale;
+
+                entries.push_back(entry);
+
+                if (bKnown)
+                    break;
+
+                cluster_timecode = -1;
+            }
+        }
+
+        pos = e.pos + e.size;
+    }
+
+    next = bKnown ? end : pos;
+    return true;
+}
+
+
+//The part of the segment a thread walks, and what it found.  The walk
+//starts at begin (or, when syncing, at the first cluster after it) and
+//stops at the first level 1 element at or after limit.
+
+struct Range
+{
+    LONGLONG begin;
+    LONGLONG limit;
+    bool bSync;
+
+    std::vector<LONGLONG> starts;  //of the level 1 elements walked
+    std::vector<webmdshow::WebmIndexEntry> entries;
+    LONGLONG end;  //where the walk stopped, or -1 if it failed
+
+};
+
+
+struct Job
+{
+    IMkvReader* pReader;
+    LONGLONG segment_start;
+    LONGLONG stop;  //of the segment
+    LONGLONG track;
+    LONGLONG scale;
+
+    std::vector<Range> ranges;
+    volatile LONG next_range;
+};
+
+
+void Walk(const Job& job, Range& r)
+{
+    r.end = -1;
+
+    LONGLONG pos = r.begin;
+
+    if (r.bSync)
+        pos = ElementReader::FindCluster(job.pReader, pos, r.limit, job.stop);
+
+    if (pos < 0)  //no cluster starts in this range
+        return;
+
+    while (pos < r.limit)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(job.pReader, pos, job.stop, e))
+            return;
+
+        r.starts.push_back(pos);
+
+        if (e.id == ElementReader::kClusterID)
+        {
+            LONGLONG next;
+
+            const bool b = ScanCluster(
+                            job.pReader,
+                            pos,
+                            e,
+                            job.stop,
+                            job.segment_start,
+                            job.track,
+                            job.scale,
+                            r.entries,
+                            next);
+
+            if (!b)
+                return;
+
+            pos = next;
+        }
+        else if (e.size < 0)
+            return;
+        else
+            pos = e.pos + e.size;
+    }
+
+    r.end = pos;
+}
+
+
+unsigned __stdcall ThreadProc(void* pv)
+{
+    Job& job = *static_cast<Job*>(pv);
+
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"mkvparser.scanner",
+            WebmMfUtil::kThreadClassBackground);
+
+    const LONG count = static_cast<LONG>(job.ranges.size());
+
+    for (;;)
+    {
+        const LONG i = InterlockedIncrement(&job.next_range) - 1;
+
+        if (i >= count)
+            break;
+
+        Walk(job, job.ranges[i]);
+    }
+
+    return 0;
+}
+
+}  //end unnamed namespace
+
+
+HRESULT ClusterScanner::Scan(
+    IMkvReader* pReader,
+    const Segment* pSegment,
+    const Track* pTrack,
+    ULONG thread_count,
+    std::vector<webmdshow::WebmIndexEntry>& entries)
+{
+    entries.clear();
+
+    if ((pReader == 0) || (pSegment == 0) || (pTrack == 0))
+        return E_POINTER;
+
+    const SegmentInfo* const pInfo = pSegment->GetInfo();
+
+    if (pInfo == 0)
+        return E_INVALIDARG;
+
+    LONGLONG total, available;
+
+    if (pReader->Length(&total, &available) < 0)
+        return E_FAIL;
+
+    Job job;
+
+    job.pReader = pReader;
+    job.segment_start = pSegment->m_start;
+    job.stop = available;
+    job.track = pTrack->GetNumber();
+    job.scale = pInfo->GetTimeCodeScale();
+    job.next_range = 0;
+
+    if (pSegment->m_size >= 0)
+        job.stop = (std::min)(job.stop, pSegment->m_start + pSegment->m_size);
+
+    const LONGLONG size = job.stop - job.segment_start;
+
+    if (size <= 0)
+        return S_OK;
+
+    if (thread_count == 0)
+        thread_count = ULONG(webmdshow::GetLogicalProcessorCount());
+
+    //A few ranges per thread, so a thread whose range is slow to read
+    //doesn't hold up the rest.
+
+    LONGLONG count = (std::max)(size / kMinRange, LONGLONG(1));
+    count = (std::min)(count, LONGLONG(4) * thread_count);
+
+    thread_count = (std::min)(thread_count, ULONG(count));
+    thread_count = (std::min)(thread_count, ULONG(MAXIMUM_WAIT_OBJECTS));
+    thread_count = (std::max)(thread_count, ULONG(1));
+
+    job.ranges.resize(static_cast<size_t>(count));
+
+    for (LONGLONG i = 0; i < count; ++i)
+    {
+        Range& r = job.ranges[static_cast<size_t>(i)];
+
+        r.begin = job.segment_start + (size * i) / count;
+        r.limit = job.segment_start + (size * (i + 1)) / count;
+        r.bSync = (i > 0);  //the first walks the headers too
+        r.end = -1;
+    }
+
+    std::vector<HANDLE> threads;
+
+    for (ULONG i = 0; i < thread_count; ++i)
+    {
+        const uintptr_t h = _beginthreadex(0, 0, &ThreadProc, &job, 0, 0);
+
+        if (h == 0)
+            break;  //just use the threads we have
+
+        threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
+
+    if (threads.empty())
+        ThreadProc(&job);
+    else
+    {
+        const DWORD n = static_cast<DWORD>(threads.size());
+
+        const DWORD dw = WaitForMultipleObjects(n, &threads[0], TRUE, INFINITE);
+        dw;
+        assert(dw != WAIT_FAILED);
+
+        for (DWORD i = 0; i < n; ++i)
+        {
+            const BOOL b = CloseHandle(threads[i]);
+            b;
+            assert(b);
+        }
+    }
+
+    //Join the ranges.  pos is where the walk so far stopped, and so the
+    //start of the next level 1 element.
+
+    typedef std::vector<Range>::iterator iter_t;
+
+    iter_t i = job.ranges.begin();
+    const iter_t j = job.ranges.end();
+
+    entries.swap(i->entries);
+    LONGLONG pos = i->end;
+
+    while (++i != j)
+    {
+        if (pos < 0)  //damaged or truncated
+            return S_FALSE;
+
+        Range& r = *i;
+
+        if (pos >= r.limit)  //an element spans the range
+            continue;
+
+        const bool bJoined = std::binary_search(
+                                r.starts.begin(),
+                                r.starts.end(),
+                                pos);
+
+        if (!bJoined)
+        {
+            Range s;
+
+            s.begin = pos;
+            s.limit = r.limit;
+            s.bSync = false;
+
+            Walk(job, s);
+
+            entries.insert(entries.end(), s.entries.begin(), s.entries.end());
+            pos = s.end;
+
+            continue;
+        }
+
+        typedef std::vector<webmdshow::WebmIndexEntry>::const_iterator e_t;
+
+        for (e_t k = r.entries.begin(); k != r.entries.end(); ++k)
+        {
+            if ((job.segment_start + k->pos) >= pos)
+                entries.push_back(*k);
+        }
+
+        pos = r.end;
+    }
+
+    return (pos < 0) ? S_FALSE : S_OK;
+}
+
+
+}  //end namespace mkvparser
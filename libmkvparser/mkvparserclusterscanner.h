@@ -0,0 +1,60 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "webmindex.h"
+#include <vector>
+
+namespace mkvparser
+{
+
+class IMkvReader;
+class Segment;
+class Track;
+
+//Builds the seek index of a segment that has no Cues, without loading
+//its clusters into the Segment.  The payload of the segment is divided
+//into byte ranges, one per thread.  Each thread syncs on the first
+//Cluster ID in its range, then walks the clusters by their sizes,
+//reading only the cluster's timecode and the block headers up to the
+//first keyframe of the track.
+//
+//The ranges are joined in order.  The clusters of a range are kept only
+//from the position where the walk of the range before it stopped, so a
+//false sync (a Cluster ID inside some frame) adds nothing.  If the walk
+//of a range never reaches that position, the range is walked again from
+//there, on the calling thread.
+//
+//The reader's Read must be safe to call from several threads at once.
+//Link with common.lib.
+
+class ClusterScanner
+{
+    ClusterScanner();
+    ClusterScanner(const ClusterScanner&);
+    ClusterScanner& operator=(const ClusterScanner&);
+
+public:
+
+    //Gets each cluster of the segment that holds a keyframe of the
+    //track, in file order, as the sidecar index stores them.  If
+    //thread_count is 0, a thread is used per logical processor.  The
+    //result is S_FALSE if the walk stopped early on a damaged or
+    //truncated cluster; the entries found before it are kept.
+    static HRESULT Scan(
+        IMkvReader*,
+        const Segment*,
+        const Track*,
+        ULONG thread_count,
+        std::vector<webmdshow::WebmIndexEntry>& entries);
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,378 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "mkvparserelementreader.h"
+#include "mkvparser.hpp"
+#include "crc32.h"
+#include <emmintrin.h>
+#include <intrin.h>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+const LONG kSyncBufferSize = 256 * 1024;
+const LONG kCrcBufferSize = 256 * 1024;
+
+
+//The offset of the first Cluster ID in buf, from offset i, among the n
+//offsets at which a whole ID fits (buf holds n + 3 bytes).  The first
+//two bytes of the ID are compared at 16 offsets at once, which rules out
+//nearly all of them; the last two are checked one candidate at a time.
+//Returns n if there is none.
+
+LONG FindClusterID(const BYTE* buf, LONG i, LONG n)
+{
+    const __m128i id0 = _mm_set1_epi8(0x1F);
+    const __m128i id1 = _mm_set1_epi8(0x43);
+
+    for (; (i + 16) <= n; i += 16)
+    {
+        const __m128i* const p = reinterpret_cast<const __m128i*>(buf + i);
+
+        const __m128i b0 = _mm_loadu_si128(p);
+        const __m128i b1 = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(buf + i + 1));
+
+        const __m128i m = _mm_and_si128(
+                            _mm_cmpeq_epi8(b0, id0),
+                            _mm_cmpeq_epi8(b1, id1));
+
+        ULONG mask = static_cast<ULONG>(_mm_movemask_epi8(m));
+
+        while (mask)
+        {
+            ULONG bit;
+            _BitScanForward(&bit, mask);
+
+            const LONG k = i + static_cast<LONG>(bit);
+
+            if ((buf[k + 2] == 0xB6) && (buf[k + 3] == 0x75))
+                return k;
+
+            mask &= mask - 1;
+        }
+    }
+
+    for (; i < n; ++i)
+    {
+        if ((buf[i] == 0x1F) && (buf[i + 1] == 0x43) &&
+            (buf[i + 2] == 0xB6) && (buf[i + 3] == 0x75))
+        {
+            return i;
+        }
+    }
+
+    return n;
+}
+
+
+//Whether the Cluster ID at start begins a cluster: its size fits, and
+//its first child is one that a cluster starts with.
+
+bool IsCluster(IMkvReader* pReader, LONGLONG start, LONGLONG stop)
+{
+    typedef ElementReader::Element Element;
+
+    Element c;
+
+    if (!ElementReader::ReadHeader(pReader, start, stop, c))
+        return false;
+
+    const LONGLONG end = (c.size >= 0) ? c.pos + c.size : stop;
+
+    Element e;
+
+    if (!ElementReader::ReadHeader(pReader, c.pos, end, e))
+        return false;
+
+    if (e.id == ElementReader::kTimecodeID)
+    {
+        LONGLONG timecode;
+        return ElementReader::ReadUInt(pReader, e, timecode);
+    }
+
+    return (e.id == ElementReader::kCrc32ID) ||
+           (e.id == ElementReader::kVoidID);
+}
+
+}  //end unnamed namespace
+
+
+bool ElementReader::ReadHeader(
+    IMkvReader* pReader,
+    LONGLONG pos,
+    LONGLONG stop,
+    Element& e)
+{
+    BYTE buf[12];  //a 4-byte ID, and an 8-byte size
+
+    const LONGLONG avail = stop - pos;
+
+    if (avail < 2)
+        return false;
+
+    const LONG len = static_cast<LONG>((std::min)(avail, LONGLONG(12)));
+
+    if (pReader->Read(pos, len, buf) != 0)
+        return false;
+
+    const BYTE b = buf[0];
+
+    if (b < 0x10)  //not a 1- to 4-byte ID
+        return false;
+
+    LONG id_len = 1;
+
+    while ((b & (0x80 >> (id_len - 1))) == 0)
+        ++id_len;
+
+    if (id_len >= len)
+        return false;
+
+    ULONG id = b;
+
+    for (LONG i = 1; i < id_len; ++i)
+        id = (id << 8) | buf[i];
+
+    const BYTE s = buf[id_len];
+
+    if (s == 0)  //size wider than 8 bytes
+        return false;
+
+    LONG size_len = 1;
+    BYTE m = 0x80;
+
+    while ((s & m) == 0)
+    {
+        ++size_len;
+        m >>= 1;
+    }
+
+    if ((id_len + size_len) > len)
+        return false;
+
+    ULONGLONG size = s & (m - 1);
+    bool bUnknown = (size == ULONGLONG(m - 1));
+
+    for (LONG i = 1; i < size_len; ++i)
+    {
+        const BYTE x = buf[id_len + i];
+
+        size = (size << 8) | x;
+        bUnknown = bUnknown && (x == 0xFF);
+    }
+
+    e.id = id;
+    e.start = pos;
+    e.pos = pos + id_len + size_len;
+    e.size = bUnknown ? kUnknownSize : LONGLONG(size);
+
+    if (bUnknown)
+        return true;
+
+    return (e.size <= (stop - e.pos));
+}
+
+
+bool ElementReader::ReadUInt(
+    IMkvReader* pReader,
+    const Element& e,
+    LONGLONG& val)
+{
+    if ((e.size <= 0) || (e.size > 8))
+        return false;
+
+    BYTE buf[8];
+
+    const LONG len = static_cast<LONG>(e.size);
+
+    if (pReader->Read(e.pos, len, buf) != 0)
+        return false;
+
+    ULONGLONG x = 0;
+
+    for (LONG i = 0; i < len; ++i)
+        x = (x << 8) | buf[i];
+
+    val = static_cast<LONGLONG>(x & 0x7FFFFFFFFFFFFFFFULL);
+    return true;
+}
+
+
+bool ElementReader::ReadBlockHeader(
+    IMkvReader* pReader,
+    const Element& e,
+    LONGLONG& track,
+    LONGLONG& timecode,
+    BYTE& flags)
+{
+    BYTE buf[11];  //an 8-byte track number, the timecode, and the flags
+
+    if (e.size < 4)
+        return false;
+
+    const LONG len = static_cast<LONG>((std::min)(e.size, LONGLONG(11)));
+
+    if (pReader->Read(e.pos, len, buf) != 0)
+        return false;
+
+    const BYTE b = buf[0];
+
+    if (b == 0)
+        return false;
+
+    LONG n = 1;
+    BYTE m = 0x80;
+
+    while ((b & m) == 0)
+    {
+        ++n;
+        m >>= 1;
+    }
+
+    if ((n + 3) > len)
+        return false;
+
+    ULONGLONG t = b & (m - 1);
+
+    for (LONG i = 1; i < n; ++i)
+        t = (t << 8) | buf[i];
+
+    track = static_cast<LONGLONG>(t);
+    timecode = SHORT((buf[n] << 8) | buf[n + 1]);
+    flags = buf[n + 2];
+
+    return true;
+}
+
+
+bool ElementReader::IsClusterChild(ULONG id)
+{
+    switch (id)
+    {
+        case kTimecodeID:
+        case kSimpleBlockID:
+        case kBlockGroupID:
+        case kPositionID:
+        case kPrevSizeID:
+        case kSilentTracksID:
+        case kEncryptedBlockID:
+        case kCrc32ID:
+        case kVoidID:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+LONGLONG ElementReader::FindCluster(
+    IMkvReader* pReader,
+    LONGLONG begin,
+    LONGLONG limit,
+    LONGLONG stop)
+{
+    std::vector<BYTE> buf(kSyncBufferSize + 3);
+
+    LONGLONG pos = begin;
+
+    while (pos < limit)
+    {
+        const LONGLONG avail = (std::min)(stop, limit + 3) - pos;
+
+        if (avail < 4)
+            return -1;
+
+        const LONG len = static_cast<LONG>(
+            (std::min)(avail, LONGLONG(buf.size())));
+
+        if (pReader->Read(pos, len, &buf[0]) != 0)
+            return -1;
+
+        const LONG n = len - 3;  //a Cluster ID may straddle two reads
+
+        LONG i = FindClusterID(&buf[0], 0, n);
+
+        while (i < n)
+        {
+            const LONGLONG start = pos + i;
+
+            if (start >= limit)
+                return -1;
+
+            if (IsCluster(pReader, start, stop))
+                return start;
+
+            i = FindClusterID(&buf[0], i + 1, n);
+        }
+
+        pos += n;
+    }
+
+    return -1;
+}
+
+
+ElementReader::Crc32Result ElementReader::CheckCrc32(
+    IMkvReader* pReader,
+    const Element& e)
+{
+    if (e.size < 0)
+        return kCrc32None;
+
+    const LONGLONG stop = e.pos + e.size;
+
+    Element c;
+
+    if (!ReadHeader(pReader, e.pos, stop, c) || (c.id != kCrc32ID))
+        return kCrc32None;
+
+    if (c.size != 4)
+        return kCrc32Mismatch;
+
+    BYTE stored[4];
+
+    if (pReader->Read(c.pos, 4, stored) != 0)
+        return kCrc32ReadError;
+
+    const ULONG expected = ULONG(stored[0]) |
+                           (ULONG(stored[1]) << 8) |
+                           (ULONG(stored[2]) << 16) |
+                           (ULONG(stored[3]) << 24);
+
+    std::vector<BYTE> buf(
+        static_cast<size_t>((std::min)(stop - c.pos - 4,
+                                       LONGLONG(kCrcBufferSize))));
+
+    uint32_t crc = 0;
+    LONGLONG pos = c.pos + 4;
+
+    while (pos < stop)
+    {
+        const LONG len = static_cast<LONG>(
+            (std::min)(stop - pos, LONGLONG(buf.size())));
+
+        if (pReader->Read(pos, len, &buf[0]) != 0)
+            return kCrc32ReadError;
+
+        crc = webmdshow::Crc32(crc, &buf[0], len);
+        pos += len;
+    }
+
+    return (crc == expected) ? kCrc32Match : kCrc32Mismatch;
+}
+
+
+}  //end namespace mkvparser
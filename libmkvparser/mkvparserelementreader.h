@@ -0,0 +1,120 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+namespace mkvparser
+{
+
+class IMkvReader;
+
+//Reads EBML element headers straight from a reader, for the tools that
+//walk a segment's clusters without loading them into the Segment.  Each
+//function returns false for an element that is damaged, or that is cut
+//short by the stop position it is given.
+
+class ElementReader
+{
+    ElementReader();
+    ElementReader(const ElementReader&);
+    ElementReader& operator=(const ElementReader&);
+
+public:
+
+    //Element IDs, with their length markers, as the spec writes them.
+
+    enum
+    {
+        kSeekHeadID = 0x114D9B74,
+        kSeekID = 0x4DBB,
+        kSeekIDID = 0x53AB,
+        kSeekPositionID = 0x53AC,
+        kInfoID = 0x1549A966,
+        kDurationID = 0x4489,
+        kTracksID = 0x1654AE6B,
+        kCuesID = 0x1C53BB6B,
+        kClusterID = 0x1F43B675,
+        kTimecodeID = 0xE7,
+        kSimpleBlockID = 0xA3,
+        kBlockGroupID = 0xA0,
+        kBlockID = 0xA1,
+        kReferenceBlockID = 0xFB,
+        kPositionID = 0xA7,
+        kPrevSizeID = 0xAB,
+        kSilentTracksID = 0x5854,
+        kEncryptedBlockID = 0xAF,
+        kCrc32ID = 0xBF,
+        kVoidID = 0xEC
+    };
+
+    static const LONGLONG kUnknownSize = -1;
+
+    struct Element
+    {
+        ULONG id;
+        LONGLONG start; //of the ID
+        LONGLONG pos;   //of the payload
+        LONGLONG size;  //of the payload, or kUnknownSize
+    };
+
+    //Reads the header of the element at pos, which must end by stop, as
+    //must its payload if its size is known.
+    static bool ReadHeader(
+        IMkvReader*,
+        LONGLONG pos,
+        LONGLONG stop,
+        Element&);
+
+    //Reads the payload of an unsigned integer element.
+    static bool ReadUInt(IMkvReader*, const Element&, LONGLONG&);
+
+    //Parses the header of a Block or SimpleBlock.  The flags byte is
+    //only meaningful for a SimpleBlock.
+    static bool ReadBlockHeader(
+        IMkvReader*,
+        const Element&,
+        LONGLONG& track,
+        LONGLONG& timecode,
+        BYTE& flags);
+
+    //Whether the ID is one that a Cluster may hold.  A cluster whose size
+    //is unknown ends at the first element that isn't.
+    static bool IsClusterChild(ULONG id);
+
+    //Finds the first plausible cluster that starts in [begin, limit), to
+    //resync on after a damaged or truncated region: a Cluster ID, with a
+    //size that fits by stop, followed by a child that a cluster starts
+    //with.  The reader is read in large buffers, searched for the ID 16
+    //bytes at a time with SSE2.  Returns the position of the cluster, or
+    //-1 if there is none, or the reader fails.
+    static LONGLONG FindCluster(
+        IMkvReader*,
+        LONGLONG begin,
+        LONGLONG limit,
+        LONGLONG stop);
+
+    //Checks the payload of an element of known size (a cluster, say)
+    //against its CRC-32 element, if it has one: the CRC-32 must be its
+    //first child, and holds the CRC (little-endian) of the rest of the
+    //payload.  The payload is read in large buffers.
+
+    enum Crc32Result
+    {
+        kCrc32None,      //no CRC-32 element, or the size is unknown
+        kCrc32Match,
+        kCrc32Mismatch,  //or the CRC-32 element is damaged
+        kCrc32ReadError  //the payload couldn't be read
+    };
+
+    static Crc32Result CheckCrc32(IMkvReader*, const Element&);
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,107 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "mkvparserfilereader.h"
+#include <cassert>
+
+namespace mkvparser
+{
+
+FileReader::FileReader() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_length(0)
+{
+}
+
+
+FileReader::~FileReader()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        const BOOL b = CloseHandle(m_hFile);
+        b;
+        assert(b);
+    }
+}
+
+
+HRESULT FileReader::Open(const wchar_t* filename)
+{
+    assert(m_hFile == INVALID_HANDLE_VALUE);
+
+    m_hFile = CreateFile(
+                filename,
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                0,  //security attributes
+                OPEN_EXISTING,
+                FILE_ATTRIBUTE_READONLY,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_hFile, &size))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_length = size.QuadPart;
+    assert(m_length >= 0);
+
+    return S_OK;
+}
+
+
+int FileReader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0) || ((pos + len) > m_length))
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    //The offset travels with the request, so we never have to move
+    //the file pointer.
+
+    OVERLAPPED o;
+    memset(&o, 0, sizeof o);
+
+    o.Offset = static_cast<DWORD>(pos);
+    o.OffsetHigh = static_cast<DWORD>(pos >> 32);
+
+    DWORD cbRead;
+
+    const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, &o);
+
+    if (!b || (cbRead != DWORD(len)))
+        return -1;
+
+    return 0;
+}
+
+
+int FileReader::Length(long long* total, long long* available)
+{
+    if (total)
+        *total = m_length;
+
+    if (available)
+        *available = m_length;
+
+    return 0;
+}
+
+
+}  //end namespace mkvparser
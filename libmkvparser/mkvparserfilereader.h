@@ -0,0 +1,40 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "mkvparser.hpp"
+
+namespace mkvparser
+{
+
+//An IMkvReader over a local file, all of which is available.  Reads
+//carry their own offset, so one reader may be used by several threads.
+
+class FileReader : public IMkvReader
+{
+    FileReader(const FileReader&);
+    FileReader& operator=(const FileReader&);
+
+public:
+    FileReader();
+    virtual ~FileReader();
+
+    HRESULT Open(const wchar_t*);
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+private:
+    HANDLE m_hFile;
+    LONGLONG m_length;
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,683 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "mkvparserframeserver.h"
+#include "mkvparser.hpp"
+#include "mkvparserfilereader.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vp8dx.h"
+#include "taskpool.h"
+#include "vp8frameinfo.h"
+#include "vpxframecache.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <new>
+#include <vector>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+struct Job;
+
+//A reader and a decoder, which one task at a time borrows from the job.
+
+class Decoder
+{
+    Decoder(const Decoder&);
+    Decoder& operator=(const Decoder&);
+
+public:
+    Decoder();
+    ~Decoder();
+
+    HRESULT Open(const wchar_t*);
+
+    //Returns the keyframe to decode from for a frame at time_ns, or 0.
+    const BlockEntry* Find(LONGLONG time_ns);
+
+    //Decodes from the keyframe at or before key_ns, and serves the
+    //requests order[first, last), which all need that keyframe.
+    void Serve(Job&, LONGLONG key_ns, ULONG first, ULONG last);
+
+private:
+    FileReader m_file;
+    Segment* m_pSegment;
+    const Track* m_pTrack;
+    bool m_bVP8;
+
+    vpx_codec_ctx_t m_ctx;
+    bool m_bDecoder;
+
+    std::vector<unsigned char> m_buf;
+
+    //A copy of the last frame shown, made when the next block may show
+    //nothing (a VP8 alt-ref frame, say) but a request needs a frame at
+    //its time: decoding the block invalidates the decoder's image.
+    std::vector<uint8_t> m_held_buf;
+    vpx_image_t m_held;
+
+    const BlockEntry* GetNext(const BlockEntry*);
+
+    HRESULT Decode(
+        Job&,
+        const Block*,
+        bool wanted,
+        const vpx_image_t*&,
+        bool& shown);
+
+};
+
+
+//What the tasks of one Serve call share.
+
+struct Job
+{
+    const wchar_t* filename;
+    const LONGLONG* times_ns;
+    FrameServer::Callback callback;
+    void* context;
+
+    std::vector<ULONG> order;  //request indexes, by time
+
+    CRITICAL_SECTION lock;
+    std::vector<Decoder*> idle;
+    HRESULT hrError;  //the first failure
+
+    volatile LONG ok;
+    FrameServer::Stats stats;
+};
+
+
+void Deliver(
+    Job& job,
+    ULONG idx,
+    LONGLONG frame_ns,
+    const vpx_image_t* img,
+    HRESULT hr)
+{
+    FrameServer::Frame f;
+
+    f.index = idx;
+    f.time_ns = job.times_ns[idx];
+    f.frame_ns = (hr == S_OK) ? frame_ns : -1;
+    f.image = (hr == S_OK) ? img : 0;
+    f.hr = hr;
+
+    job.callback(job.context, f);
+
+    if (hr == S_OK)
+        InterlockedIncrement(&job.ok);
+
+    else if (FAILED(hr))
+    {
+        EnterCriticalSection(&job.lock);
+
+        if (job.hrError == S_FALSE)
+            job.hrError = hr;
+
+        LeaveCriticalSection(&job.lock);
+    }
+}
+
+
+Decoder* Acquire(Job& job, HRESULT& hr)
+{
+    EnterCriticalSection(&job.lock);
+
+    Decoder* pDecoder = 0;
+
+    if (!job.idle.empty())
+    {
+        pDecoder = job.idle.back();
+        job.idle.pop_back();
+    }
+
+    LeaveCriticalSection(&job.lock);
+
+    hr = S_OK;
+
+    if (pDecoder)
+        return pDecoder;
+
+    pDecoder = new (std::nothrow) Decoder;
+
+    if (pDecoder == 0)
+    {
+        hr = E_OUTOFMEMORY;
+        return 0;
+    }
+
+    hr = pDecoder->Open(job.filename);
+
+    if (FAILED(hr))
+    {
+        delete pDecoder;
+        return 0;
+    }
+
+    InterlockedIncrement(&job.stats.readers);
+    return pDecoder;
+}
+
+
+void Release(Job& job, Decoder* pDecoder)
+{
+    EnterCriticalSection(&job.lock);
+    job.idle.push_back(pDecoder);
+    LeaveCriticalSection(&job.lock);
+}
+
+
+Decoder::Decoder() :
+    m_pSegment(0),
+    m_pTrack(0),
+    m_bVP8(false),
+    m_bDecoder(false)
+{
+}
+
+
+Decoder::~Decoder()
+{
+    if (m_bDecoder)
+    {
+        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        err;
+        assert(err == VPX_CODEC_OK);
+    }
+
+    delete m_pSegment;
+}
+
+
+HRESULT Decoder::Open(const wchar_t* filename)
+{
+    HRESULT hr = m_file.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    long long result = h.Parse(&m_file, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = Segment::CreateInstance(&m_file, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    result = m_pSegment->ParseHeaders();
+
+    if (result < 0)
+        return E_FAIL;
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return E_FAIL;
+
+    vpx_codec_iface_t* vpx = 0;
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack == 0) || (pTrack->GetType() != 1))  //not video
+            continue;
+
+        const char* const id = pTrack->GetCodecId();
+
+        if (id == 0)
+            continue;
+
+        if (_stricmp(id, "V_VP8") == 0)
+        {
+            vpx = &vpx_codec_vp8_dx_algo;
+            m_bVP8 = true;
+        }
+        else if (_stricmp(id, "V_VP9") == 0)
+            vpx = &vpx_codec_vp9_dx_algo;
+
+        else
+            continue;
+
+        m_pTrack = pTrack;
+        break;
+    }
+
+    if (m_pTrack == 0)
+        return E_FAIL;
+
+    if (m_pSegment->GetCues())
+        __noop;
+    else if (const SeekHead* pSH = m_pSegment->GetSeekHead())
+    {
+        const int count = pSH->GetCount();
+
+        for (int idx = 0; idx < count; ++idx)
+        {
+            const SeekHead::Entry* const p = pSH->GetEntry(idx);
+
+            if (p->id == 0x0C53BB6B)  //Cues ID
+            {
+                long len;
+
+                const long status = m_pSegment->ParseCues(p->pos, pos, len);
+                status;
+                assert(status >= 0);  //all data available in local file
+
+                break;
+            }
+        }
+    }
+
+    //The GOPs are already spread over the pool, so the decoder gets no
+    //threads of its own.
+
+    vpx_codec_dec_cfg_t cfg = {0};
+    cfg.threads = 1;
+
+    const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, vpx, &cfg, 0);
+
+    if (err == VPX_CODEC_MEM_ERROR)
+        return E_OUTOFMEMORY;
+
+    if (err != VPX_CODEC_OK)
+        return E_FAIL;
+
+    m_bDecoder = true;
+    return S_OK;
+}
+
+
+const BlockEntry* Decoder::Find(LONGLONG time_ns)
+{
+    if (const Cues* pCues = m_pSegment->GetCues())
+    {
+        while (!pCues->DoneParsing())
+        {
+            pCues->LoadCuePoint();
+
+            const CuePoint* const pCP = pCues->GetLast();
+            assert(pCP);
+
+            if (pCP->GetTime(m_pSegment) >= time_ns)
+                break;
+        }
+
+        const CuePoint* pCP;
+        const CuePoint::TrackPosition* pTP;
+
+        if (pCues->Find(time_ns, m_pTrack, pCP, pTP))
+        {
+            const BlockEntry* const pCurr = pCues->GetBlock(pCP, pTP);
+
+            if ((pCurr != 0) && !pCurr->EOS())
+                return pCurr;
+        }
+    }
+
+    //No Cues, or no cue point for this track: search the clusters.
+
+    const BlockEntry* pCurr;
+
+    for (;;)
+    {
+        const long status = m_pTrack->Seek(time_ns, pCurr);
+
+        if (status >= 0)
+            break;
+
+        if (status != E_BUFFER_NOT_FULL)
+            return 0;
+
+        if (m_pSegment->LoadCluster() != 0)  //error, or no more clusters
+            return 0;
+    }
+
+    if ((pCurr == 0) || pCurr->EOS())
+        return 0;
+
+    return pCurr;
+}
+
+
+const BlockEntry* Decoder::GetNext(const BlockEntry* pCurr)
+{
+    const BlockEntry* pNext;
+
+    for (;;)
+    {
+        const long status = m_pTrack->GetNext(pCurr, pNext);
+
+        if (status >= 0)
+            break;
+
+        if (status != E_BUFFER_NOT_FULL)
+            return 0;
+
+        if (m_pSegment->LoadCluster() != 0)  //error, or no more clusters
+            return 0;
+    }
+
+    if ((pNext == 0) || pNext->EOS())
+        return 0;
+
+    return pNext;
+}
+
+
+HRESULT Decoder::Decode(
+    Job& job,
+    const Block* pBlock,
+    bool wanted,
+    const vpx_image_t*& img,
+    bool& shown)
+{
+    shown = false;
+
+    const int nFrames = pBlock->GetFrameCount();
+
+    for (int idx = 0; idx < nFrames; ++idx)
+    {
+        const Block::Frame& f = pBlock->GetFrame(idx);
+
+        if (f.len <= 0)  //weird
+            return E_FAIL;
+
+        m_buf.resize(f.len);
+
+        if (f.Read(&m_file, &m_buf[0]) != 0)
+            return E_FAIL;
+
+        const unsigned int len = static_cast<unsigned int>(f.len);
+
+        //Without a VP8 frame header to say otherwise, assume that the
+        //frame may show nothing.
+
+        bool show = false;
+
+        if (m_bVP8)
+        {
+            webmdshow::Vp8FrameInfo info;
+
+            if (webmdshow::ParseVp8FrameInfo(&m_buf[0], len, &info))
+            {
+                if (!wanted && info.droppable)
+                {
+                    InterlockedIncrement(&job.stats.skipped);
+                    continue;
+                }
+
+                show = info.show_frame;
+            }
+        }
+
+        if (wanted && !show && (img != 0) && (img != &m_held))
+        {
+            webmdshow::CopyVpxImageI420(img, &m_held_buf, &m_held);
+            img = &m_held;
+        }
+
+        const vpx_codec_err_t err =
+            vpx_codec_decode(&m_ctx, &m_buf[0], len, 0, 0);
+
+        if (err != VPX_CODEC_OK)
+            return E_FAIL;
+
+        InterlockedIncrement(&job.stats.decoded);
+
+        vpx_codec_iter_t iter = 0;
+
+        while (const vpx_image_t* p = vpx_codec_get_frame(&m_ctx, &iter))
+        {
+            img = p;
+            shown = true;
+        }
+    }
+
+    return S_OK;
+}
+
+
+void Decoder::Serve(Job& job, LONGLONG key_ns, ULONG first, ULONG last)
+{
+    ULONG k = first;
+
+    const BlockEntry* pCurr = Find(key_ns);
+
+    if ((pCurr != 0) && pCurr->GetBlock()->IsKey())
+    {
+        InterlockedIncrement(&job.stats.gops);
+
+        const vpx_image_t* img = 0;
+        LONGLONG img_ns = -1;
+
+        while (k < last)
+        {
+            const Block* const pBlock = pCurr->GetBlock();
+            assert(pBlock);
+
+            const LONGLONG time_ns = pBlock->GetTime(pCurr->GetCluster());
+
+            const BlockEntry* const pNext = GetNext(pCurr);
+
+            const LONGLONG next_ns = (pNext == 0) ?
+                LLONG_MAX :
+                pNext->GetBlock()->GetTime(pNext->GetCluster());
+
+            //Whether a request needs the frame shown from this block's
+            //time until the next one's.
+            const bool wanted = job.times_ns[job.order[k]] < next_ns;
+
+            bool shown;
+
+            const HRESULT hr = Decode(job, pBlock, wanted, img, shown);
+
+            if (FAILED(hr))
+            {
+                while (k < last)
+                    Deliver(job, job.order[k++], -1, 0, hr);
+
+                return;
+            }
+
+            if (shown)
+                img_ns = time_ns;
+
+            while ((k < last) && (job.times_ns[job.order[k]] < next_ns))
+            {
+                const HRESULT hrFrame = img ? S_OK : S_FALSE;
+                Deliver(job, job.order[k++], img_ns, img, hrFrame);
+            }
+
+            if (pNext == 0)
+                break;
+
+            pCurr = pNext;
+        }
+    }
+
+    while (k < last)  //no frame at those times
+        Deliver(job, job.order[k++], -1, 0, S_FALSE);
+}
+
+
+struct TimeLess
+{
+    const LONGLONG* times_ns;
+
+    bool operator()(ULONG lhs, ULONG rhs) const
+    {
+        return times_ns[lhs] < times_ns[rhs];
+    }
+};
+
+
+void ServeGroup(Job& job, LONGLONG key_ns, ULONG first, ULONG last)
+{
+    HRESULT hr;
+
+    Decoder* const pDecoder = Acquire(job, hr);
+
+    if (pDecoder == 0)
+    {
+        for (ULONG k = first; k < last; ++k)
+            Deliver(job, job.order[k], -1, 0, hr);
+
+        return;
+    }
+
+    pDecoder->Serve(job, key_ns, first, last);
+
+    Release(job, pDecoder);
+}
+
+}  //end unnamed namespace
+
+
+HRESULT FrameServer::Serve(
+    const wchar_t* filename,
+    const LONGLONG* times_ns,
+    ULONG count,
+    Callback callback,
+    void* context,
+    Stats* stats)
+{
+    if ((filename == 0) || (callback == 0))
+        return E_INVALIDARG;
+
+    if ((count > 0) && (times_ns == 0))
+        return E_POINTER;
+
+    Job job;
+
+    job.filename = filename;
+    job.times_ns = times_ns;
+    job.callback = callback;
+    job.context = context;
+    job.hrError = S_FALSE;
+    job.ok = 0;
+
+    job.stats.gops = 0;
+    job.stats.decoded = 0;
+    job.stats.skipped = 0;
+    job.stats.readers = 0;
+
+    job.order.resize(count);
+
+    for (ULONG idx = 0; idx < count; ++idx)
+        job.order[idx] = idx;
+
+    const TimeLess less = { times_ns };
+    std::sort(job.order.begin(), job.order.end(), less);
+
+    InitializeCriticalSection(&job.lock);
+
+    //The first reader groups the requests by keyframe, on this thread,
+    //then goes back to the job for the tasks to borrow.
+
+    HRESULT hr = S_OK;
+
+    if (Decoder* const pDecoder = (count > 0) ? Acquire(job, hr) : 0)
+    {
+        struct Group
+        {
+            LONGLONG key_ns;
+            ULONG first;
+            ULONG last;
+        };
+
+        std::vector<Group> groups;
+
+        for (ULONG k = 0; k < count; ++k)
+        {
+            const BlockEntry* const pKey =
+                pDecoder->Find(times_ns[job.order[k]]);
+
+            if (pKey == 0)
+            {
+                Deliver(job, job.order[k], -1, 0, S_FALSE);
+                continue;
+            }
+
+            const LONGLONG key_ns =
+                pKey->GetBlock()->GetTime(pKey->GetCluster());
+
+            if (groups.empty() || (groups.back().key_ns != key_ns) ||
+                (groups.back().last != k))
+            {
+                const Group g = { key_ns, k, k + 1 };
+                groups.push_back(g);
+            }
+            else
+                ++groups.back().last;
+        }
+
+        Release(job, pDecoder);
+
+        {
+            webmdshow::TaskGroup tasks(webmdshow::TaskPool::GetShared());
+
+            typedef std::vector<Group>::const_iterator iter_t;
+
+            for (iter_t i = groups.begin(); i != groups.end(); ++i)
+            {
+                const Group g = *i;
+                Job* const pJob = &job;
+
+                tasks.Run([pJob, g]()
+                {
+                    ServeGroup(*pJob, g.key_ns, g.first, g.last);
+                });
+            }
+
+            tasks.Wait();
+        }
+
+        typedef std::vector<Decoder*>::const_iterator decoder_iter_t;
+
+        for (decoder_iter_t i = job.idle.begin(); i != job.idle.end(); ++i)
+            delete *i;
+    }
+    else
+    {
+        for (ULONG k = 0; k < count; ++k)
+            Deliver(job, job.order[k], -1, 0, hr);
+    }
+
+    DeleteCriticalSection(&job.lock);
+
+    if (stats)
+        *stats = job.stats;
+
+    if (ULONG(job.ok) == count)
+        return S_OK;
+
+    if (job.ok > 0)
+        return S_FALSE;
+
+    return job.hrError;
+}
+
+
+}  //end namespace mkvparser
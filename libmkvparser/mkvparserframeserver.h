@@ -0,0 +1,78 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "vpx/vpx_image.h"
+
+namespace mkvparser
+{
+
+//Serves the decoded frames of the first VP8 or VP9 track of a WebM file
+//at arbitrary times (for analysis tools that sample a video, say),
+//without running a playback graph or seeking it once per frame.
+//
+//The requests are sorted by time and grouped by the keyframe each one
+//needs decoding from, found through the Cues (or, without Cues, a search
+//of the clusters).  Each group's GOP is then decoded once, from that
+//keyframe up to the last frame the group asked for, as a task on the
+//shared TaskPool, so a large batch keeps every core busy.  Each task
+//borrows a reader and a decoder of its own, since the parser is not
+//thread-safe; they are opened as needed, at most one per task running
+//at once, and reused.  VP8 frames that are droppable, and not asked
+//for, are skipped.
+//
+//Link with common.lib and libvpx.
+
+class FrameServer
+{
+    FrameServer();
+    FrameServer(const FrameServer&);
+    FrameServer& operator=(const FrameServer&);
+
+public:
+
+    struct Frame
+    {
+        ULONG index;               //of the request
+        LONGLONG time_ns;          //requested
+        LONGLONG frame_ns;         //of the frame shown then, or -1
+        const vpx_image_t* image;  //valid during the callback only
+        HRESULT hr;                //S_FALSE means no frame at that time
+    };
+
+    //Called once per request, from the threads of the pool, and from
+    //more than one at once; the frames of a GOP come in time order.  A
+    //time before the first frame gets the first frame.
+    typedef void (*Callback)(void* context, const Frame&);
+
+    struct Stats
+    {
+        LONG gops;      //decoded, one per group of requests
+        LONG decoded;   //frames
+        LONG skipped;   //droppable frames not decoded
+        LONG readers;   //opened
+    };
+
+    //Decodes the frames shown at each of the count times in times_ns,
+    //and passes each to callback, before returning.  The result is S_OK
+    //when every request got a frame, S_FALSE when only some of them
+    //did, and the error of the first failure when none did; see
+    //Frame::hr.  Any stats are of this call.
+    static HRESULT Serve(
+        const wchar_t* filename,
+        const LONGLONG* times_ns,
+        ULONG count,
+        Callback callback,
+        void* context,
+        Stats* stats = 0);
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,311 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "mkvparsermapreader.h"
+#include <cassert>
+#include <cstring>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+//WIN32_MEMORY_RANGE_ENTRY; the SDK declares it only for Windows 8.
+
+struct MemoryRange
+{
+    void* VirtualAddress;
+    SIZE_T NumberOfBytes;
+};
+
+}  //end unnamed namespace
+
+
+MapReader::MapReader() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_length(0),
+    m_hMap(0),
+    m_pView(0),
+    m_view_pos(0),
+    m_view_len(0),
+    m_view_size(kDefaultViewSize)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    //View offsets must be a multiple of this.
+    m_granularity = info.dwAllocationGranularity;
+    assert(m_granularity > 0);
+
+    const HMODULE h = GetModuleHandleW(L"kernel32.dll");
+
+    m_pfnPrefetch = h ?
+        reinterpret_cast<PrefetchFn>(
+            GetProcAddress(h, "PrefetchVirtualMemory")) :
+        0;
+
+    InitializeCriticalSection(&m_view_lock);
+}
+
+
+MapReader::~MapReader()
+{
+    Close();
+    DeleteCriticalSection(&m_view_lock);
+}
+
+
+HRESULT MapReader::Open(const wchar_t* filename, ULONG view_size)
+{
+    if (filename == 0)
+        return E_INVALIDARG;
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+        return E_UNEXPECTED;
+
+    if (view_size == 0)
+        view_size = kDefaultViewSize;
+
+    m_view_size = view_size + m_granularity - 1;
+    m_view_size -= m_view_size % m_granularity;
+
+    m_hFile = CreateFile(
+                filename,
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                0,  //security attributes
+                OPEN_EXISTING,
+                FILE_ATTRIBUTE_READONLY,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_hFile, &size))
+    {
+        const DWORD e = GetLastError();
+        Close();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_length = size.QuadPart;
+    assert(m_length >= 0);
+
+    //A file of length 0 can't be mapped, but there's nothing to read
+    //anyway.  If mapping fails for any other reason, we read the file
+    //directly.
+
+    if (m_length > 0)
+        m_hMap = CreateFileMapping(m_hFile, 0, PAGE_READONLY, 0, 0, 0);
+
+    return S_OK;
+}
+
+
+void MapReader::Close()
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    UnmapView();
+
+    if (m_hMap)
+    {
+        const BOOL b = CloseHandle(m_hMap);
+        b;
+        assert(b);
+
+        m_hMap = 0;
+    }
+
+    const BOOL b = CloseHandle(m_hFile);
+    b;
+    assert(b);
+
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_length = 0;
+}
+
+
+int MapReader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0) || ((pos + len) > m_length))
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    if (m_hMap == 0)
+        return ReadFromFile(pos, len, buf);
+
+    EnterCriticalSection(&m_view_lock);
+
+    if ((pos < m_view_pos) || ((pos + len) > (m_view_pos + m_view_len)))
+    {
+        if (!MapView(pos, len))
+        {
+            LeaveCriticalSection(&m_view_lock);
+            return ReadFromFile(pos, len, buf);
+        }
+    }
+
+    const BYTE* const src = m_pView + (pos - m_view_pos);
+
+    const bool b = CopyFromView(buf, src, len);
+
+    LeaveCriticalSection(&m_view_lock);
+
+    return b ? 0 : -1;
+}
+
+
+int MapReader::Length(long long* total, long long* available)
+{
+    if (total)
+        *total = m_length;
+
+    if (available)
+        *available = m_length;
+
+    return 0;
+}
+
+
+int MapReader::ReadFromFile(long long pos, long len, unsigned char* buf)
+{
+    //The offset travels with the request, so we never have to move
+    //the file pointer.
+
+    OVERLAPPED o;
+    memset(&o, 0, sizeof o);
+
+    o.Offset = static_cast<DWORD>(pos);
+    o.OffsetHigh = static_cast<DWORD>(pos >> 32);
+
+    DWORD cbRead;
+
+    const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, &o);
+
+    if (!b || (cbRead != DWORD(len)))
+        return -1;
+
+    return 0;
+}
+
+
+bool MapReader::MapView(LONGLONG pos, LONG len)
+{
+    assert(m_hMap);
+    assert(pos >= 0);
+    assert(len > 0);
+
+    const LONGLONG view_pos = pos - (pos % m_granularity);
+    const LONGLONG view_end = pos + len;
+
+    if ((view_end - view_pos) > m_view_size)
+        return false;  //big read: not worth a view of its own
+
+    LONGLONG view_len = m_view_size;
+
+    if ((view_pos + view_len) > m_length)
+        view_len = m_length - view_pos;
+
+    //The parser reads the clusters front to back, so a window that
+    //starts inside the last one (or where it ends) is the next stretch
+    //of a sequential pass.  A seek (to the cues, say) is not.
+
+    const bool sequential = (m_pView != 0) &&
+                            (view_pos > m_view_pos) &&
+                            (view_pos <= (m_view_pos + m_view_len));
+
+    UnmapView();
+
+    ULARGE_INTEGER off;
+    off.QuadPart = view_pos;
+
+    void* const pView = MapViewOfFile(
+                            m_hMap,
+                            FILE_MAP_READ,
+                            off.HighPart,
+                            off.LowPart,
+                            static_cast<SIZE_T>(view_len));
+
+    if (pView == 0)
+        return false;
+
+    m_pView = static_cast<const BYTE*>(pView);
+    m_view_pos = view_pos;
+    m_view_len = view_len;
+
+    if (sequential)
+        Prefetch();
+
+    return true;
+}
+
+
+void MapReader::UnmapView()
+{
+    if (m_pView == 0)
+        return;
+
+    const BOOL b = UnmapViewOfFile(m_pView);
+    b;
+    assert(b);
+
+    m_pView = 0;
+    m_view_pos = 0;
+    m_view_len = 0;
+}
+
+
+void MapReader::Prefetch()
+{
+    if (m_pfnPrefetch == 0)
+        return;
+
+    //This only queues the reads of the pages that aren't resident, and
+    //returns at once; a failure costs us nothing but the read-ahead.
+
+    MemoryRange r;
+
+    r.VirtualAddress = const_cast<BYTE*>(m_pView);
+    r.NumberOfBytes = static_cast<SIZE_T>(m_view_len);
+
+    (*m_pfnPrefetch)(GetCurrentProcess(), 1, &r, 0);
+}
+
+
+bool MapReader::CopyFromView(void* dst, const void* src, size_t len)
+{
+    //Touching a mapped page can fail with an I/O error (e.g. the network
+    //share went away), which is reported as an exception instead of as a
+    //ReadFile failure.
+
+    __try
+    {
+        memcpy(dst, src, len);
+    }
+    __except(GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+             EXCEPTION_EXECUTE_HANDLER :
+             EXCEPTION_CONTINUE_SEARCH)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+}  //end namespace mkvparser
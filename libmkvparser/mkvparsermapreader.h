@@ -0,0 +1,73 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "mkvparser.hpp"
+
+namespace mkvparser
+{
+
+//An IMkvReader over a local file, all of which is available, that reads
+//through a mapping of the file instead of with ReadFile.  Only a window
+//of the file is mapped at a time, so a file of any size can be read in
+//the address space of a 32-bit process.  The window follows the reads:
+//when one falls outside of it, the window is mapped again around the
+//read.  When the new window continues the last one, the reads are
+//taken to be sequential, and the pages of the new window are prefetched
+//(where the system has PrefetchVirtualMemory, Windows 8 and later), so
+//that the disk reads ahead of the parser.
+//
+//Read may be called from several threads at once; the window has a lock
+//of its own.  A read that doesn't fit in a window is done with ReadFile.
+
+class MapReader : public IMkvReader
+{
+    MapReader(const MapReader&);
+    MapReader& operator=(const MapReader&);
+
+public:
+
+    enum { kDefaultViewSize = 32 * 1024 * 1024 };
+
+    MapReader();
+    virtual ~MapReader();
+
+    //The view size is rounded up to the allocation granularity.
+    HRESULT Open(const wchar_t*, ULONG view_size = kDefaultViewSize);
+    void Close();
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+private:
+
+    typedef BOOL (WINAPI* PrefetchFn)(HANDLE, ULONG_PTR, void*, ULONG);
+
+    HANDLE m_hFile;
+    LONGLONG m_length;
+
+    HANDLE m_hMap;
+    const BYTE* m_pView;
+    LONGLONG m_view_pos;
+    LONGLONG m_view_len;
+    LONGLONG m_view_size;
+    DWORD m_granularity;
+    PrefetchFn m_pfnPrefetch;  //0 if the system has none
+    CRITICAL_SECTION m_view_lock;  //guards the view
+
+    int ReadFromFile(long long pos, long len, unsigned char* buf);
+    bool MapView(LONGLONG pos, LONG len);
+    void UnmapView();
+    void Prefetch();
+    static bool CopyFromView(void*, const void*, size_t);
+
+};
+
+
+}  //end namespace mkvparser
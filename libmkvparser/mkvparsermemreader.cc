@@ -0,0 +1,56 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "mkvparsermemreader.h"
+#include <cassert>
+#include <cstring>
+
+namespace mkvparser
+{
+
+MemReader::MemReader(const unsigned char* buf, long long len) :
+    m_buf(buf),
+    m_length(len)
+{
+    assert(m_buf || (m_length == 0));
+    assert(m_length >= 0);
+}
+
+
+MemReader::~MemReader()
+{
+}
+
+
+int MemReader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0) || ((pos + len) > m_length))
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    memcpy(buf, m_buf + pos, len);
+
+    return 0;
+}
+
+
+int MemReader::Length(long long* total, long long* available)
+{
+    if (total)
+        *total = m_length;
+
+    if (available)
+        *available = m_length;
+
+    return 0;
+}
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,37 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "mkvparser.hpp"
+
+namespace mkvparser
+{
+
+//An IMkvReader over a file held in memory, all of which is available.
+//The reader does not copy the buffer, which must outlive it.
+
+class MemReader : public IMkvReader
+{
+    MemReader(const MemReader&);
+    MemReader& operator=(const MemReader&);
+
+public:
+    MemReader(const unsigned char* buf, long long len);
+    virtual ~MemReader();
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+private:
+    const unsigned char* const m_buf;
+    const long long m_length;
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,376 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "mkvparserprober.h"
+#include "mkvparserelementreader.h"
+#include "mkvparserfilereader.h"
+#include "mkvparser.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+typedef ElementReader::Element Element;
+
+const ULONG kBlockDurationID = 0x9B;
+
+//The end of the file is searched this many bytes at a time, for at most
+//kMaxTail bytes: a last cluster larger than that is not found.
+const LONG kTailChunk = 64 * 1024;
+const LONGLONG kMaxTail = 16 * 1024 * 1024;
+
+
+//Gets the timecode of the block in e, a SimpleBlock or a BlockGroup,
+//relative to its cluster.  For a group with a BlockDuration, this is
+//the time the block ends.
+
+bool GetBlockTimecode(IMkvReader* pReader, const Element& e, LONGLONG& result)
+{
+    LONGLONG track;
+    BYTE flags;
+
+    if (e.id == ElementReader::kSimpleBlockID)
+        return ElementReader::ReadBlockHeader(pReader, e, track, result, flags);
+
+    assert(e.id == ElementReader::kBlockGroupID);
+
+    LONGLONG pos = e.pos;
+    const LONGLONG stop = e.pos + e.size;
+
+    bool bBlock = false;
+    LONGLONG duration = 0;
+
+    while (pos < stop)
+    {
+        Element c;
+
+        if (!ElementReader::ReadHeader(pReader, pos, stop, c) || (c.size < 0))
+            return false;
+
+        if (c.id == ElementReader::kBlockID)
+        {
+            const bool b = ElementReader::ReadBlockHeader(
+                            pReader,
+                            c,
+                            track,
+                            result,
+                            flags);
+
+            if (!b)
+                return false;
+
+            bBlock = true;
+        }
+        else if (c.id == kBlockDurationID)
+        {
+            if (!ElementReader::ReadUInt(pReader, c, duration))
+                return false;
+        }
+
+        pos = c.pos + c.size;
+    }
+
+    if (!bBlock)
+        return false;
+
+    result += duration;
+    return true;
+}
+
+
+//Walks the children of the cluster c, and gets the timecode at which
+//its last block starts (or ends, if that is known).  Returns false if
+//the cluster is damaged, which is how a Cluster ID inside some frame is
+//told from a cluster.
+
+bool GetLastTimecode(
+    IMkvReader* pReader,
+    const Element& c,
+    LONGLONG stop,
+    LONGLONG& result)
+{
+    const bool bKnown = (c.size >= 0);
+    const LONGLONG end = bKnown ? (c.pos + c.size) : stop;
+
+    LONGLONG pos = c.pos;
+    LONGLONG cluster_timecode = -1;
+
+    bool bBlock = false;
+    LONGLONG last = 0;
+
+    while (pos < end)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(pReader, pos, end, e))
+            return false;
+
+        if (!ElementReader::IsClusterChild(e.id))
+        {
+            if (bKnown)
+                return false;
+
+            break;  //the next level 1 element
+        }
+
+        if (e.size < 0)
+            return false;
+
+        if (e.id == ElementReader::kTimecodeID)
+        {
+            if (!ElementReader::ReadUInt(pReader, e, cluster_timecode))
+                return false;
+        }
+        else if ((e.id == ElementReader::kSimpleBlockID) ||
+                 (e.id == ElementReader::kBlockGroupID))
+        {
+            LONGLONG t;
+
+            if (!GetBlockTimecode(pReader, e, t))
+                return false;
+
+            if (!bBlock || (t > last))  //blocks needn't be in time order
+                last = t;
+
+            bBlock = true;
+        }
+
+        pos = e.pos + e.size;
+    }
+
+    if (cluster_timecode < 0)
+        return false;
+
+    result = cluster_timecode + last;
+    return true;
+}
+
+
+//Searches back from stop, the end of the segment whose payload starts
+//at start, for the last cluster, and gets the timecode of its last
+//block.  Returns -1 if no cluster is found.
+
+LONGLONG GetLastClusterTimecode(
+    IMkvReader* pReader,
+    LONGLONG start,
+    LONGLONG stop)
+{
+    std::vector<BYTE> buf(kTailChunk + 3);
+
+    const LONGLONG floor = (std::max)(start, stop - kMaxTail);
+
+    LONGLONG limit = stop;  //the candidates start before this
+
+    while (limit > floor)
+    {
+        const LONGLONG pos = (std::max)(floor, limit - kTailChunk);
+
+        //A Cluster ID may straddle the limit.
+        const LONG len = static_cast<LONG>((std::min)(stop, limit + 3) - pos);
+
+        if (len < 4)
+            break;
+
+        if (pReader->Read(pos, len, &buf[0]) != 0)
+            return -1;
+
+        for (LONG i = static_cast<LONG>(limit - pos) - 1; i >= 0; --i)
+        {
+            if ((i + 4) > len)
+                continue;
+
+            if ((buf[i] != 0x1F) || (buf[i + 1] != 0x43) ||
+                (buf[i + 2] != 0xB6) || (buf[i + 3] != 0x75))
+            {
+                continue;
+            }
+
+            Element c;
+
+            if (!ElementReader::ReadHeader(pReader, pos + i, stop, c))
+                continue;
+
+            LONGLONG result;
+
+            if (GetLastTimecode(pReader, c, stop, result))
+                return result;
+        }
+
+        limit = pos;
+    }
+
+    return -1;
+}
+
+
+void GetTracks(const Segment* pSegment, Prober::Info& info)
+{
+    const Tracks* const pTracks = pSegment->GetTracks();
+    assert(pTracks);
+
+    const unsigned long count = pTracks->GetTracksCount();
+
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if (pTrack == 0)
+            continue;
+
+        Prober::TrackInfo t;
+
+        t.number = pTrack->GetNumber();
+        t.type = pTrack->GetType();
+
+        if (const char* id = pTrack->GetCodecId())
+            t.codec_id = id;
+
+        if (const char* name = pTrack->GetNameAsUTF8())
+            t.name = name;
+
+        t.width = 0;
+        t.height = 0;
+        t.frame_rate = 0;
+        t.sample_rate = 0;
+        t.channels = 0;
+
+        if (t.type == 1)  //video
+        {
+            const VideoTrack* const pVideo =
+                static_cast<const VideoTrack*>(pTrack);
+
+            t.width = pVideo->GetWidth();
+            t.height = pVideo->GetHeight();
+            t.frame_rate = pVideo->GetFrameRate();
+        }
+        else if (t.type == 2)  //audio
+        {
+            const AudioTrack* const pAudio =
+                static_cast<const AudioTrack*>(pTrack);
+
+            t.sample_rate = pAudio->GetSamplingRate();
+            t.channels = pAudio->GetChannels();
+        }
+
+        info.tracks.push_back(t);
+    }
+}
+
+
+HRESULT ProbeSegment(
+    IMkvReader* pReader,
+    Segment* pSegment,
+    ULONG flags,
+    Prober::Info& info)
+{
+    //This parses the level 1 elements up to the first cluster, and no
+    //further.
+
+    const long status = pSegment->ParseHeaders();
+
+    if (status != 0)
+        return E_FAIL;
+
+    const SegmentInfo* const pInfo = pSegment->GetInfo();
+
+    if (pInfo == 0)
+        return E_FAIL;
+
+    if (pSegment->GetTracks() == 0)
+        return E_FAIL;
+
+    GetTracks(pSegment, info);
+
+    info.duration_ns = pInfo->GetDuration();
+
+    if ((info.duration_ns >= 0) || (flags & Prober::kNoTailSearch))
+        return S_OK;
+
+    LONGLONG stop;
+
+    if (pSegment->m_size >= 0)
+        stop = pSegment->m_start + pSegment->m_size;
+    else
+    {
+        long long total, available;
+
+        if ((pReader->Length(&total, &available) < 0) || (total < 0))
+            return S_OK;  //no end to search back from
+
+        if (available < total)
+            return S_OK;  //the end of the file isn't here yet
+
+        stop = total;
+    }
+
+    const LONGLONG timecode =
+        GetLastClusterTimecode(pReader, pSegment->m_start, stop);
+
+    if (timecode < 0)
+        return S_OK;
+
+    info.duration_ns = timecode * pInfo->GetTimeCodeScale();
+    info.duration_estimated = true;
+
+    return S_OK;
+}
+
+}  //end unnamed namespace
+
+
+HRESULT Prober::Probe(IMkvReader* pReader, ULONG flags, Info& info)
+{
+    info.duration_ns = -1;
+    info.duration_estimated = false;
+    info.tracks.clear();
+
+    if (pReader == 0)
+        return E_INVALIDARG;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    if (h.Parse(pReader, pos) != 0)
+        return E_FAIL;
+
+    Segment* pSegment;
+
+    const long long status = Segment::CreateInstance(pReader, pos, pSegment);
+
+    if (status != 0)
+        return E_FAIL;
+
+    assert(pSegment);
+
+    const HRESULT hr = ProbeSegment(pReader, pSegment, flags, info);
+
+    delete pSegment;
+
+    return hr;
+}
+
+
+HRESULT Prober::Probe(const wchar_t* filename, Info& info)
+{
+    FileReader file;
+
+    const HRESULT hr = file.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    return Probe(&file, 0, info);
+}
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,75 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+namespace mkvparser
+{
+
+class IMkvReader;
+
+//Reads what a media library shows of a file (its duration, and its
+//tracks with their dimensions) without loading the segment.  Only the
+//EBML header and the level 1 elements before the first cluster (Info
+//and Tracks among them) are parsed.  When Info has no Duration, the
+//duration is estimated from the last cluster, which is found by
+//searching back from the end of the segment instead of by walking the
+//clusters from the front.
+
+class Prober
+{
+    Prober();
+    Prober(const Prober&);
+    Prober& operator=(const Prober&);
+
+public:
+
+    struct TrackInfo
+    {
+        LONGLONG number;
+        LONGLONG type;        //1 video, 2 audio, 0x11 subtitle, 0x21 metadata
+        std::string codec_id;
+        std::string name;     //UTF-8; empty if the track has none
+        LONGLONG width;       //video only; 0 otherwise
+        LONGLONG height;
+        double frame_rate;    //video only; 0 if unknown
+        double sample_rate;   //audio only; 0 otherwise
+        LONGLONG channels;
+    };
+
+    struct Info
+    {
+        LONGLONG duration_ns;     //-1 if unknown
+        bool duration_estimated;  //from the last cluster, not from Info
+        std::vector<TrackInfo> tracks;
+    };
+
+    enum
+    {
+        //Don't read from the end of the file (a stream that is still
+        //being downloaded, say).  Without a Duration in Info, the
+        //duration is then unknown.
+        kNoTailSearch = 1
+    };
+
+    //The reader need only be able to read the start and the end of the
+    //file.  Returns E_FAIL if the file is not a WebM (or Matroska) file,
+    //or if its headers are damaged.
+    static HRESULT Probe(IMkvReader*, ULONG flags, Info&);
+
+    //For the DirectShow callers, which (as with IMediaDet) have the name
+    //of a local file.
+    static HRESULT Probe(const wchar_t* filename, Info&);
+
+};
+
+
+}  //end namespace mkvparser
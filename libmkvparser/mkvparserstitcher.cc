@@ -0,0 +1,869 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "mkvparserstitcher.h"
+#include "mkvparser.hpp"
+#include "mkvparserfilereader.h"
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+typedef std::vector<BYTE> bytes_t;
+
+enum
+{
+    kSegmentID = 0x18538067,
+    kSeekHeadID = 0x114D9B74,
+    kSeekID = 0x4DBB,
+    kSeekIDID = 0x53AB,
+    kSeekPositionID = 0x53AC,
+    kInfoID = 0x1549A966,
+    kTimecodeScaleID = 0x2AD7B1,
+    kDurationID = 0x4489,
+    kMuxingAppID = 0x4D80,
+    kWritingAppID = 0x5741,
+    kTracksID = 0x1654AE6B,
+    kClusterID = 0x1F43B675,
+    kTimecodeID = 0xE7,
+    kCuesID = 0x1C53BB6B,
+    kCuePointID = 0xBB,
+    kCueTimeID = 0xB3,
+    kCueTrackPositionsID = 0xB7,
+    kCueTrackID = 0xF7,
+    kCueClusterPositionID = 0xF1
+};
+
+
+void PutID(bytes_t& out, ULONG id)
+{
+    int n;
+
+    if (id & 0xFF000000)
+        n = 4;
+    else if (id & 0x00FF0000)
+        n = 3;
+    else if (id & 0x0000FF00)
+        n = 2;
+    else
+        n = 1;
+
+    while (n > 0)
+        out.push_back(BYTE(id >> (8 * --n)));
+}
+
+
+//Sizes are always written in 8 bytes, so that a size may be patched
+//after the fact, and so that we never have to measure one first.
+
+void PutSize(bytes_t& out, ULONGLONG size)
+{
+    out.push_back(0x01);
+
+    for (int n = 7; n > 0; )
+        out.push_back(BYTE(size >> (8 * --n)));
+}
+
+
+void PutUInt(bytes_t& out, ULONG id, ULONGLONG value)
+{
+    int n = 1;
+
+    while ((n < 8) && (value >> (8 * n)))
+        ++n;
+
+    PutID(out, id);
+    out.push_back(BYTE(0x80 | n));
+
+    while (n > 0)
+        out.push_back(BYTE(value >> (8 * --n)));
+}
+
+
+void PutFixedUInt(bytes_t& out, ULONG id, ULONGLONG value)
+{
+    PutID(out, id);
+    out.push_back(0x88);
+
+    for (int n = 8; n > 0; )
+        out.push_back(BYTE(value >> (8 * --n)));
+}
+
+
+void PutFloat(bytes_t& out, ULONG id, double value)
+{
+    ULONGLONG bits;
+    memcpy(&bits, &value, sizeof bits);
+
+    PutFixedUInt(out, id, bits);
+}
+
+
+void PutString(bytes_t& out, ULONG id, const char* str)
+{
+    const size_t len = strlen(str);
+
+    PutID(out, id);
+    PutSize(out, len);
+
+    out.insert(out.end(), str, str + len);
+}
+
+
+void PutMaster(bytes_t& out, ULONG id, const bytes_t& body)
+{
+    PutID(out, id);
+    PutSize(out, body.size());
+
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+
+//The SeekHead has a fixed layout, so we can reserve it up front and
+//fill it in once the positions of the other elements are known.
+
+void PutSeekHead(bytes_t& out, const LONGLONG* pos, const ULONG* ids, int n)
+{
+    bytes_t head;
+
+    for (int i = 0; i < n; ++i)
+    {
+        bytes_t id;
+        PutID(id, ids[i]);
+
+        bytes_t seek;
+        PutMaster(seek, kSeekIDID, id);
+        PutFixedUInt(seek, kSeekPositionID, pos[i]);
+
+        PutMaster(head, kSeekID, seek);
+    }
+
+    PutMaster(out, kSeekHeadID, head);
+}
+
+
+bool GetID(const BYTE*& p, const BYTE* end, ULONG& id)
+{
+    if (p >= end)
+        return false;
+
+    const BYTE b = *p;
+    int n;
+
+    if (b & 0x80)
+        n = 1;
+    else if (b & 0x40)
+        n = 2;
+    else if (b & 0x20)
+        n = 3;
+    else if (b & 0x10)
+        n = 4;
+    else
+        return false;
+
+    if ((end - p) < n)
+        return false;
+
+    id = 0;
+
+    while (n-- > 0)
+        id = (id << 8) | *p++;
+
+    return true;
+}
+
+
+bool GetSize(const BYTE*& p, const BYTE* end, ULONGLONG& size)
+{
+    if (p >= end)
+        return false;
+
+    const BYTE b = *p;
+
+    int n = 1;
+    BYTE mask = 0x80;
+
+    while ((n <= 8) && !(b & mask))
+    {
+        ++n;
+        mask >>= 1;
+    }
+
+    if ((n > 8) || ((end - p) < n))
+        return false;
+
+    size = b & (mask - 1);
+    bool unknown = (size == ULONGLONG(mask - 1));
+
+    for (int i = 1; i < n; ++i)
+    {
+        unknown = unknown && (p[i] == 0xFF);
+        size = (size << 8) | p[i];
+    }
+
+    p += n;
+
+    if (unknown)
+        size = ULONGLONG(end - p);  //rest of the buffer
+
+    return true;
+}
+
+
+class Writer
+{
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+
+public:
+    Writer();
+    ~Writer();
+
+    HRESULT Open(const wchar_t*);
+    HRESULT Close();
+
+    void Write(const bytes_t&);
+    void Write(const void*, size_t);
+    HRESULT Patch(LONGLONG pos, const bytes_t&);
+
+    LONGLONG GetPosition() const;
+
+private:
+    enum { kBufferSize = 1024 * 1024 };
+
+    HANDLE m_hFile;
+    LONGLONG m_flushed;  //bytes written to the file
+    bytes_t m_buf;
+    HRESULT m_hr;        //of the first failed write
+
+    HRESULT Flush();
+    HRESULT SetFilePosition(LONGLONG);
+
+};
+
+
+Writer::Writer() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_flushed(0),
+    m_hr(S_OK)
+{
+}
+
+
+Writer::~Writer()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        const BOOL b = CloseHandle(m_hFile);
+        b;
+        assert(b);
+    }
+}
+
+
+HRESULT Writer::Open(const wchar_t* filename)
+{
+    assert(m_hFile == INVALID_HANDLE_VALUE);
+
+    m_hFile = CreateFile(
+                filename,
+                GENERIC_WRITE,
+                0,  //no sharing
+                0,  //security attributes
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_buf.reserve(kBufferSize);
+
+    return S_OK;
+}
+
+
+HRESULT Writer::Close()
+{
+    const HRESULT hr = Flush();
+
+    const BOOL b = CloseHandle(m_hFile);
+    b;
+    assert(b);
+
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    return hr;
+}
+
+
+void Writer::Write(const bytes_t& buf)
+{
+    if (!buf.empty())
+        Write(&buf[0], buf.size());
+}
+
+
+void Writer::Write(const void* buf, size_t len)
+{
+    if ((m_buf.size() + len) > kBufferSize)
+    {
+        Flush();
+
+        if (len >= kBufferSize)  //cluster, say: write it directly
+        {
+            DWORD cb;
+
+            const BOOL b = WriteFile(m_hFile, buf, DWORD(len), &cb, 0);
+
+            if (!b && SUCCEEDED(m_hr))
+            {
+                const DWORD e = GetLastError();
+                m_hr = HRESULT_FROM_WIN32(e);
+            }
+
+            m_flushed += len;
+            return;
+        }
+    }
+
+    const BYTE* const src = static_cast<const BYTE*>(buf);
+    m_buf.insert(m_buf.end(), src, src + len);
+}
+
+
+HRESULT Writer::Flush()
+{
+    if (!m_buf.empty())
+    {
+        DWORD cb;
+
+        const BOOL b = WriteFile(
+                        m_hFile,
+                        &m_buf[0],
+                        DWORD(m_buf.size()),
+                        &cb,
+                        0);
+
+        if (!b && SUCCEEDED(m_hr))
+        {
+            const DWORD e = GetLastError();
+            m_hr = HRESULT_FROM_WIN32(e);
+        }
+
+        m_flushed += m_buf.size();
+        m_buf.clear();
+    }
+
+    return m_hr;
+}
+
+
+HRESULT Writer::SetFilePosition(LONGLONG pos)
+{
+    LARGE_INTEGER li;
+    li.QuadPart = pos;
+
+    if (!SetFilePointerEx(m_hFile, li, 0, FILE_BEGIN))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Writer::Patch(LONGLONG pos, const bytes_t& buf)
+{
+    assert(!buf.empty());
+    assert((pos + LONGLONG(buf.size())) <= GetPosition());
+
+    HRESULT hr = Flush();
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = SetFilePosition(pos);
+
+    if (FAILED(hr))
+        return hr;
+
+    DWORD cb;
+
+    const BOOL b = WriteFile(m_hFile, &buf[0], DWORD(buf.size()), &cb, 0);
+
+    if (!b)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return SetFilePosition(m_flushed);
+}
+
+
+LONGLONG Writer::GetPosition() const
+{
+    return m_flushed + LONGLONG(m_buf.size());
+}
+
+
+struct CueEntry
+{
+    LONGLONG time;  //in ticks
+    LONGLONG pos;   //of cluster, relative to segment
+};
+
+typedef std::vector<CueEntry> cues_t;
+
+
+class Source
+{
+    Source(const Source&);
+    Source& operator=(const Source&);
+
+public:
+    Source();
+    ~Source();
+
+    HRESULT Open(const wchar_t*);
+
+    FileReader m_file;
+    Segment* m_pSegment;
+    long long m_ebml_size;  //bytes before the segment
+
+};
+
+
+Source::Source() : m_pSegment(0), m_ebml_size(0)
+{
+}
+
+
+Source::~Source()
+{
+    delete m_pSegment;
+}
+
+
+HRESULT Source::Open(const wchar_t* filename)
+{
+    HRESULT hr = m_file.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    long long result = h.Parse(&m_file, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = Segment::CreateInstance(&m_file, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    m_ebml_size = m_pSegment->m_element_start;
+
+    const long status = m_pSegment->Load();  //all of the local file
+
+    if (status < 0)
+        return E_FAIL;
+
+    if ((m_pSegment->GetInfo() == 0) || (m_pSegment->GetTracks() == 0))
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+long long GetVideoTrackNumber(const Tracks* pTracks)
+{
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack != 0) && (pTrack->GetType() == 1))  //video
+            return pTrack->GetNumber();
+    }
+
+    return -1;
+}
+
+
+//Copies the clusters of the input, adding offset to their timecodes,
+//and updates last_time with the time (in ticks) of the last block.
+
+HRESULT CopyClusters(
+    Source& in,
+    LONGLONG offset,
+    long long video,
+    LONGLONG segment_start,
+    Writer& w,
+    cues_t& cues,
+    LONGLONG& last_time)
+{
+    Segment* const pSegment = in.m_pSegment;
+
+    bytes_t buf;
+    bytes_t body;
+    bytes_t out;
+
+    for (const Cluster* pCluster = pSegment->GetFirst();
+         (pCluster != 0) && !pCluster->EOS();
+         pCluster = pSegment->GetNext(pCluster))
+    {
+        const long long tc = pCluster->GetTimeCode();
+
+        if (tc < 0)
+            return E_FAIL;
+
+        const long long size = pCluster->GetElementSize();
+
+        if (size <= 0)
+            return E_FAIL;
+
+        buf.resize(size_t(size));
+
+        int status = in.m_file.Read(
+                        pCluster->m_element_start,
+                        long(size),
+                        &buf[0]);
+
+        if (status)
+            return E_FAIL;
+
+        const BYTE* p = &buf[0];
+        const BYTE* const end = p + buf.size();
+
+        ULONG id;
+        ULONGLONG payload;
+
+        if (!GetID(p, end, id) || (id != kClusterID))
+            return E_FAIL;
+
+        if (!GetSize(p, end, payload) || (payload > ULONGLONG(end - p)))
+            return E_FAIL;
+
+        const BYTE* const payload_end = p + payload;
+
+        body.clear();
+        PutUInt(body, kTimecodeID, tc + offset);
+
+        while (p < payload_end)
+        {
+            const BYTE* const elem = p;
+
+            ULONGLONG len;
+
+            if (!GetID(p, payload_end, id))
+                return E_FAIL;
+
+            if (!GetSize(p, payload_end, len))
+                return E_FAIL;
+
+            if (len > ULONGLONG(payload_end - p))
+                return E_FAIL;
+
+            p += len;
+
+            if (id != kTimecodeID)  //we wrote our own
+                body.insert(body.end(), elem, p);
+        }
+
+        //A cue point for the first keyframe of the video track, and the
+        //time of the last block of any track.
+
+        const LONGLONG pos = w.GetPosition() - segment_start;
+        bool bCue = false;
+
+        const BlockEntry* pEntry;
+
+        long result = pCluster->GetFirst(pEntry);
+
+        while ((result >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const LONGLONG t = pBlock->GetTimeCode(pCluster) + offset;
+
+            if (t > last_time)
+                last_time = t;
+
+            if (!bCue && (pBlock->GetTrackNumber() == video) &&
+                pBlock->IsKey())
+            {
+                const CueEntry e = { t, pos };
+                cues.push_back(e);
+
+                bCue = true;
+            }
+
+            result = pCluster->GetNext(pEntry, pEntry);
+        }
+
+        out.clear();
+        PutMaster(out, kClusterID, body);
+
+        w.Write(out);
+    }
+
+    return S_OK;
+}
+
+}  //end anon namespace
+
+
+HRESULT Stitcher::Stitch(
+    const wchar_t* filename,
+    const Stitcher::Input* inputs,
+    ULONG count)
+{
+    if ((filename == 0) || (inputs == 0))
+        return E_POINTER;
+
+    if (count == 0)
+        return E_INVALIDARG;
+
+    Source first;
+
+    HRESULT hr = first.Open(inputs[0].filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    const SegmentInfo* const pInfo = first.m_pSegment->GetInfo();
+    const Tracks* const pTracks = first.m_pSegment->GetTracks();
+
+    const long long scale = pInfo->GetTimeCodeScale();
+    assert(scale > 0);
+
+    const long long video = GetVideoTrackNumber(pTracks);
+    const ULONG track_count = pTracks->GetTracksCount();
+
+    Writer w;
+
+    hr = w.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    bytes_t buf;
+
+    //EBML header, as the first input has it
+
+    buf.resize(size_t(first.m_ebml_size));
+
+    if (!buf.empty() && first.m_file.Read(0, long(buf.size()), &buf[0]))
+        return E_FAIL;
+
+    w.Write(buf);
+
+    //Segment, with a size we patch at the end
+
+    buf.clear();
+    PutID(buf, kSegmentID);
+    w.Write(buf);
+
+    const LONGLONG segment_size_pos = w.GetPosition();
+
+    buf.clear();
+    PutSize(buf, 0);
+    w.Write(buf);
+
+    const LONGLONG segment_start = w.GetPosition();
+
+    enum { kSeekCount = 3 };
+    const ULONG seek_ids[kSeekCount] = { kInfoID, kTracksID, kCuesID };
+    LONGLONG seek_pos[kSeekCount] = { 0, 0, 0 };
+
+    const LONGLONG seekhead_pos = w.GetPosition();
+
+    buf.clear();
+    PutSeekHead(buf, seek_pos, seek_ids, kSeekCount);
+    w.Write(buf);
+
+    //Info, with a duration we patch at the end
+
+    seek_pos[0] = w.GetPosition() - segment_start;
+
+    bytes_t info;
+    PutUInt(info, kTimecodeScaleID, scale);
+
+    //past the Info ID and size, and the Duration ID and size
+    const LONGLONG duration_pos = w.GetPosition() + 4 + 8 + info.size() + 3;
+
+    PutFloat(info, kDurationID, 0);
+
+    if (const char* str = pInfo->GetMuxingAppAsUTF8())
+        PutString(info, kMuxingAppID, str);
+
+    if (const char* str = pInfo->GetWritingAppAsUTF8())
+        PutString(info, kWritingAppID, str);
+
+    buf.clear();
+    PutMaster(buf, kInfoID, info);
+    w.Write(buf);
+
+    //Tracks, as the first input has them
+
+    seek_pos[1] = w.GetPosition() - segment_start;
+
+    buf.resize(size_t(pTracks->m_element_size));
+
+    if (first.m_file.Read(pTracks->m_element_start, long(buf.size()), &buf[0]))
+        return E_FAIL;
+
+    w.Write(buf);
+
+    //Clusters
+
+    cues_t cues;
+    LONGLONG last_time = 0;
+    LONGLONG duration = 0;  //in ticks
+
+    for (ULONG i = 0; i < count; ++i)
+    {
+        Source next;
+        Source* pSource = &first;
+
+        if (i > 0)
+        {
+            hr = next.Open(inputs[i].filename);
+
+            if (FAILED(hr))
+                return hr;
+
+            pSource = &next;
+        }
+
+        Segment* const pSegment = pSource->m_pSegment;
+        const SegmentInfo* const pSourceInfo = pSegment->GetInfo();
+
+        if ((pSourceInfo->GetTimeCodeScale() != scale) ||
+            (pSegment->GetTracks()->GetTracksCount() != track_count))
+        {
+            return E_INVALIDARG;
+        }
+
+        //The input's first cluster goes at the start of its range.
+
+        const Cluster* const pCluster = pSegment->GetFirst();
+
+        const LONGLONG first_time = ((pCluster == 0) || pCluster->EOS()) ?
+                                        0 :
+                                        pCluster->GetTimeCode();
+
+        const LONGLONG offset = inputs[i].start_ns / scale - first_time;
+
+        hr = CopyClusters(
+                *pSource,
+                offset,
+                video,
+                segment_start,
+                w,
+                cues,
+                last_time);
+
+        if (FAILED(hr))
+            return hr;
+
+        const long long d = pSourceInfo->GetDuration();  //ns
+
+        const LONGLONG end = (d >= 0) ?
+                                first_time + offset + d / scale :
+                                last_time;
+
+        if (end > duration)
+            duration = end;
+    }
+
+    //Cues
+
+    seek_pos[2] = w.GetPosition() - segment_start;
+
+    bytes_t points;
+
+    for (cues_t::size_type i = 0; i < cues.size(); ++i)
+    {
+        const CueEntry& e = cues[i];
+
+        bytes_t tp;
+        PutUInt(tp, kCueTrackID, video);
+        PutUInt(tp, kCueClusterPositionID, e.pos);
+
+        bytes_t point;
+        PutUInt(point, kCueTimeID, e.time);
+        PutMaster(point, kCueTrackPositionsID, tp);
+
+        PutMaster(points, kCuePointID, point);
+    }
+
+    buf.clear();
+    PutMaster(buf, kCuesID, points);
+    w.Write(buf);
+
+    //Now that we know where everything is:
+
+    const LONGLONG segment_end = w.GetPosition();
+
+    buf.clear();
+    PutSize(buf, segment_end - segment_start);
+    hr = w.Patch(segment_size_pos, buf);
+
+    if (SUCCEEDED(hr))
+    {
+        buf.clear();
+        PutSeekHead(buf, seek_pos, seek_ids, kSeekCount);
+        hr = w.Patch(seekhead_pos, buf);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (duration < last_time)
+            duration = last_time;
+
+        const double val = double(duration);
+
+        ULONGLONG bits;
+        memcpy(&bits, &val, sizeof bits);
+
+        buf.clear();
+
+        for (int n = 8; n > 0; )
+            buf.push_back(BYTE(bits >> (8 * --n)));
+
+        hr = w.Patch(duration_pos, buf);
+    }
+
+    const HRESULT hrClose = w.Close();
+
+    return FAILED(hr) ? hr : hrClose;
+}
+
+
+}  //end namespace mkvparser
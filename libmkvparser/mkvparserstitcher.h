@@ -0,0 +1,51 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+namespace mkvparser
+{
+
+//Joins WebM files encoded from consecutive ranges of one source into a
+//single WebM file.  Each input must begin with a keyframe, and all of
+//them must have the tracks and timecode scale of the first one, which
+//also supplies the EBML header and the Tracks element of the output.
+//
+//The clusters of each input are copied as they are, except that their
+//timecodes are moved so that the input's first cluster begins at the
+//start time of its range (block timecodes are relative to the cluster,
+//so the blocks need no change).  The output gets a new SeekHead, Info
+//(with the duration of the whole) and one Cues, with a cue point for
+//each cluster that holds a keyframe of the first video track.
+
+class Stitcher
+{
+    Stitcher();
+    Stitcher(const Stitcher&);
+    Stitcher& operator=(const Stitcher&);
+
+public:
+
+    struct Input
+    {
+        const wchar_t* filename;
+        LONGLONG start_ns;  //of the range the input was encoded from
+    };
+
+    //Writes filename from the count inputs, in time order.  The output
+    //is replaced if it exists.
+    static HRESULT Stitch(
+        const wchar_t* filename,
+        const Input* inputs,
+        ULONG count);
+
+};
+
+
+}  //end namespace mkvparser
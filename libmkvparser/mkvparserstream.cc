@@ -10,7 +10,12 @@
 #include "mkvparserstream.h"
 #include "mkvparser.hpp"
 #include "mkvparserstreamreader.h"
+#include "mkvparserelementreader.h"
+#include "cmediasample.h"
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstring>
 #include <sstream>
 #include <iomanip>
 #include <vfwmsgs.h>
@@ -22,11 +27,81 @@ using std::endl;
 namespace mkvparser
 {
 
+typedef ContentEncoding::ContentEncryption ContentEncryption;
+
+static const ContentEncryption* GetEncryption(const Track* pTrack)
+{
+    const unsigned long count = pTrack->GetContentEncodingCount();
+
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        const ContentEncoding* const e = pTrack->GetContentEncodingByIndex(i);
+
+        if ((e == 0) || (e->encoding_type() != 1))  //not encryption
+            continue;
+
+        if (e->GetEncryptionCount() == 0)
+            continue;
+
+        const ContentEncryption* const pEnc = e->GetEncryptionByIndex(0);
+
+        if ((pEnc != 0) && (pEnc->algo == 5))  //AES
+            return pEnc;
+    }
+
+    return 0;
+}
+
+
+static void GetStrippedHeader(const Track* pTrack, std::vector<BYTE>& h)
+{
+    typedef ContentEncoding::ContentCompression ContentCompression;
+
+    const unsigned long count = pTrack->GetContentEncodingCount();
+
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        const ContentEncoding* const e = pTrack->GetContentEncodingByIndex(i);
+
+        if ((e == 0) || (e->encoding_type() != 0))  //not compression
+            continue;
+
+        if (e->GetCompressionCount() == 0)
+            continue;
+
+        const ContentCompression* const c = e->GetCompressionByIndex(0);
+
+        if ((c == 0) || (c->algo != 3))  //not header stripping
+            continue;
+
+        const BYTE* const settings = c->settings;
+        h.assign(settings, settings + c->settings_len);
+
+        return;
+    }
+}
+
 
 Stream::Stream(const Track* pTrack) :
     m_pTrack(pTrack),
-    m_pLocked(0)
+    m_bLent(false),
+    m_bDeferred(false),
+    m_batch_bytes(0),
+    m_batch_frames(0),
+    m_batch_ns(0),
+    m_pBatchLast(0),
+    m_splice_ns(0),
+    m_thin_rate(0),
+    m_bReverse(false),
+    m_drop_ns(-1),
+    m_pLocked(0),
+    m_bEncrypted(GetEncryption(pTrack) != 0),
+    m_bCurrDelivered(false),
+    m_bDeferReads(false),
+    m_gop_start_ns(-1),
+    m_gop_stop_ns(-1)
 {
+    GetStrippedHeader(pTrack, m_stripped);
     Init();
 }
 
@@ -44,6 +119,10 @@ void Stream::Init()
     SetCurr(0);  //lazy init this later
     m_pStop = m_pTrack->GetEOS();  //means play entire stream
     m_bDiscontinuity = true;
+    m_drop_ns = -1;
+
+    m_read_stats.reads = 0;
+    m_read_stats.frames = 0;
 }
 
 
@@ -67,6 +146,7 @@ HRESULT Stream::SetCurr(const mkvparser::BlockEntry* pNext)
     IStreamReader* const pReader = static_cast<IStreamReader*>(pReader_);
 
     m_pCurr = pNext;
+    m_bCurrDelivered = false;
 
     pReader->UnlockPages(m_pLocked);
     m_pLocked = m_pCurr;
@@ -195,6 +275,352 @@ __int64 Stream::GetCurrTime() const
 }
 
 
+const Cluster* Stream::GetCurrCluster() const
+{
+    if (m_pCurr == 0)  //lazy init hasn't happened yet
+        return 0;
+
+    if (m_pCurr->EOS())
+        return 0;
+
+    return m_pCurr->GetCluster();
+}
+
+
+LONGLONG Stream::GetBaseTime() const
+{
+    if (m_base_time_ns < 0)  //lazy init hasn't happened yet
+        return 0;
+
+    return m_base_time_ns / 100;
+}
+
+
+void Stream::SetThinning(double rate)
+{
+    m_thin_rate = rate;
+}
+
+
+bool Stream::IsThinning() const
+{
+    if (m_thin_rate <= 1)
+        return false;
+
+    return (m_pTrack->m_pSegment->GetCues() != 0);
+}
+
+
+void Stream::SetReverse(bool b)
+{
+    m_bReverse = b;
+    m_gop_start_ns = -1;
+}
+
+
+void Stream::SetSpliceTime(LONGLONG ns)
+{
+    assert(ns >= 0);
+    m_splice_ns = ns;
+}
+
+
+bool Stream::IsEncrypted() const
+{
+    return m_bEncrypted;
+}
+
+
+bool Stream::SetDecryptionKey(
+    const BYTE* key_id,
+    ULONG key_id_len,
+    const BYTE* key)
+{
+    assert(key);
+
+    const ContentEncryption* const e = GetEncryption(m_pTrack);
+
+    if (e == 0)
+        return false;
+
+    if ((e->key_id_len != LONGLONG(key_id_len)) ||
+        ((key_id_len > 0) && (memcmp(e->key_id, key_id, key_id_len) != 0)))
+    {
+        return false;
+    }
+
+    m_aes.SetKey(key);
+    return true;
+}
+
+
+long Stream::GetStrippedSize() const
+{
+    return static_cast<long>(m_stripped.size());
+}
+
+
+long Stream::ReadFrame(LONGLONG pos, long len, BYTE* ptr) const
+{
+    IMkvReader* const pReader = m_pTrack->m_pSegment->m_pReader;
+
+    BYTE* const frame = ptr + GetStrippedSize();
+
+    ++m_read_stats.reads;
+
+    if (pReader->Read(pos, len, frame) != 0)
+        return -1;
+
+    return CopyFrame(frame, len, ptr);  //in place
+}
+
+
+LONGLONG Stream::GetBlockSpan(const Block* pBlock, LONGLONG& pos)
+{
+    assert(pBlock);
+
+    const int nFrames = pBlock->GetFrameCount();
+    assert(nFrames > 0);
+
+    const Block::Frame& first = pBlock->GetFrame(0);
+    const Block::Frame& last = pBlock->GetFrame(nFrames - 1);
+
+#ifdef _DEBUG
+    for (int idx = 1; idx < nFrames; ++idx)
+    {
+        const Block::Frame& prev = pBlock->GetFrame(idx - 1);
+        const Block::Frame& f = pBlock->GetFrame(idx);
+
+        assert(f.pos == (prev.pos + prev.len));  //laced frames are adjacent
+    }
+#endif
+
+    pos = first.pos;
+    return last.pos + last.len - pos;
+}
+
+
+long Stream::ReadBlockSpan(const Block* pBlock, BYTE* buf) const
+{
+    LONGLONG pos;
+    const LONGLONG len = GetBlockSpan(pBlock, pos);
+    assert(len >= 0);
+    assert(len <= LONG_MAX);
+
+    IMkvReader* const pReader = m_pTrack->m_pSegment->m_pReader;
+
+    ++m_read_stats.reads;
+
+    if (pReader->Read(pos, static_cast<long>(len), buf) != 0)
+        return -1;
+
+    return static_cast<long>(len);
+}
+
+
+const BYTE* Stream::ReadBlockFrames(const Block* pBlock) const
+{
+    LONGLONG pos;
+    const LONGLONG len = GetBlockSpan(pBlock, pos);
+
+    if ((len <= 0) || (len > LONG_MAX))
+        return 0;
+
+    m_block_frames.resize(static_cast<size_t>(len));
+    BYTE* const buf = &m_block_frames[0];
+
+    if (ReadBlockSpan(pBlock, buf) < 0)
+        return 0;
+
+    return buf;  //CopyFrame counts the frames
+}
+
+
+long Stream::ReadBlockFrames(const Block* pBlock, BYTE* ptr) const
+{
+    assert(ptr);
+
+    if (m_bEncrypted || (GetStrippedSize() > 0))
+        return -1;
+
+    LONGLONG pos;
+    const LONGLONG len = GetBlockSpan(pBlock, pos);
+
+    if ((len < 0) || (len > LONG_MAX))
+        return -1;
+
+    const long result = ReadBlockSpan(pBlock, ptr);
+
+    if (result >= 0)
+        m_read_stats.frames += pBlock->GetFrameCount();
+
+    return result;
+}
+
+
+long Stream::CopyFrame(const BYTE* src, long len, BYTE* ptr) const
+{
+    const long h = GetStrippedSize();
+    BYTE* const frame = ptr + h;
+
+    ++m_read_stats.frames;
+
+    if (m_bEncrypted)  //decrypted before the header is put back
+    {
+        len = webmdshow::DecryptWebmFrame(m_aes, src, len, frame);
+
+        if (len < 0)
+            return 0;  //delivered empty
+    }
+    else if (src != frame)
+        memcpy(frame, src, len);
+
+    if (h > 0)
+        memcpy(ptr, &m_stripped[0], h);
+
+    return h + len;
+}
+
+
+void Stream::GetReadStats(ReadStats& stats) const
+{
+    stats = m_read_stats;
+}
+
+
+long Stream::GetFrameSize(LONGLONG pos, long len) const
+{
+    const long h = GetStrippedSize();
+
+    if (!m_bEncrypted)
+        return h + len;
+
+    IMkvReader* const pReader = m_pTrack->m_pSegment->m_pReader;
+
+    BYTE signal;
+
+    if (len < webmdshow::kWebmSignalSize)
+        return 0;
+
+    ++m_read_stats.reads;
+
+    if (pReader->Read(pos, 1, &signal))
+        return 0;
+
+    if ((signal & 1) == 0)  //sent in the clear
+        return h + len - webmdshow::kWebmSignalSize;
+
+    if ((len < webmdshow::kWebmEncryptedHeaderSize) || !m_aes.HasKey())
+        return 0;
+
+    return h + len - webmdshow::kWebmEncryptedHeaderSize;
+}
+
+
+LONGLONG Stream::GetSampleBase() const
+{
+    return m_base_time_ns - m_splice_ns;
+}
+
+
+void Stream::SetDropTime(LONGLONG reftime)
+{
+    if ((reftime < 0) || IsThinning() || IsReverse() || IsSparse())
+        m_drop_ns = -1;
+    else
+        m_drop_ns = reftime * 100 + GetSampleBase();
+}
+
+
+HRESULT Stream::Resync()
+{
+    if (m_pCurr == 0)  //no cluster could be loaded at all
+    {
+        const HRESULT hr = SetCurr(m_pTrack->GetEOS());
+        return FAILED(hr) ? hr : S_FALSE;
+    }
+
+    if (m_pCurr->EOS())
+        return S_FALSE;
+
+    Segment* const pSegment = m_pTrack->m_pSegment;
+    IMkvReader* const pReader = pSegment->m_pReader;
+
+    LONGLONG total, avail;
+
+    if (pReader->Length(&total, &avail) < 0)
+        return E_FAIL;
+
+    LONGLONG stop = avail;
+
+    if (pSegment->m_size >= 0)
+        stop = (std::min)(stop, pSegment->m_start + pSegment->m_size);
+
+    const Cluster* const pCurrCluster = m_pCurr->GetCluster();
+    assert(pCurrCluster);
+
+    LONGLONG pos = pCurrCluster->m_element_start + 4;  //past its ID
+    const BlockEntry* pNext = m_pTrack->GetEOS();
+
+    while (!IsReverse())
+    {
+        pos = ElementReader::FindCluster(pReader, pos, stop, stop);
+
+        if (pos < 0)
+            break;
+
+        if ((m_pStop != 0) && !m_pStop->EOS() &&
+            (m_pStop->GetCluster()->m_element_start < pos))
+        {
+            break;  //skipped over the stop position
+        }
+
+        const Cluster* const pCluster =
+            pSegment->FindOrPreloadCluster(pos - pSegment->m_start);
+
+        if ((pCluster != 0) && !pCluster->EOS())
+        {
+            const BlockEntry* const pEntry = pCluster->GetEntry(m_pTrack);
+
+            if ((pEntry != 0) && !pEntry->EOS())
+            {
+                pNext = pEntry;
+                break;
+            }
+        }
+
+        pos += 4;  //none of ours in it: keep looking
+    }
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "mkvparser::Stream::Resync: track="
+       << m_pTrack->GetNumber()
+       << " from=" << pCurrCluster->m_element_start
+       << " to=" << (pNext->EOS() ? -1 : pNext->GetCluster()->m_element_start)
+       << endl;
+#endif
+
+    m_bDiscontinuity = true;
+
+    const HRESULT hr = SetCurr(pNext);
+
+    if (FAILED(hr))
+        return hr;
+
+    return pNext->EOS() ? S_FALSE : S_OK;
+}
+
+
+bool Stream::IsReverse() const
+{
+    if (!m_bReverse)
+        return false;
+
+    return (m_pTrack->m_pSegment->GetCues() != 0);
+}
+
+
 //__int64 Stream::GetStopPosition() const
 //{
 //    return GetStopTime();  //TODO: for now we only support reftime units
@@ -278,6 +704,8 @@ void Stream::SetCurrPosition(
     SetCurr(pCurr);
     m_base_time_ns = base_time_ns;
     m_bDiscontinuity = true;
+    m_gop_start_ns = -1;  //the group starts at pCurr
+    m_drop_ns = -1;
 }
 
 
@@ -456,7 +884,11 @@ HRESULT Stream::InitCurr()
     assert(pBase);
     assert(!pBase->EOS());
 
-    m_base_time_ns = pBase->GetFirstTime();
+    //A sparse stream positioned by a seek starts from its first block,
+    //which is only found this way, but keeps the base of the seek.
+
+    if (!IsSparse() || (m_base_time_ns < 0))
+        m_base_time_ns = pBase->GetFirstTime();
     //assert(m_base_time_ns >= 0);
 
 #ifdef _DEBUG
@@ -516,11 +948,30 @@ void Stream::Clear(samples_t& samples)
 
 
 HRESULT Stream::GetSampleCount(long& count)
+{
+    long size;
+    return GetSampleCount(count, size);
+}
+
+
+HRESULT Stream::GetSampleCount(long& count, long& size)
 {
     count = 0;
+    size = 0;
+    m_bLent = false;
 
     HRESULT hr = InitCurr();
 
+    if (FAILED(hr))
+        return hr;
+
+    hr = SkipDelivered();
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = SkipDropped();
+
     if (FAILED(hr))
         return hr;
 
@@ -529,7 +980,7 @@ HRESULT Stream::GetSampleCount(long& count)
         if (m_pCurr->EOS())
             return S_FALSE;  //send EOS downstream
     }
-    else if (m_pCurr == m_pStop)
+    else if ((m_pCurr == m_pStop) || m_pCurr->EOS())  //EOS when reversing
     {
         return S_FALSE;  //EOS
     }
@@ -538,43 +989,311 @@ HRESULT Stream::GetSampleCount(long& count)
     assert(pCurrBlock);
     assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
 
+    if (m_batch_bytes > 0)
+    {
+        count = 1;
+        size = InitBatch();
+
+        return S_OK;
+    }
+
     count = pCurrBlock->GetFrameCount();
     assert(count <= GetBufferCount());
 
+    for (int i = 0; i < count; ++i)
+    {
+        const Block::Frame& f = pCurrBlock->GetFrame(i);
+
+        if (f.len > size)
+            size = f.len;
+    }
+
+    size += GetStrippedSize();  //put back by ReadFrame
+
     return S_OK;
 }
 
 
-HRESULT Stream::PopulateSamples(const samples_t& samples)
+long Stream::InitBatch()
 {
-    //if (SendPreroll(pSample))
-    //    return S_OK;
+    //Returns the size of the sample, whose frames are laced as
+    //MEDIASUBTYPE_Vorbis2_Xiph_Lacing specifies: a byte with the frame
+    //count less one, then the size of each frame but the last, each as
+    //a run of 255s and a final byte less than 255, then the frames.
+    //PopulateSamples checks the current block, and any block we add
+    //must have a block after it that has been parsed (to give the stop
+    //time), so it can be populated without underflow.
+
+    const BlockEntry* pEntry = m_pCurr;
+    m_pBatchLast = m_pCurr;
+
+    const Block* pBlock = pEntry->GetBlock();
+    const __int64 start_ns = pBlock->GetTime(pEntry->GetCluster());
+
+    __int64 time_ns = start_ns;
+    long frames = 0;
+    long bytes = 1;  //frame count
+    long last_len = 0;
+
+    for (;;)
+    {
+        const int n = pBlock->GetFrameCount();
 
-    HRESULT hr = InitCurr();
+        long len = 0;
+        long lacing = 0;
 
-    if (FAILED(hr))
-        return hr;
+        for (int i = 0; i < n; ++i)
+        {
+            const Block::Frame& f = pBlock->GetFrame(i);
 
-    if (m_pStop == 0)  //TODO: this test might not be req'd
-    {
-        if (m_pCurr->EOS())
-            return S_FALSE;  //send EOS downstream
-    }
-    else if (m_pCurr == m_pStop)
-    {
-        return S_FALSE;  //EOS
-    }
+            const long frame_len = f.len + GetStrippedSize();  //at most
 
-    assert(!m_pCurr->EOS());
+            len += frame_len;
+            lacing += last_len / 255 + 1;  //the size of the previous frame
 
-    const BlockEntry* pNext;
+            last_len = frame_len;
+        }
+
+        if (frames == 0)  //first frame has no size before it
+            lacing -= 1;
+
+        if ((frames > 0) &&
+            (((frames + n) > m_batch_frames) ||
+             ((bytes + lacing + len) > m_batch_bytes)))
+        {
+            break;
+        }
+
+        frames += n;
+        bytes += lacing + len;
+        m_pBatchLast = pEntry;
+
+        const BlockEntry* pNext;
+        long status = m_pTrack->GetNext(pEntry, pNext);
+
+        if ((status < 0) || (pNext == 0) || pNext->EOS())
+            break;
+
+        if (pNext == m_pStop)
+            break;
+
+        const BlockEntry* pAfter;
+        status = m_pTrack->GetNext(pNext, pAfter);
+
+        if (status < 0)  //not parsed yet: send what we have
+            break;
+
+        pBlock = pNext->GetBlock();
+
+        if (pBlock->GetFrameCount() <= 0)
+            break;
+
+        const __int64 next_ns = pBlock->GetTime(pNext->GetCluster());
+
+        if ((next_ns < time_ns) || ((next_ns - start_ns) >= m_batch_ns))
+            break;
+
+        time_ns = next_ns;
+        pEntry = pNext;
+    }
+
+    return bytes;
+}
+
+
+HRESULT Stream::LendSamples(samples_t& samples)
+{
+    assert(samples.empty());
+
+    //Called after GetSampleCount succeeded, so m_pCurr is a block, and
+    //the reader has locked its pages.
+
+    assert(m_pCurr);
+    assert(!m_pCurr->EOS());
+
+    if (m_batch_bytes > 0)  //the frames are laced into a sample of ours
+        return S_FALSE;
+
+    if (m_bEncrypted)  //the frames are decrypted into a sample of ours
+        return S_FALSE;
+
+    if (!m_stripped.empty())  //a sample of ours has the header first
+        return S_FALSE;
+
+    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    assert(pCurrBlock);
+
+    IMkvReader* const pReader_ = m_pTrack->m_pSegment->m_pReader;
+
+    using mkvparser::IStreamReader;
+    IStreamReader* const pReader = static_cast<IStreamReader*>(pReader_);
+
+    const int count = pCurrBlock->GetFrameCount();
+
+    samples.reserve(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Block::Frame& f = pCurrBlock->GetFrame(i);
+
+        IMediaSample* pSample;
+
+        const HRESULT hr = pReader->LendFrame(f.pos, f.len, &pSample);
+
+        if (hr != S_OK)
+        {
+            Clear(samples);
+            return S_FALSE;  //copy the block instead
+        }
+
+        samples.push_back(pSample);
+    }
+
+    m_bLent = true;
+    return S_OK;
+}
+
+
+HRESULT Stream::GetSamples(
+    IMemAllocator* pAllocator,
+    GraphUtil::IMemAllocatorPtr& pLarge,
+    long count,
+    long size,
+    DWORD flags,
+    samples_t& samples)
+{
+    assert(pAllocator);
+
+    ALLOCATOR_PROPERTIES props;
+
+    HRESULT hr = pAllocator->GetProperties(&props);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (size > props.cbBuffer)
+    {
+        ALLOCATOR_PROPERTIES large;
+
+        if (bool(pLarge))
+        {
+            hr = pLarge->GetProperties(&large);
+
+            if (FAILED(hr))
+                return hr;
+        }
+
+        if (!bool(pLarge) || (size > large.cbBuffer))
+        {
+            //Samples still outstanding keep the old allocator alive
+            //until they are released.
+
+            if (bool(pLarge))
+                pLarge->Decommit();
+
+            pLarge = 0;
+
+            hr = CMediaSample::CreatePageAllocator(&pLarge);
+
+            if (FAILED(hr))
+                return hr;
+
+            large = props;
+
+            //Headroom, so that we don't make a new allocator for each
+            //keyframe that is only a little larger than the last.
+            const long cbExtra = size / 4;
+
+            large.cbBuffer = (size + cbExtra + 0xFFFF) & ~0xFFFF;
+
+            if (large.cBuffers < count)
+                large.cBuffers = count;
+
+            ALLOCATOR_PROPERTIES actual;
+
+            hr = pLarge->SetProperties(&large, &actual);
+
+            if (FAILED(hr))
+                return hr;
+
+            hr = pLarge->Commit();
+
+            if (FAILED(hr))
+                return hr;
+        }
+
+        pAllocator = pLarge;
+    }
+
+    for (long i = 0; i < count; ++i)
+    {
+        IMediaSample* pSample;
+
+        hr = pAllocator->GetBuffer(&pSample, 0, 0, flags);
+
+        if (hr != S_OK)
+            return hr;
+
+        samples.push_back(pSample);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Stream::PopulateSamples(const samples_t& samples)
+{
+    //if (SendPreroll(pSample))
+    //    return S_OK;
+
+    HRESULT hr = InitCurr();
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = SkipDelivered();
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = SkipDropped();
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pStop == 0)  //TODO: this test might not be req'd
+    {
+        if (m_pCurr->EOS())
+            return S_FALSE;  //send EOS downstream
+    }
+    else if ((m_pCurr == m_pStop) || m_pCurr->EOS())  //EOS when reversing
+    {
+        return S_FALSE;  //EOS
+    }
+
+    assert(!m_pCurr->EOS());
+
+    const BlockEntry* pNext;
     const long status = m_pTrack->GetNext(m_pCurr, pNext);
 
     if (status == E_BUFFER_NOT_FULL)
-        return VFW_E_BUFFER_UNDERFLOW;
+    {
+        if (!IsSparse())
+            return VFW_E_BUFFER_UNDERFLOW;
 
-    assert(status >= 0);  //success
-    assert(pNext);
+        pNext = 0;  //deliver the block now (see IsSparse)
+    }
+    else if (status < 0)  //damaged, past the current block
+    {
+        hr = Resync();
+
+        if (FAILED(hr))
+            return hr;
+
+        return 2;  //no samples, but not EOS either
+    }
+    else
+        assert(pNext);
 
     const Block* const pCurrBlock = m_pCurr->GetBlock();
 
@@ -585,16 +1304,16 @@ HRESULT Stream::PopulateSamples(const samples_t& samples)
 
     if (start_ns < 0)
     {
-        SetCurr(pNext);  //throw curr block away
+        DiscardCurr(pNext);
         return 2;  //no samples, but not EOS either
     }
 
     const LONGLONG base_ns = m_base_time_ns;
     //assert(base_ns >= 0);
 
-    if (start_ns < base_ns)
+    if ((start_ns < base_ns) && !IsReverse() && !IsPrerollDelivered())
     {
-        SetCurr(pNext);  //throw curr block away
+        DiscardCurr(pNext);
         return 2;  //no samples, but not EOS either
     }
 
@@ -602,12 +1321,63 @@ HRESULT Stream::PopulateSamples(const samples_t& samples)
 
     if (nFrames <= 0)   //should never happen
     {
-        SetCurr(pNext);  //throw curr block away
+        DiscardCurr(pNext);
         return 2;  //no samples, but not EOS either
     }
 
-    if (samples.size() != samples_t::size_type(nFrames))
+    m_bDeferred = m_bDeferReads && !m_bLent && (m_batch_bytes <= 0);
+    m_deferred.clear();
+
+    if (m_bDeferred)
+    {
+        for (int i = 0; i < nFrames; ++i)
+        {
+            const Block::Frame& f = pCurrBlock->GetFrame(i);
+
+            const FrameExtent e = { f.pos, f.len };
+            m_deferred.push_back(e);
+        }
+    }
+
+    if (m_batch_bytes > 0)
+    {
+        if (samples.size() != 1)
+            return 2;  //try again
+
+        assert(m_pBatchLast);
+
+        if (m_pBatchLast != m_pCurr)  //InitBatch checked that it's parsed
+        {
+            const long status = m_pTrack->GetNext(m_pBatchLast, pNext);
+            status;
+            assert(status >= 0);
+            assert(pNext);
+        }
+    }
+    else if (samples.size() != samples_t::size_type(nFrames))
         return 2;   //try again
+    else if (pNext == 0)  //sparse, and the next block isn't parsed yet
+    {
+        OnPopulateSample(0, samples);
+        m_bDiscontinuity = false;
+        m_bCurrDelivered = true;
+
+        return S_OK;
+    }
+    else if (IsReverse())
+    {
+        OnPopulateSample(pNext, samples);
+        ReverseTimes(samples);
+
+        hr = SetCurr(GetReverseNext(pNext));
+        m_bDiscontinuity = false;
+
+        return hr;
+    }
+    else if (IsThinning())
+        pNext = GetThinNext(pNext);  //the stop time is that of the next key
+    else
+        pNext = GetDropNext(pNext);  //that of the block after those skipped
 
     OnPopulateSample(pNext, samples);
 
@@ -618,18 +1388,382 @@ HRESULT Stream::PopulateSamples(const samples_t& samples)
 }
 
 
+const BlockEntry* Stream::GetThinNext(const BlockEntry* pNext) const
+{
+    //m_pCurr is the keyframe being delivered, and pNext the block after
+    //it.  Returns the keyframe to deliver instead of pNext, or pNext if
+    //the cues don't give one further on.
+
+    if ((pNext == 0) || pNext->EOS())
+        return pNext;
+
+    Segment* const pSegment = m_pTrack->m_pSegment;
+
+    const Cues* const pCues = pSegment->GetCues();
+    assert(pCues);  //IsThinning checked this
+
+    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    const LONGLONG curr_ns = pCurrBlock->GetTime(m_pCurr->GetCluster());
+    const LONGLONG target_ns = curr_ns + LONGLONG(m_thin_rate * 1000000000);
+
+    while (!pCues->DoneParsing())
+    {
+        pCues->LoadCuePoint();
+
+        const CuePoint* const pCP = pCues->GetLast();
+        assert(pCP);
+
+        if (pCP->GetTime(pSegment) >= target_ns)
+            break;
+    }
+
+    const CuePoint* pCP;
+    const CuePoint::TrackPosition* pTP;
+
+    if (!pCues->Find(target_ns, m_pTrack, pCP, pTP))
+        return pNext;
+
+    //Find gives the last cue point at or before the target, which (if the
+    //cues are sparser than the rate) can be the one we're on.  The cue
+    //points after it are loaded, since the last is at the target or later.
+
+    while (pCP->GetTime(pSegment) <= curr_ns)
+    {
+        do
+        {
+            pCP = pCues->GetNext(pCP);
+
+            if (pCP == 0)  //no keyframes after this one are indexed
+                return pNext;
+
+            pTP = pCP->Find(m_pTrack);
+        }
+        while (pTP == 0);
+    }
+
+    const BlockEntry* const pKey = pCues->GetBlock(pCP, pTP);
+
+    if ((pKey == 0) || pKey->EOS())
+        return pNext;
+
+    const LONGLONG key_ns = pKey->GetBlock()->GetTime(pKey->GetCluster());
+    const LONGLONG next_ns = pNext->GetBlock()->GetTime(pNext->GetCluster());
+
+    if (key_ns <= next_ns)  //no further on than pNext
+        return pNext;
+
+    //PopulateSamples stops when it reaches m_pStop, so we mustn't skip it.
+
+    if ((m_pStop != 0) && !m_pStop->EOS())
+    {
+        const Block* const pStopBlock = m_pStop->GetBlock();
+        const LONGLONG stop_ns = pStopBlock->GetTime(m_pStop->GetCluster());
+
+        if (key_ns >= stop_ns)
+            return m_pStop;
+    }
+
+    return pKey;
+}
+
+
+const BlockEntry* Stream::GetReverseNext(const BlockEntry* pNext)
+{
+    //m_pCurr is the block being delivered, and pNext the block after it.
+    //Returns pNext if it's in the same group, else the keyframe of the
+    //group before, or EOS if there is none.
+
+    Segment* const pSegment = m_pTrack->m_pSegment;
+
+    const Cues* const pCues = pSegment->GetCues();
+    assert(pCues);  //IsReverse checked this
+
+    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    const LONGLONG curr_ns = pCurrBlock->GetTime(m_pCurr->GetCluster());
+
+    if (m_gop_start_ns < 0)  //just positioned: its group is just m_pCurr
+    {
+        m_gop_start_ns = curr_ns;
+        m_gop_stop_ns = curr_ns + 1;
+    }
+
+    if (!IsThinning() && (pNext != 0) && !pNext->EOS())
+    {
+        const Block* const pNextBlock = pNext->GetBlock();
+        const LONGLONG next_ns = pNextBlock->GetTime(pNext->GetCluster());
+
+        if (next_ns < m_gop_stop_ns)
+            return pNext;
+    }
+
+    //When thinning, we go back about rate seconds; else to the cue point
+    //just before this group.
+
+    LONGLONG delta_ns = 1;
+
+    if (IsThinning())
+        delta_ns = LONGLONG(m_thin_rate * 1000000000);
+
+    const LONGLONG target_ns = m_gop_start_ns - delta_ns;
+
+    if (target_ns < 0)
+        return m_pTrack->GetEOS();
+
+    while (!pCues->DoneParsing())
+    {
+        pCues->LoadCuePoint();
+
+        const CuePoint* const pCP = pCues->GetLast();
+        assert(pCP);
+
+        if (pCP->GetTime(pSegment) >= target_ns)
+            break;
+    }
+
+    const CuePoint* pCP;
+    const CuePoint::TrackPosition* pTP;
+
+    if (!pCues->Find(target_ns, m_pTrack, pCP, pTP))
+        return m_pTrack->GetEOS();
+
+    const BlockEntry* const pKey = pCues->GetBlock(pCP, pTP);
+
+    if ((pKey == 0) || pKey->EOS())
+        return m_pTrack->GetEOS();
+
+    const LONGLONG key_ns = pKey->GetBlock()->GetTime(pKey->GetCluster());
+
+    if (key_ns >= m_gop_start_ns)  //no keyframe before this group
+        return m_pTrack->GetEOS();
+
+    m_gop_stop_ns = m_gop_start_ns;
+    m_gop_start_ns = key_ns;
+
+    return pKey;
+}
+
+
+void Stream::ReverseTimes(const samples_t& samples)
+{
+    //The times OnPopulateSample set are relative to the position, and
+    //(going back from there) are zero or less.  Negate them, keeping each
+    //sample's duration.
+
+    typedef samples_t::const_iterator iter_t;
+
+    for (iter_t i = samples.begin(); i != samples.end(); ++i)
+    {
+        IMediaSample* const pSample = *i;
+        assert(pSample);
+
+        LONGLONG st, sp;
+
+        HRESULT hr = pSample->GetTime(&st, &sp);
+
+        if (FAILED(hr))
+            continue;
+
+        LONGLONG start = -st;
+
+        if (start < 0)  //a frame after the position (on its first cluster)
+            start = 0;
+
+        if (hr == S_OK)
+        {
+            LONGLONG stop = start + (sp - st);
+            hr = pSample->SetTime(&start, &stop);
+        }
+        else
+            hr = pSample->SetTime(&start, 0);
+
+        assert(SUCCEEDED(hr));
+    }
+}
+
+
 //bool Stream::SendPreroll(IMediaSample*)
 //{
 //    return false;
 //}
 
 
+void Stream::SetDeferredReads(bool b)
+{
+    m_bDeferReads = b;
+}
+
+
+HRESULT Stream::ReadSamples(const samples_t& samples) const
+{
+    if (!m_bDeferred)  //PopulateSamples read them
+        return S_OK;
+
+    if (samples.size() != m_deferred.size())
+        return E_INVALIDARG;
+
+    for (samples_t::size_type i = 0; i < samples.size(); ++i)
+    {
+        IMediaSample* const pSample = samples[i];
+        assert(pSample);
+
+        const FrameExtent& e = m_deferred[i];
+
+        BYTE* ptr;
+
+        HRESULT hr = pSample->GetPointer(&ptr);
+        assert(SUCCEEDED(hr));
+        assert(ptr);
+
+        const long len = ReadFrame(e.pos, e.len, ptr);
+
+        if (len < 0)
+            return E_FAIL;
+
+        hr = pSample->SetActualDataLength(len);  //as read, not as stored
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
+bool Stream::IsPrerollDelivered() const
+{
+    return false;
+}
+
+
 ULONG Stream::GetClusterCount() const
 {
     return m_pTrack->m_pSegment->GetCount();
 }
 
 
+bool Stream::IsSparse() const
+{
+    return false;
+}
+
+
+bool Stream::GetIdleTime(LONGLONG& reftime) const
+{
+    if (m_base_time_ns < 0)  //not positioned yet
+        return false;
+
+    const Cluster* const pLast = m_pTrack->m_pSegment->GetLast();
+
+    if ((pLast == 0) || pLast->EOS())
+        return false;
+
+    const LONGLONG ns = pLast->GetTime();
+
+    if (ns < m_base_time_ns)
+        return false;
+
+    reftime = (ns - m_base_time_ns) / 100;
+    return true;
+}
+
+
+HRESULT Stream::SkipDelivered()
+{
+    if (!m_bCurrDelivered)
+        return S_OK;
+
+    assert(m_pCurr);
+    assert(!m_pCurr->EOS());
+
+    const BlockEntry* pNext;
+    const long status = m_pTrack->GetNext(m_pCurr, pNext);
+
+    if (status == E_BUFFER_NOT_FULL)
+        return VFW_E_BUFFER_UNDERFLOW;
+
+    assert(status >= 0);  //success
+    assert(pNext);
+
+    return SetCurr(pNext);
+}
+
+
+void Stream::DiscardCurr(const BlockEntry* pNext)
+{
+    if (pNext)
+        SetCurr(pNext);
+    else
+        m_bCurrDelivered = true;  //sparse: move past it once it's parsed
+}
+
+
+bool Stream::IsDropped(const BlockEntry* pBE)
+{
+    if (m_drop_ns < 0)
+        return false;
+
+    if ((pBE == 0) || pBE->EOS() || (pBE == m_pStop))
+        return false;
+
+    const Block* const pBlock = pBE->GetBlock();
+    assert(pBlock);
+
+    if (!pBlock->IsKey())
+        return true;
+
+    if (pBlock->GetTime(pBE->GetCluster()) >= m_drop_ns)
+        m_drop_ns = -1;  //caught up
+
+    return false;
+}
+
+
+const BlockEntry* Stream::GetDropNext(const BlockEntry* pNext)
+{
+    //Only the block we stop at has its pages locked (and so read).  If
+    //the walk runs out of parsed blocks, SkipDropped moves past that one.
+
+    while (IsDropped(pNext))
+    {
+        const BlockEntry* pAfter;
+        const long status = m_pTrack->GetNext(pNext, pAfter);
+
+        if (status == E_BUFFER_NOT_FULL)
+            break;
+
+        assert(status >= 0);  //success
+        assert(pAfter);
+
+        pNext = pAfter;
+    }
+
+    return pNext;
+}
+
+
+HRESULT Stream::SkipDropped()
+{
+    while (IsDropped(m_pCurr))
+    {
+        const BlockEntry* pNext;
+        const long status = m_pTrack->GetNext(m_pCurr, pNext);
+
+        if (status == E_BUFFER_NOT_FULL)
+            return VFW_E_BUFFER_UNDERFLOW;
+
+        assert(status >= 0);  //success
+        assert(pNext);
+
+        const HRESULT hr = SetCurr(GetDropNext(pNext));
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
 HRESULT Stream::SetConnectionMediaType(const AM_MEDIA_TYPE&)
 {
     return S_OK;
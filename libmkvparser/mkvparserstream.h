@@ -7,6 +7,8 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #pragma once
+#include "graphutil.h"
+#include "aesctr.h"
 #include <string>
 #include <iosfwd>
 #include <vector>
@@ -18,6 +20,7 @@ namespace mkvparser
 
 class Track;
 class BlockEntry;
+class Block;
 class Cluster;
 
 class Stream
@@ -42,17 +45,122 @@ public:
 
     HRESULT GetSampleCount(long&);
 
+    //As above, and also the size of the largest frame of the block.
+    HRESULT GetSampleCount(long& count, long& size);
+
     typedef std::vector<IMediaSample*> samples_t;
 
+    //Appends count samples for a block whose largest frame is size bytes.
+    //The buffers of pAllocator are sized for the frames of the first
+    //clusters, so a block larger than they are (a later keyframe, say) gets
+    //its samples from pLarge instead: an allocator made here, and made
+    //again as larger blocks arrive, whose buffers are committed only as
+    //they are used.  The caller decommits pLarge along with pAllocator.
+    static HRESULT GetSamples(
+                    IMemAllocator* pAllocator,
+                    GraphUtil::IMemAllocatorPtr& pLarge,
+                    long count,
+                    long size,
+                    DWORD flags,
+                    samples_t&);
+
+    //Gets the samples for the current block (after GetSampleCount) from
+    //the reader, without copying, if each of its frames lies within one
+    //page of the reader's cache; PopulateSamples then sets their times.
+    //Returns S_FALSE, and no samples, if the block must be copied.
+    HRESULT LendSamples(samples_t&);
+
     HRESULT PopulateSamples(const samples_t&);
     static void Clear(samples_t&);
 
+    //Deferred reads.  While set, PopulateSamples sets the times and flags
+    //of the samples, and notes where their frames are in the file, but
+    //doesn't read them; the caller then reads them with ReadSamples, after
+    //it has released whatever lock keeps the parser to one thread.  The
+    //reader must allow reads from several threads at once.  A batched
+    //sample (see m_batch_bytes) is still read by PopulateSamples.
+    void SetDeferredReads(bool);
+    HRESULT ReadSamples(const samples_t&) const;
+
+    //The calls made to the reader for the frames of the stream, and the
+    //frames those calls delivered, since Init.  A laced block is read
+    //with one call (see ReadBlockFrames), so there are fewer calls than
+    //frames for a stream whose blocks are laced.
+    struct ReadStats
+    {
+        LONGLONG reads;
+        LONGLONG frames;
+    };
+
+    void GetReadStats(ReadStats&) const;
+
     //__int64 GetDuration() const;
     //__int64 GetCurrPosition() const;
     //__int64 GetStopPosition() const;
     __int64 GetCurrTime() const;
     __int64 GetStopTime() const;
 
+    //The cluster of the next block to be delivered, or 0 if the stream
+    //hasn't started yet, or has reached the end.
+    const Cluster* GetCurrCluster() const;
+
+    //The time (in reftime units) the stream was positioned at, which the
+    //times of its samples are relative to.
+    LONGLONG GetBaseTime() const;
+
+    //Trick play.  At a rate above 1, the stream delivers only keyframes,
+    //found through the cues: after each, the first one at least rate
+    //seconds further on, so downstream gets about one a second.  The
+    //blocks in between are skipped, and their payloads are never read.
+    //A rate of 1 or less, or a file without cues, delivers every block.
+    void SetThinning(double rate);
+    bool IsThinning() const;
+
+    //Reverse playback.  The stream walks the cues back a keyframe at a
+    //time, and delivers the blocks from each keyframe up to the one it
+    //delivered before, in decode order, so a decoder can decode the group
+    //and present its frames last to first.  Times count up from where the
+    //stream was positioned, as the stream goes back from there.  When
+    //thinning too, only the keyframes are delivered.  A file without cues
+    //plays forward.
+    void SetReverse(bool);
+    bool IsReverse() const;
+
+    //Catch-up, when the renderer has fallen behind.  Until the stream
+    //reaches a keyframe at or after the drop time (in reftime units, as
+    //the times of its samples are), the blocks that aren't keyframes are
+    //skipped, before their payloads are read; the keyframes before then
+    //are still delivered.  A negative time cancels it, as does a seek.
+    //Not used when thinning, reversing, or for a sparse stream.
+    void SetDropTime(LONGLONG reftime);
+
+    //Damaged or truncated files.  Moves the stream past its current
+    //cluster, to the first block of the track (a keyframe, for video) in
+    //the next cluster that can be found after it, without parsing the
+    //region in between (see ElementReader::FindCluster).  That cluster is
+    //preloaded into the segment, and the stream carries on from it as it
+    //would from a cluster the loader had parsed, with a discontinuity.
+    //Returns S_FALSE, and the stream is at its end, if there is none
+    //(or the stream is reversing, or would pass its stop position).
+    HRESULT Resync();
+
+    //Playlists.  The times of the samples are put off by this much (in
+    //ns), so that a stream that takes over from another at the end of its
+    //file (see the source filter's IWebmPlaylist) carries on from where
+    //that one stopped.  Positions (GetCurrTime, say) are unaffected.
+    void SetSpliceTime(LONGLONG ns);
+
+    //Encrypted tracks.  The frames of a track with a ContentEncryption
+    //(AES, in CTR mode) are decrypted where they are read, in the samples
+    //they go out in, once the key is set; until then its encrypted frames
+    //go out empty.  Its frames are never lent, nor are those of a track
+    //with stripped headers (see ReadFrame).  Set the key before the
+    //stream runs.  Returns false if the key is for another
+    //track (by its ContentEncKeyID).
+    bool IsEncrypted() const;
+    bool SetDecryptionKey(const BYTE* key_id, ULONG key_id_len,
+                          const BYTE* key);
+
     //HRESULT GetAvailable(LONGLONG*) const;
 
     LONGLONG GetSeekTime(LONGLONG currTime, DWORD dwCurr) const;
@@ -68,21 +176,89 @@ public:
 
     ULONG GetClusterCount() const;
 
+    //A sparse stream (text, say) has blocks seconds or minutes apart, so
+    //it doesn't wait for the block after the current one to be parsed to
+    //deliver it: the block is delivered as soon as it is, with the stop
+    //time its duration gives, and the stream moves past it once the next
+    //block has been parsed.  The splitter doesn't hold the loader back for
+    //a sparse stream, nor count its waits as starvation.
+    virtual bool IsSparse() const;
+
+    //For a sparse stream waiting for its next block: the time (in reftime
+    //units, relative to the base) of the last cluster loaded, before
+    //which the stream has no block still to deliver.  Returns false if
+    //no cluster is loaded, or the stream hasn't been positioned yet.
+    bool GetIdleTime(LONGLONG&) const;
+
     const Track* const m_pTrack;
     static std::wstring ConvertFromUTF8(const char*);
 
 protected:
     explicit Stream(const Track*);
     bool m_bDiscontinuity;
+    bool m_bLent;  //the samples to populate came from LendSamples
+    bool m_bDeferred;  //ReadSamples reads the frames of these samples
+
+    //A stream whose connection carries many frames per sample (see
+    //AudioStream) sets a byte budget, and GetSampleCount then gathers the
+    //frames of the current block, and of as many of the blocks after it
+    //as are already parsed, into one sample, up to that many bytes and
+    //frames, and until the block that starts batch_ns after the first.
+    //m_pBatchLast is the last block of the batch.  A budget of 0 means a
+    //sample per frame.
+    long m_batch_bytes;
+    long m_batch_frames;
+    LONGLONG m_batch_ns;
+    const BlockEntry* m_pBatchLast;
+
     const BlockEntry* m_pCurr;
     const BlockEntry* m_pStop;
     //const Cluster* m_pBase;
     LONGLONG m_base_time_ns;
+    LONGLONG m_splice_ns;
+    double m_thin_rate;
+    bool m_bReverse;
+    LONGLONG m_drop_ns;  //-1 unless catching up (see SetDropTime)
 
     virtual std::wostream& GetKind(std::wostream&) const = 0;
 
     HRESULT InitCurr();
 
+    //What OnPopulateSample subtracts from the times of the blocks: the
+    //base time, less the splice time.
+    LONGLONG GetSampleBase() const;
+
+    //Reads the frame of len bytes at pos into ptr, and returns the bytes
+    //of the frame delivered, or a negative value if the read fails.  The
+    //frame of an encrypted track is decrypted where it lies (and is empty
+    //if it can't be).  The header stripped from the frames of the track
+    //(ContentCompression, with ContentCompAlgo 3) is put back as the
+    //frame is read, by reading the frame just after it, so that it costs
+    //no copy.  The sample needs GetStrippedSize() bytes more than len.
+    long ReadFrame(LONGLONG pos, long len, BYTE* ptr) const;
+
+    //Laced blocks.  Reads all of the frames of the block, which lie one
+    //after another in the file, with a single call to the reader, rather
+    //than one per frame, and returns where they were read to (a buffer
+    //of the stream's, until the next call), or 0 if the read fails.
+    //CopyFrame then puts each frame into its sample, as ReadFrame would
+    //have read it there.
+    const BYTE* ReadBlockFrames(const Block*) const;
+    long CopyFrame(const BYTE* src, long len, BYTE* ptr) const;
+
+    //As above, but straight into ptr, for a sample that carries the
+    //frames one after another as they are stored.  Returns the bytes
+    //read, or a negative value if the read fails, or if the frames of
+    //the track aren't delivered as stored (they're encrypted, or have a
+    //stripped header), when they must be read with ReadFrame instead.
+    long ReadBlockFrames(const Block*, BYTE* ptr) const;
+
+    //As above, the bytes of the frame delivered, from the signal byte of
+    //the frame at pos if encrypted, without reading the frame.
+    long GetFrameSize(LONGLONG pos, long len) const;
+
+    long GetStrippedSize() const;
+
     virtual long GetBufferSize() const = 0;
     virtual long GetBufferCount() const = 0;
 
@@ -90,11 +266,56 @@ protected:
                 const BlockEntry*,
                 const samples_t&) const = 0;
 
+    //Whether the blocks before the base time are delivered as preroll
+    //(a seek can start at a keyframe before the base), rather than
+    //thrown away.
+    virtual bool IsPrerollDelivered() const;
+
 private:
 
     const BlockEntry* m_pLocked;
+    const bool m_bEncrypted;
+    webmdshow::AesCtr m_aes;
+    std::vector<BYTE> m_stripped;  //the header the blocks leave out
+    mutable std::vector<BYTE> m_block_frames;  //see ReadBlockFrames
+    long ReadBlockSpan(const Block*, BYTE*) const;
+    static LONGLONG GetBlockSpan(const Block*, LONGLONG& pos);
+    mutable ReadStats m_read_stats;
     HRESULT SetCurr(const mkvparser::BlockEntry*);
 
+    //Sparse streams: m_pCurr has been delivered, and the stream moves
+    //past it when the block after it has been parsed.
+    bool m_bCurrDelivered;
+    HRESULT SkipDelivered();
+    void DiscardCurr(const BlockEntry* pNext);
+
+    //Catching up: whether the block is one to skip (at a keyframe late
+    //enough it stops the catch-up, and is not), and the first block from
+    //pNext on that isn't, as far as the blocks are parsed.
+    bool IsDropped(const BlockEntry*);
+    const BlockEntry* GetDropNext(const BlockEntry* pNext);
+    HRESULT SkipDropped();
+
+    struct FrameExtent
+    {
+        LONGLONG pos;
+        long len;
+    };
+
+    typedef std::vector<FrameExtent> extents_t;
+
+    bool m_bDeferReads;
+    extents_t m_deferred;  //the frames of the samples last populated
+    long InitBatch();
+    const BlockEntry* GetThinNext(const BlockEntry*) const;
+
+    //The group of blocks being delivered in reverse (see SetReverse): from
+    //the keyframe at m_gop_start_ns, up to the block at m_gop_stop_ns.
+    LONGLONG m_gop_start_ns;
+    LONGLONG m_gop_stop_ns;
+    const BlockEntry* GetReverseNext(const BlockEntry*);
+    static void ReverseTimes(const samples_t&);
+
 };
 
 }  //end namespace mkvparser
@@ -368,7 +368,6 @@ void AudioStream::GetVorbisMediaTypes(CMediaTypes& mtv) const
     AM_MEDIA_TYPE mt;
 
     mt.majortype = MEDIATYPE_Audio;
-    mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2;
     mt.bFixedSizeSamples = FALSE;
     mt.bTemporalCompression = FALSE;
     mt.lSampleSize = 0;
@@ -377,6 +376,14 @@ void AudioStream::GetVorbisMediaTypes(CMediaTypes& mtv) const
     mt.cbFormat = static_cast<ULONG>(cb);
     mt.pbFormat = pb;
 
+    //Laced first: a downstream filter that understands it (the Vorbis
+    //decoders, and the muxer) gets a batch of frames per sample, instead
+    //of the thousands of samples a minute that small frames would need.
+
+    mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing;
+    mtv.Add(mt);
+
+    mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2;
     mtv.Add(mt);
 
     //TODO: if we decide source filter should attempt to also
@@ -410,16 +417,38 @@ HRESULT AudioStream::QueryAccept(const AM_MEDIA_TYPE* pmt) const
 
     if (_stricmp(id, "A_VORBIS") == 0)
     {
-        if (mt.subtype != VorbisTypes::MEDIASUBTYPE_Vorbis2)
-            return S_FALSE;
+        if (mt.subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2)
+            return S_OK;
 
-        return S_OK;
+        if (mt.subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing)
+            return S_OK;
+
+        return S_FALSE;
     }
 
     return S_FALSE;
 }
 
 
+HRESULT AudioStream::SetConnectionMediaType(const AM_MEDIA_TYPE& mt)
+{
+    if (mt.subtype != VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing)
+    {
+        m_batch_bytes = 0;  //a sample per frame
+        return S_OK;
+    }
+
+    //A batch is about 100ms of audio (a handful of frames at 48kHz), and
+    //no more frames than the lacing count byte allows.
+
+    m_batch_bytes = 16 * 1024;
+    m_batch_frames = 256;
+    m_batch_ns = 100000000;
+
+    return S_OK;
+}
+
+
 #if 0  //if we decide to support Xiph Ogg Vorbis decoder filter:
 HRESULT AudioStream::SetConnectionMediaType(const AM_MEDIA_TYPE&)
 {
@@ -492,6 +521,14 @@ void AudioStream::OnPopulateSample(
     assert(m_pCurr != m_pStop);
     assert(!m_pCurr->EOS());
 
+    if (m_batch_bytes > 0)
+    {
+        assert(samples.size() == 1);
+        OnPopulateBatch(pNextEntry, samples[0]);
+
+        return;
+    }
+
     const Block* const pCurrBlock = m_pCurr->GetBlock();
     assert(pCurrBlock);
     assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
@@ -507,43 +544,11 @@ void AudioStream::OnPopulateSample(
     assert(start_ns >= 0);
     //assert((start_ns % 100) == 0);
 
-    const LONGLONG base_ns = m_base_time_ns;
+    const LONGLONG base_ns = GetSampleBase();
     //assert(base_ns >= 0);
     assert(start_ns >= base_ns);
 
-    Segment* const pSegment = m_pTrack->m_pSegment;
-    IMkvReader* const pFile = pSegment->m_pReader;
-
-    __int64 stop_ns;
-
-    if ((pNextEntry == 0) || pNextEntry->EOS())
-    {
-        const LONGLONG duration_ns = pSegment->GetDuration();
-
-        if ((duration_ns >= 0) && (duration_ns > start_ns))
-            stop_ns = duration_ns;
-        else
-        {
-            const LONGLONG ns_per_frame = 10000000;  //10ms
-            stop_ns = start_ns + LONGLONG(nFrames) * ns_per_frame;
-        }
-    }
-    else
-    {
-        const Block* const pNextBlock = pNextEntry->GetBlock();
-        assert(pNextBlock);
-
-        const Cluster* const pNextCluster = pNextEntry->GetCluster();
-
-        stop_ns = pNextBlock->GetTime(pNextCluster);
-        //assert(stop_ns > start_ns);
-
-        if (stop_ns <= start_ns)
-        {
-            const LONGLONG ns_per_frame = 10000000;  //10ms
-            stop_ns = start_ns + LONGLONG(nFrames) * ns_per_frame;
-        }
-    }
+    const __int64 stop_ns = GetStopTime(pNextEntry, start_ns, nFrames);
 
     __int64 start_reftime = (start_ns - base_ns) / 100;
     assert(start_ns >= 0);
@@ -561,6 +566,11 @@ void AudioStream::OnPopulateSample(
 
     BOOL bDiscontinuity = m_bDiscontinuity ? TRUE : FALSE;
 
+    const BYTE* src = 0;  //the frames of a laced block, read at once
+
+    if ((nFrames > 1) && !m_bLent && !m_bDeferred)
+        src = ReadBlockFrames(pCurrBlock);  //else read a frame at a time
+
     for (int idx = 0; idx < nFrames; ++idx)
     {
         IMediaSample* const pSample = samples[idx];
@@ -573,18 +583,31 @@ void AudioStream::OnPopulateSample(
         const long tgtsize = pSample->GetSize();
         tgtsize;
         assert(tgtsize >= 0);
-        assert(tgtsize >= srcsize);
+        assert(tgtsize >= srcsize + GetStrippedSize());
 
-        BYTE* ptr;
+        HRESULT hr;
+        long len = srcsize;
 
-        HRESULT hr = pSample->GetPointer(&ptr);
-        assert(SUCCEEDED(hr));
-        assert(ptr);
+        if (!m_bLent && !m_bDeferred)  //see LendSamples, ReadSamples
+        {
+            BYTE* ptr;
+
+            hr = pSample->GetPointer(&ptr);  //read srcsize bytes
+            assert(SUCCEEDED(hr));
+            assert(ptr);
+
+            if (src == 0)
+                len = ReadFrame(f.pos, srcsize, ptr);
+            else
+            {
+                len = CopyFrame(src, srcsize, ptr);
+                src += srcsize;
+            }
 
-        const long status = f.Read(pFile, ptr);
-        assert(status == 0);  //all bytes were read
+            assert(len >= 0);  //all bytes were read
+        }
 
-        hr = pSample->SetActualDataLength(srcsize);
+        hr = pSample->SetActualDataLength(len);
 
         hr = pSample->SetPreroll(FALSE);
         assert(SUCCEEDED(hr));
@@ -613,6 +636,167 @@ void AudioStream::OnPopulateSample(
 }
 
 
+void AudioStream::OnPopulateBatch(
+    const BlockEntry* pNextEntry,
+    IMediaSample* pSample) const
+{
+    //The frames of the blocks from m_pCurr to m_pBatchLast, laced the way
+    //InitBatch sized them, in one sample that spans the blocks.
+
+    assert(m_pBatchLast);
+
+    BYTE* ptr;
+
+    HRESULT hr = pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+    assert(ptr);
+
+    BYTE* const buf = ptr;
+
+    int nFrames = 0;
+
+    for (const BlockEntry* pEntry = m_pCurr; ; )
+    {
+        nFrames += pEntry->GetBlock()->GetFrameCount();
+
+        if (pEntry == m_pBatchLast)
+            break;
+
+        const long status = m_pTrack->GetNext(pEntry, pEntry);
+        status;
+        assert(status >= 0);
+    }
+
+    assert(nFrames > 0);
+    assert(nFrames <= 256);
+
+    *ptr++ = static_cast<BYTE>(nFrames - 1);  //biased count
+
+    int idx = 0;
+
+    for (int pass = 0; pass < 2; ++pass)  //sizes, then frames
+    {
+        for (const BlockEntry* pEntry = m_pCurr; ; )
+        {
+            const Block* const pBlock = pEntry->GetBlock();
+            const int n = pBlock->GetFrameCount();
+
+            long span = -1;  //the frames of a laced block, read at once
+
+            if ((pass > 0) && (n > 1))
+                span = ReadBlockFrames(pBlock, ptr);
+
+            if (span >= 0)
+                ptr += span;
+
+            for (int i = 0; (span < 0) && (i < n); ++i)
+            {
+                const Block::Frame& f = pBlock->GetFrame(i);
+
+                if (pass > 0)
+                {
+                    const long len = ReadFrame(f.pos, f.len, ptr);
+                    assert(len >= 0);  //all bytes were read
+
+                    ptr += len;
+                }
+                else if (++idx < nFrames)  //last frame has no size
+                {
+                    long len = GetFrameSize(f.pos, f.len);
+
+                    while (len >= 255)
+                    {
+                        *ptr++ = 255;
+                        len -= 255;
+                    }
+
+                    *ptr++ = static_cast<BYTE>(len);
+                }
+            }
+
+            if (pEntry == m_pBatchLast)
+                break;
+
+            const long status = m_pTrack->GetNext(pEntry, pEntry);
+            status;
+            assert(status >= 0);
+        }
+    }
+
+    const long len = static_cast<long>(ptr - buf);
+    assert(len <= pSample->GetSize());
+
+    hr = pSample->SetActualDataLength(len);
+    assert(SUCCEEDED(hr));
+
+    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    const __int64 start_ns = pCurrBlock->GetTime(m_pCurr->GetCluster());
+    const __int64 stop_ns = GetStopTime(pNextEntry, start_ns, nFrames);
+
+    const LONGLONG base_ns = GetSampleBase();
+    assert(start_ns >= base_ns);
+
+    LONGLONG start_reftime = (start_ns - base_ns) / 100;
+    LONGLONG stop_reftime = (stop_ns - base_ns) / 100;
+    assert(stop_reftime > start_reftime);
+
+    hr = pSample->SetTime(&start_reftime, &stop_reftime);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetPreroll(FALSE);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetMediaType(0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetDiscontinuity(m_bDiscontinuity ? TRUE : FALSE);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetMediaTime(0, 0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSyncPoint(TRUE);
+    assert(SUCCEEDED(hr));
+}
+
+
+LONGLONG AudioStream::GetStopTime(
+    const BlockEntry* pNextEntry,
+    LONGLONG start_ns,
+    int nFrames) const
+{
+    //The stop time of the frames that start at start_ns is the time of the
+    //block that follows them, or the end of the segment.
+
+    Segment* const pSegment = m_pTrack->m_pSegment;
+
+    const LONGLONG ns_per_frame = 10000000;  //10ms
+
+    if ((pNextEntry == 0) || pNextEntry->EOS())
+    {
+        const LONGLONG duration_ns = pSegment->GetDuration();
+
+        if ((duration_ns >= 0) && (duration_ns > start_ns))
+            return duration_ns;
+
+        return start_ns + LONGLONG(nFrames) * ns_per_frame;
+    }
+
+    const Block* const pNextBlock = pNextEntry->GetBlock();
+    assert(pNextBlock);
+
+    const Cluster* const pNextCluster = pNextEntry->GetCluster();
+
+    const LONGLONG stop_ns = pNextBlock->GetTime(pNextCluster);
+    //assert(stop_ns > start_ns);
+
+    if (stop_ns <= start_ns)
+        return start_ns + LONGLONG(nFrames) * ns_per_frame;
+
+    return stop_ns;
+}
+
+
 #if 0  //if we decide to support Xiph Ogg Vorbis decoder filter
 bool AudioStream::SendPreroll(IMediaSample* pSample)
 {
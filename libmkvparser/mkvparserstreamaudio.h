@@ -25,9 +25,7 @@ public:
     void GetMediaTypes(CMediaTypes&) const;
     HRESULT QueryAccept(const AM_MEDIA_TYPE*) const;
 
-#if 0  //if we decide to support Xiph Ogg Vorbis decoder filter:
     HRESULT SetConnectionMediaType(const AM_MEDIA_TYPE&);
-#endif
 
     //HRESULT UpdateAllocatorProperties(ALLOCATOR_PROPERTIES&) const;
 
@@ -38,6 +36,8 @@ protected:
     long GetBufferCount() const;
 
     void OnPopulateSample(const BlockEntry*, const samples_t&) const;
+    void OnPopulateBatch(const BlockEntry*, IMediaSample*) const;
+    LONGLONG GetStopTime(const BlockEntry*, LONGLONG, int) const;
 
     void GetVorbisMediaTypes(CMediaTypes&) const;
 
@@ -1,4 +1,5 @@
 #include <objbase.h>
+#include <strmif.h>
 #include "mkvparserstreamreader.h"
 
 namespace mkvparser
@@ -21,4 +22,13 @@ void IStreamReader::UnlockPages(const BlockEntry*)
 {
 }
 
+HRESULT IStreamReader::LendFrame(long long, long, IMediaSample** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+    return S_FALSE;
+}
+
 }  //end namespace mkvparser
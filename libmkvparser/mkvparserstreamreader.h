@@ -1,4 +1,5 @@
 #pragma once
+#include <strmif.h>
 #include "mkvparser.hpp"
 
 namespace mkvparser
@@ -17,6 +18,13 @@ namespace mkvparser
         virtual HRESULT LockPages(const BlockEntry*);
         virtual void UnlockPages(const BlockEntry*);
 
+        //Gets a sample whose buffer is the reader's own copy of the len
+        //bytes at pos, which must be in pages locked by LockPages.  The
+        //bytes stay valid until the sample is released, so they need not
+        //be copied.  Returns S_FALSE (and no sample) if the reader cannot
+        //lend them; the caller then reads them into a sample of its own.
+        virtual HRESULT LendFrame(long long pos, long len, IMediaSample**);
+
     };
 
 }  //end namespace mkvparser
@@ -0,0 +1,234 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "mkvparserstreamtext.h"
+#include "mkvparser.hpp"
+#include "webmtypes.h"
+#include "cmediatypes.h"
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <uuids.h>
+
+namespace mkvparser
+{
+
+TextStream* TextStream::CreateInstance(const Track* pTrack)
+{
+    assert(pTrack);
+
+    const long long type = pTrack->GetType();
+
+    if ((type != 0x11) && (type != 0x21))  //subtitle, metadata
+        return 0;
+
+    if (pTrack->GetCodecId() == 0)
+        return 0;  //nothing to tell downstream what the frames are
+
+    TextStream* const s = new (std::nothrow) TextStream(pTrack);
+    assert(s);  //TODO
+
+    return s;
+}
+
+
+TextStream::TextStream(const Track* pTrack) : Stream(pTrack)
+{
+}
+
+
+std::wostream& TextStream::GetKind(std::wostream& os) const
+{
+    return os << L"Text";
+}
+
+
+bool TextStream::IsSparse() const
+{
+    return true;
+}
+
+
+void TextStream::GetMediaTypes(CMediaTypes& mtv) const
+{
+    mtv.Clear();
+
+    const char* const id = m_pTrack->GetCodecId();
+    assert(id);
+
+    size_t cp_size;
+    const BYTE* const cp = m_pTrack->GetCodecPrivate(cp_size);
+
+    const size_t id_size = strlen(id) + 1;  //with its terminator
+
+    std::vector<BYTE> format(id_size + (cp ? cp_size : 0));
+
+    memcpy(&format[0], id, id_size);
+
+    if (cp && (cp_size > 0))
+        memcpy(&format[id_size], cp, cp_size);
+
+    AM_MEDIA_TYPE mt;
+
+    mt.majortype = MEDIATYPE_Text;
+    mt.subtype = WebmTypes::MEDIASUBTYPE_WEBM_TEXT;
+    mt.bFixedSizeSamples = FALSE;
+    mt.bTemporalCompression = FALSE;
+    mt.lSampleSize = 0;
+    mt.formattype = WebmTypes::FORMAT_WEBM_TEXT;
+    mt.pUnk = 0;
+    mt.cbFormat = static_cast<ULONG>(format.size());
+    mt.pbFormat = &format[0];
+
+    mtv.Add(mt);
+}
+
+
+HRESULT TextStream::QueryAccept(const AM_MEDIA_TYPE* pmt) const
+{
+    if (pmt == 0)
+        return E_INVALIDARG;
+
+    const AM_MEDIA_TYPE& mt = *pmt;
+
+    if (mt.majortype != MEDIATYPE_Text)
+        return S_FALSE;
+
+    if (mt.subtype != WebmTypes::MEDIASUBTYPE_WEBM_TEXT)
+        return S_FALSE;
+
+    return S_OK;
+}
+
+
+long TextStream::GetBufferSize() const
+{
+    //Cues are short; a larger block gets a buffer of its own (see
+    //Stream::GetSamples).
+    return 4096;
+}
+
+
+long TextStream::GetBufferCount() const
+{
+    return 16;
+}
+
+
+void TextStream::OnPopulateSample(
+    const BlockEntry* pNextEntry,
+    const samples_t& samples) const
+{
+    assert(!samples.empty());
+    assert(m_pCurr);
+    assert(!m_pCurr->EOS());
+
+    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    assert(pCurrBlock);
+    assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
+
+    const Cluster* const pCurrCluster = m_pCurr->GetCluster();
+    assert(pCurrCluster);
+
+    const int nFrames = pCurrBlock->GetFrameCount();
+    assert(nFrames > 0);  //checked by caller
+    assert(samples.size() == samples_t::size_type(nFrames));
+
+    Segment* const pSegment = m_pTrack->m_pSegment;
+
+    const LONGLONG base_ns = GetSampleBase();
+    const LONGLONG start_ns = pCurrBlock->GetTime(pCurrCluster);
+
+    //A cue is shown for the duration of its block group.  Without one, it
+    //lasts until the next block, if that is known, since the stream
+    //doesn't wait for it (see IsSparse).
+
+    LONGLONG stop_ns = -1;
+
+    if (m_pCurr->GetKind() == BlockEntry::kBlockGroup)
+    {
+        const BlockGroup* const pGroup =
+            static_cast<const BlockGroup*>(m_pCurr);
+
+        const LONGLONG duration = pGroup->GetDurationTimeCode();
+
+        if (duration > 0)
+        {
+            const SegmentInfo* const pInfo = pSegment->GetInfo();
+            stop_ns = start_ns + duration * pInfo->GetTimeCodeScale();
+        }
+    }
+
+    if (stop_ns >= 0)
+        __noop;
+    else if ((pNextEntry != 0) && !pNextEntry->EOS())
+    {
+        const Block* const pNextBlock = pNextEntry->GetBlock();
+        stop_ns = pNextBlock->GetTime(pNextEntry->GetCluster());
+    }
+    else
+        stop_ns = start_ns + 1000000;  //add 1ms
+
+    LONGLONG start_reftime = (start_ns - base_ns) / 100;
+    LONGLONG stop_reftime = (stop_ns - base_ns) / 100;
+
+    if (stop_reftime < start_reftime)
+        stop_reftime = start_reftime;
+
+    BOOL bDiscontinuity = m_bDiscontinuity ? TRUE : FALSE;
+
+    for (int idx = 0; idx < nFrames; ++idx)
+    {
+        IMediaSample* const pSample = samples[idx];
+
+        const Block::Frame& f = pCurrBlock->GetFrame(idx);
+
+        HRESULT hr;
+        long len = f.len;
+
+        if (!m_bLent && !m_bDeferred)  //see LendSamples, ReadSamples
+        {
+            BYTE* ptr;
+
+            hr = pSample->GetPointer(&ptr);
+            assert(SUCCEEDED(hr));
+            assert(ptr);
+
+            len = ReadFrame(f.pos, f.len, ptr);
+            assert(len >= 0);  //all bytes were read
+        }
+
+        hr = pSample->SetActualDataLength(len);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetPreroll(FALSE);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetMediaType(0);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetDiscontinuity(bDiscontinuity);
+        assert(SUCCEEDED(hr));
+
+        bDiscontinuity = FALSE;
+
+        hr = pSample->SetMediaTime(0, 0);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetSyncPoint(TRUE);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetTime(&start_reftime, &stop_reftime);
+        assert(SUCCEEDED(hr));
+    }
+}
+
+
+}  //end namespace mkvparser
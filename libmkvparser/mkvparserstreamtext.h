@@ -0,0 +1,47 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "mkvparserstream.h"
+
+namespace mkvparser
+{
+
+//The stream of a subtitle (WebVTT, say) or metadata track, passed through
+//as it is: MEDIATYPE_Text, with the WebmTypes::FORMAT_WEBM_TEXT format
+//block (the codec ID and the codec private data of the track; see
+//webmtypes.h).  Each frame is a sample, whose stop time is given by the
+//duration of its block group.  The stream is sparse (see IsSparse).
+
+class TextStream : public Stream
+{
+    explicit TextStream(const Track*);
+    TextStream(const TextStream&);
+    TextStream& operator=(const TextStream&);
+
+public:
+    //Returns 0 if the track isn't a subtitle or metadata track.
+    static TextStream* CreateInstance(const Track*);
+
+    void GetMediaTypes(CMediaTypes&) const;
+    HRESULT QueryAccept(const AM_MEDIA_TYPE*) const;
+
+    bool IsSparse() const;
+
+protected:
+    std::wostream& GetKind(std::wostream&) const;
+
+    long GetBufferSize() const;
+    long GetBufferCount() const;
+
+    void OnPopulateSample(const BlockEntry*, const samples_t&) const;
+
+};
+
+
+}  //end namespace mkvparser
@@ -65,7 +65,10 @@ VideoStream* VideoStream::CreateInstance(const VideoTrack* pTrack)
 }
 
 
-VideoStream::VideoStream(const VideoTrack* pTrack) : Stream(pTrack)
+VideoStream::VideoStream(const VideoTrack* pTrack) :
+    Stream(pTrack),
+    m_cbBuffer(0),
+    m_cBuffers(0)
 {
 }
 
@@ -315,25 +318,133 @@ HRESULT VideoStream::UpdateAllocatorProperties(
 
 long VideoStream::GetBufferSize() const
 {
+    if (m_cbBuffer <= 0)
+        EstimateBuffers();
+
+    return m_cbBuffer;
+}
+
+
+long VideoStream::GetBufferCount() const
+{
+    if (m_cBuffers <= 0)
+        EstimateBuffers();
+
+    return m_cBuffers;
+}
+
+
+void VideoStream::EstimateBuffers() const
+{
+    //A compressed frame is a small fraction of the size of the picture, so
+    //we size the buffers from the largest frame of this track in the first
+    //clusters that have been loaded, with room for larger keyframes later
+    //on.  A block larger still gets samples of its own (see
+    //Stream::GetSamples), so this need not be the worst case.  The count
+    //holds the frames of kBufferDuration, at the track's frame rate.
+
+    enum { kScanClusters = 8 };
+    enum { kMinBufferSize = 64 * 1024 };
+    enum { kMinBufferCount = 10, kMaxBufferCount = 60 };
+
+    const double kBufferDuration = 0.5;  //seconds
+
     const VideoTrack* const pTrack = static_cast<const VideoTrack*>(m_pTrack);
+    const long long tn = pTrack->GetNumber();
 
-    const __int64 w = pTrack->GetWidth();
-    const __int64 h = pTrack->GetHeight();
+    Segment* const pSegment = pTrack->m_pSegment;
+
+    long max_len = 0;
+    long long frame_count = 0;
+    long long first_ns = -1;
+    long long last_ns = -1;
+
+    const long n = pSegment->GetCount();  //just those loaded
+    const Cluster* pCluster = pSegment->GetFirst();
+
+    for (long i = 0; (i < n) && (i < kScanClusters); ++i)
+    {
+        if ((pCluster == 0) || pCluster->EOS())
+            break;
+
+        const BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            if (pBlock->GetTrackNumber() == tn)
+            {
+                for (int j = 0; j < pBlock->GetFrameCount(); ++j)
+                {
+                    const Block::Frame& f = pBlock->GetFrame(j);
+
+                    if (f.len > max_len)
+                        max_len = f.len;
+                }
 
-    //TODO: we can do better here.  VPx is based on YV12, which would waste
-    //less memory than assuming RGB32.
-    const __int64 size_ = w * h * 4;  //RGB32 (worst case)
-    assert(size_ <= LONG_MAX);
+                const long long ns = pBlock->GetTime(pCluster);
 
-    const long size = static_cast<LONG>(size_);
+                if (first_ns < 0)
+                    first_ns = ns;
 
-    return size;
+                last_ns = ns;
+                frame_count += pBlock->GetFrameCount();
+            }
+
+            status = pCluster->GetNext(pEntry, pEntry);
+        }
+
+        if (status < 0)  //not parsed yet
+            break;
+
+        if ((i + 1) < n)
+            pCluster = pSegment->GetNext(pCluster);
+    }
+
+    const long long w = pTrack->GetWidth();
+    const long long h = pTrack->GetHeight();
+
+    long long size;
+
+    if (max_len > 0)
+        size = 2LL * max_len;
+    else
+        size = w * h * 3 / 2;  //no frames yet: an uncompressed I420 frame
+
+    if (size < kMinBufferSize)
+        size = kMinBufferSize;
+
+    assert(size <= LONG_MAX);
+    m_cbBuffer = static_cast<long>(size);
+
+    double rate = pTrack->GetFrameRate();
+
+    if ((rate <= 0) && (frame_count > 1) && (last_ns > first_ns))
+        rate = double(frame_count - 1) * 1000000000 / (last_ns - first_ns);
+
+    long count = kMinBufferCount;
+
+    if (rate > 0)
+    {
+        const double count_ = rate * kBufferDuration + 0.5;
+
+        if (count_ >= kMaxBufferCount)
+            count = kMaxBufferCount;
+        else if (count_ > kMinBufferCount)
+            count = static_cast<long>(count_);
+    }
+
+    m_cBuffers = count;
 }
 
 
-long VideoStream::GetBufferCount() const
+bool VideoStream::IsPrerollDelivered() const
 {
-    return 10;  //?
+    return true;
 }
 
 
@@ -364,11 +475,10 @@ void VideoStream::OnPopulateSample(
     assert(nFrames > 0);  //checked by caller
     assert(samples.size() == samples_t::size_type(nFrames));
 
-    const LONGLONG base_ns = m_base_time_ns;
+    const LONGLONG base_ns = GetSampleBase();
     //assert(base_ns >= 0);
 
     Segment* const pSegment = m_pTrack->m_pSegment;
-    IMkvReader* const pFile = pSegment->m_pReader;
 
     const bool bKey = pCurrBlock->IsKey();
     assert(!m_bDiscontinuity || bKey);
@@ -376,9 +486,12 @@ void VideoStream::OnPopulateSample(
     const bool bInvisible = pCurrBlock->IsInvisible();
 
     const __int64 start_ns = pCurrBlock->GetTime(pCurrCluster);
-    assert(start_ns >= base_ns);
     //assert((start_ns % 100) == 0);
 
+    //A block before the base is decoded, but not presented.
+    const bool bPreroll =
+        bInvisible || ((start_ns < m_base_time_ns) && !m_bReverse);
+
     __int64 stop_ns;
 
     if ((pNextEntry == 0) || pNextEntry->EOS())
@@ -419,6 +532,11 @@ void VideoStream::OnPopulateSample(
 
     BOOL bDiscontinuity = m_bDiscontinuity ? TRUE : FALSE;
 
+    const BYTE* src = 0;  //the frames of a laced block, read at once
+
+    if ((nFrames > 1) && !m_bLent && !m_bDeferred)
+        src = ReadBlockFrames(pCurrBlock);  //else read a frame at a time
+
     for (int idx = 0; idx < nFrames; ++idx)
     {
         IMediaSample* const pSample = samples[idx];
@@ -431,20 +549,33 @@ void VideoStream::OnPopulateSample(
         const long tgtsize = pSample->GetSize();
         tgtsize;
         assert(tgtsize >= 0);
-        assert(tgtsize >= srcsize);
+        assert(tgtsize >= srcsize + GetStrippedSize());
 
-        BYTE* ptr;
+        HRESULT hr;
+        long len = srcsize;
 
-        HRESULT hr = pSample->GetPointer(&ptr);  //read srcsize bytes
-        assert(SUCCEEDED(hr));
-        assert(ptr);
+        if (!m_bLent && !m_bDeferred)  //see LendSamples, ReadSamples
+        {
+            BYTE* ptr;
+
+            hr = pSample->GetPointer(&ptr);  //read srcsize bytes
+            assert(SUCCEEDED(hr));
+            assert(ptr);
+
+            if (src == 0)
+                len = ReadFrame(f.pos, srcsize, ptr);
+            else
+            {
+                len = CopyFrame(src, srcsize, ptr);
+                src += srcsize;
+            }
 
-        const long status = f.Read(pFile, ptr);
-        assert(status == 0);  //all bytes were read
+            assert(len >= 0);  //all bytes were read
+        }
 
-        hr = pSample->SetActualDataLength(srcsize);
+        hr = pSample->SetActualDataLength(len);
 
-        hr = pSample->SetPreroll(bInvisible ? TRUE : FALSE);
+        hr = pSample->SetPreroll(bPreroll ? TRUE : FALSE);
         assert(SUCCEEDED(hr));
 
         hr = pSample->SetMediaType(0);
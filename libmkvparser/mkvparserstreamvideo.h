@@ -34,10 +34,19 @@ protected:
     long GetBufferCount() const;
 
     void OnPopulateSample(const BlockEntry*, const samples_t&) const;
+    bool IsPrerollDelivered() const;  //the decoder needs the frames
 
     void GetVpxMediaTypes(const GUID& subtype, CMediaTypes&) const;
     void GetVfwMediaTypes(CMediaTypes&) const;
 
+private:
+
+    //Estimated from the first clusters, the first time either is needed.
+    mutable long m_cbBuffer;
+    mutable long m_cBuffers;
+
+    void EstimateBuffers() const;
+
 };
 
 
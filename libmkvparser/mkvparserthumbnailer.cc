@@ -0,0 +1,519 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <process.h>
+#include "mkvparserthumbnailer.h"
+#include "mkvparser.hpp"
+#include "mkvparserfilereader.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vp8dx.h"
+#include "cpuutil.h"
+#include "libyuv_util.h"
+#include "vpxdecoderpool.h"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+class Worker
+{
+    Worker(const Worker&);
+    Worker& operator=(const Worker&);
+
+public:
+    Worker();
+    ~Worker();
+
+    HRESULT Open(const wchar_t*);
+
+    void Get(
+        LONGLONG time_ns,
+        ULONG width,
+        ULONG height,
+        Thumbnailer::Thumbnail&);
+
+private:
+    FileReader m_file;
+    Segment* m_pSegment;
+    const Track* m_pTrack;
+
+    vpx_codec_ctx_t m_ctx;
+    webmdshow::VpxDecoderPool::Key m_decoder_key;  //m_ctx borrowed for
+    bool m_bDecoder;
+
+    std::vector<unsigned char> m_buf;
+
+    const BlockEntry* Find(LONGLONG time_ns);
+    HRESULT Decode(const Block*, const vpx_image_t*&);
+
+};
+
+
+Worker::Worker() :
+    m_pSegment(0),
+    m_pTrack(0),
+    m_bDecoder(false)
+{
+}
+
+
+Worker::~Worker()
+{
+    if (m_bDecoder)
+        webmdshow::VpxDecoderPool::Get().Return(m_decoder_key, &m_ctx);
+
+    delete m_pSegment;
+}
+
+
+HRESULT Worker::Open(const wchar_t* filename)
+{
+    HRESULT hr = m_file.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    long long result = h.Parse(&m_file, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = Segment::CreateInstance(&m_file, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    result = m_pSegment->ParseHeaders();
+
+    if (result < 0)
+        return E_FAIL;
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return E_FAIL;
+
+    vpx_codec_iface_t* vpx = 0;
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack == 0) || (pTrack->GetType() != 1))  //not video
+            continue;
+
+        const char* const id = pTrack->GetCodecId();
+
+        if (id == 0)
+            continue;
+
+        if (_stricmp(id, "V_VP8") == 0)
+            vpx = &vpx_codec_vp8_dx_algo;
+
+        else if (_stricmp(id, "V_VP9") == 0)
+            vpx = &vpx_codec_vp9_dx_algo;
+
+        else
+            continue;
+
+        m_pTrack = pTrack;
+        break;
+    }
+
+    if (m_pTrack == 0)
+        return E_FAIL;
+
+    if (m_pSegment->GetCues())
+        __noop;
+    else if (const SeekHead* pSH = m_pSegment->GetSeekHead())
+    {
+        const int count = pSH->GetCount();
+
+        for (int idx = 0; idx < count; ++idx)
+        {
+            const SeekHead::Entry* const p = pSH->GetEntry(idx);
+
+            if (p->id == 0x0C53BB6B)  //Cues ID
+            {
+                long len;
+
+                const long status = m_pSegment->ParseCues(p->pos, pos, len);
+                status;
+                assert(status >= 0);  //all data available in local file
+
+                break;
+            }
+        }
+    }
+
+    //We decode one keyframe at a time, and the requests are already
+    //spread over threads, so the decoder gets no threads of its own.
+
+    webmdshow::VpxDecoderPool::Key& key = m_decoder_key;
+
+    key.iface = vpx;
+    key.flags = 0;
+    key.threads = 1;
+    key.width = 0;  //keyframes of any size
+    key.height = 0;
+
+    webmdshow::VpxDecoderPool& pool = webmdshow::VpxDecoderPool::Get();
+    const vpx_codec_err_t err = pool.Borrow(key, &m_ctx);
+
+    if (err == VPX_CODEC_MEM_ERROR)
+        return E_OUTOFMEMORY;
+
+    if (err != VPX_CODEC_OK)
+        return E_FAIL;
+
+    m_bDecoder = true;
+    return S_OK;
+}
+
+
+const BlockEntry* Worker::Find(LONGLONG time_ns)
+{
+    if (const Cues* pCues = m_pSegment->GetCues())
+    {
+        while (!pCues->DoneParsing())
+        {
+            pCues->LoadCuePoint();
+
+            const CuePoint* const pCP = pCues->GetLast();
+            assert(pCP);
+
+            if (pCP->GetTime(m_pSegment) >= time_ns)
+                break;
+        }
+
+        const CuePoint* pCP;
+        const CuePoint::TrackPosition* pTP;
+
+        if (pCues->Find(time_ns, m_pTrack, pCP, pTP))
+        {
+            const BlockEntry* const pCurr = pCues->GetBlock(pCP, pTP);
+
+            if ((pCurr != 0) && !pCurr->EOS())
+                return pCurr;
+        }
+    }
+
+    //No Cues, or no cue point for this track: search the clusters.
+
+    const BlockEntry* pCurr;
+
+    for (;;)
+    {
+        const long status = m_pTrack->Seek(time_ns, pCurr);
+
+        if (status >= 0)
+            break;
+
+        if (status != E_BUFFER_NOT_FULL)
+            return 0;
+
+        if (m_pSegment->LoadCluster() != 0)  //error, or no more clusters
+            return 0;
+    }
+
+    return pCurr;
+}
+
+
+HRESULT Worker::Decode(const Block* pBlock, const vpx_image_t*& img)
+{
+    img = 0;
+
+    const int nFrames = pBlock->GetFrameCount();
+
+    for (int idx = 0; idx < nFrames; ++idx)
+    {
+        const Block::Frame& f = pBlock->GetFrame(idx);
+
+        if (f.len <= 0)  //weird
+            return E_FAIL;
+
+        m_buf.resize(f.len);
+
+        if (f.Read(&m_file, &m_buf[0]) != 0)
+            return E_FAIL;
+
+        const unsigned int len = static_cast<unsigned int>(f.len);
+
+        const vpx_codec_err_t err =
+            vpx_codec_decode(&m_ctx, &m_buf[0], len, 0, 0);
+
+        if (err != VPX_CODEC_OK)
+            return E_FAIL;
+
+        vpx_codec_iter_t iter = 0;
+
+        while (const vpx_image_t* p = vpx_codec_get_frame(&m_ctx, &iter))
+            img = p;
+    }
+
+    return img ? S_OK : S_FALSE;
+}
+
+
+void Worker::Get(
+    LONGLONG time_ns,
+    ULONG width,
+    ULONG height,
+    Thumbnailer::Thumbnail& t)
+{
+    const BlockEntry* const pCurr = Find(time_ns);
+
+    if ((pCurr == 0) || pCurr->EOS())
+    {
+        t.hr = S_FALSE;
+        return;
+    }
+
+    const Block* const pBlock = pCurr->GetBlock();
+    assert(pBlock);
+
+    if (!pBlock->IsKey())  //weird: can't decode it on its own
+    {
+        t.hr = E_FAIL;
+        return;
+    }
+
+    const vpx_image_t* img;
+
+    const HRESULT hr = Decode(pBlock, img);
+
+    if (hr != S_OK)
+    {
+        t.hr = hr;
+        return;
+    }
+
+    if (width == 0)
+        width = img->d_w;
+
+    if (height == 0)
+        height = img->d_h;
+
+    if (!webmdshow::LibyuvScaleI420(width, height, img, &t.image))
+    {
+        t.hr = E_FAIL;
+        return;
+    }
+
+    t.time_ns = pBlock->GetTime(pCurr->GetCluster());
+    t.hr = S_OK;
+}
+
+
+//What the threads of one Extract call share.  The requests are sorted
+//by time and handed out in chunks, in order, so every thread only ever
+//moves forward through the file.
+
+struct Job
+{
+    const wchar_t* filename;
+    const LONGLONG* times_ns;
+    ULONG width;
+    ULONG height;
+    Thumbnailer::Thumbnail* thumbnails;
+
+    std::vector<ULONG> order;  //request indexes, by time
+    ULONG chunk;               //requests per grab
+    volatile LONG next_chunk;
+};
+
+
+struct TimeLess
+{
+    const LONGLONG* times_ns;
+
+    bool operator()(ULONG lhs, ULONG rhs) const
+    {
+        return times_ns[lhs] < times_ns[rhs];
+    }
+};
+
+
+unsigned __stdcall ThreadProc(void* pv)
+{
+    Job& job = *static_cast<Job*>(pv);
+
+    Worker w;
+
+    const HRESULT hrOpen = w.Open(job.filename);
+
+    const ULONG count = static_cast<ULONG>(job.order.size());
+
+    for (;;)
+    {
+        const LONG i = InterlockedIncrement(&job.next_chunk) - 1;
+        const ULONG first = ULONG(i) * job.chunk;
+
+        if (first >= count)
+            break;
+
+        const ULONG last = (std::min)(first + job.chunk, count);
+
+        for (ULONG k = first; k < last; ++k)
+        {
+            const ULONG idx = job.order[k];
+            Thumbnailer::Thumbnail& t = job.thumbnails[idx];
+
+            if (FAILED(hrOpen))
+                t.hr = hrOpen;
+            else
+                w.Get(job.times_ns[idx], job.width, job.height, t);
+        }
+    }
+
+    return 0;
+}
+
+}  //end unnamed namespace
+
+
+HRESULT Thumbnailer::Extract(
+    const wchar_t* filename,
+    const LONGLONG* times_ns,
+    ULONG count,
+    ULONG width,
+    ULONG height,
+    ULONG thread_count,
+    Thumbnail* thumbnails)
+{
+    if (filename == 0)
+        return E_INVALIDARG;
+
+    if ((count > 0) && ((times_ns == 0) || (thumbnails == 0)))
+        return E_POINTER;
+
+    for (ULONG idx = 0; idx < count; ++idx)
+    {
+        Thumbnail& t = thumbnails[idx];
+
+        t.time_ns = -1;
+        t.image = 0;
+        t.hr = E_FAIL;
+    }
+
+    if (count == 0)
+        return S_OK;
+
+    if (thread_count == 0)
+        thread_count = ULONG(webmdshow::GetLogicalProcessorCount());
+
+    thread_count = (std::min)(thread_count, count);
+    thread_count = (std::min)(thread_count, ULONG(MAXIMUM_WAIT_OBJECTS));
+    thread_count = (std::max)(thread_count, ULONG(1));
+
+    Job job;
+
+    job.filename = filename;
+    job.times_ns = times_ns;
+    job.width = width;
+    job.height = height;
+    job.thumbnails = thumbnails;
+
+    job.order.resize(count);
+
+    for (ULONG idx = 0; idx < count; ++idx)
+        job.order[idx] = idx;
+
+    const TimeLess less = { times_ns };
+    std::sort(job.order.begin(), job.order.end(), less);
+
+    //A few chunks per thread, so that a thread stuck on a slow part of
+    //the file doesn't hold up the rest of the batch.
+
+    job.chunk = (std::max)(count / (4 * thread_count), ULONG(1));
+    job.next_chunk = 0;
+
+    std::vector<HANDLE> threads;
+
+    for (ULONG i = 0; i < thread_count; ++i)
+    {
+        const uintptr_t h = _beginthreadex(0, 0, &ThreadProc, &job, 0, 0);
+
+        if (h == 0)
+            break;  //just use the threads we have
+
+        threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
+
+    if (threads.empty())
+        ThreadProc(&job);
+    else
+    {
+        const DWORD n = static_cast<DWORD>(threads.size());
+
+        const DWORD dw = WaitForMultipleObjects(n, &threads[0], TRUE, INFINITE);
+        dw;
+        assert(dw != WAIT_FAILED);
+
+        for (DWORD i = 0; i < n; ++i)
+        {
+            const BOOL b = CloseHandle(threads[i]);
+            b;
+            assert(b);
+        }
+    }
+
+    ULONG ok = 0;
+    HRESULT hrError = S_FALSE;
+
+    for (ULONG idx = 0; idx < count; ++idx)
+    {
+        const HRESULT hr = thumbnails[idx].hr;
+
+        if (hr == S_OK)
+            ++ok;
+        else if (FAILED(hr) && (hrError == S_FALSE))
+            hrError = hr;
+    }
+
+    if (ok == count)
+        return S_OK;
+
+    if (ok > 0)
+        return S_FALSE;
+
+    return hrError;
+}
+
+
+void Thumbnailer::Free(Thumbnail* thumbnails, ULONG count)
+{
+    for (ULONG idx = 0; idx < count; ++idx)
+    {
+        Thumbnail& t = thumbnails[idx];
+
+        if (t.image)
+        {
+            vpx_img_free(t.image);
+            t.image = 0;
+        }
+    }
+}
+
+
+}  //end namespace mkvparser
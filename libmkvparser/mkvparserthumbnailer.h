@@ -0,0 +1,63 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "vpx/vpx_image.h"
+
+namespace mkvparser
+{
+
+//Extracts keyframe thumbnails (seek bar previews, say) from the first
+//VP8 or VP9 track of a WebM file, without running a playback graph.
+//For each requested time we use the Cues (or, without Cues, a search
+//of the clusters) to find the nearest keyframe at or before that time,
+//decode just that frame, and scale it with LibyuvScaleI420.
+//
+//Requests are spread over a pool of threads.  The pool opens the file
+//once per thread, since the parser is not thread-safe, and each thread
+//works through the requests in time order so reads move forward.
+//
+//Link with common.lib, libvpx and libyuv.
+
+class Thumbnailer
+{
+    Thumbnailer();
+    Thumbnailer(const Thumbnailer&);
+    Thumbnailer& operator=(const Thumbnailer&);
+
+public:
+
+    struct Thumbnail
+    {
+        LONGLONG time_ns;     //of the keyframe decoded, or -1
+        vpx_image_t* image;   //I420; free with vpx_img_free, or Free
+        HRESULT hr;           //S_FALSE means no keyframe for this time
+    };
+
+    //Gets a thumbnail of width x height pixels for each of the count
+    //times in times_ns, into the matching element of thumbnails.  A
+    //width or height of 0 keeps the frame size.  thread_count of 0
+    //uses a thread per logical processor.  The result is S_OK when
+    //every request succeeded, S_FALSE when only some of them did, and
+    //the error of the first failure when none did; see Thumbnail::hr.
+    static HRESULT Extract(
+        const wchar_t* filename,
+        const LONGLONG* times_ns,
+        ULONG count,
+        ULONG width,
+        ULONG height,
+        ULONG thread_count,
+        Thumbnail* thumbnails);
+
+    static void Free(Thumbnail*, ULONG count);
+
+};
+
+
+}  //end namespace mkvparser
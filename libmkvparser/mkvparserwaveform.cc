@@ -0,0 +1,708 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <vfwmsgs.h>
+#include "mkvparserwaveform.h"
+#include "mkvparser.hpp"
+#include "mkvparserblockscanner.h"
+#include "mkvparserclusterscanner.h"
+#include "mkvparserfilereader.h"
+#include "debugutil.h"
+#include "taskpool.h"
+#include "vorbisdecoder.h"
+#include "vorbistypes.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <new>
+#include <vector>
+
+namespace mkvparser
+{
+
+namespace
+{
+
+//Enough chunks that the pool stays busy while the last ones finish, but
+//few enough that priming costs next to nothing.
+const int kChunksPerThread = 4;
+
+struct Job;
+
+//A cluster a chunk starts at, and when that chunk's samples start.
+
+struct Boundary
+{
+    LONGLONG pos;  //of the cluster, relative to the segment
+    LONGLONG time_ns;
+};
+
+
+//A reader and a decoder, which one task at a time borrows from the job.
+
+class Decoder
+{
+    Decoder(const Decoder&);
+    Decoder& operator=(const Decoder&);
+
+public:
+    Decoder();
+    ~Decoder();
+
+    HRESULT Open(const wchar_t*);
+
+    //Gets the headers, format, length and boundaries of the track.
+    HRESULT Prepare(Job&);
+
+    //Decodes chunk [first, last) of the boundaries into bins.
+    HRESULT Decode(Job&, ULONG first, ULONG last, webmdshow::WaveformBins&);
+
+private:
+    FileReader m_file;
+    Segment* m_pSegment;
+    const Track* m_pTrack;
+
+    WebmMfVorbisDecLib::VorbisDecoder m_vorbis;
+    bool m_bVorbis;
+
+    std::vector<unsigned char> m_buf;
+    std::vector<float> m_pcm;
+
+    HRESULT CreateVorbis(const Job&);
+    LONGLONG GetDuration();
+    void GetBoundaries(Job&);
+
+};
+
+
+//What the tasks of one Extract call share.
+
+struct Job
+{
+    const wchar_t* filename;
+
+    std::vector<BYTE> codec_private;
+    const BYTE* headers[WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT];
+    DWORD lengths[WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT];
+
+    LONGLONG track_number;
+    int channels;
+    int rate;
+    LONGLONG duration_ns;
+    LONGLONG total_frames;
+    int columns;
+
+    std::vector<Boundary> boundaries;
+
+    CRITICAL_SECTION lock;
+    std::vector<Decoder*> idle;
+    HRESULT hrError;  //the first failure
+
+    WaveformExtractor::Stats stats;
+};
+
+
+LONGLONG ToFrames(const Job& job, LONGLONG time_ns)
+{
+    return static_cast<LONGLONG>(double(time_ns) * job.rate / 1000000000);
+}
+
+
+Decoder* Acquire(Job& job, HRESULT& hr)
+{
+    EnterCriticalSection(&job.lock);
+
+    Decoder* pDecoder = 0;
+
+    if (!job.idle.empty())
+    {
+        pDecoder = job.idle.back();
+        job.idle.pop_back();
+    }
+
+    LeaveCriticalSection(&job.lock);
+
+    hr = S_OK;
+
+    if (pDecoder)
+        return pDecoder;
+
+    pDecoder = new (std::nothrow) Decoder;
+
+    if (pDecoder == 0)
+    {
+        hr = E_OUTOFMEMORY;
+        return 0;
+    }
+
+    hr = pDecoder->Open(job.filename);
+
+    if (FAILED(hr))
+    {
+        delete pDecoder;
+        return 0;
+    }
+
+    InterlockedIncrement(&job.stats.readers);
+    return pDecoder;
+}
+
+
+void Release(Job& job, Decoder* pDecoder)
+{
+    EnterCriticalSection(&job.lock);
+    job.idle.push_back(pDecoder);
+    LeaveCriticalSection(&job.lock);
+}
+
+
+Decoder::Decoder() :
+    m_pSegment(0),
+    m_pTrack(0),
+    m_bVorbis(false)
+{
+}
+
+
+Decoder::~Decoder()
+{
+    delete m_pSegment;
+}
+
+
+HRESULT Decoder::Open(const wchar_t* filename)
+{
+    HRESULT hr = m_file.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    long long result = h.Parse(&m_file, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = Segment::CreateInstance(&m_file, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    result = m_pSegment->ParseHeaders();
+
+    if (result < 0)
+        return E_FAIL;
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return E_FAIL;
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack == 0) || (pTrack->GetType() != 2))  //not audio
+            continue;
+
+        const char* const id = pTrack->GetCodecId();
+
+        if ((id != 0) && (_stricmp(id, "A_VORBIS") == 0))
+        {
+            m_pTrack = pTrack;
+            return S_OK;
+        }
+    }
+
+    return VFW_E_INVALID_FILE_FORMAT;  //no Vorbis track
+}
+
+
+HRESULT Decoder::CreateVorbis(const Job& job)
+{
+    if (m_bVorbis)
+        return S_OK;
+
+    //CreateDecoder does not write to the headers, though it takes them
+    //as the Ogg packets libvorbis wants.
+
+    const int status = m_vorbis.CreateDecoder(
+                        const_cast<const BYTE**>(job.headers),
+                        job.lengths,
+                        WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT);
+
+    if (FAILED(status))
+        return status;
+
+    m_bVorbis = true;
+    return S_OK;
+}
+
+
+HRESULT Decoder::Prepare(Job& job)
+{
+    assert(m_pTrack);
+
+    size_t cp_size;
+
+    const BYTE* const cp = m_pTrack->GetCodecPrivate(cp_size);
+
+    if ((cp == 0) || (cp_size == 0))
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    job.codec_private.assign(cp, cp + cp_size);
+
+    const long count = WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT;
+    long lengths[count];
+
+    const long n = VorbisTypes::GetXiphLacedPackets(
+                    &job.codec_private[0],
+                    long(cp_size),
+                    job.headers,
+                    lengths,
+                    count);
+
+    if (n != count)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    for (long i = 0; i < n; ++i)
+        job.lengths[i] = lengths[i];
+
+    const HRESULT hr = CreateVorbis(job);
+
+    if (FAILED(hr))
+        return hr;
+
+    job.track_number = m_pTrack->GetNumber();
+    job.channels = m_vorbis.GetVorbisChannels();
+    job.rate = m_vorbis.GetVorbisRate();
+    job.duration_ns = GetDuration();
+    job.total_frames = ToFrames(job, job.duration_ns);
+
+    if ((job.channels <= 0) || (job.rate <= 0) || (job.total_frames <= 0))
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    GetBoundaries(job);
+
+    if (job.boundaries.empty())
+        return VFW_E_INVALID_FILE_FORMAT;  //no clusters
+
+    return S_OK;
+}
+
+
+LONGLONG Decoder::GetDuration()
+{
+    const SegmentInfo* const pInfo = m_pSegment->GetInfo();
+
+    if (pInfo && (pInfo->GetDuration() > 0))
+        return pInfo->GetDuration();
+
+    //No Duration in the Info: take the time of the track's last block,
+    //from a walk of the block headers.  The samples of that block are
+    //dropped, which the view cannot show anyway.
+
+    std::vector<BlockScanner::Record> records;
+
+    BlockScanner::Scan(&m_file, m_pSegment, records);
+
+    typedef std::vector<BlockScanner::Record>::const_reverse_iterator iter_t;
+
+    for (iter_t i = records.rbegin(); i != records.rend(); ++i)
+    {
+        if (i->track == m_pTrack->GetNumber())
+            return i->time_ns;
+    }
+
+    return 0;
+}
+
+
+void Decoder::GetBoundaries(Job& job)
+{
+    job.boundaries.clear();
+
+    //The first cluster starts the first chunk, whether or not it is
+    //indexed, so that none of the track is missed.
+
+    if (m_pSegment->LoadCluster() < 0)
+        return;
+
+    const Cluster* const pFirst = m_pSegment->GetFirst();
+
+    if ((pFirst == 0) || pFirst->EOS())
+        return;
+
+    const Boundary b = { pFirst->GetPosition(), pFirst->GetTime() };
+    job.boundaries.push_back(b);
+
+    std::vector<Boundary> indexed;
+
+    if (const Cues* pCues = m_pSegment->GetCues())
+    {
+        while (!pCues->DoneParsing())
+            pCues->LoadCuePoint();
+
+        for (const CuePoint* pCP = pCues->GetFirst();
+             pCP != 0;
+             pCP = pCues->GetNext(pCP))
+        {
+            if (pCP->m_track_positions_count == 0)
+                continue;
+
+            //The cue points are of the video keyframes, but a cluster
+            //is a boundary for any of the tracks in it.
+
+            const Boundary b =
+            {
+                pCP->m_track_positions[0].m_pos,
+                pCP->GetTime(m_pSegment)
+            };
+
+            indexed.push_back(b);
+        }
+    }
+    else
+    {
+        std::vector<webmdshow::WebmIndexEntry> entries;
+
+        ClusterScanner::Scan(
+            &m_file,
+            m_pSegment,
+            m_pTrack,
+            0,  //a thread per processor
+            entries);
+
+        typedef std::vector<webmdshow::WebmIndexEntry>::const_iterator
+            iter_t;
+
+        for (iter_t i = entries.begin(); i != entries.end(); ++i)
+        {
+            const Boundary b = { i->pos, i->time_ns };
+            indexed.push_back(b);
+        }
+    }
+
+    //Keep the boundaries after the first, in file and time order.
+
+    typedef std::vector<Boundary>::const_iterator iter_t;
+
+    for (iter_t i = indexed.begin(); i != indexed.end(); ++i)
+    {
+        const Boundary& prev = job.boundaries.back();
+
+        if ((i->pos > prev.pos) && (i->time_ns > prev.time_ns))
+            job.boundaries.push_back(*i);
+    }
+}
+
+
+HRESULT Decoder::Decode(
+    Job& job,
+    ULONG first,
+    ULONG last,
+    webmdshow::WaveformBins& bins)
+{
+    HRESULT hr = CreateVorbis(job);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_vorbis.Flush();
+
+    const ULONG count = ULONG(job.boundaries.size());
+    assert(first < last);
+    assert(last <= count);
+
+    //Samples before the chunk's first boundary are the previous chunk's;
+    //the cluster before it is decoded to prime the decoder, and its
+    //samples dropped.
+
+    const ULONG start = (first > 0) ? first - 1 : 0;
+
+    const LONGLONG begin =
+        (first > 0) ? ToFrames(job, job.boundaries[first].time_ns) : 0;
+
+    const LONGLONG end_ns =
+        (last < count) ? job.boundaries[last].time_ns : LLONG_MAX;
+
+    const LONGLONG end =
+        (last < count) ? ToFrames(job, end_ns) : job.total_frames;
+
+    const Cluster* pCluster =
+        m_pSegment->FindOrPreloadCluster(job.boundaries[start].pos);
+
+    const LONGLONG track_number = m_pTrack->GetNumber();
+    const int channels = job.channels;
+
+    LONGLONG frame = -1;  //of the next sample out, once there is one
+    LONGLONG decoded = 0;
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        const BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            if (pBlock->GetTrackNumber() != track_number)
+            {
+                status = pCluster->GetNext(pEntry, pEntry);
+                continue;
+            }
+
+            const LONGLONG time_ns = pBlock->GetTime(pCluster);
+
+            if ((time_ns >= end_ns) || (frame >= end))  //the next chunk's
+            {
+                pCluster = 0;
+                break;
+            }
+
+            for (int idx = 0; idx < pBlock->GetFrameCount(); ++idx)
+            {
+                const Block::Frame& f = pBlock->GetFrame(idx);
+
+                if (f.len <= 0)  //weird
+                    return E_FAIL;
+
+                m_buf.resize(f.len);
+
+                if (f.Read(&m_file, &m_buf[0]) != 0)
+                    return E_FAIL;
+
+                int result = m_vorbis.Decode(&m_buf[0], UINT32(f.len));
+
+                if (FAILED(result))
+                    return result;
+
+                UINT32 available;
+
+                result = m_vorbis.GetOutputSamplesAvailable(&available);
+                assert(SUCCEEDED(result));
+
+                if (available == 0)  //the first packet, or an empty one
+                    continue;
+
+                m_pcm.resize(size_t(available) * channels);
+
+                result = m_vorbis.ConsumeOutputSamples(&m_pcm[0], available);
+
+                if (FAILED(result))
+                    return result;
+
+                //A block's samples start at its time; from there on the
+                //count of samples keeps time, which the block times (in
+                //milliseconds, typically) are too coarse to.
+
+                if (frame < 0)
+                    frame = ToFrames(job, time_ns);
+
+                //Only the samples inside [begin, end) are this chunk's.
+
+                const LONGLONG lo = (std::max)(frame, begin);
+                const LONGLONG hi = (std::min)(frame + available, end);
+
+                if (lo < hi)
+                {
+                    const float* const p =
+                        &m_pcm[0] + (lo - frame) * channels;
+
+                    bins.Add(lo, p, int(hi - lo));
+                }
+
+                frame += available;
+                decoded += available;
+            }
+
+            status = pCluster->GetNext(pEntry, pEntry);
+        }
+
+        if (pCluster == 0)  //done
+            break;
+
+        if (status < 0)
+            return E_FAIL;
+
+        pCluster = m_pSegment->GetNext(pCluster);
+    }
+
+    EnterCriticalSection(&job.lock);
+    job.stats.frames += decoded;
+    LeaveCriticalSection(&job.lock);
+
+    return S_OK;
+}
+
+
+void DecodeChunk(
+    Job& job,
+    ULONG first,
+    ULONG last,
+    webmdshow::WaveformBins& bins)
+{
+    HRESULT hr;
+
+    Decoder* const pDecoder = Acquire(job, hr);
+
+    if (pDecoder)
+    {
+        hr = pDecoder->Decode(job, first, last, bins);
+        Release(job, pDecoder);
+    }
+
+    InterlockedIncrement(&job.stats.chunks);
+
+    if (FAILED(hr))
+    {
+        EnterCriticalSection(&job.lock);
+
+        if (SUCCEEDED(job.hrError))
+            job.hrError = hr;
+
+        LeaveCriticalSection(&job.lock);
+    }
+}
+
+}  //end unnamed namespace
+
+
+HRESULT WaveformExtractor::Extract(
+    const wchar_t* filename,
+    int columns,
+    webmdshow::WaveformSummary& summary,
+    Stats* stats)
+{
+    if ((filename == 0) || (columns <= 0))
+        return E_INVALIDARG;
+
+    if (stats)
+    {
+        stats->chunks = 0;
+        stats->readers = 0;
+        stats->frames = 0;
+    }
+
+    HRESULT hr = webmdshow::WaveformCache::Read(filename, &summary);
+
+    if (SUCCEEDED(hr) && (summary.columns == columns))
+        return S_OK;
+
+    Job job;
+
+    job.filename = filename;
+    job.track_number = 0;
+    job.channels = 0;
+    job.rate = 0;
+    job.duration_ns = 0;
+    job.total_frames = 0;
+    job.columns = columns;
+    job.hrError = S_OK;
+
+    job.stats.chunks = 0;
+    job.stats.readers = 0;
+    job.stats.frames = 0;
+
+    InitializeCriticalSection(&job.lock);
+
+    //The first reader reads the headers and finds the boundaries, on
+    //this thread, then goes back to the job for the tasks to borrow.
+
+    if (Decoder* const pDecoder = Acquire(job, hr))
+    {
+        hr = pDecoder->Prepare(job);
+        Release(job, pDecoder);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        webmdshow::TaskPool& pool = webmdshow::TaskPool::GetShared();
+
+        const ULONG count = ULONG(job.boundaries.size());
+        const ULONG chunks = (std::min)(
+                                count,
+                                ULONG(kChunksPerThread * pool.thread_count()));
+
+        const webmdshow::WaveformBins empty(
+                                        job.channels,
+                                        job.total_frames,
+                                        columns);
+
+        std::vector<webmdshow::WaveformBins> bins(chunks, empty);
+
+        {
+            webmdshow::TaskGroup tasks(pool);
+
+            for (ULONG i = 0; i < chunks; ++i)
+            {
+                Job* const pJob = &job;
+                webmdshow::WaveformBins* const pBins = &bins[i];
+
+                const ULONG first = ULONG(ULONGLONG(i) * count / chunks);
+                const ULONG last = ULONG(ULONGLONG(i + 1) * count / chunks);
+
+                tasks.Run([pJob, pBins, first, last]()
+                {
+                    DecodeChunk(*pJob, first, last, *pBins);
+                });
+            }
+
+            tasks.Wait();
+        }
+
+        hr = job.hrError;
+
+        if (SUCCEEDED(hr))
+        {
+            webmdshow::WaveformBins whole(empty);
+
+            for (ULONG i = 0; i < chunks; ++i)
+                whole.Merge(bins[i]);
+
+            summary.track_number = job.track_number;
+            summary.channels = job.channels;
+            summary.rate = job.rate;
+            summary.duration_ns = job.duration_ns;
+            summary.columns = columns;
+
+            whole.GetPeaks(&summary.peaks);
+
+            //The file may be on a read-only share; the summary is good
+            //without the cache.
+
+            webmdshow::WaveformCache::Write(filename, summary);
+        }
+    }
+
+    typedef std::vector<Decoder*>::const_iterator decoder_iter_t;
+
+    for (decoder_iter_t i = job.idle.begin(); i != job.idle.end(); ++i)
+        delete *i;
+
+    DeleteCriticalSection(&job.lock);
+
+    if (stats)
+        *stats = job.stats;
+
+    return hr;
+}
+
+
+}  //end namespace mkvparser
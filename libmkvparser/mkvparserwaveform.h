@@ -0,0 +1,63 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "waveform.h"
+
+namespace mkvparser
+{
+
+//Builds the waveform overview of the first Vorbis track of a WebM file:
+//the min, max and RMS of each channel over each column of the view.
+//
+//The track is split into chunks at the clusters the Cues point to (or,
+//without Cues, the clusters a ClusterScanner finds), a few of them per
+//thread of the shared TaskPool.  Each chunk is decoded as a task of its
+//own, with a reader and a VorbisDecoder it borrows, seeded from the
+//track's CodecPrivate headers as read once by the first reader.  A
+//chunk starts decoding a cluster early, to prime the decoder, and keeps
+//only the samples inside its own time range, so the joined peaks are
+//those of one pass over the track.
+//
+//The result is cached next to the file (see webmdshow::WaveformCache),
+//so the next request for the same number of columns decodes nothing.
+//
+//Link with common.lib, libogg and libvorbis, and build vorbisdecoder.cc
+//from common.
+
+class WaveformExtractor
+{
+    WaveformExtractor();
+    WaveformExtractor(const WaveformExtractor&);
+    WaveformExtractor& operator=(const WaveformExtractor&);
+
+public:
+
+    struct Stats
+    {
+        LONG chunks;      //decoded; 0 when the cache was used
+        LONG readers;     //opened
+        LONGLONG frames;  //of samples decoded, priming included
+    };
+
+    //Gets the waveform of the file at the given number of columns, from
+    //the cache if it is current, and otherwise by decoding the track,
+    //after which the cache is written (unless the file's directory is
+    //read-only).  Fails if the file has no Vorbis track, or any chunk
+    //fails to decode.  Any stats are of this call.
+    static HRESULT Extract(
+        const wchar_t* filename,
+        int columns,
+        webmdshow::WaveformSummary&,
+        Stats* = 0);
+
+};
+
+
+}  //end namespace mkvparser
@@ -0,0 +1,168 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "webmfilters.h"
+#include "cfactory.h"
+#include "webmtypes.h"
+#include "vpxdecoderidl.h"
+#include "vp8encoderidl.h"
+#include "webmmuxidl.h"
+#include <cassert>
+
+//What the dllentry.cc of each filter would otherwise provide: its
+//factory function, and whatever else its other sources refer to.
+
+static ULONG s_cLock;
+
+namespace WebmSplit
+{
+    HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+}
+
+namespace VPXDecoderLib
+{
+    HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+}
+
+namespace WebmVorbisDecoderLib
+{
+    HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+}
+
+namespace WebmVorbisEncoderLib
+{
+    HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+}
+
+namespace VP8EncoderLib
+{
+    HRESULT CreateFilter(IClassFactory*, IUnknown*, const IID&, void**);
+
+    //The property page (and its dialog resource) is left in the DLL, but
+    //the filter still names it in ISpecifyPropertyPages.
+
+    extern const CLSID CLSID_PropPage =
+    { /* ED311102-5211-11DF-94AF-0026B977EEAA */
+        0xED311102,
+        0x5211,
+        0x11DF,
+        {0x94, 0xAF, 0x00, 0x26, 0xB9, 0x77, 0xEE, 0xAA}
+    };
+}
+
+namespace WebmMuxLib
+{
+    HRESULT CreateInstance(IClassFactory*, IUnknown*, const IID&, void**);
+
+    //Of the module the muxer is linked into, whose version goes in the
+    //MuxingApp of each file.
+    extern HMODULE s_hModule = 0;
+}
+
+
+namespace
+{
+
+CFactory s_split(&s_cLock, &WebmSplit::CreateInstance);
+CFactory s_vpxdec(&s_cLock, &VPXDecoderLib::CreateInstance);
+CFactory s_vorbisdec(&s_cLock, &WebmVorbisDecoderLib::CreateInstance);
+CFactory s_vorbisenc(&s_cLock, &WebmVorbisEncoderLib::CreateInstance);
+CFactory s_vp8enc(&s_cLock, &VP8EncoderLib::CreateFilter);
+CFactory s_mux(&s_cLock, &WebmMuxLib::CreateInstance);
+
+struct Class
+{
+    const CLSID* clsid;
+    CFactory* pFactory;
+};
+
+const Class s_classes[] =
+{
+    { &WebmTypes::CLSID_WebmSplit, &s_split },
+    { &CLSID_VPXDecoder, &s_vpxdec },
+    { &WebmTypes::CLSID_WebmVorbisDecoder, &s_vorbisdec },
+    { &WebmTypes::CLSID_WebmVorbisEncoder, &s_vorbisenc },
+    { &CLSID_VP8Encoder, &s_vp8enc },
+    { &CLSID_WebmMux, &s_mux }
+};
+
+CFactory* FindFactory(const CLSID& clsid)
+{
+    if (WebmMuxLib::s_hModule == 0)
+    {
+        const DWORD dwFlags = GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                              GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT;
+
+        HMODULE h;
+
+        const LPCWSTR addr = reinterpret_cast<LPCWSTR>(&s_cLock);
+
+        if (GetModuleHandleEx(dwFlags, addr, &h))
+            WebmMuxLib::s_hModule = h;
+    }
+
+    enum { kClasses = sizeof(s_classes) / sizeof(s_classes[0]) };
+
+    for (int i = 0; i < kClasses; ++i)
+    {
+        const Class& c = s_classes[i];
+
+        if (*c.clsid == clsid)
+            return c.pFactory;
+    }
+
+    return 0;
+}
+
+}  //end unnamed namespace
+
+
+HRESULT WebmFilters::CreateFilter(
+    const CLSID& clsid,
+    IUnknown* pOuter,
+    const IID& iid,
+    void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    CFactory* const pFactory = FindFactory(clsid);
+
+    if (pFactory == 0)
+        return CLASS_E_CLASSNOTAVAILABLE;
+
+    return pFactory->CreateInstance(pOuter, iid, ppv);
+}
+
+
+HRESULT WebmFilters::GetClassObject(
+    const CLSID& clsid,
+    const IID& iid,
+    void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    CFactory* const pFactory = FindFactory(clsid);
+
+    if (pFactory == 0)
+        return CLASS_E_CLASSNOTAVAILABLE;
+
+    return pFactory->QueryInterface(iid, ppv);
+}
+
+
+bool WebmFilters::CanUnloadNow()
+{
+    return (s_cLock == 0);
+}
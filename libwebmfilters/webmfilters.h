@@ -0,0 +1,39 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objbase.h>
+
+//The filters of webmdshow, linked into the host: the splitter, the VPX
+//decoder, the Vorbis decoder and encoder, the VP8 encoder and the muxer.
+//They are created by calling their factories directly, so the host needs
+//neither the registry nor the filter DLLs.  The host links common.lib,
+//strmiids.lib, and the vpx, yuv, ogg and vorbis libraries that the
+//filter DLLs link.
+//
+//A host that would rather ship the DLLs, but not register them, can use
+//the activation context manifest in the installer directory instead.
+
+namespace WebmFilters
+{
+
+//Creates the filter clsid (one of the filters above), as CoCreateInstance
+//would.  Returns CLASS_E_CLASSNOTAVAILABLE for any other clsid.
+HRESULT CreateFilter(const CLSID&, IUnknown* pOuter, const IID&, void**);
+
+//The class factory of the filter clsid, as DllGetClassObject would get
+//it.  A host may register it with CoRegisterClassObject, so that code it
+//doesn't control finds the filter through CoCreateInstance too (but the
+//filter mapper still enumerates only registered filters).
+HRESULT GetClassObject(const CLSID&, const IID&, void**);
+
+//Whether no instance of any of the filters (nor any lock of their
+//factories) remains.
+bool CanUnloadNow();
+
+}  //end namespace WebmFilters
@@ -0,0 +1,896 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <amvideo.h>
+#include <uuids.h>
+#include <vfwmsgs.h>
+#include "webmtranscode.h"
+#include "webmtranscodechannel.h"
+#include "webmtranscodepacket.h"
+#include "webmtranscodevpx.h"
+#include "cmediatypes.h"
+#include "cpuutil.h"
+#include "mkvparsermapreader.h"
+#include "mkvparserstreamaudio.h"
+#include "pipelinecounters.h"
+#include "spscqueue.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamaudiovorbis.h"
+#include "webmmuxstreamvideovpx.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8dx.h"
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+using webmdshow::PipelineCounters;
+
+namespace WebmTranscode
+{
+
+Options::Options() :
+    vp9(false),
+    no_audio(false),
+    deadline(-1),
+    target_bitrate(-1),
+    min_quantizer(-1),
+    max_quantizer(-1),
+    end_usage(-1),
+    keyframe_max_interval(-1),
+    thread_count(-1),
+    cpu_used(-17),
+    queue_frames(0)
+{
+}
+
+
+namespace
+{
+
+enum { kDefaultQueueFrames = 16 };
+
+//The free list of each pool holds up to this many frames more than its
+//queue does, for those the next stage (or the muxer) still holds.
+enum { kPoolSlack = 64 };
+
+enum { kProgressInterval = 1000000 };  //us
+
+
+class Job
+{
+    Job(const Job&);
+    Job& operator=(const Job&);
+
+public:
+
+    Job(const Options&, HANDLE hQuit);
+    ~Job();
+
+    HRESULT Open(const wchar_t* src);
+
+    HRESULT Run(
+        const wchar_t* dst,
+        const wchar_t* writing_app,
+        progress_t,
+        void*);
+
+private:
+
+    const Options m_options;
+    const size_t m_queue_frames;
+
+    mkvparser::MapReader m_reader;
+    mkvparser::Segment* m_pSegment;
+    const mkvparser::VideoTrack* m_pVideoTrack;
+    const mkvparser::AudioTrack* m_pAudioTrack;  //0 if not copied
+    LONGLONG m_duration;  //reftime, or -1
+
+    //Manual-reset: set when any stage fails, or hQuit is signalled,
+    //so that every other stage stops.
+    const HANDLE m_hStop;
+    const HANDLE m_hQuit;
+    HANDLE m_hQuitWait;
+    volatile LONG m_bQuit;
+
+    //Each pool is filled by one stage and released by one other.
+    PacketPool m_video_pool;    //read, released by decode
+    PacketPool m_audio_pool;    //read, released by mux
+    PacketPool m_encoded_pool;  //encode, released by mux
+
+    Channel<Packet*> m_video;    //read to decode
+    Channel<Packet*> m_audio;    //read to mux
+    Channel<Picture*> m_pictures;  //decode to encode
+    Channel<Packet*> m_encoded;  //encode to mux
+
+    //Pictures the encoder is done with, for the decoder to fill again.
+    webmdshow::SpscQueue<Picture*> m_free_pictures;
+
+    PipelineCounters m_read_counters;
+    PipelineCounters m_decode_counters;
+    PipelineCounters m_encode_counters;
+
+    HRESULT m_hrRead;
+    HRESULT m_hrDecode;
+    HRESULT m_hrEncode;
+
+    static void CALLBACK OnQuit(void*, BOOLEAN);
+    void Fail(HRESULT&, HRESULT);
+
+    void Read();
+    HRESULT ReadBlock(const mkvparser::Cluster*, const mkvparser::Block*);
+
+    void Decode();
+    HRESULT DecodeFrames(vpx_codec_ctx_t*, LONGLONG start);
+
+    void Encode();
+    HRESULT EncodeFrame(vpx_codec_ctx_t*, Picture*, LONGLONG duration);
+    HRESULT GetPackets(vpx_codec_ctx_t*, int* count = 0);
+
+    HRESULT Mux(WebmMuxLib::Context&, progress_t, void*);
+    void Drain();
+
+};
+
+
+Job::Job(const Options& options, HANDLE hQuit) :
+    m_options(options),
+    m_queue_frames(
+        (options.queue_frames > 0) ?
+            options.queue_frames :
+            kDefaultQueueFrames),
+    m_pSegment(0),
+    m_pVideoTrack(0),
+    m_pAudioTrack(0),
+    m_duration(-1),
+    m_hStop(CreateEvent(0, TRUE, FALSE, 0)),
+    m_hQuit(hQuit),
+    m_hQuitWait(0),
+    m_bQuit(0),
+    m_video_pool(m_queue_frames + kPoolSlack),
+    m_audio_pool(m_queue_frames + kPoolSlack),
+    m_encoded_pool(m_queue_frames + kPoolSlack),
+    m_video(m_queue_frames, m_hStop),
+    m_audio(m_queue_frames, m_hStop),
+    m_pictures(m_queue_frames, m_hStop),
+    m_encoded(m_queue_frames, m_hStop),
+    m_free_pictures(m_queue_frames + 8),
+    m_read_counters(L"transcode.read"),
+    m_decode_counters(L"transcode.decode"),
+    m_encode_counters(L"transcode.encode"),
+    m_hrRead(S_OK),
+    m_hrDecode(S_OK),
+    m_hrEncode(S_OK)
+{
+    assert(m_hStop);
+}
+
+
+Job::~Job()
+{
+    Drain();
+
+    Picture* pic;
+
+    while (m_free_pictures.TryPop(&pic))
+        delete pic;
+
+    delete m_pSegment;
+
+    CloseHandle(m_hStop);
+}
+
+
+//Releases whatever the stages left in the channels when the transcode
+//stopped.  The threads have been joined.
+
+void Job::Drain()
+{
+    Packet* pPacket;
+
+    while (m_video.Pop(&pPacket))
+        pPacket->Release();
+
+    while (m_audio.Pop(&pPacket))
+        pPacket->Release();
+
+    while (m_encoded.Pop(&pPacket))
+        pPacket->Release();
+
+    Picture* pic;
+
+    while (m_pictures.Pop(&pic))
+        delete pic;
+}
+
+
+void CALLBACK Job::OnQuit(void* pv, BOOLEAN)
+{
+    Job* const pJob = static_cast<Job*>(pv);
+    assert(pJob);
+
+    InterlockedExchange(&pJob->m_bQuit, 1);
+    SetEvent(pJob->m_hStop);
+}
+
+
+void Job::Fail(HRESULT& hrStage, HRESULT hr)
+{
+    assert(FAILED(hr));
+
+    hrStage = hr;
+    SetEvent(m_hStop);
+}
+
+
+HRESULT Job::Open(const wchar_t* src)
+{
+    HRESULT hr = m_reader.Open(src);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    mkvparser::EBMLHeader h;
+
+    long long result = h.Parse(&m_reader, pos);
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    result = mkvparser::Segment::CreateInstance(&m_reader, pos, m_pSegment);
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    assert(m_pSegment);
+
+    const long status = m_pSegment->Load();  //all of the file
+
+    if (status < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    const mkvparser::Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    for (unsigned long i = 0; i < pTracks->GetTracksCount(); ++i)
+    {
+        const mkvparser::Track* const t = pTracks->GetTrackByIndex(i);
+
+        if (t == 0)
+            continue;
+
+        const char* const id = t->GetCodecId();
+
+        if (id == 0)
+            continue;
+
+        if ((t->GetType() == 1) && (m_pVideoTrack == 0))  //video
+        {
+            if ((_stricmp(id, "V_VP8") == 0) || (_stricmp(id, "V_VP9") == 0))
+                m_pVideoTrack = static_cast<const mkvparser::VideoTrack*>(t);
+        }
+        else if ((t->GetType() == 2) && (m_pAudioTrack == 0))  //audio
+        {
+            if (!m_options.no_audio && (_stricmp(id, "A_VORBIS") == 0))
+                m_pAudioTrack = static_cast<const mkvparser::AudioTrack*>(t);
+        }
+    }
+
+    if (m_pVideoTrack == 0)
+        return VFW_E_INVALID_MEDIA_TYPE;  //nothing to transcode
+
+    const LONGLONG duration_ns = m_pSegment->GetDuration();
+
+    if (duration_ns >= 0)
+        m_duration = duration_ns / 100;
+
+    return S_OK;
+}
+
+
+HRESULT Job::Run(
+    const wchar_t* dst,
+    const wchar_t* writing_app,
+    progress_t progress,
+    void* context)
+{
+    using namespace WebmMuxLib;
+
+    if (m_hQuit)
+    {
+        const BOOL b = RegisterWaitForSingleObject(
+                        &m_hQuitWait,
+                        m_hQuit,
+                        &Job::OnQuit,
+                        this,
+                        INFINITE,
+                        WT_EXECUTEONLYONCE);
+
+        if (!b)
+            return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    Context ctx;
+
+    if (writing_app)
+        ctx.m_writing_app = writing_app;
+
+    HRESULT hr = ctx.m_disk.Open(dst);
+
+    if (SUCCEEDED(hr))
+    {
+        std::thread reader(&Job::Read, this);
+        std::thread decoder(&Job::Decode, this);
+        std::thread encoder(&Job::Encode, this);
+
+        hr = Mux(ctx, progress, context);
+
+        if (FAILED(hr))
+            SetEvent(m_hStop);
+
+        reader.join();
+        decoder.join();
+        encoder.join();
+    }
+
+    if (m_hQuitWait)
+    {
+        UnregisterWaitEx(m_hQuitWait, INVALID_HANDLE_VALUE);
+        m_hQuitWait = 0;
+    }
+
+    if (SUCCEEDED(hr) && FAILED(m_hrRead))
+        hr = m_hrRead;
+
+    if (SUCCEEDED(hr) && FAILED(m_hrDecode))
+        hr = m_hrDecode;
+
+    if (SUCCEEDED(hr) && FAILED(m_hrEncode))
+        hr = m_hrEncode;
+
+    if (m_bQuit)
+        hr = E_ABORT;
+
+    if (FAILED(hr))
+        DeleteFile(dst);  //closed by the muxer
+
+    return hr;
+}
+
+
+void Job::Read()
+{
+    const mkvparser::Cluster* pCluster = m_pSegment->GetFirst();
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        const mkvparser::BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const mkvparser::Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const HRESULT hr = ReadBlock(pCluster, pBlock);
+
+            if (hr != S_OK)
+            {
+                if (FAILED(hr))
+                    Fail(m_hrRead, hr);
+
+                m_video.Close();
+                m_audio.Close();
+
+                return;
+            }
+
+            status = pCluster->GetNext(pEntry, pEntry);
+        }
+
+        if (status < 0)
+        {
+            Fail(m_hrRead, VFW_E_INVALID_FILE_FORMAT);
+            break;
+        }
+
+        pCluster = m_pSegment->GetNext(pCluster);
+    }
+
+    m_video.Close();
+    m_audio.Close();
+}
+
+
+//Returns S_FALSE if the transcode was stopped.
+
+HRESULT Job::ReadBlock(
+    const mkvparser::Cluster* pCluster,
+    const mkvparser::Block* pBlock)
+{
+    const long long tn = pBlock->GetTrackNumber();
+
+    PacketPool* pPool;
+    Channel<Packet*>* pChannel;
+
+    if (tn == m_pVideoTrack->GetNumber())
+    {
+        pPool = &m_video_pool;
+        pChannel = &m_video;
+    }
+    else if (m_pAudioTrack && (tn == m_pAudioTrack->GetNumber()))
+    {
+        pPool = &m_audio_pool;
+        pChannel = &m_audio;
+    }
+    else
+        return S_OK;  //not a track we transcode or copy
+
+    const LONGLONG start = pBlock->GetTime(pCluster) / 100;  //reftime
+
+    for (int i = 0; i < pBlock->GetFrameCount(); ++i)
+    {
+        const mkvparser::Block::Frame& f = pBlock->GetFrame(i);
+
+        Packet* const pPacket = pPool->Get(f.len);
+
+        if (pPacket == 0)
+            return E_OUTOFMEMORY;
+
+        if (f.Read(&m_reader, &pPacket->m_buf[0]) != 0)
+        {
+            pPacket->Release();
+            return E_FAIL;
+        }
+
+        pPacket->m_start = (start >= 0) ? start : 0;
+        pPacket->m_key = pBlock->IsKey();
+
+        m_read_counters.OnSampleOut(f.len);
+
+        if (!pChannel->Push(pPacket))
+        {
+            pPacket->Release();
+            return S_FALSE;
+        }
+    }
+
+    return S_OK;
+}
+
+
+void Job::Decode()
+{
+    const char* const id = m_pVideoTrack->GetCodecId();
+
+    vpx_codec_iface_t* const codec =
+        (_stricmp(id, "V_VP9") == 0) ?
+            &vpx_codec_vp9_dx_algo :
+            &vpx_codec_vp8_dx_algo;
+
+    vpx_codec_dec_cfg_t cfg;
+
+    cfg.w = static_cast<unsigned int>(m_pVideoTrack->GetWidth());
+    cfg.h = static_cast<unsigned int>(m_pVideoTrack->GetHeight());
+
+    cfg.threads = webmdshow::GetVpxDecoderThreadCount(
+                    (m_options.thread_count > 0) ? m_options.thread_count : 0,
+                    codec == &vpx_codec_vp9_dx_algo,
+                    cfg.w);
+
+    vpx_codec_ctx_t ctx;
+
+    if (vpx_codec_dec_init(&ctx, codec, &cfg, 0) != VPX_CODEC_OK)
+    {
+        Fail(m_hrDecode, E_FAIL);
+        m_pictures.Close();
+        return;
+    }
+
+    Packet* pPacket;
+
+    while (m_video.Pop(&pPacket))
+    {
+        m_decode_counters.OnSampleIn(pPacket->m_len);
+
+        const LONGLONG start = pPacket->m_start;
+        vpx_codec_err_t err;
+
+        {
+            PipelineCounters::Timer timer(m_decode_counters);
+
+            err = vpx_codec_decode(
+                    &ctx,
+                    &pPacket->m_buf[0],
+                    pPacket->m_len,
+                    0,
+                    0);
+        }
+
+        pPacket->Release();
+
+        if (err != VPX_CODEC_OK)
+        {
+            Fail(m_hrDecode, E_FAIL);
+            break;
+        }
+
+        const HRESULT hr = DecodeFrames(&ctx, start);
+
+        if (FAILED(hr))
+        {
+            Fail(m_hrDecode, hr);
+            break;
+        }
+
+        if (hr != S_OK)  //stopped
+            break;
+    }
+
+    vpx_codec_destroy(&ctx);
+
+    m_pictures.Close();
+}
+
+
+//Copies the frames the decoder has ready into pictures for the encoder.
+//Returns S_FALSE if the transcode was stopped.
+
+HRESULT Job::DecodeFrames(vpx_codec_ctx_t* ctx, LONGLONG start)
+{
+    vpx_codec_iter_t iter = 0;
+
+    while (const vpx_image_t* img = vpx_codec_get_frame(ctx, &iter))
+    {
+        if (img->fmt != VPX_IMG_FMT_I420)
+            return VFW_E_INVALID_MEDIA_TYPE;
+
+        Picture* pic;
+
+        if (!m_free_pictures.TryPop(&pic))
+        {
+            pic = new (std::nothrow) Picture;
+
+            if (pic == 0)
+                return E_OUTOFMEMORY;
+        }
+
+        CopyI420(img, *pic);
+        pic->start = start;
+
+        m_decode_counters.OnSampleOut(pic->buf.size());
+
+        if (!m_pictures.Push(pic))
+        {
+            delete pic;
+            return S_FALSE;
+        }
+    }
+
+    return S_OK;
+}
+
+
+void Job::Encode()
+{
+    vpx_codec_ctx_t ctx;
+    bool bInit = false;
+
+    //A picture is encoded once the next one arrives, which gives its
+    //duration; the last keeps the duration of the one before it.
+
+    Picture* pending = 0;
+    LONGLONG duration = 0;
+
+    HRESULT hr = S_OK;
+    Picture* pic;
+
+    while ((hr == S_OK) && m_pictures.Pop(&pic))
+    {
+        m_encode_counters.OnSampleIn(pic->buf.size());
+
+        if (!bInit)
+        {
+            hr = InitEncoder(m_options, m_options.vp9, pic->w, pic->h, &ctx);
+
+            if (FAILED(hr))
+            {
+                delete pic;
+                break;
+            }
+
+            bInit = true;
+        }
+
+        if (pending)
+        {
+            if (pic->start > pending->start)
+                duration = pic->start - pending->start;
+
+            hr = EncodeFrame(&ctx, pending, duration);
+        }
+
+        pending = pic;
+    }
+
+    if (pending && (hr == S_OK))
+        hr = EncodeFrame(&ctx, pending, duration);
+    else
+        delete pending;
+
+    if (bInit && (hr == S_OK))
+    {
+        //Flushes the frames the encoder has held back (for its lag, or
+        //for altrefs).
+
+        for (;;)
+        {
+            if (vpx_codec_encode(&ctx, 0, 0, 0, 0, GetDeadline(m_options)) !=
+                VPX_CODEC_OK)
+            {
+                hr = E_FAIL;
+                break;
+            }
+
+            int count;
+            hr = GetPackets(&ctx, &count);
+
+            if ((hr != S_OK) || (count == 0))
+                break;
+        }
+    }
+
+    if (bInit)
+        vpx_codec_destroy(&ctx);
+
+    if (FAILED(hr))
+        Fail(m_hrEncode, hr);
+
+    m_encoded.Close();
+}
+
+
+//Encodes pic, which is then free for the decoder.  Returns S_FALSE if
+//the transcode was stopped.
+
+HRESULT Job::EncodeFrame(
+    vpx_codec_ctx_t* ctx,
+    Picture* pic,
+    LONGLONG duration)
+{
+    assert(pic);
+
+    vpx_image_t img;
+    WrapI420(*pic, img);
+
+    const vpx_codec_pts_t pts = pic->start / 10000;  //ms
+    const unsigned long d = (duration >= 10000) ?
+                                static_cast<unsigned long>(duration / 10000) :
+                                1;
+
+    vpx_codec_err_t err;
+
+    {
+        PipelineCounters::Timer timer(m_encode_counters);
+        err = vpx_codec_encode(ctx, &img, pts, d, 0, GetDeadline(m_options));
+    }
+
+    if (!m_free_pictures.TryPush(pic))
+        delete pic;
+
+    if (err != VPX_CODEC_OK)
+        return E_FAIL;
+
+    return GetPackets(ctx);
+}
+
+
+HRESULT Job::GetPackets(vpx_codec_ctx_t* ctx, int* count)
+{
+    if (count)
+        *count = 0;
+
+    vpx_codec_iter_t iter = 0;
+
+    while (const vpx_codec_cx_pkt_t* pkt = vpx_codec_get_cx_data(ctx, &iter))
+    {
+        if (pkt->kind != VPX_CODEC_CX_FRAME_PKT)
+            continue;
+
+        const long len = static_cast<long>(pkt->data.frame.sz);
+
+        Packet* const pPacket = m_encoded_pool.Get(len);
+
+        if (pPacket == 0)
+            return E_OUTOFMEMORY;
+
+        memcpy(&pPacket->m_buf[0], pkt->data.frame.buf, len);
+
+        pPacket->m_start = pkt->data.frame.pts * 10000;  //reftime
+        pPacket->m_key = (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
+
+        m_encode_counters.OnSampleOut(len);
+
+        if (count)
+            ++*count;
+
+        if (!m_encoded.Push(pPacket))
+        {
+            pPacket->Release();
+            return S_FALSE;
+        }
+    }
+
+    return S_OK;
+}
+
+
+//Runs on the calling thread: writes the encoded video, and the audio as
+//it was read, in time order.  The muxer holds on to the video packets
+//until it writes their cluster, so their pool grows to a cluster's worth.
+
+HRESULT Job::Mux(WebmMuxLib::Context& ctx, progress_t progress, void* pv)
+{
+    using namespace WebmMuxLib;
+
+    std::vector<BYTE> format;
+    AM_MEDIA_TYPE mt;
+
+    HRESULT hr = InitVideoMediaType(m_pVideoTrack, m_options.vp9, format, mt);
+
+    if (FAILED(hr))
+        return hr;
+
+    std::auto_ptr<StreamVideo> pVideo(
+        new (std::nothrow) StreamVideoVPx(ctx, mt));
+
+    if (pVideo.get() == 0)
+        return E_OUTOFMEMORY;
+
+    std::auto_ptr<StreamAudio> pAudio;
+
+    if (m_pAudioTrack)
+    {
+        const std::auto_ptr<mkvparser::AudioStream> pSource(
+            mkvparser::AudioStream::CreateInstance(m_pAudioTrack));
+
+        CMediaTypes mtv;
+
+        if (pSource.get())
+            pSource->GetMediaTypes(mtv);
+
+        if (mtv.Empty() || !StreamAudioVorbis::QueryAccept(mtv[0]))
+            return VFW_E_INVALID_MEDIA_TYPE;
+
+        pAudio.reset(StreamAudioVorbis::CreateStream(ctx, mtv[0]));
+
+        if (pAudio.get() == 0)
+            return E_OUTOFMEMORY;
+    }
+
+    ctx.SetVideoStream(pVideo.get());
+
+    if (pAudio.get())
+        ctx.AddAudioStream(pAudio.get());
+
+    ctx.Open(0);  //to m_disk
+
+    LONGLONG last_progress = PipelineCounters::Now();
+    LONGLONG time = 0;
+
+    for (;;)
+    {
+        if (!m_encoded.WaitData())
+        {
+            hr = E_ABORT;  //or a stage failed
+            break;
+        }
+
+        if (pAudio.get() && !m_audio.WaitData())
+        {
+            hr = E_ABORT;
+            break;
+        }
+
+        Packet* const* const v = m_encoded.Peek();
+        Packet* const* const a = pAudio.get() ? m_audio.Peek() : 0;
+
+        if ((v == 0) && (a == 0))  //both channels are done
+            break;
+
+        Packet* pPacket;
+        Stream* pStream;
+
+        if (v && ((a == 0) || ((*v)->m_start <= (*a)->m_start)))
+        {
+            m_encoded.Pop(&pPacket);
+            pStream = pVideo.get();
+        }
+        else
+        {
+            m_audio.Pop(&pPacket);
+            pStream = pAudio.get();
+        }
+
+        time = pPacket->m_start;
+
+        hr = pStream->Receive(pPacket);
+        pPacket->Release();
+
+        if (FAILED(hr))
+            break;
+
+        if (progress)
+        {
+            const LONGLONG now = PipelineCounters::Now();
+
+            if ((now - last_progress) >= kProgressInterval)
+            {
+                (*progress)(pv, time, m_duration);
+                last_progress = now;
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        //Stops the other stages first, so that no frame is left waiting
+        //to be written while the muxer finishes.
+        SetEvent(m_hStop);
+    }
+
+    ctx.Close();  //writes the cues and closes the file
+
+    ctx.SetVideoStream(0);
+
+    if (pAudio.get())
+        ctx.RemoveAudioStream(pAudio.get());
+
+    if (SUCCEEDED(hr) && progress)
+        (*progress)(pv, time, m_duration);
+
+    return SUCCEEDED(hr) ? S_OK : hr;
+}
+
+
+}  //end anon namespace
+
+
+HRESULT Transcode(
+    const wchar_t* src,
+    const wchar_t* dst,
+    const Options& options,
+    const wchar_t* writing_app,
+    HANDLE hQuit,
+    progress_t progress,
+    void* context)
+{
+    if ((src == 0) || (dst == 0))
+        return E_INVALIDARG;
+
+    Job job(options, hQuit);
+
+    const HRESULT hr = job.Open(src);
+
+    if (FAILED(hr))
+        return hr;
+
+    return job.Run(dst, writing_app, progress, context);
+}
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,105 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+//Transcodes a WebM file without a filter graph.  The pieces are those
+//the filters use: a libmkvparser segment reads the blocks, libvpx decodes
+//and re-encodes the video, and a WebmMuxLib::Context writes the output.
+//Each stage runs on a thread of its own, and hands its frames to the next
+//through a lock-free single-producer, single-consumer queue, so a
+//transcode takes no lock per frame, makes no COM calls, and negotiates
+//no allocators; a process can run as many transcodes at once as it has
+//cores for.
+
+namespace WebmTranscode
+{
+
+//The settings of the encode.  A value of -1 leaves a setting at the
+//encoder's default, as makewebm's switches do.
+
+struct Options
+{
+    Options();
+
+    bool vp9;                   //encode VP9, rather than VP8
+    bool no_audio;              //drop the audio, rather than copying it
+    int deadline;               //per frame, in microseconds
+    int target_bitrate;         //kbps
+    int min_quantizer;
+    int max_quantizer;
+    int end_usage;              //0 is VBR, 1 is CBR
+    int keyframe_max_interval;  //frames
+    int thread_count;           //of the decoder and of the encoder
+    int cpu_used;               //-16 to 16; -17 is the default
+    int queue_frames;           //between two stages; 0 is the default
+
+};
+
+
+//Called on the thread that called Transcode, about once a second, with
+//the time the mux has reached and the source's duration (in reftime
+//units; the duration is -1 if the source does not give one).
+
+typedef void (*progress_t)(void* context, LONGLONG time, LONGLONG duration);
+
+
+//Writes the WebM file dst from the WebM file src, whose first video track
+//(VP8 or VP9) is decoded and re-encoded, and whose first audio track, if
+//it is Vorbis, is copied.  The output is replaced if it exists.  If hQuit
+//(which may be 0) is signalled before the transcode completes, it stops,
+//deletes the output, and returns E_ABORT.  The writing app is also given
+//as the muxing app.  progress may be 0.
+
+HRESULT Transcode(
+    const wchar_t* src,
+    const wchar_t* dst,
+    const Options&,
+    const wchar_t* writing_app,
+    HANDLE hQuit,
+    progress_t progress,
+    void* context);
+
+
+//A range of a source for Cut, in reftime units.  A stop of -1 is the end
+//of the source.
+
+struct CutInput
+{
+    const wchar_t* filename;
+    LONGLONG start;
+    LONGLONG stop;
+};
+
+
+//Writes the WebM file dst from ranges of WebM files, one after the other,
+//re-encoding as little of them as it can.  The blocks of a range, from
+//its first keyframe at or after its start, are copied as they are; only
+//the frames before that keyframe are decoded (from the keyframe before
+//them) and re-encoded as the options say, the first as a keyframe, so the
+//range begins on its first frame.  The first audio track, if it is Vorbis,
+//is copied a block at a time: a block is kept if it starts in the range.
+//The times of each range are rebased to follow the one before it.
+//
+//Every source must have the video codec and frame size of the first, and
+//the same audio headers; the re-encoded frames take the codec of the
+//copied ones, so options.vp9 is ignored.  hQuit and progress are as for
+//Transcode, with the duration the sum of the ranges.
+
+HRESULT Cut(
+    const CutInput* inputs,
+    ULONG count,
+    const wchar_t* dst,
+    const Options&,
+    const wchar_t* writing_app,
+    HANDLE hQuit,
+    progress_t progress,
+    void* context);
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,206 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "spscqueue.h"
+#include <atomic>
+#include <cassert>
+
+namespace WebmTranscode
+{
+
+//The link from one stage's thread to the next: an SpscQueue, with the
+//waiting left to it by the queue.  A side blocks only when the queue is
+//empty or full, and the other side signals it only if it has said it is
+//waiting, so at full throughput the stages exchange frames without a
+//kernel call.  Either side returns false as soon as hStop (a manual-reset
+//event shared by the stages of a transcode) is signalled.
+
+template<typename T>
+class Channel
+{
+    Channel(const Channel&);
+    Channel& operator=(const Channel&);
+
+public:
+
+    Channel(size_t capacity, HANDLE hStop) :
+        m_queue(capacity),
+        m_hStop(hStop),
+        m_hData(CreateEvent(0, FALSE, FALSE, 0)),
+        m_hSpace(CreateEvent(0, FALSE, FALSE, 0)),
+        m_bConsumerWaiting(false),
+        m_bProducerWaiting(false),
+        m_bClosed(false)
+    {
+        assert(m_hStop);
+        assert(m_hData);
+        assert(m_hSpace);
+    }
+
+    ~Channel()
+    {
+        CloseHandle(m_hData);
+        CloseHandle(m_hSpace);
+    }
+
+    //Producer side.  Returns false if the transcode was stopped.
+    bool Push(const T& value)
+    {
+        for (;;)
+        {
+            if (m_queue.TryPush(value))
+            {
+                Signal(m_bConsumerWaiting, m_hData);
+                return true;
+            }
+
+            SetWaiting(m_bProducerWaiting);
+
+            if (m_queue.TryPush(value))
+            {
+                m_bProducerWaiting.store(false);
+                Signal(m_bConsumerWaiting, m_hData);
+                return true;
+            }
+
+            if (!Wait(m_hSpace))
+                return false;
+        }
+    }
+
+    //Producer side: no more values follow.
+    void Close()
+    {
+        m_bClosed.store(true);
+        Signal(m_bConsumerWaiting, m_hData);
+    }
+
+    //Consumer side.  Returns false when the producer has closed the
+    //channel and every value has been popped, or the transcode stopped.
+    bool Pop(T* value)
+    {
+        assert(value);
+
+        for (;;)
+        {
+            if (m_queue.TryPop(value))
+            {
+                Signal(m_bProducerWaiting, m_hSpace);
+                return true;
+            }
+
+            if (m_bClosed.load())
+            {
+                //The producer may have pushed its last values just
+                //before it closed.
+                if (m_queue.TryPop(value))
+                    return true;
+
+                return false;
+            }
+
+            if (!WaitData())
+                return false;
+        }
+    }
+
+    //Consumer side: the first value, which stays queued, or 0 if there is
+    //none yet.  The producer may push more at any time.
+    const T* Peek() const
+    {
+        const T* value;
+        return m_queue.Peek(&value) ? value : 0;
+    }
+
+    //Consumer side: whether the producer has closed the channel and
+    //every value has been popped.
+    bool IsDone() const
+    {
+        return m_bClosed.load() && IsEmpty();
+    }
+
+    //Consumer side: the same wait as Pop, without popping.  Returns
+    //false if the transcode stopped.
+    bool WaitData()
+    {
+        for (;;)
+        {
+            if (!IsEmpty() || m_bClosed.load())
+                return true;
+
+            SetWaiting(m_bConsumerWaiting);
+
+            if (!IsEmpty() || m_bClosed.load())
+            {
+                m_bConsumerWaiting.store(false);
+                return true;
+            }
+
+            if (!Wait(m_hData))
+                return false;
+        }
+    }
+
+    size_t GetSize() const
+    {
+        return m_queue.size();
+    }
+
+private:
+
+    webmdshow::SpscQueue<T> m_queue;
+    const HANDLE m_hStop;
+    const HANDLE m_hData;   //auto-reset
+    const HANDLE m_hSpace;  //auto-reset
+    std::atomic<bool> m_bConsumerWaiting;
+    std::atomic<bool> m_bProducerWaiting;
+    std::atomic<bool> m_bClosed;
+
+    bool IsEmpty() const
+    {
+        const T* value;
+        return !m_queue.Peek(&value);
+    }
+
+    //A side stores its waiting flag, then fences, before it checks the
+    //queue again; the other side fences after it has published its
+    //update, then loads the flag.  So one of the two always sees the
+    //other, and no wakeup is lost.
+
+    static void SetWaiting(std::atomic<bool>& waiting)
+    {
+        waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static void Signal(std::atomic<bool>& waiting, HANDLE h)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiting.exchange(false))
+            SetEvent(h);
+    }
+
+    //Called with the waiting flag set, having checked again after setting
+    //it.  A wakeup may be stale, so the caller checks again after this.
+    //Returns false if the transcode was stopped.
+    bool Wait(HANDLE h)
+    {
+        const HANDLE ha[2] = { h, m_hStop };
+
+        const DWORD dw = WaitForMultipleObjects(2, ha, FALSE, INFINITE);
+
+        return (dw == WAIT_OBJECT_0);
+    }
+
+};
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,1072 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <vfwmsgs.h>
+#include "webmtranscode.h"
+#include "webmtranscodepacket.h"
+#include "webmtranscodevpx.h"
+#include "cmediatypes.h"
+#include "cpuutil.h"
+#include "mkvparsermapreader.h"
+#include "mkvparserstreamaudio.h"
+#include "pipelinecounters.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamaudiovorbis.h"
+#include "webmmuxstreamvideovpx.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8dx.h"
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <new>
+#include <vector>
+
+using webmdshow::PipelineCounters;
+
+//A cut runs on the calling thread alone.  Nearly all of it is copying
+//blocks, which is bound by the reads; only the frames at the start of
+//each range, up to its first keyframe, pass through libvpx.
+
+namespace WebmTranscode
+{
+
+namespace
+{
+
+enum { kPoolSize = 256 };
+
+enum { kProgressInterval = 1000000 };  //us
+
+//While one track's queue is empty, a packet of the other is held back
+//until the reader is this far past it, in case a block of the empty
+//track is yet to come that is due before it.  Muxers interleave the
+//tracks by time to within a cluster, which is shorter than this.
+const LONGLONG kInterleaveSlack = 20000000;  //reftime
+
+
+class Source
+{
+    Source(const Source&);
+    Source& operator=(const Source&);
+
+public:
+
+    Source();
+    ~Source();
+
+    HRESULT Open(const wchar_t*, bool no_audio);
+
+    //Returns the cluster from which to read a range that starts at t:
+    //that of the last keyframe at or before t, as the Cues give it (or,
+    //if there are no Cues, as the clusters do), else the first cluster.
+    const mkvparser::Cluster* Seek(LONGLONG t);  //reftime
+
+    mkvparser::MapReader m_reader;
+    mkvparser::Segment* m_pSegment;
+    const mkvparser::VideoTrack* m_pVideoTrack;
+    const mkvparser::AudioTrack* m_pAudioTrack;  //0 if not copied
+    LONGLONG m_duration;  //reftime, or -1
+
+};
+
+
+Source::Source() :
+    m_pSegment(0),
+    m_pVideoTrack(0),
+    m_pAudioTrack(0),
+    m_duration(-1)
+{
+}
+
+
+Source::~Source()
+{
+    delete m_pSegment;
+}
+
+
+HRESULT Source::Open(const wchar_t* filename, bool no_audio)
+{
+    HRESULT hr = m_reader.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    long long pos = 0;
+
+    mkvparser::EBMLHeader h;
+
+    long long result = h.Parse(&m_reader, pos);
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    result = mkvparser::Segment::CreateInstance(&m_reader, pos, m_pSegment);
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    assert(m_pSegment);
+
+    result = m_pSegment->ParseHeaders();
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    //With Cues, a range is found without touching the clusters before
+    //it; without them, every cluster must be loaded to search.
+
+    if (m_pSegment->GetCues() == 0)
+    {
+        const long status = m_pSegment->Load();
+
+        if (status < 0)
+            return VFW_E_INVALID_FILE_FORMAT;
+    }
+
+    const mkvparser::Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    for (unsigned long i = 0; i < pTracks->GetTracksCount(); ++i)
+    {
+        const mkvparser::Track* const t = pTracks->GetTrackByIndex(i);
+
+        if (t == 0)
+            continue;
+
+        const char* const id = t->GetCodecId();
+
+        if (id == 0)
+            continue;
+
+        if ((t->GetType() == 1) && (m_pVideoTrack == 0))  //video
+        {
+            if ((_stricmp(id, "V_VP8") == 0) || (_stricmp(id, "V_VP9") == 0))
+                m_pVideoTrack = static_cast<const mkvparser::VideoTrack*>(t);
+        }
+        else if ((t->GetType() == 2) && (m_pAudioTrack == 0))  //audio
+        {
+            if (!no_audio && (_stricmp(id, "A_VORBIS") == 0))
+                m_pAudioTrack = static_cast<const mkvparser::AudioTrack*>(t);
+        }
+    }
+
+    if (m_pVideoTrack == 0)
+        return VFW_E_INVALID_MEDIA_TYPE;  //nothing to cut
+
+    const LONGLONG duration_ns = m_pSegment->GetDuration();
+
+    if (duration_ns >= 0)
+        m_duration = duration_ns / 100;
+
+    return S_OK;
+}
+
+
+const mkvparser::Cluster* Source::Seek(LONGLONG t)
+{
+    using namespace mkvparser;
+
+    const long long ns = t * 100;
+
+    if (const Cues* const pCues = m_pSegment->GetCues())
+    {
+        while (!pCues->DoneParsing())
+            pCues->LoadCuePoint();
+
+        const CuePoint* pCP;
+        const CuePoint::TrackPosition* pTP;
+
+        if (pCues->Find(ns, m_pVideoTrack, pCP, pTP))
+        {
+            const BlockEntry* const pEntry = pCues->GetBlock(pCP, pTP);
+
+            if ((pEntry != 0) && !pEntry->EOS())
+                return pEntry->GetCluster();
+        }
+
+        if (m_pSegment->GetCount() == 0)  //nothing loaded yet
+            m_pSegment->LoadCluster();
+
+        return m_pSegment->GetFirst();
+    }
+
+    const BlockEntry* pEntry;
+
+    const long status = m_pVideoTrack->Seek(ns, pEntry);
+
+    if ((status < 0) || (pEntry == 0) || pEntry->EOS())
+        return m_pSegment->GetFirst();
+
+    return pEntry->GetCluster();
+}
+
+
+class Cutter
+{
+    Cutter(const Cutter&);
+    Cutter& operator=(const Cutter&);
+
+public:
+
+    Cutter(const Options&, HANDLE hQuit);
+    ~Cutter();
+
+    HRESULT Open(const CutInput*, ULONG count);
+
+    HRESULT Run(
+        const wchar_t* dst,
+        const wchar_t* writing_app,
+        progress_t,
+        void*);
+
+private:
+
+    const Options m_options;
+    const HANDLE m_hQuit;
+
+    std::vector<Source*> m_sources;
+    const CutInput* m_inputs;
+    bool m_vp9;
+    LONGLONG m_duration;  //of the output, reftime, or -1
+
+    PacketPool m_video_pool;
+    PacketPool m_audio_pool;
+
+    //Packets for the muxer, in time order within each track.
+    std::deque<Packet*> m_video;
+    std::deque<Packet*> m_audio;
+
+    WebmMuxLib::Stream* m_pVideoStream;
+    WebmMuxLib::Stream* m_pAudioStream;  //0 if there is no audio
+
+    //The time, in the output, that the reader has copied up to.  It is
+    //held while the start of a range is decoded and re-encoded, as the
+    //encoder's output is yet to come.
+    LONGLONG m_frontier;
+
+    //The range being cut.
+    Source* m_pSource;
+    LONGLONG m_start;   //in the source, reftime
+    LONGLONG m_stop;    //in the source, reftime, or -1
+    LONGLONG m_offset;  //output time of m_start
+    LONGLONG m_end;     //output time after its last video frame
+    bool m_bCopy;       //its first keyframe at or after m_start was seen
+
+    LONGLONG m_last_video;  //output time of the last video frame, or -1
+    LONGLONG m_frame_gap;   //between the last two video frames
+
+    vpx_codec_ctx_t m_decoder;
+    bool m_bDecoder;
+
+    vpx_codec_ctx_t m_encoder;
+    bool m_bEncoder;
+
+    //A picture is encoded once the next one arrives, which gives its
+    //duration, as the transcode does.
+    Picture m_pending;
+    bool m_bPending;
+
+    std::vector<BYTE> m_frame;  //a block's frame, to decode
+
+    progress_t m_progress;
+    void* m_progress_context;
+    LONGLONG m_last_progress;
+    LONGLONG m_time;
+
+    bool IsQuit() const;
+
+    HRESULT Mux(WebmMuxLib::Context&);
+    HRESULT CutRange(const CutInput&, Source*);
+    HRESULT CutBlock(const mkvparser::Cluster*, const mkvparser::Block*);
+    HRESULT CopyBlock(const mkvparser::Block*, LONGLONG t, bool video);
+
+    HRESULT OpenDecoder();
+    HRESULT DecodeBlock(const mkvparser::Block*, LONGLONG t);
+    HRESULT EncodePicture(const vpx_image_t*, LONGLONG t);
+    HRESULT EncodePending(LONGLONG duration);
+    HRESULT FlushEncoder(LONGLONG next);
+    HRESULT GetPackets();
+    void CloseCodecs();
+
+    void OnVideo(LONGLONG t);
+    HRESULT Write(bool bFlush);
+    void Drain();
+
+};
+
+
+Cutter::Cutter(const Options& options, HANDLE hQuit) :
+    m_options(options),
+    m_hQuit(hQuit),
+    m_inputs(0),
+    m_vp9(false),
+    m_duration(-1),
+    m_video_pool(kPoolSize),
+    m_audio_pool(kPoolSize),
+    m_pVideoStream(0),
+    m_pAudioStream(0),
+    m_frontier(0),
+    m_pSource(0),
+    m_start(0),
+    m_stop(-1),
+    m_offset(0),
+    m_end(0),
+    m_bCopy(false),
+    m_last_video(-1),
+    m_frame_gap(0),
+    m_bDecoder(false),
+    m_bEncoder(false),
+    m_bPending(false),
+    m_progress(0),
+    m_progress_context(0),
+    m_last_progress(0),
+    m_time(0)
+{
+}
+
+
+Cutter::~Cutter()
+{
+    CloseCodecs();
+    Drain();
+
+    while (!m_sources.empty())
+    {
+        delete m_sources.back();
+        m_sources.pop_back();
+    }
+}
+
+
+void Cutter::Drain()
+{
+    while (!m_video.empty())
+    {
+        m_video.front()->Release();
+        m_video.pop_front();
+    }
+
+    while (!m_audio.empty())
+    {
+        m_audio.front()->Release();
+        m_audio.pop_front();
+    }
+}
+
+
+bool Cutter::IsQuit() const
+{
+    if (m_hQuit == 0)
+        return false;
+
+    return (WaitForSingleObject(m_hQuit, 0) == WAIT_OBJECT_0);
+}
+
+
+//Opens every source before anything is written, so that one that can't
+//be cut fails the cut at once.
+
+HRESULT Cutter::Open(const CutInput* inputs, ULONG count)
+{
+    m_inputs = inputs;
+    m_duration = 0;
+
+    for (ULONG i = 0; i < count; ++i)
+    {
+        const CutInput& in = inputs[i];
+
+        if ((in.filename == 0) || (in.start < 0))
+            return E_INVALIDARG;
+
+        if ((in.stop >= 0) && (in.stop <= in.start))
+            return E_INVALIDARG;
+
+        Source* const pSource = new (std::nothrow) Source;
+
+        if (pSource == 0)
+            return E_OUTOFMEMORY;
+
+        m_sources.push_back(pSource);
+
+        const HRESULT hr = pSource->Open(in.filename, m_options.no_audio);
+
+        if (FAILED(hr))
+            return hr;
+
+        const Source* const pFirst = m_sources.front();
+
+        const mkvparser::VideoTrack* const v0 = pFirst->m_pVideoTrack;
+        const mkvparser::VideoTrack* const v = pSource->m_pVideoTrack;
+
+        if ((_stricmp(v->GetCodecId(), v0->GetCodecId()) != 0) ||
+            (v->GetWidth() != v0->GetWidth()) ||
+            (v->GetHeight() != v0->GetHeight()))
+        {
+            return VFW_E_TYPE_NOT_ACCEPTED;
+        }
+
+        const mkvparser::AudioTrack* const a0 = pFirst->m_pAudioTrack;
+        const mkvparser::AudioTrack* const a = pSource->m_pAudioTrack;
+
+        if (a0 == 0)
+            pSource->m_pAudioTrack = 0;  //the output has no audio track
+
+        else if (a)
+        {
+            //Both ranges go through one decoder, so the Vorbis headers of
+            //each must be the same.
+
+            size_t size0, size;
+
+            const BYTE* const p0 = a0->GetCodecPrivate(size0);
+            const BYTE* const p = a->GetCodecPrivate(size);
+
+            if ((size != size0) || (size && (memcmp(p, p0, size) != 0)))
+                return VFW_E_TYPE_NOT_ACCEPTED;
+        }
+
+        LONGLONG stop = in.stop;
+
+        if ((pSource->m_duration >= 0) &&
+            ((stop < 0) || (stop > pSource->m_duration)))
+        {
+            stop = pSource->m_duration;
+        }
+
+        if ((stop < 0) || (m_duration < 0))
+            m_duration = -1;
+
+        else if (stop > in.start)
+            m_duration += stop - in.start;
+    }
+
+    const char* const id = m_sources.front()->m_pVideoTrack->GetCodecId();
+    m_vp9 = (_stricmp(id, "V_VP9") == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Cutter::Run(
+    const wchar_t* dst,
+    const wchar_t* writing_app,
+    progress_t progress,
+    void* context)
+{
+    using namespace WebmMuxLib;
+
+    m_progress = progress;
+    m_progress_context = context;
+    m_last_progress = PipelineCounters::Now();
+
+    Context ctx;
+
+    if (writing_app)
+        ctx.m_writing_app = writing_app;
+
+    HRESULT hr = ctx.m_disk.Open(dst);
+
+    if (SUCCEEDED(hr))
+        hr = Mux(ctx);
+
+    if (FAILED(hr))
+        DeleteFile(dst);  //closed by the muxer
+
+    return hr;
+}
+
+
+HRESULT Cutter::Mux(WebmMuxLib::Context& ctx)
+{
+    using namespace WebmMuxLib;
+
+    const Source* const pFirst = m_sources.front();
+
+    std::vector<BYTE> format;
+    AM_MEDIA_TYPE mt;
+
+    HRESULT hr = InitVideoMediaType(pFirst->m_pVideoTrack, m_vp9, format, mt);
+
+    if (FAILED(hr))
+        return hr;
+
+    std::auto_ptr<StreamVideo> pVideo(
+        new (std::nothrow) StreamVideoVPx(ctx, mt));
+
+    if (pVideo.get() == 0)
+        return E_OUTOFMEMORY;
+
+    std::auto_ptr<StreamAudio> pAudio;
+
+    if (pFirst->m_pAudioTrack)
+    {
+        const std::auto_ptr<mkvparser::AudioStream> pSource(
+            mkvparser::AudioStream::CreateInstance(pFirst->m_pAudioTrack));
+
+        CMediaTypes mtv;
+
+        if (pSource.get())
+            pSource->GetMediaTypes(mtv);
+
+        if (mtv.Empty() || !StreamAudioVorbis::QueryAccept(mtv[0]))
+            return VFW_E_INVALID_MEDIA_TYPE;
+
+        pAudio.reset(StreamAudioVorbis::CreateStream(ctx, mtv[0]));
+
+        if (pAudio.get() == 0)
+            return E_OUTOFMEMORY;
+    }
+
+    ctx.SetVideoStream(pVideo.get());
+
+    if (pAudio.get())
+        ctx.AddAudioStream(pAudio.get());
+
+    m_pVideoStream = pVideo.get();
+    m_pAudioStream = pAudio.get();
+
+    ctx.Open(0);  //to m_disk
+
+    for (size_t i = 0; i < m_sources.size(); ++i)
+    {
+        hr = CutRange(m_inputs[i], m_sources[i]);
+
+        if (FAILED(hr))
+            break;
+    }
+
+    CloseCodecs();
+    Drain();
+
+    ctx.Close();  //writes the cues and closes the file
+
+    ctx.SetVideoStream(0);
+
+    if (pAudio.get())
+        ctx.RemoveAudioStream(pAudio.get());
+
+    m_pVideoStream = 0;
+    m_pAudioStream = 0;
+
+    if (SUCCEEDED(hr) && m_progress)
+        (*m_progress)(m_progress_context, m_time, m_duration);
+
+    return SUCCEEDED(hr) ? S_OK : hr;
+}
+
+
+HRESULT Cutter::CutRange(const CutInput& in, Source* pSource)
+{
+    m_pSource = pSource;
+    m_start = in.start;
+    m_stop = in.stop;
+    m_end = m_offset;
+    m_bCopy = false;
+
+    const mkvparser::Cluster* pCluster = pSource->Seek(m_start);
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        if (IsQuit())
+            return E_ABORT;
+
+        const LONGLONG cluster_time = pCluster->GetTime() / 100;
+
+        if ((m_stop >= 0) && (cluster_time >= m_stop))
+            break;
+
+        const mkvparser::BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const mkvparser::Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const HRESULT hr = CutBlock(pCluster, pBlock);
+
+            if (FAILED(hr))
+                return hr;
+
+            status = pCluster->GetNext(pEntry, pEntry);
+        }
+
+        if (status < 0)
+            return VFW_E_INVALID_FILE_FORMAT;
+
+        pCluster = pSource->m_pSegment->GetNext(pCluster);
+    }
+
+    //A range that ends before its first keyframe is re-encoded all the
+    //way; its last picture keeps the duration of the one before it.
+
+    HRESULT hr = FlushEncoder(-1);
+
+    if (FAILED(hr))
+        return hr;
+
+    CloseCodecs();
+
+    hr = Write(true);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_offset = m_end;
+    m_frontier = m_end;
+
+    return S_OK;
+}
+
+
+HRESULT Cutter::CutBlock(
+    const mkvparser::Cluster* pCluster,
+    const mkvparser::Block* pBlock)
+{
+    const long long tn = pBlock->GetTrackNumber();
+    const LONGLONG t = pBlock->GetTime(pCluster) / 100;  //reftime
+
+    if ((m_stop >= 0) && (t >= m_stop))
+        return S_OK;
+
+    const mkvparser::AudioTrack* const pAudioTrack = m_pSource->m_pAudioTrack;
+
+    if (pAudioTrack && (tn == pAudioTrack->GetNumber()))
+    {
+        if (t < m_start)
+            return S_OK;
+
+        return CopyBlock(pBlock, t, false);
+    }
+
+    if (tn != m_pSource->m_pVideoTrack->GetNumber())
+        return S_OK;  //not a track we copy
+
+    if (m_bCopy)
+        return CopyBlock(pBlock, t, true);
+
+    if (pBlock->IsKey())
+    {
+        if (t >= m_start)
+        {
+            //The frames before this keyframe are re-encoded, and it and
+            //everything after it are copied.
+
+            const HRESULT hr = FlushEncoder(t - m_start + m_offset);
+
+            if (FAILED(hr))
+                return hr;
+
+            CloseCodecs();
+            m_bCopy = true;
+
+            return CopyBlock(pBlock, t, true);
+        }
+
+        const HRESULT hr = OpenDecoder();
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (!m_bDecoder)  //before the keyframe the range is decoded from
+        return S_OK;
+
+    return DecodeBlock(pBlock, t);
+}
+
+
+HRESULT Cutter::CopyBlock(
+    const mkvparser::Block* pBlock,
+    LONGLONG t,
+    bool video)
+{
+    PacketPool& pool = video ? m_video_pool : m_audio_pool;
+    std::deque<Packet*>& q = video ? m_video : m_audio;
+
+    const LONGLONG out = t - m_start + m_offset;
+
+    for (int i = 0; i < pBlock->GetFrameCount(); ++i)
+    {
+        const mkvparser::Block::Frame& f = pBlock->GetFrame(i);
+
+        Packet* const pPacket = pool.Get(f.len);
+
+        if (pPacket == 0)
+            return E_OUTOFMEMORY;
+
+        if (f.Read(&m_pSource->m_reader, &pPacket->m_buf[0]) != 0)
+        {
+            pPacket->Release();
+            return E_FAIL;
+        }
+
+        pPacket->m_start = out;
+        pPacket->m_key = pBlock->IsKey();
+
+        q.push_back(pPacket);
+    }
+
+    if (video)
+        OnVideo(out);
+
+    if (!m_bDecoder && !m_bEncoder && (out > m_frontier))
+        m_frontier = out;
+
+    return Write(false);
+}
+
+
+HRESULT Cutter::OpenDecoder()
+{
+    if (m_bDecoder)
+        return S_OK;
+
+    vpx_codec_iface_t* const codec =
+        m_vp9 ? &vpx_codec_vp9_dx_algo : &vpx_codec_vp8_dx_algo;
+
+    const mkvparser::VideoTrack* const pTrack = m_pSource->m_pVideoTrack;
+
+    vpx_codec_dec_cfg_t cfg;
+
+    cfg.w = static_cast<unsigned int>(pTrack->GetWidth());
+    cfg.h = static_cast<unsigned int>(pTrack->GetHeight());
+
+    cfg.threads = webmdshow::GetVpxDecoderThreadCount(
+                    (m_options.thread_count > 0) ? m_options.thread_count : 0,
+                    m_vp9,
+                    cfg.w);
+
+    if (vpx_codec_dec_init(&m_decoder, codec, &cfg, 0) != VPX_CODEC_OK)
+        return E_FAIL;
+
+    m_bDecoder = true;
+    return S_OK;
+}
+
+
+//Decodes a block before the range's first keyframe.  Its pictures are
+//encoded if they are in the range, and are only references otherwise.
+
+HRESULT Cutter::DecodeBlock(const mkvparser::Block* pBlock, LONGLONG t)
+{
+    assert(m_bDecoder);
+
+    for (int i = 0; i < pBlock->GetFrameCount(); ++i)
+    {
+        const mkvparser::Block::Frame& f = pBlock->GetFrame(i);
+
+        if (m_frame.size() < size_t(f.len))
+            m_frame.resize(f.len);
+
+        if (f.Read(&m_pSource->m_reader, &m_frame[0]) != 0)
+            return E_FAIL;
+
+        const vpx_codec_err_t err =
+            vpx_codec_decode(&m_decoder, &m_frame[0], f.len, 0, 0);
+
+        if (err != VPX_CODEC_OK)
+            return E_FAIL;
+
+        vpx_codec_iter_t iter = 0;
+
+        while (const vpx_image_t* img = vpx_codec_get_frame(&m_decoder, &iter))
+        {
+            if (img->fmt != VPX_IMG_FMT_I420)
+                return VFW_E_INVALID_MEDIA_TYPE;
+
+            if (t < m_start)
+                continue;
+
+            const HRESULT hr = EncodePicture(img, t - m_start + m_offset);
+
+            if (FAILED(hr))
+                return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+
+//The encoder is opened for the first picture of each range, so that
+//picture is always a keyframe.
+
+HRESULT Cutter::EncodePicture(const vpx_image_t* img, LONGLONG t)
+{
+    if (!m_bEncoder)
+    {
+        const HRESULT hr = InitEncoder(
+                            m_options,
+                            m_vp9,
+                            img->d_w,
+                            img->d_h,
+                            &m_encoder);
+
+        if (FAILED(hr))
+            return hr;
+
+        m_bEncoder = true;
+    }
+    else if (m_bPending)
+    {
+        const HRESULT hr = EncodePending(t - m_pending.start);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    CopyI420(img, m_pending);
+    m_pending.start = t;
+    m_bPending = true;
+
+    return S_OK;
+}
+
+
+HRESULT Cutter::EncodePending(LONGLONG duration)
+{
+    assert(m_bEncoder);
+    assert(m_bPending);
+
+    vpx_image_t img;
+    WrapI420(m_pending, img);
+
+    const vpx_codec_pts_t pts = m_pending.start / 10000;  //ms
+    const unsigned long d = (duration >= 10000) ?
+                                static_cast<unsigned long>(duration / 10000) :
+                                1;
+
+    m_bPending = false;
+
+    const vpx_codec_err_t err =
+        vpx_codec_encode(&m_encoder, &img, pts, d, 0, GetDeadline(m_options));
+
+    if (err != VPX_CODEC_OK)
+        return E_FAIL;
+
+    if (duration > 0)
+        m_frame_gap = duration;
+
+    return GetPackets();
+}
+
+
+//Encodes the last picture, which lasts until next (an output time, or -1
+//if the range ends with it), and drains the encoder.
+
+HRESULT Cutter::FlushEncoder(LONGLONG next)
+{
+    if (!m_bEncoder)
+        return S_OK;
+
+    if (m_bPending)
+    {
+        const LONGLONG duration = (next > m_pending.start) ?
+                                    next - m_pending.start :
+                                    m_frame_gap;
+
+        const HRESULT hr = EncodePending(duration);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    //Flushes the frames the encoder has held back (for its lag, or for
+    //altrefs).
+
+    for (;;)
+    {
+        const vpx_codec_err_t err =
+            vpx_codec_encode(&m_encoder, 0, 0, 0, 0, GetDeadline(m_options));
+
+        if (err != VPX_CODEC_OK)
+            return E_FAIL;
+
+        const size_t count = m_video.size();
+
+        const HRESULT hr = GetPackets();
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_video.size() == count)
+            break;
+    }
+
+    vpx_codec_destroy(&m_encoder);
+    m_bEncoder = false;
+
+    return S_OK;
+}
+
+
+HRESULT Cutter::GetPackets()
+{
+    vpx_codec_iter_t iter = 0;
+
+    while (const vpx_codec_cx_pkt_t* pkt =
+            vpx_codec_get_cx_data(&m_encoder, &iter))
+    {
+        if (pkt->kind != VPX_CODEC_CX_FRAME_PKT)
+            continue;
+
+        const long len = static_cast<long>(pkt->data.frame.sz);
+
+        Packet* const pPacket = m_video_pool.Get(len);
+
+        if (pPacket == 0)
+            return E_OUTOFMEMORY;
+
+        memcpy(&pPacket->m_buf[0], pkt->data.frame.buf, len);
+
+        pPacket->m_start = pkt->data.frame.pts * 10000;  //reftime
+        pPacket->m_key = (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
+
+        m_video.push_back(pPacket);
+
+        OnVideo(pPacket->m_start);
+    }
+
+    return Write(false);
+}
+
+
+void Cutter::CloseCodecs()
+{
+    if (m_bDecoder)
+    {
+        vpx_codec_destroy(&m_decoder);
+        m_bDecoder = false;
+    }
+
+    if (m_bEncoder)
+    {
+        vpx_codec_destroy(&m_encoder);
+        m_bEncoder = false;
+    }
+
+    m_bPending = false;
+}
+
+
+//The next range starts where this video frame would be followed by
+//another: after it, by the time between it and the frame before.
+
+void Cutter::OnVideo(LONGLONG t)
+{
+    if ((m_last_video >= 0) && (t > m_last_video))
+        m_frame_gap = t - m_last_video;
+
+    m_last_video = t;
+
+    if ((t + m_frame_gap) > m_end)
+        m_end = t + m_frame_gap;
+}
+
+
+//Writes the packets of the two queues to the muxer in time order, as far
+//as the times of those to come allow, or all of them if bFlush is set.
+
+HRESULT Cutter::Write(bool bFlush)
+{
+    using WebmMuxLib::Stream;
+
+    for (;;)
+    {
+        const bool v = !m_video.empty();
+        const bool a = !m_audio.empty();
+
+        if (!v && !a)
+            return S_OK;
+
+        std::deque<Packet*>* q;
+        Stream* pStream;
+        bool bWait;  //for a packet of the other track that may precede it
+
+        if (v && (!a || (m_video.front()->m_start <=
+                         m_audio.front()->m_start)))
+        {
+            q = &m_video;
+            pStream = m_pVideoStream;
+            bWait = !a && (m_pAudioStream != 0);
+        }
+        else
+        {
+            q = &m_audio;
+            pStream = m_pAudioStream;
+            bWait = !v;
+        }
+
+        Packet* const pPacket = q->front();
+
+        if (bWait && !bFlush &&
+            ((pPacket->m_start + kInterleaveSlack) > m_frontier))
+        {
+            return S_OK;
+        }
+
+        q->pop_front();
+
+        m_time = pPacket->m_start;
+
+        const HRESULT hr = pStream->Receive(pPacket);
+        pPacket->Release();
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_progress)
+        {
+            const LONGLONG now = PipelineCounters::Now();
+
+            if ((now - m_last_progress) >= kProgressInterval)
+            {
+                (*m_progress)(m_progress_context, m_time, m_duration);
+                m_last_progress = now;
+            }
+        }
+    }
+}
+
+
+}  //end anon namespace
+
+
+HRESULT Cut(
+    const CutInput* inputs,
+    ULONG count,
+    const wchar_t* dst,
+    const Options& options,
+    const wchar_t* writing_app,
+    HANDLE hQuit,
+    progress_t progress,
+    void* context)
+{
+    if ((inputs == 0) || (count == 0) || (dst == 0))
+        return E_INVALIDARG;
+
+    Cutter cutter(options, hQuit);
+
+    const HRESULT hr = cutter.Open(inputs, count);
+
+    if (FAILED(hr))
+        return hr;
+
+    return cutter.Run(dst, writing_app, progress, context);
+}
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,826 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <amvideo.h>
+#include <process.h>
+#include <shlwapi.h>  //link with shlwapi.lib
+#include <uuids.h>
+#include <vfwmsgs.h>
+#include "webmtranscodemuxservice.h"
+#include "webmtranscodepacket.h"
+#include "cpuutil.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamaudiovorbis.h"
+#include "webmmuxstreamvideovpx.h"
+#include "webmtypes.h"
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <new>
+
+//A session is run by one worker at a time: it is on the ready list, or
+//held by a worker, from when a frame is queued for it until its queue is
+//empty, so its Context needs no lock.  A worker gives up a session after
+//a batch of frames, for the others to have their turn.  The muxers' Files
+//are given the service's Writer, whose threads write their buffers in
+//the same way, a buffer at a time.
+
+namespace WebmTranscode
+{
+
+namespace
+{
+
+enum { kDefaultWriterCount = 4 };
+enum { kDefaultBufferSize = 256 * 1024 };
+enum { kDefaultWriteAheadLimit = 1024 * 1024 };
+enum { kDefaultMemoryLimit = 8 * 1024 * 1024 };
+
+//A session's free packets.  Hundreds of sessions are meant to share a
+//process, so each keeps few.
+enum { kPoolSize = 32 };
+
+enum { kBatchFrames = 16 };  //before the session gives up its worker
+
+
+HRESULT StartThreads(
+    int count,
+    unsigned (__stdcall* proc)(void*),
+    void* pv,
+    std::vector<HANDLE>& threads)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const uintptr_t h = _beginthreadex(
+                                0,  //security
+                                0,  //stack size
+                                proc,
+                                pv,
+                                0,   //run immediately
+                                0);  //thread id
+
+        if (h == 0)
+            return E_FAIL;
+
+        threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
+
+    return S_OK;
+}
+
+
+//Each thread takes a count of the semaphore; one that finds nothing on
+//its list has been told to stop.
+
+void StopThreads(std::vector<HANDLE>& threads, HANDLE hReady)
+{
+    if (threads.empty())
+        return;
+
+    const LONG n = static_cast<LONG>(threads.size());
+
+    BOOL b = ReleaseSemaphore(hReady, n, 0);
+    assert(b);
+
+    //One at a time: there may be more than WaitForMultipleObjects takes.
+
+    for (LONG i = 0; i < n; ++i)
+    {
+        const DWORD dw = WaitForSingleObject(threads[i], INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        b = CloseHandle(threads[i]);
+        assert(b);
+    }
+
+    threads.clear();
+}
+
+
+bool IsVideoType(const AM_MEDIA_TYPE& mt)
+{
+    if (mt.majortype != MEDIATYPE_Video)
+        return false;
+
+    if ((mt.subtype != WebmTypes::MEDIASUBTYPE_VP80) &&
+        (mt.subtype != WebmTypes::MEDIASUBTYPE_VP90))
+    {
+        return false;
+    }
+
+    if ((mt.formattype != FORMAT_VideoInfo) || (mt.pbFormat == 0))
+        return false;
+
+    if (mt.cbFormat < sizeof(VIDEOINFOHEADER))
+        return false;
+
+    const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+    const BITMAPINFOHEADER& bmih = vih.bmiHeader;
+
+    return (bmih.biWidth > 0) && (bmih.biHeight > 0);
+}
+
+}  //end anon namespace
+
+
+MuxServiceOptions::MuxServiceOptions() :
+    worker_count(0),
+    writer_count(0),
+    buffer_size(0),
+    write_ahead_limit(0)
+{
+}
+
+
+MuxSessionParams::MuxSessionParams() :
+    filename(0),
+    pStream(0),
+    video(0),
+    audio(0),
+    writing_app(0),
+    memory_limit(0)
+{
+}
+
+
+//Writes the buffers that the sessions' muxers queue.
+
+class MuxService::Writer : public EbmlIO::File::Writer
+{
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+
+public:
+
+    Writer();
+    ~Writer();
+
+    HRESULT Start(int count);
+    void Stop();
+
+    void Schedule(EbmlIO::File*);
+
+private:
+
+    CRITICAL_SECTION m_cs;
+    HANDLE m_hReady;  //semaphore: a File has buffers queued
+    std::deque<EbmlIO::File*> m_ready;
+    std::vector<HANDLE> m_threads;
+
+    static unsigned __stdcall ThreadProc(void*);
+    void Main();
+
+};
+
+
+MuxService::Writer::Writer()
+{
+    InitializeCriticalSection(&m_cs);
+
+    m_hReady = CreateSemaphore(0, 0, LONG_MAX, 0);
+    assert(m_hReady);
+}
+
+
+MuxService::Writer::~Writer()
+{
+    assert(m_threads.empty());
+    assert(m_ready.empty());
+
+    CloseHandle(m_hReady);
+    DeleteCriticalSection(&m_cs);
+}
+
+
+HRESULT MuxService::Writer::Start(int count)
+{
+    if (m_hReady == 0)
+        return E_OUTOFMEMORY;
+
+    return StartThreads(count, &Writer::ThreadProc, this, m_threads);
+}
+
+
+void MuxService::Writer::Stop()
+{
+    StopThreads(m_threads, m_hReady);
+}
+
+
+void MuxService::Writer::Schedule(EbmlIO::File* pFile)
+{
+    assert(pFile);
+
+    EnterCriticalSection(&m_cs);
+    m_ready.push_back(pFile);
+    LeaveCriticalSection(&m_cs);
+
+    const BOOL b = ReleaseSemaphore(m_hReady, 1, 0);
+    assert(b);
+    b;
+}
+
+
+unsigned MuxService::Writer::ThreadProc(void* pv)
+{
+    Writer* const pWriter = static_cast<Writer*>(pv);
+    assert(pWriter);
+
+    pWriter->Main();
+    return 0;
+}
+
+
+void MuxService::Writer::Main()
+{
+    for (;;)
+    {
+        const DWORD dw = WaitForSingleObject(m_hReady, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        EnterCriticalSection(&m_cs);
+
+        if (m_ready.empty())  //stopped
+        {
+            LeaveCriticalSection(&m_cs);
+            return;
+        }
+
+        EbmlIO::File* const pFile = m_ready.front();
+        m_ready.pop_front();
+
+        LeaveCriticalSection(&m_cs);
+
+        //One buffer, then the File goes to the back of the list.  Once
+        //WriteQueued returns false the File isn't ours to touch.
+
+        if (pFile->WriteQueued())
+            Schedule(pFile);
+    }
+}
+
+
+class MuxSession
+{
+    MuxSession(const MuxSession&);
+    MuxSession& operator=(const MuxSession&);
+
+public:
+
+    explicit MuxSession(ULONG memory_limit);
+    ~MuxSession();
+
+    HRESULT Open(
+        const MuxSessionParams&,
+        const MuxServiceOptions&,
+        EbmlIO::File::Writer*);
+
+    //Called by a worker.  Returns true if the session has frames still
+    //to mux, and must be scheduled again.
+    bool Run();
+
+    const ULONG m_memory_limit;
+
+    WebmMuxLib::Context m_ctx;
+    WebmMuxLib::StreamVideo* m_pVideo;
+    WebmMuxLib::StreamAudio* m_pAudio;  //0 if there is no audio
+    IStream* m_pStream;
+
+    //Packets are got by the caller, and released by the worker that
+    //holds the session (or by the muxer, on that worker's thread).
+    PacketPool m_pool;
+
+    struct Entry
+    {
+        Packet* pPacket;
+        MuxTrack track;
+    };
+
+    CRITICAL_SECTION m_cs;  //guards what follows
+    std::deque<Entry> m_queue;
+    bool m_bScheduled;  //on the ready list, or held by a worker
+    bool m_bClosing;
+    bool m_bWaiting;    //the caller waits for m_hSpace
+    HRESULT m_hr;
+
+    HANDLE m_hSpace;  //auto-reset: the worker took a frame, or failed
+    HANDLE m_hDone;   //manual-reset: the worker has closed the session
+
+private:
+
+    void Close();
+
+};
+
+
+MuxSession::MuxSession(ULONG memory_limit) :
+    m_memory_limit(memory_limit),
+    m_pVideo(0),
+    m_pAudio(0),
+    m_pStream(0),
+    m_pool(kPoolSize),
+    m_bScheduled(false),
+    m_bClosing(false),
+    m_bWaiting(false),
+    m_hr(S_OK)
+{
+    InitializeCriticalSection(&m_cs);
+
+    m_hSpace = CreateEvent(0, FALSE, FALSE, 0);
+    m_hDone = CreateEvent(0, TRUE, FALSE, 0);
+}
+
+
+MuxSession::~MuxSession()
+{
+    assert(m_queue.empty());
+    assert(m_ctx.m_file.GetStream() == 0);
+
+    delete m_pVideo;
+    delete m_pAudio;
+
+    if (m_pStream)
+        m_pStream->Release();
+
+    if (m_hSpace)
+        CloseHandle(m_hSpace);
+
+    if (m_hDone)
+        CloseHandle(m_hDone);
+
+    DeleteCriticalSection(&m_cs);
+}
+
+
+HRESULT MuxSession::Open(
+    const MuxSessionParams& params,
+    const MuxServiceOptions& options,
+    EbmlIO::File::Writer* pWriter)
+{
+    using namespace WebmMuxLib;
+
+    if ((m_hSpace == 0) || (m_hDone == 0))
+        return E_OUTOFMEMORY;
+
+    if ((params.video == 0) || !IsVideoType(*params.video))
+        return VFW_E_INVALID_MEDIA_TYPE;
+
+    if (params.audio && !StreamAudioVorbis::QueryAccept(*params.audio))
+        return VFW_E_INVALID_MEDIA_TYPE;
+
+    m_pVideo = new (std::nothrow) StreamVideoVPx(m_ctx, *params.video);
+
+    if (m_pVideo == 0)
+        return E_OUTOFMEMORY;
+
+    if (params.audio)
+    {
+        m_pAudio = StreamAudioVorbis::CreateStream(m_ctx, *params.audio);
+
+        if (m_pAudio == 0)
+            return E_OUTOFMEMORY;
+    }
+
+    if (params.pStream)
+    {
+        m_pStream = params.pStream;
+        m_pStream->AddRef();
+    }
+    else
+    {
+        const DWORD mode =
+            STGM_CREATE | STGM_READWRITE | STGM_SHARE_DENY_WRITE;
+
+        const HRESULT hr = SHCreateStreamOnFileEx(
+                            params.filename,
+                            mode,
+                            FILE_ATTRIBUTE_NORMAL,
+                            TRUE,  //create
+                            0,
+                            &m_pStream);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (params.writing_app)
+        m_ctx.m_writing_app = params.writing_app;
+
+    EbmlIO::File& f = m_ctx.m_file;
+
+    HRESULT hr = f.SetBufferSize(options.buffer_size);
+
+    if (FAILED(hr))
+        return hr;
+
+    f.SetWriteAheadLimit(options.write_ahead_limit);
+    f.SetWriter(pWriter);
+
+    m_ctx.SetVideoStream(m_pVideo);
+
+    if (m_pAudio)
+        m_ctx.AddAudioStream(m_pAudio);
+
+    m_ctx.Open(m_pStream);  //writes the headers
+
+    return S_OK;
+}
+
+
+bool MuxSession::Run()
+{
+    for (int i = 0; i < kBatchFrames; ++i)
+    {
+        EnterCriticalSection(&m_cs);
+
+        if (m_queue.empty())
+        {
+            const bool bClose = m_bClosing;
+
+            if (!bClose)
+                m_bScheduled = false;
+
+            LeaveCriticalSection(&m_cs);
+
+            if (bClose)
+                Close();
+
+            return false;
+        }
+
+        const Entry e = m_queue.front();
+        m_queue.pop_front();
+
+        const bool bFailed = FAILED(m_hr);
+
+        LeaveCriticalSection(&m_cs);
+
+        HRESULT hr = S_OK;
+
+        if (!bFailed)  //after a failure, what's queued is discarded
+        {
+            WebmMuxLib::Stream* const pStream =
+                (e.track == kMuxTrackVideo) ?
+                    static_cast<WebmMuxLib::Stream*>(m_pVideo) :
+                    static_cast<WebmMuxLib::Stream*>(m_pAudio);
+
+            hr = pStream->Receive(e.pPacket);
+        }
+
+        e.pPacket->Release();  //the muxer keeps a reference to video
+
+        EnterCriticalSection(&m_cs);
+
+        if (FAILED(hr) && SUCCEEDED(m_hr))
+            m_hr = hr;
+
+        const bool bSignal = m_bWaiting;
+        m_bWaiting = false;
+
+        LeaveCriticalSection(&m_cs);
+
+        if (bSignal)
+        {
+            const BOOL b = SetEvent(m_hSpace);
+            assert(b);
+            b;
+        }
+    }
+
+    return true;  //the others take their turn first
+}
+
+
+//Called by the worker that found the queue empty once the caller had
+//asked for the session to close.  Once m_hDone is set, CloseSession may
+//free the session.
+
+void MuxSession::Close()
+{
+    m_ctx.Close();  //writes the cues, and waits for the writer
+
+    m_ctx.SetVideoStream(0);
+
+    if (m_pAudio)
+        m_ctx.RemoveAudioStream(m_pAudio);
+
+    const BOOL b = SetEvent(m_hDone);
+    assert(b);
+    b;
+}
+
+
+MuxService::MuxService() :
+    m_cSessions(0),
+    m_pWriter(0)
+{
+    InitializeCriticalSection(&m_cs);
+
+    m_hReady = CreateSemaphore(0, 0, LONG_MAX, 0);
+    assert(m_hReady);
+}
+
+
+MuxService::~MuxService()
+{
+    Stop();
+
+    CloseHandle(m_hReady);
+    DeleteCriticalSection(&m_cs);
+}
+
+
+HRESULT MuxService::Start(const MuxServiceOptions& options)
+{
+    if (m_pWriter)
+        return E_FAIL;  //already started
+
+    if (m_hReady == 0)
+        return E_OUTOFMEMORY;
+
+    m_options = options;
+
+    if (m_options.worker_count <= 0)
+        m_options.worker_count = webmdshow::GetLogicalProcessorCount();
+
+    if (m_options.writer_count <= 0)
+        m_options.writer_count = kDefaultWriterCount;
+
+    if (m_options.buffer_size == 0)
+        m_options.buffer_size = kDefaultBufferSize;
+
+    if (m_options.write_ahead_limit == 0)
+        m_options.write_ahead_limit = kDefaultWriteAheadLimit;
+
+    m_pWriter = new (std::nothrow) Writer;
+
+    if (m_pWriter == 0)
+        return E_OUTOFMEMORY;
+
+    HRESULT hr = m_pWriter->Start(m_options.writer_count);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = StartThreads(
+                m_options.worker_count,
+                &MuxService::WorkerThreadProc,
+                this,
+                m_workers);
+    }
+
+    if (FAILED(hr))
+        Stop();
+
+    return hr;
+}
+
+
+void MuxService::Stop()
+{
+    assert(m_cSessions == 0);
+
+    StopThreads(m_workers, m_hReady);
+
+    if (m_pWriter)
+    {
+        m_pWriter->Stop();
+
+        delete m_pWriter;
+        m_pWriter = 0;
+    }
+}
+
+
+HRESULT MuxService::OpenSession(
+    const MuxSessionParams& params,
+    MuxSession** ppSession)
+{
+    if (ppSession == 0)
+        return E_POINTER;
+
+    MuxSession*& pSession = *ppSession;
+    pSession = 0;
+
+    if (m_pWriter == 0)
+        return E_FAIL;  //not started
+
+    if ((params.pStream == 0) && (params.filename == 0))
+        return E_INVALIDARG;
+
+    const ULONG limit = params.memory_limit ? params.memory_limit
+                                            : ULONG(kDefaultMemoryLimit);
+
+    MuxSession* const p = new (std::nothrow) MuxSession(limit);
+
+    if (p == 0)
+        return E_OUTOFMEMORY;
+
+    const HRESULT hr = p->Open(params, m_options, m_pWriter);
+
+    if (FAILED(hr))
+    {
+        delete p;
+
+        if (params.pStream == 0)
+            DeleteFile(params.filename);
+
+        return hr;
+    }
+
+    EnterCriticalSection(&m_cs);
+    ++m_cSessions;
+    LeaveCriticalSection(&m_cs);
+
+    pSession = p;
+    return S_OK;
+}
+
+
+HRESULT MuxService::WriteFrame(
+    MuxSession* pSession,
+    MuxTrack track,
+    const void* buf,
+    long len,
+    LONGLONG start,
+    LONGLONG stop,
+    bool key)
+{
+    if ((pSession == 0) || (buf == 0) || (len <= 0) || (start < 0))
+        return E_INVALIDARG;
+
+    MuxSession& s = *pSession;
+
+    if (track == kMuxTrackAudio)
+    {
+        if (s.m_pAudio == 0)
+            return E_INVALIDARG;
+    }
+    else if (track != kMuxTrackVideo)
+        return E_INVALIDARG;
+
+    EnterCriticalSection(&s.m_cs);
+
+    assert(!s.m_bClosing);
+
+    //Only while a worker has frames to take does waiting free anything.
+
+    while (SUCCEEDED(s.m_hr) &&
+           !s.m_queue.empty() &&
+           ((ULONG(s.m_pool.GetHeldBytes()) + ULONG(len)) > s.m_memory_limit))
+    {
+        s.m_bWaiting = true;
+
+        LeaveCriticalSection(&s.m_cs);
+
+        const DWORD dw = WaitForSingleObject(s.m_hSpace, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        EnterCriticalSection(&s.m_cs);
+    }
+
+    const HRESULT hr = s.m_hr;
+
+    LeaveCriticalSection(&s.m_cs);
+
+    if (FAILED(hr))
+        return hr;
+
+    Packet* const pPacket = s.m_pool.Get(len);
+
+    if (pPacket == 0)
+        return E_OUTOFMEMORY;
+
+    memcpy(&pPacket->m_buf[0], buf, len);
+
+    pPacket->m_start = start;
+    pPacket->m_stop = stop;
+    pPacket->m_key = key;
+
+    const MuxSession::Entry e = { pPacket, track };
+
+    EnterCriticalSection(&s.m_cs);
+
+    s.m_queue.push_back(e);
+
+    const bool bSchedule = !s.m_bScheduled;
+    s.m_bScheduled = true;
+
+    LeaveCriticalSection(&s.m_cs);
+
+    if (bSchedule)
+        Schedule(&s);
+
+    return S_OK;
+}
+
+
+HRESULT MuxService::CloseSession(MuxSession* pSession)
+{
+    if (pSession == 0)
+        return E_INVALIDARG;
+
+    MuxSession& s = *pSession;
+
+    EnterCriticalSection(&s.m_cs);
+
+    assert(!s.m_bClosing);
+    s.m_bClosing = true;
+
+    const bool bSchedule = !s.m_bScheduled;
+    s.m_bScheduled = true;
+
+    LeaveCriticalSection(&s.m_cs);
+
+    if (bSchedule)
+        Schedule(&s);
+
+    const DWORD dw = WaitForSingleObject(s.m_hDone, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    const HRESULT hr = s.m_hr;
+
+    delete pSession;
+
+    EnterCriticalSection(&m_cs);
+
+    assert(m_cSessions > 0);
+    --m_cSessions;
+
+    LeaveCriticalSection(&m_cs);
+
+    return hr;
+}
+
+
+ULONG MuxService::GetSessionCount() const
+{
+    EnterCriticalSection(&m_cs);
+    const ULONG n = m_cSessions;
+    LeaveCriticalSection(&m_cs);
+
+    return n;
+}
+
+
+void MuxService::Schedule(MuxSession* pSession)
+{
+    assert(pSession);
+
+    EnterCriticalSection(&m_cs);
+    m_ready.push_back(pSession);
+    LeaveCriticalSection(&m_cs);
+
+    const BOOL b = ReleaseSemaphore(m_hReady, 1, 0);
+    assert(b);
+    b;
+}
+
+
+unsigned MuxService::WorkerThreadProc(void* pv)
+{
+    MuxService* const pService = static_cast<MuxService*>(pv);
+    assert(pService);
+
+    pService->WorkerMain();
+    return 0;
+}
+
+
+void MuxService::WorkerMain()
+{
+    for (;;)
+    {
+        const DWORD dw = WaitForSingleObject(m_hReady, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        EnterCriticalSection(&m_cs);
+
+        if (m_ready.empty())  //stopped
+        {
+            LeaveCriticalSection(&m_cs);
+            return;
+        }
+
+        MuxSession* const pSession = m_ready.front();
+        m_ready.pop_front();
+
+        LeaveCriticalSection(&m_cs);
+
+        if (pSession->Run())
+            Schedule(pSession);
+    }
+}
+
+
+}  //end namespace WebmTranscode
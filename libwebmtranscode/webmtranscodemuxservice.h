@@ -0,0 +1,137 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include <deque>
+#include <vector>
+
+//Muxes many WebM files at once, in one process, from compressed frames
+//that the caller already has: an ingest server's streams, say, each of
+//which would otherwise take a makewebm process, with a graph and threads
+//of its own.  Each session is a WebmMuxLib::Context.  The frames of every
+//session are serialized by one pool of worker threads, and the buffers
+//the muxers fill are written to their streams by another pool, so the
+//threads a process needs don't grow with the number of sessions.
+
+namespace WebmTranscode
+{
+
+class MuxSession;
+
+
+//The settings shared by the sessions of a service.  A value of 0 takes
+//the default.
+
+struct MuxServiceOptions
+{
+    MuxServiceOptions();
+
+    int worker_count;         //threads serializing, by default one a core
+    int writer_count;         //threads writing to the streams (4)
+    ULONG buffer_size;        //of each session's muxer (256 KB)
+    ULONG write_ahead_limit;  //bytes a session may queue to write (1 MB)
+
+};
+
+
+//The output and tracks of a session.  The media types are those the
+//muxer filter's inpins accept: VP8 or VP9 video, and Vorbis audio, which
+//may be omitted.
+
+struct MuxSessionParams
+{
+    MuxSessionParams();
+
+    const wchar_t* filename;  //created (or replaced), unless pStream is set
+    IStream* pStream;         //the output, instead of a file
+    const AM_MEDIA_TYPE* video;
+    const AM_MEDIA_TYPE* audio;
+    const wchar_t* writing_app;
+
+    //Most bytes of frames the session may hold, queued for the workers or
+    //waiting in the muxer for their cluster to be written (8 MB if 0).
+    ULONG memory_limit;
+
+};
+
+
+enum MuxTrack
+{
+    kMuxTrackVideo,
+    kMuxTrackAudio
+};
+
+
+class MuxService
+{
+    MuxService(const MuxService&);
+    MuxService& operator=(const MuxService&);
+
+public:
+
+    MuxService();
+
+    //Every session must have been closed.
+    ~MuxService();
+
+    HRESULT Start(const MuxServiceOptions&);
+    void Stop();
+
+    //Creates the output and writes its headers.  The session is closed by
+    //CloseSession, which also frees it.
+    HRESULT OpenSession(const MuxSessionParams&, MuxSession**);
+
+    //Copies a frame, and queues it for a worker.  The frames of a session
+    //must come from one thread at a time, each track's in time order; the
+    //muxer interleaves the tracks.  Times are in reftime units, and stop
+    //may be -1.  If the session holds more than its memory limit, this
+    //waits for the workers to catch up; frames held back by the muxer to
+    //interleave them count against the limit, but are never waited for,
+    //so a track that stalls can't block the other.  Returns the error of
+    //the session, once it has one.
+    HRESULT WriteFrame(
+        MuxSession*,
+        MuxTrack,
+        const void* buf,
+        long len,
+        LONGLONG start,
+        LONGLONG stop,
+        bool key);
+
+    //Writes the frames still queued, finishes the file (its cues, and its
+    //duration), and frees the session.  Returns the first error of the
+    //session.
+    HRESULT CloseSession(MuxSession*);
+
+    ULONG GetSessionCount() const;
+
+private:
+
+    class Writer;
+
+    MuxServiceOptions m_options;
+
+    mutable CRITICAL_SECTION m_cs;
+    HANDLE m_hReady;  //semaphore: a session is ready for a worker
+
+    std::deque<MuxSession*> m_ready;
+    std::vector<HANDLE> m_workers;
+    ULONG m_cSessions;
+
+    Writer* m_pWriter;
+
+    void Schedule(MuxSession*);
+
+    static unsigned __stdcall WorkerThreadProc(void*);
+    void WorkerMain();
+
+};
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,278 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <vfwmsgs.h>
+#include "webmtranscodepacket.h"
+#include <cassert>
+#include <new>
+
+namespace WebmTranscode
+{
+
+Packet::Packet(PacketPool* pPool) :
+    m_len(0),
+    m_start(-1),
+    m_stop(-1),
+    m_key(false),
+    m_pPool(pPool),
+    m_cRef(0)
+{
+    assert(m_pPool);
+}
+
+
+Packet::~Packet()
+{
+    assert(m_cRef == 0);
+}
+
+
+HRESULT Packet::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if ((iid == __uuidof(IUnknown)) || (iid == __uuidof(IMediaSample)))
+        pUnk = static_cast<IMediaSample*>(this);
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG Packet::AddRef()
+{
+    return InterlockedIncrement(&m_cRef);
+}
+
+
+ULONG Packet::Release()
+{
+    const LONG n = InterlockedDecrement(&m_cRef);
+    assert(n >= 0);
+
+    if (n == 0)
+        m_pPool->Put(this);
+
+    return n;
+}
+
+
+HRESULT Packet::GetPointer(BYTE** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = m_buf.empty() ? 0 : &m_buf[0];
+    return S_OK;
+}
+
+
+long Packet::GetSize()
+{
+    return static_cast<long>(m_buf.size());
+}
+
+
+HRESULT Packet::GetTime(REFERENCE_TIME* pStart, REFERENCE_TIME* pStop)
+{
+    if ((pStart == 0) || (pStop == 0))
+        return E_POINTER;
+
+    if (m_start < 0)
+        return VFW_E_SAMPLE_TIME_NOT_SET;
+
+    *pStart = m_start;
+
+    if (m_stop < m_start)
+    {
+        *pStop = m_start + 1;  //as the DirectShow base classes do
+        return VFW_S_NO_STOP_TIME;
+    }
+
+    *pStop = m_stop;
+    return S_OK;
+}
+
+
+HRESULT Packet::SetTime(REFERENCE_TIME* pStart, REFERENCE_TIME* pStop)
+{
+    m_start = pStart ? *pStart : -1;
+    m_stop = (pStart && pStop) ? *pStop : -1;
+
+    return S_OK;
+}
+
+
+HRESULT Packet::IsSyncPoint()
+{
+    return m_key ? S_OK : S_FALSE;
+}
+
+
+HRESULT Packet::SetSyncPoint(BOOL b)
+{
+    m_key = b ? true : false;
+    return S_OK;
+}
+
+
+HRESULT Packet::IsPreroll()
+{
+    return S_FALSE;
+}
+
+
+HRESULT Packet::SetPreroll(BOOL b)
+{
+    return b ? E_NOTIMPL : S_OK;
+}
+
+
+long Packet::GetActualDataLength()
+{
+    return m_len;
+}
+
+
+HRESULT Packet::SetActualDataLength(long len)
+{
+    if ((len < 0) || (size_t(len) > m_buf.size()))
+        return VFW_E_BUFFER_OVERFLOW;
+
+    m_len = len;
+    return S_OK;
+}
+
+
+HRESULT Packet::GetMediaType(AM_MEDIA_TYPE** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+    return S_FALSE;  //same as the previous sample
+}
+
+
+HRESULT Packet::SetMediaType(AM_MEDIA_TYPE*)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT Packet::IsDiscontinuity()
+{
+    return S_FALSE;
+}
+
+
+HRESULT Packet::SetDiscontinuity(BOOL b)
+{
+    return b ? E_NOTIMPL : S_OK;
+}
+
+
+HRESULT Packet::GetMediaTime(LONGLONG*, LONGLONG*)
+{
+    return VFW_E_MEDIA_TIME_NOT_SET;
+}
+
+
+HRESULT Packet::SetMediaTime(LONGLONG*, LONGLONG*)
+{
+    return E_NOTIMPL;
+}
+
+
+PacketPool::PacketPool(size_t capacity) :
+    m_free(capacity),
+    m_cAlloc(0),
+    m_cbHeld(0)
+{
+}
+
+
+PacketPool::~PacketPool()
+{
+    Packet* pPacket;
+
+    while (m_free.TryPop(&pPacket))
+        delete pPacket;
+}
+
+
+Packet* PacketPool::Get(long len)
+{
+    assert(len >= 0);
+
+    Packet* pPacket;
+
+    if (!m_free.TryPop(&pPacket))
+    {
+        pPacket = new (std::nothrow) Packet(this);
+
+        if (pPacket == 0)
+            return 0;
+
+        ++m_cAlloc;
+    }
+
+    assert(pPacket->m_cRef == 0);
+
+    //A keyframe can be much larger than the frames before it; the buffer
+    //only grows, so a warm pool stops reallocating.
+
+    if (pPacket->m_buf.size() < size_t(len))
+        pPacket->m_buf.resize(len);
+
+    pPacket->m_len = len;
+    pPacket->m_start = -1;
+    pPacket->m_stop = -1;
+    pPacket->m_key = false;
+    pPacket->m_cRef = 1;
+
+    m_cbHeld += static_cast<LONG>(pPacket->m_buf.size());
+
+    return pPacket;
+}
+
+
+void PacketPool::Put(Packet* pPacket)
+{
+    assert(pPacket);
+    assert(pPacket->m_pPool == this);
+
+    m_cbHeld -= static_cast<LONG>(pPacket->m_buf.size());
+
+    if (!m_free.TryPush(pPacket))
+        delete pPacket;
+}
+
+
+LONG PacketPool::GetAllocCount() const
+{
+    return m_cAlloc;
+}
+
+
+LONG PacketPool::GetHeldBytes() const
+{
+    return m_cbHeld;
+}
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,120 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include "spscqueue.h"
+#include <atomic>
+#include <vector>
+
+namespace WebmTranscode
+{
+
+class PacketPool;
+
+//A compressed frame passed from one stage to the next: the payload of a
+//block, or a packet from the encoder, with its time.  It is also the
+//IMediaSample handed to the muxer, which keeps a reference to a video
+//frame until its cluster is written, so the encoded frame reaches the
+//file without being copied again.  The last Release returns the packet
+//to the pool it came from.
+
+class Packet : public IMediaSample
+{
+    Packet(const Packet&);
+    Packet& operator=(const Packet&);
+
+public:
+
+    std::vector<BYTE> m_buf;
+    long m_len;
+    LONGLONG m_start;  //reftime
+    LONGLONG m_stop;   //reftime, or -1 if the packet has no stop time
+    bool m_key;
+
+    //IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IMediaSample
+
+    HRESULT STDMETHODCALLTYPE GetPointer(BYTE**);
+    long STDMETHODCALLTYPE GetSize();
+    HRESULT STDMETHODCALLTYPE GetTime(REFERENCE_TIME*, REFERENCE_TIME*);
+    HRESULT STDMETHODCALLTYPE SetTime(REFERENCE_TIME*, REFERENCE_TIME*);
+    HRESULT STDMETHODCALLTYPE IsSyncPoint();
+    HRESULT STDMETHODCALLTYPE SetSyncPoint(BOOL);
+    HRESULT STDMETHODCALLTYPE IsPreroll();
+    HRESULT STDMETHODCALLTYPE SetPreroll(BOOL);
+    long STDMETHODCALLTYPE GetActualDataLength();
+    HRESULT STDMETHODCALLTYPE SetActualDataLength(long);
+    HRESULT STDMETHODCALLTYPE GetMediaType(AM_MEDIA_TYPE**);
+    HRESULT STDMETHODCALLTYPE SetMediaType(AM_MEDIA_TYPE*);
+    HRESULT STDMETHODCALLTYPE IsDiscontinuity();
+    HRESULT STDMETHODCALLTYPE SetDiscontinuity(BOOL);
+    HRESULT STDMETHODCALLTYPE GetMediaTime(LONGLONG*, LONGLONG*);
+    HRESULT STDMETHODCALLTYPE SetMediaTime(LONGLONG*, LONGLONG*);
+
+private:
+
+    friend class PacketPool;
+
+    explicit Packet(PacketPool*);
+    virtual ~Packet();
+
+    PacketPool* const m_pPool;
+    LONG m_cRef;
+
+};
+
+
+//The free packets of one producer.  Get is called only by the thread
+//that fills the packets, and the last Release of each only by the one
+//thread that consumes them, so the free list is an SpscQueue.  Packets
+//beyond its capacity are deleted when released, and new ones are made
+//when it is empty, so neither side ever waits for the other.
+
+class PacketPool
+{
+    PacketPool(const PacketPool&);
+    PacketPool& operator=(const PacketPool&);
+
+public:
+
+    explicit PacketPool(size_t capacity);
+
+    //Every packet must have been released.
+    ~PacketPool();
+
+    //Returns a packet with a reference count of 1, and a buffer of at
+    //least len bytes, or 0 if there is no memory for one.
+    Packet* Get(long len);
+
+    //The number of packets made, which stops growing once the pool has
+    //warmed up.
+    LONG GetAllocCount() const;
+
+    //The size of the buffers of the packets that have been got and not
+    //yet released.  Either side may call it.
+    LONG GetHeldBytes() const;
+
+private:
+
+    friend class Packet;
+    void Put(Packet*);
+
+    webmdshow::SpscQueue<Packet*> m_free;
+    LONG m_cAlloc;
+    std::atomic<LONG> m_cbHeld;
+
+};
+
+
+}  //end namespace WebmTranscode
@@ -0,0 +1,200 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <amvideo.h>
+#include <uuids.h>
+#include "webmtranscodevpx.h"
+#include "webmtranscode.h"
+#include "cpuutil.h"
+#include "webmtypes.h"
+#include "vpx/vp8cx.h"
+#include <cassert>
+#include <cstring>
+
+namespace WebmTranscode
+{
+
+void CopyI420(const vpx_image_t* img, Picture& pic)
+{
+    const int w = img->d_w;
+    const int h = img->d_h;
+
+    const int stride = (w + 1) & ~1;
+    const int uv_w = (w + 1) / 2;
+    const int uv_h = (h + 1) / 2;
+    const int uv_stride = stride / 2;
+
+    const size_t size = stride * h + 2 * uv_stride * uv_h;
+
+    if (pic.buf.size() < size)
+        pic.buf.resize(size);
+
+    pic.w = w;
+    pic.h = h;
+
+    BYTE* p = &pic.buf[0];
+
+    const BYTE* src = img->planes[VPX_PLANE_Y];
+
+    for (int y = 0; y < h; ++y)
+    {
+        memcpy(p, src, w);
+        src += img->stride[VPX_PLANE_Y];
+        p += stride;
+    }
+
+    const int planes[2] = { VPX_PLANE_U, VPX_PLANE_V };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        src = img->planes[planes[i]];
+
+        for (int y = 0; y < uv_h; ++y)
+        {
+            memcpy(p, src, uv_w);
+            src += img->stride[planes[i]];
+            p += uv_stride;
+        }
+    }
+}
+
+
+void WrapI420(Picture& pic, vpx_image_t& img)
+{
+    vpx_image_t* const result =
+        vpx_img_wrap(&img, VPX_IMG_FMT_I420, pic.w, pic.h, 2, &pic.buf[0]);
+
+    assert(result == &img);
+    result;
+
+    const int stride = (pic.w + 1) & ~1;
+    const int uv_stride = stride / 2;
+    const int uv_h = (pic.h + 1) / 2;
+
+    BYTE* const y = &pic.buf[0];
+    BYTE* const u = y + stride * pic.h;
+    BYTE* const v = u + uv_stride * uv_h;
+
+    img.planes[VPX_PLANE_Y] = y;
+    img.planes[VPX_PLANE_U] = u;
+    img.planes[VPX_PLANE_V] = v;
+
+    img.stride[VPX_PLANE_Y] = stride;
+    img.stride[VPX_PLANE_U] = uv_stride;
+    img.stride[VPX_PLANE_V] = uv_stride;
+}
+
+
+HRESULT InitEncoder(
+    const Options& o,
+    bool vp9,
+    int w,
+    int h,
+    vpx_codec_ctx_t* ctx)
+{
+    vpx_codec_iface_t* const codec =
+        vp9 ? &vpx_codec_vp9_cx_algo : &vpx_codec_vp8_cx_algo;
+
+    vpx_codec_enc_cfg_t cfg;
+
+    if (vpx_codec_enc_config_default(codec, &cfg, 0) != VPX_CODEC_OK)
+        return E_FAIL;
+
+    cfg.g_w = w;
+    cfg.g_h = h;
+    cfg.g_timebase.num = 1;
+    cfg.g_timebase.den = 1000;  //ms, as the encoder filter has
+
+    cfg.g_threads = webmdshow::GetVpxDecoderThreadCount(
+                        (o.thread_count > 0) ? o.thread_count : 0,
+                        vp9,
+                        w);
+
+    if (o.target_bitrate >= 0)
+        cfg.rc_target_bitrate = o.target_bitrate;
+
+    if (o.min_quantizer >= 0)
+        cfg.rc_min_quantizer = o.min_quantizer;
+
+    if (o.max_quantizer >= 0)
+        cfg.rc_max_quantizer = o.max_quantizer;
+
+    if (o.end_usage >= 0)
+        cfg.rc_end_usage = (o.end_usage == 1) ? VPX_CBR : VPX_VBR;
+
+    if (o.keyframe_max_interval >= 0)
+        cfg.kf_max_dist = o.keyframe_max_interval;
+
+    if (vpx_codec_enc_init(ctx, codec, &cfg, 0) != VPX_CODEC_OK)
+        return E_FAIL;
+
+    if (o.cpu_used >= -16)
+    {
+        const vpx_codec_err_t err =
+            vpx_codec_control(ctx, VP8E_SET_CPUUSED, o.cpu_used);
+
+        if (err != VPX_CODEC_OK)
+        {
+            vpx_codec_destroy(ctx);
+            return E_INVALIDARG;
+        }
+    }
+
+    return S_OK;
+}
+
+
+unsigned long GetDeadline(const Options& o)
+{
+    return (o.deadline >= 0) ? o.deadline : VPX_DL_GOOD_QUALITY;
+}
+
+
+HRESULT InitVideoMediaType(
+    const mkvparser::VideoTrack* pTrack,
+    bool vp9,
+    std::vector<BYTE>& format,
+    AM_MEDIA_TYPE& mt)
+{
+    assert(pTrack);
+
+    format.assign(sizeof(VIDEOINFOHEADER), 0);
+
+    VIDEOINFOHEADER& vih = reinterpret_cast<VIDEOINFOHEADER&>(format[0]);
+
+    const double rate = pTrack->GetFrameRate();
+
+    if (rate > 0)
+        vih.AvgTimePerFrame = static_cast<REFERENCE_TIME>(10000000 / rate);
+
+    BITMAPINFOHEADER& bmih = vih.bmiHeader;
+
+    bmih.biSize = sizeof bmih;
+    bmih.biWidth = static_cast<LONG>(pTrack->GetWidth());
+    bmih.biHeight = static_cast<LONG>(pTrack->GetHeight());
+    bmih.biPlanes = 1;
+
+    const GUID& subtype = vp9 ?
+                            WebmTypes::MEDIASUBTYPE_VP90 :
+                            WebmTypes::MEDIASUBTYPE_VP80;
+
+    bmih.biCompression = subtype.Data1;
+
+    memset(&mt, 0, sizeof mt);
+
+    mt.majortype = MEDIATYPE_Video;
+    mt.subtype = subtype;
+    mt.formattype = FORMAT_VideoInfo;
+    mt.cbFormat = static_cast<ULONG>(format.size());
+    mt.pbFormat = &format[0];
+
+    return S_OK;
+}
+
+}  //end namespace WebmTranscode
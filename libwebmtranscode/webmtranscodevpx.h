@@ -0,0 +1,65 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include "mkvparser.hpp"
+#include "vpx/vpx_encoder.h"
+#include "vpx/vpx_image.h"
+#include <vector>
+
+//The pieces of the transcode that Cut shares with it: the pictures passed
+//from the decoder to the encoder, the encoder's configuration, and the
+//media type of the muxer's video stream.
+
+namespace WebmTranscode
+{
+
+struct Options;
+
+
+//A decoded frame, I420 with the even stride the decoder gives its planar
+//output samples.
+
+struct Picture
+{
+    std::vector<BYTE> buf;
+    int w;
+    int h;
+    LONGLONG start;  //reftime
+};
+
+
+void CopyI420(const vpx_image_t*, Picture&);
+
+//Points img at the planes of pic.  vpx_img_wrap would round odd
+//dimensions up, and put the chroma planes after a padded luma plane.
+void WrapI420(Picture& pic, vpx_image_t& img);
+
+
+//Opens a VP8 (or VP9) encoder for pictures of w x h, with the settings
+//of the options, and a timebase of milliseconds.
+HRESULT InitEncoder(
+    const Options&,
+    bool vp9,
+    int w,
+    int h,
+    vpx_codec_ctx_t*);
+
+unsigned long GetDeadline(const Options&);
+
+
+//The VIDEOINFOHEADER of a muxer stream for the VP8 (or VP9) frames of a
+//track of the track's size and rate.  mt points into format.
+HRESULT InitVideoMediaType(
+    const mkvparser::VideoTrack*,
+    bool vp9,
+    std::vector<BYTE>& format,
+    AM_MEDIA_TYPE& mt);
+
+}  //end namespace WebmTranscode
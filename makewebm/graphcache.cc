@@ -0,0 +1,203 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <objbase.h>
+#include "graphcache.h"
+#include <cassert>
+#include <fstream>
+
+enum { kGuidLength = 38 };  //"{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}"
+
+namespace
+{
+
+class Lock
+{
+    Lock(const Lock&);
+    Lock& operator=(const Lock&);
+
+public:
+
+    explicit Lock(CRITICAL_SECTION& cs) : m_cs(cs)
+    {
+        EnterCriticalSection(&m_cs);
+    }
+
+    ~Lock()
+    {
+        LeaveCriticalSection(&m_cs);
+    }
+
+private:
+
+    CRITICAL_SECTION& m_cs;
+
+};
+
+}  //end unnamed namespace
+
+
+GraphCache::GraphCache() : m_bDirty(false)
+{
+    InitializeCriticalSection(&m_cs);
+}
+
+
+GraphCache::~GraphCache()
+{
+    DeleteCriticalSection(&m_cs);
+}
+
+
+HRESULT GraphCache::Load(const wchar_t* filename)
+{
+    if ((filename == 0) || (*filename == L'\0'))
+        return E_INVALIDARG;
+
+    m_map.clear();
+    m_filename = filename;
+    m_bDirty = false;
+
+    if (GetFileAttributes(filename) == INVALID_FILE_ATTRIBUTES)
+    {
+        const DWORD e = GetLastError();
+
+        if ((e == ERROR_FILE_NOT_FOUND) || (e == ERROR_PATH_NOT_FOUND))
+            return S_FALSE;  //empty cache, created by Save
+
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    std::wifstream is(filename);
+
+    if (!is)
+        return E_FAIL;
+
+    std::wstring line;
+
+    while (std::getline(is, line))
+    {
+        //A line that doesn't parse (a hand edit, say) is dropped, and its
+        //link found by enumeration again.
+
+        if (line.length() <= kGuidLength + 1)
+            continue;
+
+        if (line[kGuidLength] != L' ')
+            continue;
+
+        const std::wstring str = line.substr(0, kGuidLength);
+
+        CLSID clsid;
+
+        const HRESULT hr = CLSIDFromString(str.c_str(), &clsid);
+
+        if (FAILED(hr))
+            continue;
+
+        m_map[line.substr(kGuidLength + 1)] = clsid;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT GraphCache::Save()
+{
+    if (m_filename.empty())
+        return S_FALSE;
+
+    Lock lock(m_cs);
+
+    if (!m_bDirty)
+        return S_FALSE;
+
+    //Another makewebm might be reading the cache, so the new one is
+    //written to a file of its own, which then replaces the old.
+
+    const std::wstring tmp = m_filename + L".tmp";
+
+    {
+        std::wofstream os(tmp.c_str(), std::ios_base::trunc);
+
+        if (!os)
+            return E_FAIL;
+
+        typedef map_t::const_iterator iter_t;
+
+        for (iter_t i = m_map.begin(); i != m_map.end(); ++i)
+        {
+            wchar_t str[kGuidLength + 1];
+
+            const int n = StringFromGUID2(i->second, str, kGuidLength + 1);
+            n;
+            assert(n == kGuidLength + 1);
+
+            os << str << L' ' << i->first << L'\n';
+        }
+
+        if (!os.flush())
+            return E_FAIL;
+    }
+
+    const DWORD dwFlags = MOVEFILE_REPLACE_EXISTING;
+
+    if (!MoveFileEx(tmp.c_str(), m_filename.c_str(), dwFlags))
+    {
+        const DWORD e = GetLastError();
+        DeleteFile(tmp.c_str());
+
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_bDirty = false;
+    return S_OK;
+}
+
+
+bool GraphCache::IsLoaded() const
+{
+    return !m_filename.empty();
+}
+
+
+bool GraphCache::Find(const std::wstring& key, CLSID& clsid) const
+{
+    Lock lock(m_cs);
+
+    const map_t::const_iterator i = m_map.find(key);
+
+    if (i == m_map.end())
+        return false;
+
+    clsid = i->second;
+    return true;
+}
+
+
+void GraphCache::Insert(const std::wstring& key, const CLSID& clsid)
+{
+    Lock lock(m_cs);
+
+    const map_t::iterator i = m_map.find(key);
+
+    if ((i != m_map.end()) && (i->second == clsid))
+        return;
+
+    m_map[key] = clsid;
+    m_bDirty = true;
+}
+
+
+void GraphCache::Remove(const std::wstring& key)
+{
+    Lock lock(m_cs);
+
+    if (m_map.erase(key))
+        m_bDirty = true;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <map>
+#include <string>
+
+//The filters that App found by enumerating the filter mapper, each keyed
+//by the link of the graph it was found for: the demuxer of a kind of
+//source, the decoder of an audio subtype, the Vorbis encoder.  A job
+//with the same kind of input creates them from their CLSIDs instead of
+//enumerating again.  The file is text, a line for each link: the CLSID,
+//then a space, then the key.  The jobs of a batch share one cache, so
+//lookups may come from many threads; Load and Save may not.
+
+class GraphCache
+{
+    GraphCache(const GraphCache&);
+    GraphCache& operator=(const GraphCache&);
+
+public:
+
+    GraphCache();
+    ~GraphCache();
+
+    //A file that doesn't exist (yet) is an empty cache.
+    HRESULT Load(const wchar_t*);
+
+    //Writes the cache back to the file it was loaded from, if it changed.
+    //Without a file, the cache lasts as long as the process.
+    HRESULT Save();
+
+    bool IsLoaded() const;
+
+    bool Find(const std::wstring& key, CLSID&) const;
+    void Insert(const std::wstring& key, const CLSID&);
+    void Remove(const std::wstring& key);
+
+private:
+
+    mutable CRITICAL_SECTION m_cs;
+
+    typedef std::map<std::wstring, CLSID> map_t;
+    map_t m_map;
+
+    std::wstring m_filename;
+    bool m_bDirty;
+
+};
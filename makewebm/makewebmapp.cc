@@ -20,9 +20,16 @@
 #include "vp8encoderidl.h"
 #include "webmmuxidl.h"
 #include "versionhandling.h"
+#include "mkvparserstitcher.h"
+#include "oggremux.h"
+#include "webmtranscode.h"
+#include "ipipelinecounters.h"
 #include <sstream>
 #include <iomanip>
+#include <fstream>
 #include <cmath>
+#include <process.h>
+#include <shellapi.h>
 using std::hex;
 using std::dec;
 using std::wcout;
@@ -41,55 +48,83 @@ using GraphUtil::FindInpinAudio;
 
 extern HANDLE g_hQuit;
 
+_COM_SMARTPTR_TYPEDEF(IPipelineCounters, __uuidof(IPipelineCounters));
 
-App::App()
+//qedit.h, which declares it, is no longer part of the SDK.
+static const CLSID CLSID_NullRenderer =
 {
+    0xC1F400A4, 0x3F08, 0x11D3,
+    { 0x9F, 0x0B, 0x00, 0x60, 0x08, 0x03, 0x9E, 0x37 }
+};
+
+
+App::App() :
+    m_bSegment(false),
+    m_bJob(false),
+    m_pGraphCache(&m_graph_cache),
+    m_stages_start(0),
+    m_stages_time(0)
+{
+}
+
+
+App::~App()
+{
+    if (!m_stitched_filename.empty())
+    {
+        m_pGraph = 0;  //close the file
+        DeleteFile(m_stitched_filename.c_str());
+    }
 }
 
 
 int App::operator()(int argc, wchar_t* argv[])
 {
-    int status = m_cmdline.Parse(argc, argv);
+    m_args.assign(argv, argv + argc + 1);  //includes terminating null
+
+    const int status = m_cmdline.Parse(argc, argv);
 
     if (status)
         return status;
 
+    if (m_cmdline.GetBatchFile() != 0)
+        return RunBatch();
+
+    if (m_cmdline.GetPipeOutput() &&
+        (wcscmp(m_cmdline.GetOutputFileName(), L"-") == 0))
+    {
+        std::wcout.rdbuf(std::wcerr.rdbuf());  //stdout carries the WebM
+    }
+
+    return Run();
+}
+
+
+int App::Run()
+{
     const bool bVerbose = m_cmdline.GetVerbose();
 
-    assert(!bool(m_pGraph));
+    if ((m_cmdline.GetOggToWebm() > 0) && (m_cmdline.GetSaveGraphFile() == 0))
+        return RemuxOgg();
 
-    HRESULT hr = m_pGraph.CreateInstance(CLSID_FilterGraphNoThread);
+    std::vector<CmdLine::Range> ranges;
+    m_cmdline.GetRanges(ranges);
 
-    if (FAILED(hr))
-    {
-        wcout << L"Unable to create filter graph instance.\n"
-              << hrtext(hr)
-              << " (0x" << hex << hr << dec << ")"
-              << endl;
+    if (!ranges.empty())
+        return CutDirect(ranges);
 
-        return 1;  //error
-    }
+    if (m_cmdline.GetNoGraph() && (m_cmdline.GetSaveGraphFile() == 0))
+        return TranscodeDirect();
 
-    assert(bool(m_pGraph));
+    int status = CreateGraph();
+
+    if (status)
+        return status;
 
     const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
     assert(bool(pBuilder));
 
-    const GraphUtil::IMediaFilterPtr pGraphFilter(m_pGraph);
-    assert(bool(pGraphFilter));
-
-    hr = pGraphFilter->SetSyncSource(0);  //process as quickly as possible
-    //TODO: are we setting this too early?
-
-#ifdef _DEBUG
-    if (FAILED(hr))
-    {
-        wcout << L"IMediaFilter::SetSyncSource failed.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
-    }
-#endif
+    HRESULT hr;
 
     const wchar_t* const ext = wcsrchr(m_cmdline.GetInputFileName(), L'.');
 
@@ -118,86 +153,12 @@ int App::operator()(int argc, wchar_t* argv[])
         return status;
     }
 
-    IBaseFilterPtr pReader;
-
-    if (m_cmdline.GetOggToWebm() > 0)
-    {
-        hr = pReader.CreateInstance(WebmTypes::CLSID_WebmOggSource);
-
-        if (FAILED(hr))
-        {
-            wcout << "Unable to create instance of Ogg source filter.\n"
-                  << hrtext(hr)
-                  << L" (0x" << hex << hr << dec << L")"
-                  << endl;
-
-            return 1;
-        }
-
-        const GraphUtil::IFileSourceFilterPtr pFile(pReader);
-
-        if (!pFile)
-        {
-            wcout << "Ogg source filter does not support IFileSourceFilter."
-                  << endl;
-
-            return 1;
-        }
-
-        hr = pFile->Load(m_cmdline.GetInputFileName(), 0);
-
-        if (FAILED(hr))
-        {
-            wcout << "Unable to load Ogg source filter.\n"
-                  << hrtext(hr)
-                  << L" (0x" << hex << hr << dec << L")"
-                  << endl;
-
-            return 1;
-        }
-
-        hr = m_pGraph->AddFilter(pReader, L"oggsource");
-
-        if (FAILED(hr))
-        {
-            wcout << "Unable to add Ogg source filter to graph.\n"
-                  << hrtext(hr)
-                  << L" (0x" << hex << hr << dec << L")"
-                  << endl;
-
-            return 1;
-        }
-    }
-    else
-    {
-        hr = pBuilder->AddSourceFilter(
-                m_cmdline.GetInputFileName(),
-                L"source",
-                &pReader);
-
-        if (FAILED(hr))
-        {
-            wcout << "Unable to add source filter to graph.\n"
-                  << hrtext(hr)
-                  << L" (0x" << hex << hr << dec << L")"
-                  << endl;
-
-            return 1;
-        }
-    }
-
-    assert(bool(pReader));
-
-    if (GraphUtil::PinCount(pReader) == 0)
-    {
-        wcout << "Source filter does not have any output pins.\n" << endl;
-        return 1;
-    }
+    IBaseFilterPtr pDemux;
 
-    const GraphUtil::IBaseFilterPtr pDemux = AddDemuxFilter(pReader, L"demux");
+    status = CreateSourceGraph(&pDemux);
 
-    if (!bool(pDemux))
-        return 1;
+    if (status)
+        return status;
 
     const GraphUtil::IPinPtr pDemuxOutpinVideo = FindOutpinVideo(pDemux);
     //TODO: we need to do better here: we check for the 0 case,
@@ -304,7 +265,43 @@ int App::operator()(int argc, wchar_t* argv[])
     const bool bNoVideo = m_cmdline.GetNoVideo();
     const bool bTwoPass = (m_cmdline.GetTwoPass() >= 1);
 
-    if (bTwoPass && !bNoVideo)
+    GraphUtil::IPinPtr pMuxInputVideo(pDemuxOutpinVideo);
+
+    if (!bNoVideo && (m_cmdline.GetParallelChunks() >= 0))
+    {
+        assert(!bTwoPass);
+        assert(m_cmdline.GetSaveGraphFile() == 0);
+
+        const bool bAudio =
+            bool(pDemuxOutpinAudio) && !m_cmdline.GetNoAudio();
+
+        status = RunParallelChunks(
+                    pDemuxOutpinVideo,
+                    bAudio,
+                    &pMuxInputVideo);
+
+        if (status)
+            return status;
+
+        if (!bAudio)  //stitched straight to output
+            return 0;
+    }
+
+    if (bTwoPass && !bNoVideo && (m_cmdline.GetTwoPassSegments() >= 0))
+    {
+        assert(m_cmdline.GetSaveGraphFile() == 0);
+
+        status = CreateFirstPassGraph(pDemuxOutpinVideo, 0);
+
+        if (status)
+            return status;
+
+        status = RunFirstPassSegments(pDemuxOutpinVideo);
+
+        if (status)
+            return status;
+    }
+    else if (bTwoPass && !bNoVideo)
     {
         assert(m_cmdline.GetSaveGraphFile() == 0);
 
@@ -340,7 +337,7 @@ int App::operator()(int argc, wchar_t* argv[])
 
         status = CreateMuxerGraph(
                     bTwoPass,
-                    bNoVideo ? 0 : pDemuxOutpinVideo,
+                    bNoVideo ? 0 : pMuxInputVideo,
                     bNoAudio ? 0 : pDemuxOutpinAudio,
                     &pMux);
 
@@ -352,6 +349,16 @@ int App::operator()(int argc, wchar_t* argv[])
         if (status)
             return status;
 
+        hr = m_graph_cache.Save();
+
+        if (FAILED(hr))  //the graph is still good, so not an error
+        {
+            wcout << L"Unable to save graph cache file.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+        }
+
         const GraphUtil::IMediaSeekingPtr pSeek(pMux);
         assert(bool(pSeek));
 
@@ -380,384 +387,1722 @@ int App::operator()(int argc, wchar_t* argv[])
 
         //hr = rot->Revoke(dw);
         //assert(SUCCEEDED(hr));
+
+        if (m_pipe.IsOpen())
+        {
+            hr = m_pipe.GetStatus();
+
+            if (FAILED(hr) && (status == 0))
+            {
+                wcout << "Unable to write to output pipe.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                status = 1;
+            }
+
+            m_pipe.Close();
+        }
     }
 
     return status;
 }
 
 
-int App::CreateMuxerGraph(
-    bool bTwoPass,
-    IPin* pDemuxOutpinVideo,
-    IPin* pDemuxOutpinAudio,
-    IBaseFilter** ppMux)
+int App::RunBatch()
 {
-    assert(bool(m_pGraph));
-    assert(ppMux);
-
-    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
-    assert(bool(pBuilder));
+    Batch b;
 
-    const bool bVerbose = m_cmdline.GetVerbose();
+    int status = ReadJobs(b.jobs);
 
-    HRESULT hr = CoCreateInstance(
-                    CLSID_WebmMux,
-                    0,
-                    CLSCTX_INPROC_SERVER,
-                    __uuidof(IBaseFilter),
-                    (void**)ppMux);
+    if (status)
+        return status;
 
-    if (FAILED(hr))
+    if (b.jobs.empty())
     {
-        wcout << "Unable to create WebmMux filter instance.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
-
+        wcout << "No jobs found in batch job list." << endl;
         return 1;
     }
 
-    assert(ppMux);
-    IBaseFilter*& pMux = *ppMux;
+    const wchar_t* const cache = m_cmdline.GetGraphCacheFile();
 
-    assert(GraphUtil::InpinCount(pMux) == 2);  //TODO: liberalize
-    assert(GraphUtil::OutpinCount(pMux) == 1);
+    if (cache)
+    {
+        const HRESULT hr = m_graph_cache.Load(cache);
 
-    hr = m_pGraph->AddFilter(pMux, L"webmmux");
-    assert(SUCCEEDED(hr));
+        if (FAILED(hr))
+        {
+            wcout << L"Unable to load graph cache file.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;  //error
+        }
+    }
+
+    //The args of a job are those of the batch (but for the batch
+    //switches), followed by the switches of its line, which take
+    //precedence.  The jobs are complete, so the vector won't move them.
 
+    for (size_t i = 0; i < b.jobs.size(); ++i)
     {
-        _COM_SMARTPTR_TYPEDEF(IWebmMux, __uuidof(IWebmMux));
+        Job& j = b.jobs[i];
 
-        const IWebmMuxPtr pWebmMux(pMux);
+        j.args.push_back(m_args[0]);  //program name
 
-        if (!bool(pWebmMux))
+        for (size_t k = 1; m_args[k]; ++k)
         {
-            wcout << "WebmMux filter instance does not support"
-                  << " IWebmMux interface."
-                  << endl;
+            wchar_t* const arg = m_args[k];
 
-            return 1;
+            if (!m_cmdline.IsBatchArg(arg))
+                j.args.push_back(arg);
         }
 
-        //_wpgmptr
-        wchar_t* fname;
+        for (size_t k = 0; k < j.strs.size(); ++k)
+            j.args.push_back(&j.strs[k][0]);
 
-        const errno_t e = _get_wpgmptr(&fname);
-        assert(e == 0);
+        j.args.push_back(0);
+    }
 
-        wostringstream os;
-        os << L"makewebm-";
-        VersionHandling::GetVersion(fname, os);
+    size_t count = 0;
 
-        hr = pWebmMux->SetWritingApp(os.str().c_str());
+    if (m_cmdline.GetBatchJobs() > 0)
+        count = m_cmdline.GetBatchJobs();
+    else
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
 
-        if (FAILED(hr))
-        {
-            wcout << "Unable to set \"makewebm\" as WebM writing app.\n"
-                  << hrtext(hr)
-                  << L" (0x" << hex << hr << dec << L")"
-                  << endl;
+        count = info.dwNumberOfProcessors;
+    }
 
-            return 1;
-        }
+    if (count > b.jobs.size())
+        count = b.jobs.size();
 
-        if (m_cmdline.GetLive())
-        {
-            hr = pWebmMux->SetMuxMode(kWebmMuxModeLive);
-            if (FAILED(hr))
-            {
-                wcout << "Unable to enable live mode.\n"
-                      << hrtext(hr)
-                      << L" (0x" << hex << hr << dec << L")"
-                      << endl;
+    b.next = 0;
+    b.pGraphCache = &m_graph_cache;
+    b.bScript = m_cmdline.ScriptMode();
 
-                return 1;
-            }
+    InitializeCriticalSection(&b.cs);
+
+    const DWORD start = GetTickCount();
+
+    std::vector<HANDLE> threads;
 
+    while (threads.size() < count)
+    {
+        const uintptr_t h = _beginthreadex(
+                                0,  //security
+                                0,  //stack size
+                                &App::BatchThreadProc,
+                                &b,
+                                0,   //run immediately
+                                0);  //thread id
+
+        if (h == 0)
+        {
+            wcout << "Unable to create batch thread." << endl;
+            break;
         }
+
+        threads.push_back(reinterpret_cast<HANDLE>(h));
     }
 
-    int nConnections = 0;
+    //There may be more threads than WaitForMultipleObjects can wait for.
 
-    if (pDemuxOutpinVideo)
+    for (size_t i = 0; i < threads.size(); ++i)
     {
-        const IPinPtr pMuxInpinVideo(FindInpinVideo(pMux));
-        assert(bool(pMuxInpinVideo));
+        const DWORD dw = WaitForSingleObject(threads[i], INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
 
-        if (IsVPX(pDemuxOutpinVideo))
-        {
-            assert(!bTwoPass);
+        const BOOL bClosed = CloseHandle(threads[i]);
+        bClosed;
+        assert(bClosed);
+    }
+
+    const DWORD time = GetTickCount() - start;
+
+    DeleteCriticalSection(&b.cs);
+
+    size_t failed = 0;
+    size_t skipped = 0;  //not run, because of ctrl+c (or no threads)
+
+    for (size_t i = 0; i < b.jobs.size(); ++i)
+    {
+        const Job& j = b.jobs[i];
+
+        if (!j.bDone)
+            ++skipped;
+
+        else if (j.status)
+            ++failed;
+    }
+
+    if (b.bScript)
+    {
+        wcout << L"JOBS=" << b.jobs.size()
+              << L" FAILED=" << failed
+              << L" SKIPPED=" << skipped
+              << L" TIME=" << std::fixed << std::setprecision(3)
+              << (time / 1000.0)
+              << endl;
+    }
+    else
+    {
+        wcout << b.jobs.size() << L" jobs ("
+              << failed << L" failed, "
+              << skipped << L" not run) in "
+              << std::fixed << std::setprecision(1)
+              << (time / 1000.0) << L" sec, "
+              << threads.size() << L" at a time."
+              << endl;
+    }
+
+    const HRESULT hr = m_graph_cache.Save();
+
+    if (FAILED(hr))
+    {
+        wcout << L"Unable to save graph cache file.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+    }
+
+    return ((failed == 0) && (skipped == 0)) ? 0 : 1;
+}
+
+
+int App::ReadJobs(std::vector<Job>& jobs) const
+{
+    const wchar_t* const f = m_cmdline.GetBatchFile();
+    assert(f);
+
+    std::wifstream file;
+    std::wistream* is = &std::wcin;
+
+    if (wcscmp(f, L"-") != 0)
+    {
+        file.open(f);
+
+        if (!file)
+        {
+            wcout << L"Unable to open batch job list \"" << f << L"\"."
+                  << endl;
+
+            return 1;
+        }
+
+        is = &file;
+    }
+
+    wstring line;
+
+    while (std::getline(*is, line))
+    {
+        const size_t pos = line.find_first_not_of(L" \t");
+
+        if ((pos == wstring::npos) || (line[pos] == L'#'))
+            continue;
+
+        const size_t end = line.find_last_not_of(L" \t\r");
+        line = line.substr(pos, end + 1 - pos);
+
+        //CommandLineToArgvW parses a program name first, with rules of
+        //its own, so one is supplied.
+
+        const wstring cmd = L"makewebm " + line;
+
+        int argc;
+        wchar_t** const argv = CommandLineToArgvW(cmd.c_str(), &argc);
+
+        if (argv == 0)
+        {
+            wcout << L"Unable to parse batch job \"" << line << L"\"."
+                  << endl;
+
+            return 1;
+        }
+
+        jobs.push_back(Job());
+        Job& j = jobs.back();
+
+        j.line = line;
+        j.strs.assign(argv + 1, argv + argc);
+        j.status = 1;  //error, until the job succeeds
+        j.bDone = false;
+        j.time = 0;
+
+        LocalFree(argv);
+    }
+
+    return 0;
+}
+
+
+unsigned App::BatchThreadProc(void* pv)
+{
+    Batch* const pBatch = static_cast<Batch*>(pv);
+    assert(pBatch);
+
+    const HRESULT hr = CoInitialize(0);
+
+    if (FAILED(hr))
+        return 0;  //the other threads run the jobs
+
+    const LONG count = static_cast<LONG>(pBatch->jobs.size());
+
+    for (;;)
+    {
+        if (WaitForSingleObject(g_hQuit, 0) == WAIT_OBJECT_0)
+            break;
+
+        const LONG i = InterlockedIncrement(&pBatch->next) - 1;
+
+        if (i >= count)
+            break;
+
+        Job& j = pBatch->jobs[i];
+
+        const DWORD start = GetTickCount();
+
+        {
+            App app;
+            app.m_pGraphCache = pBatch->pGraphCache;
+
+            j.status = app.RunJob(j);
+        }
+
+        j.time = GetTickCount() - start;
+        j.bDone = true;
+
+        ReportJob(*pBatch, i);
+    }
+
+    CoUninitialize();
+
+    return 0;
+}
+
+
+void App::ReportJob(Batch& b, LONG i)
+{
+    const Job& j = b.jobs[i];
+
+    EnterCriticalSection(&b.cs);
+
+    if (b.bScript)
+    {
+        wcout << L"JOB=" << (i + 1)
+              << L" STATUS=" << j.status
+              << L" TIME=" << std::fixed << std::setprecision(3)
+              << (j.time / 1000.0)
+              << endl;
+    }
+    else
+    {
+        wcout << L"job " << (i + 1)
+              << (j.status ? L" failed" : L" done")
+              << L" in " << std::fixed << std::setprecision(1)
+              << (j.time / 1000.0) << L" sec: "
+              << j.line
+              << endl;
+    }
+
+    LeaveCriticalSection(&b.cs);
+}
+
+
+int App::RunJob(Job& j)
+{
+    m_bJob = true;
+
+    m_args = j.args;  //for the segments and chunks of the job
+
+    std::vector<wchar_t*> args(j.args);  //Parse permutes its argv
+    const int argc = static_cast<int>(args.size()) - 1;
+
+    const int status = m_cmdline.Parse(argc, &args[0]);
+
+    if (status)
+        return status;
+
+    if (m_cmdline.GetBatchFile() != 0)
+    {
+        wcout << "A batch job may not run a batch of its own." << endl;
+        return 1;
+    }
+
+    if (m_cmdline.GetPipeOutput())
+    {
+        wcout << "A batch job may not write to a pipe." << endl;
+        return 1;
+    }
+
+    return Run();
+}
+
+
+int App::RemuxOgg()
+{
+    //The Ogg source delivers the Vorbis packets Xiph-laced, and the muxer
+    //writes them as they are, so a graph would do nothing but copy.  We
+    //rewrite the container directly instead.
+
+    wchar_t* fname;
+
+    const errno_t e = _get_wpgmptr(&fname);
+    assert(e == 0);
+
+    wostringstream os;
+    os << L"makewebm-";
+    VersionHandling::GetVersion(fname, os);
+
+    const DWORD start = GetTickCount();
+
+    OggRemux::Stats stats;
+
+    const HRESULT hr = OggRemux::Remux(
+                        m_cmdline.GetInputFileName(),
+                        m_cmdline.GetOutputFileName(),
+                        os.str().c_str(),
+                        g_hQuit,
+                        &stats);
+
+    if (hr == E_ABORT)
+        return 1;
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to remux Ogg file.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    if (m_cmdline.GetVerbose())
+    {
+        wcout << "Remuxed in "
+              << (GetTickCount() - start)
+              << " ms."
+              << endl;
+
+        if (stats.pages > 0)
+        {
+            wcout << "Read "
+                  << stats.pages
+                  << " pages in "
+                  << stats.reads
+                  << " reads and "
+                  << stats.file_reads
+                  << " file reads ("
+                  << (double(stats.file_reads) / double(stats.pages))
+                  << " per page)."
+                  << endl;
+        }
+    }
+
+    return 0;  //success
+}
+
+
+int App::TranscodeDirect()
+{
+    //The WebM source is decoded and re-encoded by the transcode library,
+    //without a filter graph; only the encoder switches that the library
+    //supports apply.
+
+    if (m_cmdline.GetNoVideo() || (m_cmdline.GetAudioInputFileName() != 0))
+    {
+        wcout << "The no-graph switch requires a single WebM input,"
+              << " with video."
+              << endl;
+
+        return 1;
+    }
+
+    WebmTranscode::Options opt;
+    GetTranscodeOptions(opt);
+
+    const DWORD start = GetTickCount();
+
+    const HRESULT hr = WebmTranscode::Transcode(
+                        m_cmdline.GetInputFileName(),
+                        m_cmdline.GetOutputFileName(),
+                        opt,
+                        GetWritingApp().c_str(),
+                        g_hQuit,
+                        &App::OnTranscodeProgress,
+                        this);
+
+    if (!m_bJob && !m_cmdline.ScriptMode())
+        wcout << endl;
+
+    if (hr == E_ABORT)
+        return 1;
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to transcode WebM file.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    if (m_cmdline.GetVerbose())
+    {
+        wcout << "Transcoded in "
+              << (GetTickCount() - start)
+              << " ms."
+              << endl;
+    }
+
+    return 0;  //success
+}
+
+
+int App::CutDirect(const std::vector<CmdLine::Range>& ranges)
+{
+    //The ranges are copied and joined by the transcode library, which
+    //re-encodes only the frames at the start of each range that precede
+    //its first keyframe; only the encoder switches that the library
+    //supports apply to those.
+
+    if (m_cmdline.GetNoVideo() ||
+        (m_cmdline.GetAudioInputFileName() != 0) ||
+        (m_cmdline.GetSaveGraphFile() != 0) ||
+        (m_cmdline.GetParallelChunks() >= 0) ||
+        (m_cmdline.GetTwoPass() >= 1))
+    {
+        wcout << "The cut and append switches require WebM inputs,"
+              << " with video, and no filter graph."
+              << endl;
+
+        return 1;
+    }
+
+    WebmTranscode::Options opt;
+    GetTranscodeOptions(opt);
+
+    std::vector<WebmTranscode::CutInput> inputs(ranges.size());
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        const CmdLine::Range& r = ranges[i];
+        WebmTranscode::CutInput& in = inputs[i];
+
+        in.filename = r.filename;
+        in.start = static_cast<LONGLONG>(r.start * 10000000);
+        in.stop = (r.stop < 0) ? -1 : static_cast<LONGLONG>(r.stop * 10000000);
+    }
+
+    const DWORD start = GetTickCount();
+
+    const HRESULT hr = WebmTranscode::Cut(
+                        &inputs[0],
+                        static_cast<ULONG>(inputs.size()),
+                        m_cmdline.GetOutputFileName(),
+                        opt,
+                        GetWritingApp().c_str(),
+                        g_hQuit,
+                        &App::OnTranscodeProgress,
+                        this);
+
+    if (!m_bJob && !m_cmdline.ScriptMode())
+        wcout << endl;
+
+    if (hr == E_ABORT)
+        return 1;
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to cut WebM file.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    if (m_cmdline.GetVerbose())
+    {
+        wcout << "Cut in "
+              << (GetTickCount() - start)
+              << " ms."
+              << endl;
+    }
+
+    return 0;  //success
+}
+
+
+void App::GetTranscodeOptions(WebmTranscode::Options& opt) const
+{
+    opt.vp9 = (m_cmdline.GetEncoderKind() == kVP9Encoder);
+    opt.no_audio = m_cmdline.GetNoAudio();
+    opt.deadline = m_cmdline.GetDeadline();
+    opt.target_bitrate = m_cmdline.GetTargetBitrate();
+    opt.min_quantizer = m_cmdline.GetMinQuantizer();
+    opt.max_quantizer = m_cmdline.GetMaxQuantizer();
+    opt.end_usage = m_cmdline.GetEndUsage();
+    opt.keyframe_max_interval = m_cmdline.GetKeyframeMaxInterval();
+    opt.thread_count = m_cmdline.GetThreadCount();
+    opt.cpu_used = m_cmdline.GetCPUUsed();
+}
+
+
+std::wstring App::GetWritingApp()
+{
+    wchar_t* fname;
+
+    const errno_t e = _get_wpgmptr(&fname);
+    assert(e == 0);
+    e;
+
+    wostringstream os;
+    os << L"makewebm-";
+    VersionHandling::GetVersion(fname, os);
+
+    return os.str();
+}
+
+
+void App::OnTranscodeProgress(void* pv, LONGLONG time, LONGLONG duration)
+{
+    const App* const pApp = static_cast<const App*>(pv);
+    assert(pApp);
+
+    if (pApp->m_bJob)  //the batch reports the job when it's done
+        return;
+
+    const bool bScript = pApp->m_cmdline.ScriptMode();
+
+    wcout << std::fixed << std::setprecision(1);
+
+    if (bScript)
+        wcout << "TIME=" << (double(time) / 10000000);
+    else
+        wcout << "\rtime[sec]=" << (double(time) / 10000000);
+
+    if (duration >= 0)
+    {
+        if (bScript)
+            wcout << " DURATION=" << (double(duration) / 10000000);
+        else
+            wcout << L'/' << (double(duration) / 10000000);
+    }
+
+    if (bScript)
+        wcout << endl;
+    else
+        wcout << flush;
+}
+
+
+int App::CreateGraph()
+{
+    assert(!bool(m_pGraph));
+
+    HRESULT hr = m_pGraph.CreateInstance(CLSID_FilterGraphNoThread);
+
+    if (FAILED(hr))
+    {
+        wcout << L"Unable to create filter graph instance.\n"
+              << hrtext(hr)
+              << " (0x" << hex << hr << dec << ")"
+              << endl;
+
+        return 1;  //error
+    }
+
+    assert(bool(m_pGraph));
+
+    const GraphUtil::IMediaFilterPtr pGraphFilter(m_pGraph);
+    assert(bool(pGraphFilter));
+
+    hr = pGraphFilter->SetSyncSource(0);  //process as quickly as possible
+    //TODO: are we setting this too early?
+
+#ifdef _DEBUG
+    if (FAILED(hr))
+    {
+        wcout << L"IMediaFilter::SetSyncSource failed.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+    }
+#endif
+
+    //Segments load the cache too, but only the App that built the whole
+    //graph saves it.  The jobs of a batch share the batch's cache.
+
+    const wchar_t* const cache = m_cmdline.GetGraphCacheFile();
+
+    if ((cache != 0) && !m_bJob && !m_graph_cache.IsLoaded())
+    {
+        hr = m_graph_cache.Load(cache);
+
+        if (FAILED(hr))
+        {
+            wcout << L"Unable to load graph cache file.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;  //error
+        }
+    }
+
+    return 0;  //success
+}
+
+
+int App::CreateSourceGraph(IBaseFilter** ppDemux)
+{
+    assert(bool(m_pGraph));
+    assert(ppDemux);
+
+    *ppDemux = 0;
+
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    IBaseFilterPtr pReader;
+
+    if (m_cmdline.GetOggToWebm() > 0)
+    {
+        HRESULT hr = pReader.CreateInstance(WebmTypes::CLSID_WebmOggSource);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to create instance of Ogg source filter.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        const GraphUtil::IFileSourceFilterPtr pFile(pReader);
+
+        if (!pFile)
+        {
+            wcout << "Ogg source filter does not support IFileSourceFilter."
+                  << endl;
+
+            return 1;
+        }
+
+        hr = pFile->Load(m_cmdline.GetInputFileName(), 0);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to load Ogg source filter.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        hr = m_pGraph->AddFilter(pReader, L"oggsource");
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to add Ogg source filter to graph.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+    }
+    else
+    {
+        const HRESULT hr = pBuilder->AddSourceFilter(
+                m_cmdline.GetInputFileName(),
+                L"source",
+                &pReader);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to add source filter to graph.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+    }
+
+    assert(bool(pReader));
+
+    if (GraphUtil::PinCount(pReader) == 0)
+    {
+        wcout << "Source filter does not have any output pins.\n" << endl;
+        return 1;
+    }
+
+    IBaseFilter*& pDemux = *ppDemux;
+
+    pDemux = AddDemuxFilter(pReader, L"demux").Detach();
+
+    if (pDemux == 0)
+        return 1;
+
+    return 0;  //success
+}
+
+
+int App::CreateMuxerGraph(
+    bool bTwoPass,
+    IPin* pDemuxOutpinVideo,
+    IPin* pDemuxOutpinAudio,
+    IBaseFilter** ppMux)
+{
+    assert(bool(m_pGraph));
+    assert(ppMux);
+
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    const bool bVerbose = m_cmdline.GetVerbose();
+
+    //The chunks of a segment's mux always go to a file of its own.
+    const bool bPipe = m_cmdline.GetPipeOutput() && !m_bSegment;
+
+    HRESULT hr = CoCreateInstance(
+                    CLSID_WebmMux,
+                    0,
+                    CLSCTX_INPROC_SERVER,
+                    __uuidof(IBaseFilter),
+                    (void**)ppMux);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create WebmMux filter instance.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    assert(ppMux);
+    IBaseFilter*& pMux = *ppMux;
+
+    assert(GraphUtil::InpinCount(pMux) == 2);  //TODO: liberalize
+    assert(GraphUtil::OutpinCount(pMux) == 1);
+
+    hr = m_pGraph->AddFilter(pMux, L"webmmux");
+    assert(SUCCEEDED(hr));
+
+    {
+        _COM_SMARTPTR_TYPEDEF(IWebmMux2, __uuidof(IWebmMux2));
+
+        const IWebmMux2Ptr pWebmMux(pMux);
+
+        if (!bool(pWebmMux))
+        {
+            wcout << "WebmMux filter instance does not support"
+                  << " IWebmMux2 interface."
+                  << endl;
+
+            return 1;
+        }
+
+        //_wpgmptr
+        wchar_t* fname;
+
+        const errno_t e = _get_wpgmptr(&fname);
+        assert(e == 0);
+
+        wostringstream os;
+        os << L"makewebm-";
+        VersionHandling::GetVersion(fname, os);
+
+        hr = pWebmMux->SetWritingApp(os.str().c_str());
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to set \"makewebm\" as WebM writing app.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        if (m_cmdline.GetLive() || bPipe)
+        {
+            hr = pWebmMux->SetMuxMode(kWebmMuxModeLive);
+            if (FAILED(hr))
+            {
+                wcout << "Unable to enable live mode.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+
+        }
+
+        if (bPipe)
+        {
+            //Assembled clusters have known sizes, though the live mux
+            //never seeks.
+
+            hr = pWebmMux->SetClusterWrite(kWebmMuxClusterWriteAssembled);
+
+            if (FAILED(hr))
+            {
+                wcout << "Unable to enable cluster assembly.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+
+            hr = m_pipe.Open(m_cmdline.GetOutputFileName());
+
+            if (FAILED(hr))
+            {
+                wcout << "Unable to open output pipe.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+
+            hr = pWebmMux->SetChunkSink(&m_pipe);
+
+            if (FAILED(hr))
+            {
+                wcout << "Unable to set output pipe as muxer chunk sink.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+        }
+    }
+
+    int nConnections = 0;
+
+    if (pDemuxOutpinVideo)
+    {
+        const IPinPtr pMuxInpinVideo(FindInpinVideo(pMux));
+        assert(bool(pMuxInpinVideo));
+
+        if (IsVPX(pDemuxOutpinVideo))
+        {
+            assert(!bTwoPass);
 
             //TODO(matthewjheaney): liberalize this, to allow clients
             //to do a re-code of VPx using different encoding config.
 
-            hr = m_pGraph->ConnectDirect(
-                    pDemuxOutpinVideo,
-                    pMuxInpinVideo,
-                    0);
+            hr = m_pGraph->ConnectDirect(
+                    pDemuxOutpinVideo,
+                    pMuxInpinVideo,
+                    0);
+
+            if (FAILED(hr))
+            {
+                wcout << "Unable to (directly) connect splitter video outpin"
+                      << " to muxer video inpin.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+        }
+        else
+        {
+            IBaseFilterPtr pCompressor;
+
+            if (bTwoPass)
+            {
+                hr = m_pGraph->FindFilterByName(L"vp8enc", &pCompressor);
+                assert(SUCCEEDED(hr));
+                assert(bool(pCompressor));
+            }
+            else
+            {
+                hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+
+                if (FAILED(hr))
+                {
+                    wcout << "Unable to create VPX encoder filter instance.\n"
+
+                          << hrtext(hr)
+                          << L" (0x" << hex << hr << dec << L")"
+                          << endl;
+
+                    return 1;
+                }
+
+                assert(bool(pCompressor));
+            }
+
+            _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+
+            const IVP8EncoderPtr pVP8(pCompressor);
+            assert(bool(pVP8));
+
+            if (bTwoPass)
+            {
+                hr = pVP8->SetPassMode(kPassModeLastPass);
+
+                if (FAILED(hr))
+                {
+                    wcout << "Unable to set VPX encoder pass mode"
+                          << " (last pass).\n"
+                          << hrtext(hr)
+                          << L" (0x" << hex << hr << dec << L")"
+                          << endl;
+
+                    return 1;
+                }
+
+                const BYTE* buf;
+                LONGLONG len;
+
+                if (!m_stats_buf.empty())  //from segments
+                {
+                    buf = &m_stats_buf[0];
+                    len = m_stats_buf.size();
+                }
+                else
+                {
+                    const wchar_t* const stats_filename =
+                        m_stats_filename.c_str();
+
+                    hr = m_stats_file.Open(stats_filename);
+
+                    if (FAILED(hr))
+                    {
+                        wcout << "Unable to open stats file.\n"
+                              << hrtext(hr)
+                              << L" (0x" << hex << hr << dec << L")"
+                              << endl;
+
+                        return 1;
+                    }
+
+                    hr = m_stats_file.GetView(buf, len);
+                    assert(SUCCEEDED(hr));
+                    assert(buf);
+                    assert(len >= 0);
+                }
+
+                hr = pVP8->SetTwoPassStatsBuf(buf, len);
+                assert(SUCCEEDED(hr));
+            }
+            else
+            {
+                hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
+                assert(SUCCEEDED(hr));
+
+                if (m_cmdline.GetEncoderKind() == kVP9Encoder)
+                {
+                    _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+
+                    const IVPXEncoderPtr pVPX(pCompressor);
+
+                    if (!bool(pVPX))
+                    {
+                        wcout << L"Encoder filter instance does support VP9.\n";
+                        return 1;
+                    }
+
+                    hr = pVPX->SetEncoderKind(kVP9Encoder);
+
+                    if (FAILED(hr))
+                    {
+                        wcout << L"Unable to set encoder kind to VP9.\n";
+                        return 1;
+                    }
+                }
+
+                IPinPtr pVP8Inpin;
+
+                hr = pCompressor->FindPin(L"input", &pVP8Inpin);
+                assert(SUCCEEDED(hr));
+                assert(bool(pVP8Inpin));
+
+                hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
+
+                if (FAILED(hr))
+                {
+                    wcout << "Unable to connect demux outpin to"
+                          << " VPX encoder filter inpin.\n"
+                          << hrtext(hr)
+                          << L" (0x" << hex << hr << dec << L")"
+                          << endl;
+
+                    return 1;
+                }
+
+                hr = pVP8->SetPassMode(kPassModeOnePass);
+
+                if (FAILED(hr))
+                {
+                    wcout << "Unable to set VPX encoder pass mode"
+                          << " (one pass).\n"
+                          << hrtext(hr)
+                          << L" (0x" << hex << hr << dec << L")"
+                          << endl;
+
+                    return 1;
+                }
+
+                AM_MEDIA_TYPE mt;
+
+                const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+
+                hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
+
+                if (SUCCEEDED(hrMT))
+                    MediaTypeUtil::Destroy(mt);
+
+                if (FAILED(hr))
+                    return 1;
+            }
+
+            IPinPtr pVP8Outpin;
+
+            hr = pCompressor->FindPin(L"output", &pVP8Outpin);
+            assert(SUCCEEDED(hr));
+            assert(bool(pVP8Outpin));
+
+            hr = m_pGraph->ConnectDirect(pVP8Outpin, pMuxInpinVideo, 0);
+
+            if (FAILED(hr))
+            {
+                wcout << "Unable to connect VPX encoder outpin"
+                      << " to muxer video inpin.\n"
+                      << hrtext(hr)
+                      << L" (0x" << hex << hr << dec << L")"
+                      << endl;
+
+                return 1;
+            }
+        }
+
+        ++nConnections;
+
+        if (bVerbose)
+            DumpConnectionMediaType(
+                pMuxInpinVideo,
+                L"muxer video inpin",
+                &App::DumpVideoMediaType);
+    }
+
+    if (pDemuxOutpinAudio)
+    {
+        const IPinPtr pMuxInpinAudio(FindInpinAudio(pMux));
+        assert(bool(pMuxInpinAudio));
+
+        if (!ConnectAudio(pDemuxOutpinAudio, pMuxInpinAudio))
+        {
+            if (m_cmdline.GetRequireAudio())
+            {
+                wcout << "Source has audio,"
+                      << " but no audio stream connected to muxer."
+                      << endl;
+
+                return 1;
+            }
+        }
+        else
+        {
+            ++nConnections;
+
+            if (bVerbose)
+                DumpConnectionMediaType(
+                    pMuxInpinAudio,
+                    L"muxer audio inpin",
+                    &App::DumpAudioMediaType);
+        }
+    }
+
+    if (nConnections <= 0)
+    {
+        wcout << L"No splitter outpins are connected to muxer inpins."
+              << endl;
+
+        return 1;
+    }
+
+    if (bPipe)
+        return 0;  //the muxer writes to the pipe, not to its outpin
+
+    IBaseFilterPtr pWriter;
+
+    hr = pWriter.CreateInstance(CLSID_FileWriter);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create writer filter instance.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    assert(bool(pWriter));
+    assert(GraphUtil::InpinCount(pWriter) == 1);
+
+    m_pGraph->AddFilter(pWriter, L"writer");
+    assert(SUCCEEDED(hr));
+
+    const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
+    assert(bool(pSink));
+
+    const wchar_t* const filename = m_output_filename.empty() ?
+                                        m_cmdline.GetOutputFileName() :
+                                        m_output_filename.c_str();
+
+    hr = pSink->SetFileName(filename, 0);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to set output filename of file writer filter.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
 
-            if (FAILED(hr))
-            {
-                wcout << "Unable to (directly) connect splitter video outpin"
-                      << " to muxer video inpin.\n"
-                      << hrtext(hr)
-                      << L" (0x" << hex << hr << dec << L")"
-                      << endl;
+    hr = GraphUtil::ConnectDirect(m_pGraph, pMux, pWriter, 0);
 
-                return 1;
-            }
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect muxer to writer.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    //TODO: this needs to be a dedicated switch,
+    //e.g. --dry-run or --build-only
+    //if (bList)
+    //    return 1;  //soft error
+
+    return 0;  //success
+}
+
+
+
+int App::CreateFirstPassGraph(
+    IPin* pDemuxOutpinVideo,
+    IPin** ppEncoderOutpin)
+{
+    assert(bool(m_pGraph));
+    assert(pDemuxOutpinVideo);
+
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    //const bool bVerbose = m_cmdline.GetVerbose();
+
+    if (IsVPX(pDemuxOutpinVideo))
+    {
+        //TODO(matthewjheaney): we should probably handle this case,
+        //so that they can do a re-encode with different parameters.
+
+        wcout << "Video demux stream is already VPx"
+              << " -- two-pass not supported.\n";
+
+        return 1;
+    }
+
+    IBaseFilterPtr pCompressor;
+
+    HRESULT hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create VPX encoder filter instance.\n"
+
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    assert(bool(pCompressor));
+
+    hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
+    assert(SUCCEEDED(hr));
+
+    if (m_cmdline.GetEncoderKind() == kVP9Encoder)
+    {
+        _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+
+        const IVPXEncoderPtr pVPX(pCompressor);
+
+        if (!bool(pVPX))
+        {
+            wcout << L"Encoder filter instance does support VP9.\n";
+            return 1;
         }
-        else
+
+        hr = pVPX->SetEncoderKind(kVP9Encoder);
+
+        if (FAILED(hr))
         {
-            IBaseFilterPtr pCompressor;
+            wcout << L"Unable to set encoder kind to VP9.\n";
+            return 1;
+        }
+    }
 
-            if (bTwoPass)
-            {
-                hr = m_pGraph->FindFilterByName(L"vp8enc", &pCompressor);
-                assert(SUCCEEDED(hr));
-                assert(bool(pCompressor));
-            }
-            else
-            {
-                hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+    IPinPtr pVP8Inpin;
 
-                if (FAILED(hr))
-                {
-                    wcout << "Unable to create VPX encoder filter instance.\n"
+    hr = pCompressor->FindPin(L"input", &pVP8Inpin);
+    assert(SUCCEEDED(hr));
+    assert(bool(pVP8Inpin));
 
-                          << hrtext(hr)
-                          << L" (0x" << hex << hr << dec << L")"
-                          << endl;
+    hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
 
-                    return 1;
-                }
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect demux outpin to"
+              << " VPX encoder filter inpin.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+
+    const IVP8EncoderPtr pVP8(pCompressor);
+    assert(bool(pVP8));
+
+    hr = pVP8->SetPassMode(kPassModeFirstPass);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to set VPX encoder pass mode (first pass).\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    AM_MEDIA_TYPE mt;
+
+    const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+
+    hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
+
+    if (SUCCEEDED(hrMT))
+        MediaTypeUtil::Destroy(mt);
+
+    if (FAILED(hr))
+        return 1;
+
+    if (ppEncoderOutpin == 0)  //segments run the first pass
+        return 0;
+
+    IBaseFilterPtr pWriter;
+
+    if (m_bSegment)
+    {
+        //The null renderer has no IStream, so the encoder keeps the
+        //stats in memory, for RunSegment to collect.
+
+        hr = pWriter.CreateInstance(CLSID_NullRenderer);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to create null renderer filter instance.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        assert(bool(pWriter));
+        assert(GraphUtil::InpinCount(pWriter) == 1);
+
+        hr = m_pGraph->AddFilter(pWriter, L"writer");
+        assert(SUCCEEDED(hr));
+    }
+    else
+    {
+        hr = pWriter.CreateInstance(CLSID_FileWriter);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to create writer filter instance.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        assert(bool(pWriter));
+        assert(GraphUtil::InpinCount(pWriter) == 1);
+
+        m_pGraph->AddFilter(pWriter, L"writer");
+        assert(SUCCEEDED(hr));
+
+        const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
+        assert(bool(pSink));
+
+        const wchar_t* const filename = GetStatsFileName();
+
+        if (filename == 0)
+            return 1;
+
+        hr = pSink->SetFileName(filename, 0);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to set output filename (for two-pass stats)"
+                  << " of file writer filter.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+    }
+
+    IPin*& pEncoderOutpin = *ppEncoderOutpin;
+
+    hr = pCompressor->FindPin(L"output", &pEncoderOutpin);
+    assert(SUCCEEDED(hr));
+    assert(pEncoderOutpin);
+
+    const GraphUtil::IPinPtr pWriterInpin = GraphUtil::FindInpin(pWriter);
+    assert(bool(pWriterInpin));
+
+    hr = m_pGraph->ConnectDirect(pEncoderOutpin, pWriterInpin, 0);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect VPX encoder outpin to writer inpin"
+              << " (for two-pass stats).\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    return 0;  //success
+}
+
+
+int App::GetSegmentTimes(
+    IPin* pDemuxOutpinVideo,
+    int count,
+    std::vector<LONGLONG>& times,
+    LONGLONG& duration)
+{
+    assert(bool(m_pGraph));
+    assert(pDemuxOutpinVideo);
+
+    //Segments begin on keyframes of the source.  The video stream is
+    //seeked here, in the muxer graph (which is stopped), only to find
+    //the segment boundaries.
+
+    const GraphUtil::IMediaSeekingPtr pSeek(pDemuxOutpinVideo);
+
+    if (!bool(pSeek))
+    {
+        wcout << "Video demux stream does not support seeking"
+              << " -- segments not supported.\n";
+
+        return 1;
+    }
+
+    HRESULT hr = pSeek->GetDuration(&duration);
+
+    if (FAILED(hr) || (duration <= 0))
+    {
+        wcout << "Video demux stream does not have a duration"
+              << " -- segments not supported.\n";
+
+        return 1;
+    }
 
-                assert(bool(pCompressor));
-            }
+    if (count <= 0)  //one per processor
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
 
-            _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+        count = info.dwNumberOfProcessors;
+    }
 
-            const IVP8EncoderPtr pVP8(pCompressor);
-            assert(bool(pVP8));
+    if (count > MAXIMUM_WAIT_OBJECTS)
+        count = MAXIMUM_WAIT_OBJECTS;
 
-            if (bTwoPass)
-            {
-                hr = pVP8->SetPassMode(kPassModeLastPass);
+    times.clear();
+    times.push_back(0);
 
-                if (FAILED(hr))
-                {
-                    wcout << "Unable to set VPX encoder pass mode"
-                          << " (last pass).\n"
-                          << hrtext(hr)
-                          << L" (0x" << hex << hr << dec << L")"
-                          << endl;
+    for (int i = 1; i < count; ++i)
+    {
+        LONGLONG t = duration * i / count;
 
-                    return 1;
-                }
+        hr = pSeek->SetPositions(
+                &t,
+                AM_SEEKING_AbsolutePositioning |
+                    AM_SEEKING_SeekToKeyFrame |
+                    AM_SEEKING_ReturnTime,
+                0,
+                AM_SEEKING_NoPositioning);
 
-                const wchar_t* const stats_filename =
-                    m_stats_filename.c_str();
+        if (FAILED(hr))
+        {
+            wcout << "Unable to seek video demux stream"
+                  << " (for segments).\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
 
-                hr = m_stats_file.Open(stats_filename);
+            return 1;
+        }
 
-                if (FAILED(hr))
-                {
-                    wcout << "Unable to open stats file.\n"
-                          << hrtext(hr)
-                          << L" (0x" << hex << hr << dec << L")"
-                          << endl;
+        //Segments shorter than a keyframe interval collapse.
 
-                    return 1;
-                }
+        if ((t > times.back()) && (t < duration))
+            times.push_back(t);
+    }
 
-                const BYTE* buf;
-                LONGLONG len;
+    LONGLONG t = 0;
 
-                hr = m_stats_file.GetView(buf, len);
-                assert(SUCCEEDED(hr));
-                assert(buf);
-                assert(len >= 0);
+    hr = pSeek->SetPositions(
+            &t,
+            AM_SEEKING_AbsolutePositioning,
+            0,
+            AM_SEEKING_NoPositioning);
 
-                hr = pVP8->SetTwoPassStatsBuf(buf, len);
-                assert(SUCCEEDED(hr));
-            }
-            else
-            {
-                hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
-                assert(SUCCEEDED(hr));
+    assert(SUCCEEDED(hr));
 
-                if (m_cmdline.GetEncoderKind() == kVP9Encoder)
-                {
-                    _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+    return 0;  //success
+}
 
-                    const IVPXEncoderPtr pVPX(pCompressor);
 
-                    if (!bool(pVPX))
-                    {
-                        wcout << L"Encoder filter instance does support VP9.\n";
-                        return 1;
-                    }
+int App::RunSegments(std::vector<Segment>& segments)
+{
+    //Each segment is run in a graph of its own, on a thread of its own.
 
-                    hr = pVPX->SetEncoderKind(kVP9Encoder);
+    std::vector<HANDLE> threads;
 
-                    if (FAILED(hr))
-                    {
-                        wcout << L"Unable to set encoder kind to VP9.\n";
-                        return 1;
-                    }
-                }
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        Segment& s = segments[i];
 
-                IPinPtr pVP8Inpin;
+        s.args = m_args;
+        s.record_size = 0;
+        s.status = 1;  //error, until the segment succeeds
 
-                hr = pCompressor->FindPin(L"input", &pVP8Inpin);
-                assert(SUCCEEDED(hr));
-                assert(bool(pVP8Inpin));
+        const uintptr_t h = _beginthreadex(
+                                0,  //security
+                                0,  //stack size
+                                &App::SegmentThreadProc,
+                                &s,
+                                0,   //run immediately
+                                0);  //thread id
 
-                hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
+        if (h == 0)
+        {
+            wcout << "Unable to create segment thread." << endl;
+            break;
+        }
 
-                if (FAILED(hr))
-                {
-                    wcout << "Unable to connect demux outpin to"
-                          << " VPX encoder filter inpin.\n"
-                          << hrtext(hr)
-                          << L" (0x" << hex << hr << dec << L")"
-                          << endl;
+        threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
 
-                    return 1;
-                }
+    if (!threads.empty())
+    {
+        const DWORD dw = WaitForMultipleObjects(
+                            static_cast<DWORD>(threads.size()),
+                            &threads[0],
+                            TRUE,  //wait for all
+                            INFINITE);
+        dw;
+        assert(dw != WAIT_FAILED);
+
+        for (size_t i = 0; i < threads.size(); ++i)
+        {
+            const BOOL b = CloseHandle(threads[i]);
+            b;
+            assert(b);
+        }
+    }
 
-                hr = pVP8->SetPassMode(kPassModeOnePass);
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (segments[i].status)
+            return 1;  //segment has already reported the error
+    }
 
-                if (FAILED(hr))
-                {
-                    wcout << "Unable to set VPX encoder pass mode"
-                          << " (one pass).\n"
-                          << hrtext(hr)
-                          << L" (0x" << hex << hr << dec << L")"
-                          << endl;
+    return 0;  //success
+}
 
-                    return 1;
-                }
 
-                AM_MEDIA_TYPE mt;
+int App::RunFirstPassSegments(IPin* pDemuxOutpinVideo)
+{
+    std::vector<LONGLONG> times;
+    LONGLONG duration;
 
-                const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+    int status = GetSegmentTimes(
+                    pDemuxOutpinVideo,
+                    m_cmdline.GetTwoPassSegments(),
+                    times,
+                    duration);
 
-                hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
+    if (status)
+        return status;
 
-                if (SUCCEEDED(hrMT))
-                    MediaTypeUtil::Destroy(mt);
+    const size_t n = times.size();
 
-                if (FAILED(hr))
-                    return 1;
-            }
+    if (m_cmdline.GetVerbose())
+        wcout << "Running first pass as " << n << " segments." << endl;
 
-            IPinPtr pVP8Outpin;
+    std::vector<Segment> segments(n);
 
-            hr = pCompressor->FindPin(L"output", &pVP8Outpin);
-            assert(SUCCEEDED(hr));
-            assert(bool(pVP8Outpin));
+    for (size_t i = 0; i < n; ++i)
+    {
+        Segment& s = segments[i];
 
-            hr = m_pGraph->ConnectDirect(pVP8Outpin, pMuxInpinVideo, 0);
+        s.start = times[i];
+        s.stop = (i + 1 < n) ? times[i + 1] : duration;
+    }
 
-            if (FAILED(hr))
-            {
-                wcout << "Unable to connect VPX encoder outpin"
-                      << " to muxer video inpin.\n"
-                      << hrtext(hr)
-                      << L" (0x" << hex << hr << dec << L")"
-                      << endl;
+    status = RunSegments(segments);
 
-                return 1;
-            }
-        }
+    if (status)
+        return status;
 
-        ++nConnections;
+    return MergeFirstPassStats(segments);
+}
 
-        if (bVerbose)
-            DumpConnectionMediaType(
-                pMuxInpinVideo,
-                L"muxer video inpin",
-                &App::DumpVideoMediaType);
-    }
 
-    if (pDemuxOutpinAudio)
-    {
-        const IPinPtr pMuxInpinAudio(FindInpinAudio(pMux));
-        assert(bool(pMuxInpinAudio));
+int App::RunParallelChunks(
+    IPin* pDemuxOutpinVideo,
+    bool bAudio,
+    IPin** ppVideo)
+{
+    assert(bool(m_pGraph));
+    assert(ppVideo);
 
-        if (!ConnectAudio(pDemuxOutpinAudio, pMuxInpinAudio))
-        {
-            if (m_cmdline.GetRequireAudio())
-            {
-                wcout << "Source has audio,"
-                      << " but no audio stream connected to muxer."
-                      << endl;
+    *ppVideo = 0;
 
-                return 1;
-            }
-        }
-        else
-        {
-            ++nConnections;
+    if (pDemuxOutpinVideo == 0)
+    {
+        wcout << "Demuxer does not expose video output pin"
+              << " -- parallel chunks not supported.\n";
 
-            if (bVerbose)
-                DumpConnectionMediaType(
-                    pMuxInpinAudio,
-                    L"muxer audio inpin",
-                    &App::DumpAudioMediaType);
-        }
+        return 1;
     }
 
-    if (nConnections <= 0)
+    if (IsVPX(pDemuxOutpinVideo))
     {
-        wcout << L"No splitter outpins are connected to muxer inpins."
-              << endl;
+        wcout << "Video demux stream is already VPx"
+              << " -- parallel chunks not supported.\n";
 
         return 1;
     }
 
-    IBaseFilterPtr pWriter;
+    std::vector<LONGLONG> times;
+    LONGLONG duration;
 
-    hr = pWriter.CreateInstance(CLSID_FileWriter);
+    int status = GetSegmentTimes(
+                    pDemuxOutpinVideo,
+                    m_cmdline.GetParallelChunks(),
+                    times,
+                    duration);
 
-    if (FAILED(hr))
+    if (status)
+        return status;
+
+    const size_t n = times.size();
+
+    if (m_cmdline.GetVerbose())
+        wcout << "Encoding video as " << n << " chunks." << endl;
+
+    //Each chunk is a WebM file of its own, holding only video.  The
+    //encoder begins every chunk with a keyframe.
+
+    std::vector<Segment> segments(n);
+
+    for (size_t i = 0; i < n; ++i)
     {
-        wcout << "Unable to create writer filter instance.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        Segment& s = segments[i];
 
-        return 1;
+        s.start = times[i];
+        s.stop = (i + 1 < n) ? times[i + 1] : duration;
+
+        wostringstream os;
+        os << L"-CHUNK" << (i + 1) << L".webm";
+
+        s.filename = GetSidecarFileName(os.str().c_str());
     }
 
-    assert(bool(pWriter));
-    assert(GraphUtil::InpinCount(pWriter) == 1);
+    status = RunSegments(segments);
 
-    m_pGraph->AddFilter(pWriter, L"writer");
-    assert(SUCCEEDED(hr));
+    //With audio, we stitch the video into a file of its own, and mux it
+    //with the audio in the (stopped) graph we already have.
 
-    const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
-    assert(bool(pSink));
+    if (bAudio)
+        m_stitched_filename = GetSidecarFileName(L"-VIDEO.webm");
 
-    hr = pSink->SetFileName(m_cmdline.GetOutputFileName(), 0);
+    const wchar_t* const filename =
+        bAudio ? m_stitched_filename.c_str() : m_cmdline.GetOutputFileName();
 
-    if (FAILED(hr))
+    HRESULT hr = S_OK;
+
+    if (status == 0)
     {
-        wcout << "Unable to set output filename of file writer filter.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        std::vector<mkvparser::Stitcher::Input> inputs(n);
 
-        return 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            inputs[i].filename = segments[i].filename.c_str();
+            inputs[i].start_ns = segments[i].start * 100;
+        }
+
+        hr = mkvparser::Stitcher::Stitch(
+                filename,
+                &inputs[0],
+                static_cast<ULONG>(n));
     }
 
-    hr = GraphUtil::ConnectDirect(m_pGraph, pMux, pWriter, 0);
+    for (size_t i = 0; i < n; ++i)
+        DeleteFile(segments[i].filename.c_str());
+
+    if (status)
+        return status;
 
     if (FAILED(hr))
     {
-        wcout << "Unable to connect muxer to writer.\n"
+        wcout << "Unable to stitch video chunks.\n"
               << hrtext(hr)
               << L" (0x" << hex << hr << dec << L")"
               << endl;
@@ -765,163 +2110,214 @@ int App::CreateMuxerGraph(
         return 1;
     }
 
-    //TODO: this needs to be a dedicated switch,
-    //e.g. --dry-run or --build-only
-    //if (bList)
-    //    return 1;  //soft error
+    if (!bAudio)
+        return 0;  //the output is complete
 
-    return 0;  //success
-}
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
 
+    IBaseFilterPtr pReader;
 
+    hr = pBuilder->AddSourceFilter(filename, L"video source", &pReader);
 
-int App::CreateFirstPassGraph(
-    IPin* pDemuxOutpinVideo,
-    IPin** ppEncoderOutpin)
-{
-    assert(bool(m_pGraph));
-    assert(pDemuxOutpinVideo);
-    assert(ppEncoderOutpin);
+    if (FAILED(hr))
+    {
+        wcout << "Unable to add stitched video source filter to graph.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
 
-    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
-    assert(bool(pBuilder));
+        return 1;
+    }
 
-    //const bool bVerbose = m_cmdline.GetVerbose();
+    const IBaseFilterPtr pDemux = AddDemuxFilter(pReader, L"video demux");
 
-    if (IsVPX(pDemuxOutpinVideo))
-    {
-        //TODO(matthewjheaney): we should probably handle this case,
-        //so that they can do a re-encode with different parameters.
+    if (!bool(pDemux))
+        return 1;
 
-        wcout << "Video demux stream is already VPx"
-              << " -- two-pass not supported.\n";
+    *ppVideo = FindOutpinVideo(pDemux).Detach();
 
+    if (*ppVideo == 0)
+    {
+        wcout << "Stitched video does not have a video stream." << endl;
         return 1;
     }
 
-    IBaseFilterPtr pCompressor;
+    return 0;  //success
+}
 
-    HRESULT hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to create VPX encoder filter instance.\n"
+int App::MergeFirstPassStats(const std::vector<Segment>& segments)
+{
+    //A stats packet is a record of doubles, and the encoder writes one
+    //per frame, followed by a record whose fields are the sums of the
+    //fields of the frame records.  We append the frame records of each
+    //segment, renumbering them (the first field is the frame number),
+    //and then write the sums over all of them.
+
+    assert(!segments.empty());
 
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+    const LONGLONG record_size = segments[0].record_size;
 
+    if ((record_size <= 0) || (record_size % sizeof(double)))
+    {
+        wcout << "Unexpected size of first-pass stats record." << endl;
         return 1;
     }
 
-    assert(bool(pCompressor));
+    const size_t field_count = size_t(record_size) / sizeof(double);
 
-    hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
-    assert(SUCCEEDED(hr));
+    std::vector<double> total(field_count, 0);
+    double frame = 0;
 
-    if (m_cmdline.GetEncoderKind() == kVP9Encoder)
-    {
-        _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+    m_stats_buf.clear();
 
-        const IVPXEncoderPtr pVPX(pCompressor);
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const Segment& s = segments[i];
 
-        if (!bool(pVPX))
+        if (s.record_size != record_size)
         {
-            wcout << L"Encoder filter instance does support VP9.\n";
+            wcout << "First-pass segments disagree on stats record size."
+                  << endl;
+
             return 1;
         }
 
-        hr = pVPX->SetEncoderKind(kVP9Encoder);
+        const size_t record_count = s.stats.size() / size_t(record_size);
 
-        if (FAILED(hr))
+        for (size_t j = 0; (j + 1) < record_count; ++j)  //skip the sums
         {
-            wcout << L"Unable to set encoder kind to VP9.\n";
-            return 1;
-        }
-    }
+            const BYTE* const src = &s.stats[0] + j * size_t(record_size);
+            const size_t pos = m_stats_buf.size();
 
-    IPinPtr pVP8Inpin;
+            m_stats_buf.insert(m_stats_buf.end(), src, src + record_size);
 
-    hr = pCompressor->FindPin(L"input", &pVP8Inpin);
-    assert(SUCCEEDED(hr));
-    assert(bool(pVP8Inpin));
+            double* const dst = reinterpret_cast<double*>(&m_stats_buf[pos]);
 
-    hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
+            dst[0] = frame;
+            frame += 1;
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to connect demux outpin to"
-              << " VPX encoder filter inpin.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+            for (size_t k = 0; k < field_count; ++k)
+                total[k] += dst[k];
+        }
+    }
 
+    if (m_stats_buf.empty())
+    {
+        wcout << "First-pass segments did not produce any stats." << endl;
         return 1;
     }
 
-    _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+    const BYTE* const src = reinterpret_cast<const BYTE*>(&total[0]);
+    m_stats_buf.insert(m_stats_buf.end(), src, src + record_size);
 
-    const IVP8EncoderPtr pVP8(pCompressor);
-    assert(bool(pVP8));
+    return 0;  //success
+}
 
-    hr = pVP8->SetPassMode(kPassModeFirstPass);
+
+unsigned App::SegmentThreadProc(void* pv)
+{
+    Segment* const pSegment = static_cast<Segment*>(pv);
+    assert(pSegment);
+
+    const HRESULT hr = CoInitialize(0);
 
     if (FAILED(hr))
-    {
-        wcout << "Unable to set VPX encoder pass mode (first pass).\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        return 0;  //segment status is error
 
-        return 1;
+    {
+        App app;
+        pSegment->status = app.RunSegment(*pSegment);
     }
 
-    AM_MEDIA_TYPE mt;
+    CoUninitialize();
 
-    const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+    return 0;
+}
 
-    hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
 
-    if (SUCCEEDED(hrMT))
-        MediaTypeUtil::Destroy(mt);
+int App::RunSegment(Segment& s)
+{
+    m_bSegment = true;
 
-    if (FAILED(hr))
-        return 1;
+    std::vector<wchar_t*> args(s.args);  //Parse permutes its argv
+    const int argc = static_cast<int>(args.size()) - 1;
 
-    IBaseFilterPtr pWriter;
+    int status = m_cmdline.Parse(argc, &args[0]);
 
-    hr = pWriter.CreateInstance(CLSID_FileWriter);
+    if (status)
+        return status;
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to create writer filter instance.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+    status = CreateGraph();
+
+    if (status)
+        return status;
 
+    IBaseFilterPtr pDemux;
+
+    status = CreateSourceGraph(&pDemux);
+
+    if (status)
+        return status;
+
+    const GraphUtil::IPinPtr pDemuxOutpinVideo = FindOutpinVideo(pDemux);
+
+    if (!bool(pDemuxOutpinVideo))
+    {
+        wcout << "Demuxer does not expose video output pin." << endl;
         return 1;
     }
 
-    assert(bool(pWriter));
-    assert(GraphUtil::InpinCount(pWriter) == 1);
+    GraphUtil::IPinPtr pEncoderOutpin;
 
-    m_pGraph->AddFilter(pWriter, L"writer");
-    assert(SUCCEEDED(hr));
+    if (s.filename.empty())  //first pass
+    {
+        status = CreateFirstPassGraph(pDemuxOutpinVideo, &pEncoderOutpin);
 
-    const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
-    assert(bool(pSink));
+        if (status)
+            return status;
+    }
+    else  //chunk
+    {
+        m_output_filename = s.filename;
 
-    const wchar_t* const filename = GetStatsFileName();
+        IBaseFilterPtr pMux;
 
-    if (filename == 0)
-        return 1;
+        status = CreateMuxerGraph(false, pDemuxOutpinVideo, 0, &pMux);
 
-    hr = pSink->SetFileName(filename, 0);
+        if (status)
+            return status;
+
+        IBaseFilterPtr pCompressor;
+
+        HRESULT hr = m_pGraph->FindFilterByName(L"vp8enc", &pCompressor);
+        assert(SUCCEEDED(hr));
+        assert(bool(pCompressor));
+
+        hr = pCompressor->FindPin(L"output", &pEncoderOutpin);
+        assert(SUCCEEDED(hr));
+        assert(bool(pEncoderOutpin));
+    }
+
+    //The muxer does not seek the stop position, so we seek through the
+    //encoder.
+
+    const GraphUtil::IMediaSeekingPtr pSeek(pEncoderOutpin);
+    assert(bool(pSeek));
+
+    LONGLONG curr = s.start;
+    LONGLONG stop = s.stop;
+
+    HRESULT hr = pSeek->SetPositions(
+                    &curr,
+                    AM_SEEKING_AbsolutePositioning,
+                    &stop,
+                    AM_SEEKING_AbsolutePositioning);
 
     if (FAILED(hr))
     {
-        wcout << "Unable to set output filename (for two-pass stats)"
-              << " of file writer filter.\n"
+        wcout << "Unable to seek to segment.\n"
               << hrtext(hr)
               << L" (0x" << hex << hr << dec << L")"
               << endl;
@@ -929,28 +2325,50 @@ int App::CreateFirstPassGraph(
         return 1;
     }
 
-    IPin*& pEncoderOutpin = *ppEncoderOutpin;
+    status = RunGraph(pSeek);
 
-    hr = pCompressor->FindPin(L"output", &pEncoderOutpin);
+    if (status)
+        return status;
+
+    if (WaitForSingleObject(g_hQuit, 0) == WAIT_OBJECT_0)
+        return 1;  //stopped early, so the output is incomplete
+
+    if (!s.filename.empty())  //chunk
+        return 0;
+
+    IBaseFilterPtr pCompressor;
+
+    hr = m_pGraph->FindFilterByName(L"vp8enc", &pCompressor);
     assert(SUCCEEDED(hr));
-    assert(pEncoderOutpin);
+    assert(bool(pCompressor));
 
-    const GraphUtil::IPinPtr pWriterInpin = GraphUtil::FindInpin(pWriter);
-    assert(bool(pWriterInpin));
+    _COM_SMARTPTR_TYPEDEF(IVPXEncoder2, __uuidof(IVPXEncoder2));
 
-    hr = m_pGraph->ConnectDirect(pEncoderOutpin, pWriterInpin, 0);
+    const IVPXEncoder2Ptr pVPX(pCompressor);
 
-    if (FAILED(hr))
+    if (!bool(pVPX))
     {
-        wcout << "Unable to connect VPX encoder outpin to file writer inpin"
-              << " (for two-pass stats).\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        wcout << L"Encoder filter instance does not support"
+              << L" in-memory first-pass stats.\n";
+
+        return 1;
+    }
+
+    const BYTE* buf;
+    LONGLONG len;
+    LONGLONG record_size;
 
+    hr = pVPX->GetFirstPassStats(&buf, &len, &record_size);
+
+    if (hr != S_OK)
+    {
+        wcout << L"Unable to get first-pass stats of segment.\n";
         return 1;
     }
 
+    s.stats.assign(buf, buf + len);
+    s.record_size = record_size;
+
     return 0;  //success
 }
 
@@ -1136,6 +2554,12 @@ int App::RunGraph(IMediaSeeking* pSeek)
 
     m_progress = 0;
 
+    m_stages.clear();
+    m_stages_start = webmdshow::PipelineCounters::Now();
+    m_stages_time = m_stages_start;
+
+    const bool bStages = m_cmdline.GetStageStats();
+
     for (;;)
     {
         MSG msg;
@@ -1156,7 +2580,13 @@ int App::RunGraph(IMediaSeeking* pSeek)
 
         if (dw == WAIT_TIMEOUT)
         {
-            DisplayProgress(pSeek, false);
+            if (m_bSegment || m_bJob)
+                __noop;
+            else if (bStages)
+                DisplayStages(pSeek, false);
+            else
+                DisplayProgress(pSeek, false);
+
             continue;
         }
 
@@ -1198,10 +2628,17 @@ int App::RunGraph(IMediaSeeking* pSeek)
         //    break;
     }
 
-    DisplayProgress(pSeek, true);
+    if (m_bSegment || m_bJob)
+        __noop;
+    else if (bStages)
+        DisplayStages(pSeek, true);
+    else
+    {
+        DisplayProgress(pSeek, true);
 
-    if (!m_cmdline.ScriptMode())
-        wcout << endl;
+        if (!m_cmdline.ScriptMode())
+            wcout << endl;
+    }
 
     hr = pControl->Stop();
     assert(SUCCEEDED(hr));
@@ -1234,68 +2671,229 @@ void App::DisplayProgress(IMediaSeeking* pSeek, bool last)
 
     assert(curr >= 0);
 
-    double val = double(curr) / 10000000;
+    double val = double(curr) / 10000000;
+
+    wcout << std::fixed << std::setprecision(1);
+
+    if (m_cmdline.ScriptMode())
+        wcout << "TIME=" << val;
+    else
+        wcout << "\rtime[sec]=" << val;
+
+    __int64 d;
+
+    //TODO: it's not clear whether we're allowed to call
+    //IMediaSeeking::GetDuration directly on the mkvmux
+    //filter, or whether we must call the graph object.
+
+#if 1
+    hr = pSeek->GetDuration(&d);
+#else
+    const GraphUtil::IMediaSeekingPtr pSeek(m_pGraph);
+    assert(bool(pSeek));
+
+    hr = pSeek->GetDuration(&d);
+#endif
+
+    if (SUCCEEDED(hr))  //have duration
+    {
+        val = double(d) / 10000000;
+
+        if (m_cmdline.ScriptMode())
+            wcout << " DURATION=" << val;
+        else
+            wcout << L'/' << val;
+    }
+
+    if (m_cmdline.ScriptMode())
+    {
+        wcout << endl;
+        return;
+    }
+
+    if (last)
+        m_progress = 0;
+
+    //TODO: there's probably a slicker way to do this:
+
+    assert(m_progress >= 0);
+    assert(m_progress <= 10);
+
+    const int space = 10 - m_progress;
+
+    for (int i = 0; i < m_progress; ++i)
+        wcout << L'.';
+
+    for (int i = 0; i < space; ++i)
+        wcout << L' ';
+
+    ++m_progress;
+
+    if (m_progress > 10)
+        m_progress = 0;
+
+    wcout << flush;
+}
+
+
+//Prints, about once a second, the position and an estimate of the time
+//remaining, then a line per stage of each filter in the graph that
+//exposes IPipelineCounters: the frames it delivered per second since the
+//last reading, the share of that time it was busy, and the depth of its
+//queue. The stage that is busiest, or whose upstream queue is fullest,
+//is the one limiting throughput.
+//
+//With --progress-json each reading is instead written as one JSON object
+//on a line of its own, for a job scheduler to parse.
+
+void App::DisplayStages(IMediaSeeking* pSeek, bool last)
+{
+    assert(pSeek);
+
+    typedef webmdshow::PipelineCounters::Stats Stats;
+
+    const LONGLONG now = webmdshow::PipelineCounters::Now();
+    const LONGLONG interval = now - m_stages_time;
+
+    if (!last && (interval < 1000000))
+        return;
+
+    std::vector<Stats> stages;
+
+    GraphUtil::IEnumFiltersPtr e;
+
+    HRESULT hr = m_pGraph->EnumFilters(&e);
+    assert(SUCCEEDED(hr));
+
+    for (;;)
+    {
+        IBaseFilterPtr f;
+
+        hr = e->Next(1, &f, 0);
+
+        if (hr != S_OK)
+            break;
+
+        const IPipelineCountersPtr pCounters(f);
+
+        if (!bool(pCounters))
+            continue;
+
+        ULONG n;
+
+        hr = pCounters->GetStageCount(&n);
+
+        if (FAILED(hr))
+            continue;
+
+        for (ULONG i = 0; i < n; ++i)
+        {
+            Stats s;
+
+            hr = pCounters->GetStage(i, &s);
+
+            if (SUCCEEDED(hr))
+                stages.push_back(s);
+        }
+    }
+
+    __int64 curr, d;
+
+    if (FAILED(pSeek->GetCurrentPosition(&curr)))
+        curr = -1;
+
+    if (FAILED(pSeek->GetDuration(&d)))
+        d = -1;
 
-    wcout << std::fixed << std::setprecision(1);
+    const LONGLONG elapsed = now - m_stages_start;
 
-    if (m_cmdline.ScriptMode())
-        wcout << "TIME=" << val;
-    else
-        wcout << "\rtime[sec]=" << val;
+    //The time remaining, if the rest of the source encodes at the rate
+    //achieved so far.
 
-    __int64 d;
+    double eta = -1;
 
-    //TODO: it's not clear whether we're allowed to call
-    //IMediaSeeking::GetDuration directly on the mkvmux
-    //filter, or whether we must call the graph object.
+    if ((curr > 0) && (d >= curr))
+        eta = double(elapsed) * double(d - curr) / double(curr) / 1e6;
 
-#if 1
-    hr = pSeek->GetDuration(&d);
-#else
-    const GraphUtil::IMediaSeekingPtr pSeek(m_pGraph);
-    assert(bool(pSeek));
+    const bool bJson = m_cmdline.GetProgressJson();
 
-    hr = pSeek->GetDuration(&d);
-#endif
+    wcout << std::fixed << std::setprecision(1);
 
-    if (SUCCEEDED(hr))  //have duration
+    if (bJson)
     {
-        val = double(d) / 10000000;
-
-        if (m_cmdline.ScriptMode())
-            wcout << " DURATION=" << val;
-        else
-            wcout << L'/' << val;
+        wcout << L"{\"time\":" << ((curr >= 0) ? curr / 1e7 : -1.0)
+              << L",\"duration\":" << ((d >= 0) ? d / 1e7 : -1.0)
+              << L",\"elapsed\":" << elapsed / 1e6
+              << L",\"eta\":" << eta
+              << L",\"done\":" << (last ? L"true" : L"false")
+              << L",\"stages\":[";
     }
-
-    if (m_cmdline.ScriptMode())
+    else
     {
-        wcout << endl;
-        return;
+        wcout << L"time[sec]=" << ((curr >= 0) ? curr / 1e7 : -1.0);
+
+        if (d >= 0)
+            wcout << L'/' << d / 1e7;
+
+        if (eta >= 0)
+            wcout << L" eta[sec]=" << eta;
+
+        wcout << L'\n';
     }
 
-    if (last)
-        m_progress = 0;
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        const Stats& s = stages[i];
 
-    //TODO: there's probably a slicker way to do this:
+        __int64 frames = s.samples_out;
+        __int64 busy = s.busy_us;
 
-    assert(m_progress >= 0);
-    assert(m_progress <= 10);
+        for (size_t j = 0; j < m_stages.size(); ++j)
+        {
+            const Stats& prev = m_stages[j];
 
-    const int space = 10 - m_progress;
+            if (wcscmp(prev.name, s.name) == 0)
+            {
+                frames -= prev.samples_out;
+                busy -= prev.busy_us;
+                break;
+            }
+        }
 
-    for (int i = 0; i < m_progress; ++i)
-        wcout << L'.';
+        const double secs = double(interval) / 1e6;
+        const double fps = (secs > 0) ? frames / secs : 0;
+        const double pct = (interval > 0) ? 100.0 * busy / interval : 0;
 
-    for (int i = 0; i < space; ++i)
-        wcout << L' ';
+        if (bJson)
+        {
+            wcout << ((i == 0) ? L"" : L",")
+                  << L"{\"name\":\"" << s.name << L'"'
+                  << L",\"frames\":" << s.samples_out
+                  << L",\"fps\":" << fps
+                  << L",\"busy_pct\":" << pct
+                  << L",\"queue\":" << s.queue_depth
+                  << L",\"queue_peak\":" << s.queue_peak
+                  << L",\"dropped\":" << s.dropped
+                  << L'}';
+        }
+        else
+        {
+            wcout << L"  " << std::left << setw(24) << s.name << std::right
+                  << L" fps=" << fps
+                  << L" busy=" << pct << L'%'
+                  << L" queue=" << s.queue_depth << L'/' << s.queue_peak
+                  << L" dropped=" << s.dropped
+                  << L'\n';
+        }
+    }
 
-    ++m_progress;
+    if (bJson)
+        wcout << L"]}";
 
-    if (m_progress > 10)
-        m_progress = 0;
+    wcout << endl;
 
-    wcout << flush;
+    m_stages.swap(stages);
+    m_stages_time = now;
 }
 
 
@@ -1748,6 +3346,21 @@ App::EnumDemuxFilters(
     IPin* pOutputPin,
     const wchar_t* name) const
 {
+    const wstring key = GetCacheKey(
+                            L"demux",
+                            GetSubtype(pOutputPin),
+                            GetSourceExt(pOutputPin).c_str());
+
+    const IBaseFilterPtr pCached = CreateCachedFilter(key);
+
+    if (bool(pCached))
+    {
+        if (ConnectDemuxFilter(pOutputPin, pCached, name) == S_OK)
+            return pCached;
+
+        m_pGraphCache->Remove(key);
+    }
+
     const GraphUtil::IFilterMapper2Ptr pMapper(CLSID_FilterMapper2);
     assert(bool(pMapper));
 
@@ -1816,41 +3429,164 @@ App::EnumDemuxFilters(
 
         assert(bool(f));
 
-        const IPinPtr pInputPin = GraphUtil::FindInpin(f);
+        hr = ConnectDemuxFilter(pOutputPin, f, name);
 
-        if (!bool(pInputPin))
+        if (hr != S_OK)
             continue;
 
-        hr = m_pGraph->AddFilter(f, name);
+        CacheFilter(key, f);
+        return f;
+    }
+}
+
+
+HRESULT App::ConnectDemuxFilter(
+    IPin* pOutputPin,
+    IBaseFilter* f,
+    const wchar_t* name) const
+{
+    const IPinPtr pInputPin = GraphUtil::FindInpin(f);
+
+    if (!bool(pInputPin))
+        return E_FAIL;
+
+    HRESULT hr = m_pGraph->AddFilter(f, name);
+    assert(SUCCEEDED(hr));
+
+    hr = m_pGraph->ConnectDirect(pOutputPin, pInputPin, 0);
+
+    if (FAILED(hr))
+    {
+        const HRESULT hrRemove = m_pGraph->RemoveFilter(f);
+        hrRemove;
+        assert(SUCCEEDED(hrRemove));
+
+        return hr;
+    }
+
+    IPinPtr pPin = GraphUtil::FindOutpinVideo(f);
+
+    if (!bool(pPin))
+        pPin = GraphUtil::FindOutpinAudio(f);
+
+    if (!bool(pPin))
+    {
+        //TODO: do we need to disconnect here?
+
+        hr = m_pGraph->RemoveFilter(f);
         assert(SUCCEEDED(hr));
 
-        hr = m_pGraph->ConnectDirect(pOutputPin, pInputPin, 0);
+        return VFW_E_NO_ACCEPTABLE_TYPES;
+    }
 
-        if (FAILED(hr))
-        {
-            hr = m_pGraph->RemoveFilter(f);
-            assert(SUCCEEDED(hr));
+    return S_OK;
+}
 
-            continue;
-        }
 
-        IPinPtr pPin = GraphUtil::FindOutpinVideo(f);
+wstring App::GetCacheKey(
+    const wchar_t* link,
+    const GUID& subtype,
+    const wchar_t* ext)
+{
+    wchar_t str[39];
 
-        if (!bool(pPin))
-            pPin = GraphUtil::FindOutpinAudio(f);
+    const int n = StringFromGUID2(subtype, str, 39);
+    n;
+    assert(n == 39);
 
-        if (!bool(pPin))
-        {
-            //TODO: do we need to disconnect here?
+    wstring key = link;
 
-            hr = m_pGraph->RemoveFilter(f);
-            assert(SUCCEEDED(hr));
+    if ((ext != 0) && (*ext != L'\0'))
+    {
+        key += L' ';
 
-            continue;
-        }
+        for (const wchar_t* p = ext; *p; ++p)
+            key += towlower(*p);
+    }
 
-        return f;
+    key += L' ';
+    key += str;
+
+    return key;
+}
+
+
+wstring App::GetSourceExt(IPin* pPin)
+{
+    assert(pPin);
+
+    PIN_INFO info;
+
+    HRESULT hr = pPin->QueryPinInfo(&info);
+
+    if (FAILED(hr))
+        return wstring();
+
+    const GraphUtil::IFileSourceFilterPtr pSource(info.pFilter);
+
+    if (info.pFilter)
+        info.pFilter->Release();
+
+    if (!bool(pSource))
+        return wstring();
+
+    LPOLESTR filename;
+    AM_MEDIA_TYPE mt;
+
+    hr = pSource->GetCurFile(&filename, &mt);
+
+    if (FAILED(hr))
+        return wstring();
+
+    MediaTypeUtil::Destroy(mt);
+
+    wstring ext;
+
+    if (filename)
+    {
+        const wchar_t* const p = wcsrchr(filename, L'.');
+
+        if ((p != 0) && (wcspbrk(p, L"\\/") == 0))
+            ext = p;
+
+        CoTaskMemFree(filename);
+    }
+
+    return ext;
+}
+
+
+GraphUtil::IBaseFilterPtr App::CreateCachedFilter(const wstring& key) const
+{
+    CLSID clsid;
+
+    if (!m_pGraphCache->Find(key, clsid))
+        return 0;
+
+    IBaseFilterPtr f;
+
+    const HRESULT hr = f.CreateInstance(clsid);
+
+    if (FAILED(hr))  //unregistered since
+    {
+        m_pGraphCache->Remove(key);
+        return 0;
     }
+
+    return f;
+}
+
+
+void App::CacheFilter(const wstring& key, IBaseFilter* f) const
+{
+    assert(f);
+
+    CLSID clsid;
+
+    const HRESULT hr = f->GetClassID(&clsid);
+
+    if (SUCCEEDED(hr))
+        m_pGraphCache->Insert(key, clsid);
 }
 
 
@@ -2224,6 +3960,24 @@ HRESULT App::TranscodeAudio(
     if (wfx_demux.wFormatTag == WAVE_FORMAT_PCM)  //weird
         return ConnectVorbisEncoder(pDemuxOutpin, pMuxInpin);
 
+    const wstring key = GetCacheKey(L"adec", mt_demux.subtype);
+
+    const IBaseFilterPtr pCached = CreateCachedFilter(key);
+
+    if (bool(pCached))
+    {
+        const HRESULT hr = ConnectAudioDecoder(
+                            pCached,
+                            wfx_demux,
+                            pDemuxOutpin,
+                            pMuxInpin);
+
+        if (hr == S_OK)
+            return S_OK;
+
+        m_pGraphCache->Remove(key);
+    }
+
     const GraphUtil::IFilterMapper2Ptr pMapper(CLSID_FilterMapper2);
     assert(bool(pMapper));
 
@@ -2270,9 +4024,6 @@ HRESULT App::TranscodeAudio(
     if (FAILED(hr))
         return hr;
 
-    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
-    assert(bool(pBuilder));
-
     for (;;)
     {
         IMonikerPtr m;
@@ -2293,37 +4044,44 @@ HRESULT App::TranscodeAudio(
 
         assert(bool(f));  //we now have our audio decoder
 
-        hr = m_pGraph->AddFilter(f, L"audio decoder");
-        assert(SUCCEEDED(hr));
+        hr = ConnectAudioDecoder(f, wfx_demux, pDemuxOutpin, pMuxInpin);
 
-        const IPinPtr pDecoderInpin = GraphUtil::FindInpin(f);
-        assert(bool(pDecoderInpin));
+        if (hr == S_OK)
+        {
+            CacheFilter(key, f);
+            return S_OK;  //done
+        }
+    }
+}
 
-        hr = pBuilder->Connect(pDemuxOutpin, pDecoderInpin);
 
-        if (FAILED(hr))
-        {
-            hr = m_pGraph->RemoveFilter(f);
-            assert(SUCCEEDED(hr));
+HRESULT App::ConnectAudioDecoder(
+    IBaseFilter* f,
+    const WAVEFORMATEX& wfx_demux,
+    IPin* pDemuxOutpin,
+    IPin* pMuxInpin) const
+{
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
 
-            continue;
-        }
+    HRESULT hr = m_pGraph->AddFilter(f, L"audio decoder");
+    assert(SUCCEEDED(hr));
 
-        const IPinPtr pDecoderOutpin = GraphUtil::FindOutpin(f);
-        assert(bool(pDecoderOutpin));
+    const IPinPtr pDecoderInpin = GraphUtil::FindInpin(f);
+    assert(bool(pDecoderInpin));
 
-        GraphUtil::IEnumMediaTypesPtr emt;
+    hr = pBuilder->Connect(pDemuxOutpin, pDecoderInpin);
 
-        hr = pDecoderOutpin->EnumMediaTypes(&emt);
+    const IPinPtr pDecoderOutpin = GraphUtil::FindOutpin(f);
+    assert(bool(pDecoderOutpin));
 
-        if (FAILED(hr))
-        {
-            hr = m_pGraph->RemoveFilter(f);
-            assert(SUCCEEDED(hr));
+    GraphUtil::IEnumMediaTypesPtr emt;
 
-            continue;
-        }
+    if (SUCCEEDED(hr))
+        hr = pDecoderOutpin->EnumMediaTypes(&emt);
 
+    if (SUCCEEDED(hr))
+    {
         for (;;)
         {
             AM_MEDIA_TYPE* pmt;
@@ -2347,10 +4105,12 @@ HRESULT App::TranscodeAudio(
             if (hr == S_OK)
                 return S_OK;  //done
         }
-
-        hr = m_pGraph->RemoveFilter(f);
-        assert(SUCCEEDED(hr));
     }
+
+    hr = m_pGraph->RemoveFilter(f);
+    assert(SUCCEEDED(hr));
+
+    return VFW_E_NOT_CONNECTED;
 }
 
 
@@ -2383,6 +4143,23 @@ HRESULT App::ConnectVorbisEncoder(
 
 HRESULT App::ConnectVorbisEncoder(IPin* pDecoderOutpin, IPin* pMuxInpin) const
 {
+    const wstring key = GetCacheKey(L"aenc", MEDIASUBTYPE_PCM);
+
+    const IBaseFilterPtr pCached = CreateCachedFilter(key);
+
+    if (bool(pCached))
+    {
+        const HRESULT hr = ConnectEncoderFilter(
+                            pCached,
+                            pDecoderOutpin,
+                            pMuxInpin);
+
+        if (hr == S_OK)
+            return S_OK;
+
+        m_pGraphCache->Remove(key);
+    }
+
     const GraphUtil::IFilterMapper2Ptr pMapper(CLSID_FilterMapper2);
     assert(bool(pMapper));
 
@@ -2421,12 +4198,6 @@ HRESULT App::ConnectVorbisEncoder(IPin* pDecoderOutpin, IPin* pMuxInpin) const
     if (FAILED(hr))
         return hr;
 
-    const GraphUtil::IGraphConfigPtr pConfig(m_pGraph);
-    assert(bool(pConfig));
-
-    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
-    assert(bool(pBuilder));
-
     for (;;)
     {
         IMonikerPtr m;
@@ -2447,22 +4218,32 @@ HRESULT App::ConnectVorbisEncoder(IPin* pDecoderOutpin, IPin* pMuxInpin) const
 
         assert(bool(f));
 
-        hr = m_pGraph->AddFilter(f, L"vorbis encoder");
-        assert(SUCCEEDED(hr));
+        hr = ConnectEncoderFilter(f, pDecoderOutpin, pMuxInpin);
+
+        if (hr == S_OK)
+        {
+            CacheFilter(key, f);
+            return S_OK;
+        }
+    }
+}
 
-        const IPinPtr pEncoderInpin = GraphUtil::FindInpin(f);
-        assert(bool(pEncoderInpin));
 
-        hr = pBuilder->ConnectDirect(pDecoderOutpin, pEncoderInpin, 0);
+HRESULT App::ConnectEncoderFilter(
+    IBaseFilter* f,
+    IPin* pDecoderOutpin,
+    IPin* pMuxInpin) const
+{
+    HRESULT hr = m_pGraph->AddFilter(f, L"vorbis encoder");
+    assert(SUCCEEDED(hr));
 
-        if (FAILED(hr))
-        {
-            hr = m_pGraph->RemoveFilter(f);
-            assert(SUCCEEDED(hr));
+    const IPinPtr pEncoderInpin = GraphUtil::FindInpin(f);
+    assert(bool(pEncoderInpin));
 
-            continue;
-        }
+    hr = m_pGraph->ConnectDirect(pDecoderOutpin, pEncoderInpin, 0);
 
+    if (SUCCEEDED(hr))
+    {
         const IPinPtr pEncoderOutpin = GraphUtil::FindOutpin(f);
         assert(bool(pEncoderOutpin));
 
@@ -2470,10 +4251,13 @@ HRESULT App::ConnectVorbisEncoder(IPin* pDecoderOutpin, IPin* pMuxInpin) const
 
         if (SUCCEEDED(hr))
             return S_OK;
-
-        hr = m_pGraph->RemoveFilter(f);
-        assert(SUCCEEDED(hr));
     }
+
+    const HRESULT hrRemove = m_pGraph->RemoveFilter(f);
+    hrRemove;
+    assert(SUCCEEDED(hrRemove));
+
+    return hr;
 }
 
 
@@ -3125,6 +4909,21 @@ HRESULT App::SetVP8Options(
 }
 
 
+std::wstring App::GetSidecarFileName(const wchar_t* suffix) const
+{
+    wstring path = CmdLine::GetPath(m_cmdline.GetOutputFileName());
+
+    const wstring::size_type pos = path.rfind(L'.');
+
+    if (pos == wstring::npos)
+        path.append(suffix);
+    else
+        path.replace(pos, path.length(), suffix);
+
+    return path;
+}
+
+
 const wchar_t* App::GetStatsFileName()
 {
     wstring path = CmdLine::GetPath(m_cmdline.GetOutputFileName());
@@ -11,14 +11,23 @@
 #include <control.h>
 #include <uuids.h>
 #include "graphutil.h"
+#include "graphcache.h"
 #include "makewebmcmdline.h"
 #include "memfile.h"
+#include "pipesink.h"
+#include "pipelinecounters.h"
 #include <amvideo.h>
 #include <dvdmedia.h>
 #include <list>
+#include <vector>
 
 interface IVP8Encoder;
 
+namespace WebmTranscode
+{
+struct Options;
+}
+
 class App
 {
     App(const App&);
@@ -27,13 +36,34 @@ class App
 public:
 
     App();
+    ~App();
+
     int operator()(int, wchar_t*[]);
 
 private:
 
+    int Run();
+
     CmdLine m_cmdline;
+    std::vector<wchar_t*> m_args;  //argv as passed, since Parse permutes it
+
+    //The output, when it's a pipe.  Declared ahead of the graph, so that
+    //it outlives the muxer that writes to it.
+    PipeSink m_pipe;
+
     GraphUtil::IFilterGraphPtr m_pGraph;
 
+    int RemuxOgg();
+
+    int TranscodeDirect();
+    int CutDirect(const std::vector<CmdLine::Range>&);
+    void GetTranscodeOptions(WebmTranscode::Options&) const;
+    static std::wstring GetWritingApp();
+    static void OnTranscodeProgress(void*, LONGLONG, LONGLONG);
+
+    int CreateGraph();
+    int CreateSourceGraph(IBaseFilter** pDemux);
+
     int LoadGraph();
     int SaveGraph();
 
@@ -47,6 +77,72 @@ private:
 
     int CreateFirstPassGraph(IPin* pDemuxVideo, IPin** pEncoderOutpin);
 
+    //A range of the source, run by an App of its own on a thread of its
+    //own: either a segment of the first pass, or (when it has a filename)
+    //a chunk of a parallel encode.
+
+    struct Segment
+    {
+        std::vector<wchar_t*> args;
+        LONGLONG start;
+        LONGLONG stop;
+        std::wstring filename;  //of the chunk
+        std::vector<BYTE> stats;
+        LONGLONG record_size;
+        int status;
+    };
+
+    int GetSegmentTimes(
+            IPin* pDemuxVideo,
+            int count,
+            std::vector<LONGLONG>& times,
+            LONGLONG& duration);
+
+    int RunSegments(std::vector<Segment>&);
+    int RunFirstPassSegments(IPin* pDemuxVideo);
+    int MergeFirstPassStats(const std::vector<Segment>&);
+
+    int RunParallelChunks(
+            IPin* pDemuxVideo,
+            bool bAudio,
+            IPin** pVideo);
+
+    static unsigned __stdcall SegmentThreadProc(void*);
+    int RunSegment(Segment&);
+    bool m_bSegment;
+    std::wstring m_output_filename;   //of a chunk
+    std::wstring m_stitched_filename;
+
+    //A line of a batch's job list, run by an App of its own on one of
+    //the batch's threads.  Each thread initializes COM once, for all the
+    //jobs it runs, and the jobs share the batch's graph cache.
+
+    struct Job
+    {
+        std::wstring line;
+        std::vector<std::wstring> strs;  //the switches of the line
+        std::vector<wchar_t*> args;      //the batch's, then the line's
+        int status;
+        bool bDone;
+        DWORD time;  //ms
+    };
+
+    struct Batch
+    {
+        std::vector<Job> jobs;
+        volatile LONG next;  //index of the next job to run
+        GraphCache* pGraphCache;
+        bool bScript;
+        CRITICAL_SECTION cs;  //serializes the reports of the jobs
+    };
+
+    int RunBatch();
+    int ReadJobs(std::vector<Job>&) const;
+    static unsigned __stdcall BatchThreadProc(void*);
+    static void ReportJob(Batch&, LONG);
+    int RunJob(Job&);
+    bool m_bJob;
+
     int RunGraph(IMediaSeeking* pSeek);
 
     static bool IsVPX(IPin*);
@@ -64,6 +160,25 @@ private:
         IPin*,
         const wchar_t*) const;
 
+    HRESULT ConnectDemuxFilter(IPin*, IBaseFilter*, const wchar_t*) const;
+
+    //The filters found by enumeration, when a graph cache file is given.
+    //Each lookup that finds a filter which no longer connects removes it.
+
+    GraphCache m_graph_cache;
+    GraphCache* m_pGraphCache;  //the batch's, for a job
+
+    static std::wstring GetCacheKey(
+        const wchar_t* link,
+        const GUID& subtype,
+        const wchar_t* ext = 0);
+
+    static std::wstring GetSourceExt(IPin*);
+
+    GraphUtil::IBaseFilterPtr CreateCachedFilter(const std::wstring&) const;
+
+    void CacheFilter(const std::wstring& key, IBaseFilter*) const;
+
 #if 0
     bool ConnectVideo(IPin*, IPin*) const;
     HRESULT ConnectVideoConverter(IPin*, IPin*) const;
@@ -86,6 +201,14 @@ private:
 
     HRESULT ConnectVorbisEncoder(IPin*, IPin*) const;
 
+    HRESULT ConnectAudioDecoder(
+        IBaseFilter*,
+        const WAVEFORMATEX&,
+        IPin*,
+        IPin*) const;
+
+    HRESULT ConnectEncoderFilter(IBaseFilter*, IPin*, IPin*) const;
+
     static void DumpPreferredMediaTypes(
                     IPin*,
                     const wchar_t*,
@@ -98,6 +221,14 @@ private:
 
     void DisplayProgress(IMediaSeeking*, bool);
 
+    //The stage readings of the last DisplayStages, to give each stage's
+    //rate over the interval since.
+
+    void DisplayStages(IMediaSeeking*, bool);
+    std::vector<webmdshow::PipelineCounters::Stats> m_stages;
+    LONGLONG m_stages_start;  //us
+    LONGLONG m_stages_time;
+
     static void DumpVideoMediaType(const AM_MEDIA_TYPE&);
     static void DumpVideoInfoHeader(const VIDEOINFOHEADER&);
     static void DumpVideoInfoHeader2(const VIDEOINFOHEADER2&);
@@ -107,8 +238,11 @@ private:
 
     HRESULT SetVP8Options(IVP8Encoder*, const AM_MEDIA_TYPE*) const;
 
+    std::wstring GetSidecarFileName(const wchar_t* suffix) const;
+
     const wchar_t* GetStatsFileName();
     std::wstring m_stats_filename;
     MemFile m_stats_file;
+    std::vector<BYTE> m_stats_buf;  //from RunFirstPassSegments
 
 };
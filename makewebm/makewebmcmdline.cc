@@ -13,11 +13,13 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <cwchar>
 #include <sstream>
 #include <windows.h>
 #include <uuids.h>
 #include "versionhandling.h"
 #include "vp8encoderidl.h"
+#include "pipesink.h"
 using std::wcout;
 using std::endl;
 using std::boolalpha;
@@ -32,10 +34,13 @@ CmdLine::CmdLine() :
     m_list(false),
     m_version(false),
     m_script(false),
+    m_stage_stats(false),
+    m_progress_json(false),
     m_verbose(false),
     m_no_video(false),
     m_require_audio(false),
     m_no_audio(false),
+    m_no_graph(false),
     m_live(false),
     m_deadline(-1),
     m_target_bitrate(-1),
@@ -57,6 +62,7 @@ CmdLine::CmdLine() :
     m_lag_in_frames(-1),
     m_token_partitions(-1),
     m_two_pass(-1),
+    m_two_pass_segments(-1),
     m_dropframe_thresh(-1),
     m_resize_allowed(-1),
     m_resize_up_thresh(-1),
@@ -70,7 +76,14 @@ CmdLine::CmdLine() :
     m_arnr_strength(-1),
     m_arnr_type(-1),
     m_ogg_to_webm(-1),
-    m_cpu_used(-17)
+    m_parallel_chunks(-1),
+    m_cpu_used(-17),
+    m_cut(false),
+    m_cut_start(0),
+    m_cut_stop(-1),
+    m_graph_cache(0),
+    m_batch(0),
+    m_batch_jobs(-1)
 {
 }
 
@@ -81,7 +94,12 @@ void CmdLine::PrintUsage() const
 
     wcout << L"  -i, --input                     input filename\n"
           << L"  --audio-input                   audio input filename\n"
-          << L"  -o, --output                    output filename\n"
+          << L"  -o, --output                    "
+          << L"output filename, or - for stdout\n"
+          << L"  --cut                           "
+          << L"copy start[,stop] (in sec) of the input\n"
+          << L"  --append                        "
+          << L"join file[@start[,stop]] after the input\n"
           << L"  --deadline                      "
           << L"max time for frame encode (in microseconds)\n"
           << L"  --decoder-buffer-size           "
@@ -114,6 +132,10 @@ void CmdLine::PrintUsage() const
           << L"quit if no audio encoder available\n"
           << L"  --no-audio                      "
           << L"do not render audio (if present)\n"
+          << L"  --no-graph                      "
+          << L"transcode WebM without a filter graph\n"
+          << L"  --parallel-chunks               "
+          << L"encode video as parallel chunks\n"
           << L"  --resize-allowed                spatial resampling\n"
           << L"  --resize-up-threshold           "
           << L"spatial resampling up threshold\n"
@@ -121,14 +143,26 @@ void CmdLine::PrintUsage() const
           << L"spatial resampling down threshold\n"
           << L"  --script-mode                   "
           << L"print progress in script-friendly way\n"
+          << L"  --stage-stats                   "
+          << L"print per-stage fps, queues and ETA\n"
+          << L"  --progress-json                 "
+          << L"print stage progress as JSON lines\n"
           << L"  --save-graph                    "
           << L"save graph as GraphEdit storage file (*.grf)\n"
+          << L"  --graph-cache                   "
+          << L"file of filters found, to reuse for like inputs\n"
+          << L"  --batch                         "
+          << L"run each line of a job list file (- for stdin)\n"
+          << L"  --batch-jobs                    "
+          << L"number of batch jobs to run at once\n"
           << L"  --target-bitrate                "
           << L"target bandwidth (in kilobits/second)\n"
           << L"  --thread-count                  "
           << L"number of threads to use for VP8 encoding\n"
           << L"  --token-partitions              number of sub-streams\n"
           << L"  --two-pass                      two-pass encoding\n"
+          << L"  --two-pass-segments             "
+          << L"run the first pass as parallel segments\n"
           << L"  --two-pass-vbr-bias-pct         CBR/VBR bias\n"
           << L"  --two-pass-vbr-minsection-pct   minimum bitrate\n"
           << L"  --two-pass-vbr-maxsection-pct   maximum bitrate\n"
@@ -175,7 +209,13 @@ void CmdLine::PrintUsage() const
           << L"The output filename may be specified as either a switch\n"
           << L"value or command-line argument, but it may also be omitted.\n"
           << L"If omitted, its value is synthesized from the input "
-          << L"filename.\n";
+          << L"filename.\n"
+          << L'\n'
+          << L"An output of - (the standard output) or of\n"
+          << L"\\\\.\\pipe\\name (a named pipe that the reader has made) is\n"
+          << L"written as it is made: a live mux, whose clusters are\n"
+          << L"written with their sizes, and with no cues, since nothing\n"
+          << L"is rewritten.  Messages then go to the standard error.\n";
 
     wcout << L'\n'
           << L"The deadline value specifies the maximum amount of time\n"
@@ -186,6 +226,20 @@ void CmdLine::PrintUsage() const
           << L"  1 (or \"realtime\") means real-time encoding\n"
           << L"  1000000 (or \"good\") means good quality (the default)\n";
 
+    wcout << L'\n'
+          << L"The cut and append switches join ranges of WebM files\n"
+          << L"without a filter graph.  The blocks of each range are\n"
+          << L"copied; only the frames between its start and its first\n"
+          << L"keyframe are re-encoded.  The append switch may be given\n"
+          << L"more than once, and the ranges are joined in that order.\n";
+
+    wcout << L'\n'
+          << L"The batch switch runs many jobs in one process.  Each line\n"
+          << L"of the job list holds the input and output (and any other\n"
+          << L"switches) of a job; the switches of the command line apply\n"
+          << L"to every job.  Blank lines, and lines that begin with #, are\n"
+          << L"ignored.  The time of each job is printed as it finishes.\n";
+
     wcout << '\n'
           << "TODO: MORE PARAMS TO BE DESCRIBED HERE\n";
 
@@ -269,6 +323,26 @@ int CmdLine::Parse(int argc, wchar_t* argv[])
         return 1;  //soft error
     }
 
+    if (m_batch)  //the inputs and outputs are on the lines of the job list
+    {
+        if ((m_input != 0) || (m_output != 0) || (i < j))
+        {
+            wcout << L"The batch switch does not accept an input"
+                  << L" or output on the command line."
+                  << endl;
+
+            return 1;
+        }
+
+        if (m_list)
+        {
+            ListArgs();
+            return 1;
+        }
+
+        return 0;
+    }
+
     if (m_input == 0)  //not specified as switch
     {
         if (i >= j)  //no args remain
@@ -310,6 +384,57 @@ int CmdLine::Parse(int argc, wchar_t* argv[])
 #endif
     }
 
+    if (GetPipeOutput())
+    {
+        //A pipe can't be read back or rewritten, so only the single-pass
+        //graph, with the muxer in live mode, can write to it.
+
+        const bool bPipe = (m_ogg_to_webm <= 0) &&
+                           !m_no_graph &&
+                           !m_cut &&
+                           m_appends.empty() &&
+                           (m_parallel_chunks < 0) &&
+                           (m_two_pass < 1) &&
+                           (m_save_graph_file_ptr == 0);
+
+        if (!bPipe)
+        {
+            wcout << L"Pipe output is not supported with the ogg-to-webm,"
+                  << L" no-graph, cut, append, parallel-chunks, two-pass"
+                  << L" or save-graph switches."
+                  << endl;
+
+            return 1;
+        }
+    }
+
+    if ((m_parallel_chunks >= 0) && (m_two_pass >= 1))
+    {
+        wcout << L"The parallel-chunks switch"
+              << L" is not supported in two-pass mode."
+              << endl;
+
+        return 1;
+    }
+
+    if ((m_parallel_chunks >= 0) && m_save_graph_file_ptr)
+    {
+        wcout << L"Unable to save GraphEdit storage file"
+              << L" with parallel chunks."
+              << endl;
+
+        return 1;
+    }
+
+    if ((m_two_pass_segments >= 0) && (m_two_pass < 1))
+    {
+        wcout << L"The two-pass-segments switch"
+              << L" requires two-pass mode."
+              << endl;
+
+        return 1;
+    }
+
     if (m_save_graph_file_ptr)  //had a request
     {
         if (m_two_pass >= 1)  //two-pass requested
@@ -799,6 +924,18 @@ int CmdLine::ParseLongPost(
         return 1;
     }
 
+    if (_wcsnicmp(arg, L"no-graph", len) == 0)
+    {
+        if (has_value)
+        {
+            wcout << "The no-graph switch does not accept a value." << endl;
+            return -1;  //error
+        }
+
+        m_no_graph = true;
+        return 1;
+    }
+
     if (_wcsnicmp(arg, L"live", len) == 0)
     {
         if (has_value)
@@ -835,6 +972,31 @@ int CmdLine::ParseLongPost(
         return 1;
     }
 
+    if (_wcsnicmp(arg, L"stage-stats", len) == 0)
+    {
+        if (has_value)
+        {
+            wcout << "Stage-stats switch does not accept a value." << endl;
+            return -1;  //error
+        }
+
+        m_stage_stats = true;
+        return 1;
+    }
+
+    if (_wcsnicmp(arg, L"progress-json", len) == 0)
+    {
+        if (has_value)
+        {
+            wcout << "Progress-json switch does not accept a value." << endl;
+            return -1;  //error
+        }
+
+        m_stage_stats = true;
+        m_progress_json = true;
+        return 1;
+    }
+
     if (_wcsnicmp(arg, L"usage", len) == 0)
     {
         if (has_value)
@@ -1464,6 +1626,21 @@ int CmdLine::ParseLongPost(
 
     status = ParseOpt(i, arg, len, L"ogg-to-webm", m_ogg_to_webm, 0, 1, 1);
 
+    if (status)
+        return status;
+
+    //A count of 0 means one chunk per processor.
+
+    status = ParseOpt(
+                i,
+                arg,
+                len,
+                L"parallel-chunks",
+                m_parallel_chunks,
+                0,
+                MAXIMUM_WAIT_OBJECTS,
+                0);
+
     if (status)
         return status;
 
@@ -1504,6 +1681,72 @@ int CmdLine::ParseLongPost(
     if (status)
         return status;
 
+    if (_wcsnicmp(arg, L"graph-cache", len) == 0)
+    {
+        if (has_value)
+        {
+            m_graph_cache = arg + len + 1;
+
+            if (wcslen(m_graph_cache) == 0)
+            {
+                wcout << "Empty value specified for graph-cache switch."
+                      << endl;
+
+                return -1;  //error
+            }
+
+            return 1;
+        }
+
+        m_graph_cache = *++i;
+
+        if (m_graph_cache == 0)
+        {
+            wcout << "No filename specified for graph-cache switch." << endl;
+            return -1;  //error
+        }
+
+        return 2;
+    }
+
+    if (_wcsnicmp(arg, L"batch", len) == 0)
+    {
+        m_batch_args.push_back(param);
+
+        if (has_value)
+        {
+            m_batch = arg + len + 1;
+
+            if (wcslen(m_batch) == 0)
+            {
+                wcout << "Empty value specified for batch switch." << endl;
+                return -1;  //error
+            }
+
+            return 1;
+        }
+
+        m_batch = *++i;
+
+        if (m_batch == 0)
+        {
+            wcout << "No job list specified for batch switch." << endl;
+            return -1;  //error
+        }
+
+        m_batch_args.push_back(m_batch);
+
+        return 2;
+    }
+
+    status = ParseOpt(i, arg, len, L"batch-jobs", m_batch_jobs, 1, -1);
+
+    if (status > 0)
+        m_batch_args.insert(m_batch_args.end(), i, i + status);
+
+    if (status)
+        return status;
+
     if (_wcsnicmp(arg, L"save-graph", len) == 0)
     {
         const wchar_t*& f = m_save_graph_file_ptr;
@@ -1556,6 +1799,21 @@ int CmdLine::ParseLongPost(
 
     status = ParseOpt(i, arg, len, L"two-pass", m_two_pass, 0, 1, 1);
 
+    if (status)
+        return status;
+
+    //A count of 0 means one segment per processor.
+
+    status = ParseOpt(
+                i,
+                arg,
+                len,
+                L"two-pass-segments",
+                m_two_pass_segments,
+                0,
+                MAXIMUM_WAIT_OBJECTS,
+                0);
+
     if (status)
         return status;
 
@@ -1637,6 +1895,49 @@ int CmdLine::ParseLongPost(
     if (status)
         return status;
 
+    if (_wcsnicmp(arg, L"cut", len) == 0)
+    {
+        const wchar_t* const value = has_value ? arg + len + 1 : *++i;
+
+        if ((value == 0) || !ParseRange(value, m_cut_start, m_cut_stop))
+        {
+            wcout << "Bad value specified for cut switch." << endl;
+            return -1;  //error
+        }
+
+        m_cut = true;
+        return has_value ? 1 : 2;
+    }
+
+    if (_wcsnicmp(arg, L"append", len) == 0)
+    {
+        const wchar_t* const value = has_value ? arg + len + 1 : *++i;
+
+        if ((value == 0) || (*value == L'\0'))
+        {
+            wcout << "No filename specified for append switch." << endl;
+            return -1;  //error
+        }
+
+        Append a;
+
+        a.start = 0;
+        a.stop = -1;
+
+        //The range follows the last '@', if what follows it is one;
+        //otherwise the '@' is part of the filename.
+
+        const wchar_t* const at = wcsrchr(value, L'@');
+
+        if ((at != 0) && ParseRange(at + 1, a.start, a.stop))
+            a.filename.assign(value, at);
+        else
+            a.filename = value;
+
+        m_appends.push_back(a);
+        return has_value ? 1 : 2;
+    }
+
     wcout << "Unknown switch: " << *i
           << "\nUse /help or --help to get usage info."
           << endl;
@@ -1663,18 +1964,64 @@ const wchar_t* CmdLine::GetOutputFileName() const
 }
 
 
+bool CmdLine::GetPipeOutput() const
+{
+    return PipeSink::IsPipeName(m_output);
+}
+
+
 const wchar_t* CmdLine::GetSaveGraphFile() const
 {
     return m_save_graph_file_ptr;
 }
 
 
+const wchar_t* CmdLine::GetGraphCacheFile() const
+{
+    return m_graph_cache;
+}
+
+
+const wchar_t* CmdLine::GetBatchFile() const
+{
+    return m_batch;
+}
+
+
+int CmdLine::GetBatchJobs() const
+{
+    return m_batch_jobs;
+}
+
+
+bool CmdLine::IsBatchArg(const wchar_t* arg) const
+{
+    typedef std::vector<const wchar_t*>::const_iterator iter_t;
+
+    const iter_t i = std::find(m_batch_args.begin(), m_batch_args.end(), arg);
+
+    return (i != m_batch_args.end());
+}
+
+
 bool CmdLine::ScriptMode() const
 {
     return m_script;
 }
 
 
+bool CmdLine::GetStageStats() const
+{
+    return m_stage_stats;
+}
+
+
+bool CmdLine::GetProgressJson() const
+{
+    return m_progress_json;
+}
+
+
 bool CmdLine::GetList() const
 {
     return m_list;
@@ -1704,6 +2051,12 @@ bool CmdLine::GetNoAudio() const
     return m_no_audio;
 }
 
+
+bool CmdLine::GetNoGraph() const
+{
+    return m_no_graph;
+}
+
 bool CmdLine::GetLive() const
 {
     return m_live;
@@ -1854,6 +2207,12 @@ int CmdLine::GetTwoPass() const
 }
 
 
+int CmdLine::GetTwoPassSegments() const
+{
+    return m_two_pass_segments;
+}
+
+
 int CmdLine::GetTwoPassVbrBiasPct() const
 {
     return m_two_pass_vbr_bias_pct;
@@ -1896,11 +2255,77 @@ int CmdLine::GetOggToWebm() const
     return m_ogg_to_webm;
 }
 
+int CmdLine::GetParallelChunks() const
+{
+    return m_parallel_chunks;
+}
+
 int CmdLine::GetCPUUsed() const
 {
     return m_cpu_used;
 }
 
+void CmdLine::GetRanges(std::vector<Range>& ranges) const
+{
+    ranges.clear();
+
+    if (!m_cut && m_appends.empty())
+        return;
+
+    Range r;
+
+    r.filename = m_input;
+    r.start = m_cut_start;
+    r.stop = m_cut_stop;
+
+    ranges.push_back(r);
+
+    typedef std::vector<Append>::const_iterator iter_t;
+
+    for (iter_t i = m_appends.begin(); i != m_appends.end(); ++i)
+    {
+        r.filename = i->filename.c_str();
+        r.start = i->start;
+        r.stop = i->stop;
+
+        ranges.push_back(r);
+    }
+}
+
+
+//Parses start[,stop], in seconds.  The values are left as they are if
+//the string isn't one.
+
+bool CmdLine::ParseRange(const wchar_t* str, double& start, double& stop)
+{
+    wchar_t* end;
+
+    const double t0 = wcstod(str, &end);
+
+    if ((end == str) || (t0 < 0))
+        return false;
+
+    double t1 = -1;
+
+    if (*end == L',')
+    {
+        const wchar_t* const str_stop = end + 1;
+
+        t1 = wcstod(str_stop, &end);
+
+        if ((end == str_stop) || (t1 <= t0))
+            return false;
+    }
+
+    if (*end != L'\0')
+        return false;
+
+    start = t0;
+    stop = t1;
+
+    return true;
+}
+
 void CmdLine::PrintVersion() const
 {
     wcout << "makewebm ";
@@ -1979,11 +2404,35 @@ void CmdLine::ListArgs() const
     else
         wcout << m_save_graph_file_ptr << L'\n';
 
+    wcout << L"graph-cache: ";
+
+    if (m_graph_cache == 0)
+        wcout << "(no graph cache file specified)\n";
+    else
+        wcout << L"\"" << m_graph_cache << L"\"\n";
+
+    wcout << L"batch      : ";
+
+    if (m_batch == 0)
+        wcout << "(no job list specified)\n";
+    else
+        wcout << L"\"" << m_batch << L"\"\n";
+
+    wcout << L"batch-jobs : ";
+
+    if (m_batch_jobs < 0)
+        wcout << "(one for each processor)\n";
+    else
+        wcout << m_batch_jobs << L'\n';
+
     wcout << L"script-mode  : " << boolalpha << m_script << L'\n';
+    wcout << L"stage-stats  : " << boolalpha << m_stage_stats << L'\n';
+    wcout << L"progress-json: " << boolalpha << m_progress_json << L'\n';
     wcout << L"verbose      : " << boolalpha << m_verbose << L'\n';
     wcout << L"no-video     : " << boolalpha << m_no_video << L'\n';
     wcout << L"require-audio: " << boolalpha << m_require_audio << L'\n';
     wcout << L"no-audio     : " << boolalpha << m_no_audio << L'\n';
+    wcout << L"no-graph     : " << boolalpha << m_no_graph << L'\n';
     wcout << L"live         : " << boolalpha << m_live << L'\n';
 
     if (m_deadline >= 0)
@@ -2129,6 +2578,34 @@ void CmdLine::ListArgs() const
     if (m_two_pass >= 0)
         wcout << L"two-pass: " << m_two_pass << L'\n';
 
+    if (m_two_pass_segments >= 0)
+        wcout << L"two-pass-segments: " << m_two_pass_segments << L'\n';
+
+    if (m_parallel_chunks >= 0)
+        wcout << L"parallel-chunks: " << m_parallel_chunks << L'\n';
+
+    if (m_cut)
+    {
+        wcout << L"cut: " << m_cut_start;
+
+        if (m_cut_stop >= 0)
+            wcout << L',' << m_cut_stop;
+
+        wcout << L'\n';
+    }
+
+    typedef std::vector<Append>::const_iterator iter_t;
+
+    for (iter_t i = m_appends.begin(); i != m_appends.end(); ++i)
+    {
+        wcout << L"append: \"" << i->filename << L"\" " << i->start;
+
+        if (i->stop >= 0)
+            wcout << L',' << i->stop;
+
+        wcout << L'\n';
+    }
+
     if (m_two_pass_vbr_bias_pct >= 0)
         wcout << L"two-pass-vbr-bias-pct: "
               << m_two_pass_vbr_bias_pct
@@ -10,6 +10,7 @@
 #include <string>
 //#include <limits>
 #include <climits>
+#include <vector>
 
 class CmdLine
 {
@@ -25,12 +26,19 @@ public:
     const wchar_t* GetInputFileName() const;
     const wchar_t* GetAudioInputFileName() const;
     const wchar_t* GetOutputFileName() const;
+
+    //Whether the output is the standard output ("-") or a named pipe,
+    //which are written as a live mux, with nothing rewritten.
+    bool GetPipeOutput() const;
     bool ScriptMode() const;
+    bool GetStageStats() const;
+    bool GetProgressJson() const;
     bool GetList() const;
     bool GetVerbose() const;
     bool GetNoVideo() const;
     bool GetRequireAudio() const;
     bool GetNoAudio() const;
+    bool GetNoGraph() const;
     bool GetLive() const;
     int GetDeadline() const;
     int GetTargetBitrate() const;
@@ -55,6 +63,7 @@ public:
     int GetLagInFrames() const;
     int GetTokenPartitions() const;
     int GetTwoPass() const;
+    int GetTwoPassSegments() const;
     int GetTwoPassVbrBiasPct() const;
     int GetTwoPassVbrMinsectionPct() const;
     int GetTwoPassVbrMaxsectionPct() const;
@@ -63,10 +72,31 @@ public:
     int GetARNRStrength() const;
     int GetARNRType() const;
     const wchar_t* GetSaveGraphFile() const;
+    const wchar_t* GetGraphCacheFile() const;
+    const wchar_t* GetBatchFile() const;
+    int GetBatchJobs() const;
+
+    //Whether the arg is one of the batch switches (or their values), that
+    //are left out of the command line of each job.
+    bool IsBatchArg(const wchar_t*) const;
     int GetOggToWebm() const;
+    int GetParallelChunks() const;
     int GetCPUUsed() const;
     int GetEncoderKind() const;
 
+    //A range of an input file, for the cut and append switches.
+
+    struct Range
+    {
+        const wchar_t* filename;
+        double start;  //seconds
+        double stop;   //seconds, or -1 for the end of the file
+    };
+
+    //The ranges to join into the output, the input's first.  There are
+    //none unless the cut or the append switch was given.
+    void GetRanges(std::vector<Range>&) const;
+
     static std::wstring GetPath(const wchar_t*);
 
 private:
@@ -82,9 +112,12 @@ private:
     bool m_no_video;
     bool m_require_audio;
     bool m_no_audio;
+    bool m_no_graph;
     bool m_live;
 
     bool m_script;
+    bool m_stage_stats;
+    bool m_progress_json;
     bool m_verbose;
     int m_deadline;
     int m_target_bitrate;
@@ -110,6 +143,7 @@ private:
     int m_lag_in_frames;
     int m_token_partitions;
     int m_two_pass;
+    int m_two_pass_segments;
     int m_two_pass_vbr_bias_pct;
     int m_two_pass_vbr_minsection_pct;
     int m_two_pass_vbr_maxsection_pct;
@@ -118,11 +152,31 @@ private:
     int m_arnr_strength;
     int m_arnr_type;
     int m_ogg_to_webm;
+    int m_parallel_chunks;
     int m_cpu_used;
 
+    bool m_cut;
+    double m_cut_start;
+    double m_cut_stop;
+
+    struct Append
+    {
+        std::wstring filename;
+        double start;
+        double stop;
+    };
+
+    std::vector<Append> m_appends;
+
     std::wstring m_save_graph_file_str;
     const wchar_t* m_save_graph_file_ptr;
 
+    const wchar_t* m_graph_cache;
+
+    const wchar_t* m_batch;
+    int m_batch_jobs;
+    std::vector<const wchar_t*> m_batch_args;
+
     static bool IsSwitch(const wchar_t*);
     int Parse(wchar_t**);
     int ParseShort(wchar_t**);
@@ -134,6 +188,7 @@ private:
     void ListArgs() const;
     void SynthesizeOutput();
     void SynthesizeSaveGraph();
+    static bool ParseRange(const wchar_t*, double& start, double& stop);
 
 //doesn't compile for some reason
 //    enum { kValueIsRequired = std::numeric_limits<int>::min() };
@@ -0,0 +1,609 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <vfwmsgs.h>
+#include "oggremux.h"
+#include "oggfile.h"
+#include "webmconstants.h"
+#include "webmmuxebmlio.h"
+#include "webmmuxfilestream.h"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using oggparser::IOggReader;
+using oggparser::OggStream;
+using oggparser::VorbisIdent;
+
+namespace
+{
+
+typedef std::vector<BYTE> bytes_t;
+
+enum { kTrackNumber = 1 };
+enum { kTimecodeScale = 1000000 };  //ns, so timecodes are in ms
+enum { kClusterDuration = 5000 };   //ms, as the muxer has for audio
+
+//SeekHead ID and size (5), and three entries of 21 bytes each
+enum { kSeekHeadSize = 5 + 3 * 21 };
+
+enum
+{
+    kSimpleBlockID = 0xA3,
+    kCuesID = 0x1C53BB6B,
+    kCuePointID = 0xBB,
+    kCueTimeID = 0xB3,
+    kCueTrackPositionsID = 0xB7,
+    kCueTrackID = 0xF7,
+    kCueClusterPositionID = 0xF1
+};
+
+struct CuePoint
+{
+    ULONG time;
+    __int64 pos;  //of the cluster, relative to the segment's payload
+};
+
+typedef std::vector<CuePoint> cues_t;
+
+
+void WriteID(EbmlIO::File& f, ULONG id)
+{
+    if (id > WebmUtil::kEbmlMaxID3)
+        f.WriteID4(id);
+    else if (id > WebmUtil::kEbmlMaxID2)
+        f.WriteID3(id);
+    else if (id > WebmUtil::kEbmlMaxID1)
+        f.WriteID2(static_cast<USHORT>(id));
+    else
+        f.WriteID1(static_cast<BYTE>(id));
+}
+
+
+void WriteUInt(EbmlIO::File& f, ULONG id, __int64 val)
+{
+    WriteID(f, id);
+
+    const BYTE size = EbmlIO::File::GetSerializeUIntSize(val);
+
+    f.Write1UInt(size);
+    f.SerializeUInt(val, size);
+}
+
+
+//Writes the ID of a master element and a placeholder for its size, and
+//returns the position of the placeholder, for EndElement to patch once
+//the payload has been written.
+
+__int64 BeginElement(EbmlIO::File& f, ULONG id)
+{
+    WriteID(f, id);
+
+    const __int64 pos = f.GetPosition();
+    f.Write4UInt(0);
+
+    return pos;
+}
+
+
+void EndElement(EbmlIO::File& f, __int64 size_pos)
+{
+    const __int64 pos = f.GetPosition();
+    const __int64 size = pos - (size_pos + 4);
+    assert(size >= 0);
+    assert(size <= 0x0FFFFFFE);
+
+    f.SetPosition(size_pos);
+    f.Write4UInt(static_cast<ULONG>(size));
+    f.SetPosition(pos);
+}
+
+
+void PutLace(bytes_t& buf, long len)
+{
+    while (len >= 255)
+    {
+        buf.push_back(255);
+        len -= 255;
+    }
+
+    buf.push_back(static_cast<BYTE>(len));
+}
+
+
+ULONG GetTime(long long granule_pos, ULONG rate)
+{
+    assert(granule_pos >= 0);
+    assert(rate > 0);
+
+    return static_cast<ULONG>(granule_pos * 1000 / rate);  //ms
+}
+
+
+//The three Vorbis headers, Xiph-laced, as the muxer writes them.
+
+HRESULT GetCodecPrivate(
+    IOggReader* pReader,
+    const OggStream::Packet* hdrs,
+    bytes_t& buf)
+{
+    long lens[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        lens[i] = hdrs[i].GetLength();
+
+        if (lens[i] <= 0)
+            return VFW_E_INVALID_FILE_FORMAT;
+    }
+
+    buf.clear();
+    buf.push_back(2);  //number of headers - 1
+
+    PutLace(buf, lens[0]);
+    PutLace(buf, lens[1]);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const bytes_t::size_type off = buf.size();
+        buf.resize(off + lens[i]);
+
+        if (hdrs[i].Copy(pReader, &buf[off]) != lens[i])
+            return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+void WriteEbmlHeader(EbmlIO::File& f)
+{
+    const __int64 pos = BeginElement(f, WebmUtil::kEbmlID);
+
+    WriteUInt(f, WebmUtil::kEbmlVersionID, 1);
+    WriteUInt(f, WebmUtil::kEbmlReadVersionID, 1);
+    WriteUInt(f, WebmUtil::kEbmlMaxIDLengthID, 4);
+    WriteUInt(f, WebmUtil::kEbmlMaxSizeLengthID, 8);
+
+    f.WriteID2(WebmUtil::kEbmlDocTypeID);
+    f.Write1String("webm");
+
+    WriteUInt(f, WebmUtil::kEbmlDocTypeVersionID, 2);
+    WriteUInt(f, WebmUtil::kEbmlDocTypeReadVersionID, 2);
+
+    EndElement(f, pos);
+}
+
+
+//Returns the position of the Duration payload, which is patched once
+//the length of the stream is known.
+
+__int64 WriteInfo(EbmlIO::File& f, const wchar_t* writing_app)
+{
+    const __int64 pos = BeginElement(f, WebmUtil::kEbmlSegmentInfoID);
+
+    WriteUInt(f, WebmUtil::kEbmlTimeCodeScaleID, kTimecodeScale);
+
+    f.WriteID2(WebmUtil::kEbmlDurationID);
+    f.Write1UInt(4);
+
+    const __int64 duration_pos = f.GetPosition();
+    f.Serialize4Float(0);
+
+    if (writing_app)
+    {
+        f.WriteID2(WebmUtil::kEbmlMuxingAppID);
+        f.Write1UTF8(writing_app);
+
+        f.WriteID2(WebmUtil::kEbmlWritingAppID);
+        f.Write1UTF8(writing_app);
+    }
+
+    EndElement(f, pos);
+
+    return duration_pos;
+}
+
+
+void WriteTracks(
+    EbmlIO::File& f,
+    const VorbisIdent& ident,
+    const bytes_t& codec_private)
+{
+    const __int64 tracks_pos = BeginElement(f, WebmUtil::kEbmlTracksID);
+    const __int64 entry_pos = BeginElement(f, WebmUtil::kEbmlTrackEntryID);
+
+    WriteUInt(f, WebmUtil::kEbmlTrackNumberID, kTrackNumber);
+
+    //As the muxer does, we keep the UID to 7 bytes.
+
+    __int64 uid = 0;
+
+    for (int i = 0; i < 7; ++i)
+        uid = (uid << 8) | ((rand() >> 4) & 0xFF);
+
+    if (uid == 0)
+        uid = 1;
+
+    WriteUInt(f, WebmUtil::kEbmlTrackUIDID, uid);
+    WriteUInt(f, WebmUtil::kEbmlTrackTypeID, WebmUtil::kEbmlTrackTypeAudio);
+
+    f.WriteID1(WebmUtil::kEbmlCodecIDID);
+    f.Write1String("A_VORBIS");
+
+    const ULONG cb = static_cast<ULONG>(codec_private.size());
+    assert(cb > 0);
+
+    f.WriteID2(WebmUtil::kEbmlCodecPrivateID);
+    f.WriteUInt(cb);
+    f.Write(&codec_private[0], cb);
+
+    const __int64 audio_pos = BeginElement(f, WebmUtil::kEbmlAudioSettingsID);
+
+    f.WriteID1(WebmUtil::kEbmlSamplingFrequencyID);
+    f.Write1UInt(4);
+    f.Serialize4Float(static_cast<float>(ident.sample_rate));
+
+    WriteUInt(f, WebmUtil::kEbmlChannelsID, ident.channels);
+
+    EndElement(f, audio_pos);
+    EndElement(f, entry_pos);
+    EndElement(f, tracks_pos);
+}
+
+
+//The packets that end on one page, as one Xiph-laced SimpleBlock.
+//Packets that lie in a page we have read are written from its buffer;
+//the rest (those that span pages) are assembled in buf.
+
+HRESULT WriteBlock(
+    EbmlIO::File& f,
+    IOggReader* pReader,
+    const OggStream::packets_t& pkts,
+    SHORT timecode,
+    bytes_t& lace,
+    bytes_t& buf)
+{
+    const OggStream::packets_t::size_type n = pkts.size();
+    assert(n > 0);
+
+    if (n > 256)  //a page ends at most 255 packets, plus a continued one
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    lace.clear();
+    lace.push_back(static_cast<BYTE>(n - 1));  //biased count
+
+    __int64 size = 0;
+
+    for (OggStream::packets_t::size_type i = 0; i < n; ++i)
+    {
+        const long len = pkts[i].GetLength();
+
+        if (len <= 0)
+            return VFW_E_INVALID_FILE_FORMAT;
+
+        if ((i + 1) < n)  //size of last frame is implied
+            PutLace(lace, len);
+
+        size += len;
+    }
+
+    size += 1 + 2 + 1 + lace.size();  //track, timecode, flags, lacing
+
+    f.WriteID1(kSimpleBlockID);
+    f.WriteUInt(size);
+    f.Write1UInt(kTrackNumber);
+    f.Serialize2SInt(timecode);
+
+    const BYTE flags = BYTE(1 << 7) | BYTE(1 << 1);  //key, Xiph lacing
+    f.Write(&flags, 1);
+
+    f.Write(&lace[0], static_cast<ULONG>(lace.size()));
+
+    for (OggStream::packets_t::size_type i = 0; i < n; ++i)
+    {
+        const OggStream::Packet& pkt = pkts[i];
+        const long len = pkt.GetLength();
+
+        if (const unsigned char* const p = pkt.GetData())
+        {
+            f.Write(p, len);
+            continue;
+        }
+
+        buf.resize(len);
+
+        if (pkt.Copy(pReader, &buf[0]) != len)
+            return E_FAIL;
+
+        f.Write(&buf[0], len);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT WriteClusters(
+    EbmlIO::File& f,
+    OggStream& stream,
+    ULONG rate,
+    __int64 segment_start,
+    HANDLE hQuit,
+    cues_t& cues,
+    ULONG& duration)
+{
+    OggStream::packets_t pkts;
+    bytes_t lace;
+    bytes_t buf;
+
+    long long granule_pos = 0;  //leading edge of the next block
+
+    __int64 cluster_size_pos = -1;
+    ULONG cluster_time = 0;
+
+    HRESULT hr = S_OK;
+
+    for (;;)
+    {
+        //The stream hands the packet off into our queue, so that its
+        //descriptors (and their page references) aren't copied.
+
+        pkts.push_back(OggStream::Packet());
+
+        const long result = stream.GetPacket(pkts.back());
+
+        if (result < 0)
+        {
+            pkts.pop_back();
+
+            if (result != oggparser::E_END_OF_FILE)
+                hr = VFW_E_INVALID_FILE_FORMAT;
+
+            //Packets after the last granule pos (in a truncated file)
+            //cannot be timed, and are dropped, as the source does.
+
+            break;
+        }
+
+        const long long next_granule_pos = pkts.back().granule_pos;
+
+        if (next_granule_pos < 0)  //the block ends on a later page
+            continue;
+
+        if (next_granule_pos < granule_pos)
+        {
+            hr = VFW_E_INVALID_FILE_FORMAT;
+            break;
+        }
+
+        const ULONG t = GetTime(granule_pos, rate);
+
+        if ((cluster_size_pos < 0) || ((t - cluster_time) >= kClusterDuration))
+        {
+            if (cluster_size_pos >= 0)
+                EndElement(f, cluster_size_pos);
+
+            if (hQuit && (WaitForSingleObject(hQuit, 0) == WAIT_OBJECT_0))
+                return E_ABORT;
+
+            const CuePoint cp = { t, f.GetPosition() - segment_start };
+            cues.push_back(cp);
+
+            cluster_size_pos = BeginElement(f, WebmUtil::kEbmlClusterID);
+            cluster_time = t;
+
+            WriteUInt(f, WebmUtil::kEbmlTimeCodeID, cluster_time);
+        }
+
+        const SHORT tc = static_cast<SHORT>(t - cluster_time);
+
+        hr = WriteBlock(f, stream.m_pReader, pkts, tc, lace, buf);
+
+        if (FAILED(hr))
+            break;
+
+        pkts.clear();
+        granule_pos = next_granule_pos;
+    }
+
+    if (cluster_size_pos >= 0)
+        EndElement(f, cluster_size_pos);
+
+    duration = GetTime(granule_pos, rate);
+
+    return hr;
+}
+
+
+void WriteCues(EbmlIO::File& f, const cues_t& cues)
+{
+    const __int64 cues_pos = BeginElement(f, kCuesID);
+
+    for (cues_t::size_type i = 0; i < cues.size(); ++i)
+    {
+        const CuePoint& cp = cues[i];
+
+        const __int64 point_pos = BeginElement(f, kCuePointID);
+
+        WriteUInt(f, kCueTimeID, cp.time);
+
+        const __int64 tp_pos = BeginElement(f, kCueTrackPositionsID);
+
+        WriteUInt(f, kCueTrackID, kTrackNumber);
+        WriteUInt(f, kCueClusterPositionID, cp.pos);
+
+        EndElement(f, tp_pos);
+        EndElement(f, point_pos);
+    }
+
+    EndElement(f, cues_pos);
+}
+
+
+void WriteSeekEntry(EbmlIO::File& f, ULONG id, __int64 pos)
+{
+    f.WriteID2(WebmUtil::kEbmlSeekEntryID);
+    f.Write1UInt(18);  //payload size
+
+    f.WriteID2(WebmUtil::kEbmlSeekIDID);
+    f.Write1UInt(4);
+    f.WriteID4(id);
+
+    f.WriteID2(WebmUtil::kEbmlSeekPositionID);
+    f.Write1UInt(8);
+    f.Serialize8UInt(pos);
+}
+
+
+}  //end unnamed namespace
+
+
+HRESULT OggRemux::Remux(
+    const wchar_t* src,
+    const wchar_t* filename,
+    const wchar_t* writing_app,
+    HANDLE hQuit,
+    Stats* pStats)
+{
+    if ((src == 0) || (filename == 0))
+        return E_POINTER;
+
+    if (pStats)
+        memset(pStats, 0, sizeof(Stats));
+
+    WebmOggSource::OggFile reader;
+
+    HRESULT hr = reader.Open(src);
+
+    if (FAILED(hr))
+        return hr;
+
+    OggStream stream(&reader);
+    OggStream::Packet hdrs[3];
+
+    long result = stream.Init(hdrs[0], hdrs[1], hdrs[2]);
+
+    if (result < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    VorbisIdent ident;
+
+    result = ident.Read(&reader, hdrs[0]);
+
+    if ((result < 0) || (ident.channels == 0) || (ident.sample_rate == 0))
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    bytes_t codec_private;
+
+    hr = GetCodecPrivate(&reader, hdrs, codec_private);
+
+    if (FAILED(hr))
+        return hr;
+
+    WebmMuxLib::FileStream out;
+
+    hr = out.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    EbmlIO::File f;
+    f.SetStream(&out);
+
+    WriteEbmlHeader(f);
+
+    f.WriteID4(WebmUtil::kEbmlSegmentID);
+
+    const __int64 segment_size_pos = f.GetPosition();
+    f.Serialize8UInt(0x01FFFFFFFFFFFFFFLL);  //unknown; patched below
+
+    const __int64 segment_start = f.GetPosition();
+
+    //Reserve room for the SeekHead, which is written last.
+
+    const __int64 seekhead_pos = f.GetPosition();
+
+    f.WriteID1(WebmUtil::kEbmlVoidID);
+    f.Write1UInt(kSeekHeadSize - 2);
+
+    {
+        const BYTE pad[kSeekHeadSize - 2] = { 0 };
+        f.Write(pad, sizeof pad);
+    }
+
+    const __int64 info_pos = f.GetPosition();
+    const __int64 duration_pos = WriteInfo(f, writing_app);
+
+    const __int64 tracks_pos = f.GetPosition();
+    WriteTracks(f, ident, codec_private);
+
+    cues_t cues;
+    ULONG duration;
+
+    hr = WriteClusters(
+            f,
+            stream,
+            ident.sample_rate,
+            segment_start,
+            hQuit,
+            cues,
+            duration);
+
+    if (pStats)
+    {
+        WebmOggSource::OggFile::Stats stats;
+        reader.GetStats(stats);
+
+        pStats->pages = stream.GetPageReadCount();
+        pStats->reads = stats.reads;
+        pStats->file_reads = stats.file_reads;
+        pStats->file_bytes = stats.file_bytes;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        const __int64 cues_pos = f.GetPosition();
+        WriteCues(f, cues);
+
+        const __int64 segment_end = f.GetPosition();
+
+        f.SetPosition(segment_size_pos);
+        f.Write8UInt(segment_end - segment_start);
+
+        f.SetPosition(seekhead_pos);
+        f.WriteID4(WebmUtil::kEbmlSeekHeadID);
+        f.Write1UInt(kSeekHeadSize - 5);
+
+        WriteSeekEntry(f, WebmUtil::kEbmlSegmentInfoID,
+                       info_pos - segment_start);
+        WriteSeekEntry(f, WebmUtil::kEbmlTracksID,
+                       tracks_pos - segment_start);
+        WriteSeekEntry(f, kCuesID, cues_pos - segment_start);
+
+        assert(f.GetPosition() == (seekhead_pos + kSeekHeadSize));
+
+        f.SetPosition(duration_pos);
+        f.Serialize4Float(static_cast<float>(duration));
+
+        f.SetPosition(segment_end);
+    }
+
+    f.SetStream(0);  //flushes
+
+    const HRESULT hrClose = out.Close();
+
+    if (SUCCEEDED(hr))
+        hr = hrClose;
+
+    if (FAILED(hr))
+        DeleteFile(filename);
+
+    return hr;
+}
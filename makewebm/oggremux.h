@@ -0,0 +1,53 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+
+//Rewrites an Ogg Vorbis file as a WebM file, without a filter graph.
+//The pages are read with the Ogg source's parser, and the packets that
+//end on each page with a granule pos are written (Xiph-laced, as the
+//Ogg source delivers them to the muxer) as one SimpleBlock, timed from
+//the granule pos of the page before.  The output is written through the
+//muxer's buffered EbmlIO writer and unbuffered file stream, so the
+//remux costs about what copying the file would.
+
+class OggRemux
+{
+    OggRemux();
+    OggRemux(const OggRemux&);
+    OggRemux& operator=(const OggRemux&);
+
+public:
+
+    //How hard the source was read: the page headers parsed, the calls to
+    //the reader, and the reads (and bytes) of the file underneath.
+
+    struct Stats
+    {
+        long long pages;
+        long long reads;
+        long long file_reads;
+        long long file_bytes;
+    };
+
+    //Writes filename from the Ogg Vorbis file src.  The output is
+    //replaced if it exists.  If hQuit (which may be 0) is signalled
+    //before the remux completes, it stops, deletes the output, and
+    //returns E_ABORT.  The writing app is also given as the muxing app.
+    //If pStats is not 0, it receives the read statistics (all 0 if the
+    //remux fails before its clusters are written).
+
+    static HRESULT Remux(
+        const wchar_t* src,
+        const wchar_t* filename,
+        const wchar_t* writing_app,
+        HANDLE hQuit,
+        Stats* pStats = 0);
+
+};
@@ -0,0 +1,200 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "pipesink.h"
+#include <cassert>
+#include <cwchar>
+
+
+PipeSink::PipeSink() :
+    m_hPipe(INVALID_HANDLE_VALUE),
+    m_bStdOut(false),
+    m_hrWrite(S_OK),
+    m_cbWritten(0)
+{
+}
+
+
+PipeSink::~PipeSink()
+{
+    Close();
+}
+
+
+bool PipeSink::IsPipeName(const wchar_t* name)
+{
+    if (name == 0)
+        return false;
+
+    if (wcscmp(name, L"-") == 0)
+        return true;
+
+    const wchar_t prefix[] = L"\\\\.\\pipe\\";
+    const size_t len = sizeof(prefix) / sizeof(wchar_t) - 1;
+
+    return (_wcsnicmp(name, prefix, len) == 0) && (name[len] != L'\0');
+}
+
+
+HRESULT PipeSink::Open(const wchar_t* name)
+{
+    if (!IsPipeName(name))
+        return E_INVALIDARG;
+
+    if (m_hPipe != INVALID_HANDLE_VALUE)
+        return E_UNEXPECTED;
+
+    m_hrWrite = S_OK;
+    m_cbWritten = 0;
+
+    if (wcscmp(name, L"-") == 0)
+    {
+        const HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+
+        if ((h == INVALID_HANDLE_VALUE) || (h == 0))
+            return E_HANDLE;
+
+        //A WebM file is no use on the console, and would garble it.
+
+        if (GetFileType(h) == FILE_TYPE_CHAR)
+            return E_INVALIDARG;
+
+        m_hPipe = h;
+        m_bStdOut = true;
+
+        return S_OK;
+    }
+
+    m_hPipe = CreateFile(
+                name,
+                GENERIC_WRITE,
+                0,  //no sharing
+                0,  //security attributes
+                OPEN_EXISTING,
+                0,
+                0);
+
+    if (m_hPipe == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_bStdOut = false;
+
+    return S_OK;
+}
+
+
+void PipeSink::Close()
+{
+    if (m_hPipe == INVALID_HANDLE_VALUE)
+        return;
+
+    if (m_bStdOut)
+    {
+        //The reader gets EOF when we exit, not here, since the handle is
+        //the process's.  Flushing only waits for the reader.
+
+        FlushFileBuffers(m_hPipe);
+    }
+    else
+    {
+        const BOOL b = CloseHandle(m_hPipe);
+        b;
+        assert(b);
+    }
+
+    m_hPipe = INVALID_HANDLE_VALUE;
+    m_bStdOut = false;
+}
+
+
+bool PipeSink::IsOpen() const
+{
+    return (m_hPipe != INVALID_HANDLE_VALUE);
+}
+
+
+HRESULT PipeSink::GetStatus() const
+{
+    return m_hrWrite;
+}
+
+
+__int64 PipeSink::GetBytesWritten() const
+{
+    return m_cbWritten;
+}
+
+
+HRESULT PipeSink::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if ((iid == __uuidof(IUnknown)) || (iid == __uuidof(IWebmMuxChunkSink)))
+    {
+        pUnk = static_cast<IWebmMuxChunkSink*>(this);
+        return S_OK;
+    }
+
+    pUnk = 0;
+    return E_NOINTERFACE;
+}
+
+
+ULONG PipeSink::AddRef()
+{
+    return 1;
+}
+
+
+ULONG PipeSink::Release()
+{
+    return 1;
+}
+
+
+HRESULT PipeSink::OnChunk(WebmMuxChunkType, const BYTE* buf, ULONG len)
+{
+    if (m_hPipe == INVALID_HANDLE_VALUE)
+        return E_UNEXPECTED;
+
+    if (FAILED(m_hrWrite))
+        return m_hrWrite;
+
+    //A pipe may take less than we give it, so we write until it has
+    //taken all of the chunk.
+
+    while (len > 0)
+    {
+        DWORD cb;
+
+        const BOOL b = WriteFile(m_hPipe, buf, len, &cb, 0);
+
+        if (!b)
+        {
+            const DWORD e = GetLastError();
+            m_hrWrite = HRESULT_FROM_WIN32(e);
+
+            return m_hrWrite;
+        }
+
+        assert(cb <= len);
+
+        buf += cb;
+        len -= cb;
+
+        m_cbWritten += cb;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objbase.h>
+#include "webmmuxidl.h"
+
+//Writes the chunks of a live mux to a pipe: the standard output (named
+//"-"), or a named pipe (\\.\pipe\name) that the reader has created.
+//A write blocks until the reader has taken the bytes, so a slow reader
+//paces the mux instead of letting the output pile up in memory.
+
+class PipeSink : public IWebmMuxChunkSink
+{
+    PipeSink(const PipeSink&);
+    PipeSink& operator=(const PipeSink&);
+
+public:
+    PipeSink();
+    ~PipeSink();
+
+    static bool IsPipeName(const wchar_t*);
+
+    HRESULT Open(const wchar_t*);
+    void Close();
+    bool IsOpen() const;
+
+    //The result of the first write that failed (the reader closed its
+    //end, say), or S_OK.  The chunks that follow are discarded.
+    HRESULT GetStatus() const;
+
+    __int64 GetBytesWritten() const;
+
+    //IUnknown (not reference-counted; owned by the App)
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IWebmMuxChunkSink
+
+    HRESULT STDMETHODCALLTYPE OnChunk(WebmMuxChunkType, const BYTE*, ULONG);
+
+private:
+    HANDLE m_hPipe;
+    bool m_bStdOut;  //we don't own the handle
+    HRESULT m_hrWrite;
+    __int64 m_cbWritten;
+
+};
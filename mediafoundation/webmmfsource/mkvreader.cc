@@ -2,6 +2,8 @@
 #include <cassert>
 #include <algorithm>
 #include <comdef.h>
+#include <mferror.h>
+#include <mfapi.h>
 #ifdef _DEBUG
 #include "odbgstream.h"
 using std::endl;
@@ -11,10 +13,97 @@ using std::dec;
 #undef DEBUG_PURGE
 //#define DEBUG_PURGE
 
+namespace
+{
+
+//Synchronous reads of a byte stream, for MkvReader::Probe.
+
+class ByteStreamReader : public mkvparser::IMkvReader
+{
+    ByteStreamReader(const ByteStreamReader&);
+    ByteStreamReader& operator=(const ByteStreamReader&);
+
+public:
+
+    ByteStreamReader(
+        IMFByteStream* pStream,
+        const volatile LONG* pCancel) :
+        m_pStream(pStream),
+        m_pCancel(pCancel)
+    {
+    }
+
+    int Read(long long pos, long len, unsigned char* buf)
+    {
+        if ((pos < 0) || (len < 0))
+            return -1;
+
+        if (*m_pCancel)
+            return -1;
+
+        if (len == 0)
+            return 0;
+
+        HRESULT hr = m_pStream->SetCurrentPosition(pos);
+
+        if (FAILED(hr))
+            return -1;
+
+        while (len > 0)
+        {
+            ULONG cb;
+
+            hr = m_pStream->Read(buf, len, &cb);
+
+            if (FAILED(hr) || (cb == 0))
+                return -1;
+
+            buf += cb;
+            len -= cb;
+        }
+
+        return 0;
+    }
+
+    int Length(long long* total, long long* available)
+    {
+        QWORD length;
+
+        const HRESULT hr = m_pStream->GetLength(&length);
+
+        if (FAILED(hr) || (length == QWORD(-1)))
+            return -1;  //the prober needs to know where the file ends
+
+        if (total)
+            *total = length;
+
+        if (available)
+            *available = length;  //a read waits for the bytes
+
+        return 0;
+    }
+
+private:
+
+    IMFByteStream* const m_pStream;
+    const volatile LONG* const m_pCancel;
+
+};
+
+}  //end anon namespace
+
+
 MkvReader::MkvReader(IMFByteStream* pStream) :
     m_pStream(pStream),
     m_async_pos(-1),  //means "no async read in progress"
-    m_async_len(-1)   //as above
+    m_async_len(-1),  //as above
+    m_async_run(0),
+    m_purge_distance(-1),
+    m_hits(0),
+    m_misses(0),
+    m_shared(0),
+    m_pShared(0),
+    m_cancel(0)
 {
     const ULONG n = m_pStream->AddRef();
     n;
@@ -37,6 +126,24 @@ MkvReader::MkvReader(IMFByteStream* pStream) :
     //dwPageSize
     //dwAllocationGranularity
 
+    const bool bNetwork =
+        (dw & (MFBYTESTREAM_IS_REMOTE |
+               MFBYTESTREAM_HAS_SLOW_SEEK |
+               MFBYTESTREAM_IS_PARTIALLY_DOWNLOADED)) != 0;
+
+    if (bNetwork)
+    {
+        enum { network_region_size = 2 * 1024 * 1024 };
+
+        m_region_size = network_region_size;
+        m_max_run_pages = m_region_size / m_info.dwPageSize;
+    }
+    else
+    {
+        m_region_size = m_info.dwAllocationGranularity;
+        m_max_run_pages = 1;
+    }
+
     //TODO: this crashed when I used the URL from MS:
     //MF_E_BYTESTREAM_UNKNOWN_LENGTH
 
@@ -48,11 +155,15 @@ MkvReader::MkvReader(IMFByteStream* pStream) :
     //m_length = -1;  //for debugging
 
     m_avail = 0;
+
+    m_budget.Open(webmdshow::MemoryBudget::GetProcess(), true);
 }
 
 
 MkvReader::~MkvReader()
 {
+    webmdshow::SharedFileCache::Close(m_pShared);
+
     DestroyRegions();
 
     const ULONG n = m_pStream->Release();
@@ -89,6 +200,22 @@ bool MkvReader::HasSlowSeek() const
 }
 
 
+bool MkvReader::IsNetworkMode() const
+{
+    return (m_max_run_pages > 1);
+}
+
+
+HRESULT MkvReader::Probe(mkvparser::Prober::Info& info) const
+{
+    ByteStreamReader reader(m_pStream, &m_cancel);
+
+    const ULONG flags = IsNetworkMode() ? mkvparser::Prober::kNoTailSearch : 0;
+
+    return mkvparser::Prober::Probe(&reader, flags, info);
+}
+
+
 bool MkvReader::IsPartiallyDownloaded() const
 {
     DWORD dw;
@@ -351,7 +478,7 @@ int MkvReader::InsertPage(
 
 void MkvReader::CreateRegion()
 {
-    const DWORD region_size = m_info.dwAllocationGranularity;
+    const DWORD region_size = m_region_size;
     const DWORD page_size = m_info.dwPageSize;
 
     //const DWORD type = MEM_COMMIT | MEM_RESERVE;
@@ -360,10 +487,13 @@ void MkvReader::CreateRegion()
     void* const ptr = HeapAlloc(GetProcessHeap(), 0, region_size);
     assert(ptr);  //TODO
 
+    m_budget.Charge(region_size);
+
     m_regions.push_back(Region());
     Region& r = m_regions.back();
 
     r.ptr = static_cast<BYTE*>(ptr);
+    r.cached = 0;
 
     const DWORD n = region_size / page_size;
     r.pages.resize(n);
@@ -378,6 +508,7 @@ void MkvReader::CreateRegion()
         page.pos = -1;  //means "don't have data on this page"
         page.len = 0;   //means "no data on this page"
         page.cRef = 0;
+        page.time = -1;
 
         const pages_vector_t::iterator iter = r.pages.begin() + i;
         const free_pages_t::value_type value(-1, iter);
@@ -789,6 +920,8 @@ void MkvReader::DestroyRegions()
         const BOOL b = HeapFree(GetProcessHeap(), 0, r.ptr);
         assert(b);
 
+        m_budget.Release(m_region_size);
+
         m_regions.pop_front();
     }
 }
@@ -881,10 +1014,11 @@ void MkvReader::Purge(LONGLONG pos)
     }
 #endif
 
-    int i = 0;
-    enum { max_count = 16 };
+    //Behind the playback position.  This used to stop after 16 pages,
+    //which falls behind a high bitrate stream: the cache then grows
+    //without bound.  Each page costs only a pop and a free list insert.
 
-    while (!m_cache.empty() && (i < max_count))
+    while (!m_cache.empty())
     {
         const cache_t::value_type page_iter = m_cache.front();
 
@@ -906,12 +1040,41 @@ void MkvReader::Purge(LONGLONG pos)
             break;
 
         m_cache.pop_front();
+        FreeCachedPage(page_iter);
+    }
 
-        const free_pages_t::value_type value(page.pos, page_iter);
-        m_free_pages.insert(value);
+    //Too far ahead of it, such as what remains from before a seek.
+
+    if ((pos >= 0) && (m_purge_distance >= 0))
+    {
+        const LONGLONG limit = pos + m_purge_distance;
+
+        while (!m_cache.empty())
+        {
+            const cache_t::value_type page_iter = m_cache.back();
+
+            const Page& page = *page_iter;
+
+            if (page.cRef != 0)  //locked, or async read in progress
+                break;
+
+            if (page.pos < limit)
+                break;
 
-        ++i;
+            m_cache.pop_back();
+            FreeCachedPage(page_iter);
+        }
+    }
+
+    const LONGLONG request = m_budget.TakePurgeRequest();
+
+    if (request > 0)
+    {
+        PurgeBack(request);
+        ReleaseFreeRegions(0);
     }
+    else
+        ReleaseFreeRegions();
 
 #ifdef DEBUG_PURGE
     const free_pages_t::size_type new_size = m_free_pages.size();
@@ -959,11 +1122,11 @@ void MkvReader::Clear()
         assert(page.len > 0);
 
         m_cache.pop_front();
-
-        const free_pages_t::value_type value(page.pos, page_iter);
-        m_free_pages.insert(value);
+        FreeCachedPage(page_iter);
     }
 
+    ReleaseFreeRegions();
+
     m_avail = 0;
 
 #if 0 //def _DEBUG
@@ -1078,6 +1241,9 @@ HRESULT MkvReader::AsyncReadInit(
     assert(m_async_pos < 0);
     assert(m_async_len < 0);
 
+    if ((m_length < 0) && m_follower.is_open() && m_follower.IsFinished())
+        m_length = m_follower.GetSize();  //final now
+
     if (m_length >= 0)
     {
         assert(pos <= m_length);
@@ -1225,6 +1391,7 @@ HRESULT MkvReader::AsyncReadInit(
             assert(pos < (page.pos + page.len));
 
             Read(page_iter, pos, len, 0);
+            ++m_hits;
 
             //if (m_avail < pos)
             //    m_avail = pos;
@@ -1297,6 +1464,7 @@ HRESULT MkvReader::AsyncReadContinue(
         if (pos < page_end)  //cache hit
         {
             Read(page_iter, pos, len, 0);
+            ++m_hits;
 
             //if (m_avail < pos)
             //    m_avail = pos;
@@ -1429,41 +1597,73 @@ HRESULT MkvReader::AsyncReadCompletion(IMFAsyncResult* pResult)
     assert(page.pos <= m_async_pos);
     assert(page.cRef < 0);  //async read in progress
 
-    page.cRef = 0;  //unmark this page, now that I/O is complete
+    //The read filled a run of m_async_run pages, the first of which is
+    //this one.  In network mode a run can be cut short by a read that
+    //returns fewer bytes than requested; we keep the pages it filled.
+
+    const ULONG run_size = m_async_run;
+    assert(run_size >= 1);
+    assert(run_size <= ULONG(j - curr));
+
+    m_async_run = 0;
+
+    const DWORD page_size = m_info.dwPageSize;
 
     ULONG cbRead;
 
     HRESULT hr = m_pStream->EndRead(pResult, &cbRead);
-    assert(FAILED(hr) || (cbRead <= m_info.dwPageSize));
+    assert(FAILED(hr) || (cbRead <= run_size * page_size));
 
-    if (SUCCEEDED(hr))
+    if (FAILED(hr))
+        cbRead = 0;
+
+    ULONG remaining = cbRead;
+    ULONG filled = 0;  //pages kept
+
+    for (ULONG k = 0; k < run_size; ++k)
     {
-        page.len = cbRead;
-        assert(page.len <= m_info.dwPageSize);
+        Page& run_page = *curr[k];
+        assert(run_page.cRef < 0);
+
+        run_page.cRef = 0;  //unmark this page, now that I/O is complete
+
+        const ULONG len = (remaining < page_size) ? remaining : page_size;
 
-        if (page.len < m_info.dwPageSize)
+        run_page.len = len;
+        run_page.time = MFGetSystemTime();
+        remaining -= len;
+
+        if (len == 0)
+            continue;
+
+        if (len < page_size)
         {
             //We read fewer bytes than requested.  This is a normal event,
             //such as when we read the very last page of the file.
 
-            const LONGLONG length = page.pos + page.len;
+            const LONGLONG length = run_page.pos + len;
             assert((m_length < 0) || (length <= m_length));
 
             if (m_length >= 0)  //length is defined
             {
-                if (length < m_length)  //weird: fewer bytes than total length
+                if (length < m_length)  //fewer bytes than total length
                 {
-                    hr = E_FAIL;        //treat this as an I/O error
+                    run_page.len = 0;  //can't have a hole before the end
+
+                    if (k == 0)     //weird: we got nothing we can use
+                        hr = E_FAIL;  //treat this as an I/O error
 
 #ifdef _DEBUG
                     odbgstream os;
                     os << "\nmkvreader::AsyncReadCompletion: "
-                       << "ERROR - incomplete async read\n"
+                       << "incomplete async read; run page=" << k
+                       << "\n"
                        << endl;
 #endif
+                    continue;
                 }
             }
-            else //network source with unknown length
+            else if (remaining == 0) //network source with unknown length
             {
                 m_length = length;
                 assert(m_async_pos <= m_length);
@@ -1472,25 +1672,43 @@ HRESULT MkvReader::AsyncReadCompletion(IMFAsyncResult* pResult)
                     m_async_len = static_cast<LONG>(m_length - m_async_pos);
             }
         }
+
+        filled = k + 1;
     }
 
-    if (FAILED(hr) || (cbRead == 0))
+    //Free the pages we didn't fill, back to front, so that the indexes
+    //of those before them stay valid.
+
+    const cache_t::size_type first_index = curr - i;
+
+    for (ULONG k = run_size; k > filled; --k)
     {
-        m_cache.erase(curr);
+        const iter_t iter = m_cache.begin() + first_index + k - 1;
+        const cache_t::value_type run_iter = *iter;
 
-        page.pos = -1;  //means "we don't have any data on this page"
-        page.len = 0;
+        m_cache.erase(iter);
 
-        const free_pages_t::value_type value(page.pos, page_iter);
-        m_free_pages.insert(value);
+        run_iter->pos = -1;  //means "we don't have any data on this page"
+        run_iter->len = 0;
 
+        FreeCachedPage(run_iter);
+    }
+
+    if (FAILED(hr) || (filled == 0))
+    {
         m_async_len = -1;
         m_async_pos = -1;
 
-        return hr;
+        return FAILED(hr) ? hr : S_OK;
     }
 
-    const LONGLONG last_pos = page.pos + page.len;
+    const iter_t first = m_cache.begin() + first_index;
+
+    for (ULONG k = 0; k < filled; ++k)
+        WriteShared(first[k]);
+
+    const Page& last_page = *first[filled - 1];
+    const LONGLONG last_pos = last_page.pos + last_page.len;
 
     if (last_pos > m_avail)
         m_avail = last_pos;
@@ -1545,12 +1763,21 @@ HRESULT MkvReader::AsyncReadPage(
     {
         assert(page.len > 0);
 
-        m_free_pages.erase(free_page);  //page is no longer free
-        curr = m_cache.insert(next, page_iter);
+        curr = InsertCachedPage(next, free_page);
+        ++m_hits;
 
         return S_OK;
     }
 
+    if (ReadShared(free_page, key))  //another reader of the file has it
+    {
+        curr = InsertCachedPage(next, free_page);
+        return S_OK;
+    }
+
+    if (m_cancel)
+        return MF_E_OPERATION_CANCELLED;
+
     HRESULT hr;
 
 #ifdef _DEBUG
@@ -1560,11 +1787,35 @@ HRESULT MkvReader::AsyncReadPage(
     assert(FAILED(hr) || (QWORD(key) >= new_pos));
 #endif
 
+    if (m_follower.is_open())
+    {
+        //Read the page once it has been written, or the writer is done
+        //(the read is then cut short at the end of the file).  A local
+        //file isn't read in runs, so this is the whole read.
+
+        typedef webmdshow::TailFollower TF;
+        const TF::WaitResult result =
+            m_follower.WaitForSize(key + page_size, INFINITE);
+
+        if (result == TF::kCancelled)
+            return m_cancel ? MF_E_OPERATION_CANCELLED : MF_E_SHUTDOWN;
+
+        if ((result != TF::kReached) && (result != TF::kFinished))
+            return E_FAIL;
+    }
+
     hr = m_pStream->SetCurrentPosition(key);
 
     if (FAILED(hr))
         return hr;
 
+    free_run_t run(1, free_page);
+
+    if (m_max_run_pages > 1)
+        GetFreeRun(key, next, run);
+
+    const ULONG run_size = static_cast<ULONG>(run.size());
+
     const Region& r = *page.region;
     const pages_vector_t::size_type offset = page_iter - r.pages.begin();
 
@@ -1572,8 +1823,8 @@ HRESULT MkvReader::AsyncReadPage(
     //to vary across pages.
     BYTE* const ptr = page.region->ptr + offset * size_t(page_size);
 
-    //we always request the max number of bytes for a page
-    hr = m_pStream->BeginRead(ptr, page_size, pCB, 0);
+    //we always request the max number of bytes for the pages
+    hr = m_pStream->BeginRead(ptr, run_size * page_size, pCB, 0);
 
     if (FAILED(hr))
         return hr;
@@ -1587,12 +1838,375 @@ HRESULT MkvReader::AsyncReadPage(
 
     //os << new_pos << endl;
 
-    page.pos = key;
-    page.len = 0;    //we don't know actual len until async read completes
-    page.cRef = -1;  //means "async read in progress"
+    //Inserting into the deque invalidates its iterators, so remember
+    //where the first page went by index.
 
-    m_free_pages.erase(free_page);  //page is no longer free
-    curr = m_cache.insert(next, page_iter);
+    cache_t::size_type index = next - m_cache.begin();
+    const cache_t::size_type first_index = index;
+
+    for (ULONG i = 0; i < run_size; ++i)
+    {
+        Page& run_page = *run[i]->second;
+        assert(run_page.cRef == 0);
+
+        run_page.pos = key + LONGLONG(i) * page_size;
+        run_page.len = 0;    //we don't know actual len until read completes
+        run_page.cRef = -1;  //means "async read in progress"
+
+        InsertCachedPage(m_cache.begin() + index, run[i]);
+        ++index;
+    }
+
+    curr = m_cache.begin() + first_index;
+
+    m_async_run = run_size;
+    m_misses += run_size;
 
     return S_FALSE;
 }
+
+
+void MkvReader::GetFreeRun(
+    LONGLONG key,
+    cache_t::iterator next,
+    free_run_t& run)
+{
+    //Extends run, which holds the free page that will receive the page
+    //at key, with the free pages that follow that one in its region, so
+    //that a single read can fill them all.  The run stops short of the
+    //next page already in the cache, and of the end of the file.
+
+    assert(run.size() == 1);
+
+    const DWORD page_size = m_info.dwPageSize;
+
+    LONGLONG limit = -1;
+
+    if (next != m_cache.end())
+        limit = (*next)->pos;
+
+    if ((m_length >= 0) && ((limit < 0) || (m_length < limit)))
+        limit = m_length;
+
+    pages_vector_t::iterator page_iter = run.back()->second;
+    const pages_vector_t::iterator pages_end = page_iter->region->pages.end();
+
+    while (run.size() < m_max_run_pages)
+    {
+        if (++page_iter == pages_end)
+            break;
+
+        const LONGLONG pos = key + LONGLONG(run.size()) * page_size;
+
+        if ((limit >= 0) && (pos >= limit))
+            break;
+
+        const Page& page = *page_iter;
+
+        if (page.cRef != 0)
+            break;
+
+        //A page with no references is either free or cached; only the
+        //free ones are in the free list.
+
+        typedef std::pair<free_pages_t::iterator, free_pages_t::iterator>
+            range_t;
+
+        range_t range = m_free_pages.equal_range(page.pos);
+
+        while ((range.first != range.second) &&
+               (range.first->second != page_iter))
+        {
+            ++range.first;
+        }
+
+        if (range.first == range.second)  //cached
+            break;
+
+        run.push_back(range.first);
+    }
+}
+
+
+MkvReader::cache_t::iterator MkvReader::InsertCachedPage(
+    cache_t::iterator next,
+    free_pages_t::iterator free_page)
+{
+    const pages_vector_t::iterator page_iter = free_page->second;
+    m_free_pages.erase(free_page);  //page is no longer free
+
+    Region& r = *page_iter->region;
+    ++r.cached;
+
+    return m_cache.insert(next, page_iter);
+}
+
+
+void MkvReader::FreeCachedPage(pages_vector_t::iterator page_iter)
+{
+    //The caller has already removed the page from the cache.  The page
+    //keeps its pos, so that a later read of it can re-use its data.
+
+    const Page& page = *page_iter;
+
+    Region& r = *page.region;
+    assert(r.cached > 0);
+    --r.cached;
+
+    const free_pages_t::value_type value(page.pos, page_iter);
+    m_free_pages.insert(value);
+}
+
+
+void MkvReader::ReleaseFreeRegions(ULONG max_free_regions)
+{
+    //Regions none of whose pages are cached are only worth keeping to
+    //satisfy the next few page allocations.  Return the rest to the
+    //heap, so that a burst (a seek, a large frame) doesn't set the
+    //footprint for the rest of playback.
+
+    typedef regions_t::iterator iter_t;
+
+    iter_t iter = m_regions.begin();
+    const iter_t iter_end = m_regions.end();
+
+    ULONG free_regions = 0;
+
+    while (iter != iter_end)
+    {
+        Region& r = *iter;
+
+        if ((r.cached > 0) || (++free_regions <= max_free_regions))
+        {
+            ++iter;
+            continue;
+        }
+
+        typedef pages_vector_t::iterator page_iter_t;
+
+        const page_iter_t pages_end = r.pages.end();
+
+        for (page_iter_t page_iter = r.pages.begin();
+             page_iter != pages_end;
+             ++page_iter)
+        {
+            typedef std::pair<free_pages_t::iterator, free_pages_t::iterator>
+                range_t;
+
+            range_t range = m_free_pages.equal_range(page_iter->pos);
+
+            while (range.first->second != page_iter)
+            {
+                ++range.first;
+                assert(range.first != range.second);
+            }
+
+            m_free_pages.erase(range.first);
+        }
+
+        const BOOL b = HeapFree(GetProcessHeap(), 0, r.ptr);
+        assert(b);
+
+        m_budget.Release(m_region_size);
+
+        iter = m_regions.erase(iter);
+    }
+}
+
+
+void MkvReader::SetPurgeDistance(LONGLONG distance)
+{
+    m_purge_distance = distance;
+}
+
+
+void MkvReader::SetSharedFile(webmdshow::SharedFileCache::File* pFile)
+{
+    webmdshow::SharedFileCache::Close(m_pShared);
+    m_pShared = pFile;
+}
+
+
+bool MkvReader::Follow(const wchar_t* filename)
+{
+    if (!m_follower.Open(filename))
+        return false;
+
+    m_length = -1;  //until the writer is done
+    return true;
+}
+
+
+bool MkvReader::IsFollowing() const
+{
+    return m_follower.is_open();
+}
+
+
+void MkvReader::CancelFollow()
+{
+    m_follower.Cancel();
+}
+
+
+void MkvReader::CancelReads()
+{
+    InterlockedExchange(&m_cancel, 1);
+
+    if (m_follower.is_open())
+        m_follower.Cancel();
+}
+
+
+bool MkvReader::IsCancelled() const
+{
+    return (m_cancel != 0);
+}
+
+
+void MkvReader::SetBudget(webmdshow::MemoryBudget* pBudget)
+{
+    m_budget.Open(pBudget, true);
+    m_budget.Charge(LONGLONG(m_regions.size()) * m_region_size);
+}
+
+
+void MkvReader::PurgeBack(LONGLONG bytes)
+{
+    //Pages are freed to their regions; the memory goes back to the heap
+    //only once a region has no cached pages left.
+
+    LONGLONG freed = 0;
+
+    while (!m_cache.empty() && (freed < bytes))
+    {
+        const cache_t::value_type page_iter = m_cache.back();
+
+        const Page& page = *page_iter;
+
+        if (page.cRef != 0)  //locked, or async read in progress
+            break;
+
+        freed += m_info.dwPageSize;
+
+        m_cache.pop_back();
+        FreeCachedPage(page_iter);
+    }
+}
+
+
+bool MkvReader::ReadShared(free_pages_t::iterator& free_page, LONGLONG pos)
+{
+    if (m_pShared == 0)
+        return false;
+
+    const pages_vector_t::iterator page_iter = free_page->second;
+
+    Page& page = *page_iter;
+    assert(page.cRef == 0);
+
+    const DWORD page_size = m_info.dwPageSize;
+
+    const Region& r = *page.region;
+    const pages_vector_t::size_type offset = page_iter - r.pages.begin();
+
+    BYTE* const ptr = r.ptr + offset * size_t(page_size);
+
+    using webmdshow::SharedFileCache;
+
+    const long len = SharedFileCache::Read(m_pShared, pos, ptr, page_size);
+
+    if (len <= 0)  //not cached; the page is as it was
+        return false;
+
+    //Only the last page of the file may be short.  Otherwise we can't
+    //use what we copied, and the free page no longer has its old data.
+
+    if ((ULONG(len) < page_size) && (pos + len != m_length))
+    {
+        m_free_pages.erase(free_page);
+
+        page.pos = -1;  //means "we don't have any data on this page"
+        page.len = 0;
+
+        const free_pages_t::value_type value(page.pos, page_iter);
+        free_page = m_free_pages.insert(value);
+
+        return false;
+    }
+
+    page.pos = pos;
+    page.len = len;
+    page.time = MFGetSystemTime();
+
+    if ((pos + len) > m_avail)
+        m_avail = pos + len;
+
+    ++m_shared;
+    return true;
+}
+
+
+void MkvReader::WriteShared(pages_vector_t::const_iterator page_iter) const
+{
+    if (m_pShared == 0)
+        return;
+
+    const Page& page = *page_iter;
+    assert(page.pos >= 0);
+    assert(page.len > 0);
+
+    const DWORD page_size = m_info.dwPageSize;
+
+    const Region& r = *page.region;
+    const pages_vector_t::size_type offset = page_iter - r.pages.begin();
+
+    const BYTE* const ptr = r.ptr + offset * size_t(page_size);
+
+    using webmdshow::SharedFileCache;
+    SharedFileCache::Write(m_pShared, page.pos, ptr, page.len);
+}
+
+
+void MkvReader::GetCacheStats(CacheStats& stats) const
+{
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.shared = m_shared;
+    stats.resident_bytes = 0;
+
+    typedef cache_t::const_iterator iter_t;
+
+    iter_t iter = m_cache.begin();
+    const iter_t iter_end = m_cache.end();
+
+    while (iter != iter_end)
+    {
+        const Page& page = **iter++;
+        stats.resident_bytes += page.len;
+    }
+}
+
+
+MFTIME MkvReader::GetArrivalTime(LONGLONG pos) const
+{
+    if ((pos < 0) || m_cache.empty())
+        return -1;
+
+    typedef cache_t::const_iterator iter_t;
+
+    const iter_t i = m_cache.begin();
+    const iter_t j = m_cache.end();
+
+    iter_t next = std::upper_bound(i, j, pos, PageLess());
+
+    if (next == i)
+        return -1;
+
+    const Page& page = **--next;
+
+    if ((page.pos < 0) || (pos >= (page.pos + LONGLONG(page.len))))
+        return -1;
+
+    return page.time;
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include "mkvparser.hpp"
+#include "mkvparserprober.h"
+#include "sharedfilecache.h"
+#include "tailfollower.h"
+#include "memorybudget.h"
 #include <windows.h>
 #include <mfidl.h>
 #include <deque>
@@ -45,6 +49,53 @@ public:
     void Purge(LONGLONG);
     void Clear();  //purge all
 
+    //Pages that start this many bytes or more past the position passed
+    //to Purge are purged too.  Negative (the default) means never purge
+    //ahead of the playback position.
+    void SetPurgeDistance(LONGLONG);
+
+    //The file in the shared cache (see webmdshow::SharedFileCache), or
+    //null.  Async reads copy the pages the cache has instead of reading
+    //them from the byte stream, and copy the pages they read to it.  The
+    //reader closes the file.
+    void SetSharedFile(webmdshow::SharedFileCache::File*);
+
+    //Follows the file of the byte stream, which its writer is still
+    //appending to (see webmdshow::TailFollower).  Until the writer is
+    //done, the length is unknown (-1), and an async read of a page that
+    //hasn't been written yet waits for it.  CancelFollow ends the wait,
+    //and the waits to come, and may be called from any thread.
+    bool Follow(const wchar_t* filename);
+    bool IsFollowing() const;
+    void CancelFollow();
+
+    //Makes the reads not yet issued to the byte stream, both async and
+    //those of Probe, fail with MF_E_OPERATION_CANCELLED from now on, and
+    //ends a wait for a followed file.  Pages already in the cache can
+    //still be read.  May be called from any thread; there is no resume,
+    //since it is for abandoning an open.
+    void CancelReads();
+    bool IsCancelled() const;
+
+    //The regions are charged to the process budget, unless set to
+    //another.  When the budget asks for memory back, the next Purge
+    //also drops read-ahead, from the far end, and keeps no free regions.
+    void SetBudget(webmdshow::MemoryBudget*);
+
+    struct CacheStats
+    {
+        ULONGLONG hits;    //pages found in the cache by async reads
+        ULONGLONG misses;  //pages async reads had to fetch
+        ULONGLONG shared;  //pages copied from the shared cache instead
+        ULONGLONG resident_bytes;
+    };
+
+    void GetCacheStats(CacheStats&) const;
+
+    //When the page holding pos was filled, on the MFGetSystemTime clock,
+    //or -1 if that page is not in the cache.
+    MFTIME GetArrivalTime(LONGLONG pos) const;
+
     DWORD GetPageSize() const;
     bool IsFreeEmpty() const;
     void AllocateFree(ULONG);
@@ -53,6 +104,19 @@ public:
     bool HasSlowSeek() const;
     bool IsPartiallyDownloaded() const;
 
+    //True for remote, slow seek, and partially downloaded byte streams.
+    //Reads then fetch runs of up to a region's worth of pages at a time,
+    //rather than a page at a time, so that playback is not bound by the
+    //latency of each request.
+    bool IsNetworkMode() const;
+
+    //Runs mkvparser::Prober with reads made straight from the byte
+    //stream, instead of from the cache, which holds only what the source
+    //has loaded so far.  The end of the file is not searched in network
+    //mode.  Each read sets the position of the byte stream, as each
+    //async read does, so the two may be interleaved.
+    HRESULT Probe(mkvparser::Prober::Info&) const;
+
 private:
 
     IMFByteStream* const m_pStream;
@@ -68,12 +132,14 @@ private:
         LONGLONG pos;
         ULONG len;  //how much data on this page
         Region* region;
+        MFTIME time;  //when the data arrived; -1 if never
     };
 
     struct Region
     {
         BYTE* ptr;
         pages_vector_t pages;
+        ULONG cached;  //how many of our pages are in the cache
     };
 
     typedef std::list<Region> regions_t;
@@ -107,6 +173,9 @@ private:
     LONGLONG m_length;
     LONGLONG m_avail;
 
+    DWORD m_region_size;
+    DWORD m_max_run_pages;  //per async read; 1 unless network mode
+
     void Read(
         pages_vector_t::const_iterator,
         long long&,
@@ -124,12 +193,37 @@ private:
         IMFAsyncCallback* pCB,
         cache_t::iterator& curr);
 
+    typedef std::vector<free_pages_t::iterator> free_run_t;
+
+    void GetFreeRun(LONGLONG key, cache_t::iterator next, free_run_t&);
+
     //async read
     LONGLONG m_async_pos;  //key of page supplying async buf
     LONG m_async_len;      //what remains to be read
+    ULONG m_async_run;     //pages being read by the async read
+
+    LONGLONG m_purge_distance;
+    ULONGLONG m_hits;
+    ULONGLONG m_misses;
+    ULONGLONG m_shared;
+    webmdshow::SharedFileCache::File* m_pShared;
+    webmdshow::TailFollower m_follower;
+    webmdshow::MemoryBudget::Account m_budget;
+    volatile LONG m_cancel;  //set by CancelReads
+
+    bool ReadShared(free_pages_t::iterator&, LONGLONG pos);
+    void WriteShared(pages_vector_t::const_iterator) const;
 
     void CreateRegion();
     void DestroyRegions();
+    void ReleaseFreeRegions(ULONG max_free_regions = 4);
+    void PurgeBack(LONGLONG bytes);
+
+    cache_t::iterator InsertCachedPage(
+        cache_t::iterator next,
+        free_pages_t::iterator);
+
+    void FreeCachedPage(pages_vector_t::iterator);
 
     //int PurgeFront();
     //int PurgeBack();
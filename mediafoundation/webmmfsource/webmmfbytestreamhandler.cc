@@ -54,6 +54,7 @@ WebmMfByteStreamHandler::WebmMfByteStreamHandler(
     m_pClassFactory(pClassFactory),
     m_cRef(1),
     m_bCancel(FALSE),
+    m_pSource(0),
     m_async_load(this)
 {
 #ifdef _DEBUG
@@ -146,7 +147,7 @@ HRESULT WebmMfByteStreamHandler::BeginCreateObject(
     IMFByteStream* pByteStream,
     LPCWSTR pURL,
     DWORD dwFlags,
-    IPropertyStore*,
+    IPropertyStore* pProps,
     IUnknown** ppCancelCookie,
     IMFAsyncCallback* pCallback,
     IUnknown* pState)
@@ -242,7 +243,11 @@ HRESULT WebmMfByteStreamHandler::BeginCreateObject(
 
     WebmMfSource* pSource;
 
-    hr = WebmMfSource::CreateSource(m_pClassFactory, pByteStream, pSource);
+    hr = WebmMfSource::CreateSource(
+            m_pClassFactory,
+            pByteStream,
+            pProps,
+            pSource);
 
     if (FAILED(hr))
         return hr;
@@ -265,6 +270,7 @@ HRESULT WebmMfByteStreamHandler::BeginCreateObject(
 
     m_bCancel = FALSE;
     m_pByteStream = pByteStream;
+    m_pSource = pSource;
 
     return S_OK;
 }
@@ -353,6 +359,13 @@ HRESULT WebmMfByteStreamHandler::CancelObjectCreation(IUnknown*)
 
     m_bCancel = TRUE;
 
+    //Stop the parsing as well as the reads, so that the shell's handlers
+    //aren't kept waiting for a load that only has to notice the closed
+    //stream.
+
+    if (m_pSource)
+        m_pSource->CancelLoad();
+
     return m_pByteStream->Close();
 }
 
@@ -478,6 +491,7 @@ HRESULT WebmMfByteStreamHandler::EndLoad(IMFAsyncResult* pLoadResult)
     hr = MFInvokeCallback(m_pResult);
 
     m_pByteStream = 0;
+    m_pSource = 0;
     m_pResult = 0;
 
     return hr;
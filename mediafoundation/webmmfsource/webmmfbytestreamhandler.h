@@ -64,6 +64,7 @@ private:
     IMFAsyncResultPtr m_pResult;
     BOOL m_bCancel;
     IMFByteStreamPtr m_pByteStream;
+    WebmMfSource* m_pSource;  //being loaded; m_pResult holds the ref
 
     class CAsyncLoad : public IMFAsyncCallback
     {
@@ -0,0 +1,365 @@
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mferror.h>
+#include <evr.h>
+#include "webmmfsamplepool.h"
+#include <cassert>
+#include <comdef.h>
+#include <new>
+
+_COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, __uuidof(IMFMediaBuffer));
+_COM_SMARTPTR_TYPEDEF(IMFSample, __uuidof(IMFSample));
+_COM_SMARTPTR_TYPEDEF(IMFTrackedSample, __uuidof(IMFTrackedSample));
+
+namespace WebmMfSourceLib
+{
+
+HRESULT WebmMfSamplePool::CreateInstance(WebmMfSamplePool** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    WebmMfSamplePool* const p = new (std::nothrow) WebmMfSamplePool;
+    *pp = p;
+
+    if (p == 0)
+        return E_OUTOFMEMORY;
+
+    const HRESULT hr = p->CLockable::Init();
+
+    if (FAILED(hr))
+    {
+        p->Release();
+        *pp = 0;
+    }
+
+    return hr;
+}
+
+
+WebmMfSamplePool::WebmMfSamplePool() :
+    m_cRef(1),
+    m_bShutdown(false),
+    m_cbFree(0)
+{
+}
+
+
+WebmMfSamplePool::~WebmMfSamplePool()
+{
+    Purge();
+}
+
+
+HRESULT WebmMfSamplePool::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+    {
+        pUnk = static_cast<IMFAsyncCallback*>(this);
+    }
+    else if (iid == __uuidof(IMFAsyncCallback))
+    {
+        pUnk = static_cast<IMFAsyncCallback*>(this);
+    }
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG WebmMfSamplePool::AddRef()
+{
+    return InterlockedIncrement(&m_cRef);
+}
+
+
+ULONG WebmMfSamplePool::Release()
+{
+    if (LONG n = InterlockedDecrement(&m_cRef))
+        return n;
+
+    delete this;
+    return 0;
+}
+
+
+HRESULT WebmMfSamplePool::GetParameters(DWORD*, DWORD*)
+{
+    return E_NOTIMPL;  //means "assume default behavior"
+}
+
+
+HRESULT WebmMfSamplePool::Invoke(IMFAsyncResult* pResult)
+{
+    if (pResult == 0)
+        return E_INVALIDARG;
+
+    //The object of the result is the sample whose last reference
+    //was just released.
+
+    IUnknownPtr pUnk;
+
+    HRESULT hr = pResult->GetObject(&pUnk);
+
+    IMFSamplePtr pSample;
+
+    if (SUCCEEDED(hr))
+        hr = pUnk->QueryInterface(&pSample);
+
+    if (SUCCEEDED(hr))
+    {
+        Lock lock;
+
+        hr = lock.Seize(this);
+
+        if (SUCCEEDED(hr) && !m_bShutdown)
+            Recycle(pSample.Detach());
+    }
+
+    //balance the reference taken in GetSample, on behalf of the sample
+    Release();
+
+    return S_OK;
+}
+
+
+HRESULT WebmMfSamplePool::GetSample(IMFSample** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_bShutdown)
+        return MF_E_SHUTDOWN;
+
+    IMFSamplePtr pSample;
+
+    if (m_samples.empty())
+    {
+        //A sample created with a NULL surface has no buffers, but it does
+        //support IMFTrackedSample, which is what makes recycling possible.
+
+        hr = MFCreateVideoSampleFromSurface(0, &pSample);
+
+        if (FAILED(hr))
+            return hr;
+    }
+    else
+    {
+        pSample.Attach(m_samples.back());
+        m_samples.pop_back();
+    }
+
+    //Tracking is one-shot: the allocator must be set again each time
+    //the sample is handed out.
+
+    IMFTrackedSamplePtr pTracked;
+
+    hr = pSample->QueryInterface(&pTracked);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pTracked->SetAllocator(this, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    AddRef();  //released in Invoke
+
+    *pp = pSample.Detach();
+    return S_OK;
+}
+
+
+HRESULT WebmMfSamplePool::GetBuffer(DWORD cb, IMFMediaBuffer** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+
+    if (cb == 0)
+        return E_INVALIDARG;
+
+    DWORD cbClass;
+    const int idx = GetClass(cb, cbClass);
+
+    if (idx < 0)
+        return MFCreateMemoryBuffer(cb, pp);
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    buffers_t& bb = m_buffers[idx];
+
+    if (bb.empty())
+        return MFCreateMemoryBuffer(cbClass, pp);
+
+    IMFMediaBuffer* const pBuffer = bb.back();
+    bb.pop_back();
+
+    assert(m_cbFree >= cbClass);
+    m_cbFree -= cbClass;
+
+    hr = pBuffer->SetCurrentLength(0);
+    assert(SUCCEEDED(hr));
+
+    *pp = pBuffer;
+    return S_OK;
+}
+
+
+void WebmMfSamplePool::Shutdown()
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+    hr;
+    assert(SUCCEEDED(hr));
+
+    m_bShutdown = true;
+    Purge();
+}
+
+
+int WebmMfSamplePool::GetClass(DWORD cb, DWORD& cbClass)
+{
+    cbClass = kMinClass;
+
+    for (int idx = 0; idx < kClassCount; ++idx)
+    {
+        if (cb <= cbClass)
+            return idx;
+
+        cbClass <<= 1;
+    }
+
+    return -1;  //too large to pool
+}
+
+
+void WebmMfSamplePool::Recycle(IMFSample* pSample)
+{
+    //pool was already locked by caller
+
+    assert(pSample);
+
+    DWORD n;
+
+    HRESULT hr = pSample->GetBufferCount(&n);
+    assert(SUCCEEDED(hr));
+
+    buffers_t bb;
+    bb.reserve(n);
+
+    for (DWORD i = 0; i < n; ++i)
+    {
+        IMFMediaBuffer* pBuffer;
+
+        hr = pSample->GetBufferByIndex(i, &pBuffer);
+
+        if (SUCCEEDED(hr))
+            bb.push_back(pBuffer);
+    }
+
+    hr = pSample->RemoveAllBuffers();
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->DeleteAllItems();
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSampleFlags(0);
+    assert(SUCCEEDED(hr));
+
+    typedef buffers_t::const_iterator iter_t;
+
+    for (iter_t i = bb.begin(); i != bb.end(); ++i)
+        Recycle(*i);
+
+    m_samples.push_back(pSample);
+}
+
+
+void WebmMfSamplePool::Recycle(IMFMediaBuffer* pBuffer)
+{
+    //Takes ownership of the reference to pBuffer.
+
+    //The sample no longer holds the buffer, so ours should be its only
+    //reference.  A decoder that kept the buffer beyond the sample might
+    //still read from it, so it is not reused if anyone else holds it.
+
+    pBuffer->AddRef();
+    const ULONG cRef = pBuffer->Release();
+
+    DWORD cbMax;
+
+    HRESULT hr = pBuffer->GetMaxLength(&cbMax);
+
+    DWORD cbClass;
+    const int idx = GetClass(cbMax, cbClass);
+
+    const bool bRecycle = (cRef == 1) &&
+                          SUCCEEDED(hr) &&
+                          (idx >= 0) &&
+                          (cbMax == cbClass) &&
+                          (m_buffers[idx].size() < size_t(kMaxFreeCount)) &&
+                          ((m_cbFree + cbClass) <= DWORD(kMaxFreeBytes));
+
+    if (!bRecycle)
+    {
+        pBuffer->Release();
+        return;
+    }
+
+    m_buffers[idx].push_back(pBuffer);
+    m_cbFree += cbClass;
+}
+
+
+void WebmMfSamplePool::Purge()
+{
+    while (!m_samples.empty())
+    {
+        m_samples.back()->Release();
+        m_samples.pop_back();
+    }
+
+    for (int idx = 0; idx < kClassCount; ++idx)
+    {
+        buffers_t& bb = m_buffers[idx];
+
+        while (!bb.empty())
+        {
+            bb.back()->Release();
+            bb.pop_back();
+        }
+    }
+
+    m_cbFree = 0;
+}
+
+
+}  //end namespace WebmMfSourceLib
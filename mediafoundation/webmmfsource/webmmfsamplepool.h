@@ -0,0 +1,86 @@
+#pragma once
+#include "clockable.h"
+#include <vector>
+
+namespace WebmMfSourceLib
+{
+
+//The samples and buffers that a stream delivers.  Each sample is an
+//IMFTrackedSample, so when downstream releases its last reference MF
+//invokes the pool, which takes the buffers off the sample and puts both
+//back on the free lists.  Buffers are kept in size classes (powers of 2,
+//from kMinClass to kMaxClass bytes), so a frame gets a buffer of the
+//class its size rounds up to, instead of one of its exact size.  The pool
+//is refcounted separately from the stream, since samples can still be
+//downstream when the stream is destroyed.
+
+class WebmMfSamplePool : public IMFAsyncCallback, public CLockable
+{
+    WebmMfSamplePool(const WebmMfSamplePool&);
+    WebmMfSamplePool& operator=(const WebmMfSamplePool&);
+
+public:
+
+    static HRESULT CreateInstance(WebmMfSamplePool**);
+
+    //IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IMFAsyncCallback
+
+    HRESULT STDMETHODCALLTYPE GetParameters(DWORD*, DWORD*);
+    HRESULT STDMETHODCALLTYPE Invoke(IMFAsyncResult*);
+
+    //Local methods
+
+    //Returns a sample with no buffers and no attributes.
+    HRESULT GetSample(IMFSample**);
+
+    //Returns a buffer that can hold at least cb bytes, whose current
+    //length is 0.  A buffer larger than kMaxClass is not pooled.
+    HRESULT GetBuffer(DWORD cb, IMFMediaBuffer**);
+
+    //Releases the free samples and buffers.  Samples that are outstanding
+    //are released as they are returned, instead of being recycled.
+    void Shutdown();
+
+    enum
+    {
+        kMinClass = 4 * 1024,
+        kMaxClass = 16 * 1024 * 1024,
+        kClassCount = 13,  //4K, 8K, ..., 16M
+
+        //Bounds what a pool holds on to after a burst of large frames
+        //(a run of key frames, say).
+        kMaxFreeBytes = 32 * 1024 * 1024,
+        kMaxFreeCount = 32  //per class
+    };
+
+private:
+
+    WebmMfSamplePool();
+    virtual ~WebmMfSamplePool();
+
+    LONG m_cRef;
+    bool m_bShutdown;
+
+    typedef std::vector<IMFSample*> samples_t;
+    samples_t m_samples;
+
+    typedef std::vector<IMFMediaBuffer*> buffers_t;
+    buffers_t m_buffers[kClassCount];
+    DWORD m_cbFree;
+
+    static int GetClass(DWORD cb, DWORD& cbClass);
+
+    void Recycle(IMFSample*);
+    void Recycle(IMFMediaBuffer*);
+    void Purge();
+
+};
+
+
+}  //end namespace WebmMfSourceLib
@@ -5,6 +5,8 @@
 #include "webmmfstreamaudio.h"
 #include "webmmfbytestreamhandler.h"
 #include "webmtypes.h"
+#include "mkvparserelementreader.h"
+#include "threadutil.h"
 #include <mfapi.h>
 #include <mferror.h>
 #include <new>
@@ -19,6 +21,9 @@
 #include <process.h>
 #include <algorithm>
 #include <propvarutil.h>
+#include <propsys.h>
+#include <initguid.h>  //for the PKEYs
+#include <propkey.h>
 #ifdef _DEBUG
 #include <iomanip>
 #include "odbgstream.h"
@@ -76,6 +81,52 @@ using std::wstring;
 _COM_SMARTPTR_TYPEDEF(IMFMediaEventQueue, __uuidof(IMFMediaEventQueue));
 _COM_SMARTPTR_TYPEDEF(IMFStreamDescriptor, __uuidof(IMFStreamDescriptor));
 _COM_SMARTPTR_TYPEDEF(IMFMediaEvent, __uuidof(IMFMediaEvent));
+_COM_SMARTPTR_TYPEDEF(IMFAttributes, __uuidof(IMFAttributes));
+_COM_SMARTPTR_TYPEDEF(IPropertyStore, __uuidof(IPropertyStore));
+
+
+namespace
+{
+
+//The load slots of the sources in the process (see
+//WebmMfSource::StateWaitLoadSlot).  A handle of 0 means the semaphore
+//couldn't be created, and the loads are then not limited.
+
+class LoadSlots
+{
+    LoadSlots(const LoadSlots&);
+    LoadSlots& operator=(const LoadSlots&);
+
+public:
+
+    enum { kMaxConcurrentLoads = 4 };
+
+    LoadSlots() :
+        m_hSemaphore(CreateSemaphore(
+                        0,
+                        kMaxConcurrentLoads,
+                        kMaxConcurrentLoads,
+                        0))
+    {
+    }
+
+    ~LoadSlots()
+    {
+        if (m_hSemaphore)
+        {
+            const BOOL b = CloseHandle(m_hSemaphore);
+            assert(b);
+            b;
+        }
+    }
+
+    const HANDLE m_hSemaphore;
+
+};
+
+LoadSlots s_load_slots;
+
+}  //end anon namespace
 
 
 namespace WebmMfSourceLib
@@ -84,9 +135,10 @@ namespace WebmMfSourceLib
 HRESULT WebmMfSource::CreateSource(
     IClassFactory* pCF,
     IMFByteStream* pBS,
+    IPropertyStore* pProps,
     WebmMfSource*& pSource)
 {
-    pSource = new (std::nothrow) WebmMfSource(pCF, pBS);
+    pSource = new (std::nothrow) WebmMfSource(pCF, pBS, pProps);
     return pSource ? S_OK : E_OUTOFMEMORY;
 }
 
@@ -94,12 +146,16 @@ HRESULT WebmMfSource::CreateSource(
 #pragma warning(disable:4355)  //'this' ptr in member init list
 WebmMfSource::WebmMfSource(
     IClassFactory* pCF,
-    IMFByteStream* pBS) :
+    IMFByteStream* pBS,
+    IPropertyStore* pProps) :
     m_pClassFactory(pCF),
     m_cRef(1),
     m_file(pBS),
     m_pSegment(0),
     m_preroll_ns(-1),
+    m_bLowLatency(
+        (GetPropertyValue(pProps, MF_LOW_LATENCY) != 0) ||
+        (GetPropertyValue(pProps, WebmTypes::WebmMfSource_LowLatency) != 0)),
     m_bThin(FALSE),
     m_rate(1),
     m_async_read(this),
@@ -112,7 +168,36 @@ WebmMfSource::WebmMfSource(
     m_pNext(0),
     //m_bLive(true),
     m_bCanSeek(false),
-    m_load_index(-1)
+    m_load_index(-1),
+    m_prefetch_reftime(GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_PrefetchDuration)),
+    m_prefetch_bytes(GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_PrefetchBytes)),
+    m_bFastOpen(GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_FastOpen) != 0),
+    m_open_time(MFGetSystemTime()),
+    m_load_duration(-1),
+    m_first_frame_time(-1),
+    m_latency_count(0),
+    m_latency_sum(0),
+    m_latency_last(0),
+    m_latency_max(0),
+    m_bCheckCrc(GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_CheckCrc) != 0),
+    m_crc_pos(-1),
+    m_crc_checked(0),
+    m_crc_failed(0),
+    m_seek_prefetch_pos(-1),
+    m_seek_prefetch_len(0),
+    m_bCancelLoad(0),
+    m_open_deadline(GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_OpenDeadline)),
+    m_bHoldsLoadSlot(false)
 {
     HRESULT hr = m_pClassFactory->LockServer(TRUE);
     assert(SUCCEEDED(hr));
@@ -131,6 +216,47 @@ WebmMfSource::WebmMfSource(
 
     m_bLive = FAILED(hr);
 
+    //A file that is still being written (by webmmux in live mode, say)
+    //is followed as it grows, and played as a live source: it can't be
+    //seeked, and its length is unknown until the writer is done.
+
+    const LPWSTR name = GetOriginName(pBS);
+
+    if (name && webmdshow::TailFollower::IsBeingWritten(name))
+    {
+        if (m_file.Follow(name))
+            m_bLive = true;
+    }
+
+    //Keep what a byte budget prefetches, with some slack for streams
+    //that trail the furthest one.  A duration budget has no byte size
+    //up front, so it leaves purging ahead disabled.
+
+    if (m_prefetch_bytes > 0)
+        m_file.SetPurgeDistance(2 * m_prefetch_bytes);
+
+    //The WebmMfSource_SharedCacheBytes property opts in to sharing the
+    //pages of the file with the other sources in the process that have
+    //it open.  The limit is for the whole cache.
+
+    const LONGLONG shared_bytes = GetPropertyValue(
+        pProps,
+        WebmTypes::WebmMfSource_SharedCacheBytes);
+
+    if (shared_bytes > 0)
+    {
+        using webmdshow::SharedFileCache;
+        SharedFileCache::SetLimit(shared_bytes);
+
+        //The cache knows a file by its size, which a followed file keeps
+        //changing, so its pages aren't shared.
+
+        if (name && !m_file.IsFollowing())
+            m_file.SetSharedFile(SharedFileCache::Open(name));
+    }
+
+    CoTaskMemFree(name);
+
     m_commands.push_back(Command(Command::kStop, this));
 
     m_thread_state = &WebmMfSource::StateAsyncRead;
@@ -145,6 +271,14 @@ WebmMfSource::WebmMfSource(
        << "; bLive="
        << boolalpha
        << m_bLive
+       << "; prefetch[ms]="
+       << (m_prefetch_reftime / 10000)
+       << "; prefetch[bytes]="
+       << m_prefetch_bytes
+       << "; fastopen="
+       << m_bFastOpen
+       << "; lowlatency="
+       << m_bLowLatency
        << endl;
 #endif
 }
@@ -160,6 +294,8 @@ WebmMfSource::~WebmMfSource()
 
     FinalThread();
 
+    ReleaseLoadSlot();  //if shut down during the load
+
     while (!m_requests.empty())
     {
         Request& r = m_requests.front();
@@ -344,6 +480,10 @@ HRESULT WebmMfSource::QueryInterface(
     {
         pUnk = static_cast<IMFGetService*>(this);
     }
+    else if (iid == __uuidof(IMFQualityAdvise))
+    {
+        pUnk = static_cast<IMFQualityAdvise*>(this);
+    }
     else
     {
 #ifdef _DEBUG
@@ -414,15 +554,130 @@ HRESULT WebmMfSource::BeginLoad(IMFAsyncCallback* pCB)
 
     assert(m_thread_state == &WebmMfSource::StateAsyncRead);
 
+    //The first read is made by the worker thread, once it has a load
+    //slot (see StateWaitLoadSlot).
+
+    m_async_state = &WebmMfSource::StateAsyncWaitLoadSlot;
+    m_async_read.m_hrStatus = S_OK;
+
+    const BOOL b = SetEvent(m_hAsyncRead);
+    assert(b);
+
+    m_pLoadResult = pLoadResult;  //TODO: do we really local pLoadResult?
+    return S_OK;
+}
+
+
+void WebmMfSource::CancelLoad()
+{
+    InterlockedExchange(&m_bCancelLoad, 1);
+
+    m_file.CancelReads();
+
+    //Wake the worker thread, if it is waiting for a load slot, or
+    //between reads.  If it is waiting for a read, the byte stream
+    //completes it with an error (the handler closes the stream), or it
+    //completes as usual, and our flag is found either way.
+
+    const BOOL b = SetEvent(m_hAsyncRead);
+    assert(b);
+}
+
+
+bool WebmMfSource::IsOpenDeadlinePast() const
+{
+    if (m_open_deadline <= 0)
+        return false;
+
+    return ((MFGetSystemTime() - m_open_time) >= m_open_deadline);
+}
+
+
+void WebmMfSource::ReleaseLoadSlot()
+{
+    if (!m_bHoldsLoadSlot)
+        return;
+
+    m_bHoldsLoadSlot = false;
+
+    const BOOL b = ReleaseSemaphore(s_load_slots.m_hSemaphore, 1, 0);
+    assert(b);
+    b;
+}
+
+
+WebmMfSource::thread_state_t WebmMfSource::StateAsyncWaitLoadSlot()
+{
+    return &WebmMfSource::StateWaitLoadSlot;
+}
+
+
+bool WebmMfSource::StateWaitLoadSlot()
+{
+    const HANDLE hSlots = s_load_slots.m_hSemaphore;
+
+    enum { nh = 3 };
+    const HANDLE ah[nh] = { m_hQuit, m_hAsyncRead, hSlots };
+
+    const DWORD dw = hSlots ?
+                        WaitForMultipleObjects(nh, ah, FALSE, INFINITE) :
+                        WAIT_OBJECT_0 + 2;
+
+    if (dw == WAIT_FAILED)
+        return true;  //TODO: signal error to pipeline
+
+    assert(dw >= WAIT_OBJECT_0);
+    assert(dw < (WAIT_OBJECT_0 + nh));
+
+    if (dw == WAIT_OBJECT_0)  //hQuit
+        return true;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (dw == (WAIT_OBJECT_0 + 2))  //hSlots
+        m_bHoldsLoadSlot = (hSlots != 0);
+
+    if (FAILED(hr))
+    {
+        ReleaseLoadSlot();
+        return true;
+    }
+
+    if (m_pEvents == 0)  //shutdown
+    {
+        ReleaseLoadSlot();
+
+        const BOOL b = SetEvent(m_hRequestSample);
+        assert(b);
+
+        m_thread_state = &WebmMfSource::StateRequestSample;
+        return false;  //clean up and exit
+    }
+
+    if (m_bCancelLoad)
+    {
+        m_thread_state = LoadComplete(MF_E_OPERATION_CANCELLED);
+        return false;
+    }
+
+    if (hSlots && !m_bHoldsLoadSlot)  //spurious hAsyncRead
+        return false;  //wait again
+
     m_file.ResetAvailable(0);
     m_file.Seek(0);
 
     hr = m_file.AsyncReadInit(0, 1024, &m_async_read);
 
     if (FAILED(hr))
-        return hr;
+    {
+        m_thread_state = LoadComplete(hr);
+        return false;
+    }
 
     m_async_state = &WebmMfSource::StateAsyncParseEbmlHeader;
+    m_thread_state = &WebmMfSource::StateAsyncRead;
 
     if (hr == S_OK)  //all bytes already in cache
     {
@@ -432,8 +687,7 @@ HRESULT WebmMfSource::BeginLoad(IMFAsyncCallback* pCB)
         assert(b);
     }
 
-    m_pLoadResult = pLoadResult;  //TODO: do we really local pLoadResult?
-    return S_OK;
+    return false;
 }
 
 
@@ -456,6 +710,8 @@ HRESULT WebmMfSource::EndLoad(IMFAsyncResult* pLoadResult)
 WebmMfSource::thread_state_t
 WebmMfSource::LoadComplete(HRESULT hrLoad)
 {
+    ReleaseLoadSlot();
+
     if (m_pLoadResult)  //should always be true
     {
         HRESULT hr = m_pLoadResult->SetStatus(hrLoad);
@@ -470,6 +726,15 @@ WebmMfSource::LoadComplete(HRESULT hrLoad)
     if (FAILED(hrLoad))
         return &WebmMfSource::StateQuit;
 
+    m_load_duration = MFGetSystemTime() - m_open_time;
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "WebmMfSource::LoadComplete: load[ms]="
+       << (m_load_duration / 10000)
+       << endl;
+#endif
+
     const BOOL b = SetEvent(m_hRequestSample);
     assert(b);
 
@@ -683,6 +948,9 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncParseSegmentHeaders()
     else if (total < 0)  //don't know total file size
         __noop;
 
+    else if (IsOpenDeadlinePast())  //no time for the cues
+        __noop;
+
     else if (const mkvparser::SeekHead* pSH = m_pSegment->GetSeekHead())
     {
         const int count = pSH->GetCount();
@@ -714,7 +982,8 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncParseSegmentHeaders()
         }
     }
 
-    m_file.EnableBuffering(GetDuration());
+    if (!m_bLowLatency)
+        m_file.EnableBuffering(GetDuration());
 
     m_async_state = &WebmMfSource::StateAsyncLoadCluster;
     m_async_read.m_hrStatus = S_OK;
@@ -772,7 +1041,8 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncParseCues()
 
             assert(m_pSegment->GetCount() == 0);
 
-            m_file.EnableBuffering(GetDuration());
+            if (!m_bLowLatency)
+                m_file.EnableBuffering(GetDuration());
 
             m_async_state = &WebmMfSource::StateAsyncLoadCluster;
             m_async_read.m_hrStatus = S_OK;
@@ -949,6 +1219,9 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncInitStreams()
         {
             assert(status == mkvparser::E_BUFFER_NOT_FULL);
 
+            if (IsOpenDeadlinePast())  //make do with what we've found
+                break;
+
             m_async_state = &WebmMfSource::StateAsyncParseCluster;
             m_async_read.m_hrStatus = S_OK;
 
@@ -963,6 +1236,9 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncInitStreams()
             if (m_pSegment->GetCount() >= 10)
                 break;
 
+            if (IsOpenDeadlinePast())
+                break;
+
             m_load_index = -1;
 
             m_async_state = &WebmMfSource::StateAsyncLoadCluster;
@@ -1027,6 +1303,9 @@ WebmMfSource::thread_state_t WebmMfSource::StateAsyncInitStreams()
         WebmMfStream* const pStream = v.second;
         assert(pStream);
 
+        if (IsFirstBlockDeferred(pStream))
+            continue;  //searched for when the stream is started
+
         //Set stream to EOS, if not already initialized.
 
         const HRESULT hr = pStream->SetFirstBlock(0);
@@ -1056,6 +1335,9 @@ bool WebmMfSource::InitStreamsDone() const
         WebmMfStream* const pStream = v.second;
         assert(pStream);
 
+        if (IsFirstBlockDeferred(pStream))
+            continue;
+
         if (pStream->GetFirstBlock() == 0)
             return false;
     }
@@ -1064,6 +1346,26 @@ bool WebmMfSource::InitStreamsDone() const
 }
 
 
+bool WebmMfSource::IsFirstBlockDeferred(const WebmMfStream* pStream) const
+{
+    //In fast open mode we only wait for the video streams during the
+    //load, since finding the first audio block can mean loading far more
+    //clusters than the first video frame needs.  A source without video
+    //still finds every first block.
+
+    if (!m_bFastOpen)
+        return false;
+
+    if (pStream->GetFirstBlock())
+        return false;
+
+    if (pStream->m_pTrack->GetType() == 1)  //video
+        return false;
+
+    return HaveVideo();
+}
+
+
 std::wstring WebmMfSource::ConvertFromUTF8(const char* str)
 {
     const int cch = MultiByteToWideChar(
@@ -1634,6 +1936,11 @@ HRESULT WebmMfSource::Pause()
 
 HRESULT WebmMfSource::Shutdown()
 {
+    //The worker thread may be holding the lock while it waits for the
+    //writer of a followed file, so end that wait first.
+
+    m_file.CancelFollow();
+
     Lock lock;
 
     HRESULT hr = lock.Seize(this);
@@ -1936,6 +2243,24 @@ HRESULT WebmMfSource::GetService(
     if (sid == MF_RATE_CONTROL_SERVICE)
         return WebmMfSource::QueryInterface(iid, ppv);
 
+    if (sid == MF_QUALITY_SERVICES)
+        return WebmMfSource::QueryInterface(iid, ppv);
+
+    if (sid == WebmTypes::WebmMfSource_CacheStats)
+        return GetCacheStats(iid, ppv);
+
+    if (sid == WebmTypes::WebmMfSource_OpenStats)
+        return GetOpenStats(iid, ppv);
+
+    if (sid == WebmTypes::WebmMfSource_LatencyStats)
+        return GetLatencyStats(iid, ppv);
+
+    if (sid == WebmTypes::WebmMfSource_CrcStats)
+        return GetCrcStats(iid, ppv);
+
+    if (sid == MF_PROPERTY_HANDLER_SERVICE)
+        return GetPropertyStore(iid, ppv);
+
     if (ppv)
         *ppv = 0;
 
@@ -1943,6 +2268,420 @@ HRESULT WebmMfSource::GetService(
 }
 
 
+HRESULT WebmMfSource::SetDropMode(MF_QUALITY_DROP_MODE mode)
+{
+    if (mode == MF_DROP_MODE_NONE)
+        return S_OK;
+
+    return MF_E_NO_MORE_DROP_MODES;
+}
+
+
+HRESULT WebmMfSource::SetQualityLevel(MF_QUALITY_LEVEL level)
+{
+    if (level == MF_QUALITY_NORMAL)
+        return S_OK;
+
+    return MF_E_NO_MORE_QUALITY_LEVELS;
+}
+
+
+HRESULT WebmMfSource::GetDropMode(MF_QUALITY_DROP_MODE* pMode)
+{
+    if (pMode == 0)
+        return E_POINTER;
+
+    *pMode = MF_DROP_MODE_NONE;
+    return S_OK;
+}
+
+
+HRESULT WebmMfSource::GetQualityLevel(MF_QUALITY_LEVEL* pLevel)
+{
+    if (pLevel == 0)
+        return E_POINTER;
+
+    *pLevel = MF_QUALITY_NORMAL;
+    return S_OK;
+}
+
+
+HRESULT WebmMfSource::DropTime(LONGLONG reftime)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    //The amount is absolute, measured from where each video stream is
+    //now; it replaces the value from any earlier call.  Zero cancels.
+
+    typedef streams_t::iterator iter_t;
+
+    iter_t i = m_streams.begin();
+    const iter_t j = m_streams.end();
+
+    while (i != j)
+    {
+        const streams_t::value_type& v = *i++;
+
+        WebmMfStream* const pStream = v.second;
+        assert(pStream);
+
+        if (!pStream->IsSelected())
+            continue;
+
+        if (pStream->m_pTrack->GetType() != 1)  //not video
+            continue;
+
+        static_cast<WebmMfStreamVideo*>(pStream)->DropTime(reftime);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT WebmMfSource::GetCacheStats(REFIID iid, LPVOID* ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    MkvReader::CacheStats stats;
+    m_file.GetCacheStats(stats);
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    //A snapshot: ask for the service again to get fresh values.
+
+    IMFAttributesPtr pAttributes;
+
+    hr = MFCreateAttributes(&pAttributes, 3);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(WebmTypes::WebmMfSource_CacheHits, stats.hits);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(
+            WebmTypes::WebmMfSource_CacheMisses,
+            stats.misses);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(
+            WebmTypes::WebmMfSource_CacheResidentBytes,
+            stats.resident_bytes);
+
+    if (FAILED(hr))
+        return hr;
+
+    return pAttributes->QueryInterface(iid, ppv);
+}
+
+
+HRESULT WebmMfSource::GetOpenStats(REFIID iid, LPVOID* ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    const MFTIME load_duration = m_load_duration;
+    const MFTIME first_frame_time = m_first_frame_time;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    //Times not reached yet are left out of the snapshot.
+
+    IMFAttributesPtr pAttributes;
+
+    hr = MFCreateAttributes(&pAttributes, 2);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (load_duration >= 0)
+    {
+        hr = pAttributes->SetUINT64(
+                WebmTypes::WebmMfSource_LoadDuration,
+                load_duration);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (first_frame_time >= 0)
+    {
+        hr = pAttributes->SetUINT64(
+                WebmTypes::WebmMfSource_TimeToFirstFrame,
+                first_frame_time);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return pAttributes->QueryInterface(iid, ppv);
+}
+
+
+HRESULT WebmMfSource::GetLatencyStats(REFIID iid, LPVOID* ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    const LONGLONG count = m_latency_count;
+    const MFTIME sum = m_latency_sum;
+    const MFTIME last = m_latency_last;
+    const MFTIME max = m_latency_max;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    //Empty until a sample has been delivered.
+
+    IMFAttributesPtr pAttributes;
+
+    hr = MFCreateAttributes(&pAttributes, 3);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (count <= 0)
+        return pAttributes->QueryInterface(iid, ppv);
+
+    hr = pAttributes->SetUINT64(WebmTypes::WebmMfSource_LatencyLast, last);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(
+            WebmTypes::WebmMfSource_LatencyMean,
+            sum / count);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(WebmTypes::WebmMfSource_LatencyMax, max);
+
+    if (FAILED(hr))
+        return hr;
+
+    return pAttributes->QueryInterface(iid, ppv);
+}
+
+
+HRESULT WebmMfSource::GetCrcStats(REFIID iid, LPVOID* ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    const LONGLONG checked = m_crc_checked;
+    const LONGLONG failed = m_crc_failed;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    IMFAttributesPtr pAttributes;
+
+    hr = MFCreateAttributes(&pAttributes, 2);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(
+            WebmTypes::WebmMfSource_CrcChecked,
+            checked);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAttributes->SetUINT64(WebmTypes::WebmMfSource_CrcFailed, failed);
+
+    if (FAILED(hr))
+        return hr;
+
+    return pAttributes->QueryInterface(iid, ppv);
+}
+
+
+HRESULT WebmMfSource::GetPropertyStore(REFIID iid, LPVOID* ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    *ppv = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pEvents == 0)
+        return MF_E_SHUTDOWN;
+
+    mkvparser::Prober::Info info;
+
+    hr = m_file.Probe(info);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    IPropertyStorePtr pStore;
+
+    hr = PSCreateMemoryPropertyStore(
+            __uuidof(IPropertyStore),
+            reinterpret_cast<void**>(&pStore));
+
+    if (FAILED(hr))
+        return hr;
+
+    PROPVARIANT var;
+
+    if (info.duration_ns >= 0)
+    {
+        const ULONGLONG duration = info.duration_ns / 100;  //reftime
+
+        hr = InitPropVariantFromUInt64(duration, &var);
+        assert(SUCCEEDED(hr));
+
+        hr = pStore->SetValue(PKEY_Media_Duration, var);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    bool bVideo = false;
+    bool bAudio = false;
+
+    typedef mkvparser::Prober::TrackInfo track_t;
+    typedef std::vector<track_t>::const_iterator iter_t;
+
+    for (iter_t i = info.tracks.begin(); i != info.tracks.end(); ++i)
+    {
+        const track_t& t = *i;
+
+        if ((t.type == 1) && !bVideo)
+        {
+            bVideo = true;
+
+            hr = InitPropVariantFromUInt32(ULONG(t.width), &var);
+            assert(SUCCEEDED(hr));
+
+            hr = pStore->SetValue(PKEY_Video_FrameWidth, var);
+
+            if (FAILED(hr))
+                return hr;
+
+            hr = InitPropVariantFromUInt32(ULONG(t.height), &var);
+            assert(SUCCEEDED(hr));
+
+            hr = pStore->SetValue(PKEY_Video_FrameHeight, var);
+
+            if (FAILED(hr))
+                return hr;
+
+            if (t.frame_rate > 0)
+            {
+                //frames per 1000 seconds
+                const ULONG rate = static_cast<ULONG>(t.frame_rate * 1000);
+
+                hr = InitPropVariantFromUInt32(rate, &var);
+                assert(SUCCEEDED(hr));
+
+                hr = pStore->SetValue(PKEY_Video_FrameRate, var);
+
+                if (FAILED(hr))
+                    return hr;
+            }
+        }
+        else if ((t.type == 2) && !bAudio)
+        {
+            bAudio = true;
+
+            hr = InitPropVariantFromUInt32(ULONG(t.channels), &var);
+            assert(SUCCEEDED(hr));
+
+            hr = pStore->SetValue(PKEY_Audio_ChannelCount, var);
+
+            if (FAILED(hr))
+                return hr;
+
+            hr = InitPropVariantFromUInt32(ULONG(t.sample_rate), &var);
+            assert(SUCCEEDED(hr));
+
+            hr = pStore->SetValue(PKEY_Audio_SampleRate, var);
+
+            if (FAILED(hr))
+                return hr;
+        }
+    }
+
+    return pStore->QueryInterface(iid, ppv);
+}
+
+
 HRESULT WebmMfSource::CreateStream(
     IMFStreamDescriptor* pSD,
     const mkvparser::Track* pTrack)
@@ -2240,6 +2979,10 @@ unsigned WebmMfSource::ThreadProc(void* pv)
     WebmMfSource* const pSource = static_cast<WebmMfSource*>(pv);
     assert(pSource);
 
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmmfsource",
+            WebmMfUtil::kThreadClassPlayback);
+
     return pSource->Main();
 }
 
@@ -2508,6 +3251,18 @@ WebmMfSource::thread_state_t WebmMfSource::OnRequestSample()
         return 0;  //come back here
     }
 
+    if (m_seek_prefetch_pos >= 0)
+    {
+        m_async_read.m_bCanInterrupt = false;
+        m_async_read.m_hrStatus = S_OK;
+        m_async_state = &WebmMfSource::StateAsyncSeekPrefetchInit;
+
+        const BOOL b = SetEvent(m_hAsyncRead);
+        assert(b);
+
+        return &WebmMfSource::StateAsyncRead;
+    }
+
     requests_t& rr = m_requests;
 
     //{
@@ -2945,6 +3700,21 @@ WebmMfSource::thread_state_t WebmMfSource::OnRequestSample()
         return &WebmMfSource::StateQuit;
     }
 
+    UpdateLatency(pCurr->GetBlock());
+
+    if ((m_first_frame_time < 0) &&
+        ((pStream->m_pTrack->GetType() == 1) || !HaveVideo()))
+    {
+        m_first_frame_time = MFGetSystemTime() - m_open_time;
+
+#ifdef _DEBUG
+        odbgstream os;
+        os << "WebmMfSource: time to first frame[ms]="
+           << (m_first_frame_time / 10000)
+           << endl;
+#endif
+    }
+
     if (r.pToken)
         r.pToken->Release();
 
@@ -3029,7 +3799,7 @@ WebmMfSource::Parse(bool& bDone)
 {
     bDone = true;
 
-    if (m_bThin || (m_rate != 1))
+    if (m_bThin || (m_rate != 1) || m_bLowLatency)
         return 0;
 
     typedef streams_t::const_iterator iter_t;
@@ -3127,17 +3897,51 @@ WebmMfSource::Parse(const mkvparser::Cluster* pCurr, bool& bDone)
             //   << " pos-filepos=" << (pos - filepos)
             //   << endl;
 
-            //m_async_state = &WebmMfSource::StateAsyncParseCurr;
-            m_async_state = &WebmMfSource::StateAsyncRequestSample;
-            return &WebmMfSource::StateAsyncRead;
-        }
+            //m_async_state = &WebmMfSource::StateAsyncParseCurr;
+            m_async_state = &WebmMfSource::StateAsyncRequestSample;
+            return &WebmMfSource::StateAsyncRead;
+        }
+    }
+
+    assert(bDone);
+
+    //Without a prefetch budget we parse just one cluster ahead of the
+    //furthest stream.  With one, we keep walking forward (which, since
+    //reads are serial, also loads the block payloads into the cache)
+    //until the budget is spent.  It does not have to be spent all at
+    //once: each call returns as soon as it parses something, so sample
+    //requests get in between, and they interrupt any read in progress.
+
+    const mkvparser::Cluster* const pBase = pCurr;
+
+    for (;;)
+    {
+        const mkvparser::Cluster* pNext;
+
+        if (thread_state_t s = ParseNext(pCurr, pNext, bDone))
+            return s;
+
+        if (!bDone || (pNext == 0))
+            return 0;
+
+        if (!IsPrefetchDue(pBase, pNext))
+            return 0;
+
+        pCurr = pNext;
     }
+}
 
-    assert(bDone);
 
-    //Create next cluster object (if it doesn't already exist).
+WebmMfSource::thread_state_t
+WebmMfSource::ParseNext(
+    const mkvparser::Cluster* pCurr,
+    const mkvparser::Cluster*& pNext,
+    bool& bDone)
+{
+    bDone = true;
+    pNext = 0;
 
-    const mkvparser::Cluster* pNext;
+    //Create next cluster object (if it doesn't already exist).
 
     for (;;)
     {
@@ -3147,7 +3951,10 @@ WebmMfSource::Parse(const mkvparser::Cluster* pCurr, bool& bDone)
         const long status = m_pSegment->ParseNext(pCurr, pNext, pos, len);
 
         if (status > 0)  //EOF
+        {
+            pNext = 0;
             return 0;
+        }
 
         if (status == 0)  //have next cluster
             break;
@@ -3194,7 +4001,10 @@ WebmMfSource::Parse(const mkvparser::Cluster* pCurr, bool& bDone)
         const long status = pNext->Parse(pos, len);
 
         if (status > 0) //nothing remains to be parsed
+        {
+            CheckClusterCrc(pNext);
             return 0;
+        }
 
         if (status == 0)  //parsed something
         {
@@ -3234,6 +4044,186 @@ WebmMfSource::Parse(const mkvparser::Cluster* pCurr, bool& bDone)
 }
 
 
+void WebmMfSource::CheckClusterCrc(const mkvparser::Cluster* pCluster)
+{
+    if (!m_bCheckCrc)
+        return;
+
+    const LONGLONG start = pCluster->m_element_start;
+
+    if (start <= m_crc_pos)  //checked already, or behind the parse
+        return;
+
+    m_crc_pos = start;
+
+    typedef mkvparser::ElementReader ElementReader;
+
+    ElementReader::Element c;
+
+    if (!ElementReader::ReadHeader(&m_file, start, LLONG_MAX, c))
+        return;
+
+    switch (ElementReader::CheckCrc32(&m_file, c))
+    {
+        case ElementReader::kCrc32Match:
+            ++m_crc_checked;
+            break;
+
+        case ElementReader::kCrc32Mismatch:
+        {
+            ++m_crc_checked;
+            ++m_crc_failed;
+
+#ifdef _DEBUG
+            odbgstream os;
+            os << "WebmMfSource: CRC-32 of cluster at " << start
+               << " doesn't match" << endl;
+#endif
+
+            break;
+        }
+
+        default:  //no CRC-32, or its pages have left the cache
+            break;
+    }
+}
+
+
+void WebmMfSource::UpdateLatency(const mkvparser::Block* pBlock)
+{
+    assert(pBlock);
+
+    const LONGLONG pos = pBlock->m_start + pBlock->m_size - 1;
+    const MFTIME arrival = m_file.GetArrivalTime(pos);
+
+    if (arrival < 0)  //page no longer in the cache
+        return;
+
+    const MFTIME now = MFGetSystemTime();
+    const MFTIME latency = (now > arrival) ? (now - arrival) : 0;
+
+    ++m_latency_count;
+    m_latency_sum += latency;
+    m_latency_last = latency;
+
+    if (latency > m_latency_max)
+        m_latency_max = latency;
+}
+
+
+bool WebmMfSource::IsPrefetchDue(
+    const mkvparser::Cluster* pBase,
+    const mkvparser::Cluster* pNext) const
+{
+    assert(pBase);
+    assert(pNext);
+
+    if ((m_prefetch_reftime <= 0) && (m_prefetch_bytes <= 0))
+        return false;
+
+    if (m_prefetch_bytes > 0)
+    {
+        const LONGLONG bytes = pNext->m_element_start - pBase->m_element_start;
+
+        if (bytes >= m_prefetch_bytes)
+            return false;
+    }
+
+    if (m_prefetch_reftime > 0)
+    {
+        const LONGLONG base_ns = pBase->GetTime();
+        const LONGLONG next_ns = pNext->GetTime();
+
+        if ((base_ns < 0) || (next_ns < 0))  //weird
+            return false;
+
+        const LONGLONG reftime = (next_ns - base_ns) / 100;
+
+        if (reftime >= m_prefetch_reftime)
+            return false;
+    }
+
+    return true;
+}
+
+
+LONGLONG WebmMfSource::GetPropertyValue(
+    IPropertyStore* pProps,
+    const GUID& fmtid)
+{
+    if (pProps == 0)
+        return 0;
+
+    PROPERTYKEY key;
+
+    key.fmtid = fmtid;
+    key.pid = 0;
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+
+    HRESULT hr = pProps->GetValue(key, &var);
+
+    if (FAILED(hr))
+        return 0;
+
+    LONGLONG value;
+
+    switch (var.vt)
+    {
+        case VT_UI8:
+            value = static_cast<LONGLONG>(var.uhVal.QuadPart);
+            break;
+
+        case VT_I8:
+            value = var.hVal.QuadPart;
+            break;
+
+        case VT_UI4:
+            value = var.ulVal;
+            break;
+
+        case VT_I4:
+            value = var.lVal;
+            break;
+
+        case VT_BOOL:
+            value = var.boolVal ? 1 : 0;
+            break;
+
+        default:
+            value = 0;
+            break;
+    }
+
+    PropVariantClear(&var);
+
+    return (value < 0) ? 0 : value;
+}
+
+
+LPWSTR WebmMfSource::GetOriginName(IMFByteStream* pBS)
+{
+    const IMFAttributesPtr pAttributes(pBS);
+
+    if (!bool(pAttributes))
+        return 0;
+
+    LPWSTR name;
+    UINT32 len;
+
+    const HRESULT hr = pAttributes->GetAllocatedString(
+                        MF_BYTESTREAM_ORIGIN_NAME,
+                        &name,
+                        &len);
+
+    if (FAILED(hr))
+        return 0;
+
+    return name;
+}
+
+
 #if 0
 WebmMfSource::thread_state_t
 WebmMfSource::StateAsyncParseCurr()
@@ -3562,7 +4552,8 @@ bool WebmMfSource::Command::OnStart()
     const LONGLONG time_ns = reftime * 100;
     assert(time_ns >= 0);
 
-    m_pSource->m_preroll_ns = time_ns;  //TODO: better way to handle this?
+    //TODO: better way to handle this?
+    m_pSource->m_preroll_ns = m_pSource->m_bLowLatency ? -1 : time_ns;
 
     mkvparser::Segment* const pSegment = m_pSource->m_pSegment;
 
@@ -3969,6 +4960,7 @@ void WebmMfSource::Command::OnStartNoSeek() const
     //we need to load it into the cache
 
     m_pSource->m_preroll_ns = -1;  //don't throw anything away
+    m_pSource->m_seek_prefetch_pos = -1;
 
     mkvparser::Segment* const pSegment = m_pSource->m_pSegment;
 
@@ -4031,7 +5023,7 @@ void WebmMfSource::Command::OnStartNoSeek() const
         //then pCurr=NULL, and this is intepreted to mean
         //"use the requested seek time to find the block".
 
-        pStream->SetCurrBlock(pStream->GetFirstBlock());
+        SetCurrBlockFirst(pStream);
     }
 
     const mkvparser::Cluster* const pCurr = pSegment->GetFirst();
@@ -4064,6 +5056,28 @@ void WebmMfSource::Command::OnStartNoSeek() const
 }
 
 
+void WebmMfSource::Command::SetCurrBlockFirst(WebmMfStream* pStream) const
+{
+    if (const mkvparser::BlockEntry* pFirst = pStream->GetFirstBlock())
+    {
+        pStream->SetCurrBlock(pFirst);
+        return;
+    }
+
+    //Fast open deferred the search for this stream's first block, so we
+    //let the stream find it lazily, in the first cluster, when its first
+    //sample is requested.
+
+    assert(m_pSource->IsFirstBlockDeferred(pStream));
+
+    const mkvparser::Cluster* const pFirst = m_pSource->m_pSegment->GetFirst();
+    assert(pFirst);
+    assert(!pFirst->EOS());  //the load found a video block
+
+    pStream->SetCurrBlockInit(0, pFirst->GetPosition());
+}
+
+
 void WebmMfSource::Command::OnStartComplete() const
 {
     HRESULT hr = m_pSource->QueueEvent(
@@ -4306,7 +5320,10 @@ void WebmMfSource::Command::OnStartInitStreams(
     LONGLONG time_ns,
     LONGLONG base_pos) const
 {
-    m_pSource->m_preroll_ns = m_pSource->m_bThin ? -1 : time_ns;
+    if (m_pSource->m_bThin || m_pSource->m_bLowLatency)
+        m_pSource->m_preroll_ns = -1;
+    else
+        m_pSource->m_preroll_ns = time_ns;
 
     mkvparser::Segment* const pSegment = m_pSource->m_pSegment;
 
@@ -4365,14 +5382,132 @@ void WebmMfSource::Command::OnStartInitStreams(
         pStream->SetCurrBlockInit(time_ns, base_pos);
     }
 
+    SetSeekPrefetch(time_ns, base_pos);
+
     MkvReader& f = m_pSource->m_file;
 
     f.ResetAvailable(base_pos);
-    f.Seek(base_pos);
+
+    if (m_pSource->m_seek_prefetch_pos >= 0)
+        f.Seek(m_pSource->m_seek_prefetch_pos);
+    else
+        f.Seek(base_pos);
 }
 #endif
 
 
+void WebmMfSource::Command::SetSeekPrefetch(
+    LONGLONG time_ns,
+    LONGLONG base_pos) const
+{
+    WebmMfSource* const pSource = m_pSource;
+
+    pSource->m_seek_prefetch_pos = -1;
+    pSource->m_seek_prefetch_len = 0;
+
+    if (pSource->m_bLowLatency)  //nothing is read ahead of requests
+        return;
+
+    mkvparser::Segment* const pSegment = pSource->m_pSegment;
+
+    const mkvparser::Cues* const pCues = pSegment->GetCues();
+    assert(pCues);
+
+    using mkvparser::CuePoint;
+
+    //Every stream begins its search on the base cluster; a video stream
+    //whose cue point is on a later cluster searches forward to it.  An
+    //audio stream (which is rarely cued) finds its block near the
+    //furthest of those, so the span runs to the next cued cluster.
+
+    LONGLONG last_pos = base_pos;
+    const CuePoint* pLast = 0;
+
+    typedef streams_t::const_iterator iter_t;
+
+    iter_t i = pSource->m_streams.begin();
+    const iter_t j = pSource->m_streams.end();
+
+    while (i != j)
+    {
+        const WebmMfStream* const pStream = (i++)->second;
+        assert(pStream);
+
+        if (!pStream->IsSelected())
+            continue;
+
+        const CuePoint* pCP;
+        const CuePoint::TrackPosition* pTP;
+
+        if (!pCues->Find(time_ns, pStream->m_pTrack, pCP, pTP))
+            continue;
+
+        assert(pCP);
+        assert(pTP);
+
+        if ((pLast == 0) || (pTP->m_pos > last_pos))
+        {
+            last_pos = (pTP->m_pos > base_pos) ? pTP->m_pos : base_pos;
+            pLast = pCP;
+        }
+    }
+
+    if (pLast == 0)  //weird, since the base came from the cues
+        return;
+
+    LONGLONG end_pos = -1;  //of the span, relative to the segment
+
+    const CuePoint* pCP = pLast;
+
+    while (end_pos < 0)
+    {
+        const CuePoint* const pCurr = pCP;
+
+        for (;;)
+        {
+            pCP = pCues->GetNext(pCurr);
+
+            if ((pCP != 0) || pCues->DoneParsing())
+                break;
+
+            pCues->LoadCuePoint();
+        }
+
+        if (pCP == 0)  //the furthest cluster is the last one cued
+            break;
+
+        const CuePoint::TrackPosition* const tp = pCP->m_track_positions;
+        const size_t count = pCP->m_track_positions_count;
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            const LONGLONG pos = tp[k].m_pos;
+
+            if ((pos > last_pos) && ((end_pos < 0) || (pos < end_pos)))
+                end_pos = pos;
+        }
+    }
+
+    LONGLONG len;
+
+    if (end_pos >= 0)
+        len = end_pos - base_pos;
+    else if (pSegment->m_size >= 0)  //read to the end of the segment
+        len = pSegment->m_size - base_pos;
+    else  //the file is still being written
+        return;
+
+    if (len <= 0)  //weird
+        return;
+
+    if (len > kMaxSeekPrefetch)
+        len = kMaxSeekPrefetch;
+
+    pSource->m_seek_prefetch_pos = pSegment->m_start + base_pos;
+    pSource->m_seek_prefetch_len = static_cast<LONG>(len);
+}
+
+
 void WebmMfSource::Command::OnSeek() const
 {
     assert(m_kind == kSeek);
@@ -4438,6 +5573,8 @@ void WebmMfSource::Command::OnStop() const
 
     assert(SUCCEEDED(hr));
 
+    m_pSource->m_seek_prefetch_pos = -1;
+
     MkvReader& f = m_pSource->m_file;
 
     f.ResetAvailable(0);
@@ -4599,7 +5736,7 @@ void WebmMfSource::Command::OnRestart() const //unpause
             //if we've been playing for a while and we're not near t=0.
             //To make this correct there really needs to be a seek.
 
-            pStream->SetCurrBlock(pStream->GetFirstBlock());
+            SetCurrBlockFirst(pStream);
 #endif
         }
     }
@@ -4671,11 +5808,25 @@ WebmMfSource::thread_state_t WebmMfSource::OnAsyncRead()
         return &WebmMfSource::StateRequestSample;  //clean up and exit
     }
 
+    if (m_bCancelLoad)
+    {
+        if (m_pLoadResult)
+            return LoadComplete(MF_E_OPERATION_CANCELLED);
+
+        //Cancelled just as the load completed: the handler reports the
+        //cancellation, and shuts us down, so there is nothing to read.
+
+        return &WebmMfSource::StateQuit;
+    }
+
     //this is the value of calling AsyncReadCompletion
     hr = m_async_read.m_hrStatus;  //assigned a value in Invoke
 
     if (FAILED(hr))
     {
+        if (m_pLoadResult)  //the handler is waiting to hear
+            return LoadComplete(hr);
+
         Error(L"OnAsyncRead AsyncReadCompletion failed.", hr);
         return &WebmMfSource::StateQuit;
     }
@@ -4686,6 +5837,9 @@ WebmMfSource::thread_state_t WebmMfSource::OnAsyncRead()
 
         if (FAILED(hr))
         {
+            if (m_pLoadResult)
+                return LoadComplete(hr);
+
             Error(L"OnAsyncRead AsyncReadContinue failed.", hr);
             return &WebmMfSource::StateQuit;
         }
@@ -5065,6 +6219,9 @@ WebmMfSource::StateAsyncGetCurrBlockObjectInit()
 
         const long status = m_pCurr->Parse(pos, len);
 
+        if (status > 0)  //nothing remains to be parsed
+            CheckClusterCrc(m_pCurr);
+
         if (status >= 0)
             break;
 
@@ -5097,6 +6254,64 @@ WebmMfSource::StateAsyncGetCurrBlockObjectInit()
 }
 
 
+WebmMfSource::thread_state_t
+WebmMfSource::StateAsyncSeekPrefetchInit()
+{
+    assert(m_seek_prefetch_pos >= 0);
+    assert(m_seek_prefetch_len > 0);
+
+    const LONGLONG pos = m_seek_prefetch_pos;
+    const LONG len = m_seek_prefetch_len;
+
+    m_seek_prefetch_pos = -1;  //whatever happens, we read it only once
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "WebmMfSource::StateAsyncSeekPrefetchInit: pos="
+       << pos
+       << " len="
+       << len
+       << endl;
+#endif
+
+    LONGLONG total, avail;
+
+    const int status = m_file.Length(&total, &avail);
+
+    if ((status < 0) || ((total >= 0) && (pos >= total)))  //weird
+        return StateAsyncSeekPrefetchFinal();
+
+    const HRESULT hr = m_file.AsyncReadInit(pos, len, &m_async_read);
+
+    if (FAILED(hr))
+    {
+        Error(L"StateAsyncSeekPrefetchInit AsyncReadInit.", hr);
+        return &WebmMfSource::StateQuit;
+    }
+
+    if (hr == S_FALSE)  //event will be set in Invoke
+    {
+        m_async_state = &WebmMfSource::StateAsyncSeekPrefetchFinal;
+        return 0;
+    }
+
+    return StateAsyncSeekPrefetchFinal();
+}
+
+
+WebmMfSource::thread_state_t
+WebmMfSource::StateAsyncSeekPrefetchFinal()
+{
+    //The target clusters of all the streams are in the cache now, so
+    //the requests that were waiting on the seek are served from it.
+
+    const BOOL b = SetEvent(m_hRequestSample);
+    assert(b);
+
+    return &WebmMfSource::StateRequestSample;
+}
+
+
 WebmMfSource::thread_state_t
 WebmMfSource::StateAsyncGetCurrBlockObjectFinal()
 {
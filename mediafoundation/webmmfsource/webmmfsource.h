@@ -19,6 +19,7 @@ class WebmMfSource : public IMFMediaSource,
                      public IMFRateControl,
                      public IMFRateSupport,
                      public IMFGetService,
+                     public IMFQualityAdvise,
                      public CLockable
 {
     WebmMfSource(const WebmMfSource&);
@@ -29,6 +30,7 @@ public:
     static HRESULT CreateSource(
             IClassFactory*,
             IMFByteStream*,
+            IPropertyStore*,
             WebmMfSource*&);
 
     //IUnknown
@@ -93,11 +95,34 @@ public:
 
     HRESULT STDMETHODCALLTYPE GetService(REFGUID, REFIID, LPVOID*);
 
+    //IMFQualityAdvise
+    //
+    //The only means of dropping that we support is DropTime: the video
+    //streams skip the blocks that aren't keyframes, without reading them,
+    //until they've caught up.  There are no drop modes or quality levels.
+
+    HRESULT STDMETHODCALLTYPE SetDropMode(MF_QUALITY_DROP_MODE);
+
+    HRESULT STDMETHODCALLTYPE SetQualityLevel(MF_QUALITY_LEVEL);
+
+    HRESULT STDMETHODCALLTYPE GetDropMode(MF_QUALITY_DROP_MODE*);
+
+    HRESULT STDMETHODCALLTYPE GetQualityLevel(MF_QUALITY_LEVEL*);
+
+    HRESULT STDMETHODCALLTYPE DropTime(LONGLONG);
+
     //local methods
 
     HRESULT BeginLoad(IMFAsyncCallback*);
     //HRESULT EndLoad(IMFAsyncResult*);
 
+    //Abandons the load begun by BeginLoad.  Reads not yet issued fail,
+    //a wait for a load slot or a followed file ends, and the load
+    //completes with MF_E_OPERATION_CANCELLED at its next step.  Takes no
+    //lock, so it may be called from any thread, even while the worker
+    //thread waits in a read.
+    void CancelLoad();
+
     bool IsStopped() const;
     bool IsPaused() const;
     HRESULT RequestSample(WebmMfStream*, IUnknown*);
@@ -106,11 +131,29 @@ private:
 
     static std::wstring ConvertFromUTF8(const char*);
 
-    WebmMfSource(IClassFactory*, IMFByteStream*);
+    WebmMfSource(IClassFactory*, IMFByteStream*, IPropertyStore*);
     virtual ~WebmMfSource();
 
     LONGLONG GetDuration() const;
 
+    //WebmMfSource_CacheStats service
+    HRESULT GetCacheStats(REFIID, LPVOID*);
+
+    //WebmMfSource_OpenStats service
+    HRESULT GetOpenStats(REFIID, LPVOID*);
+
+    //WebmMfSource_LatencyStats service
+    HRESULT GetLatencyStats(REFIID, LPVOID*);
+
+    //WebmMfSource_CrcStats service
+    HRESULT GetCrcStats(REFIID, LPVOID*);
+
+    //MF_PROPERTY_HANDLER_SERVICE: the duration, and the dimensions of the
+    //first video and audio tracks, for the shell's property handler.
+    //They come from mkvparser::Prober, so the duration is known (or
+    //estimated) even when the file has none in its Info.
+    HRESULT GetPropertyStore(REFIID, LPVOID*);
+
     IClassFactory* const m_pClassFactory;
     LONG m_cRef;
     IMFMediaEventQueue* m_pEvents;
@@ -137,6 +180,12 @@ public:
     mkvparser::Segment* m_pSegment;
     LONGLONG m_preroll_ns;
 
+    //Set from MF_LOW_LATENCY or the WebmMfSource_LowLatency property.
+    //For live playback: the file isn't buffered ahead, nothing is parsed
+    //ahead of the requests, there is no preroll, and each audio block is
+    //a sample of its own, delivered as soon as it has been parsed.
+    const bool m_bLowLatency;
+
 private:
 
     BOOL m_bThin;
@@ -195,6 +244,7 @@ private:
     bool StateAsyncRead();
     bool StateRequestSample();
     bool StateQuit();
+    bool StateWaitLoadSlot();
 
     thread_state_t OnAsyncRead();
     thread_state_t OnRequestSample();
@@ -205,6 +255,7 @@ private:
     const mkvparser::Cluster* m_pNext;
 
     //for async load:
+    thread_state_t StateAsyncWaitLoadSlot();
     thread_state_t StateAsyncParseEbmlHeader();
     thread_state_t StateAsyncParseSegmentHeaders();
     thread_state_t StateAsyncLoadCluster();
@@ -252,6 +303,100 @@ private:
     //thread_state_t PreloadCache(const mkvparser::BlockEntry*);
     thread_state_t Parse(bool& bDone);
     thread_state_t Parse(const mkvparser::Cluster*, bool& bDone);
+    thread_state_t ParseNext(
+        const mkvparser::Cluster*,
+        const mkvparser::Cluster*&,
+        bool& bDone);
+
+    //How far idle parsing may run ahead of the furthest stream, set from
+    //the WebmMfSource_PrefetchDuration and _PrefetchBytes properties
+    //passed to the byte stream handler.  When both are 0, it parses
+    //only one cluster ahead.
+    const LONGLONG m_prefetch_reftime;
+    const LONGLONG m_prefetch_bytes;
+
+    bool IsPrefetchDue(
+        const mkvparser::Cluster* pBase,
+        const mkvparser::Cluster* pNext) const;
+
+    //Set from the WebmMfSource_FastOpen property.  The load stops as soon
+    //as the video streams have their first block; the search for the
+    //first block of the other streams is left until they are started.
+    const bool m_bFastOpen;
+
+    bool IsFirstBlockDeferred(const WebmMfStream*) const;
+
+    //Measured from construction of the source, in reftime units, for the
+    //WebmMfSource_OpenStats service; -1 until the event happens.
+    const MFTIME m_open_time;
+    MFTIME m_load_duration;
+    MFTIME m_first_frame_time;
+
+    //From the arrival of the last byte of a block in the cache to the
+    //delivery of its sample, in reftime units, for the
+    //WebmMfSource_LatencyStats service.
+    LONGLONG m_latency_count;
+    MFTIME m_latency_sum;
+    MFTIME m_latency_last;
+    MFTIME m_latency_max;
+
+    void UpdateLatency(const mkvparser::Block*);
+
+    //Set from the WebmMfSource_CheckCrc property.  Each cluster that
+    //begins with a CRC-32 element is checked against it once the cluster
+    //has been parsed, from the pages the parse brought into the cache,
+    //for the WebmMfSource_CrcStats service.  A cluster that fails is
+    //still played.  Clusters are checked as the parse moves forward, each
+    //once; one whose pages have already left the cache goes unchecked.
+    const bool m_bCheckCrc;
+    LONGLONG m_crc_pos;  //of the last cluster checked
+    LONGLONG m_crc_checked;
+    LONGLONG m_crc_failed;
+
+    void CheckClusterCrc(const mkvparser::Cluster*);
+
+    //Set by a start or seek that lands on cue points: the span of the
+    //file (from the cluster the streams begin their search on, to the
+    //cluster after the furthest one the cues give for any selected
+    //stream) that the first samples come from.  The whole span is read
+    //with one async read before any request is served, so that the
+    //streams don't each stall in turn on the reads of their own target
+    //clusters.  The pos is absolute; -1 if there is nothing to read.
+    LONGLONG m_seek_prefetch_pos;
+    LONG m_seek_prefetch_len;
+
+    enum { kMaxSeekPrefetch = 4 * 1024 * 1024 };
+
+    thread_state_t StateAsyncSeekPrefetchInit();
+    thread_state_t StateAsyncSeekPrefetchFinal();
+
+    //Set by CancelLoad.
+    volatile LONG m_bCancelLoad;
+
+    //Set from the WebmMfSource_OpenDeadline property, in reftime units;
+    //0 means none.  Once that long has passed since construction, the
+    //load doesn't start on the cues, and stops searching clusters for
+    //first blocks as soon as it has one cluster: the streams found so
+    //far are played, and the others start at end of stream.  For the
+    //shell's thumbnail and property handlers, which would rather have
+    //partial metadata in time than all of it late.
+    const LONGLONG m_open_deadline;
+
+    bool IsOpenDeadlinePast() const;
+
+    //Only a few sources in the process load at once, so that a burst of
+    //opens (the shell's, as it thumbnails a folder) doesn't have them all
+    //contend for the disk.  The worker thread waits for a slot before it
+    //reads anything, and LoadComplete gives the slot back.
+    bool m_bHoldsLoadSlot;
+
+    void ReleaseLoadSlot();
+
+    static LONGLONG GetPropertyValue(IPropertyStore*, const GUID&);
+
+    //The MF_BYTESTREAM_ORIGIN_NAME of the byte stream, or null if it has
+    //none.  Free the result using CoTaskMemFree.
+    static LPWSTR GetOriginName(IMFByteStream*);
     //thread_state_t PreloadSample(WebmMfStream*);
 
     thread_state_t LoadComplete(HRESULT);
@@ -295,9 +440,12 @@ private:
 
         void OnStartNoSeek() const;
         void OnStartInitStreams(LONGLONG time_ns, LONGLONG base_pos) const;
+        void SetSeekPrefetch(LONGLONG time_ns, LONGLONG base_pos) const;
         void OnStartComplete() const;
         void OnSeekComplete() const;
 
+        void SetCurrBlockFirst(WebmMfStream*) const;
+
     };
 
     typedef std::list<Command> commands_t;
@@ -1,5 +1,6 @@
 #include "webmmfsource.h"
 #include "webmmfstream.h"
+#include "webmmfsamplepool.h"
 //#include "mkvparser.hpp"
 #include <mfapi.h>
 #include <mferror.h>
@@ -36,14 +37,19 @@ WebmMfStream::WebmMfStream(
     m_time_ns(-1),
     m_cluster_pos(-1),
     m_rate(1),
-    m_thin_ns(-3)  //means "not thinning"
+    m_thin_ns(-3),  //means "not thinning"
+    m_pPool(0)
 {
     m_pDesc->AddRef();
 
-    const HRESULT hr = MFCreateEventQueue(&m_pEvents);
+    HRESULT hr = MFCreateEventQueue(&m_pEvents);
     assert(SUCCEEDED(hr));
     assert(m_pEvents);
 
+    hr = WebmMfSamplePool::CreateInstance(&m_pPool);
+    assert(SUCCEEDED(hr));  //TODO
+    assert(m_pPool);
+
     m_curr.Init();
 }
 
@@ -61,6 +67,16 @@ WebmMfStream::~WebmMfStream()
         m_pEvents = 0;
     }
 
+    if (m_pPool)
+    {
+        //Samples still downstream keep the pool alive until they
+        //are released.
+
+        m_pPool->Shutdown();
+        m_pPool->Release();
+        m_pPool = 0;
+    }
+
     const ULONG n = m_pDesc->Release();
     n;
 }
@@ -388,6 +404,9 @@ HRESULT WebmMfStream::Shutdown()
 
     PurgeSamples();
 
+    if (m_pPool)
+        m_pPool->Shutdown();
+
     m_pSource->m_file.UnlockPage(m_pLocked);
     m_pLocked = 0;
 
@@ -5,6 +5,7 @@ namespace WebmMfSourceLib
 {
 
 //class WebmMfSource;
+class WebmMfSamplePool;
 
 class WebmMfStream : public IMFMediaStream
 {
@@ -155,6 +156,9 @@ protected:
     float m_rate;
     LONGLONG m_thin_ns;
 
+    //The samples and frame buffers given to GetSample.
+    WebmMfSamplePool* m_pPool;
+
 private:
 
     IMFMediaEventQueue* m_pEvents;
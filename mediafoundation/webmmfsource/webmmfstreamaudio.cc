@@ -1,5 +1,6 @@
 #include "webmmfsource.h"
 #include "webmmfstream.h"
+#include "webmmfsamplepool.h"
 #include "webmmfstreamaudio.h"
 #include "vorbistypes.h"
 #include <mfapi.h>
@@ -280,6 +281,12 @@ WebmMfStreamAudio::~WebmMfStreamAudio()
 }
 
 
+LONGLONG WebmMfStreamAudio::GetQuota() const
+{
+    return m_pSource->m_bLowLatency ? 0 : kQuotaTimeNanoseconds;
+}
+
+
 void WebmMfStreamAudio::OnDeselect()
 {
     m_pQuota = 0;
@@ -480,7 +487,7 @@ long WebmMfStreamAudio::GetNextBlock()
 
             const LONGLONG delta_ns = next_ns - curr_ns;
 
-            if (delta_ns > kQuotaTimeNanoseconds)
+            if (delta_ns > GetQuota())
             {
                 m_pQuota = pNextEntry;
                 break;
@@ -578,7 +585,7 @@ long WebmMfStreamAudio::GetNextBlock()
 
             const LONGLONG delta_ns = next_ns - curr_ns;
 
-            if (delta_ns > kQuotaTimeNanoseconds)
+            if (delta_ns > GetQuota())
             {
                 m_pQuota = pNext;
                 m_sample_extent = m_blocks;
@@ -659,7 +666,7 @@ long WebmMfStreamAudio::NotifyNextCluster(
 
             const LONGLONG delta_ns = next_ns - curr_ns;
 
-            if (delta_ns > kQuotaTimeNanoseconds)
+            if (delta_ns > GetQuota())
             {
                 m_pQuota = pNextEntry;
                 break;
@@ -751,7 +758,7 @@ long WebmMfStreamAudio::NotifyNextCluster(
 
             const LONGLONG delta_ns = next_ns - curr_ns;
 
-            if (delta_ns > kQuotaTimeNanoseconds)
+            if (delta_ns > GetQuota())
             {
                 m_pQuota = pNext;
                 m_sample_extent = m_blocks;
@@ -1058,7 +1065,7 @@ HRESULT WebmMfStreamAudio::GetSample(IUnknown* pToken)
 
     IMFSamplePtr pSample;
 
-    hr = MFCreateSample(&pSample);
+    hr = m_pPool->GetSample(&pSample);
     assert(SUCCEEDED(hr));  //TODO
     assert(pSample);
 
@@ -1264,7 +1271,7 @@ HRESULT WebmMfStreamAudio::ReadBlock(
 
         IMFMediaBufferPtr pBuffer;
 
-        HRESULT hr = MFCreateMemoryBuffer(cbBuffer, &pBuffer);
+        HRESULT hr = m_pPool->GetBuffer(cbBuffer, &pBuffer);
         assert(SUCCEEDED(hr));  //TODO
         assert(pBuffer);
 
@@ -1375,7 +1382,7 @@ HRESULT WebmMfStreamAudio::PopulateSample(IMFSample* pSample)
 
         IMFMediaBufferPtr pBuffer;
 
-        hr = MFCreateMemoryBuffer(cbBuffer, &pBuffer);
+        hr = m_pPool->GetBuffer(cbBuffer, &pBuffer);
         assert(SUCCEEDED(hr));
         assert(pBuffer);
 
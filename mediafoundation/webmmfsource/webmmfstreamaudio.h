@@ -53,6 +53,10 @@ private:
     const mkvparser::BlockEntry* m_pQuota;
     long m_next_index;
 
+    //How much audio goes into a sample: none beyond its first block, in
+    //low latency mode.
+    LONGLONG GetQuota() const;
+
     typedef std::list<const mkvparser::BlockEntry*> blocks_t;
     blocks_t m_blocks;
     blocks_t m_sample_extent;
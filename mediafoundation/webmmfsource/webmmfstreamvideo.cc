@@ -1,5 +1,6 @@
 #include "webmmfsource.h"
 #include "webmmfstream.h"
+#include "webmmfsamplepool.h"
 #include "webmmfstreamvideo.h"
 #include "webmtypes.h"
 #include <mfapi.h>
@@ -40,10 +41,14 @@ HRESULT WebmMfStreamVideo::CreateStreamDescriptor(
     const char* const codec = pTrack->GetCodecId();
     assert(codec);
 
+    GUID subtype;
+
     if (_stricmp(codec, "V_VP8") == 0)
-        __noop;
+        subtype = WebmTypes::MEDIASUBTYPE_VP80;
     //else if (_stricmp(codec, "V_ON2VP8") == 0)  //legacy
     //    __noop;
+    else if (_stricmp(codec, "V_VP9") == 0)
+        subtype = WebmTypes::MEDIASUBTYPE_VP90;
     else  //weird
     {
         pDesc = 0;
@@ -62,7 +67,7 @@ HRESULT WebmMfStreamVideo::CreateStreamDescriptor(
     hr = pmt->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
     assert(SUCCEEDED(hr));
 
-    hr = pmt->SetGUID(MF_MT_SUBTYPE, WebmTypes::MEDIASUBTYPE_VP80);
+    hr = pmt->SetGUID(MF_MT_SUBTYPE, subtype);
     assert(SUCCEEDED(hr));
 
     hr = pmt->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, FALSE);
@@ -244,7 +249,8 @@ WebmMfStreamVideo::WebmMfStreamVideo(
     const mkvparser::VideoTrack* pTrack) :
     WebmMfStream(pSource, pDesc, pTrack),
     m_pNextBlock(0),
-    m_next_index(-1)
+    m_next_index(-1),
+    m_drop_ns(-1)
 {
 }
 
@@ -258,6 +264,7 @@ void WebmMfStreamVideo::OnDeselect()
 {
     m_pNextBlock = 0;
     m_next_index = -1;
+    m_drop_ns = -1;
 }
 
 
@@ -265,6 +272,46 @@ void WebmMfStreamVideo::OnSetCurrBlock()
 {
     m_pNextBlock = 0;
     m_next_index = -1;
+    m_drop_ns = -1;
+}
+
+
+void WebmMfStreamVideo::DropTime(LONGLONG reftime)
+{
+    const mkvparser::BlockEntry* const pCurr = m_curr.pBE;
+
+    if ((pCurr == 0) || pCurr->EOS() || (m_thin_ns >= 0))
+        return;
+
+    if (reftime <= 0)
+    {
+        m_drop_ns = -1;
+        return;
+    }
+
+    const mkvparser::Block* const pBlock = pCurr->GetBlock();
+    assert(pBlock);
+
+    const LONGLONG curr_ns = pBlock->GetTime(pCurr->GetCluster());
+    m_drop_ns = curr_ns + 100 * reftime;
+}
+
+
+bool WebmMfStreamVideo::IsDropped(const mkvparser::BlockEntry* pBE)
+{
+    if ((m_drop_ns < 0) || (m_thin_ns >= 0))
+        return false;
+
+    const mkvparser::Block* const pBlock = pBE->GetBlock();
+    assert(pBlock);
+
+    if (!pBlock->IsKey())
+        return true;
+
+    if (pBlock->GetTime(pBE->GetCluster()) >= m_drop_ns)
+        m_drop_ns = -1;  //caught up
+
+    return false;
 }
 
 
@@ -558,7 +605,7 @@ long WebmMfStreamVideo::GetNextBlock()
         const mkvparser::Block* const pBlock = pNext->GetBlock();
         assert(pBlock);
 
-        if (pBlock->GetTrackNumber() == tn)
+        if ((pBlock->GetTrackNumber() == tn) && !IsDropped(pNext))
         {
             m_pNextBlock = pNext;
             return 1;  //we have a next block
@@ -629,7 +676,7 @@ long WebmMfStreamVideo::NotifyNextCluster(
         const mkvparser::Block* const pBlock = pNext->GetBlock();
         assert(pBlock);
 
-        if (pBlock->GetTrackNumber() == tn)
+        if ((pBlock->GetTrackNumber() == tn) && !IsDropped(pNext))
         {
             m_pNextBlock = pNext;
             return 1;  //we have a next block
@@ -701,7 +748,7 @@ HRESULT WebmMfStreamVideo::GetSample(IUnknown* pToken)
 
     IMFSamplePtr pSample;
 
-    HRESULT hr = MFCreateSample(&pSample);
+    HRESULT hr = m_pPool->GetSample(&pSample);
     assert(SUCCEEDED(hr));  //TODO
     assert(pSample);
 
@@ -725,7 +772,7 @@ HRESULT WebmMfStreamVideo::GetSample(IUnknown* pToken)
 
         IMFMediaBufferPtr pBuffer;
 
-        hr = MFCreateMemoryBuffer(cbBuffer, &pBuffer);
+        hr = m_pPool->GetBuffer(cbBuffer, &pBuffer);
         assert(SUCCEEDED(hr));
         assert(pBuffer);
 
@@ -40,6 +40,12 @@ public:
 
     HRESULT GetSample(IUnknown* pToken);
 
+    //IMFQualityAdvise::DropTime, by way of the source.  The blocks that
+    //aren't keyframes are skipped, without reading them, until a keyframe
+    //this far (reftime) past the block to be delivered next.  Keyframes
+    //are still delivered in between.  A seek cancels it.
+    void DropTime(LONGLONG reftime);
+
 protected:
 
     void OnDeselect();
@@ -50,6 +56,9 @@ private:
     const mkvparser::BlockEntry* m_pNextBlock;
     long m_next_index;
 
+    LONGLONG m_drop_ns;  //-1 unless catching up
+    bool IsDropped(const mkvparser::BlockEntry*);
+
     static HRESULT GetFrameRate(
         const mkvparser::VideoTrack*,
         UINT32&,
@@ -9,6 +9,7 @@
 #include <windows.h>
 #include <windowsx.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <queue>
@@ -16,12 +17,17 @@
 
 #include "debugutil.h"
 #include "SDLVideoPlayer.h"
+#include "SDL_syswm.h"
 
 #define TRY_DECODE_THREAD 1
 #define TRY_AUDIO_TIMING 1
 
 #define FF_REFRESH_EVENT (SDL_USEREVENT)
 
+// The present thread sleeps for no longer than this, so that it notices a
+// new frame, or a jump in the clock, soon enough.
+const long long kMaxPresentDelayMilli = 10;
+
 struct VORBISFORMAT2  //matroska.org
 {
   DWORD channels;
@@ -38,7 +44,6 @@ SDLVideoPlayer::SDLVideoPlayer():
   overlay(NULL),
   mythread(NULL),
   //affmutex(NULL),
-  m_vbuffer_mutex(NULL),
   m_setup_audio(false),
   m_channels(NULL),
   m_sample_rate(NULL),
@@ -51,10 +56,14 @@ SDLVideoPlayer::SDLVideoPlayer():
   m_vbuffer_write(0),
   m_vbuffer_size(0),
   m_base_milli(0),
-  m_total_samples(0),
   m_inited(false),
   m_last_video_milli(-1),
-  m_last_video_jitter(0)
+  m_last_video_jitter(0),
+  m_frames_presented(0),
+  m_frames_dropped(0),
+  m_jitter_sum(0),
+  m_jitter_max(0),
+  m_use_d3d11(false)
 {
   // Since this doesn't work:
   //#pragma warning(push)
@@ -94,7 +103,6 @@ int SDLVideoPlayer::Init()
         DBGLOG("SDL_Init failed, " << SDL_GetError());
         return E_FAIL;
     }
-    m_vbuffer_mutex = SDL_CreateMutex();
     m_audio_mutex = SDL_CreateMutex();
     m_audio_cond = SDL_CreateCond();
     for (int i = 0; i < OVERLAY_BUFFER_SIZE; ++i)
@@ -105,6 +113,11 @@ int SDLVideoPlayer::Init()
     return 0;
 }
 
+void SDLVideoPlayer::set_use_d3d11(bool use)
+{
+  m_use_d3d11 = use;
+}
+
 int SDLVideoPlayer::setup_surface(int display_width, int display_height)
 {
   Init();
@@ -198,13 +211,8 @@ int SDLVideoPlayer::Exit()
   SDL_FreeYUVOverlay(overlay);
   overlay = NULL;
 
-  m_vbuffer_mutex = SDL_CreateMutex();
-  m_audio_mutex = SDL_CreateMutex();
-  m_audio_cond = SDL_CreateCond();
-
   SDL_DestroyCond(m_audio_cond);
   SDL_DestroyMutex(m_audio_mutex);
-  SDL_DestroyMutex(m_vbuffer_mutex);
 
   SDL_Quit();
 
@@ -359,67 +367,136 @@ int SDLVideoPlayer::event_thread(void *data)
 
 #endif
 
+// The present thread.  Despite the name, it doesn't decode: it shows each
+// queued frame once the playback clock (the audio clock, when there is
+// audio) reaches the frame's time.
 int SDLVideoPlayer::video_decode_loop(void *data)
 {
   SDLVideoPlayer* pSDLPlayer = (SDLVideoPlayer*)data;
 
   while (pSDLPlayer->signalquit)
   {
-    //int rv = 0;
-    int delay = 0;
+    const int delay = pSDLPlayer->present_next_frame();
+
+    if (delay > 0)
+      SDL_Delay(delay);
+  }
+
+  pSDLPlayer->m_d3d11_presenter.Close();
+  return 0;
+}
+
+// Presents or drops the frame at |m_vbuffer_read|, if it's due.  Returns
+// how long to sleep before calling again, in milliseconds.
+int SDLVideoPlayer::present_next_frame()
+{
+  const LONG size = m_vbuffer_size;
+
+  if (size == 0)
+    return 1;
+
+  const long long time = get_playback_milli();
+  const long long frame_milli = m_overlay_milli[m_vbuffer_read];
+
+  if (frame_milli > time)
+  {
+    // Not due yet.
+    return static_cast<int>((std::min)(frame_milli - time,
+                                       kMaxPresentDelayMilli));
+  }
 
-    SDL_LockMutex(pSDLPlayer->m_vbuffer_mutex);
+  // Late.  If the frame after this one is due as well, this one would be
+  // replaced at once, so drop it: presentation catches up with the clock,
+  // and decode, which only waits for a free slot, is never held up.
+  bool drop = false;
+
+  if (size > 1)
+  {
+    const int next = (m_vbuffer_read + 1) % OVERLAY_BUFFER_SIZE;
+    drop = (m_overlay_milli[next] <= time);
+  }
 
-    if (pSDLPlayer->m_vbuffer_size == 0)
+  if (drop)
+  {
+    ++m_frames_dropped;
+  }
+  else
+  {
+    if (!m_use_d3d11 ||
+        FAILED(present_d3d11(m_overlay_buffer[m_vbuffer_read])))
     {
-      delay = 1;
+      SDL_DisplayYUVOverlay(m_overlay_buffer[m_vbuffer_read], &drect);
     }
-    else
-    {
-      unsigned int time = pSDLPlayer->get_playback_milli();
 
-      if (pSDLPlayer->m_overlay_milli[pSDLPlayer->m_vbuffer_read] > time)
-      {
-        // Frame is not ready to be shown
-        __int64 overlay_milli = pSDLPlayer->m_overlay_milli[pSDLPlayer->m_vbuffer_read];
-        delay = static_cast<int>(overlay_milli - time);
-      }
-      else
-      {
-        pSDLPlayer->m_last_video_milli =
-            pSDLPlayer->m_overlay_milli[pSDLPlayer->m_vbuffer_read];
+    const long long jitter = time - frame_milli;
 
-        //SDL_LockMutex(affmutex);
-        SDL_DisplayYUVOverlay(
-            pSDLPlayer->m_overlay_buffer[pSDLPlayer->m_vbuffer_read],
-            &pSDLPlayer->drect);
-        //SDL_UnlockMutex(affmutex);
+    m_last_video_milli = frame_milli;
+    m_last_video_jitter = jitter;
 
-        pSDLPlayer->m_last_video_jitter =
-            time - pSDLPlayer->m_last_video_milli;
+    ++m_frames_presented;
+    m_jitter_sum += jitter;
+    m_jitter_max = (std::max)(m_jitter_max, jitter);
+  }
 
-        pSDLPlayer->m_vbuffer_size--;
-        pSDLPlayer->m_vbuffer_read++;
-        if (pSDLPlayer->m_vbuffer_read == OVERLAY_BUFFER_SIZE)
-          pSDLPlayer->m_vbuffer_read = 0;
+  // Hand the slot back to put_frame.
+  m_vbuffer_read = (m_vbuffer_read + 1) % OVERLAY_BUFFER_SIZE;
+  InterlockedDecrement(&m_vbuffer_size);
 
-        if (pSDLPlayer->m_last_video_jitter > 19)
-        {
-          delay = 1;
-        }
-        else
-        {
-          delay = 20 - static_cast<int>(pSDLPlayer->m_last_video_jitter);
-        }
-      }
+  return 0;
+}
+
+// Draws |src_overlay| with |m_d3d11_presenter|, which writes the overlay's
+// planes straight into its textures and converts them to RGB on the GPU.
+// The presenter is opened on the first frame, on SDL's window; if that
+// fails, SDL presents from then on.
+int SDLVideoPlayer::present_d3d11(SDL_Overlay *src_overlay)
+{
+  HRESULT hr;
+
+  if (!m_d3d11_presenter.GetDevice())
+  {
+    SDL_SysWMinfo info;
+    SDL_VERSION(&info.version);
+
+    if (SDL_GetWMInfo(&info) <= 0)
+    {
+      DBGLOG("SDL_GetWMInfo failed, " << SDL_GetError());
+      m_use_d3d11 = false;
+      return E_FAIL;
     }
 
-    SDL_UnlockMutex(pSDLPlayer->m_vbuffer_mutex);
+    hr = m_d3d11_presenter.Open(info.window, NULL);
 
-    SDL_Delay(delay);
+    if (FAILED(hr))
+    {
+      DBGLOG("D3D11Presenter::Open failed, using SDL" << HRLOG(hr));
+      m_use_d3d11 = false;
+      return hr;
+    }
   }
 
-  return 0;
+  // The overlay is YV12: V comes before U.
+  SDL_LockYUVOverlay(src_overlay);
+  hr = m_d3d11_presenter.PresentI420(src_overlay->w, src_overlay->h,
+                                     src_overlay->pixels[0],
+                                     src_overlay->pitches[0],
+                                     src_overlay->pixels[2],
+                                     src_overlay->pitches[2],
+                                     src_overlay->pixels[1],
+                                     src_overlay->pitches[1]);
+  SDL_UnlockYUVOverlay(src_overlay);
+  return hr;
+}
+
+void SDLVideoPlayer::get_present_stats(PresentStats& stats) const
+{
+  // The counts are the present thread's; a snapshot taken while it runs
+  // can be a frame out of date.
+  stats.frames_presented = m_frames_presented;
+  stats.frames_dropped = m_frames_dropped;
+  stats.max_jitter_milli = m_jitter_max;
+  stats.mean_jitter_milli = m_frames_presented ?
+      static_cast<double>(m_jitter_sum) / m_frames_presented : 0.0;
 }
 
 int SDLVideoPlayer::show_frame(vpx_image_t *img, int display_width,
@@ -474,29 +551,24 @@ int SDLVideoPlayer::convert_frame(SDL_Overlay *dst_overlay,
 int SDLVideoPlayer::put_frame(vpx_image_t *img, long long time,
                               int display_width, int display_height)
 {
-  int rv = 0;
-
-  SDL_LockMutex(m_vbuffer_mutex);
-
   if (m_vbuffer_size == OVERLAY_BUFFER_SIZE)
   {
     // 1 signals we are full
-    rv = 1;
-  }
-  else
-  {
-    // TODO(tomfinegan): check result or make void
-    convert_frame(m_overlay_buffer[m_vbuffer_write], img, display_width,
-                  display_height);
-    m_overlay_milli[m_vbuffer_write] = time;
-    m_vbuffer_size++;
-    m_vbuffer_write++;
-    if (m_vbuffer_write == OVERLAY_BUFFER_SIZE)
-      m_vbuffer_write = 0;
+    return 1;
   }
 
-  SDL_UnlockMutex(m_vbuffer_mutex);
-  return rv;
+  // The slot at |m_vbuffer_write| is ours until we publish it, so the
+  // present thread can display another slot meanwhile.
+  // TODO(tomfinegan): check result or make void
+  convert_frame(m_overlay_buffer[m_vbuffer_write], img, display_width,
+                display_height);
+  m_overlay_milli[m_vbuffer_write] = time;
+  m_vbuffer_write = (m_vbuffer_write + 1) % OVERLAY_BUFFER_SIZE;
+
+  // A full barrier: the frame is written before the present thread can see
+  // its slot as filled.
+  InterlockedIncrement(&m_vbuffer_size);
+  return 0;
 }
 
 int SDLVideoPlayer::setup_vpx_decoder()
@@ -532,14 +604,11 @@ int SDLVideoPlayer::decode_vpx_frame(const unsigned char* data,
 #ifdef TRY_DECODE_THREAD
   jitter;
   // Check to see if the decode buffer is full
-  SDL_LockMutex(m_vbuffer_mutex);
   if (m_vbuffer_size == OVERLAY_BUFFER_SIZE)
   {
     // 1 signals we are full
-    SDL_UnlockMutex(m_vbuffer_mutex);
     return 1;
   }
-  SDL_UnlockMutex(m_vbuffer_mutex);
 
   vpx_dec_iter_t  iter = NULL;
   vpx_image_t    *img;
@@ -555,7 +624,8 @@ int SDLVideoPlayer::decode_vpx_frame(const unsigned char* data,
 
   img = vpx_codec_get_frame(&decoder, &iter);
 
-  put_frame(img, milli, m_width, m_height);
+  if (img)
+    put_frame(img, milli, m_width, m_height);
 #else
   vpx_dec_iter_t  iter = NULL;
   vpx_image_t    *img;
@@ -600,6 +670,8 @@ int SDLVideoPlayer::setup_audio_hardware(const unsigned int channels,
     return -1;
   }
 
+  // SDL double buffers: the device plays a period behind the callback.
+  m_clock.Start(m_spec.freq, m_spec.samples);
   m_setup_audio = true;
 
   // Start the audio thread.
@@ -750,6 +822,10 @@ void SDLVideoPlayer::audio_callback(void *userdata, Uint8 *stream, int len)
   // TODO: use block align here
   const unsigned int samples_wanted = len / 4;
 
+#ifdef TRY_AUDIO_TIMING
+  pPlayer->m_clock.OnSamplesConsumed(samples_wanted);
+#endif
+
   while (len > 0)
   {
     unsigned int samples_available;
@@ -796,10 +872,6 @@ void SDLVideoPlayer::audio_callback(void *userdata, Uint8 *stream, int len)
         ptr++;
       }
 
-#ifdef TRY_AUDIO_TIMING
-      pPlayer->m_total_samples += samples_wanted;
-#endif
-
       len -= len;
       stream += len;
     }
@@ -818,17 +890,35 @@ void SDLVideoPlayer::audio_callback(void *userdata, Uint8 *stream, int len)
       delete pPkt;
     }
   }
+
+  // Decode ahead of the device by the clock's target depth, which grows as
+  // the callbacks jitter, but without waiting for packets: a callback that
+  // blocks is the glitch this is meant to prevent.
+  const unsigned int target_depth = pPlayer->m_clock.GetTargetDepth();
+
+  for (;;)
+  {
+    unsigned int samples_available = 0;
+    pPlayer->m_vorbis_decoder.GetOutputSamplesAvailable(&samples_available);
+
+    if (samples_available >= target_depth)
+      break;
+
+    AudioFrame* pPkt;
+    if (pPlayer->packet_queue_get(&pPkt, 0) <= 0)
+      break;
+
+    pPlayer->m_vorbis_decoder.Decode(pPkt->data, pPkt->size);
+    delete [] pPkt->data;
+    delete pPkt;
+  }
 }
 
 unsigned int SDLVideoPlayer::get_playback_milli()
 {
 #ifdef TRY_AUDIO_TIMING
   if (m_setup_audio)
-  {
-    double milliseconds =
-        (((double)m_total_samples) / m_sample_rate) * 1000.0;
-    return (unsigned int)milliseconds;
-  }
+    return static_cast<unsigned int>(m_clock.GetMilli());
 #endif
   if (!m_base_milli)
     m_base_milli = timeGetTime();
@@ -845,11 +935,7 @@ int SDLVideoPlayer::get_last_time_rendered(long long& video_milli,
 
 #ifdef TRY_AUDIO_TIMING
   if (m_setup_audio)
-  {
-    double milliseconds =
-        ((static_cast<double>(m_total_samples)) / m_sample_rate) * 1000.0;
-    audio_milli = static_cast<long long>(milliseconds);
-  }
+    audio_milli = m_clock.GetMilli();
 #endif
 
   video_milli = m_last_video_milli;
@@ -9,6 +9,8 @@
 #ifndef __WEBMDSHOW_MEDIAFOUNDATION_WEBMMFTESTS_SDLPLAY_SDLVIDEOPLAYER_H__
 #define __WEBMDSHOW_MEDIAFOUNDATION_WEBMMFTESTS_SDLPLAY_SDLVIDEOPLAYER_H__
 
+#include "d3d11presenter.h"
+#include "playbackclock.h"
 #include "vorbisdecoder.h"
 #include "vpx/vpx_decoder.h"
 #include "vpx/vp8dx.h"
@@ -31,6 +33,15 @@ struct AudioFrame
   int size;
 };
 
+// How well the present thread is keeping up with the playback clock.
+struct PresentStats
+{
+  long long frames_presented;
+  long long frames_dropped;  // late, and skipped for the frame after them
+  long long max_jitter_milli;  // latest a frame has been presented
+  double mean_jitter_milli;
+};
+
 class SDLVideoPlayer
 {
 public:
@@ -42,6 +53,10 @@ public:
     static int event_thread(void *data);
     static int video_decode_loop(void *data);
 
+    // Presents with Direct3D 11 instead of SDL's overlays, if |use| is
+    // true. Call before |setup_surface|; if the presenter can't be opened,
+    // the player falls back to SDL.
+    void set_use_d3d11(bool use);
     int setup_surface(int display_width, int display_height);
     int show_frame(vpx_image_t *img, int display_width,
                    int display_height);
@@ -68,8 +83,13 @@ public:
                                long long& video_milli_jitter,
                                long long& audio_milli);
 
+    void get_present_stats(PresentStats& stats) const;
+
 private:
 
+    int present_next_frame();
+    int present_d3d11(SDL_Overlay *src_overlay);
+
     // Video
     int m_width;
     int m_height;
@@ -83,17 +103,30 @@ private:
 
     vpx_dec_ctx_t decoder;
 
+    // A single-producer, single-consumer ring of decoded frames: put_frame
+    // owns |m_vbuffer_write| and the present thread |m_vbuffer_read|.  They
+    // share only |m_vbuffer_size|, which each changes with an interlocked
+    // operation once it is done with its slot, so neither takes a lock.
     SDL_Thread *m_video_thread;
-    SDL_mutex *m_vbuffer_mutex;
     SDL_Overlay *m_overlay_buffer[OVERLAY_BUFFER_SIZE];
     long long m_overlay_milli[OVERLAY_BUFFER_SIZE];
     int m_vbuffer_read;
     int m_vbuffer_write;
-    int m_vbuffer_size;
+    volatile LONG m_vbuffer_size;
 
     long long m_last_video_milli;
     long long m_last_video_jitter;
 
+    // Written by the present thread only.
+    long long m_frames_presented;
+    long long m_frames_dropped;
+    long long m_jitter_sum;
+    long long m_jitter_max;
+
+    // Used, opened and closed by the present thread only.
+    bool m_use_d3d11;
+    WebmDirectX::D3D11Presenter m_d3d11_presenter;
+
     // Audio
     bool m_setup_audio;
     int m_channels;
@@ -105,7 +138,10 @@ private:
     SDL_AudioSpec m_spec;
     unsigned char* m_scratch_buffer;
     int m_scratch_size;
-    long long m_total_samples;
+
+    // Advanced by the audio callback; read by the present thread, and any
+    // other, without a lock.
+    PlaybackClock m_clock;
 
     std::queue<AudioFrame*> m_audio_queue;
 
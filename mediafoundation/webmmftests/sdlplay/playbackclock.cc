@@ -0,0 +1,160 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "playbackclock.h"
+
+// The weight of a callback interval in the jitter estimate, as in RFC 3550.
+const double kJitterWeight = 1.0 / 16;
+
+// The target depth covers this many times the jitter, and is capped at
+// this many periods.
+const double kJitterDepthFactor = 4.0;
+const int kMaxDepthPeriods = 8;
+
+PlaybackClock::PlaybackClock():
+  m_frequency(1),
+  m_sample_rate(0),
+  m_latency_samples(0),
+  m_sequence(0),
+  m_consumed_samples(0),
+  m_last_counter(0),
+  m_last_period(0),
+  m_jitter_seconds(0),
+  m_jitter_micro(0),
+  m_target_depth(0)
+{
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  m_frequency = frequency.QuadPart;
+
+  m_snapshot.base_samples = 0;
+  m_snapshot.limit_samples = 0;
+  m_snapshot.counter = 0;
+}
+
+void PlaybackClock::Start(int sample_rate, int latency_samples)
+{
+  m_sample_rate = sample_rate;
+  m_latency_samples = latency_samples;
+  m_consumed_samples = 0;
+  m_last_counter = 0;
+  m_last_period = 0;
+  m_jitter_seconds = 0;
+
+  InterlockedExchange(&m_jitter_micro, 0);
+  InterlockedExchange(&m_target_depth, latency_samples);
+
+  const Snapshot snapshot = { 0, 0, 0 };
+  Publish(snapshot);
+}
+
+void PlaybackClock::OnSamplesConsumed(int samples)
+{
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  if (m_last_counter && m_sample_rate > 0)
+  {
+    // The callback should come once the device has played the period it
+    // was last given; how far off it is, is the jitter.
+    const double interval =
+        static_cast<double>(now.QuadPart - m_last_counter) / m_frequency;
+    const double period = static_cast<double>(m_last_period) / m_sample_rate;
+    const double deviation = fabs(interval - period);
+
+    m_jitter_seconds += (deviation - m_jitter_seconds) * kJitterWeight;
+
+    const double jitter_samples = m_jitter_seconds * m_sample_rate;
+    const int depth = samples +
+        static_cast<int>(ceil(kJitterDepthFactor * jitter_samples));
+
+    InterlockedExchange(&m_jitter_micro,
+                        static_cast<LONG>(m_jitter_seconds * 1000000.0));
+    InterlockedExchange(&m_target_depth,
+                        (std::min)(depth, samples * kMaxDepthPeriods));
+  }
+
+  // The device starts on the samples it was given |m_latency_samples| ago,
+  // and plays until it reaches those it is given now.
+  Snapshot snapshot;
+  snapshot.base_samples = m_consumed_samples - m_latency_samples;
+  m_consumed_samples += samples;
+  snapshot.limit_samples = m_consumed_samples - m_latency_samples;
+  snapshot.counter = now.QuadPart;
+  Publish(snapshot);
+
+  m_last_counter = now.QuadPart;
+  m_last_period = samples;
+}
+
+void PlaybackClock::Publish(const Snapshot& snapshot)
+{
+  // Each increment is a full barrier: the sequence is odd before the
+  // snapshot changes, and even again only once it has.
+  InterlockedIncrement(&m_sequence);
+  m_snapshot = snapshot;
+  InterlockedIncrement(&m_sequence);
+}
+
+long long PlaybackClock::GetMilli() const
+{
+  if (m_sample_rate <= 0)
+    return 0;
+
+  Snapshot snapshot;
+
+  for (;;)
+  {
+    const LONG sequence = m_sequence;
+
+    if (sequence & 1)
+    {
+      YieldProcessor();
+      continue;
+    }
+
+    MemoryBarrier();
+    snapshot = *const_cast<const Snapshot*>(&m_snapshot);
+    MemoryBarrier();
+
+    if (m_sequence == sequence)
+      break;
+  }
+
+  if (!snapshot.counter)
+    return 0;
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  const long long elapsed_samples =
+      (now.QuadPart - snapshot.counter) * m_sample_rate / m_frequency;
+  const long long position =
+      (std::min)(snapshot.base_samples + elapsed_samples,
+                 snapshot.limit_samples);
+
+  if (position <= 0)
+    return 0;
+
+  return position * 1000 / m_sample_rate;
+}
+
+int PlaybackClock::GetTargetDepth() const
+{
+  return m_target_depth;
+}
+
+double PlaybackClock::GetJitterMilli() const
+{
+  return m_jitter_micro / 1000.0;
+}
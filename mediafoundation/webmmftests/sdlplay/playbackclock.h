@@ -0,0 +1,83 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_MEDIAFOUNDATION_WEBMMFTESTS_SDLPLAY_PLAYBACKCLOCK_H__
+#define __WEBMDSHOW_MEDIAFOUNDATION_WEBMMFTESTS_SDLPLAY_PLAYBACKCLOCK_H__
+
+// The master clock of sdlplay: the time of the audio the device is playing,
+// derived from the samples the audio callback has handed it. Between
+// callbacks the clock runs on the performance counter, so it advances
+// smoothly rather than a device period at a time, but it never passes the
+// samples the device has been given.
+//
+// The audio callback is the only writer. The other threads read the clock
+// without taking a lock: the callback publishes each update under a
+// sequence count, and a reader retries if an update overlapped its read.
+//
+// The clock also measures how regularly the callbacks come. From that it
+// derives how many samples the callback should keep decoded ahead of the
+// device: a period when the callbacks are steady, for the least latency,
+// and more as they jitter, so that a late packet doesn't starve the
+// device.
+class PlaybackClock
+{
+public:
+  PlaybackClock();
+
+  // Resets the clock for a device that plays |sample_rate| samples a
+  // second, and that is |latency_samples| behind the callback (a period,
+  // for SDL's double buffered devices).
+  void Start(int sample_rate, int latency_samples);
+
+  // Called by the audio callback on entry, as it hands the device
+  // |samples| more samples.
+  void OnSamplesConsumed(int samples);
+
+  // The playback time, in milliseconds; 0 until the device has played any
+  // audio. Safe to call from any thread.
+  long long GetMilli() const;
+
+  // The samples the audio callback should keep decoded ahead of the
+  // device. Safe to call from any thread.
+  int GetTargetDepth() const;
+
+  // The mean deviation of the callback intervals from the periods they
+  // played, in milliseconds.
+  double GetJitterMilli() const;
+
+private:
+  // The state a reader needs, published under |m_sequence|.
+  struct Snapshot
+  {
+    long long base_samples;   // the position at |counter|
+    long long limit_samples;  // the position the device can't pass
+    long long counter;
+  };
+
+  void Publish(const Snapshot& snapshot);
+
+  long long m_frequency;  // of the performance counter
+  int m_sample_rate;
+  int m_latency_samples;
+
+  // Odd while the writer updates |m_snapshot|.
+  volatile LONG m_sequence;
+  Snapshot m_snapshot;
+
+  // The writer's own state.
+  long long m_consumed_samples;
+  long long m_last_counter;
+  int m_last_period;
+  double m_jitter_seconds;
+
+  // Written by the audio callback, read by anyone.
+  volatile LONG m_jitter_micro;
+  volatile LONG m_target_depth;
+};
+
+#endif // __WEBMDSHOW_MEDIAFOUNDATION_WEBMMFTESTS_SDLPLAY_PLAYBACKCLOCK_H__
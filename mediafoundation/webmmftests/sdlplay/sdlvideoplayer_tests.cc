@@ -23,3 +23,38 @@ TEST(SDLVideoPlayer, Init)
     SDLVideoPlayer sdl_player;
     ASSERT_EQ(0, sdl_player.Init());
 }
+
+TEST(SDLVideoPlayer, PresentStatsStartEmpty)
+{
+    SDLVideoPlayer sdl_player;
+    PresentStats stats;
+    sdl_player.get_present_stats(stats);
+    EXPECT_EQ(0, stats.frames_presented);
+    EXPECT_EQ(0, stats.frames_dropped);
+    EXPECT_EQ(0, stats.max_jitter_milli);
+    EXPECT_EQ(0.0, stats.mean_jitter_milli);
+}
+
+TEST(PlaybackClock, StaysWithinThePlayingPeriod)
+{
+    PlaybackClock clock;
+    clock.Start(1000, 100);
+    EXPECT_EQ(0, clock.GetMilli());
+    EXPECT_EQ(100, clock.GetTargetDepth());
+
+    // The device is still a period behind the first callback.
+    clock.OnSamplesConsumed(100);
+    EXPECT_EQ(0, clock.GetMilli());
+
+    // Three periods given, so the device plays the second of them.
+    clock.OnSamplesConsumed(100);
+    clock.OnSamplesConsumed(100);
+    const long long milli = clock.GetMilli();
+    EXPECT_GE(milli, 100);
+    EXPECT_LE(milli, 200);
+
+    // Callbacks with no wait between them jitter by nearly a period each.
+    EXPECT_GT(clock.GetJitterMilli(), 0.0);
+    EXPECT_GT(clock.GetTargetDepth(), 100);
+    EXPECT_LE(clock.GetTargetDepth(), 800);
+}
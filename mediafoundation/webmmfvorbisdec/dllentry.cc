@@ -124,10 +124,11 @@ STDAPI DllRegisterServer()
     if (FAILED(hr))
         return hr;
 
-    enum { cInputTypes = 1 };
+    enum { cInputTypes = 2 };
     MFT_REGISTER_TYPE_INFO pInputTypes[cInputTypes] =
     {
-        { MFMediaType_Audio, VorbisTypes::MEDIASUBTYPE_Vorbis2 }
+        { MFMediaType_Audio, VorbisTypes::MEDIASUBTYPE_Vorbis2 },
+        { MFMediaType_Audio, VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing }
     };
 
     enum { cOutputTypes = 1 };
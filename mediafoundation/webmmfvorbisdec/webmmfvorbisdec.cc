@@ -16,6 +16,7 @@
 #include <cassert>
 #include <new>
 #include <cmath>
+#include <climits>
 
 #include "clockable.h"
 #include "debugutil.h"
@@ -68,14 +69,16 @@ WebmMfVorbisDec::WebmMfVorbisDec(IClassFactory* pClassFactory) :
     m_total_samples_decoded(0),
     m_mediatime_decoded(-1),
     m_drain(false),
-    m_post_process_samples(false),
-    m_scratch(NULL, 0)
+    m_output_int16(false)
 {
     HRESULT hr = m_pClassFactory->LockServer(TRUE);
     assert(SUCCEEDED(hr));
 
     hr = CLockable::Init();
     assert(SUCCEEDED(hr));
+
+    hr = MFCreateAttributes(&m_attributes, 1);
+    assert(SUCCEEDED(hr));
 }
 
 WebmMfVorbisDec::~WebmMfVorbisDec()
@@ -243,10 +246,16 @@ HRESULT WebmMfVorbisDec::GetOutputStreamInfo(DWORD dwOutputStreamID,
 
 HRESULT WebmMfVorbisDec::GetAttributes(IMFAttributes** pp)
 {
-    if (pp)
-        *pp = 0;
+    if (pp == 0)
+        return E_POINTER;
 
-    return E_NOTIMPL;
+    *pp = m_attributes;
+
+    if (*pp == 0)
+        return E_NOTIMPL;
+
+    (*pp)->AddRef();
+    return S_OK;
 }
 
 HRESULT WebmMfVorbisDec::GetInputStreamAttributes(DWORD, IMFAttributes** pp)
@@ -285,7 +294,7 @@ HRESULT WebmMfVorbisDec::GetInputAvailableType(DWORD dwInputStreamID,
     if (dwInputStreamID != 0)
         return MF_E_INVALIDSTREAMNUMBER;
 
-    if (dwTypeIndex > 0)
+    if (dwTypeIndex > 1)
         return MF_E_NO_MORE_TYPES;
 
     if (pp == 0)
@@ -300,7 +309,11 @@ HRESULT WebmMfVorbisDec::GetInputAvailableType(DWORD dwInputStreamID,
     hr = pmt->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
     assert(SUCCEEDED(hr));
 
-    hr = pmt->SetGUID(MF_MT_SUBTYPE, VorbisTypes::MEDIASUBTYPE_Vorbis2);
+    const GUID& subtype = (dwTypeIndex == 0) ?
+                            VorbisTypes::MEDIASUBTYPE_Vorbis2 :
+                            VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing;
+
+    hr = pmt->SetGUID(MF_MT_SUBTYPE, subtype);
     assert(SUCCEEDED(hr));
 
     hr = pmt->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
@@ -485,12 +498,6 @@ HRESULT WebmMfVorbisDec::SetOutputType(DWORD dwOutputStreamID,
 
     hr = pmt->CopyAllItems(m_output_mediatype);
 
-    if (FAILED(hr))
-        return hr;
-
-    // Check to see if input matches output
-    UINT32 channels_in;
-    hr = m_input_mediatype->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &channels_in);
     if (FAILED(hr))
         return hr;
 
@@ -500,22 +507,26 @@ HRESULT WebmMfVorbisDec::SetOutputType(DWORD dwOutputStreamID,
     if (FAILED(hr))
         return hr;
 
-    if (channels_in == channels_out)
-    {
-        GUID subtype_out;
-        hr = m_output_mediatype->GetGUID(MF_MT_SUBTYPE, &subtype_out);
-        if (FAILED(hr))
-            return hr;
+    UINT32 rate_out;
+    hr = m_output_mediatype->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND,
+                                       &rate_out);
+    if (FAILED(hr))
+        return hr;
 
-        if (subtype_out != MFAudioFormat_Float)
-        {
-            m_post_process_samples = true;
-        }
-    }
-    else
-    {
-        m_post_process_samples = true;
-    }
+    // A downmix or a rate that is not the stream's is done by the decoder
+    // as it stores its output, so that no resampler or mixer need follow
+    // us in the topology.
+    hr = m_vorbis_decoder.SetOutputFormat(channels_out, rate_out);
+    if (FAILED(hr))
+        return hr;
+
+    GUID subtype_out;
+    hr = m_output_mediatype->GetGUID(MF_MT_SUBTYPE, &subtype_out);
+    if (FAILED(hr))
+        return hr;
+
+    // 16-bit PCM is converted as the decoder interleaves its output.
+    m_output_int16 = (subtype_out != MFAudioFormat_Float);
 
     CHK(hr, m_output_mediatype->GetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT,
                                           &m_block_align));
@@ -733,6 +744,7 @@ HRESULT WebmMfVorbisDec::ProcessInput(DWORD dwInputStreamID,
 HRESULT WebmMfVorbisDec::DecodeVorbisFormat2Sample(IMFSample* p_sample)
 {
     assert(p_sample);
+    assert(m_input_mediatype);
 
     DWORD count;
 
@@ -741,6 +753,19 @@ HRESULT WebmMfVorbisDec::DecodeVorbisFormat2Sample(IMFSample* p_sample)
     if (FAILED(status))
         return status;
 
+    //A buffer of a laced sample holds many packets (see vorbistypes.h),
+    //which are decoded in turn.
+
+    GUID subtype;
+
+    status = m_input_mediatype->GetGUID(MF_MT_SUBTYPE, &subtype);
+
+    if (FAILED(status))
+        return status;
+
+    const bool laced =
+        (subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing);
+
     for (DWORD idx = 0; idx < count; ++idx)
     {
         IMFMediaBufferPtr buf;
@@ -758,7 +783,32 @@ HRESULT WebmMfVorbisDec::DecodeVorbisFormat2Sample(IMFSample* p_sample)
         if (FAILED(status))
             return status;
 
-        const HRESULT status2 = m_vorbis_decoder.Decode(p_data, data_len);
+        HRESULT status2;
+
+        if (laced)
+        {
+            enum { kMaxPackets = 256 };
+
+            const BYTE* packets[kMaxPackets];
+            long lengths[kMaxPackets];
+
+            const long n = VorbisTypes::GetXiphLacedPackets(
+                            p_data,
+                            data_len,
+                            packets,
+                            lengths,
+                            kMaxPackets);
+
+            status2 = (n > 0) ? S_OK : E_INVALIDARG;
+
+            for (long i = 0; (i < n) && SUCCEEDED(status2); ++i)
+            {
+                BYTE* const p_packet = const_cast<BYTE*>(packets[i]);
+                status2 = m_vorbis_decoder.Decode(p_packet, lengths[i]);
+            }
+        }
+        else
+            status2 = m_vorbis_decoder.Decode(p_data, data_len);
 
         status = buf->Unlock();
         assert(SUCCEEDED(status));
@@ -832,74 +882,37 @@ HRESULT WebmMfVorbisDec::ProcessLibVorbisOutput(IMFSample* p_sample,
     // requested: shoving it all in just because it fits isn't what we want...
     const DWORD max_bytes_to_consume = samples_to_process * block_align;
     assert(max_bytes_to_consume <= mf_storage_limit);
-    if (!m_post_process_samples)
-    {
-        BYTE* p_mf_buffer_data = NULL;
-        DWORD mf_data_len = 0;
-        status = mf_output_buffer->Lock(&p_mf_buffer_data, &mf_storage_limit,
-                                        &mf_data_len);
-        if (FAILED(status))
-            return status;
+    BYTE* p_mf_buffer_data = NULL;
+    DWORD mf_data_len = 0;
+    status = mf_output_buffer->Lock(&p_mf_buffer_data, &mf_storage_limit,
+                                    &mf_data_len);
+    if (FAILED(status))
+        return status;
 
-        float* const ptr_mf_buffer =
-            reinterpret_cast<float*>(p_mf_buffer_data);
+    if (m_output_int16)
+    {
+        int16_t* const ptr_mf_buffer =
+            reinterpret_cast<int16_t*>(p_mf_buffer_data);
 
         status = m_vorbis_decoder.ConsumeOutputSamples(ptr_mf_buffer,
                                                        samples_to_process);
-
-        assert(SUCCEEDED(status));
-
-        const HRESULT unlock_status = mf_output_buffer->Unlock();
-        assert(SUCCEEDED(unlock_status));
-        if (FAILED(unlock_status))
-        {
-            return unlock_status;
-        }
     }
     else
     {
-        const DWORD vorbis_bytes_to_consume = samples_to_process *
-            m_vorbis_decoder.GetVorbisChannels() * sizeof(float);
-
-        if (m_scratch.size() < vorbis_bytes_to_consume)
-        {
-            m_scratch.reset(
-                new (std::nothrow) unsigned char[vorbis_bytes_to_consume],
-                vorbis_bytes_to_consume);
-            if (!m_scratch)
-            {
-                return E_OUTOFMEMORY;
-            }
-        }
-
-        float* const p_vorbis_float_buffer =
-            reinterpret_cast<float*>(m_scratch.get());
+        float* const ptr_mf_buffer =
+            reinterpret_cast<float*>(p_mf_buffer_data);
 
-        status = m_vorbis_decoder.ConsumeOutputSamples(p_vorbis_float_buffer,
+        status = m_vorbis_decoder.ConsumeOutputSamples(ptr_mf_buffer,
                                                        samples_to_process);
+    }
 
-        assert(SUCCEEDED(status));
-
-        BYTE* p_mf_buffer_data = NULL;
-        DWORD mf_data_len = 0;
-        status = mf_output_buffer->Lock(&p_mf_buffer_data, &mf_storage_limit,
-                                        &mf_data_len);
-        if (FAILED(status))
-            return status;
-
-        if (!PostProcessSamples(p_vorbis_float_buffer,
-                                samples_to_process,
-                                p_mf_buffer_data))
-        {
-            return E_INVALIDARG;
-        }
+    assert(SUCCEEDED(status));
 
-        const HRESULT unlock_status = mf_output_buffer->Unlock();
-        assert(SUCCEEDED(unlock_status));
-        if (FAILED(unlock_status))
-        {
-            return unlock_status;
-        }
+    const HRESULT unlock_status = mf_output_buffer->Unlock();
+    assert(SUCCEEDED(unlock_status));
+    if (FAILED(unlock_status))
+    {
+        return unlock_status;
     }
 
     const UINT32 bytes_written = max_bytes_to_consume;
@@ -910,169 +923,6 @@ HRESULT WebmMfVorbisDec::ProcessLibVorbisOutput(IMFSample* p_sample,
     return status;
 }
 
-bool WebmMfVorbisDec::PostProcessSamples(float* const p_vorbis_float_buffer,
-                                         UINT32 samples_to_process,
-                                         BYTE* p_mf_buffer_data)
-{
-    UINT32 channels_to_convert = m_vorbis_decoder.GetVorbisChannels();
-
-    UINT32 channels_out;
-    HRESULT hr = m_output_mediatype->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS,
-                                               &channels_out);
-    if (FAILED(hr))
-        return false;
-    assert(channels_out <= channels_to_convert);
-
-    GUID subtype_out;
-    hr = m_output_mediatype->GetGUID(MF_MT_SUBTYPE, &subtype_out);
-    if (FAILED(hr))
-        return false;
-
-    if (channels_out < channels_to_convert)
-    {
-        const bool convert_to_short =
-            (subtype_out != MFAudioFormat_Float) ? true : false;
-
-        float* src = static_cast<float*>(p_vorbis_float_buffer);
-        float* dstfl = reinterpret_cast<float*>(p_mf_buffer_data);
-        short* dst16 = reinterpret_cast<short*>(p_mf_buffer_data);
-
-        // TODO(tomfinegan or fgalligan): setup a postprocessing function ptr
-        //                                and always call through the ptr to
-        //                                avoid most of the format checks
-        //                                during playback.
-        for (UINT32 i=0; i<samples_to_process; ++i)
-        {
-            float left = 0.0f;
-            float right = 0.0f;
-
-            if (channels_out == 2)
-            {
-                // Downmix to stereo
-                switch (channels_to_convert)
-                {
-                case 8:
-                    left = src[0] + src[3] + src[2] * 0.7f
-                        + src[4] * 0.7f + src[6] * 0.7f;
-                    right = src[1] + src[3] + src[2] * 0.7f
-                        + src[5] * 0.7f + src[7] * 0.7f;
-                    src += 8;
-                    break;
-                case 7:
-                    left = src[0] + src[3] + src[2] * 0.7f
-                        + src[4] * 0.7f + src[6] * 0.7f;
-                    right = src[1] + src[3] + src[2] * 0.7f
-                        + src[5] * 0.7f + src[6] * 0.7f;
-                    src += 7;
-                    break;
-                case 6:
-                    left = src[0] + src[3] + src[2] * 0.7f + src[4] * 0.7f;
-                    right = src[1] + src[3] + src[2] * 0.7f + src[5] * 0.7f;
-                    src += 6;
-                    break;
-                case 5:
-                    left = src[0] + src[2] * 0.7f + src[3] * 0.7f;
-                    right = src[1] + src[2] * 0.7f + src[4] * 0.7f;
-                    src += 5;
-                    break;
-                case 4:
-                    left = src[0] + src[2] * 0.7f + src[3] * 0.7f;
-                    right = src[1] + src[2] * 0.7f + src[3] * 0.7f;
-                    src += 4;
-                    break;
-                case 3:
-                    left = src[0] + src[2] * 0.7f;
-                    right = src[1] + src[2] * 0.7f;
-                    src += 3;
-                    break;
-                }
-
-                if (convert_to_short)
-                {
-                    int val = static_cast<int>(floor(left * 32767.f + .5f));
-                    if (val > 32767)
-                    {
-                        val = 32767;
-                    }
-                    else if (val < -32768)
-                    {
-                        val = -32768;
-                    }
-                    *dst16++ = static_cast<short>(val);
-
-                    val = static_cast<int>(floor(right * 32767.f + .5f));
-                    if(val > 32767)
-                    {
-                        val = 32767;
-                    }
-                    else if(val < -32768)
-                    {
-                        val = -32768;
-                    }
-                    *dst16++ = static_cast<short>(val);
-                }
-                else
-                {
-                    *dstfl++ = left;
-                    *dstfl++ = right;
-                }
-            }
-            else if (channels_out == 6)
-            {
-                // fold to 5.1
-                if (convert_to_short)
-                {
-                    for (int j=0; j<6; ++j)
-                    {
-                        int val = static_cast<int>(floor(src[j] *
-                                                   32767.f + .5f));
-                        if (val > 32767)
-                        {
-                            val = 32767;
-                        }
-                        else if (val < -32768)
-                        {
-                            val = -32768;
-                        }
-                        *dst16++ = static_cast<short>(val);
-                    }
-                }
-                else
-                {
-                    memcpy(dstfl, src, 6 * sizeof(float));
-                    dstfl += 6;
-                }
-
-                src += channels_to_convert;
-            }
-        }
-    }
-    else if (subtype_out != MFAudioFormat_Float)
-    {
-        const int samples_to_convert =
-            samples_to_process * channels_to_convert;
-
-        float* src = static_cast<float*>(p_vorbis_float_buffer);
-        short* dst16 = reinterpret_cast<short*>(p_mf_buffer_data);
-
-        for (int i=0; i<samples_to_convert; i++)
-        {
-            int val = static_cast<int>(floor(src[i] * 32767.f + .5f));
-            if (val > 32767)
-            {
-                val = 32767;
-            }
-            else if (val < -32768)
-            {
-                val = -32768;
-            }
-            *dst16++ = static_cast<short>(val);
-        }
-    }
-
-    return true;
-}
-
 REFERENCE_TIME WebmMfVorbisDec::SamplesToMediaTime(UINT64 sample_count) const
 {
     const double kHz = 10000000.0;
@@ -1134,8 +984,9 @@ HRESULT WebmMfVorbisDec::ProcessOutput(DWORD dwFlags, DWORD cOutputBufferCount,
         return E_INVALIDARG;
     }
 
-    // make sure we have an input sample to work on
-    if (m_mf_input_samples.empty())
+    // make sure we have an input sample to work on, unless we're draining
+    // PCM held back for aggregation
+    if (m_mf_input_samples.empty() && !m_drain)
     {
         return MF_E_TRANSFORM_NEED_MORE_INPUT;
     }
@@ -1163,62 +1014,50 @@ HRESULT WebmMfVorbisDec::ProcessOutput(DWORD dwFlags, DWORD cOutputBufferCount,
         return E_INVALIDARG;
     }
 
-    IMFSample* const p_mf_input_sample = m_mf_input_samples.front();
-    assert(p_mf_input_sample);
+    // get output buffer size, and use it to calculate |samples_to_process| to
+    // ensure we never try to process more samples than will fit in the output
+    // buffer
 
-    CHK(hr, DecodeVorbisFormat2Sample(p_mf_input_sample));
+    const DWORD buffer_capacity_bytes =
+        get_mf_buffer_capacity(p_mf_output_sample, 0);
+    const DWORD buffer_capacity_samples =
+        (buffer_capacity_bytes + (m_block_align - 1)) / m_block_align;
 
-    if (FAILED(hr))
-    {
-        return hr;
-    }
+    // When aggregating, decode the queued input until there's PCM for the
+    // target duration, or enough to fill the buffer.  Otherwise, decode
+    // just the one input sample.
+    const UINT32 target_samples = GetOutputTargetSamples();
+    const UINT32 samples_wanted =
+        target_samples > buffer_capacity_samples ?
+            buffer_capacity_samples : target_samples;
 
-    // store input start time for logging/debugging
-    LONGLONG input_start_time = 0;
-    CHK(hr, p_mf_input_sample->GetSampleTime(&input_start_time));
-    assert(SUCCEEDED(hr));
-    assert(input_start_time >= 0);
-    if (FAILED(hr))
-    {
-        return hr;
-    }
+    UINT32 samples_available = 0;
 
-    if (m_decode_start_time < 0)
+    while (!m_mf_input_samples.empty())
     {
-        m_total_samples_decoded = 0;
-        m_decode_start_time = input_start_time;
+        CHK(hr, DecodeNextInputSample());
 
-        // DEBUG
-        m_mediatime_decoded = 0;
+        if (FAILED(hr))
+        {
+            return hr;
+        }
 
-        m_start_time = m_decode_start_time;
+        CHK(hr, m_vorbis_decoder.GetOutputSamplesAvailable(&samples_available));
 
-        //DBGLOG("m_decode_start_time="
-        //       << REFTIMETOSECONDS(m_decode_start_time));
+        if (samples_available >= samples_wanted)
+            break;
     }
 
-    // media sample data has been passed to libvorbis; pop/release
-    m_mf_input_samples.pop_front();
-    p_mf_input_sample->Release();
-
-    //DBGLOG("IN start_time=" << REFTIMETOSECONDS(input_start_time) <<
-    //       " duration=" << REFTIMETOSECONDS(input_duration));
-
-    // get output buffer size, and use it to calculate |samples_to_process| to
-    // ensure we never try to process more samples than will fit in the output
-    // buffer
-
-    const DWORD buffer_capacity_bytes =
-        get_mf_buffer_capacity(p_mf_output_sample, 0);
-    const DWORD buffer_capacity_samples =
-        (buffer_capacity_bytes + (m_block_align - 1)) / m_block_align;
-
-    UINT32 samples_available;
     CHK(hr, m_vorbis_decoder.GetOutputSamplesAvailable(&samples_available));
 
     if (samples_available == 0)
         return MF_E_TRANSFORM_NEED_MORE_INPUT;
 
+    // hold back a short output until more input arrives, unless that won't
+    // happen before a drain completes
+    if ((samples_available < samples_wanted) && !m_drain)
+        return MF_E_TRANSFORM_NEED_MORE_INPUT;
+
     // Ensure we never try to process more samples than will fit in our output
     // buffer -- abuse |buffer_capacity_samples| to cap |samples_to_process| if
     // needed.
@@ -1273,6 +1112,76 @@ HRESULT WebmMfVorbisDec::ProcessOutput(DWORD dwFlags, DWORD cOutputBufferCount,
 }
 
 
+HRESULT WebmMfVorbisDec::DecodeNextInputSample()
+{
+    assert(!m_mf_input_samples.empty());
+
+    IMFSample* const p_mf_input_sample = m_mf_input_samples.front();
+    assert(p_mf_input_sample);
+
+    HRESULT hr;
+    CHK(hr, DecodeVorbisFormat2Sample(p_mf_input_sample));
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // store input start time for logging/debugging
+    LONGLONG input_start_time = 0;
+    CHK(hr, p_mf_input_sample->GetSampleTime(&input_start_time));
+    assert(SUCCEEDED(hr));
+    assert(input_start_time >= 0);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (m_decode_start_time < 0)
+    {
+        m_total_samples_decoded = 0;
+        m_decode_start_time = input_start_time;
+
+        // DEBUG
+        m_mediatime_decoded = 0;
+
+        m_start_time = m_decode_start_time;
+
+        //DBGLOG("m_decode_start_time="
+        //       << REFTIMETOSECONDS(m_decode_start_time));
+    }
+
+    // media sample data has been passed to libvorbis; pop/release
+    m_mf_input_samples.pop_front();
+    p_mf_input_sample->Release();
+
+    //DBGLOG("IN start_time=" << REFTIMETOSECONDS(input_start_time) <<
+    //       " duration=" << REFTIMETOSECONDS(input_duration));
+
+    return S_OK;
+}
+
+UINT32 WebmMfVorbisDec::GetOutputTargetSamples() const
+{
+    if (m_attributes == 0)
+        return 0;
+
+    UINT64 duration;
+
+    const HRESULT hr =
+        m_attributes->GetUINT64(WebmTypes::WebmMfVorbisDec_OutputDuration,
+                                &duration);
+
+    if (FAILED(hr) || (duration == 0))
+        return 0;
+
+    // the output samples' times come from the count of samples decoded, so
+    // they stay exact however many packets are aggregated
+    const UINT64 samples = MediaTimeToSamples(REFERENCE_TIME(duration));
+
+    return samples > ULONG_MAX ? ULONG_MAX : static_cast<UINT32>(samples);
+}
+
 HRESULT WebmMfVorbisDec::CreateVorbisDecoder(IMFMediaType* p_media_type)
 {
     //
@@ -1356,10 +1265,14 @@ HRESULT WebmMfVorbisDec::ValidateOutputFormat(IMFMediaType *pmt)
     status = pmt->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &output_rate);
     assert(SUCCEEDED(status));
 
-    UINT32 vorbis_rate = m_vorbis_decoder.GetVorbisRate();
+    const int vorbis_channels = m_vorbis_decoder.GetVorbisChannels();
+    const int vorbis_rate = m_vorbis_decoder.GetVorbisRate();
 
-    if (output_rate != vorbis_rate)
+    if (!webmdshow::PcmConverter::IsSupported(vorbis_channels, vorbis_rate,
+                                              output_channels, output_rate))
+    {
         return MF_E_INVALIDMEDIATYPE;
+    }
 
     UINT32 wBitsPerSample = 0;
 
@@ -1689,8 +1602,14 @@ bool WebmMfVorbisDec::FormatSupported(bool is_input, IMFMediaType* p_mediatype)
     {
         hr = p_mediatype->GetGUID(MF_MT_SUBTYPE, &g);
 
-        if (FAILED(hr) || g != VorbisTypes::MEDIASUBTYPE_Vorbis2)
+        if (FAILED(hr))
             return false;
+
+        if (g != VorbisTypes::MEDIASUBTYPE_Vorbis2 &&
+            g != VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing)
+        {
+            return false;
+        }
     }
     else
     {
@@ -141,6 +141,8 @@ private:
     HRESULT ValidateOutputFormat(IMFMediaType *pmt);
     HRESULT CreateMediaBuffer(DWORD size, IMFMediaBuffer** pp_buffer);
     HRESULT DecodeVorbisFormat2Sample(IMFSample* p_mf_input_sample);
+    HRESULT DecodeNextInputSample();
+    UINT32 GetOutputTargetSamples() const;
     HRESULT ProcessLibVorbisOutput(IMFSample* p_mf_output_sample,
                                    UINT32 samples_to_process);
 
@@ -155,21 +157,12 @@ private:
 
     HRESULT ResetMediaType(bool reset_input);
 
-    bool PostProcessSamples(float* const p_vorbis_float_buffer,
-                            UINT32 samples_to_process,
-                            BYTE* p_mf_buffer_data);
     REFERENCE_TIME SamplesToMediaTime(UINT64 num_samples) const;
     UINT64 MediaTimeToSamples(REFERENCE_TIME media_time) const;
 
-    // Scratch buffer used by the filter to convert samples from one format to
-    // another.
-    WebmUtil::auto_array<unsigned char> m_scratch;
-
     bool m_drain;
-    // When |m_post_process_samples| is true the filter will need to process
-    // the output from the decoder because the input format does not match
-    // the output format.
-    bool m_post_process_samples;
+    // The output type is 16-bit PCM, which the decoder writes directly.
+    bool m_output_int16;
 
     IClassFactory* const m_pClassFactory;
 
@@ -177,6 +170,12 @@ private:
     IMFMediaTypePtr m_input_mediatype;
     IMFMediaTypePtr m_output_mediatype;
 
+    // Holds WebmTypes::WebmMfVorbisDec_OutputDuration, the duration of PCM
+    // to aggregate into each output sample.  Absent or zero, each input
+    // sample gives an output sample.
+    _COM_SMARTPTR_TYPEDEF(IMFAttributes, __uuidof(IMFAttributes));
+    IMFAttributesPtr m_attributes;
+
     LONG m_cRef;
 
     typedef std::list<IMFSample*> mf_input_samples_t;
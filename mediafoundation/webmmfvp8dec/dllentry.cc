@@ -22,10 +22,17 @@ static ULONG s_cLock;
 namespace WebmMfVp8DecLib {
 
 HRESULT CreateDecoder(IClassFactory*, IUnknown*, const IID&, void**);
+HRESULT CreateVp9Decoder(IClassFactory*, IUnknown*, const IID&, void**);
 
 }  // end namespace WebmMfVp8DecLib
 
 static CFactory s_handler_factory(&s_cLock, &WebmMfVp8DecLib::CreateDecoder);
+static CFactory s_vp9_factory(&s_cLock, &WebmMfVp8DecLib::CreateVp9Decoder);
+
+static HRESULT RegisterDecoder(const CLSID&, const wchar_t* friendly_name,
+                               const wchar_t* filename, const wchar_t* progid,
+                               const wchar_t* progid_version,
+                               const GUID& subtype);
 
 BOOL APIENTRY DllMain(HINSTANCE hModule, DWORD dwReason, LPVOID) {
   switch (dwReason) {
@@ -49,11 +56,19 @@ STDAPI DllGetClassObject(const CLSID& clsid, const IID& iid, void** ppv) {
   if (clsid == WebmTypes::CLSID_WebmMfVp8Dec)
     return s_handler_factory.QueryInterface(iid, ppv);
 
+  if (clsid == WebmTypes::CLSID_WebmMfVp9Dec)
+    return s_vp9_factory.QueryInterface(iid, ppv);
+
   return CLASS_E_CLASSNOTAVAILABLE;
 }
 
 STDAPI DllUnregisterServer() {
-  HRESULT hr = MFTUnregister(WebmTypes::CLSID_WebmMfVp8Dec);
+  HRESULT hr = MFTUnregister(WebmTypes::CLSID_WebmMfVp9Dec);
+  // assert(SUCCEEDED(hr));  //TODO: dump this it fails
+
+  hr = ComReg::UnRegisterCoclass(WebmTypes::CLSID_WebmMfVp9Dec);
+
+  hr = MFTUnregister(WebmTypes::CLSID_WebmMfVp8Dec);
   // assert(SUCCEEDED(hr));  //TODO: dump this it fails
 
   hr = ComReg::UnRegisterCoclass(WebmTypes::CLSID_WebmMfVp8Dec);
@@ -74,15 +89,32 @@ STDAPI DllRegisterServer() {
   const wchar_t* const filename = filename_.c_str();
 
 #if _DEBUG
-  const wchar_t friendly_name[] = L"WebM MF VP8 Decoder Transform (Debug)";
+  const wchar_t vp8_name[] = L"WebM MF VP8 Decoder Transform (Debug)";
+  const wchar_t vp9_name[] = L"WebM MF VP9 Decoder Transform (Debug)";
 #else
-  const wchar_t friendly_name[] = L"WebM MF VP8 Decoder Transform";
+  const wchar_t vp8_name[] = L"WebM MF VP8 Decoder Transform";
+  const wchar_t vp9_name[] = L"WebM MF VP9 Decoder Transform";
 #endif
 
-  hr = ComReg::RegisterCoclass(
-      WebmTypes::CLSID_WebmMfVp8Dec, friendly_name, filename,
-      L"Webm.MfVp8Dec",  // TODO: do we really need ProgIDs?
-      L"Webm.MfVp8Dec.1",
+  hr = RegisterDecoder(WebmTypes::CLSID_WebmMfVp8Dec, vp8_name, filename,
+                       L"Webm.MfVp8Dec",  // TODO: do we really need ProgIDs?
+                       L"Webm.MfVp8Dec.1", WebmTypes::MEDIASUBTYPE_VP80);
+
+  if (FAILED(hr))
+    return hr;
+
+  hr = RegisterDecoder(WebmTypes::CLSID_WebmMfVp9Dec, vp9_name, filename,
+                       L"Webm.MfVp9Dec", L"Webm.MfVp9Dec.1",
+                       WebmTypes::MEDIASUBTYPE_VP90);
+
+  return hr;
+}
+
+HRESULT RegisterDecoder(const CLSID& clsid, const wchar_t* friendly_name,
+                        const wchar_t* filename, const wchar_t* progid,
+                        const wchar_t* progid_version, const GUID& subtype) {
+  HRESULT hr = ComReg::RegisterCoclass(
+      clsid, friendly_name, filename, progid, progid_version,
       false,  // not insertable
       false,  // not a control
       ComReg::kBoth,  // DShow filters must support "both"
@@ -95,17 +127,18 @@ STDAPI DllRegisterServer() {
 
   enum { cInputTypes = 1 };
   MFT_REGISTER_TYPE_INFO pInputTypes[cInputTypes] = {
-      {MFMediaType_Video, WebmTypes::MEDIASUBTYPE_VP80}};
+      {MFMediaType_Video, subtype}};
 
-  enum { cOutputTypes = 3 };
+  enum { cOutputTypes = 4 };
   MFT_REGISTER_TYPE_INFO pOutputTypes[cOutputTypes] = {
       {MFMediaType_Video, MFVideoFormat_NV12},
       {MFMediaType_Video, MFVideoFormat_YV12},
-      {MFMediaType_Video, MFVideoFormat_IYUV}};
+      {MFMediaType_Video, MFVideoFormat_IYUV},
+      {MFMediaType_Video, WebmTypes::MEDIASUBTYPE_Y800}};
 
   wchar_t* const friendly_name_ = const_cast<wchar_t*>(friendly_name);
 
-  hr = MFTRegister(WebmTypes::CLSID_WebmMfVp8Dec, MFT_CATEGORY_VIDEO_DECODER,
+  hr = MFTRegister(clsid, MFT_CATEGORY_VIDEO_DECODER,
                    friendly_name_,
                    MFT_ENUM_FLAG_SYNCMFT,  // TODO: for now, just support sync
                    cInputTypes, pInputTypes, cOutputTypes, pOutputTypes,
@@ -0,0 +1,394 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "samplepool.h"
+
+#include <comdef.h>
+#include <evr.h>
+
+#include <cassert>
+#include <new>
+
+_COM_SMARTPTR_TYPEDEF(ID3D11Device, __uuidof(ID3D11Device));
+_COM_SMARTPTR_TYPEDEF(ID3D11Texture2D, __uuidof(ID3D11Texture2D));
+_COM_SMARTPTR_TYPEDEF(IMFDXGIBuffer, __uuidof(IMFDXGIBuffer));
+_COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, __uuidof(IMFMediaBuffer));
+_COM_SMARTPTR_TYPEDEF(IMFSample, __uuidof(IMFSample));
+_COM_SMARTPTR_TYPEDEF(IMFTrackedSample, __uuidof(IMFTrackedSample));
+
+namespace WebmMfVp8DecLib {
+
+HRESULT SamplePool::CreateInstance(SamplePool** pp) {
+  if (pp == 0)
+    return E_POINTER;
+
+  SamplePool* const p = new (std::nothrow) SamplePool;
+  *pp = p;
+
+  if (p == 0)
+    return E_OUTOFMEMORY;
+
+  const HRESULT hr = p->CLockable::Init();
+
+  if (FAILED(hr)) {
+    p->Release();
+    *pp = 0;
+  }
+
+  return hr;
+}
+
+SamplePool::SamplePool()
+    : m_cRef(1),
+      m_bShutdown(false),
+      m_cbBuffer(0),
+      m_cAllocated(0),
+      m_pDevice(0),
+      m_width(0),
+      m_height(0),
+      m_pfnCreateDXGISurfaceBuffer(0) {
+  // mfplat.dll is already loaded, since the decoder links against it.
+  const HMODULE h = GetModuleHandleW(L"mfplat.dll");
+
+  if (h) {
+    FARPROC const pfn = GetProcAddress(h, "MFCreateDXGISurfaceBuffer");
+    m_pfnCreateDXGISurfaceBuffer =
+        reinterpret_cast<CreateDXGISurfaceBufferFn>(pfn);
+  }
+}
+
+SamplePool::~SamplePool() {
+  Purge();
+  SetDevice(0);
+}
+
+HRESULT SamplePool::QueryInterface(const IID& iid, void** ppv) {
+  if (ppv == 0)
+    return E_POINTER;
+
+  IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+  if (iid == __uuidof(IUnknown)) {
+    pUnk = static_cast<IMFAsyncCallback*>(this);
+  } else if (iid == __uuidof(IMFAsyncCallback)) {
+    pUnk = static_cast<IMFAsyncCallback*>(this);
+  } else {
+    pUnk = 0;
+    return E_NOINTERFACE;
+  }
+
+  pUnk->AddRef();
+  return S_OK;
+}
+
+ULONG SamplePool::AddRef() { return InterlockedIncrement(&m_cRef); }
+
+ULONG SamplePool::Release() {
+  if (LONG n = InterlockedDecrement(&m_cRef))
+    return n;
+
+  delete this;
+  return 0;
+}
+
+HRESULT SamplePool::GetParameters(DWORD*, DWORD*) {
+  return E_NOTIMPL;  // means "assume default behavior"
+}
+
+HRESULT SamplePool::Invoke(IMFAsyncResult* pResult) {
+  if (pResult == 0)
+    return E_INVALIDARG;
+
+  // The object of the result is the sample whose last reference
+  // was just released.
+
+  IUnknownPtr pUnk;
+
+  HRESULT hr = pResult->GetObject(&pUnk);
+
+  IMFSamplePtr pSample;
+
+  if (SUCCEEDED(hr))
+    hr = pUnk->QueryInterface(&pSample);
+
+  if (SUCCEEDED(hr)) {
+    Lock lock;
+
+    hr = lock.Seize(this);
+
+    if (SUCCEEDED(hr) && !m_bShutdown && IsCurrent(pSample))
+      m_free.push_back(pSample.Detach());
+  }
+
+  // balance the reference taken in GetSample, on behalf of the sample
+  Release();
+
+  return S_OK;
+}
+
+HRESULT SamplePool::GetSample(DWORD cb, IMFSample** pp) {
+  if (pp == 0)
+    return E_POINTER;
+
+  *pp = 0;
+
+  if (cb == 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_bShutdown)
+    return MF_E_SHUTDOWN;
+
+  if (m_pDevice || (cb != m_cbBuffer)) {
+    Purge();
+    SetDevice(0);
+    m_cbBuffer = cb;
+  }
+
+  return Allocate(pp);
+}
+
+HRESULT SamplePool::GetTextureSample(ID3D11Device* pDevice, UINT width,
+                                     UINT height, IMFSample** pp) {
+  if (pp == 0)
+    return E_POINTER;
+
+  *pp = 0;
+
+  if ((pDevice == 0) || (width == 0) || (height == 0))
+    return E_INVALIDARG;
+
+  if (m_pfnCreateDXGISurfaceBuffer == 0)
+    return E_NOTIMPL;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_bShutdown)
+    return MF_E_SHUTDOWN;
+
+  if ((pDevice != m_pDevice) || (width != m_width) || (height != m_height)) {
+    Purge();
+    SetDevice(pDevice);
+    m_cbBuffer = 0;
+    m_width = width;
+    m_height = height;
+  }
+
+  return Allocate(pp);
+}
+
+bool SamplePool::SupportsTextures() const {
+  return (m_pfnCreateDXGISurfaceBuffer != 0);
+}
+
+HRESULT SamplePool::Allocate(IMFSample** pp) {
+  // pool was already locked by caller
+
+  IMFSamplePtr pSample;
+  HRESULT hr;
+
+  if (m_free.empty()) {
+    hr = CreateSample(&pSample);
+
+    if (FAILED(hr))
+      return hr;
+  } else {
+    pSample.Attach(m_free.back());
+    m_free.pop_back();
+
+    hr = pSample->DeleteAllItems();
+    assert(SUCCEEDED(hr));
+
+    IMFMediaBufferPtr pBuffer;
+
+    hr = pSample->GetBufferByIndex(0, &pBuffer);
+    assert(SUCCEEDED(hr));
+
+    hr = pBuffer->SetCurrentLength(0);
+    assert(SUCCEEDED(hr));
+  }
+
+  // Tracking is one-shot: the allocator must be set again each time
+  // the sample is handed out.
+
+  IMFTrackedSamplePtr pTracked;
+
+  hr = pSample->QueryInterface(&pTracked);
+
+  if (FAILED(hr))
+    return hr;
+
+  hr = pTracked->SetAllocator(this, 0);
+
+  if (FAILED(hr))
+    return hr;
+
+  AddRef();  // released in Invoke
+
+  *pp = pSample.Detach();
+  return S_OK;
+}
+
+void SamplePool::Shutdown() {
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+  assert(SUCCEEDED(hr));
+
+  m_bShutdown = true;
+  Purge();
+}
+
+LONG SamplePool::GetAllocationCount() const { return m_cAllocated; }
+
+void SamplePool::Purge() {
+  while (!m_free.empty()) {
+    m_free.back()->Release();
+    m_free.pop_back();
+  }
+}
+
+void SamplePool::SetDevice(ID3D11Device* pDevice) {
+  if (pDevice)
+    pDevice->AddRef();
+
+  if (m_pDevice)
+    m_pDevice->Release();
+
+  m_pDevice = pDevice;
+}
+
+bool SamplePool::IsCurrent(IMFSample* pSample) const {
+  IMFMediaBufferPtr pBuffer;
+
+  HRESULT hr = pSample->GetBufferByIndex(0, &pBuffer);
+
+  if (FAILED(hr))
+    return false;
+
+  IMFDXGIBufferPtr pDXGIBuffer;
+
+  hr = pBuffer->QueryInterface(&pDXGIBuffer);
+
+  if (FAILED(hr)) {
+    if (m_pDevice)
+      return false;
+
+    DWORD cbMax;
+
+    hr = pBuffer->GetMaxLength(&cbMax);
+    return SUCCEEDED(hr) && (cbMax == m_cbBuffer);
+  }
+
+  if (m_pDevice == 0)
+    return false;
+
+  ID3D11Texture2DPtr pTexture;
+
+  hr = pDXGIBuffer->GetResource(__uuidof(ID3D11Texture2D),
+                                reinterpret_cast<void**>(&pTexture));
+
+  if (FAILED(hr))
+    return false;
+
+  ID3D11DevicePtr pDevice;
+  pTexture->GetDevice(&pDevice);
+
+  if (pDevice != m_pDevice)
+    return false;
+
+  D3D11_TEXTURE2D_DESC desc;
+  pTexture->GetDesc(&desc);
+
+  return (desc.Width == m_width) && (desc.Height == m_height);
+}
+
+HRESULT SamplePool::CreateSample(IMFSample** pp) {
+  // A sample created with a NULL surface has no buffers, but it does
+  // support IMFTrackedSample, which is what makes recycling possible.
+
+  IMFSamplePtr pSample;
+
+  HRESULT hr = MFCreateVideoSampleFromSurface(0, &pSample);
+
+  if (FAILED(hr))
+    return hr;
+
+  IMFMediaBufferPtr pBuffer;
+
+  if (m_pDevice)
+    hr = CreateTextureBuffer(&pBuffer);
+  else
+    hr = MFCreateAlignedMemoryBuffer(m_cbBuffer, MF_16_BYTE_ALIGNMENT,
+                                     &pBuffer);
+
+  if (FAILED(hr))
+    return hr;
+
+  hr = pSample->AddBuffer(pBuffer);
+
+  if (FAILED(hr))
+    return hr;
+
+  ++m_cAllocated;
+
+  *pp = pSample.Detach();
+  return S_OK;
+}
+
+HRESULT SamplePool::CreateTextureBuffer(IMFMediaBuffer** pp) {
+  assert(m_pDevice);
+  assert(m_pfnCreateDXGISurfaceBuffer);
+
+  D3D11_TEXTURE2D_DESC desc;
+
+  desc.Width = m_width;
+  desc.Height = m_height;
+  desc.MipLevels = 1;
+  desc.ArraySize = 1;
+  desc.Format = DXGI_FORMAT_NV12;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = 0;
+
+  ID3D11Texture2DPtr pTexture;
+
+  HRESULT hr = m_pDevice->CreateTexture2D(&desc, 0, &pTexture);
+
+  if (FAILED(hr)) {
+    // Not every device can sample NV12 from a shader; the video
+    // processor of the renderer does not need the bind flag.
+    desc.BindFlags = 0;
+
+    hr = m_pDevice->CreateTexture2D(&desc, 0, &pTexture);
+
+    if (FAILED(hr))
+      return hr;
+  }
+
+  return (*m_pfnCreateDXGISurfaceBuffer)(__uuidof(ID3D11Texture2D), pTexture,
+                                         0,  // subresource
+                                         FALSE,  // top-down
+                                         pp);
+}
+
+}  // end namespace WebmMfVp8DecLib
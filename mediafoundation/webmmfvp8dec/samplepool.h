@@ -0,0 +1,104 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef WEBMDSHOW_MEDIAFOUNDATION_WEBMMFVP8DEC_SAMPLEPOOL_H_
+#define WEBMDSHOW_MEDIAFOUNDATION_WEBMMFVP8DEC_SAMPLEPOOL_H_
+
+#include <d3d11.h>
+#include <mfapi.h>
+#include <mfidl.h>
+
+#include <vector>
+
+#include "clockable.h"
+
+namespace WebmMfVp8DecLib {
+
+// Output samples for the decoder, when it provides its own samples
+// (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES).  Each sample is an IMFTrackedSample
+// holding one buffer: either system memory, or an IMFDXGIBuffer wrapping an
+// NV12 texture when the decoder has a D3D11 device.  When the last reference
+// to a sample handed out by the pool is released, MF invokes the pool's
+// callback and the sample is put back on the free list, so that in steady
+// state no buffers are allocated.  The pool is refcounted separately from
+// the decoder, because samples can still be downstream when the decoder is
+// destroyed.
+class SamplePool : public IMFAsyncCallback, public CLockable {
+  SamplePool(const SamplePool&);
+  SamplePool& operator=(const SamplePool&);
+
+ public:
+  static HRESULT CreateInstance(SamplePool**);
+
+  // IUnknown
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+  ULONG STDMETHODCALLTYPE AddRef();
+  ULONG STDMETHODCALLTYPE Release();
+
+  // IMFAsyncCallback
+
+  HRESULT STDMETHODCALLTYPE GetParameters(DWORD*, DWORD*);
+  HRESULT STDMETHODCALLTYPE Invoke(IMFAsyncResult*);
+
+  // Returns a sample whose buffer can hold cb bytes.  The buffer length is
+  // reset to 0.  If cb differs from the size of the buffers in the pool,
+  // the free samples are discarded, and samples of the old size that are
+  // still outstanding are not recycled when they are released.
+  HRESULT GetSample(DWORD cb, IMFSample**);
+
+  // Returns a sample whose buffer is a width x height NV12 texture created
+  // on the device.  Changing the device or the size discards the pool, as
+  // for GetSample.  Returns E_NOTIMPL if the platform cannot wrap textures
+  // in media buffers (MFCreateDXGISurfaceBuffer is Windows 8 and later).
+  HRESULT GetTextureSample(ID3D11Device*, UINT width, UINT height,
+                           IMFSample**);
+
+  bool SupportsTextures() const;
+
+  // Releases the free samples.  Samples that are outstanding are released
+  // as they are returned, instead of being recycled.
+  void Shutdown();
+
+  // Number of samples created since the pool was created.
+  LONG GetAllocationCount() const;
+
+ private:
+  SamplePool();
+  virtual ~SamplePool();
+
+  LONG m_cRef;
+  bool m_bShutdown;
+  DWORD m_cbBuffer;
+  LONG m_cAllocated;
+
+  // The texture configuration, when m_pDevice is non-null.
+  ID3D11Device* m_pDevice;
+  UINT m_width;
+  UINT m_height;
+
+  typedef HRESULT(STDAPICALLTYPE* CreateDXGISurfaceBufferFn)(
+      REFIID, IUnknown*, UINT, BOOL, IMFMediaBuffer**);
+
+  // Looked up at run time, so the decoder still loads on Windows 7.
+  CreateDXGISurfaceBufferFn m_pfnCreateDXGISurfaceBuffer;
+
+  typedef std::vector<IMFSample*> samples_t;
+  samples_t m_free;
+
+  void Purge();
+  void SetDevice(ID3D11Device*);
+  bool IsCurrent(IMFSample*) const;
+  HRESULT Allocate(IMFSample**);
+  HRESULT CreateSample(IMFSample**);
+  HRESULT CreateTextureBuffer(IMFMediaBuffer**);
+};
+
+}  // end namespace WebmMfVp8DecLib
+
+#endif  // WEBMDSHOW_MEDIAFOUNDATION_WEBMMFVP8DEC_SAMPLEPOOL_H_
@@ -15,7 +15,9 @@
 #include <cassert>
 #include <new>
 
+#include "cpuutil.h"
 #include "libyuv_util.h"
+#include "vp8frameinfo.h"
 
 #ifdef _DEBUG
 #include "odbgstream.h"
@@ -24,6 +26,9 @@ using std::endl;
 using std::boolalpha;
 #endif
 
+_COM_SMARTPTR_TYPEDEF(ID3D11Device, __uuidof(ID3D11Device));
+_COM_SMARTPTR_TYPEDEF(ID3D11DeviceContext, __uuidof(ID3D11DeviceContext));
+_COM_SMARTPTR_TYPEDEF(ID3D11Texture2D, __uuidof(ID3D11Texture2D));
 _COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, __uuidof(IMFMediaBuffer));
 _COM_SMARTPTR_TYPEDEF(IMF2DBuffer, __uuidof(IMF2DBuffer));
 
@@ -31,6 +36,19 @@ namespace WebmMfVp8DecLib {
 
 HRESULT CreateDecoder(IClassFactory* pClassFactory, IUnknown* pOuter,
                       const IID& iid, void** ppv) {
+  return WebmMfVp8Dec::CreateInstance(pClassFactory, pOuter,
+                                      WebmTypes::MEDIASUBTYPE_VP80, iid, ppv);
+}
+
+HRESULT CreateVp9Decoder(IClassFactory* pClassFactory, IUnknown* pOuter,
+                         const IID& iid, void** ppv) {
+  return WebmMfVp8Dec::CreateInstance(pClassFactory, pOuter,
+                                      WebmTypes::MEDIASUBTYPE_VP90, iid, ppv);
+}
+
+HRESULT WebmMfVp8Dec::CreateInstance(IClassFactory* pClassFactory,
+                                     IUnknown* pOuter, const GUID& subtype,
+                                     const IID& iid, void** ppv) {
   if (ppv == 0)
     return E_POINTER;
 
@@ -39,7 +57,8 @@ HRESULT CreateDecoder(IClassFactory* pClassFactory, IUnknown* pOuter,
   if (pOuter)
     return CLASS_E_NOAGGREGATION;
 
-  WebmMfVp8Dec* const p = new (std::nothrow) WebmMfVp8Dec(pClassFactory);
+  WebmMfVp8Dec* const p =
+      new (std::nothrow) WebmMfVp8Dec(pClassFactory, subtype);
 
   if (p == 0)
     return E_OUTOFMEMORY;
@@ -54,12 +73,19 @@ HRESULT CreateDecoder(IClassFactory* pClassFactory, IUnknown* pOuter,
   return hr;
 }
 
-WebmMfVp8Dec::WebmMfVp8Dec(IClassFactory* pClassFactory)
+WebmMfVp8Dec::WebmMfVp8Dec(IClassFactory* pClassFactory, const GUID& subtype)
     : m_pClassFactory(pClassFactory),
       m_cRef(1),
+      m_subtype(subtype),
       m_pInputMediaType(0),
       m_pOutputMediaType(0),
+      m_bDecoderInit(false),
       m_scaled_image(0),
+      m_pAttributes(0),
+      m_pPool(0),
+      m_pDeviceManager(0),
+      m_hDevice(0),
+      m_pStaging(0),
       m_rate(1),
       m_bThin(FALSE),
       m_drop_mode(MF_DROP_MODE_NONE),
@@ -74,6 +100,30 @@ WebmMfVp8Dec::WebmMfVp8Dec(IClassFactory* pClassFactory)
   hr = CLockable::Init();
   assert(SUCCEEDED(hr));
 
+  hr = MFCreateAttributes(&m_pAttributes, 2);
+
+  if (SUCCEEDED(hr)) {
+    hr = m_pAttributes->SetUINT32(MF_SA_D3D_AWARE, FALSE);
+    assert(SUCCEEDED(hr));
+  } else {
+    m_pAttributes = 0;
+  }
+
+  // If the pool cannot be created, the caller supplies the output
+  // samples, as before.
+
+  hr = SamplePool::CreateInstance(&m_pPool);
+
+  if (FAILED(hr))
+    m_pPool = 0;
+
+  ResetDecodeStats();
+
+  if (m_pAttributes && m_pPool && m_pPool->SupportsTextures()) {
+    hr = m_pAttributes->SetUINT32(MF_SA_D3D11_AWARE, TRUE);
+    assert(SUCCEEDED(hr));
+  }
+
   // m_frame_rate.Init();
 }
 
@@ -84,12 +134,10 @@ WebmMfVp8Dec::~WebmMfVp8Dec() {
     assert(n == 0);
 
     m_pInputMediaType = 0;
-
-    const vpx_codec_err_t e = vpx_codec_destroy(&m_ctx);
-    e;
-    assert(e == VPX_CODEC_OK);
   }
 
+  DestroyDecoder();
+
   vpx_img_free(m_scaled_image);
   m_scaled_image = NULL;
 
@@ -102,6 +150,18 @@ WebmMfVp8Dec::~WebmMfVp8Dec() {
   }
 
   Flush();
+  ReleaseD3D();
+
+  if (m_pPool) {
+    m_pPool->Shutdown();  // samples still downstream keep the pool alive
+    m_pPool->Release();
+    m_pPool = 0;
+  }
+
+  if (m_pAttributes) {
+    m_pAttributes->Release();
+    m_pAttributes = 0;
+  }
 
   HRESULT hr = m_pClassFactory->LockServer(FALSE);
   assert(SUCCEEDED(hr));
@@ -292,6 +352,12 @@ HRESULT WebmMfVp8Dec::GetOutputStreamInfo(DWORD dwOutputStreamID,
                  MFT_OUTPUT_STREAM_SINGLE_SAMPLE_PER_BUFFER |
                  MFT_OUTPUT_STREAM_FIXED_SAMPLE_SIZE;
 
+  // Output samples come from the pool, so that frames are decoded into
+  // recycled buffers instead of a new allocation per frame.
+
+  if (m_pPool)
+    info.dwFlags |= MFT_OUTPUT_STREAM_PROVIDES_SAMPLES;
+
   FrameSize size;
 
   info.cbSize = GetOutputBufferSize(size);
@@ -320,6 +386,14 @@ DWORD WebmMfVp8Dec::GetOutputBufferSize(FrameSize& s) const {
   const DWORD h = s.height;
   assert(h);
 
+  GUID subtype;
+
+  if ((m_pOutputMediaType != 0) &&
+      SUCCEEDED(m_pOutputMediaType->GetGUID(MF_MT_SUBTYPE, &subtype)) &&
+      (subtype == WebmTypes::MEDIASUBTYPE_Y800)) {
+    return w * h;
+  }
+
   const DWORD cb = w * h + 2 * (((w + 1) / 2) * ((h + 1) / 2));
 
   // TODO: this result does not account for stride
@@ -328,10 +402,16 @@ DWORD WebmMfVp8Dec::GetOutputBufferSize(FrameSize& s) const {
 }
 
 HRESULT WebmMfVp8Dec::GetAttributes(IMFAttributes** pp) {
-  if (pp)
-    *pp = 0;
+  if (pp == 0)
+    return E_POINTER;
 
-  return E_NOTIMPL;
+  *pp = m_pAttributes;
+
+  if (m_pAttributes == 0)
+    return E_NOTIMPL;
+
+  m_pAttributes->AddRef();
+  return S_OK;
 }
 
 HRESULT WebmMfVp8Dec::GetInputStreamAttributes(DWORD, IMFAttributes** pp) {
@@ -376,7 +456,7 @@ HRESULT WebmMfVp8Dec::GetInputAvailableType(DWORD dwInputStreamID,
   hr = pmt->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
   assert(SUCCEEDED(hr));
 
-  hr = pmt->SetGUID(MF_MT_SUBTYPE, WebmTypes::MEDIASUBTYPE_VP80);
+  hr = pmt->SetGUID(MF_MT_SUBTYPE, m_subtype);
   assert(SUCCEEDED(hr));
 
   hr = pmt->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, FALSE);
@@ -397,7 +477,7 @@ HRESULT WebmMfVp8Dec::GetOutputAvailableType(DWORD dwOutputStreamID,
   if (dwOutputStreamID != 0)
     return MF_E_INVALIDSTREAMNUMBER;
 
-  enum { subtype_count = 3 };
+  enum { subtype_count = 4 };
 
   if (dwTypeIndex >= subtype_count)
     return MF_E_NO_MORE_TYPES;
@@ -421,8 +501,11 @@ HRESULT WebmMfVp8Dec::GetOutputAvailableType(DWORD dwOutputStreamID,
   hr = pmt->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
   assert(SUCCEEDED(hr));
 
+  // Y800, luma only, is last: it is for analytics (motion detection, OCR),
+  // which ask for it by name. Its FOURCC GUID is the same in MF.
   const GUID subtypes[subtype_count] = {MFVideoFormat_NV12, MFVideoFormat_YV12,
-                                        MFVideoFormat_IYUV};
+                                        MFVideoFormat_IYUV,
+                                        WebmTypes::MEDIASUBTYPE_Y800};
 
   const GUID& subtype = subtypes[dwTypeIndex];
 
@@ -497,12 +580,10 @@ HRESULT WebmMfVp8Dec::SetInputType(DWORD dwInputStreamID, IMFMediaType* pmt,
       assert(n == 0);
 
       m_pInputMediaType = 0;
-
-      const vpx_codec_err_t e = vpx_codec_destroy(&m_ctx);
-      e;
-      assert(e == VPX_CODEC_OK);
     }
 
+    DestroyDecoder();
+
     if (m_pOutputMediaType) {
       const ULONG n = m_pOutputMediaType->Release();
       n;
@@ -533,7 +614,7 @@ HRESULT WebmMfVp8Dec::SetInputType(DWORD dwInputStreamID, IMFMediaType* pmt,
   if (FAILED(hr))
     return MF_E_INVALIDMEDIATYPE;
 
-  if (g != WebmTypes::MEDIASUBTYPE_VP80)
+  if (g != m_subtype)
     return MF_E_INVALIDMEDIATYPE;
 
   // hr = pmt->SetUINT32(MF_MT_COMPRESSED, FALSE);
@@ -576,9 +657,7 @@ HRESULT WebmMfVp8Dec::SetInputType(DWORD dwInputStreamID, IMFMediaType* pmt,
     hr = m_pInputMediaType->DeleteAllItems();
     assert(SUCCEEDED(hr));
 
-    const vpx_codec_err_t e = vpx_codec_destroy(&m_ctx);
-    e;
-    assert(e == VPX_CODEC_OK);
+    DestroyDecoder();
   } else {
     hr = MFCreateMediaType(&m_pInputMediaType);
 
@@ -593,21 +672,8 @@ HRESULT WebmMfVp8Dec::SetInputType(DWORD dwInputStreamID, IMFMediaType* pmt,
 
   // m_frame_rate = r;
 
-  // TODO: should this really be done here?
-
-  vpx_codec_iface_t& vp8 = vpx_codec_vp8_dx_algo;
-
-  const int flags = 0;  // TODO: VPX_CODEC_USE_POSTPROC;
-
-  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, &vp8, 0, flags);
-
-  if (err == VPX_CODEC_MEM_ERROR)
-    return E_OUTOFMEMORY;
-
-  if (err != VPX_CODEC_OK)
-    return E_FAIL;
-
-  // const HRESULT hr = OnApplyPostProcessing();
+  // The decoder itself is initialized when the first sample arrives
+  // (see InitDecoder).
 
   if (m_pOutputMediaType) {
     // TODO: Is this the correct behavior?
@@ -712,6 +778,8 @@ HRESULT WebmMfVp8Dec::SetOutputType(DWORD dwOutputStreamID, IMFMediaType* pmt,
     __noop;
   else if (g == MFVideoFormat_IYUV)
     __noop;
+  else if (g == WebmTypes::MEDIASUBTYPE_Y800)
+    __noop;
   else  // TODO: add I420 support
     return MF_E_INVALIDMEDIATYPE;
 
@@ -931,7 +999,7 @@ HRESULT WebmMfVp8Dec::ProcessEvent(DWORD dwInputStreamID,
   return E_NOTIMPL;  // TODO
 }
 
-HRESULT WebmMfVp8Dec::ProcessMessage(MFT_MESSAGE_TYPE m, ULONG_PTR) {
+HRESULT WebmMfVp8Dec::ProcessMessage(MFT_MESSAGE_TYPE m, ULONG_PTR param) {
 #if 0  // def _DEBUG
     odbgstream os;
     os << "WebmMfVp8Dec::ProcessMessage(samples.size="
@@ -966,7 +1034,7 @@ HRESULT WebmMfVp8Dec::ProcessMessage(MFT_MESSAGE_TYPE m, ULONG_PTR) {
             os << "SET_D3D" << endl;
 #endif
 
-      return S_OK;
+      return SetD3DManager(param);
 
     case MFT_MESSAGE_DROP_SAMPLES:
 #if 0  // def _DEBUG
@@ -982,8 +1050,10 @@ HRESULT WebmMfVp8Dec::ProcessMessage(MFT_MESSAGE_TYPE m, ULONG_PTR) {
 
       // http://msdn.microsoft.com/en-us/library/dd940421%28v=VS.85%29.aspx
 
-      // TODO: init decoder library here, instead of during SetInputType
+      // The decoder is initialized by the first ProcessInput, which comes
+      // after this (see InitDecoder).
 
+      ResetDecodeStats();
       return S_OK;
 
     case MFT_MESSAGE_NOTIFY_END_STREAMING:
@@ -1062,6 +1132,13 @@ HRESULT WebmMfVp8Dec::ProcessInput(DWORD dwInputStreamID, IMFSample* pSample,
   if (m_pOutputMediaType == 0)  // TODO: need this check here?
     return MF_E_TRANSFORM_TYPE_NOT_SET;
 
+  if (!m_bDecoderInit) {
+    hr = InitDecoder();
+
+    if (FAILED(hr))
+      return hr;
+  }
+
   pSample->AddRef();
 
   m_samples.push_back(SampleInfo());
@@ -1074,6 +1151,66 @@ HRESULT WebmMfVp8Dec::ProcessInput(DWORD dwInputStreamID, IMFSample* pSample,
   return S_OK;
 }
 
+HRESULT WebmMfVp8Dec::InitDecoder() {
+  assert(!m_bDecoderInit);
+  assert(m_pInputMediaType);
+
+  FrameSize s;
+
+  HRESULT hr = MFGetAttributeSize(m_pInputMediaType, MF_MT_FRAME_SIZE,
+                                  &s.width, &s.height);
+
+  if (FAILED(hr))  // checked by SetInputType
+    return MF_E_INVALIDMEDIATYPE;
+
+  vpx_codec_iface_t& vpx =
+      IsVp9() ? vpx_codec_vp9_dx_algo : vpx_codec_vp8_dx_algo;
+
+  const int flags = 0;  // TODO: VPX_CODEC_USE_POSTPROC;
+
+  UINT32 threads = 0;
+
+  if (m_pAttributes) {
+    hr = m_pAttributes->GetUINT32(WebmTypes::WebmMfVp8Dec_ThreadCount,
+                                  &threads);
+
+    if (FAILED(hr))
+      threads = 0;
+  }
+
+  webmdshow::VpxDecoderPool::Key& key = m_decoder_key;
+
+  key.iface = &vpx;
+  key.flags = flags;
+  key.threads = webmdshow::GetVpxDecoderThreadCount(
+      static_cast<int>(threads), IsVp9(), static_cast<int>(s.width));
+  key.width = static_cast<int>(s.width);
+  key.height = static_cast<int>(s.height);
+
+  webmdshow::VpxDecoderPool& pool = webmdshow::VpxDecoderPool::Get();
+  const vpx_codec_err_t err = pool.Borrow(key, &m_ctx);
+
+  if (err == VPX_CODEC_MEM_ERROR)
+    return E_OUTOFMEMORY;
+
+  if (err != VPX_CODEC_OK)
+    return E_FAIL;
+
+  // const HRESULT hr = OnApplyPostProcessing();
+
+  m_bDecoderInit = true;
+  return S_OK;
+}
+
+void WebmMfVp8Dec::DestroyDecoder() {
+  if (!m_bDecoderInit)
+    return;
+
+  webmdshow::VpxDecoderPool::Get().Return(m_decoder_key, &m_ctx);
+
+  m_bDecoderInit = false;
+}
+
 HRESULT WebmMfVp8Dec::ProcessOutput(DWORD dwFlags, DWORD cOutputBufferCount,
                                     MFT_OUTPUT_DATA_BUFFER* pOutputSamples,
                                     DWORD* pdwStatus) {
@@ -1102,15 +1239,53 @@ HRESULT WebmMfVp8Dec::ProcessOutput(DWORD dwFlags, DWORD cOutputBufferCount,
   if (pOutputSamples == 0)
     return E_INVALIDARG;
 
-  const MFT_OUTPUT_DATA_BUFFER& data = pOutputSamples[0];
+  MFT_OUTPUT_DATA_BUFFER& data = pOutputSamples[0];
   // data.dwStreamID should equal 0, but we ignore it
 
+  // We advertise PROVIDES_SAMPLES when the pool exists, but a sample
+  // supplied by the caller is still honored.
+
+  IMFSample* pSample = data.pSample;
+  const bool bPooled = (pSample == 0);
+
+  if (bPooled) {
+    if (m_pPool == 0)
+      return E_INVALIDARG;
+
+    if (m_samples.empty())
+      return MF_E_TRANSFORM_NEED_MORE_INPUT;
+
+    // If a texture cannot be had, decode into system memory instead.
+
+    hr = GetTextureSample(&pSample);
+
+    if (hr != S_OK) {
+      FrameSize size;
+
+      hr = m_pPool->GetSample(GetOutputBufferSize(size), &pSample);
+
+      if (FAILED(hr))
+        return hr;
+    }
+  }
+
   for (;;) {
-    hr = Decode(data.pSample);
+    hr = Decode(pSample);
 
     if (FAILED(hr) || (hr == S_OK))
-      return hr;
+      break;
+  }
+
+  PublishDecodeStats();
+
+  if (bPooled) {
+    if (hr == S_OK)
+      data.pSample = pSample;  // caller owns our reference
+    else
+      pSample->Release();  // back to the pool
   }
+
+  return hr;
 }
 
 HRESULT WebmMfVp8Dec::Decode(IMFSample* pSample_out) {
@@ -1161,7 +1336,7 @@ HRESULT WebmMfVp8Dec::Decode(IMFSample* pSample_out) {
 
     if (SUCCEEDED(hr) && (bPreroll != FALSE)) {
       // preroll frame
-      hr = i.DecodeAll(m_ctx);
+      hr = i.DecodeAll(m_ctx, m_decode_stats);
 
       i.pSample->Release();
       i.pSample = 0;
@@ -1175,7 +1350,21 @@ HRESULT WebmMfVp8Dec::Decode(IMFSample* pSample_out) {
       return S_FALSE;  // throw away this sample
     }
 
-    hr = i.DecodeOne(m_ctx, time, duration);
+    // A frame that is about to be thrown away need not be decoded,
+    // if no later frame refers to it.  This is what keeps fast-forward
+    // (where the drop mode is high) from decoding every frame.
+    //
+    // Not so for VP9: even a frame that refreshes no reference buffer
+    // leaves its motion vectors behind, which the next frame may predict
+    // from.  VP9 frames are always decoded, and dropped after.
+
+    if (!IsVp9() && IsDropDue(bKey) && i.IsDroppable()) {
+      hr = i.SkipOne();
+      ++m_decode_stats.skipped;
+    } else {
+      hr = i.DecodeOne(m_ctx, time, duration);
+      ++m_decode_stats.decoded;
+    }
 
     if (FAILED(hr) || (hr != S_OK)) {
       i.pSample->Release();
@@ -1233,11 +1422,20 @@ HRESULT WebmMfVp8Dec::Decode(IMFSample* pSample_out) {
   // the page "Uncompressed Video Buffers".
   // http://msdn.microsoft.com/en-us/library/aa473821%28v=VS.85%29.aspx
 
+  IMFDXGIBuffer* dxgi_out;
   IMF2DBuffer* buf2d_out;
 
-  hr = buf_out->QueryInterface(&buf2d_out);
+  if (SUCCEEDED(buf_out->QueryInterface(&dxgi_out))) {
+    assert(dxgi_out);
 
-  if (SUCCEEDED(hr)) {
+    const HRESULT hrGetFrame = GetFrame(dxgi_out);
+
+    dxgi_out->Release();
+    dxgi_out = 0;
+
+    if (FAILED(hrGetFrame) || (hrGetFrame != S_OK))
+      return hrGetFrame;
+  } else if (SUCCEEDED(buf_out->QueryInterface(&buf2d_out))) {
     assert(buf2d_out);
 
     BYTE* ptr_out;
@@ -1329,7 +1527,8 @@ HRESULT WebmMfVp8Dec::GetFrame(BYTE* pOutBuf, ULONG strideOut,
                                const GUID& subtype) {
   assert(pOutBuf);
   assert(strideOut);
-  assert((strideOut % 2) == 0);  // TODO: resolve this issue
+  assert(((strideOut % 2) == 0) ||
+         (subtype == WebmTypes::MEDIASUBTYPE_Y800));  // TODO: resolve this
 
   vpx_codec_iter_t iter = 0;
 
@@ -1338,18 +1537,69 @@ HRESULT WebmMfVp8Dec::GetFrame(BYTE* pOutBuf, ULONG strideOut,
   if (f == 0)  // alt-ref
     return S_FALSE;  // tell caller to pop this buffer and call me back
 
-  // Scale (if necessary).
+  // VP9 profiles 1 to 3 decode to other formats, which we don't convert.
+  if (f->fmt != VPX_IMG_FMT_I420)
+    return MF_E_UNSUPPORTED_FORMAT;
+
   FrameSize size;
   GetOutputBufferSize(size);
+
+  // Y800 has no chroma, so only the Y plane is copied, or scaled.
+  if (subtype == WebmTypes::MEDIASUBTYPE_Y800) {
+    if (f->d_h != size.height || f->d_w != size.width) {
+      if (!webmdshow::LibyuvScaleLuma(
+              f, pOutBuf, strideOut, size.width, size.height,
+              webmdshow::GetPlaybackScaleFilter(f->d_w, f->d_h, size.width,
+                                                size.height))) {
+        assert(false && "webmdshow::LibyuvScaleLuma failed");
+        return E_FAIL;
+      }
+    } else {
+      const BYTE* pInY = f->planes[VPX_PLANE_Y];
+      BYTE* pOut = pOutBuf;
+
+      for (unsigned int y = 0; y < f->d_h; ++y) {
+        memcpy(pOut, pInY, f->d_w);
+        pInY += f->stride[VPX_PLANE_Y];
+        pOut += strideOut;
+      }
+    }
+
+    const vpx_image_t* const f2 = vpx_codec_get_frame(&m_ctx, &iter);
+    f2;
+    assert(f2 == 0);
+
+    return S_OK;
+  }
+
+  // Scale (if necessary).
   if (f->d_h != size.height || f->d_w != size.width) {
-    if (!webmdshow::LibyuvScaleI420(size.width, size.height,
-                                    f, &m_scaled_image)) {
-      assert(false && "webmdshow::LibyuvScaleI420 failed");
+    m_scaler.set_filter(webmdshow::GetPlaybackScaleFilter(
+        f->d_w, f->d_h, size.width, size.height));
+
+    if (!m_scaler.Scale(size.width, size.height, f, &m_scaled_image)) {
+      assert(false && "webmdshow::LibyuvScaler::Scale failed");
       return E_FAIL;
     }
     f = m_scaled_image;
   }
 
+  if (subtype == MFVideoFormat_NV12) {
+    BYTE* const pOutUV = pOutBuf + strideOut * f->d_h;
+
+    if (!webmdshow::LibyuvI420ToNV12(f, pOutBuf, strideOut,
+                                     pOutUV, strideOut)) {
+      assert(false && "webmdshow::LibyuvI420ToNV12 failed");
+      return E_FAIL;
+    }
+
+    const vpx_image_t* const f2 = vpx_codec_get_frame(&m_ctx, &iter);
+    f2;
+    assert(f2 == 0);
+
+    return S_OK;
+  }
+
   // Y
 
   const BYTE* pInY = f->planes[VPX_PLANE_Y];
@@ -1381,23 +1631,7 @@ HRESULT WebmMfVp8Dec::GetFrame(BYTE* pOutBuf, ULONG strideOut,
   wIn = (wIn + 1) / 2;
   hIn = (hIn + 1) / 2;
 
-  if (subtype == MFVideoFormat_NV12) {
-    for (unsigned int y = 0; y < hIn; ++y) {
-      const BYTE* u = pInU;  // src
-      const BYTE* v = pInV;  // src
-      BYTE* uv = pOut;  // dst
-
-      for (unsigned int idx = 0; idx < wIn; ++idx)  // uv
-      {
-        *uv++ = *u++;  // Cb
-        *uv++ = *v++;  // Cr
-      }
-
-      pInU += strideInU;
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  } else if (subtype == MFVideoFormat_YV12) {
+  if (subtype == MFVideoFormat_YV12) {
     strideOut /= 2;
 
     // V
@@ -1610,6 +1844,234 @@ HRESULT WebmMfVp8Dec::GetService(REFGUID sid, REFIID iid, LPVOID* ppv) {
   return MF_E_UNSUPPORTED_SERVICE;
 }
 
+HRESULT WebmMfVp8Dec::GetFrame(IMFDXGIBuffer* pBuffer) {
+  ID3D11Texture2DPtr pTexture;
+
+  HRESULT hr = pBuffer->GetResource(__uuidof(ID3D11Texture2D),
+                                    reinterpret_cast<void**>(&pTexture));
+
+  if (FAILED(hr))
+    return hr;
+
+  UINT subresource;
+
+  hr = pBuffer->GetSubresourceIndex(&subresource);
+
+  if (FAILED(hr))
+    return hr;
+
+  D3D11_TEXTURE2D_DESC desc;
+  pTexture->GetDesc(&desc);
+
+  if (desc.Format != DXGI_FORMAT_NV12)
+    return E_INVALIDARG;
+
+  ID3D11DevicePtr pDevice;
+  pTexture->GetDevice(&pDevice);
+
+  if (m_pStaging) {
+    D3D11_TEXTURE2D_DESC staging_desc;
+    m_pStaging->GetDesc(&staging_desc);
+
+    ID3D11DevicePtr pStagingDevice;
+    m_pStaging->GetDevice(&pStagingDevice);
+
+    if ((pStagingDevice != pDevice) || (staging_desc.Width != desc.Width) ||
+        (staging_desc.Height != desc.Height)) {
+      m_pStaging->Release();
+      m_pStaging = 0;
+    }
+  }
+
+  if (m_pStaging == 0) {
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = 0;
+
+    hr = pDevice->CreateTexture2D(&desc, 0, &m_pStaging);
+
+    if (FAILED(hr)) {
+      m_pStaging = 0;
+      return hr;
+    }
+  }
+
+  // The immediate context is not thread-safe.  Locking the device
+  // through the manager serializes us with the renderer.
+
+  if (m_pDeviceManager) {
+    void* pv;
+
+    hr = m_pDeviceManager->LockDevice(m_hDevice, __uuidof(ID3D11Device), &pv,
+                                      TRUE);
+
+    if (FAILED(hr))
+      return hr;
+
+    static_cast<IUnknown*>(pv)->Release();
+  }
+
+  ID3D11DeviceContextPtr pContext;
+  pDevice->GetImmediateContext(&pContext);
+
+  // The mapped staging texture has the NV12 layout that GetFrame writes:
+  // the interleaved UV plane follows the Y plane, at the same pitch.
+
+  D3D11_MAPPED_SUBRESOURCE mapped;
+
+  HRESULT hrGetFrame =
+      pContext->Map(m_pStaging, 0, D3D11_MAP_WRITE, 0, &mapped);
+
+  if (SUCCEEDED(hrGetFrame)) {
+    hrGetFrame = GetFrame(static_cast<BYTE*>(mapped.pData), mapped.RowPitch,
+                          MFVideoFormat_NV12);
+
+    pContext->Unmap(m_pStaging, 0);
+
+    if (hrGetFrame == S_OK)
+      pContext->CopySubresourceRegion(pTexture, subresource, 0, 0, 0,
+                                      m_pStaging, 0, 0);
+  }
+
+  if (m_pDeviceManager) {
+    hr = m_pDeviceManager->UnlockDevice(m_hDevice, FALSE);
+    assert(SUCCEEDED(hr));
+  }
+
+  return hrGetFrame;
+}
+
+HRESULT WebmMfVp8Dec::SetD3DManager(ULONG_PTR param) {
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  ReleaseD3D();
+
+  if (param == 0)  // back to system memory
+    return S_OK;
+
+  if ((m_pPool == 0) || !m_pPool->SupportsTextures())
+    return E_NOTIMPL;
+
+  IUnknown* const pUnk = reinterpret_cast<IUnknown*>(param);
+
+  // We advertise MF_SA_D3D_AWARE=FALSE, so we should never be given
+  // a D3D9 manager.
+
+  hr = pUnk->QueryInterface(&m_pDeviceManager);
+
+  if (FAILED(hr)) {
+    m_pDeviceManager = 0;
+    return hr;
+  }
+
+  hr = m_pDeviceManager->OpenDeviceHandle(&m_hDevice);
+
+  if (FAILED(hr)) {
+    m_hDevice = 0;
+    ReleaseD3D();
+    return hr;
+  }
+
+  return S_OK;
+}
+
+void WebmMfVp8Dec::ReleaseD3D() {
+  if (m_pStaging) {
+    m_pStaging->Release();
+    m_pStaging = 0;
+  }
+
+  if (m_pDeviceManager) {
+    if (m_hDevice) {
+      const HRESULT hr = m_pDeviceManager->CloseDeviceHandle(m_hDevice);
+      hr;
+      assert(SUCCEEDED(hr));
+
+      m_hDevice = 0;
+    }
+
+    m_pDeviceManager->Release();
+    m_pDeviceManager = 0;
+  }
+}
+
+HRESULT WebmMfVp8Dec::GetD3DDevice(ID3D11Device** pp) {
+  // MFT was already locked by caller
+
+  void* pv;
+
+  HRESULT hr = m_pDeviceManager->GetVideoService(
+      m_hDevice, __uuidof(ID3D11Device), &pv);
+
+  if (hr == MF_E_DXGI_NEW_VIDEO_DEVICE) {
+    // The manager has been given a new device.  Samples on the old
+    // device are discarded by the pool as they come back.
+
+    hr = m_pDeviceManager->CloseDeviceHandle(m_hDevice);
+    assert(SUCCEEDED(hr));
+
+    m_hDevice = 0;
+
+    if (m_pStaging) {
+      m_pStaging->Release();
+      m_pStaging = 0;
+    }
+
+    hr = m_pDeviceManager->OpenDeviceHandle(&m_hDevice);
+
+    if (FAILED(hr)) {
+      m_hDevice = 0;
+      return hr;
+    }
+
+    hr = m_pDeviceManager->GetVideoService(m_hDevice, __uuidof(ID3D11Device),
+                                           &pv);
+  }
+
+  if (FAILED(hr))
+    return hr;
+
+  *pp = static_cast<ID3D11Device*>(pv);
+  return S_OK;
+}
+
+HRESULT WebmMfVp8Dec::GetTextureSample(IMFSample** pp) {
+  // MFT was already locked by caller
+
+  if (m_pDeviceManager == 0)
+    return S_FALSE;
+
+  GUID subtype;
+
+  HRESULT hr = m_pOutputMediaType->GetGUID(MF_MT_SUBTYPE, &subtype);
+  assert(SUCCEEDED(hr));
+
+  if (subtype != MFVideoFormat_NV12)  // textures are NV12 only
+    return S_FALSE;
+
+  ID3D11DevicePtr pDevice;
+
+  hr = GetD3DDevice(&pDevice);
+
+  if (FAILED(hr))
+    return hr;
+
+  FrameSize size;
+  GetOutputBufferSize(size);
+
+  return m_pPool->GetTextureSample(pDevice, size.width, size.height, pp);
+}
+
 void WebmMfVp8Dec::Flush() {
   while (!m_samples.empty()) {
     SampleInfo& i = m_samples.front();
@@ -1622,7 +2084,8 @@ void WebmMfVp8Dec::Flush() {
   }
 }
 
-HRESULT WebmMfVp8Dec::SampleInfo::DecodeAll(vpx_codec_ctx_t& ctx) {
+HRESULT WebmMfVp8Dec::SampleInfo::DecodeAll(vpx_codec_ctx_t& ctx,
+                                            DecodeStats& stats) {
   assert(pSample);
 
   DWORD count;
@@ -1646,7 +2109,18 @@ HRESULT WebmMfVp8Dec::SampleInfo::DecodeAll(vpx_codec_ctx_t& ctx) {
     assert(ptr);
     assert(len);
 
-    const vpx_codec_err_t e = vpx_codec_decode(&ctx, ptr, len, 0, 0);
+    // Preroll frames are never rendered, so only the frames that
+    // later frames refer to need to be decoded.
+
+    webmdshow::Vp8FrameInfo info;
+    vpx_codec_err_t e = VPX_CODEC_OK;
+
+    if (webmdshow::ParseVp8FrameInfo(ptr, len, &info) && info.droppable) {
+      ++stats.skipped;
+    } else {
+      e = vpx_codec_decode(&ctx, ptr, len, 0, 0);
+      ++stats.decoded;
+    }
 
     hr = buf->Unlock();
     assert(SUCCEEDED(hr));
@@ -1660,6 +2134,48 @@ HRESULT WebmMfVp8Dec::SampleInfo::DecodeAll(vpx_codec_ctx_t& ctx) {
   return S_OK;
 }
 
+HRESULT WebmMfVp8Dec::SampleInfo::SkipOne() {
+  assert(pSample);
+
+  DWORD count;
+
+  const HRESULT hr = pSample->GetBufferCount(&count);
+  hr;
+  assert(SUCCEEDED(hr));
+  assert(count > dwBuffer);
+
+  ++dwBuffer;  // consume this buffer, without decoding it
+  return (dwBuffer >= count) ? S_FALSE : S_OK;
+}
+
+bool WebmMfVp8Dec::SampleInfo::IsDroppable() const {
+  assert(pSample);
+
+  IMFMediaBufferPtr buf;
+
+  HRESULT hr = pSample->GetBufferByIndex(dwBuffer, &buf);
+
+  if (FAILED(hr))
+    return false;
+
+  BYTE* ptr;
+  DWORD len;
+
+  hr = buf->Lock(&ptr, 0, &len);
+
+  if (FAILED(hr))
+    return false;
+
+  webmdshow::Vp8FrameInfo info;
+  const bool bDroppable =
+      webmdshow::ParseVp8FrameInfo(ptr, len, &info) && info.droppable;
+
+  hr = buf->Unlock();
+  assert(SUCCEEDED(hr));
+
+  return bDroppable;
+}
+
 HRESULT WebmMfVp8Dec::SampleInfo::DecodeOne(vpx_codec_ctx_t& ctx,
                                             LONGLONG& time,
                                             LONGLONG& duration) {
@@ -1804,6 +2320,42 @@ void WebmMfVp8Dec::ReplenishDropBudget() {
   m_drop_budget = (1 << (5 - d));
 }
 
+bool WebmMfVp8Dec::IsVp9() const {
+  return (m_subtype == WebmTypes::MEDIASUBTYPE_VP90);
+}
+
+bool WebmMfVp8Dec::IsDropDue(bool bKey) const {
+  // Must agree with the drop logic in Decode.
+
+  if (bKey || (m_drop_mode == MF_DROP_MODE_NONE))
+    return false;
+
+  if (m_drop_mode >= MF_DROP_MODE_5)
+    return true;
+
+  return (m_drop_budget <= 1);
+}
+
+void WebmMfVp8Dec::ResetDecodeStats() {
+  m_decode_stats.decoded = 0;
+  m_decode_stats.skipped = 0;
+
+  PublishDecodeStats();
+}
+
+void WebmMfVp8Dec::PublishDecodeStats() {
+  if (m_pAttributes == 0)
+    return;
+
+  HRESULT hr = m_pAttributes->SetUINT64(WebmTypes::WebmMfVp8Dec_FramesDecoded,
+                                        m_decode_stats.decoded);
+  assert(SUCCEEDED(hr));
+
+  hr = m_pAttributes->SetUINT64(WebmTypes::WebmMfVp8Dec_FramesSkipped,
+                                m_decode_stats.skipped);
+  assert(SUCCEEDED(hr));
+}
+
 HRESULT WebmMfVp8Dec::SetQualityLevel(MF_QUALITY_LEVEL q) {
   if (q == MF_QUALITY_NORMAL)
     return S_OK;
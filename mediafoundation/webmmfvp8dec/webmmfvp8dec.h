@@ -9,6 +9,7 @@
 #ifndef WEBMDSHOW_MEDIAFOUNDATION_WEBMMFVP8DEC_WEBMMFVP8DEC_H_
 #define WEBMDSHOW_MEDIAFOUNDATION_WEBMMFVP8DEC_WEBMMFVP8DEC_H_
 
+#include <d3d11.h>
 #include <mfapi.h>
 #include <mferror.h>
 #include <mfidl.h>
@@ -19,10 +20,16 @@
 #include "vpx/vp8dx.h"
 
 #include "clockable.h"
+#include "libyuv_util.h"
+#include "samplepool.h"
+#include "vpxdecoderpool.h"
 #include "webmtypes.h"
 
 namespace WebmMfVp8DecLib {
 
+// Decodes VP8 (CLSID_WebmMfVp8Dec) or VP9 (CLSID_WebmMfVp9Dec) with
+// libvpx. The codec is fixed when the transform is created, and is the
+// only input subtype it accepts.
 class WebmMfVp8Dec : public IMFTransform,
                      // public IVP8PostProcessing,  //TODO
                      // public IMFQualityAdvise,
@@ -32,6 +39,8 @@ class WebmMfVp8Dec : public IMFTransform,
                      public IMFGetService,
                      public CLockable {
   friend HRESULT CreateDecoder(IClassFactory*, IUnknown*, const IID&, void**);
+  friend HRESULT CreateVp9Decoder(IClassFactory*, IUnknown*, const IID&,
+                                  void**);
 
   WebmMfVp8Dec(const WebmMfVp8Dec&);
   WebmMfVp8Dec& operator=(const WebmMfVp8Dec&);
@@ -151,12 +160,19 @@ class WebmMfVp8Dec : public IMFTransform,
   HRESULT STDMETHODCALLTYPE GetService(REFGUID, REFIID, LPVOID*);
 
  private:
-  explicit WebmMfVp8Dec(IClassFactory*);
+  WebmMfVp8Dec(IClassFactory*, const GUID& subtype);
   virtual ~WebmMfVp8Dec();
 
+  static HRESULT CreateInstance(IClassFactory*, IUnknown*,
+                                const GUID& subtype, const IID&, void**);
+
   IClassFactory* const m_pClassFactory;
   LONG m_cRef;
 
+  // WebmTypes::MEDIASUBTYPE_VP80 or MEDIASUBTYPE_VP90.
+  const GUID m_subtype;
+  bool IsVp9() const;
+
   struct FrameSize {
     UINT32 width;
     UINT32 height;
@@ -179,19 +195,65 @@ class WebmMfVp8Dec : public IMFTransform,
   IMFMediaType* m_pInputMediaType;
   IMFMediaType* m_pOutputMediaType;
 
+  // Frames passed to the decoder, and frames that were due to be dropped
+  // and that no later frame depends on, which are not decoded at all.
+  // Published as the WebmMfVp8Dec_FramesDecoded and _FramesSkipped
+  // attributes, and reset when streaming begins.
+  struct DecodeStats {
+    UINT64 decoded;
+    UINT64 skipped;
+  };
+
+  DecodeStats m_decode_stats;
+  void ResetDecodeStats();
+  void PublishDecodeStats();
+
   struct SampleInfo {
     IMFSample* pSample;
     DWORD dwBuffer;
 
-    HRESULT DecodeAll(vpx_codec_ctx_t&);
+    HRESULT DecodeAll(vpx_codec_ctx_t&, DecodeStats&);
     HRESULT DecodeOne(vpx_codec_ctx_t&, LONGLONG&, LONGLONG&);
+    HRESULT SkipOne();
+    bool IsDroppable() const;
   };
 
   typedef std::list<SampleInfo> samples_t;
   samples_t m_samples;
 
+  // The context is initialized on the first ProcessInput, not when the
+  // input type is set: the shell sets the types of decoders it never
+  // feeds (to read a file's properties, say), and should not pay for the
+  // libvpx setup, or for its threads. It is borrowed from the module's
+  // pool, for m_decoder_key, and goes back to it when destroyed.
   vpx_codec_ctx_t m_ctx;
+  webmdshow::VpxDecoderPool::Key m_decoder_key;
+  bool m_bDecoderInit;
+  HRESULT InitDecoder();
+  void DestroyDecoder();
+
   vpx_image_t* m_scaled_image;
+  webmdshow::LibyuvScaler m_scaler;  // split over the shared TaskPool
+
+  // Returned by GetAttributes.  The client sets
+  // WebmTypes::WebmMfVp8Dec_ThreadCount here before the input type is
+  // set; 0 (or absent) means choose from the processor count.
+  IMFAttributes* m_pAttributes;
+
+  // Non-null when the decoder provides its own output samples.
+  SamplePool* m_pPool;
+
+  // Set by MFT_MESSAGE_SET_D3D_MANAGER.  When present, and the output
+  // type is NV12, pooled samples are textures on the manager's device,
+  // filled from m_pStaging.
+  IMFDXGIDeviceManager* m_pDeviceManager;
+  HANDLE m_hDevice;
+  ID3D11Texture2D* m_pStaging;
+
+  HRESULT SetD3DManager(ULONG_PTR);
+  void ReleaseD3D();
+  HRESULT GetD3DDevice(ID3D11Device**);
+  HRESULT GetTextureSample(IMFSample**);
 
   float m_rate;  // trick-play mode
   BOOL m_bThin;
@@ -200,6 +262,7 @@ class WebmMfVp8Dec : public IMFTransform,
   int m_drop_budget;
   int m_drop_late;
   void ReplenishDropBudget();
+  bool IsDropDue(bool bKey) const;
 
   // struct LagInfo
   //{
@@ -218,6 +281,7 @@ class WebmMfVp8Dec : public IMFTransform,
   DWORD GetOutputBufferSize(FrameSize&) const;
   HRESULT Decode(IMFSample*);
   HRESULT GetFrame(BYTE*, ULONG, const GUID&);
+  HRESULT GetFrame(IMFDXGIBuffer*);
 
   void Flush();
 };
@@ -14,8 +14,10 @@
 #include <evcode.h>
 #include "hrtext.h"
 #include "mediatypeutil.h"
+#include "ipipelinecounters.h"
 #include <string>
 #include <sstream>
+#include <vector>
 using std::hex;
 using std::dec;
 using std::wcout;
@@ -29,6 +31,13 @@ using GraphUtil::FindOutpinAudio;
 using GraphUtil::FindInpinVideo;
 using GraphUtil::FindInpinAudio;
 
+_COM_SMARTPTR_TYPEDEF(IPipelineCounters, __uuidof(IPipelineCounters));
+
+// qedit.h, which declares it, is no longer part of the SDK.
+static const CLSID CLSID_NullRenderer = {
+    0xC1F400A4, 0x3F08, 0x11D3, {0x9F, 0x0B, 0x00, 0x60, 0x08, 0x03, 0x9E,
+                                 0x37}};
+
 App::App(HANDLE hQuit) : m_hQuit(hQuit) {
   assert(m_hQuit);
 }
@@ -272,6 +281,13 @@ int App::BuildGraph() {
     }
   }
 
+  if (m_cmdline.GetNullRender()) {
+    const int status = NullRender();
+
+    if (status)
+      return status;
+  }
+
 #if 0
     hr = pBuilder->SetLogFile(0);
     assert(SUCCEEDED(hr));
@@ -286,6 +302,106 @@ int App::BuildGraph() {
   return 0;  // success
 }
 
+// Replaces each renderer, a filter with connected inpins and no outpins,
+// with a null renderer, and takes the clock away from the graph, so that
+// samples are delivered as fast as the splitter and decoders produce them.
+int App::NullRender() {
+  const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+  assert(bool(pBuilder));
+
+  std::vector<IBaseFilterPtr> renderers;
+  std::vector<IPinPtr> outpins;
+
+  GraphUtil::IEnumFiltersPtr ef;
+
+  HRESULT hr = m_pGraph->EnumFilters(&ef);
+  assert(SUCCEEDED(hr));
+
+  for (;;) {
+    IBaseFilterPtr filter;
+
+    hr = ef->Next(1, &filter, 0);
+
+    if (hr != S_OK)
+      break;
+
+    if (GraphUtil::OutpinCount(filter) != 0)
+      continue;
+
+    GraphUtil::IEnumPinsPtr ep;
+
+    hr = filter->EnumPins(&ep);
+    assert(SUCCEEDED(hr));
+
+    size_t n = 0;
+
+    for (;;) {
+      IPinPtr pin;
+
+      hr = ep->Next(1, &pin, 0);
+
+      if (hr != S_OK)
+        break;
+
+      IPinPtr outpin;
+
+      hr = pin->ConnectedTo(&outpin);
+
+      if (FAILED(hr) || !bool(outpin))
+        continue;
+
+      outpins.push_back(outpin);
+      ++n;
+    }
+
+    if (n > 0)
+      renderers.push_back(filter);
+  }
+
+  // Removing a filter disconnects its pins.
+  for (size_t i = 0; i < renderers.size(); ++i) {
+    hr = m_pGraph->RemoveFilter(renderers[i]);
+    assert(SUCCEEDED(hr));
+  }
+
+  for (size_t i = 0; i < outpins.size(); ++i) {
+    IBaseFilterPtr pNull;
+
+    hr = pNull.CreateInstance(CLSID_NullRenderer);
+
+    if (FAILED(hr)) {
+      wcout << "Unable to create Null Renderer filter instance.\n"
+            << hrtext(hr) << L" (0x" << hex << hr << dec << L")" << endl;
+
+      return 1;
+    }
+
+    std::wostringstream os;
+    os << L"null renderer " << i;
+
+    hr = m_pGraph->AddFilter(pNull, os.str().c_str());
+    assert(SUCCEEDED(hr));
+
+    const IPinPtr pInpin(GraphUtil::FindInpin(pNull));
+    assert(bool(pInpin));
+
+    hr = pBuilder->Connect(outpins[i], pInpin);
+
+    if (FAILED(hr)) {
+      RenderFailed(outpins[i], hr);
+      return 1;
+    }
+  }
+
+  const GraphUtil::IMediaFilterPtr pMediaFilter(m_pGraph);
+  assert(bool(pMediaFilter));
+
+  hr = pMediaFilter->SetSyncSource(0);
+  assert(SUCCEEDED(hr));
+
+  return 0;
+}
+
 void App::DestroyGraph() {
   if (IFilterGraph* pGraph = m_pGraph.Detach()) {
     const ULONG n = pGraph->Release();
@@ -314,6 +430,20 @@ int App::RunGraph() {
   const GraphUtil::IMediaControlPtr pControl(m_pGraph);
   assert(bool(pControl));
 
+  const bool bBenchmark = m_cmdline.GetBenchmark();
+
+  // Pausing first lets the graph queue its first samples untimed.
+  if (bBenchmark) {
+    hr = pControl->Pause();
+    assert(SUCCEEDED(hr));
+
+    OAFilterState state;
+    hr = pControl->GetState(INFINITE, &state);
+    assert(SUCCEEDED(hr));
+  }
+
+  const int64_t start_us = webmdshow::PipelineCounters::Now();
+
   hr = pControl->Run();
   assert(SUCCEEDED(hr));
 
@@ -359,14 +489,127 @@ int App::RunGraph() {
       break;
   }
 
+  const int64_t elapsed_us = webmdshow::PipelineCounters::Now() - start_us;
+
   wcout << endl;
 
   hr = pControl->Stop();
   assert(SUCCEEDED(hr));
 
+  if (bBenchmark)
+    PrintBenchmark(elapsed_us);
+
   return 0;
 }
 
+// Returns the upper bound, in us, of the histogram bucket holding the
+// |percent|th percentile of |stats|' processing times, or -1 if none were
+// recorded. The last bucket has no bound, and reports its lower one.
+static int64_t GetPercentile(const webmdshow::PipelineCounters::Stats& stats,
+                             int percent) {
+  enum { kBuckets = webmdshow::PipelineCounters::kHistogramBuckets };
+
+  int64_t total = 0;
+
+  for (int i = 0; i < kBuckets; ++i)
+    total += stats.histogram[i];
+
+  if (total <= 0)
+    return -1;
+
+  const int64_t rank = (total * percent + 99) / 100;  // at least 1
+  int64_t count = 0;
+
+  for (int i = 0; i < kBuckets - 1; ++i) {
+    count += stats.histogram[i];
+
+    if (count >= rank)
+      return int64_t(1) << i;
+  }
+
+  return int64_t(1) << (kBuckets - 2);
+}
+
+static int64_t ToMicroseconds(const FILETIME& ft) {
+  ULARGE_INTEGER t;
+  t.LowPart = ft.dwLowDateTime;
+  t.HighPart = ft.dwHighDateTime;
+
+  return t.QuadPart / 10;  // 100 ns units
+}
+
+// Prints a line per stage of every filter in the graph that exposes
+// IPipelineCounters: its frame rate over the run, the 50th, 90th and 99th
+// percentiles of its per-frame processing time, and its busy time, which
+// is CPU time spent on the stream's behalf. The process' CPU time follows.
+void App::PrintBenchmark(int64_t elapsed_us) const {
+  using webmdshow::PipelineCounters;
+
+  const double seconds = double(elapsed_us) / 1e6;
+
+  wcout << L"elapsed    : " << std::fixed << std::setprecision(3) << seconds
+        << L" s\n";
+
+  GraphUtil::IEnumFiltersPtr ef;
+
+  HRESULT hr = m_pGraph->EnumFilters(&ef);
+  assert(SUCCEEDED(hr));
+
+  for (;;) {
+    IBaseFilterPtr filter;
+
+    hr = ef->Next(1, &filter, 0);
+
+    if (hr != S_OK)
+      break;
+
+    const IPipelineCountersPtr pCounters(filter);
+
+    if (!bool(pCounters))
+      continue;
+
+    ULONG n;
+
+    hr = pCounters->GetStageCount(&n);
+
+    if (FAILED(hr))
+      continue;
+
+    for (ULONG i = 0; i < n; ++i) {
+      PipelineCounters::Stats stats;
+
+      hr = pCounters->GetStage(i, &stats);
+
+      if (FAILED(hr))
+        continue;
+
+      const double fps = (seconds > 0) ? stats.samples_out / seconds : 0;
+
+      wcout << std::left << std::setw(24) << stats.name << std::right
+            << L" frames " << stats.samples_out << L" (" << std::setprecision(1)
+            << fps << L"/s)"
+            << L" p50 " << GetPercentile(stats, 50) << L" us"
+            << L" p90 " << GetPercentile(stats, 90) << L" us"
+            << L" p99 " << GetPercentile(stats, 99) << L" us"
+            << L" busy " << std::setprecision(3) << stats.busy_us / 1e6
+            << L" s" << L" dropped " << stats.dropped << L'\n';
+    }
+  }
+
+  FILETIME creation, exit, kernel, user;
+
+  if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+    const int64_t cpu_us = ToMicroseconds(kernel) + ToMicroseconds(user);
+
+    wcout << L"process cpu: " << std::setprecision(3) << cpu_us / 1e6
+          << L" s (" << std::setprecision(1)
+          << ((elapsed_us > 0) ? 100.0 * cpu_us / elapsed_us : 0)
+          << L"% of elapsed)\n";
+  }
+
+  wcout << endl;
+}
+
 void App::RenderFailed(IPin* pin, HRESULT hrRender) {
   assert(pin);
 
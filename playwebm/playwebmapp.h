@@ -13,6 +13,7 @@
 #include <comdef.h>
 #include <control.h>
 #include <uuids.h>
+#include <stdint.h>
 #include "graphutil.h"
 #include "playwebmcmdline.h"
 
@@ -30,7 +31,9 @@ class App {
   GraphUtil::IFilterGraphPtr m_pGraph;
 
   int BuildGraph();
+  int NullRender();
   int RunGraph();
+  void PrintBenchmark(int64_t elapsed_us) const;
   void DestroyGraph();
   static void RenderFailed(IPin*, HRESULT);
 };
@@ -30,7 +30,9 @@ CmdLine::CmdLine()
       m_bVersion(false),
       m_pSplitter(0),
       m_pSource(0),
-      m_bVerbose(false) {}
+      m_bVerbose(false),
+      m_bNullRender(false),
+      m_bBenchmark(false) {}
 
 int CmdLine::Parse(int argc, wchar_t* argv[]) {
   m_argv = argv;
@@ -298,6 +300,27 @@ int CmdLine::ParseWindows(wchar_t** i) {
     return 1;
   }
 
+  if (_wcsnicmp(arg, L"null-render", len) == 0) {
+    if (*end == L':') {
+      wcout << "Null-render option does not accept a value." << endl;
+      return -1;  // error
+    }
+
+    m_bNullRender = true;
+    return 1;
+  }
+
+  if (_wcsnicmp(arg, L"benchmark", len) == 0) {
+    if (*end == L':') {
+      wcout << "Benchmark option does not accept a value." << endl;
+      return -1;  // error
+    }
+
+    m_bNullRender = true;
+    m_bBenchmark = true;
+    return 1;
+  }
+
   if ((wcsncmp(arg, L"?", len) == 0) || (_wcsnicmp(arg, L"help", len) == 0)) {
     if (*end == L':') {
       wcout << "Help option does not accept a value." << endl;
@@ -563,6 +586,43 @@ int CmdLine::ParseShort(wchar_t** i) {
       m_bList = true;
       return 1;
 
+    case L'n':
+    case L'N':
+      if (*(arg + 1) != L'\0') {
+        const size_t len = wcslen(arg);
+
+        if (_wcsnicmp(arg, L"null-render", len) != 0) {
+          wcout << L"Unknown switch: " << *i << L"\nIf null rendering was "
+                                                L"desired, specify the -n or "
+                                                L"--null-render switches."
+                << endl;
+
+          return -1;  // error
+        }
+      }
+
+      m_bNullRender = true;
+      return 1;
+
+    case L'b':
+    case L'B':
+      if (*(arg + 1) != L'\0') {
+        const size_t len = wcslen(arg);
+
+        if (_wcsnicmp(arg, L"benchmark", len) != 0) {
+          wcout << L"Unknown switch: " << *i << L"\nIf a benchmark was "
+                                                L"desired, specify the -b or "
+                                                L"--benchmark switches."
+                << endl;
+
+          return -1;  // error
+        }
+      }
+
+      m_bNullRender = true;
+      m_bBenchmark = true;
+      return 1;
+
     case L'V':
       if (*(arg + 1) != L'\0') {
         const size_t len = wcslen(arg);
@@ -766,6 +826,27 @@ int CmdLine::ParseLong(wchar_t** i) {
     return 1;
   }
 
+  if (_wcsnicmp(arg, L"null-render", len) == 0) {
+    if (*end == L'=') {
+      wcout << L"Null-render switch does not accept a value." << endl;
+      return -1;  // error
+    }
+
+    m_bNullRender = true;
+    return 1;
+  }
+
+  if (_wcsnicmp(arg, L"benchmark", len) == 0) {
+    if (*end == L'=') {
+      wcout << L"Benchmark switch does not accept a value." << endl;
+      return -1;  // error
+    }
+
+    m_bNullRender = true;
+    m_bBenchmark = true;
+    return 1;
+  }
+
   if (_wcsnicmp(arg, L"verbose", len) == 0) {
     if (*end == L'=') {
       wcout << L"Verbose switch does not accept a value." << endl;
@@ -802,6 +883,10 @@ bool CmdLine::GetList() const { return m_bList; }
 
 bool CmdLine::GetVerbose() const { return m_bVerbose; }
 
+bool CmdLine::GetNullRender() const { return m_bNullRender; }
+
+bool CmdLine::GetBenchmark() const { return m_bBenchmark; }
+
 void CmdLine::PrintVersion() const {
   wcout << "playwebm ";
 
@@ -822,6 +907,8 @@ void CmdLine::PrintUsage() const {
   wcout << L"  -i, --input       input filename\n"
         << L"  -s, --source      use source filter\n"
         << L"  -S, --splitter    use splitter filter\n"
+        << L"  -n, --null-render render to null renderers, unclocked\n"
+        << L"  -b, --benchmark   null-render, and report throughput\n"
         << L"  -l, --list        print switch values, but do not run app\n"
         << L"  -v, --verbose     print verbose list or usage info\n"
         << L"  -V, --version     print version information\n"
@@ -838,6 +925,12 @@ void CmdLine::PrintUsage() const {
           << L"If neither the source switch nor the splitter switch is\n"
           << L"specified, then the graph is constructed by calling\n"
           << L"IGraphBuilder::RenderFile.\n" << L'\n'
+          << L"With --null-render, each stream is rendered to a null\n"
+          << L"renderer and the graph runs without a clock, as fast as its\n"
+          << L"filters allow. --benchmark does the same and, at the end of\n"
+          << L"the run, prints the frame rate, the processing time\n"
+          << L"percentiles and the busy time of each stage, and the CPU\n"
+          << L"time of the process.\n" << L'\n'
           << L"The input filename must be specified, as either\n"
           << L"a switch value or as a command-line argument.\n" << L'\n'
           << L"Note that the order of appearance of switches and arguments\n"
@@ -881,6 +974,12 @@ void CmdLine::ListArgs() const {
     wcout << L'\n';
   }
 
+  if (m_bNullRender)
+    wcout << L"null-render: true\n";
+
+  if (m_bBenchmark)
+    wcout << L"benchmark  : true\n";
+
   wcout << endl;
 }
 
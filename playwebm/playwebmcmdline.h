@@ -25,6 +25,8 @@ class CmdLine {
   const CLSID* GetSource() const;
   bool GetList() const;
   bool GetVerbose() const;
+  bool GetNullRender() const;
+  bool GetBenchmark() const;
 
  private:
   const wchar_t* const* m_argv;  // unpermutated
@@ -32,6 +34,8 @@ class CmdLine {
   bool m_bList;
   bool m_bVerbose;
   bool m_bVersion;
+  bool m_bNullRender;
+  bool m_bBenchmark;
   const wchar_t* m_input;
   const CLSID* m_pSplitter;
   const CLSID* m_pSource;
@@ -40,6 +40,7 @@ readonly DSHOW_RCFILES="makewebm
                         webmsource
                         webmsplit
                         webmcc
+                        webmshm
                         webmvorbisencoder
                         webmvorbisdecoder
                         webmoggsource"
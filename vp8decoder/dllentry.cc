@@ -134,7 +134,7 @@ STDAPI DllRegisterServer() {
 
   REGFILTERPINS& outpin = pins[1];
 
-  enum { nOutpinMediaTypes = 7 };
+  enum { nOutpinMediaTypes = 10 };
   const REGPINTYPES outpinMediaTypes[nOutpinMediaTypes] = {
       {&MEDIATYPE_Video, &MEDIASUBTYPE_NV12},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YV12},
@@ -142,7 +142,10 @@ STDAPI DllRegisterServer() {
       {&MEDIATYPE_Video, &MEDIASUBTYPE_UYVY},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YUY2},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YUYV},
-      {&MEDIATYPE_Video, &MEDIASUBTYPE_YVYU}};
+      {&MEDIATYPE_Video, &MEDIASUBTYPE_YVYU},
+      {&MEDIATYPE_Video, &MEDIASUBTYPE_RGB32},
+      {&MEDIATYPE_Video, &MEDIASUBTYPE_RGB24},
+      {&MEDIATYPE_Video, &WebmTypes::MEDIASUBTYPE_Y800}};
 
   outpin.strName = 0;  // obsolete
   outpin.bRendered = FALSE;  // always FALSE for outpins
@@ -84,6 +84,9 @@ HRESULT Filter::CNondelegating::QueryInterface(const IID& iid, void** ppv) {
   else if (iid == __uuidof(IVP8PostProcessing)) {
     pUnk = static_cast<IVP8PostProcessing*>(m_pFilter);
   }
+  else if (iid == __uuidof(IVP8DecoderSettings)) {
+    pUnk = static_cast<IVP8DecoderSettings*>(m_pFilter);
+  }
   else {
 #if 0
     wodbgstream os;
@@ -139,6 +142,10 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
   m_cfg.flags = 0;
   m_cfg.deblock = 0;
   m_cfg.noise = 0;
+  m_cfg.threads = 0;  // auto
+  m_cfg.reverse_cache = 64;
+  m_cfg.scrub_cache = 0;  // off
+  m_cfg.async_postproc = false;
 
 #ifdef _DEBUG
   odbgstream os;
@@ -195,6 +202,21 @@ HRESULT Filter::Stop() {
     case kStateRunning:
     case kStateRunningWaitingForKeyframe:
       m_state = kStateStopped;
+
+      if (m_inpin.IsPostprocAsync()) {
+        // The postprocessing thread needs the lock to see that we're
+        // stopped, so release it while waiting for the thread.
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        m_inpin.StopPostprocThread();
+
+        hr = lock.Seize(this);
+
+        if (FAILED(hr))
+          return hr;
+      }
+
       OnStop();  // decommit outpin's allocator
       break;
 
@@ -566,7 +588,144 @@ HRESULT Filter::ApplyPostProcessing() {
   return m_inpin.OnApplyPostProcessing();
 }
 
+HRESULT Filter::SetThreadCount(int count) {
+  if (count < 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.threads = count;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetThreadCount(int* pCount) {
+  if (pCount == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pCount = m_cfg.threads;
+
+  return S_OK;
+}
+
+HRESULT Filter::SetReverseCacheSize(int megabytes) {
+  if (megabytes <= 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.reverse_cache = megabytes;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetReverseCacheSize(int* pMegabytes) {
+  if (pMegabytes == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pMegabytes = m_cfg.reverse_cache;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetQualityLevel(int* pLevel) {
+  if (pLevel == 0)
+    return E_POINTER;
+
+  // No lock: the level is atomic, and polled while streaming.
+  *pLevel = m_quality.GetLevel();
+
+  return S_OK;
+}
+
+HRESULT Filter::SetScrubCacheSize(int megabytes) {
+  if (megabytes < 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.scrub_cache = megabytes;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetScrubCacheSize(int* pMegabytes) {
+  if (pMegabytes == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pMegabytes = m_cfg.scrub_cache;
+
+  return S_OK;
+}
+
+HRESULT Filter::SetAsyncPostProcessing(BOOL async) {
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.async_postproc = (async != FALSE);
+
+  return S_OK;
+}
+
+HRESULT Filter::GetAsyncPostProcessing(BOOL* pAsync) {
+  if (pAsync == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pAsync = m_cfg.async_postproc ? TRUE : FALSE;
+
+  return S_OK;
+}
+
 void Filter::OnStart() {
+  m_quality.Reset();
+
   HRESULT hr = m_inpin.Start();
   assert(SUCCEEDED(hr));  // TODO
 
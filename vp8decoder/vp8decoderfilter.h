@@ -13,18 +13,26 @@
 #include <string>
 
 #include "clockable.h"
+#include "qualityladder.h"
 #include "vp8decoderidl.h"
 #include "vp8decoderinpin.h"
 #include "vp8decoderoutpin.h"
 
 namespace VP8DecoderLib {
 
-class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
+class Filter : public IBaseFilter,
+               public IVP8PostProcessing,
+               public IVP8DecoderSettings,
+               public CLockable {
  public:
   struct Config {
     int flags;
     int deblock;
     int noise;
+    int threads;
+    int reverse_cache;  // megabytes
+    int scrub_cache;  // megabytes; 0 for none
+    bool async_postproc;
   };
 
   // IUnknown
@@ -55,6 +63,17 @@ class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
   HRESULT STDMETHODCALLTYPE GetNoiseLevel(int*);
   HRESULT STDMETHODCALLTYPE ApplyPostProcessing();
 
+  // IVP8DecoderSettings
+  HRESULT STDMETHODCALLTYPE SetThreadCount(int);
+  HRESULT STDMETHODCALLTYPE GetThreadCount(int*);
+  HRESULT STDMETHODCALLTYPE SetReverseCacheSize(int);
+  HRESULT STDMETHODCALLTYPE GetReverseCacheSize(int*);
+  HRESULT STDMETHODCALLTYPE GetQualityLevel(int*);
+  HRESULT STDMETHODCALLTYPE SetScrubCacheSize(int);
+  HRESULT STDMETHODCALLTYPE GetScrubCacheSize(int*);
+  HRESULT STDMETHODCALLTYPE SetAsyncPostProcessing(BOOL);
+  HRESULT STDMETHODCALLTYPE GetAsyncPostProcessing(BOOL*);
+
   // local classes and methods
   FILTER_STATE GetStateLocked() const;
   HRESULT OnDecodeFailureLocked();
@@ -66,6 +85,10 @@ class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
   Outpin m_outpin;
   Config m_cfg;
 
+  // Stepped by the renderer's quality messages to the outpin, and read by
+  // the inpin as it decodes.
+  webmdshow::QualityLadder m_quality;
+
  private:
   class CNondelegating : public IUnknown {
    public:
@@ -18,16 +18,25 @@
 #include <uuids.h>
 #include <vfwmsgs.h>
 
+#include <process.h>
+
 #include <cassert>
+#include <cstring>
 
 #include "vp8decoderfilter.h"
 #include "vp8decoderinpin.h"
 #include "vp8decoderoutpin.h"
 
 #include "mediatypeutil.h"
+#include "videomediatype.h"
 #include "vpx/vp8dx.h"
 
+#include "cpuutil.h"
 #include "graphutil.h"
+#include "libyuv_util.h"
+#include "vp8frameinfo.h"
+#include "vpxframecache.h"
+#include "vpxsamplecopy.h"
 #include "webmtypes.h"
 
 #ifdef _DEBUG
@@ -43,7 +52,24 @@ using std::setprecision;
 namespace VP8DecoderLib {
 
 Inpin::Inpin(Filter* p)
-    : Pin(p, PINDIR_INPUT, L"input"), m_bEndOfStream(false), m_bFlush(false) {
+    : Pin(p, PINDIR_INPUT, L"input"),
+      m_bEndOfStream(false),
+      m_bFlush(false),
+      m_generation(0),
+      m_bReverse(false),
+      m_reverse_bytes(0),
+      m_segment_start(0),
+      m_segment_rate(1),
+      m_skipped_bytes(0),
+      m_quality_level(webmdshow::QualityLadder::kLevelFull),
+      m_scaled_frame(NULL),
+      m_filter_level(0),
+      m_bPostprocAsync(false),
+      m_hPostprocThread(0),
+      m_postproc_next(0),
+      m_postproc_pending(false),
+      m_postproc_busy(false),
+      m_postproc_status(S_OK) {
   AM_MEDIA_TYPE mt;
 
   mt.majortype = MEDIATYPE_Video;
@@ -57,6 +83,28 @@ Inpin::Inpin(Filter* p)
   mt.pbFormat = 0;
 
   m_preferred_mtv.Add(mt);
+
+  m_hPostproc = CreateEvent(0, 0, 0, 0);  // auto-reset
+  assert(m_hPostproc);
+
+  m_hPostprocDone = CreateEvent(0, 0, 0, 0);  // auto-reset
+  assert(m_hPostprocDone);
+}
+
+Inpin::~Inpin() {
+  assert(m_hPostprocThread == 0);
+
+  BOOL b = CloseHandle(m_hPostproc);
+  assert(b);
+
+  b = CloseHandle(m_hPostprocDone);
+  assert(b);
+}
+
+Inpin::DecoderLock::DecoderLock() {
+  const HRESULT hr = CLockable::Init();
+  hr;
+  assert(SUCCEEDED(hr));
 }
 
 HRESULT Inpin::QueryInterface(const IID& iid, void** ppv) {
@@ -190,6 +238,22 @@ HRESULT Inpin::EndOfStream() {
   if (!bool(m_pPinConnection))
     return VFW_E_NOT_CONNECTED;
 
+  if (m_bReverse && !m_reverse_frames.empty()) {
+    // The frames of the first group in the stream (the last we get).
+    hr = DeliverReverseFrames(lock);
+
+    if (FAILED(hr))
+      return hr;
+  }
+
+  if (IsPostprocAsync()) {
+    // The end of the stream follows the frames the worker has.
+    hr = WaitPostprocLocked(lock, true);
+
+    if (FAILED(hr))
+      return hr;
+  }
+
   m_bEndOfStream = true;
 
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
@@ -230,6 +294,18 @@ HRESULT Inpin::BeginFlush() {
 #endif
 
   m_bFlush = true;
+  ++m_generation;
+  ClearReverseFrames();
+  ClearSkipped();
+
+  // The worker drops the frame it has; Receive may be waiting for it.
+  m_postproc_pending = false;
+
+  if (IsPostprocAsync()) {
+    const BOOL b = SetEvent(m_hPostprocDone);
+    b;
+    assert(b);
+  }
 
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
@@ -259,6 +335,7 @@ HRESULT Inpin::EndFlush() {
 
   m_bFlush = false;
   m_bEndOfStream = false;
+  m_postproc_status = S_OK;
 
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
@@ -281,6 +358,16 @@ HRESULT Inpin::NewSegment(REFERENCE_TIME st, REFERENCE_TIME sp, double r) {
   if (!bool(m_pPinConnection))
     return VFW_E_NOT_CONNECTED;
 
+  // Downstream sees the frames of a reverse segment with rising times.
+  m_bReverse = (r < 0);
+  ClearReverseFrames();
+
+  if (m_bReverse)
+    r = -r;
+
+  m_segment_start = st;
+  m_segment_rate = r;
+
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
 
@@ -426,6 +513,14 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   if (m_bFlush)
     return S_FALSE;
 
+  if (m_bReverse && (pInSample->IsSyncPoint() == S_OK)) {
+    // This keyframe begins the group before the one we hold.
+    hr = DeliverReverseFrames(lock);
+
+    if (hr != S_OK)
+      return hr;
+  }
+
   BYTE* buf;
 
   hr = pInSample->GetPointer(&buf);
@@ -435,121 +530,167 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   const long len = pInSample->GetActualDataLength();
   assert(len >= 0);
 
-  const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, buf, len, 0, 0);
+  const int level = m_pFilter->m_quality.GetLevel();
 
-  if (err != VPX_CODEC_OK)
-    return m_pFilter->OnDecodeFailureLocked();
+  if (level != m_quality_level) {
+    m_quality_level = level;
+    OnApplyPostProcessing();
+  }
 
-  hr = pInSample->IsSyncPoint();
+  // A frame that no later frame depends on need not be decoded at all,
+  // when the renderer can't keep up. Reverse playback holds on to every
+  // frame of a group, so it keeps them.
+  if ((level >= webmdshow::QualityLadder::kLevelDropNonReference) &&
+      !m_bReverse && (pInSample->IsPreroll() != S_OK)) {
+    webmdshow::Vp8FrameInfo info;
 
-  m_pFilter->OnDecodeSuccessLocked(hr == S_OK);
+    if (webmdshow::ParseVp8FrameInfo(buf, len, &info) && info.droppable)
+      return S_OK;
+  }
 
-  if (pInSample->IsPreroll() == S_OK)
-    return S_OK;
+  if (IsPostprocAsync()) {
+    webmdshow::Vp8FrameInfo info;
 
-  lock.Release();
+    if (webmdshow::ParseVp8FrameInfo(buf, len, &info))
+      m_filter_level = info.filter_level;
+  }
 
-  GraphUtil::IMediaSamplePtr pOutSample;
+  // A frame decoded before, as an editor scrubs back over it, is
+  // presented from the scrub cache instead of being decoded again.
+  REFERENCE_TIME scrub_time;
 
-  hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+  const bool bScrub = GetScrubTime(pInSample, scrub_time);
+  const bool bCached = bScrub && m_scrub_cache.Lookup(scrub_time) &&
+                       SkipDecode(pInSample, buf, len);
 
-  if (FAILED(hr))
-    return S_FALSE;
+  if (!bCached) {
+    // The decoder first catches up on the frames the cache presented.
+    skipped_t skipped;
+    skipped.swap(m_skipped);
+    m_skipped_bytes = 0;
 
-  assert(bool(pOutSample));
+    // Decode without the filter lock (see DecoderLock). The state is
+    // checked again once we have it back.
+    const unsigned int generation = m_generation;
 
-  hr = lock.Seize(m_pFilter);
+    lock.Release();
 
-  if (FAILED(hr))
-    return hr;
+    CLockable::Lock decoder_lock;
 
-  if (m_pFilter->GetStateLocked() == State_Stopped)
-    return VFW_E_NOT_RUNNING;
+    hr = decoder_lock.Seize(&m_decoder_lock);
 
-  if (!bool(outpin.m_pPinConnection))  // should never happen
-    return S_FALSE;
+    if (FAILED(hr))
+      return hr;
 
-  if (!bool(outpin.m_pInputPin))  // should never happen
-    return S_FALSE;
+    vpx_codec_err_t err = VPX_CODEC_OK;
 
-  vpx_codec_iter_t iter = 0;
+    typedef skipped_t::const_iterator iter_t;
 
-  vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
+    for (iter_t i = skipped.begin(); i != skipped.end(); ++i) {
+      const unsigned int size = static_cast<unsigned int>(i->size());
+      err = vpx_codec_decode(&m_ctx, &(*i)[0], size, 0, 0);
 
-  if (f == 0)
-    return S_OK;
+      if (err != VPX_CODEC_OK)
+        break;
 
-  AM_MEDIA_TYPE* pmt;
+      vpx_codec_iter_t iter = 0;
 
-  hr = pOutSample->GetMediaType(&pmt);
+      while (vpx_codec_get_frame(&m_ctx, &iter) != 0) {
+      }  // presented already
+    }
 
-  if (SUCCEEDED(hr) && (pmt != 0)) {
-    hr = outpin.QueryAccept(pmt);
+    if (err == VPX_CODEC_OK)
+      err = vpx_codec_decode(&m_ctx, buf, len, 0, 0);
 
-    if (hr != S_OK) {
-      assert(hr == S_OK);
+    decoder_lock.Release();
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
       return hr;
-    }
 
-    outpin.m_connection_mtv.Clear();
-    outpin.m_connection_mtv.Add(*pmt);
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
 
-    MediaTypeUtil::Free(pmt);
-    pmt = 0;
+    if (m_bFlush || (m_generation != generation))
+      return S_FALSE;
+
+    if (err != VPX_CODEC_OK)
+      return m_pFilter->OnDecodeFailureLocked();
+
+    hr = pInSample->IsSyncPoint();
+
+    m_pFilter->OnDecodeSuccessLocked(hr == S_OK);
   }
 
-  const AM_MEDIA_TYPE& mt = outpin.m_connection_mtv[0];
+  if (pInSample->IsPreroll() == S_OK) {
+    // Scrubbing back lands on these, so they are worth keeping too.
+    if (bScrub && !bCached) {
+      vpx_codec_iter_t iter = 0;
+
+      if (const vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter))
+        m_scrub_cache.Insert(scrub_time, f);
+    }
+
+    return S_OK;
+  }
 
-  const BITMAPINFOHEADER* bmih_ptr;
-  const RECT* rc_ptr;
+  if (m_bReverse) {
+    vpx_codec_iter_t iter = 0;
 
-  if (mt.formattype == FORMAT_VideoInfo) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
-    assert(mt.pbFormat);
+    if (const vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter))
+      CacheReverseFrame(f, pInSample);
 
-    const VIDEOINFOHEADER& vih_out = (VIDEOINFOHEADER&)(*mt.pbFormat);
-    const RECT& rc_out = vih_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih_out.bmiHeader;
+    return S_OK;
+  }
 
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else if (mt.formattype == FORMAT_VideoInfo2) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER2));
-    assert(mt.pbFormat);
+  if (IsPostprocAsync()) {
+    // The worker postprocesses the frame and delivers it.
+    hr = WaitPostprocLocked(lock, false);
 
-    const VIDEOINFOHEADER2& vih2_out = (VIDEOINFOHEADER2&)(*mt.pbFormat);
-    const RECT& rc_out = vih2_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih2_out.bmiHeader;
+    if (hr != S_OK)
+      return hr;
 
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else {
-    return E_FAIL;
+    if (const vpx_image_t* const f = GetFrame(bCached, bScrub, scrub_time))
+      QueuePostprocFrameLocked(f, pInSample);
+
+    return S_OK;
   }
 
-  if (mt.subtype == MEDIASUBTYPE_NV12)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  lock.Release();
+
+  GraphUtil::IMediaSamplePtr pOutSample;
+
+  hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+  if (FAILED(hr))
+    return S_FALSE;
+
+  assert(bool(pOutSample));
 
-  else if (mt.subtype == MEDIASUBTYPE_YV12)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  hr = lock.Seize(m_pFilter);
 
-  else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  if (FAILED(hr))
+    return hr;
 
-  else if (mt.subtype == MEDIASUBTYPE_UYVY)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return VFW_E_NOT_RUNNING;
 
-  else if (mt.subtype == MEDIASUBTYPE_YUY2)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  if (!bool(outpin.m_pPinConnection))  // should never happen
+    return S_FALSE;
 
-  else if (mt.subtype == MEDIASUBTYPE_YUYV)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  if (!bool(outpin.m_pInputPin))  // should never happen
+    return S_FALSE;
 
-  else if (mt.subtype == MEDIASUBTYPE_YVYU)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  const vpx_image_t* const f = GetFrame(bCached, bScrub, scrub_time);
 
-  else
-    return E_FAIL;
+  if (f == 0)
+    return S_OK;
+
+  hr = PopulateSample(pOutSample, f);
+
+  if (hr != S_OK)
+    return hr;
 
   __int64 st, sp;
 
@@ -591,291 +732,269 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   return outpin.m_pInputPin->Receive(pOutSample);
 }
 
-HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
-                               long n,  // in
-                               long* pm)  { // out
-  if (pm == 0)
-    return E_POINTER;
+const vpx_image_t* Inpin::GetFrame(bool bCached, bool bScrub,
+                                   REFERENCE_TIME scrub_time) {
+  if (bCached)
+    return m_scrub_cache.Get(scrub_time);  // null if purged meanwhile
 
-  long& m = *pm;  // out
-  m = 0;
+  vpx_codec_iter_t iter = 0;
+  const vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
 
-  if (n <= 0)
-    return S_OK;  // weird
+  if ((f != 0) && bScrub)
+    m_scrub_cache.Insert(scrub_time, f);
 
-  if (pSamples == 0)
-    return E_INVALIDARG;
+  return f;
+}
 
-  for (long i = 0; i < n; ++i) {
-    IMediaSample* const pSample = pSamples[i];
-    assert(pSample);
+HRESULT Inpin::PopulateSample(IMediaSample* pOutSample,
+                              const vpx_image_t* f) {
+  Outpin& outpin = m_pFilter->m_outpin;
 
-    const HRESULT hr = Receive(pSample);
+  AM_MEDIA_TYPE* pmt;
 
-    if (hr != S_OK)
-      return hr;
+  HRESULT hr = pOutSample->GetMediaType(&pmt);
 
-    ++m;
+  if (SUCCEEDED(hr) && (pmt != 0) &&
+      MediaTypeUtil::Equal(*pmt, outpin.m_connection_mtv[0])) {
+    MediaTypeUtil::Free(pmt);  // downstream restated the type we have
+    pmt = 0;
   }
 
-  return S_OK;
-}
-
-void Inpin::CopyToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  // Y
+  if (SUCCEEDED(hr) && (pmt != 0)) {
+    hr = outpin.QueryAccept(pmt);
 
-  const BYTE* pInY = f->planes[VPX_PLANE_Y];
-  assert(pInY);
+    if (hr != S_OK) {
+      assert(hr == S_OK);
+      return hr;
+    }
 
-  unsigned int width_in = f->d_w;
-  unsigned int height_in = f->d_h;
+    outpin.m_connection_mtv.Clear();
+    outpin.m_connection_mtv.Add(*pmt);
 
-  BYTE* pOutBuf;
+    MediaTypeUtil::Free(pmt);
+    pmt = 0;
+  }
 
-  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
-  assert(SUCCEEDED(hr));
-  assert(pOutBuf);
+  // The stream changed resolution. Switch downstream to frames of the new
+  // size if it can take them, and scale the frame to the size it has if
+  // not. Y800 is scaled as it is copied, since it has no chroma to scale.
+  LONG w, h;
 
-  BYTE* pOut = pOutBuf;
+  if (webmdshow::GetVideoFrameSize(outpin.m_connection_mtv[0], &w, &h) &&
+      ((LONG(f->d_w) != w) || (LONG(f->d_h) != h))) {
+    const HRESULT hrSize = outpin.SetFrameSizeLocked(pOutSample, f->d_w,
+                                                     f->d_h);
 
-  const int strideInY = f->stride[VPX_PLANE_Y];
+    if (FAILED(hrSize))
+      return hrSize;
 
-  LONG strideOut = bmih_out.biWidth;
-  assert(strideOut);
-  assert((strideOut % 2) == 0);
+    if ((hrSize != S_OK) &&
+        (outpin.m_connection_mtv[0].subtype !=
+         WebmTypes::MEDIASUBTYPE_Y800)) {
+      if (!webmdshow::LibyuvScaleI420(w, h, f, &m_scaled_frame))
+        return E_FAIL;
 
-  for (unsigned int y = 0; y < height_in; ++y) {
-    memcpy(pOut, pInY, width_in);
-    pInY += strideInY;
-    pOut += strideOut;
+      f = m_scaled_frame;
+    }
   }
 
-  width_in = (width_in + 1) / 2;
-  height_in = (height_in + 1) / 2;
+  return webmdshow::CopyVpxImageToSample(f, outpin.m_connection_mtv[0],
+                                          pOutSample);
+}
 
-  const BYTE* pInV = f->planes[VPX_PLANE_V];
-  assert(pInV);
+void Inpin::CacheReverseFrame(const vpx_image_t* f, IMediaSample* pInSample) {
+  // The frame is copied, in I420, since the decoder reuses its buffers.
+  const size_t size = webmdshow::GetVpxImageI420Size(f);
+  const size_t limit = size_t(m_pFilter->m_cfg.reverse_cache) << 20;
 
-  const int strideInV = f->stride[VPX_PLANE_V];
+  while (!m_reverse_frames.empty() && (m_reverse_bytes + size > limit)) {
+    m_reverse_bytes -= m_reverse_frames.front().buf.size();
+    m_reverse_frames.pop_front();
+  }
 
-  const BYTE* pInU = f->planes[VPX_PLANE_U];
-  assert(pInU);
+  if (size > limit)
+    return;
 
-  const int strideInU = f->stride[VPX_PLANE_U];
+  m_reverse_frames.push_back(ReverseFrame());
+  ReverseFrame& frame = m_reverse_frames.back();
 
-  if (subtype_out == MEDIASUBTYPE_NV12) {
-    // Note that while NV12 is considered a planar format,
-    // the chroma plane packs the UV samples.
+  frame.time_status = pInSample->GetTime(&frame.start, &frame.stop);
+  frame.filter_level = m_filter_level;
 
-    // UV
+  // The list doesn't move its elements, so the planes stay valid.
+  webmdshow::CopyVpxImageI420(f, &frame.buf, &frame.image);
+  m_reverse_bytes += size;
+}
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      const BYTE* u = pInU;
-      const BYTE* v = pInV;
-      BYTE* uv = pOut;
+HRESULT Inpin::DeliverReverseFrames(CLockable::Lock& lock) {
+  // Called, and returns, with the lock held (unless seizing it fails).
+  // Delivers the frames held, the last one decoded first.
+  Outpin& outpin = m_pFilter->m_outpin;
 
-      for (unsigned int idx = 0; idx < width_in; ++idx) {
-        *uv++ = *u++;
-        *uv++ = *v++;
-      }
+  if (IsPostprocAsync()) {
+    const HRESULT hr = WaitPostprocLocked(lock, true);
 
-      pInU += strideInU;
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  } else if (subtype_out == MEDIASUBTYPE_YV12) {
-    strideOut /= 2;
+    if (hr != S_OK)
+      return hr;
+  }
 
-    // V
+  while (!m_reverse_frames.empty()) {
+    if (!bool(outpin.m_pAllocator))
+      return VFW_E_NO_ALLOCATOR;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
+    lock.Release();
 
-    // U
+    GraphUtil::IMediaSamplePtr pOutSample;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
-    }
-  } else {
-    assert(subtype_out == WebmTypes::MEDIASUBTYPE_I420);
-    strideOut /= 2;
+    HRESULT hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
 
-    // U
+    const HRESULT hrSeize = lock.Seize(m_pFilter);
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
-    }
+    if (FAILED(hrSeize))
+      return hrSeize;
 
-    // V
+    if (FAILED(hr))
+      return S_FALSE;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  }
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
+    if (m_bFlush || !bool(outpin.m_pInputPin))
+      return S_FALSE;
 
-  hr = pOutSample->SetActualDataLength(lenOut);
-  assert(SUCCEEDED(hr));
-}
+    if (m_reverse_frames.empty())  // a new segment began
+      return S_OK;
 
-void Inpin::CopyToPacked(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out, const RECT& rc_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  const LONG rect_width_out = rc_out.right - rc_out.left;
-  assert(rect_width_out >= 0);
+    ReverseFrame& frame = m_reverse_frames.back();
 
-  const LONG width_out =
-      (rect_width_out > 0) ? rect_width_out : bmih_out.biWidth;
-  assert(width_out > 0);
+    if (IsPostprocAsync()) {
+      const vp8_postproc_cfg_t cfg = GetPostprocConfigLocked();
 
-  const LONG rect_height_out = rc_out.bottom - rc_out.top;
-  assert(rect_height_out >= 0);
+      if (webmdshow::Vp8Postprocessor::IsEnabled(cfg))
+        m_postprocessor.Process(cfg, frame.filter_level, &frame.image);
+    }
 
-  const LONG height_out =
-      (rect_height_out > 0) ? rect_height_out : labs(bmih_out.biHeight);
+    hr = PopulateSample(pOutSample, &frame.image);
 
-  const BYTE* pInY_base = f->planes[VPX_PLANE_Y];
-  assert(pInY_base);
+    if (hr != S_OK)
+      return hr;
 
-  const int strideInY = f->stride[VPX_PLANE_Y];
+    REFERENCE_TIME st = frame.start;
+    REFERENCE_TIME sp = frame.stop;
 
-  const BYTE* pInV_base = f->planes[VPX_PLANE_V];
-  assert(pInV_base);
+    if (FAILED(frame.time_status))
+      hr = pOutSample->SetTime(0, 0);
+    else if (frame.time_status == S_OK)
+      hr = pOutSample->SetTime(&st, &sp);
+    else
+      hr = pOutSample->SetTime(&st, 0);
 
-  const int strideInV = f->stride[VPX_PLANE_V];
+    assert(SUCCEEDED(hr));
 
-  const BYTE* pInU_base = f->planes[VPX_PLANE_U];
-  assert(pInU_base);
+    hr = pOutSample->SetSyncPoint(TRUE);
+    assert(SUCCEEDED(hr));
 
-  const int strideInU = f->stride[VPX_PLANE_U];
+    hr = pOutSample->SetPreroll(FALSE);
+    assert(SUCCEEDED(hr));
 
-  const unsigned int width_in = f->d_w;
-  assert(LONG(width_in) == width_out);
+    hr = pOutSample->SetDiscontinuity(FALSE);
+    assert(SUCCEEDED(hr));
 
-  const unsigned int height_in = f->d_h;
-  assert(LONG(height_in) == height_out);
+    hr = pOutSample->SetMediaTime(0, 0);
 
-  BYTE* pOutBuf;
+    m_reverse_bytes -= frame.buf.size();
+    m_reverse_frames.pop_back();
 
-  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
-  assert(SUCCEEDED(hr));
-  assert(pOutBuf);
+    IMemInputPin* const pInputPin = outpin.m_pInputPin;
 
-  const LONG strideOut_ = 2 * width_in;
-  LONG strideOut;
+    lock.Release();
 
-  if (bmih_out.biWidth < strideOut_)
-    strideOut = strideOut_;
-  else
-    strideOut = bmih_out.biWidth;
-
-  const LONG uv_width = width_in / 2;
-  const LONG uv_height = height_in / 2;
-
-  int u_off, v_off, y_off;
-
-  if (subtype_out == MEDIASUBTYPE_UYVY) {
-    u_off = 0;
-    v_off = 2;
-    y_off = 1;
-  } else if ((subtype_out == MEDIASUBTYPE_YUY2) ||
-             (subtype_out == MEDIASUBTYPE_YUYV)) {
-    u_off = 1;
-    v_off = 3;
-    y_off = 0;
-  } else {
-    assert(subtype_out == MEDIASUBTYPE_YVYU);
+    hr = pInputPin->Receive(pOutSample);
 
-    u_off = 3;
-    v_off = 1;
-    y_off = 0;
-  }
+    const HRESULT hrReseize = lock.Seize(m_pFilter);
 
-  BYTE* pOut = pOutBuf;
+    if (FAILED(hrReseize))
+      return hrReseize;
 
-  for (LONG hdx = 0; hdx < uv_height; ++hdx) {
-    BYTE* const pOut0 = pOut;
-    pOut += strideOut;
+    if (hr != S_OK)
+      return hr;
+  }
 
-    BYTE* const pOut1 = pOut;
-    pOut += strideOut;
+  return S_OK;
+}
 
-    BYTE* pOutU0 = pOut0 + u_off;
-    BYTE* pOutU1 = pOut1 + u_off;
+void Inpin::ClearReverseFrames() {
+  m_reverse_frames.clear();
+  m_reverse_bytes = 0;
+}
 
-    BYTE* pOutV0 = pOut0 + v_off;
-    BYTE* pOutV1 = pOut1 + v_off;
+bool Inpin::GetScrubTime(IMediaSample* pInSample,
+                         REFERENCE_TIME& time) const {
+  if ((m_scrub_cache.GetLimit() == 0) || m_bReverse)
+    return false;
 
-    BYTE* pOutY0 = pOut0 + y_off;
-    BYTE* pOutY1 = pOut1 + y_off;
+  REFERENCE_TIME st, sp;
 
-    const BYTE* pInU = pInU_base;
-    pInU_base += strideInU;
+  if (FAILED(pInSample->GetTime(&st, &sp)))
+    return false;
 
-    const BYTE* pInV = pInV_base;
-    pInV_base += strideInV;
+  // Sample times are relative to the segment, which each seek restarts,
+  // so the key is the time in the stream.
+  time = m_segment_start + REFERENCE_TIME(double(st) * m_segment_rate);
+  return true;
+}
 
-    const BYTE* pInY0 = pInY_base;
-    pInY_base += strideInY;
+bool Inpin::SkipDecode(IMediaSample* pInSample, const BYTE* buf, long len) {
+  // Nothing that came before a keyframe is needed to decode it.
+  if (pInSample->IsSyncPoint() == S_OK)
+    ClearSkipped();
 
-    const BYTE* pInY1 = pInY_base;
-    pInY_base += strideInY;
+  // Past this, catching up would be slow enough to lose what the cache
+  // saved; decode as usual instead.
+  enum { kMaxSkippedBytes = 16 * 1024 * 1024 };
 
-    for (LONG wdx = 0; wdx < uv_width; ++wdx) {
-      *pOutU0 = *pInU;
-      *pOutU1 = *pInU;
+  if (m_skipped_bytes + len > kMaxSkippedBytes)
+    return false;
 
-      pOutU0 += 4;
-      pOutU1 += 4;
+  m_skipped.push_back(std::vector<BYTE>(buf, buf + len));
+  m_skipped_bytes += len;
 
-      ++pInU;
+  return true;
+}
 
-      *pOutV0 = *pInV;
-      *pOutV1 = *pInV;
+void Inpin::ClearSkipped() {
+  m_skipped.clear();
+  m_skipped_bytes = 0;
+}
 
-      pOutV0 += 4;
-      pOutV1 += 4;
+HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
+                               long n,  // in
+                               long* pm)  { // out
+  if (pm == 0)
+    return E_POINTER;
 
-      ++pInV;
+  long& m = *pm;  // out
+  m = 0;
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+  if (n <= 0)
+    return S_OK;  // weird
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+  if (pSamples == 0)
+    return E_INVALIDARG;
 
-      ++pInY0;
-      ++pInY1;
+  for (long i = 0; i < n; ++i) {
+    IMediaSample* const pSample = pSamples[i];
+    assert(pSample);
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+    const HRESULT hr = Receive(pSample);
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+    if (hr != S_OK)
+      return hr;
 
-      ++pInY0;
-      ++pInY1;
-    }
+    ++m;
   }
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
-
-  hr = pOutSample->SetActualDataLength(lenOut);
-  assert(SUCCEEDED(hr));
+  return S_OK;
 }
 
 HRESULT Inpin::ReceiveCanBlock() {
@@ -895,6 +1014,8 @@ HRESULT Inpin::ReceiveCanBlock() {
 }
 
 HRESULT Inpin::OnDisconnect() {
+  m_scrub_cache.Clear();  // the frames of another stream
+
   return m_pFilter->m_outpin.OnInpinDisconnect();
 }
 
@@ -917,11 +1038,25 @@ HRESULT Inpin::Start() {
   m_bEndOfStream = false;
   m_bFlush = false;
 
-  vpx_codec_iface_t& vp8 = vpx_codec_vp8_dx_algo;
+  CLockable::Lock decoder_lock;
+
+  HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
+  webmdshow::VpxDecoderPool::Key& key = m_decoder_key;
 
-  const int flags = VPX_CODEC_USE_POSTPROC;
+  key.iface = &vpx_codec_vp8_dx_algo;
+  key.flags = VPX_CODEC_USE_POSTPROC;
+  key.threads = webmdshow::GetVpxDecoderThreadCount(m_pFilter->m_cfg.threads,
+                                                    false,  // VP8
+                                                    GetFrameWidth());
+  key.width = GetFrameWidth();
+  key.height = GetFrameHeight();
 
-  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, &vp8, 0, flags);
+  webmdshow::VpxDecoderPool& pool = webmdshow::VpxDecoderPool::Get();
+  const vpx_codec_err_t err = pool.Borrow(key, &m_ctx);
 
   if (err == VPX_CODEC_MEM_ERROR)
     return E_OUTOFMEMORY;
@@ -929,33 +1064,356 @@ HRESULT Inpin::Start() {
   if (err != VPX_CODEC_OK)
     return E_FAIL;
 
-  const HRESULT hr = OnApplyPostProcessing();
+  m_quality_level = m_pFilter->m_quality.GetLevel();
+
+  m_scrub_cache.SetLimit(size_t(m_pFilter->m_cfg.scrub_cache) << 20);
+
+  m_bPostprocAsync = m_pFilter->m_cfg.async_postproc;
+  m_postproc_status = S_OK;
+
+  hr = OnApplyPostProcessing();
 
   if (FAILED(hr)) {
     Stop();
     return hr;
   }
 
+  if (m_bPostprocAsync)
+    StartPostprocThread();
+
   return S_OK;
 }
 
 void Inpin::Stop() {
-  const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
-  err;
-  assert(err == VPX_CODEC_OK);
+  assert(m_hPostprocThread == 0);  // Filter::Stop stopped it
+
+  m_bPostprocAsync = false;
+  m_postproc_pending = false;
+  m_postproc_busy = false;
+
+  ClearReverseFrames();
+  ClearSkipped();
+  ++m_generation;
+
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+  hr;
+  assert(SUCCEEDED(hr));
+
+  webmdshow::VpxDecoderPool::Get().Return(m_decoder_key, &m_ctx);
+
+  if (m_scaled_frame != NULL) {
+    vpx_img_free(m_scaled_frame);
+    m_scaled_frame = NULL;
+  }
 }
 
-HRESULT Inpin::OnApplyPostProcessing() {
+int Inpin::GetFrameWidth() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  return vih.bmiHeader.biWidth;
+}
+
+int Inpin::GetFrameHeight() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  const LONG h = vih.bmiHeader.biHeight;
+
+  return (h < 0) ? -h : h;
+}
+
+vp8_postproc_cfg_t Inpin::GetPostprocConfigLocked() const {
   const Filter::Config& src = m_pFilter->m_cfg;
-  vp8_postproc_cfg_t tgt;
+  vp8_postproc_cfg_t cfg;
+
+  // The first rung of the quality ladder turns postprocessing off.
+  const bool postproc =
+      m_quality_level < webmdshow::QualityLadder::kLevelNoPostproc;
 
-  tgt.post_proc_flag = src.flags;
-  tgt.deblocking_level = src.deblock;
-  tgt.noise_level = src.noise;
+  cfg.post_proc_flag = postproc ? src.flags : 0;
+  cfg.deblocking_level = src.deblock;
+  cfg.noise_level = src.noise;
+
+  return cfg;
+}
+
+HRESULT Inpin::OnApplyPostProcessing() {
+  vp8_postproc_cfg_t tgt = GetPostprocConfigLocked();
+
+  // The worker postprocesses instead, as it takes each frame.
+  if (IsPostprocAsync())
+    tgt.post_proc_flag = 0;
+
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
 
   const vpx_codec_err_t err = vpx_codec_control(&m_ctx, VP8_SET_POSTPROC, &tgt);
 
+  // The frames cached were postprocessed as before.
+  m_scrub_cache.Clear();
+
   return (err == VPX_CODEC_OK) ? S_OK : E_FAIL;
 }
 
+bool Inpin::IsPostprocAsync() const {
+  return m_bPostprocAsync;
+}
+
+void Inpin::StartPostprocThread() {
+  assert(m_hPostprocThread == 0);
+
+  m_postproc_pending = false;
+  m_postproc_busy = false;
+
+  BOOL b = ResetEvent(m_hPostproc);
+  assert(b);
+
+  b = ResetEvent(m_hPostprocDone);
+  assert(b);
+
+  const uintptr_t h = _beginthreadex(0,  // security
+                                     0,  // stack size
+                                     &Inpin::PostprocThreadProc, this,
+                                     0,  // run immediately
+                                     0);  // thread id
+
+  m_hPostprocThread = reinterpret_cast<HANDLE>(h);
+  assert(m_hPostprocThread);
+}
+
+void Inpin::StopPostprocThread() {
+  if (m_hPostprocThread == 0)
+    return;
+
+  // Decommit first, so that a worker waiting in GetBuffer wakes up.
+  Outpin& outpin = m_pFilter->m_outpin;
+
+  if (bool(outpin.m_pAllocator)) {
+    const HRESULT hr = outpin.m_pAllocator->Decommit();
+    hr;
+    assert(SUCCEEDED(hr));
+  }
+
+  BOOL b = SetEvent(m_hPostproc);
+  assert(b);
+
+  b = SetEvent(m_hPostprocDone);  // in case Receive is waiting
+  assert(b);
+
+  const DWORD dw = WaitForSingleObject(m_hPostprocThread, INFINITE);
+  dw;
+  assert(dw == WAIT_OBJECT_0);
+
+  b = CloseHandle(m_hPostprocThread);
+  assert(b);
+
+  m_hPostprocThread = 0;
+}
+
+unsigned Inpin::PostprocThreadProc(void* pv) {
+  Inpin* const pPin = static_cast<Inpin*>(pv);
+  assert(pPin);
+
+  return pPin->PostprocMain();
+}
+
+unsigned Inpin::PostprocMain() {
+  webmdshow::Vp8Postprocessor postprocessor;
+
+  for (;;) {
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return 0;
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return 0;
+
+    if (!m_postproc_pending) {
+      hr = lock.Release();
+      assert(SUCCEEDED(hr));
+
+      const DWORD dw = WaitForSingleObject(m_hPostproc, INFINITE);
+
+      if (dw == WAIT_FAILED)
+        return 0;
+
+      assert(dw == WAIT_OBJECT_0);
+      continue;
+    }
+
+    // Receive fills the other slot while we have this one.
+    PostprocFrame& frame = m_postproc_frames[m_postproc_next];
+    m_postproc_next ^= 1;
+    m_postproc_pending = false;
+    m_postproc_busy = true;
+
+    // Read as the frame is taken, so the ladder's level applies from the
+    // next frame on.
+    const vp8_postproc_cfg_t cfg = GetPostprocConfigLocked();
+
+    BOOL b = SetEvent(m_hPostprocDone);
+    assert(b);
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    // The work that would have held up the decoder.
+    if (webmdshow::Vp8Postprocessor::IsEnabled(cfg))
+      postprocessor.Process(cfg, frame.filter_level, &frame.image);
+
+    const HRESULT hrDeliver = DeliverPostprocFrame(frame);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return 0;
+
+    m_postproc_busy = false;
+
+    // Receive returns a failure downstream reported, as it would have.
+    if ((hrDeliver != S_OK) && (frame.generation == m_generation) &&
+        (m_postproc_status == S_OK)) {
+      m_postproc_status = hrDeliver;
+    }
+
+    b = SetEvent(m_hPostprocDone);
+    assert(b);
+  }
+}
+
+HRESULT Inpin::DeliverPostprocFrame(PostprocFrame& frame) {
+  Outpin& outpin = m_pFilter->m_outpin;
+
+  if (!bool(outpin.m_pAllocator))
+    return VFW_E_NO_ALLOCATOR;
+
+  GraphUtil::IMediaSamplePtr pOutSample;
+
+  HRESULT hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+  Filter::Lock lock;
+
+  const HRESULT hrSeize = lock.Seize(m_pFilter);
+
+  if (FAILED(hrSeize))
+    return hrSeize;
+
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return VFW_E_NOT_RUNNING;
+
+  if (m_bFlush || (frame.generation != m_generation))
+    return S_OK;  // dropped
+
+  if (FAILED(hr))
+    return S_FALSE;
+
+  if (!bool(outpin.m_pInputPin))  // should never happen
+    return S_FALSE;
+
+  hr = PopulateSample(pOutSample, &frame.image);
+
+  if (hr != S_OK)
+    return hr;
+
+  REFERENCE_TIME st = frame.start;
+  REFERENCE_TIME sp = frame.stop;
+
+  if (FAILED(frame.time_status))
+    hr = pOutSample->SetTime(0, 0);
+  else if (frame.time_status == S_OK)
+    hr = pOutSample->SetTime(&st, &sp);
+  else
+    hr = pOutSample->SetTime(&st, 0);
+
+  assert(SUCCEEDED(hr));
+
+  hr = pOutSample->SetSyncPoint(TRUE);
+  assert(SUCCEEDED(hr));
+
+  hr = pOutSample->SetPreroll(FALSE);
+  assert(SUCCEEDED(hr));
+
+  hr = pOutSample->SetDiscontinuity(frame.discontinuity);
+  assert(SUCCEEDED(hr));
+
+  hr = pOutSample->SetMediaTime(0, 0);
+
+  IMemInputPin* const pInputPin = outpin.m_pInputPin;
+
+  lock.Release();
+
+  return pInputPin->Receive(pOutSample);
+}
+
+void Inpin::QueuePostprocFrameLocked(const vpx_image_t* f,
+                                     IMediaSample* pInSample) {
+  assert(f);
+  assert(!m_postproc_pending);
+
+  PostprocFrame& frame = m_postproc_frames[m_postproc_next];
+
+  webmdshow::CopyVpxImageI420(f, &frame.buf, &frame.image);
+  frame.filter_level = m_filter_level;
+  frame.time_status = pInSample->GetTime(&frame.start, &frame.stop);
+  frame.discontinuity = (pInSample->IsDiscontinuity() == S_OK);
+  frame.generation = m_generation;
+
+  m_postproc_pending = true;
+
+  const BOOL b = SetEvent(m_hPostproc);
+  b;
+  assert(b);
+}
+
+HRESULT Inpin::WaitPostprocLocked(CLockable::Lock& lock, bool drain) {
+  for (;;) {
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    if (m_bFlush)
+      return S_FALSE;
+
+    if (m_postproc_status != S_OK)
+      return m_postproc_status;
+
+    if (!m_postproc_pending && !(drain && m_postproc_busy))
+      return S_OK;
+
+    HRESULT hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    const DWORD dw = WaitForSingleObject(m_hPostprocDone, INFINITE);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    if (dw == WAIT_FAILED)
+      return E_FAIL;
+  }
+}
+
 }  // namespace VP8DecoderLib
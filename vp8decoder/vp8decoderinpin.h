@@ -10,16 +10,25 @@
 
 #include <amvideo.h>
 
+#include <list>
+#include <vector>
+
+#include "vpx/vp8.h"
 #include "vpx/vpx_decoder.h"
 
+#include "clockable.h"
 #include "graphutil.h"
 #include "vp8decoderpin.h"
+#include "vp8postproc.h"
+#include "vpxdecoderpool.h"
+#include "vpxframecache.h"
 
 namespace VP8DecoderLib {
 
 class Inpin : public Pin, public IMemInputPin {
  public:
   explicit Inpin(Filter*);
+  virtual ~Inpin();
 
   // IUnknown interface:
   HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
@@ -51,28 +60,158 @@ class Inpin : public Pin, public IMemInputPin {
   void Stop();  // from running/paused to stopped
   HRESULT OnApplyPostProcessing();
 
+  // True from Start to Stop when frames are postprocessed on the worker
+  // thread (see PostprocMain). Filter::Stop stops the thread without the
+  // filter lock, before the rest of Stop.
+  bool IsPostprocAsync() const;
+  void StopPostprocThread();
+
  protected:
   HRESULT GetName(PIN_INFO&) const;
   HRESULT OnDisconnect();
 
  private:
-  HRESULT PopulateSample(IMediaSample*, const vpx_image_t*);
+  // Reverse playback: a negative rate in NewSegment means the upstream
+  // splitter sends each group of pictures in decode order, the groups
+  // going back through the stream (see mkvparser::Stream::SetReverse).
+  // The decoded frames of a group are held here, and delivered last to
+  // first when the next group (or the end of the stream) arrives.  The
+  // frames held are bounded by Filter::Config::reverse_cache; the earliest
+  // are dropped first.
+  struct ReverseFrame {
+    std::vector<BYTE> buf;
+    vpx_image_t image;  // points into buf
+    REFERENCE_TIME start;
+    REFERENCE_TIME stop;
+    HRESULT time_status;  // of the input sample's GetTime
+    int filter_level;  // for asynchronous postprocessing
+  };
+
+  typedef std::list<ReverseFrame> reverse_frames_t;
+
+  void CacheReverseFrame(const vpx_image_t*, IMediaSample*);
+  HRESULT DeliverReverseFrames(CLockable::Lock&);
+  void ClearReverseFrames();
+
+  // Scrubbing: the frames decoded are kept in m_scrub_cache, keyed by
+  // the time in the stream, up to Filter::Config::scrub_cache.  A frame
+  // the cache has is presented without being decoded.  The decoder then
+  // falls behind the stream, so the frames it skipped since the last
+  // keyframe are kept, and decoded before the next frame the cache lacks.
+  typedef std::vector<std::vector<BYTE> > skipped_t;
+
+  // Returns false when the cache is off, in reverse, or with no time.
+  bool GetScrubTime(IMediaSample*, REFERENCE_TIME&) const;
+
+  // Returns false if the frame is to be decoded after all.
+  bool SkipDecode(IMediaSample*, const BYTE*, long);
+  void ClearSkipped();
 
-  static void CopyToPlanar(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out,
-                           const BITMAPINFOHEADER& bmih_out);
+  HRESULT PopulateSample(IMediaSample*, const vpx_image_t*);
 
-  static void CopyToPacked(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out, const RECT& rc_out,
-                           const BITMAPINFOHEADER& bmih_out);
+  // The frame to present for the input sample: from the scrub cache, or
+  // the one just decoded, which the cache then keeps.
+  const vpx_image_t* GetFrame(bool bCached, bool bScrub,
+                              REFERENCE_TIME scrub_time);
+
+  // Asynchronous postprocessing (Filter::Config::async_postproc): libvpx
+  // leaves the frames alone, and a worker thread postprocesses each one,
+  // and delivers it, while Receive decodes the next. Receive queues a
+  // copy of the frame, since libvpx reuses its buffers, in one of two
+  // slots, the worker having the other; it waits while the worker has
+  // yet to take the frame queued before. Frames delivered on the
+  // streaming thread (reverse playback) wait for the worker to finish,
+  // and are postprocessed where they are, so the stream stays in order.
+  struct PostprocFrame {
+    std::vector<BYTE> buf;
+    vpx_image_t image;  // points into buf
+    int filter_level;
+    REFERENCE_TIME start;
+    REFERENCE_TIME stop;
+    HRESULT time_status;
+    bool discontinuity;
+    unsigned int generation;  // m_generation when queued
+  };
+
+  void StartPostprocThread();
+  static unsigned __stdcall PostprocThreadProc(void*);
+  unsigned PostprocMain();
+  HRESULT DeliverPostprocFrame(PostprocFrame&);
+
+  // The postprocessing IVP8PostProcessing asks for, unless the quality
+  // ladder has turned it off.
+  vp8_postproc_cfg_t GetPostprocConfigLocked() const;
+
+  void QueuePostprocFrameLocked(const vpx_image_t*, IMediaSample*);
+
+  // Called, and returns, with the lock held (unless seizing it fails).
+  // Waits until the worker has taken the frame queued, and with |drain|,
+  // until it has delivered it too. Returns S_OK, unless streaming
+  // stopped, flushed or failed meanwhile.
+  HRESULT WaitPostprocLocked(CLockable::Lock&, bool drain);
+
+  // Return the width and height of the connected input stream, or 0 when
+  // unknown.
+  int GetFrameWidth() const;
+  int GetFrameHeight() const;
 
   // Manual DISALLOW_COPY_AND_ASSIGN.
   Inpin(const Inpin&);
   Inpin& operator=(const Inpin&);
 
+  // Receive decodes holding only the decoder lock, so that the control
+  // interfaces, BeginFlush and Stop don't wait behind the frame. Start,
+  // Stop and the postprocessing settings seize it too, after the filter
+  // lock, before they change m_ctx; the streaming thread's other uses of
+  // m_ctx need only the filter lock.
+  class DecoderLock : public CLockable {
+   public:
+    DecoderLock();
+  };
+
   bool m_bEndOfStream;
   bool m_bFlush;
+  DecoderLock m_decoder_lock;
   vpx_codec_ctx_t m_ctx;
+  webmdshow::VpxDecoderPool::Key m_decoder_key;  // m_ctx was borrowed for
+
+  // Bumped by BeginFlush and Stop, so that a Receive that decoded without
+  // the filter lock can tell that the stream moved on meanwhile.
+  unsigned int m_generation;
+
+  bool m_bReverse;
+  reverse_frames_t m_reverse_frames;
+  size_t m_reverse_bytes;
+
+  webmdshow::VpxFrameCache m_scrub_cache;
+  REFERENCE_TIME m_segment_start;
+  double m_segment_rate;
+  skipped_t m_skipped;
+  size_t m_skipped_bytes;
+
+  // The quality ladder level the decoder was last set up for.
+  int m_quality_level;
+
+  // A frame of a new size, scaled to the size of the output when that
+  // can't change with it (see Outpin::SetFrameSizeLocked).
+  vpx_image_t* m_scaled_frame;
+
+  // The loop filter level of the frame last decoded, which sets the
+  // strength of the asynchronous postprocessing.
+  int m_filter_level;
+
+  bool m_bPostprocAsync;
+  HANDLE m_hPostprocThread;
+  HANDLE m_hPostproc;  // a frame was queued, or stop requested
+  HANDLE m_hPostprocDone;  // the worker took or delivered a frame
+  PostprocFrame m_postproc_frames[2];
+  int m_postproc_next;  // the slot Receive fills next
+  bool m_postproc_pending;  // the worker has yet to take that slot
+  bool m_postproc_busy;  // the worker has the other
+  HRESULT m_postproc_status;  // the last delivery that failed, until a flush
+
+  // Postprocesses the reverse frames, on the streaming thread.
+  webmdshow::Vp8Postprocessor m_postprocessor;
 };
 
 }  // namespace VP8DecoderLib
@@ -16,6 +16,7 @@
 
 #include "cmediasample.h"
 #include "mediatypeutil.h"
+#include "videomediatype.h"
 #include "vp8decoderfilter.h"
 #include "vp8decoderoutpin.h"
 #include "webmtypes.h"
@@ -30,9 +31,28 @@ using std::hex;
 
 using std::wstring;
 
+namespace {
+
+bool IsRgb(const GUID& subtype) {
+  return (subtype == MEDIASUBTYPE_RGB32) || (subtype == MEDIASUBTYPE_RGB24);
+}
+
+// Returns the stride of an RGB DIB row: whole DWORDs.
+LONG GetRgbStride(const GUID& subtype, LONG width) {
+  const LONG bytes = (subtype == MEDIASUBTYPE_RGB32) ? 4 : 3;
+  return (bytes * width + 3) & ~3;
+}
+
+}  // namespace
+
 namespace VP8DecoderLib {
 
-Outpin::Outpin(Filter* pFilter) : Pin(pFilter, PINDIR_OUTPUT, L"output") {
+Outpin::Outpin(Filter* pFilter)
+    : Pin(pFilter, PINDIR_OUTPUT, L"output"),
+      m_pQualitySink(0),
+      m_bOwnAllocator(false),
+      m_scale_width(0),
+      m_scale_height(0) {
   SetDefaultMediaTypes();
 }
 
@@ -84,6 +104,9 @@ HRESULT Outpin::QueryInterface(const IID& iid, void** ppv) {
   else if (iid == __uuidof(IMediaSeeking))
     pUnk = static_cast<IMediaSeeking*>(this);
 
+  else if (iid == __uuidof(IQualityControl))
+    pUnk = static_cast<IQualityControl*>(this);
+
   else {
 #if 0
         wodbgstream os;
@@ -200,12 +223,16 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
 
   hr = pInputPin->GetAllocator(&pAllocator);
 
+  bool own_allocator = false;
+
   if (FAILED(hr)) {
     // hr = CMemAllocator::CreateInstance(&m_sample_factory, &pAllocator);
     hr = CMediaSample::CreateAllocator(&pAllocator);
 
     if (FAILED(hr))
       return VFW_E_NO_ALLOCATOR;
+
+    own_allocator = true;
   }
 
   assert(bool(pAllocator));
@@ -225,7 +252,9 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   LONG w, h;
   GetConnectionDimensions(w, h);
 
-  const long cbBuffer = 2 * w * h;
+  const GUID& subtype = m_connection_mtv[0].subtype;
+  const long cbBuffer =
+      IsRgb(subtype) ? GetRgbStride(subtype, w) * h : 2 * w * h;
 
   if (props.cbBuffer < cbBuffer)
     props.cbBuffer = cbBuffer;
@@ -249,6 +278,9 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   m_pPinConnection = pin;
   m_pAllocator = pAllocator;
   m_pInputPin = pInputPin;
+  m_bOwnAllocator = own_allocator;
+  m_scale_width = 0;
+  m_scale_height = 0;
 
   return S_OK;
 }
@@ -256,6 +288,7 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
 HRESULT Outpin::OnDisconnect() {
   m_pInputPin = 0;
   m_pAllocator = 0;
+  m_bOwnAllocator = false;
 
   return S_OK;
 }
@@ -287,6 +320,12 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
     __noop;
   else if (mt_query.subtype == MEDIASUBTYPE_YUYV)
     __noop;
+  else if (mt_query.subtype == MEDIASUBTYPE_RGB32)
+    __noop;
+  else if (mt_query.subtype == MEDIASUBTYPE_RGB24)
+    __noop;
+  else if (mt_query.subtype == WebmTypes::MEDIASUBTYPE_Y800)
+    __noop;
   else
     return S_FALSE;
 
@@ -308,15 +347,45 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
   if (mt_query.formattype == GUID_NULL)
     return S_OK;
 
-  const AM_MEDIA_TYPE& mt_in = inpin.m_connection_mtv[0];
+  // Once the type has changed, a renderer can ask again for every sample
+  // (the EVR does), so remember the last type vetted against this input.
+  if (!m_accepted_mtv.Empty() &&
+      MediaTypeUtil::Equal(m_accepted_mtv[0], mt_query))
+    return S_OK;
+
+  // Vet against the size of the frames being delivered, which after an
+  // in-band change is no longer the size the input was connected with.
+  VIDEOINFOHEADER vih_in =
+      reinterpret_cast<const VIDEOINFOHEADER&>(
+          *inpin.m_connection_mtv[0].pbFormat);
+
+  LONG w, h;
+
+  if (bool(m_pPinConnection) &&
+      webmdshow::GetVideoFrameSize(m_connection_mtv[0], &w, &h)) {
+    vih_in.bmiHeader.biWidth = w;
+    vih_in.bmiHeader.biHeight = h;
+  }
+
+  AM_MEDIA_TYPE mt_in = inpin.m_connection_mtv[0];
+  mt_in.cbFormat = sizeof vih_in;
+  mt_in.pbFormat = reinterpret_cast<BYTE*>(&vih_in);
+
+  HRESULT result;
 
   if (mt_query.formattype == FORMAT_VideoInfo)
-    return QueryAcceptVideoInfo(mt_in, mt_query);
+    result = QueryAcceptVideoInfo(mt_in, mt_query);
+  else if (mt_query.formattype == FORMAT_VideoInfo2)
+    result = QueryAcceptVideoInfo2(mt_in, mt_query);
+  else
+    return S_FALSE;
 
-  if (mt_query.formattype == FORMAT_VideoInfo2)
-    return QueryAcceptVideoInfo2(mt_in, mt_query);
+  if (result == S_OK) {
+    m_accepted_mtv.Clear();
+    m_accepted_mtv.Add(mt_query);
+  }
 
-  return S_FALSE;
+  return result;
 }
 
 HRESULT Outpin::QueryAcceptVideoInfo(const AM_MEDIA_TYPE& mt_in,
@@ -387,7 +456,9 @@ bool Outpin::VetBMIH(const VIDEOINFOHEADER& vih_in, const GUID& subtype_out,
   if (bmih_out.biSize != sizeof(BITMAPINFOHEADER))  // TODO: liberalize
     return false;
 
-  if (bmih_out.biCompression != subtype_out.Data1)
+  const bool rgb = IsRgb(subtype_out);
+
+  if (bmih_out.biCompression != (rgb ? BI_RGB : subtype_out.Data1))
     return false;
 
   const LONG stride_out = bmih_out.biWidth;
@@ -395,7 +466,9 @@ bool Outpin::VetBMIH(const VIDEOINFOHEADER& vih_in, const GUID& subtype_out,
   if (stride_out <= 0)
     return false;
 
-  if (stride_out % 2)
+  // Only the planar types with chroma need an even stride.
+  if ((stride_out % 2) && !rgb &&
+      (subtype_out != WebmTypes::MEDIASUBTYPE_Y800))
     return false;
 
   const LONG height_out = labs(bmih_out.biHeight);  // yes, negative OK
@@ -720,11 +793,49 @@ HRESULT Outpin::GetPreroll(LONGLONG* p) {
   return E_FAIL;
 }
 
+HRESULT Outpin::Notify(IBaseFilter*, Quality q) {
+  // Called by the renderer as it renders, so it mustn't wait for the
+  // filter lock, which the inpin may hold while it waits for the
+  // renderer to release a buffer.
+  if (m_pQualitySink)
+    return m_pQualitySink->Notify(m_pFilter, q);
+
+  if (m_pFilter->m_quality.OnQuality(q.Proportion, q.Late)) {
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp8dec::outpin::Notify: quality level="
+       << m_pFilter->m_quality.GetLevel() << endl;
+#endif
+  }
+
+  // Once we have shed all we can, the message goes upstream, so that the
+  // splitter can skip to the next keyframe without reading the frames
+  // we would only drop.
+  if (m_pFilter->m_quality.GetLevel() == webmdshow::QualityLadder::kLevelMax) {
+    const GraphUtil::IQualityControlPtr pQC(
+        m_pFilter->m_inpin.m_pPinConnection);
+
+    if (bool(pQC))
+      return pQC->Notify(m_pFilter, q);
+  }
+
+  return S_OK;
+}
+
+HRESULT Outpin::SetSink(IQualityControl* pSink) {
+  m_pQualitySink = pSink;
+  return S_OK;
+}
+
 HRESULT Outpin::GetName(PIN_INFO& info) const {
   wstring name;
 
   if (!bool(m_pPinConnection)) {
     name = L"YUV";
+  } else if (m_connection_mtv[0].subtype == MEDIASUBTYPE_RGB32) {
+    name = L"RGB32";
+  } else if (m_connection_mtv[0].subtype == MEDIASUBTYPE_RGB24) {
+    name = L"RGB24";
   } else {
     const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
     const char* p = (const char*)&mt.subtype.Data1;
@@ -764,6 +875,7 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
   assert(h > 0);
 
   m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
 
   // planar
 
@@ -795,6 +907,30 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
 
   AddPreferred(MEDIASUBTYPE_YVYU, vihIn.AvgTimePerFrame, w, h, dwBitCount,
                dwSizeImage);
+
+  // RGB, for renderers that take nothing else; bottom-up, as a DIB is
+  // unless biHeight is negative.
+
+  dwBitCount = 32;
+  dwSizeImage = GetRgbStride(MEDIASUBTYPE_RGB32, w) * h;
+
+  AddPreferred(MEDIASUBTYPE_RGB32, vihIn.AvgTimePerFrame, w, h, dwBitCount,
+               dwSizeImage);
+
+  dwBitCount = 24;
+  dwSizeImage = GetRgbStride(MEDIASUBTYPE_RGB24, w) * h;
+
+  AddPreferred(MEDIASUBTYPE_RGB24, vihIn.AvgTimePerFrame, w, h, dwBitCount,
+               dwSizeImage);
+
+  // Luma only, for analytics (motion detection, OCR), which ask for it by
+  // name; last, so that no renderer picks it.
+
+  dwBitCount = 8;
+  dwSizeImage = w * h;
+
+  AddPreferred(WebmTypes::MEDIASUBTYPE_Y800, vihIn.AvgTimePerFrame, w, h,
+               dwBitCount, dwSizeImage);
 }
 
 HRESULT Outpin::OnInpinDisconnect() {
@@ -816,7 +952,81 @@ HRESULT Outpin::OnInpinDisconnect() {
   return S_OK;
 }
 
-void Outpin::SetDefaultMediaTypes() { m_preferred_mtv.Clear(); }
+void Outpin::SetDefaultMediaTypes() {
+  m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
+}
+
+HRESULT Outpin::SetFrameSizeLocked(IMediaSample* pSample, LONG w, LONG h) {
+  assert(pSample);
+  assert(bool(m_pPinConnection));
+
+  if ((w == m_scale_width) && (h == m_scale_height))
+    return S_FALSE;
+
+  CMediaTypes mtv;
+
+  HRESULT hr =
+      webmdshow::ResizeVideoMediaType(m_connection_mtv[0], w, h, &mtv);
+
+  if (FAILED(hr))
+    return hr;
+
+  const AM_MEDIA_TYPE& mt = mtv[0];
+
+  hr = m_pPinConnection->QueryAccept(&mt);
+
+  if (hr != S_OK) {
+    m_scale_width = w;
+    m_scale_height = h;
+
+    return S_FALSE;
+  }
+
+  const long size = static_cast<long>(mt.lSampleSize);
+
+  if (pSample->GetSize() < size) {
+    if (m_bOwnAllocator) {
+      // Each sample gets a buffer of the new size the next time we get it,
+      // so the next frame can switch.
+      IMemAllocator* const pAllocator = m_pAllocator;
+
+      hr = static_cast<CMemAllocator*>(pAllocator)->GrowBuffers(size);
+
+      return FAILED(hr) ? hr : S_FALSE;
+    }
+
+    // A renderer's allocator makes buffers of the new size when its pin
+    // is reconnected with the type, and then attaches the type to a sample
+    // it gives us, which is how PopulateSample switches to it. Meanwhile,
+    // our QueryAccept has to take the type when downstream asks.
+    hr = m_pPinConnection->ReceiveConnection(this, &mt);
+
+    if (SUCCEEDED(hr)) {
+      m_accepted_mtv.Clear();
+      m_accepted_mtv.Add(mt);
+    }
+
+    m_scale_width = w;
+    m_scale_height = h;
+
+    return S_FALSE;
+  }
+
+  hr = pSample->SetMediaType(const_cast<AM_MEDIA_TYPE*>(&mt));
+
+  if (FAILED(hr))
+    return hr;
+
+  m_connection_mtv.Clear();
+  m_connection_mtv.Add(mt);
+
+  m_accepted_mtv.Clear();
+  m_scale_width = 0;
+  m_scale_height = 0;
+
+  return S_OK;
+}
 
 void Outpin::GetConnectionDimensions(LONG& w, LONG& h) const {
   assert(!m_connection_mtv.Empty());
@@ -889,7 +1099,7 @@ void Outpin::AddVIH(CMediaTypes& mtv, const GUID& subtype,
   bmih.biHeight = height;
   bmih.biPlanes = 1;  // because Microsoft says so
   bmih.biBitCount = static_cast<WORD>(dwBitCount);
-  bmih.biCompression = subtype.Data1;
+  bmih.biCompression = IsRgb(subtype) ? BI_RGB : subtype.Data1;
   bmih.biSizeImage = dwSizeImage;
   bmih.biXPelsPerMeter = 0;
   bmih.biYPelsPerMeter = 0;
@@ -940,7 +1150,7 @@ void Outpin::AddVIH2(CMediaTypes& mtv, const GUID& subtype,
   bmih.biHeight = height;
   bmih.biPlanes = 1;  // because Microsoft says so
   bmih.biBitCount = static_cast<WORD>(dwBitCount);
-  bmih.biCompression = subtype.Data1;
+  bmih.biCompression = IsRgb(subtype) ? BI_RGB : subtype.Data1;
   bmih.biSizeImage = dwSizeImage;
   bmih.biXPelsPerMeter = 0;
   bmih.biYPelsPerMeter = 0;
@@ -16,7 +16,7 @@
 namespace VP8DecoderLib {
 class Filter;
 
-class Outpin : public Pin, public IMediaSeeking {
+class Outpin : public Pin, public IMediaSeeking, public IQualityControl {
  public:
   explicit Outpin(Filter*);
   virtual ~Outpin();
@@ -63,6 +63,10 @@ class Outpin : public Pin, public IMediaSeeking {
   HRESULT STDMETHODCALLTYPE GetRate(double*);
   HRESULT STDMETHODCALLTYPE GetPreroll(LONGLONG*);
 
+  // IQualityControl
+  HRESULT STDMETHODCALLTYPE Notify(IBaseFilter*, Quality);
+  HRESULT STDMETHODCALLTYPE SetSink(IQualityControl*);
+
   // local functions
   GraphUtil::IMemInputPinPtr m_pInputPin;
   GraphUtil::IMemAllocatorPtr m_pAllocator;
@@ -70,6 +74,14 @@ class Outpin : public Pin, public IMediaSeeking {
   void OnInpinConnect(const AM_MEDIA_TYPE&);
   HRESULT OnInpinDisconnect();
 
+  // Switches the output, in band, to frames of w x h, when the stream
+  // changes resolution: downstream is asked to accept the resized type,
+  // which is attached to |sample|. Returns S_FALSE when |sample| can't
+  // carry frames of that size, in which case its frame is scaled to the
+  // current size; if its buffer was too small, the buffers to come are
+  // made bigger.
+  HRESULT SetFrameSizeLocked(IMediaSample* sample, LONG w, LONG h);
+
   HRESULT Start();  // from stopped to running/paused
   void Stop();  // from running/paused to stopped
 
@@ -81,6 +93,10 @@ class Outpin : public Pin, public IMediaSeeking {
   Outpin(const Outpin&);
   Outpin& operator=(const Outpin&);
 
+  // When set, quality messages go here instead of to our quality ladder.
+  // Not AddRef'd, as IQualityControl::SetSink requires.
+  IQualityControl* m_pQualitySink;
+
   void SetDefaultMediaTypes();
 
   static HRESULT QueryAcceptVideoInfo(const AM_MEDIA_TYPE& mt_in,
@@ -105,6 +121,20 @@ class Outpin : public Pin, public IMediaSeeking {
   static void AddVIH2(CMediaTypes&, const GUID& subtype,
                       REFERENCE_TIME AvgTimePerFrame, LONG width, LONG height,
                       DWORD dwBitCount, DWORD dwSizeImage);
+
+  // The last type with a format block that QueryAccept accepted, while
+  // the inpin has its current connection.
+  CMediaTypes m_accepted_mtv;
+
+  // True when m_pAllocator is a CMemAllocator that we created, whose
+  // buffers can grow.
+  bool m_bOwnAllocator;
+
+  // A frame size SetFrameSizeLocked gave up on (downstream refused it, or
+  // will attach it to a sample of its own), so frames of this size are
+  // scaled without asking again.
+  LONG m_scale_width;
+  LONG m_scale_height;
 };
 
 }  // end namespace VP8DecoderLib
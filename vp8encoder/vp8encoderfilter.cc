@@ -81,9 +81,15 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_outpin_video(this),
       m_outpin_preview(this),
       m_bDirty(false),
+      m_counters(L"vp8enc"),
       m_bForceKeyframe(false),
       m_keyframe_interval(0),
-      m_decimate(0)
+      m_decimate(0),
+      m_input_queue_length(2),
+      m_input_queue_policy(kInputQueueBlock),
+      m_bAdaptiveRealtime(false),
+      m_max_duplicate_skip(0),
+      m_temporal_layer_count(0)
 {
     m_pClassFactory->LockServer(TRUE);
 
@@ -113,6 +119,12 @@ Filter::~Filter()
     os << "vp8enc::filter::dtor" << endl;
 #endif
 
+    while (!m_simulcast.empty())
+    {
+        delete m_simulcast.back();
+        m_simulcast.pop_back();
+    }
+
     m_pClassFactory->LockServer(FALSE);
 }
 
@@ -192,6 +204,10 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<IPersistStream*>(m_pFilter);
     }
+    else if (iid == __uuidof(IVPXEncoder2))
+    {
+        pUnk = static_cast<IVPXEncoder2*>(m_pFilter);
+    }
     else if (iid == __uuidof(IVPXEncoder))
     {
         pUnk = static_cast<IVPXEncoder*>(m_pFilter);
@@ -204,6 +220,10 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<ISpecifyPropertyPages*>(m_pFilter);
     }
+    else if (iid == __uuidof(IPipelineCounters))
+    {
+        pUnk = static_cast<IPipelineCounters*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -292,6 +312,21 @@ HRESULT Filter::Stop()
         case State_Running:
             m_state = State_Stopped;
             OnStop();    //decommit outpin's allocator
+
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            //Now wait for the encode thread to terminate.
+            m_inpin.StopThread();
+
+            //The rendition threads never seize the filter lock.
+
+            hr = lock.Seize(this);
+            assert(SUCCEEDED(hr));  //TODO
+
+            for (size_t i = 0; i < m_simulcast.size(); ++i)
+                m_simulcast[i]->StopThread();
+
             break;
 
         case State_Stopped:
@@ -449,14 +484,19 @@ HRESULT Filter::EnumPins(IEnumPins** pp)
     if (FAILED(hr))
         return hr;
 
-    IPin* pins[3] =
-    {
-        &m_inpin,
-        &m_outpin_video,
-        &m_outpin_preview
-    };
+    const ULONG n = 3 + static_cast<ULONG>(m_simulcast.size());
+
+    const size_t cb = n * sizeof(IPin*);
+    IPin** const pins = (IPin**)_alloca(cb);
+
+    pins[0] = &m_inpin;
+    pins[1] = &m_outpin_video;
+    pins[2] = &m_outpin_preview;
 
-    return CEnumPins::CreateInstance(pins, 3, pp);
+    for (ULONG i = 3; i < n; ++i)
+        pins[i] = m_simulcast[i - 3];
+
+    return CEnumPins::CreateInstance(pins, n, pp);
 }
 
 
@@ -474,16 +514,28 @@ HRESULT Filter::FindPin(
     if (id1 == 0)
         return E_INVALIDARG;
 
-    Pin* pins[3] =
-    {
-        &m_inpin,
-        &m_outpin_video,
-        &m_outpin_preview
-    };
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    const ULONG n = 3 + static_cast<ULONG>(m_simulcast.size());
+
+    const size_t cb = n * sizeof(Pin*);
+    Pin** const pins = (Pin**)_alloca(cb);
+
+    pins[0] = &m_inpin;
+    pins[1] = &m_outpin_video;
+    pins[2] = &m_outpin_preview;
+
+    for (ULONG i = 3; i < n; ++i)
+        pins[i] = m_simulcast[i - 3];
 
     Pin** iter = pins;
 
-    for (int i = 0; i < 3; ++i)
+    for (ULONG i = 0; i < n; ++i)
     {
         Pin* const pin = *iter++;
 
@@ -1387,6 +1439,11 @@ HRESULT Filter::SetPassMode(VP8PassMode m)
     if (m == tgt)  //no need for any other checks
         return S_OK;
 
+    //The renditions are not encoded in the first pass.
+
+    if ((m == kPassModeFirstPass) && IsSimulcastConnected())
+        return VFW_E_ALREADY_CONNECTED;
+
     OutpinVideo& outpin = m_outpin_video;
 
     hr = outpin.OnSetPassMode(m);
@@ -1864,6 +1921,9 @@ HRESULT Filter::SetDecimate(int decimate)
     if (m_outpin_video.m_pPinConnection || m_outpin_preview.m_pPinConnection)
         return VFW_E_ALREADY_CONNECTED;
 
+    if (IsSimulcastConnected())
+        return VFW_E_ALREADY_CONNECTED;
+
     if (decimate < 2)
         decimate = 1;
 
@@ -1880,6 +1940,14 @@ HRESULT Filter::SetDecimate(int decimate)
     if (FAILED(hr))
         return hr;
 
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+    {
+        hr = m_simulcast[i]->SetAvgTimePerFrame(avg_time_per_frame);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
     m_decimate = decimate;
     m_bDirty = true;
 
@@ -1921,7 +1989,8 @@ HRESULT Filter::SetEncoderKind(VPXEncoderKind encoder_kind)
 
     if (bool(m_inpin.m_pPinConnection) ||
         bool(m_outpin_video.m_pPinConnection) ||
-        bool (m_outpin_preview.m_pPinConnection))
+        bool (m_outpin_preview.m_pPinConnection) ||
+        IsSimulcastConnected())
     {
         return VFW_E_ALREADY_CONNECTED;
     }
@@ -1932,6 +2001,9 @@ HRESULT Filter::SetEncoderKind(VPXEncoderKind encoder_kind)
     m_outpin_video.SetDefaultMediaTypes();
     m_outpin_preview.SetDefaultMediaTypes();
 
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+        m_simulcast[i]->SetDefaultMediaTypes();
+
     return S_OK;
 }
 
@@ -1953,6 +2025,593 @@ HRESULT Filter::GetEncoderKind(VPXEncoderKind* pEncoderKind)
 }
 
 
+HRESULT Filter::SetInputQueueLength(int length)
+{
+    if (length < 1)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_input_queue_length = length;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetInputQueueLength(int* pLength)
+{
+    if (pLength == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pLength = m_input_queue_length;
+    return S_OK;
+}
+
+
+HRESULT Filter::SetInputQueuePolicy(VPXInputQueuePolicy policy)
+{
+    switch (policy)
+    {
+        case kInputQueueBlock:
+        case kInputQueueDropOldest:
+        case kInputQueueDropNewest:
+            break;
+
+        default:
+            return E_INVALIDARG;
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_input_queue_policy = policy;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetInputQueuePolicy(VPXInputQueuePolicy* pPolicy)
+{
+    if (pPolicy == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pPolicy = m_input_queue_policy;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetInputQueueStats(
+    LONGLONG* pQueued,
+    LONGLONG* pDropped,
+    LONGLONG* pBlocked)
+{
+    if ((pQueued == 0) || (pDropped == 0) || (pBlocked == 0))
+        return E_POINTER;
+
+    //No lock: the counts are atomic (each is exact, though they may be
+    //read either side of a sample).
+
+    *pQueued = m_inpin.m_queued_count;
+    *pDropped = m_inpin.m_dropped_count;
+    *pBlocked = m_inpin.m_blocked_count;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetInputFrameStats(
+    LONGLONG* pWrapped,
+    LONGLONG* pConverted)
+{
+    if ((pWrapped == 0) || (pConverted == 0))
+        return E_POINTER;
+
+    //No lock, as for GetInputQueueStats.
+
+    *pWrapped = m_inpin.m_wrapped_count;
+    *pConverted = m_inpin.m_converted_count;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetSimulcastCount(int count)
+{
+    if ((count < 0) || (count > kMaxSimulcastCount))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    const size_t n = static_cast<size_t>(count);
+
+    for (size_t i = n; i < m_simulcast.size(); ++i)
+    {
+        const OutpinSimulcast* const pPin = m_simulcast[i];
+
+        if (bool(pPin->m_pPinConnection))
+            return VFW_E_ALREADY_CONNECTED;
+
+        if (pPin->IsEncoding())  //Stop has yet to join its thread
+            return VFW_E_NOT_STOPPED;
+    }
+
+    while (m_simulcast.size() > n)
+    {
+        delete m_simulcast.back();
+        m_simulcast.pop_back();
+    }
+
+    while (m_simulcast.size() < n)
+    {
+        const int index = static_cast<int>(m_simulcast.size());
+
+        OutpinSimulcast* const pPin =
+            new (std::nothrow) OutpinSimulcast(this, index);
+
+        if (pPin == 0)
+            return E_OUTOFMEMORY;
+
+        if (bool(m_inpin.m_pPinConnection))
+            pPin->OnInpinConnect();
+        else
+            pPin->SetDefaultMediaTypes();
+
+        m_simulcast.push_back(pPin);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetSimulcastCount(int* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pCount = static_cast<int>(m_simulcast.size());
+    return S_OK;
+}
+
+
+HRESULT Filter::SetSimulcastRendition(
+    int index,
+    int width,
+    int height,
+    int target_bitrate)
+{
+    if ((width < 0) || (height < 0))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if ((index < 0) || (size_t(index) >= m_simulcast.size()))
+        return E_INVALIDARG;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    OutpinSimulcast* const pPin = m_simulcast[index];
+
+    const bool bResize = (width != pPin->m_width) || (height != pPin->m_height);
+
+    if (bResize && bool(pPin->m_pPinConnection))
+        return VFW_E_ALREADY_CONNECTED;
+
+    pPin->m_width = width;
+    pPin->m_height = height;
+    pPin->m_target_bitrate = target_bitrate;
+
+    if (bResize && bool(m_inpin.m_pPinConnection))
+        pPin->OnInpinConnect();  //preferred media types have the size
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetSimulcastRendition(
+    int index,
+    int* pWidth,
+    int* pHeight,
+    int* pTargetBitrate)
+{
+    if ((pWidth == 0) || (pHeight == 0) || (pTargetBitrate == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if ((index < 0) || (size_t(index) >= m_simulcast.size()))
+        return E_INVALIDARG;
+
+    const OutpinSimulcast* const pPin = m_simulcast[index];
+
+    *pWidth = pPin->m_width;
+    *pHeight = pPin->m_height;
+    *pTargetBitrate = pPin->m_target_bitrate;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetFirstPassStats(
+    const BYTE** pbuf,
+    LONGLONG* plen,
+    LONGLONG* precsize)
+{
+    if (pbuf)
+        *pbuf = 0;
+
+    if (plen)
+        *plen = 0;
+
+    if (precsize)
+        *precsize = 0;
+
+    if ((pbuf == 0) || (plen == 0) || (precsize == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    const OutpinVideo::stats_t& stats = m_outpin_video.m_stats;
+
+    if (stats.empty())
+        return S_FALSE;
+
+    *pbuf = &stats[0];
+    *plen = stats.size();
+    *precsize = m_outpin_video.m_stats_record_size;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetAdaptiveRealtime(int enable)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_bAdaptiveRealtime = (enable != 0);
+    return S_OK;
+}
+
+
+HRESULT Filter::GetAdaptiveRealtime(int* pEnable)
+{
+    if (pEnable == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pEnable = m_bAdaptiveRealtime ? 1 : 0;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetAdaptiveRealtimeState(int* pDeadline, int* pCPUUsed)
+{
+    if ((pDeadline == 0) || (pCPUUsed == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDeadline = static_cast<int>(m_inpin.m_rt_deadline);
+    *pCPUUsed = m_inpin.m_rt_cpu_used;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetEncodeTimeHistogram(int count, LONGLONG* counts)
+{
+    if (counts == 0)
+        return E_POINTER;
+
+    if (count < kEncodeTimeBucketCount)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    for (int i = 0; i < kEncodeTimeBucketCount; ++i)
+        counts[i] = m_inpin.m_encode_time_counts[i];
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetPreviewDecimation(int max_fps, int max_width)
+{
+    if ((max_fps < 0) || (max_width < 0))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    OutpinPreview& pin = m_outpin_preview;
+
+    const bool bResize = (max_width != pin.m_max_width);
+
+    if (bResize && bool(pin.m_pPinConnection))
+        return VFW_E_ALREADY_CONNECTED;
+
+    if (max_fps != pin.m_max_fps)
+    {
+        pin.m_max_fps = max_fps;
+        pin.m_next_time = -1;  //start over with the next frame
+    }
+
+    pin.m_max_width = max_width;
+
+    if (bResize && bool(m_inpin.m_pPinConnection))
+        pin.OnInpinConnect();  //preferred media types have the size
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetPreviewDecimation(int* pMaxFrameRate, int* pMaxWidth)
+{
+    if ((pMaxFrameRate == 0) || (pMaxWidth == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pMaxFrameRate = m_outpin_preview.m_max_fps;
+    *pMaxWidth = m_outpin_preview.m_max_width;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetDuplicateFrameSkip(int max_skipped)
+{
+    if (max_skipped < 0)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_max_duplicate_skip = max_skipped;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetDuplicateFrameSkip(int* pMaxSkipped)
+{
+    if (pMaxSkipped == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pMaxSkipped = m_max_duplicate_skip;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetDuplicateFrameCount(LONGLONG* pSkipped)
+{
+    if (pSkipped == 0)
+        return E_POINTER;
+
+    //No lock, as for GetInputQueueStats.
+
+    *pSkipped = m_inpin.m_skipped_count;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetTemporalLayers(int count, const int* bitrates)
+{
+    if ((count < 0) || (count > kMaxTemporalLayers))
+        return E_INVALIDARG;
+
+    if (count >= 2)
+    {
+        if (bitrates == 0)
+            return E_POINTER;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int prev = (i > 0) ? bitrates[i - 1] : 0;
+
+            if (bitrates[i] <= prev)
+                return E_INVALIDARG;
+        }
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_temporal_layer_count = (count >= 2) ? count : 0;
+
+    for (int i = 0; i < m_temporal_layer_count; ++i)
+        m_temporal_layer_bitrates[i] = bitrates[i];
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetTemporalLayers(int* pCount, int* bitrates)
+{
+    if ((pCount == 0) || (bitrates == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pCount = m_temporal_layer_count;
+
+    for (int i = 0; i < kMaxTemporalLayers; ++i)
+    {
+        if (i < m_temporal_layer_count)
+            bitrates[i] = m_temporal_layer_bitrates[i];
+        else
+            bitrates[i] = 0;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetFrameStatsCapacity(int capacity)
+{
+    if ((capacity < 0) || (capacity > kMaxFrameStatsCapacity))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    return m_inpin.SetFrameStatsCapacity(capacity);
+}
+
+
+HRESULT Filter::GetFrameStatsCapacity(int* pCapacity)
+{
+    if (pCapacity == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pCapacity = m_inpin.GetFrameStatsCapacity();
+    return S_OK;
+}
+
+
+HRESULT Filter::GetFrameStats(
+    int count,
+    VPXFrameStats* stats,
+    int* pCount,
+    LONGLONG* pLost)
+{
+    if (count < 0)
+        return E_INVALIDARG;
+
+    if (((count > 0) && (stats == 0)) || (pCount == 0) || (pLost == 0))
+        return E_POINTER;
+
+    //No lock: the encode thread writes the ring without one, and we are
+    //its only reader.
+
+    *pCount = m_inpin.GetFrameStats(stats, count);
+    *pLost = m_inpin.m_frame_stats_lost;
+
+    return S_OK;
+}
+
+
 HRESULT Filter::IsDirty()
 {
     Lock lock;
@@ -1983,7 +2642,8 @@ HRESULT Filter::Load(IStream* pStream)
 
     if (bool(m_inpin.m_pPinConnection) ||
         bool(m_outpin_video.m_pPinConnection) ||
-        bool(m_outpin_preview.m_pPinConnection))
+        bool(m_outpin_preview.m_pPinConnection) ||
+        IsSimulcastConnected())
     {
         return VFW_E_ALREADY_CONNECTED;
     }
@@ -2021,6 +2681,9 @@ HRESULT Filter::Load(IStream* pStream)
     m_outpin_video.SetDefaultMediaTypes();
     m_outpin_preview.SetDefaultMediaTypes();
 
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+        m_simulcast[i]->SetDefaultMediaTypes();
+
     return S_OK;
 }
 
@@ -2092,6 +2755,8 @@ HRESULT Filter::OnStart()
     if (FAILED(hr))
     {
         m_inpin.Stop();
+        m_inpin.StopThread();  //no thread yet; destroys encoder
+
         return hr;
     }
 
@@ -2101,19 +2766,72 @@ HRESULT Filter::OnStart()
     {
         m_outpin_video.Stop();
         m_inpin.Stop();
+        m_inpin.StopThread();  //no thread yet; destroys encoder
 
         return hr;
     }
 
+    //The renditions copy the encoder configuration from the inpin, so
+    //they start after it.
+
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+    {
+        OutpinSimulcast* const pPin = m_simulcast[i];
+
+        hr = pPin->Start();
+
+        if (SUCCEEDED(hr))
+            hr = pPin->StartEncoder();
+
+        if (FAILED(hr))
+        {
+            for (size_t j = 0; j <= i; ++j)
+            {
+                m_simulcast[j]->Stop();
+                m_simulcast[j]->StopThread();  //no thread yet
+            }
+
+            m_outpin_preview.Stop();
+            m_outpin_video.Stop();
+            m_inpin.Stop();
+            m_inpin.StopThread();  //no thread yet; destroys encoder
+
+            return hr;
+        }
+    }
+
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+        m_simulcast[i]->StartThread();
+
+    m_inpin.StartThread();
+
     return S_OK;
 }
 
 
 void Filter::OnStop()
 {
+    //Stop inpin first, to signal the encode thread to terminate.  Decommitting
+    //the outpins' allocators releases the thread if it waits for a buffer.
+
+    m_inpin.Stop();
     m_outpin_preview.Stop();
     m_outpin_video.Stop();
-    m_inpin.Stop();
+
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+        m_simulcast[i]->Stop();
+}
+
+
+bool Filter::IsSimulcastConnected() const
+{
+    for (size_t i = 0; i < m_simulcast.size(); ++i)
+    {
+        if (bool(m_simulcast[i]->m_pPinConnection))
+            return true;
+    }
+
+    return false;
 }
 
 
@@ -2154,4 +2872,35 @@ HRESULT Filter::GetPages(CAUUID* p)
 }
 
 
+HRESULT Filter::GetStageCount(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    *pCount = 1;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetStage(ULONG index, Stats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    if (index != 0)
+        return E_INVALIDARG;
+
+    //The counters are read without the filter lock.
+    m_counters.GetStats(pStats);
+    return S_OK;
+}
+
+
+HRESULT Filter::ResetStages()
+{
+    m_counters.Reset();
+    return S_OK;
+}
+
+
 }  //end namespace VP8EncoderLib
@@ -9,19 +9,24 @@
 #pragma once
 #include <strmif.h>
 #include <string>
+#include <vector>
 #include "clockable.h"
+#include "ipipelinecounters.h"
+#include "pipelinecounters.h"
 #include "vp8encoderinpin.h"
 #include "vp8encoderoutpinvideo.h"
 #include "vp8encoderoutpinpreview.h"
+#include "vp8encoderoutpinsimulcast.h"
 #include "vp8encoderidl.h"
 
 namespace VP8EncoderLib
 {
 
 class Filter : public IBaseFilter,
-               public IVPXEncoder,
+               public IVPXEncoder2,
                public IPersistStream,
                public ISpecifyPropertyPages,
+               public IPipelineCounters,
                public CLockable
 {
     friend HRESULT CreateFilter(
@@ -175,6 +180,59 @@ public:
     HRESULT STDMETHODCALLTYPE SetEncoderKind(VPXEncoderKind);
     HRESULT STDMETHODCALLTYPE GetEncoderKind(VPXEncoderKind*);
 
+    //IVPXEncoder2
+
+    HRESULT STDMETHODCALLTYPE SetInputQueueLength(int);
+    HRESULT STDMETHODCALLTYPE GetInputQueueLength(int*);
+
+    HRESULT STDMETHODCALLTYPE SetInputQueuePolicy(VPXInputQueuePolicy);
+    HRESULT STDMETHODCALLTYPE GetInputQueuePolicy(VPXInputQueuePolicy*);
+
+    HRESULT STDMETHODCALLTYPE GetInputQueueStats(
+        LONGLONG*,
+        LONGLONG*,
+        LONGLONG*);
+
+    HRESULT STDMETHODCALLTYPE GetInputFrameStats(LONGLONG*, LONGLONG*);
+
+    HRESULT STDMETHODCALLTYPE SetSimulcastCount(int);
+    HRESULT STDMETHODCALLTYPE GetSimulcastCount(int*);
+
+    HRESULT STDMETHODCALLTYPE SetSimulcastRendition(int, int, int, int);
+    HRESULT STDMETHODCALLTYPE GetSimulcastRendition(int, int*, int*, int*);
+
+    HRESULT STDMETHODCALLTYPE GetFirstPassStats(
+        const BYTE**,
+        LONGLONG*,
+        LONGLONG*);
+
+    HRESULT STDMETHODCALLTYPE SetAdaptiveRealtime(int);
+    HRESULT STDMETHODCALLTYPE GetAdaptiveRealtime(int*);
+
+    HRESULT STDMETHODCALLTYPE GetAdaptiveRealtimeState(int*, int*);
+
+    HRESULT STDMETHODCALLTYPE GetEncodeTimeHistogram(int, LONGLONG*);
+
+    HRESULT STDMETHODCALLTYPE SetPreviewDecimation(int, int);
+    HRESULT STDMETHODCALLTYPE GetPreviewDecimation(int*, int*);
+
+    HRESULT STDMETHODCALLTYPE SetDuplicateFrameSkip(int);
+    HRESULT STDMETHODCALLTYPE GetDuplicateFrameSkip(int*);
+
+    HRESULT STDMETHODCALLTYPE GetDuplicateFrameCount(LONGLONG*);
+
+    HRESULT STDMETHODCALLTYPE SetTemporalLayers(int, const int*);
+    HRESULT STDMETHODCALLTYPE GetTemporalLayers(int*, int*);
+
+    HRESULT STDMETHODCALLTYPE SetFrameStatsCapacity(int);
+    HRESULT STDMETHODCALLTYPE GetFrameStatsCapacity(int*);
+
+    HRESULT STDMETHODCALLTYPE GetFrameStats(
+        int,
+        VPXFrameStats*,
+        int*,
+        LONGLONG*);
+
     //IPersistStream
 
     HRESULT STDMETHODCALLTYPE IsDirty();
@@ -186,6 +244,12 @@ public:
 
     HRESULT STDMETHODCALLTYPE GetPages(CAUUID*);
 
+    //IPipelineCounters
+
+    HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*);
+    HRESULT STDMETHODCALLTYPE ResetStages();
+
 private:
     class CNondelegating : public IUnknown
     {
@@ -220,6 +284,15 @@ public:
     OutpinPreview m_outpin_preview;
     bool m_bDirty;
 
+    enum { kMaxSimulcastCount = 8 };
+
+    typedef std::vector<OutpinSimulcast*> simulcast_t;
+    simulcast_t m_simulcast;  //extra video outpins, after the preview pin
+
+    //Frames in, and frames out of the video outpin; the queue depth is
+    //that of the inpin's input queue.
+    webmdshow::PipelineCounters m_counters;
+
     struct Config
     {
         typedef __int32 int32_t;
@@ -266,11 +339,18 @@ public:
     bool m_bForceKeyframe;
     REFERENCE_TIME m_keyframe_interval;
     int m_decimate;
+    int m_input_queue_length;
+    VPXInputQueuePolicy m_input_queue_policy;
+    bool m_bAdaptiveRealtime;
+    int m_max_duplicate_skip;  //0 disables duplicate frame skipping
+    int m_temporal_layer_count;  //0 or 1 means no layers
+    int m_temporal_layer_bitrates[kMaxTemporalLayers];
     VP8PassMode GetPassMode() const;
 
 private:
     HRESULT OnStart();
     void OnStop();
+    bool IsSimulcastConnected() const;
 
 };
 
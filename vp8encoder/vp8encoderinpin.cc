@@ -11,12 +11,18 @@
 #include "vp8encoderoutpin.h"
 #include "mediatypeutil.h"
 #include "webmtypes.h"
+#include "libyuv_util.h"
+#include "encoderthreadbudget.h"
+#include "encoderlookahead.h"
 #include "vpx/vp8cx.h"
 #include <vfwmsgs.h>
 #include <uuids.h>
 #include <cassert>
 #include <amvideo.h>   //VideoInfoHeader
 #include <dvdmedia.h>  //VideoInfoHeader2
+#include <process.h>
+#include <algorithm>
+#include <new>
 #ifdef _DEBUG
 #include "odbgstream.h"
 #include <iomanip>
@@ -28,17 +34,120 @@ using std::dec;
 namespace VP8EncoderLib
 {
 
+//The temporal layer patterns, as in the examples of libvpx.  Every frame
+//refers to the last frame of layer 0 (LAST); in the pattern of 3 layers,
+//the second frame of layer 2 refers to the frame of layer 1 (GOLDEN) as
+//well.  Only layer 0 updates LAST, and only layer 1 GOLDEN, and the upper
+//layers leave the entropy contexts alone, so that dropping them leaves
+//the layers below as they were.
+
+struct TemporalLayerPattern
+{
+    unsigned int period;
+    unsigned int layer_id[4];
+    unsigned int rate_decimator[kMaxTemporalLayers];
+    vpx_enc_frame_flags_t flags[4];
+};
+
+static const vpx_enc_frame_flags_t kLayerNoRef =
+    VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF;
+
+static const vpx_enc_frame_flags_t kLayerNoUpdate =
+    VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF |
+    VP8_EFLAG_NO_UPD_ENTROPY;
+
+static const TemporalLayerPattern s_layer_patterns[2] =
+{
+    {
+        2,
+        { 0, 1 },
+        { 2, 1 },
+        {
+            kLayerNoRef | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF,
+            kLayerNoRef | kLayerNoUpdate
+        }
+    },
+    {
+        4,
+        { 0, 2, 1, 2 },
+        { 4, 2, 1 },
+        {
+            kLayerNoRef | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF,
+            kLayerNoRef | kLayerNoUpdate,
+            kLayerNoRef | (kLayerNoUpdate & ~VP8_EFLAG_NO_UPD_GF),
+            VP8_EFLAG_NO_REF_ARF | kLayerNoUpdate
+        }
+    }
+};
+
+
+static const TemporalLayerPattern& GetLayerPattern(int count)
+{
+    assert(count >= 2);
+    assert(count <= kMaxTemporalLayers);
+
+    return s_layer_patterns[count - 2];
+}
+
+
 Inpin::Inpin(Filter* p) :
     Pin(p, PINDIR_INPUT, L"input"),
     m_bEndOfStream(false),
     m_bFlush(false),
-    m_bDiscontinuity(true),
-    m_buf(0),
-    m_buflen(0),
+    m_img(0),
+    m_img_buf(0),
+    m_img_capacity(0),
     m_last_keyframe_time(0),
     m_frames_received(0),
-    m_decimate_start_time(0)
+    m_decimate_start_time(0),
+    m_duplicate_run(0),
+    m_layer_count(0),
+    m_layer_index(0),
+    m_layer(-1),
+    m_queued_count(0),
+    m_dropped_count(0),
+    m_blocked_count(0),
+    m_wrapped_count(0),
+    m_converted_count(0),
+    m_skipped_count(0),
+    m_frame_stats_lost(0),
+    m_frame_stats(0),
+    m_rt_cpu_used(0),
+    m_rt_deadline(kDeadlineGoodQuality),
+    m_rt_base_cpu_used(0),
+    m_cpu_used_applied(0),
+    m_rt_load(0),
+    m_rt_settle(0),
+    m_budget_id(0),
+    m_budget_generation(0),
+    m_lookahead_id(0),
+    m_lookahead_generation(0),
+    m_bActiveMap(false),
+    m_bRoiMap(false),
+    m_hThread(0),
+    m_bBusy(false),
+    m_hrDeliver(S_OK)
 {
+    m_hSamples = CreateEvent(0, 0, 0, 0);
+    assert(m_hSamples);
+
+    m_hSpace = CreateEvent(0, 0, 0, 0);
+    assert(m_hSpace);
+
+    m_hIdle = CreateEvent(0, 1, 1, 0);  //manual-reset, signalled
+    assert(m_hIdle);
+
+    for (int i = 0; i < kEncodeTimeBucketCount; ++i)
+        m_encode_time_counts[i] = 0;
+
+    LARGE_INTEGER freq;
+
+    const BOOL bFreq = QueryPerformanceFrequency(&freq);
+    bFreq;
+    assert(bFreq);
+
+    m_perf_freq = freq.QuadPart;
+
     AM_MEDIA_TYPE mt;
 
     mt.majortype = MEDIATYPE_Video;
@@ -56,19 +165,55 @@ Inpin::Inpin(Filter* p) :
     mt.subtype = WebmTypes::MEDIASUBTYPE_I420;
     m_preferred_mtv.Add(mt);
 
+    mt.subtype = MEDIASUBTYPE_NV12;
+    m_preferred_mtv.Add(mt);
+
     mt.subtype = MEDIASUBTYPE_YUY2;
     m_preferred_mtv.Add(mt);
 
     mt.subtype = MEDIASUBTYPE_YUYV;
     m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_UYVY;
+    m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_YVYU;
+    m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_RGB32;
+    m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_RGB24;
+    m_preferred_mtv.Add(mt);
 }
 
 
 Inpin::~Inpin()
 {
-    PurgePending();
+    assert(m_hThread == 0);
+
+    PurgeSamples();
+
+    FreeImage();
+
+    delete m_frame_stats;
 
-    delete[] m_buf;
+    BOOL b = CloseHandle(m_hSamples);
+    assert(b);
+
+    b = CloseHandle(m_hSpace);
+    assert(b);
+
+    b = CloseHandle(m_hIdle);
+    assert(b);
+}
+
+
+Inpin::EncoderLock::EncoderLock()
+{
+    const HRESULT hr = CLockable::Init();
+    hr;
+    assert(SUCCEEDED(hr));
 }
 
 
@@ -131,7 +276,9 @@ HRESULT Inpin::QueryInternalConnections(
     if (FAILED(hr))
         return hr;
 
-    const ULONG m = 2;  //number of output pins
+    const Filter::simulcast_t& simulcast = m_pFilter->m_simulcast;
+
+    const ULONG m = 2 + ULONG(simulcast.size());  //number of output pins
 
     ULONG& n = *pn;
 
@@ -164,6 +311,12 @@ HRESULT Inpin::QueryInternalConnections(
     pa[1] = &m_pFilter->m_outpin_preview;
     pa[1]->AddRef();
 
+    for (ULONG i = 2; i < m; ++i)
+    {
+        pa[i] = simulcast[i - 2];
+        pa[i]->AddRef();
+    }
+
     n = m;
     return S_OK;
 }
@@ -211,6 +364,11 @@ HRESULT Inpin::ReceiveConnection(
     m_pFilter->m_outpin_video.OnInpinConnect();
     m_pFilter->m_outpin_preview.OnInpinConnect();
 
+    const Filter::simulcast_t& simulcast = m_pFilter->m_simulcast;
+
+    for (size_t i = 0; i < simulcast.size(); ++i)
+        simulcast[i]->OnInpinConnect();
+
     return S_OK;
 }
 
@@ -238,104 +396,14 @@ HRESULT Inpin::EndOfStream()
 
     m_bEndOfStream = true;
 
-    const vpx_codec_err_t err = vpx_codec_encode(&m_ctx, 0, 0, 0, 0, 0);
-    err;
-    assert(err == VPX_CODEC_OK);  //TODO
-
-    const VP8PassMode m = m_pFilter->GetPassMode();
-
-    OutpinVideo& outpin = m_pFilter->m_outpin_video;
-
-    vpx_codec_iter_t iter = 0;
-
-    for (;;)
-    {
-        const vpx_codec_cx_pkt_t* const pkt =
-            vpx_codec_get_cx_data(&m_ctx, &iter);
-
-        if (pkt == 0)
-            break;
-
-        switch (pkt->kind)
-        {
-            case VPX_CODEC_CX_FRAME_PKT:
-                assert(m != kPassModeFirstPass);
-                AppendFrame(pkt);
-                break;
-
-            case VPX_CODEC_STATS_PKT:
-                assert(m == kPassModeFirstPass);
-                outpin.WriteStats(pkt);
-                break;
-
-            default:
-                assert(false);
-                return E_FAIL;
-        }
-    }
-
-    if (m != kPassModeFirstPass)
-    {
-        while (!m_pending.empty())
-        {
-            if (!bool(outpin.m_pAllocator))
-                break;
-
-            lock.Release();
-
-            GraphUtil::IMediaSamplePtr pOutSample;
-
-            const HRESULT hrGetBuffer =
-                outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
-
-            hr = lock.Seize(m_pFilter);
-
-            if (FAILED(hr))
-                return hr;
-
-            if (FAILED(hrGetBuffer))
-                break;
-
-            assert(bool(pOutSample));
-
-            PopulateSample(pOutSample);  //consume pending frame
-
-            if (!bool(outpin.m_pInputPin))
-                break;
-
-            lock.Release();
-
-            const HRESULT hrReceive = outpin.m_pInputPin->Receive(pOutSample);
-
-            hr = lock.Seize(m_pFilter);
-
-            if (FAILED(hr))
-                return hr;
-
-            if (hrReceive != S_OK)
-                break;
-        }
-    }
-
-    //We hold the lock.
-
-    if (IPin* pPin = m_pFilter->m_outpin_preview.m_pPinConnection)
-    {
-        lock.Release();
-
-        hr = pPin->EndOfStream();
-
-        hr = lock.Seize(m_pFilter);
-        assert(SUCCEEDED(hr));  //TODO
-    }
+    //The encode thread drains the encoder, and sends EOS downstream,
+    //after it has encoded the frames received before this.
 
-    //We hold the lock.
+    m_samples.push_back(0);  //EOS is not subject to the queue length
 
-    if (IPin* pPin = outpin.m_pPinConnection)
-    {
-        lock.Release();
-        hr = pPin->EndOfStream();
-    }
+    const BOOL b = SetEvent(m_hSamples);
+    b;
+    assert(b);
 
     return S_OK;
 }
@@ -359,6 +427,12 @@ HRESULT Inpin::BeginFlush()
 
     m_bFlush = true;
 
+    PurgeSamples();  //including a queued EOS
+
+    const BOOL b = SetEvent(m_hSpace);  //release Receive, if it waits
+    b;
+    assert(b);
+
     //We hold the lock
 
     if (IPin* pPin = m_pFilter->m_outpin_preview.m_pPinConnection)
@@ -373,6 +447,21 @@ HRESULT Inpin::BeginFlush()
 
     //We hold the lock
 
+    for (size_t i = 0; i < m_pFilter->m_simulcast.size(); ++i)
+    {
+        if (IPin* pPin = m_pFilter->m_simulcast[i]->m_pPinConnection)
+        {
+            lock.Release();
+
+            hr = pPin->BeginFlush();
+
+            hr = lock.Seize(m_pFilter);
+            assert(SUCCEEDED(hr));  //TODO
+        }
+    }
+
+    //We hold the lock
+
     if (IPin* pPin = m_pFilter->m_outpin_video.m_pPinConnection)
     {
         lock.Release();
@@ -395,7 +484,30 @@ HRESULT Inpin::EndFlush()
     if (!bool(m_pPinConnection))
         return VFW_E_NOT_CONNECTED;
 
+    //Wait for the encode thread to finish with the sample it was handling
+    //when the flush began, so that nothing it encoded from that sample is
+    //delivered after the flush.
+
+    while (m_bBusy)
+    {
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        const DWORD dw = WaitForSingleObject(m_hIdle, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return E_FAIL;
+
+        assert(dw == WAIT_OBJECT_0);
+
+        hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
     m_bFlush = false;
+    m_hrDeliver = S_OK;
 
     //We hold the lock
 
@@ -411,6 +523,21 @@ HRESULT Inpin::EndFlush()
 
     //We hold the lock
 
+    for (size_t i = 0; i < m_pFilter->m_simulcast.size(); ++i)
+    {
+        if (IPin* pPin = m_pFilter->m_simulcast[i]->m_pPinConnection)
+        {
+            lock.Release();
+
+            hr = pPin->EndFlush();
+
+            hr = lock.Seize(m_pFilter);
+            assert(SUCCEEDED(hr));  //TODO
+        }
+    }
+
+    //We hold the lock
+
     if (IPin* pPin = m_pFilter->m_outpin_video.m_pPinConnection)
     {
         lock.Release();
@@ -450,6 +577,21 @@ HRESULT Inpin::NewSegment(
 
     //We hold the lock
 
+    for (size_t i = 0; i < m_pFilter->m_simulcast.size(); ++i)
+    {
+        if (IPin* pPin = m_pFilter->m_simulcast[i]->m_pPinConnection)
+        {
+            lock.Release();
+
+            hr = pPin->NewSegment(st, sp, r);
+
+            hr = lock.Seize(m_pFilter);
+            assert(SUCCEEDED(hr));  //TODO
+        }
+    }
+
+    //We hold the lock
+
     if (IPin* pPin = m_pFilter->m_outpin_video.m_pPinConnection)
     {
         lock.Release();
@@ -476,12 +618,30 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
         __noop;
 
+    else if (mt.subtype == MEDIASUBTYPE_NV12)
+        __noop;
+
     else if (mt.subtype == MEDIASUBTYPE_YUY2)
         __noop;
 
     else if (mt.subtype == MEDIASUBTYPE_YUYV)
         __noop;
 
+    else if (mt.subtype == MEDIASUBTYPE_UYVY)
+        __noop;
+
+    else if (mt.subtype == MEDIASUBTYPE_YVYU)
+        __noop;
+
+    else if (mt.subtype == MEDIASUBTYPE_RGB32)
+        __noop;
+
+    else if (mt.subtype == MEDIASUBTYPE_ARGB32)
+        __noop;
+
+    else if (mt.subtype == MEDIASUBTYPE_RGB24)
+        __noop;
+
     else
         return S_FALSE;
 
@@ -526,16 +686,27 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (bmih.biWidth <= 0)
         return S_FALSE;
 
-    if (bmih.biWidth % 2)  //TODO
-        return S_FALSE;
-
     if (bmih.biHeight == 0)
         return S_FALSE;
 
-    if (bmih.biHeight % 2)  //TODO
-        return S_FALSE;
+    if (mt.subtype == MEDIASUBTYPE_RGB24)
+    {
+        if (bmih.biCompression != BI_RGB)
+            return S_FALSE;
+
+        if (bmih.biBitCount != 24)
+            return S_FALSE;
+    }
+    else if ((mt.subtype == MEDIASUBTYPE_RGB32) ||
+             (mt.subtype == MEDIASUBTYPE_ARGB32))
+    {
+        if (bmih.biCompression != BI_RGB)
+            return S_FALSE;
 
-    if (bmih.biCompression != mt.subtype.Data1)
+        if (bmih.biBitCount != 32)
+            return S_FALSE;
+    }
+    else if (bmih.biCompression != mt.subtype.Data1)
         return S_FALSE;
 
     return S_OK;
@@ -621,101 +792,338 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     if (m_bFlush)
         return S_FALSE;
 
-    const BITMAPINFOHEADER& bmih = GetBMIH();
+    if (m_hrDeliver != S_OK)  //downstream rejected an earlier frame
+        return m_hrDeliver;
 
-    const LONG w = bmih.biWidth;
-    assert(w > 0);
-    assert((w % 2) == 0);  //TODO
+    __int64 st, sp;
 
-    const LONG h = labs(bmih.biHeight);
-    assert(h > 0);
-    assert((h % 2) == 0);  //TODO
+    hr = pInSample->GetTime(&st, &sp);
 
-    const long len = pInSample->GetActualDataLength();
-    len;
-    assert(len >= 0);
+    if (FAILED(hr))
+        return hr;
 
-    vpx_img_fmt_t fmt;
+    webmdshow::PipelineCounters& counters = m_pFilter->m_counters;
+    counters.OnSampleIn(pInSample->GetActualDataLength());
 
-    const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+    if (m_pFilter->m_decimate > 1)
+    {
+        if (m_frames_received++ % m_pFilter->m_decimate)
+        {
+            counters.OnDrop();
+            return S_OK;
+        }
+    }
 
-    if (mt.subtype == MEDIASUBTYPE_YV12)
-        fmt = VPX_IMG_FMT_YV12;
+    bool bSkip;
 
-    else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
-        fmt = VPX_IMG_FMT_I420;
+    hr = SkipDuplicate(lock, pInSample, st, bSkip);
 
-    else if ((mt.subtype == MEDIASUBTYPE_YUY2) ||
-             (mt.subtype == MEDIASUBTYPE_YUYV))
-    {
-        fmt = VPX_IMG_FMT_YUY2;
-    }
-    else
+    if (hr != S_OK)  //stopped or flushed while we compared
+        return hr;
+
+    if (bSkip)
+        return S_OK;
+
+    bool bBlocked = false;
+
+    for (;;)
     {
-        assert(false);
-        return E_FAIL;
-    }
+        const int n = m_pFilter->m_input_queue_length;
+        assert(n >= 1);
 
-    BYTE* inbuf;
+        if (m_samples.size() < size_t(n))
+            break;
 
-    hr = pInSample->GetPointer(&inbuf);
-    assert(SUCCEEDED(hr));
-    assert(inbuf);
+        const VPXInputQueuePolicy policy = m_pFilter->m_input_queue_policy;
 
-    BYTE* imgbuf;
+        if (policy == kInputQueueDropNewest)
+        {
+            ++m_dropped_count;
+            counters.OnDrop();
+            return S_OK;
+        }
 
-    switch (fmt)
-    {
-        case VPX_IMG_FMT_YV12:
-        case VPX_IMG_FMT_I420:
+        if (policy == kInputQueueDropOldest)
         {
-            assert(len == (w*h + 2*((w+1)/2)*((h+1)/2)));
+            IMediaSample* const pOldSample = m_samples.front();
+            assert(pOldSample);  //EOS is queued last
 
-            imgbuf = inbuf;
-            assert(imgbuf);
+            m_samples.pop_front();
+            ++m_dropped_count;
+            counters.OnDrop();
 
-            break;
+            //The encoder would have placed a keyframe here.
+
+            if (pOldSample->IsDiscontinuity() == S_OK)
+                m_pFilter->m_bForceKeyframe = true;
+
+            pOldSample->Release();
+            continue;
         }
-        case VPX_IMG_FMT_YUY2:
+
+        assert(policy == kInputQueueBlock);
+
+        if (!bBlocked)
         {
-            assert(len == ((2*w) * h));
+            bBlocked = true;
+            ++m_blocked_count;
+        }
 
-            fmt = VPX_IMG_FMT_YV12;
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
 
-            imgbuf = ConvertYUY2ToYV12(inbuf, w, h);
-            assert(imgbuf);
+        const DWORD dw = WaitForSingleObject(m_hSpace, INFINITE);
 
-            break;
-        }
-        default:
-            assert(false);
+        if (dw == WAIT_FAILED)
             return E_FAIL;
-    }
 
-    __int64 st, sp;
+        assert(dw == WAIT_OBJECT_0);
 
-    hr = pInSample->GetTime(&st, &sp);
+        hr = lock.Seize(m_pFilter);
 
-    if (FAILED(hr))
+        if (FAILED(hr))
+            return hr;
+
+        if (m_pFilter->m_state == State_Stopped)
+            return VFW_E_NOT_RUNNING;
+
+        if (m_bFlush)
+            return S_FALSE;
+
+        if (m_hrDeliver != S_OK)
+            return m_hrDeliver;
+    }
+
+    pInSample->AddRef();
+    m_samples.push_back(pInSample);
+
+    ++m_queued_count;
+    counters.SetQueueDepth(static_cast<int>(m_samples.size()));
+
+    const BOOL b = SetEvent(m_hSamples);
+    b;
+    assert(b);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::SkipDuplicate(
+    Filter::Lock& lock,
+    IMediaSample* pInSample,
+    __int64 st,
+    bool& bSkip)
+{
+    //Called by Receive, holding the filter lock.  A repeat of the frame
+    //before is dropped here, before it costs a queue slot, a conversion
+    //or an encode.  The output carries no stop times, so the frame before
+    //lasts until the next frame encoded, in the muxer as in a renderer.
+
+    bSkip = false;
+
+    const int max_run = m_pFilter->m_max_duplicate_skip;
+
+    if (max_run <= 0)
+    {
+        m_duplicates.Reset();  //so that turning it on starts afresh
+        return S_OK;
+    }
+
+    //A frame that the encoder is to make a keyframe is never skipped, and
+    //neither is a frame after a run of max_run repeats, so that a static
+    //screen is still sent every so often.
+
+    bool bKey = (m_start_reftime < 0) ||
+                m_pFilter->m_bForceKeyframe ||
+                (pInSample->IsDiscontinuity() == S_OK);
+
+    if (!bKey &&
+        m_cfg.kf_mode == kKeyframeModeDisabled &&
+        m_pFilter->m_keyframe_interval > 0)
+    {
+        const __int64 reftime_since_last_kf = st - m_last_keyframe_time;
+        bKey = (reftime_since_last_kf >= m_pFilter->m_keyframe_interval);
+    }
+
+    const bool bAllowed = !bKey && (m_duplicate_run < max_run);
+
+    //A host that sends an empty list of dirty rectangles tells us that
+    //nothing changed, and we take its word for it.
+
+    _COM_SMARTPTR_TYPEDEF(IVPXSampleHints, __uuidof(IVPXSampleHints));
+
+    const IVPXSampleHintsPtr pHints(pInSample);
+
+    ULONG count;
+    const RECT* rects;
+
+    if (bAllowed &&
+        bool(pHints) &&
+        (pHints->GetDirtyRects(&count, &rects) == S_OK) &&
+        (count == 0))
+    {
+        ++m_duplicate_run;
+        ++m_skipped_count;
+
+        bSkip = true;
+        return S_OK;
+    }
+
+    BYTE* buf;
+
+    HRESULT hr = pInSample->GetPointer(&buf);
+    assert(SUCCEEDED(hr));
+    assert(buf);
+
+    const long len = pInSample->GetActualDataLength();
+    assert(len >= 0);
+
+    //The compare reads the whole frame when it is a repeat, so we do it
+    //without the lock, as Encode converts.  Only this thread touches the
+    //detector while the filter runs.
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    const bool bDuplicate = m_duplicates.IsDuplicate(buf, len);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
         return hr;
 
-    if (m_pFilter->m_decimate > 1)
+    if (m_pFilter->m_state == State_Stopped)
+        return VFW_E_NOT_RUNNING;
+
+    if (m_bFlush)
+        return S_FALSE;
+
+    if (m_hrDeliver != S_OK)
+        return m_hrDeliver;
+
+    if (bDuplicate && bAllowed)
     {
-        if (m_frames_received++ % m_pFilter->m_decimate)
-            return S_OK;
+        ++m_duplicate_run;
+        ++m_skipped_count;
+
+        bSkip = true;
     }
+    else
+        m_duplicate_run = 0;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::Encode(Filter::Lock& lock, IMediaSample* pInSample)
+{
+    assert(pInSample);
+
+    //Conversion and encoding, without the wait to deliver.
+    const __int64 start = webmdshow::PipelineCounters::Now();
+
+    const BITMAPINFOHEADER& bmih = GetBMIH();
+
+    const LONG w = bmih.biWidth;
+    assert(w > 0);
+
+    const LONG h = labs(bmih.biHeight);
+    assert(h > 0);
+
+    const long len = pInSample->GetActualDataLength();
+    assert(len >= 0);
+
+    const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+
+    BYTE* inbuf;
+
+    HRESULT hr = pInSample->GetPointer(&inbuf);
+    assert(SUCCEEDED(hr));
+    assert(inbuf);
+
+    __int64 st, sp;
+
+    hr = pInSample->GetTime(&st, &sp);
+
+    if (FAILED(hr))
+        return hr;
 
     vpx_image_t img_;
-    vpx_image_t* const img = vpx_img_wrap(&img_, fmt, w, h, 1, imgbuf);
-    assert(img);
-    assert(img == &img_);
+    vpx_image_t* img;
+    bool bConverted = false;
+
+    if ((mt.subtype == MEDIASUBTYPE_YV12) ||
+        (mt.subtype == WebmTypes::MEDIASUBTYPE_I420))
+    {
+        //Zero-copy: the encoder reads the planes of the sample itself.
+
+        assert(len == (w*h + 2*((w+1)/2)*((h+1)/2)));
+
+        const vpx_img_fmt_t fmt = (mt.subtype == MEDIASUBTYPE_YV12) ?
+                                    VPX_IMG_FMT_YV12 :
+                                    VPX_IMG_FMT_I420;
+
+        img = vpx_img_wrap(&img_, fmt, w, h, 1, inbuf);
+        assert(img);
+        assert(img == &img_);
+
+        //TODO: set this based on vih.rcSource
+        const int status = vpx_img_set_rect(img, 0, 0, w, h);
+        status;
+        assert(status == 0);
+
+        //vpx_img_wrap rounds odd dimensions up to even, but the planes of
+        //the sample are packed at the frame's own size.
+
+        const int uv_stride = (w + 1) / 2;
+        const int uv_size = uv_stride * ((h + 1) / 2);
+
+        BYTE* const uv = inbuf + w*h;
+
+        img->stride[VPX_PLANE_Y] = w;
+        img->stride[VPX_PLANE_U] = uv_stride;
+        img->stride[VPX_PLANE_V] = uv_stride;
+
+        if (fmt == VPX_IMG_FMT_YV12)
+        {
+            img->planes[VPX_PLANE_V] = uv;
+            img->planes[VPX_PLANE_U] = uv + uv_size;
+        }
+        else
+        {
+            img->planes[VPX_PLANE_U] = uv;
+            img->planes[VPX_PLANE_V] = uv + uv_size;
+        }
+    }
+    else
+    {
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        img = Convert(mt.subtype, bmih, inbuf, len);
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));  //TODO
+
+        if (img == 0)
+            return E_FAIL;
+
+        bConverted = true;
 
-    //TODO: set this based on vih.rcSource
-    const int status = vpx_img_set_rect(img, 0, 0, w, h);
-    status;
-    assert(status == 0);
+        if (mt.subtype == MEDIASUBTYPE_NV12)
+        {
+            //Only the chroma was converted; the encoder reads the luma
+            //plane of the sample itself.
+
+            img_ = *img;
+            img_.planes[VPX_PLANE_Y] = inbuf;
+            img_.stride[VPX_PLANE_Y] = w;
+
+            img = &img_;
+        }
+    }
 
-    m_pFilter->m_outpin_preview.Render(lock, img);
+    m_pFilter->m_outpin_preview.Render(lock, img, st);
 
     OutpinVideo& outpin = m_pFilter->m_outpin_video;
 
@@ -838,166 +1246,610 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
             f |= VPX_EFLAG_FORCE_KF;
     }
 
-    const Filter::Config::int32_t deadline_ = m_pFilter->m_cfg.deadline;
-    const ULONG dl = (deadline_ >= 0) ? deadline_ : kDeadlineGoodQuality;
+    vpx_enc_frame_flags_t layer_flags = 0;
+    int layer = -1;
+
+    if (m_layer_count > 0)
+        layer = NextLayer(f, layer_flags);
+
+    if (!m_pFilter->m_bAdaptiveRealtime)
+    {
+        m_rt_deadline = GetDeadline();
+        m_rt_cpu_used = m_rt_base_cpu_used;
+    }
+
+    const ULONG dl = m_rt_deadline;
+    const int cpu_used = m_rt_cpu_used;
 
     const __int64 st2 = m_start_reftime / 10000;  // scale to ms
     const unsigned long d2 = (d + 9999) / 10000;  // scale to ms
 
-    const vpx_codec_err_t err = vpx_codec_encode(&m_ctx, img, st2, d2, f, dl);
-    err;
-    assert(err == VPX_CODEC_OK);  //TODO
+    if (bConverted)
+        ++m_converted_count;
+    else
+        ++m_wrapped_count;
 
-    const VP8PassMode m = m_pFilter->GetPassMode();
+    OutpinSimulcast* simulcast[Filter::kMaxSimulcastCount];
+    const int n = GetSimulcast(simulcast);
 
-    vpx_codec_iter_t iter = 0;
+    //Encode without the filter lock, so that Receive can queue the next
+    //sample meanwhile.  The encoder copies the image into its lookahead
+    //buffers before vpx_codec_encode returns, so a wrapped sample needs
+    //no reference beyond the one the queue gave us, even when frames are
+    //lagged (lag_in_frames, ARNR).  The simulcast renditions scale and
+    //encode the same image on their own threads while we encode it here;
+    //they use the same flags, so that their keyframes line up with ours.
 
-    for (;;)
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    CLockable::Lock encoder_lock;
+
+    hr = encoder_lock.Seize(&m_encoder_lock);
+    assert(SUCCEEDED(hr));  //TODO
+
+    ApplyHints(pInSample, f);
+
+    vpx_codec_err_t err;
+
+    if (cpu_used != m_cpu_used_applied)
     {
-        const vpx_codec_cx_pkt_t* const pkt =
-            vpx_codec_get_cx_data(&m_ctx, &iter);
+        err = vpx_codec_control(&m_ctx, VP8E_SET_CPUUSED, cpu_used);
+        assert(err == VPX_CODEC_OK);  //TODO
 
-        if (pkt == 0)
-            break;
+        for (int i = 0; i < n; ++i)
+        {
+            vpx_codec_ctx_t* const ctx = &simulcast[i]->m_ctx;
 
-        switch (pkt->kind)
+            err = vpx_codec_control(ctx, VP8E_SET_CPUUSED, cpu_used);
+            assert(err == VPX_CODEC_OK);  //TODO
+        }
+
+        m_cpu_used_applied = cpu_used;
+    }
+
+    if (m_budget_id)
+    {
+        //Another encoder of the process started or stopped, so the
+        //threads were shared out again.  The renditions are idle until
+        //they are posted this image, so this is when to take them.
+
+        using webmdshow::EncoderThreadBudget;
+
+        const uint32_t generation = EncoderThreadBudget::Get().GetGeneration();
+
+        if (generation != m_budget_generation)
         {
-            case VPX_CODEC_CX_FRAME_PKT:
-                assert(m != kPassModeFirstPass);
-                AppendFrame(pkt);
-                break;
+            ApplyThreadGrant(&m_ctx, &m_cfg, m_budget_id);
 
-            case VPX_CODEC_STATS_PKT:
-                assert(m == kPassModeFirstPass);
-                outpin.WriteStats(pkt);
-                break;
+            for (int i = 0; i < n; ++i)
+                simulcast[i]->ApplyThreadGrant();
 
-            default:
-                assert(false);
-                return E_FAIL;
+            m_budget_generation = generation;
         }
     }
 
-    if (m == kPassModeFirstPass)
-        return S_OK;  //nothing else to do
-
-    while (!m_pending.empty())
+    if (m_lookahead_id)
     {
-        if (!bool(outpin.m_pAllocator))
-            return VFW_E_NO_ALLOCATOR;
+        //The memory budget asked for memory back, so the lags of the
+        //process's encoders were cut.  As with the threads, the
+        //renditions take theirs now, while they are idle.
 
-        lock.Release();
+        using webmdshow::EncoderLookahead;
 
-        GraphUtil::IMediaSamplePtr pOutSample;
+        EncoderLookahead& lookahead = EncoderLookahead::Get();
+        lookahead.Service();
 
-        hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+        const uint32_t generation = lookahead.GetGeneration();
 
-        if (FAILED(hr))
-            return hr;
+        if (generation != m_lookahead_generation)
+        {
+            ApplyLookaheadGrant(&m_ctx, &m_cfg, m_lookahead_id);
 
-        assert(bool(pOutSample));
+            for (int i = 0; i < n; ++i)
+                simulcast[i]->ApplyLookaheadGrant();
 
-        hr = lock.Seize(m_pFilter);
+            m_lookahead_generation = generation;
+        }
+    }
 
-        if (FAILED(hr))
-            return hr;
+    if (layer >= 0)
+    {
+        err = vpx_codec_control(&m_ctx, VP8E_SET_TEMPORAL_LAYER_ID, layer);
+        assert(err == VPX_CODEC_OK);  //TODO
+    }
 
-        PopulateSample(pOutSample);  //consume pending frame
+    LARGE_INTEGER t0;
+    QueryPerformanceCounter(&t0);
 
-        if (!bool(outpin.m_pInputPin))
-            return S_FALSE;
+    //The renditions have no layers, so they get the keyframe flag only.
 
-        lock.Release();
+    for (int i = 0; i < n; ++i)
+        simulcast[i]->Post(img, st2, d2, f, dl);
+
+    err = vpx_codec_encode(&m_ctx, img, st2, d2, f | layer_flags, dl);
+    assert(err == VPX_CODEC_OK);  //TODO
 
-        hr = outpin.m_pInputPin->Receive(pOutSample);
+    for (int i = 0; i < n; ++i)
+    {
+        err = simulcast[i]->Wait();
+        assert(err == VPX_CODEC_OK);  //TODO
+    }
 
-        if (hr != S_OK)
-            return hr;
+    LARGE_INTEGER t1;
+    QueryPerformanceCounter(&t1);
 
-        hr = lock.Seize(m_pFilter);
+    VPXFrameStats call;
 
-        if (FAILED(hr))
-            return hr;
+    if (m_frame_stats)
+    {
+        //The quantizer is that of the last frame the encoder produced,
+        //which is the one out of this call.
+
+        int q;
+
+        err = vpx_codec_control(&m_ctx, VP8E_GET_LAST_QUANTIZER_64, &q);
+
+        call.Time = st;
+        const LONGLONG ticks = t1.QuadPart - t0.QuadPart;
+
+        call.EncodeTime = ticks * 10000000 / m_perf_freq;
+        call.Size = 0;
+        call.Quantizer = (err == VPX_CODEC_OK) ? q : -1;
+        call.Layer = layer;
+        call.Flags = 0;
     }
 
-    return S_OK;
-}
+    hr = encoder_lock.Release();
+    assert(SUCCEEDED(hr));
 
+    hr = lock.Seize(m_pFilter);
+    assert(SUCCEEDED(hr));  //TODO
 
-void Inpin::PopulateSample(IMediaSample* p)
-{
-    assert(p);
-    assert(!m_pending.empty());
+    OnEncodeTime(t1.QuadPart - t0.QuadPart, d);
 
-#ifdef _DEBUG
-    {
-        AM_MEDIA_TYPE* pmt;
+    int frames = 0;
 
-        const HRESULT hr = p->GetMediaType(&pmt);
-        assert(FAILED(hr) || (pmt == 0));
+    hr = GetPackets(&m_ctx, outpin, m_frame_stats ? &call : 0, &frames);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_frame_stats && (frames == 0) && (m_cfg.g_lag_in_frames == 0) &&
+        (m_pFilter->GetPassMode() != kPassModeFirstPass))
+    {
+        call.Flags = kFrameStatsDropped;
+        PostFrameStats(call, 0);
     }
-#endif
 
-    _COM_SMARTPTR_TYPEDEF(IVP8Sample, __uuidof(IVP8Sample));
+    for (int i = 0; i < n; ++i)
+    {
+        OutpinSimulcast* const pPin = simulcast[i];
 
-    const IVP8SamplePtr pSample(p);
-    assert(bool(pSample));
+        hr = GetPackets(&pPin->m_ctx, *pPin);
 
-    IVP8Sample::Frame& f = pSample->GetFrame();
-    assert(f.buf == 0);  //should have already been reclaimed
+        if (FAILED(hr))
+            return hr;
+    }
 
-    f = m_pending.front();
-    assert(f.buf);
+    m_pFilter->m_counters.AddProcessingTime(
+        webmdshow::PipelineCounters::Now() - start);
 
-    m_pending.pop_front();
+    if (m_pFilter->GetPassMode() == kPassModeFirstPass)
+        return S_OK;  //nothing else to do
 
-    HRESULT hr = p->SetPreroll(FALSE);
-    assert(SUCCEEDED(hr));
+    hr = Deliver(lock, outpin);
 
-    hr = p->SetDiscontinuity(m_bDiscontinuity ? TRUE : FALSE);
-    assert(SUCCEEDED(hr));
+    for (int i = 0; (hr == S_OK) && (i < n); ++i)
+        hr = Deliver(lock, *simulcast[i]);
 
-    m_bDiscontinuity = false;
+    return hr;
 }
 
 
-void Inpin::AppendFrame(const vpx_codec_cx_pkt_t* pkt)
+HRESULT Inpin::Drain(Filter::Lock& lock)
 {
-    assert(pkt);
-    assert(pkt->kind == VPX_CODEC_CX_FRAME_PKT);
+    OutpinVideo& outpin = m_pFilter->m_outpin_video;
 
-    IVP8Sample::Frame f;
+    OutpinSimulcast* simulcast[Filter::kMaxSimulcastCount];
+    const int n = GetSimulcast(simulcast);
 
-    const HRESULT hr = m_pFilter->m_outpin_video.GetFrame(f);
-    hr;
+    HRESULT hr = lock.Release();
     assert(SUCCEEDED(hr));
-    assert(f.buf);
 
-    const size_t len_ = pkt->data.frame.sz;
-    const long len = static_cast<long>(len_);
+    CLockable::Lock encoder_lock;
 
-    const long size = f.buflen - f.off;
-    size;
-    assert(size >= len);
+    hr = encoder_lock.Seize(&m_encoder_lock);
+    assert(SUCCEEDED(hr));  //TODO
 
-    BYTE* tgt = f.buf + f.off;
-    //assert(intptr_t(tgt - props.cbPrefix) % props.cbAlign == 0);
+    for (int i = 0; i < n; ++i)
+        simulcast[i]->Post(0, 0, 0, 0, 0);
 
-    memcpy(tgt, pkt->data.frame.buf, len);
+    vpx_codec_err_t err = vpx_codec_encode(&m_ctx, 0, 0, 0, 0, 0);
+    err;
+    assert(err == VPX_CODEC_OK);  //TODO
 
-    f.len = len;
+    for (int i = 0; i < n; ++i)
+    {
+        err = simulcast[i]->Wait();
+        assert(err == VPX_CODEC_OK);  //TODO
+    }
 
-    f.start = pkt->data.frame.pts * 10000; // scale to 100 ns ticks
-    assert(f.start >= 0);
+    hr = encoder_lock.Release();
+    assert(SUCCEEDED(hr));
 
-#if 0
-    f.stop = f.start + pkt->data.frame.duration;
-    assert(f.stop > f.start);
-#else
-    f.stop = -1;  //don't send stop time
-#endif
+    hr = lock.Seize(m_pFilter);
+    assert(SUCCEEDED(hr));  //TODO
 
-    const uint32_t bKey = pkt->data.frame.flags & VPX_FRAME_IS_KEY;
+    //The frames held back for lag come out of this call; what this call
+    //cost says nothing about them.
+
+    VPXFrameStats call;
+
+    call.Time = 0;
+    call.EncodeTime = 0;
+    call.Size = 0;
+    call.Quantizer = -1;
+    call.Layer = -1;
+    call.Flags = 0;
+
+    hr = GetPackets(&m_ctx, outpin, m_frame_stats ? &call : 0);
+
+    for (int i = 0; SUCCEEDED(hr) && (i < n); ++i)
+        hr = GetPackets(&simulcast[i]->m_ctx, *simulcast[i]);
+
+    if (SUCCEEDED(hr) &&
+        (m_hrDeliver == S_OK) &&
+        (m_pFilter->GetPassMode() != kPassModeFirstPass))
+    {
+        m_hrDeliver = Deliver(lock, outpin);
+
+        for (int i = 0; (m_hrDeliver == S_OK) && (i < n); ++i)
+            m_hrDeliver = Deliver(lock, *simulcast[i]);
+    }
+
+    //We hold the lock.
+
+    if (IPin* pPin = m_pFilter->m_outpin_preview.m_pPinConnection)
+    {
+        lock.Release();
+
+        hr = pPin->EndOfStream();
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));  //TODO
+    }
+
+    //We hold the lock.
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (IPin* pPin = simulcast[i]->m_pPinConnection)
+        {
+            lock.Release();
+
+            hr = pPin->EndOfStream();
+
+            hr = lock.Seize(m_pFilter);
+            assert(SUCCEEDED(hr));  //TODO
+        }
+    }
+
+    //We hold the lock.
+
+    if (IPin* pPin = m_pFilter->m_outpin_video.m_pPinConnection)
+    {
+        lock.Release();
+
+        hr = pPin->EndOfStream();
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));  //TODO
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::GetPackets(
+    vpx_codec_ctx_t* ctx,
+    OutpinVideo& outpin,
+    const VPXFrameStats* pCall,
+    int* pFrames)
+{
+    assert(ctx);
+
+    const VP8PassMode m = m_pFilter->GetPassMode();
+
+    vpx_codec_iter_t iter = 0;
+
+    for (;;)
+    {
+        const vpx_codec_cx_pkt_t* const pkt =
+            vpx_codec_get_cx_data(ctx, &iter);
+
+        if (pkt == 0)
+            return S_OK;
+
+        switch (pkt->kind)
+        {
+            case VPX_CODEC_CX_FRAME_PKT:
+                assert(m != kPassModeFirstPass);
+                AppendFrame(outpin, pkt);
+
+                if (pCall)
+                    PostFrameStats(*pCall, pkt);
+
+                if (pFrames)
+                    ++*pFrames;
+
+                break;
+
+            case VPX_CODEC_STATS_PKT:
+                assert(m == kPassModeFirstPass);
+                outpin.WriteStats(pkt);
+                break;
+
+            default:
+                assert(false);
+                return E_FAIL;
+        }
+    }
+}
+
+
+void Inpin::PostFrameStats(
+    const VPXFrameStats& call,
+    const vpx_codec_cx_pkt_t* pkt)
+{
+    assert(m_frame_stats);
+
+    VPXFrameStats s = call;
+
+    if (pkt)
+    {
+        //The encoder's timebase is milliseconds (see Encode).
+
+        s.Time = pkt->data.frame.pts * 10000;
+        s.Size = static_cast<int>(pkt->data.frame.sz);
+
+        if (pkt->data.frame.flags & VPX_FRAME_IS_KEY)
+            s.Flags |= kFrameStatsKeyframe;
+
+        if (pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE)
+            s.Flags |= kFrameStatsInvisible;
+    }
+
+    if (!m_frame_stats->TryPush(s))
+        ++m_frame_stats_lost;
+}
+
+
+HRESULT Inpin::SetFrameStatsCapacity(int capacity)
+{
+    //The filter is stopped, so the encode thread isn't running.
+
+    assert(capacity >= 0);
+
+    delete m_frame_stats;
+    m_frame_stats = 0;
+
+    if (capacity == 0)
+        return S_OK;
+
+    m_frame_stats = new (std::nothrow) frame_stats_t(capacity);
+
+    if (m_frame_stats == 0)
+        return E_OUTOFMEMORY;
+
+    return S_OK;
+}
+
+
+int Inpin::GetFrameStatsCapacity() const
+{
+    if (m_frame_stats == 0)
+        return 0;
+
+    return static_cast<int>(m_frame_stats->capacity());
+}
+
+
+int Inpin::GetFrameStats(VPXFrameStats* stats, int count)
+{
+    if (m_frame_stats == 0)
+        return 0;
+
+    int n = 0;
+
+    while ((n < count) && m_frame_stats->TryPop(stats + n))
+        ++n;
+
+    return n;
+}
+
+
+HRESULT Inpin::Deliver(Filter::Lock& lock, OutpinVideo& outpin)
+{
+    //We hold the lock, and return holding it.
+    //
+    //The frames of one encode call (an altref and the frame after it,
+    //say) go downstream in a single ReceiveMultiple.  Each frame already
+    //sits in a buffer from the allocator's pool, which the sample simply
+    //adopts (see PopulateSample).  We wait for the first sample of a
+    //batch only; the others we take only when the allocator has them to
+    //spare, since downstream might hold on to its samples until it has
+    //received more.
+
+    enum { kMaxBatch = 8 };
+
+    while (!outpin.m_pending.empty())
+    {
+        if (m_bFlush)  //frames encoded before the flush
+        {
+            outpin.PurgePending();
+            return S_FALSE;
+        }
+
+        if (!bool(outpin.m_pAllocator))
+            return VFW_E_NO_ALLOCATOR;
+
+        HRESULT hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        GraphUtil::IMediaSamplePtr samples[kMaxBatch];
+
+        const HRESULT hrGetBuffer =
+            outpin.m_pAllocator->GetBuffer(&samples[0], 0, 0, 0);
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));  //TODO
+
+        if (FAILED(hrGetBuffer))
+            return hrGetBuffer;
+
+        assert(bool(samples[0]));
+
+        if (m_bFlush)
+            continue;  //discard pending frames
+
+        if (!bool(outpin.m_pAllocator))  //weird
+            return VFW_E_NO_ALLOCATOR;
+
+        IMediaSample* batch[kMaxBatch];
+        long n = 0;
+
+        for (;;)
+        {
+            PopulateSample(outpin, samples[n]);  //consume pending frame
+
+            batch[n] = samples[n];
+            ++n;
+
+            if (outpin.m_pending.empty() || (n >= kMaxBatch))
+                break;
+
+            hr = outpin.m_pAllocator->GetBuffer(
+                    &samples[n],
+                    0,
+                    0,
+                    AM_GBF_NOWAIT);
+
+            if (hr != S_OK)  //VFW_E_TIMEOUT: rest go in the next batch
+                break;
+
+            assert(bool(samples[n]));
+        }
+
+        if (!bool(outpin.m_pInputPin))
+            return S_FALSE;
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        long m;
+
+        const HRESULT hrReceive =
+            outpin.m_pInputPin->ReceiveMultiple(batch, n, &m);
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));  //TODO
+
+        if (hrReceive != S_OK)
+            return hrReceive;
+
+        if (&outpin == &m_pFilter->m_outpin_video)
+        {
+            for (long i = 0; i < m; ++i)
+                m_pFilter->m_counters.OnSampleOut(
+                    batch[i]->GetActualDataLength());
+        }
+
+        if (m < n)  //downstream stopped taking samples
+            return S_FALSE;
+    }
+
+    return S_OK;
+}
+
+
+void Inpin::PopulateSample(OutpinVideo& outpin, IMediaSample* p)
+{
+    assert(p);
+    assert(!outpin.m_pending.empty());
+
+#ifdef _DEBUG
+    {
+        AM_MEDIA_TYPE* pmt;
+
+        const HRESULT hr = p->GetMediaType(&pmt);
+        assert(FAILED(hr) || (pmt == 0));
+    }
+#endif
+
+    _COM_SMARTPTR_TYPEDEF(IVP8Sample, __uuidof(IVP8Sample));
+
+    const IVP8SamplePtr pSample(p);
+    assert(bool(pSample));
+
+    IVP8Sample::Frame& f = pSample->GetFrame();
+    assert(f.buf == 0);  //should have already been reclaimed
+
+    f = outpin.m_pending.front();
+    assert(f.buf);
+
+    outpin.m_pending.pop_front();
+
+    HRESULT hr = p->SetPreroll(FALSE);
+    assert(SUCCEEDED(hr));
+
+    hr = p->SetDiscontinuity(outpin.m_bDiscontinuity ? TRUE : FALSE);
+    assert(SUCCEEDED(hr));
+
+    outpin.m_bDiscontinuity = false;
+}
+
+
+void Inpin::AppendFrame(OutpinVideo& outpin, const vpx_codec_cx_pkt_t* pkt)
+{
+    assert(pkt);
+    assert(pkt->kind == VPX_CODEC_CX_FRAME_PKT);
+
+    const size_t len_ = pkt->data.frame.sz;
+    const long len = static_cast<long>(len_);
+
+    //A keyframe can be larger than the allocator's cbBuffer, so the
+    //frame is sized for the packet.
+
+    IVP8Sample::Frame f;
+
+    const HRESULT hr = outpin.GetFrame(len, f);
+    hr;
+    assert(SUCCEEDED(hr));
+    assert(f.buf);
+
+    const long size = f.buflen - f.off;
+    size;
+    assert(size >= len);
+
+    BYTE* tgt = f.buf + f.off;
+    //assert(intptr_t(tgt - props.cbPrefix) % props.cbAlign == 0);
+
+    memcpy(tgt, pkt->data.frame.buf, len);
+
+    f.len = len;
+
+    f.start = pkt->data.frame.pts * 10000; // scale to 100 ns ticks
+    assert(f.start >= 0);
+
+#if 0
+    f.stop = f.start + pkt->data.frame.duration;
+    assert(f.stop > f.start);
+#else
+    f.stop = -1;  //don't send stop time
+#endif
+
+    const uint32_t bKey = pkt->data.frame.flags & VPX_FRAME_IS_KEY;
 #if 0 //def _DEBUG
     odbgstream os;
     os << "["__FUNCTION__"] " << "time=" << f.start / 10000000.0
@@ -1005,16 +1857,36 @@ void Inpin::AppendFrame(const vpx_codec_cx_pkt_t* pkt)
 #endif
 
     f.key = bKey ? true : false;
+    f.layer = -1;
 
-    if (f.key)
-        m_last_keyframe_time = f.start;
+    //The fixed keyframe interval follows the primary output; the
+    //renditions are forced along with it.  So does the layer pattern: a
+    //keyframe refers to nothing, so it is in layer 0 whatever its place,
+    //and the frame after it is second in the pattern.  Frames leave the
+    //encoder as they enter it (see SetConfig), so m_layer is this one's.
 
-    m_pending.push_back(f);
+    if (&outpin == &m_pFilter->m_outpin_video)
+    {
+        if (f.key)
+            m_last_keyframe_time = f.start;
+
+        if (m_layer_count == 0)
+            __noop;
+        else if (f.key)
+        {
+            f.layer = 0;
+            m_layer_index = 1;
+        }
+        else
+            f.layer = m_layer;
+    }
+
+    outpin.m_pending.push_back(f);
 
 #if 0 //def _DEBUG
     odbgstream os;
     os << "vp8encoder::inpin::appendframe: pending.size="
-       << m_pending.size()
+       << outpin.m_pending.size()
        << endl;
 #endif
 }
@@ -1063,182 +1935,508 @@ HRESULT Inpin::ReceiveCanBlock()
     if (FAILED(hr))
         return S_OK;  //?
 
-    if (IMemInputPin* pPin = m_pFilter->m_outpin_video.m_pInputPin)
+    //Downstream is called from the encode thread, so we block only
+    //when we wait for room in the input queue.
+
+    if (m_pFilter->m_input_queue_policy == kInputQueueBlock)
+        return S_OK;
+
+    return S_FALSE;
+}
+
+
+HRESULT Inpin::OnDisconnect()
+{
+    HRESULT hr = m_pFilter->m_outpin_preview.OnInpinDisconnect();
+    assert(SUCCEEDED(hr));
+
+    hr = m_pFilter->m_outpin_video.OnInpinDisconnect();
+    assert(SUCCEEDED(hr));
+
+    const Filter::simulcast_t& simulcast = m_pFilter->m_simulcast;
+
+    for (size_t i = 0; i < simulcast.size(); ++i)
     {
-        lock.Release();
-        return pPin->ReceiveCanBlock();
+        hr = simulcast[i]->OnInpinDisconnect();
+        assert(SUCCEEDED(hr));
     }
 
-    return S_FALSE;
+    return S_OK;
+}
+
+
+std::wstring Inpin::GetName() const
+{
+    return L"YUV";
+}
+
+
+void Inpin::PurgeSamples()
+{
+    while (!m_samples.empty())
+    {
+        IMediaSample* const pSample = m_samples.front();
+        m_samples.pop_front();
+
+        if (pSample)  //null is EOS
+            pSample->Release();
+    }
+}
+
+
+int Inpin::GetSimulcast(OutpinSimulcast** pa) const
+{
+    //We hold the lock.  Renditions are added and removed only while the
+    //filter is stopped, but their threads run only while it is not.
+
+    const Filter::simulcast_t& simulcast = m_pFilter->m_simulcast;
+    assert(simulcast.size() <= Filter::kMaxSimulcastCount);
+
+    int n = 0;
+
+    for (size_t i = 0; i < simulcast.size(); ++i)
+    {
+        OutpinSimulcast* const pPin = simulcast[i];
+        assert(pPin);
+
+        if (pPin->IsEncoding())
+            pa[n++] = pPin;
+    }
+
+    return n;
+}
+
+
+HRESULT Inpin::Start()
+{
+    assert(m_hThread == 0);
+    assert(m_samples.empty());
+
+    m_bEndOfStream = false;
+    m_bFlush = false;
+    m_start_reftime = -1;  //first-time flag
+
+    m_bBusy = false;
+    m_hrDeliver = S_OK;
+
+    m_queued_count = 0;
+    m_dropped_count = 0;
+    m_blocked_count = 0;
+    m_wrapped_count = 0;
+    m_converted_count = 0;
+    m_skipped_count = 0;
+    m_frame_stats_lost = 0;
+
+    if (m_frame_stats)  //records of the last run
+    {
+        VPXFrameStats s;
+
+        while (m_frame_stats->TryPop(&s))
+            __noop;
+    }
+
+    m_duplicates.Reset();
+    m_duplicate_run = 0;
+
+    if (GetCodec() == &vpx_codec_vp8_cx_algo)
+        m_layer_count = m_pFilter->m_temporal_layer_count;
+    else
+        m_layer_count = 0;  //the VP9 encoder layers differently
+
+    m_layer_index = 0;
+    m_layer = -1;
+
+    for (int i = 0; i < kEncodeTimeBucketCount; ++i)
+        m_encode_time_counts[i] = 0;
+
+    //The encoders start at the cpu_used value of the settings (or at the
+    //encoder default of 0), and adaptive real-time mode only ever makes
+    //them faster than that.
+
+    const Filter::Config::int32_t cpu_used = m_pFilter->m_cfg.cpu_used;
+
+    if (cpu_used < -16 || cpu_used > 16)
+        m_rt_base_cpu_used = 0;
+    else
+        m_rt_base_cpu_used = cpu_used;
+
+    m_rt_cpu_used = m_rt_base_cpu_used;
+    m_cpu_used_applied = m_rt_base_cpu_used;
+    m_rt_deadline = GetDeadline();
+    m_rt_load = 0;
+    m_rt_settle = 0;
+
+    m_bActiveMap = false;
+    m_bRoiMap = false;
+
+    OutpinVideo& outpin = m_pFilter->m_outpin_video;
+
+    outpin.m_bDiscontinuity = true;
+    outpin.PurgePending();
+    outpin.ClearStats();
+
+    m_pFilter->m_outpin_preview.m_next_time = -1;
+
+    const BITMAPINFOHEADER& bmih = GetBMIH();
+
+    const LONG w = bmih.biWidth;
+    assert(w > 0);
+
+    const LONG h = labs(bmih.biHeight);
+    assert(h > 0);
+
+    vpx_codec_iface_t* const codec = GetCodec();
+
+    vpx_codec_enc_cfg_t& tgt = m_cfg;
+
+    vpx_codec_err_t err = vpx_codec_enc_config_default(codec, &tgt, 0);
+
+    if (err != VPX_CODEC_OK)
+        return E_FAIL;
+
+    tgt.g_w = w;
+    tgt.g_h = h;
+    tgt.g_timebase.num = 1;
+    tgt.g_timebase.den = 1000;  // millisecond ticks
+    // The filter scales to milliseconds because the encoder will generate
+    // altref frames that is one timestamp tick different than another frame.
+    // The default downstream filter has a resolution of milliseconds so set
+    // the encoder timebase to milliseconds.
+
+    m_budget_id = JoinThreadBudget(w, h);
+    m_budget_generation = webmdshow::EncoderThreadBudget::Get().GetGeneration();
+
+    SetConfig();
+
+    m_lookahead_id = JoinLookahead(tgt);
+    m_lookahead_generation = webmdshow::EncoderLookahead::Get().GetGeneration();
+
+    const HRESULT hr = InitEncoder(&m_ctx, &tgt, m_budget_id);
+
+    if (FAILED(hr))  //OnStart does not stop us
+    {
+        LeaveThreadBudget(m_budget_id);
+        LeaveLookahead(m_lookahead_id);
+    }
+
+    return hr;
+}
+
+
+unsigned long Inpin::GetDeadline() const
+{
+    const Filter::Config::int32_t deadline = m_pFilter->m_cfg.deadline;
+    return (deadline >= 0) ? deadline : kDeadlineGoodQuality;
+}
+
+
+int Inpin::GetMaxCPUUsed() const
+{
+    if (m_pFilter->m_cfg.encoder_kind == kVP9Encoder)
+        return 8;
+
+    return 16;
+}
+
+
+void Inpin::OnEncodeTime(LONGLONG ticks, unsigned long duration)
+{
+    //Called by the encode thread, holding the filter lock, with the
+    //time the last frame took to encode (in performance counter ticks,
+    //simulcast renditions included), and the frame interval (in
+    //reftime units).
+
+    const double interval = double(duration) * m_perf_freq / 10000000;
+    const double load = double(ticks) / interval;
+
+    int bucket = (load > 0) ? int(load * 4) : 0;  //quarters of interval
+
+    if (bucket >= kEncodeTimeBucketCount)
+        bucket = kEncodeTimeBucketCount - 1;
+
+    ++m_encode_time_counts[bucket];
+
+    //The load is averaged over the last 8 frames or so, and after each
+    //change of the operating point we let the average settle for as
+    //long, so that one slow frame (a keyframe, say) doesn't bounce us
+    //between points.
+
+    m_rt_load += (load - m_rt_load) / 8;
+
+    if (!m_pFilter->m_bAdaptiveRealtime)
+        return;
+
+    if (++m_rt_settle < 8)
+        return;
+
+    const int max_cpu_used = GetMaxCPUUsed();
+    const int cpu_used = abs(m_rt_cpu_used);
+    const int sign = (m_rt_cpu_used < 0) ? -1 : 1;
+
+    if (m_rt_load > 0.9)  //falling behind
+    {
+        //First give up the quality deadline, then trade quality for
+        //speed one cpu_used step at a time.
+
+        if (m_rt_deadline != kDeadlineRealtime)
+            m_rt_deadline = kDeadlineRealtime;
+
+        else if (cpu_used < max_cpu_used)
+            m_rt_cpu_used = sign * (cpu_used + 1);
+
+        else
+            return;  //as fast as we go
+    }
+    else if (m_rt_load < 0.5)  //headroom: undo our changes, in reverse
+    {
+        if (cpu_used > abs(m_rt_base_cpu_used))
+            m_rt_cpu_used = sign * (cpu_used - 1);
+
+        else if (m_rt_deadline != GetDeadline())
+            m_rt_deadline = GetDeadline();
+
+        else
+            return;  //at the configured point
+    }
+    else
+        return;
+
+    m_rt_settle = 0;
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp8enc::Inpin::OnEncodeTime: load=" << m_rt_load
+       << " cpu_used=" << m_rt_cpu_used
+       << " deadline=" << m_rt_deadline
+       << endl;
+#endif
+}
+
+
+int Inpin::NextLayer(
+    vpx_enc_frame_flags_t f,
+    vpx_enc_frame_flags_t& layer_flags)
+{
+    //Called by the encode thread, holding the filter lock.
+
+    const TemporalLayerPattern& p = GetLayerPattern(m_layer_count);
+
+    if (f & VPX_EFLAG_FORCE_KF)
+        m_layer_index = 0;
+
+    const unsigned int i = m_layer_index;
+    assert(i < p.period);
+
+    m_layer_index = (i + 1) % p.period;
+
+    m_layer = p.layer_id[i];
+    layer_flags = p.flags[i];
+
+    return m_layer;
 }
 
 
-HRESULT Inpin::OnDisconnect()
+void Inpin::ApplyHints(IMediaSample* pSample, vpx_enc_frame_flags_t flags)
 {
-    HRESULT hr = m_pFilter->m_outpin_preview.OnInpinDisconnect();
-    assert(SUCCEEDED(hr));
+    //Called by the encode thread, holding the encoder lock.  The maps
+    //stay set in the encoder until they are replaced, so a frame that
+    //comes without a hint clears the map the frame before it set.
 
-    hr = m_pFilter->m_outpin_video.OnInpinDisconnect();
-    assert(SUCCEEDED(hr));
+    _COM_SMARTPTR_TYPEDEF(IVPXSampleHints, __uuidof(IVPXSampleHints));
 
-    return S_OK;
-}
+    const IVPXSampleHintsPtr pHints(pSample);
 
+    const unsigned int cols = (m_cfg.g_w + 15) / 16;
+    const unsigned int rows = (m_cfg.g_h + 15) / 16;
 
-std::wstring Inpin::GetName() const
-{
-    return L"YUV";
-}
+    bool bActiveMap = false;
 
+    ULONG count;
+    const RECT* rects;
 
-void Inpin::PurgePending()
-{
-    while (!m_pending.empty())
+    if (!bool(pHints) || (flags & VPX_EFLAG_FORCE_KF))
+        __noop;
+    else if (pHints->GetDirtyRects(&count, &rects) != S_OK)
+        __noop;
+    else if ((count == 0) || (rects != 0))
     {
-        IVP8Sample::Frame& f = m_pending.front();
-        assert(f.buf);
+        m_active_map.assign(cols * rows, 0);
+
+        for (ULONG i = 0; i < count; ++i)
+        {
+            const RECT& r = rects[i];
 
-        delete[] f.buf;
+            const LONG x0 = (std::max)(r.left, LONG(0)) / 16;
+            const LONG y0 = (std::max)(r.top, LONG(0)) / 16;
+            const LONG x1 = (std::min)((r.right + 15) / 16, LONG(cols));
+            const LONG y1 = (std::min)((r.bottom + 15) / 16, LONG(rows));
 
-        m_pending.pop_front();
+            for (LONG y = y0; y < y1; ++y)
+                for (LONG x = x0; x < x1; ++x)
+                    m_active_map[y * cols + x] = 1;
+        }
+
+        bActiveMap = true;
     }
-}
 
+    if (bActiveMap || m_bActiveMap)
+    {
+        vpx_active_map_t map;
 
-HRESULT Inpin::Start()
-{
-    m_bDiscontinuity = true;
-    m_bEndOfStream = false;
-    m_bFlush = false;
-    m_start_reftime = -1;  //first-time flag
+        map.active_map = bActiveMap ? &m_active_map[0] : 0;  //0 clears
+        map.rows = rows;
+        map.cols = cols;
 
-    PurgePending();
+        const vpx_codec_err_t err =
+            vpx_codec_control(&m_ctx, VP8E_SET_ACTIVEMAP, &map);
 
-    const BITMAPINFOHEADER& bmih = GetBMIH();
+        if (err == VPX_CODEC_OK)
+            m_bActiveMap = bActiveMap;
+    }
 
-    const LONG w = bmih.biWidth;
-    assert(w > 0);
-    assert((w % 2) == 0);  //TODO
+    vpx_roi_map_t roi;
 
-    const LONG h = labs(bmih.biHeight);
-    assert(h > 0);
-    assert((h % 2) == 0);  //TODO
+    roi.roi_map = 0;  //clears
+    roi.rows = rows;
+    roi.cols = cols;
+
+    if (bool(pHints))
+    {
+        ULONG c, r;
+        const BYTE* segments;
+
+        const HRESULT hr = pHints->GetRoiMap(
+                            &c,
+                            &r,
+                            &segments,
+                            roi.delta_q,
+                            roi.delta_lf,
+                            roi.static_threshold);
+
+        //The encoder copies the map, so it may point into the sample.
+
+        if ((hr == S_OK) && (segments != 0) && (c == cols) && (r == rows))
+            roi.roi_map = const_cast<BYTE*>(segments);
+    }
+
+    if ((roi.roi_map != 0) || m_bRoiMap)
+    {
+        const vpx_codec_err_t err =
+            vpx_codec_control(&m_ctx, VP8E_SET_ROI_MAP, &roi);
+
+        if (err == VPX_CODEC_OK)
+            m_bRoiMap = (roi.roi_map != 0);
+    }
+}
 
-    vpx_codec_iface_t* codec;
 
+vpx_codec_iface_t* Inpin::GetCodec() const
+{
     switch (m_pFilter->m_cfg.encoder_kind)
     {
         case kVP8Encoder:
         default:
-          codec = &vpx_codec_vp8_cx_algo;
-          break;
+          return &vpx_codec_vp8_cx_algo;
 
         case kVP9Encoder:
-          codec = &vpx_codec_vp9_cx_algo;
-          break;
+          return &vpx_codec_vp9_cx_algo;
     }
+}
 
-    vpx_codec_enc_cfg_t& tgt = m_cfg;
-
-    vpx_codec_err_t err = vpx_codec_enc_config_default(codec, &tgt, 0);
-
-    if (err != VPX_CODEC_OK)
-        return E_FAIL;
 
-    tgt.g_w = w;
-    tgt.g_h = h;
-    tgt.g_timebase.num = 1;
-    tgt.g_timebase.den = 1000;  // millisecond ticks
-    // The filter scales to milliseconds because the encoder will generate
-    // altref frames that is one timestamp tick different than another frame.
-    // The default downstream filter has a resolution of milliseconds so set
-    // the encoder timebase to milliseconds.
+HRESULT Inpin::InitEncoder(
+    vpx_codec_ctx_t* ctx,
+    const vpx_codec_enc_cfg_t* cfg,
+    int budget_id)
+{
+    //Also used by the simulcast renditions, with their own configuration.
 
-    SetConfig();
+    assert(ctx);
+    assert(cfg);
 
-    err = vpx_codec_enc_init(&m_ctx, codec, &tgt, 0);
+    vpx_codec_err_t err = vpx_codec_enc_init(ctx, GetCodec(), cfg, 0);
 
     if (err != VPX_CODEC_OK)
     {
 #ifdef _DEBUG
-        const char* str = vpx_codec_error_detail(&m_ctx);
+        const char* str = vpx_codec_error_detail(ctx);
         str;
 #endif
 
         return E_FAIL;
     }
 
-    err = SetTokenPartitions();
+    err = SetTokenPartitions(ctx, budget_id);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetAutoAltRef();
+    err = SetAutoAltRef(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetARNRMaxFrames();
+    err = SetARNRMaxFrames(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetARNRStrength();
+    err = SetARNRStrength(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetARNRType();
+    err = SetARNRType(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetCPUUsed();
+    err = SetCPUUsed(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
         return E_FAIL;
     }
 
-    err = SetStaticThreshold();
+    err = SetStaticThreshold(ctx);
 
     if (err != VPX_CODEC_OK)
     {
-        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        const vpx_codec_err_t err = vpx_codec_destroy(ctx);
         err;
         assert(err == VPX_CODEC_OK);
 
@@ -1248,13 +2446,152 @@ HRESULT Inpin::Start()
     return S_OK;
 }
 
+
 void Inpin::Stop()
 {
+    //We hold the lock, and the filter is already in State_Stopped.
+
+    PurgeSamples();
+
+    BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
+    assert(b);
+
+    b = SetEvent(m_hSpace);  //release Receive, if it waits
+    assert(b);
+}
+
+
+void Inpin::StartThread()
+{
+    assert(m_hThread == 0);
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Inpin::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp8enc::Inpin::StartThread: hThread=0x"
+       << hex << h << dec
+       << endl;
+#endif
+}
+
+
+void Inpin::StopThread()
+{
+    //Once the thread has terminated, nothing else uses the encoder.
+
+    if (m_hThread)
+    {
+#ifdef _DEBUG
+        odbgstream os;
+        os << "vp8enc::Inpin::StopThread: hThread=0x"
+           << hex << uintptr_t(m_hThread) << dec
+           << endl;
+#endif
+
+        const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        const BOOL b = CloseHandle(m_hThread);
+        b;
+        assert(b);
+
+        m_hThread = 0;
+    }
+
     const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
     err;
     assert(err == VPX_CODEC_OK);
 
     memset(&m_ctx, 0, sizeof m_ctx);
+
+    LeaveThreadBudget(m_budget_id);
+    LeaveLookahead(m_lookahead_id);
+
+    FreeImage();  //back to the pool, for the next encode
+}
+
+
+unsigned Inpin::ThreadProc(void* pv)
+{
+    Inpin* const pPin = static_cast<Inpin*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned Inpin::Main()
+{
+    for (;;)
+    {
+        Filter::Lock lock;
+
+        HRESULT hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return 0;  //TODO: signal error
+
+        if (m_pFilter->m_state == State_Stopped)
+            return 0;
+
+        if (m_samples.empty())
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            const DWORD dw = WaitForSingleObject(m_hSamples, INFINITE);
+
+            if (dw == WAIT_FAILED)
+                return 0;  //TODO: signal error
+
+            assert(dw == WAIT_OBJECT_0);
+            continue;
+        }
+
+        IMediaSample* const pSample = m_samples.front();
+        m_samples.pop_front();
+
+        m_pFilter->m_counters.SetQueueDepth(static_cast<int>(m_samples.size()));
+
+        m_bBusy = true;
+
+        BOOL b = ResetEvent(m_hIdle);
+        assert(b);
+
+        b = SetEvent(m_hSpace);
+        assert(b);
+
+        if (pSample == 0)  //EOS
+            Drain(lock);
+        else
+        {
+            //Once downstream has rejected a frame, we only discard
+            //samples until the next flush.
+
+            if (m_hrDeliver == S_OK)
+                m_hrDeliver = Encode(lock, pSample);
+
+            pSample->Release();
+        }
+
+        //We hold the lock.
+
+        m_bBusy = false;
+
+        b = SetEvent(m_hIdle);
+        assert(b);
+    }
 }
 
 
@@ -1262,7 +2599,28 @@ HRESULT Inpin::OnApplySettings(std::wstring& msg)
 {
     SetConfig();
 
-    const vpx_codec_err_t err = vpx_codec_enc_config_set(&m_ctx, &m_cfg);
+    //The encode thread holds the encoder lock, but not the filter lock,
+    //while it encodes a frame.
+
+    CLockable::Lock encoder_lock;
+
+    const HRESULT hr = encoder_lock.Seize(&m_encoder_lock);
+
+    if (FAILED(hr))
+        return hr;
+
+    vpx_codec_ctx_t* ctx = &m_ctx;
+    vpx_codec_err_t err = vpx_codec_enc_config_set(ctx, &m_cfg);
+
+    const Filter::simulcast_t& simulcast = m_pFilter->m_simulcast;
+
+    for (size_t i = 0; (err == VPX_CODEC_OK) && (i < simulcast.size()); ++i)
+    {
+        OutpinSimulcast* const pPin = simulcast[i];
+
+        ctx = &pPin->m_ctx;
+        err = pPin->ApplySettings();
+    }
 
     if (err == VPX_CODEC_OK)
     {
@@ -1270,7 +2628,7 @@ HRESULT Inpin::OnApplySettings(std::wstring& msg)
         return S_OK;
     }
 
-    const char* const str = vpx_codec_error_detail(&m_ctx);
+    const char* const str = vpx_codec_error_detail(ctx);
 
     const int cch = MultiByteToWideChar(
                         CP_UTF8,
@@ -1307,8 +2665,7 @@ void Inpin::SetConfig()
     const Filter::Config& src = m_pFilter->m_cfg;
     vpx_codec_enc_cfg_t& tgt = m_cfg;
 
-    if (src.threads >= 0)
-        tgt.g_threads = src.threads;
+    SetThreads(tgt, m_budget_id);
 
     if (src.error_resilient >= 0)
         tgt.g_error_resilient = src.error_resilient;
@@ -1423,24 +2780,213 @@ void Inpin::SetConfig()
 
     if (src.keyframe_max_interval >= 0)
         tgt.kf_max_dist = src.keyframe_max_interval;
+
+    if (m_layer_count > 0)
+    {
+        const TemporalLayerPattern& p = GetLayerPattern(m_layer_count);
+        const int* const bitrates = m_pFilter->m_temporal_layer_bitrates;
+
+        tgt.ts_number_layers = m_layer_count;
+        tgt.ts_periodicity = p.period;
+
+        for (unsigned int i = 0; i < p.period; ++i)
+            tgt.ts_layer_id[i] = p.layer_id[i];
+
+        for (int i = 0; i < m_layer_count; ++i)
+        {
+            tgt.ts_target_bitrate[i] = bitrates[i];
+            tgt.ts_rate_decimator[i] = p.rate_decimator[i];
+        }
+
+        tgt.rc_target_bitrate = bitrates[m_layer_count - 1];
+        tgt.g_lag_in_frames = 0;  //so that we know the layer of a packet
+    }
+
+    ClampLag(tgt, m_lookahead_id);  //a cut lag cannot be raised again
+}
+
+
+int Inpin::JoinThreadBudget(LONG w, LONG h) const
+{
+    //A thread count set with IVP8Encoder::SetThreadCount is this
+    //filter's to keep; only the default is shared.
+
+    if (m_pFilter->m_cfg.threads >= 0)
+        return 0;
+
+    webmdshow::EncoderThreadBudget::Demand d;
+
+    d.width = w;
+    d.height = h;
+    d.realtime = (GetDeadline() == kDeadlineRealtime);
+
+    return webmdshow::EncoderThreadBudget::Get().Join(d);
+}
+
+
+void Inpin::LeaveThreadBudget(int& budget_id)
+{
+    if (budget_id == 0)
+        return;
+
+    webmdshow::EncoderThreadBudget::Get().Leave(budget_id);
+    budget_id = 0;
+}
+
+
+int Inpin::JoinLookahead(vpx_codec_enc_cfg_t& tgt) const
+{
+    if (tgt.g_lag_in_frames == 0)
+        return 0;
+
+    using webmdshow::EncoderLookahead;
+
+    EncoderLookahead::Demand d;
+
+    d.frame_bytes = EncoderLookahead::GetFrameBytes(tgt.g_w, tgt.g_h);
+    d.lag = tgt.g_lag_in_frames;
+
+    const int lookahead_id = EncoderLookahead::Get().Join(d);
+
+    ClampLag(tgt, lookahead_id);  //to what fits in the budget
+
+    return lookahead_id;
+}
+
+
+void Inpin::LeaveLookahead(int& lookahead_id)
+{
+    if (lookahead_id == 0)
+        return;
+
+    webmdshow::EncoderLookahead::Get().Leave(lookahead_id);
+    lookahead_id = 0;
+}
+
+
+void Inpin::ClampLag(vpx_codec_enc_cfg_t& tgt, int lookahead_id)
+{
+    if (lookahead_id == 0)
+        return;
+
+    const int lag = webmdshow::EncoderLookahead::Get().GetLag(lookahead_id);
+
+    if ((lag >= 0) && (tgt.g_lag_in_frames > unsigned(lag)))
+        tgt.g_lag_in_frames = lag;
+}
+
+
+void Inpin::ApplyLookaheadGrant(
+    vpx_codec_ctx_t* ctx,
+    vpx_codec_enc_cfg_t* cfg,
+    int lookahead_id)
+{
+    assert(ctx);
+    assert(cfg);
+
+    if ((lookahead_id == 0) || (ctx->iface == 0))
+        return;
+
+    const unsigned int lag = cfg->g_lag_in_frames;
+
+    ClampLag(*cfg, lookahead_id);
+
+    if (cfg->g_lag_in_frames == lag)
+        return;
+
+    //libvpx lowers the lag of a running encoder (the frames it already
+    //holds are drained as it goes), but keeps the lookahead it allocated
+    //at init until it is destroyed.
+
+    const vpx_codec_err_t err = vpx_codec_enc_config_set(ctx, cfg);
+
+    if (err != VPX_CODEC_OK)  //keep the lag it has
+        cfg->g_lag_in_frames = lag;
 }
 
 
-vpx_codec_err_t Inpin::SetTokenPartitions()
+void Inpin::SetThreads(vpx_codec_enc_cfg_t& tgt, int budget_id) const
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
-    if (src.token_partitions < 0)
-        return VPX_CODEC_OK;
+    if (src.threads >= 0)
+    {
+        tgt.g_threads = src.threads;
+        return;
+    }
+
+    webmdshow::EncoderThreadBudget::Grant grant;
+
+    if (budget_id && webmdshow::EncoderThreadBudget::Get().GetGrant(
+                        budget_id,
+                        &grant))
+    {
+        tgt.g_threads = grant.threads;
+    }
+}
+
+
+void Inpin::ApplyThreadGrant(
+    vpx_codec_ctx_t* ctx,
+    vpx_codec_enc_cfg_t* cfg,
+    int budget_id)
+{
+    assert(ctx);
+    assert(cfg);
+
+    if ((budget_id == 0) || (ctx->iface == 0))
+        return;
+
+    const unsigned int threads = cfg->g_threads;
+
+    SetThreads(*cfg, budget_id);
+
+    if (cfg->g_threads != threads)
+    {
+        const vpx_codec_err_t err = vpx_codec_enc_config_set(ctx, cfg);
+
+        if (err != VPX_CODEC_OK)  //keep the threads it has
+            cfg->g_threads = threads;
+    }
+
+    const vpx_codec_err_t err = SetTokenPartitions(ctx, budget_id);
+    err;
+    assert(err == VPX_CODEC_OK);
+}
+
+
+vpx_codec_err_t Inpin::SetTokenPartitions(
+    vpx_codec_ctx_t* ctx,
+    int budget_id)
+{
+    const Filter::Config& src = m_pFilter->m_cfg;
+
+    int val = src.token_partitions;
+
+    if (val < 0)
+    {
+        //As many partitions as the encoder has threads, so that the
+        //decoder can use as many.  The VP9 encoder has tiles instead.
+
+        webmdshow::EncoderThreadBudget::Grant grant;
+
+        if (budget_id == 0 || GetCodec() != &vpx_codec_vp8_cx_algo)
+            return VPX_CODEC_OK;
+
+        if (!webmdshow::EncoderThreadBudget::Get().GetGrant(budget_id, &grant))
+            return VPX_CODEC_OK;
+
+        val = grant.token_partitions;
+    }
 
     const vp8e_token_partitions token_partitions =
-        static_cast<vp8e_token_partitions>(src.token_partitions);
+        static_cast<vp8e_token_partitions>(val);
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_TOKEN_PARTITIONS, token_partitions);
+        ctx, VP8E_SET_TOKEN_PARTITIONS, token_partitions);
 }
 
-vpx_codec_err_t Inpin::SetAutoAltRef()
+vpx_codec_err_t Inpin::SetAutoAltRef(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1448,10 +2994,10 @@ vpx_codec_err_t Inpin::SetAutoAltRef()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_ENABLEAUTOALTREF, src.auto_alt_ref);
+        ctx, VP8E_SET_ENABLEAUTOALTREF, src.auto_alt_ref);
 }
 
-vpx_codec_err_t Inpin::SetARNRMaxFrames()
+vpx_codec_err_t Inpin::SetARNRMaxFrames(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1459,10 +3005,10 @@ vpx_codec_err_t Inpin::SetARNRMaxFrames()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_ARNR_MAXFRAMES, src.arnr_max_frames);
+        ctx, VP8E_SET_ARNR_MAXFRAMES, src.arnr_max_frames);
 }
 
-vpx_codec_err_t Inpin::SetARNRStrength()
+vpx_codec_err_t Inpin::SetARNRStrength(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1470,10 +3016,10 @@ vpx_codec_err_t Inpin::SetARNRStrength()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_ARNR_STRENGTH, src.arnr_strength);
+        ctx, VP8E_SET_ARNR_STRENGTH, src.arnr_strength);
 }
 
-vpx_codec_err_t Inpin::SetARNRType()
+vpx_codec_err_t Inpin::SetARNRType(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1481,10 +3027,10 @@ vpx_codec_err_t Inpin::SetARNRType()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_ARNR_TYPE, src.arnr_type);
+        ctx, VP8E_SET_ARNR_TYPE, src.arnr_type);
 }
 
-vpx_codec_err_t Inpin::SetCPUUsed()
+vpx_codec_err_t Inpin::SetCPUUsed(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1492,10 +3038,10 @@ vpx_codec_err_t Inpin::SetCPUUsed()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_CPUUSED, src.cpu_used);
+        ctx, VP8E_SET_CPUUSED, src.cpu_used);
 }
 
-vpx_codec_err_t Inpin::SetStaticThreshold()
+vpx_codec_err_t Inpin::SetStaticThreshold(vpx_codec_ctx_t* ctx)
 {
     const Filter::Config& src = m_pFilter->m_cfg;
 
@@ -1503,105 +3049,133 @@ vpx_codec_err_t Inpin::SetStaticThreshold()
         return VPX_CODEC_OK;
 
     return vpx_codec_control(
-        &m_ctx, VP8E_SET_STATIC_THRESHOLD, src.static_threshold);
+        ctx, VP8E_SET_STATIC_THRESHOLD, src.static_threshold);
 }
 
-BYTE* Inpin::ConvertYUY2ToYV12(
-    const BYTE* srcbuf,
-    ULONG w,
-    ULONG h)
+void Inpin::FreeImage()
 {
-    assert(srcbuf);
-    assert((w % 2) == 0);  //TODO
-    assert((h % 2) == 0);  //TODO
-
-    const ULONG len = w*h + 2*((w+1)/2)*((h+1)/2);
+    if (m_img == 0)
+        return;
 
-    if (m_buflen < len)
-    {
-        delete[] m_buf;
+    webmdshow::FramePool* const pool =
+        webmdshow::EncoderLookahead::Get().image_pool();
 
-        m_buf = 0;
-        m_buflen = 0;
+    pool->Release(m_img_buf, m_img_capacity);
 
-        m_buf = new (std::nothrow) BYTE[len];
-        assert(m_buf);  //TODO
+    m_img = 0;
+    m_img_buf = 0;
+    m_img_capacity = 0;
+}
 
-        m_buflen = len;
-    }
 
-    BYTE* dst_y = m_buf;
-    BYTE* dst_v = dst_y + w*h;
-    BYTE* dst_u = dst_v + ((w/2)*(h/2));
+vpx_image_t* Inpin::Convert(
+    const GUID& subtype,
+    const BITMAPINFOHEADER& bmih,
+    const BYTE* src,
+    long len)
+{
+    assert(src);
 
-    const ULONG src_stride = 2*w;
+    const LONG w = bmih.biWidth;
+    assert(w > 0);
 
-    const ULONG dst_y_stride = w;
-    const ULONG dst_uv_stride = w/2;
+    const LONG h = labs(bmih.biHeight);
+    assert(h > 0);
 
-    const BYTE* src = srcbuf;
+    if (m_img && ((m_img->d_w != ULONG(w)) || (m_img->d_h != ULONG(h))))
+        FreeImage();
 
-    for (ULONG i = 0; i < h; ++i)
+    if (m_img == 0)
     {
-        const BYTE* src0_y = src;
-        src = src0_y + src_stride;
+        //As vpx_img_alloc lays out an I420 image: the luma stride
+        //aligned to 16, the chroma planes half of it.
 
-        BYTE* dst0_y = dst_y;
-        dst_y = dst0_y + dst_y_stride;
+        const size_t stride = (((w + 1) & ~1) + 15) & ~15;
+        const size_t size = stride * ((h + 1) & ~1) * 3 / 2;
 
-        for (ULONG j = 0; j < dst_y_stride; ++j)
-        {
-            *dst0_y = *src0_y;
+        webmdshow::FramePool* const pool =
+            webmdshow::EncoderLookahead::Get().image_pool();
 
-            src0_y += 2;
-            ++dst0_y;
-        }
+        m_img_buf = pool->Acquire(size, &m_img_capacity);
+
+        if (m_img_buf == 0)  //out of memory, or of budget
+            return 0;
+
+        m_img = vpx_img_wrap(
+                    &m_img_wrap,
+                    VPX_IMG_FMT_I420,
+                    w,
+                    h,
+                    16,
+                    m_img_buf);
+
+        assert(m_img == &m_img_wrap);
     }
 
-    src = srcbuf;
+    bool b;
 
-    for (ULONG i = 0; i < h; i += 2)
+    if (subtype == MEDIASUBTYPE_NV12)
     {
-        const BYTE* src0_u = src + 1;
-        const BYTE* src1_u = src0_u + src_stride;
+        //The luma isn't copied (see Encode).  The chroma rows follow the
+        //luma plane, each a pair of U and V for every two pixels.
 
-        const BYTE* src0_v = src + 3;
-        const BYTE* src1_v = src0_v + src_stride;
+        const LONG uv_stride = 2 * ((w + 1) / 2);
 
-        src += 2 * src_stride;
+        len;
+        assert(len >= w * h + uv_stride * ((h + 1) / 2));
 
-        BYTE* dst0_u = dst_u;
-        dst_u += dst_uv_stride;
+        const BYTE* const uv = src + w * h;
 
+        b = webmdshow::LibyuvNV12ChromaToI420(uv, uv_stride, w, h, m_img);
+    }
+    else if ((subtype == MEDIASUBTYPE_RGB32) ||
+        (subtype == MEDIASUBTYPE_ARGB32) ||
+        (subtype == MEDIASUBTYPE_RGB24))
+    {
+        const webmdshow::RgbFormat fmt =
+            (subtype == MEDIASUBTYPE_RGB24) ?
+                webmdshow::kRgbFormatRGB24 :
+                webmdshow::kRgbFormatRGB32;
 
-        BYTE* dst0_v = dst_v;
-        dst_v += dst_uv_stride;
+        const LONG bpp = (fmt == webmdshow::kRgbFormatRGB24) ? 3 : 4;
+        const LONG stride = (bpp * w + 3) & ~3;  //DIB rows are DWORD-aligned
 
-        for (ULONG j = 0; j < dst_uv_stride; ++j)
-        {
-            const UINT u0 = *src0_u;
-            const UINT u1 = *src1_u;
-            const UINT src_u = (u0 + u1) / 2;  //?
+        len;
+        assert(len >= stride * h);
 
-            const UINT v0 = *src0_v;
-            const UINT v1 = *src1_v;
-            const UINT src_v = (v0 + v1) / 2;  //?
+        //A positive biHeight means a bottom-up DIB.
+        const LONG hh = (bmih.biHeight > 0) ? -h : h;
 
-            *dst0_u = static_cast<BYTE>(src_u);
-            *dst0_v = static_cast<BYTE>(src_v);
+        b = webmdshow::LibyuvRgbToI420(src, stride, fmt, w, hh, m_img);
+    }
+    else
+    {
+        webmdshow::PackedYuvFormat fmt;
+
+        if (subtype == MEDIASUBTYPE_UYVY)
+            fmt = webmdshow::kPackedYuvUYVY;
 
-            src0_u += 4;
-            src1_u += 4;
+        else if (subtype == MEDIASUBTYPE_YVYU)
+            fmt = webmdshow::kPackedYuvYVYU;
 
-            src0_v += 4;
-            src1_v += 4;
+        else
+        {
+            assert((subtype == MEDIASUBTYPE_YUY2) ||
+                   (subtype == MEDIASUBTYPE_YUYV));
 
-            ++dst0_u;
-            ++dst0_v;
+            fmt = webmdshow::kPackedYuvYUY2;
         }
+
+        const LONG stride = (4 * ((w + 1) / 2) + 3) & ~3;
+        assert(len >= stride * h);
+
+        b = webmdshow::LibyuvPackedToI420(src, stride, fmt, w, h, m_img);
     }
 
-    return m_buf;
+    if (!b)
+        return 0;
+
+    return m_img;
 }
 
 
@@ -9,13 +9,21 @@
 #pragma once
 #include "vp8encoderpin.h"
 #include "graphutil.h"
+#include "clockable.h"
 #include "vpx/vpx_encoder.h"
 #include "ivp8sample.h"
+#include "duplicateframe.h"
+#include "spscqueue.h"
+#include <atomic>
 #include <list>
+#include <vector>
 
 namespace VP8EncoderLib
 {
 
+class OutpinVideo;
+class OutpinSimulcast;
+
 class Inpin : public Pin, public IMemInputPin
 {
     Inpin(const Inpin&);
@@ -83,48 +91,205 @@ public:
     HRESULT Start();  //from stopped to running/paused
     void Stop();      //from running/paused to stopped
 
+    void StartThread();
+    void StopThread();  //call without the filter lock; destroys encoder
+
     HRESULT OnApplySettings(std::wstring&);
 
+    HRESULT InitEncoder(
+                vpx_codec_ctx_t*,
+                const vpx_codec_enc_cfg_t*,
+                int budget_id);
+
+    //The primary encoder and each rendition have their own share of the
+    //process's encoder threads (see EncoderThreadBudget), unless the
+    //filter has a thread count of its own, when the id is 0.
+
+    int JoinThreadBudget(LONG w, LONG h) const;
+    static void LeaveThreadBudget(int& budget_id);
+    void SetThreads(vpx_codec_enc_cfg_t&, int budget_id) const;
+
+    void ApplyThreadGrant(  //holding the encoder lock
+            vpx_codec_ctx_t*,
+            vpx_codec_enc_cfg_t*,
+            int budget_id);
+
+    //The lookahead (lag_in_frames) of the primary encoder and of each
+    //rendition is charged to the memory budget by the process's encoder
+    //frame pool (see EncoderLookahead), which cuts the lag when the
+    //budget is short.  The id is 0 when the encoder has no lag.  Join
+    //sets the lag of the configuration to the lag granted.
+
+    int JoinLookahead(vpx_codec_enc_cfg_t&) const;
+    static void LeaveLookahead(int& lookahead_id);
+    static void ClampLag(vpx_codec_enc_cfg_t&, int lookahead_id);
+
+    static void ApplyLookaheadGrant(  //holding the encoder lock
+            vpx_codec_ctx_t*,
+            vpx_codec_enc_cfg_t*,
+            int lookahead_id);
+
 protected:
     //HRESULT GetName(PIN_INFO&) const;
     std::wstring GetName() const;
     HRESULT OnDisconnect();
-    void PurgePending();
 
 public:
     GraphUtil::IMemAllocatorPtr m_pAllocator;
     vpx_codec_enc_cfg_t m_cfg;
-    __int64 m_start_reftime;  //to implement IMediaSeeking::GetCurrentPos
+
+    //The position and the frame counts are written by the streaming
+    //threads holding the filter lock, but atomically, so that the
+    //applications that poll them (GetCurrentPosition, the IVP8Encoder
+    //stats) read them without the lock, and don't wait behind a frame.
+
+    std::atomic<__int64> m_start_reftime;  //for IMediaSeeking::GetCurrentPos
+
+    std::atomic<__int64> m_queued_count;
+    std::atomic<__int64> m_dropped_count;
+    std::atomic<__int64> m_blocked_count;
+    std::atomic<__int64> m_wrapped_count;    //encoded from the sample's planes
+    std::atomic<__int64> m_converted_count;  //encoded from m_img
+    std::atomic<__int64> m_skipped_count;    //repeats of the frame before
+    std::atomic<__int64> m_frame_stats_lost;  //to a full ring
+
+    //The frame statistics ring (see IVPXEncoder2::SetFrameStatsCapacity)
+    //is replaced only while the filter is stopped.  The encode thread
+    //writes it, and GetFrameStats drains it, neither with a lock.
+
+    HRESULT SetFrameStatsCapacity(int);
+    int GetFrameStatsCapacity() const;
+    int GetFrameStats(VPXFrameStats*, int);
+
+    //Encode times, in quarters of the frame interval (the last bucket
+    //counts everything slower), and the adaptive real-time operating
+    //point.  The encode thread updates them holding the filter lock.
+
+    __int64 m_encode_time_counts[kEncodeTimeBucketCount];
+    int m_rt_cpu_used;
+    unsigned long m_rt_deadline;
 
 private:
-    bool m_bDiscontinuity;
     bool m_bEndOfStream;
     bool m_bFlush;
     vpx_codec_ctx_t m_ctx;
 
-    typedef std::list<IVP8Sample::Frame> frames_t;
-    frames_t m_pending;  //waiting to be pushed downstream
+    //Receive queues samples for the encode thread, which encodes them
+    //and delivers the frames downstream.  A null sample is EOS.  The
+    //thread calls vpx_codec_encode without the filter lock, holding the
+    //encoder lock instead, so that Receive need not wait for it.  The
+    //simulcast renditions encode on their own threads meanwhile, also
+    //under the encoder lock.
+
+    class EncoderLock : public CLockable
+    {
+    public:
+        EncoderLock();
+    };
+
+    EncoderLock m_encoder_lock;
+
+    typedef std::list<IMediaSample*> samples_t;
+    samples_t m_samples;  //waiting to be encoded
+
+    HANDLE m_hThread;
+    HANDLE m_hSamples;  //signalled when a sample is queued
+    HANDLE m_hSpace;    //signalled when a sample is dequeued
+    HANDLE m_hIdle;     //set while thread is not handling a sample
+    bool m_bBusy;
+    HRESULT m_hrDeliver;  //result of last downstream Receive
+
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+
+    HRESULT Encode(CLockable::Lock&, IMediaSample*);
+    HRESULT Drain(CLockable::Lock&);
+    HRESULT GetPackets(
+        vpx_codec_ctx_t*,
+        OutpinVideo&,
+        const VPXFrameStats* = 0,  //of the encode call, to record frames
+        int* = 0);                 //frames got
+    HRESULT Deliver(CLockable::Lock&, OutpinVideo&);
+    void PurgeSamples();
+    int GetSimulcast(OutpinSimulcast**) const;
+
+    void AppendFrame(OutpinVideo&, const vpx_codec_cx_pkt_t*);
+
+    typedef webmdshow::SpscQueue<VPXFrameStats> frame_stats_t;
+    frame_stats_t* m_frame_stats;
+
+    void PostFrameStats(const VPXFrameStats&, const vpx_codec_cx_pkt_t*);
+    void PopulateSample(OutpinVideo&, IMediaSample*);
+
+    vpx_codec_iface_t* GetCodec() const;
+    unsigned long GetDeadline() const;  //of the settings
+    int GetMaxCPUUsed() const;
+    void SetConfig();
+    vpx_codec_err_t SetTokenPartitions(vpx_codec_ctx_t*, int budget_id);
+    vpx_codec_err_t SetAutoAltRef(vpx_codec_ctx_t*);
+    vpx_codec_err_t SetARNRMaxFrames(vpx_codec_ctx_t*);
+    vpx_codec_err_t SetARNRStrength(vpx_codec_ctx_t*);
+    vpx_codec_err_t SetARNRType(vpx_codec_ctx_t*);
+    vpx_codec_err_t SetCPUUsed(vpx_codec_ctx_t*);
+    vpx_codec_err_t SetStaticThreshold(vpx_codec_ctx_t*);
+
+    //Packed, RGB or NV12 chroma is converted into this, which wraps a
+    //buffer of the encoder frame pool's images; null until needed.
 
-    void AppendFrame(const vpx_codec_cx_pkt_t*);
-    void PopulateSample(IMediaSample*);
+    vpx_image_t* m_img;
+    vpx_image_t m_img_wrap;
+    uint8_t* m_img_buf;
+    size_t m_img_capacity;
 
-    void SetConfig();
-    vpx_codec_err_t SetTokenPartitions();
-    vpx_codec_err_t SetAutoAltRef();
-    vpx_codec_err_t SetARNRMaxFrames();
-    vpx_codec_err_t SetARNRStrength();
-    vpx_codec_err_t SetARNRType();
-    vpx_codec_err_t SetCPUUsed();
-    vpx_codec_err_t SetStaticThreshold();
+    void FreeImage();
+
+    int m_rt_base_cpu_used;  //of the settings, as of Start
+    int m_cpu_used_applied;  //of the encoders; under the encoder lock
+    double m_rt_load;        //encode time over frame interval, averaged
+    int m_rt_settle;         //frames since the operating point changed
+    int m_budget_id;         //of the thread budget, or 0
+    uint32_t m_budget_generation;  //whose grants the encoders have
+    int m_lookahead_id;      //of the encoder frame pool, or 0
+    uint32_t m_lookahead_generation;
+    LONGLONG m_perf_freq;
+
+    void OnEncodeTime(LONGLONG ticks, unsigned long duration);
+
+    //Per-frame hints from IVPXSampleHints on the input sample.
 
-    BYTE* m_buf;
-    size_t m_buflen;
+    std::vector<unsigned char> m_active_map;
+    bool m_bActiveMap;  //set in the encoder
+    bool m_bRoiMap;     //set in the encoder
+
+    void ApplyHints(IMediaSample*, vpx_enc_frame_flags_t);
 
     REFERENCE_TIME m_last_keyframe_time;
     __int64 m_frames_received;
     __int64 m_decimate_start_time;
 
-    BYTE* ConvertYUY2ToYV12(const BYTE*, ULONG, ULONG);
+    //Duplicate frame skipping.  The detector is only used by Receive,
+    //without the filter lock, and by Start.
+
+    webmdshow::DuplicateFrameDetector m_duplicates;
+    int m_duplicate_run;  //frames skipped since the last one queued
+
+    HRESULT SkipDuplicate(CLockable::Lock&, IMediaSample*, __int64, bool&);
+
+    //Temporal layers, as of Start.  The encode thread steps through the
+    //pattern of layers, one place per frame, and a keyframe starts it
+    //again; m_layer is that of the frame it last encoded.
+
+    int m_layer_count;  //0 when the stream has no layers
+    int m_layer_index;  //place of the next frame in the pattern
+    int m_layer;
+
+    int NextLayer(vpx_enc_frame_flags_t, vpx_enc_frame_flags_t&);
+
+    vpx_image_t* Convert(
+        const GUID&,
+        const BITMAPINFOHEADER&,
+        const BYTE*,
+        long);
 
 };
 
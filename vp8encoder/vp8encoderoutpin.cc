@@ -243,15 +243,24 @@ HRESULT Outpin::EndFlush()
 }
 
 
+void Outpin::GetFrameSize(LONG& w, LONG& h) const
+{
+    const Inpin& inpin = m_pFilter->m_inpin;
+    const BITMAPINFOHEADER& bmih = inpin.GetBMIH();
+
+    w = bmih.biWidth;
+    h = labs(bmih.biHeight);
+}
+
+
 void Outpin::OnInpinConnect()
 {
     const Inpin& inpin = m_pFilter->m_inpin;
-    const BITMAPINFOHEADER& bmihIn = inpin.GetBMIH();
 
-    const LONG ww = bmihIn.biWidth;
-    assert(ww > 0);
+    LONG ww, hh;
+    GetFrameSize(ww, hh);  //dispatch to subclass
 
-    const LONG hh = labs(bmihIn.biHeight);
+    assert(ww > 0);
     assert(hh > 0);
 
     //TODO: does this really need to be a conditional expr?
@@ -13,6 +13,7 @@
 #include "vp8encoderoutpinpreview.h"
 #include "cmediasample.h"
 #include "mediatypeutil.h"
+#include "libyuv_util.h"
 #include <vfwmsgs.h>
 #include <amvideo.h>
 #include <dvdmedia.h>
@@ -27,11 +28,126 @@ using std::hex;
 
 using std::wstring;
 
+namespace
+{
+
+//Both write the YV12 layout of the preview connection (the V plane,
+//then the U plane, after the Y plane), and return the end of it.
+
+BYTE* CopyImage(const vpx_image_t* img, BYTE* pOutBuf, LONG strideOut)
+{
+    unsigned int wIn = img->d_w;
+    unsigned int hIn = img->d_h;
+
+    BYTE* pOut = pOutBuf;
+
+    //Y
+
+    const BYTE* pInY = img->planes[VPX_PLANE_Y];
+    assert(pInY);
+
+    const int strideInY = img->stride[VPX_PLANE_Y];
+
+    for (unsigned int y = 0; y < hIn; ++y)
+    {
+        memcpy(pOut, pInY, wIn);
+        pInY += strideInY;
+        pOut += strideOut;
+    }
+
+    strideOut = (strideOut + 1) / 2;
+
+    wIn = (wIn + 1) / 2;
+    hIn = (hIn + 1) / 2;
+
+    const BYTE* pInV = img->planes[VPX_PLANE_V];
+    assert(pInV);
+
+    const int strideInV = img->stride[VPX_PLANE_V];
+
+    const BYTE* pInU = img->planes[VPX_PLANE_U];
+    assert(pInU);
+
+    const int strideInU = img->stride[VPX_PLANE_U];
+
+    //V
+
+    for (unsigned int y = 0; y < hIn; ++y)
+    {
+        memcpy(pOut, pInV, wIn);
+        pInV += strideInV;
+        pOut += strideOut;
+    }
+
+    //U
+
+    for (unsigned int y = 0; y < hIn; ++y)
+    {
+        memcpy(pOut, pInU, wIn);
+        pInU += strideInU;
+        pOut += strideOut;
+    }
+
+    return pOut;
+}
+
+
+BYTE* ScaleImage(
+    const vpx_image_t* img,
+    LONG wOut,
+    LONG hOut,
+    BYTE* pOutBuf,
+    LONG strideOut)
+{
+    //Scale straight into the sample, which we describe to libyuv as a
+    //YV12 image with the strides of our connection.
+
+    const LONG strideOutUV = (strideOut + 1) / 2;
+    const LONG hOutUV = (hOut + 1) / 2;
+
+    vpx_image_t img_;
+
+    vpx_image_t* tgt = vpx_img_wrap(
+                        &img_,
+                        VPX_IMG_FMT_YV12,
+                        wOut,
+                        hOut,
+                        1,
+                        pOutBuf);
+    assert(tgt == &img_);
+
+    BYTE* pOut = pOutBuf;
+
+    tgt->stride[VPX_PLANE_Y] = strideOut;
+    tgt->stride[VPX_PLANE_U] = strideOutUV;
+    tgt->stride[VPX_PLANE_V] = strideOutUV;
+
+    tgt->planes[VPX_PLANE_Y] = pOut;
+    pOut += strideOut * hOut;
+
+    tgt->planes[VPX_PLANE_V] = pOut;
+    pOut += strideOutUV * hOutUV;
+
+    tgt->planes[VPX_PLANE_U] = pOut;
+    pOut += strideOutUV * hOutUV;
+
+    if (!webmdshow::LibyuvScaleI420(wOut, hOut, img, &tgt))
+        return 0;
+
+    assert(tgt == &img_);  //same size, so not reallocated
+    return pOut;
+}
+
+}  //end anon namespace
+
 namespace VP8EncoderLib
 {
 
 OutpinPreview::OutpinPreview(Filter* pFilter) :
-    Outpin(pFilter, L"preview")
+    Outpin(pFilter, L"preview"),
+    m_max_fps(0),
+    m_max_width(0),
+    m_next_time(-1)
 {
 }
 
@@ -167,6 +283,27 @@ void OutpinPreview::SetDefaultMediaTypes()
 }
 
 
+void OutpinPreview::GetFrameSize(LONG& w, LONG& h) const
+{
+    LONG ww, hh;
+    Outpin::GetFrameSize(ww, hh);  //of the input
+
+    if ((m_max_width <= 0) || (ww <= m_max_width))
+    {
+        w = ww;
+        h = hh;
+    }
+    else
+    {
+        w = m_max_width;
+        h = MulDiv(m_max_width, hh, ww);
+
+        if (h < 1)
+            h = 1;
+    }
+}
+
+
 HRESULT OutpinPreview::PostConnect(IPin* p)
 {
     GraphUtil::IMemInputPinPtr pInputPin;
@@ -193,7 +330,8 @@ HRESULT OutpinPreview::PostConnect(IPin* p)
 
 void OutpinPreview::Render(
     CLockable::Lock& lock,
-    const vpx_image_t* img)
+    const vpx_image_t* img,
+    REFERENCE_TIME st)
 {
     assert(img);
 
@@ -206,6 +344,25 @@ void OutpinPreview::Render(
     if (!bool(m_pAllocator))
         return;
 
+    //Frames above the preview rate are dropped here, before we touch
+    //them, so that a monitor doesn't take cycles from the encoder.
+
+    if (m_max_fps > 0)
+    {
+        if ((m_next_time >= 0) && (st < m_next_time))
+            return;
+
+        const REFERENCE_TIME interval = 10000000 / m_max_fps;
+
+        if (m_next_time < 0)
+            m_next_time = st;
+
+        m_next_time += interval;
+
+        if (m_next_time <= st)  //we fell behind (a gap in the input)
+            m_next_time = st + interval;
+    }
+
     HRESULT hr = lock.Release();
     assert(SUCCEEDED(hr));
 
@@ -239,19 +396,10 @@ void OutpinPreview::Render(
         pmt = 0;
     }
 
-    unsigned int wIn = img->d_w;
-    unsigned int hIn = img->d_h;
-
     const BITMAPINFOHEADER& bmih = GetBMIH();
 
-    LONG strideOut = bmih.biWidth;
+    const LONG strideOut = bmih.biWidth;
     assert(strideOut);
-    assert((strideOut % 2) == 0);
-
-    //Y
-
-    const BYTE* pInY = img->planes[VPX_PLANE_Y];
-    assert(pInY);
 
     BYTE* pOutBuf;
 
@@ -259,49 +407,18 @@ void OutpinPreview::Render(
     assert(SUCCEEDED(hr));
     assert(pOutBuf);
 
-    BYTE* pOut = pOutBuf;
-
-    const int strideInY = img->stride[VPX_PLANE_Y];
-
-    for (unsigned int y = 0; y < hIn; ++y)
-    {
-        memcpy(pOut, pInY, wIn);
-        pInY += strideInY;
-        pOut += strideOut;
-    }
-
-    strideOut /= 2;
-
-    wIn = (wIn + 1) / 2;
-    hIn = (hIn + 1) / 2;
-
-    const BYTE* pInV = img->planes[VPX_PLANE_V];
-    assert(pInV);
+    LONG wOut, hOut;
+    GetFrameSize(wOut, hOut);
 
-    const int strideInV = img->stride[VPX_PLANE_V];
+    BYTE* pOut;
 
-    const BYTE* pInU = img->planes[VPX_PLANE_U];
-    assert(pInU);
-
-    const int strideInU = img->stride[VPX_PLANE_U];
-
-    //V
-
-    for (unsigned int y = 0; y < hIn; ++y)
-    {
-        memcpy(pOut, pInV, wIn);
-        pInV += strideInV;
-        pOut += strideOut;
-    }
-
-    //U
+    if ((img->d_w == ULONG(wOut)) && (img->d_h == ULONG(hOut)))
+        pOut = CopyImage(img, pOutBuf, strideOut);
+    else
+        pOut = ScaleImage(img, wOut, hOut, pOutBuf, strideOut);
 
-    for (unsigned int y = 0; y < hIn; ++y)
-    {
-        memcpy(pOut, pInU, wIn);
-        pInU += strideInU;
-        pOut += strideOut;
-    }
+    if (pOut == 0)
+        return;
 
     hr = pOutSample->SetTime(0, 0);
     assert(SUCCEEDED(hr));
@@ -39,12 +39,21 @@ public:
 
     //local functions
 
-    void Render(CLockable::Lock&, const vpx_image_t*);
+    void Render(CLockable::Lock&, const vpx_image_t*, REFERENCE_TIME);
     void SetDefaultMediaTypes();
 
+    //Preview decimation: at most m_max_fps frames per second (0 means
+    //every frame), and at most m_max_width pixels wide (0 means the
+    //width of the input), scaled keeping the aspect ratio.
+
+    int m_max_fps;
+    LONG m_max_width;
+    REFERENCE_TIME m_next_time;  //of the next frame rendered; -1 at start
+
 protected:
     virtual HRESULT PostConnect(IPin*);
     void GetSubtype(GUID&) const;
+    void GetFrameSize(LONG&, LONG&) const;
 
 };
 
@@ -0,0 +1,409 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <comdef.h>
+#include <uuids.h>
+#include "vp8encoderfilter.h"
+#include "vp8encoderoutpinsimulcast.h"
+#include "libyuv_util.h"
+#include <vfwmsgs.h>
+#include <process.h>
+#include <sstream>
+#include <cassert>
+#ifdef _DEBUG
+#include "odbgstream.h"
+using std::endl;
+using std::dec;
+using std::hex;
+#endif
+
+using std::wstring;
+
+namespace
+{
+
+wstring GetSimulcastId(int index)
+{
+    std::wostringstream os;
+    os << L"simulcast" << (index + 1);
+
+    return os.str();
+}
+
+}  //end anon namespace
+
+namespace VP8EncoderLib
+{
+
+OutpinSimulcast::OutpinSimulcast(Filter* pFilter, int index) :
+    OutpinVideo(pFilter, GetSimulcastId(index).c_str()),
+    m_index(index),
+    m_width(0),
+    m_height(0),
+    m_target_bitrate(-1),
+    m_img(0),
+    m_budget_id(0),
+    m_lookahead_id(0),
+    m_hThread(0),
+    m_bStop(false),
+    m_post_img(0),
+    m_post_pts(0),
+    m_post_duration(0),
+    m_post_flags(0),
+    m_post_deadline(0),
+    m_post_err(VPX_CODEC_OK)
+{
+    memset(&m_ctx, 0, sizeof m_ctx);
+    memset(&m_cfg, 0, sizeof m_cfg);
+
+    m_hPosted = CreateEvent(0, 0, 0, 0);
+    assert(m_hPosted);
+
+    m_hDone = CreateEvent(0, 0, 0, 0);
+    assert(m_hDone);
+}
+
+
+OutpinSimulcast::~OutpinSimulcast()
+{
+    assert(m_hThread == 0);
+    assert(m_ctx.iface == 0);
+
+    vpx_img_free(m_img);
+
+    BOOL b = CloseHandle(m_hPosted);
+    assert(b);
+
+    b = CloseHandle(m_hDone);
+    assert(b);
+}
+
+
+std::wstring OutpinSimulcast::GetName() const
+{
+    std::wostringstream os;
+    os << OutpinVideo::GetName() << L' ' << (m_index + 1);
+
+    return os.str();
+}
+
+
+HRESULT OutpinSimulcast::QueryAccept(const AM_MEDIA_TYPE* pmt)
+{
+    {
+        Filter::Lock lock;
+
+        const HRESULT hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
+
+        //Only the primary output writes first-pass stats.
+
+        if (m_pFilter->GetPassMode() == kPassModeFirstPass)
+            return S_FALSE;
+    }
+
+    return OutpinVideo::QueryAccept(pmt);
+}
+
+
+void OutpinSimulcast::OnInpinConnect()
+{
+    assert(!bool(m_pPinConnection));
+    Outpin::OnInpinConnect();
+}
+
+
+HRESULT OutpinSimulcast::PostConnect(IPin* p)
+{
+    return PostConnectVideo(p);
+}
+
+
+void OutpinSimulcast::GetFrameSize(LONG& w, LONG& h) const
+{
+    LONG ww, hh;
+    Outpin::GetFrameSize(ww, hh);  //of the input
+
+    if (m_width <= 0 && m_height <= 0)
+    {
+        w = ww;
+        h = hh;
+    }
+    else if (m_height <= 0)
+    {
+        w = m_width;
+        h = MulDiv(m_width, hh, ww);
+    }
+    else if (m_width <= 0)
+    {
+        w = MulDiv(m_height, ww, hh);
+        h = m_height;
+    }
+    else
+    {
+        w = m_width;
+        h = m_height;
+    }
+
+    if (w < 1)
+        w = 1;
+
+    if (h < 1)
+        h = 1;
+}
+
+
+HRESULT OutpinSimulcast::StartEncoder()
+{
+    assert(m_hThread == 0);
+    assert(m_ctx.iface == 0);
+
+    m_bDiscontinuity = true;
+    PurgePending();
+
+    if (!bool(m_pPinConnection))
+        return S_FALSE;
+
+    if (m_pFilter->GetPassMode() == kPassModeFirstPass)
+        return S_FALSE;
+
+    Inpin& inpin = m_pFilter->m_inpin;
+
+    const BITMAPINFOHEADER& bmih = GetBMIH();  //of our connection
+    m_budget_id = inpin.JoinThreadBudget(bmih.biWidth, labs(bmih.biHeight));
+
+    SetConfig();
+
+    m_lookahead_id = inpin.JoinLookahead(m_cfg);
+
+    return inpin.InitEncoder(&m_ctx, &m_cfg, m_budget_id);
+}
+
+
+void OutpinSimulcast::SetConfig()
+{
+    //Every setting but the size and the bitrate is the primary's, which
+    //Inpin::Start has already configured.
+
+    m_cfg = m_pFilter->m_inpin.m_cfg;
+
+    const BITMAPINFOHEADER& bmih = GetBMIH();  //of our connection
+
+    m_cfg.g_w = bmih.biWidth;
+    m_cfg.g_h = labs(bmih.biHeight);
+
+    if (m_target_bitrate > 0)
+        m_cfg.rc_target_bitrate = m_target_bitrate;
+
+    //Two-pass stats describe the primary output's frames, not ours.
+
+    m_cfg.g_pass = VPX_RC_ONE_PASS;
+    m_cfg.rc_twopass_stats_in.buf = 0;
+    m_cfg.rc_twopass_stats_in.sz = 0;
+
+    //Nor are the temporal layers ours.
+
+    m_cfg.ts_number_layers = 1;
+    m_cfg.ts_periodicity = 0;
+
+    //Nor are the primary's threads.
+
+    m_pFilter->m_inpin.SetThreads(m_cfg, m_budget_id);
+
+    //Nor its lookahead, if ours was cut.
+
+    Inpin::ClampLag(m_cfg, m_lookahead_id);
+}
+
+
+vpx_codec_err_t OutpinSimulcast::ApplySettings()
+{
+    if (m_ctx.iface == 0)  //not encoding
+        return VPX_CODEC_OK;
+
+    SetConfig();
+
+    return vpx_codec_enc_config_set(&m_ctx, &m_cfg);
+}
+
+
+void OutpinSimulcast::ApplyThreadGrant()
+{
+    m_pFilter->m_inpin.ApplyThreadGrant(&m_ctx, &m_cfg, m_budget_id);
+}
+
+
+void OutpinSimulcast::ApplyLookaheadGrant()
+{
+    Inpin::ApplyLookaheadGrant(&m_ctx, &m_cfg, m_lookahead_id);
+}
+
+
+bool OutpinSimulcast::IsEncoding() const
+{
+    return (m_hThread != 0);
+}
+
+
+void OutpinSimulcast::StartThread()
+{
+    assert(m_hThread == 0);
+
+    if (m_ctx.iface == 0)  //not connected, or first pass
+        return;
+
+    m_bStop = false;
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &OutpinSimulcast::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp8enc::OutpinSimulcast::StartThread: hThread=0x"
+       << hex << h << dec
+       << endl;
+#endif
+}
+
+
+void OutpinSimulcast::StopThread()
+{
+    //The encode thread has terminated, so nothing is posted to us.
+
+    if (m_hThread)
+    {
+        m_bStop = true;
+
+        const BOOL b = SetEvent(m_hPosted);
+        b;
+        assert(b);
+
+        const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        const BOOL bClose = CloseHandle(m_hThread);
+        bClose;
+        assert(bClose);
+
+        m_hThread = 0;
+    }
+
+    if (m_ctx.iface)
+    {
+        const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+        err;
+        assert(err == VPX_CODEC_OK);
+
+        memset(&m_ctx, 0, sizeof m_ctx);
+    }
+
+    Inpin::LeaveThreadBudget(m_budget_id);  //also when StartEncoder failed
+    Inpin::LeaveLookahead(m_lookahead_id);
+}
+
+
+void OutpinSimulcast::Post(
+    const vpx_image_t* img,
+    vpx_codec_pts_t pts,
+    unsigned long duration,
+    vpx_enc_frame_flags_t flags,
+    unsigned long deadline)
+{
+    assert(m_hThread);
+
+    m_post_img = img;
+    m_post_pts = pts;
+    m_post_duration = duration;
+    m_post_flags = flags;
+    m_post_deadline = deadline;
+
+    const BOOL b = SetEvent(m_hPosted);
+    b;
+    assert(b);
+}
+
+
+vpx_codec_err_t OutpinSimulcast::Wait()
+{
+    assert(m_hThread);
+
+    const DWORD dw = WaitForSingleObject(m_hDone, INFINITE);
+
+    if (dw == WAIT_FAILED)
+        return VPX_CODEC_ERROR;
+
+    assert(dw == WAIT_OBJECT_0);
+
+    return m_post_err;
+}
+
+
+unsigned OutpinSimulcast::ThreadProc(void* pv)
+{
+    OutpinSimulcast* const pPin = static_cast<OutpinSimulcast*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned OutpinSimulcast::Main()
+{
+    for (;;)
+    {
+        const DWORD dw = WaitForSingleObject(m_hPosted, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return 0;  //TODO: signal error
+
+        assert(dw == WAIT_OBJECT_0);
+
+        if (m_bStop)
+            return 0;
+
+        const vpx_image_t* img = m_post_img;
+
+        if (img && (img->d_w != m_cfg.g_w || img->d_h != m_cfg.g_h))
+        {
+            if (webmdshow::LibyuvScaleI420(m_cfg.g_w, m_cfg.g_h, img, &m_img))
+                img = m_img;
+            else
+                img = 0;
+        }
+
+        if (m_post_img && (img == 0))
+            m_post_err = VPX_CODEC_MEM_ERROR;
+        else
+            m_post_err = vpx_codec_encode(
+                            &m_ctx,
+                            img,
+                            m_post_pts,
+                            m_post_duration,
+                            m_post_flags,
+                            m_post_deadline);
+
+        const BOOL b = SetEvent(m_hDone);
+        b;
+        assert(b);
+    }
+}
+
+
+}  //end namespace VP8EncoderLib
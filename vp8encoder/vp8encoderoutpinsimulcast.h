@@ -0,0 +1,100 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "vp8encoderoutpinvideo.h"
+#include "vpx/vpx_encoder.h"
+
+namespace VP8EncoderLib
+{
+class Filter;
+
+//A simulcast rendition: an extra video output pin with an encoder of its
+//own.  The inpin's encode thread hands each input image to the pin's
+//worker thread, which scales it to the pin's size and encodes it while
+//the encode thread encodes the primary output.  The encode thread then
+//collects the packets and delivers them, as it does for the primary.
+
+class OutpinSimulcast : public OutpinVideo
+{
+    OutpinSimulcast(const OutpinSimulcast&);
+    OutpinSimulcast& operator=(const OutpinSimulcast&);
+
+protected:
+    std::wstring GetName() const;
+
+public:
+    OutpinSimulcast(Filter*, int index);
+    virtual ~OutpinSimulcast();
+
+    //IPin interface:
+
+    HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE*);
+
+    //local functions
+
+    void OnInpinConnect();
+
+    HRESULT StartEncoder();  //after Inpin::Start, from stopped
+    void StartThread();
+    void StopThread();  //call without the filter lock; destroys encoder
+    bool IsEncoding() const;
+
+    //Called by the encode thread, without the filter lock but holding
+    //the inpin's encoder lock.  A null image drains the encoder.
+
+    void Post(
+        const vpx_image_t*,
+        vpx_codec_pts_t,
+        unsigned long duration,
+        vpx_enc_frame_flags_t,
+        unsigned long deadline);
+
+    vpx_codec_err_t Wait();  //for the image posted last
+
+    vpx_codec_err_t ApplySettings();  //holding the encoder lock
+    void ApplyThreadGrant();          //holding the encoder lock
+    void ApplyLookaheadGrant();       //holding the encoder lock
+
+    const int m_index;
+    LONG m_width;           //0 means from the input
+    LONG m_height;          //0 means from the input
+    int m_target_bitrate;   //kbps; 0 or less means the filter's
+    vpx_codec_ctx_t m_ctx;
+
+protected:
+    HRESULT PostConnect(IPin*);
+    void GetFrameSize(LONG&, LONG&) const;
+
+private:
+    vpx_codec_enc_cfg_t m_cfg;
+    vpx_image_t* m_img;  //input scaled to our size
+    int m_budget_id;     //of the thread budget, or 0
+    int m_lookahead_id;  //of the encoder frame pool, or 0
+
+    HANDLE m_hThread;
+    HANDLE m_hPosted;  //signalled when an image is posted
+    HANDLE m_hDone;    //signalled when the posted image is encoded
+    bool m_bStop;
+
+    const vpx_image_t* m_post_img;
+    vpx_codec_pts_t m_post_pts;
+    unsigned long m_post_duration;
+    vpx_enc_frame_flags_t m_post_flags;
+    unsigned long m_post_deadline;
+    vpx_codec_err_t m_post_err;
+
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+
+    void SetConfig();
+
+};
+
+
+}  //end namespace VP8EncoderLib
@@ -33,13 +33,24 @@ namespace VP8EncoderLib
 {
 
 OutpinVideo::OutpinVideo(Filter* pFilter) :
-    Outpin(pFilter, L"output")
+    Outpin(pFilter, L"output"),
+    m_bDiscontinuity(true),
+    m_stats_record_size(0)
+{
+}
+
+
+OutpinVideo::OutpinVideo(Filter* pFilter, const wchar_t* id) :
+    Outpin(pFilter, id),
+    m_bDiscontinuity(true),
+    m_stats_record_size(0)
 {
 }
 
 
 OutpinVideo::~OutpinVideo()
 {
+    PurgePending();
 }
 
 
@@ -443,12 +454,9 @@ HRESULT OutpinVideo::GetStopPosition(LONGLONG* p)
 
 HRESULT OutpinVideo::GetCurrentPosition(LONGLONG* p)
 {
-    Filter::Lock lock;
-
-    HRESULT hr = lock.Seize(m_pFilter);
-
-    if (FAILED(hr))
-        return hr;
+    //No filter lock: players poll the position, and it shouldn't wait
+    //for the frame being encoded.  The position is atomic, and the
+    //connection doesn't change while the graph is streaming.
 
     if (!bool(m_pPinConnection))
         return VFW_E_NOT_CONNECTED;
@@ -459,7 +467,6 @@ HRESULT OutpinVideo::GetCurrentPosition(LONGLONG* p)
 
     if (bool(pSeek))
     {
-        lock.Release();
         return pSeek->GetCurrentPosition(p);
     }
 
@@ -759,7 +766,7 @@ void OutpinVideo::SetFirstPassMediaTypes()
 }
 
 
-HRESULT OutpinVideo::GetFrame(IVP8Sample::Frame& f)
+HRESULT OutpinVideo::GetFrame(long len, IVP8Sample::Frame& f)
 {
     IMemAllocator* const pAlloc_ = m_pAllocator;
     assert(pAlloc_);
@@ -767,7 +774,7 @@ HRESULT OutpinVideo::GetFrame(IVP8Sample::Frame& f)
 
     CMemAllocator* const pAlloc = static_cast<CMemAllocator*>(pAlloc_);
 
-    return CVP8Sample::GetFrame(pAlloc, f);
+    return CVP8Sample::GetFrame(pAlloc, len, f);
 }
 
 
@@ -804,12 +811,15 @@ HRESULT OutpinVideo::PostConnectVideo(IPin* p)
 
 HRESULT OutpinVideo::PostConnectStats(IPin* p)
 {
+    //Without an IStream downstream (a null renderer, say), we keep the
+    //stats in memory, for GetFirstPassStats.
+
     IStreamPtr pStream;
 
     HRESULT hr = p->QueryInterface(&pStream);
 
     if (FAILED(hr))
-        return hr;
+        pStream = 0;
 
     const GraphUtil::IMemInputPinPtr pMemInput(p);
 
@@ -951,13 +961,62 @@ HRESULT OutpinVideo::OnSetPassMode(VP8PassMode m)
 }
 
 
+void OutpinVideo::PurgePending()
+{
+    if (m_pending.empty())
+        return;
+
+    //The buffers came from the pool of our allocator (see GetFrame),
+    //so that's where they go back to, if we still have it.
+
+    CMemAllocator* pAlloc = 0;
+
+    if (bool(m_pAllocator) && (m_pFilter->GetPassMode() != kPassModeFirstPass))
+    {
+        IMemAllocator* const pAlloc_ = m_pAllocator;
+        pAlloc = static_cast<CMemAllocator*>(pAlloc_);
+    }
+
+    while (!m_pending.empty())
+    {
+        IVP8Sample::Frame& f = m_pending.front();
+        assert(f.buf);
+
+        if (pAlloc)
+            CVP8Sample::ReleaseFrame(pAlloc, f);
+        else
+            CVP8Sample::FreeFrame(f);
+
+        m_pending.pop_front();
+    }
+}
+
+
+void OutpinVideo::ClearStats()
+{
+    m_stats.clear();
+    m_stats_record_size = 0;
+}
+
+
 void OutpinVideo::WriteStats(const vpx_codec_cx_pkt_t* pkt)
 {
     assert(pkt);
     assert(pkt->kind == VPX_CODEC_STATS_PKT);
-    assert(bool(m_pStream));
 
     const vpx_fixed_buf& buf = pkt->data.twopass_stats;
+
+    if (!bool(m_pStream))
+    {
+        assert((m_stats_record_size == 0) || (buf.sz == m_stats_record_size));
+        m_stats_record_size = buf.sz;
+
+        const BYTE* const src = static_cast<const BYTE*>(buf.buf);
+        m_stats.insert(m_stats.end(), src, src + buf.sz);
+
+        return;
+    }
+
     const ULONG cb = static_cast<ULONG>(buf.sz);
 
     ULONG cbWrite;
@@ -9,6 +9,9 @@
 #pragma once
 #include "vp8encoderoutpin.h"
 #include "vp8encoderidl.h"
+#include "ivp8sample.h"
+#include <list>
+#include <vector>
 
 namespace VP8EncoderLib
 {
@@ -23,6 +26,8 @@ class OutpinVideo : public Outpin,
 protected:
     std::wstring GetName() const;
 
+    OutpinVideo(Filter*, const wchar_t* id);
+
 public:
     explicit OutpinVideo(Filter*);
     virtual ~OutpinVideo();
@@ -79,11 +84,25 @@ public:
     //local functions
 
     virtual void OnInpinConnect();
-    HRESULT GetFrame(IVP8Sample::Frame&);
+    HRESULT GetFrame(long len, IVP8Sample::Frame&);
     HRESULT OnSetPassMode(VP8PassMode);
     void WriteStats(const vpx_codec_cx_pkt_t*);
     void SetDefaultMediaTypes();
 
+    typedef std::list<IVP8Sample::Frame> frames_t;
+    frames_t m_pending;  //waiting to be pushed downstream
+    bool m_bDiscontinuity;
+
+    void PurgePending();
+
+    //First-pass stats packets, when the downstream pin has no IStream
+    //to write them to.  Every packet is m_stats_record_size bytes.
+    typedef std::vector<BYTE> stats_t;
+    stats_t m_stats;
+    size_t m_stats_record_size;
+
+    void ClearStats();
+
 protected:
     HRESULT OnDisconnect();
     void SetFirstPassMediaTypes();
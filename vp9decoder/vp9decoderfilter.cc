@@ -77,6 +77,8 @@ HRESULT Filter::CNondelegating::QueryInterface(const IID& iid, void** ppv) {
              iid == __uuidof(IMediaFilter) ||
              iid == __uuidof(IPersist)) {
     pUnk = static_cast<IBaseFilter*>(m_pFilter);
+  } else if (iid == __uuidof(IVP9DecoderSettings)) {
+    pUnk = static_cast<IVP9DecoderSettings*>(m_pFilter);
   } else {
     pUnk = 0;
     return E_NOINTERFACE;
@@ -121,6 +123,10 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
   m_info.pGraph = 0;
   m_info.achName[0] = L'\0';
 
+  m_cfg.threads = 0;  // auto
+  m_cfg.input_queue_depth = 0;  // synchronous
+  m_cfg.output_queue_depth = 0;
+
 #ifdef _DEBUG
   odbgstream os;
   os << "vp9dec::filter::ctor" << endl;
@@ -176,6 +182,14 @@ HRESULT Filter::Stop() {
     case kStateRunning:
     case kStateRunningWaitingForKeyframe:
       m_state = kStateStopped;
+
+      if (m_inpin.IsPipelined()) {
+        // The decode and delivery threads need the lock to see that
+        // we're stopped, so release it before waiting for them.
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+      }
+
       OnStop();  // decommit outpin's allocator
       break;
 
@@ -430,7 +444,110 @@ HRESULT Filter::QueryVendorInfo(LPWSTR* pstr) {
   return E_NOTIMPL;
 }
 
+HRESULT Filter::SetThreadCount(int count) {
+  if (count < 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.threads = count;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetThreadCount(int* pCount) {
+  if (pCount == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pCount = m_cfg.threads;
+
+  return S_OK;
+}
+
+HRESULT Filter::SetPipelineDepth(int input_depth, int output_depth) {
+  if ((input_depth < 0) || (output_depth < 0))
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_state != kStateStopped)
+    return VFW_E_NOT_STOPPED;
+
+  m_cfg.input_queue_depth = input_depth;
+  m_cfg.output_queue_depth = output_depth;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetPipelineDepth(int* pInputDepth, int* pOutputDepth) {
+  if ((pInputDepth == 0) || (pOutputDepth == 0))
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pInputDepth = m_cfg.input_queue_depth;
+  *pOutputDepth = m_cfg.output_queue_depth;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetDecodePath(VP9DecodePath* pPath) {
+  if (pPath == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pPath = m_outpin.m_dxva.IsOpen() ? kDecodePathDXVA2 : kDecodePathSoftware;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetQualityLevel(int* pLevel) {
+  if (pLevel == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pLevel = m_quality.GetLevel();
+
+  return S_OK;
+}
+
 void Filter::OnStart() {
+  m_quality.Reset();
+
   HRESULT hr = m_inpin.Start();
   assert(SUCCEEDED(hr));  // TODO
 
@@ -13,13 +13,22 @@
 #include <string>
 
 #include "clockable.h"
+#include "qualityladder.h"
+#include "vp9decoderidl.h"
 #include "vp9decoderinpin.h"
 #include "vp9decoderoutpin.h"
 
 namespace VP9DecoderLib {
 
-class Filter : public IBaseFilter, public CLockable {
+class Filter : public IBaseFilter, public IVP9DecoderSettings,
+               public CLockable {
  public:
+  struct Config {
+    int threads;
+    int input_queue_depth;  // 0 means decode synchronously in Receive
+    int output_queue_depth;
+  };
+
   // IUnknown
   HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
   ULONG STDMETHODCALLTYPE AddRef();
@@ -39,6 +48,14 @@ class Filter : public IBaseFilter, public CLockable {
   HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
   HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
 
+  // IVP9DecoderSettings
+  HRESULT STDMETHODCALLTYPE SetThreadCount(int);
+  HRESULT STDMETHODCALLTYPE GetThreadCount(int*);
+  HRESULT STDMETHODCALLTYPE SetPipelineDepth(int, int);
+  HRESULT STDMETHODCALLTYPE GetPipelineDepth(int*, int*);
+  HRESULT STDMETHODCALLTYPE GetDecodePath(VP9DecodePath*);
+  HRESULT STDMETHODCALLTYPE GetQualityLevel(int*);
+
   FILTER_STATE GetStateLocked() const;
   HRESULT OnDecodeFailureLocked();
   void OnDecodeSuccessLocked(bool is_key);
@@ -46,6 +63,11 @@ class Filter : public IBaseFilter, public CLockable {
   FILTER_INFO m_info;
   Inpin m_inpin;
   Outpin m_outpin;
+  Config m_cfg;
+
+  // Stepped by the renderer's quality messages to the outpin, and read by
+  // the inpin as it decodes.
+  webmdshow::QualityLadder m_quality;
 
  private:
   enum State {
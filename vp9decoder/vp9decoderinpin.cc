@@ -15,14 +15,22 @@
 #include <uuids.h>
 #include <vfwmsgs.h>
 
+#include <process.h>
+
 #include <cassert>
+#include <new>
 
 #include "vpx/vp8dx.h"
 
+#include "cpuutil.h"
 #include "graphutil.h"
+#include "highbitdepth.h"
+#include "libyuv_util.h"
 #include "mediatypeutil.h"
+#include "videomediatype.h"
 #include "vp9decoderfilter.h"
 #include "vp9decoderoutpin.h"
+#include "vpxsamplecopy.h"
 #include "webmtypes.h"
 
 #ifdef _DEBUG
@@ -38,7 +46,30 @@ using std::setprecision;
 namespace VP9DecoderLib {
 
 Inpin::Inpin(Filter* p)
-    : Pin(p, PINDIR_INPUT, L"input"), m_bEndOfStream(false), m_bFlush(false) {
+    : Pin(p, PINDIR_INPUT, L"input"),
+      m_bEndOfStream(false),
+      m_bFlush(false),
+      m_bPooled(false),
+      m_bAccelerated(false),
+      m_bPipeline(false),
+      m_bFrameThreading(false),
+      m_input_depth(0),
+      m_hDecodeThread(0),
+      m_bDecoding(false),
+      m_flush_count(0),
+      m_decoded_flush_count(0),
+      m_frame_id(0),
+      m_bFrameBuffers(false),
+      m_bZeroCopy(false),
+      m_start_count(0),
+      m_scaled_frame(NULL),
+      m_dithered_frame(NULL) {
+  m_hInput = CreateEvent(0, 0, 0, 0);
+  assert(m_hInput);  // TODO
+
+  m_hInputSpace = CreateEvent(0, 0, 0, 0);
+  assert(m_hInputSpace);  // TODO
+
   AM_MEDIA_TYPE mt;
 
   mt.majortype = MEDIATYPE_Video;
@@ -54,6 +85,23 @@ Inpin::Inpin(Filter* p)
   m_preferred_mtv.Add(mt);
 }
 
+Inpin::~Inpin() {
+  assert(m_hDecodeThread == 0);
+  assert(m_input_samples.empty());
+
+  BOOL b = CloseHandle(m_hInput);
+  assert(b);
+
+  b = CloseHandle(m_hInputSpace);
+  assert(b);
+}
+
+Inpin::DecoderLock::DecoderLock() {
+  const HRESULT hr = CLockable::Init();
+  hr;
+  assert(SUCCEEDED(hr));
+}
+
 HRESULT Inpin::QueryInterface(const IID& iid, void** ppv) {
   if (ppv == 0)
     return E_POINTER;
@@ -184,6 +232,21 @@ HRESULT Inpin::EndOfStream() {
   if (!bool(m_pPinConnection))
     return VFW_E_NOT_CONNECTED;
 
+  if (m_bPipeline && (m_pFilter->GetStateLocked() != State_Stopped)) {
+    if (m_bFlush)
+      return S_FALSE;
+
+    // The decode thread passes EOS to the outpin after the last queued frame
+    // has been decoded, and the outpin delivers it after the last frame.
+    m_bEndOfStream = true;
+    m_input_samples.push_back(0);
+
+    const BOOL b = SetEvent(m_hInput);
+    assert(b);
+
+    return S_OK;
+  }
+
   m_bEndOfStream = true;
 
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
@@ -225,6 +288,24 @@ HRESULT Inpin::BeginFlush() {
 
   m_bFlush = true;
 
+  // Frames the decode thread is holding, or that Receive is decoding
+  // without the filter lock, are discarded when they observe the new
+  // flush count.
+  ++m_flush_count;
+
+  if (m_bPipeline) {
+    // Discard what is queued on either side of the decode thread, and wake
+    // a Receive call blocked on a full input queue.
+    ReleaseInputSamples();
+    m_pFilter->m_outpin.FlushSamplesLocked();
+
+    BOOL b = SetEvent(m_hInputSpace);
+    assert(b);
+
+    b = SetEvent(m_hInput);
+    assert(b);
+  }
+
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
 
@@ -418,6 +499,26 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   if (m_bFlush)
     return S_FALSE;
 
+  if (m_bPipeline) {
+    lock.Release();
+    return ReceivePipelined(pInSample);
+  }
+
+  if (m_bAccelerated) {
+    lock.Release();
+
+    IMediaSample* p;
+
+    hr = DecodeAccelerated(pInSample, &p);
+
+    if ((hr != S_OK) || (p == 0))
+      return hr;
+
+    const GraphUtil::IMediaSamplePtr pOutSample(p, false);
+
+    return outpin.m_pInputPin->Receive(pOutSample);
+  }
+
   BYTE* buf;
 
   hr = pInSample->GetPointer(&buf);
@@ -435,8 +536,36 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   const long len = pInSample->GetActualDataLength();
   assert(len >= 0);
 
+  // Decode without the filter lock (see DecoderLock). The state is
+  // checked again once we have it back.
+  const ULONG start_count = m_start_count;
+  const ULONG flush_count = m_flush_count;
+
+  lock.Release();
+
+  CLockable::Lock decoder_lock;
+
+  hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
   const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, buf, len, 0, 0);
 
+  decoder_lock.Release();
+
+  hr = lock.Seize(m_pFilter);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return VFW_E_NOT_RUNNING;
+
+  if (m_bFlush || (m_flush_count != flush_count) ||
+      (m_start_count != start_count))
+    return S_FALSE;
+
   if (err != VPX_CODEC_OK)
     return m_pFilter->OnDecodeFailureLocked();
 
@@ -447,41 +576,193 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   if (pInSample->IsPreroll() == S_OK)
     return S_OK;
 
+  if (IsDroppableFrame())
+    return S_OK;
+
+  FrameInfo info;
+  GetFrameInfo(pInSample, info);
+
+  vpx_codec_iter_t iter = 0;
+
+  vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
+
+  if (f == 0)
+    return S_OK;
+
+  GraphUtil::IMediaSamplePtr pOutSample(GetZeroCopySampleLocked(f), false);
+
+  if (!bool(pOutSample)) {
+    lock.Release();
+
+    hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+    if (FAILED(hr))
+      return S_FALSE;
+
+    assert(pOutSample != NULL);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    // |f| belongs to m_ctx, which doesn't survive a stop.
+    if (m_start_count != start_count)
+      return S_FALSE;
+
+    if (outpin.m_pPinConnection == NULL)
+      return S_FALSE;
+
+    if (outpin.m_pInputPin == NULL)
+      return S_FALSE;
+
+    hr = PopulateSample(pOutSample, f);
+
+    if (hr != S_OK)
+      return hr;
+  }
+
+  SetFrameInfo(info, pOutSample);
+
   lock.Release();
 
-  GraphUtil::IMediaSamplePtr pOutSample;
+  return outpin.m_pInputPin->Receive(pOutSample);
+}
 
-  hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+HRESULT Inpin::DecodeAccelerated(IMediaSample* pInSample,
+                                 IMediaSample** ppOutSample) {
+  assert(pInSample);
+  assert(ppOutSample);
 
-  if (FAILED(hr))
-    return S_FALSE;
+  *ppOutSample = 0;
+
+  BYTE* buf;
+
+  HRESULT hr = pInSample->GetPointer(&buf);
+  assert(SUCCEEDED(hr));
+  assert(buf);
+
+  const long len = pInSample->GetActualDataLength();
+  assert(len >= 0);
+
+  ULONG sizes[VP9HeaderParser::kMaxSuperframeFrames];
 
-  assert(pOutSample != NULL);
+  const int count = VP9HeaderParser::ParseSuperframeIndex(buf, len, sizes);
+
+  Filter::Lock lock;
 
   hr = lock.Seize(m_pFilter);
 
   if (FAILED(hr))
     return hr;
 
-  if (m_pFilter->GetStateLocked() == State_Stopped)
-    return VFW_E_NOT_RUNNING;
+  if (count <= 0)
+    return m_pFilter->OnDecodeFailureLocked();
 
-  if (outpin.m_pPinConnection == NULL)
-    return S_FALSE;
+  Outpin& outpin = m_pFilter->m_outpin;
+  VP9DxvaDecoder& dxva = outpin.m_dxva;
 
-  if (outpin.m_pInputPin == NULL)
-    return S_FALSE;
+  const ULONG start_count = m_start_count;
 
-  vpx_codec_iter_t iter = 0;
+  // A WebM block shows at most one frame; the others in a superframe are
+  // hidden (an alt-ref, typically).
+  GraphUtil::IMediaSamplePtr pShown;
 
-  vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
+  // Whether |pShown| refreshes no reference slot, so nothing needs it.
+  bool bUnreferenced = false;
 
-  if (f == 0)
+  const BYTE* data = buf;
+
+  for (int i = 0; i < count; data += sizes[i++]) {
+    VP9FrameHeader hdr;
+
+    if (!dxva.ParseFrame(data, sizes[i], hdr)) {
+      dxva.Reset();
+      return m_pFilter->OnDecodeFailureLocked();
+    }
+
+    if (hdr.show_existing_frame) {
+      IMediaSample* const p = dxva.GetReferenceSample(hdr.frame_to_show);
+
+      if (p)
+        pShown = GraphUtil::IMediaSamplePtr(p, false);
+
+      bUnreferenced = false;
+      continue;
+    }
+
+    GraphUtil::IMediaSamplePtr pOutSample;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    // GetBuffer waits for a surface that neither downstream nor the
+    // reference slots hold.
+    hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+    if (FAILED(hr))
+      return S_FALSE;  // decommitted: we're stopping
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    // The decoder was reset by a stop, so |hdr| is stale.
+    if (m_start_count != start_count)
+      return S_FALSE;
+
+    // The parser is ahead of the decoder now; start again from the next
+    // key frame.
+    if (m_bFlush) {
+      dxva.Reset();
+      return S_FALSE;
+    }
+
+    hr = dxva.DecodeFrame(data, sizes[i], hdr, pOutSample);
+
+    if (FAILED(hr)) {
+      dxva.Reset();
+      return m_pFilter->OnDecodeFailureLocked();
+    }
+
+    if (hdr.show_frame) {
+      pShown = pOutSample;
+      bUnreferenced = (hdr.refresh_frame_flags == 0);
+    }
+  }
+
+  m_pFilter->OnDecodeSuccessLocked(pInSample->IsSyncPoint() == S_OK);
+
+  if (!bool(pShown) || (pInSample->IsPreroll() == S_OK))
+    return S_OK;
+
+  if (bUnreferenced && (m_pFilter->m_quality.GetLevel() >=
+                        webmdshow::QualityLadder::kLevelDropNonReference))
     return S_OK;
 
+  FrameInfo info;
+  GetFrameInfo(pInSample, info);
+
+  SetFrameInfo(info, pShown);
+
+  *ppOutSample = pShown.Detach();
+  return S_OK;
+}
+
+HRESULT Inpin::PopulateSample(IMediaSample* pOutSample,
+                              const vpx_image_t* f) {
+  Outpin& outpin = m_pFilter->m_outpin;
+
   AM_MEDIA_TYPE* pmt;
 
-  hr = pOutSample->GetMediaType(&pmt);
+  const HRESULT hr = pOutSample->GetMediaType(&pmt);
 
   if (SUCCEEDED(hr) && (pmt != 0)) {
     assert(outpin.QueryAccept(pmt) == S_OK);
@@ -490,69 +771,100 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
 
     MediaTypeUtil::Free(pmt);
     pmt = 0;
+
+    m_zero_copy_mtv.Clear();  // downstream chose the type
   }
 
-  const AM_MEDIA_TYPE& mt = outpin.m_connection_mtv[0];
+  // A profile 2 (or 3) stream of 10 or 12 bits. Switch downstream to P010
+  // or P016 if it can take them; the frame is dithered to 8 bits if not.
+  const bool high_bit_depth = webmdshow::IsHighBitDepthI420(f);
 
-  const BITMAPINFOHEADER* bmih_ptr;
-  const RECT* rc_ptr;
+  if (high_bit_depth) {
+    const HRESULT hrDepth = outpin.SetBitDepthLocked(pOutSample,
+                                                     f->bit_depth);
 
-  if (mt.formattype == FORMAT_VideoInfo) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
-    assert(mt.pbFormat);
+    if (FAILED(hrDepth))
+      return hrDepth;
+  }
 
-    const VIDEOINFOHEADER& vih_out = (VIDEOINFOHEADER&)(*mt.pbFormat);
-    const RECT& rc_out = vih_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih_out.bmiHeader;
+  // The stream changed resolution. Switch downstream to frames of the new
+  // size if it can take them, and scale the frame to the size it has if
+  // not. Y800 is scaled as it is copied, since it has no chroma to scale.
+  LONG w, h;
 
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else if (mt.formattype == FORMAT_VideoInfo2) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER2));
-    assert(mt.pbFormat);
+  if (webmdshow::GetVideoFrameSize(outpin.m_connection_mtv[0], &w, &h) &&
+      ((LONG(f->d_w) != w) || (LONG(f->d_h) != h))) {
+    const HRESULT hrSize = outpin.SetFrameSizeLocked(pOutSample, f->d_w,
+                                                     f->d_h);
 
-    const VIDEOINFOHEADER2& vih2_out = (VIDEOINFOHEADER2&)(*mt.pbFormat);
-    const RECT& rc_out = vih2_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih2_out.bmiHeader;
+    if (FAILED(hrSize))
+      return hrSize;
 
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else {
-    return E_FAIL;
-  }
+    if ((hrSize != S_OK) &&
+        (outpin.m_connection_mtv[0].subtype !=
+         WebmTypes::MEDIASUBTYPE_Y800)) {
+      if (high_bit_depth) {  // the scaler is of 8-bit samples
+        if (!webmdshow::DitherVpxImage(f, &m_dithered_frame))
+          return E_FAIL;
 
-  if (mt.subtype == MEDIASUBTYPE_NV12)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+        f = m_dithered_frame;
+      }
+
+      if (!webmdshow::LibyuvScaleI420(w, h, f, &m_scaled_frame))
+        return E_FAIL;
+
+      f = m_scaled_frame;
+    }
+  }
 
-  else if (mt.subtype == MEDIASUBTYPE_YV12)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  const AM_MEDIA_TYPE& mt = outpin.m_connection_mtv[0];
 
-  else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
-    CopyToPlanar(f, pOutSample, mt.subtype, *bmih_ptr);
+  if (!m_zero_copy_mtv.Empty()) {
+    // The previous frame went downstream in the libvpx buffer layout.
+    // Switch back to the connection media type for the copied frame.
+    AM_MEDIA_TYPE& mt_out = const_cast<AM_MEDIA_TYPE&>(mt);
+    const HRESULT hrSet = pOutSample->SetMediaType(&mt_out);
 
-  else if (mt.subtype == MEDIASUBTYPE_UYVY)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    if (FAILED(hrSet))
+      return hrSet;
 
-  else if (mt.subtype == MEDIASUBTYPE_YUY2)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    m_zero_copy_mtv.Clear();
+  }
 
-  else if (mt.subtype == MEDIASUBTYPE_YUYV)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  // The planar and P010 copies take 16-bit frames; the packed and RGB ones
+  // take them dithered.
+  if (webmdshow::IsHighBitDepthI420(f) &&
+      (mt.subtype != MEDIASUBTYPE_NV12) &&
+      (mt.subtype != MEDIASUBTYPE_YV12) &&
+      (mt.subtype != WebmTypes::MEDIASUBTYPE_I420) &&
+      (mt.subtype != WebmTypes::MEDIASUBTYPE_P010) &&
+      (mt.subtype != WebmTypes::MEDIASUBTYPE_P016)) {
+    if (!webmdshow::DitherVpxImage(f, &m_dithered_frame))
+      return E_FAIL;
+
+    f = m_dithered_frame;
+  }
 
-  else if (mt.subtype == MEDIASUBTYPE_YVYU)
-    CopyToPacked(f, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+  return webmdshow::CopyVpxImageToSample(f, mt, pOutSample);
+}
 
-  else
-    return E_FAIL;
+void Inpin::GetFrameInfo(IMediaSample* pInSample, FrameInfo& info) {
+  info.id = 0;
+  info.time_status = pInSample->GetTime(&info.start, &info.stop);
+  info.preroll = (pInSample->IsPreroll() == S_OK);
+  info.discontinuity = (pInSample->IsDiscontinuity() == S_OK);
+}
 
-  __int64 st, sp;
+void Inpin::SetFrameInfo(const FrameInfo& info, IMediaSample* pOutSample) {
+  REFERENCE_TIME st = info.start;
+  REFERENCE_TIME sp = info.stop;
 
-  hr = pInSample->GetTime(&st, &sp);
+  HRESULT hr;
 
-  if (FAILED(hr)) {
+  if (FAILED(info.time_status)) {
     hr = pOutSample->SetTime(0, 0);
     assert(SUCCEEDED(hr));
-  } else if (hr == S_OK) {
+  } else if (info.time_status == S_OK) {
     hr = pOutSample->SetTime(&st, &sp);
     assert(SUCCEEDED(hr));
   } else {
@@ -566,307 +878,294 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   hr = pOutSample->SetPreroll(FALSE);
   assert(SUCCEEDED(hr));
 
-  hr = pInSample->IsDiscontinuity();
-  hr = pOutSample->SetDiscontinuity(hr == S_OK);
+  hr = pOutSample->SetDiscontinuity(info.discontinuity ? TRUE : FALSE);
+  assert(SUCCEEDED(hr));
 
   hr = pOutSample->SetMediaTime(0, 0);
+}
 
-#if 0
-    //LONGLONG st, sp;
-    hr = pOutSample->GetTime(&st, &sp);
-    assert(SUCCEEDED(hr));
+int Inpin::GetFrameBuffer(void* priv, size_t size,
+                          vpx_codec_frame_buffer_t* fb) {
+  Inpin* const pPin = static_cast<Inpin*>(priv);
+  assert(pPin);
+  assert(fb);
 
-    odbgstream os;
-    os << "V: " << fixed << setprecision(3) << (double(st)/10000000.0) << endl;
-#endif
+  return pPin->OnGetFrameBuffer(size, *fb);
+}
 
-  lock.Release();
+int Inpin::ReleaseFrameBuffer(void*, vpx_codec_frame_buffer_t* fb) {
+  assert(fb);
 
-  return outpin.m_pInputPin->Receive(pOutSample);
+  FrameBuffer* const p = static_cast<FrameBuffer*>(fb->priv);
+
+  if (p == 0)
+    return 0;
+
+  if (p->pSample)
+    p->pSample->Release();  // returns the sample to the allocator
+
+  delete[] p->pHeap;
+  delete p;
+
+  fb->priv = 0;
+  fb->data = 0;
+
+  return 0;
 }
 
-HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
-                               long n,  // in
-                               long* pm) { // out
-  if (pm == 0)
-    return E_POINTER;
+int Inpin::OnGetFrameBuffer(size_t size, vpx_codec_frame_buffer_t& fb) {
+  FrameBuffer* const p = new (std::nothrow) FrameBuffer;
 
-  long& m = *pm;  // out
-  m = 0;
+  if (p == 0)
+    return -1;
 
-  if (n <= 0)
-    return S_OK;  // weird
+  p->pSample = 0;
+  p->pHeap = 0;
+  p->bDelivered = false;
 
-  if (pSamples == 0)
-    return E_INVALIDARG;
+  if (m_bZeroCopy) {
+    // Never wait for a sample here: libvpx may be holding some of them as
+    // reference frames, and downstream may be holding the rest.
+    IMemAllocator* const pAllocator = m_pFilter->m_outpin.m_pAllocator;
+    assert(pAllocator);
 
-  for (long i = 0; i < n; ++i) {
-    IMediaSample* const pSample = pSamples[i];
-    assert(pSample);
+    IMediaSample* pSample;
 
-    const HRESULT hr = Receive(pSample);
+    HRESULT hr = pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
 
-    if (hr != S_OK)
-      return hr;
+    if (SUCCEEDED(hr)) {
+      BYTE* buf;
 
-    ++m;
+      hr = pSample->GetPointer(&buf);
+
+      if (SUCCEEDED(hr) && (size_t(pSample->GetSize()) >= size)) {
+        p->pSample = pSample;
+        fb.data = buf;
+      } else {
+        pSample->Release();
+      }
+    }
   }
 
-  return S_OK;
-}
+  if (p->pSample == 0) {
+    p->pHeap = new (std::nothrow) BYTE[size];
 
-void Inpin::CopyToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  // Y
+    if (p->pHeap == 0) {
+      delete p;
+      return -1;
+    }
 
-  const BYTE* pInY = f->planes[VPX_PLANE_Y];
-  assert(pInY);
+    fb.data = p->pHeap;
+  }
 
-  unsigned int width_in = f->d_w;
-  unsigned int height_in = f->d_h;
+  memset(fb.data, 0, size);  // required by libvpx
 
-  BYTE* pOutBuf;
+  fb.size = size;
+  fb.priv = p;
 
-  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
-  assert(SUCCEEDED(hr));
-  assert(pOutBuf);
+  return 0;
+}
 
-  BYTE* pOut = pOutBuf;
+IMediaSample* Inpin::GetZeroCopySampleLocked(const vpx_image_t* f) {
+  assert(f);
 
-  const int strideInY = f->stride[VPX_PLANE_Y];
+  if (!m_bZeroCopy)
+    return 0;
 
-  LONG strideOut = bmih_out.biWidth;
-  assert(strideOut);
-  assert((strideOut % 2) == 0);  //?
+  FrameBuffer* const fb = static_cast<FrameBuffer*>(f->fb_priv);
 
-  for (unsigned int y = 0; y < height_in; ++y) {
-    memcpy(pOut, pInY, width_in);
-    pInY += strideInY;
-    pOut += strideOut;
-  }
+  if ((fb == 0) || (fb->pSample == 0))
+    return 0;  // decoded into heap memory
 
-  width_in = (width_in + 1) / 2;
-  height_in = (height_in + 1) / 2;
+  // VP9 can show the same buffer more than once. Downstream may still be
+  // holding the sample from the first time, so later showings are copied.
+  if (fb->bDelivered)
+    return 0;
 
-  const BYTE* pInV = f->planes[VPX_PLANE_V];
-  assert(pInV);
+  IMediaSample* const pSample = fb->pSample;
 
-  const int strideInV = f->stride[VPX_PLANE_V];
+  BYTE* buf;
 
-  const BYTE* pInU = f->planes[VPX_PLANE_U];
-  assert(pInU);
+  HRESULT hr = pSample->GetPointer(&buf);
+  assert(SUCCEEDED(hr));
 
-  const int strideInU = f->stride[VPX_PLANE_U];
+  LONG stride, height;
+  RECT rc;
 
-  if (subtype_out == MEDIASUBTYPE_NV12) {
-    // UV
+  if (!GetZeroCopyLayout(f, buf, pSample->GetSize(), stride, height, rc))
+    return 0;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      const BYTE* u = pInU;
-      const BYTE* v = pInV;
-      BYTE* uv = pOut;
+  if (!SetZeroCopyMediaTypeLocked(pSample, stride, height, rc))
+    return 0;
 
-      for (unsigned int idx = 0; idx < width_in; ++idx) {
-        *uv++ = *u++;
-        *uv++ = *v++;
-      }
+  hr = pSample->SetActualDataLength(stride * height * 3 / 2);
+  assert(SUCCEEDED(hr));
 
-      pInU += strideInU;
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  } else if (subtype_out == MEDIASUBTYPE_YV12) {
-    strideOut /= 2;
+  fb->bDelivered = true;
 
-    // V
+  pSample->AddRef();  // libvpx keeps its reference
+  return pSample;
+}
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
+bool Inpin::GetZeroCopyLayout(const vpx_image_t* f, const BYTE* buf,
+                              long size, LONG& stride, LONG& height,
+                              RECT& rc) {
+  // libvpx lays out its frame buffer as a bordered I420 picture: a Y plane
+  // of stride x height bytes, followed by U and V planes of half that in each
+  // dimension. The visible image starts at the same (even) offset into each
+  // plane, scaled for chroma. When this holds, downstream can consume the
+  // buffer as I420 with a stride of the Y stride, and a source rectangle.
 
-    // U
+  if (f->fmt != VPX_IMG_FMT_I420)
+    return false;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
-    }
-  } else {
-    assert(subtype_out == WebmTypes::MEDIASUBTYPE_I420);
-    strideOut /= 2;
+  if ((f->x_chroma_shift != 1) || (f->y_chroma_shift != 1))
+    return false;
 
-    // U
+  stride = f->stride[VPX_PLANE_Y];
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
-    }
+  if ((stride <= 0) || (stride % 2))
+    return false;
 
-    // V
+  const LONG uv_stride = stride / 2;
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  }
+  if (f->stride[VPX_PLANE_U] != uv_stride)
+    return false;
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
+  if (f->stride[VPX_PLANE_V] != uv_stride)
+    return false;
 
-  hr = pOutSample->SetActualDataLength(lenOut);
-  assert(SUCCEEDED(hr));
-}
+  const ptrdiff_t y_off = f->planes[VPX_PLANE_Y] - buf;
+  const ptrdiff_t u_off = f->planes[VPX_PLANE_U] - buf;
+  const ptrdiff_t v_off = f->planes[VPX_PLANE_V] - buf;
 
-void Inpin::CopyToPacked(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out, const RECT& rc_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  const LONG rect_width_out = rc_out.right - rc_out.left;
-  assert(rect_width_out >= 0);
+  if ((y_off < 0) || (u_off <= y_off) || (v_off <= u_off))
+    return false;
 
-  const LONG width_out =
-      (rect_width_out > 0) ? rect_width_out : bmih_out.biWidth;
-  assert(width_out > 0);
+  const LONG top = static_cast<LONG>(y_off / stride);
+  const LONG left = static_cast<LONG>(y_off % stride);
 
-  const LONG rect_height_out = rc_out.bottom - rc_out.top;
-  assert(rect_height_out >= 0);
+  if ((top % 2) || (left % 2))
+    return false;
 
-  const LONG height_out =
-      (rect_height_out > 0) ? rect_height_out : labs(bmih_out.biHeight);
+  const LONG uv_origin = (top / 2) * uv_stride + (left / 2);
+  const ptrdiff_t y_size = u_off - uv_origin;
 
-  const BYTE* pInY_base = f->planes[VPX_PLANE_Y];
-  assert(pInY_base);
+  if ((y_size <= 0) || (y_size % stride))
+    return false;
 
-  const int strideInY = f->stride[VPX_PLANE_Y];
+  height = static_cast<LONG>(y_size / stride);
 
-  const BYTE* pInV_base = f->planes[VPX_PLANE_V];
-  assert(pInV_base);
+  if (height % 2)
+    return false;
 
-  const int strideInV = f->stride[VPX_PLANE_V];
+  if (v_off != u_off + uv_stride * (height / 2))
+    return false;
 
-  const BYTE* pInU_base = f->planes[VPX_PLANE_U];
-  assert(pInU_base);
+  if ((left + LONG(f->d_w) > stride) || (top + LONG(f->d_h) > height))
+    return false;
 
-  const int strideInU = f->stride[VPX_PLANE_U];
+  if (stride * height * 3 / 2 > size)
+    return false;
 
-  const unsigned int width_in = f->d_w;
-  assert(LONG(width_in) == width_out);
+  rc.left = left;
+  rc.top = top;
+  rc.right = left + f->d_w;
+  rc.bottom = top + f->d_h;
 
-  const unsigned int height_in = f->d_h;
-  assert(LONG(height_in) == height_out);
+  return true;
+}
 
-  BYTE* pOutBuf;
+bool Inpin::SetZeroCopyMediaTypeLocked(IMediaSample* pSample, LONG stride,
+                                       LONG height, const RECT& rc) {
+  Outpin& outpin = m_pFilter->m_outpin;
 
-  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
-  assert(SUCCEEDED(hr));
-  assert(pOutBuf);
-
-  const LONG strideOut_ = 2 * width_in;
-  LONG strideOut;
-
-  if (bmih_out.biWidth < strideOut_)
-    strideOut = strideOut_;
-  else
-    strideOut = bmih_out.biWidth;
-
-  const LONG uv_width = width_in / 2;
-  const LONG uv_height = height_in / 2;
-
-  int u_off, v_off, y_off;
-
-  if (subtype_out == MEDIASUBTYPE_UYVY) {
-    u_off = 0;
-    v_off = 2;
-    y_off = 1;
-  } else if ((subtype_out == MEDIASUBTYPE_YUY2) ||
-             (subtype_out == MEDIASUBTYPE_YUYV)) {
-    u_off = 1;
-    v_off = 3;
-    y_off = 0;
-  } else {
-    assert(subtype_out == MEDIASUBTYPE_YVYU);
+  CMediaTypes mtv;
 
-    u_off = 3;
-    v_off = 1;
-    y_off = 0;
-  }
+  HRESULT hr = mtv.Add(outpin.m_connection_mtv[0]);
 
-  BYTE* pOut = pOutBuf;
+  if (FAILED(hr))
+    return false;
 
-  for (LONG hdx = 0; hdx < uv_height; ++hdx) {
-    BYTE* const pOut0 = pOut;
-    pOut += strideOut;
+  AM_MEDIA_TYPE& mt = mtv[0];
 
-    BYTE* const pOut1 = pOut;
-    pOut += strideOut;
+  BITMAPINFOHEADER* bmih;
 
-    BYTE* pOutU0 = pOut0 + u_off;
-    BYTE* pOutU1 = pOut1 + u_off;
+  if (mt.formattype == FORMAT_VideoInfo) {
+    VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+    vih.rcSource = rc;
+    vih.rcTarget = rc;
+    bmih = &vih.bmiHeader;
+  } else {
+    assert(mt.formattype == FORMAT_VideoInfo2);
+    VIDEOINFOHEADER2& vih2 = (VIDEOINFOHEADER2&)(*mt.pbFormat);
+    vih2.rcSource = rc;
+    vih2.rcTarget = rc;
+    bmih = &vih2.bmiHeader;
+  }
 
-    BYTE* pOutV0 = pOut0 + v_off;
-    BYTE* pOutV1 = pOut1 + v_off;
+  bmih->biWidth = stride;
+  bmih->biHeight = height;
+  bmih->biSizeImage = stride * height * 3 / 2;
 
-    BYTE* pOutY0 = pOut0 + y_off;
-    BYTE* pOutY1 = pOut1 + y_off;
+  mt.lSampleSize = bmih->biSizeImage;
 
-    const BYTE* pInU = pInU_base;
-    pInU_base += strideInU;
+  if (!m_zero_copy_mtv.Empty()) {
+    const AM_MEDIA_TYPE& mt_curr = m_zero_copy_mtv[0];
 
-    const BYTE* pInV = pInV_base;
-    pInV_base += strideInV;
+    if ((mt_curr.cbFormat == mt.cbFormat) &&
+        (memcmp(mt_curr.pbFormat, mt.pbFormat, mt.cbFormat) == 0))
+      return true;  // downstream is already on this layout
+  }
 
-    const BYTE* pInY0 = pInY_base;
-    pInY_base += strideInY;
+  // Ask downstream once. If it can't take our layout, stop trying, and
+  // copy every frame as before.
+  hr = outpin.m_pPinConnection->QueryAccept(&mt);
 
-    const BYTE* pInY1 = pInY_base;
-    pInY_base += strideInY;
+  if (hr != S_OK) {
+    m_bZeroCopy = false;
+    return false;
+  }
 
-    for (LONG wdx = 0; wdx < uv_width; ++wdx) {
-      *pOutU0 = *pInU;
-      *pOutU1 = *pInU;
+  hr = pSample->SetMediaType(&mt);
 
-      pOutU0 += 4;
-      pOutU1 += 4;
+  if (FAILED(hr))
+    return false;
 
-      ++pInU;
+  m_zero_copy_mtv.Clear();
+  m_zero_copy_mtv.Add(mt);
 
-      *pOutV0 = *pInV;
-      *pOutV1 = *pInV;
+  return true;
+}
 
-      pOutV0 += 4;
-      pOutV1 += 4;
+HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
+                               long n,  // in
+                               long* pm) { // out
+  if (pm == 0)
+    return E_POINTER;
 
-      ++pInV;
+  long& m = *pm;  // out
+  m = 0;
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+  if (n <= 0)
+    return S_OK;  // weird
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+  if (pSamples == 0)
+    return E_INVALIDARG;
 
-      ++pInY0;
-      ++pInY1;
+  for (long i = 0; i < n; ++i) {
+    IMediaSample* const pSample = pSamples[i];
+    assert(pSample);
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+    const HRESULT hr = Receive(pSample);
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+    if (hr != S_OK)
+      return hr;
 
-      ++pInY0;
-      ++pInY1;
-    }
+    ++m;
   }
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
-
-  hr = pOutSample->SetActualDataLength(lenOut);
-  assert(SUCCEEDED(hr));
+  return S_OK;
 }
 
 HRESULT Inpin::ReceiveCanBlock() {
@@ -877,6 +1176,9 @@ HRESULT Inpin::ReceiveCanBlock() {
   if (FAILED(hr))
     return S_OK;  //?
 
+  if (m_bPipeline)
+    return S_OK;  // Receive waits when the input queue is full
+
   if (IMemInputPin* pPin = m_pFilter->m_outpin.m_pInputPin) {
     lock.Release();
     return pPin->ReceiveCanBlock();
@@ -908,11 +1210,59 @@ HRESULT Inpin::Start() {
   m_bEndOfStream = false;
   m_bFlush = false;
 
+  const Filter::Config& config = m_pFilter->m_cfg;
+
+  m_input_depth = config.input_queue_depth;
+  m_bPipeline = (m_input_depth > 0);
+
+  // libvpx is initialized either way, so that the stream can fall back to
+  // it if the DXVA2 decoder is closed by a reconnection.
+  m_bAccelerated = m_pFilter->m_outpin.m_dxva.IsOpen();
+
   vpx_codec_iface_t& vp9 = vpx_codec_vp9_dx_algo;
 
-  const int flags = 0;
+  webmdshow::VpxDecoderPool::Key& key = m_decoder_key;
+
+  key.iface = &vp9;
+  key.flags = 0;
+  key.threads = webmdshow::GetVpxDecoderThreadCount(config.threads,
+                                                    true,  // VP9
+                                                    GetFrameWidth());
+  key.width = GetFrameWidth();
+  key.height = GetFrameHeight();
+
+  // Frame-based threading releases frames some time after their compressed
+  // data was submitted, which only the pipelined path is prepared to handle.
+  m_bFrameThreading =
+      m_bPipeline && !m_bAccelerated && (key.threads > 1) &&
+      ((vpx_codec_get_caps(&vp9) & VPX_CODEC_CAP_FRAME_THREADING) != 0);
+
+  if (m_bFrameThreading)
+    key.flags |= VPX_CODEC_USE_FRAME_THREADING;
 
-  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, &vp9, 0, flags);
+  m_bFrameBuffers =
+      m_pFilter->m_outpin.m_bFrameBuffers &&
+      ((vpx_codec_get_caps(&vp9) & VPX_CODEC_CAP_EXTERNAL_FRAME_BUFFER) != 0);
+
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_bPooled = !m_bFrameBuffers;
+
+  vpx_codec_err_t err;
+
+  if (m_bPooled) {
+    err = webmdshow::VpxDecoderPool::Get().Borrow(key, &m_ctx);
+  } else {
+    vpx_codec_dec_cfg_t cfg = {0};
+    cfg.threads = key.threads;
+
+    err = vpx_codec_dec_init(&m_ctx, &vp9, &cfg, key.flags);
+  }
 
   if (err == VPX_CODEC_MEM_ERROR)
     return E_OUTOFMEMORY;
@@ -920,13 +1270,493 @@ HRESULT Inpin::Start() {
   if (err != VPX_CODEC_OK)
     return E_FAIL;
 
+  ++m_start_count;
+
+  if (m_bFrameBuffers) {
+    err = vpx_codec_set_frame_buffer_functions(&m_ctx,
+                                               &Inpin::GetFrameBuffer,
+                                               &Inpin::ReleaseFrameBuffer,
+                                               this);
+
+    m_bFrameBuffers = (err == VPX_CODEC_OK);
+  }
+
+  m_bZeroCopy = m_bFrameBuffers;
+  m_zero_copy_mtv.Clear();
+
+  if (m_bPipeline)
+    StartDecodeThread();
+
   return S_OK;
 }
 
+int Inpin::GetFrameWidth() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  return vih.bmiHeader.biWidth;
+}
+
+int Inpin::GetFrameHeight() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  const LONG h = vih.bmiHeader.biHeight;
+
+  return (h < 0) ? -h : h;
+}
+
 void Inpin::Stop() {
-  const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+  // The filter has already moved to the stopped state, and has released its
+  // lock if the pipeline is running, so the decode thread terminates as soon
+  // as it wakes up.
+  StopDecodeThread();
+  ReleaseInputSamples();
+
+  // Let go of the reference frames, so that the outpin can decommit.
+  m_pFilter->m_outpin.m_dxva.Reset();
+
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+  hr;
+  assert(SUCCEEDED(hr));
+
+  if (m_bPooled) {
+    webmdshow::VpxDecoderPool::Get().Return(m_decoder_key, &m_ctx);
+  } else {
+    const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
+    err;
+    assert(err == VPX_CODEC_OK);
+  }
+
+  if (m_scaled_frame != NULL) {
+    vpx_img_free(m_scaled_frame);
+    m_scaled_frame = NULL;
+  }
+
+  if (m_dithered_frame != NULL) {
+    vpx_img_free(m_dithered_frame);
+    m_dithered_frame = NULL;
+  }
+}
+
+bool Inpin::IsPipelined() const {
+  return m_bPipeline;
+}
+
+bool Inpin::IsDecodeIdleLocked() const {
+  return m_input_samples.empty() && !m_bDecoding;
+}
+
+HRESULT Inpin::ReceivePipelined(IMediaSample* pInSample) {
+  Filter::Lock lock;
+
+  HRESULT hr = lock.Seize(m_pFilter);
+
+  if (FAILED(hr))
+    return hr;
+
+  for (;;) {
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    if (m_bEndOfStream)
+      return VFW_E_SAMPLE_REJECTED_EOS;
+
+    if (m_bFlush)
+      return S_FALSE;
+
+    if (m_input_samples.size() < samples_t::size_type(m_input_depth))
+      break;
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    const DWORD dw = WaitForSingleObject(m_hInputSpace, INFINITE);
+
+    if (dw == WAIT_FAILED)
+      return E_FAIL;
+
+    assert(dw == WAIT_OBJECT_0);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+  }
+
+  pInSample->AddRef();
+  m_input_samples.push_back(pInSample);
+
+  const BOOL b = SetEvent(m_hInput);
+  assert(b);
+
+  return S_OK;
+}
+
+int Inpin::GetInputSample(IMediaSample** ppSample, ULONG& flush_count) {
+  assert(ppSample);
+
+  IMediaSample*& pSample = *ppSample;
+  pSample = 0;
+
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return -2;  // terminate
+
+  if (m_input_samples.empty())
+    return -1;  // wait
+
+  pSample = m_input_samples.front();
+  m_input_samples.pop_front();
+
+  m_bDecoding = true;
+  flush_count = m_flush_count;
+
+  const BOOL b = SetEvent(m_hInputSpace);
+  assert(b);
+
+  return pSample ? 1 : 0;  // 0 means EOS
+}
+
+void Inpin::ReleaseInputSamples() {
+  while (!m_input_samples.empty()) {
+    IMediaSample* const pSample = m_input_samples.front();
+    m_input_samples.pop_front();
+
+    if (pSample)
+      pSample->Release();
+  }
+}
+
+void Inpin::StartDecodeThread() {
+  assert(m_hDecodeThread == 0);
+  assert(m_input_samples.empty());
+
+  m_bDecoding = false;
+  m_decoded_flush_count = m_flush_count;
+  m_frame_infos.clear();
+
+  BOOL b = ResetEvent(m_hInput);
+  assert(b);
+
+  b = ResetEvent(m_hInputSpace);
+  assert(b);
+
+  const uintptr_t h = _beginthreadex(0,  // security
+                                     0,  // stack size
+                                     &Inpin::DecodeThreadProc, this,
+                                     0,  // run immediately
+                                     0);  // thread id
+
+  m_hDecodeThread = reinterpret_cast<HANDLE>(h);
+  assert(m_hDecodeThread);
+}
+
+void Inpin::StopDecodeThread() {
+  if (m_hDecodeThread == 0)
+    return;
+
+  BOOL b = SetEvent(m_hInput);
+  assert(b);
+
+  b = SetEvent(m_hInputSpace);  // in case Receive is waiting
+  assert(b);
+
+  const DWORD dw = WaitForSingleObject(m_hDecodeThread, INFINITE);
+  dw;
+  assert(dw == WAIT_OBJECT_0);
+
+  b = CloseHandle(m_hDecodeThread);
+  assert(b);
+
+  m_hDecodeThread = 0;
+  m_frame_infos.clear();
+}
+
+unsigned Inpin::DecodeThreadProc(void* pv) {
+  Inpin* const pPin = static_cast<Inpin*>(pv);
+  assert(pPin);
+
+  return pPin->DecodeMain();
+}
+
+unsigned Inpin::DecodeMain() {
+  Outpin& outpin = m_pFilter->m_outpin;
+
+  for (;;) {
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return 0;
+
+    IMediaSample* pInSample;
+    ULONG flush_count;
+
+    const int status = GetInputSample(&pInSample, flush_count);
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    if (status < -1)  // terminate thread
+      return 0;
+
+    if (status == -1) {  // wait for input
+      const DWORD dw = WaitForSingleObject(m_hInput, INFINITE);
+
+      if (dw == WAIT_FAILED)
+        return 0;
+
+      assert(dw == WAIT_OBJECT_0);
+      continue;
+    }
+
+    if (flush_count != m_decoded_flush_count) {
+      // A flush happened since the last sample we decoded. Drop anything
+      // libvpx is still holding for the frames from before the flush.
+      DrainDecoder(true);
+      m_frame_infos.clear();
+      m_decoded_flush_count = flush_count;
+    }
+
+    if (status == 0) {  // EOS
+      DrainDecoder(false);
+    } else {
+      Decode(pInSample);
+      pInSample->Release();
+    }
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return 0;
+
+    if ((status == 0) && !m_bFlush && (m_flush_count == flush_count))
+      outpin.QueueEndOfStreamLocked();
+
+    // Let the delivery thread re-evaluate whether it may release frames.
+    m_bDecoding = false;
+    outpin.OnSamplesChangedLocked();
+  }
+}
+
+HRESULT Inpin::Decode(IMediaSample* pInSample) {
+  assert(pInSample);
+
+  if (m_bAccelerated) {
+    IMediaSample* p;
+
+    HRESULT hr = DecodeAccelerated(pInSample, &p);
+
+    if ((hr != S_OK) || (p == 0))
+      return hr;
+
+    GraphUtil::IMediaSamplePtr pOutSample(p, false);
+
+    Filter::Lock lock;
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    if (m_bFlush || (m_flush_count != m_decoded_flush_count))
+      return S_FALSE;
+
+    m_pFilter->m_outpin.QueueSampleLocked(pOutSample.Detach());
+    return S_OK;
+  }
+
+  BYTE* buf;
+
+  HRESULT hr = pInSample->GetPointer(&buf);
+  assert(SUCCEEDED(hr));
+  assert(buf);
+
+  const long len = pInSample->GetActualDataLength();
+  assert(len >= 0);
+
+  FrameInfo info;
+  GetFrameInfo(pInSample, info);
+
+  if (++m_frame_id == 0)  // 0 means "no frame info" to PopFrameInfo
+    ++m_frame_id;
+
+  info.id = m_frame_id;
+  m_frame_infos.push_back(info);
+
+  void* const user_priv = reinterpret_cast<void*>(ULONG_PTR(info.id));
+
+  const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, buf, len, user_priv, 0);
+
+  Filter::Lock lock;
+
+  hr = lock.Seize(m_pFilter);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (err != VPX_CODEC_OK) {
+    m_frame_infos.pop_back();
+    return m_pFilter->OnDecodeFailureLocked();
+  }
+
+  m_pFilter->OnDecodeSuccessLocked(pInSample->IsSyncPoint() == S_OK);
+
+  if (IsDroppableFrame()) {
+    m_frame_infos.pop_back();
+    return S_OK;
+  }
+
+  hr = lock.Release();
+  assert(SUCCEEDED(hr));
+
+  return DeliverFrames();
+}
+
+HRESULT Inpin::DeliverFrames() {
+  Outpin& outpin = m_pFilter->m_outpin;
+
+  if (!bool(outpin.m_pAllocator))  // not connected: just drain the decoder
+    return S_FALSE;
+
+  vpx_codec_iter_t iter = 0;
+
+  while (const vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter)) {
+    FrameInfo info;
+
+    if (!PopFrameInfo(f->user_priv, info))
+      continue;
+
+    if (info.preroll)
+      continue;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    GraphUtil::IMediaSamplePtr pOutSample(GetZeroCopySampleLocked(f), false);
+
+    const bool copy = !bool(pOutSample);
+
+    if (copy) {
+      hr = lock.Release();
+      assert(SUCCEEDED(hr));
+
+      // GetBuffer is where renderer backpressure shows up. We wait here
+      // without the filter lock, while upstream keeps filling the input
+      // queue.
+      hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+      if (FAILED(hr))
+        return S_FALSE;  // decommitted: we're stopping
+
+      hr = lock.Seize(m_pFilter);
+
+      if (FAILED(hr))
+        return hr;
+    }
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      return VFW_E_NOT_RUNNING;
+
+    if (m_bFlush || (m_flush_count != m_decoded_flush_count))
+      return S_FALSE;
+
+    if (copy) {
+      hr = PopulateSample(pOutSample, f);
+
+      if (hr != S_OK)
+        return hr;
+    }
+
+    SetFrameInfo(info, pOutSample);
+
+    outpin.QueueSampleLocked(pOutSample.Detach());
+  }
+
+  return S_OK;
+}
+
+void Inpin::DrainDecoder(bool discard) {
+  if (!m_bFrameThreading) {
+    // Without frame threading every frame is returned by the decode call
+    // that produced it, so there is nothing left to drain.
+    return;
+  }
+
+  const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, NULL, 0, NULL, 0);
   err;
   assert(err == VPX_CODEC_OK);
+
+  if (!discard) {
+    DeliverFrames();
+    return;
+  }
+
+  vpx_codec_iter_t iter = 0;
+
+  while (vpx_codec_get_frame(&m_ctx, &iter) != NULL)
+    __noop;
+}
+
+bool Inpin::PopFrameInfo(const void* user_priv, FrameInfo& info) {
+  const ULONG id = static_cast<ULONG>(reinterpret_cast<ULONG_PTR>(user_priv));
+
+  if (id == 0)
+    return false;
+
+  // Frames come out in decode order. Entries older than this frame belong to
+  // input samples that produced no visible frame (e.g. alt-ref frames).
+  while (!m_frame_infos.empty()) {
+    const FrameInfo& front = m_frame_infos.front();
+
+    if (front.id == id) {
+      info = front;
+      m_frame_infos.pop_front();
+      return true;
+    }
+
+    m_frame_infos.pop_front();
+  }
+
+  return false;
+}
+
+bool Inpin::IsDroppableFrame() {
+  if (m_bFrameThreading)
+    return false;
+
+  if (m_pFilter->m_quality.GetLevel() <
+      webmdshow::QualityLadder::kLevelDropNonReference)
+    return false;
+
+  int flags;
+
+  const vpx_codec_err_t err =
+      vpx_codec_control(&m_ctx, VP8D_GET_LAST_REF_UPDATES, &flags);
+
+  return (err == VPX_CODEC_OK) && (flags == 0);
 }
 
 }  // namespace VP9DecoderLib
@@ -10,16 +10,22 @@
 
 #include <amvideo.h>
 
+#include <list>
+
 #include "vpx/vpx_decoder.h"
+#include "vpx/vpx_frame_buffer.h"
 
+#include "clockable.h"
 #include "graphutil.h"
 #include "vp9decoderpin.h"
+#include "vpxdecoderpool.h"
 
 namespace VP9DecoderLib {
 
 class Inpin : public Pin, public IMemInputPin {
  public:
   explicit Inpin(Filter*);
+  virtual ~Inpin();
 
   // IUnknown interface:
   HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
@@ -48,25 +54,153 @@ class Inpin : public Pin, public IMemInputPin {
   HRESULT Start();  // from stopped to running/paused
   void Stop();  // from running/paused to stopped
 
+  // Pipelined decoding (see IVP9DecoderSettings::SetPipelineDepth). When the
+  // pipeline is enabled, Receive only queues the compressed sample; a decode
+  // thread owned by this pin decodes it and hands the frame to the outpin's
+  // delivery thread.
+  bool IsPipelined() const;
+  bool IsDecodeIdleLocked() const;
+
  protected:
   HRESULT GetName(PIN_INFO&) const;
   HRESULT OnDisconnect();
 
  private:
-  static void CopyToPlanar(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out,
-                           const BITMAPINFOHEADER& bmih_out);
-
-  static void CopyToPacked(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out, const RECT& rc_out,
-                           const BITMAPINFOHEADER& bmih_out);
+  // Timing and flags of an input sample. The id is passed to libvpx as the
+  // |user_priv| value of the decode call, which lets frames released late by
+  // frame-threaded decoding find their timestamps.
+  struct FrameInfo {
+    ULONG id;
+    HRESULT time_status;  // result of IMediaSample::GetTime
+    REFERENCE_TIME start;
+    REFERENCE_TIME stop;
+    bool preroll;
+    bool discontinuity;
+  };
+
+  typedef std::list<FrameInfo> frame_infos_t;
+  typedef std::list<IMediaSample*> samples_t;
+
+  static void GetFrameInfo(IMediaSample*, FrameInfo&);
+  static void SetFrameInfo(const FrameInfo&, IMediaSample*);
+
+  HRESULT PopulateSample(IMediaSample*, const vpx_image_t*);
+
+  // Decodes |pInSample| with the outpin's DXVA2 decoder. Called without
+  // the filter lock, which is taken while decoding and released while
+  // waiting for a surface. The frame the sample shows, if any, is returned
+  // (AddRef'd) in |ppOutSample|, with the sample's timing set.
+  HRESULT DecodeAccelerated(IMediaSample* pInSample,
+                            IMediaSample** ppOutSample);
+
+  // libvpx external frame buffers. When the outpin's allocator allows it,
+  // libvpx decodes into samples taken from that allocator, which can then
+  // be delivered downstream without copying. Otherwise (or when no sample
+  // is available) frame buffers come from the heap, and frames are copied.
+  struct FrameBuffer {
+    IMediaSample* pSample;  // null when allocated from the heap
+    BYTE* pHeap;
+    bool bDelivered;
+  };
+
+  static int GetFrameBuffer(void*, size_t, vpx_codec_frame_buffer_t*);
+  static int ReleaseFrameBuffer(void*, vpx_codec_frame_buffer_t*);
+  int OnGetFrameBuffer(size_t, vpx_codec_frame_buffer_t&);
+
+  // Returns the (AddRef'd) sample |f| was decoded into, ready to deliver,
+  // or null if the frame must be copied.
+  IMediaSample* GetZeroCopySampleLocked(const vpx_image_t* f);
+
+  static bool GetZeroCopyLayout(const vpx_image_t* f, const BYTE* buf,
+                                long size, LONG& stride, LONG& height,
+                                RECT& rc);
+
+  bool SetZeroCopyMediaTypeLocked(IMediaSample*, LONG stride, LONG height,
+                                  const RECT& rc);
+
+  HRESULT ReceivePipelined(IMediaSample*);
+  int GetInputSample(IMediaSample**, ULONG& flush_count);
+  void ReleaseInputSamples();
+
+  void StartDecodeThread();
+  void StopDecodeThread();
+  static unsigned __stdcall DecodeThreadProc(void*);
+  unsigned DecodeMain();
+  HRESULT Decode(IMediaSample*);
+  HRESULT DeliverFrames();
+  void DrainDecoder(bool discard);
+  bool PopFrameInfo(const void* user_priv, FrameInfo&);
+
+  // Whether the quality ladder has us drop frames that refresh no
+  // reference frame, and the frame libvpx decoded last is one. Always
+  // false with frame-based threading, where the decoder is frames ahead.
+  bool IsDroppableFrame();
+
+  // Return the width and height of the connected input stream, or 0 when
+  // unknown.
+  int GetFrameWidth() const;
+  int GetFrameHeight() const;
 
   Inpin(const Inpin&);
   Inpin& operator=(const Inpin&);
 
+  // Receive decodes holding only the decoder lock when the stream isn't
+  // pipelined, so that the control interfaces, BeginFlush and Stop don't
+  // wait behind the frame. Start and Stop seize it too, after the filter
+  // lock, before they change m_ctx. (The decode thread needs no lock:
+  // Stop ends it first.)
+  class DecoderLock : public CLockable {
+   public:
+    DecoderLock();
+  };
+
   bool m_bEndOfStream;
   bool m_bFlush;
+  DecoderLock m_decoder_lock;
   vpx_codec_ctx_t m_ctx;
+
+  // What m_ctx was borrowed for. A decoder given our frame buffer
+  // functions can't go back to the pool, and is made afresh rather than
+  // borrowed, since libvpx won't take the functions once it has decoded.
+  webmdshow::VpxDecoderPool::Key m_decoder_key;
+  bool m_bPooled;
+
+  // True when the stream is decoded by the outpin's DXVA2 decoder, rather
+  // than by m_ctx. Set at Start.
+  bool m_bAccelerated;
+
+  // Pipeline state. m_input_samples, m_bDecoding and m_flush_count are
+  // protected by the filter lock; m_frame_infos and m_decoded_flush_count
+  // are only touched by the decode thread.
+  bool m_bPipeline;
+  bool m_bFrameThreading;
+  long m_input_depth;
+  HANDLE m_hDecodeThread;
+  HANDLE m_hInput;  // input queued, or stop/flush requested
+  HANDLE m_hInputSpace;  // input dequeued, or stop/flush requested
+  samples_t m_input_samples;  // null entry means EOS
+  bool m_bDecoding;
+  ULONG m_flush_count;
+  ULONG m_decoded_flush_count;
+  ULONG m_frame_id;
+  frame_infos_t m_frame_infos;
+
+  // Zero-copy state, touched only by the thread that decodes.
+  // m_zero_copy_mtv holds the media type downstream was last switched to
+  // for zero-copy samples; it is empty when downstream is on the connection
+  // media type.
+  bool m_bFrameBuffers;
+  bool m_bZeroCopy;
+  CMediaTypes m_zero_copy_mtv;
+  ULONG m_start_count;
+
+  // A frame of a new size, scaled to the size of the output when that
+  // can't change with it (see Outpin::SetFrameSizeLocked).
+  vpx_image_t* m_scaled_frame;
+
+  // A high bit depth frame dithered to 8 bits, for the outputs (and the
+  // scaler) that only take 8-bit frames.
+  vpx_image_t* m_dithered_frame;
 };
 
 }  // namespace VP9DecoderLib
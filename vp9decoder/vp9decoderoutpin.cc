@@ -9,6 +9,7 @@
 
 #include <amvideo.h>
 #include <dvdmedia.h>
+#include <process.h>
 #include <strmif.h>
 #include <uuids.h>
 #include <vfwmsgs.h>
@@ -17,6 +18,7 @@
 
 #include "cmediasample.h"
 #include "mediatypeutil.h"
+#include "videomediatype.h"
 #include "vp9decoderfilter.h"
 #include "webmtypes.h"
 
@@ -32,13 +34,33 @@ using std::wstring;
 
 namespace VP9DecoderLib {
 
-Outpin::Outpin(Filter* pFilter) : Pin(pFilter, PINDIR_OUTPUT, L"output") {
+Outpin::Outpin(Filter* pFilter)
+    : Pin(pFilter, PINDIR_OUTPUT, L"output"),
+      m_bFrameBuffers(false),
+      m_hThread(0),
+      m_last_start(0),
+      m_bEndOfStream(false),
+      m_output_depth(0),
+      m_pQualitySink(0),
+      m_bOwnAllocator(false),
+      m_scale_width(0),
+      m_scale_height(0),
+      m_bit_depth(0) {
+  m_hSamples = CreateEvent(0, 0, 0, 0);  // auto-reset
+  assert(m_hSamples);
+
   SetDefaultMediaTypes();
 }
 
 Outpin::~Outpin() {
   assert(!bool(m_pAllocator));
   assert(!bool(m_pInputPin));
+  assert(m_hThread == 0);
+  assert(m_samples.empty());
+
+  const BOOL b = CloseHandle(m_hSamples);
+  b;
+  assert(b);
 }
 
 // transition from stopped
@@ -53,6 +75,9 @@ HRESULT Outpin::Start() {
   hr;
   assert(SUCCEEDED(hr));  // TODO
 
+  if (m_pFilter->m_inpin.IsPipelined())
+    StartThread();
+
   return S_OK;
 }
 
@@ -64,9 +89,182 @@ void Outpin::Stop() {
   assert(bool(m_pAllocator));
   assert(bool(m_pInputPin));
 
+  // Decommit first, so that a decode thread waiting in GetBuffer wakes up.
   const HRESULT hr = m_pAllocator->Decommit();
   hr;
   assert(SUCCEEDED(hr));
+
+  StopThread();
+  FlushSamplesLocked();
+}
+
+void Outpin::QueueSampleLocked(IMediaSample* pSample) {
+  assert(pSample);
+
+  REFERENCE_TIME start, stop;
+
+  if (SUCCEEDED(pSample->GetTime(&start, &stop)))
+    m_last_start = start;
+
+  m_samples.insert(std::make_pair(m_last_start, pSample));
+
+  const BOOL b = SetEvent(m_hSamples);
+  b;
+  assert(b);
+}
+
+void Outpin::QueueEndOfStreamLocked() {
+  m_bEndOfStream = true;
+
+  const BOOL b = SetEvent(m_hSamples);
+  b;
+  assert(b);
+}
+
+void Outpin::FlushSamplesLocked() {
+  while (!m_samples.empty()) {
+    const samples_t::iterator i = m_samples.begin();
+    IMediaSample* const pSample = i->second;
+    m_samples.erase(i);
+
+    pSample->Release();
+  }
+
+  m_last_start = 0;
+  m_bEndOfStream = false;
+}
+
+void Outpin::OnSamplesChangedLocked() {
+  const BOOL b = SetEvent(m_hSamples);
+  b;
+  assert(b);
+}
+
+void Outpin::StartThread() {
+  assert(m_hThread == 0);
+  assert(m_samples.empty());
+
+  m_output_depth = m_pFilter->m_cfg.output_queue_depth;
+
+  if (m_output_depth < 1)
+    m_output_depth = 1;
+
+  m_last_start = 0;
+  m_bEndOfStream = false;
+
+  const BOOL b = ResetEvent(m_hSamples);
+  b;
+  assert(b);
+
+  const uintptr_t h = _beginthreadex(0,  // security
+                                     0,  // stack size
+                                     &Outpin::ThreadProc, this,
+                                     0,  // run immediately
+                                     0);  // thread id
+
+  m_hThread = reinterpret_cast<HANDLE>(h);
+  assert(m_hThread);
+}
+
+void Outpin::StopThread() {
+  if (m_hThread == 0)
+    return;
+
+  BOOL b = SetEvent(m_hSamples);
+  assert(b);
+
+  const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+  dw;
+  assert(dw == WAIT_OBJECT_0);
+
+  b = CloseHandle(m_hThread);
+  assert(b);
+
+  m_hThread = 0;
+}
+
+unsigned Outpin::ThreadProc(void* pv) {
+  Outpin* const pPin = static_cast<Outpin*>(pv);
+  assert(pPin);
+
+  return pPin->Main();
+}
+
+unsigned Outpin::Main() {
+  assert(bool(m_pPinConnection));
+  assert(bool(m_pInputPin));
+
+  for (;;) {
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return 0;
+
+    IMediaSample* pSample;
+
+    const int status = GetSample(&pSample);
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    if (status < -1)  // terminate thread
+      return 0;
+
+    if (status == -1) {  // wait for samples
+      const DWORD dw = WaitForSingleObject(m_hSamples, INFINITE);
+
+      if (dw == WAIT_FAILED)
+        return 0;
+
+      assert(dw == WAIT_OBJECT_0);
+      continue;
+    }
+
+    if (status == 0) {  // EOS
+      hr = m_pPinConnection->EndOfStream();
+      continue;
+    }
+
+    // Downstream may block here (e.g. a paused renderer). That only stalls
+    // this thread: the decode thread continues until the queue is full.
+    hr = m_pInputPin->Receive(pSample);
+    pSample->Release();
+  }
+}
+
+int Outpin::GetSample(IMediaSample** ppSample) {
+  assert(ppSample);
+
+  IMediaSample*& pSample = *ppSample;
+  pSample = 0;
+
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return -2;  // terminate
+
+  if (m_samples.empty()) {
+    if (!m_bEndOfStream)
+      return -1;  // wait
+
+    m_bEndOfStream = false;
+    return 0;  // EOS
+  }
+
+  // Hold samples back while more might arrive that precede them. Once the
+  // queue is full, or the decoder has nothing more in flight, the earliest
+  // sample can't be preceded by anything still to come.
+  const samples_t::size_type depth = m_output_depth;
+
+  if ((m_samples.size() < depth) && !m_bEndOfStream &&
+      !m_pFilter->m_inpin.IsDecodeIdleLocked())
+    return -1;  // wait
+
+  const samples_t::iterator i = m_samples.begin();
+  pSample = i->second;
+  m_samples.erase(i);
+
+  return 1;
 }
 
 HRESULT Outpin::QueryInterface(const IID& iid, void** ppv) {
@@ -81,6 +279,8 @@ HRESULT Outpin::QueryInterface(const IID& iid, void** ppv) {
     pUnk = static_cast<IPin*>(this);
   } else if (iid == __uuidof(IMediaSeeking))
     pUnk = static_cast<IMediaSeeking*>(this);
+  else if (iid == __uuidof(IQualityControl))
+    pUnk = static_cast<IQualityControl*>(this);
   else {
 #if 0
     wodbgstream os;
@@ -194,15 +394,26 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
     m_connection_mtv.Add(mt);
   }
 
+  if (m_connection_mtv[0].subtype == MEDIASUBTYPE_NV12) {
+    hr = ConnectAccelerated(pin, pInputPin);
+
+    if (SUCCEEDED(hr))
+      return S_OK;
+  }
+
   GraphUtil::IMemAllocatorPtr pAllocator;
 
   hr = pInputPin->GetAllocator(&pAllocator);
 
+  bool own_allocator = false;
+
   if (FAILED(hr)) {
     hr = CMediaSample::CreateAllocator(&pAllocator);
 
     if (FAILED(hr))
       return VFW_E_NO_ALLOCATOR;
+
+    own_allocator = true;
   }
 
   assert(bool(pAllocator));
@@ -219,10 +430,36 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   if (props.cBuffers <= 0)
     props.cBuffers = 1;
 
+  // Samples held in the delivery queue are still allocated, so make room for
+  // them on top of what downstream asked for.
+  props.cBuffers += m_pFilter->m_cfg.output_queue_depth;
+
   LONG w, h;
   GetConnectionDimensions(w, h);
 
-  const long cbBuffer = 2 * w * h;
+  long cbBuffer = 2 * w * h;
+
+  if (IsHighBitDepthSubtype(m_connection_mtv[0].subtype))
+    cbBuffer = 3 * w * h;
+
+  // When the samples are plain memory from our own allocator, and the output
+  // is I420 (which has the same plane order as libvpx), the inpin may have
+  // libvpx decode straight into them. Those samples double as reference
+  // frames, so we need enough of them, each large enough for libvpx's
+  // bordered layout.
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+
+  const bool frame_buffers =
+      own_allocator && (mt.subtype == WebmTypes::MEDIASUBTYPE_I420);
+
+  if (frame_buffers) {
+    props.cBuffers += VP9_MAXIMUM_REF_BUFFERS + VPX_MAXIMUM_WORK_BUFFERS;
+
+    const long cbFrameBuffer = GetFrameBufferSize(w, h);
+
+    if (cbBuffer < cbFrameBuffer)
+      cbBuffer = cbFrameBuffer;
+  }
 
   if (props.cbBuffer < cbBuffer)
     props.cbBuffer = cbBuffer;
@@ -238,6 +475,9 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   if (FAILED(hr))
     return hr;
 
+  m_bFrameBuffers = frame_buffers && (actual.cBuffers >= props.cBuffers) &&
+      (actual.cbBuffer >= props.cbBuffer);
+
   hr = pInputPin->NotifyAllocator(pAllocator, 0);  // allow writes
 
   if (FAILED(hr) && (hr != E_NOTIMPL))
@@ -246,6 +486,88 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   m_pPinConnection = pin;
   m_pAllocator = pAllocator;
   m_pInputPin = pInputPin;
+  m_bOwnAllocator = own_allocator;
+  m_scale_width = 0;
+  m_scale_height = 0;
+  m_bit_depth = 0;
+
+  return S_OK;
+}
+
+HRESULT Outpin::ConnectAccelerated(IPin* pin, IMemInputPin* pInputPin) {
+  IDirect3DDeviceManager9* pManager;
+
+  HRESULT hr = VP9DxvaDecoder::GetDeviceManager(pin, &pManager);
+
+  if (FAILED(hr))
+    return hr;
+
+  ALLOCATOR_PROPERTIES props;
+
+  props.cBuffers = -1;
+  props.cbBuffer = -1;
+  props.cbAlign = -1;
+  props.cbPrefix = -1;
+
+  hr = pInputPin->GetAllocatorRequirements(&props);
+
+  if (props.cBuffers <= 0)
+    props.cBuffers = 1;
+
+  // Every sample is a surface, so on top of what downstream holds and the
+  // delivery queue, there must be room for the reference frames and the
+  // frame being decoded.
+  long count = props.cBuffers + m_pFilter->m_cfg.output_queue_depth +
+               VP9FrameHeader::kRefFrames + 1;
+
+  if (count > VP9DxvaDecoder::GetMaxSurfaceCount())
+    count = VP9DxvaDecoder::GetMaxSurfaceCount();
+
+  LONG w, h;
+  GetConnectionDimensions(w, h);
+
+  hr = m_dxva.Open(pManager, w, h, count);
+  pManager->Release();
+
+  if (FAILED(hr))
+    return hr;
+
+  GraphUtil::IMemAllocatorPtr pAllocator;
+
+  hr = m_dxva.CreateAllocator(&pAllocator);
+
+  if (SUCCEEDED(hr)) {
+    ALLOCATOR_PROPERTIES actual;
+
+    m_dxva.GetAllocatorProperties(props);
+    hr = pAllocator->SetProperties(&props, &actual);
+  }
+
+  if (SUCCEEDED(hr)) {
+    hr = pInputPin->NotifyAllocator(pAllocator, 0);
+
+    if (hr == E_NOTIMPL)
+      hr = S_OK;
+  }
+
+  if (FAILED(hr)) {
+    m_dxva.Close();
+    return hr;
+  }
+
+#ifdef _DEBUG
+  odbgstream os;
+  os << "vp9dec::outpin: DXVA2 decode, " << count << " surfaces" << endl;
+#endif
+
+  m_pPinConnection = pin;
+  m_pAllocator = pAllocator;
+  m_pInputPin = pInputPin;
+  m_bFrameBuffers = false;
+  m_bOwnAllocator = false;  // the surfaces are fixed in size
+  m_scale_width = 0;
+  m_scale_height = 0;
+  m_bit_depth = 0;
 
   return S_OK;
 }
@@ -253,6 +575,9 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
 HRESULT Outpin::OnDisconnect() {
   m_pInputPin = 0;
   m_pAllocator = 0;
+  m_bFrameBuffers = false;
+  m_bOwnAllocator = false;
+  m_dxva.Close();
 
   return S_OK;
 }
@@ -284,6 +609,10 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
     __noop;
   else if (mt_query.subtype == MEDIASUBTYPE_YUYV)
     __noop;
+  else if (IsHighBitDepthSubtype(mt_query.subtype))
+    __noop;
+  else if (mt_query.subtype == WebmTypes::MEDIASUBTYPE_Y800)
+    __noop;
   else
     return S_FALSE;
 
@@ -305,15 +634,45 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
   if (mt_query.formattype == GUID_NULL)
     return S_OK;
 
-  const AM_MEDIA_TYPE& mt_in = inpin.m_connection_mtv[0];
+  // Once the type has changed, a renderer can ask again for every sample
+  // (the EVR does), so remember the last type vetted against this input.
+  if (!m_accepted_mtv.Empty() &&
+      MediaTypeUtil::Equal(m_accepted_mtv[0], mt_query))
+    return S_OK;
+
+  // Vet against the size of the frames being delivered, which after an
+  // in-band change is no longer the size the input was connected with.
+  VIDEOINFOHEADER vih_in =
+      reinterpret_cast<const VIDEOINFOHEADER&>(
+          *inpin.m_connection_mtv[0].pbFormat);
+
+  LONG w, h;
+
+  if (bool(m_pPinConnection) &&
+      webmdshow::GetVideoFrameSize(m_connection_mtv[0], &w, &h)) {
+    vih_in.bmiHeader.biWidth = w;
+    vih_in.bmiHeader.biHeight = h;
+  }
+
+  AM_MEDIA_TYPE mt_in = inpin.m_connection_mtv[0];
+  mt_in.cbFormat = sizeof vih_in;
+  mt_in.pbFormat = reinterpret_cast<BYTE*>(&vih_in);
+
+  HRESULT result;
 
   if (mt_query.formattype == FORMAT_VideoInfo)
-    return QueryAcceptVideoInfo(mt_in, mt_query);
+    result = QueryAcceptVideoInfo(mt_in, mt_query);
+  else if (mt_query.formattype == FORMAT_VideoInfo2)
+    result = QueryAcceptVideoInfo2(mt_in, mt_query);
+  else
+    return S_OK;
 
-  if (mt_query.formattype == FORMAT_VideoInfo2)
-    return QueryAcceptVideoInfo2(mt_in, mt_query);
+  if (result == S_OK) {
+    m_accepted_mtv.Clear();
+    m_accepted_mtv.Add(mt_query);
+  }
 
-  return S_OK;
+  return result;
 }
 
 HRESULT Outpin::QueryAcceptVideoInfo(const AM_MEDIA_TYPE& mt_in,
@@ -392,7 +751,8 @@ bool Outpin::VetBMIH(const VIDEOINFOHEADER& vih_in, const GUID& subtype_out,
   if (stride_out <= 0)
     return false;
 
-  if (stride_out % 2)
+  // Only the types with chroma need an even stride.
+  if ((stride_out % 2) && (subtype_out != WebmTypes::MEDIASUBTYPE_Y800))
     return false;
 
   const LONG height_out = labs(bmih_out.biHeight);  // yes, negative OK
@@ -718,6 +1078,40 @@ HRESULT Outpin::GetPreroll(LONGLONG* p) {
   return E_FAIL;
 }
 
+HRESULT Outpin::Notify(IBaseFilter*, Quality q) {
+  // Called by the renderer as it renders, so it mustn't wait for the
+  // filter lock, which the inpin may hold while it waits for the
+  // renderer to release a buffer.
+  if (m_pQualitySink)
+    return m_pQualitySink->Notify(m_pFilter, q);
+
+  if (m_pFilter->m_quality.OnQuality(q.Proportion, q.Late)) {
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp9dec::outpin::Notify: quality level="
+       << m_pFilter->m_quality.GetLevel() << endl;
+#endif
+  }
+
+  // Once we have shed all we can, the message goes upstream, so that the
+  // splitter can skip to the next keyframe without reading the frames
+  // we would only drop.
+  if (m_pFilter->m_quality.GetLevel() == webmdshow::QualityLadder::kLevelMax) {
+    const GraphUtil::IQualityControlPtr pQC(
+        m_pFilter->m_inpin.m_pPinConnection);
+
+    if (bool(pQC))
+      return pQC->Notify(m_pFilter, q);
+  }
+
+  return S_OK;
+}
+
+HRESULT Outpin::SetSink(IQualityControl* pSink) {
+  m_pQualitySink = pSink;
+  return S_OK;
+}
+
 HRESULT Outpin::GetName(PIN_INFO& info) const {
   wstring name;
 
@@ -756,6 +1150,7 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
   const BITMAPINFOHEADER& bmihIn = vihIn.bmiHeader;
 
   m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
 
   const LONG w = bmihIn.biWidth;
   assert(w > 0);
@@ -795,6 +1190,28 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
 
   AddPreferred(MEDIASUBTYPE_YVYU, vihIn.AvgTimePerFrame, w, h, dwBitCount,
                dwSizeImage);
+
+  // 16-bit planar, for high bit depth streams, last: the input type doesn't
+  // say the stream's depth, so 8-bit output is the default (and
+  // SetBitDepthLocked switches once a frame says otherwise).
+
+  dwBitCount = 24;
+  dwSizeImage = 2 * (w * h + 2 * ((w + 1) / 2 * (h + 1) / 2));
+
+  AddPreferred(WebmTypes::MEDIASUBTYPE_P010, vihIn.AvgTimePerFrame, w, h,
+               dwBitCount, dwSizeImage);
+
+  AddPreferred(WebmTypes::MEDIASUBTYPE_P016, vihIn.AvgTimePerFrame, w, h,
+               dwBitCount, dwSizeImage);
+
+  // Luma only, for analytics (motion detection, OCR), which ask for it by
+  // name.
+
+  dwBitCount = 8;
+  dwSizeImage = w * h;
+
+  AddPreferred(WebmTypes::MEDIASUBTYPE_Y800, vihIn.AvgTimePerFrame, w, h,
+               dwBitCount, dwSizeImage);
 }
 
 HRESULT Outpin::OnInpinDisconnect() {
@@ -818,6 +1235,195 @@ HRESULT Outpin::OnInpinDisconnect() {
 
 void Outpin::SetDefaultMediaTypes() {
   m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
+}
+
+HRESULT Outpin::SetFrameSizeLocked(IMediaSample* pSample, LONG w, LONG h) {
+  assert(pSample);
+  assert(bool(m_pPinConnection));
+
+  if ((w == m_scale_width) && (h == m_scale_height))
+    return S_FALSE;
+
+  CMediaTypes mtv;
+
+  HRESULT hr =
+      webmdshow::ResizeVideoMediaType(m_connection_mtv[0], w, h, &mtv);
+
+  if (FAILED(hr))
+    return hr;
+
+  const AM_MEDIA_TYPE& mt = mtv[0];
+
+  hr = m_pPinConnection->QueryAccept(&mt);
+
+  if (hr != S_OK) {
+    m_scale_width = w;
+    m_scale_height = h;
+
+    return S_FALSE;
+  }
+
+  const long size = static_cast<long>(mt.lSampleSize);
+
+  if (pSample->GetSize() < size) {
+    if (m_bOwnAllocator) {
+      // Each sample gets a buffer of the new size the next time we get it,
+      // so the next frame can switch.
+      IMemAllocator* const pAllocator = m_pAllocator;
+
+      hr = static_cast<CMemAllocator*>(pAllocator)->GrowBuffers(size);
+
+      return FAILED(hr) ? hr : S_FALSE;
+    }
+
+    // A renderer's allocator makes buffers of the new size when its pin
+    // is reconnected with the type, and then attaches the type to a sample
+    // it gives us, which is how PopulateSample switches to it. Meanwhile,
+    // our QueryAccept has to take the type when downstream asks.
+    hr = m_pPinConnection->ReceiveConnection(this, &mt);
+
+    if (SUCCEEDED(hr)) {
+      m_accepted_mtv.Clear();
+      m_accepted_mtv.Add(mt);
+    }
+
+    m_scale_width = w;
+    m_scale_height = h;
+
+    return S_FALSE;
+  }
+
+  hr = pSample->SetMediaType(const_cast<AM_MEDIA_TYPE*>(&mt));
+
+  if (FAILED(hr))
+    return hr;
+
+  m_connection_mtv.Clear();
+  m_connection_mtv.Add(mt);
+
+  m_accepted_mtv.Clear();
+  m_scale_width = 0;
+  m_scale_height = 0;
+
+  return S_OK;
+}
+
+HRESULT Outpin::SetBitDepthLocked(IMediaSample* pSample, int bit_depth) {
+  assert(pSample);
+  assert(bool(m_pPinConnection));
+
+  const AM_MEDIA_TYPE& mt_conn = m_connection_mtv[0];
+
+  if (IsHighBitDepthSubtype(mt_conn.subtype))
+    return S_OK;  // P010 takes 8 bits as well as 10 or 12
+
+  if (mt_conn.subtype == WebmTypes::MEDIASUBTYPE_Y800)
+    return S_FALSE;  // asked for 8 bits; the frame is dithered
+
+  if ((bit_depth <= 8) || (bit_depth == m_bit_depth))
+    return S_FALSE;
+
+  m_bit_depth = bit_depth;
+
+  LONG w, h;
+
+  if (!webmdshow::GetVideoFrameSize(mt_conn, &w, &h))
+    return S_FALSE;
+
+  const GUID& subtype = (bit_depth > 10) ? WebmTypes::MEDIASUBTYPE_P016
+                                         : WebmTypes::MEDIASUBTYPE_P010;
+
+  // The connection type with the 16-bit subtype, resized to recompute the
+  // image size.
+  CMediaTypes mtv_subtype;
+
+  HRESULT hr = mtv_subtype.Add(mt_conn);
+
+  if (FAILED(hr))
+    return hr;
+
+  const BITMAPINFOHEADER* bmih_ptr;
+  const RECT* rc_ptr;
+
+  if (!webmdshow::GetVideoBitmap(mtv_subtype[0], &bmih_ptr, &rc_ptr))
+    return S_FALSE;
+
+  BITMAPINFOHEADER& bmih = const_cast<BITMAPINFOHEADER&>(*bmih_ptr);
+  bmih.biCompression = subtype.Data1;
+  bmih.biBitCount = 24;
+  mtv_subtype[0].subtype = subtype;
+
+  CMediaTypes mtv;
+
+  hr = webmdshow::ResizeVideoMediaType(mtv_subtype[0], w, h, &mtv);
+
+  if (FAILED(hr))
+    return hr;
+
+  const AM_MEDIA_TYPE& mt = mtv[0];
+
+  hr = m_pPinConnection->QueryAccept(&mt);
+
+  if (hr != S_OK)
+    return S_FALSE;
+
+  const long size = static_cast<long>(mt.lSampleSize);
+
+  if (pSample->GetSize() < size) {
+    // As for a change of frame size.
+    if (m_bOwnAllocator) {
+      IMemAllocator* const pAllocator = m_pAllocator;
+
+      hr = static_cast<CMemAllocator*>(pAllocator)->GrowBuffers(size);
+
+      m_bit_depth = 0;  // ask again once the buffers are bigger
+      return FAILED(hr) ? hr : S_FALSE;
+    }
+
+    hr = m_pPinConnection->ReceiveConnection(this, &mt);
+
+    if (SUCCEEDED(hr)) {
+      m_accepted_mtv.Clear();
+      m_accepted_mtv.Add(mt);
+    }
+
+    return S_FALSE;
+  }
+
+  hr = pSample->SetMediaType(const_cast<AM_MEDIA_TYPE*>(&mt));
+
+  if (FAILED(hr))
+    return hr;
+
+  m_connection_mtv.Clear();
+  m_connection_mtv.Add(mt);
+
+  m_accepted_mtv.Clear();
+
+  return S_OK;
+}
+
+bool Outpin::IsHighBitDepthSubtype(const GUID& subtype) {
+  return (subtype == WebmTypes::MEDIASUBTYPE_P010) ||
+         (subtype == WebmTypes::MEDIASUBTYPE_P016);
+}
+
+long Outpin::GetFrameBufferSize(LONG w, LONG h) {
+  // This follows vp9_realloc_frame_buffer. libvpx has used a border of
+  // either 32 or 160 pixels, depending on version; assume the larger.
+  const LONG border = 160;
+
+  const LONG aligned_w = (w + 7) & ~7;
+  const LONG aligned_h = (h + 7) & ~7;
+
+  const LONG y_stride = (aligned_w + 2 * border + 31) & ~31;
+  const long y_size = (aligned_h + 2 * border) * y_stride;
+
+  const LONG uv_stride = y_stride / 2;
+  const long uv_size = (aligned_h / 2 + border) * uv_stride;
+
+  return y_size + 2 * uv_size + 32;  // libvpx aligns the buffer itself
 }
 
 void Outpin::GetConnectionDimensions(LONG& w, LONG& h) const {
@@ -12,14 +12,18 @@
 #include <comdef.h>
 #include <strmif.h>
 
+#include <map>
+
 #include "graphutil.h"
 #include "vp9decoderpin.h"
+#include "vp9dxvadecoder.h"
+#include "vpx/vpx_frame_buffer.h"
 
 namespace VP9DecoderLib {
 
 class Filter;
 
-class Outpin : public Pin, public IMediaSeeking {
+class Outpin : public Pin, public IMediaSeeking, public IQualityControl {
  public:
   explicit Outpin(Filter*);
   virtual ~Outpin();
@@ -59,16 +63,51 @@ class Outpin : public Pin, public IMediaSeeking {
   HRESULT STDMETHODCALLTYPE GetRate(double*);
   HRESULT STDMETHODCALLTYPE GetPreroll(LONGLONG*);
 
+  // IQualityControl
+  HRESULT STDMETHODCALLTYPE Notify(IBaseFilter*, Quality);
+  HRESULT STDMETHODCALLTYPE SetSink(IQualityControl*);
+
   // local functions
   HRESULT Start();  // from stopped to running/paused
   void Stop();  // from running/paused to stopped
   void OnInpinConnect(const AM_MEDIA_TYPE&);
   HRESULT OnInpinDisconnect();
 
+  // Switches the output, in band, to frames of w x h, when the stream
+  // changes resolution: downstream is asked to accept the resized type,
+  // which is attached to |sample|. Returns S_FALSE when |sample| can't
+  // carry frames of that size, in which case its frame is scaled to the
+  // current size; if its buffer was too small, the buffers to come are
+  // made bigger.
+  HRESULT SetFrameSizeLocked(IMediaSample* sample, LONG w, LONG h);
+
+  // Switches the output, in band, to P010 (P016 for 12 bits) when the
+  // frames turn out to be of high bit depth, which VP9 profile 2 only says
+  // once a frame is decoded. Returns S_FALSE when downstream keeps its
+  // 8-bit type (or takes the new one on a later sample), in which case the
+  // frame is dithered to 8 bits.
+  HRESULT SetBitDepthLocked(IMediaSample* sample, int bit_depth);
+
+  // Delivery queue, used when the inpin decodes on its own thread. Samples
+  // are released downstream in presentation order, from a thread owned by
+  // this pin.
+  void QueueSampleLocked(IMediaSample*);  // takes ownership
+  void QueueEndOfStreamLocked();
+  void FlushSamplesLocked();
+  void OnSamplesChangedLocked();
+
   // public members
   GraphUtil::IMemInputPinPtr m_pInputPin;
   GraphUtil::IMemAllocatorPtr m_pAllocator;
 
+  // True when m_pAllocator is our own allocator, sized such that its samples
+  // can also serve as libvpx external frame buffers.
+  bool m_bFrameBuffers;
+
+  // Open when downstream is a DXVA2 renderer whose device decodes VP9, in
+  // which case m_pAllocator's samples are the decoder's surfaces.
+  VP9DxvaDecoder m_dxva;
+
  protected:
   HRESULT GetName(PIN_INFO&) const;
   HRESULT OnDisconnect();
@@ -87,6 +126,22 @@ class Outpin : public Pin, public IMediaSeeking {
 
   void GetConnectionDimensions(LONG& w, LONG& h) const;
 
+  // Connects with the decoder's surfaces as the samples, if downstream
+  // supports DXVA2 and its device can decode the stream. On failure the
+  // connection falls back to system memory samples.
+  HRESULT ConnectAccelerated(IPin*, IMemInputPin*);
+
+  static bool IsHighBitDepthSubtype(const GUID&);  // P010 or P016
+
+  // Upper bound of the size libvpx requests for a frame of this size.
+  static long GetFrameBufferSize(LONG w, LONG h);
+
+  void StartThread();
+  void StopThread();
+  static unsigned __stdcall ThreadProc(void*);
+  unsigned Main();
+  int GetSample(IMediaSample**);
+
   void AddPreferred(const GUID& subtype, REFERENCE_TIME AvgTimePerFrame,
                     LONG width, LONG height, DWORD dwBitCount,
                     DWORD dwSizeImage);
@@ -100,6 +155,39 @@ class Outpin : public Pin, public IMediaSeeking {
                       DWORD dwBitCount, DWORD dwSizeImage);
   Outpin(const Outpin&);
   Outpin& operator=(const Outpin&);
+
+  // Keyed by start time. Samples without a timestamp are keyed by the start
+  // time of the sample queued before them, so they keep their position.
+  typedef std::multimap<REFERENCE_TIME, IMediaSample*> samples_t;
+
+  HANDLE m_hThread;
+  HANDLE m_hSamples;  // queue changed, or stop requested
+  samples_t m_samples;
+  REFERENCE_TIME m_last_start;
+  bool m_bEndOfStream;
+  long m_output_depth;
+
+  // When set, quality messages go here instead of to our quality ladder.
+  // Not AddRef'd, as IQualityControl::SetSink requires.
+  IQualityControl* m_pQualitySink;
+
+  // The last type with a format block that QueryAccept accepted, while
+  // the inpin has its current connection.
+  CMediaTypes m_accepted_mtv;
+
+  // True when m_pAllocator is a CMemAllocator that we created, whose
+  // buffers can grow.
+  bool m_bOwnAllocator;
+
+  // A frame size SetFrameSizeLocked gave up on (downstream refused it, or
+  // will attach it to a sample of its own), so frames of this size are
+  // scaled without asking again.
+  LONG m_scale_width;
+  LONG m_scale_height;
+
+  // The bit depth SetBitDepthLocked last asked downstream for, so that it
+  // asks once per depth.
+  int m_bit_depth;
 };
 
 }  // end namespace VP9DecoderLib
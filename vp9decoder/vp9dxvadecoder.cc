@@ -0,0 +1,918 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+#include "vp9dxvadecoder.h"
+
+#include <evr.h>
+#include <mfidl.h>
+#include <vfwmsgs.h>
+
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#include "cmediasample.h"
+#include "cmemallocator.h"
+
+#ifdef _DEBUG
+#include "odbgstream.h"
+using std::endl;
+using std::hex;
+using std::dec;
+#endif
+
+namespace VP9DecoderLib {
+
+namespace {
+
+// DXVA_ModeVP9_VLD_Profile0
+const GUID kModeVP9Profile0 = {
+    0x463707F8, 0xA1D0, 0x4585,
+    {0x87, 0x6D, 0x83, 0xAA, 0x6D, 0x60, 0xB8, 0x9E}};
+
+const D3DFORMAT kFormatNV12 =
+    static_cast<D3DFORMAT>(MAKEFOURCC('N', 'V', '1', '2'));
+
+// DXVA decoders want their surfaces a whole number of macroblocks.
+const LONG kSurfaceAlignment = 16;
+
+// The accelerator reads the bitstream buffer in 128 byte units.
+const UINT kBitstreamAlignment = 128;
+
+// BeginFrame returns E_PENDING while the accelerator is busy with the
+// surface; it's retried this many times, this far apart.
+const int kBeginFrameRetries = 50;
+const DWORD kBeginFrameRetryMilli = 2;
+
+// The DXVA VP9 structures, which the Windows 8.1 SDK doesn't have. They
+// follow the DXVA specification for VP9, and are byte packed as the rest
+// of dxva.h is.
+#pragma pack(push, 1)
+
+struct DxvaPicEntryVPx {
+  UCHAR bPicEntry;  // Index7Bits, and AssociatedFlag in the top bit
+};
+
+struct DxvaSegmentationVP9 {
+  UCHAR wSegmentInfoFlags;
+  UCHAR tree_probs[7];
+  UCHAR pred_probs[3];
+  SHORT feature_data[8][4];
+  UCHAR feature_mask[8];
+};
+
+struct DxvaPicParamsVP9 {
+  DxvaPicEntryVPx CurrPic;
+  UCHAR profile;
+  USHORT wFormatAndPictureInfoFlags;
+  UINT width;
+  UINT height;
+  UCHAR BitDepthMinus8Luma;
+  UCHAR BitDepthMinus8Chroma;
+  UCHAR interp_filter;
+  UCHAR Reserved8Bits;
+  DxvaPicEntryVPx ref_frame_map[8];
+  UINT ref_frame_coded_width[8];
+  UINT ref_frame_coded_height[8];
+  DxvaPicEntryVPx frame_refs[3];
+  CHAR ref_frame_sign_bias[4];
+  CHAR filter_level;
+  CHAR sharpness_level;
+  UCHAR wControlInfoFlags;
+  CHAR ref_deltas[4];
+  CHAR mode_deltas[2];
+  SHORT base_qindex;
+  CHAR y_dc_delta_q;
+  CHAR uv_dc_delta_q;
+  CHAR uv_ac_delta_q;
+  DxvaSegmentationVP9 stVP9Segments;
+  UCHAR log2_tile_cols;
+  UCHAR log2_tile_rows;
+  USHORT uncompressed_header_size_byte_aligned;
+  USHORT first_partition_size;
+  USHORT Reserved16Bits;
+  UINT Reserved32Bits;
+  UINT StatusReportFeedbackNumber;
+};
+
+struct DxvaSliceVPxShort {
+  UINT BSNALunitDataLocation;
+  UINT SliceBytesInBuffer;
+  USHORT wBadSliceChopping;
+};
+
+#pragma pack(pop)
+
+}  // namespace
+
+// A sample whose buffer is a decoder surface, which the renderer gets with
+// IMFGetService::GetService(MR_BUFFER_SERVICE). The memory CMediaSample
+// allocates is a token: the renderer never locks it.
+class VP9DxvaDecoder::Sample : public CMediaSample, public IMFGetService {
+ public:
+  class Factory : public CMemAllocator::ISampleFactory {
+   public:
+    Factory(IDirect3DSurface9* const* surfaces, long count);
+    virtual ~Factory();
+
+    HRESULT CreateSample(CMemAllocator*, IMemSample*&);
+    HRESULT InitializeSample(IMemSample*);
+    HRESULT FinalizeSample(IMemSample*);
+    HRESULT DestroySample(IMemSample*);
+    HRESULT Destroy(CMemAllocator*);
+
+    void ReleaseIndex(int index);
+
+   private:
+    Factory(const Factory&);
+    Factory& operator=(const Factory&);
+
+    IDirect3DSurface9* m_surfaces[kMaxSurfaces];
+    const long m_count;
+
+    // Non-zero while a sample has the surface. Samples are created in
+    // Commit, and destroyed as they are released after a Decommit, so
+    // this is claimed and released from different threads.
+    volatile LONG m_used[kMaxSurfaces];
+  };
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+  ULONG STDMETHODCALLTYPE AddRef();
+  ULONG STDMETHODCALLTYPE Release();
+
+  // IMFGetService
+  HRESULT STDMETHODCALLTYPE GetService(REFGUID, REFIID, LPVOID*);
+
+ private:
+  Sample(CMemAllocator*, Factory*, IDirect3DSurface9*, int index);
+  virtual ~Sample();
+
+  Sample(const Sample&);
+  Sample& operator=(const Sample&);
+
+  Factory* const m_pFactory;
+  IDirect3DSurface9* const m_pSurface;
+  const int m_index;
+};
+
+VP9DxvaDecoder::Sample::Sample(CMemAllocator* pAllocator, Factory* pFactory,
+                               IDirect3DSurface9* pSurface, int index)
+    : CMediaSample(pAllocator, false),
+      m_pFactory(pFactory),
+      m_pSurface(pSurface),
+      m_index(index) {
+  m_pSurface->AddRef();
+}
+
+VP9DxvaDecoder::Sample::~Sample() {
+  m_pSurface->Release();
+  m_pFactory->ReleaseIndex(m_index);
+}
+
+HRESULT VP9DxvaDecoder::Sample::QueryInterface(const IID& iid, void** ppv) {
+  if (ppv == 0)
+    return E_POINTER;
+
+  if (iid == __uuidof(IMFGetService)) {
+    *ppv = static_cast<IMFGetService*>(this);
+    AddRef();
+    return S_OK;
+  }
+
+  return CMediaSample::QueryInterface(iid, ppv);
+}
+
+ULONG VP9DxvaDecoder::Sample::AddRef() {
+  return CMediaSample::AddRef();
+}
+
+ULONG VP9DxvaDecoder::Sample::Release() {
+  return CMediaSample::Release();
+}
+
+HRESULT VP9DxvaDecoder::Sample::GetService(REFGUID service, REFIID iid,
+                                           LPVOID* ppv) {
+  if (ppv == 0)
+    return E_POINTER;
+
+  *ppv = 0;
+
+  if (service != MR_BUFFER_SERVICE)
+    return MF_E_UNSUPPORTED_SERVICE;
+
+  return m_pSurface->QueryInterface(iid, ppv);
+}
+
+VP9DxvaDecoder::Sample::Factory::Factory(IDirect3DSurface9* const* surfaces,
+                                         long count)
+    : m_count(count) {
+  assert(count <= kMaxSurfaces);
+
+  for (long i = 0; i < m_count; ++i) {
+    m_surfaces[i] = surfaces[i];
+    m_surfaces[i]->AddRef();
+    m_used[i] = 0;
+  }
+}
+
+VP9DxvaDecoder::Sample::Factory::~Factory() {
+  for (long i = 0; i < m_count; ++i) {
+    assert(m_used[i] == 0);
+    m_surfaces[i]->Release();
+  }
+}
+
+HRESULT VP9DxvaDecoder::Sample::Factory::CreateSample(
+    CMemAllocator* pAllocator,
+    IMemSample*& pResult) {
+  assert(pAllocator);
+  pResult = 0;
+
+  int index = -1;
+
+  for (long i = 0; i < m_count; ++i) {
+    if (InterlockedCompareExchange(&m_used[i], 1, 0) == 0) {
+      index = i;
+      break;
+    }
+  }
+
+  if (index < 0)  // the allocator wants more samples than we have surfaces
+    return E_OUTOFMEMORY;
+
+  Sample* const pSample =
+      new (std::nothrow) Sample(pAllocator, this, m_surfaces[index], index);
+
+  if (pSample == 0) {
+    ReleaseIndex(index);
+    return E_OUTOFMEMORY;
+  }
+
+  const HRESULT hr = pSample->Create();
+
+  if (FAILED(hr)) {
+    delete pSample;
+    return hr;
+  }
+
+  pResult = pSample;
+  return S_OK;
+}
+
+HRESULT VP9DxvaDecoder::Sample::Factory::InitializeSample(IMemSample* p) {
+  assert(p);
+  return p->Initialize();
+}
+
+HRESULT VP9DxvaDecoder::Sample::Factory::FinalizeSample(IMemSample* p) {
+  assert(p);
+  return p->Finalize();
+}
+
+HRESULT VP9DxvaDecoder::Sample::Factory::DestroySample(IMemSample* p) {
+  assert(p);
+  return p->Destroy();
+}
+
+HRESULT VP9DxvaDecoder::Sample::Factory::Destroy(CMemAllocator*) {
+  delete this;
+  return S_OK;
+}
+
+void VP9DxvaDecoder::Sample::Factory::ReleaseIndex(int index) {
+  assert(index >= 0);
+  assert(index < m_count);
+
+  InterlockedExchange(&m_used[index], 0);
+}
+
+//
+// VP9DxvaDecoder
+//
+VP9DxvaDecoder::VP9DxvaDecoder()
+    : m_pManager(0),
+      m_hDevice(0),
+      m_pService(0),
+      m_pDecoder(0),
+      m_count(0),
+      m_width(0),
+      m_height(0),
+      m_status_report(0) {
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    m_ref_samples[i] = 0;
+    m_ref_index[i] = kNoSurface;
+    m_ref_width[i] = 0;
+    m_ref_height[i] = 0;
+  }
+}
+
+VP9DxvaDecoder::~VP9DxvaDecoder() {
+  Close();
+}
+
+HRESULT VP9DxvaDecoder::GetDeviceManager(IPin* pPin,
+                                         IDirect3DDeviceManager9** pp) {
+  if ((pPin == 0) || (pp == 0))
+    return E_POINTER;
+
+  *pp = 0;
+
+  IMFGetService* pGetService;
+
+  HRESULT hr = pPin->QueryInterface(&pGetService);
+
+  if (FAILED(hr))
+    return hr;
+
+  // The renderer must be told which kind of surfaces it will be given
+  // before it hands out its device.
+  IDirectXVideoMemoryConfiguration* pConfig;
+
+  hr = pGetService->GetService(MR_VIDEO_ACCELERATION_SERVICE,
+                               __uuidof(IDirectXVideoMemoryConfiguration),
+                               reinterpret_cast<void**>(&pConfig));
+
+  if (SUCCEEDED(hr)) {
+    for (DWORD i = 0;; ++i) {
+      DXVA2_SurfaceType type;
+
+      hr = pConfig->GetAvailableSurfaceTypeByIndex(i, &type);
+
+      if (FAILED(hr))
+        break;
+
+      if (type == DXVA2_SurfaceType_DecoderRenderTarget) {
+        hr = pConfig->SetSurfaceType(type);
+        break;
+      }
+    }
+
+    pConfig->Release();
+  }
+
+  if (SUCCEEDED(hr)) {
+    hr = pGetService->GetService(MR_VIDEO_ACCELERATION_SERVICE,
+                                 __uuidof(IDirect3DDeviceManager9),
+                                 reinterpret_cast<void**>(pp));
+  }
+
+  pGetService->Release();
+  return hr;
+}
+
+long VP9DxvaDecoder::GetMaxSurfaceCount() {
+  return kMaxSurfaces;
+}
+
+HRESULT VP9DxvaDecoder::Open(IDirect3DDeviceManager9* pManager, LONG width,
+                             LONG height, long count) {
+  Close();
+
+  if (pManager == 0)
+    return E_POINTER;
+
+  if ((width <= 0) || (height <= 0) || (count <= 0) || (count > kMaxSurfaces))
+    return E_INVALIDARG;
+
+  m_pManager = pManager;
+  m_pManager->AddRef();
+
+  HRESULT hr = m_pManager->OpenDeviceHandle(&m_hDevice);
+
+  if (SUCCEEDED(hr)) {
+    hr = m_pManager->GetVideoService(m_hDevice,
+                                     __uuidof(IDirectXVideoDecoderService),
+                                     reinterpret_cast<void**>(&m_pService));
+  }
+
+  if (FAILED(hr)) {
+    Close();
+    return hr;
+  }
+
+  // Is there a VP9 profile 0 decoder ...
+  UINT guid_count = 0;
+  GUID* guids = 0;
+  bool found = false;
+
+  hr = m_pService->GetDecoderDeviceGuids(&guid_count, &guids);
+
+  if (SUCCEEDED(hr)) {
+    for (UINT i = 0; (i < guid_count) && !found; ++i)
+      found = (guids[i] == kModeVP9Profile0);
+
+    CoTaskMemFree(guids);
+  }
+
+  // ... that writes NV12 ...
+  if (found) {
+    UINT format_count = 0;
+    D3DFORMAT* formats = 0;
+
+    found = false;
+    hr = m_pService->GetDecoderRenderTargets(kModeVP9Profile0, &format_count,
+                                             &formats);
+
+    if (SUCCEEDED(hr)) {
+      for (UINT i = 0; (i < format_count) && !found; ++i)
+        found = (formats[i] == kFormatNV12);
+
+      CoTaskMemFree(formats);
+    }
+  }
+
+  // ... and takes the bitstream as it is?
+  DXVA2_VideoDesc desc;
+  memset(&desc, 0, sizeof desc);
+
+  desc.SampleWidth = width;
+  desc.SampleHeight = height;
+  desc.Format = kFormatNV12;
+  desc.SampleFormat.SampleFormat = DXVA2_SampleProgressiveFrame;
+
+  DXVA2_ConfigPictureDecode config;
+
+  if (found) {
+    UINT config_count = 0;
+    DXVA2_ConfigPictureDecode* configs = 0;
+
+    found = false;
+    hr = m_pService->GetDecoderConfigurations(kModeVP9Profile0, &desc, 0,
+                                              &config_count, &configs);
+
+    if (SUCCEEDED(hr)) {
+      for (UINT i = 0; (i < config_count) && !found; ++i) {
+        if ((configs[i].ConfigBitstreamRaw == 1) &&
+            (configs[i].guidConfigBitstreamEncryption == DXVA2_NoEncrypt)) {
+          config = configs[i];
+          found = true;
+        }
+      }
+
+      CoTaskMemFree(configs);
+    }
+  }
+
+  if (!found) {
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp9dec::dxva: no VP9 profile 0 decoder for " << width << "x"
+       << height << endl;
+#endif
+
+    Close();
+    return E_NOTIMPL;
+  }
+
+  const LONG aligned_width = (width + kSurfaceAlignment - 1) &
+                             ~(kSurfaceAlignment - 1);
+  const LONG aligned_height = (height + kSurfaceAlignment - 1) &
+                              ~(kSurfaceAlignment - 1);
+
+  hr = m_pService->CreateSurface(aligned_width, aligned_height, count - 1,
+                                 kFormatNV12, D3DPOOL_DEFAULT, 0,
+                                 DXVA2_VideoDecoderRenderTarget, m_surfaces,
+                                 0);
+
+  if (FAILED(hr)) {
+    Close();
+    return hr;
+  }
+
+  m_count = count;
+
+  hr = m_pService->CreateVideoDecoder(kModeVP9Profile0, &desc, &config,
+                                      m_surfaces, m_count, &m_pDecoder);
+
+  if (FAILED(hr)) {
+    Close();
+    return hr;
+  }
+
+  m_width = width;
+  m_height = height;
+  m_status_report = 0;
+
+  Reset();
+
+  return S_OK;
+}
+
+void VP9DxvaDecoder::Close() {
+  Reset();
+
+  if (m_pDecoder) {
+    m_pDecoder->Release();
+    m_pDecoder = 0;
+  }
+
+  for (long i = 0; i < m_count; ++i)
+    m_surfaces[i]->Release();
+
+  m_count = 0;
+
+  if (m_pService) {
+    m_pService->Release();
+    m_pService = 0;
+  }
+
+  if (m_pManager) {
+    if (m_hDevice) {
+      m_pManager->CloseDeviceHandle(m_hDevice);
+      m_hDevice = 0;
+    }
+
+    m_pManager->Release();
+    m_pManager = 0;
+  }
+
+  m_width = 0;
+  m_height = 0;
+}
+
+bool VP9DxvaDecoder::IsOpen() const {
+  return (m_pDecoder != 0);
+}
+
+HRESULT VP9DxvaDecoder::CreateAllocator(IMemAllocator** pp) {
+  if (pp == 0)
+    return E_POINTER;
+
+  *pp = 0;
+
+  if (!IsOpen())
+    return E_UNEXPECTED;
+
+  Sample::Factory* const pFactory =
+      new (std::nothrow) Sample::Factory(m_surfaces, m_count);
+
+  if (pFactory == 0)
+    return E_OUTOFMEMORY;
+
+  const HRESULT hr = CMemAllocator::CreateInstance(pFactory, pp);
+
+  if (FAILED(hr))
+    delete pFactory;
+
+  return hr;
+}
+
+void VP9DxvaDecoder::GetAllocatorProperties(ALLOCATOR_PROPERTIES& props) const {
+  props.cBuffers = m_count;
+  props.cbBuffer = 1;
+  props.cbAlign = 1;
+  props.cbPrefix = 0;
+}
+
+void VP9DxvaDecoder::Reset() {
+  m_parser.Reset();
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i)
+    SetReference(i, 0, kNoSurface, 0, 0);
+}
+
+bool VP9DxvaDecoder::ParseFrame(const BYTE* data, ULONG size,
+                                VP9FrameHeader& hdr) {
+  return m_parser.Parse(data, size, hdr);
+}
+
+HRESULT VP9DxvaDecoder::DecodeFrame(const BYTE* data, ULONG size,
+                                    const VP9FrameHeader& hdr,
+                                    IMediaSample* pTarget) {
+  if (!IsOpen())
+    return E_UNEXPECTED;
+
+  assert(!hdr.show_existing_frame);
+
+  // Only what the decoder was opened for
+  if ((hdr.profile != 0) || (hdr.bit_depth != 8))
+    return E_FAIL;
+
+  if ((hdr.width > m_width) || (hdr.height > m_height))
+    return E_FAIL;
+
+  const int index = GetSurfaceIndex(pTarget);
+
+  if (index < 0)
+    return E_INVALIDARG;
+
+  if (!hdr.key_frame && !hdr.intra_only) {
+    for (int i = 0; i < VP9FrameHeader::kRefsPerFrame; ++i) {
+      if (m_ref_index[hdr.ref_frame_idx[i]] == kNoSurface)
+        return E_FAIL;
+    }
+  }
+
+  // The renderer resets its device when the display changes; our
+  // surfaces are gone with the old one.
+  HRESULT hr = m_pManager->TestDevice(m_hDevice);
+
+  if (FAILED(hr))
+    return hr;
+
+  DxvaPicParamsVP9 pp;
+  memset(&pp, 0, sizeof pp);
+
+  pp.CurrPic.bPicEntry = static_cast<UCHAR>(index);
+  pp.profile = static_cast<UCHAR>(hdr.profile);
+  pp.wFormatAndPictureInfoFlags = static_cast<USHORT>(
+      (!hdr.key_frame << 0) |
+      (hdr.show_frame << 1) |
+      (hdr.error_resilient_mode << 2) |
+      (hdr.subsampling_x << 3) |
+      (hdr.subsampling_y << 4) |
+      (hdr.refresh_frame_context << 6) |
+      (hdr.frame_parallel_decoding_mode << 7) |
+      (hdr.intra_only << 8) |
+      (hdr.frame_context_idx << 9) |
+      (hdr.reset_frame_context << 11) |
+      ((hdr.key_frame ? 0 : hdr.allow_high_precision_mv) << 13));
+  pp.width = hdr.width;
+  pp.height = hdr.height;
+  pp.BitDepthMinus8Luma = static_cast<UCHAR>(hdr.bit_depth - 8);
+  pp.BitDepthMinus8Chroma = static_cast<UCHAR>(hdr.bit_depth - 8);
+  pp.interp_filter = static_cast<UCHAR>(hdr.interp_filter);
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    pp.ref_frame_map[i].bPicEntry = static_cast<UCHAR>(m_ref_index[i]);
+    pp.ref_frame_coded_width[i] = m_ref_width[i];
+    pp.ref_frame_coded_height[i] = m_ref_height[i];
+  }
+
+  for (int i = 0; i < VP9FrameHeader::kRefsPerFrame; ++i) {
+    if (hdr.key_frame || hdr.intra_only) {
+      pp.frame_refs[i].bPicEntry = kNoSurface;
+    } else {
+      const int slot = hdr.ref_frame_idx[i];
+      pp.frame_refs[i].bPicEntry = static_cast<UCHAR>(m_ref_index[slot]);
+    }
+
+    pp.ref_frame_sign_bias[i + 1] = static_cast<CHAR>(
+        hdr.ref_frame_sign_bias[i]);
+  }
+
+  pp.filter_level = static_cast<CHAR>(hdr.filter_level);
+  pp.sharpness_level = static_cast<CHAR>(hdr.sharpness_level);
+  pp.wControlInfoFlags = static_cast<UCHAR>(
+      (hdr.mode_ref_delta_enabled << 0) |
+      (hdr.mode_ref_delta_update << 1) |
+      (hdr.use_prev_frame_mvs << 2));
+
+  for (int i = 0; i < 4; ++i)
+    pp.ref_deltas[i] = static_cast<CHAR>(hdr.ref_deltas[i]);
+
+  for (int i = 0; i < 2; ++i)
+    pp.mode_deltas[i] = static_cast<CHAR>(hdr.mode_deltas[i]);
+
+  pp.base_qindex = static_cast<SHORT>(hdr.base_qindex);
+  pp.y_dc_delta_q = static_cast<CHAR>(hdr.y_dc_delta_q);
+  pp.uv_dc_delta_q = static_cast<CHAR>(hdr.uv_dc_delta_q);
+  pp.uv_ac_delta_q = static_cast<CHAR>(hdr.uv_ac_delta_q);
+
+  const VP9FrameHeader::Segmentation& seg = hdr.seg;
+  DxvaSegmentationVP9& segments = pp.stVP9Segments;
+
+  segments.wSegmentInfoFlags = static_cast<UCHAR>(
+      (seg.enabled << 0) |
+      (seg.update_map << 1) |
+      (seg.temporal_update << 2) |
+      (seg.abs_delta << 3));
+
+  memcpy(segments.tree_probs, seg.tree_probs, sizeof segments.tree_probs);
+  memcpy(segments.pred_probs, seg.pred_probs, sizeof segments.pred_probs);
+
+  for (int i = 0; i < VP9FrameHeader::kSegments; ++i) {
+    UCHAR mask = 0;
+
+    for (int j = 0; j < VP9FrameHeader::kSegFeatures; ++j) {
+      if (seg.feature_enabled[i][j])
+        mask |= (1 << j);
+
+      segments.feature_data[i][j] = static_cast<SHORT>(seg.feature_data[i][j]);
+    }
+
+    segments.feature_mask[i] = mask;
+  }
+
+  pp.log2_tile_cols = static_cast<UCHAR>(hdr.log2_tile_cols);
+  pp.log2_tile_rows = static_cast<UCHAR>(hdr.log2_tile_rows);
+  pp.uncompressed_header_size_byte_aligned =
+      static_cast<USHORT>(hdr.uncompressed_header_size);
+  pp.first_partition_size = static_cast<USHORT>(hdr.compressed_header_size);
+
+  if (++m_status_report == 0)  // 0 means "no status report wanted"
+    ++m_status_report;
+
+  pp.StatusReportFeedbackNumber = m_status_report;
+
+  for (int i = 0;; ++i) {
+    hr = m_pDecoder->BeginFrame(m_surfaces[index], 0);
+
+    if ((hr != E_PENDING) || (i >= kBeginFrameRetries))
+      break;
+
+    Sleep(kBeginFrameRetryMilli);
+  }
+
+  if (FAILED(hr))
+    return hr;
+
+  DXVA2_DecodeBufferDesc buffers[3];
+  memset(buffers, 0, sizeof buffers);
+
+  DxvaSliceVPxShort slice;
+  slice.BSNALunitDataLocation = 0;
+  slice.SliceBytesInBuffer = 0;
+  slice.wBadSliceChopping = 0;
+
+  hr = CommitBuffer(DXVA2_PictureParametersBufferType, &pp, sizeof pp);
+
+  buffers[0].CompressedBufferType = DXVA2_PictureParametersBufferType;
+  buffers[0].DataSize = sizeof pp;
+
+  if (SUCCEEDED(hr))
+    hr = CommitBitstream(data, size, slice.SliceBytesInBuffer);
+
+  buffers[1].CompressedBufferType = DXVA2_BitStreamDateBufferType;
+  buffers[1].DataSize = slice.SliceBytesInBuffer;
+
+  if (SUCCEEDED(hr))
+    hr = CommitBuffer(DXVA2_SliceControlBufferType, &slice, sizeof slice);
+
+  buffers[2].CompressedBufferType = DXVA2_SliceControlBufferType;
+  buffers[2].DataSize = sizeof slice;
+
+  if (SUCCEEDED(hr)) {
+    DXVA2_DecodeExecuteParams params;
+    params.NumCompBuffers = 3;
+    params.pCompressedBuffers = buffers;
+    params.pExtensionData = 0;
+
+    hr = m_pDecoder->Execute(&params);
+  }
+
+  const HRESULT hrEnd = m_pDecoder->EndFrame(0);
+
+  if (SUCCEEDED(hr))
+    hr = hrEnd;
+
+  if (FAILED(hr)) {
+#ifdef _DEBUG
+    odbgstream os;
+    os << "vp9dec::dxva: decode failed, hr=0x" << hex << hr << dec << endl;
+#endif
+
+    return hr;
+  }
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    if (hdr.refresh_frame_flags & (1 << i))
+      SetReference(i, pTarget, index, hdr.width, hdr.height);
+  }
+
+  return S_OK;
+}
+
+IMediaSample* VP9DxvaDecoder::GetReferenceSample(int slot) {
+  assert(slot >= 0);
+  assert(slot < VP9FrameHeader::kRefFrames);
+
+  IMediaSample* const pSample = m_ref_samples[slot];
+
+  if (pSample == 0)
+    return 0;
+
+  // Our references are one per slot that holds the sample; any other is
+  // downstream's, and the sample can't be sent again while it has it.
+  ULONG slots = 0;
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    if (m_ref_samples[i] == pSample)
+      ++slots;
+  }
+
+  IMemSample* pMemSample;
+
+  HRESULT hr = pSample->QueryInterface(&pMemSample);
+  assert(SUCCEEDED(hr));
+
+  const ULONG count = pMemSample->GetCount();
+  pMemSample->Release();
+
+  if (count > slots + 1)  // our QueryInterface is one more
+    return 0;
+
+  pSample->AddRef();
+  return pSample;
+}
+
+int VP9DxvaDecoder::GetSurfaceIndex(IMediaSample* pSample) const {
+  if (pSample == 0)
+    return -1;
+
+  IMFGetService* pGetService;
+
+  HRESULT hr = pSample->QueryInterface(&pGetService);
+
+  if (FAILED(hr))
+    return -1;
+
+  IDirect3DSurface9* pSurface;
+
+  hr = pGetService->GetService(MR_BUFFER_SERVICE, __uuidof(IDirect3DSurface9),
+                               reinterpret_cast<void**>(&pSurface));
+
+  pGetService->Release();
+
+  if (FAILED(hr))
+    return -1;
+
+  int index = -1;
+
+  for (long i = 0; i < m_count; ++i) {
+    if (m_surfaces[i] == pSurface) {
+      index = i;
+      break;
+    }
+  }
+
+  pSurface->Release();
+  return index;
+}
+
+HRESULT VP9DxvaDecoder::CommitBuffer(UINT type, const void* data, UINT size) {
+  void* buf;
+  UINT buf_size;
+
+  HRESULT hr = m_pDecoder->GetBuffer(type, &buf, &buf_size);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (buf_size >= size)
+    memcpy(buf, data, size);
+  else
+    hr = E_OUTOFMEMORY;
+
+  const HRESULT hrRelease = m_pDecoder->ReleaseBuffer(type);
+
+  return FAILED(hr) ? hr : hrRelease;
+}
+
+HRESULT VP9DxvaDecoder::CommitBitstream(const BYTE* data, ULONG size,
+                                        UINT& committed) {
+  committed = 0;
+
+  void* buf;
+  UINT buf_size;
+
+  HRESULT hr = m_pDecoder->GetBuffer(DXVA2_BitStreamDateBufferType, &buf,
+                                     &buf_size);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (buf_size >= size) {
+    BYTE* const dst = static_cast<BYTE*>(buf);
+    memcpy(dst, data, size);
+
+    // Zero to the end of the accelerator's last read, if there's room.
+    UINT padding = kBitstreamAlignment - (size % kBitstreamAlignment);
+
+    if (padding == kBitstreamAlignment)
+      padding = 0;
+
+    if (padding > buf_size - size)
+      padding = buf_size - size;
+
+    memset(dst + size, 0, padding);
+    committed = size + padding;
+  } else {
+    hr = E_OUTOFMEMORY;
+  }
+
+  const HRESULT hrRelease =
+      m_pDecoder->ReleaseBuffer(DXVA2_BitStreamDateBufferType);
+
+  return FAILED(hr) ? hr : hrRelease;
+}
+
+void VP9DxvaDecoder::SetReference(int slot, IMediaSample* pSample, int index,
+                                  int width, int height) {
+  if (pSample)
+    pSample->AddRef();
+
+  if (m_ref_samples[slot])
+    m_ref_samples[slot]->Release();
+
+  m_ref_samples[slot] = pSample;
+  m_ref_index[slot] = index;
+  m_ref_width[slot] = width;
+  m_ref_height[slot] = height;
+}
+
+}  // namespace VP9DecoderLib
@@ -0,0 +1,112 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+#ifndef WEBMDSHOW_VP9DECODER_VP9DXVADECODER_HPP_
+#define WEBMDSHOW_VP9DECODER_VP9DXVADECODER_HPP_
+
+#include <d3d9.h>
+#include <dxva2api.h>
+#include <strmif.h>
+
+#include "vp9headerparser.h"
+
+namespace VP9DecoderLib {
+
+// Decodes VP9 profile 0 with DXVA2, on the Direct3D 9 device of a
+// renderer that supports DXVA2 (the EVR, through its input pin's
+// IMFGetService). The decoder writes NV12 surfaces, which go downstream
+// as they are: each sample of the allocator from |CreateAllocator| is a
+// surface, which the renderer gets from the sample's IMFGetService.
+//
+// VP9 has no slices, so a frame goes to the accelerator as it is, with
+// the picture parameters parsed from its uncompressed header; the
+// accelerator parses the compressed header itself. Reference frames are
+// samples the decoder holds on to, so the allocator doesn't hand out a
+// reference surface to decode into until the stream no longer needs it.
+//
+// The decoder is not thread safe: the inpin decodes with the filter lock
+// held.
+class VP9DxvaDecoder {
+ public:
+  VP9DxvaDecoder();
+  ~VP9DxvaDecoder();
+
+  // Gets the DXVA2 device manager of the renderer connected to |pPin|,
+  // after asking it for decoder render target surfaces. Fails if the
+  // renderer doesn't support DXVA2.
+  static HRESULT GetDeviceManager(IPin* pPin, IDirect3DDeviceManager9**);
+
+  // Opens a decoder for frames of up to |width| x |height|, with |count|
+  // surfaces. Fails, and leaves the decoder closed, if the device has no
+  // VP9 profile 0 decoder that writes NV12.
+  HRESULT Open(IDirect3DDeviceManager9*, LONG width, LONG height, long count);
+  void Close();
+  bool IsOpen() const;
+
+  // The most surfaces |Open| accepts.
+  static long GetMaxSurfaceCount();
+
+  // Creates an allocator whose samples are the decoder's surfaces, one
+  // sample per surface. Set its properties with |GetAllocatorProperties|.
+  HRESULT CreateAllocator(IMemAllocator**);
+  void GetAllocatorProperties(ALLOCATOR_PROPERTIES&) const;
+
+  // Forgets the stream, and releases the reference frames.
+  void Reset();
+
+  // Parses the header of the next frame of the stream.
+  bool ParseFrame(const BYTE*, ULONG, VP9FrameHeader&);
+
+  // Decodes the frame |hdr| was parsed from into the surface of |pTarget|,
+  // a sample from the allocator, and keeps it in the reference slots the
+  // frame refreshes.
+  HRESULT DecodeFrame(const BYTE*, ULONG, const VP9FrameHeader& hdr,
+                      IMediaSample* pTarget);
+
+  // Returns the (AddRef'd) sample in reference slot |slot|, for a frame
+  // that shows an existing one, or null if the slot is empty or its
+  // sample is still downstream (in which case the frame is a repeat, and
+  // is not shown again).
+  IMediaSample* GetReferenceSample(int slot);
+
+ private:
+  enum { kMaxSurfaces = 32, kNoSurface = 0xFF };
+
+  class Sample;
+
+  int GetSurfaceIndex(IMediaSample*) const;
+  HRESULT CommitBuffer(UINT type, const void* data, UINT size);
+  HRESULT CommitBitstream(const BYTE* data, ULONG size, UINT& committed);
+  void SetReference(int slot, IMediaSample*, int index, int width,
+                    int height);
+
+  VP9DxvaDecoder(const VP9DxvaDecoder&);
+  VP9DxvaDecoder& operator=(const VP9DxvaDecoder&);
+
+  IDirect3DDeviceManager9* m_pManager;
+  HANDLE m_hDevice;
+  IDirectXVideoDecoderService* m_pService;
+  IDirectXVideoDecoder* m_pDecoder;
+  IDirect3DSurface9* m_surfaces[kMaxSurfaces];
+  long m_count;
+  LONG m_width;
+  LONG m_height;
+  UINT m_status_report;
+
+  VP9HeaderParser m_parser;
+
+  // The frame in each of VP9's reference slots: the (AddRef'd) sample, the
+  // index of its surface, and its size.
+  IMediaSample* m_ref_samples[VP9FrameHeader::kRefFrames];
+  int m_ref_index[VP9FrameHeader::kRefFrames];
+  int m_ref_width[VP9FrameHeader::kRefFrames];
+  int m_ref_height[VP9FrameHeader::kRefFrames];
+};
+
+}  // namespace VP9DecoderLib
+
+#endif  // WEBMDSHOW_VP9DECODER_VP9DXVADECODER_HPP_
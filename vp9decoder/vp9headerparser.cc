@@ -0,0 +1,489 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+#include "vp9headerparser.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace VP9DecoderLib {
+
+namespace {
+
+const int kSyncCode0 = 0x49;
+const int kSyncCode1 = 0x83;
+const int kSyncCode2 = 0x42;
+const int kColorSpaceRgb = 7;
+const int kMinTileWidthB64 = 4;
+const int kMaxTileWidthB64 = 64;
+const BYTE kMaxProb = 255;
+
+// Bits of the segmentation feature data (Q, loop filter, reference, skip),
+// and whether it's signed.
+const int kSegFeatureBits[VP9FrameHeader::kSegFeatures] = {8, 6, 2, 0};
+const bool kSegFeatureSigned[VP9FrameHeader::kSegFeatures] = {
+    true, true, false, false};
+
+const int kLiteralToFilter[4] = {
+    VP9FrameHeader::kEightTapSmooth, VP9FrameHeader::kEightTap,
+    VP9FrameHeader::kEightTapSharp, VP9FrameHeader::kBilinear};
+
+}  // namespace
+
+// Reads the uncompressed header, most significant bit first. Reading past
+// the end yields zeros and sets |overrun|, which the parser checks once at
+// the end rather than after each field.
+class VP9HeaderParser::BitReader {
+ public:
+  BitReader(const BYTE* data, ULONG size)
+      : overrun(false), m_data(data), m_size(size), m_pos(0) {}
+
+  int ReadBit() {
+    const ULONG byte = m_pos >> 3;
+
+    if (byte >= m_size) {
+      overrun = true;
+      return 0;
+    }
+
+    const int bit = (m_data[byte] >> (7 - (m_pos & 7))) & 1;
+    ++m_pos;
+    return bit;
+  }
+
+  int ReadLiteral(int bits) {
+    int value = 0;
+
+    for (int i = 0; i < bits; ++i)
+      value = (value << 1) | ReadBit();
+
+    return value;
+  }
+
+  int ReadSignedLiteral(int bits) {
+    const int value = ReadLiteral(bits);
+    return ReadBit() ? -value : value;
+  }
+
+  ULONG GetByteSize() const { return (m_pos + 7) >> 3; }
+
+  bool overrun;
+
+ private:
+  const BYTE* const m_data;
+  const ULONG m_size;
+  ULONG m_pos;  // in bits
+};
+
+VP9HeaderParser::VP9HeaderParser() {
+  Reset();
+}
+
+void VP9HeaderParser::Reset() {
+  m_bKeyFrameSeen = false;
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    m_ref_width[i] = 0;
+    m_ref_height[i] = 0;
+  }
+
+  SetupPastIndependence();
+
+  memset(m_seg.tree_probs, kMaxProb, sizeof m_seg.tree_probs);
+  memset(m_seg.pred_probs, kMaxProb, sizeof m_seg.pred_probs);
+  m_seg.enabled = false;
+  m_seg.update_map = false;
+  m_seg.temporal_update = false;
+  m_seg.update_data = false;
+
+  m_last_width = 0;
+  m_last_height = 0;
+  m_last_show_frame = false;
+  m_last_intra_only = false;
+}
+
+void VP9HeaderParser::SetupPastIndependence() {
+  // As vp9_setup_past_independence: the segment features are cleared, and
+  // the loop filter deltas go back to their defaults.
+  memset(m_seg.feature_enabled, 0, sizeof m_seg.feature_enabled);
+  memset(m_seg.feature_data, 0, sizeof m_seg.feature_data);
+  m_seg.abs_delta = false;
+
+  m_ref_deltas[0] = 1;  // INTRA_FRAME
+  m_ref_deltas[1] = 0;  // LAST_FRAME
+  m_ref_deltas[2] = -1;  // GOLDEN_FRAME
+  m_ref_deltas[3] = -1;  // ALTREF_FRAME
+
+  m_mode_deltas[0] = 0;
+  m_mode_deltas[1] = 0;
+}
+
+int VP9HeaderParser::ParseSuperframeIndex(
+    const BYTE* data, ULONG size, ULONG (&frame_sizes)[kMaxSuperframeFrames]) {
+  if ((data == 0) || (size == 0))
+    return 0;
+
+  frame_sizes[0] = size;
+
+  const BYTE marker = data[size - 1];
+
+  if ((marker & 0xE0) != 0xC0)
+    return 1;
+
+  const int frames = (marker & 0x7) + 1;
+  const int mag = ((marker >> 3) & 0x3) + 1;
+  const ULONG index_size = 2 + mag * frames;
+
+  // The index is bracketed by the marker; a frame that merely ends with a
+  // byte that looks like one has no index.
+  if ((size < index_size) || (data[size - index_size] != marker))
+    return 1;
+
+  const BYTE* p = data + size - index_size + 1;
+  ULONG total = 0;
+
+  for (int i = 0; i < frames; ++i) {
+    ULONG frame_size = 0;
+
+    for (int j = 0; j < mag; ++j)
+      frame_size |= ULONG(*p++) << (j * 8);
+
+    if (frame_size == 0)
+      return 0;
+
+    frame_sizes[i] = frame_size;
+    total += frame_size;
+  }
+
+  if (total > size - index_size)
+    return 0;
+
+  return frames;
+}
+
+bool VP9HeaderParser::Parse(const BYTE* data, ULONG size,
+                            VP9FrameHeader& hdr) {
+  memset(&hdr, 0, sizeof hdr);
+
+  BitReader br(data, size);
+
+  if (br.ReadLiteral(2) != 2)  // frame_marker
+    return false;
+
+  const int profile_low_bit = br.ReadBit();
+  const int profile_high_bit = br.ReadBit();
+  hdr.profile = (profile_high_bit << 1) | profile_low_bit;
+
+  if ((hdr.profile == 3) && br.ReadBit())  // reserved_zero
+    return false;
+
+  hdr.show_existing_frame = (br.ReadBit() != 0);
+
+  if (hdr.show_existing_frame) {
+    hdr.frame_to_show = br.ReadLiteral(3);
+    hdr.show_frame = true;
+    hdr.uncompressed_header_size = br.GetByteSize();
+
+    return !br.overrun && (m_ref_width[hdr.frame_to_show] > 0);
+  }
+
+  hdr.key_frame = (br.ReadBit() == 0);  // frame_type
+  hdr.show_frame = (br.ReadBit() != 0);
+  hdr.error_resilient_mode = (br.ReadBit() != 0);
+
+  if (hdr.key_frame) {
+    if ((br.ReadLiteral(8) != kSyncCode0) ||
+        (br.ReadLiteral(8) != kSyncCode1) ||
+        (br.ReadLiteral(8) != kSyncCode2)) {
+      return false;
+    }
+
+    if (!ParseColorConfig(br, hdr))
+      return false;
+
+    ParseFrameSize(br, hdr);
+    hdr.refresh_frame_flags = 0xFF;
+  } else {
+    if (!m_bKeyFrameSeen)
+      return false;
+
+    hdr.intra_only = hdr.show_frame ? false : (br.ReadBit() != 0);
+    hdr.reset_frame_context =
+        hdr.error_resilient_mode ? 0 : br.ReadLiteral(2);
+
+    if (hdr.intra_only) {
+      if ((br.ReadLiteral(8) != kSyncCode0) ||
+          (br.ReadLiteral(8) != kSyncCode1) ||
+          (br.ReadLiteral(8) != kSyncCode2)) {
+        return false;
+      }
+
+      if (hdr.profile > 0) {
+        if (!ParseColorConfig(br, hdr))
+          return false;
+      } else {
+        // Profile 0 intra-only frames don't repeat the color config.
+        hdr.bit_depth = 8;
+        hdr.subsampling_x = 1;
+        hdr.subsampling_y = 1;
+      }
+
+      hdr.refresh_frame_flags = br.ReadLiteral(8);
+      ParseFrameSize(br, hdr);
+    } else {
+      hdr.bit_depth = 8;  // profile 0 and 1 streams are 8 bit
+      hdr.subsampling_x = 1;
+      hdr.subsampling_y = 1;
+      hdr.refresh_frame_flags = br.ReadLiteral(8);
+
+      for (int i = 0; i < VP9FrameHeader::kRefsPerFrame; ++i) {
+        hdr.ref_frame_idx[i] = br.ReadLiteral(3);
+        hdr.ref_frame_sign_bias[i] = br.ReadBit();
+
+        if (m_ref_width[hdr.ref_frame_idx[i]] <= 0)
+          return false;
+      }
+
+      ParseFrameSizeWithRefs(br, hdr);
+      hdr.allow_high_precision_mv = (br.ReadBit() != 0);
+
+      if (br.ReadBit())  // is_filter_switchable
+        hdr.interp_filter = VP9FrameHeader::kSwitchable;
+      else
+        hdr.interp_filter = kLiteralToFilter[br.ReadLiteral(2)];
+    }
+  }
+
+  if (!hdr.error_resilient_mode) {
+    hdr.refresh_frame_context = (br.ReadBit() != 0);
+    hdr.frame_parallel_decoding_mode = (br.ReadBit() != 0);
+  } else {
+    hdr.refresh_frame_context = false;
+    hdr.frame_parallel_decoding_mode = true;
+  }
+
+  hdr.frame_context_idx = br.ReadLiteral(2);
+
+  if (hdr.key_frame || hdr.intra_only || hdr.error_resilient_mode)
+    SetupPastIndependence();
+
+  ParseLoopFilter(br, hdr);
+  ParseQuantization(br, hdr);
+  ParseSegmentation(br, hdr);
+  ParseTileInfo(br, hdr);
+
+  hdr.compressed_header_size = br.ReadLiteral(16);
+  hdr.uncompressed_header_size = br.GetByteSize();
+
+  if (br.overrun || (hdr.compressed_header_size == 0))
+    return false;
+
+  if (hdr.uncompressed_header_size + hdr.compressed_header_size > size)
+    return false;
+
+  // As libvpx: the previous frame's motion vectors can be used only if it
+  // was shown, is the same size, and they don't depend on a lost context.
+  hdr.use_prev_frame_mvs = !hdr.error_resilient_mode &&
+                           (hdr.width == m_last_width) &&
+                           (hdr.height == m_last_height) &&
+                           !m_last_intra_only && m_last_show_frame;
+
+  // The frame is good: commit the state that later frames depend on.
+  if (hdr.key_frame)
+    m_bKeyFrameSeen = true;
+
+  for (int i = 0; i < VP9FrameHeader::kRefFrames; ++i) {
+    if (hdr.refresh_frame_flags & (1 << i)) {
+      m_ref_width[i] = hdr.width;
+      m_ref_height[i] = hdr.height;
+    }
+  }
+
+  m_last_width = hdr.width;
+  m_last_height = hdr.height;
+  m_last_show_frame = hdr.show_frame;
+  m_last_intra_only = hdr.intra_only;
+
+  return true;
+}
+
+bool VP9HeaderParser::ParseColorConfig(BitReader& br, VP9FrameHeader& hdr) {
+  hdr.bit_depth = 8;
+
+  if (hdr.profile >= 2)
+    hdr.bit_depth = br.ReadBit() ? 12 : 10;
+
+  const int color_space = br.ReadLiteral(3);
+
+  if (color_space != kColorSpaceRgb) {
+    br.ReadBit();  // color_range
+
+    if ((hdr.profile == 1) || (hdr.profile == 3)) {
+      hdr.subsampling_x = br.ReadBit();
+      hdr.subsampling_y = br.ReadBit();
+
+      if (br.ReadBit())  // reserved_zero
+        return false;
+    } else {
+      hdr.subsampling_x = 1;
+      hdr.subsampling_y = 1;
+    }
+  } else {
+    // RGB is 4:4:4, which profile 0 and 2 don't have.
+    if ((hdr.profile != 1) && (hdr.profile != 3))
+      return false;
+
+    hdr.subsampling_x = 0;
+    hdr.subsampling_y = 0;
+
+    if (br.ReadBit())  // reserved_zero
+      return false;
+  }
+
+  return true;
+}
+
+void VP9HeaderParser::ParseFrameSize(BitReader& br, VP9FrameHeader& hdr) {
+  hdr.width = br.ReadLiteral(16) + 1;
+  hdr.height = br.ReadLiteral(16) + 1;
+
+  if (br.ReadBit()) {  // render_and_frame_size_different
+    br.ReadLiteral(16);  // render_width_minus_1
+    br.ReadLiteral(16);  // render_height_minus_1
+  }
+}
+
+void VP9HeaderParser::ParseFrameSizeWithRefs(BitReader& br,
+                                             VP9FrameHeader& hdr) {
+  for (int i = 0; i < VP9FrameHeader::kRefsPerFrame; ++i) {
+    if (br.ReadBit()) {  // found_ref
+      const int idx = hdr.ref_frame_idx[i];
+      hdr.width = m_ref_width[idx];
+      hdr.height = m_ref_height[idx];
+
+      if (br.ReadBit()) {  // render_and_frame_size_different
+        br.ReadLiteral(16);
+        br.ReadLiteral(16);
+      }
+
+      return;
+    }
+  }
+
+  ParseFrameSize(br, hdr);
+}
+
+void VP9HeaderParser::ParseLoopFilter(BitReader& br, VP9FrameHeader& hdr) {
+  hdr.filter_level = br.ReadLiteral(6);
+  hdr.sharpness_level = br.ReadLiteral(3);
+  hdr.mode_ref_delta_enabled = (br.ReadBit() != 0);
+  hdr.mode_ref_delta_update = false;
+
+  if (hdr.mode_ref_delta_enabled) {
+    hdr.mode_ref_delta_update = (br.ReadBit() != 0);
+
+    if (hdr.mode_ref_delta_update) {
+      for (int i = 0; i < 4; ++i) {
+        if (br.ReadBit())
+          m_ref_deltas[i] = br.ReadSignedLiteral(6);
+      }
+
+      for (int i = 0; i < 2; ++i) {
+        if (br.ReadBit())
+          m_mode_deltas[i] = br.ReadSignedLiteral(6);
+      }
+    }
+  }
+
+  memcpy(hdr.ref_deltas, m_ref_deltas, sizeof hdr.ref_deltas);
+  memcpy(hdr.mode_deltas, m_mode_deltas, sizeof hdr.mode_deltas);
+}
+
+void VP9HeaderParser::ParseQuantization(BitReader& br, VP9FrameHeader& hdr) {
+  hdr.base_qindex = br.ReadLiteral(8);
+  hdr.y_dc_delta_q = br.ReadBit() ? br.ReadSignedLiteral(4) : 0;
+  hdr.uv_dc_delta_q = br.ReadBit() ? br.ReadSignedLiteral(4) : 0;
+  hdr.uv_ac_delta_q = br.ReadBit() ? br.ReadSignedLiteral(4) : 0;
+}
+
+void VP9HeaderParser::ParseSegmentation(BitReader& br, VP9FrameHeader& hdr) {
+  m_seg.update_map = false;
+  m_seg.update_data = false;
+  m_seg.enabled = (br.ReadBit() != 0);
+
+  if (m_seg.enabled) {
+    m_seg.update_map = (br.ReadBit() != 0);
+
+    if (m_seg.update_map) {
+      for (int i = 0; i < 7; ++i)
+        m_seg.tree_probs[i] = br.ReadBit() ? BYTE(br.ReadLiteral(8)) : kMaxProb;
+
+      m_seg.temporal_update = (br.ReadBit() != 0);
+
+      for (int i = 0; i < 3; ++i) {
+        if (m_seg.temporal_update && br.ReadBit())
+          m_seg.pred_probs[i] = BYTE(br.ReadLiteral(8));
+        else
+          m_seg.pred_probs[i] = kMaxProb;
+      }
+    }
+
+    m_seg.update_data = (br.ReadBit() != 0);
+
+    if (m_seg.update_data) {
+      m_seg.abs_delta = (br.ReadBit() != 0);
+
+      for (int i = 0; i < VP9FrameHeader::kSegments; ++i) {
+        for (int j = 0; j < VP9FrameHeader::kSegFeatures; ++j) {
+          int data = 0;
+          const bool enabled = (br.ReadBit() != 0);
+
+          if (enabled) {
+            data = br.ReadLiteral(kSegFeatureBits[j]);
+
+            if (kSegFeatureSigned[j] && br.ReadBit())
+              data = -data;
+          }
+
+          m_seg.feature_enabled[i][j] = enabled;
+          m_seg.feature_data[i][j] = data;
+        }
+      }
+    }
+  }
+
+  hdr.seg = m_seg;
+}
+
+void VP9HeaderParser::ParseTileInfo(BitReader& br, VP9FrameHeader& hdr) {
+  const int mi_cols = (hdr.width + 7) >> 3;
+  const int sb64_cols = (mi_cols + 7) >> 3;
+
+  int min_log2 = 0;
+
+  while ((kMaxTileWidthB64 << min_log2) < sb64_cols)
+    ++min_log2;
+
+  int max_log2 = 1;
+
+  while ((sb64_cols >> max_log2) >= kMinTileWidthB64)
+    ++max_log2;
+
+  --max_log2;
+
+  hdr.log2_tile_cols = min_log2;
+
+  while ((hdr.log2_tile_cols < max_log2) && br.ReadBit())
+    ++hdr.log2_tile_cols;
+
+  hdr.log2_tile_rows = br.ReadBit();
+
+  if (hdr.log2_tile_rows)
+    hdr.log2_tile_rows += br.ReadBit();
+}
+
+}  // namespace VP9DecoderLib
@@ -0,0 +1,142 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+#ifndef WEBMDSHOW_VP9DECODER_VP9HEADERPARSER_HPP_
+#define WEBMDSHOW_VP9DECODER_VP9HEADERPARSER_HPP_
+
+#include <windows.h>
+
+namespace VP9DecoderLib {
+
+// The fields of a VP9 frame's uncompressed header that a hardware decoder
+// needs (see the VP9 bitstream specification, section 6.2), with the
+// loop filter deltas and segmentation features carried over from earlier
+// frames where this one doesn't update them.
+struct VP9FrameHeader {
+  enum { kRefFrames = 8, kRefsPerFrame = 3, kSegments = 8, kSegFeatures = 4 };
+
+  // libvpx's INTERP_FILTER values, which DXVA uses too.
+  enum InterpFilter {
+    kEightTap = 0,
+    kEightTapSmooth = 1,
+    kEightTapSharp = 2,
+    kBilinear = 3,
+    kSwitchable = 4
+  };
+
+  int profile;
+  bool show_existing_frame;
+  int frame_to_show;  // a reference slot, when |show_existing_frame|
+
+  bool key_frame;
+  bool show_frame;
+  bool error_resilient_mode;
+  bool intra_only;
+  int reset_frame_context;
+  int bit_depth;
+  int subsampling_x;
+  int subsampling_y;
+  int width;
+  int height;
+  int refresh_frame_flags;
+  int ref_frame_idx[kRefsPerFrame];  // LAST, GOLDEN, ALTREF
+  int ref_frame_sign_bias[kRefsPerFrame];
+  bool allow_high_precision_mv;
+  int interp_filter;
+  bool refresh_frame_context;
+  bool frame_parallel_decoding_mode;
+  int frame_context_idx;
+  bool use_prev_frame_mvs;
+
+  int filter_level;
+  int sharpness_level;
+  bool mode_ref_delta_enabled;
+  bool mode_ref_delta_update;
+  int ref_deltas[4];
+  int mode_deltas[2];
+
+  int base_qindex;
+  int y_dc_delta_q;
+  int uv_dc_delta_q;
+  int uv_ac_delta_q;
+
+  struct Segmentation {
+    bool enabled;
+    bool update_map;
+    bool temporal_update;
+    bool update_data;
+    bool abs_delta;
+    BYTE tree_probs[7];
+    BYTE pred_probs[3];
+    bool feature_enabled[kSegments][kSegFeatures];
+    int feature_data[kSegments][kSegFeatures];
+  } seg;
+
+  int log2_tile_cols;
+  int log2_tile_rows;
+
+  ULONG uncompressed_header_size;  // in bytes, after byte alignment
+  ULONG compressed_header_size;
+};
+
+// Parses the frame headers of a VP9 stream, one frame at a time and in
+// decode order: each header depends on the state left by the ones before
+// it (the sizes of the reference frames, and the deltas and features that
+// persist from frame to frame).
+class VP9HeaderParser {
+ public:
+  enum { kMaxSuperframeFrames = 8 };
+
+  VP9HeaderParser();
+
+  // Forgets the stream: the next frame must be a key frame.
+  void Reset();
+
+  // Splits a sample into the frames of its superframe index, if it has
+  // one. Returns the number of frames (1 for a sample that has no index),
+  // or 0 if the index is malformed.
+  static int ParseSuperframeIndex(const BYTE* data, ULONG size,
+                                  ULONG (&frame_sizes)[kMaxSuperframeFrames]);
+
+  // Parses the frame at |data|. Returns false if the header is malformed,
+  // or refers to a reference frame the parser hasn't seen.
+  bool Parse(const BYTE* data, ULONG size, VP9FrameHeader& hdr);
+
+ private:
+  class BitReader;
+
+  bool ParseColorConfig(BitReader&, VP9FrameHeader&);
+  void ParseFrameSize(BitReader&, VP9FrameHeader&);
+  void ParseFrameSizeWithRefs(BitReader&, VP9FrameHeader&);
+  void ParseLoopFilter(BitReader&, VP9FrameHeader&);
+  void ParseQuantization(BitReader&, VP9FrameHeader&);
+  void ParseSegmentation(BitReader&, VP9FrameHeader&);
+  void ParseTileInfo(BitReader&, VP9FrameHeader&);
+  void SetupPastIndependence();
+
+  VP9HeaderParser(const VP9HeaderParser&);
+  VP9HeaderParser& operator=(const VP9HeaderParser&);
+
+  bool m_bKeyFrameSeen;
+  int m_ref_width[VP9FrameHeader::kRefFrames];
+  int m_ref_height[VP9FrameHeader::kRefFrames];
+
+  // Carried from one frame to the next.
+  int m_ref_deltas[4];
+  int m_mode_deltas[2];
+  VP9FrameHeader::Segmentation m_seg;
+
+  // Of the last frame decoded, for |use_prev_frame_mvs|.
+  int m_last_width;
+  int m_last_height;
+  bool m_last_show_frame;
+  bool m_last_intra_only;
+};
+
+}  // namespace VP9DecoderLib
+
+#endif  // WEBMDSHOW_VP9DECODER_VP9HEADERPARSER_HPP_
@@ -222,7 +222,7 @@ STDAPI DllRegisterServer() {
 
   REGFILTERPINS& outpin = pins[1];
 
-  enum { nOutpinMediaTypes = 7 };
+  enum { nOutpinMediaTypes = 8 };
   const REGPINTYPES outpinMediaTypes[nOutpinMediaTypes] = {
       {&MEDIATYPE_Video, &MEDIASUBTYPE_NV12},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YV12},
@@ -230,7 +230,8 @@ STDAPI DllRegisterServer() {
       {&MEDIATYPE_Video, &MEDIASUBTYPE_UYVY},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YUY2},
       {&MEDIATYPE_Video, &MEDIASUBTYPE_YUYV},
-      {&MEDIATYPE_Video, &MEDIASUBTYPE_YVYU}};
+      {&MEDIATYPE_Video, &MEDIASUBTYPE_YVYU},
+      {&MEDIATYPE_Video, &WebmTypes::MEDIASUBTYPE_Y800}};
 
   outpin.strName = 0;
   outpin.bRendered = FALSE;
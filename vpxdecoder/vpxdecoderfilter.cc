@@ -82,6 +82,10 @@ HRESULT Filter::CNondelegating::QueryInterface(const IID& iid, void** ppv) {
     pUnk = static_cast<IBaseFilter*>(m_pFilter);
   } else if (iid == __uuidof(IVP8PostProcessing)) {
     pUnk = static_cast<IVP8PostProcessing*>(m_pFilter);
+  } else if (iid == __uuidof(IVPXDecoderSettings)) {
+    pUnk = static_cast<IVPXDecoderSettings*>(m_pFilter);
+  } else if (iid == __uuidof(IPipelineCounters)) {
+    pUnk = static_cast<IPipelineCounters*>(m_pFilter);
   } else {
 #if _DEBUG
     wodbgstream os;
@@ -126,7 +130,8 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_clock(0),
       m_state(kStateStopped),
       m_inpin(this),
-      m_outpin(this) {
+      m_outpin(this),
+      m_counters(L"vpxdec") {
   m_pClassFactory->LockServer(TRUE);
 
   const HRESULT hr = CLockable::Init();
@@ -140,6 +145,7 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
   m_cfg.flags = 0;
   m_cfg.deblock = 0;
   m_cfg.noise = 0;
+  m_cfg.threads = 0;  // auto
 
 #ifdef _DEBUG
   odbgstream os;
@@ -567,6 +573,63 @@ HRESULT Filter::ApplyPostProcessing() {
   return m_inpin.OnApplyPostProcessing();
 }
 
+HRESULT Filter::SetThreadCount(int count) {
+  if (count < 0)
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  m_cfg.threads = count;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetThreadCount(int* pCount) {
+  if (pCount == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *pCount = m_cfg.threads;
+
+  return S_OK;
+}
+
+HRESULT Filter::GetStageCount(ULONG* pCount) {
+  if (pCount == 0)
+    return E_POINTER;
+
+  *pCount = 1;
+  return S_OK;
+}
+
+HRESULT Filter::GetStage(ULONG index, Stats* pStats) {
+  if (pStats == 0)
+    return E_POINTER;
+
+  if (index != 0)
+    return E_INVALIDARG;
+
+  // The counters are read without the filter lock.
+  m_counters.GetStats(pStats);
+  return S_OK;
+}
+
+HRESULT Filter::ResetStages() {
+  m_counters.Reset();
+  return S_OK;
+}
+
 void Filter::OnStart() {
   HRESULT hr = m_inpin.Start();
   assert(SUCCEEDED(hr));  // TODO
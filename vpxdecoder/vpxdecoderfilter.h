@@ -13,18 +13,25 @@
 #include <string>
 
 #include "clockable.h"
+#include "ipipelinecounters.h"
+#include "pipelinecounters.h"
 #include "vpxdecoderidl.h"
 #include "vpxdecoderinpin.h"
 #include "vpxdecoderoutpin.h"
 
 namespace VPXDecoderLib {
 
-class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
+class Filter : public IBaseFilter,
+               public IVP8PostProcessing,
+               public IVPXDecoderSettings,
+               public IPipelineCounters,
+               public CLockable {
  public:
   struct Config {
     int flags;
     int deblock;
     int noise;
+    int threads;
   };
 
   // IUnknown
@@ -55,6 +62,15 @@ class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
   HRESULT STDMETHODCALLTYPE GetNoiseLevel(int*);
   HRESULT STDMETHODCALLTYPE ApplyPostProcessing();
 
+  // IVPXDecoderSettings
+  HRESULT STDMETHODCALLTYPE SetThreadCount(int);
+  HRESULT STDMETHODCALLTYPE GetThreadCount(int*);
+
+  // IPipelineCounters
+  HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*);
+  HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*);
+  HRESULT STDMETHODCALLTYPE ResetStages();
+
   // local classes and methods
   FILTER_STATE GetStateLocked() const;
   HRESULT OnDecodeFailureLocked();
@@ -66,6 +82,10 @@ class Filter : public IBaseFilter, public IVP8PostProcessing, public CLockable {
   Outpin m_outpin;
   Config m_cfg;
 
+  // Compressed samples in, decoded frames out; the processing time is
+  // that of decoding and converting one frame.
+  webmdshow::PipelineCounters m_counters;
+
  private:
   class CNondelegating : public IUnknown {
    public:
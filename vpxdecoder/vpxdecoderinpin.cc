@@ -20,15 +20,20 @@
 #include <uuids.h>
 #include <vfwmsgs.h>
 
+#include <algorithm>
 #include <cassert>
 
 #include "libyuv_util.h"
 #include "vpx/vp8dx.h"
 
+#include "cpuutil.h"
 #include "graphutil.h"
 #include "mediatypeutil.h"
+#include "videomediatype.h"
 #include "vpxdecoderfilter.h"
 #include "vpxdecoderoutpin.h"
+#include "vpxsamplecopy.h"
+#include "webmtrace.h"
 #include "webmtypes.h"
 
 #ifdef _DEBUG
@@ -54,6 +59,7 @@ Inpin::Inpin(Filter* p)
     : Pin(p, PINDIR_INPUT, L"input"),
       m_bEndOfStream(false),
       m_bFlush(false),
+      m_generation(0),
       scaled_frame(NULL) {
   AM_MEDIA_TYPE mt;
 
@@ -70,6 +76,12 @@ Inpin::Inpin(Filter* p)
   m_preferred_mtv.Add(mt);
 }
 
+Inpin::DecoderLock::DecoderLock() {
+  const HRESULT hr = CLockable::Init();
+  hr;
+  assert(SUCCEEDED(hr));
+}
+
 HRESULT Inpin::QueryInterface(const IID& iid, void** ppv) {
   if (ppv == 0)
     return E_POINTER;
@@ -241,6 +253,7 @@ HRESULT Inpin::BeginFlush() {
 #endif
 
   m_bFlush = true;
+  ++m_generation;
 
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
@@ -454,17 +467,65 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   const long len = pInSample->GetActualDataLength();
   assert(len >= 0);
 
+  webmdshow::PipelineCounters& counters = m_pFilter->m_counters;
+  counters.OnSampleIn(len);
+
+  // Processing time leaves out the wait for an output buffer, which is
+  // the downstream filter's.
+  const int64_t decode_start = webmdshow::PipelineCounters::Now();
+
+  webmdshow::TraceSample(webmdshow::kTraceFrameDecodeBegin, 0, pInSample);
+
+  // Decode without the filter lock (see DecoderLock). The state is
+  // checked again once we have it back.
+  const unsigned int generation = m_generation;
+
+  lock.Release();
+
+  CLockable::Lock decoder_lock;
+
+  hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
   const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, buf, len, 0, 0);
 
-  if (err != VPX_CODEC_OK)
+  decoder_lock.Release();
+
+  const int64_t decode_time =
+      webmdshow::PipelineCounters::Now() - decode_start;
+
+  webmdshow::TraceSample(webmdshow::kTraceFrameDecodeEnd, 0, pInSample);
+
+  hr = lock.Seize(m_pFilter);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_pFilter->GetStateLocked() == State_Stopped)
+    return VFW_E_NOT_RUNNING;
+
+  if (m_bFlush || (m_generation != generation)) {
+    counters.OnDrop();
+    counters.AddProcessingTime(decode_time);
+    return S_FALSE;
+  }
+
+  if (err != VPX_CODEC_OK) {
+    counters.OnDrop();
+    counters.AddProcessingTime(decode_time);
     return m_pFilter->OnDecodeFailureLocked();
+  }
 
   hr = pInSample->IsSyncPoint();
 
   m_pFilter->OnDecodeSuccessLocked(hr == S_OK);
 
-  if (pInSample->IsPreroll() == S_OK)
+  if (pInSample->IsPreroll() == S_OK) {
+    counters.AddProcessingTime(decode_time);
     return S_OK;
+  }
 
   lock.Release();
 
@@ -472,8 +533,11 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
 
   hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
 
-  if (FAILED(hr))
+  if (FAILED(hr)) {
+    counters.OnDrop();
+    counters.AddProcessingTime(decode_time);
     return S_FALSE;
+  }
 
   assert(bool(pOutSample));
 
@@ -491,17 +555,27 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   if (!bool(outpin.m_pInputPin))  // should never happen
     return S_FALSE;
 
+  const int64_t convert_start = webmdshow::PipelineCounters::Now();
+
   vpx_codec_iter_t iter = 0;
 
   const vpx_image_t* frame = vpx_codec_get_frame(&m_ctx, &iter);
 
-  if (frame == NULL)
+  if (frame == NULL) {
+    counters.AddProcessingTime(decode_time);
     return S_OK;
+  }
 
   AM_MEDIA_TYPE* pmt;
 
   hr = pOutSample->GetMediaType(&pmt);
 
+  if (SUCCEEDED(hr) && (pmt != 0) &&
+      MediaTypeUtil::Equal(*pmt, outpin.m_connection_mtv[0])) {
+    MediaTypeUtil::Free(pmt);  // downstream restated the type we have
+    pmt = 0;
+  }
+
   if (SUCCEEDED(hr) && (pmt != 0)) {
     hr = outpin.QueryAccept(pmt);
 
@@ -522,59 +596,27 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   const BITMAPINFOHEADER* bmih_ptr;
   const RECT* rc_ptr;
 
-  if (mt.formattype == FORMAT_VideoInfo) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
-    assert(mt.pbFormat);
-
-    const VIDEOINFOHEADER& vih_out = (VIDEOINFOHEADER&)(*mt.pbFormat);
-    const RECT& rc_out = vih_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih_out.bmiHeader;
-
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else if (mt.formattype == FORMAT_VideoInfo2) {
-    assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER2));
-    assert(mt.pbFormat);
-
-    const VIDEOINFOHEADER2& vih2_out = (VIDEOINFOHEADER2&)(*mt.pbFormat);
-    const RECT& rc_out = vih2_out.rcSource;
-    const BITMAPINFOHEADER& bmih_out = vih2_out.bmiHeader;
-
-    bmih_ptr = &bmih_out;
-    rc_ptr = &rc_out;
-  } else {
+  if (!webmdshow::GetVideoBitmap(mt, &bmih_ptr, &rc_ptr))
     return E_FAIL;
-  }
 
-  // Scale (if necessary).
+  // Scale and color convert (if necessary). Scaling writes the sample
+  // itself, so that planar output is scaled straight into it. Y800 is
+  // scaled as it is copied, luma only.
   const uint32_t out_width = bmih_ptr->biWidth;
   const uint32_t out_height = std::abs(bmih_ptr->biHeight);
-  if (frame->d_h != out_height || frame->d_w != out_width) {
-    if (!webmdshow::LibyuvScaleI420(out_width, out_height,
-                                    frame, &scaled_frame)) {
-      assert(false && "webmdshow::LibyuvScale failed.");
-      return E_FAIL;
-    }
-    frame = scaled_frame;
-  }
-
-  // Color convert (if necessary).
-  if (mt.subtype == MEDIASUBTYPE_NV12)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YV12)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_UYVY)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YUY2)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YUYV)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YVYU)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else
-    return E_FAIL;
+  if ((frame->d_h != out_height || frame->d_w != out_width) &&
+      (mt.subtype != WebmTypes::MEDIASUBTYPE_Y800)) {
+    hr = ScaleToSample(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    if (FAILED(hr))
+      return hr;
+  } else {
+    hr = webmdshow::CopyVpxImageToSample(frame, mt, pOutSample);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  // Carries the input's time, which the output does not have yet.
+  webmdshow::TraceSample(webmdshow::kTraceFrameCopy, 0, pInSample);
 
   __int64 st, sp;
 
@@ -611,6 +653,10 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
     os << "V: " << fixed << setprecision(3) << (double(st)/10000000.0) << endl;
 #endif
 
+  counters.AddProcessingTime(decode_time + webmdshow::PipelineCounters::Now() -
+                             convert_start);
+  counters.OnSampleOut(pOutSample->GetActualDataLength());
+
   lock.Release();
 
   return outpin.m_pInputPin->Receive(pOutSample);
@@ -646,16 +692,32 @@ HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
   return S_OK;
 }
 
-void Inpin::CopyToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  // Y
-
-  const BYTE* pInY = f->planes[VPX_PLANE_Y];
-  assert(pInY);
+HRESULT Inpin::ScaleToSample(const vpx_image_t* f, IMediaSample* pOutSample,
+                             const GUID& subtype_out, const RECT& rc_out,
+                             const BITMAPINFOHEADER& bmih_out) {
+  const int width_out = bmih_out.biWidth;
+  const int height_out = labs(bmih_out.biHeight);
+
+  const bool packed = (subtype_out != MEDIASUBTYPE_NV12) &&
+                      (subtype_out != MEDIASUBTYPE_YV12) &&
+                      (subtype_out != WebmTypes::MEDIASUBTYPE_I420);
+
+  scaler.set_filter(webmdshow::GetPlaybackScaleFilter(f->d_w, f->d_h,
+                                                      width_out,
+                                                      height_out));
+
+  if (packed) {
+    // libyuv has no scaler that writes packed 4:2:2, so scale into the
+    // frame kept for the connection and convert from that.
+    if (!scaler.Scale(width_out, height_out, f, &scaled_frame)) {
+      assert(false && "webmdshow::LibyuvScaler::Scale failed.");
+      return E_FAIL;
+    }
 
-  unsigned int width_in = f->d_w;
-  unsigned int height_in = f->d_h;
+    webmdshow::CopyVpxImageToPacked(scaled_frame, pOutSample, subtype_out,
+                                     rc_out, bmih_out);
+    return S_OK;
+  }
 
   BYTE* pOutBuf;
 
@@ -663,244 +725,88 @@ void Inpin::CopyToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
   assert(SUCCEEDED(hr));
   assert(pOutBuf);
 
-  BYTE* pOut = pOutBuf;
-
-  const int strideInY = f->stride[VPX_PLANE_Y];
-
-  LONG strideOut = bmih_out.biWidth;
+  const LONG strideOut = bmih_out.biWidth;
   assert(strideOut);
   assert((strideOut % 2) == 0);
 
-  for (unsigned int y = 0; y < height_in; ++y) {
-    memcpy(pOut, pInY, width_in);
-    pInY += strideInY;
-    pOut += strideOut;
-  }
-
-  width_in = (width_in + 1) / 2;
-  height_in = (height_in + 1) / 2;
+  const LONG strideOutUV = strideOut / 2;
+  const int height_uv = (height_out + 1) / 2;
 
-  const BYTE* pInV = f->planes[VPX_PLANE_V];
-  assert(pInV);
+  BYTE* const pOutY = pOutBuf;
+  BYTE* const pOutChroma = pOutY + strideOut * height_out;
 
-  const int strideInV = f->stride[VPX_PLANE_V];
+  const long lenOut = strideOut * (height_out + height_uv);
 
-  const BYTE* pInU = f->planes[VPX_PLANE_U];
-  assert(pInU);
+  if (subtype_out != MEDIASUBTYPE_NV12) {
+    BYTE* pOutU = pOutChroma;
+    BYTE* pOutV = pOutChroma + strideOutUV * height_uv;
 
-  const int strideInU = f->stride[VPX_PLANE_U];
+    if (subtype_out == MEDIASUBTYPE_YV12)
+      std::swap(pOutU, pOutV);
 
-  if (subtype_out == MEDIASUBTYPE_NV12) {
-    // Note that while NV12 is considered a planar format,
-    // the chroma plane packs the UV samples.
-
-    // UV
-
-    for (unsigned int y = 0; y < height_in; ++y) {
-      const BYTE* u = pInU;
-      const BYTE* v = pInV;
-      BYTE* uv = pOut;
-
-      for (unsigned int idx = 0; idx < width_in; ++idx) {
-        *uv++ = *u++;
-        *uv++ = *v++;
-      }
-
-      pInU += strideInU;
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-  } else if (subtype_out == MEDIASUBTYPE_YV12) {
-    strideOut /= 2;
-
-    // V
-
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
-
-    // U
-
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
-    }
-  } else {
-    assert(subtype_out == WebmTypes::MEDIASUBTYPE_I420);
-    strideOut /= 2;
-
-    // U
-
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInU, width_in);
-      pInU += strideInU;
-      pOut += strideOut;
+    if (!scaler.ScaleToPlanes(f, pOutY, strideOut,
+                              pOutU, strideOutUV,
+                              pOutV, strideOutUV,
+                              width_out, height_out)) {
+      assert(false && "webmdshow::LibyuvScaler::ScaleToPlanes failed.");
+      return E_FAIL;
     }
 
-    // V
+    hr = pOutSample->SetActualDataLength(lenOut);
+    assert(SUCCEEDED(hr));
 
-    for (unsigned int y = 0; y < height_in; ++y) {
-      memcpy(pOut, pInV, width_in);
-      pInV += strideInV;
-      pOut += strideOut;
-    }
+    return S_OK;
   }
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
-
-  hr = pOutSample->SetActualDataLength(lenOut);
-  assert(SUCCEEDED(hr));
-}
-
-void Inpin::CopyToPacked(const vpx_image_t* f, IMediaSample* pOutSample,
-                         const GUID& subtype_out, const RECT& rc_out,
-                         const BITMAPINFOHEADER& bmih_out) {
-  const LONG rect_width_out = rc_out.right - rc_out.left;
-  assert(rect_width_out >= 0);
-
-  const LONG width_out =
-      (rect_width_out > 0) ? rect_width_out : bmih_out.biWidth;
-  assert(width_out > 0);
-
-  const LONG rect_height_out = rc_out.bottom - rc_out.top;
-  assert(rect_height_out >= 0);
-
-  const LONG height_out =
-      (rect_height_out > 0) ? rect_height_out : labs(bmih_out.biHeight);
-
-  const BYTE* pInY_base = f->planes[VPX_PLANE_Y];
-  assert(pInY_base);
-
-  const int strideInY = f->stride[VPX_PLANE_Y];
-
-  const BYTE* pInV_base = f->planes[VPX_PLANE_V];
-  assert(pInV_base);
-
-  const int strideInV = f->stride[VPX_PLANE_V];
-
-  const BYTE* pInU_base = f->planes[VPX_PLANE_U];
-  assert(pInU_base);
-
-  const int strideInU = f->stride[VPX_PLANE_U];
-
-  const unsigned int width_in = f->d_w;
-  assert(LONG(width_in) == width_out);
-
-  const unsigned int height_in = f->d_h;
-  assert(LONG(height_in) == height_out);
-
-  BYTE* pOutBuf;
-
-  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
-  assert(SUCCEEDED(hr));
-  assert(pOutBuf);
-
-  const LONG strideOut_ = 2 * width_in;
-  LONG strideOut;
-
-  if (bmih_out.biWidth < strideOut_)
-    strideOut = strideOut_;
-  else
-    strideOut = bmih_out.biWidth;
-
-  const LONG uv_width = width_in / 2;
-  const LONG uv_height = height_in / 2;
-
-  int u_off, v_off, y_off;
-
-  if (subtype_out == MEDIASUBTYPE_UYVY) {
-    u_off = 0;
-    v_off = 2;
-    y_off = 1;
-  } else if ((subtype_out == MEDIASUBTYPE_YUY2) ||
-             (subtype_out == MEDIASUBTYPE_YUYV)) {
-    u_off = 1;
-    v_off = 3;
-    y_off = 0;
-  } else {
-    assert(subtype_out == MEDIASUBTYPE_YVYU);
-
-    u_off = 3;
-    v_off = 1;
-    y_off = 0;
+  // NV12: the Y plane, which is most of the frame, is scaled straight into
+  // the sample. U and V are scaled into the chroma planes of the frame kept
+  // for the connection, and interleaved into the sample from there.
+  if (scaled_frame != NULL && (scaled_frame->d_w != UINT(width_out) ||
+                               scaled_frame->d_h != UINT(height_out))) {
+    vpx_img_free(scaled_frame);
+    scaled_frame = NULL;
   }
 
-  BYTE* pOut = pOutBuf;
-
-  for (LONG hdx = 0; hdx < uv_height; ++hdx) {
-    BYTE* const pOut0 = pOut;
-    pOut += strideOut;
-
-    BYTE* const pOut1 = pOut;
-    pOut += strideOut;
-
-    BYTE* pOutU0 = pOut0 + u_off;
-    BYTE* pOutU1 = pOut1 + u_off;
-
-    BYTE* pOutV0 = pOut0 + v_off;
-    BYTE* pOutV1 = pOut1 + v_off;
-
-    BYTE* pOutY0 = pOut0 + y_off;
-    BYTE* pOutY1 = pOut1 + y_off;
-
-    const BYTE* pInU = pInU_base;
-    pInU_base += strideInU;
-
-    const BYTE* pInV = pInV_base;
-    pInV_base += strideInV;
-
-    const BYTE* pInY0 = pInY_base;
-    pInY_base += strideInY;
-
-    const BYTE* pInY1 = pInY_base;
-    pInY_base += strideInY;
-
-    for (LONG wdx = 0; wdx < uv_width; ++wdx) {
-      *pOutU0 = *pInU;
-      *pOutU1 = *pInU;
-
-      pOutU0 += 4;
-      pOutU1 += 4;
-
-      ++pInU;
+  if (scaled_frame == NULL) {
+    scaled_frame =
+        vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width_out, height_out, 16);
 
-      *pOutV0 = *pInV;
-      *pOutV1 = *pInV;
-
-      pOutV0 += 4;
-      pOutV1 += 4;
-
-      ++pInV;
+    if (scaled_frame == NULL)
+      return E_OUTOFMEMORY;
+  }
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+  const BYTE* const pU = scaled_frame->planes[VPX_PLANE_U];
+  const int strideU = scaled_frame->stride[VPX_PLANE_U];
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+  const BYTE* const pV = scaled_frame->planes[VPX_PLANE_V];
+  const int strideV = scaled_frame->stride[VPX_PLANE_V];
 
-      ++pInY0;
-      ++pInY1;
+  if (!scaler.ScaleToPlanes(
+          f, pOutY, strideOut,
+          scaled_frame->planes[VPX_PLANE_U], strideU,
+          scaled_frame->planes[VPX_PLANE_V], strideV,
+          width_out, height_out)) {
+    assert(false && "webmdshow::LibyuvScaler::ScaleToPlanes failed.");
+    return E_FAIL;
+  }
 
-      *pOutY0 = *pInY0;
-      *pOutY1 = *pInY1;
+  const int width_uv = (width_out + 1) / 2;
 
-      pOutY0 += 2;
-      pOutY1 += 2;
+  for (int y = 0; y < height_uv; ++y) {
+    const BYTE* const u = pU + y * strideU;
+    const BYTE* const v = pV + y * strideV;
+    BYTE* const uv = pOutChroma + y * strideOut;
 
-      ++pInY0;
-      ++pInY1;
+    for (int x = 0; x < width_uv; ++x) {
+      uv[2 * x] = u[x];
+      uv[2 * x + 1] = v[x];
     }
   }
 
-  const ptrdiff_t lenOut_ = pOut - pOutBuf;
-  const long lenOut = static_cast<long>(lenOut_);
-
   hr = pOutSample->SetActualDataLength(lenOut);
   assert(SUCCEEDED(hr));
+
+  return S_OK;
 }
 
 HRESULT Inpin::ReceiveCanBlock() {
@@ -920,6 +826,12 @@ HRESULT Inpin::ReceiveCanBlock() {
 }
 
 HRESULT Inpin::OnDisconnect() {
+  // The scaled frame is sized for the connection.
+  if (scaled_frame != NULL) {
+    vpx_img_free(scaled_frame);
+    scaled_frame = NULL;
+  }
+
   return m_pFilter->m_outpin.OnInpinDisconnect();
 }
 
@@ -954,7 +866,26 @@ HRESULT Inpin::Start() {
     return E_FAIL;
   }
 
-  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, vpx, 0, flags);
+  const bool is_vp9 = (vpx == &vpx_codec_vp9_dx_algo);
+
+  webmdshow::VpxDecoderPool::Key& key = m_decoder_key;
+
+  key.iface = vpx;
+  key.flags = flags;
+  key.threads = webmdshow::GetVpxDecoderThreadCount(m_pFilter->m_cfg.threads,
+                                                    is_vp9, GetFrameWidth());
+  key.width = GetFrameWidth();
+  key.height = GetFrameHeight();
+
+  CLockable::Lock decoder_lock;
+
+  HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
+  webmdshow::VpxDecoderPool& pool = webmdshow::VpxDecoderPool::Get();
+  const vpx_codec_err_t err = pool.Borrow(key, &m_ctx);
   if (err == VPX_CODEC_MEM_ERROR)
     return E_OUTOFMEMORY;
 
@@ -962,7 +893,7 @@ HRESULT Inpin::Start() {
     return E_FAIL;
 
   if (m_connection_mtv[0].subtype == WebmTypes::MEDIASUBTYPE_VP80) {
-    const HRESULT hr = OnApplyPostProcessing();
+    hr = OnApplyPostProcessing();
 
     if (FAILED(hr)) {
       Stop();
@@ -974,9 +905,15 @@ HRESULT Inpin::Start() {
 }
 
 void Inpin::Stop() {
-  const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
-  err;
-  assert(err == VPX_CODEC_OK);
+  ++m_generation;
+
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+  hr;
+  assert(SUCCEEDED(hr));
+
+  webmdshow::VpxDecoderPool::Get().Return(m_decoder_key, &m_ctx);
 
   if (scaled_frame != NULL) {
     vpx_img_free(scaled_frame);
@@ -984,6 +921,34 @@ void Inpin::Stop() {
   }
 }
 
+int Inpin::GetFrameWidth() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  return vih.bmiHeader.biWidth;
+}
+
+int Inpin::GetFrameHeight() const {
+  if (m_connection_mtv.Empty())
+    return 0;
+
+  const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+  assert(mt.formattype == FORMAT_VideoInfo);
+  assert(mt.cbFormat >= sizeof(VIDEOINFOHEADER));
+  assert(mt.pbFormat);
+
+  const VIDEOINFOHEADER& vih = (VIDEOINFOHEADER&)(*mt.pbFormat);
+  const LONG h = vih.bmiHeader.biHeight;
+
+  return (h < 0) ? -h : h;
+}
+
 HRESULT Inpin::OnApplyPostProcessing() {
   const Filter::Config& src = m_pFilter->m_cfg;
   vp8_postproc_cfg_t tgt;
@@ -992,6 +957,13 @@ HRESULT Inpin::OnApplyPostProcessing() {
   tgt.deblocking_level = src.deblock;
   tgt.noise_level = src.noise;
 
+  CLockable::Lock decoder_lock;
+
+  const HRESULT hr = decoder_lock.Seize(&m_decoder_lock);
+
+  if (FAILED(hr))
+    return hr;
+
   const vpx_codec_err_t err = vpx_codec_control(&m_ctx, VP8_SET_POSTPROC, &tgt);
 
   return (err == VPX_CODEC_OK) ? S_OK : E_FAIL;
@@ -12,8 +12,11 @@
 
 #include "vpx/vpx_decoder.h"
 
+#include "clockable.h"
 #include "graphutil.h"
+#include "libyuv_util.h"
 #include "vpxdecoderpin.h"
+#include "vpxdecoderpool.h"
 
 namespace VPXDecoderLib {
 
@@ -58,22 +61,46 @@ class Inpin : public Pin, public IMemInputPin {
  private:
   HRESULT PopulateSample(IMediaSample*, const vpx_image_t*);
 
-  static void CopyToPlanar(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out,
-                           const BITMAPINFOHEADER& bmih_out);
+  // Return the width and height of the connected input stream, or 0 when
+  // unknown.
+  int GetFrameWidth() const;
+  int GetFrameHeight() const;
 
-  static void CopyToPacked(const vpx_image_t* image, IMediaSample* sample,
-                           const GUID& subtype_out, const RECT& rc_out,
-                           const BITMAPINFOHEADER& bmih_out);
+  // Scales |image| to the size of |bmih_out| and writes it to |sample|
+  // as |subtype_out|. Planar formats are scaled straight into the sample;
+  // packed ones go through |scaled_frame|, which is kept for the
+  // connection so that it is allocated once rather than per frame. The
+  // scale is split across the shared thread pool for large frames.
+  HRESULT ScaleToSample(const vpx_image_t* image, IMediaSample* sample,
+                        const GUID& subtype_out, const RECT& rc_out,
+                        const BITMAPINFOHEADER& bmih_out);
 
   // Manual DISALLOW_COPY_AND_ASSIGN.
   Inpin(const Inpin&);
   Inpin& operator=(const Inpin&);
 
+  // Receive decodes holding only the decoder lock, so that the control
+  // interfaces, BeginFlush and Stop don't wait behind the frame. Start,
+  // Stop and the postprocessing settings seize it too, after the filter
+  // lock, before they change m_ctx; the streaming thread's other uses of
+  // m_ctx need only the filter lock.
+  class DecoderLock : public CLockable {
+   public:
+    DecoderLock();
+  };
+
   bool m_bEndOfStream;
   bool m_bFlush;
+  DecoderLock m_decoder_lock;
   vpx_codec_ctx_t m_ctx;
+  webmdshow::VpxDecoderPool::Key m_decoder_key;  // m_ctx was borrowed for
+
+  // Bumped by BeginFlush and Stop, so that a Receive that decoded without
+  // the filter lock can tell that the stream moved on meanwhile.
+  unsigned int m_generation;
+
   vpx_image_t* scaled_frame;
+  webmdshow::LibyuvScaler scaler;
 };
 
 }  // namespace VPXDecoderLib
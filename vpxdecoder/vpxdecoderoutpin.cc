@@ -192,9 +192,20 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
     m_connection_mtv.Add(mt);
   }
 
+  LONG w, h;
+  GetConnectionDimensions(w, h);
+
+  const long cbBuffer = 2 * w * h;
+
+  // Frames of 4K and up get buffers from large pages on the NUMA node of
+  // the streaming thread, when we provide the allocator.
+  const long kPageAllocatorMinBuffer = 2 * 3840 * 2160;
+
   GraphUtil::IMemAllocatorPtr pAllocator;
   hr = pInputPin->GetAllocator(&pAllocator);
-  if (FAILED(hr))
+  if (FAILED(hr) && cbBuffer >= kPageAllocatorMinBuffer)
+    hr = CMediaSample::CreatePageAllocator(&pAllocator);
+  else if (FAILED(hr))
     hr = CMediaSample::CreateAllocator(&pAllocator);
 
   if (FAILED(hr) || pAllocator == NULL) {
@@ -209,11 +220,6 @@ HRESULT Outpin::Connect(IPin* pin, const AM_MEDIA_TYPE* pmt) {
   if (props.cBuffers <= 0)
     props.cBuffers = 1;
 
-  LONG w, h;
-  GetConnectionDimensions(w, h);
-
-  const long cbBuffer = 2 * w * h;
-
   if (props.cbBuffer < cbBuffer)
     props.cbBuffer = cbBuffer;
 
@@ -278,7 +284,8 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
       mt_query.subtype != MEDIASUBTYPE_UYVY &&
       mt_query.subtype != MEDIASUBTYPE_YVYU &&
       mt_query.subtype != MEDIASUBTYPE_YUY2 &&
-      mt_query.subtype != MEDIASUBTYPE_YUYV) {
+      mt_query.subtype != MEDIASUBTYPE_YUYV &&
+      mt_query.subtype != WebmTypes::MEDIASUBTYPE_Y800) {
     return S_FALSE;
   }
 
@@ -299,15 +306,29 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt_query) {
   if (mt_query.formattype == GUID_NULL)
     return S_OK;
 
+  // Once the type has changed, a renderer can ask again for every sample
+  // (the EVR does), so remember the last type vetted against this input.
+  if (!m_accepted_mtv.Empty() &&
+      MediaTypeUtil::Equal(m_accepted_mtv[0], mt_query))
+    return S_OK;
+
   const AM_MEDIA_TYPE& mt_in = inpin.m_connection_mtv[0];
 
+  HRESULT result;
+
   if (mt_query.formattype == FORMAT_VideoInfo)
-    return QueryAcceptVideoInfo(mt_in, mt_query);
+    result = QueryAcceptVideoInfo(mt_in, mt_query);
+  else if (mt_query.formattype == FORMAT_VideoInfo2)
+    result = QueryAcceptVideoInfo2(mt_in, mt_query);
+  else
+    return S_FALSE;
 
-  if (mt_query.formattype == FORMAT_VideoInfo2)
-    return QueryAcceptVideoInfo2(mt_in, mt_query);
+  if (result == S_OK) {
+    m_accepted_mtv.Clear();
+    m_accepted_mtv.Add(mt_query);
+  }
 
-  return S_FALSE;
+  return result;
 }
 
 HRESULT Outpin::QueryAcceptVideoInfo(const AM_MEDIA_TYPE& mt_in,
@@ -386,7 +407,8 @@ bool Outpin::VetBMIH(const VIDEOINFOHEADER& vih_in, const GUID& subtype_out,
   if (stride_out <= 0)
     return false;
 
-  if (stride_out % 2)
+  // Only the types with chroma need an even stride.
+  if ((stride_out % 2) && (subtype_out != WebmTypes::MEDIASUBTYPE_Y800))
     return false;
 
   const LONG height_out = labs(bmih_out.biHeight);  // yes, negative OK
@@ -755,6 +777,7 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
   assert(h > 0);
 
   m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
 
   // planar
 
@@ -786,6 +809,15 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn) {
 
   AddPreferred(MEDIASUBTYPE_YVYU, vihIn.AvgTimePerFrame, w, h, dwBitCount,
                dwSizeImage);
+
+  // Luma only, for analytics (motion detection, OCR), which ask for it by
+  // name.
+
+  dwBitCount = 8;
+  dwSizeImage = w * h;
+
+  AddPreferred(WebmTypes::MEDIASUBTYPE_Y800, vihIn.AvgTimePerFrame, w, h,
+               dwBitCount, dwSizeImage);
 }
 
 HRESULT Outpin::OnInpinDisconnect() {
@@ -807,7 +839,10 @@ HRESULT Outpin::OnInpinDisconnect() {
   return S_OK;
 }
 
-void Outpin::SetDefaultMediaTypes() { m_preferred_mtv.Clear(); }
+void Outpin::SetDefaultMediaTypes() {
+  m_preferred_mtv.Clear();
+  m_accepted_mtv.Clear();
+}
 
 void Outpin::GetConnectionDimensions(LONG& w, LONG& h) const {
   assert(!m_connection_mtv.Empty());
@@ -105,6 +105,10 @@ class Outpin : public Pin, public IMediaSeeking {
   static void AddVIH2(CMediaTypes&, const GUID& subtype,
                       REFERENCE_TIME AvgTimePerFrame, LONG width, LONG height,
                       DWORD dwBitCount, DWORD dwSizeImage);
+
+  // The last type with a format block that QueryAccept accepted, while
+  // the inpin has its current connection.
+  CMediaTypes m_accepted_mtv;
 };
 
 }  // namespace VPXDecoderLib
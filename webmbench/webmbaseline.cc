@@ -0,0 +1,539 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "webmbaseline.h"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace WebmBench
+{
+
+namespace
+{
+
+//A JSON value, of the little of JSON that webmbench writes: objects,
+//arrays, strings, numbers, and (should a run gain them) true, false and
+//null.
+
+struct Value
+{
+    enum Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+    Type type;
+    double number;  //also 0 or 1 for a bool
+    std::string string;
+
+    typedef std::vector<Value> elements_t;
+    elements_t elements;
+
+    typedef std::vector<std::pair<std::string, Value> > members_t;
+    members_t members;
+
+    Value() : type(kNull), number(0)
+    {
+    }
+
+    //Returns the member |name| of an object, or 0.
+    const Value* Get(const char* name) const;
+
+};
+
+
+const Value* Value::Get(const char* name) const
+{
+    typedef members_t::const_iterator iter_t;
+
+    for (iter_t i = members.begin(); i != members.end(); ++i)
+    {
+        if (i->first == name)
+            return &i->second;
+    }
+
+    return 0;
+}
+
+
+class Reader
+{
+    Reader(const Reader&);
+    Reader& operator=(const Reader&);
+
+public:
+    Reader(const char* begin, const char* end);
+
+    //Parses the one value of the text.
+    bool Parse(Value&);
+
+private:
+    const char* m_p;
+    const char* const m_end;
+
+    enum { kMaxDepth = 64 };
+
+    bool ParseValue(Value&, int depth);
+    bool ParseString(std::string&);
+    bool ParseNumber(double&);
+    bool ParseWord(const char*);
+    bool Next(char);  //skips space, and takes the character if it is next
+    void SkipSpace();
+
+};
+
+
+Reader::Reader(const char* begin, const char* end) :
+    m_p(begin),
+    m_end(end)
+{
+}
+
+
+bool Reader::Parse(Value& v)
+{
+    if (!ParseValue(v, 0))
+        return false;
+
+    SkipSpace();
+    return (m_p == m_end);
+}
+
+
+bool Reader::ParseValue(Value& v, int depth)
+{
+    if (depth > kMaxDepth)
+        return false;
+
+    SkipSpace();
+
+    if (m_p >= m_end)
+        return false;
+
+    switch (*m_p)
+    {
+        case '{':
+        {
+            ++m_p;
+            v.type = Value::kObject;
+
+            if (Next('}'))
+                return true;
+
+            do
+            {
+                SkipSpace();
+
+                std::string name;
+
+                if (!ParseString(name) || !Next(':'))
+                    return false;
+
+                v.members.push_back(std::make_pair(name, Value()));
+
+                if (!ParseValue(v.members.back().second, depth + 1))
+                    return false;
+            }
+            while (Next(','));
+
+            return Next('}');
+        }
+        case '[':
+        {
+            ++m_p;
+            v.type = Value::kArray;
+
+            if (Next(']'))
+                return true;
+
+            do
+            {
+                v.elements.push_back(Value());
+
+                if (!ParseValue(v.elements.back(), depth + 1))
+                    return false;
+            }
+            while (Next(','));
+
+            return Next(']');
+        }
+        case '"':
+            v.type = Value::kString;
+            return ParseString(v.string);
+
+        case 't':
+            v.type = Value::kBool;
+            v.number = 1;
+            return ParseWord("true");
+
+        case 'f':
+            v.type = Value::kBool;
+            return ParseWord("false");
+
+        case 'n':
+            return ParseWord("null");
+
+        default:
+            v.type = Value::kNumber;
+            return ParseNumber(v.number);
+    }
+}
+
+
+bool Reader::ParseString(std::string& s)
+{
+    if ((m_p >= m_end) || (*m_p != '"'))
+        return false;
+
+    ++m_p;
+
+    while (m_p < m_end)
+    {
+        const char c = *m_p++;
+
+        if (c == '"')
+            return true;
+
+        if (c != '\\')
+        {
+            s += c;
+            continue;
+        }
+
+        if (m_p >= m_end)
+            return false;
+
+        const char e = *m_p++;
+
+        switch (e)
+        {
+            case '"':
+            case '\\':
+            case '/':
+                s += e;
+                break;
+
+            case 'b':
+                s += '\b';
+                break;
+
+            case 'f':
+                s += '\f';
+                break;
+
+            case 'n':
+                s += '\n';
+                break;
+
+            case 'r':
+                s += '\r';
+                break;
+
+            case 't':
+                s += '\t';
+                break;
+
+            case 'u':
+            {
+                if (m_end - m_p < 4)
+                    return false;
+
+                const std::string hex(m_p, m_p + 4);
+                m_p += 4;
+
+                char* end;
+                const unsigned long u = strtoul(hex.c_str(), &end, 16);
+
+                if (*end != '\0')
+                    return false;
+
+                //As UTF-8; webmbench escapes only control characters,
+                //and surrogates are not paired up.
+
+                if (u < 0x80)
+                    s += char(u);
+
+                else if (u < 0x800)
+                {
+                    s += char(0xC0 | (u >> 6));
+                    s += char(0x80 | (u & 0x3F));
+                }
+                else
+                {
+                    s += char(0xE0 | (u >> 12));
+                    s += char(0x80 | ((u >> 6) & 0x3F));
+                    s += char(0x80 | (u & 0x3F));
+                }
+
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return false;  //unterminated
+}
+
+
+bool Reader::ParseNumber(double& n)
+{
+    const char* const begin = m_p;
+
+    while ((m_p < m_end) && strchr("+-0123456789.eE", *m_p))
+        ++m_p;
+
+    if (m_p == begin)
+        return false;
+
+    const std::string text(begin, m_p);
+
+    char* end;
+    n = strtod(text.c_str(), &end);
+
+    return (*end == '\0');
+}
+
+
+bool Reader::ParseWord(const char* word)
+{
+    const size_t len = strlen(word);
+
+    if ((size_t(m_end - m_p) < len) || (strncmp(m_p, word, len) != 0))
+        return false;
+
+    m_p += len;
+    return true;
+}
+
+
+bool Reader::Next(char c)
+{
+    SkipSpace();
+
+    if ((m_p >= m_end) || (*m_p != c))
+        return false;
+
+    ++m_p;
+    return true;
+}
+
+
+void Reader::SkipSpace()
+{
+    while ((m_p < m_end) && strchr(" \t\r\n", *m_p))
+        ++m_p;
+}
+
+
+//A benchmark of a run, as compared.
+
+struct Sample
+{
+    double items;
+    double median_us;
+};
+
+//By "<file or scenario>: <benchmark>", in the order of the names.
+typedef std::map<std::string, Sample> samples_t;
+
+
+//Adds the benchmarks of the entries of |list| (the run's "files" or
+//"scenarios"), each named by its member |key|, to |samples|.
+
+bool AddSamples(const Value* list, const char* key, samples_t& samples)
+{
+    if (list == 0)
+        return true;  //a run of files alone, or of scenarios alone
+
+    if (list->type != Value::kArray)
+        return false;
+
+    typedef Value::elements_t::const_iterator iter_t;
+
+    for (iter_t i = list->elements.begin(); i != list->elements.end(); ++i)
+    {
+        const Value* const name = i->Get(key);
+        const Value* const benchmarks = i->Get("benchmarks");
+
+        if ((name == 0) || (name->type != Value::kString))
+            return false;
+
+        if ((benchmarks == 0) || (benchmarks->type != Value::kArray))
+            return false;
+
+        const Value::elements_t& bb = benchmarks->elements;
+
+        for (iter_t j = bb.begin(); j != bb.end(); ++j)
+        {
+            const Value* const b = j->Get("name");
+            const Value* const items = j->Get("items");
+            const Value* const median = j->Get("median_us");
+
+            if ((b == 0) || (b->type != Value::kString))
+                return false;
+
+            if ((items == 0) || (items->type != Value::kNumber))
+                return false;
+
+            if ((median == 0) || (median->type != Value::kNumber))
+                return false;
+
+            const Sample s = { items->number, median->number };
+            samples[name->string + ": " + b->string] = s;
+        }
+    }
+
+    return true;
+}
+
+
+HRESULT ReadRun(const wchar_t* filename, samples_t& samples)
+{
+    FILE* f;
+
+    if (_wfopen_s(&f, filename, L"rb") != 0)
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+    std::vector<char> text;
+    char buf[4096];
+
+    for (;;)
+    {
+        const size_t n = fread(buf, 1, sizeof buf, f);
+
+        if (n == 0)
+            break;
+
+        text.insert(text.end(), buf, buf + n);
+    }
+
+    const bool error = (ferror(f) != 0);
+    fclose(f);
+
+    if (error)
+        return E_FAIL;
+
+    //A run saved by a redirect of stdout has no BOM, but one edited by
+    //hand may have.
+
+    size_t off = 0;
+
+    if ((text.size() >= 3) && (memcmp(&text[0], "\xEF\xBB\xBF", 3) == 0))
+        off = 3;
+
+    const char* const begin = text.empty() ? 0 : &text[0];
+
+    Reader reader(begin + off, begin + text.size());
+    Value root;
+
+    if (!reader.Parse(root) || (root.type != Value::kObject))
+        return E_FAIL;
+
+    if (!AddSamples(root.Get("files"), "file", samples))
+        return E_FAIL;
+
+    if (!AddSamples(root.Get("scenarios"), "scenario", samples))
+        return E_FAIL;
+
+    return S_OK;
+}
+
+}  //end anon namespace
+
+
+HRESULT CompareRuns(
+    const wchar_t* baseline_name,
+    const wchar_t* run_name,
+    double tolerance,
+    FILE* out)
+{
+    assert(baseline_name);
+    assert(run_name);
+    assert(out);
+
+    samples_t baseline, run;
+
+    HRESULT hr = ReadRun(baseline_name, baseline);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = ReadRun(run_name, run);
+
+    if (FAILED(hr))
+        return hr;
+
+    bool pass = true;
+
+    typedef samples_t::const_iterator iter_t;
+
+    for (iter_t i = baseline.begin(); i != baseline.end(); ++i)
+    {
+        const char* const name = i->first.c_str();
+        const Sample& b = i->second;
+
+        const iter_t j = run.find(i->first);
+
+        if (j == run.end())
+        {
+            fprintf(out, "MISSING     %s\n", name);
+            pass = false;
+
+            continue;
+        }
+
+        const Sample& r = j->second;
+
+        if (r.items != b.items)
+        {
+            fprintf(out,
+                    "CHANGED     %s: %.0f items, baseline %.0f\n",
+                    name,
+                    r.items,
+                    b.items);
+
+            continue;
+        }
+
+        const double change = (b.median_us > 0) ?
+                              (r.median_us / b.median_us - 1) * 100 :
+                              0;
+
+        const char* verdict;
+
+        if (change > tolerance)
+        {
+            verdict = "REGRESSION";
+            pass = false;
+        }
+        else if (change < -tolerance)
+            verdict = "improved";
+        else
+            verdict = "ok";
+
+        fprintf(out,
+                "%-11s %s: %.0f us, baseline %.0f us (%+.1f%%)\n",
+                verdict,
+                name,
+                r.median_us,
+                b.median_us,
+                change);
+    }
+
+    for (iter_t i = run.begin(); i != run.end(); ++i)
+    {
+        if (baseline.find(i->first) == baseline.end())
+            fprintf(out, "new         %s\n", i->first.c_str());
+    }
+
+    return pass ? S_OK : S_FALSE;
+}
+
+}  //end namespace WebmBench
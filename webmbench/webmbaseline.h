@@ -0,0 +1,37 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <cstdio>
+
+namespace WebmBench
+{
+
+//Compares a run of webmbench with a baseline, a run kept from before the
+//change, both as webmbench writes them to stdout.  Each benchmark of each
+//file and scenario is matched by name, and the median time of the run is
+//compared with that of the baseline:
+//
+//  - a median more than |tolerance| percent over the baseline's is a
+//    regression;
+//  - a benchmark whose items differ from the baseline's did not do the
+//    same work, and is reported but not compared;
+//  - a benchmark of the baseline that the run does not have fails the
+//    comparison, so that a scenario that stopped running does not pass.
+//
+//Writes a line for each benchmark to |out|.  Returns S_OK if the run
+//passes, S_FALSE if it does not, or an error if either file cannot be
+//read as the output of webmbench.
+HRESULT CompareRuns(
+    const wchar_t* baseline,
+    const wchar_t* run,
+    double tolerance,
+    FILE* out);
+
+}  //end namespace WebmBench
@@ -0,0 +1,1328 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <comdef.h>
+#include <amvideo.h>
+#include <uuids.h>
+#include <vfwmsgs.h>
+#include <mfapi.h>
+#include <mferror.h>
+#include <mftransform.h>
+#include "webmbench.h"
+#include "cmediasample.h"
+#include "colorconverter.h"
+#include "cpuutil.h"
+#include "debugutil.h"
+#include "graphutil.h"
+#include "mkvparserblockscanner.h"
+#include "mkvparserfilereader.h"
+#include "mkvparsermemreader.h"
+#include "pipelinecounters.h"
+#include "scratchbuf.h"
+#include "vorbisdecoder.h"
+#include "vorbistypes.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamvideovpx.h"
+#include "webmsynth.h"
+#include "webmtypes.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vp8dx.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <new>
+
+using webmdshow::PipelineCounters;
+
+namespace WebmBench
+{
+
+namespace
+{
+
+//An open segment of a file held in memory.
+
+class Parser
+{
+    Parser(const Parser&);
+    Parser& operator=(const Parser&);
+
+public:
+    explicit Parser(const Input&);
+    ~Parser();
+
+    HRESULT Open();
+
+    mkvparser::MemReader m_reader;
+    mkvparser::Segment* m_pSegment;
+
+};
+
+
+Parser::Parser(const Input& in) :
+    m_reader(in.data.empty() ? 0 : &in.data[0], in.data.size()),
+    m_pSegment(0)
+{
+}
+
+
+Parser::~Parser()
+{
+    delete m_pSegment;
+}
+
+
+HRESULT Parser::Open()
+{
+    assert(m_pSegment == 0);
+
+    long long pos = 0;
+
+    mkvparser::EBMLHeader h;
+
+    long long result = h.Parse(&m_reader, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = mkvparser::Segment::CreateInstance(&m_reader, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    const long status = m_pSegment->Load();  //all of the file
+
+    if (status < 0)
+        return E_FAIL;
+
+    if (m_pSegment->GetTracks() == 0)
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+//Times one iteration of a benchmark.  The first iteration warms up the
+//caches and the allocators, and is not recorded.
+
+class Timer
+{
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+
+public:
+    Timer(Result& r, int iteration) :
+        m_result(r),
+        m_iteration(iteration),
+        m_start(PipelineCounters::Now())
+    {
+    }
+
+    ~Timer()
+    {
+        if (m_iteration > 0)
+            m_result.times_us.push_back(PipelineCounters::Now() - m_start);
+    }
+
+private:
+    Result& m_result;
+    const int m_iteration;
+    const LONGLONG m_start;
+
+};
+
+
+void InitResult(Result& r, const char* name, LONGLONG items, LONGLONG bytes)
+{
+    r.name = name;
+    r.items = items;
+    r.bytes = bytes;
+    r.times_us.clear();
+}
+
+
+LONGLONG GetFrameBytes(const Input& in)
+{
+    LONGLONG result = 0;
+
+    typedef Input::frames_t::const_iterator iter_t;
+
+    for (iter_t i = in.frames.begin(); i != in.frames.end(); ++i)
+        result += i->len;
+
+    return result;
+}
+
+
+//Copies the visible area of |img| to |dst| as I420, with the even stride
+//the decoder gives its planar output samples.
+
+void CopyI420(const vpx_image_t* img, std::vector<BYTE>& dst)
+{
+    const int w = img->d_w;
+    const int h = img->d_h;
+
+    const int stride = (w + 1) & ~1;
+    const int uv_w = (w + 1) / 2;
+    const int uv_h = (h + 1) / 2;
+    const int uv_stride = stride / 2;
+
+    const size_t size = stride * h + 2 * uv_stride * uv_h;
+
+    if (dst.size() < size)
+        dst.resize(size);
+
+    BYTE* p = &dst[0];
+
+    const BYTE* src = img->planes[VPX_PLANE_Y];
+
+    for (int y = 0; y < h; ++y)
+    {
+        memcpy(p, src, w);
+        src += img->stride[VPX_PLANE_Y];
+        p += stride;
+    }
+
+    const int planes[2] = { VPX_PLANE_U, VPX_PLANE_V };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        src = img->planes[planes[i]];
+
+        for (int y = 0; y < uv_h; ++y)
+        {
+            memcpy(p, src, uv_w);
+            src += img->stride[planes[i]];
+            p += uv_stride;
+        }
+    }
+}
+
+
+//Fills a frame with a ramp, so that the conversions do not see a
+//constant, which some row functions could handle faster.
+
+void FillFrame(std::vector<BYTE>& buf)
+{
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = static_cast<BYTE>((i * 7) ^ (i >> 8));
+}
+
+
+HRESULT MuxFrames(
+    const Input& in,
+    const AM_MEDIA_TYPE& mt,
+    IMemAllocator* pAllocator,
+    IStream* pStream)
+{
+    using namespace WebmMuxLib;
+
+    Context ctx;
+
+    StreamVideo* const pVideo = new (std::nothrow) StreamVideoVPx(ctx, mt);
+
+    if (pVideo == 0)
+        return E_OUTOFMEMORY;
+
+    ctx.SetVideoStream(pVideo);
+    ctx.Open(pStream);
+
+    HRESULT hr = S_OK;
+
+    typedef Input::frames_t::const_iterator iter_t;
+
+    for (iter_t i = in.frames.begin(); i != in.frames.end(); ++i)
+    {
+        const Input::Frame& f = *i;
+
+        GraphUtil::IMediaSamplePtr pSample;
+
+        //The muxer holds at most a cluster or two of frames, for which
+        //the allocator has enough buffers; rather than waiting forever
+        //if it does not, the benchmark fails.
+        hr = pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+        if (FAILED(hr))
+            break;
+
+        BYTE* ptr;
+
+        hr = pSample->GetPointer(&ptr);
+        assert(SUCCEEDED(hr));
+
+        memcpy(ptr, &in.data[size_t(f.pos)], f.len);
+
+        hr = pSample->SetActualDataLength(f.len);
+        assert(SUCCEEDED(hr));
+
+        LONGLONG st = f.time;
+        LONGLONG sp = f.time + in.frame_duration;
+
+        hr = pSample->SetTime(&st, (sp > st) ? &sp : 0);
+        assert(SUCCEEDED(hr));
+
+        hr = pSample->SetSyncPoint(f.key ? TRUE : FALSE);
+        assert(SUCCEEDED(hr));
+
+        hr = pVideo->Receive(pSample);
+
+        if (FAILED(hr))
+            break;
+    }
+
+    ctx.Close();
+    ctx.SetVideoStream(0);
+
+    delete pVideo;
+
+    return FAILED(hr) ? hr : S_OK;
+}
+
+
+_COM_SMARTPTR_TYPEDEF(IMFTransform, __uuidof(IMFTransform));
+_COM_SMARTPTR_TYPEDEF(IMFMediaType, __uuidof(IMFMediaType));
+_COM_SMARTPTR_TYPEDEF(IMFMediaBuffer, __uuidof(IMFMediaBuffer));
+_COM_SMARTPTR_TYPEDEF(IMFSample, __uuidof(IMFSample));
+
+typedef HRESULT (STDAPICALLTYPE* DllGetClassObjectFn)(
+    const CLSID&, const IID&, void**);
+
+
+HRESULT CreateMFSample(DWORD size, IMFSample** pp)
+{
+    IMFMediaBufferPtr pBuffer;
+
+    HRESULT hr = MFCreateMemoryBuffer(size, &pBuffer);
+
+    if (FAILED(hr))
+        return hr;
+
+    IMFSamplePtr pSample;
+
+    hr = MFCreateSample(&pSample);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pSample->AddBuffer(pBuffer);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pp = pSample.Detach();
+    return S_OK;
+}
+
+
+//Creates the decoder of |clsid| from the DLL |h|, sets its types and
+//decodes the first frame of the input, as the media session does before
+//the first frame of a file is shown.
+
+HRESULT DecodeFirstFrame(
+    const Input& in,
+    HMODULE h,
+    const CLSID& clsid,
+    const GUID& subtype)
+{
+    const DllGetClassObjectFn pfn = reinterpret_cast<DllGetClassObjectFn>(
+        GetProcAddress(h, "DllGetClassObject"));
+
+    if (pfn == 0)
+        return E_FAIL;
+
+    IClassFactoryPtr pFactory;
+
+    HRESULT hr = (*pfn)(
+        clsid,
+        __uuidof(IClassFactory),
+        reinterpret_cast<void**>(&pFactory));
+
+    if (FAILED(hr))
+        return hr;
+
+    IMFTransformPtr pDecoder;
+
+    hr = pFactory->CreateInstance(
+        0,
+        __uuidof(IMFTransform),
+        reinterpret_cast<void**>(&pDecoder));
+
+    if (FAILED(hr))
+        return hr;
+
+    IMFMediaTypePtr pmt;
+
+    hr = MFCreateMediaType(&pmt);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pmt->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    assert(SUCCEEDED(hr));
+
+    hr = pmt->SetGUID(MF_MT_SUBTYPE, subtype);
+    assert(SUCCEEDED(hr));
+
+    hr = MFSetAttributeSize(pmt, MF_MT_FRAME_SIZE, in.width, in.height);
+    assert(SUCCEEDED(hr));
+
+    hr = pDecoder->SetInputType(0, pmt, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    pmt = 0;
+
+    hr = pDecoder->GetOutputAvailableType(0, 0, &pmt);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pDecoder->SetOutputType(0, pmt, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pDecoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    const Input::Frame& f = in.frames.front();
+
+    IMFSamplePtr pInput;
+
+    hr = CreateMFSample(f.len, &pInput);
+
+    if (FAILED(hr))
+        return hr;
+
+    {
+        IMFMediaBufferPtr pBuffer;
+
+        hr = pInput->GetBufferByIndex(0, &pBuffer);
+        assert(SUCCEEDED(hr));
+
+        BYTE* ptr;
+
+        hr = pBuffer->Lock(&ptr, 0, 0);
+
+        if (FAILED(hr))
+            return hr;
+
+        memcpy(ptr, &in.data[size_t(f.pos)], f.len);
+
+        hr = pBuffer->Unlock();
+        assert(SUCCEEDED(hr));
+
+        hr = pBuffer->SetCurrentLength(f.len);
+        assert(SUCCEEDED(hr));
+    }
+
+    hr = pInput->SetSampleTime(f.time);
+    assert(SUCCEEDED(hr));
+
+    hr = pInput->SetUINT32(MFSampleExtension_CleanPoint, TRUE);
+    assert(SUCCEEDED(hr));
+
+    hr = pDecoder->ProcessInput(0, pInput, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    //We supply the output sample, even from a decoder that would provide
+    //its own: a pooled sample is returned to the pool asynchronously,
+    //which might be after the DLL has been unloaded.
+
+    MFT_OUTPUT_STREAM_INFO info;
+
+    hr = pDecoder->GetOutputStreamInfo(0, &info);
+
+    if (FAILED(hr))
+        return hr;
+
+    MFT_OUTPUT_DATA_BUFFER data;
+    memset(&data, 0, sizeof data);
+
+    hr = CreateMFSample(info.cbSize, &data.pSample);
+
+    if (FAILED(hr))
+        return hr;
+
+    DWORD status;
+
+    hr = pDecoder->ProcessOutput(0, 1, &data, &status);
+
+    data.pSample->Release();
+
+    if (data.pEvents)
+        data.pEvents->Release();
+
+    return (hr == S_OK) ? S_OK : E_FAIL;  //a keyframe yields a frame
+}
+
+//Decodes all of the input's Vorbis frames with a new decoder, consuming
+//the samples of each frame as float or as 16-bit PCM, and sets |blocks|
+//to the number of sample frames.
+
+HRESULT DecodeVorbis(const Input& in, bool int16, LONGLONG& blocks)
+{
+    const BYTE* headers[WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT];
+    long lengths[WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT];
+
+    const long n = VorbisTypes::GetXiphLacedPackets(
+                    &in.audio_private[0],
+                    long(in.audio_private.size()),
+                    headers,
+                    lengths,
+                    WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT);
+
+    if (n != long(WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT))
+        return E_FAIL;
+
+    DWORD header_lengths[WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT];
+
+    for (long i = 0; i < n; ++i)
+        header_lengths[i] = lengths[i];
+
+    WebmMfVorbisDecLib::VorbisDecoder decoder;
+
+    int status = decoder.CreateDecoder(headers, header_lengths, n);
+
+    if (FAILED(status))
+        return status;
+
+    const int channels = decoder.GetVorbisChannels();
+
+    std::vector<float> buf;
+    std::vector<int16_t> buf16;
+
+    blocks = 0;
+
+    typedef Input::frames_t::const_iterator iter_t;
+
+    for (iter_t i = in.audio_frames.begin(); i != in.audio_frames.end(); ++i)
+    {
+        const Input::Frame& f = *i;
+
+        //Decode does not write to the frame, though it takes a BYTE*.
+        BYTE* const ptr = const_cast<BYTE*>(&in.data[size_t(f.pos)]);
+
+        status = decoder.Decode(ptr, f.len);
+
+        if (FAILED(status))
+            return status;
+
+        UINT32 available;
+
+        status = decoder.GetOutputSamplesAvailable(&available);
+        assert(SUCCEEDED(status));
+
+        if (available == 0)  //the first frame
+            continue;
+
+        const size_t samples = size_t(available) * channels;
+
+        if (int16)
+        {
+            if (buf16.size() < samples)
+                buf16.resize(samples);
+
+            status = decoder.ConsumeOutputSamples(&buf16[0], available);
+        }
+        else
+        {
+            if (buf.size() < samples)
+                buf.resize(samples);
+
+            status = decoder.ConsumeOutputSamples(&buf[0], available);
+        }
+
+        if (FAILED(status))
+            return status;
+
+        blocks += available;
+    }
+
+    return S_OK;
+}
+
+}  //end anon namespace
+
+
+HRESULT Input::Load(const wchar_t* name)
+{
+    filename = name;
+    data.clear();
+
+    {
+        mkvparser::FileReader file;
+
+        const HRESULT hr = file.Open(name);
+
+        if (FAILED(hr))
+            return hr;
+
+        long long size;
+
+        file.Length(&size, 0);
+
+        if ((size <= 0) || (size > LONG_MAX))
+            return E_FAIL;
+
+        data.resize(size_t(size));
+
+        if (file.Read(0, long(size), &data[0]) != 0)
+            return E_FAIL;
+    }
+
+    return Parse();
+}
+
+
+HRESULT Input::Parse()
+{
+    codec_id.clear();
+    width = 0;
+    height = 0;
+    frame_duration = 0;
+    frames.clear();
+    max_frame_len = 0;
+    audio_codec_id.clear();
+    sample_rate = 0;
+    channels = 0;
+    audio_private.clear();
+    audio_frames.clear();
+    synthetic_video = false;
+    synthetic_audio = false;
+
+    Parser parser(*this);
+
+    const HRESULT hr = parser.Open();
+
+    if (FAILED(hr))
+        return hr;
+
+    const mkvparser::Segment* const pSegment = parser.m_pSegment;
+
+    if (const mkvparser::SegmentInfo* const pInfo = pSegment->GetInfo())
+    {
+        const char* const app = pInfo->GetWritingAppAsUTF8();
+        GetSynthPayloads(app, synthetic_video, synthetic_audio);
+    }
+
+    const mkvparser::Tracks* const pTracks = pSegment->GetTracks();
+
+    const mkvparser::VideoTrack* pTrack = 0;
+    const mkvparser::AudioTrack* pAudio = 0;
+
+    for (unsigned long i = 0; i < pTracks->GetTracksCount(); ++i)
+    {
+        const mkvparser::Track* const t = pTracks->GetTrackByIndex(i);
+
+        if (t == 0)
+            continue;
+
+        if ((t->GetType() == 1) && (pTrack == 0))  //video
+            pTrack = static_cast<const mkvparser::VideoTrack*>(t);
+
+        else if ((t->GetType() == 2) && (pAudio == 0))  //audio
+            pAudio = static_cast<const mkvparser::AudioTrack*>(t);
+    }
+
+    if ((pTrack == 0) && (pAudio == 0))
+        return S_OK;  //only the parse and convert benchmarks apply
+
+    long long tn = -1;
+
+    if (pTrack)
+    {
+        const char* const id = pTrack->GetCodecId();
+
+        if (id)
+            codec_id = id;
+
+        width = static_cast<long>(pTrack->GetWidth());
+        height = static_cast<long>(pTrack->GetHeight());
+
+        const double r = pTrack->GetFrameRate();
+
+        if (r > 0)
+            frame_duration = static_cast<LONGLONG>(10000000 / r);
+
+        tn = pTrack->GetNumber();
+    }
+
+    long long atn = -1;
+
+    if (pAudio)
+    {
+        const char* const id = pAudio->GetCodecId();
+
+        if (id)
+            audio_codec_id = id;
+
+        sample_rate = static_cast<long>(pAudio->GetSamplingRate());
+        channels = static_cast<long>(pAudio->GetChannels());
+
+        size_t size;
+
+        const unsigned char* const cp = pAudio->GetCodecPrivate(size);
+
+        if (cp)
+            audio_private.assign(cp, cp + size);
+
+        atn = pAudio->GetNumber();
+    }
+
+    for (const mkvparser::Cluster* pCluster = pSegment->GetFirst();
+         (pCluster != 0) && !pCluster->EOS();
+         pCluster = pSegment->GetNext(pCluster))
+    {
+        const mkvparser::BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const mkvparser::Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const long long n = pBlock->GetTrackNumber();
+
+            if ((n == tn) || (n == atn))
+            {
+                const LONGLONG t = pBlock->GetTime(pCluster) / 100;
+
+                frames_t& ff = (n == tn) ? frames : audio_frames;
+
+                for (int i = 0; i < pBlock->GetFrameCount(); ++i)
+                {
+                    const mkvparser::Block::Frame& bf = pBlock->GetFrame(i);
+
+                    const Frame f = { bf.pos, bf.len, t, pBlock->IsKey() };
+                    ff.push_back(f);
+
+                    if (n == tn)
+                        max_frame_len = std::max(max_frame_len, bf.len);
+                }
+            }
+
+            status = pCluster->GetNext(pEntry, pEntry);
+        }
+    }
+
+    return S_OK;
+}
+
+
+LONGLONG Result::GetMin() const
+{
+    assert(!times_us.empty());
+    return *std::min_element(times_us.begin(), times_us.end());
+}
+
+
+LONGLONG Result::GetMax() const
+{
+    assert(!times_us.empty());
+    return *std::max_element(times_us.begin(), times_us.end());
+}
+
+
+LONGLONG Result::GetMedian() const
+{
+    assert(!times_us.empty());
+
+    std::vector<LONGLONG> t(times_us);
+    std::sort(t.begin(), t.end());
+
+    const size_t n = t.size();
+
+    if (n % 2)
+        return t[n / 2];
+
+    return (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+
+LONGLONG Result::GetMean() const
+{
+    assert(!times_us.empty());
+
+    LONGLONG sum = 0;
+
+    for (size_t i = 0; i < times_us.size(); ++i)
+        sum += times_us[i];
+
+    return sum / LONGLONG(times_us.size());
+}
+
+
+HRESULT BenchParse(const Input& in, int iterations, results_t& results)
+{
+    Result r;
+    InitResult(r, "parse", 0, in.data.size());
+
+    std::vector<unsigned char> buf;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        Timer timer(r, iteration);
+
+        Parser parser(in);
+
+        const HRESULT hr = parser.Open();
+
+        if (FAILED(hr))
+            return hr;
+
+        mkvparser::Segment* const pSegment = parser.m_pSegment;
+        LONGLONG count = 0;
+
+        for (const mkvparser::Cluster* pCluster = pSegment->GetFirst();
+             (pCluster != 0) && !pCluster->EOS();
+             pCluster = pSegment->GetNext(pCluster))
+        {
+            const mkvparser::BlockEntry* pEntry;
+
+            long status = pCluster->GetFirst(pEntry);
+
+            while ((status >= 0) && (pEntry != 0) && !pEntry->EOS())
+            {
+                const mkvparser::Block* const pBlock = pEntry->GetBlock();
+                assert(pBlock);
+
+                for (int i = 0; i < pBlock->GetFrameCount(); ++i)
+                {
+                    const mkvparser::Block::Frame& f = pBlock->GetFrame(i);
+
+                    if (f.len <= 0)
+                        continue;
+
+                    if (buf.size() < size_t(f.len))
+                        buf.resize(f.len);
+
+                    if (f.Read(&parser.m_reader, &buf[0]) != 0)
+                        return E_FAIL;
+
+                    ++count;
+                }
+
+                status = pCluster->GetNext(pEntry, pEntry);
+            }
+
+            if (status < 0)
+                return E_FAIL;
+        }
+
+        r.items = count;
+    }
+
+    results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT BenchScan(const Input& in, int iterations, results_t& results)
+{
+    Result r;
+    InitResult(r, "scan_headers", 0, in.data.size());
+
+    std::vector<mkvparser::BlockScanner::Record> records;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        Parser parser(in);
+
+        HRESULT hr = parser.Open();
+
+        if (FAILED(hr))
+            return hr;
+
+        Timer timer(r, iteration);
+
+        hr = mkvparser::BlockScanner::Scan(
+                &parser.m_reader,
+                parser.m_pSegment,
+                records);
+
+        if (hr != S_OK)
+            return E_FAIL;
+
+        r.items = records.size();
+    }
+
+    results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT BenchDecode(const Input& in, int iterations, results_t& results)
+{
+    if (in.frames.empty() || in.synthetic_video)
+        return S_FALSE;
+
+    vpx_codec_iface_t* iface;
+    const char* name;
+
+    if (in.codec_id == "V_VP8")
+    {
+        iface = &vpx_codec_vp8_dx_algo;
+        name = "decode_vp8";
+    }
+    else if (in.codec_id == "V_VP9")
+    {
+        iface = &vpx_codec_vp9_dx_algo;
+        name = "decode_vp9";
+    }
+    else
+        return S_FALSE;
+
+    const LONGLONG frames = in.frames.size();
+
+    Result decode;
+    InitResult(decode, name, frames, GetFrameBytes(in));
+
+    Result copy;
+    InitResult(copy, "copy_i420", frames, 0);
+
+    std::vector<BYTE> buf;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        vpx_codec_dec_cfg_t cfg = { 0 };
+        cfg.threads = webmdshow::GetVpxDecoderThreadCount(
+                        0,
+                        iface == &vpx_codec_vp9_dx_algo,
+                        in.width);
+
+        vpx_codec_ctx_t ctx;
+
+        if (vpx_codec_dec_init(&ctx, iface, &cfg, 0) != VPX_CODEC_OK)
+            return E_FAIL;
+
+        LONGLONG decode_us = 0;
+        LONGLONG copy_us = 0;
+        LONGLONG copy_bytes = 0;
+
+        typedef Input::frames_t::const_iterator iter_t;
+
+        for (iter_t i = in.frames.begin(); i != in.frames.end(); ++i)
+        {
+            const Input::Frame& f = *i;
+
+            const LONGLONG t0 = PipelineCounters::Now();
+
+            const vpx_codec_err_t err = vpx_codec_decode(
+                                            &ctx,
+                                            &in.data[size_t(f.pos)],
+                                            f.len,
+                                            0,
+                                            0);
+
+            if (err != VPX_CODEC_OK)
+            {
+                vpx_codec_destroy(&ctx);
+                return E_FAIL;
+            }
+
+            vpx_codec_iter_t iter = 0;
+
+            const vpx_image_t* const img = vpx_codec_get_frame(&ctx, &iter);
+
+            const LONGLONG t1 = PipelineCounters::Now();
+
+            decode_us += t1 - t0;
+
+            if (img == 0)  //a frame that is not shown
+                continue;
+
+            CopyI420(img, buf);
+
+            copy_us += PipelineCounters::Now() - t1;
+            copy_bytes += img->d_w * img->d_h * 3 / 2;
+        }
+
+        vpx_codec_destroy(&ctx);
+
+        if (iteration > 0)
+        {
+            decode.times_us.push_back(decode_us);
+            copy.times_us.push_back(copy_us);
+        }
+
+        copy.bytes = copy_bytes;
+    }
+
+    results.push_back(decode);
+    results.push_back(copy);
+
+    return S_OK;
+}
+
+
+HRESULT BenchConvert(const Input& in, int iterations, results_t& results)
+{
+    using namespace webmdshow;
+
+    struct Conversion
+    {
+        const char* name;
+        ColorFormat src;
+        ColorFormat dst;
+    };
+
+    static const Conversion conversions[] =
+    {
+        { "convert_i420_yv12", kColorFormatI420, kColorFormatYV12 },
+        { "convert_i420_nv12", kColorFormatI420, kColorFormatNV12 },
+        { "convert_i420_yuy2", kColorFormatI420, kColorFormatYUY2 },
+        { "convert_i420_uyvy", kColorFormatI420, kColorFormatUYVY },
+        { "convert_i420_rgb32", kColorFormatI420, kColorFormatRGB32 },
+        { "convert_yuy2_i420", kColorFormatYUY2, kColorFormatI420 },
+        { "convert_rgb24_i420", kColorFormatRGB24, kColorFormatI420 },
+        { "convert_rgb32_i420", kColorFormatRGB32, kColorFormatI420 },
+    };
+
+    enum { kFrames = 30 };  //for each iteration
+
+    //A file with no video track is converted at 1080p.
+    const int w = (in.width > 0) ? in.width : 1920;
+    const int h = (in.height > 0) ? in.height : 1080;
+
+    const int n = sizeof conversions / sizeof conversions[0];
+
+    for (int i = 0; i < n; ++i)
+    {
+        const Conversion& c = conversions[i];
+
+        const int src_stride = ColorConverter::GetStride(c.src, w);
+        const int dst_stride = ColorConverter::GetStride(c.dst, w);
+
+        std::vector<BYTE> src(
+            ColorConverter::GetFrameSize(c.src, src_stride, h));
+        std::vector<BYTE> dst(
+            ColorConverter::GetFrameSize(c.dst, dst_stride, h));
+
+        FillFrame(src);
+
+        ColorConverter cc;
+
+        if (!cc.Init(c.src, src_stride, c.dst, dst_stride, w, h))
+            return E_FAIL;
+
+        Result r;
+        InitResult(r, c.name, kFrames, LONGLONG(kFrames) * src.size());
+
+        for (int iteration = 0; iteration <= iterations; ++iteration)
+        {
+            Timer timer(r, iteration);
+
+            for (int j = 0; j < kFrames; ++j)
+            {
+                if (!cc.Convert(&src[0], &dst[0]))
+                    return E_FAIL;
+            }
+        }
+
+        results.push_back(r);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT BenchScratchBuf(const Input& in, int iterations, results_t& results)
+{
+    if (in.frames.empty())
+        return S_FALSE;
+
+    //The buffer is consumed whenever it holds this much, as a live
+    //muxer hands each chunk on.
+    const uint64 kChunkSize = 64 * 1024;
+
+    Result r;
+    InitResult(r, "scratchbuf", in.frames.size(), GetFrameBytes(in));
+
+    WebmUtil::EbmlScratchBuf buf;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        Timer timer(r, iteration);
+
+        buf.Reset();
+
+        const LONGLONG base = in.frames.front().time;
+
+        typedef Input::frames_t::const_iterator iter_t;
+
+        for (iter_t i = in.frames.begin(); i != in.frames.end(); ++i)
+        {
+            const Input::Frame& f = *i;
+
+            //Relative to the start, in ms, as if in one long cluster.
+            const LONGLONG tc = (f.time - base) / 10000;
+
+            buf.WriteID1(0xA3);  //SimpleBlock
+            buf.Write4UInt(f.len + 4);
+            buf.Write1UInt(1);  //track number
+            buf.Serialize2UInt(static_cast<uint16>(tc));
+            buf.Serialize1UInt(f.key ? 0x80 : 0x00);
+            buf.Write(&in.data[size_t(f.pos)], f.len);
+
+            const uint64 len = buf.GetBufferLength();
+
+            if (len >= kChunkSize)
+                buf.Erase(uint32(0), static_cast<int32>(len));
+        }
+    }
+
+    results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT BenchMux(const Input& in, int iterations, results_t& results)
+{
+    if (in.frames.empty() || !in.frames.front().key)
+        return S_FALSE;
+
+    VIDEOINFOHEADER vih;
+    memset(&vih, 0, sizeof vih);
+
+    vih.AvgTimePerFrame = in.frame_duration;
+
+    BITMAPINFOHEADER& bmih = vih.bmiHeader;
+
+    bmih.biSize = sizeof bmih;
+    bmih.biWidth = in.width;
+    bmih.biHeight = in.height;
+    bmih.biPlanes = 1;
+
+    AM_MEDIA_TYPE mt;
+    memset(&mt, 0, sizeof mt);
+
+    mt.majortype = MEDIATYPE_Video;
+    mt.formattype = FORMAT_VideoInfo;
+    mt.cbFormat = sizeof vih;
+    mt.pbFormat = reinterpret_cast<BYTE*>(&vih);
+
+    if (in.codec_id == "V_VP8")
+    {
+        mt.subtype = WebmTypes::MEDIASUBTYPE_VP80;
+        bmih.biCompression = WebmTypes::MEDIASUBTYPE_VP80.Data1;
+    }
+    else if (in.codec_id == "V_VP9")
+    {
+        mt.subtype = WebmTypes::MEDIASUBTYPE_VP90;
+        bmih.biCompression = WebmTypes::MEDIASUBTYPE_VP90.Data1;
+    }
+    else
+        return S_FALSE;
+
+    GraphUtil::IMemAllocatorPtr pAllocator;
+
+    HRESULT hr = CMediaSample::CreateAllocator(&pAllocator);
+
+    if (FAILED(hr))
+        return hr;
+
+    ALLOCATOR_PROPERTIES props, actual;
+
+    props.cBuffers = static_cast<long>(
+                        std::min<size_t>(in.frames.size(), 512));
+    props.cbBuffer = in.max_frame_len;
+    props.cbAlign = 1;
+    props.cbPrefix = 0;
+
+    hr = pAllocator->SetProperties(&props, &actual);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = pAllocator->Commit();
+
+    if (FAILED(hr))
+        return hr;
+
+    Result r;
+    InitResult(r, "mux", in.frames.size(), 0);
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        IStreamPtr pStream;
+
+        hr = CreateStreamOnHGlobal(0, TRUE, &pStream);
+
+        if (FAILED(hr))
+            break;
+
+        {
+            Timer timer(r, iteration);
+            hr = MuxFrames(in, mt, pAllocator, pStream);
+        }
+
+        if (FAILED(hr))
+            break;
+
+        STATSTG stg;
+
+        hr = pStream->Stat(&stg, STATFLAG_NONAME);
+
+        if (FAILED(hr))
+            break;
+
+        r.bytes = stg.cbSize.QuadPart;
+    }
+
+    pAllocator->Decommit();
+
+    if (FAILED(hr))
+        return hr;
+
+    results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT BenchVorbis(const Input& in, int iterations, results_t& results)
+{
+    if ((in.audio_codec_id != "A_VORBIS") || in.audio_private.empty() ||
+        in.audio_frames.empty() || in.synthetic_audio)
+    {
+        return S_FALSE;
+    }
+
+    Result decode;
+    InitResult(decode, "decode_vorbis_float", 0, 0);
+
+    Result decode16;
+    InitResult(decode16, "decode_vorbis_pcm16", 0, 0);
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        LONGLONG blocks;
+
+        {
+            Timer timer(decode, iteration);
+
+            const HRESULT hr = DecodeVorbis(in, false, blocks);
+
+            if (FAILED(hr))
+                return hr;
+        }
+
+        decode.items = blocks;
+        decode.bytes = blocks * in.channels * sizeof(float);
+
+        {
+            Timer timer(decode16, iteration);
+
+            const HRESULT hr = DecodeVorbis(in, true, blocks);
+
+            if (FAILED(hr))
+                return hr;
+        }
+
+        decode16.items = blocks;
+        decode16.bytes = blocks * in.channels * sizeof(int16_t);
+    }
+
+    results.push_back(decode);
+    results.push_back(decode16);
+
+    return S_OK;
+}
+
+
+HRESULT BenchStartup(const Input& in, int iterations, results_t& results)
+{
+    if (in.frames.empty() || !in.frames.front().key || in.synthetic_video)
+        return S_FALSE;
+
+    if (in.width % 2)  //the decoder rejects an odd width
+        return S_FALSE;
+
+    CLSID clsid;
+    GUID subtype;
+
+    if (in.codec_id == "V_VP8")
+    {
+        clsid = WebmTypes::CLSID_WebmMfVp8Dec;
+        subtype = WebmTypes::MEDIASUBTYPE_VP80;
+    }
+    else if (in.codec_id == "V_VP9")
+    {
+        clsid = WebmTypes::CLSID_WebmMfVp9Dec;
+        subtype = WebmTypes::MEDIASUBTYPE_VP90;
+    }
+    else
+        return S_FALSE;
+
+    //The decoder is found as the system would find it, beside webmbench
+    //or on the path, but not through the registry: what is measured is
+    //the build under test, whatever is installed.
+
+    const wchar_t* const dll = (sizeof(void*) == 8) ?
+                               L"webmmfvp8dec64.dll" :
+                               L"webmmfvp8dec32.dll";
+
+    {
+        const HMODULE h = LoadLibraryW(dll);
+
+        if (h == 0)  //not built, or not copied beside webmbench
+            return S_FALSE;
+
+        FreeLibrary(h);
+    }
+
+    HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+
+    if (FAILED(hr))
+        return hr;
+
+    Result r;
+    InitResult(r, "mf_startup", 1, in.frames.front().len);
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        Timer timer(r, iteration);
+
+        const HMODULE h = LoadLibraryW(dll);
+
+        if (h == 0)
+        {
+            const DWORD e = GetLastError();
+            hr = HRESULT_FROM_WIN32(e);
+            break;
+        }
+
+        hr = DecodeFirstFrame(in, h, clsid, subtype);
+
+        FreeLibrary(h);
+
+        if (FAILED(hr))
+            break;
+    }
+
+    MFShutdown();
+
+    if (FAILED(hr))
+        return hr;
+
+    results.push_back(r);
+    return S_OK;
+}
+
+
+}  //end namespace WebmBench
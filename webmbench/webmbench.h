@@ -0,0 +1,124 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+namespace WebmBench
+{
+
+//A WebM file read into memory, and the frames of its first video and
+//audio tracks, which the benchmarks replay without a filter graph.
+
+struct Input
+{
+    struct Frame
+    {
+        long long pos;  //of the frame's data in the file
+        long len;
+        LONGLONG time;  //reftime units
+        bool key;
+    };
+
+    std::wstring filename;
+    std::vector<unsigned char> data;
+
+    std::string codec_id;  //"V_VP8" or "V_VP9"; empty if no video track
+    long width;
+    long height;
+    LONGLONG frame_duration;  //reftime units; 0 if unknown
+
+    typedef std::vector<Frame> frames_t;
+    frames_t frames;
+    long max_frame_len;
+
+    std::string audio_codec_id;  //"A_VORBIS"; empty if no audio track
+    long sample_rate;
+    long channels;
+    std::vector<unsigned char> audio_private;  //the CodecPrivate
+    frames_t audio_frames;
+
+    //Whether the frames are of random bytes, in a file made by
+    //Synthesize; they then do not decode.
+    bool synthetic_video;
+    bool synthetic_audio;
+
+    //Reads the file and parses it.
+    HRESULT Load(const wchar_t* filename);
+
+    //Parses |data| as a WebM file.
+    HRESULT Parse();
+};
+
+
+//The timings of one benchmark: the time taken by each iteration, for
+//|items| frames (or elements) and |bytes| bytes per iteration.
+
+struct Result
+{
+    std::string name;
+    LONGLONG items;
+    LONGLONG bytes;
+    std::vector<LONGLONG> times_us;
+
+    LONGLONG GetMin() const;
+    LONGLONG GetMax() const;
+    LONGLONG GetMedian() const;
+    LONGLONG GetMean() const;
+};
+
+typedef std::vector<Result> results_t;
+
+//Each benchmark runs |iterations| times and appends its results; it
+//returns S_FALSE, having appended nothing, if it does not apply to the
+//input (a file with no video track has no frames to decode or mux, and
+//the synthetic frames of a generated file none to decode).
+
+//Parses every cluster and block entry of the file through an
+//in-memory IMkvReader, and reads every frame, as the splitter does.
+HRESULT BenchParse(const Input&, int iterations, results_t&);
+
+//Lists the blocks of the file with a BlockScanner, reading only the
+//element and block headers; the time excludes opening the segment.
+HRESULT BenchScan(const Input&, int iterations, results_t&);
+
+//Decodes the video frames with libvpx, and copies each decoded image
+//into an I420 buffer, as the decoder does into its output samples.
+//Appends a result for each of the two.
+HRESULT BenchDecode(const Input&, int iterations, results_t&);
+
+//Converts frames of the input's size between the formats webmcc
+//handles, with a ColorConverter per conversion.
+HRESULT BenchConvert(const Input&, int iterations, results_t&);
+
+//Writes a SimpleBlock for each video frame to an EbmlScratchBuf, as the
+//live muxers do, and consumes the buffer from the front.
+HRESULT BenchScratchBuf(const Input&, int iterations, results_t&);
+
+//Muxes the video frames into a WebM file in an in-memory IStream, with
+//a WebmMuxLib::Context and a VPx stream, as the muxer filter does.
+HRESULT BenchMux(const Input&, int iterations, results_t&);
+
+//Decodes the Vorbis frames with libvorbis, as the Media Foundation
+//decoder does, and consumes the decoded samples as interleaved float and
+//as 16-bit PCM.  Appends a result for each of the two; the items are
+//sample frames, so that items_per_s over the sample rate is the speed
+//relative to real time.
+HRESULT BenchVorbis(const Input&, int iterations, results_t&);
+
+//Loads the Media Foundation decoder DLL of the video track, creates the
+//decoder, sets its types and decodes the first frame, then unloads the
+//DLL, as the shell does for each file it shows.  The time is that to
+//the first decoded sample, DLL load included.  Returns S_FALSE if the
+//DLL cannot be loaded (it is looked for beside webmbench, and on the
+//path).
+HRESULT BenchStartup(const Input&, int iterations, results_t&);
+
+}  //end namespace WebmBench
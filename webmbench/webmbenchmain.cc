@@ -0,0 +1,517 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "webmbench.h"
+#include "webmbaseline.h"
+#include "webmscenario.h"
+#include "webmsynth.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+
+//Runs the hot paths of the splitter, decoders, colour converter and muxer
+//on each file named on the command line, without a filter graph, and
+//the startup of the Media Foundation decoder, and writes the timings to
+//stdout as JSON, so that runs can be compared across releases:
+//
+//  webmbench [-n iterations] [-synth spec]... [file.webm]...
+//
+//Each benchmark is timed over |iterations| runs (5 by default), after
+//one run that is not timed.  Each -synth names a synthetic file, made in
+//memory as the spec says (see webmsynth.h), which is benchmarked as a
+//file would be, so that the shapes real files rarely have are covered
+//the same way from run to run.  To keep one, or to look at it:
+//
+//  webmbench -synth spec -o file.webm
+//
+//Each -scenario runs one of the end-to-end scenarios of webmscenario.h
+//(or, as -scenario all, every one), whose results follow those of the
+//files, with the pipeline counters of their stages.  A run kept as the
+//baseline of a release is checked against a later run, and the exit
+//status is 1 if a median has grown by more than the tolerance (10% by
+//default):
+//
+//  webmbench -n 5 -scenario all > baseline.json
+//  webmbench -compare baseline.json run.json [-tolerance percent]
+
+using namespace WebmBench;
+
+namespace
+{
+
+typedef HRESULT (*bench_t)(const Input&, int, results_t&);
+
+const bench_t g_benchmarks[] =
+{
+    BenchParse,
+    BenchScan,
+    BenchDecode,
+    BenchConvert,
+    BenchScratchBuf,
+    BenchMux,
+    BenchVorbis,
+    BenchStartup,
+};
+
+
+std::string ToJsonString(const std::string& s)
+{
+    std::string result = "\"";
+
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        const char c = s[i];
+
+        if ((c == '"') || (c == '\\'))
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            sprintf_s(buf, "\\u%04x", static_cast<unsigned char>(c));
+            result += buf;
+        }
+        else
+            result += c;
+    }
+
+    result += '"';
+    return result;
+}
+
+
+std::string ToJsonString(const std::wstring& s)
+{
+    if (s.empty())
+        return "\"\"";
+
+    const int n = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, 0, 0, 0, 0);
+
+    if (n <= 0)
+        return "\"\"";
+
+    std::string utf8(n, '\0');
+
+    WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, &utf8[0], n, 0, 0);
+    utf8.resize(n - 1);  //the terminator
+
+    return ToJsonString(utf8);
+}
+
+
+void PrintResult(const Result& r, bool last)
+{
+    const LONGLONG median = r.GetMedian();
+
+    const double items_per_s = (median > 0) ? r.items * 1e6 / median : 0;
+    const double mb_per_s = (median > 0) ? double(r.bytes) / median : 0;
+
+    printf("        {\n");
+    printf("          \"name\": %s,\n", ToJsonString(r.name).c_str());
+    printf("          \"iterations\": %u,\n", unsigned(r.times_us.size()));
+    printf("          \"items\": %lld,\n", r.items);
+    printf("          \"bytes\": %lld,\n", r.bytes);
+    printf("          \"min_us\": %lld,\n", r.GetMin());
+    printf("          \"median_us\": %lld,\n", median);
+    printf("          \"mean_us\": %lld,\n", r.GetMean());
+    printf("          \"max_us\": %lld,\n", r.GetMax());
+    printf("          \"items_per_s\": %.1f,\n", items_per_s);
+    printf("          \"mb_per_s\": %.1f\n", mb_per_s);
+    printf("        }%s\n", last ? "" : ",");
+}
+
+
+//The upper bound, in us, of the histogram bucket of |stats| holding the
+//|percent|th percentile of the processing times, or -1 if none were
+//recorded; as playwebm -benchmark reports them.
+
+LONGLONG GetPercentile(
+    const webmdshow::PipelineCounters::Stats& stats,
+    int percent)
+{
+    enum { kBuckets = webmdshow::PipelineCounters::kHistogramBuckets };
+
+    LONGLONG total = 0;
+
+    for (int i = 0; i < kBuckets; ++i)
+        total += stats.histogram[i];
+
+    if (total <= 0)
+        return -1;
+
+    const LONGLONG rank = (total * percent + 99) / 100;  //at least 1
+    LONGLONG count = 0;
+
+    for (int i = 0; i < kBuckets - 1; ++i)
+    {
+        count += stats.histogram[i];
+
+        if (count >= rank)
+            return LONGLONG(1) << i;
+    }
+
+    return LONGLONG(1) << (kBuckets - 2);
+}
+
+
+void PrintCounters(const webmdshow::PipelineCounters::Stats& s, bool last)
+{
+    const std::string name = ToJsonString(std::wstring(s.name));
+
+    printf("        {\n");
+    printf("          \"name\": %s,\n", name.c_str());
+    printf("          \"samples_in\": %lld,\n", s.samples_in);
+    printf("          \"samples_out\": %lld,\n", s.samples_out);
+    printf("          \"bytes_in\": %lld,\n", s.bytes_in);
+    printf("          \"bytes_out\": %lld,\n", s.bytes_out);
+    printf("          \"dropped\": %lld,\n", s.dropped);
+    printf("          \"busy_us\": %lld,\n", s.busy_us);
+    printf("          \"queue_peak\": %d,\n", s.queue_peak);
+    printf("          \"p50_us\": %lld,\n", GetPercentile(s, 50));
+    printf("          \"p99_us\": %lld\n", GetPercentile(s, 99));
+    printf("        }%s\n", last ? "" : ",");
+}
+
+
+//Returns false if the scenario failed; its entry then carries the error,
+//and any results it had.
+
+bool RunScenarioJob(const char* name, int iterations, bool last)
+{
+    ScenarioResult s;
+
+    const HRESULT hr = RunScenario(name, iterations, s);
+
+    printf("    {\n");
+    printf("      \"scenario\": %s,\n", ToJsonString(s.name).c_str());
+    printf("      \"corpus\": %s,\n", ToJsonString(s.corpus).c_str());
+
+    if (FAILED(hr))
+        printf("      \"error\": \"0x%08lX\",\n", hr);
+
+    printf("      \"counters\": [\n");
+
+    for (size_t i = 0; i < s.counters.size(); ++i)
+        PrintCounters(s.counters[i], i + 1 == s.counters.size());
+
+    printf("      ],\n");
+    printf("      \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < s.results.size(); ++i)
+        PrintResult(s.results[i], i + 1 == s.results.size());
+
+    printf("      ]\n");
+    printf("    }%s\n", last ? "" : ",");
+
+    return SUCCEEDED(hr);
+}
+
+
+int Compare(const wchar_t* baseline, const wchar_t* run, double tolerance)
+{
+    const HRESULT hr = CompareRuns(baseline, run, tolerance, stdout);
+
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"webmbench: cannot compare: 0x%08lX\n", hr);
+        return 2;
+    }
+
+    return (hr == S_OK) ? 0 : 1;
+}
+
+
+//A file named on the command line, or a synthetic file made in memory.
+
+struct Job
+{
+    const wchar_t* filename;  //0 for a synthetic file
+    SynthParams synth;
+};
+
+
+HRESULT Load(const Job& job, Input& in)
+{
+    if (job.filename)
+        return in.Load(job.filename);
+
+    in.filename = L"synth:" + job.synth.spec;
+
+    const HRESULT hr = Synthesize(job.synth, in.data);
+
+    if (FAILED(hr))
+        return hr;
+
+    return in.Parse();
+}
+
+
+//Returns false if a benchmark failed; the file's entry then carries the
+//error, and the results of the benchmarks that ran.
+
+bool RunFile(const Job& job, int iterations, bool last)
+{
+    Input in;
+
+    HRESULT hr = Load(job, in);
+
+    const std::string name = ToJsonString(in.filename);
+
+    printf("    {\n");
+    printf("      \"file\": %s,\n", name.c_str());
+
+    results_t results;
+
+    if (SUCCEEDED(hr))
+    {
+        printf("      \"size\": %u,\n", unsigned(in.data.size()));
+        printf("      \"codec\": %s,\n", ToJsonString(in.codec_id).c_str());
+        printf("      \"width\": %ld,\n", in.width);
+        printf("      \"height\": %ld,\n", in.height);
+        printf("      \"frames\": %u,\n", unsigned(in.frames.size()));
+        printf("      \"sample_rate\": %ld,\n", in.sample_rate);
+        printf("      \"channels\": %ld,\n", in.channels);
+
+        const int n = sizeof g_benchmarks / sizeof g_benchmarks[0];
+
+        for (int i = 0; i < n; ++i)
+        {
+            hr = (*g_benchmarks[i])(in, iterations, results);
+
+            if (FAILED(hr))
+                break;
+        }
+    }
+
+    if (FAILED(hr))
+        printf("      \"error\": \"0x%08lX\",\n", hr);
+
+    printf("      \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < results.size(); ++i)
+        PrintResult(results[i], i + 1 == results.size());
+
+    printf("      ]\n");
+    printf("    }%s\n", last ? "" : ",");
+
+    return SUCCEEDED(hr);
+}
+
+
+//Writes the synthetic file to disk, rather than benchmarking it.
+
+int SaveSynth(const SynthParams& synth, const wchar_t* filename)
+{
+    std::vector<unsigned char> data;
+
+    const HRESULT hr = Synthesize(synth, data);
+
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"webmbench: synth failed: 0x%08lX\n", hr);
+        return 1;
+    }
+
+    FILE* f;
+
+    if (_wfopen_s(&f, filename, L"wb") != 0)
+    {
+        fwprintf(stderr, L"webmbench: cannot open %s\n", filename);
+        return 1;
+    }
+
+    const size_t n = fwrite(&data[0], 1, data.size(), f);
+
+    if ((fclose(f) != 0) || (n != data.size()))
+    {
+        fwprintf(stderr, L"webmbench: cannot write %s\n", filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int Usage()
+{
+    fwprintf(stderr,
+             L"usage: webmbench [-n iterations] [-synth spec]... "
+             L"[-scenario name|all]... [file.webm]...\n"
+             L"       webmbench -synth spec -o file.webm\n"
+             L"       webmbench -compare baseline.json run.json "
+             L"[-tolerance percent]\n"
+             L"spec: preset[,name=value...] (see webmsynth.h)\n"
+             L"name: decode_4k_vp9, live_1080p, remux_multi, seek_storm, "
+             L"thumbnails\n");
+    return 2;
+}
+
+}  //end anon namespace
+
+
+int wmain(int argc, wchar_t* argv[])
+{
+    int iterations = 5;
+    const wchar_t* out = 0;
+    const wchar_t* baseline = 0;
+    const wchar_t* run = 0;
+    double tolerance = 10;
+
+    std::vector<Job> jobs;
+    std::vector<const char*> scenarios;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const wchar_t* const arg = argv[i];
+
+        if (wcscmp(arg, L"-n") == 0)
+        {
+            if (++i >= argc)
+                return Usage();
+
+            iterations = _wtoi(argv[i]);
+
+            if (iterations <= 0)
+                return Usage();
+        }
+        else if (wcscmp(arg, L"-synth") == 0)
+        {
+            if (++i >= argc)
+                return Usage();
+
+            Job job;
+            job.filename = 0;
+
+            if (FAILED(job.synth.Parse(argv[i])))
+            {
+                fwprintf(stderr, L"webmbench: bad spec: %s\n", argv[i]);
+                return Usage();
+            }
+
+            jobs.push_back(job);
+        }
+        else if (wcscmp(arg, L"-o") == 0)
+        {
+            if (++i >= argc)
+                return Usage();
+
+            out = argv[i];
+        }
+        else if (wcscmp(arg, L"-scenario") == 0)
+        {
+            if (++i >= argc)
+                return Usage();
+
+            const bool all = (wcscmp(argv[i], L"all") == 0);
+            bool found = false;
+
+            for (int j = 0; g_scenarios[j]; ++j)
+            {
+                const char* const name = g_scenarios[j];
+                const std::wstring wname(name, name + strlen(name));
+
+                if (all || (wname == argv[i]))
+                {
+                    scenarios.push_back(name);
+                    found = true;
+                }
+            }
+
+            if (!found)
+            {
+                fwprintf(stderr, L"webmbench: no scenario: %s\n", argv[i]);
+                return Usage();
+            }
+        }
+        else if (wcscmp(arg, L"-compare") == 0)
+        {
+            if ((i + 2) >= argc)
+                return Usage();
+
+            baseline = argv[++i];
+            run = argv[++i];
+        }
+        else if (wcscmp(arg, L"-tolerance") == 0)
+        {
+            if (++i >= argc)
+                return Usage();
+
+            tolerance = _wtof(argv[i]);
+
+            if (tolerance <= 0)
+                return Usage();
+        }
+        else
+        {
+            Job job;
+            job.filename = arg;
+
+            jobs.push_back(job);
+        }
+    }
+
+    if (baseline)
+    {
+        if (!jobs.empty() || !scenarios.empty() || out)
+            return Usage();
+
+        return Compare(baseline, run, tolerance);
+    }
+
+    if (jobs.empty() && scenarios.empty())
+        return Usage();
+
+    if (out && ((jobs.size() != 1) || jobs[0].filename || !scenarios.empty()))
+        return Usage();
+
+    const HRESULT hr = CoInitialize(0);
+
+    if (FAILED(hr))
+        return 1;
+
+    if (out)
+    {
+        const int status = SaveSynth(jobs[0].synth, out);
+        CoUninitialize();
+
+        return status;
+    }
+
+    bool ok = true;
+
+    printf("{\n");
+    printf("  \"iterations\": %d,\n", iterations);
+    printf("  \"files\": [\n");
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        if (!RunFile(jobs[i], iterations, i + 1 == jobs.size()))
+            ok = false;
+    }
+
+    printf("  ],\n");
+    printf("  \"scenarios\": [\n");
+
+    for (size_t i = 0; i < scenarios.size(); ++i)
+    {
+        const bool last = (i + 1 == scenarios.size());
+
+        if (!RunScenarioJob(scenarios[i], iterations, last))
+            ok = false;
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    CoUninitialize();
+
+    return ok ? 0 : 1;
+}
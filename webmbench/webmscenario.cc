@@ -0,0 +1,1689 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <comdef.h>
+#include <amvideo.h>
+#include <uuids.h>
+#include <vfwmsgs.h>
+#include "webmscenario.h"
+#include "webmsynth.h"
+#include "cmediasample.h"
+#include "cpuutil.h"
+#include "graphutil.h"
+#include "mkvparsermemreader.h"
+#include "mkvparserthumbnailer.h"
+#include "vorbistypes.h"
+#include "vpxdecoderpool.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamaudiovorbis.h"
+#include "webmmuxstreamvideovpx.h"
+#include "webmtypes.h"
+#include "vpx/vpx_decoder.h"
+#include "vpx/vpx_encoder.h"
+#include "vpx/vp8cx.h"
+#include "vpx/vp8dx.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <new>
+
+using webmdshow::PipelineCounters;
+
+namespace WebmBench
+{
+
+const char* const g_scenarios[] =
+{
+    "decode_4k_vp9",
+    "live_1080p",
+    "remux_multi",
+    "seek_storm",
+    "thumbnails",
+    0
+};
+
+
+namespace
+{
+
+typedef ScenarioResult::counters_t counters_t;
+
+//As fast as the encoders go in real time; the corpus and the live
+//scenario both want speed over quality.
+const int kCpuUsed = 8;
+
+
+//Adds the reading |s| to that of the stage of the same name in |cc|, so
+//that stages made again for each iteration are summed over them.
+
+void AddStats(const PipelineCounters::Stats& s, counters_t& cc)
+{
+    typedef counters_t::iterator iter_t;
+
+    for (iter_t i = cc.begin(); i != cc.end(); ++i)
+    {
+        PipelineCounters::Stats& t = *i;
+
+        if (wcscmp(t.name, s.name) != 0)
+            continue;
+
+        t.samples_in += s.samples_in;
+        t.samples_out += s.samples_out;
+        t.bytes_in += s.bytes_in;
+        t.bytes_out += s.bytes_out;
+        t.dropped += s.dropped;
+        t.busy_us += s.busy_us;
+        t.queue_depth = s.queue_depth;
+        t.queue_peak = std::max(t.queue_peak, s.queue_peak);
+
+        for (int j = 0; j < PipelineCounters::kHistogramBuckets; ++j)
+            t.histogram[j] += s.histogram[j];
+
+        return;
+    }
+
+    cc.push_back(s);
+}
+
+
+void AddCounters(const PipelineCounters& c, counters_t& cc)
+{
+    PipelineCounters::Stats s;
+    c.GetStats(&s);
+
+    AddStats(s, cc);
+}
+
+
+void InitResult(Result& r, const char* name, LONGLONG items, LONGLONG bytes)
+{
+    r.name = name;
+    r.items = items;
+    r.bytes = bytes;
+    r.times_us.clear();
+}
+
+
+//A linear congruential generator, so that the seek times are the same
+//from run to run.
+
+class Random
+{
+public:
+    explicit Random(ULONG seed) : m_x(seed)
+    {
+    }
+
+    //Returns a value from 0 up to, but not including, |n|.
+    LONGLONG Get(LONGLONG n)
+    {
+        m_x = m_x * 6364136223846793005ULL + 1442695040888963407ULL;
+        return LONGLONG((m_x >> 11) % ULONGLONG(n));
+    }
+
+private:
+    ULONGLONG m_x;
+
+};
+
+
+//The pictures of a synthetic capture source: a few frames of moving
+//bands and a grid, made once and cycled through, so that the encoder
+//sees motion and detail and the capture costs nothing per frame.
+
+class Camera
+{
+    Camera(const Camera&);
+    Camera& operator=(const Camera&);
+
+public:
+    enum { kPictures = 16 };
+
+    Camera();
+    ~Camera();
+
+    HRESULT Init(long width, long height);
+
+    const vpx_image_t* Get(long frame) const;
+
+private:
+    vpx_image_t* m_pictures[kPictures];
+
+};
+
+
+Camera::Camera()
+{
+    memset(m_pictures, 0, sizeof m_pictures);
+}
+
+
+Camera::~Camera()
+{
+    for (int i = 0; i < kPictures; ++i)
+        vpx_img_free(m_pictures[i]);
+}
+
+
+HRESULT Camera::Init(long w, long h)
+{
+    for (int i = 0; i < kPictures; ++i)
+    {
+        vpx_image_t* const img = vpx_img_alloc(0, VPX_IMG_FMT_I420, w, h, 16);
+
+        if (img == 0)
+            return E_OUTOFMEMORY;
+
+        m_pictures[i] = img;
+
+        const int shift = i * 4;  //pixels the bands move per frame
+
+        for (long y = 0; y < h; ++y)
+        {
+            BYTE* const p = img->planes[VPX_PLANE_Y] +
+                            y * img->stride[VPX_PLANE_Y];
+
+            for (long x = 0; x < w; ++x)
+            {
+                const int band = ((x + y + shift) >> 3) & 0x3F;
+                const int grid = (((x >> 4) ^ (y >> 4)) & 1) * 32;
+
+                p[x] = BYTE(64 + band * 2 + grid);
+            }
+        }
+
+        const long uv_w = (w + 1) / 2;
+        const long uv_h = (h + 1) / 2;
+
+        for (long y = 0; y < uv_h; ++y)
+        {
+            BYTE* const u = img->planes[VPX_PLANE_U] +
+                            y * img->stride[VPX_PLANE_U];
+
+            BYTE* const v = img->planes[VPX_PLANE_V] +
+                            y * img->stride[VPX_PLANE_V];
+
+            for (long x = 0; x < uv_w; ++x)
+            {
+                u[x] = BYTE(128 + (((x + shift) >> 4) & 0x1F));
+                v[x] = BYTE(128 - ((y >> 4) & 0x1F));
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+const vpx_image_t* Camera::Get(long frame) const
+{
+    return m_pictures[frame % kPictures];
+}
+
+
+//A clip for the encoder to make from the camera's pictures.
+
+struct Clip
+{
+    bool vp9;
+    long width;
+    long height;
+    long fps;
+    long frames;
+    long gop;      //frames from a keyframe to the next
+    long bitrate;  //kbps
+    bool live;     //muxed as a capture graph muxes, without Cues
+};
+
+
+HRESULT CreateAllocator(long count, long size, IMemAllocator** pp)
+{
+    HRESULT hr = CMediaSample::CreateAllocator(pp);
+
+    if (FAILED(hr))
+        return hr;
+
+    ALLOCATOR_PROPERTIES props, actual;
+
+    props.cBuffers = count;
+    props.cbBuffer = size;
+    props.cbAlign = 1;
+    props.cbPrefix = 0;
+
+    hr = (*pp)->SetProperties(&props, &actual);
+
+    if (FAILED(hr))
+        return hr;
+
+    return (*pp)->Commit();
+}
+
+
+void GetVideoMediaType(
+    bool vp9,
+    long width,
+    long height,
+    LONGLONG duration,
+    VIDEOINFOHEADER& vih,
+    AM_MEDIA_TYPE& mt)
+{
+    memset(&vih, 0, sizeof vih);
+
+    vih.AvgTimePerFrame = duration;
+
+    const GUID& subtype = vp9 ?
+                          WebmTypes::MEDIASUBTYPE_VP90 :
+                          WebmTypes::MEDIASUBTYPE_VP80;
+
+    BITMAPINFOHEADER& bmih = vih.bmiHeader;
+
+    bmih.biSize = sizeof bmih;
+    bmih.biWidth = width;
+    bmih.biHeight = height;
+    bmih.biPlanes = 1;
+    bmih.biCompression = subtype.Data1;
+
+    memset(&mt, 0, sizeof mt);
+
+    mt.majortype = MEDIATYPE_Video;
+    mt.subtype = subtype;
+    mt.formattype = FORMAT_VideoInfo;
+    mt.cbFormat = sizeof vih;
+    mt.pbFormat = reinterpret_cast<BYTE*>(&vih);
+}
+
+
+//Hands frames to a muxer stream in samples of its own allocators, one
+//for keyframes and one for the frames between, as an upstream filter
+//would.  The muxer holds the frames of a cluster or two, for which the
+//allocators have buffers enough; rather than waiting forever if they do
+//not, Send fails.
+
+class Sender
+{
+    Sender(const Sender&);
+    Sender& operator=(const Sender&);
+
+public:
+    Sender();
+    ~Sender();
+
+    HRESULT Init(long gop, long max_key, long max_frame);
+
+    HRESULT Send(
+        WebmMuxLib::Stream*,
+        const void* data,
+        long len,
+        LONGLONG time,
+        LONGLONG duration,  //0 if unknown
+        bool key);
+
+private:
+    GraphUtil::IMemAllocatorPtr m_pKeys;
+    GraphUtil::IMemAllocatorPtr m_pFrames;
+
+};
+
+
+Sender::Sender()
+{
+}
+
+
+Sender::~Sender()
+{
+    if (m_pKeys)
+        m_pKeys->Decommit();
+
+    if (m_pFrames)
+        m_pFrames->Decommit();
+}
+
+
+HRESULT Sender::Init(long gop, long max_key, long max_frame)
+{
+    const long held = 2 * gop + 16;
+
+    HRESULT hr = CreateAllocator(held / gop + 4, max_key, &m_pKeys);
+
+    if (FAILED(hr))
+        return hr;
+
+    return CreateAllocator(held, max_frame, &m_pFrames);
+}
+
+
+HRESULT Sender::Send(
+    WebmMuxLib::Stream* pStream,
+    const void* data,
+    long len,
+    LONGLONG time,
+    LONGLONG duration,
+    bool key)
+{
+    IMemAllocator* const pAllocator = key ? m_pKeys : m_pFrames;
+
+    GraphUtil::IMediaSamplePtr pSample;
+
+    HRESULT hr = pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (len > pSample->GetSize())
+        return VFW_E_BUFFER_OVERFLOW;
+
+    BYTE* ptr;
+
+    hr = pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+
+    memcpy(ptr, data, len);
+
+    hr = pSample->SetActualDataLength(len);
+    assert(SUCCEEDED(hr));
+
+    LONGLONG st = time;
+    LONGLONG sp = time + duration;
+
+    hr = pSample->SetTime(&st, (sp > st) ? &sp : 0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSyncPoint(key ? TRUE : FALSE);
+    assert(SUCCEEDED(hr));
+
+    return pStream->Receive(pSample);
+}
+
+
+HRESULT ReadStream(IStream* pStream, std::vector<unsigned char>& data)
+{
+    STATSTG stg;
+
+    HRESULT hr = pStream->Stat(&stg, STATFLAG_NONAME);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (stg.cbSize.QuadPart > LONG_MAX)  //as Input::Load allows
+        return E_FAIL;
+
+    const ULONG size = stg.cbSize.LowPart;
+
+    data.resize(size);
+
+    if (size == 0)
+        return S_OK;
+
+    LARGE_INTEGER pos;
+    pos.QuadPart = 0;
+
+    hr = pStream->Seek(pos, STREAM_SEEK_SET, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    ULONG cb;
+
+    hr = pStream->Read(&data[0], size, &cb);
+
+    if (FAILED(hr) || (cb != size))
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+HRESULT InitEncoder(const Clip& c, vpx_codec_ctx_t* ctx)
+{
+    vpx_codec_iface_t* const codec =
+        c.vp9 ? &vpx_codec_vp9_cx_algo : &vpx_codec_vp8_cx_algo;
+
+    vpx_codec_enc_cfg_t cfg;
+
+    if (vpx_codec_enc_config_default(codec, &cfg, 0) != VPX_CODEC_OK)
+        return E_FAIL;
+
+    cfg.g_w = c.width;
+    cfg.g_h = c.height;
+    cfg.g_timebase.num = 1;
+    cfg.g_timebase.den = 1000;  //ms, as the encoder filter has
+    cfg.g_threads = webmdshow::GetVpxDecoderThreadCount(0, c.vp9, c.width);
+    cfg.g_lag_in_frames = 0;  //in real time
+    cfg.rc_end_usage = VPX_CBR;
+    cfg.rc_target_bitrate = c.bitrate;
+    cfg.kf_min_dist = c.gop;
+    cfg.kf_max_dist = c.gop;
+
+    if (vpx_codec_enc_init(ctx, codec, &cfg, 0) != VPX_CODEC_OK)
+        return E_FAIL;
+
+    if (vpx_codec_control(ctx, VP8E_SET_CPUUSED, kCpuUsed) != VPX_CODEC_OK)
+    {
+        vpx_codec_destroy(ctx);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+//Encodes |clip| from the camera's pictures, and muxes each frame as the
+//encoder gives it to a WebmMuxLib::Context writing to |pStream|.  The
+//encoder and the muxer are timed as stages of |counters|, which may be 0.
+
+HRESULT EncodeClip(
+    const Clip& clip,
+    const Camera& camera,
+    IStream* pStream,
+    counters_t* pCounters)
+{
+    using namespace WebmMuxLib;
+
+    //A keyframe is taken to be no larger than half the picture, and any
+    //other frame than an eighth of it, which at the bitrates of the clips
+    //is many times what they need.
+
+    const long picture = clip.width * clip.height * 3 / 2;
+
+    Sender sender;
+
+    HRESULT hr = sender.Init(clip.gop, picture / 2, picture / 8);
+
+    if (FAILED(hr))
+        return hr;
+
+    vpx_codec_ctx_t enc;
+
+    hr = InitEncoder(clip, &enc);
+
+    if (FAILED(hr))
+        return hr;
+
+    PipelineCounters encode_counters(L"webmbench.encode");
+
+    const LONGLONG duration = 10000000 / clip.fps;  //reftime units
+
+    VIDEOINFOHEADER vih;
+    AM_MEDIA_TYPE mt;
+
+    GetVideoMediaType(clip.vp9, clip.width, clip.height, duration, vih, mt);
+
+    Context ctx;
+
+    if (clip.live)
+    {
+        ctx.SetLiveMuxMode(true);
+        ctx.SetClusterAssembly(true);  //known cluster sizes
+    }
+
+    StreamVideo* const pVideo = new (std::nothrow) StreamVideoVPx(ctx, mt);
+
+    if (pVideo == 0)
+    {
+        vpx_codec_destroy(&enc);
+        return E_OUTOFMEMORY;
+    }
+
+    ctx.SetVideoStream(pVideo);
+    ctx.Open(pStream);
+
+    //One more pass than there are frames, to flush the encoder.
+
+    for (long i = 0; SUCCEEDED(hr) && (i <= clip.frames); ++i)
+    {
+        const vpx_image_t* const img = (i < clip.frames) ? camera.Get(i) : 0;
+
+        const vpx_codec_pts_t pts = vpx_codec_pts_t(i) * 1000 / clip.fps;
+        const unsigned long ms = 1000 / clip.fps;
+
+        {
+            PipelineCounters::Timer timer(encode_counters);
+
+            if (img)
+                encode_counters.OnSampleIn(picture);
+
+            const vpx_codec_err_t err = vpx_codec_encode(
+                                            &enc,
+                                            img,
+                                            pts,
+                                            ms,
+                                            0,
+                                            VPX_DL_REALTIME);
+
+            if (err != VPX_CODEC_OK)
+            {
+                hr = E_FAIL;
+                break;
+            }
+        }
+
+        vpx_codec_iter_t iter = 0;
+
+        while (const vpx_codec_cx_pkt_t* pkt =
+                    vpx_codec_get_cx_data(&enc, &iter))
+        {
+            if (pkt->kind != VPX_CODEC_CX_FRAME_PKT)
+                continue;
+
+            const long len = long(pkt->data.frame.sz);
+            const bool key = (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
+
+            encode_counters.OnSampleOut(len);
+
+            hr = sender.Send(
+                    pVideo,
+                    pkt->data.frame.buf,
+                    len,
+                    LONGLONG(pkt->data.frame.pts) * 10000,
+                    duration,
+                    key);
+
+            if (FAILED(hr))
+                break;
+        }
+    }
+
+    ctx.Close();
+
+    if (pCounters)
+    {
+        AddCounters(encode_counters, *pCounters);
+        AddCounters(ctx.m_counters, *pCounters);
+        AddCounters(ctx.m_write_counters, *pCounters);
+    }
+
+    ctx.SetVideoStream(0);
+    delete pVideo;
+
+    vpx_codec_destroy(&enc);
+
+    return FAILED(hr) ? hr : S_OK;
+}
+
+
+//Encodes |clip| into |seed|, for a corpus whose frames must decode.
+
+HRESULT MakeSeed(const Clip& clip, Input& seed)
+{
+    Camera camera;
+
+    HRESULT hr = camera.Init(clip.width, clip.height);
+
+    if (FAILED(hr))
+        return hr;
+
+    IStreamPtr pStream;
+
+    hr = CreateStreamOnHGlobal(0, TRUE, &pStream);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = EncodeClip(clip, camera, pStream, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    seed.filename = L"clip";
+
+    hr = ReadStream(pStream, seed.data);
+
+    if (FAILED(hr))
+        return hr;
+
+    return seed.Parse();
+}
+
+
+//Makes the synthetic file |spec| (with |seed|, if not 0, in place of its
+//seed file) into |in|.
+
+HRESULT MakeCorpus(const wchar_t* spec, const Input* seed, Input& in)
+{
+    SynthParams p;
+
+    HRESULT hr = p.Parse(spec);
+
+    if (FAILED(hr))
+        return hr;
+
+    in.filename = L"synth:" + p.spec;
+
+    if (seed)
+        hr = Synthesize(p, *seed, in.data);
+    else
+        hr = Synthesize(p, in.data);
+
+    if (FAILED(hr))
+        return hr;
+
+    return in.Parse();
+}
+
+
+std::string ToString(const std::wstring& s)
+{
+    return std::string(s.begin(), s.end());  //a spec is ASCII
+}
+
+
+//An open segment of a file held in memory.
+
+class Source
+{
+    Source(const Source&);
+    Source& operator=(const Source&);
+
+public:
+    explicit Source(const Input&);
+    ~Source();
+
+    //Parses every cluster if |load|, else only the headers and the Cues,
+    //as the splitter and the source do when they open a file.
+    HRESULT Open(bool load);
+
+    mkvparser::MemReader m_reader;
+    mkvparser::Segment* m_pSegment;
+
+};
+
+
+Source::Source(const Input& in) :
+    m_reader(in.data.empty() ? 0 : &in.data[0], in.data.size()),
+    m_pSegment(0)
+{
+}
+
+
+Source::~Source()
+{
+    delete m_pSegment;
+}
+
+
+HRESULT Source::Open(bool load)
+{
+    assert(m_pSegment == 0);
+
+    long long pos = 0;
+
+    mkvparser::EBMLHeader h;
+
+    long long result = h.Parse(&m_reader, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = mkvparser::Segment::CreateInstance(&m_reader, pos, m_pSegment);
+
+    if (result < 0)
+        return E_FAIL;
+
+    assert(m_pSegment);
+
+    if (load)
+        result = m_pSegment->Load();
+    else
+        result = m_pSegment->ParseHeaders();
+
+    if (result < 0)
+        return E_FAIL;
+
+    if (m_pSegment->GetTracks() == 0)
+        return E_FAIL;
+
+    if (load || m_pSegment->GetCues())
+        return S_OK;
+
+    //The Cues follow the clusters, and are found through the SeekHead.
+
+    using mkvparser::SeekHead;
+
+    if (const SeekHead* const pSH = m_pSegment->GetSeekHead())
+    {
+        for (int idx = 0; idx < pSH->GetCount(); ++idx)
+        {
+            const SeekHead::Entry* const p = pSH->GetEntry(idx);
+
+            if (p->id == 0x0C53BB6B)  //Cues ID
+            {
+                long len;
+
+                if (m_pSegment->ParseCues(p->pos, pos, len) < 0)
+                    return E_FAIL;
+
+                break;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+const mkvparser::Track* GetVideoTrack(const mkvparser::Segment* pSegment)
+{
+    const mkvparser::Tracks* const pTracks = pSegment->GetTracks();
+
+    for (unsigned long i = 0; i < pTracks->GetTracksCount(); ++i)
+    {
+        const mkvparser::Track* const t = pTracks->GetTrackByIndex(i);
+
+        if ((t != 0) && (t->GetType() == 1))  //video
+            return t;
+    }
+
+    return 0;
+}
+
+
+HRESULT RunDecode4k(int iterations, ScenarioResult& s)
+{
+    Clip clip;
+
+    clip.vp9 = true;
+    clip.width = 3840;
+    clip.height = 2160;
+    clip.fps = 30;
+    clip.frames = 30;
+    clip.gop = 30;
+    clip.bitrate = 20000;
+    clip.live = false;
+
+    Input seed;
+
+    HRESULT hr = MakeSeed(clip, seed);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The seed's second of video, from its keyframe, repeated.
+
+    const wchar_t spec[] = L"default,seconds=10,audio_tracks=0";
+
+    Input in;
+
+    hr = MakeCorpus(spec, &seed, in);
+
+    if (FAILED(hr))
+        return hr;
+
+    s.corpus = "synth:" + ToString(spec) + ",seed=vp9 3840x2160";
+
+    webmdshow::VpxDecoderPool::Key key;
+
+    key.iface = &vpx_codec_vp9_dx_algo;
+    key.flags = 0;
+    key.threads = webmdshow::GetVpxDecoderThreadCount(0, true, in.width);
+    key.width = in.width;
+    key.height = in.height;
+
+    webmdshow::VpxDecoderPool& pool = webmdshow::VpxDecoderPool::Get();
+
+    Result r;
+    InitResult(r, "decode_4k_vp9", in.frames.size(), in.data.size());
+
+    std::vector<unsigned char> buf;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        PipelineCounters read_counters(L"webmbench.read");
+        PipelineCounters decode_counters(L"webmbench.decode");
+
+        vpx_codec_ctx_t ctx;
+
+        if (pool.Borrow(key, &ctx) != VPX_CODEC_OK)
+            return E_FAIL;
+
+        const LONGLONG start = PipelineCounters::Now();
+
+        Source src(in);
+
+        hr = src.Open(true);
+
+        const mkvparser::Segment* const pSegment = src.m_pSegment;
+
+        const mkvparser::Track* const pTrack = SUCCEEDED(hr) ?
+                                               GetVideoTrack(pSegment) :
+                                               0;
+
+        if (pTrack == 0)
+            hr = E_FAIL;
+
+        const mkvparser::BlockEntry* pEntry = 0;
+
+        if (SUCCEEDED(hr) && (pTrack->GetFirst(pEntry) < 0))
+            hr = E_FAIL;
+
+        LONGLONG shown = 0;
+
+        while (SUCCEEDED(hr) && (pEntry != 0) && !pEntry->EOS())
+        {
+            const mkvparser::Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const mkvparser::Block::Frame& f = pBlock->GetFrame(0);
+
+            {
+                PipelineCounters::Timer timer(read_counters);
+
+                if (buf.size() < size_t(f.len))
+                    buf.resize(f.len);
+
+                if (f.Read(&src.m_reader, &buf[0]) != 0)
+                {
+                    hr = E_FAIL;
+                    break;
+                }
+
+                read_counters.OnSampleIn(f.len);
+                read_counters.OnSampleOut(f.len);
+            }
+
+            {
+                PipelineCounters::Timer timer(decode_counters);
+
+                decode_counters.OnSampleIn(f.len);
+
+                const vpx_codec_err_t err =
+                    vpx_codec_decode(&ctx, &buf[0], f.len, 0, 0);
+
+                if (err != VPX_CODEC_OK)
+                {
+                    hr = E_FAIL;
+                    break;
+                }
+
+                //The null renderer: each image is taken, and dropped.
+
+                vpx_codec_iter_t iter = 0;
+
+                while (const vpx_image_t* img =
+                            vpx_codec_get_frame(&ctx, &iter))
+                {
+                    decode_counters.OnSampleOut(img->d_w * img->d_h * 3 / 2);
+                    ++shown;
+                }
+            }
+
+            if (pTrack->GetNext(pEntry, pEntry) < 0)
+                hr = E_FAIL;
+        }
+
+        const LONGLONG elapsed = PipelineCounters::Now() - start;
+
+        pool.Return(key, &ctx);
+
+        if (FAILED(hr))
+            return hr;
+
+        if (iteration > 0)
+        {
+            r.times_us.push_back(elapsed);
+
+            AddCounters(read_counters, s.counters);
+            AddCounters(decode_counters, s.counters);
+        }
+
+        r.items = shown;
+    }
+
+    s.results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT RunLive1080p(int iterations, ScenarioResult& s)
+{
+    Clip clip;
+
+    clip.vp9 = false;
+    clip.width = 1920;
+    clip.height = 1080;
+    clip.fps = 30;
+    clip.frames = 10 * clip.fps;
+    clip.gop = clip.fps;  //a keyframe a second, as live streams have
+    clip.bitrate = 4000;
+    clip.live = true;
+
+    s.corpus = "capture:vp8 1920x1080 30fps 10s";
+
+    Camera camera;
+
+    HRESULT hr = camera.Init(clip.width, clip.height);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The items are frames, so that items_per_s against the frame rate is
+    //the speed relative to real time.
+
+    Result r;
+    InitResult(r, "live_1080p", clip.frames, 0);
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        IStreamPtr pStream;
+
+        hr = CreateStreamOnHGlobal(0, TRUE, &pStream);
+
+        if (FAILED(hr))
+            return hr;
+
+        counters_t counters;
+
+        const LONGLONG start = PipelineCounters::Now();
+
+        hr = EncodeClip(clip, camera, pStream, &counters);
+
+        const LONGLONG elapsed = PipelineCounters::Now() - start;
+
+        if (FAILED(hr))
+            return hr;
+
+        STATSTG stg;
+
+        hr = pStream->Stat(&stg, STATFLAG_NONAME);
+
+        if (FAILED(hr))
+            return hr;
+
+        r.bytes = stg.cbSize.QuadPart;
+
+        if (iteration > 0)
+        {
+            r.times_us.push_back(elapsed);
+
+            typedef counters_t::const_iterator iter_t;
+
+            for (iter_t i = counters.begin(); i != counters.end(); ++i)
+                AddStats(*i, s.counters);
+        }
+    }
+
+    s.results.push_back(r);
+    return S_OK;
+}
+
+
+//Copies every block of the VP8 or VP9 track and of the Vorbis tracks of
+//|in| into a new file, as a remuxer does: no frame is decoded.
+
+HRESULT Remux(
+    const Input& in,
+    Sender& video_sender,
+    Sender& audio_sender,
+    IStream* pStream,
+    counters_t& counters)
+{
+    using namespace WebmMuxLib;
+
+    Source src(in);
+
+    HRESULT hr = src.Open(true);
+
+    if (FAILED(hr))
+        return hr;
+
+    const mkvparser::Segment* const pSegment = src.m_pSegment;
+    const mkvparser::Tracks* const pTracks = pSegment->GetTracks();
+
+    PipelineCounters read_counters(L"webmbench.read");
+
+    Context ctx;
+
+    VIDEOINFOHEADER vih;
+    AM_MEDIA_TYPE mt;
+
+    StreamVideo* pVideo = 0;
+    long long video_number = -1;
+
+    std::vector<std::vector<BYTE> > formats(pTracks->GetTracksCount());
+
+    typedef std::vector<std::pair<long long, Stream*> > streams_t;
+    streams_t audio;
+
+    for (unsigned long i = 0; i < pTracks->GetTracksCount(); ++i)
+    {
+        const mkvparser::Track* const t = pTracks->GetTrackByIndex(i);
+
+        if (t == 0)
+            continue;
+
+        const char* const id = t->GetCodecId();
+
+        if (id == 0)
+            continue;
+
+        if ((t->GetType() == 1) && (pVideo == 0))  //video
+        {
+            const bool vp9 = (strcmp(id, "V_VP9") == 0);
+
+            if (!vp9 && (strcmp(id, "V_VP8") != 0))
+                continue;
+
+            const mkvparser::VideoTrack* const v =
+                static_cast<const mkvparser::VideoTrack*>(t);
+
+            GetVideoMediaType(
+                vp9,
+                static_cast<long>(v->GetWidth()),
+                static_cast<long>(v->GetHeight()),
+                in.frame_duration,
+                vih,
+                mt);
+
+            pVideo = new (std::nothrow) StreamVideoVPx(ctx, mt);
+
+            if (pVideo == 0)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+
+            ctx.SetVideoStream(pVideo);
+            video_number = t->GetNumber();
+        }
+        else if ((t->GetType() == 2) && (strcmp(id, "A_VORBIS") == 0))
+        {
+            const mkvparser::AudioTrack* const a =
+                static_cast<const mkvparser::AudioTrack*>(t);
+
+            size_t size;
+
+            const unsigned char* const cp = a->GetCodecPrivate(size);
+
+            if (cp == 0)
+                continue;
+
+            std::vector<BYTE>& format = formats[i];
+
+            if (!GetVorbisFormat(
+                    std::vector<BYTE>(cp, cp + size),
+                    static_cast<long>(a->GetSamplingRate()),
+                    static_cast<long>(a->GetChannels()),
+                    format))
+            {
+                continue;
+            }
+
+            memset(&mt, 0, sizeof mt);
+
+            mt.majortype = MEDIATYPE_Audio;
+            mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2;
+            mt.formattype = VorbisTypes::FORMAT_Vorbis2;
+            mt.cbFormat = ULONG(format.size());
+            mt.pbFormat = &format[0];
+
+            StreamAudio* const pAudio =
+                StreamAudioVorbis::CreateStream(ctx, mt);
+
+            if (pAudio == 0)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+
+            ctx.AddAudioStream(pAudio);
+            audio.push_back(std::make_pair(t->GetNumber(), pAudio));
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ctx.Open(pStream);
+
+        std::vector<unsigned char> buf;
+
+        for (const mkvparser::Cluster* pCluster = pSegment->GetFirst();
+             SUCCEEDED(hr) && (pCluster != 0) && !pCluster->EOS();
+             pCluster = pSegment->GetNext(pCluster))
+        {
+            const mkvparser::BlockEntry* pEntry;
+
+            long status = pCluster->GetFirst(pEntry);
+
+            while (SUCCEEDED(hr) && (status >= 0) &&
+                   (pEntry != 0) && !pEntry->EOS())
+            {
+                const mkvparser::Block* const pBlock = pEntry->GetBlock();
+                assert(pBlock);
+
+                const long long n = pBlock->GetTrackNumber();
+
+                Stream* pDst = (n == video_number) ? pVideo : 0;
+
+                typedef streams_t::const_iterator iter_t;
+
+                for (iter_t i = audio.begin(); !pDst && i != audio.end(); ++i)
+                {
+                    if (i->first == n)
+                        pDst = i->second;
+                }
+
+                const LONGLONG t = pBlock->GetTime(pCluster) / 100;
+
+                for (int i = 0; pDst && (i < pBlock->GetFrameCount()); ++i)
+                {
+                    const mkvparser::Block::Frame& f = pBlock->GetFrame(i);
+
+                    {
+                        PipelineCounters::Timer timer(read_counters);
+
+                        if (buf.size() < size_t(f.len))
+                            buf.resize(f.len);
+
+                        if (f.Read(&src.m_reader, &buf[0]) != 0)
+                        {
+                            hr = E_FAIL;
+                            break;
+                        }
+
+                        read_counters.OnSampleIn(f.len);
+                        read_counters.OnSampleOut(f.len);
+                    }
+
+                    if (pDst == pVideo)
+                        hr = video_sender.Send(
+                                pVideo,
+                                &buf[0],
+                                f.len,
+                                t,
+                                in.frame_duration,
+                                pBlock->IsKey());
+                    else
+                        hr = audio_sender.Send(
+                                pDst,
+                                &buf[0],
+                                f.len,
+                                t,
+                                0,
+                                true);
+
+                    if (FAILED(hr))
+                        break;
+                }
+
+                status = pCluster->GetNext(pEntry, pEntry);
+            }
+
+            if (status < 0)
+                hr = E_FAIL;
+        }
+
+        ctx.Close();
+
+        AddCounters(read_counters, counters);
+        AddCounters(ctx.m_counters, counters);
+        AddCounters(ctx.m_write_counters, counters);
+    }
+
+    typedef streams_t::const_iterator iter_t;
+
+    for (iter_t i = audio.begin(); i != audio.end(); ++i)
+    {
+        ctx.RemoveAudioStream(static_cast<StreamAudio*>(i->second));
+        delete i->second;
+    }
+
+    ctx.SetVideoStream(0);
+    delete pVideo;
+
+    return FAILED(hr) ? hr : S_OK;
+}
+
+
+HRESULT RunRemux(int iterations, ScenarioResult& s)
+{
+    const wchar_t spec[] = L"multi_audio";
+
+    Input in;
+
+    HRESULT hr = MakeCorpus(spec, 0, in);
+
+    if (FAILED(hr))
+        return hr;
+
+    s.corpus = "synth:" + ToString(spec);
+
+    if (in.frames.empty() || !in.frames.front().key)
+        return E_FAIL;
+
+    long max_key = 1;
+    long max_frame = 1;
+    long gop = 1;
+    long max_gop = 1;
+
+    typedef Input::frames_t::const_iterator iter_t;
+
+    for (iter_t i = in.frames.begin(); i != in.frames.end(); ++i)
+    {
+        if (i->key)
+        {
+            max_key = std::max(max_key, i->len);
+            gop = 1;
+        }
+        else
+        {
+            max_frame = std::max(max_frame, i->len);
+            max_gop = std::max(max_gop, ++gop);
+        }
+    }
+
+    Sender video_sender;
+
+    hr = video_sender.Init(max_gop, max_key, max_frame);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The audio streams copy each block, so the samples come straight
+    //back; the tracks after the first have blocks of their own sizes.
+
+    enum { kMaxAudioFrame = 256 * 1024 };
+
+    Sender audio_sender;
+
+    hr = audio_sender.Init(1, kMaxAudioFrame, kMaxAudioFrame);
+
+    if (FAILED(hr))
+        return hr;
+
+    Result r;
+    InitResult(r, "remux_multi", 0, in.data.size());
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        IStreamPtr pStream;
+
+        hr = CreateStreamOnHGlobal(0, TRUE, &pStream);
+
+        if (FAILED(hr))
+            return hr;
+
+        counters_t counters;
+
+        const LONGLONG start = PipelineCounters::Now();
+
+        hr = Remux(in, video_sender, audio_sender, pStream, counters);
+
+        const LONGLONG elapsed = PipelineCounters::Now() - start;
+
+        if (FAILED(hr))
+            return hr;
+
+        if (iteration > 0)
+        {
+            r.times_us.push_back(elapsed);
+
+            typedef counters_t::const_iterator iter_t;
+
+            for (iter_t i = counters.begin(); i != counters.end(); ++i)
+            {
+                AddStats(*i, s.counters);
+
+                if (wcscmp(i->name, L"webmbench.read") == 0)
+                    r.items = i->samples_out;  //the frames copied
+            }
+        }
+    }
+
+    s.results.push_back(r);
+    return S_OK;
+}
+
+
+HRESULT RunSeekStorm(int iterations, ScenarioResult& s)
+{
+    enum { kSeeks = 500 };
+
+    const wchar_t spec[] = L"long,seconds=7200";
+
+    Input in;
+
+    HRESULT hr = MakeCorpus(spec, 0, in);
+
+    if (FAILED(hr))
+        return hr;
+
+    s.corpus = "synth:" + ToString(spec);
+
+    if (in.frames.empty())
+        return E_FAIL;
+
+    const LONGLONG duration_ns = in.frames.back().time * 100;
+
+    //The open is that of the source, which reads the headers and the
+    //Cues and none of the clusters; each seek then reads the cluster of
+    //its keyframe, as the source preloads it.
+
+    Result open;
+    InitResult(open, "seek_open", 1, 0);
+
+    Result storm;
+    InitResult(storm, "seek_storm", kSeeks, 0);
+
+    std::vector<unsigned char> buf;
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        PipelineCounters seek_counters(L"webmbench.seek");
+
+        const LONGLONG t0 = PipelineCounters::Now();
+
+        Source src(in);
+
+        hr = src.Open(false);
+
+        if (FAILED(hr))
+            return hr;
+
+        const mkvparser::Segment* const pSegment = src.m_pSegment;
+        const mkvparser::Cues* const pCues = pSegment->GetCues();
+        const mkvparser::Track* const pTrack = GetVideoTrack(pSegment);
+
+        if ((pCues == 0) || (pTrack == 0))
+            return E_FAIL;
+
+        while (!pCues->DoneParsing())
+            pCues->LoadCuePoint();
+
+        const LONGLONG t1 = PipelineCounters::Now();
+
+        Random random(1);  //the same seeks in each iteration
+        LONGLONG bytes = 0;
+
+        for (int i = 0; i < kSeeks; ++i)
+        {
+            PipelineCounters::Timer timer(seek_counters);
+
+            const LONGLONG time_ns = random.Get(duration_ns);
+
+            using mkvparser::CuePoint;
+
+            const CuePoint* pCP;
+            const CuePoint::TrackPosition* pTP;
+
+            if (!pCues->Find(time_ns, pTrack, pCP, pTP))
+                return E_FAIL;
+
+            const mkvparser::BlockEntry* const pEntry =
+                pCues->GetBlock(pCP, pTP);
+
+            if ((pEntry == 0) || pEntry->EOS())
+                return E_FAIL;
+
+            const mkvparser::Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            const mkvparser::Block::Frame& f = pBlock->GetFrame(0);
+
+            if (buf.size() < size_t(f.len))
+                buf.resize(f.len);
+
+            if (f.Read(&src.m_reader, &buf[0]) != 0)
+                return E_FAIL;
+
+            seek_counters.OnSampleIn(1);
+            seek_counters.OnSampleOut(f.len);
+
+            bytes += f.len;
+        }
+
+        const LONGLONG t2 = PipelineCounters::Now();
+
+        storm.bytes = bytes;
+
+        if (iteration > 0)
+        {
+            open.times_us.push_back(t1 - t0);
+            storm.times_us.push_back(t2 - t1);
+
+            AddCounters(seek_counters, s.counters);
+        }
+    }
+
+    s.results.push_back(open);
+    s.results.push_back(storm);
+
+    return S_OK;
+}
+
+
+//The thumbnailer reads a file of its own, so the corpus is written to
+//one, which is deleted when the scenario is done.
+
+class TempFile
+{
+    TempFile(const TempFile&);
+    TempFile& operator=(const TempFile&);
+
+public:
+    TempFile();
+    ~TempFile();
+
+    HRESULT Create(const std::vector<unsigned char>& data);
+
+    const wchar_t* GetName() const;
+
+private:
+    wchar_t m_name[MAX_PATH];
+    bool m_bCreated;
+
+};
+
+
+TempFile::TempFile() : m_bCreated(false)
+{
+    m_name[0] = L'\0';
+}
+
+
+TempFile::~TempFile()
+{
+    if (m_bCreated)
+        DeleteFileW(m_name);
+}
+
+
+HRESULT TempFile::Create(const std::vector<unsigned char>& data)
+{
+    wchar_t path[MAX_PATH];
+
+    const DWORD n = GetTempPathW(MAX_PATH, path);
+
+    if ((n == 0) || (n >= MAX_PATH))
+        return E_FAIL;
+
+    if (GetTempFileNameW(path, L"wmb", 0, m_name) == 0)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    m_bCreated = true;  //GetTempFileName has made it
+
+    const HANDLE h = CreateFileW(
+                        m_name,
+                        GENERIC_WRITE,
+                        0,
+                        0,
+                        CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_TEMPORARY,
+                        0);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    DWORD cb = 0;
+
+    const BOOL b = data.empty() ||
+                   WriteFile(h, &data[0], DWORD(data.size()), &cb, 0);
+
+    const DWORD e = b ? 0 : GetLastError();
+
+    CloseHandle(h);
+
+    if (!b)
+        return HRESULT_FROM_WIN32(e);
+
+    return (cb == data.size()) ? S_OK : E_FAIL;
+}
+
+
+const wchar_t* TempFile::GetName() const
+{
+    return m_name;
+}
+
+
+HRESULT RunThumbnails(int iterations, ScenarioResult& s)
+{
+    enum { kThumbnails = 100 };
+    enum { kWidth = 160, kHeight = 90 };
+
+    Clip clip;
+
+    clip.vp9 = false;
+    clip.width = 640;
+    clip.height = 360;
+    clip.fps = 30;
+    clip.frames = 60;
+    clip.gop = 60;
+    clip.bitrate = 800;
+    clip.live = false;
+
+    Input seed;
+
+    HRESULT hr = MakeSeed(clip, seed);
+
+    if (FAILED(hr))
+        return hr;
+
+    //A keyframe every 2 s, from the seed's, repeated.
+
+    const wchar_t spec[] = L"default,seconds=600,audio_tracks=0";
+
+    Input in;
+
+    hr = MakeCorpus(spec, &seed, in);
+
+    if (FAILED(hr))
+        return hr;
+
+    s.corpus = "synth:" + ToString(spec) + ",seed=vp8 640x360";
+
+    TempFile file;
+
+    hr = file.Create(in.data);
+
+    if (FAILED(hr))
+        return hr;
+
+    const LONGLONG duration_ns = LONGLONG(600) * 1000000000;
+
+    LONGLONG times_ns[kThumbnails];
+
+    for (int i = 0; i < kThumbnails; ++i)
+        times_ns[i] = duration_ns * i / kThumbnails;
+
+    using mkvparser::Thumbnailer;
+
+    Result r;
+    InitResult(r, "thumbnails", kThumbnails, in.data.size());
+
+    for (int iteration = 0; iteration <= iterations; ++iteration)
+    {
+        PipelineCounters thumbnail_counters(L"webmbench.thumbnail");
+
+        Thumbnailer::Thumbnail thumbnails[kThumbnails];
+        memset(thumbnails, 0, sizeof thumbnails);
+
+        const LONGLONG start = PipelineCounters::Now();
+
+        hr = Thumbnailer::Extract(
+                file.GetName(),
+                times_ns,
+                kThumbnails,
+                kWidth,
+                kHeight,
+                0,  //a thread per logical processor
+                thumbnails);
+
+        const LONGLONG elapsed = PipelineCounters::Now() - start;
+
+        thumbnail_counters.AddProcessingTime(elapsed);
+
+        for (int i = 0; i < kThumbnails; ++i)
+        {
+            thumbnail_counters.OnSampleIn(0);
+
+            if (thumbnails[i].hr == S_OK)
+                thumbnail_counters.OnSampleOut(kWidth * kHeight * 3 / 2);
+            else
+                thumbnail_counters.OnDrop();
+        }
+
+        Thumbnailer::Free(thumbnails, kThumbnails);
+
+        if (hr != S_OK)  //all of them, or it is not the same batch
+            return FAILED(hr) ? hr : E_FAIL;
+
+        if (iteration > 0)
+        {
+            r.times_us.push_back(elapsed);
+            AddCounters(thumbnail_counters, s.counters);
+        }
+    }
+
+    s.results.push_back(r);
+    return S_OK;
+}
+
+
+typedef HRESULT (*scenario_t)(int, ScenarioResult&);
+
+//In the order of g_scenarios.
+const scenario_t g_run[] =
+{
+    RunDecode4k,
+    RunLive1080p,
+    RunRemux,
+    RunSeekStorm,
+    RunThumbnails,
+};
+
+
+}  //end anon namespace
+
+
+HRESULT RunScenario(const char* name, int iterations, ScenarioResult& s)
+{
+    assert(name);
+
+    const int n = sizeof g_run / sizeof g_run[0];
+
+    for (int i = 0; i < n; ++i)
+    {
+        assert(g_scenarios[i]);
+
+        if (strcmp(g_scenarios[i], name) != 0)
+            continue;
+
+        s.name = name;
+        s.corpus.clear();
+        s.results.clear();
+        s.counters.clear();
+
+        return (*g_run[i])(iterations, s);
+    }
+
+    return E_INVALIDARG;
+}
+
+}  //end namespace WebmBench
@@ -0,0 +1,56 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "webmbench.h"
+#include "pipelinecounters.h"
+
+namespace WebmBench
+{
+
+//Whole-pipeline scenarios, to go with the benchmarks of single paths.
+//Each runs a path through the components a graph would use (the parser,
+//libvpx, the muxer, the thumbnailer), on a file of the synthetic corpus
+//made in memory, without a filter graph and without anything registered:
+//
+//  decode_4k_vp9  10 s of 3840x2160 VP9, demuxed and decoded to nothing,
+//                 as playwebm -null-render plays it
+//  live_1080p     10 s of 1920x1080 from a synthetic capture source,
+//                 encoded with VP8 in real time and muxed live, as a
+//                 capture graph does
+//  remux_multi    the video and eight Vorbis tracks of a multi_audio
+//                 file, copied into a new file
+//  seek_storm     500 seeks over a file of 2 hours, each to the cued
+//                 keyframe at or before a random time, read as the
+//                 source reads it after a seek
+//  thumbnails     a batch of 100 thumbnails of a 10 minute file
+//
+//Where the frames must decode, the corpus is seeded with a clip that the
+//scenario encodes with libvpx first.  Making the corpus is not timed.
+//Besides its timings, a scenario reports the pipeline counters of its
+//stages (those of the muxer's Context among them), summed over the timed
+//iterations.
+
+struct ScenarioResult
+{
+    std::string name;
+    std::string corpus;  //the spec of its synthetic file, or of its clip
+    results_t results;
+
+    typedef std::vector<webmdshow::PipelineCounters::Stats> counters_t;
+    counters_t counters;
+};
+
+//The names of the scenarios, in the order they run; the last is 0.
+extern const char* const g_scenarios[];
+
+//Runs the scenario |name| |iterations| times, after one run that is not
+//timed.  Returns E_INVALIDARG if there is no such scenario.
+HRESULT RunScenario(const char* name, int iterations, ScenarioResult&);
+
+}  //end namespace WebmBench
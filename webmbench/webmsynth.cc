@@ -0,0 +1,1317 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include <comdef.h>
+#include <amvideo.h>
+#include <uuids.h>
+#include "webmsynth.h"
+#include "webmbench.h"
+#include "cmediasample.h"
+#include "graphutil.h"
+#include "vorbistypes.h"
+#include "webmmuxcontext.h"
+#include "webmmuxstreamaudiovorbis.h"
+#include "webmmuxstreamvideovpx.h"
+#include "webmtypes.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <cwchar>
+#include <new>
+
+namespace WebmBench
+{
+
+namespace
+{
+
+//Followed by the payloads that were made up, as in "webmbench synth:
+//video audio".
+const char kWritingApp[] = "webmbench synth:";
+
+//Each packet is taken to be a long block (of the 2048 samples the
+//synthetic identification header gives), which overlaps the blocks on
+//either side by half.
+enum { kPacketSamples = 1024 };
+
+
+//A xorshift generator, seeded per frame, so that the bytes of a frame
+//do not depend on the frames muxed before it.
+
+class Random
+{
+public:
+    Random(long seed, long track, long index);
+
+    ULONG Next();
+
+    //A size within 25% of |mean|.
+    long GetSize(long mean);
+
+    void Fill(BYTE*, long len);
+
+private:
+    ULONG m_state;
+
+};
+
+
+Random::Random(long seed, long track, long index)
+{
+    ULONG x = ULONG(seed) * 0x9E3779B1UL;
+    x ^= ULONG(track) * 0x85EBCA6BUL;
+    x ^= ULONG(index) * 0xC2B2AE35UL;
+    x ^= x >> 16;
+    x *= 0x7FEB352DUL;
+    x ^= x >> 15;
+
+    m_state = x ? x : 1;  //0 would stay 0
+}
+
+
+ULONG Random::Next()
+{
+    ULONG x = m_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    m_state = x;
+    return x;
+}
+
+
+long Random::GetSize(long mean)
+{
+    const ULONG range = ULONG(mean / 2) + 1;
+    return mean - mean / 4 + long(Next() % range);
+}
+
+
+void Random::Fill(BYTE* p, long len)
+{
+    while (len >= 4)
+    {
+        const ULONG x = Next();
+        memcpy(p, &x, 4);
+
+        p += 4;
+        len -= 4;
+    }
+
+    if (len > 0)
+    {
+        const ULONG x = Next();
+        memcpy(p, &x, len);
+    }
+}
+
+
+//The largest size that Random::GetSize returns.
+
+long GetMaxRandomSize(long mean)
+{
+    return mean + mean / 4 + 1;
+}
+
+
+void Put32(BYTE* p, ULONG x)  //little-endian
+{
+    p[0] = BYTE(x);
+    p[1] = BYTE(x >> 8);
+    p[2] = BYTE(x >> 16);
+    p[3] = BYTE(x >> 24);
+}
+
+
+//Writes the frame tag of a VP8 frame of |len| bytes (at least 10): a
+//shown frame of version 0, with a first partition of half the frame.  A
+//keyframe's tag is followed by the start code and the frame size.
+
+void WriteVP8Header(BYTE* p, long len, bool key, long width, long height)
+{
+    const ULONG first_part = std::min<ULONG>(ULONG(len) / 2, 0x7FFFF);
+    const ULONG tag = (key ? 0 : 1) | (1 << 4) | (first_part << 5);
+
+    p[0] = BYTE(tag);
+    p[1] = BYTE(tag >> 8);
+    p[2] = BYTE(tag >> 16);
+
+    if (!key)
+        return;
+
+    p[3] = 0x9D;
+    p[4] = 0x01;
+    p[5] = 0x2A;
+    p[6] = BYTE(width);
+    p[7] = BYTE(width >> 8) & 0x3F;  //no scaling
+    p[8] = BYTE(height);
+    p[9] = BYTE(height >> 8) & 0x3F;
+}
+
+
+//The video track of a synthetic file: the frames of the seed's video
+//track from its first keyframe on, repeated, or else VP8 frames of
+//random bytes.
+
+class Video
+{
+    Video(const Video&);
+    Video& operator=(const Video&);
+
+public:
+    Video(const SynthParams&, const Input& seed);
+
+    HRESULT Init();
+
+    bool IsSynthetic() const;
+    long GetCount() const;  //0 if there is no video track
+    LONGLONG GetDuration() const;
+    LONGLONG GetTime(long i) const;
+    long GetMaxSize(bool key) const;
+    long GetMaxGop() const;
+
+    void GetMediaType(VIDEOINFOHEADER&, AM_MEDIA_TYPE&) const;
+
+    bool IsKey(long i) const;
+
+    //Writes frame |i| to |buf|, which has room for GetMaxSize bytes,
+    //and returns its size.
+    long GetFrame(long i, BYTE* buf) const;
+
+private:
+    const SynthParams& m_params;
+    const Input& m_seed;
+    size_t m_first;  //the seed's first keyframe
+    std::string m_codec_id;
+    long m_width;
+    long m_height;
+    LONGLONG m_duration;
+    long m_count;
+    long m_max_key;
+    long m_max_delta;
+    long m_max_gop;
+
+    const Input::Frame& GetSeedFrame(long i) const;
+
+};
+
+
+Video::Video(const SynthParams& p, const Input& seed) :
+    m_params(p),
+    m_seed(seed),
+    m_first(0),
+    m_width(0),
+    m_height(0),
+    m_duration(0),
+    m_count(0),
+    m_max_key(0),
+    m_max_delta(0),
+    m_max_gop(0)
+{
+}
+
+
+HRESULT Video::Init()
+{
+    const SynthParams& p = m_params;
+    const Input::frames_t& ff = m_seed.frames;
+
+    if (ff.empty())
+    {
+        if (p.width == 0)
+            return S_OK;  //no video track
+
+        m_codec_id = "V_VP8";
+        m_width = p.width;
+        m_height = p.height;
+        m_duration = 10000000 / p.fps;
+        m_max_key = GetMaxRandomSize(p.key_size);
+        m_max_delta = GetMaxRandomSize(p.frame_size);
+        m_max_gop = p.gop;
+    }
+    else
+    {
+        if ((m_seed.codec_id != "V_VP8") && (m_seed.codec_id != "V_VP9"))
+            return E_INVALIDARG;
+
+        while ((m_first < ff.size()) && !ff[m_first].key)
+            ++m_first;
+
+        if (m_first >= ff.size())
+            return E_INVALIDARG;
+
+        const size_t n = ff.size() - m_first;
+
+        m_codec_id = m_seed.codec_id;
+        m_width = m_seed.width;
+        m_height = m_seed.height;
+        m_duration = m_seed.frame_duration;
+
+        if ((m_duration <= 0) && (n > 1))
+            m_duration = (ff.back().time - ff[m_first].time) / LONGLONG(n - 1);
+
+        if (m_duration <= 0)
+            m_duration = 10000000 / p.fps;
+
+        m_max_key = 1;
+        m_max_delta = 1;
+        m_max_gop = 1;
+
+        long gop = 0;
+
+        for (size_t i = m_first; i < ff.size(); ++i)
+        {
+            const Input::Frame& f = ff[i];
+
+            if (f.key)
+            {
+                m_max_key = std::max(m_max_key, f.len);
+                gop = 1;
+            }
+            else
+            {
+                m_max_delta = std::max(m_max_delta, f.len);
+                ++gop;
+            }
+
+            m_max_gop = std::max(m_max_gop, gop);
+        }
+    }
+
+    const LONGLONG count = LONGLONG(p.seconds) * 10000000 / m_duration;
+
+    if (count > LONG_MAX)
+        return E_INVALIDARG;
+
+    m_count = std::max(long(count), 1L);
+    return S_OK;
+}
+
+
+bool Video::IsSynthetic() const
+{
+    return m_seed.frames.empty();
+}
+
+
+long Video::GetCount() const
+{
+    return m_count;
+}
+
+
+LONGLONG Video::GetDuration() const
+{
+    return m_duration;
+}
+
+
+LONGLONG Video::GetTime(long i) const
+{
+    return i * m_duration;
+}
+
+
+long Video::GetMaxSize(bool key) const
+{
+    return key ? m_max_key : m_max_delta;
+}
+
+
+long Video::GetMaxGop() const
+{
+    return m_max_gop;
+}
+
+
+void Video::GetMediaType(VIDEOINFOHEADER& vih, AM_MEDIA_TYPE& mt) const
+{
+    memset(&vih, 0, sizeof vih);
+
+    vih.AvgTimePerFrame = m_duration;
+
+    const GUID& subtype = (m_codec_id == "V_VP9") ?
+                          WebmTypes::MEDIASUBTYPE_VP90 :
+                          WebmTypes::MEDIASUBTYPE_VP80;
+
+    BITMAPINFOHEADER& bmih = vih.bmiHeader;
+
+    bmih.biSize = sizeof bmih;
+    bmih.biWidth = m_width;
+    bmih.biHeight = m_height;
+    bmih.biPlanes = 1;
+    bmih.biCompression = subtype.Data1;
+
+    memset(&mt, 0, sizeof mt);
+
+    mt.majortype = MEDIATYPE_Video;
+    mt.subtype = subtype;
+    mt.formattype = FORMAT_VideoInfo;
+    mt.cbFormat = sizeof vih;
+    mt.pbFormat = reinterpret_cast<BYTE*>(&vih);
+}
+
+
+const Input::Frame& Video::GetSeedFrame(long i) const
+{
+    const size_t n = m_seed.frames.size() - m_first;
+    return m_seed.frames[m_first + size_t(i) % n];
+}
+
+
+bool Video::IsKey(long i) const
+{
+    if (IsSynthetic())
+        return (i % m_params.gop) == 0;
+
+    return GetSeedFrame(i).key;
+}
+
+
+long Video::GetFrame(long i, BYTE* buf) const
+{
+    if (!IsSynthetic())
+    {
+        const Input::Frame& f = GetSeedFrame(i);
+        memcpy(buf, &m_seed.data[size_t(f.pos)], f.len);
+
+        return f.len;
+    }
+
+    const bool key = IsKey(i);
+
+    Random r(m_params.seed, 0, i);
+
+    const long len = r.GetSize(key ? m_params.key_size : m_params.frame_size);
+    r.Fill(buf, len);
+
+    WriteVP8Header(buf, len, key, m_width, m_height);
+
+    return len;
+}
+
+
+//Splits the CodecPrivate of a Vorbis track, the three headers in Xiph
+//lacing, into the sizes of the headers and the offset of the first.
+
+bool ParseXiphHeaders(
+    const std::vector<BYTE>& cp,
+    DWORD (&sizes)[3],
+    size_t& off)
+{
+    if ((cp.size() < 3) || (cp[0] != 2))  //the count, less 1
+        return false;
+
+    size_t pos = 1;
+    size_t total = 0;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        DWORD size = 0;
+
+        for (;;)
+        {
+            if (pos >= cp.size())
+                return false;
+
+            const BYTE b = cp[pos++];
+            size += b;
+
+            if (b < 255)
+                break;
+        }
+
+        sizes[i] = size;
+        total += size;
+    }
+
+    if (cp.size() - pos <= total)
+        return false;
+
+    sizes[2] = DWORD(cp.size() - pos - total);
+    off = pos;
+
+    return true;
+}
+
+
+//The audio tracks of a synthetic file, all alike: each the packets of
+//the seed's Vorbis track, repeated, or else packets of random bytes
+//behind made-up headers, of which only the identification header is
+//real.  A seed's packets are timed as kPacketSamples each, which they
+//are only on average.
+
+class Audio
+{
+    Audio(const Audio&);
+    Audio& operator=(const Audio&);
+
+public:
+    Audio(const SynthParams&, const Input& seed);
+
+    HRESULT Init();
+
+    bool IsSynthetic() const;
+    LONGLONG GetTime(long packet) const;
+    LONGLONG GetBlockDuration() const;
+    long GetMaxSize() const;  //of a block
+
+    //The format block points into the Audio object.
+    void GetMediaType(AM_MEDIA_TYPE&) const;
+
+    //Writes the block that begins with packet |packet| of the track to
+    //|buf|, which has room for GetMaxSize bytes, and returns its size.
+    long GetBlock(long track, long packet, BYTE* buf);
+
+private:
+    const SynthParams& m_params;
+    const Input& m_seed;
+    std::vector<BYTE> m_format;  //VORBISFORMAT2, then the headers
+    long m_sample_rate;
+    long m_max_packet;
+    std::vector<long> m_sizes;  //of the packets of a block
+
+    long GetPacket(long track, long packet, BYTE* buf) const;
+
+};
+
+
+Audio::Audio(const SynthParams& p, const Input& seed) :
+    m_params(p),
+    m_seed(seed),
+    m_sample_rate(0),
+    m_max_packet(0),
+    m_sizes(p.lace)
+{
+}
+
+
+HRESULT Audio::Init()
+{
+    using VorbisTypes::VORBISFORMAT2;
+
+    const SynthParams& p = m_params;
+
+    VORBISFORMAT2 fmt;
+    std::vector<BYTE> headers;
+
+    if (IsSynthetic())
+    {
+        m_sample_rate = p.sample_rate;
+        m_max_packet = GetMaxRandomSize(p.packet_size);
+
+        const ULONG bitrate = ULONG(p.packet_size) * 8 * p.sample_rate /
+                              kPacketSamples;
+
+        BYTE ident[30];
+
+        ident[0] = 1;
+        memcpy(ident + 1, "vorbis", 6);
+        Put32(ident + 7, 0);  //version
+        ident[11] = BYTE(p.channels);
+        Put32(ident + 12, p.sample_rate);
+        Put32(ident + 16, 0);  //maximum bitrate
+        Put32(ident + 20, bitrate);
+        Put32(ident + 24, 0);  //minimum bitrate
+        ident[28] = 0xB8;  //blocksizes of 256 and 2048
+        ident[29] = 1;  //framing
+
+        const char vendor[] = "webmbench";
+        const ULONG vendor_len = sizeof vendor - 1;
+
+        BYTE comment[7 + 4 + vendor_len + 4 + 1];
+
+        comment[0] = 3;
+        memcpy(comment + 1, "vorbis", 6);
+        Put32(comment + 7, vendor_len);
+        memcpy(comment + 11, vendor, vendor_len);
+        Put32(comment + 11 + vendor_len, 0);  //no user comments
+        comment[sizeof comment - 1] = 1;  //framing
+
+        BYTE setup[7 + 32];
+
+        setup[0] = 5;
+        memcpy(setup + 1, "vorbis", 6);
+
+        Random r(p.seed, -1, 0);
+        r.Fill(setup + 7, sizeof setup - 7);
+
+        headers.insert(headers.end(), ident, ident + sizeof ident);
+        headers.insert(headers.end(), comment, comment + sizeof comment);
+        headers.insert(headers.end(), setup, setup + sizeof setup);
+
+        fmt.channels = p.channels;
+        fmt.samplesPerSec = p.sample_rate;
+        fmt.headerSize[0] = sizeof ident;
+        fmt.headerSize[1] = sizeof comment;
+        fmt.headerSize[2] = sizeof setup;
+    }
+    else
+    {
+        size_t off;
+
+        if (!ParseXiphHeaders(m_seed.audio_private, fmt.headerSize, off))
+            return E_INVALIDARG;
+
+        if (fmt.headerSize[0] != 30)  //as the muxer requires
+            return E_INVALIDARG;
+
+        if ((m_seed.sample_rate <= 0) || (m_seed.channels <= 0))
+            return E_INVALIDARG;
+
+        const std::vector<BYTE>& cp = m_seed.audio_private;
+        headers.assign(cp.begin() + off, cp.end());
+
+        m_sample_rate = m_seed.sample_rate;
+        m_max_packet = 1;
+
+        typedef Input::frames_t::const_iterator iter_t;
+
+        const Input::frames_t& ff = m_seed.audio_frames;
+
+        for (iter_t i = ff.begin(); i != ff.end(); ++i)
+            m_max_packet = std::max(m_max_packet, i->len);
+
+        fmt.channels = m_seed.channels;
+        fmt.samplesPerSec = m_seed.sample_rate;
+    }
+
+    fmt.bitsPerSample = 16;
+
+    const BYTE* const pfmt = reinterpret_cast<const BYTE*>(&fmt);
+
+    m_format.assign(pfmt, pfmt + sizeof fmt);
+    m_format.insert(m_format.end(), headers.begin(), headers.end());
+
+    return S_OK;
+}
+
+
+bool Audio::IsSynthetic() const
+{
+    return (m_seed.audio_codec_id != "A_VORBIS") ||
+           m_seed.audio_private.empty() ||
+           m_seed.audio_frames.empty();
+}
+
+
+LONGLONG Audio::GetTime(long packet) const
+{
+    return LONGLONG(packet) * kPacketSamples * 10000000 / m_sample_rate;
+}
+
+
+LONGLONG Audio::GetBlockDuration() const
+{
+    return GetTime(m_params.lace);
+}
+
+
+long Audio::GetMaxSize() const
+{
+    const long lace = m_params.lace;
+    const long payload = lace * m_max_packet;
+
+    if (lace <= 1)
+        return payload;
+
+    return payload + 1 + (lace - 1) * (m_max_packet / 255 + 1);
+}
+
+
+void Audio::GetMediaType(AM_MEDIA_TYPE& mt) const
+{
+    memset(&mt, 0, sizeof mt);
+
+    mt.majortype = MEDIATYPE_Audio;
+
+    if (m_params.lace > 1)
+        mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing;
+    else
+        mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2;
+
+    mt.formattype = VorbisTypes::FORMAT_Vorbis2;
+    mt.cbFormat = ULONG(m_format.size());
+    mt.pbFormat = const_cast<BYTE*>(&m_format[0]);
+}
+
+
+long Audio::GetPacket(long track, long packet, BYTE* buf) const
+{
+    if (!IsSynthetic())
+    {
+        const Input::frames_t& ff = m_seed.audio_frames;
+        const Input::Frame& f = ff[size_t(packet) % ff.size()];
+
+        if (buf)
+            memcpy(buf, &m_seed.data[size_t(f.pos)], f.len);
+
+        return f.len;
+    }
+
+    Random r(m_params.seed, 1 + track, packet);
+
+    const long len = r.GetSize(m_params.packet_size);
+
+    if (buf)
+    {
+        r.Fill(buf, len);
+        buf[0] &= 0xFE;  //an audio packet
+    }
+
+    return len;
+}
+
+
+long Audio::GetBlock(long track, long packet, BYTE* buf)
+{
+    const long lace = m_params.lace;
+
+    BYTE* p = buf;
+
+    if (lace > 1)
+    {
+        for (long i = 0; i < lace; ++i)
+            m_sizes[i] = GetPacket(track, packet + i, 0);
+
+        *p++ = BYTE(lace - 1);
+
+        for (long i = 0; i < lace - 1; ++i)
+        {
+            long size = m_sizes[i];
+
+            while (size >= 255)
+            {
+                *p++ = 255;
+                size -= 255;
+            }
+
+            *p++ = BYTE(size);
+        }
+    }
+
+    for (long i = 0; i < lace; ++i)
+        p += GetPacket(track, packet + i, p);
+
+    return long(p - buf);
+}
+
+
+HRESULT CreateAllocator(long count, long size, IMemAllocator** pp)
+{
+    HRESULT hr = CMediaSample::CreateAllocator(pp);
+
+    if (FAILED(hr))
+        return hr;
+
+    ALLOCATOR_PROPERTIES props, actual;
+
+    props.cBuffers = count;
+    props.cbBuffer = size;
+    props.cbAlign = 1;
+    props.cbPrefix = 0;
+
+    hr = (*pp)->SetProperties(&props, &actual);
+
+    if (FAILED(hr))
+        return hr;
+
+    return (*pp)->Commit();
+}
+
+
+HRESULT SendVideo(
+    const Video& video,
+    long i,
+    IMemAllocator* pKeys,
+    IMemAllocator* pFrames,
+    WebmMuxLib::StreamVideo* pStream)
+{
+    const bool key = video.IsKey(i);
+
+    GraphUtil::IMediaSamplePtr pSample;
+
+    //The muxer holds the frames of a cluster or two, and those waiting
+    //for the audio to catch up, for which the allocators have enough
+    //buffers; rather than waiting forever if they do not, the mux fails.
+    IMemAllocator* const pAllocator = key ? pKeys : pFrames;
+
+    HRESULT hr = pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+    if (FAILED(hr))
+        return hr;
+
+    BYTE* ptr;
+
+    hr = pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+
+    const long len = video.GetFrame(i, ptr);
+
+    hr = pSample->SetActualDataLength(len);
+    assert(SUCCEEDED(hr));
+
+    LONGLONG st = video.GetTime(i);
+    LONGLONG sp = st + video.GetDuration();
+
+    hr = pSample->SetTime(&st, &sp);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSyncPoint(key ? TRUE : FALSE);
+    assert(SUCCEEDED(hr));
+
+    return pStream->Receive(pSample);
+}
+
+
+HRESULT SendAudio(
+    Audio& audio,
+    long track,
+    long packet,
+    IMemAllocator* pAllocator,
+    WebmMuxLib::StreamAudio* pStream)
+{
+    GraphUtil::IMediaSamplePtr pSample;
+
+    //The stream copies the block, so the sample comes straight back.
+    HRESULT hr = pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+    if (FAILED(hr))
+        return hr;
+
+    BYTE* ptr;
+
+    hr = pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+
+    const long len = audio.GetBlock(track, packet, ptr);
+
+    hr = pSample->SetActualDataLength(len);
+    assert(SUCCEEDED(hr));
+
+    LONGLONG st = audio.GetTime(packet);
+    LONGLONG sp = st + audio.GetBlockDuration();
+
+    hr = pSample->SetTime(&st, &sp);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSyncPoint(TRUE);
+    assert(SUCCEEDED(hr));
+
+    return pStream->Receive(pSample);
+}
+
+
+//Feeds the frames of every track to the muxer in the order of their
+//times, as the interleaving of the inpins would.
+
+HRESULT Mux(
+    const SynthParams& p,
+    const Video& video,
+    Audio& audio,
+    IMemAllocator* pKeys,
+    IMemAllocator* pFrames,
+    IMemAllocator* pBlocks,
+    IStream* pStream)
+{
+    using namespace WebmMuxLib;
+
+    Context ctx;
+
+    std::wstring& app = ctx.m_writing_app;
+    app.assign(kWritingApp, kWritingApp + sizeof kWritingApp - 1);
+
+    if ((video.GetCount() > 0) && video.IsSynthetic())
+        app += L" video";
+
+    if ((p.audio_tracks > 0) && audio.IsSynthetic())
+        app += L" audio";
+
+    if (!p.cues)
+    {
+        ctx.SetLiveMuxMode(true);
+        ctx.SetClusterAssembly(true);  //known cluster sizes
+    }
+
+    if (p.cluster_ms == 0)
+        ctx.SetClusterKeyFramesOnly(true);
+
+    else if (p.cluster_ms > 0)
+        ctx.SetMaxClusterDuration(p.cluster_ms);
+
+    HRESULT hr = S_OK;
+
+    StreamVideo* pVideo = 0;
+
+    if (video.GetCount() > 0)
+    {
+        VIDEOINFOHEADER vih;
+        AM_MEDIA_TYPE mt;
+
+        video.GetMediaType(vih, mt);
+
+        pVideo = new (std::nothrow) StreamVideoVPx(ctx, mt);
+
+        if (pVideo == 0)
+            return E_OUTOFMEMORY;
+
+        ctx.SetVideoStream(pVideo);
+    }
+
+    std::vector<StreamAudio*> tracks;
+
+    if (p.audio_tracks > 0)
+    {
+        AM_MEDIA_TYPE mt;
+        audio.GetMediaType(mt);
+
+        for (long i = 0; i < p.audio_tracks; ++i)
+        {
+            StreamAudio* const pAudio =
+                StreamAudioVorbis::CreateStream(ctx, mt);
+
+            if (pAudio == 0)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+
+            ctx.AddAudioStream(pAudio);
+            tracks.push_back(pAudio);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ctx.Open(pStream);
+
+        const LONGLONG end = LONGLONG(p.seconds) * 10000000;
+
+        long frame = 0;
+        long packet = 0;
+
+        while (SUCCEEDED(hr))
+        {
+            const bool bVideo = frame < video.GetCount();
+            const bool bAudio = !tracks.empty() &&
+                                (audio.GetTime(packet) < end);
+
+            if (bVideo &&
+                (!bAudio || (video.GetTime(frame) <= audio.GetTime(packet))))
+            {
+                hr = SendVideo(video, frame, pKeys, pFrames, pVideo);
+                ++frame;
+            }
+            else if (bAudio)
+            {
+                for (size_t i = 0; i < tracks.size(); ++i)
+                {
+                    hr = SendAudio(audio, long(i), packet, pBlocks, tracks[i]);
+
+                    if (FAILED(hr))
+                        break;
+                }
+
+                packet += p.lace;
+            }
+            else
+                break;
+        }
+
+        ctx.Close();
+    }
+
+    typedef std::vector<StreamAudio*>::const_iterator iter_t;
+
+    for (iter_t i = tracks.begin(); i != tracks.end(); ++i)
+    {
+        ctx.RemoveAudioStream(*i);
+        delete static_cast<Stream*>(*i);
+    }
+
+    ctx.SetVideoStream(0);
+    delete pVideo;
+
+    return FAILED(hr) ? hr : S_OK;
+}
+
+
+struct Field
+{
+    const wchar_t* name;
+    long SynthParams::* value;
+    long min;
+    long max;
+};
+
+const Field g_fields[] =
+{
+    { L"width", &SynthParams::width, 0, 16383 },
+    { L"height", &SynthParams::height, 0, 16383 },
+    { L"fps", &SynthParams::fps, 1, 240 },
+    { L"seconds", &SynthParams::seconds, 1, 86400 },
+    { L"gop", &SynthParams::gop, 1, 100000 },
+    { L"key_size", &SynthParams::key_size, 16, 16 << 20 },
+    { L"frame_size", &SynthParams::frame_size, 16, 16 << 20 },
+    { L"cluster_ms", &SynthParams::cluster_ms, -1, SHRT_MAX },
+    { L"cues", &SynthParams::cues, 0, 1 },
+    { L"audio_tracks", &SynthParams::audio_tracks, 0, 16 },
+    { L"sample_rate", &SynthParams::sample_rate, 8000, 192000 },
+    { L"channels", &SynthParams::channels, 1, 8 },
+    { L"packet_size", &SynthParams::packet_size, 8, 65536 },
+    { L"lace", &SynthParams::lace, 1, 255 },
+    { L"seed", &SynthParams::seed, 0, LONG_MAX },
+};
+
+
+bool SetPreset(const std::wstring& name, SynthParams& p)
+{
+    p.width = 640;
+    p.height = 360;
+    p.fps = 30;
+    p.seconds = 60;
+    p.gop = 60;
+    p.key_size = 40000;
+    p.frame_size = 6000;
+    p.cluster_ms = -1;
+    p.cues = 1;
+    p.audio_tracks = 1;
+    p.sample_rate = 48000;
+    p.channels = 2;
+    p.packet_size = 340;  //128 kbps
+    p.lace = 1;
+    p.seed = 1;
+    p.seed_file.clear();
+
+    if (name == L"default")
+        return true;
+
+    if (name == L"tiny_clusters")
+    {
+        p.cluster_ms = 1;
+        return true;
+    }
+
+    if (name == L"huge_clusters")
+    {
+        p.width = 1280;
+        p.height = 720;
+        p.gop = 900;
+        p.key_size = 80000;
+        p.frame_size = 12000;
+        p.cluster_ms = 0;
+        return true;
+    }
+
+    if (name == L"no_cues")
+    {
+        p.cues = 0;
+        return true;
+    }
+
+    if (name == L"laced")
+    {
+        p.lace = 64;
+        return true;
+    }
+
+    if (name == L"multi_audio")
+    {
+        p.audio_tracks = 8;
+        return true;
+    }
+
+    if (name == L"8k")
+    {
+        p.width = 7680;
+        p.height = 4320;
+        p.seconds = 10;
+        p.gop = 30;
+        p.key_size = 1500000;
+        p.frame_size = 300000;
+        return true;
+    }
+
+    if (name == L"long")
+    {
+        p.width = 320;
+        p.height = 180;
+        p.fps = 10;
+        p.seconds = 3 * 60 * 60;
+        p.gop = 100;
+        p.key_size = 3000;
+        p.frame_size = 400;
+        p.sample_rate = 8000;
+        p.channels = 1;
+        p.packet_size = 60;
+        return true;
+    }
+
+    return false;
+}
+
+}  //end anon namespace
+
+
+HRESULT SynthParams::Parse(const wchar_t* str)
+{
+    if (str == 0)
+        return E_POINTER;
+
+    std::vector<std::wstring> items;
+
+    for (const wchar_t* p = str;;)
+    {
+        const wchar_t* const q = wcschr(p, L',');
+
+        if (q == 0)
+        {
+            items.push_back(p);
+            break;
+        }
+
+        items.push_back(std::wstring(p, q));
+        p = q + 1;
+    }
+
+    if (!SetPreset(items[0], *this))
+        return E_INVALIDARG;
+
+    spec = str;
+
+    for (size_t i = 1; i < items.size(); ++i)
+    {
+        const std::wstring& item = items[i];
+        const size_t eq = item.find(L'=');
+
+        if ((eq == std::wstring::npos) || (eq == 0) || (eq + 1 == item.size()))
+            return E_INVALIDARG;
+
+        const std::wstring name = item.substr(0, eq);
+        const wchar_t* const value = item.c_str() + eq + 1;
+
+        if (name == L"seed_file")
+        {
+            seed_file = value;
+            continue;
+        }
+
+        const Field* f = g_fields;
+        const Field* const fend = f + sizeof g_fields / sizeof g_fields[0];
+
+        while ((f != fend) && (name != f->name))
+            ++f;
+
+        if (f == fend)
+            return E_INVALIDARG;
+
+        wchar_t* end;
+        const long n = wcstol(value, &end, 10);
+
+        if ((*end != L'\0') || (n < f->min) || (n > f->max))
+            return E_INVALIDARG;
+
+        this->*(f->value) = n;
+    }
+
+    if ((width == 0) != (height == 0))
+        return E_INVALIDARG;
+
+    if ((width > 0) && (width < 16))  //room for a keyframe's header
+        return E_INVALIDARG;
+
+    return S_OK;
+}
+
+
+HRESULT Synthesize(const SynthParams& p, std::vector<unsigned char>& data)
+{
+    data.clear();
+
+    Input seed;
+
+    if (!p.seed_file.empty())
+    {
+        const HRESULT hr = seed.Load(p.seed_file.c_str());
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return Synthesize(p, seed, data);
+}
+
+
+HRESULT Synthesize(
+    const SynthParams& p,
+    const Input& seed,
+    std::vector<unsigned char>& data)
+{
+    data.clear();
+
+    Video video(p, seed);
+
+    HRESULT hr = video.Init();
+
+    if (FAILED(hr))
+        return hr;
+
+    Audio audio(p, seed);
+
+    if (p.audio_tracks > 0)
+    {
+        hr = audio.Init();
+
+        if (FAILED(hr))
+            return hr;
+    }
+    else if (video.GetCount() == 0)
+        return E_INVALIDARG;  //no tracks
+
+    GraphUtil::IMemAllocatorPtr pKeys, pFrames, pBlocks;
+
+    if (video.GetCount() > 0)
+    {
+        //The muxer holds the frames of the cluster being filled, and of
+        //the video that is ahead of the audio by up to a block.
+
+        const LONGLONG ahead = (p.audio_tracks > 0) ?
+                               audio.GetBlockDuration() / video.GetDuration() :
+                               0;
+
+        const long gop = video.GetMaxGop();
+        const long held = 2 * gop + long(ahead) + 16;
+
+        hr = CreateAllocator(held / gop + 4, video.GetMaxSize(true), &pKeys);
+
+        if (FAILED(hr))
+            return hr;
+
+        hr = CreateAllocator(held, video.GetMaxSize(false), &pFrames);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (p.audio_tracks > 0)
+    {
+        hr = CreateAllocator(2, audio.GetMaxSize(), &pBlocks);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    IStreamPtr pStream;
+
+    hr = CreateStreamOnHGlobal(0, TRUE, &pStream);
+
+    if (SUCCEEDED(hr))
+        hr = Mux(p, video, audio, pKeys, pFrames, pBlocks, pStream);
+
+    if (pKeys)
+        pKeys->Decommit();
+
+    if (pFrames)
+        pFrames->Decommit();
+
+    if (pBlocks)
+        pBlocks->Decommit();
+
+    if (FAILED(hr))
+        return hr;
+
+    STATSTG stg;
+
+    hr = pStream->Stat(&stg, STATFLAG_NONAME);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (stg.cbSize.QuadPart > LONG_MAX)  //as Input::Load allows
+        return E_FAIL;
+
+    const ULONG size = stg.cbSize.LowPart;
+
+    data.resize(size);
+
+    LARGE_INTEGER pos;
+    pos.QuadPart = 0;
+
+    hr = pStream->Seek(pos, STREAM_SEEK_SET, 0);
+
+    if (FAILED(hr))
+        return hr;
+
+    ULONG cb;
+
+    hr = pStream->Read(&data[0], size, &cb);
+
+    if (FAILED(hr) || (cb != size))
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+bool GetVorbisFormat(
+    const std::vector<unsigned char>& cp,
+    long sample_rate,
+    long channels,
+    std::vector<unsigned char>& format)
+{
+    using VorbisTypes::VORBISFORMAT2;
+
+    VORBISFORMAT2 fmt;
+    size_t off;
+
+    if (!ParseXiphHeaders(cp, fmt.headerSize, off))
+        return false;
+
+    if (fmt.headerSize[0] != 30)  //as the muxer requires
+        return false;
+
+    if ((sample_rate <= 0) || (channels <= 0))
+        return false;
+
+    fmt.channels = channels;
+    fmt.samplesPerSec = sample_rate;
+    fmt.bitsPerSample = 16;
+
+    const BYTE* const pfmt = reinterpret_cast<const BYTE*>(&fmt);
+
+    format.assign(pfmt, pfmt + sizeof fmt);
+    format.insert(format.end(), cp.begin() + off, cp.end());
+
+    return true;
+}
+
+
+void GetSynthPayloads(const char* writing_app, bool& video, bool& audio)
+{
+    video = false;
+    audio = false;
+
+    if (writing_app == 0)
+        return;
+
+    const size_t len = sizeof kWritingApp - 1;
+
+    if (strncmp(writing_app, kWritingApp, len) != 0)
+        return;
+
+    const char* const payloads = writing_app + len;
+
+    video = (strstr(payloads, "video") != 0);
+    audio = (strstr(payloads, "audio") != 0);
+}
+
+}  //end namespace WebmBench
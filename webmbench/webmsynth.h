@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+namespace WebmBench
+{
+
+//The shape of a synthetic WebM file, as given on the command line:
+//
+//  preset[,name=value...]
+//
+//The preset is one of those below, and each name=value overrides one of
+//its fields.  The presets are the shapes that real files rarely cover
+//but that the splitter and the muxer must handle:
+//
+//  default        360p VP8 at 30 fps for 60 s, one stereo Vorbis track
+//  tiny_clusters  a cluster per video frame
+//  huge_clusters  720p, 30 s between keyframes, clusters at keyframes only
+//  no_cues        muxed live: no SeekHead and no Cues
+//  laced          64 Vorbis packets laced in each audio block
+//  multi_audio    8 audio tracks
+//  8k             7680x4320 for 10 s, with frames of 1.5 MB and 300 KB
+//  long           3 hours of 180p at 10 fps, with 8 kHz mono audio
+//
+//The payloads are of random bytes, the same for the same seed, behind
+//the headers the muxer and the splitter look at (a VP8 frame header, and
+//the Vorbis identification header); they do not decode.  If a seed file
+//is given, its first video track replaces the video (its codec, size and
+//frame rate included), and its Vorbis track the audio, the frames of each
+//being repeated for as long as the file lasts.
+
+struct SynthParams
+{
+    std::wstring spec;   //as given to Parse
+
+    long width;          //0 for no video track
+    long height;
+    long fps;
+    long seconds;
+    long gop;            //frames from a keyframe to the next
+    long key_size;       //mean size of a keyframe, in bytes
+    long frame_size;     //mean size of the other frames
+    long cluster_ms;     //maximum cluster duration; 0 means keyframes
+                         //only, and -1 the muxer's default
+    long cues;           //0 to mux live, which writes neither
+
+    long audio_tracks;
+    long sample_rate;
+    long channels;
+    long packet_size;    //mean size of a Vorbis packet
+    long lace;           //packets per block
+
+    long seed;
+    std::wstring seed_file;
+
+    //Returns E_INVALIDARG if the spec names no preset, or a field that
+    //does not exist, or gives a field a value out of its range.
+    HRESULT Parse(const wchar_t* spec);
+};
+
+
+struct Input;
+
+//Muxes the synthetic file into |data|, with a WebmMuxLib::Context, as
+//the muxer filter would.
+HRESULT Synthesize(const SynthParams&, std::vector<unsigned char>& data);
+
+//The same, with |seed| in place of the seed file, for a seed made in
+//memory (as the scenarios encode theirs); the seed_file is ignored.
+HRESULT Synthesize(
+    const SynthParams&,
+    const Input& seed,
+    std::vector<unsigned char>& data);
+
+//Makes the format block of a Vorbis media type (a VORBISFORMAT2, then the
+//three headers) from the CodecPrivate of a Vorbis track, as the splitter
+//does.  Returns false if the CodecPrivate does not hold the headers.
+bool GetVorbisFormat(
+    const std::vector<unsigned char>& codec_private,
+    long sample_rate,
+    long channels,
+    std::vector<unsigned char>& format);
+
+//The WritingApp of a synthetic file says which of its payloads were
+//made up rather than taken from a seed; given the WritingApp of a file,
+//returns whether its video and audio frames are of random bytes (both
+//false if the file is not synthetic).
+void GetSynthPayloads(const char* writing_app, bool& video, bool& audio);
+
+}  //end namespace WebmBench
@@ -135,11 +135,16 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS& inpin = pins[0];
 
-    enum { nInpinMediaTypes = 2 };
+    enum { nInpinMediaTypes = 7 };
     const REGPINTYPES inpinMediaTypes[nInpinMediaTypes] =
     {
-        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 },
-        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB32 }
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_YV12 },
+        { &MEDIATYPE_Video, &WebmTypes::MEDIASUBTYPE_I420 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_NV12 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_YUY2 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_UYVY },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB32 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 }
     };
 
     inpin.strName = 0;              //obsolete
@@ -154,10 +159,16 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS& outpin = pins[1];
 
-    enum { nOutpinMediaTypes = 1 };
+    enum { nOutpinMediaTypes = 7 };
     const REGPINTYPES outpinMediaTypes[nOutpinMediaTypes] =
     {
         { &MEDIATYPE_Video, &MEDIASUBTYPE_YV12 },
+        { &MEDIATYPE_Video, &WebmTypes::MEDIASUBTYPE_I420 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_NV12 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_YUY2 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_UYVY },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB32 },
+        { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 }
     };
 
     outpin.strName = 0;              //obsolete
@@ -76,7 +76,8 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_state(State_Stopped),
       m_clock(0),
       m_inpin(this),
-      m_outpin(this)
+      m_outpin(this),
+      m_counters(L"webmcc")
 {
     m_pClassFactory->LockServer(TRUE);
 
@@ -137,6 +138,14 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<IBaseFilter*>(m_pFilter);
     }
+    else if (iid == __uuidof(IPropertyBag))
+    {
+        pUnk = static_cast<IPropertyBag*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IPipelineCounters))
+    {
+        pUnk = static_cast<IPipelineCounters*>(m_pFilter);
+    }
     else
     {
         pUnk = 0;
@@ -515,6 +524,163 @@ HRESULT Filter::QueryVendorInfo(LPWSTR* pstr)
 }
 
 
+HRESULT Filter::Read(
+    LPCOLESTR name,
+    VARIANT* pVar,
+    IErrorLog*)
+{
+    if (name == 0)
+        return E_POINTER;
+
+    if (pVar == 0)
+        return E_POINTER;
+
+    //Read from the streaming thread's converter without the filter
+    //lock; the values are each read atomically.
+
+    webmdshow::ColorConverter::Stats stats;
+    int bands;
+
+    m_outpin.GetConverterStats(stats, bands);
+
+    LONGLONG value;
+
+    if (_wcsicmp(name, L"FramesConverted") == 0)
+        value = stats.frames;
+
+    else if (_wcsicmp(name, L"LastConvertTime") == 0)
+        value = stats.last_us;
+
+    else if (_wcsicmp(name, L"AverageConvertTime") == 0)
+        value = (stats.frames > 0) ? stats.total_us / stats.frames : 0;
+
+    else if (_wcsicmp(name, L"MaxConvertTime") == 0)
+        value = stats.max_us;
+
+    else if (_wcsicmp(name, L"ConvertBands") == 0)
+        value = bands;
+
+    else if (_wcsicmp(name, L"YuvMatrix") == 0)
+    {
+        webmdshow::YuvMatrix matrix;
+        webmdshow::YuvRange range;
+
+        m_outpin.GetYuvMatrix(matrix, range);
+        value = (matrix == webmdshow::kYuvMatrixBT709) ? 709 : 601;
+    }
+    else if (_wcsicmp(name, L"YuvFullRange") == 0)
+    {
+        webmdshow::YuvMatrix matrix;
+        webmdshow::YuvRange range;
+
+        m_outpin.GetYuvMatrix(matrix, range);
+        value = (range == webmdshow::kYuvRangeFull) ? 1 : 0;
+    }
+
+    else if (_wcsicmp(name, L"GpuConvert") == 0)
+        value = m_outpin.GetGpuConvert() ? 1 : 0;
+
+    else if (_wcsicmp(name, L"GpuConverting") == 0)
+        value = m_outpin.IsGpuConverting() ? 1 : 0;
+
+    else
+        return E_INVALIDARG;
+
+    if ((pVar->vt != VT_EMPTY) && (pVar->vt != VT_I4))
+        return E_FAIL;
+
+    pVar->vt = VT_I4;
+    pVar->lVal = static_cast<LONG>(value);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::Write(LPCOLESTR name, VARIANT* pVar)
+{
+    if (name == 0)
+        return E_POINTER;
+
+    if (pVar == 0)
+        return E_POINTER;
+
+    if (pVar->vt != VT_I4)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (_wcsicmp(name, L"GpuConvert") == 0)
+        return m_outpin.SetGpuConvert(pVar->lVal != 0);
+
+    webmdshow::YuvMatrix matrix;
+    webmdshow::YuvRange range;
+
+    m_outpin.GetYuvMatrix(matrix, range);
+
+    if (_wcsicmp(name, L"YuvMatrix") == 0)
+    {
+        if (pVar->lVal == 601)
+            matrix = webmdshow::kYuvMatrixBT601;
+
+        else if (pVar->lVal == 709)
+            matrix = webmdshow::kYuvMatrixBT709;
+
+        else
+            return E_INVALIDARG;
+    }
+    else if (_wcsicmp(name, L"YuvFullRange") == 0)
+    {
+        if (pVar->lVal)
+            range = webmdshow::kYuvRangeFull;
+        else
+            range = webmdshow::kYuvRangeLimited;
+    }
+    else
+        return E_INVALIDARG;
+
+    return m_outpin.SetYuvMatrix(matrix, range);
+}
+
+
+HRESULT Filter::GetStageCount(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    *pCount = 1;
+    return S_OK;
+}
+
+
+HRESULT Filter::GetStage(ULONG index, Stats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    if (index != 0)
+        return E_INVALIDARG;
+
+    //The counters are read without the filter lock.
+    m_counters.GetStats(pStats);
+    return S_OK;
+}
+
+
+HRESULT Filter::ResetStages()
+{
+    m_counters.Reset();
+    return S_OK;
+}
+
+
 void Filter::OnStart()
 {
     HRESULT hr = m_inpin.Start();
@@ -8,15 +8,20 @@
 
 #pragma once
 #include <strmif.h>
+#include <ocidl.h>
 #include <string>
 #include "webmccinpin.h"
 #include "webmccoutpin.h"
 #include "clockable.h"
+#include "ipipelinecounters.h"
+#include "pipelinecounters.h"
 
 namespace WebmColorConversion
 {
 
 class Filter : public IBaseFilter,
+               public IPropertyBag,
+               public IPipelineCounters,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -54,6 +59,30 @@ public:
     HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
     HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
 
+    //IPropertyBag
+    //
+    //"FramesConverted" is the number of frames converted since the
+    //output pin connected.  "LastConvertTime", "AverageConvertTime" and
+    //"MaxConvertTime" are the times taken to convert them, in
+    //microseconds, and "ConvertBands" is the number of bands each frame
+    //is split into (0 on the GPU); these are read-only.  "YuvMatrix"
+    //(601 or 709) and "YuvFullRange" (0 or 1) select how YUV is
+    //converted to RGB.  "GpuConvert" (0 or 1) converts frames with a
+    //Direct3D 11 compute shader, which also scales them to the output
+    //size rather than cropping, where the formats and the machine allow
+    //it; "GpuConverting" (read-only) says whether they are.  All but the
+    //read-only ones may be written while the filter is stopped (all
+    //VT_I4).
+
+    HRESULT STDMETHODCALLTYPE Read(LPCOLESTR, VARIANT*, IErrorLog*);
+    HRESULT STDMETHODCALLTYPE Write(LPCOLESTR, VARIANT*);
+
+    //IPipelineCounters
+
+    HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*);
+    HRESULT STDMETHODCALLTYPE ResetStages();
+
 private:
     class CNondelegating : public IUnknown
     {
@@ -86,6 +115,10 @@ public:
     Inpin m_inpin;
     Outpin m_outpin;
 
+    //Frames queued by the inpin and converted by the outpin's thread;
+    //the queue depth is that of the inpin's queue.
+    webmdshow::PipelineCounters m_counters;
+
 private:
     void OnStart();
 
@@ -37,7 +37,6 @@ Inpin::Inpin(Filter* p) :
     AM_MEDIA_TYPE mt;
 
     mt.majortype = MEDIATYPE_Video;
-    mt.subtype = MEDIASUBTYPE_RGB24;
     mt.bFixedSizeSamples = FALSE;
     mt.bTemporalCompression = FALSE;
     mt.lSampleSize = 0;
@@ -46,10 +45,11 @@ Inpin::Inpin(Filter* p) :
     mt.cbFormat = 0;
     mt.pbFormat = 0;
 
-    m_preferred_mtv.Add(mt);
-
-    mt.subtype = MEDIASUBTYPE_RGB32;
-    m_preferred_mtv.Add(mt);
+    for (int i = 0; i < cFormats; ++i)
+    {
+        mt.subtype = *s_formats[i].subtype;
+        m_preferred_mtv.Add(mt);
+    }
 
     m_hSamples = CreateEvent(0, 0, 0, 0);
     assert(m_hSamples);
@@ -463,11 +463,9 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (mt.majortype != MEDIATYPE_Video)
         return S_FALSE;
 
-    if (mt.subtype == MEDIASUBTYPE_RGB24)
-        __noop;
-    else if (mt.subtype == MEDIASUBTYPE_RGB32)
-        __noop;
-    else
+    const Format* const pFormat = FindFormat(mt.subtype);
+
+    if (pFormat == 0)
         return S_FALSE;
 
     if (mt.pbFormat == 0)
@@ -485,6 +483,11 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
         //if (vih.AvgTimePerFrame <= 0)
         //    return S_FALSE;
 
+        const RECT& rc = vih.rcSource;
+
+        if (!IsRectEmpty(&rc) && (rc.right - rc.left > vih.bmiHeader.biWidth))
+            return S_FALSE;
+
         pbmih = &vih.bmiHeader;
     }
 #if 0  //TODO
@@ -513,16 +516,10 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (bmih.biWidth <= 0)
         return S_FALSE;
 
-    if (bmih.biWidth % 2)  //TODO
-        return S_FALSE;
-
     if (bmih.biHeight == 0)
         return S_FALSE;
 
-    if (bmih.biHeight % 2)  //TODO
-        return S_FALSE;
-
-    if (bmih.biCompression != BI_RGB)
+    if (bmih.biCompression != pFormat->biCompression)
         return S_FALSE;
 
     return S_OK;
@@ -658,6 +655,10 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     pInSample->AddRef();
     m_samples.push_back(pInSample);
 
+    webmdshow::PipelineCounters& counters = m_pFilter->m_counters;
+    counters.OnSampleIn(pInSample->GetActualDataLength());
+    counters.SetQueueDepth(static_cast<int>(m_samples.size()));
+
     const BOOL b = SetEvent(m_hSamples);
     assert(b);
 
@@ -867,6 +868,8 @@ int Inpin::GetSample(IMediaSample** ppSample)
     pSample = m_samples.front();
     m_samples.pop_front();
 
+    m_pFilter->m_counters.SetQueueDepth(static_cast<int>(m_samples.size()));
+
     if (pSample)
         return 1;
 
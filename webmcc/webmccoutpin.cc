@@ -13,6 +13,7 @@
 #include "cmediasample.h"
 #include "mediatypeutil.h"
 #include "webmtypes.h"
+#include "threadutil.h"
 #include <vfwmsgs.h>
 #include <uuids.h>
 #include <cassert>
@@ -37,8 +38,9 @@ namespace WebmColorConversion
 
 Outpin::Outpin(Filter* pFilter) :
     Pin(pFilter, PINDIR_OUTPUT, L"output"),
-    m_hThread(0),
-    m_rgb_to_yuv(0)
+    m_bGpuConvert(false),
+    m_bGpuConverting(false),
+    m_hThread(0)
 {
     SetDefaultMediaTypes();
 }
@@ -172,7 +174,7 @@ HRESULT Outpin::Connect(
         {
             const AM_MEDIA_TYPE& mt = m_preferred_mtv[i];
 
-            if (mt.subtype == mt.subtype)
+            if (mt.subtype == pmt->subtype)
             {
                 idx = i;
                 break;
@@ -216,6 +218,11 @@ HRESULT Outpin::Connect(
         m_connection_mtv.Add(mt);
     }
 
+    hr = InitConverter();
+
+    if (FAILED(hr))
+        return hr;
+
     GraphUtil::IMemAllocatorPtr pAllocator;
 
     hr = pInputPin->GetAllocator(&pAllocator);
@@ -244,18 +251,17 @@ HRESULT Outpin::Connect(
     if (props.cBuffers < cBuffers)
         props.cBuffers = cBuffers;
 
-    const VIDEOINFOHEADER* const pvih = this->GetVideoInfo();
-    assert(pvih);
+    const Format* pFormat;
+    int stride, width, height;
 
-    const BITMAPINFOHEADER& bmih = pvih->bmiHeader;
+    const bool bLayout = GetFrameLayout(pFormat, stride, width, height);
+    bLayout;
+    assert(bLayout);
 
-    const LONG w = bmih.biWidth;
-    const LONG h = labs(bmih.biHeight);
-
-    const LONG y = w * h;
-    const LONG uv = (w/2) * (h/2);
-
-    const LONG cbBuffer = y + 2 * uv;
+    const LONG cbBuffer = webmdshow::ColorConverter::GetFrameSize(
+                            pFormat->color_format,
+                            stride,
+                            height);
 
     if (props.cbBuffer < cbBuffer)
         props.cbBuffer = cbBuffer;
@@ -323,7 +329,9 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (mtOut.majortype != MEDIATYPE_Video)
         return S_FALSE;
 
-    if (mtOut.subtype != MEDIASUBTYPE_YV12)
+    const Format* const pFormat = FindFormat(mtOut.subtype);
+
+    if (pFormat == 0)
         return S_FALSE;
 
     if (mtOut.formattype == GUID_NULL)
@@ -340,7 +348,9 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
 
     const VIDEOINFOHEADER& vihOut = (VIDEOINFOHEADER&)(*mtOut.pbFormat);
     const BITMAPINFOHEADER& bmihOut = vihOut.bmiHeader;
-    bmihOut;
+
+    if (bmihOut.biCompression != pFormat->biCompression)
+        return S_FALSE;
 
     //TODO: vet vih and bmih
 
@@ -727,7 +737,17 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn)
     assert(mtIn.cbFormat >= sizeof(VIDEOINFOHEADER));
 
     const VIDEOINFOHEADER& vihIn = (VIDEOINFOHEADER&)(*mtIn.pbFormat);
-    const BITMAPINFOHEADER& bmihIn = vihIn.bmiHeader;
+
+    const Format* pFormatIn;
+    int stride_in, w, h;
+
+    const bool bLayout = m_pFilter->m_inpin.GetFrameLayout(
+                            pFormatIn,
+                            stride_in,
+                            w,
+                            h);
+    bLayout;
+    assert(bLayout);
 
     m_preferred_mtv.Clear();
 
@@ -737,10 +757,8 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn)
     BITMAPINFOHEADER& bmih = vih.bmiHeader;
 
     mt.majortype = MEDIATYPE_Video;
-    mt.subtype = MEDIASUBTYPE_YV12;
     mt.bFixedSizeSamples = TRUE;
     mt.bTemporalCompression = FALSE;
-    mt.lSampleSize = 0;  //TODO
     mt.formattype = FORMAT_VideoInfo;
     mt.pUnk = 0;
     mt.cbFormat = sizeof vih;
@@ -753,33 +771,36 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn)
     vih.AvgTimePerFrame = vihIn.AvgTimePerFrame;
 
     bmih.biSize = sizeof(BITMAPINFOHEADER);  //40
-    bmih.biWidth = bmihIn.biWidth;
-    bmih.biHeight = bmihIn.biHeight;
+    bmih.biWidth = w;
+    bmih.biHeight = h;  //bottom-up, for RGB
     bmih.biPlanes = 1;
-    bmih.biBitCount = 12;
-    memcpy(&bmih.biCompression, "YV12", 4);
-    bmih.biSizeImage = 0;  //TODO
     bmih.biXPelsPerMeter = 0;
     bmih.biYPelsPerMeter = 0;
     bmih.biClrUsed = 0;
     bmih.biClrImportant = 0;
 
-    m_preferred_mtv.Add(mt);
+    for (int i = 0; i < cFormats; ++i)
+    {
+        const Format& f = s_formats[i];
 
-    img_fmt_t src;
+        const int stride =
+            webmdshow::ColorConverter::GetStride(f.color_format, w);
 
-    if (mtIn.subtype == MEDIASUBTYPE_RGB24)
-        src = IMG_FMT_RGB24;
-    else
-    {
-        assert(mtIn.subtype == MEDIASUBTYPE_RGB32);
-        src = IMG_FMT_RGB32;
-    }
+        const int size =
+            webmdshow::ColorConverter::GetFrameSize(
+                f.color_format,
+                stride,
+                h);
+
+        mt.subtype = *f.subtype;
+        mt.lSampleSize = size;
 
-    const img_fmt_t dst = IMG_FMT_YV12;  //TODO: liberalize
+        bmih.biBitCount = f.biBitCount;
+        bmih.biCompression = f.biCompression;
+        bmih.biSizeImage = size;
 
-    m_rgb_to_yuv = on2_get_rgb_to_yuv(dst, src);
-    assert(m_rgb_to_yuv);
+        m_preferred_mtv.Add(mt);
+    }
 }
 
 
@@ -805,6 +826,145 @@ HRESULT Outpin::OnInpinDisconnect()
 }
 
 
+HRESULT Outpin::InitConverter()
+{
+    const Format* pFormatIn;
+    int stride_in, w_in, h_in;
+
+    const Inpin& inpin = m_pFilter->m_inpin;
+
+    if (!inpin.GetFrameLayout(pFormatIn, stride_in, w_in, h_in))
+        return VFW_E_NOT_CONNECTED;
+
+    const Format* pFormatOut;
+    int stride_out, w_out, h_out;
+
+    if (!GetFrameLayout(pFormatOut, stride_out, w_out, h_out))
+        return VFW_E_TYPE_NOT_ACCEPTED;
+
+    //The converter does not scale: if downstream asked for a different
+    //size, convert the part of the frame the two have in common.
+
+    const int w = (w_out < w_in) ? w_out : w_in;
+    const int h = (h_out < h_in) ? h_out : h_in;
+
+    const bool b = m_converter.Init(
+                    pFormatIn->color_format,
+                    stride_in,
+                    pFormatOut->color_format,
+                    stride_out,
+                    w,
+                    h);
+
+    if (!b)
+        return VFW_E_TYPE_NOT_ACCEPTED;
+
+    //The GPU converts the whole frame, scaled to the size downstream
+    //asked for; m_converter stays ready in case the GPU fails.
+
+    m_bGpuConverting = false;
+
+    if (!m_bGpuConvert)
+    {
+        m_gpu_converter.Close();
+        return S_OK;
+    }
+
+    m_gpu_converter.set_yuv_matrix(
+        m_converter.yuv_matrix(),
+        m_converter.yuv_range());
+
+    m_bGpuConverting = m_gpu_converter.Init(
+                        pFormatIn->color_format,
+                        stride_in,
+                        w_in,
+                        h_in,
+                        pFormatOut->color_format,
+                        stride_out,
+                        w_out,
+                        h_out);
+
+#ifdef _DEBUG
+    if (!m_bGpuConverting)
+    {
+        odbgstream os;
+        os << "webmcc::Outpin::InitConverter: no GPU conversion;"
+           << " converting on the CPU"
+           << endl;
+    }
+#endif
+
+    return S_OK;
+}
+
+
+void Outpin::GetConverterStats(
+    webmdshow::ColorConverter::Stats& stats,
+    int& bands) const
+{
+    if (m_bGpuConverting)
+    {
+        m_gpu_converter.GetStats(&stats);
+        bands = 0;
+    }
+    else
+    {
+        m_converter.GetStats(&stats);
+        bands = m_converter.band_count();
+    }
+}
+
+
+void Outpin::GetYuvMatrix(
+    webmdshow::YuvMatrix& matrix,
+    webmdshow::YuvRange& range) const
+{
+    matrix = m_converter.yuv_matrix();
+    range = m_converter.yuv_range();
+}
+
+
+HRESULT Outpin::SetYuvMatrix(
+    webmdshow::YuvMatrix matrix,
+    webmdshow::YuvRange range)
+{
+    m_converter.set_yuv_matrix(matrix, range);
+
+    if (!bool(m_pPinConnection))
+        return S_OK;
+
+    return InitConverter();
+}
+
+
+bool Outpin::GetGpuConvert() const
+{
+    return m_bGpuConvert;
+}
+
+
+bool Outpin::IsGpuConverting() const
+{
+    return m_bGpuConverting;
+}
+
+
+HRESULT Outpin::SetGpuConvert(bool bGpuConvert)
+{
+    m_bGpuConvert = bGpuConvert;
+
+    if (!bool(m_pPinConnection))
+    {
+        if (!m_bGpuConvert)
+            m_gpu_converter.Close();
+
+        return S_OK;
+    }
+
+    return InitConverter();
+}
+
+
 void Outpin::SetDefaultMediaTypes()
 {
     m_preferred_mtv.Clear();
@@ -812,7 +972,6 @@ void Outpin::SetDefaultMediaTypes()
     AM_MEDIA_TYPE mt;
 
     mt.majortype = MEDIATYPE_Video;
-    mt.subtype = MEDIASUBTYPE_YV12;
     mt.bFixedSizeSamples = TRUE;
     mt.bTemporalCompression = FALSE;
     mt.lSampleSize = 0;
@@ -821,7 +980,11 @@ void Outpin::SetDefaultMediaTypes()
     mt.cbFormat = 0;
     mt.pbFormat = 0;
 
-    m_preferred_mtv.Add(mt);
+    for (int i = 0; i < cFormats; ++i)
+    {
+        mt.subtype = *s_formats[i].subtype;
+        m_preferred_mtv.Add(mt);
+    }
 }
 
 
@@ -885,7 +1048,13 @@ unsigned Outpin::ThreadProc(void* pv)
        << endl;
 #endif
 
-    pPin->Main();
+    {
+        const WebmMfUtil::ThreadPolicyScope policy(
+                L"webmcc",
+                WebmMfUtil::kThreadClassPlayback);
+
+        pPin->Main();
+    }
 
 #ifdef _DEBUG
     os << "webmcc::Outpin["
@@ -927,10 +1096,18 @@ unsigned Outpin::Main()
             return 0;
 
         if (status < -1)  //terminate thread
+        {
+            DiscardGpuFrames();  //flushed, with the inpin's samples
             return 0;
+        }
 
         if (status == 0)  //EOS (no payload)
         {
+            //Send what the GPU still holds ahead of the EOS.
+
+            if (DeliverGpuFrames(0) != S_OK)
+                DiscardGpuFrames();
+
 #ifdef _DEBUG
             odbgstream os;
             os << "webmcc::outpin::EOS: calling pin->EOS" << endl;
@@ -947,23 +1124,63 @@ unsigned Outpin::Main()
         }
         else if (status > 0)  //have payload to send downstream
         {
-            GraphUtil::IMediaSamplePtr pOutSample;
+            HRESULT hr;
 
-            HRESULT hr = m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+            if (m_bGpuConverting && SubmitGpuFrame(pInSample))
+            {
+                //The planes have been copied to the GPU, so the input
+                //sample can go; the output is read back kLatency frames
+                //later, by which time the GPU is done with it.
 
-            if (hr == S_OK)
+                pInSample = 0;
+
+                hr = DeliverGpuFrames(
+                        webmdshow::GpuColorConverter::kLatency);
+            }
+            else
             {
-                PopulateSample(pInSample, pOutSample);
+                GraphUtil::IMediaSamplePtr pOutSample;
 
-                hr = m_pInputPin->Receive(pOutSample);
+                hr = m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+                webmdshow::PipelineCounters& counters =
+                    m_pFilter->m_counters;
 
                 if (hr == S_OK)
-                    continue;
+                {
+                    {
+                        webmdshow::PipelineCounters::Timer timer(counters);
+                        PopulateSample(pInSample, pOutSample);
+                    }
+
+                    counters.OnSampleOut(pOutSample->GetActualDataLength());
+
+                    hr = m_pInputPin->Receive(pOutSample);
+                }
+                else
+                    counters.OnDrop();
             }
 
+            if (hr == S_OK)
+                continue;
+
+            DiscardGpuFrames();
+
             pInSample = 0;
             inpin.OnCompletion();
         }
+        else  //no samples queued
+        {
+            //There is nothing to overlap the readback with, and holding
+            //frames back would keep a paused renderer from ever receiving
+            //its first, so send what the GPU holds.
+
+            if (DeliverGpuFrames(0) != S_OK)
+            {
+                DiscardGpuFrames();
+                inpin.OnCompletion();
+            }
+        }
 
         const DWORD dw = WaitForSingleObject(hSamples, INFINITE);
 
@@ -986,31 +1203,11 @@ void Outpin::PopulateSample(
 
     const Inpin& inpin = m_pFilter->m_inpin;
 
-    const VIDEOINFOHEADER* const pvih_in = inpin.GetVideoInfo();
-    assert(pvih_in);
-
-    const RECT& rc_in = pvih_in->rcSource;
-
-    const LONG rc_in_w = rc_in.right - rc_in.left;
-    assert(rc_in_w >= 0);
-    assert(rc_in_w % 2 == 0);  //TODO
+    const Format* pFormat;
+    int stride, w, h;
 
-    //BITMAPINFOHEADER Structure
-    //http://msdn.microsoft.com/en-us/library/dd183376%28v=vs.85%29.aspx
-
-    const BITMAPINFOHEADER& bmih_in = pvih_in->bmiHeader;
-
-    const LONG w_in = bmih_in.biWidth;  //stride
-    assert(w_in > 0);
-    assert(w_in % 2 == 0);  //TODO
-    //assert(w_in == rc_in_w);
-
-    const LONG hh_in = bmih_in.biHeight;
-    assert(hh_in);
-
-    const LONG h_in = labs(hh_in);
-    assert(h_in > 0);
-    assert(h_in % 2 == 0);  //TODO
+    bool b = inpin.GetFrameLayout(pFormat, stride, w, h);
+    assert(b);
 
     BYTE* buf_in;
 
@@ -1018,100 +1215,94 @@ void Outpin::PopulateSample(
     assert(SUCCEEDED(hr));
     assert(buf_in);
 
-    const AM_MEDIA_TYPE* const pmt_in = inpin.GetMediaType();
-    assert(pmt_in);
-
-    const GUID& subtype_in = pmt_in->subtype;
-
-    LONG bytes_per_pixel;
-
-    if (subtype_in == MEDIASUBTYPE_RGB24)
-        bytes_per_pixel = 3;
-    else
-    {
-        assert(subtype_in == MEDIASUBTYPE_RGB32);
-        bytes_per_pixel = 4;
-    }
-
-    const LONG stride_in = w_in * bytes_per_pixel;
-    const ULONG size_in = stride_in * h_in;  //calculated
+    const long size_in = webmdshow::ColorConverter::GetFrameSize(
+                            pFormat->color_format,
+                            stride,
+                            h);
+    size_in;
 
     const long actual_size_in = pIn->GetActualDataLength();
-    assert(actual_size_in >= 0);
-    assert(ULONG(actual_size_in) == size_in);
-
-    BYTE* const rgb = buf_in + stride_in * (h_in - 1);
+    actual_size_in;
+    assert(actual_size_in >= size_in);
 
     //output
 
-    const VIDEOINFOHEADER* const pvih_out = this->GetVideoInfo();
-    assert(pvih_out);
+    b = GetFrameLayout(pFormat, stride, w, h);
+    assert(b);
 
-    const RECT& rc_out = pvih_out->rcSource;
+    BYTE* buf_out;
 
-    const LONG rc_out_w = rc_out.right - rc_out.left;
-    assert(rc_out_w >= 0);
-    assert(rc_out_w % 2 == 0);  //TODO
+    hr = pOut->GetPointer(&buf_out);
+    assert(SUCCEEDED(hr));
+    assert(buf_out);
 
-    const BITMAPINFOHEADER& bmih_out = pvih_out->bmiHeader;
+    const long size_out = webmdshow::ColorConverter::GetFrameSize(
+                            pFormat->color_format,
+                            stride,
+                            h);
 
-    const LONG w_out = bmih_out.biWidth;  //stride
-    assert(w_out > 0);
-    assert(w_out % 2 == 0);  //TODO
+    const long actual_size_out = pOut->GetSize();
+    actual_size_out;
+    assert(actual_size_out >= size_out);
 
-    const LONG hh_out = bmih_out.biHeight;
-    assert(hh_out);
+    b = m_converter.Convert(buf_in, buf_out);
+    b;
+    assert(b);
 
-    const LONG h_out = labs(hh_out);
-    assert(h_out % 2 == 0);  //TODO
+    hr = pOut->SetActualDataLength(size_out);
+    assert(SUCCEEDED(hr));
 
-    BYTE* buf_out;
+    SampleProps props;
 
-    hr = pOut->GetPointer(&buf_out);
-    assert(SUCCEEDED(hr));
-    assert(buf_out);
+    GetSampleProps(pIn, props);
+    SetSampleProps(props, pOut);
+}
 
-    const AM_MEDIA_TYPE* const pmt_out = this->GetMediaType();
-    assert(pmt_out);
-    assert(pmt_out->subtype == MEDIASUBTYPE_YV12);
 
-    BYTE* const y = buf_out;
+long Outpin::GetOutputSize() const
+{
+    const Format* pFormat;
+    int stride, w, h;
 
-    const LONG y_stride = w_out;
-    const ULONG y_height = h_out;
+    const bool b = GetFrameLayout(pFormat, stride, w, h);
+    b;
+    assert(b);
 
-    const ULONG y_size = y_stride * y_height;
+    return webmdshow::ColorConverter::GetFrameSize(
+            pFormat->color_format,
+            stride,
+            h);
+}
 
-    const ULONG uv_stride = y_stride / 2;
-    const ULONG uv_height = y_height / 2;
 
-    const ULONG uv_size = uv_stride * uv_height;
+void Outpin::GetSampleProps(IMediaSample* pIn, SampleProps& props)
+{
+    assert(pIn);
 
-    const ULONG size_out = y_size + 2 * uv_size;  //calculated
+    props.hrTime = pIn->GetTime(&props.st, &props.sp);
 
-    const long actual_size_out = pOut->GetSize();
-    assert(actual_size_out >= 0);
-    assert(ULONG(actual_size_out) >= size_out);
+    const HRESULT hrDiscontinuity = pIn->IsDiscontinuity();
+    assert(SUCCEEDED(hrDiscontinuity));
 
-    BYTE* const v = y + y_size;
-    BYTE* const u = v + uv_size;
+    props.bDiscontinuity = (hrDiscontinuity == S_OK);
+}
 
-    assert(m_rgb_to_yuv);
-    (*m_rgb_to_yuv)(rgb, w_in, h_in, y, u, v, -1 * stride_in, y_stride);
 
-    hr = pOut->SetActualDataLength(size_out);
-    assert(SUCCEEDED(hr));
+void Outpin::SetSampleProps(const SampleProps& props, IMediaSample* pOut)
+{
+    assert(pOut);
 
-    REFERENCE_TIME st, sp;
+    REFERENCE_TIME st = props.st;
+    REFERENCE_TIME sp = props.sp;
 
-    hr = pIn->GetTime(&st, &sp);
+    HRESULT hr;
 
-    if (hr == S_OK)
+    if (props.hrTime == S_OK)
     {
         hr = pOut->SetTime(&st, &sp);
         assert(SUCCEEDED(hr));
     }
-    else if (SUCCEEDED(hr))
+    else if (SUCCEEDED(props.hrTime))
     {
         hr = pOut->SetTime(&st, 0);
         assert(SUCCEEDED(hr));
@@ -1131,12 +1322,7 @@ void Outpin::PopulateSample(
     hr = pOut->SetMediaType(0);
     assert(SUCCEEDED(hr));
 
-    const HRESULT hrDiscontinuity = pIn->IsDiscontinuity();
-    assert(SUCCEEDED(hrDiscontinuity));
-
-    const bool bDiscontinuity = (hrDiscontinuity == S_OK);
-
-    hr = pOut->SetDiscontinuity(bDiscontinuity ? TRUE : FALSE);
+    hr = pOut->SetDiscontinuity(props.bDiscontinuity ? TRUE : FALSE);
     assert(SUCCEEDED(hr));
 
     hr = pOut->SetMediaTime(0, 0);
@@ -1144,4 +1330,110 @@ void Outpin::PopulateSample(
 }
 
 
+bool Outpin::SubmitGpuFrame(IMediaSample* pIn)
+{
+    assert(pIn);
+    assert(m_bGpuConverting);
+
+    BYTE* buf_in;
+
+    const HRESULT hr = pIn->GetPointer(&buf_in);
+    assert(SUCCEEDED(hr));
+    assert(buf_in);
+
+    bool b;
+
+    {
+        webmdshow::PipelineCounters::Timer timer(m_pFilter->m_counters);
+        b = m_gpu_converter.Submit(buf_in);
+    }
+
+    if (!b)  //the device is lost; convert on the CPU from now on
+    {
+        DiscardGpuFrames();
+        m_bGpuConverting = false;
+
+        return false;
+    }
+
+    SampleProps props;
+
+    GetSampleProps(pIn, props);
+    m_gpu_frames.push_back(props);
+
+    return true;
+}
+
+
+HRESULT Outpin::DeliverGpuFrames(int keep)
+{
+    webmdshow::PipelineCounters& counters = m_pFilter->m_counters;
+
+    while (m_gpu_converter.pending() > keep)
+    {
+        assert(!m_gpu_frames.empty());
+
+        GraphUtil::IMediaSamplePtr pOutSample;
+
+        HRESULT hr = m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+
+        if (hr != S_OK)
+        {
+            counters.OnDrop();
+            return FAILED(hr) ? hr : E_FAIL;
+        }
+
+        BYTE* buf_out;
+
+        hr = pOutSample->GetPointer(&buf_out);
+        assert(SUCCEEDED(hr));
+        assert(buf_out);
+
+        bool b;
+
+        {
+            webmdshow::PipelineCounters::Timer timer(counters);
+            b = m_gpu_converter.Retrieve(buf_out);
+        }
+
+        const SampleProps props = m_gpu_frames.front();
+        m_gpu_frames.pop_front();
+
+        if (!b)  //the device is lost, with the frames it held
+        {
+            for (size_t i = 0; i <= m_gpu_frames.size(); ++i)
+                counters.OnDrop();
+
+            DiscardGpuFrames();
+            m_bGpuConverting = false;
+
+            return S_OK;
+        }
+
+        const long size_out = GetOutputSize();
+
+        hr = pOutSample->SetActualDataLength(size_out);
+        assert(SUCCEEDED(hr));
+
+        SetSampleProps(props, pOutSample);
+
+        counters.OnSampleOut(size_out);
+
+        hr = m_pInputPin->Receive(pOutSample);
+
+        if (hr != S_OK)
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
+void Outpin::DiscardGpuFrames()
+{
+    m_gpu_converter.Discard();
+    m_gpu_frames.clear();
+}
+
+
 }  //end namespace WebmColorConversion
@@ -9,8 +9,9 @@
 #pragma once
 #include "webmccpin.h"
 #include <comdef.h>
+#include <deque>
 #include "graphutil.h"
-#include "on2_codec/on2_image.h"
+#include "gpucolorconverter.h"
 
 namespace WebmColorConversion
 {
@@ -112,10 +113,54 @@ public:
     void OnInpinConnect(const AM_MEDIA_TYPE&);
     HRESULT OnInpinDisconnect();
 
+    //Conversion timings, and the number of bands each frame is split
+    //into, since the pin was last connected.
+    void GetConverterStats(webmdshow::ColorConverter::Stats&, int&) const;
+
+    //The matrix and range used to convert YUV to RGB.  Set them with
+    //the filter locked and stopped; a connected pin's converter is
+    //initialized again.
+    void GetYuvMatrix(webmdshow::YuvMatrix&, webmdshow::YuvRange&) const;
+    HRESULT SetYuvMatrix(webmdshow::YuvMatrix, webmdshow::YuvRange);
+
+    //Whether frames are to be converted and scaled on the GPU, if the
+    //formats and the machine allow it, and whether they are.  Set it
+    //with the filter locked and stopped, as for SetYuvMatrix.
+    bool GetGpuConvert() const;
+    bool IsGpuConverting() const;
+    HRESULT SetGpuConvert(bool);
+
 private:
     void SetDefaultMediaTypes();
-    on2_rgb_to_yuv_t m_rgb_to_yuv;
+    webmdshow::ColorConverter m_converter;
+    HRESULT InitConverter();
     void PopulateSample(IMediaSample* pIn, IMediaSample* pOut);
+    long GetOutputSize() const;
+
+    //The properties of an input sample that its output sample takes on.
+    struct SampleProps
+    {
+        REFERENCE_TIME st;
+        REFERENCE_TIME sp;
+        HRESULT hrTime;
+        bool bDiscontinuity;
+    };
+
+    static void GetSampleProps(IMediaSample*, SampleProps&);
+    static void SetSampleProps(const SampleProps&, IMediaSample*);
+
+    //The GPU converter, used in place of m_converter while
+    //m_bGpuConverting, and the properties of each frame it holds,
+    //oldest first.  A frame is sent downstream kLatency frames after it
+    //was submitted, or as soon as the inpin's queue runs dry.
+    webmdshow::GpuColorConverter m_gpu_converter;
+    bool m_bGpuConvert;
+    bool m_bGpuConverting;
+    std::deque<SampleProps> m_gpu_frames;
+
+    bool SubmitGpuFrame(IMediaSample*);
+    HRESULT DeliverGpuFrames(int keep);
+    void DiscardGpuFrames();
 
 private:
     HANDLE m_hThread;
@@ -9,6 +9,7 @@
 #include <strmif.h>
 #include "webmccpin.h"
 #include "webmccfilter.h"
+#include "webmtypes.h"
 #include <vfwmsgs.h>
 #include <cassert>
 #include <uuids.h>
@@ -20,6 +21,23 @@ using std::endl;
 namespace WebmColorConversion
 {
 
+const Pin::Format Pin::s_formats[Pin::cFormats] =
+{
+    { &MEDIASUBTYPE_YV12, webmdshow::kColorFormatYV12, 12,
+      MAKEFOURCC('Y', 'V', '1', '2') },
+    { &WebmTypes::MEDIASUBTYPE_I420, webmdshow::kColorFormatI420, 12,
+      MAKEFOURCC('I', '4', '2', '0') },
+    { &MEDIASUBTYPE_NV12, webmdshow::kColorFormatNV12, 12,
+      MAKEFOURCC('N', 'V', '1', '2') },
+    { &MEDIASUBTYPE_YUY2, webmdshow::kColorFormatYUY2, 16,
+      MAKEFOURCC('Y', 'U', 'Y', '2') },
+    { &MEDIASUBTYPE_UYVY, webmdshow::kColorFormatUYVY, 16,
+      MAKEFOURCC('U', 'Y', 'V', 'Y') },
+    { &MEDIASUBTYPE_RGB32, webmdshow::kColorFormatRGB32, 32, BI_RGB },
+    { &MEDIASUBTYPE_RGB24, webmdshow::kColorFormatRGB24, 24, BI_RGB }
+};
+
+
 Pin::Pin(
     Filter* pFilter,
     PIN_DIRECTION dir,
@@ -223,4 +241,65 @@ const VIDEOINFOHEADER* Pin::GetVideoInfo() const
 }
 
 
+const Pin::Format* Pin::FindFormat(const GUID& subtype)
+{
+    for (int i = 0; i < cFormats; ++i)
+    {
+        const Format& f = s_formats[i];
+
+        if (*f.subtype == subtype)
+            return &f;
+    }
+
+    return 0;
+}
+
+
+bool Pin::GetFrameLayout(
+    const Format*& pFormat,
+    int& stride,
+    int& width,
+    int& height) const
+{
+    const AM_MEDIA_TYPE* const pmt = GetMediaType();
+    const VIDEOINFOHEADER* const pvih = GetVideoInfo();
+
+    if ((pmt == 0) || (pvih == 0))
+        return false;
+
+    pFormat = FindFormat(pmt->subtype);
+
+    if (pFormat == 0)
+        return false;
+
+    const BITMAPINFOHEADER& bmih = pvih->bmiHeader;
+
+    if ((bmih.biWidth <= 0) || (bmih.biHeight == 0))
+        return false;
+
+    //biWidth is the stride, in pixels; rcSource, if set, is the part
+    //of each row that is the picture.
+
+    const RECT& rc = pvih->rcSource;
+
+    if (IsRectEmpty(&rc))
+        width = bmih.biWidth;
+    else
+        width = rc.right - rc.left;
+
+    height = labs(bmih.biHeight);
+
+    const webmdshow::ColorFormat f = pFormat->color_format;
+    stride = webmdshow::ColorConverter::GetStride(f, bmih.biWidth);
+
+    //An RGB DIB is bottom-up unless biHeight is negative; YUV is always
+    //top-down.
+
+    if ((pFormat->biCompression == BI_RGB) && (bmih.biHeight > 0))
+        stride = -stride;
+
+    return true;
+}
+
+
 }  //end namespace WebmColorConversion
@@ -9,6 +9,7 @@
 #pragma once
 #include "cmediatypes.h"
 #include "graphutil.h"
+#include "colorconverter.h"
 #include <amvideo.h>
 #include <string>
 
@@ -86,6 +87,31 @@ public:
     const AM_MEDIA_TYPE* GetMediaType() const;
     const VIDEOINFOHEADER* GetVideoInfo() const;
 
+    //The formats the filter converts between, in the order in which
+    //the outpin offers them.
+
+    struct Format
+    {
+        const GUID* subtype;
+        webmdshow::ColorFormat color_format;
+        WORD biBitCount;
+        DWORD biCompression;
+    };
+
+    enum { cFormats = 7 };
+    static const Format s_formats[cFormats];
+
+    static const Format* FindFormat(const GUID& subtype);
+
+    //Returns the stride (negative for a bottom-up DIB) and height of
+    //frames of the connection media type, and the width of their
+    //visible part.
+    bool GetFrameLayout(
+        const Format*&,
+        int& stride,
+        int& width,
+        int& height) const;
+
 protected:
     virtual HRESULT GetName(PIN_INFO&) const = 0;
     virtual HRESULT OnDisconnect();
@@ -0,0 +1,227 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "webmmuxchunkstream.h"
+#include <cassert>
+
+namespace WebmMuxLib
+{
+
+ChunkStream::ChunkStream() :
+    m_pSink(0),
+    m_type(kWebmMuxChunkBlock),
+    m_pos(0),
+    m_cChunks(0)
+{
+}
+
+
+ChunkStream::~ChunkStream()
+{
+    SetSink(0);
+}
+
+
+void ChunkStream::SetSink(IWebmMuxChunkSink* pSink)
+{
+    if (pSink)
+        pSink->AddRef();
+
+    if (m_pSink)
+        m_pSink->Release();
+
+    m_pSink = pSink;
+    m_type = kWebmMuxChunkBlock;
+    m_pos = 0;
+    m_cChunks = 0;
+}
+
+
+IWebmMuxChunkSink* ChunkStream::GetSink() const
+{
+    return m_pSink;
+}
+
+
+void ChunkStream::SetChunkType(WebmMuxChunkType type)
+{
+    m_type = type;
+}
+
+
+__int64 ChunkStream::GetChunkCount() const
+{
+    return m_cChunks;
+}
+
+
+HRESULT ChunkStream::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IStream*>(this);
+
+    else if (iid == __uuidof(ISequentialStream))
+        pUnk = static_cast<ISequentialStream*>(this);
+
+    else if (iid == __uuidof(IStream))
+        pUnk = static_cast<IStream*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG ChunkStream::AddRef()
+{
+    return 1;
+}
+
+
+ULONG ChunkStream::Release()
+{
+    return 1;
+}
+
+
+HRESULT ChunkStream::Read(void*, ULONG, ULONG* pcbRead)
+{
+    if (pcbRead)
+        *pcbRead = 0;
+
+    return STG_E_ACCESSDENIED;  //write-only
+}
+
+
+HRESULT ChunkStream::Write(const void* pv, ULONG cb, ULONG* pcbWritten)
+{
+    if (pcbWritten)
+        *pcbWritten = 0;
+
+    if (m_pSink == 0)
+        return E_UNEXPECTED;
+
+    if (cb == 0)
+        return S_OK;
+
+    if (pv == 0)
+        return STG_E_INVALIDPOINTER;
+
+    const BYTE* const pData = static_cast<const BYTE*>(pv);
+
+    const HRESULT hr = m_pSink->OnChunk(m_type, pData, cb);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_type = kWebmMuxChunkBlock;
+    m_pos += cb;
+    ++m_cChunks;
+
+    if (pcbWritten)
+        *pcbWritten = cb;
+
+    return S_OK;
+}
+
+
+HRESULT ChunkStream::Seek(
+    LARGE_INTEGER move,
+    DWORD origin,
+    ULARGE_INTEGER* pPos)
+{
+    __int64 pos;
+
+    switch (origin)
+    {
+        case STREAM_SEEK_SET:
+            pos = move.QuadPart;
+            break;
+
+        case STREAM_SEEK_CUR:
+            pos = m_pos + move.QuadPart;
+            break;
+
+        default:
+            return STG_E_INVALIDFUNCTION;
+    }
+
+    if (pos != m_pos)  //bytes already delivered cannot be rewritten
+        return STG_E_INVALIDFUNCTION;
+
+    if (pPos)
+        pPos->QuadPart = m_pos;
+
+    return S_OK;
+}
+
+
+HRESULT ChunkStream::SetSize(ULARGE_INTEGER)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT ChunkStream::CopyTo(
+    IStream*,
+    ULARGE_INTEGER,
+    ULARGE_INTEGER*,
+    ULARGE_INTEGER*)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT ChunkStream::Commit(DWORD)
+{
+    return S_OK;
+}
+
+
+HRESULT ChunkStream::Revert()
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT ChunkStream::LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT ChunkStream::UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT ChunkStream::Stat(STATSTG*, DWORD)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT ChunkStream::Clone(IStream**)
+{
+    return E_NOTIMPL;
+}
+
+
+}  //end namespace WebmMuxLib
@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objidl.h>
+#include "webmmuxidl.h"
+
+namespace WebmMuxLib
+{
+
+//An append-only stream that hands each write to an IWebmMuxChunkSink,
+//so a live mux can be delivered without an IStream downstream.  The
+//muxer flushes its write buffer at chunk boundaries, so each flush
+//arrives at the sink as one chunk.  Seeking is not supported (other
+//than to query the current position), which is fine for live mode,
+//since nothing gets rewritten.
+
+class ChunkStream : public IStream
+{
+    ChunkStream(const ChunkStream&);
+    ChunkStream& operator=(const ChunkStream&);
+
+public:
+
+    ChunkStream();
+    ~ChunkStream();
+
+    void SetSink(IWebmMuxChunkSink*);
+    IWebmMuxChunkSink* GetSink() const;
+
+    //Type reported for the next write; reverts to kWebmMuxChunkBlock
+    //once that write has been delivered.
+    void SetChunkType(WebmMuxChunkType);
+
+    __int64 GetChunkCount() const;
+
+    //IUnknown (not reference-counted; owned by the Context)
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //ISequentialStream
+
+    HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*);
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*);
+
+    //IStream
+
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*);
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER);
+
+    HRESULT STDMETHODCALLTYPE CopyTo(
+        IStream*,
+        ULARGE_INTEGER,
+        ULARGE_INTEGER*,
+        ULARGE_INTEGER*);
+
+    HRESULT STDMETHODCALLTYPE Commit(DWORD);
+    HRESULT STDMETHODCALLTYPE Revert();
+
+    HRESULT STDMETHODCALLTYPE LockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE UnlockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD);
+    HRESULT STDMETHODCALLTYPE Clone(IStream**);
+
+private:
+
+    IWebmMuxChunkSink* m_pSink;
+    WebmMuxChunkType m_type;
+    __int64 m_pos;
+    __int64 m_cChunks;
+
+};
+
+}  //end namespace WebmMuxLib
@@ -6,14 +6,21 @@
 // in the file PATENTS.  All contributing project authors may
 // be found in the AUTHORS file in the root of the source tree.
 
+#define _CRT_RAND_S  //for rand_s, before the CRT headers
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstring>
 #include <ctime>
 #include <sstream>
 
 #include <strmif.h>
 #include <comdef.h>
+#include <process.h>
 
 #include "comreg.h"
+#include "crc32.h"
+#include "ebmlelement.h"
 #include "scratchbuf.h"
 #include "versionhandling.h"
 #include "webmconstants.h"
@@ -26,8 +33,15 @@ using std::endl;
 
 using std::wstring;
 using std::wostringstream;
+using WebmUtil::EbmlWriteBytes;
+using WebmUtil::EbmlWriteHeader;
+using WebmUtil::EbmlWriteID;
+using WebmUtil::EbmlWriteUIntElement;
+using WebmUtil::EbmlWriteUnknownSize;
 
 enum { kAudioClusterSizeInTimeMs = 5000 };  //TODO: parameterize this
+enum { kHeaderBufferSize = 16384 };  //EBML header, segment info, tracks
+enum { kCueSpacingMs = 1000 };  //assumed when there's no cue interval
 
 namespace WebmMuxLib
 {
@@ -35,29 +49,74 @@ namespace WebmMuxLib
 extern HMODULE s_hModule;
 
 Context::Context() :
+   m_counters(L"webmmux"),
+   m_write_counters(L"webmmux.write"),
    m_bLiveMux(false),
+   m_bLowLatency(false),
+   m_bSegments(false),
+   m_segment_duration(0),
+   m_segment_timecode(0),
+   m_max_cluster_size(0),
+   m_bClusterKeyFramesOnly(false),
+   m_bClusterAssembly(false),
+   m_bClusterCrc(false),
+   m_cluster_video_size(0),
+   m_cClusterBlocks(0),
    m_bBufferData(false),
    m_pVideo(0),
-   m_pAudio(0),
    m_timecode_scale(1000000),  //TODO
    m_info_pos(0),
    m_seekhead_pos(0),
-   m_segment_pos(0)
+   m_segment_pos(0),
+   m_cClusters(0),
+   m_cues_reserve_duration(0),
+   m_cues_void_pos(-1),
+   m_cues_void_size(0),
+   m_checkpoint_interval(0),
+   m_checkpoint_timecode(0),
+   m_bPreallocate(false),
+   m_preallocated(0),
+   m_preallocate_pos(0),
+   m_preallocate_timecode(0),
+   m_queue_duration(0),
+   m_hWriterThread(0),
+   m_bStopWriter(false),
+   m_pWriterLock(0),
+   m_bEncrypt(false),
+   m_iv(0)
 {
+    m_hWriterEvent = CreateEvent(0, 0, 0, 0);  //auto-reset
+    assert(m_hWriterEvent);  //TODO
+
     //Seed the random number generator, which is needed
     //for creation of unique TrackUIDs.
 
     const time_t time_ = time(0);
     const unsigned seed = static_cast<unsigned>(time_);
     srand(seed);
+
+    SetMaxClusterDuration(1000);
+
+    //The headers are assembled in m_buf.  Reset keeps its capacity, so
+    //sizing it once here means it never has to grow while copying the
+    //codec private data of the tracks.
+    m_buf.Reserve(kHeaderBufferSize);
+
+    m_file.SetCounters(&m_write_counters);
+    m_file.SetWriteAheadLimit(EbmlIO::File::kDefaultWriteAheadLimit);
 }
 
 
 Context::~Context()
 {
    assert(m_pVideo == 0);
-   assert(m_pAudio == 0);
+   assert(m_audio.empty());
    assert(m_file.GetStream() == 0);
+   assert(m_hWriterThread == 0);
+
+   const BOOL b = CloseHandle(m_hWriterEvent);
+   assert(b);
+   b;
 }
 
 
@@ -66,19 +125,197 @@ void Context::SetVideoStream(StreamVideo* pVideo)
    assert((pVideo == 0) || (m_pVideo == 0));
    assert((pVideo == 0) || (pVideo->GetFrames().empty()));
    assert((pVideo == 0) || (pVideo->GetKeyFrames().empty()));
-   assert(m_clusters.empty());
+   assert(m_cues.GetCount() == 0);
 
    m_pVideo = pVideo;
 }
 
 
-void Context::SetAudioStream(StreamAudio* pAudio)
+void Context::AddAudioStream(StreamAudio* pAudio)
+{
+   assert(pAudio);
+   assert(pAudio->GetFrames().empty());
+   assert(GetAudioIndex(pAudio) >= m_audio.size());
+   assert(m_cues.GetCount() == 0);
+
+   const AudioTrack t = { pAudio, false, 0 };
+   m_audio.push_back(t);
+}
+
+
+void Context::RemoveAudioStream(StreamAudio* pAudio)
+{
+   typedef audio_tracks_t::iterator iter_t;
+
+   for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+   {
+       if (i->m_pStream == pAudio)
+       {
+           m_audio.erase(i);
+           return;
+       }
+   }
+
+   assert(false);
+}
+
+
+ULONG Context::GetAudioIndex(const StreamAudio* pAudio) const
+{
+    //Returns m_audio.size() if the stream isn't found.
+
+    const ULONG n = static_cast<ULONG>(m_audio.size());
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        if (m_audio[i].m_pStream == pAudio)
+            return i;
+    }
+
+    return n;
+}
+
+
+bool Context::IsEOSAudio() const
+{
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        if (!i->m_bEOS)
+            return false;
+    }
+
+    return true;  //also true when there are no audio streams
+}
+
+
+bool Context::HasAudioFrames() const
+{
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        if (!i->m_pStream->GetFrames().empty())
+            return true;
+    }
+
+    return false;
+}
+
+
+bool Context::GetAudioStart(ULONG& t) const
+{
+    //Finds the smallest timecode among the frames in the audio queues.
+
+    bool result = false;
+
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        const StreamAudio::frames_t& aframes = i->m_pStream->GetFrames();
+
+        if (aframes.empty())
+            continue;
+
+        const StreamAudio::AudioFrame* const paf = aframes.front();
+        assert(paf);
+
+        const ULONG at = paf->GetTimecode();
+
+        if (!result || (at < t))
+            t = at;
+
+        result = true;
+    }
+
+    return result;
+}
+
+
+bool Context::IsAudioReady(ULONG t) const
+{
+    //Returns true when every audio stream that hasn't reached EOS
+    //has delivered a frame whose timecode is at least t.
+
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        if (i->m_bEOS)
+            continue;
+
+        const StreamAudio::frames_t& aframes = i->m_pStream->GetFrames();
+
+        if (aframes.empty())
+            return false;
+
+        const StreamAudio::AudioFrame* const paf = aframes.back();
+        assert(paf);
+
+        if (paf->GetTimecode() < t)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool Context::GetQueueDepth(int tn, ULONG& frames) const
+{
+    if ((m_pVideo != 0) && (m_pVideo->GetTrackNumber() == tn))
+    {
+        frames = static_cast<ULONG>(m_pVideo->GetFrames().size());
+        return true;
+    }
+
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        const StreamAudio* const pAudio = i->m_pStream;
+
+        if (pAudio->GetTrackNumber() == tn)
+        {
+            frames = static_cast<ULONG>(pAudio->GetFrames().size());
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+ULONG Context::GetQueueDepth() const
+{
+    ULONG n = 0;
+
+    if (m_pVideo)
+        n += static_cast<ULONG>(m_pVideo->GetFrames().size());
+
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+        n += static_cast<ULONG>(i->m_pStream->GetFrames().size());
+
+    return n;
+}
+
+
+ULONG Context::GetAllocCount() const
 {
-   assert((pAudio == 0) || (m_pAudio == 0));
-   assert((pAudio == 0) || (pAudio->GetFrames().empty()));
-   assert(m_clusters.empty());
+    ULONG n = 0;
+
+    if (m_pVideo)
+        n += m_pVideo->GetAllocCount();
 
-   m_pAudio = pAudio;  //TODO: generlize this to many audio streams
+    typedef audio_tracks_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+        n += i->m_pStream->GetAllocCount();
+
+    return n;
 }
 
 
@@ -88,13 +325,14 @@ void Context::Open(IStream* pStream)
     assert(m_file.GetStream() == 0);
     assert((m_pVideo == 0) || (m_pVideo->GetFrames().empty()));
     assert((m_pVideo == 0) || (m_pVideo->GetKeyFrames().empty()));
-    assert((m_pAudio == 0) || (m_pAudio->GetFrames().empty()));
-    assert(m_clusters.empty());
+    assert(!HasAudioFrames());
+    assert(m_cues.GetCount() == 0);
 
     m_max_timecode = 0;        //to keep track of duration
+    m_video_last_timecode = -1;
     m_cEOS = 0;
     m_bEOSVideo = false;  //means we haven't seen EOS yet (from either
-    m_bEOSAudio = false;  //the stream itself, or because of stop)
+                          //the stream itself, or because of stop)
 
     int tn = 0;
 
@@ -104,15 +342,40 @@ void Context::Open(IStream* pStream)
         ++m_cEOS;
     }
 
-    if (m_pAudio)
+    typedef audio_tracks_t::iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
     {
-        m_pAudio->SetTrackNumber(++tn);
+        i->m_pStream->SetTrackNumber(++tn);
+        i->m_bEOS = false;
         ++m_cEOS;
     }
 
+    if (m_bSegments && m_segments.GetSink())
+        pStream = &m_segments;  //deliver in segments instead
+
+    else if (m_bLiveMux && m_chunks.GetSink())
+        pStream = &m_chunks;  //deliver through the sink instead
+
+    else if ((pStream == 0) && m_disk.IsOpen())
+        pStream = &m_disk;  //write the file ourselves
+
     if (pStream)
     {
-        m_file.SetStream(pStream);
+        m_chunks.SetChunkType(kWebmMuxChunkHeader);
+
+        if (pStream == &m_segments)
+        {
+            const HRESULT hr = m_segments.StartSegment(0);  //initialization
+            hr;
+            assert(SUCCEEDED(hr));
+        }
+
+        //Live chunks and DASH segments are cut at the frames that the
+        //muxer writes, so those streams must see each write as it's made.
+        const bool bWriteAhead = !m_bLiveMux && (pStream != &m_segments);
+
+        m_file.SetStream(pStream, bWriteAhead);
 
 #if 0   //TODO: parameterize this (with default of 0)
         const __int64 One_GB = 1024i64 * 1024i64 * 1024i64;
@@ -131,13 +394,27 @@ void Context::Open(IStream* pStream)
 
         ResetBuffer();
 
+        m_info.clear();
+        m_cues_void_pos = -1;
+        m_checkpoint_timecode = 0;
+        m_preallocated = 0;
+
         if (!m_bLiveMux)
             m_file.SetPosition(0);
         else
             assert(m_file.GetPosition() == 0);
 
+        if (!m_bLowLatency)
+            m_tee.Start();  //if it has sinks
+
         WriteEbmlHeader();
         InitSegment();
+
+        if (!m_bBufferData)  //otherwise the tracks are still to come
+            m_tee.QueueHeader();
+
+        if (m_bLiveMux)
+            m_file.Flush();  //headers go downstream now
     }
 }
 
@@ -147,8 +424,9 @@ void Context::Close()
     if (m_pVideo)
         NotifyVideoEOS(0);
 
-    if (m_pAudio)
-        NotifyAudioEOS(0);
+    //By way of the stream, so that it writes any frames it holds back.
+    for (ULONG i = 0; i < m_audio.size(); ++i)
+        m_audio[i].m_pStream->EndOfStream();
 
     Final();
 }
@@ -161,17 +439,50 @@ void Context::Final()
         if (m_pVideo)
             m_pVideo->Final();  //grant last wishes
 
-        if (m_pAudio)
-            m_pAudio->Final();  //grant last wishes
+        for (ULONG i = 0; i < m_audio.size(); ++i)
+            m_audio[i].m_pStream->Final();  //grant last wishes
+
+        const bool bSegments = (m_file.GetStream() == &m_segments);
 
         FinalSegment();
-        m_file.SetStream(0);
+        m_file.SetStream(0);  //flushes
+
+        m_tee.Stop();  //once the copies have been delivered
+
+        if (bSegments)
+        {
+            const LONGLONG t = GetMilliseconds(m_max_timecode);
+
+            const HRESULT hr = m_segments.Close(t);
+            hr;
+            assert(SUCCEEDED(hr));
+        }
+
+#ifdef _DEBUG
+        odbgstream os;
+        os << "WebmMux::Context::Final: bytes written="
+           << m_file.GetBytesWritten()
+           << " write calls="
+           << m_file.GetWriteCount()
+           << " peak queued="
+           << m_file.GetPeakQueuedBytes()
+           << " stall ms="
+           << (m_file.GetStallTime() / 1000)
+           << endl;
+#endif
+    }
+
+    if (m_disk.IsOpen())
+    {
+        const HRESULT hr = m_disk.Close();
+        hr;
+        assert(SUCCEEDED(hr));
     }
 
-    assert(m_clusters.empty());
+    assert(m_cues.GetCount() == 0);
     assert((m_pVideo == 0) || (m_pVideo->GetFrames().empty()));
     assert((m_pVideo == 0) || (m_pVideo->GetKeyFrames().empty()));
-    assert((m_pAudio == 0) || (m_pAudio->GetFrames().empty()));
+    assert(!HasAudioFrames());
 }
 
 
@@ -253,12 +564,20 @@ void Context::WriteEbmlHeader()
     // dump |m_buf| into the out file
     m_file.Write(m_buf.GetBufferPtr(),
                  static_cast<ULONG>(m_buf.GetBufferLength()));
+    m_tee.AppendHeader(m_buf.GetBufferPtr(),
+                       static_cast<ULONG>(m_buf.GetBufferLength()));
     m_buf.Reset();
 }
 
 
 void Context::InitSegment()
 {
+    //The copies of the tee are live, whatever the mode: their segment
+    //has unknown size, and no seek head.
+
+    const BYTE tee_segment[] = { 0x18, 0x53, 0x80, 0x67, 0xFF };
+    m_tee.AppendHeader(tee_segment, sizeof tee_segment);
+
     m_file.WriteID4(WebmUtil::kEbmlSegmentID);  //Segment ID
 
     if (m_bLiveMux)
@@ -281,38 +600,64 @@ void Context::FinalSegment()
 {
     if (!m_bLiveMux)
     {
-        m_cues_pos = m_file.GetPosition();  //end of clusters
+        const bool bReserved = (m_pVideo != 0) && IsCuesReserveFit();
 
-        if (m_pVideo)
-            WriteCues();
+        if (bReserved)
+            m_cues_pos = m_cues_void_pos;
+        else
+        {
+            //The reserved space may hold the cues of a checkpoint.
+            if (m_cues_void_pos >= 0)
+                VoidReservedCues();
+
+            m_cues_pos = m_file.GetPosition();  //end of clusters
+
+            if (m_pVideo)
+                WriteCues();
+        }
 
         const __int64 maxpos = m_file.GetPosition();
         m_file.SetSize(maxpos);
 
+        //What remains are patches of the headers.  They're made in
+        //order of position, and the segment size, seek head and segment
+        //info are contiguous, so they reach the stream as a single write
+        //(and the reserved cues as a second one).
+
         const __int64 size = maxpos - m_segment_pos - 12;
         assert(size >= 0);
 
-        m_file.SetPosition(m_segment_pos);
-
-        const ULONG id = m_file.ReadID4();
-        assert(id == WebmUtil::kEbmlSegmentID);
-        id;
-
+        m_file.SetPosition(m_segment_pos + 4);  //past the Segment ID
         m_file.Write8UInt(size);  //total size of the segment
 
         if (m_pVideo)
             FinalSeekHead();
 
         FinalInfo();
+
+        if (bReserved)
+            WriteReservedCues();
     }
 
-    m_clusters.clear();
+    m_cues.Clear();
+    m_cClusters = 0;
 }
 
 
 void Context::FinalInfo()
 {
-    m_file.SetPosition(m_duration_pos);
+    //Rather than seek over the start of the segment info, we write it
+    //again from the copy made by InitInfo, so that this patch joins the
+    //one made by FinalSeekHead.
+
+    m_file.SetPosition(m_info_pos);
+
+    const __int64 off = m_duration_pos - m_info_pos;
+    assert(off > 0);
+    assert(off <= __int64(m_info.size()));
+
+    m_file.Write(&m_info[0], static_cast<ULONG>(off));
+    assert(m_file.GetPosition() == m_duration_pos);
 
     m_file.WriteID2(WebmUtil::kEbmlDurationID); // Duration ID
     m_file.Write1UInt(4);                       // payload size
@@ -389,7 +734,14 @@ void Context::FinalSeekHead()
 
     m_file.WriteID1(WebmUtil::kEbmlVoidID);
     m_file.Write2UInt(void_size);
-    m_file.SetPosition(void_size, STREAM_SEEK_CUR);
+
+    //Write the padding, instead of seeking over it, so that the patches
+    //that follow stay contiguous with this one.
+
+    BYTE pad[void_size];
+    memset(pad, 0, void_size);
+
+    m_file.Write(pad, void_size);
 
     assert((m_file.GetPosition() - start_pos) == (4 + 2 + final_size));
 }
@@ -489,8 +841,14 @@ void Context::InitInfo()
         m_buf.GetBufferLength() - num_bytes_to_ignore;
     m_buf.RewriteUInt(size_pos, actual_seginfo_len, sizeof(uint16));
 
-    m_file.Write(m_buf.GetBufferPtr(),
-                 static_cast<ULONG>(m_buf.GetBufferLength()));
+    const BYTE* const ptr = m_buf.GetBufferPtr();
+    const ULONG len = static_cast<ULONG>(m_buf.GetBufferLength());
+
+    if (!m_bLiveMux)
+        m_info.assign(ptr, ptr + len);
+
+    m_file.Write(ptr, len);
+    m_tee.AppendHeader(ptr, len);  //the Void for Duration stays void
     m_buf.Reset();
 }
 
@@ -521,8 +879,8 @@ void Context::WriteTrack()
     if (m_pVideo)
         m_pVideo->WriteTrackEntry(++track_num);
 
-    if (m_pAudio)  //TODO: allow for multiple audio streams
-        m_pAudio->WriteTrackEntry(++track_num);
+    for (ULONG i = 0; i < m_audio.size(); ++i)
+        m_audio[i].m_pStream->WriteTrackEntry(++track_num);
 
     if (m_bBufferData)
     {
@@ -540,7 +898,11 @@ void Context::WriteTrack()
         m_buf.RewriteUInt(track_len_offset, actual_tracks_len, sizeof(uint16));
         m_file.Write(m_buf.GetBufferPtr(),
                      static_cast<ULONG>(m_buf.GetBufferLength()));
+        m_tee.AppendHeader(m_buf.GetBufferPtr(),
+                           static_cast<ULONG>(m_buf.GetBufferLength()));
         m_buf.Reset();
+
+        InitCues();
     }
 
 }
@@ -574,150 +936,173 @@ void Context::Cluster::Final(
 #endif
 
 
-void Context::WriteCuePoints(const Cluster& c)
+void Context::InitCues()
 {
-    //cue point container = 1 + size len(2) + payload len
-    //  time = 1 + size len(1) + payload len(4)
-    //  track posns container = 1 + size len + payload len
-    //     track = 1 + size len + payload len (track number val)
-    //     cluster pos = 1 + size len + payload len (pos val)
-    //     block num = 2 + size len + payload len (block num val)
+    //Called once the tracks have been written, to reserve space for
+    //the cues after them.
 
-    //TODO: for now just write video keyframes
-    //Do we even need audio here?
-    //We would need something, if this is an audio-only mux.
+    if (m_bLiveMux || (m_pVideo == 0) || (m_cues_reserve_duration == 0))
+        return;
 
-    //TODO: write this at beginning of file
+    assert(m_cues_void_pos < 0);
 
-    const Cluster::keyframes_t& kk = c.m_keyframes;
-    assert(kk.size() <= 255);
+    const ULONG interval = GetCueInterval();
+    const ULONG spacing = (interval > 0) ? interval : ULONG(kCueSpacingMs);
 
-    typedef Cluster::keyframes_t::const_iterator iter_t;
+    const __int64 n = m_cues_reserve_duration / spacing + 1;
+    const __int64 size = 8 + n * CueIndex::kPointSize;  //one Cues element
 
-    iter_t i = kk.begin();
-    const iter_t j = kk.end();
+    if (size > 0x0FFFFFFE)  //won't fit in the 4-byte size of Cues
+        return;
 
-    while (i != j)
-    {
-        const Keyframe& k = *i++;
-        WriteCuePoint(c, k);
-    }
+    m_cues_void_pos = m_file.GetPosition();
+    m_cues_void_size = size;
+
+    m_file.WriteID1(WebmUtil::kEbmlVoidID);
+    m_file.Write8UInt(size - 9);
+    m_file.SetPosition(size - 9, STREAM_SEEK_CUR);
 }
 
 
-Context::Keyframe::Keyframe() :
-   m_timecode(0),
-   m_block(0)
+__int64 Context::GetCuesSize() const
 {
+    return m_cues.GetSize();
 }
 
 
-Context::Keyframe::Keyframe(
-   ULONG t,
-   ULONG n) :
-   m_timecode(t),
-   m_block(n)
+bool Context::IsCuesReserveFit() const
 {
+    if (m_cues_void_pos < 0)
+        return false;
+
+    const __int64 size = GetCuesSize();
+
+    if (size == m_cues_void_size)
+        return true;
+
+    //Otherwise there must be room for another Void element (with its
+    //8-byte size) after the cues.
+
+    return ((size + 9) <= m_cues_void_size);
 }
 
 
-void Context::WriteCuePoint(
-    const Cluster& c,
-    const Keyframe& k)
+void Context::WriteReservedCues()
 {
-    assert(m_pVideo);
+    assert(IsCuesReserveFit());
 
-    EbmlIO::File& f = m_file;
+    m_file.SetPosition(m_cues_void_pos);
+    WriteCues();
 
-    f.WriteID1(0xBB);  //CuePoint ID
-    f.Write1UInt(28);  //payload size
+    //What's left of the reserved space stays void.
 
-#ifdef _DEBUG
-    const __int64 start_pos = f.GetPosition();
-#endif
+    const __int64 void_end = m_cues_void_pos + m_cues_void_size;
+    const __int64 void_size = void_end - m_file.GetPosition();
 
-    f.WriteID1(0xB3);                //CueTime ID
-    f.Write1UInt(4);                 //payload len is 4
-    f.Serialize4UInt(k.m_timecode);  //payload
-
-    f.WriteID1(0xB7);  //CueTrackPositions
-    f.Write1UInt(20);  //payload size
+    if (void_size > 0)
+    {
+        assert(void_size >= 9);
 
-#ifdef _DEBUG
-    const __int64 start_track_pos = f.GetPosition();
-#endif
+        m_file.WriteID1(WebmUtil::kEbmlVoidID);
+        m_file.Write8UInt(void_size - 9);
+    }
+}
 
-    const int tn_ = m_pVideo->GetTrackNumber();
-    assert(tn_ > 0);
-    assert(tn_ <= 255);
 
-    const BYTE tn = static_cast<BYTE>(tn_);
+void Context::VoidReservedCues()
+{
+    //Turns the reserved space back into a single Void element, so that
+    //the cues a checkpoint left there aren't taken for the segment's.
 
-    f.WriteID1(0xF7);        //CueTrack ID
-    f.Write1UInt(1);         //payload size is 1 byte
-    f.Serialize1UInt(tn);    //payload
+    assert(m_cues_void_pos >= 0);
+    assert(m_cues_void_size >= 9);
 
-    const __int64 off = c.m_pos - m_segment_pos - 12;
-    assert(off >= 0);
+    const __int64 pos = m_file.GetPosition();
 
-    f.WriteID1(0xF1);        //CueClusterPosition ID
-    f.Write1UInt(8);         //payload size is 8 bytes
-    f.Serialize8UInt(off);   //payload
-
-    //TODO: Keyframe::m_block_number is a 4-byte
-    //number, and we serialize all 4 bytes.  However,
-    //it's unlikely we'll have block numbers that large
-    //(because we create a new cluster every second).
-    //Right now we always decide statically how many
-    //bytes to serialize (we're using 4 bytes of storage,
-    //so we serialize all 4 bytes, irrespective of the
-    //value at run-time), but in the future we
-    //could decide to check at run-time how large a value
-    //we have, and then only serialize the minimum number
-    //of bytes required for that value.
-
-    f.WriteID2(0x5378);            //CueBlockNumber
-    f.Write1UInt(4);               //payload size
-    f.Serialize4UInt(k.m_block);   //payload  //TODO: don't need 4 bytes
+    m_file.SetPosition(m_cues_void_pos);
+    m_file.WriteID1(WebmUtil::kEbmlVoidID);
+    m_file.Write8UInt(m_cues_void_size - 9);
 
-#ifdef _DEBUG
-    const __int64 stop_pos = f.GetPosition();
-    assert((stop_pos - start_track_pos) == 20);
-    assert((stop_pos - start_pos) == 28);
-#endif
+    m_file.SetPosition(pos);
 }
 
 
-
-void Context::WriteCues()
+void Context::WriteCheckpoint()
 {
-    m_file.WriteID4(0x1C53BB6B);   //Cues ID
-
-    //allocate 4 bytes of storage for size of cues element
-    const __int64 start_pos = m_file.SetPosition(4, STREAM_SEEK_CUR);
+    assert(!m_bLiveMux);
+    assert(m_pVideo);
 
-    typedef clusters_t::const_iterator iter_t;
+    if (m_cues.GetCount() == 0)
+        return;
 
-    iter_t i = m_clusters.begin();
-    const iter_t j = m_clusters.end();
+    const __int64 end_pos = m_file.GetPosition();  //end of clusters
 
-    while (i != j)
+    if (!IsCuesReserveFit())
     {
-        const Cluster& c = *i++;
-        WriteCuePoints(c);
+        //Reserve space after the clusters, with room for the cues to
+        //double, so that the space is moved (and the old space wasted)
+        //only a logarithmic number of times.
+
+        const __int64 size = 2 * GetCuesSize() + 9;
+
+        if (size > 0x0FFFFFFE)  //won't fit in the 4-byte size of Cues
+            return;
+
+        if (m_cues_void_pos >= 0)
+            VoidReservedCues();
+
+        m_cues_void_pos = end_pos;
+        m_cues_void_size = size;
     }
 
-    const __int64 stop_pos = m_file.GetPosition();
+    WriteReservedCues();
 
-    const __int64 size_ = stop_pos - start_pos;
-    assert(size_ <= ULONG_MAX);
+    __int64 maxpos = m_cues_void_pos + m_cues_void_size;
+
+    if (maxpos < end_pos)
+        maxpos = end_pos;
+
+    //The segment, as far as a reader is concerned, ends here; clusters
+    //written after this point are found by scanning from it.
+
+    const __int64 size = maxpos - m_segment_pos - 12;
+    assert(size >= 0);
+
+    m_file.SetPosition(m_segment_pos + 4);  //past the Segment ID
+    m_file.Write8UInt(size);
+
+    m_cues_pos = m_cues_void_pos;
+
+    FinalSeekHead();
+    FinalInfo();
+
+    m_file.SetPosition(maxpos);  //the next cluster follows
+    m_file.Flush();
+
+    //Ask the stream to make what it has been given durable.  Streams
+    //that don't keep anything back may not implement this.
+
+    IStream* const pStream = m_file.GetStream();
+    assert(pStream);
+
+    const HRESULT hr = pStream->Commit(STGC_DEFAULT);
+    hr;
+}
+
+
+void Context::WriteCues()
+{
+    //TODO: for now just write video keyframes
+    //Do we even need audio here?
+    //We would need something, if this is an audio-only mux.
 
-    const ULONG size = static_cast<ULONG>(size_);
+    assert(m_pVideo);
 
-    m_file.SetPosition(start_pos - 4);
-    m_file.Write4UInt(size);
+    const int tn = m_pVideo->GetTrackNumber();
+    assert(tn > 0);
+    assert(tn <= 255);
 
-    m_file.SetPosition(stop_pos);
+    m_cues.Write(m_file, static_cast<BYTE>(tn), m_segment_pos + 12);
 }
 
 
@@ -735,6 +1120,12 @@ void Context::NotifyVideoFrame(
     assert(!vframes.empty());
     assert(vframes.back() == pFrame);
 
+    if (m_bLowLatency)
+    {
+        WriteFramesLowLatency();
+        return;
+    }
+
     const ULONG vt = pFrame->GetTimecode();
 
     StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
@@ -742,70 +1133,29 @@ void Context::NotifyVideoFrame(
     if (rframes.empty())
     {
         rframes.push_back(pFrame);
+        m_cluster_video_size = pFrame->GetSize();
         return;
     }
 
-    if (pFrame->IsKey())
-        rframes.push_back(pFrame);
-    else if (m_bLiveMux)
+    if (!pFrame->IsKey() && !IsVideoClusterFull(*pFrame))
     {
-        #if 0 //def _DEBUG
-        odbgstream os;
-        os << "["__FUNCTION__"] " << "rframes.size()=" << rframes.size()
-           << " vframes.size()=" << vframes.size()<< endl;
-        #endif
+        m_cluster_video_size += pFrame->GetSize();
         return;
     }
 
-    else
-    {
-        const StreamVideo::VideoFrame* const pvf0 = rframes.back();
-        assert(pvf0);
-
-        const ULONG vt0 = pvf0->GetTimecode();
-        assert(vt >= vt0);
-
-        const LONGLONG dt = LONGLONG(vt) - LONGLONG(vt0);
-        assert(dt >= 0);
-
-        const LONGLONG scale = GetTimecodeScale();
-        assert(scale >= 1);
-
-        const LONGLONG ns = scale * dt;
-
-        //TODO: allow this to be parameterized
-        if (ns <= 1000000000)  //1 sec
-            return;
-
-        rframes.push_back(pFrame);
-    }
+    rframes.push_back(pFrame);
+    m_cluster_video_size = pFrame->GetSize();
 
     //At this point, we have at least 2 rframes, which means
     //at least one cluster is potentially available to be written
     //to the file.  (Here the constraints that the video stream
     //needs to satisfy have been satisified.  We might still have
-    //to wait for the audio stream to satisfy its constraints.)
+    //to wait for the audio streams to satisfy their constraints.)
 
-    if ((m_pAudio == 0) || m_bEOSAudio)
-    {
+    if (IsQueued())
+        WakeWriter();
+    else if (IsAudioReady(vt))
         CreateNewCluster(pFrame);
-        return;
-    }
-
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-
-    if (aframes.empty())
-        return;
-
-    const StreamAudio::AudioFrame* const paf = aframes.back();
-    assert(paf);
-
-    const ULONG at = paf->GetTimecode();
-
-    if (at < vt)
-        return;
-
-    CreateNewCluster(pFrame);
 }
 
 
@@ -813,30 +1163,37 @@ void Context::NotifyAudioFrame(
     StreamAudio* pAudio,
     StreamAudio::AudioFrame* pFrame)
 {
-    pAudio;
     assert(pAudio);
-    assert(pAudio == m_pAudio);
+    assert(GetAudioIndex(pAudio) < m_audio.size());
     assert(pFrame);
     assert(m_file.GetStream());
 
     StreamAudio::frames_t& aframes = pAudio->GetFrames();
     aframes.push_back(pFrame);
 
-    const ULONG at = pFrame->GetTimecode();
+    if (m_bLowLatency)
+    {
+        WriteFramesLowLatency();
+        return;
+    }
+
+    if (IsQueued())
+    {
+        WakeWriter();
+        return;
+    }
 
     if ((m_pVideo == 0) || (m_pVideo->GetFrames().empty() && m_bEOSVideo))
     {
-        const StreamAudio::AudioFrame* const paf = aframes.front();
-        assert(paf);
-
-        const ULONG at0 = paf->GetTimecode();
-        assert(at >= at0);
+        ULONG at0;
 
-        const LONG dt = LONG(at) - LONG(at0);
+        const bool b = GetAudioStart(at0);
+        assert(b);
+        b;
 
         //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
         //THIS IS WRONG AND NEEDS TO BE FIXED
-        if (dt >= kAudioClusterSizeInTimeMs)
+        if (IsAudioReady(at0 + kAudioClusterSizeInTimeMs))
             CreateNewClusterAudioOnly();
 
         return;
@@ -854,7 +1211,7 @@ void Context::NotifyAudioFrame(
 
         const ULONG vt = static_cast<ULONG>(vt_);
 
-        if (at >= vt)
+        if (IsAudioReady(vt))
             CreateNewCluster(0);  //NULL means deque all video
 
         return;  //not enough audio yet
@@ -885,7 +1242,7 @@ void Context::NotifyAudioFrame(
     const ULONG vt = pvf->GetTimecode();  //2nd rframe
     assert(vt >= vt0);
 
-    if (at < vt)
+    if (!IsAudioReady(vt))
         return;  //not enough audio
 
     CreateNewCluster(pvf);  //2nd rframe
@@ -903,11 +1260,21 @@ bool Context::WaitVideo() const
     if (m_bEOSVideo)
         return false;
 
-    if (m_pAudio == 0)
+    if (m_bLowLatency)  //frames are never held back for interleaving
         return false;
 
-    if (m_bEOSAudio)
-        return false;
+    if (IsQueued())
+    {
+        const StreamVideo::frames_t& vframes = m_pVideo->GetFrames();
+
+        if (vframes.empty())
+            return false;
+
+        const ULONG vt0 = vframes.front()->GetTimecode();
+        const ULONG vt = vframes.back()->GetTimecode();
+
+        return WaitQueued(vt0, vt);
+    }
 
     StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
 
@@ -931,60 +1298,96 @@ bool Context::WaitVideo() const
     if (dt < 1000)
         return false;
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
+    //We have a cluster's worth of video, so wait if any audio
+    //stream is lagging behind it.
 
-    if (aframes.empty())
-        return true;
+    typedef audio_tracks_t::const_iterator audio_iter_t;
 
-    const StreamAudio::AudioFrame* const paf = aframes.back();
-    assert(paf);
+    for (audio_iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        if (i->m_bEOS)
+            continue;
 
-    const ULONG at = paf->GetTimecode();
+        const StreamAudio::frames_t& aframes = i->m_pStream->GetFrames();
 
-    if (vt <= at)
-        return false;
+        if (aframes.empty())
+            return true;
 
-    //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
-    //THIS IS WRONG AND NEEDS TO BE FIXED
-    if ((vt - at) <= 1000)
-        return false;
+        const StreamAudio::AudioFrame* const paf = aframes.back();
+        assert(paf);
 
-    return true;
+        const ULONG at = paf->GetTimecode();
+
+        if (vt <= at)
+            continue;
+
+        //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
+        //THIS IS WRONG AND NEEDS TO BE FIXED
+        if ((vt - at) <= 1000)
+            continue;
+
+        return true;
+    }
+
+    return false;
 }
 
 
-bool Context::WaitAudio() const
+bool Context::WaitAudio(const StreamAudio* pAudio) const
 {
     if (m_file.GetStream() == 0)
         return false;
 
-    if (m_pAudio == 0)
-        return false;
+    const ULONG index = GetAudioIndex(pAudio);
 
-    if (m_bEOSAudio)
+    if (index >= m_audio.size())
         return false;
 
-    if (m_pVideo == 0)
+    if (m_audio[index].m_bEOS)
         return false;
 
-    if (m_bEOSVideo)
+    if (m_bLowLatency)
         return false;
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
+    const StreamAudio::frames_t& aframes = pAudio->GetFrames();
 
     if (aframes.empty())
         return false;
 
-    const StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
-
-    if (rframes.empty())
-        return true;  //wait for some video
-
     const StreamAudio::AudioFrame* const paf = aframes.back();
     assert(paf);
 
     const ULONG at = paf->GetTimecode();
 
+    if (IsQueued())
+        return WaitQueued(aframes.front()->GetTimecode(), at);
+
+    if ((m_pVideo == 0) || m_bEOSVideo)
+    {
+        //Without video to pace it, an audio stream is allowed to get at
+        //most one cluster ahead of the other audio streams.
+
+        ULONG at0;
+
+        const bool b = GetAudioStart(at0);
+        assert(b);
+        b;
+
+        //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
+        //THIS IS WRONG AND NEEDS TO BE FIXED
+        const ULONG at_stop = at0 + kAudioClusterSizeInTimeMs;
+
+        if (at < at_stop)
+            return false;
+
+        return !IsAudioReady(at_stop);
+    }
+
+    const StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+
+    if (rframes.empty())
+        return true;  //wait for some video
+
     const StreamVideo::VideoFrame* const pvf = rframes.back();
     assert(pvf);
 
@@ -1011,6 +1414,90 @@ bool Context::WaitAudio() const
 }
 
 
+bool Context::WaitQueued(ULONG t0, ULONG t) const
+{
+    //A stream whose queue spans t0 to t waits when that's more than the
+    //budget, unless it is a stream the writer is waiting for: the stream
+    //furthest behind never waits, so the ones ahead of it always drain.
+
+    if ((t - t0) <= m_queue_duration)
+        return false;
+
+    if (!IsAudioReady(t))
+        return true;
+
+    if ((m_pVideo == 0) || m_bEOSVideo)
+        return false;
+
+    return (m_pVideo->GetLastTimecode() < LONG(t));
+}
+
+
+bool Context::CreateReadyCluster()
+{
+    //The same decisions that NotifyVideoFrame and NotifyAudioFrame make
+    //as each frame arrives, made for whatever is queued.
+
+    if ((m_pVideo == 0) || (m_pVideo->GetFrames().empty() && m_bEOSVideo))
+    {
+        ULONG at0;
+
+        if (!GetAudioStart(at0))
+            return false;
+
+        //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
+        //THIS IS WRONG AND NEEDS TO BE FIXED
+        if (!IsAudioReady(at0 + kAudioClusterSizeInTimeMs))
+            return false;
+
+        CreateNewClusterAudioOnly();
+        return true;
+    }
+
+    if (m_pVideo->GetFrames().empty())
+        return false;
+
+    const StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+
+    if (rframes.size() >= 2)
+    {
+        StreamVideo::frames_t::const_iterator i = rframes.begin();
+
+        const StreamVideo::VideoFrame* const pvf = *++i;  //2nd rframe
+        assert(pvf);
+
+        if (!IsAudioReady(pvf->GetTimecode()))
+            return false;
+
+        CreateNewCluster(pvf);
+        return true;
+    }
+
+    if (!m_bEOSVideo)
+        return false;
+
+    const LONG vt = m_pVideo->GetLastTimecode();
+    assert(vt >= 0);
+
+    if (!IsAudioReady(static_cast<ULONG>(vt)))
+        return false;
+
+    CreateNewCluster(0);  //NULL means deque all video
+    return true;
+}
+
+
+bool Context::WriteReadyClusters()
+{
+    bool result = false;
+
+    while (CreateReadyCluster())
+        result = true;
+
+    return result;
+}
+
+
 
 int Context::NotifyVideoEOS(StreamVideo* pSource)
 {
@@ -1026,18 +1513,25 @@ int Context::NotifyVideoEOS(StreamVideo* pSource)
 
     if (m_file.GetStream() == 0)
         __noop;
-    else if ((m_pAudio == 0) || m_bEOSAudio)
+    else if (m_bLowLatency)
+        WriteFramesLowLatency();
+    else if (IsEOSAudio())
     {
+        if (IsQueued())
+            WriteReadyClusters();  //so the queues aren't written as one
+
         for (;;)
         {
             if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
                 CreateNewCluster(0);
-            else if ((m_pAudio != 0) && !m_pAudio->GetFrames().empty())
+            else if (HasAudioFrames())
                 CreateNewClusterAudioOnly();
             else
                 break;
         }
     }
+    else if (IsQueued())
+        WakeWriter();  //the audio no longer waits for video
 
     return EOS(pSource);
 }
@@ -1045,30 +1539,42 @@ int Context::NotifyVideoEOS(StreamVideo* pSource)
 
 int Context::NotifyAudioEOS(StreamAudio* pSource)
 {
-    if (m_bEOSAudio)
+    const ULONG index = GetAudioIndex(pSource);
+    assert(index < m_audio.size());
+
+    AudioTrack& t = m_audio[index];
+
+    if (t.m_bEOS)
         return 0;
 
 #if 0
     odbgstream os;
-    os << "mux::eosaudio" << endl;
+    os << "mux::eosaudio: track=" << pSource->GetTrackNumber() << endl;
 #endif
 
-    m_bEOSAudio = true;
+    t.m_bEOS = true;
 
     if (m_file.GetStream() == 0)
         __noop;
-    else if ((m_pVideo == 0) || m_bEOSVideo)
+    else if (m_bLowLatency)
+        WriteFramesLowLatency();
+    else if (((m_pVideo == 0) || m_bEOSVideo) && IsEOSAudio())
     {
+        if (IsQueued())
+            WriteReadyClusters();
+
         for (;;)
         {
             if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
                 CreateNewCluster(0);
-            else if ((m_pAudio != 0) && !m_pAudio->GetFrames().empty())
+            else if (HasAudioFrames())
                 CreateNewClusterAudioOnly();
             else
                 break;
         }
     }
+    else if (IsQueued())
+        WakeWriter();  //the other streams no longer wait for this one
 
     return EOS(pSource);
 }
@@ -1088,6 +1594,47 @@ int Context::EOS(Stream*)
 }
 
 
+bool Context::IsVideoClusterFull(const StreamVideo::VideoFrame& f) const
+{
+    //Whether the (non-key) video frame f must begin a new cluster,
+    //because the one that began at the last cluster boundary is full.
+
+    if (m_bLiveMux)  //a client can join the stream at any cluster
+        return false;
+
+    const StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+    assert(!rframes.empty());
+
+    const StreamVideo::VideoFrame* const pvf0 = rframes.back();
+    assert(pvf0);
+
+    const ULONG vt0 = pvf0->GetTimecode();
+    const ULONG vt = f.GetTimecode();
+    assert(vt >= vt0);
+
+    const ULONG dt = vt - vt0;
+
+    //The block timecode (relative to the cluster) must fit in 16 bits,
+    //whatever the policy.
+
+    if (dt > SHRT_MAX)
+        return true;
+
+    if (m_bClusterKeyFramesOnly)
+        return false;
+
+    if ((m_max_cluster_duration > 0) && (dt > m_max_cluster_duration))
+        return true;
+
+    const ULONG size = m_cluster_video_size;
+
+    if ((m_max_cluster_size > 0) && (size >= m_max_cluster_size))
+        return true;
+
+    return false;
+}
+
+
 void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
 {
 #if 0
@@ -1108,49 +1655,136 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
     const StreamVideo::frames_t& vframes = m_pVideo->GetFrames();
     assert(!vframes.empty());
 
-    clusters_t& cc = m_clusters;
+    //A video frame goes on this cluster if it precedes the stop frame.
+    //An audio frame goes on this cluster if the frame following it in
+    //the same stream also precedes the stop frame, so that the largest
+    //audio frame less than the stop frame begins the next cluster.  When
+    //there is no stop frame, all of the video is written, together with
+    //the audio that is not later than the last video frame.
 
-    //const Cluster* const pPrevCluster = cc.empty() ? 0 : &cc.back();
+    ULONG cVideoFrames = 0;
 
-    cc.push_back(Cluster());
-    Cluster& c = cc.back();
+    typedef StreamVideo::frames_t::const_iterator video_iter_t;
 
-    c.m_pos = m_file.GetPosition();
+    for (video_iter_t i = vframes.begin(); i != vframes.end(); ++i)
+    {
+        if (*i == pvf_stop)
+            break;
+
+        ++cVideoFrames;
+    }
+
+    assert(cVideoFrames > 0);
+
+    const StreamVideo::VideoFrame* const pvf_first = vframes.front();
+    assert(pvf_first);
+
+    const StreamVideo::VideoFrame* const pvf_last = vframes.back();
+    assert(pvf_last);
+
+    ULONG t0 = pvf_first->GetTimecode();
+
+    typedef audio_tracks_t::iterator audio_iter_t;
 
+    for (audio_iter_t k = m_audio.begin(); k != m_audio.end(); ++k)
     {
-        const StreamVideo::VideoFrame* const pvf = vframes.front();
-        assert(pvf);
-        assert(pvf != pvf_stop);
+        AudioTrack& t = *k;
+        t.m_cClusterFrames = 0;
+
+        const StreamAudio::frames_t& aframes = t.m_pStream->GetFrames();
+
+        if (aframes.empty())
+            continue;
+
+        typedef StreamAudio::frames_t::const_iterator iter_t;
+
+        iter_t i = aframes.begin();
+        const iter_t j = aframes.end();
+
+        const ULONG at = (*i)->GetTimecode();
+
+        if (at < t0)
+            t0 = at;
 
-        const ULONG vt = pvf->GetTimecode();
+        if (pvf_stop == 0)
+        {
+            const ULONG vt_last = pvf_last->GetTimecode();
 
-        if ((m_pAudio == 0) || m_pAudio->GetFrames().empty())
-            c.m_timecode = vt;
+            while ((i != j) && ((*i)->GetTimecode() <= vt_last))
+            {
+                ++t.m_cClusterFrames;
+                ++i;
+            }
+        }
         else
         {
-            const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-            const StreamAudio::AudioFrame* const paf = aframes.front();
-            const ULONG at = paf->GetTimecode();
+            const ULONG vt_stop = pvf_stop->GetTimecode();
+
+            for (;;)
+            {
+                const iter_t next = ++i;
+
+                if (next == j)
+                    break;
 
-            c.m_timecode = (at <= vt) ? at : vt;
+                if ((*next)->GetTimecode() >= vt_stop)
+                    break;
+
+                ++t.m_cClusterFrames;
+            }
         }
     }
 
-    // Write cluster header
-    m_file.WriteID4(WebmUtil::kEbmlClusterID);
-    if (!m_bLiveMux)
+    StartSegmentCluster(t0);
+    Preallocate(t0);
+
+    Cluster& c = m_cluster;
+    ++m_cClusters;
+
+    c.m_pos = m_file.GetPosition();
+    c.m_timecode = t0;
+
+    // The copies of the tee are made from the assembled bytes.  A copy
+    // that has lost clusters can resume only at a video keyframe.
+    const bool bAssemble =
+        m_bClusterAssembly || m_bClusterCrc || m_tee.IsStarted();
+    const bool bKey = pvf_first->IsKey();
+
+    // In live mode the cluster size is known only if it's assembled,
+    // since the stream can't be seeked.
+    const bool bKnownSize = !m_bLiveMux || bAssemble;
+
+    if (bAssemble)
+        m_file.BeginAssembly();  //our seek back is resolved in memory
+
+    // Write cluster header, assembled with its timecode and written in
+    // one call
+    BYTE hdr[4 + 4 + 6 + 1 + 1 + 8];  // ID, size, CRC-32, Timecode
+    BYTE* p = EbmlWriteID<WebmUtil::kEbmlClusterID>(hdr);
+
+    if (bKnownSize)
     {
         // Use a 8-byte cluster header
-        m_file.Serialize4UInt(0x1FFFFFFF);  // temp cluster size; rewritten
-                                            // below if |m_bLiveMux| is false
+        p = EbmlWriteUnknownSize<4>(p);  // temp cluster size; rewritten
+                                         // below
     }
     else
     {
         // Use a 5-byte cluster header
-        m_file.Serialize1UInt(0xFF);
+        p = EbmlWriteUnknownSize<1>(p);
     }
 
-    m_file.WriteID1(WebmUtil::kEbmlTimeCodeID);
+    __int64 crc_pos = -1;  //of the CRC-32 placeholder
+
+    if (m_bClusterCrc)
+    {
+        // The CRC-32 must be the first child.  Until the cluster is
+        // complete, it's a Void of the same size.
+        crc_pos = c.m_pos + (p - hdr);
+
+        p = EbmlWriteHeader<WebmUtil::kEbmlVoidID, 4>(p);
+        p = EbmlWriteBytes(p, 0, 4);
+    }
 
     BYTE timecode_size;
 
@@ -1166,8 +1800,12 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
         timecode_size = 8;
     }
 
-    m_file.Write1UInt(timecode_size);
-    m_file.SerializeUInt(c.m_timecode, timecode_size);
+    p = EbmlWriteUIntElement<WebmUtil::kEbmlTimeCodeID>(
+            p,
+            c.m_timecode,
+            timecode_size);
+
+    m_file.Write(hdr, static_cast<ULONG>(p - hdr));
 
     const __int64 off = c.m_pos - m_segment_pos - 12;
     assert(off >= 0);
@@ -1189,175 +1827,135 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
     }
 #endif
 
-    ULONG cFrames = 0;
-    LONG vtc_prev  = -1;
-
-    StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+    WriteClusterFrames(c, pvf_stop, cVideoFrames);
 
-    while (!vframes.empty())
+    if (bKnownSize)
     {
-        typedef StreamVideo::frames_t::const_iterator video_iter_t;
-
-        video_iter_t video_iter = vframes.begin();
-        const video_iter_t video_iter_end = vframes.end();
+        // We must seek back to the cluster size pos, and replace the
+        // -1 placeholder with the correct value.
+        const __int64 pos = m_file.GetPosition();
 
-        const StreamVideo::VideoFrame* const pvf = *video_iter++;
-        assert(pvf);
+        const __int64 size_ = pos - c.m_pos - 8;
+        assert(size_ <= ULONG_MAX);
 
-        if (pvf == pvf_stop)
-            break;
+        const ULONG size = static_cast<ULONG>(size_);
 
-        const StreamVideo::VideoFrame* const pvf_next =
-            (video_iter == video_iter_end) ? 0 : *video_iter;
+        m_file.SetPosition(c.m_pos + 4);
+        m_file.Write4UInt(size);
 
-        //const bool bLastVideo = (pvf_next == pvf_stop);
+        m_file.SetPosition(pos);
 
-        const ULONG vt = pvf->GetTimecode();
-        assert(vt >= c.m_timecode);
-        assert((pvf_stop == 0) || (vt < pvf_stop->GetTimecode()));
+        WriteClusterCrc(crc_pos);
+        TeeCluster(bKey);
+        m_file.EndAssembly();  //the whole cluster goes out now
+    }
 
-        if ((m_pAudio == 0) || m_pAudio->GetFrames().empty())
+    if (m_bLiveMux == false)
+    {
+        if ((m_checkpoint_interval > 0) && (m_pVideo != 0))
         {
-            if (!rframes.empty() && (pvf == rframes.front()))
-                rframes.pop_front();
-
-            const ULONG vtc = pvf->GetTimecode();
-
-            WriteVideoFrame(c, cFrames, pvf_stop, pvf_next, vtc_prev);
+            const ULONG dt = c.m_timecode - m_checkpoint_timecode;
 
-            vtc_prev = vtc;
-
-            continue;
+            if (dt >= m_checkpoint_interval)
+            {
+                m_checkpoint_timecode = c.m_timecode;
+                WriteCheckpoint();
+            }
         }
+    }
+    else
+    {
+        // In live mode the cluster must not wait in the write buffer.
+        m_file.Flush();
+    }
+}
 
-        const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-        typedef StreamAudio::frames_t::const_iterator audio_iter_t;
-
-        audio_iter_t i = aframes.begin();
-        const audio_iter_t j = aframes.end();
 
-        const StreamAudio::AudioFrame* const paf = *i++;  //1st audio frame
-        assert(paf);
+void Context::CreateNewClusterAudioOnly()
+{
+    assert(m_bBufferData == false);
 
-        const ULONG at = paf->GetTimecode();
-        assert(at >= c.m_timecode);
+    ULONG t0;
 
-        if (vt < at)
-        {
-            if (!rframes.empty() && (pvf == rframes.front()))
-                rframes.pop_front();
+    const bool b = GetAudioStart(t0);
+    assert(b);
+    b;
 
-            const ULONG vtc = pvf->GetTimecode();
+    assert((m_cClusters == 0) || (t0 >= m_cluster.m_timecode));
 
-            WriteVideoFrame(c, cFrames, pvf_stop, pvf_next, vtc_prev);
+    typedef audio_tracks_t::iterator audio_iter_t;
 
-            vtc_prev = vtc;
+    for (audio_iter_t k = m_audio.begin(); k != m_audio.end(); ++k)
+    {
+        AudioTrack& t = *k;
+        t.m_cClusterFrames = 0;
 
-            continue;
-        }
+        const StreamAudio::frames_t& aframes = t.m_pStream->GetFrames();
 
-        //At this point, we have (at least) one audio frame,
-        //and (at least) one video frame.  They could have an
-        //equal timecode, or the audio might be smaller than
-        //the video.  Our desire is that the largest audio
-        //frame less than the pvf_stop go on the next cluster,
-        //which means any video frames greater than the audio
-        //frame will also go on the next cluster.
+        typedef StreamAudio::frames_t::const_iterator iter_t;
 
-        if (pvf_stop == 0)  //means write all extant frames
+        for (iter_t i = aframes.begin(); i != aframes.end(); ++i)
         {
-            //We know that this audio frame is less or equal to
-            //the video frame, so write it now.
-
-            WriteAudioFrame(c, cFrames);
-            continue;
-        }
-
-        //At this point, we still have an audio frame and a
-        //video frame, neigther of which has been written yet.
-
-        const ULONG vt_stop = pvf_stop->GetTimecode();
-
-        if (at >= vt_stop)  //weird
-            break;
-
-        if (i == j)  //weird
-            break;
-
-        const StreamAudio::AudioFrame* const paf_stop = *i;  //2nd audio frame
-        assert(paf_stop);
+            const ULONG at = (*i)->GetTimecode();
+            assert(at >= t0);
 
-        const ULONG at_stop = paf_stop->GetTimecode();
+            const LONG dt = LONG(at) - LONG(t0);
 
-        if (at_stop >= vt_stop)
-            break;
-
-        WriteAudioFrame(c, cFrames);   //write 1st audio frame
-    }
-
-    if (m_bLiveMux == false)
-    {
-        // In default (not live) mode we must seek back to the
-        // cluster size pos, and replace the -1 placeholder with
-        // the correct value.
-        const __int64 pos = m_file.GetPosition();
-
-        const __int64 size_ = pos - c.m_pos - 8;
-        assert(size_ <= ULONG_MAX);
-
-        const ULONG size = static_cast<ULONG>(size_);
-
-        m_file.SetPosition(c.m_pos + 4);
-        m_file.Write4UInt(size);
+            if (dt > kAudioClusterSizeInTimeMs)
+                break;
 
-        m_file.SetPosition(pos);
+            ++t.m_cClusterFrames;
+        }
     }
-}
-
-
-void Context::CreateNewClusterAudioOnly()
-{
-    assert(m_bBufferData == false);
-    assert(m_pAudio);
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-    assert(!aframes.empty());
+    StartSegmentCluster(t0);
+    Preallocate(t0);
 
-    const StreamAudio::AudioFrame* const paf_first = aframes.front();
-    assert(paf_first);
+    Cluster& c = m_cluster;
+    ++m_cClusters;
 
-    const StreamAudio::AudioFrame& af_first = *paf_first;
-
-    const ULONG af_first_time = af_first.GetTimecode();
+    c.m_pos = m_file.GetPosition();
+    c.m_timecode = t0;
 
-    clusters_t& cc = m_clusters;
-    assert(cc.empty() || (af_first_time > cc.back().m_timecode));
+    const bool bAssemble =
+        m_bClusterAssembly || m_bClusterCrc || m_tee.IsStarted();
+    const bool bKnownSize = !m_bLiveMux || bAssemble;
 
-    cc.push_back(Cluster());
-    Cluster& c = cc.back();
+    if (bAssemble)
+        m_file.BeginAssembly();
 
-    c.m_pos = m_file.GetPosition();
-    c.m_timecode = af_first_time;
+    // Write cluster header, assembled with its timecode and written in
+    // one call
+    BYTE hdr[4 + 4 + 6 + 1 + 1 + 8];  // ID, size, CRC-32, Timecode
+    BYTE* p = EbmlWriteID<WebmUtil::kEbmlClusterID>(hdr);
 
-    // Write cluster header
-    m_file.WriteID4(WebmUtil::kEbmlClusterID);
-    if (!m_bLiveMux)
+    if (bKnownSize)
     {
         // Use a 7-byte cluster header
-        m_file.SerializeUInt(0x3FFFFF, 3);  // temp cluster size; rewritten
-                                            // below if |m_bLiveMux| is false
+        p = EbmlWriteUnknownSize<3>(p);  // temp cluster size; rewritten
+                                         // below
     }
     else
     {
         // Use a 5-byte cluster header
-        m_file.Serialize1UInt(0xFF);
+        p = EbmlWriteUnknownSize<1>(p);
     }
 
-    m_file.WriteID1(WebmUtil::kEbmlTimeCodeID);
-
-    BYTE timecode_size;
+    __int64 crc_pos = -1;  //of the CRC-32 placeholder
 
-    if (!m_bLiveMux)
+    if (m_bClusterCrc)
+    {
+        // The CRC-32 must be the first child.  Until the cluster is
+        // complete, it's a Void of the same size.
+        crc_pos = c.m_pos + (p - hdr);
+
+        p = EbmlWriteHeader<WebmUtil::kEbmlVoidID, 4>(p);
+        p = EbmlWriteBytes(p, 0, 4);
+    }
+
+    BYTE timecode_size;
+
+    if (!m_bLiveMux)
     {
         timecode_size = m_file.GetSerializeUIntSize(c.m_timecode);
         assert(timecode_size <= 8);
@@ -1369,8 +1967,12 @@ void Context::CreateNewClusterAudioOnly()
         timecode_size = 8;
     }
 
-    m_file.Write1UInt(timecode_size);
-    m_file.SerializeUInt(c.m_timecode, timecode_size);
+    p = EbmlWriteUIntElement<WebmUtil::kEbmlTimeCodeID>(
+            p,
+            c.m_timecode,
+            timecode_size);
+
+    m_file.Write(hdr, static_cast<ULONG>(p - hdr));
 
     const __int64 off = c.m_pos - m_segment_pos - 12;
     assert(off >= 0);
@@ -1392,46 +1994,334 @@ void Context::CreateNewClusterAudioOnly()
     }
 #endif
 
-    ULONG cFrames = 0;   //TODO: must write cues for audio
+    WriteClusterFrames(c, 0, 0);  //TODO: must write cues for audio
 
-    while (!aframes.empty())
+    if (bKnownSize)
     {
-        const StreamAudio::AudioFrame* const paf = aframes.front();
+        // We must seek back to the cluster size pos, and replace the
+        // -1 placeholder with the correct value.
+        const LONGLONG pos = m_file.GetPosition();
+        const LONGLONG size = pos - (c.m_pos + 7);  //7 = ID (4) + size (3)
+
+        m_file.SetPosition(c.m_pos + 4);
+        m_file.WriteUInt(size, 3);
+
+        m_file.SetPosition(pos);
+
+        WriteClusterCrc(crc_pos);
+        TeeCluster(true);  //every audio frame is a key frame
+        m_file.EndAssembly();
+    }
+
+    if (m_bLiveMux)
+    {
+        // In live mode the cluster must not wait in the write buffer.
+        m_file.Flush();
+    }
+}
+
+
+void Context::WriteClusterCrc(__int64 pos)
+{
+    //Called once the cluster has been assembled, before it's teed.
+
+    if ((pos < 0) || !m_file.IsAssembling())
+        return;  //a flush ended the assembly early; the Void stays
+
+    const BYTE* ptr;
+    ULONG len;
+
+    m_file.GetAssembly(ptr, len);
+
+    const __int64 end = m_file.GetPosition();
+    const __int64 begin = end - len;  //of the cluster
+    assert(pos >= begin);
+
+    const ULONG off = static_cast<ULONG>(pos - begin) + 6;
+    assert(off <= len);
+
+    const uint32_t crc = webmdshow::Crc32(0, ptr + off, len - off);
+
+    BYTE elem[6];
+    BYTE* p = EbmlWriteHeader<WebmUtil::kEbmlCrc32ID, 4>(elem);
+
+    for (int i = 0; i < 4; ++i)  //little-endian, unlike other integers
+        *p++ = static_cast<BYTE>(crc >> (8 * i));
+
+    m_file.SetPosition(pos);
+    m_file.Write(elem, sizeof elem);
+    m_file.SetPosition(end);
+}
+
+
+void Context::TeeCluster(bool bKey)
+{
+    //Called once the cluster has been assembled, before it's written.
+
+    if (!m_tee.IsStarted() || !m_file.IsAssembling())
+        return;  //a flush ended the assembly early
+
+    const BYTE* ptr;
+    ULONG len;
+
+    m_file.GetAssembly(ptr, len);
+    m_tee.QueueCluster(ptr, len, bKey);
+}
+
+
+bool Context::ClusterHead::operator<(const ClusterHead& rhs) const
+{
+    //The heap keeps its greatest element on top, so the frame to be
+    //written first must compare greatest.  On equal timecodes audio
+    //goes before video, and audio tracks go in track order.
+
+    if (m_timecode != rhs.m_timecode)
+        return (m_timecode > rhs.m_timecode);
+
+    return (m_index > rhs.m_index);
+}
+
+
+void Context::PushClusterHead(ULONG timecode, ULONG index)
+{
+    const ClusterHead h = { timecode, index };
+
+    m_heads.push_back(h);
+    std::push_heap(m_heads.begin(), m_heads.end());
+}
+
+
+void Context::WriteClusterFrames(
+    Cluster& c,
+    const StreamVideo::VideoFrame* pvf_stop,
+    ULONG cVideoFrames)
+{
+    //Writes the first cVideoFrames video frames, and the first
+    //m_cClusterFrames frames of each audio track.  No more than one
+    //frame per stream is in the heap at any time, so the heap never
+    //grows beyond the number of streams.
+
+    assert(m_heads.empty());
+
+    const ULONG video_index = static_cast<ULONG>(m_audio.size());
+
+    if (cVideoFrames > 0)
+    {
+        const StreamVideo::VideoFrame* const pvf = m_pVideo->GetFrames().front();
+        assert(pvf);
+
+        PushClusterHead(pvf->GetTimecode(), video_index);
+    }
+
+    for (ULONG index = 0; index < video_index; ++index)
+    {
+        const AudioTrack& t = m_audio[index];
+
+        if (t.m_cClusterFrames == 0)
+            continue;
+
+        const StreamAudio::AudioFrame* const paf =
+            t.m_pStream->GetFrames().front();
         assert(paf);
 
-        const ULONG t = paf->GetTimecode();
-        assert(t >= c.m_timecode);
+        PushClusterHead(paf->GetTimecode(), index);
+    }
 
-        const LONG dt = LONG(t) - LONG(c.m_timecode);
+    ULONG cFrames = 0;
 
-        if (dt > kAudioClusterSizeInTimeMs)
-            break;
+    while (!m_heads.empty())
+    {
+        std::pop_heap(m_heads.begin(), m_heads.end());
+
+        const ULONG index = m_heads.back().m_index;
+        m_heads.pop_back();
+
+        if (index == video_index)
+        {
+            const StreamVideo::frames_t& vframes = m_pVideo->GetFrames();
+            StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+
+            typedef StreamVideo::frames_t::const_iterator iter_t;
+
+            iter_t i = vframes.begin();
+            const iter_t j = vframes.end();
+
+            const StreamVideo::VideoFrame* const pvf = *i++;
+            assert(pvf);
+            assert(pvf != pvf_stop);
 
-        WriteAudioFrame(c, cFrames);
+            const StreamVideo::VideoFrame* const pvf_next = (i == j) ? 0 : *i;
+
+            const ULONG vtc = pvf->GetTimecode();
+            assert(vtc >= c.m_timecode);
+            assert((pvf_stop == 0) || (vtc < pvf_stop->GetTimecode()));
+
+            if (!rframes.empty() && (pvf == rframes.front()))
+                rframes.pop_front();
+
+            WriteVideoFrame(c, cFrames, pvf_stop, pvf_next);
+
+            if (--cVideoFrames > 0)
+            {
+                assert(pvf_next);
+                PushClusterHead(pvf_next->GetTimecode(), video_index);
+            }
+        }
+        else
+        {
+            AudioTrack& t = m_audio[index];
+            StreamAudio& s = *t.m_pStream;
+
+            WriteAudioFrame(c, cFrames, s);
+
+            if (--t.m_cClusterFrames > 0)
+            {
+                const StreamAudio::AudioFrame* const paf = s.GetFrames().front();
+                assert(paf);
+
+                PushClusterHead(paf->GetTimecode(), index);
+            }
+        }
     }
+}
 
-    if (m_bLiveMux == false)
+
+void Context::WriteFramesLowLatency()
+{
+    //Each frame is written as soon as it's received.  More than one
+    //frame is queued only while the track headers are still being
+    //buffered, in which case the earliest frame goes first.
+
+    if (m_bBufferData)
+        return;  //tracks have not been written yet
+
+    for (;;)
     {
-        // In default (not live) mode we must seek back to the
-        // cluster size pos, and replace the -1 placeholder with
-        // the correct value.
-        const LONGLONG pos = m_file.GetPosition();
-        const LONGLONG size = pos - (c.m_pos + 7);  //7 = ID (4) + size (3)
+        StreamVideo::VideoFrame* pvf = 0;
+        StreamAudio* pAudio = 0;
+        ULONG t = 0;
 
-        m_file.SetPosition(c.m_pos + 4);
-        m_file.WriteUInt(size, 3);
+        if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
+        {
+            pvf = m_pVideo->GetFrames().front();
+            assert(pvf);
 
-        m_file.SetPosition(pos);
+            t = pvf->GetTimecode();
+        }
+
+        typedef audio_tracks_t::const_iterator iter_t;
+
+        for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+        {
+            StreamAudio* const s = i->m_pStream;
+            const StreamAudio::frames_t& aframes = s->GetFrames();
+
+            if (aframes.empty())
+                continue;
+
+            const ULONG at = aframes.front()->GetTimecode();
+
+            if (((pvf == 0) && (pAudio == 0)) || (at < t))
+            {
+                pAudio = s;
+                t = at;
+            }
+        }
+
+        if (pAudio == 0)
+        {
+            if (pvf == 0)
+                break;
+        }
+        else
+            pvf = 0;
+
+        bool bNewCluster;
+
+        if (m_cClusters == 0)
+            bNewCluster = true;
+        else
+        {
+            const LONG dt = LONG(t) - LONG(m_cluster.m_timecode);
+            const __int64 size = m_file.GetPosition() - m_cluster.m_pos;
+
+            const bool bKey =
+                (pvf != 0) && pvf->IsKey() && (m_cClusterBlocks > 0);
+
+            //Keyframe boundaries only are kept while there is video.
+            const bool bLimits = !m_bClusterKeyFramesOnly ||
+                                 (m_pVideo == 0) || m_bEOSVideo;
+
+            const bool bDuration =
+                bLimits && (m_max_cluster_duration > 0) &&
+                (dt >= LONG(m_max_cluster_duration));
+
+            const bool bSize =
+                bLimits && (m_max_cluster_size > 0) &&
+                (size >= m_max_cluster_size);
+
+            //The block timecode (relative to the cluster) must fit in 16
+            //bits.  Beginning a cluster on each keyframe allows a client
+            //to join the stream there.
+            bNewCluster = (dt < SHRT_MIN) || (dt > SHRT_MAX) ||
+                          bKey || bDuration || bSize;
+        }
+
+        if (bNewCluster)
+            CreateNewClusterLowLatency(t);
+
+        if (pvf)
+        {
+            StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
+            assert(rframes.empty());  //not used in this mode
+            rframes;
+
+            WriteVideoFrame(m_cluster, m_cClusterBlocks, 0, 0);
+        }
+        else
+            WriteAudioFrame(m_cluster, m_cClusterBlocks, *pAudio);
+
+        m_file.Flush();  //the block goes downstream now
     }
 }
 
 
+void Context::CreateNewClusterLowLatency(ULONG timecode)
+{
+    assert(m_bBufferData == false);
+    assert(m_bLiveMux);
+
+    Cluster& c = m_cluster;
+    ++m_cClusters;
+
+    c.m_pos = m_file.GetPosition();
+    c.m_timecode = timecode;
+
+    m_cClusterBlocks = 0;
+
+    //The cluster header is delivered together with its first block.
+    m_chunks.SetChunkType(kWebmMuxChunkCluster);
+
+    // Write cluster header, with unknown size (the next cluster
+    // implicitly ends this one)
+    BYTE hdr[4 + 1 + 1 + 1 + 8];  // ID, size, Timecode ID, size, payload
+    BYTE* p = EbmlWriteID<WebmUtil::kEbmlClusterID>(hdr);
+    p = EbmlWriteUnknownSize<1>(p);
+
+    // To facilitate easy rewriting of timecodes, always write 8 byte
+    // timecodes in live mux mode.
+    p = EbmlWriteUIntElement<WebmUtil::kEbmlTimeCodeID, 8>(p, c.m_timecode);
+    assert(p == (hdr + sizeof hdr));
+
+    m_file.Write(hdr, sizeof hdr);
+}
+
+
 void Context::WriteVideoFrame(
     Cluster& c,
     ULONG& cFrames,
     const StreamVideo::VideoFrame* stop,
-    const StreamVideo::VideoFrame* next,
-    LONG /* prev_timecode */ )
+    const StreamVideo::VideoFrame* next)
 {
     assert(m_pVideo);
     StreamVideo& s = *m_pVideo;
@@ -1452,51 +2342,58 @@ void Context::WriteVideoFrame(
     ++cFrames;
 
     const ULONG ft = pf->GetTimecode();
+    const __int64 block_pos = m_file.GetPosition();
 
-#if 1
-    pf->WriteSimpleBlock(s, c.m_timecode);
-#else
-    if (next != stop)
-        pf->WriteSimpleBlock(s, c.m_timecode);
-    else
-    {
-        ULONG duration;
+    //A frame of a temporal layer goes in a block group, which records
+    //the layer.  A group without a ReferenceBlock is a keyframe, so a
+    //delta frame refers to the video frame before it (an altref too:
+    //each frame is written as it comes, shown or not).
 
-        if (next == 0)
-            duration = pf->GetDuration();
-        else
-        {
-            const ULONG tc_curr = pf->GetTimecode();
-            const ULONG tc_next = next->GetTimecode();
+    LONG ref_timecode = m_video_last_timecode;
 
-            if (tc_next <= tc_curr)
-                duration = 0;
-            else
-                duration = tc_next - tc_curr;
-        }
+    if ((ref_timecode < 0) ||
+        (ULONG(ref_timecode) >= ft) ||
+        ((ft - ref_timecode) > SHRT_MAX))
+    {
+        ref_timecode = (ft > 0) ? LONG(ft) - 1 : 0;
+    }
 
-        if (duration == 0)
-            pf->WriteSimpleBlock(s, c.m_timecode);
-        else if ((prev_timecode >= 0) && (ft > ULONG(prev_timecode)))
-            pf->WriteBlockGroup(s, c.m_timecode, prev_timecode, duration);
-        else if (pf->IsKey())
-            pf->WriteBlockGroup(s, c.m_timecode, -1, duration);
-        else
-            pf->WriteSimpleBlock(s, c.m_timecode);
+    if (m_bEncrypt)
+        WriteEncryptedBlock(*pf, s, c.m_timecode, ref_timecode);
+    else if (pf->GetTemporalLayer() < 0)
+        pf->WriteSimpleBlock(s, c.m_timecode);
+    else
+    {
+        const ULONG h = s.GetStrippedSize();
+        assert(s.IsStrippable(pf->GetData(), pf->GetSize()));
+
+        pf->WriteBlockGroup(
+            s,
+            c.m_timecode,
+            ref_timecode,
+            0,
+            pf->GetTemporalLayer(),
+            pf->GetData() + h,
+            pf->GetSize() - h);
     }
-#endif
 
-    if (pf->IsKey())
+    if (pf->IsKey() && !m_bLiveMux)  //cues are only written in file mode
     {
-        Cluster::keyframes_t& kk = c.m_keyframes;
-        const Keyframe k(ft, cFrames);
+        //In file mode the cluster has a 4-byte ID and a 4-byte size.
+        const __int64 rel_pos = block_pos - c.m_pos - 8;
+        assert(rel_pos >= 0);
+        assert(rel_pos <= ULONG_MAX);
 
-        kk.push_back(k);
+        m_cues.Add(c.m_pos, ft, cFrames, static_cast<ULONG>(rel_pos));
     }
 
     if (ft > m_max_timecode)
        m_max_timecode = ft;
 
+    m_video_last_timecode = LONG(ft);
+
+    m_counters.OnSampleOut(pf->GetSize());
+
     vframes.pop_front();
     pf->Release();
 
@@ -1510,11 +2407,52 @@ void Context::WriteVideoFrame(
 }
 
 
-void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames)
+void Context::WriteEncryptedBlock(
+    const StreamVideo::VideoFrame& f,
+    const StreamVideo& s,
+    ULONG cluster_timecode,
+    LONG prev_timecode)
 {
-   assert(m_pAudio);
-   StreamAudio& s = *m_pAudio;
+    const ULONG h = s.GetStrippedSize();  //stripped before encryption
+    assert(s.IsStrippable(f.GetData(), f.GetSize()));
+
+    const ULONG size = f.GetSize() - h;
+    const ULONG block_size = webmdshow::kWebmEncryptedHeaderSize + size;
 
+    if (m_crypt_buf.size() < block_size)
+        m_crypt_buf.resize(block_size);
+
+    BYTE* const buf = &m_crypt_buf[0];
+
+    const long len = webmdshow::EncryptWebmFrame(
+                        m_aes,
+                        m_iv++,
+                        f.GetData() + h,
+                        size,
+                        buf);
+
+    assert(ULONG(len) == block_size);
+
+    const int layer = f.GetTemporalLayer();
+
+    if (layer < 0)
+        f.WriteSimpleBlock(s, cluster_timecode, buf, ULONG(len));
+    else
+    {
+        f.WriteBlockGroup(
+            s,
+            cluster_timecode,
+            prev_timecode,
+            0,
+            layer,
+            buf,
+            ULONG(len));
+    }
+}
+
+
+void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames, StreamAudio& s)
+{
    StreamAudio::frames_t& aframes = s.GetFrames();
    assert(!aframes.empty());
 
@@ -1531,6 +2469,8 @@ void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames)
    if (ft > m_max_timecode)
       m_max_timecode = ft;
 
+   m_counters.OnSampleOut(pf->GetSize());
+
    aframes.pop_front();
    pf->Release();
 
@@ -1556,6 +2496,12 @@ void Context::FlushVideo(StreamVideo* pVideo)
         return;
     }
 
+    if (m_bLowLatency)
+    {
+        WriteFramesLowLatency();
+        return;
+    }
+
     while (!vframes.empty())
         CreateNewCluster(0);
 }
@@ -1564,7 +2510,7 @@ void Context::FlushVideo(StreamVideo* pVideo)
 void Context::FlushAudio(StreamAudio* pAudio)
 {
     assert(pAudio);
-    assert(pAudio == m_pAudio);
+    assert(GetAudioIndex(pAudio) < m_audio.size());
 
     const StreamAudio::frames_t& aframes = pAudio->GetFrames();
 
@@ -1574,6 +2520,12 @@ void Context::FlushAudio(StreamAudio* pAudio)
         return;
     }
 
+    if (m_bLowLatency)
+    {
+        WriteFramesLowLatency();
+        return;
+    }
+
     while (!aframes.empty())
     {
         if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
@@ -1583,6 +2535,268 @@ void Context::FlushAudio(StreamAudio* pAudio)
     }
 }
 
+void Context::SetCueInterval(ULONG interval_ms)
+{
+    //Timecodes are unscaled (in units of m_timecode_scale ns).
+    const __int64 interval = __int64(interval_ms) * 1000000 / m_timecode_scale;
+    m_cues.SetMinInterval(static_cast<ULONG>(interval));
+}
+
+
+ULONG Context::GetCueInterval() const
+{
+    const __int64 interval = m_cues.GetMinInterval();
+    return static_cast<ULONG>(interval * m_timecode_scale / 1000000);
+}
+
+
+void Context::SetCuesReserveDuration(ULONG duration_ms)
+{
+    m_cues_reserve_duration = duration_ms;
+}
+
+
+ULONG Context::GetCuesReserveDuration() const
+{
+    return m_cues_reserve_duration;
+}
+
+
+void Context::SetCheckpointInterval(ULONG interval_ms)
+{
+    const __int64 interval = __int64(interval_ms) * 1000000 / m_timecode_scale;
+    m_checkpoint_interval = static_cast<ULONG>(interval);
+}
+
+
+ULONG Context::GetCheckpointInterval() const
+{
+    const __int64 interval = m_checkpoint_interval;
+    return static_cast<ULONG>(interval * m_timecode_scale / 1000000);
+}
+
+
+void Context::SetPreallocation(bool b)
+{
+    m_bPreallocate = b;
+}
+
+
+bool Context::GetPreallocation() const
+{
+    return m_bPreallocate;
+}
+
+
+void Context::Preallocate(ULONG timecode)
+{
+    if (!m_bPreallocate || m_bLiveMux)
+        return;
+
+    const __int64 pos = m_file.GetPosition();
+
+    if (m_cClusters == 0)  //the rate is measured from the first cluster
+    {
+        m_preallocate_pos = pos;
+        m_preallocate_timecode = timecode;
+    }
+
+    if (m_preallocated < 0)  //the volume is full: grow as we write
+        return;
+
+    if ((m_preallocated - pos) > (kMinPreallocateSize / 4))
+        return;
+
+    __int64 size = kMinPreallocateSize;
+
+    const __int64 bytes = pos - m_preallocate_pos;
+    const LONGLONG ms = GetMilliseconds(timecode - m_preallocate_timecode);
+
+    if ((bytes > 0) && (ms > 0))
+    {
+        __int64 ahead = bytes * kPreallocateAheadMs / ms;
+
+        const LONGLONG expected = m_cues_reserve_duration;
+
+        if (expected > ms)
+        {
+            const __int64 rest = bytes * (expected - ms) / ms;
+
+            if (rest > ahead)
+                ahead = rest;
+        }
+
+        if (ahead > kMaxPreallocateSize)
+            size = kMaxPreallocateSize;
+
+        else if (ahead > size)
+            size = ahead;
+    }
+
+    //Setting the size flushes what's buffered.  If the volume hasn't the
+    //room for a whole chunk, we settle for less.
+
+    while (size >= kMinPreallocateSize)
+    {
+        const HRESULT hr = m_file.SetSize(pos + size);
+
+        if (SUCCEEDED(hr))
+        {
+            m_preallocated = pos + size;
+            return;
+        }
+
+        size /= 2;
+    }
+
+    m_preallocated = -1;
+}
+
+
+void Context::SetInterleaveQueueDuration(ULONG duration_ms)
+{
+    const __int64 duration = __int64(duration_ms) * 1000000 / m_timecode_scale;
+    m_queue_duration = static_cast<ULONG>(duration);
+}
+
+
+ULONG Context::GetInterleaveQueueDuration() const
+{
+    const __int64 duration = m_queue_duration;
+    return static_cast<ULONG>(duration * m_timecode_scale / 1000000);
+}
+
+
+void Context::StartWriter(
+    CLockable* pLock,
+    const HANDLE* events,
+    ULONG count)
+{
+    assert(pLock);
+    assert(m_hWriterThread == 0);
+
+    if ((m_queue_duration == 0) || m_bLowLatency)
+        return;
+
+    if (m_file.GetStream() == 0)
+        return;
+
+    m_pWriterLock = pLock;
+    m_writer_events.assign(events, events + count);
+    m_bStopWriter = false;
+
+    const BOOL b = ResetEvent(m_hWriterEvent);
+    assert(b);
+    b;
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Context::WriterThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    //If there's no thread, the inpins go back to pacing each other.
+    m_hWriterThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hWriterThread);
+}
+
+
+void Context::StopWriter(CLockable::Lock& lock)
+{
+    if (m_hWriterThread == 0)
+        return;
+
+    m_bStopWriter = true;
+
+    BOOL b = SetEvent(m_hWriterEvent);
+    assert(b);
+
+    HRESULT hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    const DWORD dw = WaitForSingleObject(m_hWriterThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    hr = lock.Seize(m_pWriterLock);
+    assert(SUCCEEDED(hr));
+
+    b = CloseHandle(m_hWriterThread);
+    assert(b);
+    b;
+
+    m_hWriterThread = 0;
+    m_pWriterLock = 0;
+    m_writer_events.clear();
+}
+
+
+bool Context::IsQueued() const
+{
+    return (m_hWriterThread != 0);
+}
+
+
+void Context::WakeWriter()
+{
+    const BOOL b = SetEvent(m_hWriterEvent);
+    assert(b);
+    b;
+}
+
+
+unsigned Context::WriterThreadProc(void* pv)
+{
+    Context* const pContext = static_cast<Context*>(pv);
+    assert(pContext);
+
+    return pContext->WriterMain();
+}
+
+
+unsigned Context::WriterMain()
+{
+    for (;;)
+    {
+        const DWORD dw = WaitForSingleObject(m_hWriterEvent, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        CLockable::Lock lock;
+
+        const HRESULT hr = lock.Seize(m_pWriterLock);
+
+        if (FAILED(hr))
+            return 1;
+
+        if (m_bStopWriter)
+            return 0;
+
+        if (m_file.GetStream() == 0)  //all streams have reached EOS
+            continue;
+
+        if (!WriteReadyClusters())
+            continue;
+
+        //The streams that were waiting for their queues to drain can
+        //look again.
+
+        typedef std::vector<HANDLE>::const_iterator iter_t;
+
+        const iter_t j = m_writer_events.end();
+
+        for (iter_t i = m_writer_events.begin(); i != j; ++i)
+        {
+            const BOOL b = SetEvent(*i);
+            assert(b);
+            b;
+        }
+    }
+}
+
+
 bool Context::GetLiveMuxMode() const
 {
     return m_bLiveMux;
@@ -1591,6 +2805,206 @@ bool Context::GetLiveMuxMode() const
 void Context::SetLiveMuxMode(bool is_live)
 {
     m_bLiveMux = is_live;
+
+    if (!is_live)
+    {
+        m_bLowLatency = false;
+        m_bSegments = false;
+    }
+}
+
+bool Context::GetSegmentMode() const
+{
+    return m_bSegments;
+}
+
+void Context::SetSegmentMode(bool b)
+{
+    m_bSegments = b;
+
+    if (b)
+    {
+        m_bLiveMux = true;
+        m_bLowLatency = false;
+    }
+}
+
+void Context::SetSegmentDuration(ULONG duration_ms)
+{
+    const __int64 duration = __int64(duration_ms) * 1000000 / m_timecode_scale;
+    m_segment_duration = static_cast<ULONG>(duration);
+}
+
+ULONG Context::GetSegmentDuration() const
+{
+    const __int64 duration = m_segment_duration;
+    return static_cast<ULONG>(duration * m_timecode_scale / 1000000);
+}
+
+LONGLONG Context::GetMilliseconds(ULONG timecode) const
+{
+    return LONGLONG(timecode) * m_timecode_scale / 1000000;
+}
+
+void Context::StartSegmentCluster(ULONG timecode)
+{
+    if (m_file.GetStream() != &m_segments)
+        return;
+
+    //The first cluster ends the initialization segment.
+
+    const bool bStart =
+        (m_segments.GetSegmentCount() <= 1) ||
+        (timecode >= (m_segment_timecode + m_segment_duration));
+
+    if (bStart)
+    {
+        m_file.Flush();  //the bytes so far belong to the last segment
+
+        const HRESULT hr = m_segments.StartSegment(GetMilliseconds(timecode));
+        hr;
+        assert(SUCCEEDED(hr));
+
+        m_segment_timecode = timecode;
+    }
+
+    m_segments.AddCluster(GetMilliseconds(timecode));
+}
+
+bool Context::GetLowLatencyMode() const
+{
+    return m_bLowLatency;
+}
+
+void Context::SetLowLatencyMode(bool b)
+{
+    m_bLowLatency = b;
+
+    if (b)
+    {
+        m_bLiveMux = true;
+        m_bSegments = false;
+    }
+}
+
+void Context::SetMaxClusterDuration(ULONG duration_ms)
+{
+    const __int64 duration = __int64(duration_ms) * 1000000 / m_timecode_scale;
+    m_max_cluster_duration = static_cast<ULONG>(duration);
+}
+
+ULONG Context::GetMaxClusterDuration() const
+{
+    const __int64 duration = m_max_cluster_duration;
+    return static_cast<ULONG>(duration * m_timecode_scale / 1000000);
+}
+
+void Context::SetMaxClusterSize(ULONG size)
+{
+    m_max_cluster_size = size;
+}
+
+ULONG Context::GetMaxClusterSize() const
+{
+    return m_max_cluster_size;
+}
+
+void Context::SetEncryptionKey(
+    const BYTE* key_id,
+    ULONG key_id_len,
+    const BYTE* key)
+{
+    assert(key_id_len <= kMaxKeyIdSize);
+
+    m_bEncrypt = (key != 0);
+
+    if (!m_bEncrypt)
+    {
+        m_key_id.clear();
+        return;
+    }
+
+    m_aes.SetKey(key);
+
+    const char* const id = reinterpret_cast<const char*>(key_id);
+    m_key_id.assign(id, id + key_id_len);
+
+    //Every frame under a key needs an IV of its own, so the IVs of a mux
+    //count up from a random start, lest two muxes with the same key use
+    //the same ones.
+
+    unsigned int hi, lo;
+
+    const errno_t e_hi = rand_s(&hi);
+    const errno_t e_lo = rand_s(&lo);
+    assert(e_hi == 0);
+    assert(e_lo == 0);
+    e_hi;
+    e_lo;
+
+    m_iv = (ULONGLONG(hi) << 32) | lo;
+}
+
+bool Context::IsEncrypting() const
+{
+    return m_bEncrypt;
+}
+
+const std::string& Context::GetEncryptionKeyId() const
+{
+    return m_key_id;
+}
+
+void Context::SetVideoStrippedHeader(const BYTE* header, ULONG size)
+{
+    assert(size <= kMaxStrippedHeaderSize);
+    m_video_stripped.assign(header, header + size);
+}
+
+const std::vector<BYTE>& Context::GetVideoStrippedHeader() const
+{
+    return m_video_stripped;
+}
+
+void Context::SetAudioStrippedHeader(const BYTE* header, ULONG size)
+{
+    assert(size <= kMaxStrippedHeaderSize);
+    m_audio_stripped.assign(header, header + size);
+}
+
+const std::vector<BYTE>& Context::GetAudioStrippedHeader() const
+{
+    return m_audio_stripped;
+}
+
+void Context::SetClusterKeyFramesOnly(bool b)
+{
+    m_bClusterKeyFramesOnly = b;
+}
+
+bool Context::GetClusterKeyFramesOnly() const
+{
+    return m_bClusterKeyFramesOnly;
+}
+
+void Context::SetClusterAssembly(bool b)
+{
+    m_bClusterAssembly = b;
+}
+
+bool Context::GetClusterAssembly() const
+{
+    return m_bClusterAssembly;
+}
+
+void Context::SetClusterCrc(bool b)
+{
+    m_bClusterCrc = b;
+}
+
+bool Context::GetClusterCrc() const
+{
+    return m_bClusterCrc;
 }
 
 void Context::BufferData()
@@ -1608,8 +3022,20 @@ void Context::FlushBufferedData()
                       m_buf_element_info.byte_count);
     m_file.Write(m_buf.GetBufferPtr(),
                  static_cast<ULONG>(m_buf.GetBufferLength()));
+    m_tee.AppendHeader(m_buf.GetBufferPtr(),
+                       static_cast<ULONG>(m_buf.GetBufferLength()));
     m_buf.Reset();
     m_bBufferData = false;
+
+    m_tee.QueueHeader();
+    InitCues();  //the buffered data are the tracks
+
+    if (m_bLiveMux)
+    {
+        // The tracks complete the headers, so they go downstream now.
+        m_chunks.SetChunkType(kWebmMuxChunkHeader);
+        m_file.Flush();
+    }
 }
 
 void Context::ResetBuffer()
@@ -7,11 +7,20 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #pragma once
+#include "aesctr.h"
+#include "clockable.h"
+#include "pipelinecounters.h"
 #include "scratchbuf.h"
+#include "webmmuxchunkstream.h"
+#include "webmmuxcues.h"
 #include "webmmuxebmlio.h"
+#include "webmmuxfilestream.h"
+#include "webmmuxsegmentstream.h"
+#include "webmmuxtee.h"
 #include "webmmuxstreamvideo.h"
 #include "webmmuxstreamaudio.h"
 #include <list>
+#include <vector>
 
 namespace WebmMuxLib
 {
@@ -27,13 +36,38 @@ public:
    WebmUtil::EbmlScratchBuf m_buf;
    std::wstring m_writing_app;
 
+   //In live mode, if a sink has been set, output goes here instead
+   //of to the stream passed to Open.
+   ChunkStream m_chunks;
+
+   //In segment mode, if a sink has been set, output goes here instead,
+   //split into DASH segments.
+   SegmentStream m_segments;
+
+   //If open when the mux starts, and no stream has been passed to Open,
+   //output is written directly to this file.
+   FileStream m_disk;
+
+   //Live copies of the mux, for sinks of their own.  Clusters are then
+   //assembled (see SetClusterAssembly), so that the bytes of each are
+   //serialized once, for the stream and the copies both.  Not used in
+   //low latency mode.
+   Tee m_tee;
+
+   //Frames received on the inpins, and frames written to clusters.
+   webmdshow::PipelineCounters m_counters;
+
+   //Buffers handed to the stream, and the time its writes take.
+   webmdshow::PipelineCounters m_write_counters;
+
    Context();
    ~Context();
 
    void SetVideoStream(StreamVideo*);
 
-   //TODO: this needs to liberalized to handle multiple audio streams.
-   void SetAudioStream(StreamAudio*);
+   //Audio streams are assigned track numbers in the order they are added.
+   void AddAudioStream(StreamAudio*);
+   void RemoveAudioStream(StreamAudio*);
 
    void Open(IStream*);
    void Close();
@@ -46,7 +80,19 @@ public:
     void NotifyAudioFrame(StreamAudio*, StreamAudio::AudioFrame*);
     int NotifyAudioEOS(StreamAudio*);
     void FlushAudio(StreamAudio*);
-    bool WaitAudio() const;
+    bool WaitAudio(const StreamAudio*) const;
+
+    //Number of frames held in the queue of the stream having the
+    //given track number, waiting to be written to a cluster.
+    bool GetQueueDepth(int track_number, ULONG& frames) const;
+
+    //The same, summed over the streams.
+    ULONG GetQueueDepth() const;
+
+    //Number of heap allocations made for frames and frame queues,
+    //summed over the streams.  It stops changing once the frame pools
+    //have warmed up.
+    ULONG GetAllocCount() const;
 
     ULONG GetTimecodeScale() const;
     ULONG GetTimecode() const;  //of frame most recently written to file
@@ -54,13 +100,164 @@ public:
     bool GetLiveMuxMode() const;
     void SetLiveMuxMode(bool is_live);
 
+    //Low latency is a live mode in which each block is written (and
+    //flushed) as soon as its frame is received, in clusters of unknown
+    //size.  A cluster ends at a video keyframe, or when it reaches the
+    //maximum duration (in milliseconds) or size (in bytes).  A limit
+    //of 0 means there is none.
+    bool GetLowLatencyMode() const;
+    void SetLowLatencyMode(bool);
+
+    //Segment mode is a live mode in which the output is split into an
+    //initialization segment (everything up to the first cluster) and
+    //media segments, each of which begins with a cluster once the one
+    //before has lasted the segment duration (in milliseconds).  Clusters
+    //begin at video keyframes in the live modes, so the segments do too.
+    bool GetSegmentMode() const;
+    void SetSegmentMode(bool);
+
+    void SetSegmentDuration(ULONG);
+    ULONG GetSegmentDuration() const;
+
+    //Outside of low latency mode, a cluster begins at a video keyframe,
+    //or (in file mode) at the first video frame after the cluster has
+    //reached the maximum duration or video size, unless clusters are
+    //limited to keyframe boundaries.
+    void SetMaxClusterDuration(ULONG);
+    ULONG GetMaxClusterDuration() const;
+
+    void SetMaxClusterSize(ULONG);
+    ULONG GetMaxClusterSize() const;
+
+    void SetClusterKeyFramesOnly(bool);
+    bool GetClusterKeyFramesOnly() const;
+
+    //Whether each cluster is assembled in memory and written with its
+    //final size in one piece, instead of with a placeholder size that is
+    //patched (by seeking back) once its blocks have been written.  In file
+    //mode the stream then only sees appends while the clusters are
+    //written, though the headers and cues are still patched when the mux
+    //completes.  In live mode, where clusters otherwise have unknown
+    //size, it gives them known sizes.  Not used in low latency mode,
+    //which writes each block as it's received.
+    void SetClusterAssembly(bool);
+    bool GetClusterAssembly() const;
+
+    //Whether each cluster begins with a CRC-32 element, holding the CRC
+    //of the rest of its payload, so that an archive can be checked one
+    //cluster at a time.  Clusters are then assembled, and the CRC is
+    //computed in memory once the cluster is complete; a cluster whose
+    //assembly a flush ends early keeps a Void element in its place, and
+    //goes unchecked.  Off by default.  Not used in low latency mode.
+    void SetClusterCrc(bool);
+    bool GetClusterCrc() const;
+
+    //Minimum time (in milliseconds) between cue points; 0 means
+    //every video keyframe gets a cue point.
+    void SetCueInterval(ULONG);
+    ULONG GetCueInterval() const;
+
+    //Expected duration (in milliseconds) of the mux, used to size a
+    //Void element written after the tracks.  If the cues fit in it they
+    //are written there when the file is closed, near the front of the
+    //file; otherwise they follow the clusters as usual.  0 (the default)
+    //means no space is reserved.  Not used in the live modes.
+    void SetCuesReserveDuration(ULONG);
+    ULONG GetCuesReserveDuration() const;
+
+    //Interval (in milliseconds) between checkpoints: at the first cluster
+    //boundary past each, the cues of the clusters written so far are
+    //written, and the seek head, segment size and duration patched to
+    //match, so that if the mux never reaches Final the file is still
+    //seekable up to the last checkpoint.  The checkpoint cues go in the
+    //reserved space if they fit, or else in space reserved after the
+    //clusters, room enough for as many cue points again.  0 (the default)
+    //means no checkpoints.  Only used in file mode, with video.
+    void SetCheckpointInterval(ULONG);
+    ULONG GetCheckpointInterval() const;
+
+    //Preallocation, in file mode.  Space is reserved ahead of the write
+    //position in large chunks, by setting the size of the stream, so that
+    //a long capture is written into space allocated contiguously, and the
+    //size of the file isn't extended by every write.  A chunk is enough
+    //for kPreallocateAheadMs at the rate the mux has been written so far,
+    //or for the rest of the expected duration (see SetCuesReserveDuration)
+    //if that is more, within the limits below.  When the mux completes the
+    //size is trimmed to what was written.  Off by default.  Not used in
+    //the live modes.
+    enum { kPreallocateAheadMs = 60000 };
+    enum { kMinPreallocateSize = 64 * 1024 * 1024 };
+    enum { kMaxPreallocateSize = 1024 * 1024 * 1024 };
+
+    void SetPreallocation(bool);
+    bool GetPreallocation() const;
+
+    //Duration (in milliseconds) of frames a stream may have queued before
+    //its inpin blocks, in queued interleave mode.  In that mode the inpins
+    //don't pace each other: a writer thread writes each cluster once every
+    //stream has reached its end, so a slow encoder upstream of one pin
+    //doesn't park the encoder of another until that one is this far ahead.
+    //0 (the default) means the inpins pace each other instead.  Not used
+    //in low latency mode, which never holds frames back.
+    void SetInterleaveQueueDuration(ULONG);
+    ULONG GetInterleaveQueueDuration() const;
+
+    //Start and stop the writer thread of queued interleave mode, once the
+    //file is open.  The thread writes with |pLock| seized, as the inpins
+    //do, and sets each of the |count| events after writing clusters, for
+    //the inpins waiting for their queues to drain.  StopWriter is called
+    //with the lock held, and releases it while the thread exits.
+    void StartWriter(CLockable* pLock, const HANDLE* events, ULONG count);
+
+    //Video encryption (ContentEncryption, AES-128 in CTR mode).  Once a
+    //key is set, each video frame is encrypted as it is written to its
+    //block, with an IV of its own, and the video track says how, and
+    //names the key by key_id (of at most kMaxKeyIdSize bytes).  A key of
+    //0 turns encryption off.  Set before the mux starts.
+    enum { kMaxKeyIdSize = 64 };
+
+    void SetEncryptionKey(const BYTE* key_id, ULONG key_id_len,
+                          const BYTE* key);
+    bool IsEncrypting() const;
+    const std::string& GetEncryptionKeyId() const;
+
+    //Header stripping (ContentCompression, with ContentCompAlgo 3), for
+    //a track whose frames all begin with the same bytes: the track gives
+    //them once, its blocks leave them out, and the splitter puts them
+    //back.  A frame that doesn't begin with them is rejected by its
+    //inpin.  Audio whose frames are laced isn't stripped.  Empty (the
+    //default) means no stripping.  Set before the mux starts.
+    enum { kMaxStrippedHeaderSize = 64 };
+
+    void SetVideoStrippedHeader(const BYTE*, ULONG);
+    const std::vector<BYTE>& GetVideoStrippedHeader() const;
+
+    void SetAudioStrippedHeader(const BYTE*, ULONG);
+    const std::vector<BYTE>& GetAudioStrippedHeader() const;
+    void StopWriter(CLockable::Lock&);
+
     void BufferData();
     void FlushBufferedData();
 
 private:
 
    StreamVideo* m_pVideo;
-   StreamAudio* m_pAudio;  //TODO: accept multiple audio streams
+
+    struct AudioTrack
+    {
+        StreamAudio* m_pStream;
+        bool m_bEOS;
+        ULONG m_cClusterFrames;  //frames that go on the cluster being written
+    };
+
+    typedef std::vector<AudioTrack> audio_tracks_t;
+    audio_tracks_t m_audio;
+
+    ULONG GetAudioIndex(const StreamAudio*) const;
+    bool IsEOSAudio() const;
+    bool HasAudioFrames() const;
+    bool GetAudioStart(ULONG& timecode) const;
+    bool IsAudioReady(ULONG timecode) const;
 
    void Final();
 
@@ -84,17 +281,10 @@ private:
    __int64 m_track_pos;
    __int64 m_cues_pos;
    __int64 m_duration_pos;
+   std::vector<BYTE> m_info;  //segment info as written, for FinalInfo
    const ULONG m_timecode_scale;  //TODO: video vs. audio
    ULONG m_max_timecode;  //unscaled
-
-    struct Keyframe
-    {
-        ULONG m_timecode;    //unscaled
-        ULONG m_block;       //1-based number of block within cluster
-
-        Keyframe();   //needed for std::list
-        Keyframe(ULONG timecode, ULONG block);
-    };
+   LONG m_video_last_timecode;  //for the ReferenceBlock of a layered frame
 
     struct Cluster
     {
@@ -102,33 +292,79 @@ private:
         __int64 m_pos;
 
         ULONG m_timecode;
-
-        typedef std::list<Keyframe> keyframes_t;
-        keyframes_t m_keyframes;
     };
 
-   typedef std::list<Cluster> clusters_t;
-   clusters_t m_clusters;
+   Cluster m_cluster;  //the cluster most recently created
+   ULONG m_cClusters;
+
+   CueIndex m_cues;
+
+   ULONG m_cues_reserve_duration;  //milliseconds
+   __int64 m_cues_void_pos;   //-1 if no space is reserved
+   __int64 m_cues_void_size;  //including the Void ID and size
+
+   void InitCues();
+   __int64 GetCuesSize() const;
+   bool IsCuesReserveFit() const;
+   void WriteReservedCues();
+   void VoidReservedCues();
+
+   ULONG m_checkpoint_interval;  //unscaled
+   ULONG m_checkpoint_timecode;  //of the cluster that made the last one
+
+   void WriteCheckpoint();
+
+   bool m_bPreallocate;
+   __int64 m_preallocated;  //end of the reserved space; -1 if out of space
+   __int64 m_preallocate_pos;     //of the first cluster, for the rate
+   ULONG m_preallocate_timecode;  //of the first cluster
+
+   //Called before a cluster is written at |timecode|, to reserve another
+   //chunk once the write position nears the end of the reserved space.
+   void Preallocate(ULONG timecode);
 
    //void WriteSecondSeekHead();
    void WriteCues();
    //void FinalClusters(__int64 pos);
 
-    //bool ReadyToCreateNewClusterVideo(const StreamVideo::VideoFrame&) const;
+    bool IsVideoClusterFull(const StreamVideo::VideoFrame&) const;
     void CreateNewCluster(const StreamVideo::VideoFrame*);
     void CreateNewClusterAudioOnly();
 
+    //Queues the cluster just assembled for the copies of the tee.
+    void TeeCluster(bool bKey);
+
+    //In the cluster just assembled, replaces the Void at |pos| with the
+    //CRC-32 of what follows it.
+    void WriteClusterCrc(__int64 pos);
+
+    //Frames of all streams are written to a cluster in timecode order,
+    //by way of a heap holding the head frame of each stream.
+
+    struct ClusterHead
+    {
+        ULONG m_timecode;
+        ULONG m_index;  //audio track index, or m_audio.size() for video
+
+        bool operator<(const ClusterHead&) const;
+    };
+
+    typedef std::vector<ClusterHead> heads_t;
+    heads_t m_heads;
+
+    void PushClusterHead(ULONG timecode, ULONG index);
+    void WriteClusterFrames(
+        Cluster&,
+        const StreamVideo::VideoFrame* stop,
+        ULONG cVideoFrames);
+
     void WriteVideoFrame(
         Cluster&,
         ULONG&,
         const StreamVideo::VideoFrame* stop,
-        const StreamVideo::VideoFrame* next,
-        LONG prev_timecode);
+        const StreamVideo::VideoFrame* next);
 
-    void WriteAudioFrame(Cluster&, ULONG&);
-
-    void WriteCuePoints(const Cluster&);
-    void WriteCuePoint(const Cluster&, const Keyframe&);
+    void WriteAudioFrame(Cluster&, ULONG&, StreamAudio&);
 
     //EOS can happen either because we receive a notification from the stream,
     //or because the graph was stopped (before reaching end-of-stream proper).
@@ -136,12 +372,53 @@ private:
     //EOS already.
 
     bool m_bEOSVideo;
-    bool m_bEOSAudio;
     int m_cEOS;
     int EOS(Stream*);
 
     bool m_bLiveMux;
 
+    bool m_bLowLatency;
+    ULONG m_max_cluster_duration;  //unscaled
+    ULONG m_max_cluster_size;
+    bool m_bClusterKeyFramesOnly;
+    bool m_bClusterAssembly;
+    bool m_bClusterCrc;
+    ULONG m_cluster_video_size;  //since the last video cluster boundary
+    ULONG m_cClusterBlocks;  //in the low latency cluster being written
+
+    void WriteFramesLowLatency();
+    void CreateNewClusterLowLatency(ULONG timecode);
+
+    bool m_bSegments;
+    ULONG m_segment_duration;  //unscaled
+    ULONG m_segment_timecode;  //of the media segment being written
+
+    LONGLONG GetMilliseconds(ULONG timecode) const;
+
+    //Called before a cluster is written at |timecode|, to start a new
+    //media segment with it if it's time for one.
+    void StartSegmentCluster(ULONG timecode);
+
+    ULONG m_queue_duration;  //unscaled
+
+    HANDLE m_hWriterThread;  //0 unless in queued interleave mode
+    HANDLE m_hWriterEvent;   //frames queued, or stop requested
+    bool m_bStopWriter;
+    CLockable* m_pWriterLock;
+    std::vector<HANDLE> m_writer_events;
+
+    static unsigned __stdcall WriterThreadProc(void*);
+    unsigned WriterMain();
+
+    bool IsQueued() const;
+    void WakeWriter();
+    bool WaitQueued(ULONG t0, ULONG t) const;
+
+    //Write the next cluster, or all of them, if every stream that hasn't
+    //reached EOS has reached the end of it.
+    bool CreateReadyCluster();
+    bool WriteReadyClusters();
+
     struct BufferedElementSizeInfo
     {
         unsigned __int64 offset; // offset to size value in |m_buf|
@@ -153,6 +430,24 @@ private:
     bool m_bBufferData;
     BufferedElementSizeInfo m_buf_element_info;
     void ResetBuffer();
+
+    //The frames can't be encrypted where they lie, since their buffers
+    //are the samples of the upstream filter, so each is encrypted into
+    //m_crypt_buf, which grows to the largest frame and is reused.
+    bool m_bEncrypt;
+    webmdshow::AesCtr m_aes;
+    std::string m_key_id;
+    ULONGLONG m_iv;  //of the next frame
+    std::vector<BYTE> m_crypt_buf;
+
+    std::vector<BYTE> m_video_stripped;
+    std::vector<BYTE> m_audio_stripped;
+
+    void WriteEncryptedBlock(
+        const StreamVideo::VideoFrame&,
+        const StreamVideo&,
+        ULONG cluster_timecode,
+        LONG prev_timecode);
 };
 
 
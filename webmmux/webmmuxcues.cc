@@ -0,0 +1,212 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "ebmlelement.h"
+#include "webmconstants.h"
+#include "webmmuxcues.h"
+#include "webmmuxebmlio.h"
+#include <cassert>
+#include <new>
+
+using namespace WebmUtil;
+
+namespace WebmMuxLib
+{
+
+CueIndex::CueIndex() :
+    m_count(0),
+    m_min_interval(0)
+{
+}
+
+
+CueIndex::~CueIndex()
+{
+    Clear();
+}
+
+
+void CueIndex::SetMinInterval(ULONG interval)
+{
+    m_min_interval = interval;
+}
+
+
+ULONG CueIndex::GetMinInterval() const
+{
+    return m_min_interval;
+}
+
+
+bool CueIndex::Add(__int64 pos, ULONG timecode, ULONG block, ULONG rel_pos)
+{
+    assert(pos >= 0);
+    assert(block > 0);
+
+    if ((m_count > 0) && (m_min_interval > 0))
+    {
+        const CuePoint& prev = (*this)[m_count - 1];
+
+        if ((timecode >= prev.m_timecode) &&
+            ((timecode - prev.m_timecode) < m_min_interval))
+        {
+            return false;  //thinned
+        }
+    }
+
+    const ULONG idx = m_count & (kChunkSize - 1);
+
+    if (idx == 0)  //need another chunk
+    {
+        CuePoint* const chunk = new (std::nothrow) CuePoint[kChunkSize];
+        assert(chunk);
+
+        if (chunk == 0)
+            return false;
+
+        m_chunks.push_back(chunk);
+    }
+
+    CuePoint& cp = m_chunks.back()[idx];
+
+    cp.m_pos = pos;
+    cp.m_timecode = timecode;
+    cp.m_block = block;
+    cp.m_rel_pos = rel_pos;
+
+    ++m_count;
+    return true;
+}
+
+
+void CueIndex::Clear()
+{
+    while (!m_chunks.empty())
+    {
+        delete[] m_chunks.back();
+        m_chunks.pop_back();
+    }
+
+    m_count = 0;
+}
+
+
+ULONG CueIndex::GetCount() const
+{
+    return m_count;
+}
+
+
+const CueIndex::CuePoint& CueIndex::operator[](ULONG i) const
+{
+    assert(i < m_count);
+
+    const CuePoint* const chunk = m_chunks[i >> kChunkShift];
+    return chunk[i & (kChunkSize - 1)];
+}
+
+
+__int64 CueIndex::GetSize() const
+{
+    return 8 + __int64(m_count) * kPointSize;
+}
+
+
+void CueIndex::Write(
+    EbmlIO::File& f,
+    BYTE tn,
+    __int64 segment_start) const
+{
+    assert(tn > 0);
+
+    const __int64 size = GetSize() - 8;
+    assert(size <= 0x0FFFFFFE);
+
+    BYTE hdr[8];
+
+    BYTE* p = EbmlWriteID<kEbmlCuesID>(hdr);
+    p = EbmlWriteSize<4>(p, size);
+    assert(p == (hdr + sizeof hdr));
+
+    f.Write(hdr, sizeof hdr);
+
+#ifdef _DEBUG
+    const __int64 start_pos = f.GetPosition();
+#endif
+
+    for (ULONG i = 0; i < m_count; ++i)
+        WritePoint(f, (*this)[i], tn, segment_start);
+
+#ifdef _DEBUG
+    const __int64 stop_pos = f.GetPosition();
+    assert((stop_pos - start_pos) == size);
+#endif
+}
+
+
+void CueIndex::WritePoint(
+    EbmlIO::File& f,
+    const CuePoint& k,
+    BYTE tn,
+    __int64 segment_start)
+{
+    //cue point container = 1 + size len(2) + payload len
+    //  time = 1 + size len(1) + payload len(4)
+    //  track posns container = 1 + size len + payload len
+    //     track = 1 + size len + payload len (track number val)
+    //     cluster pos = 1 + size len + payload len (pos val)
+    //     relative pos = 1 + size len + payload len (pos val)
+    //     block num = 2 + size len + payload len (block num val)
+
+    //Every element of the point has a fixed ID and size, so the point
+    //is assembled from constant headers, and written in one piece.
+
+    BYTE buf[kPointSize];
+    BYTE* p = buf;
+
+    p = EbmlWriteHeader<kEbmlCuePointID, kPointSize - 2>(p);
+
+    p = EbmlWriteUIntElement<kEbmlCueTimeID, 4>(p, k.m_timecode);
+
+    enum
+    {
+        kTrackPositionsSize =
+            EbmlHeaderSize<kEbmlCueTrackID, 1>::value +
+            EbmlHeaderSize<kEbmlCueClusterPositionID, 8>::value +
+            EbmlHeaderSize<kEbmlCueRelativePositionID, 4>::value +
+            EbmlHeaderSize<kEbmlCueBlockNumberID, 4>::value
+    };
+
+    p = EbmlWriteHeader<kEbmlCueTrackPositionsID, kTrackPositionsSize>(p);
+
+    p = EbmlWriteUIntElement<kEbmlCueTrackID, 1>(p, tn);
+
+    const __int64 off = k.m_pos - segment_start;
+    assert(off >= 0);
+
+    p = EbmlWriteUIntElement<kEbmlCueClusterPositionID, 8>(p, off);
+
+    //The block's position within the cluster lets a reader go straight
+    //to it, without parsing the blocks that precede it.
+
+    p = EbmlWriteUIntElement<kEbmlCueRelativePositionID, 4>(p, k.m_rel_pos);
+
+    //TODO: the block number is written in all 4 bytes, though it's
+    //unlikely to need more than 1 (a cluster lasts a second or so), so
+    //that every point has the same size (see GetSize).
+
+    p = EbmlWriteUIntElement<kEbmlCueBlockNumberID, 4>(p, k.m_block);
+
+    assert(p == (buf + kPointSize));
+
+    f.Write(buf, kPointSize);
+}
+
+
+}  //end namespace WebmMuxLib
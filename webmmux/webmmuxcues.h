@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <vector>
+
+namespace EbmlIO
+{
+class File;
+}
+
+namespace WebmMuxLib
+{
+
+//The cue points collected during the mux, to be written as the Cues
+//element when the file is closed.  Points are stored in fixed-size chunks,
+//so appending never moves existing points, and each point costs 24 bytes
+//with no per-point heap allocation.
+//
+//Each point is written with the same fixed layout, so the size of the
+//Cues element is known from the number of points before it is written.
+
+class CueIndex
+{
+    CueIndex(const CueIndex&);
+    CueIndex& operator=(const CueIndex&);
+
+public:
+    struct CuePoint
+    {
+        __int64 m_pos;       //absolute pos of cluster within file
+        ULONG m_timecode;    //unscaled
+        ULONG m_block;       //1-based number of block within cluster
+        ULONG m_rel_pos;     //pos of block relative to cluster payload
+    };
+
+    CueIndex();
+    ~CueIndex();
+
+    //Minimum distance (in unscaled timecode units) between consecutive
+    //cue points.  Keyframes closer than this to the previous cue point
+    //are not indexed.  Zero means every keyframe is indexed.
+    void SetMinInterval(ULONG);
+    ULONG GetMinInterval() const;
+
+    bool Add(
+        __int64 cluster_pos,
+        ULONG timecode,
+        ULONG block,
+        ULONG rel_pos);
+    void Clear();
+
+    ULONG GetCount() const;
+    const CuePoint& operator[](ULONG) const;
+
+    enum { kPointSize = 36 };  //of each CuePoint element, see WritePoint
+
+    //The size of the Cues element, header included.
+    __int64 GetSize() const;
+
+    //Writes the Cues element at the file's current position.  The points
+    //are cues for track tn, and their cluster positions are written
+    //relative to segment_start, the start of the Segment's payload.
+    void Write(EbmlIO::File&, BYTE tn, __int64 segment_start) const;
+
+private:
+    static void WritePoint(
+        EbmlIO::File&,
+        const CuePoint&,
+        BYTE tn,
+        __int64 segment_start);
+
+    enum { kChunkShift = 12 };
+    enum { kChunkSize = 1 << kChunkShift };  //points per chunk
+
+    typedef std::vector<CuePoint*> chunks_t;
+    chunks_t m_chunks;
+
+    ULONG m_count;
+    ULONG m_min_interval;
+
+};
+
+}  //end namespace WebmMuxLib
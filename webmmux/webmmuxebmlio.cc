@@ -7,14 +7,22 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #include <strmif.h>
+#include <process.h>
 #include "webmmuxebmlio.h"
 #include <cassert>
+#include <climits>
 #include <limits>
 #include <malloc.h>  //_malloca
+#include <new>
+#include "pipelinecounters.h"
+#include "webmtrace.h"
+
+using webmdshow::PipelineCounters;
 
 
 EbmlIO::File::File() : m_pStream(0)
 {
+    m_buffer.m_pFile = this;
 }
 
 
@@ -24,10 +32,15 @@ EbmlIO::File::~File()
 }
 
 
-void EbmlIO::File::SetStream(IStream* p)
+void EbmlIO::File::SetStream(IStream* p, bool bWriteAhead)
 {
     assert((m_pStream == 0) || (p == 0));
+
+    if (p == 0)
+        Flush();
+
     m_pStream = p;
+    m_buffer.SetStream(p, bWriteAhead);
 }
 
 
@@ -39,6 +52,7 @@ IStream* EbmlIO::File::GetStream() const
 
 HRESULT EbmlIO::File::SetSize(__int64 size)
 {
+    Flush();
     return EbmlIO::SetSize(m_pStream, size);
 }
 
@@ -47,44 +61,1014 @@ __int64 EbmlIO::File::SetPosition(
     __int64 pos,
     STREAM_SEEK origin)
 {
-    return EbmlIO::SetPosition(m_pStream, pos, origin);
+    return m_buffer.Seek(pos, origin);
 }
 
 
 __int64 EbmlIO::File::GetPosition() const
 {
-    File* const const_file = const_cast<File*>(this);
-    return const_file->SetPosition(0, STREAM_SEEK_CUR);
+    return m_buffer.GetPosition();
+}
+
+
+HRESULT EbmlIO::File::SetBufferSize(ULONG size)
+{
+    if (size > kMaxBufferSize)
+        return E_INVALIDARG;
+
+    return m_buffer.SetSize(size);
+}
+
+
+ULONG EbmlIO::File::GetBufferSize() const
+{
+    return m_buffer.m_size;
+}
+
+
+HRESULT EbmlIO::File::SetWriteAheadLimit(ULONG limit)
+{
+    if (m_pStream)
+        return E_FAIL;
+
+    m_buffer.m_write_ahead = limit;
+    return S_OK;
+}
+
+
+ULONG EbmlIO::File::GetWriteAheadLimit() const
+{
+    return m_buffer.m_write_ahead;
+}
+
+
+void EbmlIO::File::Flush()
+{
+    const HRESULT hr = m_buffer.Flush();
+    assert(SUCCEEDED(hr));
+    hr;
+}
+
+
+__int64 EbmlIO::File::GetBytesWritten() const
+{
+    return m_buffer.m_cbWritten;
+}
+
+
+__int64 EbmlIO::File::GetWriteCount() const
+{
+    return m_buffer.m_cWrites;
+}
+
+
+ULONG EbmlIO::File::GetQueuedBytes() const
+{
+    return m_buffer.GetQueuedBytes();
+}
+
+
+ULONG EbmlIO::File::GetPeakQueuedBytes() const
+{
+    return m_buffer.m_peak;
+}
+
+
+__int64 EbmlIO::File::GetStallTime() const
+{
+    return m_buffer.m_stall_us;
+}
+
+
+void EbmlIO::File::SetCounters(PipelineCounters* pCounters)
+{
+    assert(m_pStream == 0);
+    m_buffer.m_pCounters = pCounters;
+}
+
+
+HRESULT EbmlIO::File::SetWriter(Writer* pWriter)
+{
+    if (m_pStream)
+        return E_FAIL;
+
+    m_buffer.m_pWriter = pWriter;
+    return S_OK;
+}
+
+
+bool EbmlIO::File::WriteQueued()
+{
+    return m_buffer.WriteNext();
+}
+
+
+EbmlIO::File::Buffer::Buffer() :
+    m_pStream(0),
+    m_size(kDefaultBufferSize),
+    m_buf(0),
+    m_base(0),
+    m_len(0),
+    m_off(0),
+    m_cbWritten(0),
+    m_cWrites(0),
+    m_write_ahead(0),
+    m_peak(0),
+    m_stall_us(0),
+    m_pCounters(0),
+    m_pFile(0),
+    m_pWriter(0),
+    m_bWriteAhead(false),
+    m_hThread(0),
+    m_queued(0),
+    m_bStop(false),
+    m_hrWrite(S_OK),
+    m_stream_pos(0),
+    m_bAssembly(false),
+    m_asm(0),
+    m_asm_size(0),
+    m_asm_base(0),
+    m_asm_len(0),
+    m_asm_off(0)
+{
+    m_hQueued = CreateEvent(0, 0, 0, 0);  //auto-reset
+    assert(m_hQueued);
+
+    m_hWritten = CreateEvent(0, 0, 0, 0);  //auto-reset
+    assert(m_hWritten);
+
+    InitializeCriticalSection(&m_cs);
+}
+
+
+EbmlIO::File::Buffer::~Buffer()
+{
+    assert(m_len == 0);
+    assert(!m_bWriteAhead);
+    assert(!m_bAssembly);
+
+    FreeBuffers();
+
+    delete[] m_asm;
+
+    DeleteCriticalSection(&m_cs);
+
+    CloseHandle(m_hQueued);
+    CloseHandle(m_hWritten);
+}
+
+
+void EbmlIO::File::Buffer::FreeBuffers()
+{
+    delete[] m_buf;
+    m_buf = 0;
+
+    while (!m_free.empty())
+    {
+        delete[] m_free.back();
+        m_free.pop_back();
+    }
+}
+
+
+void EbmlIO::File::Buffer::SetStream(IStream* p, bool bWriteAhead)
+{
+    assert(m_len == 0);
+    assert(m_off == 0);
+
+    if (m_bWriteAhead)  //the File has flushed, so the queue is empty
+        StopWriter();
+
+    m_pStream = p;
+
+    if (p == 0)
+        return;
+
+    m_base = EbmlIO::SetPosition(p, 0, STREAM_SEEK_CUR);
+    m_cbWritten = 0;
+    m_cWrites = 0;
+
+    //The buffer is allocated the first time it's used, so a muxer that
+    //never opens a file doesn't pay for it.
+
+    if (bWriteAhead && (m_size > 0) && (m_write_ahead > 0))
+        StartWriter();
+}
+
+
+//If there is neither a writer nor a thread, buffers are written on the
+//caller's thread, as they are without write-ahead.
+
+void EbmlIO::File::Buffer::StartWriter()
+{
+    assert(!m_bWriteAhead);
+    assert(m_hThread == 0);
+    assert(m_queue.empty());
+
+    m_bStop = false;
+    m_hrWrite = S_OK;
+    m_stream_pos = m_base;
+    m_queued = 0;
+    m_peak = 0;
+    m_stall_us = 0;
+
+    if (m_pWriter)  //the writer's threads are scheduled as blocks queue
+    {
+        m_bWriteAhead = true;
+        return;
+    }
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Buffer::WriterThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+    m_bWriteAhead = (m_hThread != 0);
+}
+
+
+void EbmlIO::File::Buffer::StopWriter()
+{
+    assert(m_bWriteAhead);
+    m_bWriteAhead = false;
+
+    if (m_hThread == 0)
+        return;
+
+    EnterCriticalSection(&m_cs);
+    assert(m_queue.empty());
+    m_bStop = true;
+    LeaveCriticalSection(&m_cs);
+
+    BOOL b = SetEvent(m_hQueued);
+    assert(b);
+
+    const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    b = CloseHandle(m_hThread);
+    assert(b);
+    b;
+
+    m_hThread = 0;
+}
+
+
+unsigned EbmlIO::File::Buffer::WriterThreadProc(void* pv)
+{
+    Buffer* const pBuffer = static_cast<Buffer*>(pv);
+    assert(pBuffer);
+
+    pBuffer->WriterMain();
+    return 0;
+}
+
+
+void EbmlIO::File::Buffer::WriterMain()
+{
+    for (;;)
+    {
+        EnterCriticalSection(&m_cs);
+
+        while (m_queue.empty() && !m_bStop)
+        {
+            LeaveCriticalSection(&m_cs);
+
+            const DWORD dw = WaitForSingleObject(m_hQueued, INFINITE);
+            dw;
+            assert(dw == WAIT_OBJECT_0);
+
+            EnterCriticalSection(&m_cs);
+        }
+
+        const bool bStop = m_queue.empty();
+
+        LeaveCriticalSection(&m_cs);
+
+        if (bStop)
+            return;
+
+        WriteNext();
+    }
+}
+
+
+//Writes the block at the front of the queue, and returns whether there
+//are more.  Only one thread at a time calls this: the File's own, or
+//one of the writer's.
+
+bool EbmlIO::File::Buffer::WriteNext()
+{
+    EnterCriticalSection(&m_cs);
+
+    if (m_queue.empty())
+    {
+        LeaveCriticalSection(&m_cs);
+        return false;
+    }
+
+    //The block stays in the queue while it's written, so that its
+    //bytes count against the limit, and Drain waits for it.
+
+    const Block b = m_queue.front();
+    const bool bFailed = FAILED(m_hrWrite);
+
+    LeaveCriticalSection(&m_cs);
+
+    HRESULT hr = S_OK;
+
+    if (!bFailed)  //after a failure, what's queued is discarded
+    {
+        if (b.pos != m_stream_pos)
+            EbmlIO::SetPosition(m_pStream, b.pos, STREAM_SEEK_SET);
+
+        hr = WriteStream(b.buf, b.len, b.pos);
+        m_stream_pos = b.pos + b.len;
+    }
+
+    EnterCriticalSection(&m_cs);
+
+    m_queue.pop_front();
+    m_queued -= b.len;
+    m_free.push_back(b.buf);
+
+    if (FAILED(hr) && SUCCEEDED(m_hrWrite))
+        m_hrWrite = hr;
+
+    if (m_pCounters)
+        m_pCounters->SetQueueDepth(static_cast<int>(m_queue.size()));
+
+    const bool bMore = !m_queue.empty();
+
+    //Signalled while the lock is held: once Drain has seen the queue
+    //empty, the File may be destroyed, and this thread mustn't touch it.
+
+    const BOOL bSet = SetEvent(m_hWritten);
+    assert(bSet);
+    bSet;
+
+    LeaveCriticalSection(&m_cs);
+
+    return bMore;
+}
+
+
+//Hands the buffered bytes to the writer thread, and makes another buffer
+//current.  It's here that the caller waits, if the queue is at its limit.
+
+HRESULT EbmlIO::File::Buffer::Queue()
+{
+    assert(m_bWriteAhead);
+
+    if (m_len == 0)
+    {
+        assert(m_off == 0);
+        return S_OK;
+    }
+
+    EnterCriticalSection(&m_cs);
+
+    //At least one block may always be queued, so that a buffer larger
+    //than the limit doesn't wait forever.
+
+    while (!m_queue.empty() && ((m_queued + m_len) > m_write_ahead))
+    {
+        LeaveCriticalSection(&m_cs);
+
+        const __int64 t0 = PipelineCounters::Now();
+
+        const DWORD dw = WaitForSingleObject(m_hWritten, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        m_stall_us += PipelineCounters::Now() - t0;
+
+        EnterCriticalSection(&m_cs);
+    }
+
+    const HRESULT hrWrite = m_hrWrite;
+    const bool bSchedule = m_queue.empty();
+
+    const Block b = { m_buf, m_len, m_base };
+    m_queue.push_back(b);
+
+    m_queued += m_len;
+
+    if (m_queued > m_peak)
+        m_peak = m_queued;
+
+    if (m_free.empty())
+        m_buf = 0;
+    else
+    {
+        m_buf = m_free.back();
+        m_free.pop_back();
+    }
+
+    if (m_pCounters)
+    {
+        m_pCounters->OnSampleIn(m_len);
+        m_pCounters->SetQueueDepth(static_cast<int>(m_queue.size()));
+    }
+
+    LeaveCriticalSection(&m_cs);
+
+    //The writer's thread holds the File until its queue is empty, so it
+    //is only scheduled again once that has happened.
+
+    if (m_pWriter == 0)
+    {
+        const BOOL bSet = SetEvent(m_hQueued);
+        assert(bSet);
+        bSet;
+    }
+    else if (bSchedule)
+        m_pWriter->Schedule(m_pFile);
+
+    m_base += m_off;
+    m_len = 0;
+    m_off = 0;
+
+    if (m_buf == 0)
+    {
+        m_buf = new (std::nothrow) BYTE[m_size];
+
+        if (m_buf == 0)
+            return E_OUTOFMEMORY;
+    }
+
+    return hrWrite;
+}
+
+
+//Waits until the writer thread has written everything queued, and leaves
+//the stream positioned at m_base, as it would be without write-ahead.
+
+HRESULT EbmlIO::File::Buffer::Drain()
+{
+    assert(m_bWriteAhead);
+
+    const __int64 t0 = PipelineCounters::Now();
+
+    EnterCriticalSection(&m_cs);
+
+    while (!m_queue.empty())
+    {
+        LeaveCriticalSection(&m_cs);
+
+        const DWORD dw = WaitForSingleObject(m_hWritten, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        EnterCriticalSection(&m_cs);
+    }
+
+    const HRESULT hr = m_hrWrite;
+
+    LeaveCriticalSection(&m_cs);
+
+    m_stall_us += PipelineCounters::Now() - t0;
+
+    //The writer is idle, so its position is ours to use.
+
+    if (m_stream_pos != m_base)
+    {
+        EbmlIO::SetPosition(m_pStream, m_base, STREAM_SEEK_SET);
+        m_stream_pos = m_base;
+    }
+
+    return hr;
+}
+
+
+ULONG EbmlIO::File::Buffer::GetQueuedBytes() const
+{
+    EnterCriticalSection(&m_cs);
+    const ULONG queued = m_queued;
+    LeaveCriticalSection(&m_cs);
+
+    return queued;
+}
+
+
+HRESULT EbmlIO::File::Buffer::SetSize(ULONG size)
+{
+    if (m_pStream)  //only while no file is open
+        return E_FAIL;
+
+    assert(m_len == 0);
+
+    if (size == m_size)
+        return S_OK;
+
+    FreeBuffers();
+
+    m_size = size;
+    return S_OK;
+}
+
+
+__int64 EbmlIO::File::Buffer::GetPosition() const
+{
+    if (m_bAssembly)
+        return m_asm_base + m_asm_off;
+
+    return m_base + m_off;
+}
+
+
+__int64 EbmlIO::File::Buffer::Seek(__int64 move, STREAM_SEEK origin)
+{
+    assert(m_pStream);
+
+    if (origin == STREAM_SEEK_END)  //we don't know the size
+    {
+        const HRESULT hr = Flush();
+        assert(SUCCEEDED(hr));
+        hr;
+
+        m_base = EbmlIO::SetPosition(m_pStream, move, origin);
+        m_stream_pos = m_base;
+
+        return m_base;
+    }
+
+    const __int64 pos = (origin == STREAM_SEEK_CUR) ? GetPosition() + move
+                                                     : move;
+    assert(pos >= 0);
+
+    if (m_bAssembly)
+    {
+        if ((pos >= m_asm_base) && (pos <= (m_asm_base + m_asm_len)))
+        {
+            m_asm_off = static_cast<ULONG>(pos - m_asm_base);
+            return pos;
+        }
+
+        EndAssembly();
+    }
+
+    if ((pos >= m_base) && (pos <= (m_base + m_len)))
+    {
+        m_off = static_cast<ULONG>(pos - m_base);
+        return pos;
+    }
+
+    if (m_bWriteAhead)  //the writer seeks to each block as it writes it
+    {
+        const HRESULT hr = Queue();
+        assert(SUCCEEDED(hr));
+        hr;
+
+        m_base = pos;
+        return pos;
+    }
+
+    const HRESULT hr = Flush();
+    assert(SUCCEEDED(hr));
+    hr;
+
+    m_base = EbmlIO::SetPosition(m_pStream, pos, STREAM_SEEK_SET);
+    return m_base;
+}
+
+
+HRESULT EbmlIO::File::Buffer::Flush()
+{
+    //The stream is always positioned at m_base while we have bytes
+    //buffered, so they can be written in one call.
+
+    if (m_bAssembly)
+        EndAssembly();
+
+    if (m_bWriteAhead)
+    {
+        const HRESULT hr = Queue();
+
+        if (FAILED(hr))
+            return hr;
+
+        return Drain();
+    }
+
+    if (m_len == 0)
+    {
+        assert(m_off == 0);
+        return S_OK;
+    }
+
+    const HRESULT hr = WriteStream(m_buf, m_len, m_base);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_off != m_len)  //current pos is behind the end of buffered data
+        EbmlIO::SetPosition(m_pStream, m_base + m_off, STREAM_SEEK_SET);
+
+    m_base += m_off;
+    m_len = 0;
+    m_off = 0;
+
+    return S_OK;
+}
+
+
+//Called by the writer thread while it runs, and otherwise by the caller,
+//with the stream positioned at pos.
+
+HRESULT EbmlIO::File::Buffer::WriteStream(
+    const void* buf,
+    ULONG cb,
+    __int64 pos)
+{
+    assert(m_pStream);
+
+    ULONG cbWritten;
+    HRESULT hr;
+
+    if (m_pCounters)
+    {
+        PipelineCounters::Timer timer(*m_pCounters);
+        hr = m_pStream->Write(buf, cb, &cbWritten);
+    }
+    else
+        hr = m_pStream->Write(buf, cb, &cbWritten);
+
+    assert(SUCCEEDED(hr));
+    assert(cbWritten == cb);
+
+    ++m_cWrites;
+
+    if (SUCCEEDED(hr))
+    {
+        m_cbWritten += cbWritten;
+
+        if (m_pCounters)
+            m_pCounters->OnSampleOut(cbWritten);
+
+        webmdshow::TraceFrame(
+            webmdshow::kTraceFrameWrite,
+            0,
+            pos,
+            cbWritten);
+    }
+
+    return hr;
+}
+
+
+HRESULT EbmlIO::File::Buffer::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if ((iid == __uuidof(IUnknown)) || (iid == __uuidof(ISequentialStream)))
+    {
+        pUnk = static_cast<ISequentialStream*>(this);
+        return S_OK;
+    }
+
+    pUnk = 0;
+    return E_NOINTERFACE;
+}
+
+
+ULONG EbmlIO::File::Buffer::AddRef()
+{
+    return 1;  //lifetime is that of the owning File
+}
+
+
+ULONG EbmlIO::File::Buffer::Release()
+{
+    return 1;
+}
+
+
+HRESULT EbmlIO::File::Buffer::Read(void* buf, ULONG cb, ULONG* pcbRead)
+{
+    assert(m_pStream);
+
+    HRESULT hr = Flush();
+
+    if (FAILED(hr))
+        return hr;
+
+    ULONG cbRead;
+
+    hr = m_pStream->Read(buf, cb, &cbRead);
+
+    if (SUCCEEDED(hr))
+        m_base += cbRead;
+
+    m_stream_pos = m_base;
+
+    if (pcbRead)
+        *pcbRead = cbRead;
+
+    return hr;
+}
+
+
+HRESULT EbmlIO::File::Buffer::Write(const void* buf, ULONG cb, ULONG* pcb)
+{
+    assert(m_pStream);
+
+    if (pcb)
+        *pcb = 0;
+
+    HRESULT hr;
+
+    if (m_bAssembly)
+    {
+        hr = Assemble(buf, cb);
+
+        if (SUCCEEDED(hr) && pcb)
+            *pcb = cb;
+
+        return hr;
+    }
+
+    if ((m_buf == 0) && (m_size > 0))
+        m_buf = new (std::nothrow) BYTE[m_size];
+
+    if (m_bWriteAhead && m_buf)
+    {
+        //A write larger than the buffer is split across buffers, rather
+        //than written through, so it doesn't wait for the queue to drain.
+
+        const BYTE* src = static_cast<const BYTE*>(buf);
+        ULONG n = cb;
+
+        while (n > 0)
+        {
+            if (m_off >= m_size)
+            {
+                hr = Queue();
+
+                if (FAILED(hr))
+                    return hr;
+            }
+
+            const ULONG room = m_size - m_off;
+            const ULONG len = (n < room) ? n : room;
+
+            memcpy(m_buf + m_off, src, len);
+            m_off += len;
+
+            if (m_off > m_len)
+                m_len = m_off;
+
+            src += len;
+            n -= len;
+        }
+
+        if (pcb)
+            *pcb = cb;
+
+        return S_OK;
+    }
+
+    if ((m_buf == 0) || ((m_off + cb) > m_size))
+    {
+        hr = Flush();
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if ((m_buf == 0) || (cb > m_size))  //write through
+    {
+        hr = WriteStream(buf, cb, m_base);
+
+        if (FAILED(hr))
+            return hr;
+
+        m_base += cb;
+        m_stream_pos = m_base;
+
+        if (pcb)
+            *pcb = cb;
+
+        return S_OK;
+    }
+
+    memcpy(m_buf + m_off, buf, cb);
+    m_off += cb;
+
+    if (m_off > m_len)
+        m_len = m_off;
+
+    if (pcb)
+        *pcb = cb;
+
+    return S_OK;
+}
+
+
+void EbmlIO::File::Buffer::WriteGather(
+    const void* hdr,
+    ULONG hdr_len,
+    const void* buf,
+    ULONG len)
+{
+    assert(m_pStream);
+    assert(m_off <= m_size);
+
+    const ULONG room = m_size - m_off;
+
+    if (m_bAssembly ||
+        (m_buf == 0) ||
+        (hdr_len > room) ||
+        (len > (room - hdr_len)))
+    {
+        //Write allocates the buffer, and flushes or queues it (or
+        //appends to the assembly).
+        EbmlIO::Write(this, hdr, hdr_len);
+        EbmlIO::Write(this, buf, len);
+
+        return;
+    }
+
+    BYTE* const dst = m_buf + m_off;
+
+    memcpy(dst, hdr, hdr_len);
+    memcpy(dst + hdr_len, buf, len);
+
+    m_off += hdr_len + len;
+
+    if (m_off > m_len)
+        m_len = m_off;
+}
+
+
+void EbmlIO::File::Buffer::BeginAssembly()
+{
+    assert(m_pStream);
+    assert(!m_bAssembly);
+
+    m_bAssembly = true;
+    m_asm_base = m_base + m_off;
+    m_asm_len = 0;
+    m_asm_off = 0;
+}
+
+
+void EbmlIO::File::Buffer::EndAssembly()
+{
+    if (!m_bAssembly)
+        return;
+
+    m_bAssembly = false;
+
+    //Nothing was written since the assembly began, so the current pos is
+    //still where it began.
+
+    assert((m_base + m_off) == m_asm_base);
+
+    if (m_asm_len > 0)
+    {
+        //A write larger than the write buffer goes through to the stream
+        //in one call (or is split across buffers, when writing ahead).
+
+        const HRESULT hr = Write(m_asm, m_asm_len, 0);
+        assert(SUCCEEDED(hr));
+        hr;
+    }
+
+    if (m_asm_off != m_asm_len)
+        Seek(m_asm_base + m_asm_off, STREAM_SEEK_SET);
+
+    m_asm_len = 0;
+    m_asm_off = 0;
+
+    if (m_asm_size > kMaxBufferSize)  //not worth keeping
+    {
+        delete[] m_asm;
+
+        m_asm = 0;
+        m_asm_size = 0;
+    }
+}
+
+
+HRESULT EbmlIO::File::Buffer::Assemble(const void* buf, ULONG cb)
+{
+    assert(m_bAssembly);
+    assert(m_asm_off <= m_asm_len);
+
+    if (cb > (ULONG_MAX - m_asm_off))
+        return E_OUTOFMEMORY;
+
+    const ULONG end = m_asm_off + cb;
+
+    if (end > m_asm_size)
+    {
+        //Grow by doubling, so that a large cluster is copied only a few
+        //times as it's assembled.
+
+        ULONG size = (m_asm_size > 0) ? m_asm_size : 64 * 1024;
+
+        while (size < end)
+            size = (size > (ULONG_MAX / 2)) ? end : 2 * size;
+
+        BYTE* const p = new (std::nothrow) BYTE[size];
+
+        if (p == 0)
+            return E_OUTOFMEMORY;
+
+        if (m_asm_len > 0)
+            memcpy(p, m_asm, m_asm_len);
+
+        delete[] m_asm;
+
+        m_asm = p;
+        m_asm_size = size;
+    }
+
+    memcpy(m_asm + m_asm_off, buf, cb);
+    m_asm_off = end;
+
+    if (m_asm_off > m_asm_len)
+        m_asm_len = m_asm_off;
+
+    return S_OK;
+}
+
+
+void EbmlIO::File::BeginAssembly()
+{
+    m_buffer.BeginAssembly();
+}
+
+
+void EbmlIO::File::EndAssembly()
+{
+    m_buffer.EndAssembly();
+}
+
+
+bool EbmlIO::File::IsAssembling() const
+{
+    return m_buffer.m_bAssembly;
+}
+
+
+void EbmlIO::File::GetAssembly(const BYTE*& ptr, ULONG& len) const
+{
+    assert(m_buffer.m_bAssembly);
+
+    ptr = m_buffer.m_asm;
+    len = m_buffer.m_asm_len;
 }
 
 
 void EbmlIO::File::Write(const void* buf, ULONG cb)
 {
-    EbmlIO::Write(m_pStream, buf, cb);
+    EbmlIO::Write(&m_buffer, buf, cb);
+}
+
+
+void EbmlIO::File::WriteGather(
+    const void* hdr,
+    ULONG hdr_len,
+    const void* buf,
+    ULONG len)
+{
+    m_buffer.WriteGather(hdr, hdr_len, buf, len);
 }
 
 
 void EbmlIO::File::Serialize8UInt(__int64 val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 8);
+    EbmlIO::Serialize(&m_buffer, &val, 8);
 }
 
 
 void EbmlIO::File::Serialize4UInt(ULONG val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 4);
+    EbmlIO::Serialize(&m_buffer, &val, 4);
 }
 
 
 void EbmlIO::File::Serialize2UInt(USHORT val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 2);
+    EbmlIO::Serialize(&m_buffer, &val, 2);
 }
 
 
 void EbmlIO::File::Serialize1UInt(BYTE val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 1);
+    EbmlIO::Serialize(&m_buffer, &val, 1);
 }
 
 
@@ -108,97 +1092,97 @@ BYTE EbmlIO::File::GetSerializeUIntSize(__int64 val)
 
 void EbmlIO::File::SerializeUInt(__int64 val, BYTE size)
 {
-    EbmlIO::Serialize(m_pStream, &val, size);
+    EbmlIO::Serialize(&m_buffer, &val, size);
 }
 
 
 void EbmlIO::File::Serialize2SInt(SHORT val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 2);
+    EbmlIO::Serialize(&m_buffer, &val, 2);
 }
 
 
 void EbmlIO::File::Serialize4Float(float val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 4);
+    EbmlIO::Serialize(&m_buffer, &val, 4);
 }
 
 
 void EbmlIO::File::WriteID4(ULONG id)
 {
-    EbmlIO::WriteID4(m_pStream, id);
+    EbmlIO::WriteID4(&m_buffer, id);
 }
 
 
 void EbmlIO::File::WriteID3(ULONG id)
 {
-    EbmlIO::WriteID3(m_pStream, id);
+    EbmlIO::WriteID3(&m_buffer, id);
 }
 
 
 void EbmlIO::File::WriteID2(USHORT id)
 {
-    EbmlIO::WriteID2(m_pStream, id);
+    EbmlIO::WriteID2(&m_buffer, id);
 }
 
 
 void EbmlIO::File::WriteID1(BYTE id)
 {
-    EbmlIO::WriteID1(m_pStream, id);
+    EbmlIO::WriteID1(&m_buffer, id);
 }
 
 
 ULONG EbmlIO::File::ReadID4()
 {
-    return EbmlIO::ReadID4(m_pStream);
+    return EbmlIO::ReadID4(&m_buffer);
 }
 
 
 void EbmlIO::File::Write8UInt(__int64 val)
 {
-    EbmlIO::Write8UInt(m_pStream, val);
+    EbmlIO::Write8UInt(&m_buffer, val);
 }
 
 
 void EbmlIO::File::Write4UInt(ULONG val)
 {
-    EbmlIO::Write4UInt(m_pStream, val);
+    EbmlIO::Write4UInt(&m_buffer, val);
 }
 
 
 void EbmlIO::File::Write2UInt(USHORT val)
 {
-    EbmlIO::Write2UInt(m_pStream, val);
+    EbmlIO::Write2UInt(&m_buffer, val);
 }
 
 
 void EbmlIO::File::Write1UInt(BYTE val)
 {
-    EbmlIO::Write1UInt(m_pStream, val);
+    EbmlIO::Write1UInt(&m_buffer, val);
 }
 
 
 void EbmlIO::File::WriteUInt(__int64 val, ULONG size)
 {
-    return EbmlIO::WriteUInt(m_pStream, val, size);
+    return EbmlIO::WriteUInt(&m_buffer, val, size);
 }
 
 
 void EbmlIO::File::Write1String(const char* str)
 {
-    EbmlIO::Write1String(m_pStream, str);
+    EbmlIO::Write1String(&m_buffer, str);
 }
 
 
 //void EbmlIO::File::Write1String(const char* str, size_t len)
 //{
-//    EbmlIO::Write1String(m_pStream, str, len);
+//    EbmlIO::Write1String(&m_buffer, str, len);
 //}
 
 
 void EbmlIO::File::Write1UTF8(const wchar_t* str)
 {
-    EbmlIO::Write1UTF8(m_pStream, str);
+    EbmlIO::Write1UTF8(&m_buffer, str);
 }
 
 
@@ -352,6 +1336,36 @@ void EbmlIO::WriteUInt(
 }
 
 
+ULONG EbmlIO::EncodeUInt(BYTE* p, __int64 val)
+{
+    assert(p);
+    assert(val >= 0);
+    assert(val <= 0x00FFFFFFFFFFFFFE);
+
+    //The least size for which val <= (1 << (size * 7)) - 2, as WriteUInt
+    //finds it.
+    const ULONG size = 1 +
+                       ULONG(val > 0x7E) +
+                       ULONG(val > 0x3FFE) +
+                       ULONG(val > 0x1FFFFE) +
+                       ULONG(val > 0x0FFFFFFE) +
+                       ULONG(val > 0x07FFFFFFFE) +
+                       ULONG(val > 0x03FFFFFFFFFE) +
+                       ULONG(val > 0x01FFFFFFFFFFFE);
+
+    const unsigned __int64 bit = 1ULL << (size * 7);
+
+    //Shift the size-byte value to the top, so that it's stored
+    //big-endian in p[0] to p[size - 1].
+    const unsigned __int64 x = (val | bit) << (64 - 8 * size);
+
+    for (int i = 0; i < 8; ++i)
+        p[i] = static_cast<BYTE>(x >> (56 - 8 * i));
+
+    return size;
+}
+
+
 void EbmlIO::WriteID4(ISequentialStream* pStream, ULONG id)
 {
     assert(pStream);
@@ -7,6 +7,13 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #pragma once
+#include <deque>
+#include <vector>
+
+namespace webmdshow
+{
+class PipelineCounters;
+}
 
 namespace EbmlIO
 {
@@ -20,7 +27,9 @@ namespace EbmlIO
         File();
         ~File();
 
-        void SetStream(IStream*);
+        //With bWriteAhead, and a write-ahead limit, full buffers are
+        //written to the stream on a thread of the File's own.
+        void SetStream(IStream*, bool bWriteAhead = false);
         IStream* GetStream() const;
 
         HRESULT SetSize(__int64);
@@ -30,6 +39,10 @@ namespace EbmlIO
 
         void Write(const void*, ULONG);
 
+        //Writes hdr, then buf.  When they fit in the buffer they are
+        //copied into it directly, instead of through the stream methods.
+        void WriteGather(const void* hdr, ULONG, const void* buf, ULONG);
+
         void Serialize8UInt(__int64);
         void Serialize4UInt(ULONG);
         void Serialize2UInt(USHORT);
@@ -58,9 +71,183 @@ namespace EbmlIO
         //void Write1String(const char* str, size_t len);
         void Write1UTF8(const wchar_t*);
 
+        //Writes are collected in a buffer of this size, and forwarded to
+        //the stream when it fills, or when we seek outside of it.  A size
+        //of 0 means each write goes directly to the stream.
+        enum { kDefaultBufferSize = 1024 * 1024 };
+        enum { kMaxBufferSize = 16 * 1024 * 1024 };
+
+        HRESULT SetBufferSize(ULONG);
+        ULONG GetBufferSize() const;
+
+        //Write-ahead.  When a limit is set, a buffer that fills is queued
+        //for the writer thread, and serialization goes on in another,
+        //so a stream that is slow to write doesn't hold up the caller;
+        //it only waits once more than the limit is queued.  Flush, and
+        //anything that reads, resizes or seeks from the end of the
+        //stream, waits for the queue to drain.  A limit of 0 (the
+        //default) means buffers are written on the caller's thread.
+        enum { kDefaultWriteAheadLimit = 16 * 1024 * 1024 };
+
+        HRESULT SetWriteAheadLimit(ULONG);  //only while no stream is set
+        ULONG GetWriteAheadLimit() const;
+
+        //Writes all of the buffered bytes to the stream, and returns.
+        void Flush();
+
+        //Assembly.  From BeginAssembly until EndAssembly, writes are
+        //collected in a buffer of their own, which grows to hold all of
+        //them, so that seeks back inside them (to patch the size of an
+        //element once its children are written) are resolved in memory.
+        //EndAssembly then writes them out in one piece, at the position
+        //the assembly began.  The buffer keeps its capacity for the next
+        //assembly, unless that grew past kMaxBufferSize.  A flush, or a
+        //seek outside of the assembly, ends it early.
+        void BeginAssembly();
+        void EndAssembly();
+        bool IsAssembling() const;
+
+        //The bytes assembled so far.  They stay valid until the assembly
+        //ends, or more are written.
+        void GetAssembly(const BYTE*&, ULONG&) const;
+
+        __int64 GetBytesWritten() const;  //to stream
+        __int64 GetWriteCount() const;    //calls to IStream::Write
+
+        ULONG GetQueuedBytes() const;     //for the writer thread
+        ULONG GetPeakQueuedBytes() const;
+        __int64 GetStallTime() const;     //us spent waiting for the writer
+
+        //Receives a sample for each IStream::Write, with the time spent
+        //in it, and the number of buffers queued for the writer thread.
+        void SetCounters(webmdshow::PipelineCounters*);
+
+        //Threads shared by many Files, that write their queued buffers
+        //instead of a thread of each File's own.  Schedule is called when
+        //a File's queue stops being empty; the writer then calls the
+        //File's WriteQueued, on one of its threads at a time, until it
+        //returns false.  It mustn't touch the File after that.
+        class Writer
+        {
+        public:
+            virtual void Schedule(File*) = 0;
+
+        protected:
+            virtual ~Writer() {}
+        };
+
+        HRESULT SetWriter(Writer*);  //only while no stream is set
+
+        //Writes the oldest queued buffer, and returns whether there are
+        //others.  Called by the Writer.
+        bool WriteQueued();
+
     private:
 
+        //The EbmlIO functions write to an ISequentialStream, one element
+        //(and frequently one byte) at a time.  This stream collects those
+        //writes.  Seeks that land inside the buffered bytes (to patch
+        //a size, for example) are resolved in memory.
+
+        class Buffer : public ISequentialStream
+        {
+            Buffer(const Buffer&);
+            Buffer& operator=(const Buffer&);
+
+        public:
+
+            Buffer();
+            ~Buffer();
+
+            void SetStream(IStream*, bool bWriteAhead);
+            HRESULT SetSize(ULONG);
+
+            __int64 Seek(__int64, STREAM_SEEK);
+            __int64 GetPosition() const;
+            HRESULT Flush();
+
+            HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+            ULONG STDMETHODCALLTYPE AddRef();
+            ULONG STDMETHODCALLTYPE Release();
+
+            HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*);
+            HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*);
+
+            void WriteGather(const void*, ULONG, const void*, ULONG);
+
+            void BeginAssembly();
+            void EndAssembly();
+
+            IStream* m_pStream;
+            ULONG m_size;    //capacity of m_buf
+            BYTE* m_buf;
+            __int64 m_base;  //stream pos of m_buf[0]
+            ULONG m_len;     //number of bytes buffered
+            ULONG m_off;     //current pos, relative to m_base
+
+            __int64 m_cbWritten;
+            __int64 m_cWrites;
+
+            ULONG m_write_ahead;  //limit, in bytes
+            ULONG m_peak;
+            __int64 m_stall_us;
+            webmdshow::PipelineCounters* m_pCounters;
+            File* m_pFile;
+            Writer* m_pWriter;
+
+            ULONG GetQueuedBytes() const;
+            bool WriteNext();
+
+            bool m_bAssembly;
+            BYTE* m_asm;        //the assembly buffer
+            ULONG m_asm_size;   //capacity of m_asm
+            __int64 m_asm_base; //stream pos of m_asm[0]
+            ULONG m_asm_len;    //number of bytes assembled
+            ULONG m_asm_off;    //current pos, relative to m_asm_base
+
+        private:
+
+            HRESULT Assemble(const void*, ULONG);
+
+            HRESULT WriteStream(const void*, ULONG, __int64 pos);
+
+            //A full buffer, for the writer thread.
+            struct Block
+            {
+                BYTE* buf;
+                ULONG len;
+                __int64 pos;
+            };
+
+            bool m_bWriteAhead;
+            HANDLE m_hThread;   //0 unless writing ahead on our own thread
+            HANDLE m_hQueued;   //auto-reset: a block was queued, or stop
+            HANDLE m_hWritten;  //auto-reset: a block was written
+
+            //Guards the queue, the free buffers and the writer's result.
+            mutable CRITICAL_SECTION m_cs;
+
+            std::deque<Block> m_queue;  //the front one is being written
+            std::vector<BYTE*> m_free;  //written, to be filled again
+            ULONG m_queued;             //bytes in m_queue
+            bool m_bStop;
+            HRESULT m_hrWrite;          //of the first write that failed
+
+            __int64 m_stream_pos;  //of the stream, while writing ahead
+
+            void StartWriter();
+            void StopWriter();
+            HRESULT Queue();
+            HRESULT Drain();
+            void FreeBuffers();
+
+            static unsigned __stdcall WriterThreadProc(void*);
+            void WriterMain();
+
+        };
+
         IStream* m_pStream;
+        Buffer m_buffer;
 
     };
 
@@ -84,6 +271,11 @@ namespace EbmlIO
     void Write1UInt(ISequentialStream*, BYTE);
     void WriteUInt(ISequentialStream*, __int64, ULONG size = 0);
 
+    //Stores val at p as a vint of the least size, as WriteUInt does when
+    //no size is given, and returns the size.  All 8 bytes at p are
+    //written, so that the size needs no branches to find or to store.
+    ULONG EncodeUInt(BYTE* p, __int64 val);
+
     void Write1String(ISequentialStream*, const char*);
     void Write1String(ISequentialStream*, const char*, size_t);
     void Write1UTF8(ISequentialStream*, const wchar_t*);
@@ -0,0 +1,712 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "webmmuxfilestream.h"
+#include <cassert>
+#include <cstring>
+
+namespace WebmMuxLib
+{
+
+static void SetOffset(OVERLAPPED& o, __int64 pos)
+{
+    o.Offset = static_cast<DWORD>(pos);
+    o.OffsetHigh = static_cast<DWORD>(pos >> 32);
+}
+
+
+FileStream::FileStream() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hPatch(INVALID_HANDLE_VALUE),
+    m_bPending(false),
+    m_curr(0),
+    m_len(0),
+    m_base(0),
+    m_pos(0),
+    m_size(0),
+    m_align(0)
+{
+    memset(&m_overlapped, 0, sizeof m_overlapped);
+
+    m_buf[0] = 0;
+    m_buf[1] = 0;
+}
+
+
+FileStream::~FileStream()
+{
+    Close();
+}
+
+
+bool FileStream::IsOpen() const
+{
+    return (m_hFile != INVALID_HANDLE_VALUE);
+}
+
+
+HRESULT FileStream::Open(const wchar_t* filename)
+{
+    if (filename == 0)
+        return E_INVALIDARG;
+
+    if (IsOpen())
+        return E_UNEXPECTED;
+
+    //Unbuffered writes must be whole sectors, from sector-aligned
+    //memory.  We never write less than a page, which also covers
+    //the 4K sectors of advanced format disks that report 512.
+
+    DWORD cbSector = 0;
+
+    wchar_t root[MAX_PATH];
+
+    if (GetVolumePathNameW(filename, root, MAX_PATH))
+    {
+        DWORD spc, nfc, tnc;
+
+        if (!GetDiskFreeSpaceW(root, &spc, &cbSector, &nfc, &tnc))
+            cbSector = 0;
+    }
+
+    m_align = (cbSector > 4096) ? cbSector : 4096;
+
+    if (kBufferSize % m_align)
+        return E_FAIL;
+
+    m_hFile = CreateFileW(
+                filename,
+                GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                0,
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL |
+                  FILE_FLAG_NO_BUFFERING |
+                  FILE_FLAG_OVERLAPPED,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_hPatch = CreateFileW(
+                filename,
+                GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                0,
+                OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL,
+                0);
+
+    if (m_hPatch == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        Destroy();
+
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_overlapped.hEvent = CreateEvent(0, TRUE, FALSE, 0);
+
+    if (m_overlapped.hEvent == 0)
+    {
+        const DWORD e = GetLastError();
+        Destroy();
+
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    //VirtualAlloc returns memory aligned to the allocation
+    //granularity (64K), which satisfies any sector size.
+
+    for (int i = 0; i < 2; ++i)
+    {
+        void* const pv = VirtualAlloc(
+                            0,
+                            kBufferSize,
+                            MEM_COMMIT | MEM_RESERVE,
+                            PAGE_READWRITE);
+
+        if (pv == 0)
+        {
+            Destroy();
+            return E_OUTOFMEMORY;
+        }
+
+        m_buf[i] = static_cast<BYTE*>(pv);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Close()
+{
+    if (!IsOpen())
+        return S_FALSE;
+
+    HRESULT hr = S_OK;
+
+    if (m_len > 0)
+    {
+        //The final write is padded out to a whole sector; the file is
+        //trimmed back to its proper size below.
+
+        const ULONG cb = ((m_len + m_align - 1) / m_align) * m_align;
+        memset(m_buf[m_curr] + m_len, 0, cb - m_len);
+
+        hr = Submit(cb);
+    }
+
+    const HRESULT hrWait = Wait();
+
+    if (SUCCEEDED(hr))
+        hr = hrWait;
+
+    if (SUCCEEDED(hr))
+    {
+        LARGE_INTEGER size;
+        size.QuadPart = m_size;
+
+        if (!SetFilePointerEx(m_hPatch, size, 0, FILE_BEGIN) ||
+            !SetEndOfFile(m_hPatch))
+        {
+            const DWORD e = GetLastError();
+            hr = HRESULT_FROM_WIN32(e);
+        }
+    }
+
+    Destroy();
+
+    return hr;
+}
+
+
+void FileStream::Destroy()
+{
+    assert(!m_bPending);
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_hPatch != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hPatch);
+        m_hPatch = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_overlapped.hEvent)
+        CloseHandle(m_overlapped.hEvent);
+
+    memset(&m_overlapped, 0, sizeof m_overlapped);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (m_buf[i])
+        {
+            VirtualFree(m_buf[i], 0, MEM_RELEASE);
+            m_buf[i] = 0;
+        }
+    }
+
+    m_curr = 0;
+    m_len = 0;
+    m_base = 0;
+    m_pos = 0;
+    m_size = 0;
+}
+
+
+HRESULT FileStream::Submit(ULONG cb)
+{
+    assert(cb <= kBufferSize);
+    assert((cb % m_align) == 0);
+
+    HRESULT hr = Wait();  //for the other buffer to be free
+
+    if (FAILED(hr))
+        return hr;
+
+    SetOffset(m_overlapped, m_base);
+
+    const BOOL b = WriteFile(m_hFile, m_buf[m_curr], cb, 0, &m_overlapped);
+
+    if (!b)
+    {
+        const DWORD e = GetLastError();
+
+        if (e != ERROR_IO_PENDING)
+            return HRESULT_FROM_WIN32(e);
+    }
+
+    m_bPending = true;
+
+    m_curr ^= 1;
+    m_base += kBufferSize;
+    m_len = 0;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Wait()
+{
+    if (!m_bPending)
+        return S_OK;
+
+    m_bPending = false;
+
+    DWORD cb;
+
+    if (!GetOverlappedResult(m_hFile, &m_overlapped, &cb, TRUE))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::WriteTail(const BYTE* p, ULONG n)
+{
+    while (n > 0)
+    {
+        assert(m_pos >= m_base);
+
+        BYTE* const buf = m_buf[m_curr];
+        const __int64 off = m_pos - m_base;
+
+        if (off >= kBufferSize)  //past the buffer: zero-fill the gap
+        {
+            memset(buf + m_len, 0, kBufferSize - m_len);
+            m_len = kBufferSize;
+
+            const HRESULT hr = Submit(kBufferSize);
+
+            if (FAILED(hr))
+                return hr;
+
+            continue;
+        }
+
+        const ULONG pos = static_cast<ULONG>(off);
+
+        if (pos > m_len)
+        {
+            memset(buf + m_len, 0, pos - m_len);
+            m_len = pos;
+        }
+
+        const ULONG room = kBufferSize - pos;
+        const ULONG len = (n <= room) ? n : room;
+
+        memcpy(buf + pos, p, len);
+
+        p += len;
+        n -= len;
+        m_pos += len;
+
+        if ((pos + len) > m_len)
+            m_len = pos + len;
+
+        if (m_len >= kBufferSize)
+        {
+            const HRESULT hr = Submit(kBufferSize);
+
+            if (FAILED(hr))
+                return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Patch(__int64 pos, const BYTE* p, ULONG n)
+{
+    assert((pos + n) <= m_base);
+
+    if (m_bPending && ((pos + n) > (m_base - kBufferSize)))
+    {
+        const HRESULT hr = Wait();  //the bytes are still in flight
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    //The patch handle is synchronous; the OVERLAPPED only sets the
+    //position.
+
+    OVERLAPPED o;
+    memset(&o, 0, sizeof o);
+
+    SetOffset(o, pos);
+
+    DWORD cb;
+
+    if (!WriteFile(m_hPatch, p, n, &cb, &o))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    if (cb != n)
+        return STG_E_MEDIUMFULL;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Fetch(__int64 pos, BYTE* p, ULONG n)
+{
+    assert((pos + n) <= m_base);
+
+    if (m_bPending && ((pos + n) > (m_base - kBufferSize)))
+    {
+        const HRESULT hr = Wait();
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    OVERLAPPED o;
+    memset(&o, 0, sizeof o);
+
+    SetOffset(o, pos);
+
+    DWORD cb;
+
+    if (!ReadFile(m_hPatch, p, n, &cb, &o))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    if (cb != n)
+        return STG_E_READFAULT;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IStream*>(this);
+
+    else if (iid == __uuidof(ISequentialStream))
+        pUnk = static_cast<ISequentialStream*>(this);
+
+    else if (iid == __uuidof(IStream))
+        pUnk = static_cast<IStream*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG FileStream::AddRef()
+{
+    return 1;
+}
+
+
+ULONG FileStream::Release()
+{
+    return 1;
+}
+
+
+HRESULT FileStream::Read(void* pv, ULONG cb, ULONG* pcbRead)
+{
+    if (pcbRead)
+        *pcbRead = 0;
+
+    if (!IsOpen())
+        return E_UNEXPECTED;
+
+    if (cb == 0)
+        return S_OK;
+
+    if (pv == 0)
+        return STG_E_INVALIDPOINTER;
+
+    if (m_pos >= m_size)
+        return S_OK;
+
+    const __int64 avail = m_size - m_pos;
+    const ULONG total = (cb <= avail) ? cb : static_cast<ULONG>(avail);
+
+    BYTE* p = static_cast<BYTE*>(pv);
+    ULONG n = total;
+
+    if (m_pos < m_base)  //already written to disk
+    {
+        const __int64 behind = m_base - m_pos;
+        const ULONG len = (n <= behind) ? n : static_cast<ULONG>(behind);
+
+        const HRESULT hr = Fetch(m_pos, p, len);
+
+        if (FAILED(hr))
+            return hr;
+
+        p += len;
+        n -= len;
+        m_pos += len;
+    }
+
+    if (n > 0)
+    {
+        const __int64 off = m_pos - m_base;
+        ULONG len = 0;
+
+        if (off < m_len)
+        {
+            const ULONG buffered = m_len - static_cast<ULONG>(off);
+            len = (n <= buffered) ? n : buffered;
+
+            memcpy(p, m_buf[m_curr] + off, len);
+        }
+
+        memset(p + len, 0, n - len);  //extended by SetSize
+        m_pos += n;
+    }
+
+    if (pcbRead)
+        *pcbRead = total;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Write(const void* pv, ULONG cb, ULONG* pcbWritten)
+{
+    if (pcbWritten)
+        *pcbWritten = 0;
+
+    if (!IsOpen())
+        return E_UNEXPECTED;
+
+    if (cb == 0)
+        return S_OK;
+
+    if (pv == 0)
+        return STG_E_INVALIDPOINTER;
+
+    const BYTE* p = static_cast<const BYTE*>(pv);
+    ULONG n = cb;
+
+    if (m_pos < m_base)  //patch bytes already written to disk
+    {
+        const __int64 behind = m_base - m_pos;
+        const ULONG len = (n <= behind) ? n : static_cast<ULONG>(behind);
+
+        const HRESULT hr = Patch(m_pos, p, len);
+
+        if (FAILED(hr))
+            return hr;
+
+        p += len;
+        n -= len;
+        m_pos += len;
+    }
+
+    if (n > 0)
+    {
+        const HRESULT hr = WriteTail(p, n);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (m_pos > m_size)
+        m_size = m_pos;
+
+    if (pcbWritten)
+        *pcbWritten = cb;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Seek(
+    LARGE_INTEGER move,
+    DWORD origin,
+    ULARGE_INTEGER* pPos)
+{
+    if (!IsOpen())
+        return E_UNEXPECTED;
+
+    __int64 pos;
+
+    switch (origin)
+    {
+        case STREAM_SEEK_SET:
+            pos = move.QuadPart;
+            break;
+
+        case STREAM_SEEK_CUR:
+            pos = m_pos + move.QuadPart;
+            break;
+
+        case STREAM_SEEK_END:
+            pos = m_size + move.QuadPart;
+            break;
+
+        default:
+            return STG_E_INVALIDFUNCTION;
+    }
+
+    if (pos < 0)
+        return STG_E_INVALIDFUNCTION;
+
+    m_pos = pos;
+
+    if (pPos)
+        pPos->QuadPart = m_pos;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::SetSize(ULARGE_INTEGER size)
+{
+    if (!IsOpen())
+        return E_UNEXPECTED;
+
+    //The file itself is sized when it is closed, except that growing it
+    //(as the muxer does, to preallocate) extends it now, so that the
+    //space is allocated in one piece.  Where the process is permitted
+    //to (it holds SE_MANAGE_VOLUME_NAME, and has enabled it), the new
+    //space is also made valid, so that the writes into it don't have to
+    //update the valid data length of the file as they go.
+
+    if (size.QuadPart > m_size)
+    {
+        LARGE_INTEGER end;
+        end.QuadPart = size.QuadPart;
+
+        if (!SetFilePointerEx(m_hPatch, end, 0, FILE_BEGIN) ||
+            !SetEndOfFile(m_hPatch))
+        {
+            const DWORD e = GetLastError();
+            return HRESULT_FROM_WIN32(e);
+        }
+
+        SetFileValidData(m_hPatch, end.QuadPart);  //fails if not permitted
+    }
+
+    m_size = size.QuadPart;
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::CopyTo(
+    IStream*,
+    ULARGE_INTEGER,
+    ULARGE_INTEGER*,
+    ULARGE_INTEGER*)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT FileStream::Commit(DWORD)
+{
+    //Makes what has been written so far durable.  The buffer being
+    //filled is copied to the file through the patch handle (it is
+    //written again, unbuffered, once it fills), once the buffer in
+    //flight has landed.
+
+    if (!IsOpen())
+        return E_UNEXPECTED;
+
+    HRESULT hr = Wait();
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_len > 0)
+    {
+        OVERLAPPED o;
+        memset(&o, 0, sizeof o);
+
+        SetOffset(o, m_base);
+
+        DWORD cb;
+
+        if (!WriteFile(m_hPatch, m_buf[m_curr], m_len, &cb, &o))
+        {
+            const DWORD e = GetLastError();
+            return HRESULT_FROM_WIN32(e);
+        }
+
+        if (cb != m_len)
+            return STG_E_MEDIUMFULL;
+    }
+
+    if (!FlushFileBuffers(m_hPatch))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT FileStream::Revert()
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT FileStream::LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT FileStream::UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT FileStream::Stat(STATSTG*, DWORD)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT FileStream::Clone(IStream**)
+{
+    return E_NOTIMPL;
+}
+
+
+}  //end namespace WebmMuxLib
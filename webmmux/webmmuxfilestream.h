@@ -0,0 +1,109 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objidl.h>
+
+namespace WebmMuxLib
+{
+
+//A stream that writes the mux directly to a file, bypassing the system
+//cache.  Sequential output is gathered into one of two sector-aligned
+//buffers; when it fills, it is handed to the disk as an overlapped,
+//unbuffered write, and filling continues in the other buffer, so the
+//streaming thread only blocks if the disk falls a whole buffer behind.
+//Writes to bytes that have already left the buffers (the header
+//patches made when the mux is finalized) go through a second, ordinary
+//cached handle on the same file.  Commit copies the buffer being filled
+//through that handle as well, and flushes it, so that a checkpoint of
+//the mux survives a crash.
+
+class FileStream : public IStream
+{
+    FileStream(const FileStream&);
+    FileStream& operator=(const FileStream&);
+
+public:
+
+    FileStream();
+    ~FileStream();
+
+    //Creates the file (replacing any existing file of that name).
+    HRESULT Open(const wchar_t*);
+
+    //Writes what remains in the buffers, waits for all writes to
+    //complete, trims the file to its final size, and closes it.
+    HRESULT Close();
+
+    bool IsOpen() const;
+
+    enum { kBufferSize = 1024 * 1024 };  //each of the two buffers
+
+    //IUnknown (not reference-counted; owned by the Context)
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //ISequentialStream
+
+    HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*);
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*);
+
+    //IStream
+
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*);
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER);
+
+    HRESULT STDMETHODCALLTYPE CopyTo(
+        IStream*,
+        ULARGE_INTEGER,
+        ULARGE_INTEGER*,
+        ULARGE_INTEGER*);
+
+    HRESULT STDMETHODCALLTYPE Commit(DWORD);
+    HRESULT STDMETHODCALLTYPE Revert();
+
+    HRESULT STDMETHODCALLTYPE LockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE UnlockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD);
+    HRESULT STDMETHODCALLTYPE Clone(IStream**);
+
+private:
+
+    HANDLE m_hFile;   //unbuffered and overlapped: sequential output
+    HANDLE m_hPatch;  //cached: access to bytes already written to disk
+    OVERLAPPED m_overlapped;
+    bool m_bPending;  //a buffer is in flight
+
+    BYTE* m_buf[2];
+    int m_curr;       //the buffer being filled
+    ULONG m_len;      //bytes in the buffer being filled
+    __int64 m_base;   //file position of the buffer being filled
+    __int64 m_pos;
+    __int64 m_size;
+    ULONG m_align;    //sector size of the volume
+
+    HRESULT Submit(ULONG);
+    HRESULT Wait();
+    HRESULT WriteTail(const BYTE*, ULONG);
+    HRESULT Patch(__int64, const BYTE*, ULONG);
+    HRESULT Fetch(__int64, BYTE*, ULONG);
+    void Destroy();
+
+};
+
+}  //end namespace WebmMuxLib
@@ -74,11 +74,24 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_state(State_Stopped),
       m_clock(0),
       m_inpin_video(this),
-      m_inpin_audio(this),
       m_outpin(this)
 {
     m_pClassFactory->LockServer(TRUE);
 
+    static const wchar_t* const ids[kAudioInpins] =
+    {
+        L"audio",
+        L"audio 2",
+        L"audio 3",
+        L"audio 4"
+    };
+
+    for (int i = 0; i < kAudioInpins; ++i)
+    {
+        m_inpin_audio[i] = new (std::nothrow) InpinAudio(this, ids[i]);
+        assert(m_inpin_audio[i]);  //TODO
+    }
+
     const HRESULT hr = CLockable::Init();
     hr;
     assert(SUCCEEDED(hr));
@@ -101,6 +114,9 @@ Filter::~Filter()
     os << "mkvmux::dtor" << endl;
 #endif
 
+    for (int i = 0; i < kAudioInpins; ++i)
+        delete m_inpin_audio[i];
+
     m_pClassFactory->LockServer(FALSE);
 }
 
@@ -145,10 +161,22 @@ HRESULT Filter::nondelegating_t::QueryInterface(
     {
         pUnk = static_cast<IAMFilterMiscFlags*>(m_pFilter);
     }
+    else if (iid == __uuidof(IWebmMux2))
+    {
+        pUnk = static_cast<IWebmMux2*>(m_pFilter);
+    }
     else if (iid == __uuidof(IWebmMux))
     {
         pUnk = static_cast<IWebmMux*>(m_pFilter);
     }
+    else if (iid == __uuidof(IPipelineCounters))
+    {
+        pUnk = static_cast<IPipelineCounters*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IWebmEncryption))
+    {
+        pUnk = static_cast<IWebmEncryption*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -234,9 +262,13 @@ HRESULT Filter::Stop()
             //m_inpin_video.Stop();
             //m_inpin_audio.Stop();
 
+            m_ctx.StopWriter(lock);  //releases the lock while it waits
+
             m_outpin.Final();  //close mkv file if req'd
 
-            m_inpin_audio.Final();
+            for (int i = kAudioInpins - 1; i >= 0; --i)
+                m_inpin_audio[i]->Final();
+
             m_inpin_video.Final();
 
             break;
@@ -276,9 +308,18 @@ HRESULT Filter::Pause()
     switch (m_state)
     {
         case State_Stopped:
+            hr = OpenOutputFile();
+
+            if (FAILED(hr))
+                return hr;
+
             m_inpin_video.Init();
-            m_inpin_audio.Init();
+
+            for (int i = 0; i < kAudioInpins; ++i)
+                m_inpin_audio[i]->Init();
+
             m_outpin.Init();
+            StartWriter();
             break;
 
         case State_Running:
@@ -309,16 +350,28 @@ HRESULT Filter::Run(REFERENCE_TIME start)
     switch (m_state)
     {
         case State_Stopped:
+            hr = OpenOutputFile();
+
+            if (FAILED(hr))
+                return hr;
+
             m_inpin_video.Init();
-            m_inpin_audio.Init();
+
+            for (int i = 0; i < kAudioInpins; ++i)
+                m_inpin_audio[i]->Init();
+
             m_outpin.Init();
+            StartWriter();
             break;
 
         case State_Paused:
         case State_Running:
         default:
             m_inpin_video.Run();
-            m_inpin_audio.Run();
+
+            for (int i = 0; i < kAudioInpins; ++i)
+                m_inpin_audio[i]->Run();
+
             break;
     }
 
@@ -398,9 +451,17 @@ HRESULT Filter::GetSyncSource(
 
 HRESULT Filter::EnumPins(IEnumPins** pp)
 {
-    IPin* const pa[3] = { &m_inpin_video, &m_inpin_audio, &m_outpin };
+    enum { n = 2 + kAudioInpins };
+    IPin* pa[n];
+
+    pa[0] = &m_inpin_video;
+
+    for (int i = 0; i < kAudioInpins; ++i)
+        pa[1 + i] = m_inpin_audio[i];
+
+    pa[n - 1] = &m_outpin;
 
-    return CEnumPins::CreateInstance(pa, 3, pp);
+    return CEnumPins::CreateInstance(pa, n, pp);
 }
 
 
@@ -418,14 +479,15 @@ HRESULT Filter::FindPin(
     if (id == 0)
         return E_INVALIDARG;
 
-    enum { n = 3 };
+    enum { n = 2 + kAudioInpins };
+    Pin* pins[n];
 
-    Pin* const pins[n] =
-    {
-        &m_inpin_video,
-        &m_inpin_audio,
-        &m_outpin
-    };
+    pins[0] = &m_inpin_video;
+
+    for (int i = 0; i < kAudioInpins; ++i)
+        pins[1 + i] = m_inpin_audio[i];
+
+    pins[n - 1] = &m_outpin;
 
     for (int i = 0; i < n; ++i)
     {
@@ -566,7 +628,7 @@ HRESULT Filter::GetCapabilities(DWORD* pdw)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -646,7 +708,7 @@ HRESULT Filter::IsFormatSupported(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -691,7 +753,7 @@ HRESULT Filter::QueryPreferredFormat(GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -732,7 +794,7 @@ HRESULT Filter::GetTimeFormat(GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -773,7 +835,7 @@ HRESULT Filter::IsUsingTimeFormat(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -819,7 +881,7 @@ HRESULT Filter::SetTimeFormat(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -872,7 +934,7 @@ HRESULT Filter::GetDuration(LONGLONG* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_pPinConnection)
+    if (IPin* pin = m_inpin_audio[0]->m_pPinConnection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -989,7 +1051,7 @@ HRESULT Filter::ConvertTimeFormat(
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = m_inpin_audio[0]->m_connection)
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -1140,10 +1202,13 @@ HRESULT Filter::SetPositions(
     if (FAILED(hr))
         return hr;
 
-    hr = m_inpin_audio.ResetPosition();
+    for (int i = 0; i < kAudioInpins; ++i)
+    {
+        hr = m_inpin_audio[i]->ResetPosition();
 
-    if (FAILED(hr))
-        return hr;
+        if (FAILED(hr))
+            return hr;
+    }
 
     if (dwCurr_ & AM_SEEKING_ReturnTime)
         tCurr = 0;
@@ -1308,7 +1373,8 @@ HRESULT Filter::SetMuxMode(WebmMuxMode mux_mode)
     Lock lock;
 
     int imux_mode = mux_mode;
-    if (imux_mode < kWebmMuxModeDefault && mux_mode > kWebmMuxModeLive)
+    if (imux_mode < kWebmMuxModeDefault ||
+        imux_mode > kWebmMuxModeDashSegments)
         return E_INVALIDARG;
 
     HRESULT hr = lock.Seize(this);
@@ -1319,7 +1385,9 @@ HRESULT Filter::SetMuxMode(WebmMuxMode mux_mode)
     if (m_state != State_Stopped)
         return VFW_E_NOT_STOPPED;
 
-    m_ctx.SetLiveMuxMode(mux_mode == kWebmMuxModeLive);
+    m_ctx.SetLiveMuxMode(mux_mode != kWebmMuxModeDefault);
+    m_ctx.SetLowLatencyMode(mux_mode == kWebmMuxModeLiveLowLatency);
+    m_ctx.SetSegmentMode(mux_mode == kWebmMuxModeDashSegments);
 
     return S_OK;
 }
@@ -1337,7 +1405,11 @@ HRESULT Filter::GetMuxMode(WebmMuxMode* pMuxMode)
     if (FAILED(hr))
         return hr;
 
-    if (m_ctx.GetLiveMuxMode())
+    if (m_ctx.GetSegmentMode())
+        *pMuxMode = kWebmMuxModeDashSegments;
+    else if (m_ctx.GetLowLatencyMode())
+        *pMuxMode = kWebmMuxModeLiveLowLatency;
+    else if (m_ctx.GetLiveMuxMode())
         *pMuxMode = kWebmMuxModeLive;
     else
         *pMuxMode = kWebmMuxModeDefault;
@@ -1346,83 +1418,952 @@ HRESULT Filter::GetMuxMode(WebmMuxMode* pMuxMode)
 }
 
 
-HRESULT Filter::OnEndOfStream()
+HRESULT Filter::SetWriteBufferSize(ULONG size)
 {
-#if 1
-    //NOTE: it appears that you must do both of send EOS downstream
-    //to the file writer, and act as renderer (as described below):
-    if (IPin* pin = m_outpin.m_pPinConnection)
-    {
-        const HRESULT hr = pin->EndOfStream();
-        hr;
-        assert(SUCCEEDED(hr));
-    }
+    Lock lock;
 
-    //"End-of-Stream Notifications"
-    //http://msdn.microsoft.com/en-us/library/dd375604(VS.85).aspx
+    HRESULT hr = lock.Seize(this);
 
-    //The key to getting this to work is to treat this muxer as
-    //as renderer.  We do that by supporting both IMediaSeeking and
-    //IAMFilterMiscFlags.  As the API states:
-    //
-    //(begin quote)
-    //To determine the number of streams, the Filter Graph Manager
-    //counts the number of filters that support seeking (through
-    //IMediaSeeking or IMediaPosition) and have a rendered input pin,
-    //which is defined as an input pin with no corresponding outputs.
-    //The Filter Graph Manager determines whether a pin is rendered
-    //in one of two ways:
-    //
-    //(1)  The pin's IPin::QueryInternalConnections method returns zero
-    //     in the nPin parameter.
-    //(2)  The filter exposes the IAMFilterMiscFlags interface and
-    //     returns the AM_FILTER_MISC_FLAGS_IS_RENDERER flag.
-    //(end quote)
-    //
-    //See also:
-    //"IPin::QueryInternalConnections Method"
-    //http://msdn.microsoft.com/en-us/library/dd390431(VS.85).aspx
-    //
-    //(begin quote)
-    //This method has another use that is now deprecated: The Filter
-    //Graph Manager treats a filter as being a renderer filter if at
-    //least one input pin implements this method but returns zero in nPin.
-    //If you are writing a new renderer filter, however, you should
-    //implement the IAMFilterMiscFlags interface instead of using this
-    //method to indicate that the filter is a renderer.
-    //(end quote)
+    if (FAILED(hr))
+        return hr;
 
-#if 0
-    odbgstream os;
-    os << "muxer::filter::OnEndOfStream: sending EC_COMPLETE" << endl;
-#endif
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
 
-    _COM_SMARTPTR_TYPEDEF(IMediaEventSink, __uuidof(IMediaEventSink));
+    return m_ctx.m_file.SetBufferSize(size);
+}
 
-    const IMediaEventSinkPtr pSink(m_info.pGraph);
-    assert(bool(pSink));
 
-    const HRESULT hr = pSink->Notify(EC_COMPLETE, S_OK, 0);
-    hr;
-    assert(SUCCEEDED(hr));
+HRESULT Filter::GetWriteBufferSize(ULONG* pSize)
+{
+    if (pSize == 0)
+        return E_POINTER;
 
-#else
-    //TODO: I thought that sending EOS should be enough, but apparently
-    //the EC_COMPLETE is not being delivered to the main loop.
-    //I don't know why.  As a workaround, just manually send
-    //a user event, so we know something gets delivered.
+    Lock lock;
 
-    _COM_SMARTPTR_TYPEDEF(IMediaEventSink, __uuidof(IMediaEventSink));
+    HRESULT hr = lock.Seize(this);
 
-    const IMediaEventSinkPtr pSink(m_info.pGraph);
-    assert(bool(pSink));
+    if (FAILED(hr))
+        return hr;
 
-    const HRESULT hr = pSink->Notify(EC_USER + 0x100, 0, 0);
-    hr;
-#endif
+    *pSize = m_ctx.m_file.GetBufferSize();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetCueInterval(ULONG interval_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetCueInterval(interval_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetCueInterval(ULONG* pInterval)
+{
+    if (pInterval == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pInterval = m_ctx.GetCueInterval();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetQueueDepth(long track_number, ULONG* pFrames)
+{
+    if (pFrames == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state == State_Stopped)
+        return VFW_E_NOT_RUNNING;
+
+    if (!m_ctx.GetQueueDepth(track_number, *pFrames))
+        return E_INVALIDARG;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetAllocationCount(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state == State_Stopped)
+        return VFW_E_NOT_RUNNING;
+
+    *pCount = m_ctx.GetAllocCount();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetChunkSink(IWebmMuxChunkSink* pSink)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.m_chunks.SetSink(pSink);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetMaxClusterDuration(ULONG duration_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetMaxClusterDuration(duration_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetMaxClusterDuration(ULONG* pDuration)
+{
+    if (pDuration == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDuration = m_ctx.GetMaxClusterDuration();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetMaxClusterSize(ULONG size)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetMaxClusterSize(size);
 
     return S_OK;
 }
 
 
+HRESULT Filter::GetMaxClusterSize(ULONG* pSize)
+{
+    if (pSize == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pSize = m_ctx.GetMaxClusterSize();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetClusterBoundary(WebmMuxClusterBoundary boundary)
+{
+    if ((boundary != kWebmMuxClusterBoundaryLimits) &&
+        (boundary != kWebmMuxClusterBoundaryKeyFrames))
+    {
+        return E_INVALIDARG;
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetClusterKeyFramesOnly(boundary == kWebmMuxClusterBoundaryKeyFrames);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetClusterBoundary(WebmMuxClusterBoundary* pBoundary)
+{
+    if (pBoundary == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_ctx.GetClusterKeyFramesOnly())
+        *pBoundary = kWebmMuxClusterBoundaryKeyFrames;
+    else
+        *pBoundary = kWebmMuxClusterBoundaryLimits;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetCuesReserveDuration(ULONG duration_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetCuesReserveDuration(duration_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetCuesReserveDuration(ULONG* pDuration)
+{
+    if (pDuration == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDuration = m_ctx.GetCuesReserveDuration();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetCheckpointInterval(ULONG interval_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetCheckpointInterval(interval_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetCheckpointInterval(ULONG* pInterval)
+{
+    if (pInterval == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pInterval = m_ctx.GetCheckpointInterval();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetPreallocation(BOOL b)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetPreallocation(b != FALSE);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetPreallocation(BOOL* pb)
+{
+    if (pb == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pb = m_ctx.GetPreallocation() ? TRUE : FALSE;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetInterleaveQueueDuration(ULONG duration_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetInterleaveQueueDuration(duration_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetInterleaveQueueDuration(ULONG* pDuration)
+{
+    if (pDuration == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDuration = m_ctx.GetInterleaveQueueDuration();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetSegmentSink(IWebmMuxSegmentSink* pSink)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.m_segments.SetSink(pSink);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetSegmentDuration(ULONG duration_ms)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetSegmentDuration(duration_ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetSegmentDuration(ULONG* pDuration)
+{
+    if (pDuration == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDuration = m_ctx.GetSegmentDuration();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetWriteAheadLimit(ULONG limit)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    return m_ctx.m_file.SetWriteAheadLimit(limit);
+}
+
+
+HRESULT Filter::GetWriteAheadLimit(ULONG* pLimit)
+{
+    if (pLimit == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pLimit = m_ctx.m_file.GetWriteAheadLimit();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetWriteAheadStats(
+    ULONG* pQueued,
+    ULONG* pPeak,
+    ULONG* pStallMs)
+{
+    if ((pQueued == 0) || (pPeak == 0) || (pStallMs == 0))
+        return E_POINTER;
+
+    //Like the pipeline counters, these are read without the filter lock,
+    //so that they can be polled while the graph runs.
+
+    const EbmlIO::File& f = m_ctx.m_file;
+
+    *pQueued = f.GetQueuedBytes();
+    *pPeak = f.GetPeakQueuedBytes();
+    *pStallMs = static_cast<ULONG>(f.GetStallTime() / 1000);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetClusterWrite(WebmMuxClusterWrite w)
+{
+    if ((w != kWebmMuxClusterWritePatched) &&
+        (w != kWebmMuxClusterWriteAssembled) &&
+        (w != kWebmMuxClusterWriteChecked))
+    {
+        return E_INVALIDARG;
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetClusterAssembly(w != kWebmMuxClusterWritePatched);
+    m_ctx.SetClusterCrc(w == kWebmMuxClusterWriteChecked);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetClusterWrite(WebmMuxClusterWrite* pWrite)
+{
+    if (pWrite == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_ctx.GetClusterCrc())
+        *pWrite = kWebmMuxClusterWriteChecked;
+    else if (m_ctx.GetClusterAssembly())
+        *pWrite = kWebmMuxClusterWriteAssembled;
+    else
+        *pWrite = kWebmMuxClusterWritePatched;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::AddTeeSink(IWebmMuxChunkSink* pSink)
+{
+    if (pSink == 0)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    return m_ctx.m_tee.AddSink(pSink);
+}
+
+
+HRESULT Filter::RemoveTeeSinks()
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.m_tee.RemoveSinks();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetTeeQueueLimit(ULONG limit)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.m_tee.SetQueueLimit(limit);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetTeeQueueLimit(ULONG* pLimit)
+{
+    if (pLimit == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pLimit = m_ctx.m_tee.GetQueueLimit();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetTeeStats(ULONG index, ULONG* pQueued, ULONG* pDropped)
+{
+    if ((pQueued == 0) || (pDropped == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!m_ctx.m_tee.GetStats(index, *pQueued, *pDropped))
+        return E_INVALIDARG;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetVideoStrippedHeader(ULONG size, const BYTE* header)
+{
+    if ((header == 0) && (size > 0))
+        return E_POINTER;
+
+    if (size > Context::kMaxStrippedHeaderSize)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetVideoStrippedHeader(header, size);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetAudioStrippedHeader(ULONG size, const BYTE* header)
+{
+    if ((header == 0) && (size > 0))
+        return E_POINTER;
+
+    if (size > Context::kMaxStrippedHeaderSize)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetAudioStrippedHeader(header, size);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetOutputFile(const wchar_t* str)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (str == 0)
+        m_output_file.clear();
+
+    else if (*str == L'\0')
+        return E_INVALIDARG;
+
+    else
+        m_output_file = str;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetOutputFile(wchar_t** p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    wchar_t*& str = *p;
+    str = 0;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_output_file.empty())
+        return S_OK;
+
+    const size_t len = m_output_file.length();   //wchar strlen
+    const size_t buflen = len + 1;                //wchar strlen + wchar null
+    const size_t cb = buflen * sizeof(wchar_t);   //total bytes
+
+    str = (wchar_t*)CoTaskMemAlloc(cb);
+
+    if (str == 0)
+        return E_OUTOFMEMORY;
+
+    const errno_t e = wcscpy_s(str, buflen, m_output_file.c_str());
+    e;
+    assert(e == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetStageCount(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    *pCount = 2;  //frames, then writes to the stream
+    return S_OK;
+}
+
+
+HRESULT Filter::GetStage(ULONG index, Stats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    //The counters are read without the filter lock.
+
+    if (index == 0)
+        m_ctx.m_counters.GetStats(pStats);
+
+    else if (index == 1)
+        m_ctx.m_write_counters.GetStats(pStats);
+
+    else
+        return E_INVALIDARG;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::ResetStages()
+{
+    m_ctx.m_counters.Reset();
+    m_ctx.m_write_counters.Reset();
+    return S_OK;
+}
+
+
+HRESULT Filter::SetEncryptionKey(
+    const BYTE* key_id,
+    ULONG key_id_len,
+    const BYTE* key)
+{
+    if ((key_id == 0) && (key_id_len > 0))
+        return E_POINTER;
+
+    if (key_id_len > kMaxKeyIdSize)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetEncryptionKey(key_id, key_id_len, key);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::OpenOutputFile()
+{
+    //The file is only written directly if nothing downstream is
+    //going to receive the mux.
+
+    if (m_output_file.empty())
+        return S_FALSE;
+
+    if (bool(m_outpin.m_pStream) || m_ctx.m_chunks.GetSink())
+        return S_FALSE;
+
+    return m_ctx.m_disk.Open(m_output_file.c_str());
+}
+
+
+HRESULT Filter::OnEndOfStream()
+{
+#if 1
+    //NOTE: it appears that you must do both of send EOS downstream
+    //to the file writer, and act as renderer (as described below):
+    if (IPin* pin = m_outpin.m_pPinConnection)
+    {
+        const HRESULT hr = pin->EndOfStream();
+        hr;
+        assert(SUCCEEDED(hr));
+    }
+
+    //"End-of-Stream Notifications"
+    //http://msdn.microsoft.com/en-us/library/dd375604(VS.85).aspx
+
+    //The key to getting this to work is to treat this muxer as
+    //as renderer.  We do that by supporting both IMediaSeeking and
+    //IAMFilterMiscFlags.  As the API states:
+    //
+    //(begin quote)
+    //To determine the number of streams, the Filter Graph Manager
+    //counts the number of filters that support seeking (through
+    //IMediaSeeking or IMediaPosition) and have a rendered input pin,
+    //which is defined as an input pin with no corresponding outputs.
+    //The Filter Graph Manager determines whether a pin is rendered
+    //in one of two ways:
+    //
+    //(1)  The pin's IPin::QueryInternalConnections method returns zero
+    //     in the nPin parameter.
+    //(2)  The filter exposes the IAMFilterMiscFlags interface and
+    //     returns the AM_FILTER_MISC_FLAGS_IS_RENDERER flag.
+    //(end quote)
+    //
+    //See also:
+    //"IPin::QueryInternalConnections Method"
+    //http://msdn.microsoft.com/en-us/library/dd390431(VS.85).aspx
+    //
+    //(begin quote)
+    //This method has another use that is now deprecated: The Filter
+    //Graph Manager treats a filter as being a renderer filter if at
+    //least one input pin implements this method but returns zero in nPin.
+    //If you are writing a new renderer filter, however, you should
+    //implement the IAMFilterMiscFlags interface instead of using this
+    //method to indicate that the filter is a renderer.
+    //(end quote)
+
+#if 0
+    odbgstream os;
+    os << "muxer::filter::OnEndOfStream: sending EC_COMPLETE" << endl;
+#endif
+
+    _COM_SMARTPTR_TYPEDEF(IMediaEventSink, __uuidof(IMediaEventSink));
+
+    const IMediaEventSinkPtr pSink(m_info.pGraph);
+    assert(bool(pSink));
+
+    const HRESULT hr = pSink->Notify(EC_COMPLETE, S_OK, 0);
+    hr;
+    assert(SUCCEEDED(hr));
+
+#else
+    //TODO: I thought that sending EOS should be enough, but apparently
+    //the EC_COMPLETE is not being delivered to the main loop.
+    //I don't know why.  As a workaround, just manually send
+    //a user event, so we know something gets delivered.
+
+    _COM_SMARTPTR_TYPEDEF(IMediaEventSink, __uuidof(IMediaEventSink));
+
+    const IMediaEventSinkPtr pSink(m_info.pGraph);
+    assert(bool(pSink));
+
+    const HRESULT hr = pSink->Notify(EC_USER + 0x100, 0, 0);
+    hr;
+#endif
+
+    return S_OK;
+}
+
+
+void Filter::StartWriter()
+{
+    //The writer thread of queued interleave mode wakes the inpins as
+    //their queues drain.
+
+    HANDLE hh[1 + kAudioInpins];
+
+    hh[0] = m_inpin_video.m_hSample;
+
+    for (int i = 0; i < kAudioInpins; ++i)
+        hh[1 + i] = m_inpin_audio[i]->m_hSample;
+
+    m_ctx.StartWriter(this, hh, 1 + kAudioInpins);
+}
+
+
+void Filter::NotifyInpins(const Inpin* pSender)
+{
+    if (pSender != &m_inpin_video)
+    {
+        const BOOL b = SetEvent(m_inpin_video.m_hSample);
+        assert(b);
+        b;
+    }
+
+    for (int i = 0; i < kAudioInpins; ++i)
+    {
+        InpinAudio* const pin = m_inpin_audio[i];
+
+        if (pin == pSender)
+            continue;
+
+        const BOOL b = SetEvent(pin->m_hSample);
+        assert(b);
+        b;
+    }
+}
+
+
 } //end namespace WebmMuxLib
@@ -14,6 +14,8 @@
 #include "webmmuxoutpin.h"
 #include "webmmuxcontext.h"
 #include "clockable.h"
+#include "ipipelinecounters.h"
+#include "iwebmencryption.h"
 #include "webmmuxidl.h"
 
 namespace WebmMuxLib
@@ -22,7 +24,9 @@ namespace WebmMuxLib
 class Filter : public IBaseFilter,
                public IMediaSeeking,
                public IAMFilterMiscFlags,
-               public IWebmMux,
+               public IWebmMux2,
+               public IPipelineCounters,
+               public IWebmEncryption,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -107,6 +111,77 @@ public:
     HRESULT STDMETHODCALLTYPE SetMuxMode(WebmMuxMode);
     HRESULT STDMETHODCALLTYPE GetMuxMode(WebmMuxMode*);
 
+    //IWebmMux2
+
+    HRESULT STDMETHODCALLTYPE SetWriteBufferSize(ULONG);
+    HRESULT STDMETHODCALLTYPE GetWriteBufferSize(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetCueInterval(ULONG);
+    HRESULT STDMETHODCALLTYPE GetCueInterval(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE GetQueueDepth(long, ULONG*);
+    HRESULT STDMETHODCALLTYPE GetAllocationCount(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetChunkSink(IWebmMuxChunkSink*);
+
+    HRESULT STDMETHODCALLTYPE SetMaxClusterDuration(ULONG);
+    HRESULT STDMETHODCALLTYPE GetMaxClusterDuration(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetMaxClusterSize(ULONG);
+    HRESULT STDMETHODCALLTYPE GetMaxClusterSize(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetClusterBoundary(WebmMuxClusterBoundary);
+    HRESULT STDMETHODCALLTYPE GetClusterBoundary(WebmMuxClusterBoundary*);
+
+    HRESULT STDMETHODCALLTYPE SetCuesReserveDuration(ULONG);
+    HRESULT STDMETHODCALLTYPE GetCuesReserveDuration(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetCheckpointInterval(ULONG);
+    HRESULT STDMETHODCALLTYPE GetCheckpointInterval(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetPreallocation(BOOL);
+    HRESULT STDMETHODCALLTYPE GetPreallocation(BOOL*);
+
+    HRESULT STDMETHODCALLTYPE SetOutputFile(const wchar_t*);
+    HRESULT STDMETHODCALLTYPE GetOutputFile(wchar_t**);
+
+    HRESULT STDMETHODCALLTYPE SetInterleaveQueueDuration(ULONG);
+    HRESULT STDMETHODCALLTYPE GetInterleaveQueueDuration(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetSegmentSink(IWebmMuxSegmentSink*);
+
+    HRESULT STDMETHODCALLTYPE SetSegmentDuration(ULONG);
+    HRESULT STDMETHODCALLTYPE GetSegmentDuration(ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetWriteAheadLimit(ULONG);
+    HRESULT STDMETHODCALLTYPE GetWriteAheadLimit(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetWriteAheadStats(ULONG*, ULONG*, ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetClusterWrite(WebmMuxClusterWrite);
+    HRESULT STDMETHODCALLTYPE GetClusterWrite(WebmMuxClusterWrite*);
+
+    HRESULT STDMETHODCALLTYPE AddTeeSink(IWebmMuxChunkSink*);
+    HRESULT STDMETHODCALLTYPE RemoveTeeSinks();
+    HRESULT STDMETHODCALLTYPE SetTeeQueueLimit(ULONG);
+    HRESULT STDMETHODCALLTYPE GetTeeQueueLimit(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetTeeStats(ULONG, ULONG*, ULONG*);
+
+    HRESULT STDMETHODCALLTYPE SetVideoStrippedHeader(ULONG, const BYTE*);
+    HRESULT STDMETHODCALLTYPE SetAudioStrippedHeader(ULONG, const BYTE*);
+
+    //IPipelineCounters
+
+    HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*);
+    HRESULT STDMETHODCALLTYPE ResetStages();
+
+    //IWebmEncryption
+
+    HRESULT STDMETHODCALLTYPE SetEncryptionKey(
+                                const BYTE* key_id,
+                                ULONG key_id_len,
+                                const BYTE* key);
+
 private:
 
     class nondelegating_t : public IUnknown
@@ -136,17 +211,28 @@ private:
     REFERENCE_TIME m_start;
     IReferenceClock* m_clock;
     FILTER_INFO m_info;
+    std::wstring m_output_file;
+
+    HRESULT OpenOutputFile();
+    void StartWriter();
 
 public:
 
     FILTER_STATE m_state;
     InpinVideo m_inpin_video;
-    InpinAudio m_inpin_audio;
+
+    enum { kAudioInpins = 4 };
+    InpinAudio* m_inpin_audio[kAudioInpins];
+
     Outpin m_outpin;
     Context m_ctx;
 
     HRESULT OnEndOfStream();
 
+    //Wakes up the inpins (other than the sender) that are waiting for
+    //another stream to catch up.
+    void NotifyInpins(const Inpin*);
+
 };
 
 }  //end WebmMux
@@ -0,0 +1,112 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "webmmuxframepool.h"
+#include <cassert>
+#include <new>
+
+namespace WebmMuxLib
+{
+
+FramePool::FramePool() :
+    m_cAlloc(0)
+{
+    for (int i = 0; i < kClassCount; ++i)
+        m_free[i] = 0;
+}
+
+
+FramePool::~FramePool()
+{
+    for (int i = 0; i < kClassCount; ++i)
+    {
+        Block* p = m_free[i];
+
+        while (p)
+        {
+            Block* const pNext = p->m_pNext;
+            ::operator delete(p);
+            p = pNext;
+        }
+    }
+}
+
+
+int FramePool::GetClass(ULONG size)
+{
+    //Returns the index of the smallest class that can hold a block
+    //of this size, or kClassCount if the block is too large to pool.
+
+    int k = 0;
+    ULONG cb = 1UL << kMinShift;
+
+    while (cb < size)
+    {
+        if (++k >= kClassCount)
+            return kClassCount;
+
+        cb <<= 1;
+    }
+
+    return k;
+}
+
+
+void* FramePool::Alloc(ULONG size)
+{
+    const int k = GetClass(size);
+
+    if (k >= kClassCount)
+    {
+        ++m_cAlloc;
+        return ::operator new(size, std::nothrow);
+    }
+
+    Block* const p = m_free[k];
+
+    if (p)
+    {
+        m_free[k] = p->m_pNext;
+        return p;
+    }
+
+    ++m_cAlloc;
+
+    const size_t cb = size_t(1) << (k + kMinShift);
+    return ::operator new(cb, std::nothrow);
+}
+
+
+void FramePool::Free(void* pv, ULONG size)
+{
+    if (pv == 0)
+        return;
+
+    const int k = GetClass(size);
+
+    if (k >= kClassCount)
+    {
+        ::operator delete(pv);
+        return;
+    }
+
+    Block* const p = static_cast<Block*>(pv);
+
+    p->m_pNext = m_free[k];
+    m_free[k] = p;
+}
+
+
+ULONG FramePool::GetAllocCount() const
+{
+    return m_cAlloc;
+}
+
+
+}  //end namespace WebmMuxLib
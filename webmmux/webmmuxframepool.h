@@ -0,0 +1,55 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+
+namespace WebmMuxLib
+{
+
+//Recycles the frame objects and payload buffers of a stream, so that
+//once the mux reaches a steady state no more memory is requested from
+//the heap.  Blocks are kept on free lists by size class (powers of 2);
+//a freed block is put back on the list of its class, and reused by the
+//next request of that class.  The pool is not thread-safe: frames are
+//created and released with the filter lock held.
+
+class FramePool
+{
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+public:
+    FramePool();
+    ~FramePool();
+
+    //Returns 0 if the heap is exhausted.
+    void* Alloc(ULONG size);
+
+    //The size must be the same as was passed to Alloc.
+    void Free(void*, ULONG size);
+
+    //Number of blocks obtained from the heap.
+    ULONG GetAllocCount() const;
+
+private:
+    enum { kMinShift = 5 };  //smallest class is 32 bytes
+    enum { kClassCount = 22 };  //largest class is 64 MB
+
+    struct Block
+    {
+        Block* m_pNext;
+    };
+
+    Block* m_free[kClassCount];
+    ULONG m_cAlloc;
+
+    static int GetClass(ULONG size);
+
+};
+
+}  //end namespace WebmMuxLib
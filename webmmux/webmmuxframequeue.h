@@ -0,0 +1,172 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <cassert>
+#include <vector>
+
+namespace WebmMuxLib
+{
+
+//A FIFO of frame pointers, stored in a ring buffer, with the subset
+//of the std::list interface used by the muxer.  The ring only grows
+//(doubling its capacity) when it is full, so once the queue has reached
+//its high water mark, pushing and popping frames does no allocation.
+//Iterators are invalidated by push_back and pop_front.
+
+template<typename T>
+class FrameQueue
+{
+    FrameQueue(const FrameQueue&);
+    FrameQueue& operator=(const FrameQueue&);
+
+public:
+    FrameQueue() :
+        m_head(0),
+        m_size(0),
+        m_cGrow(0)
+    {
+    }
+
+    bool empty() const
+    {
+        return (m_size == 0);
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    T front() const
+    {
+        assert(m_size > 0);
+        return m_ring[m_head];
+    }
+
+    T back() const
+    {
+        assert(m_size > 0);
+        return m_ring[Wrap(m_head + m_size - 1)];
+    }
+
+    void push_back(T t)
+    {
+        if (m_size >= m_ring.size())
+            Grow();
+
+        m_ring[Wrap(m_head + m_size)] = t;
+        ++m_size;
+    }
+
+    void pop_front()
+    {
+        assert(m_size > 0);
+
+        m_head = Wrap(m_head + 1);
+        --m_size;
+    }
+
+    class const_iterator
+    {
+    public:
+        const_iterator() : m_pQueue(0), m_index(0)
+        {
+        }
+
+        T operator*() const
+        {
+            assert(m_pQueue);
+            assert(m_index < m_pQueue->m_size);
+
+            return m_pQueue->m_ring[m_pQueue->Wrap(m_pQueue->m_head + m_index)];
+        }
+
+        const_iterator& operator++()
+        {
+            ++m_index;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const const_iterator result(*this);
+            ++m_index;
+            return result;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            assert(m_pQueue == rhs.m_pQueue);
+            return (m_index == rhs.m_index);
+        }
+
+        bool operator!=(const const_iterator& rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+    private:
+        friend class FrameQueue;
+
+        const_iterator(const FrameQueue* q, size_t i) : m_pQueue(q), m_index(i)
+        {
+        }
+
+        const FrameQueue* m_pQueue;
+        size_t m_index;  //relative to head
+    };
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, m_size);
+    }
+
+    //Number of times the ring had to be reallocated.
+    ULONG GetGrowCount() const
+    {
+        return m_cGrow;
+    }
+
+private:
+    enum { kInitialCapacity = 32 };  //must be a power of 2
+
+    std::vector<T> m_ring;  //size is always 0 or a power of 2
+    size_t m_head;
+    size_t m_size;
+    ULONG m_cGrow;
+
+    size_t Wrap(size_t i) const
+    {
+        return i & (m_ring.size() - 1);
+    }
+
+    void Grow()
+    {
+        const size_t n = m_ring.size();
+        const size_t cap = (n == 0) ? size_t(kInitialCapacity) : 2 * n;
+
+        std::vector<T> ring(cap);
+
+        for (size_t i = 0; i < m_size; ++i)
+            ring[i] = m_ring[Wrap(m_head + i)];
+
+        m_ring.swap(ring);
+        m_head = 0;
+
+        ++m_cGrow;
+    }
+
+};
+
+}  //end namespace WebmMuxLib
@@ -9,6 +9,7 @@
 #include "webmmuxfilter.h"
 #include "webmmuxstream.h"
 #include "graphutil.h"
+#include "webmtrace.h"
 #include <vfwmsgs.h>
 #include <cassert>
 #ifdef _DEBUG
@@ -421,18 +422,68 @@ HRESULT Inpin::Receive(IMediaSample* pSample)
     if (m_bFlush)
         return S_FALSE;
 
-    hr = m_pStream->Receive(pSample);
+    hr = ReceiveSample(pSample);
 
     if (hr != S_OK)
         return hr;
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifyInpins(this);  //wake up other pins
 
     return Wait(lock);
 }
 
 
+HRESULT Inpin::ReceiveSample(IMediaSample* pSample)
+{
+    //We hold the lock.
+
+    Context& ctx = m_pFilter->m_ctx;
+    webmdshow::PipelineCounters& counters = ctx.m_counters;
+
+    counters.OnSampleIn(pSample->GetActualDataLength());
+
+    webmdshow::TraceSample(
+        webmdshow::kTraceFrameMuxReceive,
+        m_pStream->GetTrackNumber(),
+        pSample);
+
+    HRESULT hr;
+
+    if (!IsStrippable(pSample))
+        hr = VFW_E_SAMPLE_REJECTED;
+    else
+    {
+        webmdshow::PipelineCounters::Timer timer(counters);
+        hr = m_pStream->Receive(pSample);
+    }
+
+    if (hr != S_OK)
+        counters.OnDrop();
+
+    counters.SetQueueDepth(static_cast<int>(ctx.GetQueueDepth()));
+
+    return hr;
+}
+
+
+bool Inpin::IsStrippable(IMediaSample* pSample) const
+{
+    if (m_pStream->GetStrippedSize() == 0)
+        return true;
+
+    BYTE* ptr;
+
+    const HRESULT hr = pSample->GetPointer(&ptr);
+
+    if (FAILED(hr) || (ptr == 0))
+        return false;
+
+    const long len = pSample->GetActualDataLength();
+
+    return (len >= 0) && m_pStream->IsStrippable(ptr, ULONG(len));
+}
+
+
 HRESULT Inpin::Wait(CLockable::Lock& lock)
 {
     //TODO:
@@ -466,10 +517,12 @@ HRESULT Inpin::Wait(CLockable::Lock& lock)
     //If we're paused, then write frame, and block caller.
     //If we transition from paused, then wake up and release caller.
 
-    const HANDLE hOther = GetOtherHandle();
+    //With more than one audio stream, we might be waiting on any of
+    //the other pins, so each pin signals every other pin's m_hSample
+    //event, and we only have to wait on our own.
 
     enum { cHandles = 2 };
-    HANDLE hh[cHandles] = { m_hStateChangeOrFlush, hOther };
+    HANDLE hh[cHandles] = { m_hStateChangeOrFlush, m_hSample };
 
 #ifdef DEBUG_WAIT
     wodbgstream os;
@@ -614,7 +667,7 @@ HRESULT Inpin::ReceiveMultiple(
         }
 #endif
 
-        const HRESULT hr = m_pStream->Receive(pSample);
+        const HRESULT hr = ReceiveSample(pSample);
 
         if (hr != S_OK)
         {
@@ -627,8 +680,7 @@ HRESULT Inpin::ReceiveMultiple(
         ++m;
     }
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifyInpins(this);  //wake up other pins
 
     return Wait(lock);
 }
@@ -664,8 +716,7 @@ HRESULT Inpin::OnEndOfStream()
        << endl;
 #endif
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifyInpins(this);  //wake up other pins
 
     if (result <= 0)
         return S_OK;
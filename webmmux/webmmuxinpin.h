@@ -88,6 +88,8 @@ public:
 
     HRESULT ResetPosition();
 
+    //Signalled when another pin receives a sample or EOS, or when the
+    //context's writer thread has written clusters.
     HANDLE m_hSample;
 
 protected:
@@ -100,6 +102,13 @@ private:
    bool m_bEndOfStream;
    bool m_bFlush;
 
+   //Passes the sample to the stream, counting it.
+   HRESULT ReceiveSample(IMediaSample*);
+
+   //Whether the frame begins with the header its block leaves out (see
+   //Context::SetVideoStrippedHeader).
+   bool IsStrippable(IMediaSample*) const;
+
 protected:
 
     Stream* m_pStream;
@@ -107,7 +116,6 @@ protected:
     virtual void OnFinal() = 0;
 
     HRESULT Wait(CLockable::Lock&);
-    virtual HANDLE GetOtherHandle() const = 0;
 
     HANDLE m_hStateChangeOrFlush;
 
@@ -17,8 +17,8 @@
 namespace WebmMuxLib
 {
 
-InpinAudio::InpinAudio(Filter* p) :
-    Inpin(p, L"audio")
+InpinAudio::InpinAudio(Filter* p, const wchar_t* id) :
+    Inpin(p, id)
 {
     CMediaTypes& mtv = m_preferred_mtv;
 
@@ -96,7 +96,7 @@ HRESULT InpinAudio::OnInit()
     else
         return E_FAIL;  //should never happen
 
-    ctx.SetAudioStream(pStream);  //TODO: accept multiple audio streams
+    ctx.AddAudioStream(pStream);
     m_pStream = pStream;
 
     return S_OK;
@@ -105,15 +105,11 @@ HRESULT InpinAudio::OnInit()
 
 void InpinAudio::OnFinal()
 {
-   Context& ctx = m_pFilter->m_ctx;
-   ctx.SetAudioStream(0);
-}
-
+   if (m_pStream == 0)  //not connected
+       return;
 
-HANDLE InpinAudio::GetOtherHandle() const
-{
-    const InpinVideo& iv = m_pFilter->m_inpin_video;
-    return iv.m_hSample;
+   Context& ctx = m_pFilter->m_ctx;
+   ctx.RemoveAudioStream(static_cast<StreamAudio*>(m_pStream));
 }
 
 
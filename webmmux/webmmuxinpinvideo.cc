@@ -208,11 +208,4 @@ void InpinVideo::OnFinal()
 }
 
 
-HANDLE InpinVideo::GetOtherHandle() const
-{
-    const InpinAudio& ia = m_pFilter->m_inpin_audio;
-    return ia.m_hSample;
-}
-
-
 } //end namespace WebmMuxLib
@@ -33,8 +33,6 @@ protected:
     HRESULT OnInit();
     void OnFinal();
 
-    HANDLE GetOtherHandle() const;
-
     HRESULT QueryAcceptVPx(const AM_MEDIA_TYPE&) const;
     HRESULT VetBitmapInfoHeader(const BITMAPINFOHEADER&) const;
     HRESULT GetAllocatorRequirementsVPx(ALLOCATOR_PROPERTIES&) const;
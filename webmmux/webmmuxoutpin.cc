@@ -256,36 +256,43 @@ HRESULT Outpin::QueryInternalConnections(IPin** pa, ULONG* pn)
     if (pn == 0)
         return E_POINTER;
 
+    Filter& f = *m_pFilter;
+    enum { n = 1 + Filter::kAudioInpins };
+
     if (*pn == 0)
     {
         if (pa == 0)  //query for required number
         {
-            *pn = 2;
+            *pn = n;
             return S_OK;
         }
 
         return S_FALSE;  //means "insufficient number of array elements"
     }
 
+    const ULONG cMax = *pn;
     *pn = 0;
 
     if (pa == 0)
         return E_POINTER;
 
-    if (*pn < 2)
+    if (cMax < n)
         return S_FALSE;  //means "insufficient number of array elements"
 
     IPin*& vpin = pa[0];
 
-    vpin = &m_pFilter->m_inpin_video;
+    vpin = &f.m_inpin_video;
     vpin->AddRef();
 
-    IPin*& apin = pa[1];
+    for (int i = 0; i < Filter::kAudioInpins; ++i)
+    {
+        IPin*& apin = pa[1 + i];
 
-    apin = &m_pFilter->m_inpin_audio;
-    apin->AddRef();
+        apin = f.m_inpin_audio[i];
+        apin->AddRef();
+    }
 
-    *pn = 2;
+    *pn = n;
     return S_OK;
 }
 
@@ -0,0 +1,318 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "webmmuxsegmentstream.h"
+#include <cassert>
+
+namespace WebmMuxLib
+{
+
+SegmentStream::SegmentStream() :
+    m_pSink(0),
+    m_pStream(0),
+    m_cSegments(0),
+    m_pos(0),
+    m_segment_pos(0),
+    m_segment_time(0)
+{
+}
+
+
+SegmentStream::~SegmentStream()
+{
+    SetSink(0);
+}
+
+
+void SegmentStream::SetSink(IWebmMuxSegmentSink* pSink)
+{
+    assert(m_pStream == 0);  //not while a mux is being written
+
+    if (pSink)
+        pSink->AddRef();
+
+    if (m_pSink)
+        m_pSink->Release();
+
+    m_pSink = pSink;
+    m_cSegments = 0;
+    m_pos = 0;
+}
+
+
+IWebmMuxSegmentSink* SegmentStream::GetSink() const
+{
+    return m_pSink;
+}
+
+
+HRESULT SegmentStream::StartSegment(LONGLONG t)
+{
+    if (m_pSink == 0)
+        return E_UNEXPECTED;
+
+    HRESULT hr = EndSegment(t);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The index goes up even if the sink fails, so that the segments
+    //that do get written keep their numbers.
+
+    const ULONG index = m_cSegments++;
+
+    m_segment_pos = m_pos;
+    m_segment_time = t;
+    m_clusters.clear();
+
+    IStream* pStream;
+
+    hr = m_pSink->GetSegmentStream(index, &pStream);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (pStream == 0)
+        return E_POINTER;
+
+    m_pStream = pStream;
+    return S_OK;
+}
+
+
+void SegmentStream::AddCluster(LONGLONG t)
+{
+    assert(m_cSegments > 1);  //not the initialization segment
+
+    const ULONGLONG off = static_cast<ULONGLONG>(m_pos - m_segment_pos);
+
+    const WebmMuxClusterEntry e = { off, t };
+    m_clusters.push_back(e);
+}
+
+
+HRESULT SegmentStream::EndSegment(LONGLONG t)
+{
+    if (m_pStream == 0)
+        return S_OK;
+
+    m_pStream->Release();
+    m_pStream = 0;
+
+    assert(m_cSegments > 0);
+    const ULONG index = m_cSegments - 1;
+
+    const ULONGLONG size = m_pos - m_segment_pos;
+
+    LONGLONG start = 0;
+    LONGLONG duration = 0;
+
+    if (index > 0)
+    {
+        start = m_segment_time;
+        duration = (t > start) ? (t - start) : 0;
+    }
+
+    const ULONG count = static_cast<ULONG>(m_clusters.size());
+    const WebmMuxClusterEntry* const pClusters =
+        m_clusters.empty() ? 0 : &m_clusters[0];
+
+    return m_pSink->OnSegmentComplete(
+            index,
+            size,
+            start,
+            duration,
+            count,
+            pClusters);
+}
+
+
+HRESULT SegmentStream::Close(LONGLONG t)
+{
+    const HRESULT hr = EndSegment(t);
+
+    m_cSegments = 0;
+    m_pos = 0;
+    m_clusters.clear();
+
+    return hr;
+}
+
+
+ULONG SegmentStream::GetSegmentCount() const
+{
+    return m_cSegments;
+}
+
+
+HRESULT SegmentStream::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IStream*>(this);
+
+    else if (iid == __uuidof(ISequentialStream))
+        pUnk = static_cast<ISequentialStream*>(this);
+
+    else if (iid == __uuidof(IStream))
+        pUnk = static_cast<IStream*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG SegmentStream::AddRef()
+{
+    return 1;
+}
+
+
+ULONG SegmentStream::Release()
+{
+    return 1;
+}
+
+
+HRESULT SegmentStream::Read(void*, ULONG, ULONG* pcbRead)
+{
+    if (pcbRead)
+        *pcbRead = 0;
+
+    return STG_E_ACCESSDENIED;  //write-only
+}
+
+
+HRESULT SegmentStream::Write(const void* pv, ULONG cb, ULONG* pcbWritten)
+{
+    if (pcbWritten)
+        *pcbWritten = 0;
+
+    if (m_pStream == 0)
+        return E_UNEXPECTED;
+
+    if (cb == 0)
+        return S_OK;
+
+    if (pv == 0)
+        return STG_E_INVALIDPOINTER;
+
+    ULONG cbWritten;
+
+    const HRESULT hr = m_pStream->Write(pv, cb, &cbWritten);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_pos += cbWritten;
+
+    if (pcbWritten)
+        *pcbWritten = cbWritten;
+
+    return (cbWritten == cb) ? S_OK : STG_E_MEDIUMFULL;
+}
+
+
+HRESULT SegmentStream::Seek(
+    LARGE_INTEGER move,
+    DWORD origin,
+    ULARGE_INTEGER* pPos)
+{
+    __int64 pos;
+
+    switch (origin)
+    {
+        case STREAM_SEEK_SET:
+            pos = move.QuadPart;
+            break;
+
+        case STREAM_SEEK_CUR:
+            pos = m_pos + move.QuadPart;
+            break;
+
+        default:
+            return STG_E_INVALIDFUNCTION;
+    }
+
+    if (pos != m_pos)  //bytes already written cannot be rewritten
+        return STG_E_INVALIDFUNCTION;
+
+    if (pPos)
+        pPos->QuadPart = m_pos;
+
+    return S_OK;
+}
+
+
+HRESULT SegmentStream::SetSize(ULARGE_INTEGER)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT SegmentStream::CopyTo(
+    IStream*,
+    ULARGE_INTEGER,
+    ULARGE_INTEGER*,
+    ULARGE_INTEGER*)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT SegmentStream::Commit(DWORD flags)
+{
+    if (m_pStream == 0)
+        return S_OK;
+
+    return m_pStream->Commit(flags);
+}
+
+
+HRESULT SegmentStream::Revert()
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT SegmentStream::LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT SegmentStream::UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD)
+{
+    return STG_E_INVALIDFUNCTION;
+}
+
+
+HRESULT SegmentStream::Stat(STATSTG*, DWORD)
+{
+    return E_NOTIMPL;
+}
+
+
+HRESULT SegmentStream::Clone(IStream**)
+{
+    return E_NOTIMPL;
+}
+
+
+}  //end namespace WebmMuxLib
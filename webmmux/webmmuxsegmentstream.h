@@ -0,0 +1,109 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objidl.h>
+#include <vector>
+#include "webmmuxidl.h"
+
+namespace WebmMuxLib
+{
+
+//An append-only stream that writes each segment of a DASH mux to a
+//stream of its own, supplied by an IWebmMuxSegmentSink, and collects the
+//index of each segment as it goes.  Positions run on from one segment to
+//the next, so to the muxer this is a single stream.  As with ChunkStream,
+//seeking is not supported (other than to query the current position).
+
+class SegmentStream : public IStream
+{
+    SegmentStream(const SegmentStream&);
+    SegmentStream& operator=(const SegmentStream&);
+
+public:
+
+    SegmentStream();
+    ~SegmentStream();
+
+    void SetSink(IWebmMuxSegmentSink*);
+    IWebmMuxSegmentSink* GetSink() const;
+
+    //Completes the segment being written, if any, and starts the next
+    //one, at time t (in milliseconds).  The first segment started is the
+    //initialization segment.  The muxer must flush its write buffer
+    //first, so that the bytes written so far go to the old segment.
+    HRESULT StartSegment(LONGLONG t);
+
+    //Adds a cluster beginning at the current position, at time t, to
+    //the index of the segment being written.
+    void AddCluster(LONGLONG t);
+
+    //Completes the last segment, whose duration runs to time t, and
+    //forgets the segments, for the next mux.
+    HRESULT Close(LONGLONG t);
+
+    //Number of segments started since the last Close.
+    ULONG GetSegmentCount() const;
+
+    //IUnknown (not reference-counted; owned by the Context)
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //ISequentialStream
+
+    HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*);
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*);
+
+    //IStream
+
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*);
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER);
+
+    HRESULT STDMETHODCALLTYPE CopyTo(
+        IStream*,
+        ULARGE_INTEGER,
+        ULARGE_INTEGER*,
+        ULARGE_INTEGER*);
+
+    HRESULT STDMETHODCALLTYPE Commit(DWORD);
+    HRESULT STDMETHODCALLTYPE Revert();
+
+    HRESULT STDMETHODCALLTYPE LockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE UnlockRegion(
+        ULARGE_INTEGER,
+        ULARGE_INTEGER,
+        DWORD);
+
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD);
+    HRESULT STDMETHODCALLTYPE Clone(IStream**);
+
+private:
+
+    HRESULT EndSegment(LONGLONG t);
+
+    IWebmMuxSegmentSink* m_pSink;
+    IStream* m_pStream;  //of the segment being written
+    ULONG m_cSegments;
+    __int64 m_pos;
+
+    //The segment being written.
+    __int64 m_segment_pos;
+    LONGLONG m_segment_time;
+
+    typedef std::vector<WebmMuxClusterEntry> clusters_t;
+    clusters_t m_clusters;
+
+};
+
+}  //end namespace WebmMuxLib
@@ -7,11 +7,13 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #include <strmif.h>
+#include "ebmlelement.h"
 #include "webmconstants.h"
 #include "webmmuxstream.h"
 #include "webmmuxcontext.h"
 #include <cassert>
 #include <climits>
+#include <cstring>
 
 
 namespace WebmMuxLib
@@ -63,6 +65,30 @@ int Stream::GetTrackNumber() const
 }
 
 
+ULONG Stream::GetAllocCount() const
+{
+    return m_pool.GetAllocCount();
+}
+
+
+ULONG Stream::GetStrippedSize() const
+{
+    return static_cast<ULONG>(m_stripped.size());
+}
+
+
+bool Stream::IsStrippable(const BYTE* data, ULONG size) const
+{
+    if (m_stripped.empty())
+        return true;
+
+    if (size < m_stripped.size())
+        return false;
+
+    return (memcmp(data, &m_stripped[0], m_stripped.size()) == 0);
+}
+
+
 void Stream::WriteTrackEntry(int tn)
 {
     WebmUtil::EbmlScratchBuf& entry_buf = m_context.m_buf;
@@ -93,6 +119,7 @@ void Stream::WriteTrackEntry(int tn)
     WriteTrackCodecPrivate();
     WriteTrackCodecName();
     WriteTrackSettings();
+    WriteTrackContentEncodings();
 
     const uint64 entry_len = entry_buf.GetBufferLength() - num_bytes_to_ignore;
     entry_buf.RewriteUInt(entry_len_offset, entry_len, sizeof(uint16));
@@ -142,6 +169,106 @@ void Stream::WriteTrackSettings()
 }
 
 
+void Stream::WriteTrackContentEncodings()
+{
+}
+
+
+static void WriteUIntElement2(
+    WebmUtil::EbmlScratchBuf& buf,
+    uint16 id,
+    uint8 val)
+{
+    buf.WriteID2(id);
+    buf.Write1UInt(1);
+    buf.Serialize1UInt(val);
+}
+
+
+void Stream::WriteContentEncodings(bool encrypted)
+{
+    //The frames are stripped first, and then encrypted, so the stripping
+    //has order 0, and the splitter undoes the encryption first.  The
+    //elements are small enough for sizes of 1 byte, except for those of
+    //ContentEncodings and ContentEncoding, which get 2 bytes.
+
+    if (m_stripped.empty() && !encrypted)
+        return;
+
+    using namespace WebmUtil;
+    EbmlScratchBuf& buf = m_context.m_buf;
+
+    const std::string& key_id = m_context.GetEncryptionKeyId();
+    assert(key_id.size() <= Context::kMaxKeyIdSize);
+    assert(m_stripped.size() <= Context::kMaxStrippedHeaderSize);
+
+    const uint8 header_len = static_cast<uint8>(m_stripped.size());
+    const uint8 compression_len = 4 + (3 + header_len);  //algo, settings
+    const uint16 strip_len = 4 + 4 + 4 + (3 + compression_len);
+
+    const uint8 id_len = static_cast<uint8>(key_id.size());
+    const uint8 aes_len = 4;  //cipher mode
+    const uint8 encryption_len = 4 + (3 + id_len) + (3 + aes_len);
+    const uint16 encrypt_len = 4 + 4 + 4 + (3 + encryption_len);
+
+    uint16 encodings_len = 0;
+
+    if (!m_stripped.empty())
+        encodings_len += 4 + strip_len;
+
+    if (encrypted)
+        encodings_len += 4 + encrypt_len;
+
+    buf.WriteID2(kEbmlContentEncodingsID);
+    buf.Write2UInt(encodings_len);
+
+    uint8 order = 0;
+
+    if (!m_stripped.empty())
+    {
+        buf.WriteID2(kEbmlContentEncodingID);
+        buf.Write2UInt(strip_len);
+
+        WriteUIntElement2(buf, kEbmlContentEncodingOrderID, order++);
+        WriteUIntElement2(buf, kEbmlContentEncodingScopeID, 1);  //frames
+        WriteUIntElement2(buf, kEbmlContentEncodingTypeID, 0);  //compression
+
+        buf.WriteID2(kEbmlContentCompressionID);
+        buf.Write1UInt(compression_len);
+
+        WriteUIntElement2(buf, kEbmlContentCompAlgoID, 3);  //header stripping
+
+        buf.WriteID2(kEbmlContentCompSettingsID);
+        buf.Write1UInt(header_len);
+        buf.Write(&m_stripped[0], header_len);
+    }
+
+    if (encrypted)
+    {
+        buf.WriteID2(kEbmlContentEncodingID);
+        buf.Write2UInt(encrypt_len);
+
+        WriteUIntElement2(buf, kEbmlContentEncodingOrderID, order++);
+        WriteUIntElement2(buf, kEbmlContentEncodingScopeID, 1);  //frames
+        WriteUIntElement2(buf, kEbmlContentEncodingTypeID, 1);  //encryption
+
+        buf.WriteID2(kEbmlContentEncryptionID);
+        buf.Write1UInt(encryption_len);
+
+        WriteUIntElement2(buf, kEbmlContentEncAlgoID, 5);  //AES
+
+        buf.WriteID2(kEbmlContentEncKeyIDID);
+        buf.Write1UInt(id_len);
+        buf.Write(reinterpret_cast<const uint8*>(key_id.data()), id_len);
+
+        buf.WriteID2(kEbmlContentEncAESSettingsID);
+        buf.Write1UInt(aes_len);
+
+        WriteUIntElement2(buf, kEbmlAESSettingsCipherModeID, 1);  //CTR
+    }
+}
+
+
 Stream::TrackUID_t Stream::CreateTrackUID()
 {
     TrackUID_t result;
@@ -192,9 +319,21 @@ int Stream::Frame::GetLacing() const
 }
 
 
-ULONG Stream::Frame::GetBlockSize() const
+int Stream::Frame::GetTemporalLayer() const
 {
-    const ULONG result = 1 + 2 + 1 + GetSize();  //tn, tc, flg, f
+    return -1;
+}
+
+
+bool Stream::Frame::IsInvisible() const
+{
+    return false;
+}
+
+
+ULONG Stream::Frame::GetBlockSize(ULONG payload_size)
+{
+    const ULONG result = 1 + 2 + 1 + payload_size;  //tn, tc, flg, f
     return result;
 }
 
@@ -202,7 +341,20 @@ void Stream::Frame::WriteSimpleBlock(
     const Stream& s,
     ULONG cluster_tc) const
 {
-    WriteBlock(s, cluster_tc, true, GetBlockSize());  //SimpleBlock
+    const ULONG h = s.GetStrippedSize();
+    assert(s.IsStrippable(GetData(), GetSize()));
+
+    WriteSimpleBlock(s, cluster_tc, GetData() + h, GetSize() - h);
+}
+
+void Stream::Frame::WriteSimpleBlock(
+    const Stream& s,
+    ULONG cluster_tc,
+    const BYTE* payload,
+    ULONG payload_size) const
+{
+    const ULONG block_size = GetBlockSize(payload_size);
+    WriteBlock(s, cluster_tc, true, block_size, payload, payload_size);
 }
 
 void Stream::Frame::WriteBlockGroup(
@@ -211,9 +363,47 @@ void Stream::Frame::WriteBlockGroup(
     LONG prev_tc,
     ULONG duration) const
 {
+    const ULONG h = s.GetStrippedSize();
+    assert(s.IsStrippable(GetData(), GetSize()));
+
+    WriteBlockGroup(
+        s,
+        cluster_tc,
+        prev_tc,
+        duration,
+        -1,
+        GetData() + h,
+        GetSize() - h);
+}
+
+void Stream::Frame::WriteBlockGroup(
+    const Stream& s,
+    ULONG cluster_tc,
+    LONG prev_tc,
+    ULONG duration,
+    int layer,
+    const BYTE* payload,
+    ULONG payload_size) const
+{
+    using WebmUtil::EbmlHeaderSize;
+
     EbmlIO::File& file = s.m_context.m_file;
 
-    const ULONG block_size = GetBlockSize();
+    //BlockAdditions holds one BlockMore, of a BlockAddID and a one-byte
+    //BlockAdditional.
+
+    typedef EbmlHeaderSize<WebmUtil::kEbmlBlockAddIDID, 1> add_id_t;
+    typedef EbmlHeaderSize<WebmUtil::kEbmlBlockAdditionalID, 1> add_t;
+
+    enum { kMoreSize = add_id_t::value + add_t::value };
+
+    typedef EbmlHeaderSize<WebmUtil::kEbmlBlockMoreID, kMoreSize> more_t;
+
+    typedef EbmlHeaderSize<
+                WebmUtil::kEbmlBlockAdditionsID,
+                more_t::value> additions_t;
+
+    const ULONG block_size = GetBlockSize(payload_size);
     ULONG block_group_size = 5 + block_size;
 
     const bool bKey = IsKey();
@@ -224,6 +414,9 @@ void Stream::Frame::WriteBlockGroup(
     if (duration > 0)
         block_group_size += 1 + 1 + 4;
 
+    if (layer >= 0)
+        block_group_size += additions_t::value;
+
     //begin block group
 
     file.WriteID1(WebmUtil::kEbmlBlockGroupID);
@@ -233,7 +426,13 @@ void Stream::Frame::WriteBlockGroup(
     const __int64 pos = file.GetPosition();
 #endif
 
-    WriteBlock(s, cluster_tc, false, block_size);
+    WriteBlock(s, cluster_tc, false, block_size, payload, payload_size);
+
+    //The elements that follow the block have fixed IDs and sizes, and
+    //are written together.
+
+    BYTE buf[(1 + 1 + 2) + (1 + 1 + 4) + additions_t::value];
+    BYTE* p = buf;
 
     if (!bKey)
     {
@@ -246,20 +445,43 @@ void Stream::Frame::WriteBlockGroup(
         assert(tc < 0);
         assert(tc >= SHRT_MIN);
 
-        const SHORT val = static_cast<SHORT>(tc);
+        const USHORT val = static_cast<USHORT>(tc);  //two's complement
 
-        file.WriteID1(WebmUtil::kEbmlReferenceBlockID);
-        file.Write1UInt(2);
-        file.Serialize2SInt(val);
+        p = WebmUtil::EbmlWriteUIntElement<
+                WebmUtil::kEbmlReferenceBlockID, 2>(p, val);
     }
 
     if (duration > 0)
     {
-        file.WriteID1(WebmUtil::kEbmlBlockDurationID);
-        file.Write1UInt(4);  //TODO: use min size
-        file.Serialize4UInt(duration);
+        //TODO: use min size
+        p = WebmUtil::EbmlWriteUIntElement<
+                WebmUtil::kEbmlBlockDurationID, 4>(p, duration);
     }
 
+    if (layer >= 0)
+    {
+        assert(layer <= 255);
+
+        p = WebmUtil::EbmlWriteHeader<
+                WebmUtil::kEbmlBlockAdditionsID, more_t::value>(p);
+
+        p = WebmUtil::EbmlWriteHeader<
+                WebmUtil::kEbmlBlockMoreID, kMoreSize>(p);
+
+        p = WebmUtil::EbmlWriteUIntElement<
+                WebmUtil::kEbmlBlockAddIDID, 1>(
+                    p,
+                    WebmUtil::kWebmTemporalLayerBlockAddID);
+
+        p = WebmUtil::EbmlWriteHeader<
+                WebmUtil::kEbmlBlockAdditionalID, 1>(p);
+
+        *p++ = static_cast<BYTE>(layer);
+    }
+
+    if (p != buf)
+        file.Write(buf, static_cast<ULONG>(p - buf));
+
     //end block group
 
 #ifdef _DEBUG
@@ -273,28 +495,37 @@ void Stream::Frame::WriteBlock(
     const Stream& s,
     ULONG cluster_timecode,
     bool simple_block,
-    ULONG block_size) const
+    ULONG block_size,
+    const BYTE* payload,
+    ULONG payload_size) const
 {
     EbmlIO::File& file = s.m_context.m_file;
 
-    //begin block
-
-    const BYTE id = simple_block ? 0xA3 : 0xA1;  //SimpleBlock vs. Block
+    //The header is assembled here, and written with the frame in one
+    //call, instead of a byte at a time through the stream.
 
-    file.WriteID1(id);
-    file.WriteUInt(block_size);
+    BYTE hdr[1 + 8 + 1 + 2 + 1];  //id, size, tn, tc, flg
+    BYTE* p = hdr;
 
 #ifdef _DEBUG
     const __int64 pos = file.GetPosition();
 #endif
 
+    //begin block
+
+    if (simple_block)
+        p = WebmUtil::EbmlWriteID<WebmUtil::kEbmlSimpleBlockID>(p);
+    else
+        p = WebmUtil::EbmlWriteID<WebmUtil::kEbmlBlockID>(p);
+
+    const ULONG size_len = EbmlIO::EncodeUInt(p, block_size);
+    p += size_len;
+
     const int tn_ = s.GetTrackNumber();
     assert(tn_ > 0);
     assert(tn_ <= 255);
 
-    const BYTE tn = static_cast<BYTE>(tn_);
-
-    file.Write1UInt(tn);   //track number
+    *p++ = static_cast<BYTE>(tn_ | 0x80);  //track number
 
     {
         const ULONG ft = GetTimecode();
@@ -304,9 +535,10 @@ void Stream::Frame::WriteBlock(
         assert(tc_ >= SHRT_MIN);
         assert(tc_ <= SHRT_MAX);
 
-        const SHORT tc = static_cast<SHORT>(tc_);
+        const USHORT tc = static_cast<USHORT>(tc_);
 
-        file.Serialize2SInt(tc);       //relative timecode
+        *p++ = static_cast<BYTE>(tc >> 8);  //relative timecode
+        *p++ = static_cast<BYTE>(tc);
     }
 
     BYTE flags = 0;
@@ -314,6 +546,9 @@ void Stream::Frame::WriteBlock(
     if (simple_block & IsKey())
         flags |= BYTE(1 << 7);
 
+    if (IsInvisible())
+        flags |= BYTE(1 << 3);
+
     const int lacing = GetLacing();
     assert(lacing >= 0);
     assert(lacing <= 3);
@@ -321,15 +556,18 @@ void Stream::Frame::WriteBlock(
     const BYTE fLacing = static_cast<BYTE>(lacing << 1);
     flags |= fLacing;
 
-    file.Write(&flags, 1);   //written as binary, not uint
+    *p++ = flags;  //written as binary, not uint
+
+    const ULONG hdr_len = static_cast<ULONG>(p - hdr);
+    assert((hdr_len + payload_size) == (1 + size_len + block_size));
 
-    file.Write(GetData(), GetSize());  //frame
+    file.WriteGather(hdr, hdr_len, payload, payload_size);  //frame
 
     //end block
 
 #ifdef _DEBUG
     const __int64 newpos = file.GetPosition();
-    assert((newpos - pos) == block_size);
+    assert((newpos - pos) == (1 + size_len + block_size));
 #endif
 }
 
@@ -7,6 +7,8 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #pragma once
+#include "webmmuxframepool.h"
+#include <vector>
 
 namespace WebmMuxLib
 {
@@ -32,6 +34,17 @@ public:
     void SetTrackNumber(int);
     int GetTrackNumber() const;
 
+    //Number of heap allocations made for this stream's frames and
+    //frame queues.
+    virtual ULONG GetAllocCount() const;
+
+    //Header stripping (see Context::SetVideoStrippedHeader): the bytes
+    //that begin every frame of the track, which its blocks leave out, as
+    //set when the track was written.  A frame that doesn't begin with
+    //them can't be written.
+    ULONG GetStrippedSize() const;
+    bool IsStrippable(const BYTE*, ULONG) const;
+
     class Frame
     {
         Frame(const Frame&);
@@ -46,9 +59,11 @@ public:
             const Stream&,
             ULONG cluster_timecode,
             bool simple_block,
-            ULONG block_size) const;
+            ULONG block_size,
+            const BYTE* payload,
+            ULONG payload_size) const;
 
-        ULONG GetBlockSize() const;
+        static ULONG GetBlockSize(ULONG payload_size);
 
     public:
         virtual bool IsKey() const = 0;
@@ -57,12 +72,39 @@ public:
                     const Stream&,
                     ULONG cluster_timecode) const;
 
+        //As above, but the block carries payload (the frame encrypted,
+        //say) instead of the data of the frame.
+        void WriteSimpleBlock(
+                    const Stream&,
+                    ULONG cluster_timecode,
+                    const BYTE* payload,
+                    ULONG payload_size) const;
+
         void WriteBlockGroup(
                     const Stream&,
                     ULONG cluster_timecode,
                     LONG prev_timecode,
                     ULONG duration) const;
 
+        //As above, but the block carries payload, and when layer is 0 or
+        //more the group records it in its BlockAdditions, so that a relay
+        //can drop the upper temporal layers by filtering blocks.
+        void WriteBlockGroup(
+                    const Stream&,
+                    ULONG cluster_timecode,
+                    LONG prev_timecode,
+                    ULONG duration,
+                    int layer,
+                    const BYTE* payload,
+                    ULONG payload_size) const;
+
+        //The temporal layer of the frame, or -1 when its stream has none.
+        virtual int GetTemporalLayer() const;
+
+        //Whether the frame is decoded but never shown (a VP8 altref).
+        //Its block carries the invisible flag.
+        virtual bool IsInvisible() const;
+
         virtual ULONG GetTimecode() const = 0;
         virtual ULONG GetDuration() const = 0;  //TimecodeScale units
 
@@ -84,6 +126,16 @@ protected:
 
     int m_trackNumber;
 
+    //Memory for the stream's frames.  It is declared in the base class,
+    //so that it outlives the frame queues of the derived classes.
+    FramePool m_pool;
+
+    std::vector<BYTE> m_stripped;  //the header the blocks leave out
+
+    //Writes the ContentEncodings of the track, for m_stripped and for
+    //encryption with the key of the context, or nothing if neither.
+    void WriteContentEncodings(bool encrypted);
+
     virtual void WriteTrackNumber(int);
     virtual void WriteTrackUID();
     virtual void WriteTrackType() = 0;
@@ -92,6 +144,7 @@ protected:
     virtual void WriteTrackCodecPrivate();
     virtual void WriteTrackCodecName() = 0;
     virtual void WriteTrackSettings();
+    virtual void WriteTrackContentEncodings();
 
 };
 
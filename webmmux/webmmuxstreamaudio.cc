@@ -45,7 +45,7 @@ StreamAudio::~StreamAudio()
 
 bool StreamAudio::Wait() const
 {
-    return m_context.WaitAudio();
+    return m_context.WaitAudio(this);
 }
 
 
@@ -66,6 +66,23 @@ void StreamAudio::WriteTrackType()
 }
 
 
+void StreamAudio::WriteTrackContentEncodings()
+{
+    if (IsLaced())
+        m_stripped.clear();
+    else
+        m_stripped = m_context.GetAudioStrippedHeader();
+
+    WriteContentEncodings(false);
+}
+
+
+bool StreamAudio::IsLaced() const
+{
+    return false;
+}
+
+
 void StreamAudio::WriteTrackSettings()
 {
     WebmUtil::EbmlScratchBuf& buf = m_context.m_buf;
@@ -182,6 +199,13 @@ StreamAudio::frames_t& StreamAudio::GetFrames()
     return m_frames;
 }
 
+
+ULONG StreamAudio::GetAllocCount() const
+{
+    return Stream::GetAllocCount() + m_frames.GetGrowCount();
+}
+
+
 void StreamAudio::Flush()
 {
     m_context.FlushAudio(this);
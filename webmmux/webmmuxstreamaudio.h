@@ -8,7 +8,7 @@
 
 #pragma once
 #include "webmmuxstream.h"
-#include <list>
+#include "webmmuxframequeue.h"
 
 namespace WebmMuxLib
 {
@@ -26,6 +26,10 @@ protected:
 
     void WriteTrackType();
     void WriteTrackSettings();
+    void WriteTrackContentEncodings();
+
+    //Whether the blocks lace frames, whose headers can't be stripped.
+    virtual bool IsLaced() const;
 
     const void* GetFormat(ULONG&) const;
 
@@ -49,9 +53,11 @@ public:
 
     };
 
-    typedef std::list<AudioFrame*> frames_t;
+    typedef FrameQueue<AudioFrame*> frames_t;
     frames_t& GetFrames();
 
+    ULONG GetAllocCount() const;
+
 private:
     void* const m_pFormat;
     const ULONG m_cFormat;
@@ -15,6 +15,7 @@
 #include <cassert>
 #include <uuids.h>
 #include <vfwmsgs.h>
+#include <new>
 #if 0 //def _DEBUG
 #include <odbgstream.h>
 #include <iomanip>
@@ -180,7 +181,8 @@ StreamAudioVorbis::VorbisFrame::VorbisFrame(
 #else
 StreamAudioVorbis::VorbisFrame::VorbisFrame(
     IMediaSample* pSample,
-    StreamAudioVorbis* pStream)
+    StreamAudioVorbis* pStream) :
+    m_pool(pStream->m_pool)
 {
     __int64 st, sp;  //reftime units
 
@@ -220,7 +222,7 @@ StreamAudioVorbis::VorbisFrame::VorbisFrame(
     assert(SUCCEEDED(hr));
     assert(ptr);
 
-    m_data = new (std::nothrow) BYTE[m_size];
+    m_data = static_cast<BYTE*>(m_pool.Alloc(m_size));
     assert(m_data);  //TODO
 
     memcpy(m_data, ptr, m_size);
@@ -241,11 +243,20 @@ StreamAudioVorbis::VorbisFrame::~VorbisFrame()
     const ULONG n = m_pSample->Release();
     n;
 #else
-    delete[] m_data;
+    m_pool.Free(m_data, m_size);
 #endif
 }
 
 
+void StreamAudioVorbis::VorbisFrame::Release()
+{
+    FramePool& pool = m_pool;
+
+    this->~VorbisFrame();
+    pool.Free(this, sizeof(VorbisFrame));
+}
+
+
 const VorbisTypes::VORBISFORMAT2&
 StreamAudioVorbis::GetFormat() const
 {
@@ -270,6 +281,12 @@ int StreamAudioVorbis::VorbisFrame::GetLacing() const
 }
 
 
+bool StreamAudioVorbis::IsLaced() const
+{
+    return (m_subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing);
+}
+
+
 ULONG StreamAudioVorbis::GetSamplesPerSec() const
 {
     const VorbisTypes::VORBISFORMAT2& fmt = GetFormat();
@@ -436,8 +453,12 @@ HRESULT StreamAudioVorbis::Receive(IMediaSample* pSample)
     if (file.GetStream() == 0)
         return S_OK;
 
-    VorbisFrame* const pFrame = new (std::nothrow) VorbisFrame(pSample, this);
-    assert(pFrame);  //TODO
+    void* const pv = m_pool.Alloc(sizeof(VorbisFrame));
+
+    if (pv == 0)
+        return E_OUTOFMEMORY;
+
+    VorbisFrame* const pFrame = new (pv) VorbisFrame(pSample, this);
 
     m_context.NotifyAudioFrame(this, pFrame);
 
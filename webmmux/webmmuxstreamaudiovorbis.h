@@ -34,6 +34,8 @@ protected:
     void WriteTrackCodecName();
     void WriteTrackCodecPrivate();
 
+    bool IsLaced() const;
+
 public:
     static void GetMediaTypes(CMediaTypes&);
     static bool QueryAccept(const AM_MEDIA_TYPE&);
@@ -58,6 +60,7 @@ private:
         VorbisFrame(const VorbisFrame&);
 
     private:
+        FramePool& m_pool;
         ULONG m_timecode;
         ULONG m_duration;
         BYTE* m_data;
@@ -77,6 +80,8 @@ private:
         ULONG GetSize() const;
         const BYTE* GetData() const;
 
+        void Release();  //back to the stream's pool
+
     };
 
 };
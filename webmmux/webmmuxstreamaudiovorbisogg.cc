@@ -11,6 +11,7 @@
 #include <vfwmsgs.h>
 
 #include <cassert>
+#include <new>
 
 #include "cmediatypes.h"
 #include "vorbistypes.h"
@@ -165,68 +166,47 @@ StreamAudioVorbisOgg::VorbisFrame::~VorbisFrame()
 }
 #else
 StreamAudioVorbisOgg::VorbisFrame::VorbisFrame(
-    IMediaSample* pSample,
-    StreamAudioVorbisOgg* pStream)
+    FramePool& pool,
+    ULONG timecode,
+    ULONG duration,
+    BYTE* buf,
+    ULONG buf_size,
+    const BYTE* data,
+    ULONG size,
+    int lacing) :
+    m_pool(pool),
+    m_timecode(timecode),
+    m_duration(duration),
+    m_buf(buf),
+    m_buf_size(buf_size),
+    m_data(data),
+    m_size(size),
+    m_lacing(lacing)
 {
-    __int64 st, sp;  //this is actually samples, not reftime
-
-    HRESULT hr = pSample->GetTime(&st, &sp);
-    assert(SUCCEEDED(hr));
-    assert(st >= 0);
-
-    double samples = double(st);
-
-    const ULONG samples_per_sec_ = pStream->GetSamplesPerSec();
-    assert(samples_per_sec_ > 0);
-
-    const double samples_per_sec = double(samples_per_sec_);
-
-    //secs [=] samples / samples/sec
-    double secs = samples / samples_per_sec;
-
-    double ns = secs * 1000000000.0;
-
-    const Context& ctx = pStream->m_context;
-    const ULONG scale = ctx.GetTimecodeScale();
-    assert(scale >= 1);
-
-    double tc = ns / scale;
-    assert(tc <= ULONG_MAX);
-
-    m_timecode = static_cast<ULONG>(tc);
-
-    if ((hr == VFW_S_NO_STOP_TIME) || (sp <= st))
-        m_duration = 0;
-    else
-    {
-        samples = double(sp - st);
-        secs = samples / samples_per_sec;
-        ns = secs * 1000000000.0;
-        tc = ns / scale;
-        m_duration = static_cast<ULONG>(tc);
-    }
-
-    const long size = pSample->GetActualDataLength();
-    assert(size > 0);
+    assert(m_buf);
+    assert(m_data >= m_buf);
+    assert((m_data + m_size) <= (m_buf + m_buf_size));
+}
 
-    m_size = size;
 
-    BYTE* ptr;
+StreamAudioVorbisOgg::VorbisFrame::~VorbisFrame()
+{
+    m_pool.Free(m_buf, m_buf_size);
+}
 
-    hr = pSample->GetPointer(&ptr);
-    assert(SUCCEEDED(hr));
-    assert(ptr);
 
-    m_data = new (std::nothrow) BYTE[m_size];
-    assert(m_data);  //TODO
+void StreamAudioVorbisOgg::VorbisFrame::Release()
+{
+    FramePool& pool = m_pool;
 
-    memcpy(m_data, ptr, m_size);
+    this->~VorbisFrame();
+    pool.Free(this, sizeof(VorbisFrame));
 }
 
 
-StreamAudioVorbisOgg::VorbisFrame::~VorbisFrame()
+int StreamAudioVorbisOgg::VorbisFrame::GetLacing() const
 {
-    delete[] m_data;
+    return m_lacing;
 }
 #endif
 
@@ -249,6 +229,12 @@ StreamAudioVorbisOgg::GetFormat() const
 }
 
 
+bool StreamAudioVorbisOgg::IsLaced() const
+{
+    return true;
+}
+
+
 ULONG StreamAudioVorbisOgg::GetSamplesPerSec() const
 {
     const VorbisTypes::VORBISFORMAT& fmt = GetFormat();
@@ -313,10 +299,45 @@ StreamAudioVorbisOgg::StreamAudioVorbisOgg(
     Context& ctx,
     const BYTE* pb,
     ULONG cb) :
-    StreamAudio(ctx, pb, cb)
+    StreamAudio(ctx, pb, cb),
+    m_lace(0),
+    m_lace_size(0),
+    m_lace_count(0),
+    m_lace_start(0),
+    m_lace_stop(0),
+    m_ident_len(0),
+    m_comment_len(0),
+    m_setup_len(0),
+    m_codec_private_data_pos(0)
+{
+}
+
+
+StreamAudioVorbisOgg::~StreamAudioVorbisOgg()
 {
+    if (m_lace)  //the stream ended without delivering it
+        m_pool.Free(m_lace, kLaceBufferSize);
 }
 
+
+ULONG StreamAudioVorbisOgg::GetTimecode(__int64 samples) const
+{
+    const double samples_per_sec = double(GetSamplesPerSec());
+
+    //secs [=] samples / samples/sec
+    const double secs = double(samples) / samples_per_sec;
+    const double ns = secs * 1000000000.0;
+
+    const ULONG scale = m_context.GetTimecodeScale();
+    assert(scale >= 1);
+
+    const double tc = ns / scale;
+    assert(tc <= ULONG_MAX);
+
+    return static_cast<ULONG>(tc);
+}
+
+
 void StreamAudioVorbisOgg::WriteTrackCodecID()
 {
     WebmUtil::EbmlScratchBuf& buf = m_context.m_buf;
@@ -351,21 +372,61 @@ void StreamAudioVorbisOgg::WriteTrackCodecPrivate()
 }
 
 
+HRESULT StreamAudioVorbisOgg::WriteHeader(
+    const BYTE* data,
+    ULONG size,
+    ULONG& len)
+{
+    assert(len == 0);
+
+    if (m_context.m_file.GetStream() == 0)
+    {
+        len = size;  //there is no CodecPrivate to write to
+        return S_OK;
+    }
+
+    //The CodecPrivate element begins with its 2-byte ID and 4-byte size,
+    //the header count and the lengths of the ident and comment headers,
+    //followed by the headers, in the order they are received.
+
+    const ULONG offset = 2 + 4 + 1 + 1 + 1 + m_ident_len + m_comment_len;
+    const ULONG total = offset + size;
+
+    //The reserved space must be filled exactly, or leave room for a Void
+    //element of at least 4 bytes.
+
+    if ((total != kPRIVATE_DATA_BYTES_RESERVED) &&
+        ((total + 4) > kPRIVATE_DATA_BYTES_RESERVED))
+    {
+        return VFW_E_BUFFER_OVERFLOW;
+    }
+
+    WebmUtil::EbmlScratchBuf& buf = m_context.m_buf;
+
+    const uint64 pos = m_codec_private_data_pos + offset;
+    buf.Rewrite(pos, data, static_cast<int32>(size));
+
+    len = size;
+    return S_OK;
+}
+
+
 HRESULT StreamAudioVorbisOgg::FinalizeTrackCodecPrivate()
 {
-    if (m_ident.empty() || m_comment.empty() || m_setup.empty())
+    //The headers themselves are already in place (see WriteHeader).
+    //What remains is the element's ID and size, the lengths of the
+    //headers, and a Void element over the rest of the reserved space.
+
+    if ((m_ident_len == 0) || (m_comment_len == 0) || (m_setup_len == 0))
         return S_OK;
 
-    const uint32 ident_len = static_cast<const uint32>(m_ident.size());
-    assert(ident_len > 0);
+    const uint32 ident_len = m_ident_len;
     assert(ident_len <= 255);
 
-    const uint32 comment_len = static_cast<const uint32>(m_comment.size());
-    assert(comment_len > 0);
+    const uint32 comment_len = m_comment_len;
     assert(comment_len <= 255);
 
-    const uint32 setup_len = static_cast<const uint32>(m_setup.size());
-    assert(setup_len > 0);
+    const uint32 setup_len = m_setup_len;
 
     const uint32 hdr_len = ident_len + comment_len + setup_len;
 
@@ -394,14 +455,8 @@ HRESULT StreamAudioVorbisOgg::FinalizeTrackCodecPrivate()
     val = static_cast<uint8>(comment_len);
     rewrite_offset += buf.Rewrite(rewrite_offset, &val, sizeof(uint8));
 
-    // write ident data
-    rewrite_offset += buf.Rewrite(rewrite_offset, &m_ident[0], ident_len);
-
-    // write comment data
-    rewrite_offset += buf.Rewrite(rewrite_offset, &m_comment[0], comment_len);
-
-    // write vorbis decoder setup data
-    rewrite_offset += buf.Rewrite(rewrite_offset, &m_setup[0], setup_len);
+    // the ident, comment and setup headers follow
+    rewrite_offset += hdr_len;
 
     // Fill any remaining reserved space with a proper EBML Void element
     const uint64 private_len = rewrite_offset - m_codec_private_data_pos;
@@ -420,12 +475,10 @@ HRESULT StreamAudioVorbisOgg::FinalizeTrackCodecPrivate()
                                         sizeof(uint8));
         rewrite_offset += buf.RewriteUInt(rewrite_offset, void_len,
                                           sizeof(uint16));
-        const uint8 fill_val = 0;
-        for (int i = 0; i < void_len; ++i)
-        {
-            rewrite_offset += buf.Rewrite(rewrite_offset, &fill_val,
-                                          sizeof(uint8));
-        }
+
+        // The contents of the Void element are still the zeros that
+        // WriteTrackCodecPrivate filled the reserved space with.
+        rewrite_offset += void_len;
 
         const uint64 private_end =
             kPRIVATE_DATA_BYTES_RESERVED + m_codec_private_data_pos;
@@ -462,34 +515,34 @@ HRESULT StreamAudioVorbisOgg::Receive(IMediaSample* pSample)
     if (len == 0)
         return S_OK;  //?
 
-    BYTE* const buf_end = buf + len;
-
-    if (m_ident.empty())
+    if (m_ident_len == 0)
     {
         assert(len >= 7);
         assert(buf[0] == 1);
         assert(memcmp(buf + 1, "vorbis", 6) == 0);
-        m_ident.assign(buf, buf_end);
 
-        return S_OK;
+        return WriteHeader(buf, len, m_ident_len);
     }
 
-    if (m_comment.empty())
+    if (m_comment_len == 0)
     {
         assert(len >= 7);
         assert(buf[0] == 3);
         assert(memcmp(buf + 1, "vorbis", 6) == 0);
-        m_comment.assign(buf, buf_end);
 
-        return S_OK;
+        return WriteHeader(buf, len, m_comment_len);
     }
 
-    if (m_setup.empty())
+    if (m_setup_len == 0)
     {
         assert(len >= 7);
         assert(buf[0] == 5);
         assert(memcmp(buf + 1, "vorbis", 6) == 0);
-        m_setup.assign(buf, buf_end);
+
+        hr = WriteHeader(buf, len, m_setup_len);
+
+        if (FAILED(hr))
+            return hr;
 
         if (file.GetStream())
         {
@@ -506,9 +559,9 @@ HRESULT StreamAudioVorbisOgg::Receive(IMediaSample* pSample)
 
     //In order to construct a frame, we need to have
     //both the start and stop times, so we check it
-    //here before calling the ctor.
+    //here before appending the packet.
 
-    __int64 st, sp;
+    __int64 st, sp;  //this is actually samples, not reftime
 
     hr = pSample->GetTime(&st, &sp);
 
@@ -521,8 +574,181 @@ HRESULT StreamAudioVorbisOgg::Receive(IMediaSample* pSample)
     if (st >= sp)
         return S_OK;  //throw away this sample
 
-    VorbisFrame* const pFrame = new (std::nothrow) VorbisFrame(pSample, this);
-    assert(SUCCEEDED(hr));  //TODO
+    assert(st >= 0);
+
+    return AppendPacket(buf, len, st, sp);
+}
+
+
+HRESULT StreamAudioVorbisOgg::AppendPacket(
+    const BYTE* data,
+    ULONG size,
+    __int64 st,
+    __int64 sp)
+{
+    enum { kLaceDataSize = kLaceBufferSize - kLaceHeaderSize };
+
+    if (m_lace_count > 0)
+    {
+        //A lace holds packets that follow each other without a gap, so
+        //that the time of each can be derived from the block's.
+
+        const __int64 rate = GetSamplesPerSec();
+        const __int64 max_samples = rate * kLaceDurationMs / 1000;
+
+        const bool bFit =
+            (st == m_lace_stop) &&
+            ((sp - m_lace_start) <= max_samples) &&
+            ((m_lace_size + size) <= kLaceDataSize);
+
+        if (!bFit)
+        {
+            const HRESULT hr = NotifyLace();
+
+            if (FAILED(hr))
+                return hr;
+        }
+    }
+
+    //In low latency mode each packet is written as soon as it arrives.
+
+    if (m_context.GetLowLatencyMode() || (size > kLaceDataSize))
+        return NotifyPacket(data, size, st, sp);
+
+    if (m_lace == 0)
+    {
+        m_lace = static_cast<BYTE*>(m_pool.Alloc(kLaceBufferSize));
+
+        if (m_lace == 0)
+            return E_OUTOFMEMORY;
+    }
+
+    if (m_lace_count == 0)
+        m_lace_start = st;
+
+    memcpy(m_lace + kLaceHeaderSize + m_lace_size, data, size);
+
+    m_lace_size += size;
+    m_lace_sizes[m_lace_count++] = size;
+    m_lace_stop = sp;
+
+    if (m_lace_count >= kLacePackets)
+        return NotifyLace();
+
+    return S_OK;
+}
+
+
+HRESULT StreamAudioVorbisOgg::NotifyLace()
+{
+    assert(m_lace);
+    assert(m_lace_count > 0);
+
+    BYTE* const data = m_lace + kLaceHeaderSize;
+
+    ULONG hdr_len = 0;
+    int lacing = 0;
+
+    if (m_lace_count > 1)
+    {
+        //Xiph lacing: the number of packets less 1, then the size of
+        //each packet but the last, as a run of 255s and a remainder.  The
+        //header ends where the packets begin.
+
+        hdr_len = 1;
+
+        for (ULONG i = 0; i < (m_lace_count - 1); ++i)
+            hdr_len += m_lace_sizes[i] / 255 + 1;
+
+        assert(hdr_len <= kLaceHeaderSize);
+
+        BYTE* p = data - hdr_len;
+
+        *p++ = static_cast<BYTE>(m_lace_count - 1);
+
+        for (ULONG i = 0; i < (m_lace_count - 1); ++i)
+        {
+            ULONG n = m_lace_sizes[i];
+
+            while (n >= 255)
+            {
+                *p++ = 255;
+                n -= 255;
+            }
+
+            *p++ = static_cast<BYTE>(n);
+        }
+
+        assert(p == data);
+
+        lacing = 1;  //Xiph
+    }
+
+    void* const pv = m_pool.Alloc(sizeof(VorbisFrame));
+
+    if (pv == 0)
+        return E_OUTOFMEMORY;
+
+    const ULONG timecode = GetTimecode(m_lace_start);
+    const ULONG duration = GetTimecode(m_lace_stop - m_lace_start);
+
+    VorbisFrame* const pFrame = new (pv) VorbisFrame(
+                                            m_pool,
+                                            timecode,
+                                            duration,
+                                            m_lace,
+                                            kLaceBufferSize,
+                                            data - hdr_len,
+                                            hdr_len + m_lace_size,
+                                            lacing);
+
+    //The frame owns the buffer now.
+
+    m_lace = 0;
+    m_lace_size = 0;
+    m_lace_count = 0;
+
+    m_context.NotifyAudioFrame(this, pFrame);
+
+    return S_OK;
+}
+
+
+HRESULT StreamAudioVorbisOgg::NotifyPacket(
+    const BYTE* data,
+    ULONG size,
+    __int64 st,
+    __int64 sp)
+{
+    assert(m_lace_count == 0);
+
+    BYTE* const buf = static_cast<BYTE*>(m_pool.Alloc(size));
+
+    if (buf == 0)
+        return E_OUTOFMEMORY;
+
+    memcpy(buf, data, size);
+
+    void* const pv = m_pool.Alloc(sizeof(VorbisFrame));
+
+    if (pv == 0)
+    {
+        m_pool.Free(buf, size);
+        return E_OUTOFMEMORY;
+    }
+
+    const ULONG timecode = GetTimecode(st);
+    const ULONG duration = GetTimecode(sp - st);
+
+    VorbisFrame* const pFrame = new (pv) VorbisFrame(
+                                            m_pool,
+                                            timecode,
+                                            duration,
+                                            buf,
+                                            size,
+                                            buf,
+                                            size,
+                                            0);  //no lacing
 
     m_context.NotifyAudioFrame(this, pFrame);
 
@@ -532,7 +758,19 @@ HRESULT StreamAudioVorbisOgg::Receive(IMediaSample* pSample)
 
 int StreamAudioVorbisOgg::EndOfStream()
 {
+    if (m_lace_count > 0)
+        NotifyLace();
+
     return m_context.NotifyAudioEOS(this);
 }
 
+
+void StreamAudioVorbisOgg::Flush()
+{
+    if (m_lace_count > 0)
+        NotifyLace();
+
+    StreamAudio::Flush();
+}
+
 }  //end namespace WebmMuxLib
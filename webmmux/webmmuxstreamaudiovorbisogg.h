@@ -9,8 +9,6 @@
 #include "webmmuxstreamaudio.h"
 #include "webmmuxcontext.h"
 
-#include <vector>
-
 class CMediaTypes;
 
 namespace VorbisTypes
@@ -36,7 +34,11 @@ protected:
     void WriteTrackCodecName();
     void WriteTrackCodecPrivate();
 
+    bool IsLaced() const;  //packets are laced into blocks
+
 public:
+    ~StreamAudioVorbisOgg();
+
     static void GetMediaTypes(CMediaTypes&);
     static bool QueryAccept(const AM_MEDIA_TYPE&);
 
@@ -44,12 +46,39 @@ public:
 
     HRESULT Receive(IMediaSample*);
     int EndOfStream();
+    void Flush();
 
 private:
-    typedef std::vector<BYTE> header_t;
-    header_t m_ident;
-    header_t m_comment;
-    header_t m_setup;
+    //Consecutive packets are Xiph-laced into one block, for up to
+    //kLaceDurationMs of audio.  The packets are copied into a pooled
+    //buffer of kLaceBufferSize bytes as they arrive, after space for the
+    //lacing header, which is filled in once the lace is complete; the
+    //buffer is then the payload of the block, as it is.
+    enum { kLacePackets = 8 };
+    enum { kLaceDurationMs = 100 };
+    enum { kLaceBufferSize = 8192 };
+    enum { kLaceHeaderSize = 48 };  //1 + (kLacePackets - 1) + 8192/255
+
+    BYTE* m_lace;
+    ULONG m_lace_size;  //of the packets, following the header space
+    ULONG m_lace_sizes[kLacePackets];
+    ULONG m_lace_count;
+    __int64 m_lace_start;  //samples
+    __int64 m_lace_stop;
+
+    HRESULT AppendPacket(const BYTE*, ULONG, __int64 st, __int64 sp);
+    HRESULT NotifyLace();
+    HRESULT NotifyPacket(const BYTE*, ULONG, __int64 st, __int64 sp);
+
+    ULONG GetTimecode(__int64 samples) const;
+
+    //Lengths of the Vorbis headers received so far.  Each header is
+    //copied straight into the CodecPrivate element that
+    //WriteTrackCodecPrivate reserves, where it goes in the laced
+    //headers.
+    ULONG m_ident_len;
+    ULONG m_comment_len;
+    ULONG m_setup_len;
 
     const VorbisTypes::VORBISFORMAT& GetFormat() const;
 
@@ -59,13 +88,29 @@ private:
         VorbisFrame(const VorbisFrame&);
 
     private:
+        FramePool& m_pool;
         ULONG m_timecode;
         ULONG m_duration;
-        BYTE* m_data;
+        BYTE* m_buf;  //the pooled block
+        ULONG m_buf_size;
+        const BYTE* m_data;  //within m_buf
         ULONG m_size;
+        int m_lacing;
+
+    protected:
+        int GetLacing() const;
 
     public:
-        VorbisFrame(IMediaSample*, StreamAudioVorbisOgg*);
+        VorbisFrame(
+            FramePool&,
+            ULONG timecode,
+            ULONG duration,
+            BYTE* buf,
+            ULONG buf_size,
+            const BYTE* data,
+            ULONG size,
+            int lacing);
+
         ~VorbisFrame();
 
         ULONG GetTimecode() const;
@@ -73,10 +118,13 @@ private:
 
         ULONG GetSize() const;
         const BYTE* GetData() const;
+
+        void Release();  //back to the stream's pool
     };
 
     unsigned __int64 m_codec_private_data_pos;
 
+    HRESULT WriteHeader(const BYTE*, ULONG, ULONG& len);
     HRESULT FinalizeTrackCodecPrivate();
 };
 
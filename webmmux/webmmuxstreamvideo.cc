@@ -118,6 +118,13 @@ void StreamVideo::WriteTrackType()
 }
 
 
+void StreamVideo::WriteTrackContentEncodings()
+{
+    m_stripped = m_context.GetVideoStrippedHeader();
+    WriteContentEncodings(m_context.IsEncrypting());
+}
+
+
 bool StreamVideo::Wait() const
 {
     return m_context.WaitVideo();
@@ -136,6 +143,17 @@ StreamVideo::frames_t& StreamVideo::GetKeyFrames()
 }
 
 
+ULONG StreamVideo::GetAllocCount() const
+{
+    ULONG n = Stream::GetAllocCount();
+
+    n += m_vframes.GetGrowCount();
+    n += m_rframes.GetGrowCount();
+
+    return n;
+}
+
+
 void StreamVideo::Flush()
 {
     m_context.FlushVideo(this);
@@ -8,7 +8,7 @@
 
 #pragma once
 #include "webmmuxstream.h"
-#include <list>
+#include "webmmuxframequeue.h"
 
 namespace WebmMuxLib
 {
@@ -23,6 +23,7 @@ protected:
     ~StreamVideo();
 
     void WriteTrackType();
+    void WriteTrackContentEncodings();
 
 public:
     void Flush();
@@ -40,10 +41,12 @@ public:
 
     virtual LONG GetLastTimecode() const = 0;
 
-    typedef std::list<VideoFrame*> frames_t;
+    typedef FrameQueue<VideoFrame*> frames_t;
     frames_t& GetFrames();
     frames_t& GetKeyFrames();
 
+    ULONG GetAllocCount() const;
+
 protected:
     frames_t m_vframes;
     frames_t m_rframes;
@@ -11,9 +11,12 @@
 #include "webmmuxcontext.h"
 #include "webmmuxstreamvideovpx.h"
 #include "webmtypes.h"
+#include "ivpxsamplelayer.h"
+#include "ivp8sample.h"
 #include <climits>
 #include <cassert>
 #include <vfwmsgs.h>
+#include <new>
 #ifdef _DEBUG
 #include "odbgstream.h"
 using std::endl;
@@ -28,7 +31,12 @@ namespace WebmMuxLib
 StreamVideoVPx::VPxFrame::VPxFrame(
     IMediaSample* pSample,
     StreamVideoVPx* pStream) :
-    m_pSample(pSample)
+    m_pool(pStream->m_pool),
+    m_pSample(pSample),
+    m_layer(-1),
+    m_invisible(false),
+    m_data(0),
+    m_size(0)
 {
     assert(m_pSample);
     m_pSample->AddRef();
@@ -58,6 +66,66 @@ StreamVideoVPx::VPxFrame::VPxFrame(
         tc = ns / scale;
         m_duration = static_cast<ULONG>(tc);
     }
+
+    //A sample from the VP8 encoder's allocator is a CVP8Sample, whose
+    //frame we use as is: the block is written from the encoder's own
+    //buffer, which we hold (via the sample) until the block is out.
+
+    IVP8Sample* pVP8Sample;
+
+    if (SUCCEEDED(m_pSample->QueryInterface(&pVP8Sample)))
+    {
+        const IVP8Sample::Frame& f = pVP8Sample->GetFrame();
+        assert(f.buf);
+        assert(f.off >= 0);
+        assert(f.len >= 0);
+        assert((f.off + f.len) <= f.buflen);
+
+        m_data = f.buf + f.off;
+        m_size = f.len;
+        m_layer = f.layer;
+
+        pVP8Sample->Release();
+    }
+    else
+    {
+        BYTE* ptr;
+
+        const HRESULT hrPtr = m_pSample->GetPointer(&ptr);
+        hrPtr;
+        assert(SUCCEEDED(hrPtr));
+        assert(ptr);
+
+        const long len = m_pSample->GetActualDataLength();
+        assert(len >= 0);
+
+        m_data = ptr;
+        m_size = len;
+
+        IVPXSampleLayer* pLayer;
+
+        if (SUCCEEDED(m_pSample->QueryInterface(&pLayer)))
+        {
+            int layer;
+
+            if (pLayer->GetTemporalLayer(&layer) == S_OK)
+                m_layer = layer;
+
+            pLayer->Release();
+        }
+    }
+
+    //The VP8 encoder sends an altref (see SetAutoAltRef) as a frame of its
+    //own, whose frame tag has show_frame clear.  It's written in turn as
+    //any other frame, flagged invisible, so that it needs no holding back
+    //to be paired with the frame shown after it.  VP9 packs its hidden
+    //frames into a superframe with the frame shown, so none is on its own.
+
+    if ((pStream->m_mt.subtype == WebmTypes::MEDIASUBTYPE_VP80) &&
+        (m_size >= 3))
+    {
+        m_invisible = ((m_data[0] & 0x10) == 0);  //show_frame
+    }
 }
 
 
@@ -68,6 +136,15 @@ StreamVideoVPx::VPxFrame::~VPxFrame()
 }
 
 
+void StreamVideoVPx::VPxFrame::Release()
+{
+    FramePool& pool = m_pool;
+
+    this->~VPxFrame();
+    pool.Free(this, sizeof(VPxFrame));
+}
+
+
 ULONG StreamVideoVPx::VPxFrame::GetTimecode() const
 {
     return m_timecode;
@@ -80,6 +157,18 @@ ULONG StreamVideoVPx::VPxFrame::GetDuration() const
 }
 
 
+int StreamVideoVPx::VPxFrame::GetTemporalLayer() const
+{
+    return m_layer;
+}
+
+
+bool StreamVideoVPx::VPxFrame::IsInvisible() const
+{
+    return m_invisible;
+}
+
+
 bool StreamVideoVPx::VPxFrame::IsKey() const
 {
     return (m_pSample->IsSyncPoint() == S_OK);
@@ -88,22 +177,13 @@ bool StreamVideoVPx::VPxFrame::IsKey() const
 
 ULONG StreamVideoVPx::VPxFrame::GetSize() const
 {
-    const long result = m_pSample->GetActualDataLength();
-    assert(result >= 0);
-
-    return result;
+    return m_size;
 }
 
 
 const BYTE* StreamVideoVPx::VPxFrame::GetData() const
 {
-    BYTE* ptr;
-
-    const HRESULT hr = m_pSample->GetPointer(&ptr);
-    assert(SUCCEEDED(hr));
-    assert(ptr);
-
-    return ptr;
+    return m_data;
 }
 
 
@@ -250,8 +330,12 @@ HRESULT StreamVideoVPx::Receive(IMediaSample* pSample)
     if (file.GetStream() == 0)
         return S_OK;
 
-    VPxFrame* const pFrame = new (std::nothrow) VPxFrame(pSample, this);
-    assert(pFrame);  //TODO
+    void* const pv = m_pool.Alloc(sizeof(VPxFrame));
+
+    if (pv == 0)
+        return E_OUTOFMEMORY;
+
+    VPxFrame* const pFrame = new (pv) VPxFrame(pSample, this);
 
     assert(!m_vframes.empty() || pFrame->IsKey());
 
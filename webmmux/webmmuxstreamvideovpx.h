@@ -39,9 +39,14 @@ private:
         VPxFrame& operator=(const VPxFrame&);
 
     private:
+        FramePool& m_pool;
         IMediaSample* const m_pSample;
         ULONG m_timecode;
         ULONG m_duration;
+        int m_layer;  //from IVPXSampleLayer
+        bool m_invisible;
+        const BYTE* m_data;  //the sample's payload
+        ULONG m_size;
 
     public:
         explicit VPxFrame(IMediaSample*, StreamVideoVPx*);
@@ -50,9 +55,13 @@ private:
         bool IsKey() const;
         ULONG GetTimecode() const;
         ULONG GetDuration() const;
+        int GetTemporalLayer() const;
+        bool IsInvisible() const;
         ULONG GetSize() const;
         const BYTE* GetData() const;
 
+        void Release();  //back to the stream's pool
+
     };
 
 public:
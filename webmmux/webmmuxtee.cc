@@ -0,0 +1,442 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include <process.h>
+#include "webmmuxtee.h"
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace WebmMuxLib
+{
+
+Tee::Tee() :
+    m_limit(kDefaultQueueLimit),
+    m_bStarted(false)
+{
+}
+
+
+Tee::~Tee()
+{
+    Stop();
+    RemoveSinks();
+}
+
+
+HRESULT Tee::AddSink(IWebmMuxChunkSink* pSink)
+{
+    if (pSink == 0)
+        return E_INVALIDARG;
+
+    assert(!m_bStarted);
+
+    Output* const p = new (std::nothrow) Output(pSink);
+
+    if (p == 0)
+        return E_OUTOFMEMORY;
+
+    m_outputs.push_back(p);
+    return S_OK;
+}
+
+
+void Tee::RemoveSinks()
+{
+    assert(!m_bStarted);
+
+    while (!m_outputs.empty())
+    {
+        delete m_outputs.back();
+        m_outputs.pop_back();
+    }
+}
+
+
+ULONG Tee::GetSinkCount() const
+{
+    return static_cast<ULONG>(m_outputs.size());
+}
+
+
+void Tee::SetQueueLimit(ULONG limit)
+{
+    m_limit = limit;
+}
+
+
+ULONG Tee::GetQueueLimit() const
+{
+    return m_limit;
+}
+
+
+void Tee::Start()
+{
+    assert(!m_bStarted);
+
+    if (m_outputs.empty())
+        return;
+
+    m_header.clear();
+
+    typedef outputs_t::iterator iter_t;
+
+    for (iter_t i = m_outputs.begin(); i != m_outputs.end(); ++i)
+        (*i)->Start();
+
+    m_bStarted = true;
+}
+
+
+void Tee::Stop()
+{
+    if (!m_bStarted)
+        return;
+
+    typedef outputs_t::iterator iter_t;
+
+    for (iter_t i = m_outputs.begin(); i != m_outputs.end(); ++i)
+        (*i)->Stop();
+
+    m_header.clear();
+    m_bStarted = false;
+}
+
+
+bool Tee::IsStarted() const
+{
+    return m_bStarted;
+}
+
+
+void Tee::AppendHeader(const void* buf, ULONG len)
+{
+    if (!m_bStarted)
+        return;
+
+    const BYTE* const ptr = static_cast<const BYTE*>(buf);
+    m_header.insert(m_header.end(), ptr, ptr + len);
+}
+
+
+void Tee::QueueHeader()
+{
+    if (!m_bStarted || m_header.empty())
+        return;
+
+    const ULONG len = static_cast<ULONG>(m_header.size());
+
+    Chunk* const c = CreateChunk(kWebmMuxChunkHeader, &m_header[0], len);
+
+    if (c == 0)
+        return;
+
+    Queue(c, true);
+    m_header.clear();
+}
+
+
+void Tee::QueueCluster(const void* buf, ULONG len, bool bKey)
+{
+    if (!m_bStarted || (len == 0))
+        return;
+
+    Chunk* const c = CreateChunk(kWebmMuxChunkCluster, buf, len);
+
+    if (c == 0)  //the sinks lose it, as if their queues were full
+        bKey = false;
+
+    Queue(c, bKey);
+}
+
+
+void Tee::Queue(Chunk* c, bool bKey)
+{
+    //c is null if there was no memory for it.
+
+    typedef outputs_t::iterator iter_t;
+
+    for (iter_t i = m_outputs.begin(); i != m_outputs.end(); ++i)
+        (*i)->Queue(c, bKey, m_limit);
+
+    if (c)
+        ReleaseChunk(c);  //the queues hold the references now
+}
+
+
+bool Tee::GetStats(ULONG index, ULONG& queued, ULONG& dropped) const
+{
+    if (index >= m_outputs.size())
+        return false;
+
+    m_outputs[index]->GetStats(queued, dropped);
+    return true;
+}
+
+
+Tee::Chunk* Tee::CreateChunk(
+    WebmMuxChunkType type,
+    const void* buf,
+    ULONG len)
+{
+    Chunk* const c = new (std::nothrow) Chunk;
+
+    if (c == 0)
+        return 0;
+
+    c->m_buf = new (std::nothrow) BYTE[len];
+
+    if (c->m_buf == 0)
+    {
+        delete c;
+        return 0;
+    }
+
+    memcpy(c->m_buf, buf, len);
+
+    c->m_cRef = 1;
+    c->m_type = type;
+    c->m_len = len;
+
+    return c;
+}
+
+
+void Tee::ReleaseChunk(Chunk* c)
+{
+    assert(c);
+    assert(c->m_cRef > 0);
+
+    if (InterlockedDecrement(&c->m_cRef) > 0)
+        return;
+
+    delete[] c->m_buf;
+    delete c;
+}
+
+
+Tee::Output::Output(IWebmMuxChunkSink* pSink) :
+    m_pSink(pSink),
+    m_hThread(0),
+    m_queued(0),
+    m_bStop(false),
+    m_bSkip(false),
+    m_cDropped(0),
+    m_hrSink(S_OK)
+{
+    assert(m_pSink);
+    m_pSink->AddRef();
+
+    m_hQueued = CreateEvent(0, 0, 0, 0);  //auto-reset
+    assert(m_hQueued);  //TODO
+
+    InitializeCriticalSection(&m_cs);
+}
+
+
+Tee::Output::~Output()
+{
+    assert(m_hThread == 0);
+    assert(m_queue.empty());
+
+    DeleteCriticalSection(&m_cs);
+
+    const BOOL b = CloseHandle(m_hQueued);
+    assert(b);
+    b;
+
+    m_pSink->Release();
+}
+
+
+void Tee::Output::Start()
+{
+    assert(m_hThread == 0);
+    assert(m_queue.empty());
+
+    m_queued = 0;
+    m_bStop = false;
+    m_bSkip = false;
+    m_cDropped = 0;
+    m_hrSink = S_OK;
+
+    const BOOL b = ResetEvent(m_hQueued);
+    assert(b);
+    b;
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Tee::Output::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    //Without a thread, the chunks of this sink are dropped (see Queue).
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+}
+
+
+void Tee::Output::Stop()
+{
+    if (m_hThread == 0)
+        return;
+
+    EnterCriticalSection(&m_cs);
+    m_bStop = true;
+    LeaveCriticalSection(&m_cs);
+
+    BOOL b = SetEvent(m_hQueued);
+    assert(b);
+
+    //The thread delivers what's queued before it exits.
+
+    const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    b = CloseHandle(m_hThread);
+    assert(b);
+    b;
+
+    m_hThread = 0;
+
+    assert(m_queue.empty());
+    assert(m_queued == 0);
+}
+
+
+void Tee::Output::Queue(Chunk* c, bool bKey, ULONG limit)
+{
+    EnterCriticalSection(&m_cs);
+
+    bool bQueue;
+
+    if ((c == 0) || (m_hThread == 0) || FAILED(m_hrSink))
+        bQueue = false;
+
+    else if (c->m_type == kWebmMuxChunkHeader)
+        bQueue = true;
+
+    else if (m_bSkip && !bKey)
+        bQueue = false;  //a decoder couldn't start here
+
+    else if (m_queue.empty())
+        bQueue = true;  //however large it is, or the sink never gets it
+
+    else
+        bQueue = (c->m_len <= limit) && (m_queued <= (limit - c->m_len));
+
+    if (bQueue)
+    {
+        InterlockedIncrement(&c->m_cRef);
+
+        m_queue.push_back(c);
+        m_queued += c->m_len;
+
+        m_bSkip = false;
+    }
+    else if ((c == 0) || (c->m_type != kWebmMuxChunkHeader))
+    {
+        m_bSkip = true;
+        ++m_cDropped;
+    }
+
+    LeaveCriticalSection(&m_cs);
+
+    if (bQueue)
+    {
+        const BOOL b = SetEvent(m_hQueued);
+        assert(b);
+        b;
+    }
+}
+
+
+void Tee::Output::GetStats(ULONG& queued, ULONG& dropped) const
+{
+    EnterCriticalSection(&m_cs);
+
+    queued = m_queued;
+    dropped = m_cDropped;
+
+    LeaveCriticalSection(&m_cs);
+}
+
+
+unsigned Tee::Output::ThreadProc(void* pv)
+{
+    Output* const pOutput = static_cast<Output*>(pv);
+    assert(pOutput);
+
+    pOutput->Main();
+    return 0;
+}
+
+
+void Tee::Output::Main()
+{
+    for (;;)
+    {
+        const DWORD dw = WaitForSingleObject(m_hQueued, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        for (;;)
+        {
+            EnterCriticalSection(&m_cs);
+
+            if (m_queue.empty())
+            {
+                const bool bStop = m_bStop;
+
+                LeaveCriticalSection(&m_cs);
+
+                if (bStop)
+                    return;
+
+                break;
+            }
+
+            //The chunk stays on the queue while it's delivered, so that
+            //it counts against the limit.
+
+            Chunk* const c = m_queue.front();
+            const HRESULT hrSink = m_hrSink;
+
+            LeaveCriticalSection(&m_cs);
+
+            //Once the sink fails, what's left is released unseen.
+
+            HRESULT hr = S_OK;
+
+            if (SUCCEEDED(hrSink))
+                hr = m_pSink->OnChunk(c->m_type, c->m_buf, c->m_len);
+
+            EnterCriticalSection(&m_cs);
+
+            m_queue.pop_front();
+
+            assert(m_queued >= c->m_len);
+            m_queued -= c->m_len;
+
+            if (FAILED(hr) && SUCCEEDED(m_hrSink))
+                m_hrSink = hr;
+
+            LeaveCriticalSection(&m_cs);
+
+            ReleaseChunk(c);
+        }
+    }
+}
+
+
+}  //end namespace WebmMuxLib
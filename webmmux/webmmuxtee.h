@@ -0,0 +1,133 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <objidl.h>
+#include "webmmuxidl.h"
+#include <deque>
+#include <vector>
+
+namespace WebmMuxLib
+{
+
+//Copies of the mux, for sinks other than the output stream.  Each
+//cluster is serialized once, and the same bytes are queued for every
+//sink, each of which is delivered to on a thread of its own, so a sink
+//that is slow to take its chunks stalls neither the output stream nor
+//the other sinks.  A sink whose queue is past the limit loses clusters
+//instead, until a cluster that begins with a key frame fits again.
+//
+//The copies are live streams: a header chunk (the EBML header, a
+//segment of unknown size, its info and tracks), then a chunk for each
+//cluster, written with its size.  The cues and the patches the output
+//stream gets are not copied.
+
+class Tee
+{
+    Tee(const Tee&);
+    Tee& operator=(const Tee&);
+
+public:
+
+    Tee();
+    ~Tee();
+
+    //Sinks are added and removed only while the tee is stopped.
+    HRESULT AddSink(IWebmMuxChunkSink*);
+    void RemoveSinks();
+    ULONG GetSinkCount() const;
+
+    //Most bytes queued for a sink before it loses clusters.
+    enum { kDefaultQueueLimit = 8 * 1024 * 1024 };
+
+    void SetQueueLimit(ULONG);
+    ULONG GetQueueLimit() const;
+
+    //Start creates the thread of each sink.  Stop waits for each sink to
+    //take what it has queued, then ends its thread.
+    void Start();
+    void Stop();
+    bool IsStarted() const;
+
+    //The header is written in pieces; they are collected until
+    //QueueHeader, which queues them for the sinks as one chunk.
+    void AppendHeader(const void*, ULONG);
+    void QueueHeader();
+
+    void QueueCluster(const void*, ULONG, bool bKey);
+
+    //Bytes queued for the sink now, and the clusters it has lost since
+    //the tee started.
+    bool GetStats(ULONG index, ULONG& queued, ULONG& dropped) const;
+
+private:
+
+    //Shared by the queues of the sinks; the last to release it frees it.
+    struct Chunk
+    {
+        LONG m_cRef;
+        WebmMuxChunkType m_type;
+        ULONG m_len;
+        BYTE* m_buf;
+    };
+
+    static Chunk* CreateChunk(WebmMuxChunkType, const void*, ULONG);
+    static void ReleaseChunk(Chunk*);
+
+    class Output
+    {
+        Output(const Output&);
+        Output& operator=(const Output&);
+
+    public:
+
+        explicit Output(IWebmMuxChunkSink*);
+        ~Output();
+
+        void Start();
+        void Stop();
+
+        //Takes a reference to the chunk, unless it's dropped.  Header
+        //chunks are never dropped.
+        void Queue(Chunk*, bool bKey, ULONG limit);
+
+        void GetStats(ULONG& queued, ULONG& dropped) const;
+
+    private:
+
+        IWebmMuxChunkSink* const m_pSink;
+        HANDLE m_hThread;
+        HANDLE m_hQueued;  //auto-reset: a chunk was queued, or stop
+
+        //Guards the queue, and the state shared with the thread.
+        mutable CRITICAL_SECTION m_cs;
+
+        std::deque<Chunk*> m_queue;  //the front one is being delivered
+        ULONG m_queued;              //bytes in m_queue
+        bool m_bStop;
+        bool m_bSkip;    //dropping until a cluster begins with a key frame
+        ULONG m_cDropped;
+        HRESULT m_hrSink;  //of the first OnChunk that failed
+
+        static unsigned __stdcall ThreadProc(void*);
+        void Main();
+
+    };
+
+    typedef std::vector<Output*> outputs_t;
+    outputs_t m_outputs;
+
+    ULONG m_limit;
+    bool m_bStarted;
+    std::vector<BYTE> m_header;
+
+    void Queue(Chunk*, bool bKey);
+
+};
+
+}  //end namespace WebmMuxLib
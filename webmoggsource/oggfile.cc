@@ -9,14 +9,18 @@
 #include <strmif.h>
 #include "oggfile.h"
 #include <cassert>
+#include <cstring>
 
 namespace WebmOggSource
 {
 
 OggFile::OggFile() :
     m_hFile(INVALID_HANDLE_VALUE),
-    m_length(0)
+    m_length(0),
+    m_buf(0),
+    m_stamp(0)
 {
+    memset(&m_stats, 0, sizeof m_stats);
 }
 
 
@@ -81,6 +85,35 @@ HRESULT OggFile::Open(const wchar_t* strFileName)
     m_length = size.QuadPart;
     assert(m_length >= 0);
 
+    const SIZE_T cb = SIZE_T(kWindowSize) * kWindowCount;
+
+    void* const buf = VirtualAlloc(
+                        0,
+                        cb,
+                        MEM_COMMIT | MEM_RESERVE,
+                        PAGE_READWRITE);
+
+    if (buf == 0)
+    {
+        Close();
+        return E_OUTOFMEMORY;
+    }
+
+    m_buf = static_cast<unsigned char*>(buf);
+
+    for (int i = 0; i < kWindowCount; ++i)
+    {
+        Window& w = m_windows[i];
+
+        w.pos = -1;
+        w.len = 0;
+        w.buf = m_buf + i * kWindowSize;
+        w.stamp = 0;
+    }
+
+    m_stamp = 0;
+    memset(&m_stats, 0, sizeof m_stats);
+
     return S_OK;
 }
 
@@ -90,6 +123,15 @@ HRESULT OggFile::Close()
     if (m_hFile == INVALID_HANDLE_VALUE)
         return S_FALSE;
 
+    if (m_buf)
+    {
+        const BOOL b = VirtualFree(m_buf, 0, MEM_RELEASE);
+        b;
+        assert(b);
+
+        m_buf = 0;
+    }
+
     const BOOL b = CloseHandle(m_hFile);
 
     m_hFile = INVALID_HANDLE_VALUE;
@@ -125,20 +167,111 @@ long OggFile::Read(
     if (pos > m_length)
         return oggparser::E_END_OF_FILE;
 
-    //if (len == 0)
-    //    return 0;  //success
+    ++m_stats.reads;
+
+    if (len > kWindowSize)  //would only evict windows still in use
+    {
+        LONG cbRead;
+
+        const long result = ReadFromFile(pos, len, buf, cbRead);
+
+        if (result < 0)
+            return result;
+
+        if (cbRead < len)
+            return oggparser::E_END_OF_FILE;
+
+        return 0;  //success
+    }
+
+    while (len > 0)
+    {
+        if (pos >= m_length)
+            return oggparser::E_END_OF_FILE;
+
+        const Window* const w = GetWindow(pos);
+
+        if (w == 0)
+            return oggparser::E_READ_ERROR;
+
+        const LONG off = static_cast<LONG>(pos - w->pos);
+        assert(off >= 0);
+        assert(off < kWindowSize);
+
+        if (off >= w->len)  //file was truncated since we opened it
+            return oggparser::E_END_OF_FILE;
+
+        const LONG n = ((w->len - off) < len) ? (w->len - off) : len;
+
+        memcpy(buf, w->buf + off, n);
 
-    //if ((pos + len) > m_length)
-    //    return oggparser::E_END_OF_FILE;
+        pos += n;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;  //success
+}
+
+
+const OggFile::Window* OggFile::GetWindow(LONGLONG pos)
+{
+    const LONGLONG window_pos = pos - (pos % kWindowSize);
+
+    Window* victim = m_windows;
+
+    for (int i = 0; i < kWindowCount; ++i)
+    {
+        Window& w = m_windows[i];
+
+        if (w.pos == window_pos)
+        {
+            ++m_stats.hits;
+            w.stamp = ++m_stamp;
+
+            return &w;
+        }
+
+        if (w.stamp < victim->stamp)  //least recently used
+            victim = &w;
+    }
+
+    const LONGLONG len_ = m_length - window_pos;
+    const LONG len = (len_ < kWindowSize) ? LONG(len_) : LONG(kWindowSize);
+
+    victim->pos = -1;
+    victim->len = 0;
+    victim->stamp = 0;
 
+    LONG cbRead;
+
+    const long result = ReadFromFile(window_pos, len, victim->buf, cbRead);
+
+    if (result < 0)
+        return 0;
+
+    victim->pos = window_pos;
+    victim->len = cbRead;
+    victim->stamp = ++m_stamp;
+
+    return victim;
+}
+
+
+long OggFile::ReadFromFile(
+    LONGLONG pos,
+    LONG len,
+    unsigned char* buf,
+    LONG& cbRead)
+{
     const HRESULT hr = SetPosition(pos);
 
     if (FAILED(hr))
         return oggparser::E_READ_ERROR;
 
-    DWORD cbRead;
+    DWORD cb;
 
-    const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, 0);
+    const BOOL b = ::ReadFile(m_hFile, buf, len, &cb, 0);
 
     if (!b)
     {
@@ -148,35 +281,36 @@ long OggFile::Read(
         return oggparser::E_READ_ERROR;
     }
 
+    ++m_stats.file_reads;
+    m_stats.file_bytes += cb;
+
     //Testing for the End of a File
     //http://msdn.microsoft.com/en-us/library/aa365690(v=vs.85).aspx
 
-    if (cbRead < DWORD(len))
-        return oggparser::E_END_OF_FILE;
+    cbRead = static_cast<LONG>(cb);
 
     return 0;  //success
 }
 
 
-#if 0
-
-int OggFile::Length(
-    long long* pTotal,
-    long long* pAvailable)
+long OggFile::Length(long long* pTotal)
 {
     if (!IsOpen())
         return -1;
 
-    if (pTotal)
-        *pTotal = m_length;
+    if (pTotal == 0)
+        return -1;
 
-    if (pAvailable)
-        *pAvailable = m_length;
+    *pTotal = m_length;
 
     return 0;  //success
 }
 
-#endif
+
+void OggFile::GetStats(Stats& stats) const
+{
+    stats = m_stats;
+}
 
 
 } //end namespace WebmOggSource
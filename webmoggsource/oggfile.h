@@ -13,6 +13,14 @@
 namespace WebmOggSource
 {
 
+//The parser reads a page in small pieces (the fixed header, the segment
+//table, and then the payload), so the file is read ahead in large
+//windows, aligned on their size, and the reads are satisfied from them.
+//The last few windows are kept, so that the backward seeks of bisection
+//(and re-reading a page) are usually satisfied without the file.  Reads
+//larger than a window go to the file directly.  Not thread safe (the
+//source filter's lock serializes access to it).
+
 //class OggFile : public mkvparser::IStreamReader
 class OggFile : public oggparser::IOggReader
 {
@@ -28,13 +36,41 @@ public:
     bool IsOpen() const;
 
     long Read(long long pos, long len, unsigned char* buf);
-    //int Length(long long* total, long long* available);
+    long Length(long long* total);
+
+    enum { kWindowSize = 256 * 1024 };  //a multiple of the page size
+    enum { kWindowCount = 4 };
+
+    struct Stats
+    {
+        long long reads;       //calls to Read
+        long long file_reads;  //calls to ReadFile
+        long long file_bytes;  //bytes read from the file
+        long long hits;        //windows found already read
+    };
+
+    void GetStats(Stats&) const;
 
 private:
     HANDLE m_hFile;
     LONGLONG m_length;
 
+    struct Window
+    {
+        LONGLONG pos;  //-1 if empty
+        LONG len;
+        unsigned char* buf;
+        LONGLONG stamp;  //of last use; 0 if empty
+    };
+
+    unsigned char* m_buf;  //VirtualAlloc'd, for all the windows
+    Window m_windows[kWindowCount];
+    LONGLONG m_stamp;
+    Stats m_stats;
+
     HRESULT SetPosition(LONGLONG) const;
+    long ReadFromFile(LONGLONG pos, LONG len, unsigned char*, LONG& cb);
+    const Window* GetWindow(LONGLONG pos);
 
 };
 
@@ -1,6 +1,7 @@
 #include "oggparser.h"
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 //#include <malloc.h>
 
 typedef std::list<oggparser::OggPage> pages_t;
@@ -44,134 +45,90 @@ long OggPage::Read(IOggReader* pReader, long long& pos)
     if (pos < 0)
         return -1;
 
-    long result = pReader->Read(pos, 4, capture_pattern);
+    //The fixed part of the header, and then the segment table, each
+    //take a single read.  The payload is left in the file; we only
+    //compute where each packet (or packet fragment) lies.
 
-    if (result < 0)  //error
-        return result;
-
-    if (memcmp(capture_pattern, "OggS", 4) != 0)
-        return E_FILE_FORMAT_INVALID;
-
-    pos += 4;  //consume capture_pattern
-
-    long long version_;
-
-    result = ReadInt(pReader, pos, 1, version_);
-
-    if (result < 0)  //error
-        return result;
-
-    ++pos;  //consume version
-
-    version = static_cast<unsigned char>(version_);
-
-    long long header_;
+    unsigned char hdr[27];
 
-    result = ReadInt(pReader, pos, 1, header_);
+    long result = pReader->Read(pos, 27, hdr);
 
     if (result < 0)  //error
         return result;
 
-    ++pos;  //consume header flag
+    memcpy(capture_pattern, hdr, 4);
 
-    header = static_cast<unsigned char>(header_);
-
-    result = ReadInt(pReader, pos, 8, granule_pos);
-
-    if (result < 0)  //error
-        return result;
-
-    pos += 8;  //consume granule pos
-
-    long long serial_num_;
-
-    result = ReadInt(pReader, pos, 4, serial_num_);
-
-    if (result < 0)  //error
-        return result;
-
-    pos += 4;  //consume serial number
-
-    serial_num = static_cast<unsigned long>(serial_num_);
+    if (memcmp(capture_pattern, "OggS", 4) != 0)
+        return E_FILE_FORMAT_INVALID;
 
-    long long sequence_num_;
+    pos += 27;  //consume fixed header
 
-    result = ReadInt(pReader, pos, 4, sequence_num_);
+    version = hdr[4];
+    header = hdr[5];
 
-    if (result < 0)  //error
-        return result;
+    unsigned long long granule_pos_ = 0;
 
-    pos += 4;  //consume page sequence number
+    for (int i = 7; i >= 0; --i)
+        granule_pos_ = (granule_pos_ << 8) | hdr[6 + i];
 
-    sequence_num = static_cast<unsigned long>(sequence_num_);
+    granule_pos = static_cast<long long>(granule_pos_);
 
-    long long crc_;
+    serial_num = hdr[14] | (hdr[15] << 8) | (hdr[16] << 16) |
+                 (static_cast<unsigned long>(hdr[17]) << 24);
 
-    result = ReadInt(pReader, pos, 4, crc_);
+    sequence_num = hdr[18] | (hdr[19] << 8) | (hdr[20] << 16) |
+                   (static_cast<unsigned long>(hdr[21]) << 24);
 
-    if (result < 0)  //error
-        return result;
+    //http://www.ross.net/crc/download/crc_v3.txt
 
-    pos += 4;  //consume crc
+    crc = hdr[22] | (hdr[23] << 8) | (hdr[24] << 16) |
+          (static_cast<unsigned long>(hdr[25]) << 24);
 
-    //http://www.ross.net/crc/download/crc_v3.txt
+    const long segments_count = hdr[26];
 
-    crc = static_cast<unsigned long>(crc_);
+    if (segments_count <= 0)   //TODO: confirm this
+        return E_FILE_FORMAT_INVALID;
 
-    long long segments_count;
+    unsigned char lacing[255];
 
-    result = ReadInt(pReader, pos, 1, segments_count);
+    result = pReader->Read(pos, segments_count, lacing);
 
     if (result < 0)  //error
         return result;
 
-    if (segments_count <= 0)   //TODO: confirm this
-        return E_FILE_FORMAT_INVALID;
-
-    ++pos;  //consume segment count
+    pos += segments_count;  //consume segment table
 
     descriptors.clear();
 
-    while (segments_count > 0)
+    long len = 0;
+
+    for (long i = 0; i < segments_count; ++i)
     {
-        descriptors.push_back(Descriptor());
+        const unsigned char lacing_value = lacing[i];
+        len += lacing_value;
 
+        if (lacing_value == 255)
         {
-            Descriptor& data = descriptors.back();
+            if ((i + 1) < segments_count)
+                continue;
 
-            data.pos = -1;  //fill in later
-            data.len = 0;
-        }
+            descriptors.push_back(Descriptor());
+            Descriptor& payload = descriptors.back();
 
-        for (;;)
+            payload.len = -len;  //pkt continued on next page
+        }
+        else
         {
-            long long lacing_value;
-
-            result = ReadInt(pReader, pos, 1, lacing_value);
+            descriptors.push_back(Descriptor());
+            Descriptor& payload = descriptors.back();
 
-            if (result < 0)  //error
-                return result;
-
-            ++pos;  //consume lacing value
-
-            {
-                Descriptor& payload = descriptors.back();
-                payload.len += static_cast<long>(lacing_value);
-
-                if (--segments_count <= 0)
-                {
-                    if (lacing_value == 255)  //pkt continued on next page
-                        payload.len = -payload.len;
-                    else  //pkt completed on curr page
-                        header |= OggPage::fDone;
-
-                    break;
-                }
-            }
+            payload.len = len;  //pkt completed on curr page
 
-            if (lacing_value != 255)
-                break;
+            if ((i + 1) >= segments_count)
+                header |= OggPage::fDone;
         }
+
+        len = 0;
     }
 
     typedef descriptors_t::iterator iter_t;
@@ -419,6 +376,7 @@ OggStream::OggStream(IOggReader* p) :
     m_page_base(0),
     m_pos(0),
     m_base(0),
+    m_page_reads(0),
     m_serial_num(0)
 {
 }
@@ -441,7 +399,7 @@ long OggStream::Init(
 
     for (;;)
     {
-        long result = page.Read(m_pReader, m_pos);
+        long result = ReadPage(page, m_pos);
 
         if (result < 0)
             return result;
@@ -479,10 +437,15 @@ long OggStream::Init(
 
     m_serial_num = page.serial_num;
 
+    long result = LoadPage(page, m_pos);
+
+    if (result < 0)
+        return result;
+
     ident.descriptors = page.descriptors;
     ident.granule_pos = 0;
 
-    long result = GetPacket(comment, 10);
+    result = GetPacket(comment, 10);
 
     if (result < 0)
         return result;
@@ -518,6 +481,315 @@ long OggStream::Reset()
 }
 
 
+OggPageIndex* OggStream::GetIndex()
+{
+    return &m_index;
+}
+
+
+long long OggStream::GetPageReadCount() const
+{
+    return m_page_reads;
+}
+
+
+long OggStream::ReadPage(OggPage& page, long long& pos)
+{
+    ++m_page_reads;
+    return page.Read(m_pReader, pos);
+}
+
+
+long OggStream::FindPage(
+    long long pos,
+    long long stop,
+    OggPage& page,
+    long long& page_pos)
+{
+    //Resynchronize on the capture pattern, and return the first page of
+    //our bitstream that has a granule pos and begins before stop.  We
+    //don't check the CRC, so a candidate must also have version 0 and fit
+    //in the file before we believe it.
+
+    long long total;
+
+    long result = m_pReader->Length(&total);
+
+    if (result < 0)
+        return result;
+
+    if (stop > total)
+        stop = total;
+
+    enum { kChunk = 4096 };
+    unsigned char buf[kChunk];
+
+    while (pos < stop)
+    {
+        const long long len_ = total - pos;
+
+        if (len_ < 4)
+            return 0;
+
+        const long len = (len_ < kChunk) ? static_cast<long>(len_) : kChunk;
+
+        result = m_pReader->Read(pos, len, buf);
+
+        if (result < 0)
+            return result;
+
+        long i = 0;
+
+        while ((i <= len - 4) && (memcmp(buf + i, "OggS", 4) != 0))
+            ++i;
+
+        if (i > len - 4)  //the pattern might straddle the chunk boundary
+        {
+            pos += len - 3;
+            continue;
+        }
+
+        page_pos = pos + i;
+
+        if (page_pos >= stop)
+            return 0;
+
+        long long next = page_pos;
+
+        result = ReadPage(page, next);
+
+        if ((result == E_FILE_FORMAT_INVALID) ||
+            (result == E_END_OF_FILE) ||
+            ((result >= 0) && ((page.version != 0) || (next > total))))
+        {
+            pos = page_pos + 1;  //not a page after all
+            continue;
+        }
+
+        if (result < 0)
+            return result;
+
+        if ((page.serial_num == m_serial_num) && (page.granule_pos >= 0))
+            return 1;  //found
+
+        pos = next;
+    }
+
+    return 0;  //not found
+}
+
+
+long OggStream::Seek(long long granule_pos, long long& start_pos)
+{
+    //We look for the last page whose granule pos precedes the target.
+    //The packets completed on that page end at its granule pos, so the
+    //stream resumes with the packet that follows them.
+    //
+    //The search bisects the file by position, narrowing [lo, hi) until
+    //it spans only a couple of pages, and then reads pages from lo.  lo
+    //is always the position of a page that precedes the target (or of
+    //the first data page), and no page we want begins at or after hi.
+
+    long long total;
+
+    long result = m_pReader->Length(&total);
+
+    if (result < 0)
+        return result;
+
+    long long lo = m_base;
+    long long hi = total;
+
+    OggPageIndex::Entry best;
+    best.pos = -1;  //means "no page precedes the target"
+
+    {
+        const OggPageIndex::Entry* before;
+        const OggPageIndex::Entry* after;
+
+        m_index.Find(m_serial_num, granule_pos, before, after);
+
+        if ((before != 0) && (before->pos >= lo))
+        {
+            lo = before->pos;
+            best = *before;
+        }
+
+        if ((after != 0) && (after->pos < hi))
+            hi = after->pos;
+    }
+
+    const long long kMaxLinear = 2 * 65536;  //about two of the largest pages
+
+    OggPage page;
+
+    while ((hi - lo) > kMaxLinear)
+    {
+        const long long mid = lo + (hi - lo) / 2;
+
+        long long page_pos;
+
+        result = FindPage(mid, hi, page, page_pos);
+
+        if (result < 0)
+            return result;
+
+        if (result == 0)  //no page of ours begins in [mid, hi)
+        {
+            hi = mid;
+            continue;
+        }
+
+        m_index.Add(page, page_pos);
+
+        if (page.granule_pos < granule_pos)
+        {
+            lo = page_pos;
+
+            best.pos = page_pos;
+            best.granule_pos = page.granule_pos;
+            best.serial_num = page.serial_num;
+            best.sequence_num = page.sequence_num;
+        }
+        else
+            hi = mid;
+    }
+
+    long long pos = lo;
+
+    while (pos < hi)
+    {
+        const long long page_pos = pos;
+
+        result = ReadPage(page, pos);
+
+        if (result == E_END_OF_FILE)
+            break;
+
+        if (result < 0)
+            return result;
+
+        if (page.serial_num != m_serial_num)
+            continue;
+
+        if (page.granule_pos < 0)
+            continue;
+
+        m_index.Add(page, page_pos);
+
+        if (page.granule_pos >= granule_pos)
+            break;
+
+        best.pos = page_pos;
+        best.granule_pos = page.granule_pos;
+        best.serial_num = page.serial_num;
+        best.sequence_num = page.sequence_num;
+
+        if (page.header & OggPage::fEOS)
+            break;
+    }
+
+    if (best.pos < 0)  //the target is on the first data page
+    {
+        Reset();
+        start_pos = 0;
+
+        return 0;
+    }
+
+    pos = best.pos;
+
+    result = ReadPage(page, pos);
+
+    if (result < 0)
+        return result;
+
+    result = LoadPage(page, pos);
+
+    if (result < 0)
+        return result;
+
+    //Of the packets on the page, only the one that it leaves unfinished
+    //(if any) is still to be delivered.
+
+    m_packets.clear();
+
+    const OggPage::Descriptor& d = page.descriptors.back();
+
+    if (d.len < 0)
+    {
+        m_packets.push_back(Packet());
+        Packet& pkt = m_packets.back();
+
+        pkt.descriptors.push_back(d);
+        pkt.granule_pos = -1;
+    }
+
+    m_pos = (page.header & OggPage::fEOS) ? -1 : pos;
+    m_page_num = page.sequence_num + 1;
+
+    start_pos = page.granule_pos;
+    return 0;
+}
+
+
+long OggStream::GetLastGranulePos(long long& granule_pos)
+{
+    //Look for the last page of our bitstream in the final 64kB of the
+    //file, then in successively larger spans before that.
+
+    long long total;
+
+    long result = m_pReader->Length(&total);
+
+    if (result < 0)
+        return result;
+
+    long long stop = total;
+    long long len = 65536;
+
+    for (;;)
+    {
+        const long long start = ((total - len) > m_base) ? total - len : m_base;
+
+        granule_pos = -1;
+
+        long long pos = start;
+
+        for (;;)
+        {
+            OggPage page;
+            long long page_pos;
+
+            result = FindPage(pos, stop, page, page_pos);
+
+            if (result < 0)
+                return result;
+
+            if (result == 0)
+                break;
+
+            m_index.Add(page, page_pos);
+
+            granule_pos = page.granule_pos;
+            pos = page_pos + 1;
+        }
+
+        if (granule_pos >= 0)
+            return 0;
+
+        if (start <= m_base)  //no data pages
+        {
+            granule_pos = 0;
+            return 0;
+        }
+
+        stop = start;
+        len *= 2;
+    }
+}
+
+
 #if 0
 long OggStream::GetPackets(OggPage& page, long long page_pos)
 {
@@ -674,7 +946,7 @@ long OggStream::ParsePage()
 
     const long long page_pos = m_pos;
 
-    const long result = page.Read(m_pReader, m_pos);
+    const long result = ReadPage(page, m_pos);
 
     if (result < 0)  //error
         return result;
@@ -687,6 +959,16 @@ long OggStream::ParsePage()
 
     assert(!page.descriptors.empty());
 
+    const long result_ = LoadPage(page, m_pos);
+
+    if (result_ < 0)  //error
+        return result_;
+
+    typedef OggPage::descriptors_t::const_iterator desc_iter_t;
+
+    desc_iter_t i = page.descriptors.begin();
+    const desc_iter_t j = page.descriptors.end();
+
     if (page.header & OggPage::fContinued)
     {
         if (m_packets.empty())
@@ -706,8 +988,7 @@ long OggStream::ParsePage()
             d.len = labs(d.len);
         }
 
-        dd.push_back(page.descriptors.front());
-        page.descriptors.pop_front();
+        dd.push_back(*i++);
     }
     else if (!m_packets.empty())
     {
@@ -724,19 +1005,13 @@ long OggStream::ParsePage()
         }
     }
 
-    OggPage::descriptors_t& dd = page.descriptors;
-
-    while (!dd.empty())
+    while (i != j)
     {
-        OggPage::Descriptor& d = dd.front();
-
         m_packets.push_back(Packet());
         Packet& pkt = m_packets.back();
 
-        pkt.descriptors.push_back(d);
+        pkt.descriptors.push_back(*i++);
         pkt.granule_pos = -1;
-
-        dd.pop_front();
     }
 
     assert(!m_packets.empty());
@@ -794,6 +1069,44 @@ long OggStream::ParsePage()
 }
 
 
+long OggStream::LoadPage(OggPage& page, long long end)
+{
+    //Read the payload of the page (which ends at end) into a pooled
+    //buffer, in a single read, and point its descriptors at the buffer.
+
+    assert(!page.descriptors.empty());
+
+    const long long pos = page.descriptors.front().pos;
+    assert(end >= pos);
+
+    const long len = static_cast<long>(end - pos);
+
+    unsigned char* buf;
+    const OggPageRef ref = m_pool.Get(pos, len, buf);
+
+    if (len > 0)
+    {
+        const long result = m_pReader->Read(pos, len, buf);
+
+        if (result < 0)  //error
+            return result;
+    }
+
+    typedef OggPage::descriptors_t::iterator iter_t;
+
+    iter_t i = page.descriptors.begin();
+    const iter_t j = page.descriptors.end();
+
+    while (i != j)
+    {
+        OggPage::Descriptor& d = *i++;
+        d.page = ref;
+    }
+
+    return 0;  //success
+}
+
+
 long OggStream::GetPacket(Packet& pkt)
 {
     return GetPacket(pkt, 0);
@@ -826,9 +1139,9 @@ long OggStream::ParsePacket(Packet& pkt_)
     if (m_packets.empty())
         return 0;  //no packet available for consumption
 
-    const Packet& pkt = m_packets.front();
+    Packet& pkt = m_packets.front();
 
-    const OggPage::descriptors_t& dd = pkt.descriptors;
+    OggPage::descriptors_t& dd = pkt.descriptors;
     assert(!dd.empty());
 
     const OggPage::Descriptor& d = dd.back();
@@ -836,7 +1149,9 @@ long OggStream::ParsePacket(Packet& pkt_)
     if (d.len < 0)  //hasn't been completed yet
         return 0;   //packet not available for consumption yet
 
-    pkt_ = pkt;
+    pkt_.descriptors.swap(dd);  //hand off, rather than copy
+    pkt_.granule_pos = pkt.granule_pos;
+
     m_packets.pop_front();
 
     return 1;  //successfully consumed pkt
@@ -891,10 +1206,15 @@ long OggPage::Copy(
     {
         const Descriptor& d = *i++;
 
-        const long result = pReader->Read(d.pos, d.len, buf);
+        if (const unsigned char* const p = d.page.GetData(d.pos))
+            memcpy(buf, p, d.len);
+        else
+        {
+            const long result = pReader->Read(d.pos, d.len, buf);
 
-        if (result < 0)  //error
-            return result;
+            if (result < 0)  //error
+                return result;
+        }
 
         buf += d.len;
     }
@@ -920,6 +1240,20 @@ long OggStream::Packet::IsHeader(IOggReader* pReader, const char* str) const
 }
 
 
+const unsigned char* OggStream::Packet::GetData() const
+{
+    if (descriptors.size() != 1)
+        return NULL;
+
+    const OggPage::Descriptor& d = descriptors.front();
+
+    if (d.len < 0)
+        return NULL;
+
+    return d.page.GetData(d.pos);
+}
+
+
 long OggPage::Match(
     const descriptors_t& dd,
     IOggReader* pReader,
@@ -943,16 +1277,25 @@ long OggPage::Match(
         long long pos = d.pos;
         const long long pos_end = d.pos + d.len;
 
+        const unsigned char* p = d.page.GetData(d.pos);
+
         while ((*str != '\0') && (pos != pos_end))
         {
             unsigned char c;
 
-            const long result = pReader->Read(pos++, 1, &c);
+            if (p)
+                c = *p++;
+            else
+            {
+                const long result = pReader->Read(pos, 1, &c);
 
-            if (result < 0)  //error
-                return result;
+                if (result < 0)  //error
+                    return result;
+            }
 
-            if (*str++ != c)
+            ++pos;
+
+            if (*str++ != static_cast<char>(c))
                 return 0;  //does not match
         }
 
@@ -1084,4 +1427,338 @@ long VorbisIdent::Read(IOggReader* pReader, const OggStream::Packet& ident)
 }
 
 
+struct OggPageRef::Buffer
+{
+    OggPagePool* pPool;
+    long cRef;
+    long long pos;  //of the first payload byte
+    std::vector<unsigned char> data;
+};
+
+
+OggPageRef::OggPageRef() : m_pBuffer(0)
+{
+}
+
+
+OggPageRef::OggPageRef(Buffer* p) : m_pBuffer(p)
+{
+    if (m_pBuffer)
+        ++m_pBuffer->cRef;
+}
+
+
+OggPageRef::OggPageRef(const OggPageRef& rhs) : m_pBuffer(rhs.m_pBuffer)
+{
+    if (m_pBuffer)
+        ++m_pBuffer->cRef;
+}
+
+
+OggPageRef::~OggPageRef()
+{
+    if (m_pBuffer && (--m_pBuffer->cRef == 0))
+        m_pBuffer->pPool->Put(m_pBuffer);
+}
+
+
+OggPageRef& OggPageRef::operator=(const OggPageRef& rhs)
+{
+    if (rhs.m_pBuffer)
+        ++rhs.m_pBuffer->cRef;
+
+    if (m_pBuffer && (--m_pBuffer->cRef == 0))
+        m_pBuffer->pPool->Put(m_pBuffer);
+
+    m_pBuffer = rhs.m_pBuffer;
+    return *this;
+}
+
+
+const unsigned char* OggPageRef::GetData(long long pos) const
+{
+    if (m_pBuffer == 0)
+        return NULL;
+
+    const std::vector<unsigned char>& data = m_pBuffer->data;
+
+    const long long off = pos - m_pBuffer->pos;
+    assert(off >= 0);
+    assert(off <= static_cast<long long>(data.size()));
+
+    if (data.empty())
+        return NULL;
+
+    return &data[0] + off;
+}
+
+
+OggPagePool::OggPagePool() : m_count(0)
+{
+}
+
+
+OggPagePool::~OggPagePool()
+{
+    assert(m_free.size() == buffers_t::size_type(m_count));
+
+    while (!m_free.empty())
+    {
+        delete m_free.back();
+        m_free.pop_back();
+    }
+}
+
+
+OggPageRef OggPagePool::Get(long long pos, long len, unsigned char*& buf)
+{
+    assert(len >= 0);
+
+    OggPageRef::Buffer* p;
+
+    if (m_free.empty())
+    {
+        p = new OggPageRef::Buffer;
+        p->pPool = this;
+        p->cRef = 0;
+
+        ++m_count;
+    }
+    else
+    {
+        p = m_free.back();
+        m_free.pop_back();
+    }
+
+    //A page is at most 65307 bytes, so a recycled buffer soon has the
+    //capacity for any page, and resizing it doesn't allocate.
+
+    p->pos = pos;
+    p->data.resize(len);
+
+    buf = p->data.empty() ? 0 : &p->data[0];
+
+    return OggPageRef(p);
+}
+
+
+void OggPagePool::Put(OggPageRef::Buffer* p)
+{
+    assert(p);
+    assert(p->pPool == this);
+    assert(p->cRef == 0);
+
+    m_free.push_back(p);
+}
+
+
+namespace
+{
+
+struct IndexHeader
+{
+    char magic[4];
+    unsigned long version;
+    long long file_size;
+    long long file_time;
+    long long count;
+};
+
+const char kIndexMagic[4] = { 'O', 'I', 'D', 'X' };
+const unsigned long kIndexVersion = 1;
+
+bool LessBySerialPos(
+    const OggPageIndex::Entry& lhs,
+    const OggPageIndex::Entry& rhs)
+{
+    if (lhs.serial_num != rhs.serial_num)
+        return (lhs.serial_num < rhs.serial_num);
+
+    return (lhs.pos < rhs.pos);
+}
+
+}  //end anonymous namespace
+
+
+OggPageIndex::OggPageIndex() : m_bDirty(false)
+{
+}
+
+
+void OggPageIndex::Clear()
+{
+    m_entries.clear();
+    m_bDirty = false;
+}
+
+
+void OggPageIndex::Add(const OggPage& page, long long pos)
+{
+    if (page.granule_pos < 0)
+        return;
+
+    Entry e;
+
+    e.pos = pos;
+    e.granule_pos = page.granule_pos;
+    e.serial_num = page.serial_num;
+    e.sequence_num = page.sequence_num;
+
+    const entries_t::iterator i = std::lower_bound(
+                                    m_entries.begin(),
+                                    m_entries.end(),
+                                    e,
+                                    LessBySerialPos);
+
+    if ((i != m_entries.end()) &&
+        (i->serial_num == e.serial_num) &&
+        (i->pos == e.pos))
+    {
+        return;  //already indexed
+    }
+
+    m_entries.insert(i, e);
+    m_bDirty = true;
+}
+
+
+void OggPageIndex::Find(
+    unsigned long serial_num,
+    long long granule_pos,
+    const Entry*& before,
+    const Entry*& after) const
+{
+    before = 0;
+    after = 0;
+
+    //Within a bitstream, granule pos increases with file position, so
+    //the entries of a bitstream are also in granule pos order.
+
+    typedef entries_t::const_iterator iter_t;
+
+    iter_t i = m_entries.begin();
+    iter_t j = m_entries.end();
+
+    while (i != j)  //lower bound of the bitstream
+    {
+        const iter_t k = i + (j - i) / 2;
+
+        if (k->serial_num < serial_num)
+            i = k + 1;
+        else
+            j = k;
+    }
+
+    const iter_t first = i;
+
+    j = m_entries.end();
+
+    while (i != j)  //first entry that doesn't precede granule_pos
+    {
+        const iter_t k = i + (j - i) / 2;
+
+        if ((k->serial_num == serial_num) && (k->granule_pos < granule_pos))
+            i = k + 1;
+        else
+            j = k;
+    }
+
+    if (i != first)
+        before = &*(i - 1);
+
+    if ((i != m_entries.end()) && (i->serial_num == serial_num))
+        after = &*i;
+}
+
+
+const OggPageIndex::entries_t& OggPageIndex::GetEntries() const
+{
+    return m_entries;
+}
+
+
+bool OggPageIndex::IsDirty() const
+{
+    return m_bDirty;
+}
+
+
+void OggPageIndex::SetDirty(bool b)
+{
+    m_bDirty = b;
+}
+
+
+void OggPageIndex::Save(
+    long long file_size,
+    long long file_time,
+    std::vector<unsigned char>& image) const
+{
+    IndexHeader h;
+
+    memcpy(h.magic, kIndexMagic, sizeof h.magic);
+    h.version = kIndexVersion;
+    h.file_size = file_size;
+    h.file_time = file_time;
+    h.count = static_cast<long long>(m_entries.size());
+
+    const size_t cb = m_entries.size() * sizeof(Entry);
+
+    image.resize(sizeof h + cb);
+    memcpy(&image[0], &h, sizeof h);
+
+    if (cb > 0)
+        memcpy(&image[sizeof h], &m_entries[0], cb);
+}
+
+
+long OggPageIndex::Load(
+    const unsigned char* image,
+    size_t len,
+    long long file_size,
+    long long file_time)
+{
+    Clear();
+
+    if ((image == 0) || (len < sizeof(IndexHeader)))
+        return E_FILE_FORMAT_INVALID;
+
+    IndexHeader h;
+    memcpy(&h, image, sizeof h);
+
+    if ((memcmp(h.magic, kIndexMagic, sizeof h.magic) != 0) ||
+        (h.version != kIndexVersion) ||
+        (h.file_size != file_size) ||
+        (h.file_time != file_time) ||
+        (h.count < 0))
+    {
+        return E_FILE_FORMAT_INVALID;
+    }
+
+    const size_t cb = len - sizeof h;
+
+    if (((cb % sizeof(Entry)) != 0) ||
+        (static_cast<long long>(cb / sizeof(Entry)) != h.count))
+    {
+        return E_FILE_FORMAT_INVALID;
+    }
+
+    m_entries.resize(cb / sizeof(Entry));
+
+    if (cb > 0)
+        memcpy(&m_entries[0], image + sizeof h, cb);
+
+    for (size_t i = 1; i < m_entries.size(); ++i)
+    {
+        if (!LessBySerialPos(m_entries[i - 1], m_entries[i]))
+        {
+            m_entries.clear();
+            return E_FILE_FORMAT_INVALID;
+        }
+    }
+
+    return 0;  //success
+}
+
+
 }  //end namespace oggparser
@@ -1,7 +1,10 @@
 #ifndef OGGPARSER_HPP
 #define OGGPARSER_HPP
 
+#include <cstddef>
+#include <deque>
 #include <list>
+#include <vector>
 
 namespace oggparser
 {
@@ -17,7 +20,7 @@ class IOggReader
 public:
     //TODO: the semantics here are still in-work:
     virtual long Read(long long pos, long len, unsigned char* buf) = 0;
-    //virtual long Length(long long* total /* , long long* available */ ) = 0;
+    virtual long Length(long long* total /* , long long* available */ ) = 0;
 protected:
     virtual ~IOggReader();
 };
@@ -29,6 +32,62 @@ long ReadInt(
     long len,
     long long& val);
 
+class OggPagePool;
+
+//A counted reference to the payload of a page, as read into a buffer
+//from an OggPagePool.  The packets of a page refer to its payload, so
+//they can be delivered without reading the file again.
+
+class OggPageRef
+{
+public:
+    OggPageRef();
+    OggPageRef(const OggPageRef&);
+    ~OggPageRef();
+
+    OggPageRef& operator=(const OggPageRef&);
+
+    //Returns the payload byte at file position pos, or NULL if this
+    //refers to no page.
+    const unsigned char* GetData(long long pos) const;
+
+    struct Buffer;
+
+private:
+    friend class OggPagePool;
+    explicit OggPageRef(Buffer*);
+
+    Buffer* m_pBuffer;
+};
+
+
+//Page buffers, recycled once the last reference to them is gone.  The
+//pool is not thread safe (the source filter's lock serializes access to
+//it), and it must outlive all of its references.
+
+class OggPagePool
+{
+    OggPagePool(const OggPagePool&);
+    OggPagePool& operator=(const OggPagePool&);
+
+public:
+    OggPagePool();
+    ~OggPagePool();
+
+    //Gets a buffer for the len payload bytes at file position pos, and
+    //points buf at it, for the caller to fill in.
+    OggPageRef Get(long long pos, long len, unsigned char*& buf);
+
+    void Put(OggPageRef::Buffer*);
+
+private:
+    typedef std::vector<OggPageRef::Buffer*> buffers_t;
+    buffers_t m_free;
+    long m_count;  //buffers allocated
+
+};
+
+
 class OggPage
 {
 public:
@@ -56,9 +115,10 @@ public:
     {
         long long pos;
         long len;
+        OggPageRef page;  //payload of the page, if it has been read
     };
 
-    typedef std::list<Descriptor> descriptors_t;
+    typedef std::vector<Descriptor> descriptors_t;
 
     static long GetLength(const descriptors_t&);
     static long Copy(
@@ -79,6 +139,72 @@ public:
     long Read(IOggReader*, long long&);
 };
 
+//The pages of a logical bitstream that earlier seeks have read, in file
+//order.  A seek only bisects the span between the indexed pages that
+//bracket its target, so as the index fills in (or once it has been loaded
+//from a previous session), seeking costs a handful of page reads.
+
+class OggPageIndex
+{
+    OggPageIndex(const OggPageIndex&);
+    OggPageIndex& operator=(const OggPageIndex&);
+
+public:
+
+    struct Entry
+    {
+        long long pos;  //of the page header
+        long long granule_pos;
+        unsigned long serial_num;
+        unsigned long sequence_num;
+    };
+
+    typedef std::vector<Entry> entries_t;
+
+    OggPageIndex();
+
+    void Clear();
+
+    //Pages whose granule pos is -1 are not indexed.
+    void Add(const OggPage&, long long pos);
+
+    //Finds the last page of the bitstream whose granule pos precedes
+    //granule_pos, and the first page that doesn't.  Either may be NULL.
+    void Find(
+        unsigned long serial_num,
+        long long granule_pos,
+        const Entry*& before,
+        const Entry*& after) const;
+
+    const entries_t& GetEntries() const;
+
+    //Whether pages have been added since the index was loaded or saved.
+    bool IsDirty() const;
+    void SetDirty(bool);
+
+    //The image is stamped with the size and time of the media file;
+    //Load rejects (returning E_FILE_FORMAT_INVALID, and leaving the index
+    //empty) an image that is damaged or belongs to another version of
+    //the file.
+    void Save(
+        long long file_size,
+        long long file_time,
+        std::vector<unsigned char>& image) const;
+
+    long Load(
+        const unsigned char* image,
+        size_t len,
+        long long file_size,
+        long long file_time);
+
+private:
+
+    entries_t m_entries;  //by serial num, then pos
+    bool m_bDirty;
+
+};
+
+
 //rfc5334.txt
 //Ogg Media Types
 
@@ -103,14 +229,33 @@ public:
         long GetLength() const;
         long Copy(IOggReader*, unsigned char* buf) const;
         long IsHeader(IOggReader*, const char*) const;
+
+        //Returns the payload in place, if it lies in one page that has
+        //been read (as most packets do), or else NULL.
+        const unsigned char* GetData() const;
     };
 
-    typedef std::list<Packet> packets_t;
+    typedef std::deque<Packet> packets_t;
 
     long Init(Packet& ident, Packet& comment, Packet& setup);
     long Reset();
     long GetPacket(Packet&);
 
+    //Positions the stream on the packet that follows the last page whose
+    //granule pos precedes granule_pos, and returns the granule pos at
+    //which that packet begins.
+    long Seek(long long granule_pos, long long& start_pos);
+
+    //Gets the granule pos of the last page of the stream.
+    long GetLastGranulePos(long long&);
+
+    OggPageIndex* GetIndex();
+
+    //The number of page headers read (by parsing, seeking, and
+    //resynchronizing), against which the reader's own read counts can
+    //be measured.
+    long long GetPageReadCount() const;
+
 private:
 
     unsigned long m_serial_num;
@@ -118,12 +263,18 @@ private:
     unsigned long m_page_base;
     long long m_pos;
     long long m_base;
+    long long m_page_reads;
 
+    long ReadPage(OggPage&, long long& pos);
     long GetPacket(Packet&, int);
     long ParsePacket(Packet&);
     long ParsePage();
+    long LoadPage(OggPage&, long long end);
+    long FindPage(long long pos, long long stop, OggPage&, long long&);
 
+    OggPagePool m_pool;  //decl must precede m_packets
     packets_t m_packets;
+    OggPageIndex m_index;
 
 };
 
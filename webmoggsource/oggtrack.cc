@@ -12,7 +12,10 @@ OggTrack::OggTrack(
     oggparser::OggStream* pStream,
     ULONG id) :
     m_pStream(pStream),
-    m_id(id)
+    m_id(id),
+    m_bDiscontinuity(true),
+    m_curr_time(0),
+    m_stop_time(-1)
 {
     //Init();
 }
@@ -30,11 +33,30 @@ void OggTrack::Reset()
     //SetCurr(0);  //lazy init this later
     //m_pStop = m_pTrack->GetEOS();  //means play entire stream
     m_bDiscontinuity = true;
+    m_curr_time = 0;
     m_pStream->Reset();
     OnReset();
 }
 
 
+LONGLONG OggTrack::GetCurrTime() const
+{
+    return m_curr_time;
+}
+
+
+LONGLONG OggTrack::GetStopTime() const
+{
+    return m_stop_time;
+}
+
+
+void OggTrack::SetStopTime(LONGLONG reftime)
+{
+    m_stop_time = reftime;
+}
+
+
 std::wstring OggTrack::GetId() const
 {
     std::wostringstream os;
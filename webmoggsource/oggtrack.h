@@ -29,6 +29,17 @@ public:
     void Reset();
     //void Stop();
 
+    //Seeking, in reftime units.  The current time is where the segment
+    //begins (the time of the last seek); a stop time of -1 means "play to
+    //the end of the stream".
+
+    virtual HRESULT Seek(LONGLONG) = 0;
+    virtual HRESULT GetDuration(LONGLONG&) = 0;
+
+    LONGLONG GetCurrTime() const;
+    LONGLONG GetStopTime() const;
+    void SetStopTime(LONGLONG);
+
     std::wstring GetId() const;    //IPin::QueryId
     std::wstring GetName() const;  //IPin::QueryPinInfo
     virtual void GetMediaTypes(CMediaTypes&) const = 0;
@@ -46,6 +57,8 @@ public:
 
 protected:
     bool m_bDiscontinuity;
+    LONGLONG m_curr_time;
+    LONGLONG m_stop_time;
     //const BlockEntry* m_pCurr;
     //const BlockEntry* m_pStop;
     //const Cluster* m_pBase;
@@ -51,6 +51,7 @@ OggTrackAudio::OggTrackAudio(
     OggTrack(pStream, id),
     m_granule_pos(0),
     m_reftime(0),
+    m_duration(-1),
     m_pfnGetSampleCount(0),
     m_pfnPopulateSamples(0)
 {
@@ -82,6 +83,66 @@ void OggTrackAudio::OnReset()
 {
     m_granule_pos = 0;
     m_reftime = 0;
+    m_packets.clear();
+}
+
+
+HRESULT OggTrackAudio::Seek(LONGLONG reftime)
+{
+    if (reftime < 0)
+        reftime = 0;
+
+    const LONGLONG rate = m_fmt.sample_rate;
+    assert(rate > 0);
+
+    const LONGLONG granule_pos = reftime * rate / 10000000;
+
+    long long start_pos;
+
+    const long result = m_pStream->Seek(granule_pos, start_pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    //The stream resumes at start_pos, which precedes the requested time,
+    //so the samples before it go downstream with negative times (relative
+    //to the new segment), for the decoder to prime itself with.
+
+    m_packets.clear();
+    m_granule_pos = start_pos;
+    m_reftime = GetReftime(start_pos);
+    m_curr_time = reftime;
+    m_bDiscontinuity = true;
+
+    return S_OK;
+}
+
+
+HRESULT OggTrackAudio::GetDuration(LONGLONG& reftime)
+{
+    if (m_duration < 0)
+    {
+        long long granule_pos;
+
+        const long result = m_pStream->GetLastGranulePos(granule_pos);
+
+        if (result < 0)
+            return E_FAIL;
+
+        m_duration = GetReftime(granule_pos);
+    }
+
+    reftime = m_duration;
+    return S_OK;
+}
+
+
+LONGLONG OggTrackAudio::GetReftime(LONGLONG granule_pos) const
+{
+    const LONGLONG rate = m_fmt.sample_rate;
+    assert(rate > 0);
+
+    return granule_pos * 10000000 / rate;
 }
 
 
@@ -377,6 +438,9 @@ long OggTrackAudio::GetPackets()
 #else
 HRESULT OggTrackAudio::GetPackets(long& count)
 {
+    if ((m_stop_time >= 0) && (m_reftime >= m_stop_time))
+        return S_FALSE;  //EOS
+
     if (!m_packets.empty())  //weird
     {
         const OggStream::Packet& pkt = m_packets.back();
@@ -395,20 +459,24 @@ HRESULT OggTrackAudio::GetPackets(long& count)
 
     for (;;)
     {
-        OggStream::Packet pkt;
+        //The stream hands the packet off into our queue, so that its
+        //descriptors (and their page references) aren't copied.
+
+        m_packets.push_back(OggStream::Packet());
+        OggStream::Packet& pkt = m_packets.back();
 
         const long result = m_pStream->GetPacket(pkt);
 
         if (result < 0)  //error (or EOF)
         {
+            m_packets.pop_back();
+
             if (result != oggparser::E_END_OF_FILE)
                 return E_FAIL;
 
             break;
         }
 
-        m_packets.push_back(pkt);
-
         if (pkt.granule_pos >= 0)
         {
             assert(m_granule_pos >= 0);
@@ -528,7 +596,10 @@ HRESULT OggTrackAudio::PopulateSamplesVorbis2(const samples_t& ss)
         hr = pSample->SetMediaTime(&curr_samples, &next_samples);
         assert(SUCCEEDED(hr));
 
-        hr = pSample->SetTime(&curr_reftime, &next_reftime);
+        LONGLONG start = curr_reftime - m_curr_time;
+        LONGLONG stop = next_reftime - m_curr_time;
+
+        hr = pSample->SetTime(&start, &stop);
         assert(SUCCEEDED(hr));
 
         curr_samples = next_samples;
@@ -561,24 +632,23 @@ HRESULT OggTrackAudio::PopulateSamplesVorbis2(const samples_t& ss)
             hr = pSample->SetMediaTime(0, 0);
             assert(SUCCEEDED(hr));
 
-            hr = pSample->SetTime(&curr_reftime, 0);
+            LONGLONG start = curr_reftime - m_curr_time;
+
+            hr = pSample->SetTime(&start, 0);
             assert(SUCCEEDED(hr));
         }
         else
         {
             m_granule_pos = granule_pos;  //next_samples
-
-            const float next_samples_ = static_cast<float>(m_granule_pos);
-
-            const float next_sec = next_samples_ / samples_per_sec;
-            const float next_reftime_ = next_sec * 10000000.0F;
-
-            m_reftime = static_cast<LONGLONG>(next_reftime_);  //next_reftime
+            m_reftime = GetReftime(m_granule_pos);  //next_reftime
 
             hr = pSample->SetMediaTime(&curr_samples, &m_granule_pos);
             assert(SUCCEEDED(hr));
 
-            hr = pSample->SetTime(&curr_reftime, &m_reftime);
+            LONGLONG start = curr_reftime - m_curr_time;
+            LONGLONG stop = m_reftime - m_curr_time;
+
+            hr = pSample->SetTime(&start, &stop);
             assert(SUCCEEDED(hr));
         }
 
@@ -834,19 +904,15 @@ HRESULT OggTrackAudio::PopulateSamplesVorbis2XiphLacing(const samples_t& ss)
     LONGLONG curr_reftime = m_reftime;
 
     m_granule_pos = granule_pos;  //next_samples
-
-    const float next_samples_ = static_cast<float>(m_granule_pos);
-    const float samples_per_sec = static_cast<float>(m_fmt.sample_rate);
-
-    const float next_sec = next_samples_ / samples_per_sec;
-    const float next_reftime_ = next_sec * 10000000.0F;
-
-    m_reftime = static_cast<LONGLONG>(next_reftime_);  //next_reftime
+    m_reftime = GetReftime(m_granule_pos);  //next_reftime
 
     hr = pSample->SetMediaTime(&curr_samples, &m_granule_pos);
     assert(SUCCEEDED(hr));
 
-    hr = pSample->SetTime(&curr_reftime, &m_reftime);
+    LONGLONG start = curr_reftime - m_curr_time;
+    LONGLONG stop = m_reftime - m_curr_time;
+
+    hr = pSample->SetTime(&start, &stop);
     assert(SUCCEEDED(hr));
 
     hr = pSample->SetDiscontinuity(m_bDiscontinuity ? TRUE : FALSE);
@@ -26,6 +26,9 @@ public:
     HRESULT GetPackets(long&);
     HRESULT PopulateSamples(const samples_t&);
 
+    HRESULT Seek(LONGLONG);
+    HRESULT GetDuration(LONGLONG&);
+
 protected:
     std::wostream& GetKind(std::wostream&) const;
     std::wstring GetCodecName() const;
@@ -39,8 +42,11 @@ protected:
     oggparser::VorbisIdent m_fmt;
     LONGLONG m_granule_pos;
     LONGLONG m_reftime;
+    LONGLONG m_duration;  //-1 until we have looked for the last page
     GUID m_subtype;
 
+    LONGLONG GetReftime(LONGLONG granule_pos) const;
+
     long (OggTrackAudio::*m_pfnGetSampleCount)() const;
     long GetSampleCountVorbis2() const;
     long GetSampleCountVorbis2XiphLacing() const;
@@ -13,6 +13,7 @@
 #include "webmoggsourceoutpin.h"
 #include "webmtypes.h"
 #include "oggtrackaudio.h"
+#include "webmindex.h"
 #include <new>
 #include <cassert>
 #include <vfwmsgs.h>
@@ -121,6 +122,7 @@ Filter::~Filter()
         delete p;
     }
 
+    SaveIndex();
     //delete m_pStream;
 
     m_pClassFactory->LockServer(FALSE);
@@ -249,6 +251,7 @@ HRESULT Filter::Stop()
             hr = lock.Seize(this);
             assert(SUCCEEDED(hr));  //TODO
 
+            SaveIndex();
             break;
 
         case State_Stopped:
@@ -586,10 +589,136 @@ HRESULT Filter::Load(LPCOLESTR filename, const AM_MEDIA_TYPE* pmt)
     m_filename = filename;
     //m_pStream = pStream;
 
+    LoadIndex();
+
     return S_OK;
 }
 
 
+void Filter::LoadIndex()
+{
+    //The page index that seeks build up is kept in "<file>.oggidx".  A
+    //missing or stale sidecar just means that the first seeks bisect the
+    //whole file.
+
+    long long file_size, file_time;
+
+    HRESULT hr = webmdshow::WebmIndex::GetFileStamp(
+                    m_filename.c_str(),
+                    &file_size,
+                    &file_time);
+
+    if (FAILED(hr))
+        return;
+
+    const wstring name = m_filename + L".oggidx";
+
+    const HANDLE h = CreateFileW(
+                        name.c_str(),
+                        GENERIC_READ,
+                        FILE_SHARE_READ,
+                        0,  //security attributes
+                        OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL,
+                        0);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    std::vector<unsigned char> image;
+
+    LARGE_INTEGER size;
+
+    if (GetFileSizeEx(h, &size) && (size.HighPart == 0) && (size.LowPart > 0))
+    {
+        image.resize(size.LowPart);
+
+        DWORD cb;
+
+        const BOOL b = ReadFile(h, &image[0], size.LowPart, &cb, 0);
+
+        if (!b || (cb != size.LowPart))
+            image.clear();
+    }
+
+    CloseHandle(h);
+
+    if (image.empty())
+        return;
+
+    OggPageIndex* const pIndex = m_stream.GetIndex();
+
+    const long result = pIndex->Load(
+                            &image[0],
+                            image.size(),
+                            file_size,
+                            file_time);
+    result;
+}
+
+
+void Filter::SaveIndex()
+{
+    OggPageIndex* const pIndex = m_stream.GetIndex();
+
+    if (!pIndex->IsDirty() || m_filename.empty())
+        return;
+
+    long long file_size, file_time;
+
+    HRESULT hr = webmdshow::WebmIndex::GetFileStamp(
+                    m_filename.c_str(),
+                    &file_size,
+                    &file_time);
+
+    if (FAILED(hr))
+        return;
+
+    std::vector<unsigned char> image;
+    pIndex->Save(file_size, file_time, image);
+
+    if (image.size() > MAXDWORD)
+        return;
+
+    //Write a temporary file and move it into place, so that a later
+    //Load never sees a partial sidecar.
+
+    const wstring name = m_filename + L".oggidx";
+    const wstring temp_name = name + L".tmp";
+
+    const HANDLE h = CreateFileW(
+                        temp_name.c_str(),
+                        GENERIC_WRITE,
+                        0,  //share mode
+                        0,  //security attributes
+                        CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL,
+                        0);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    const DWORD cb = static_cast<DWORD>(image.size());
+    DWORD cbWritten;
+
+    const BOOL b = WriteFile(h, &image[0], cb, &cbWritten, 0);
+
+    CloseHandle(h);
+
+    if (!b || (cbWritten != cb) ||
+        !MoveFileExW(
+            temp_name.c_str(),
+            name.c_str(),
+            MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(temp_name.c_str());
+        return;
+    }
+
+    pIndex->SetDirty(false);
+}
+
+
 HRESULT Filter::OggInit()
 {
     assert(m_file.IsOpen());
@@ -738,6 +867,18 @@ void Filter::OnStop()
 {
     //Final();
 
+#ifdef _DEBUG
+    OggFile::Stats stats;
+    m_file.GetStats(stats);
+
+    odbgstream os;
+    os << "webmoggsrc::OnStop: pages read=" << m_stream.GetPageReadCount()
+       << " reads=" << stats.reads
+       << " file reads=" << stats.file_reads
+       << " window hits=" << stats.hits
+       << endl;
+#endif
+
     typedef pins_t::iterator iter_t;
 
     iter_t i = m_pins.begin();
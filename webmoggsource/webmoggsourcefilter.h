@@ -129,6 +129,9 @@ private:
     typedef std::vector<Outpin*> pins_t;
     pins_t m_pins;
 
+    void LoadIndex();
+    void SaveIndex();
+
 #if 0  //TODO
 
     int GetConnectionCount() const;
@@ -17,6 +17,7 @@
 #include <sstream>
 #include <iomanip>
 #include <process.h>
+#include <limits>
 #ifdef _DEBUG
 #include "odbgstream.h"
 #include "iidstr.h"
@@ -152,13 +153,9 @@ HRESULT Outpin::QueryInterface(const IID& iid, void** ppv)
     else if (iid == __uuidof(IPin))
         pUnk = static_cast<IPin*>(this);
 
-#if 0  //TODO
-
     else if (iid == __uuidof(IMediaSeeking))
         pUnk = static_cast<IMediaSeeking*>(this);
 
-#endif  //TODO
-
     else
     {
 #if 0
@@ -403,8 +400,6 @@ HRESULT Outpin::EndFlush()
 }
 
 
-#if 0  //TODO
-
 HRESULT Outpin::GetCapabilities(DWORD* pdw)
 {
     if (pdw == 0)
@@ -534,115 +529,7 @@ HRESULT Outpin::GetDuration(LONGLONG* p)
     if (FAILED(hr))
         return hr;
 
-    using namespace mkvparser;
-
-    Segment* const pSegment = m_pStream->m_pTrack->m_pSegment;
-    assert(pSegment);
-
-    LONGLONG duration_ns = pSegment->GetDuration();
-
-    if (duration_ns >= 0)  //actually have a duration in file
-    {
-        reftime = duration_ns / 100;
-        return S_OK;
-    }
-
-    if (pSegment->Unparsed() <= 0)  //done parsing
-    {
-        const Cluster* const pCluster = pSegment->GetLast();
-
-        if ((pCluster == 0) || pCluster->EOS())
-        {
-            reftime = 0;
-            return S_OK;
-        }
-
-        duration_ns = pCluster->GetLastTime();
-        assert(duration_ns >= 0);
-
-        reftime = duration_ns / 100;
-
-        return S_OK;
-    }
-
-    if (const Cues* pCues = pSegment->GetCues())
-    {
-        const CuePoint* const pCP = pCues->GetLast();
-        assert(pCP);  //TODO
-
-        const Tracks* const pTracks = pSegment->GetTracks();
-        const ULONG count = pTracks->GetTracksCount();
-
-        for (ULONG idx = 0; idx < count; ++idx)
-        {
-            const Track* const pTrack = pTracks->GetTrackByIndex(idx);
-
-            if (pTrack == 0)
-                continue;
-
-            const CuePoint::TrackPosition* const pTP = pCP->Find(pTrack);
-
-            if (pTP == 0)
-                continue;
-
-            const BlockEntry* const pBE = pCues->GetBlock(pCP, pTP);
-
-            if ((pBE == 0) || pBE->EOS())
-                continue;
-
-            const Cluster* pCluster = pBE->GetCluster();
-            assert(pCluster);
-            assert(!pCluster->EOS());
-
-            if (pCluster->GetIndex() >= 0)  //loaded
-            {
-                const Cluster* const p = pSegment->GetLast();
-                assert(p);
-                assert(p->GetIndex() >= 0);
-
-                pCluster = p;
-            }
-            else //pre-loaded
-            {
-                for (int i = 0; i < 10; ++i)
-                {
-                    const Cluster* const p = pSegment->GetNext(pCluster);
-
-                    if ((p == 0) || p->EOS())
-                        break;
-
-                    pCluster = p;
-                }
-            }
-
-            duration_ns = pCluster->GetLastTime();
-            assert(duration_ns >= 0);
-
-            reftime = duration_ns / 100;  //reftime
-
-            return S_OK;
-        }
-    }
-
-    const long status = pSegment->LoadCluster();
-    assert(status >= 0);
-
-    {
-        const Cluster* const pCluster = pSegment->GetLast();  //best we can do
-
-        if ((pCluster == 0) || pCluster->EOS())
-        {
-            reftime = 0;
-            return S_OK;
-        }
-
-        duration_ns = pCluster->GetLastTime();
-        assert(duration_ns >= 0);
-
-        reftime = duration_ns / 100;
-
-        return S_OK;
-    }
+    return m_pTrack->GetDuration(reftime);
 }
 
 
@@ -659,11 +546,11 @@ HRESULT Outpin::GetStopPosition(LONGLONG* p)
         return hr;
 
     LONGLONG& pos = *p;
-    pos = m_pStream->GetStopTime();
+    pos = m_pTrack->GetStopTime();
 
     if (pos < 0)  //means "use duration"
     {
-        hr = GetDuration(&pos);
+        hr = m_pTrack->GetDuration(pos);
 
         if (FAILED(hr) || (pos < 0))
             return E_FAIL;  //?
@@ -685,16 +572,7 @@ HRESULT Outpin::GetCurrentPosition(LONGLONG* p)
     if (FAILED(hr))
         return hr;
 
-    LONGLONG& pos = *p;
-    pos = m_pStream->GetCurrTime();
-
-    if (pos < 0)  //means "use duration"
-    {
-        hr = GetDuration(&pos);
-
-        if (FAILED(hr) || (pos < 0))
-            return E_FAIL;
-    }
+    *p = m_pTrack->GetCurrTime();
 
     return S_OK;
 }
@@ -741,314 +619,136 @@ HRESULT Outpin::SetPositions(
     if (FAILED(hr))
         return hr;
 
-#if 0 //def _DEBUG
-    wodbgstream os;
-    os << "\nwebmsource::Outpin[" << m_id << "]::SetPos(begin): pCurr="
-       << dec << (pCurr ? *pCurr : -1)
-       << " dwCurr=0x"
-       << hex << dwCurr_
-       << " pStop="
-       << dec << (pStop ? *pStop : -1)
-       << " dwStop=0x"
-       << hex << dwStop_
-       << "; STATE=" << m_pFilter->m_state
-       << endl;
-#endif
-
     if (m_connection == 0)
         return VFW_E_NOT_CONNECTED;
 
     const DWORD dwCurrPos = dwCurr_ & AM_SEEKING_PositioningBitsMask;
     const DWORD dwStopPos = dwStop_ & AM_SEEKING_PositioningBitsMask;
 
-    if (dwCurrPos == AM_SEEKING_NoPositioning)
+    //Check for errors first, before changing any state.
+
+    switch (dwCurrPos)
     {
-        if (dwCurr_ & AM_SEEKING_ReturnTime)
-        {
-            if (pCurr == 0)
+        case AM_SEEKING_NoPositioning:
+            if ((dwCurr_ & AM_SEEKING_ReturnTime) && (pCurr == 0))
                 return E_POINTER;
 
-            *pCurr = m_pStream->GetCurrTime();
+            break;
 
-            if (*pCurr < 0)  //means "use duration"
-            {
-                hr = GetDuration(pCurr);
+        case AM_SEEKING_AbsolutePositioning:
+        case AM_SEEKING_RelativePositioning:
+            if (pCurr == 0)
+                return E_INVALIDARG;
 
-                if (FAILED(hr) || (*pCurr < 0))
-                    *pCurr = 0;  //?
-            }
-        }
+            break;
 
-        if (dwStopPos == AM_SEEKING_NoPositioning)
-        {
-            if (dwStop_ & AM_SEEKING_ReturnTime)
-            {
-                if (pStop == 0)
-                    return E_POINTER;
+        case AM_SEEKING_IncrementalPositioning:
+        default:
+            return E_INVALIDARG;  //applies only to stop pos
+    }
 
-                *pStop = m_pStream->GetStopTime();
+    switch (dwStopPos)
+    {
+        case AM_SEEKING_NoPositioning:
+            if ((dwStop_ & AM_SEEKING_ReturnTime) && (pStop == 0))
+                return E_POINTER;
 
-                if (*pStop < 0) //means "use duration"
-                {
-                    hr = GetDuration(pStop);
+            break;
 
-                    if (FAILED(hr) || (*pStop < 0))
-                        *pStop = 0;  //?
-                }
-            }
+        case AM_SEEKING_AbsolutePositioning:
+        case AM_SEEKING_RelativePositioning:
+        case AM_SEEKING_IncrementalPositioning:
+            if (pStop == 0)
+                return E_INVALIDARG;
 
-            return S_FALSE;  //no position change
-        }
+            break;
 
-        if (pStop == 0)
+        default:
             return E_INVALIDARG;
+    }
 
-        LONGLONG& tStop = *pStop;
-
-        //It makes sense to be able to adjust this during stop.
-        //However, if we're paused/running, then the thread is either
-        //still sending frames, or it has already sent EOS.  In the
-        //former case, it makes sense to be able to adjust where
-        //the running thread will stop.  But in the latter case,
-        //the thread has already terminated, and it wouldn't
-        //make any sense to restart the thread because there
-        //would be a large time gap.
-
-        m_pStream->SetStopPosition(tStop, dwStop_);
+    if ((dwCurrPos == AM_SEEKING_NoPositioning) &&
+        (dwStopPos == AM_SEEKING_NoPositioning))
+    {
+        if (dwCurr_ & AM_SEEKING_ReturnTime)
+            *pCurr = m_pTrack->GetCurrTime();
 
         if (dwStop_ & AM_SEEKING_ReturnTime)
         {
-            tStop = m_pStream->GetStopTime();
-
-            if (tStop < 0)  //means "use duration"
-            {
-                hr = GetDuration(&tStop);
+            *pStop = m_pTrack->GetStopTime();
 
-                if (FAILED(hr) || (tStop < 0))
-                    tStop = 0;  //??
-            }
+            if ((*pStop < 0) && FAILED(m_pTrack->GetDuration(*pStop)))
+                *pStop = 0;  //?
         }
 
-        //TODO: You're supposed to return S_FALSE if there has
-        //been no change in position.  Does changing only the stop
-        //position count has having changed the position?
-
-        return S_OK;
+        return S_FALSE;  //no position change
     }
 
-    //Check for errors first, before changing any state.
+    LONGLONG tCurr = m_pTrack->GetCurrTime();
 
-    if (pCurr == 0)
-        return E_INVALIDARG;
+    if (dwCurrPos == AM_SEEKING_AbsolutePositioning)
+        tCurr = *pCurr;
 
-    switch (dwCurrPos)
-    {
-        case AM_SEEKING_IncrementalPositioning:
-        default:
-            return E_INVALIDARG;  //applies only to stop pos
+    else if (dwCurrPos == AM_SEEKING_RelativePositioning)
+        tCurr += *pCurr;
 
-        case AM_SEEKING_AbsolutePositioning:
-        case AM_SEEKING_RelativePositioning:
-            break;
-    }
-
-    if (dwStopPos == AM_SEEKING_NoPositioning)
+    if (dwStopPos != AM_SEEKING_NoPositioning)
     {
-        if (((dwStop_ & AM_SEEKING_ReturnTime) != 0) && (pStop == 0))
-            return E_POINTER;
-    }
-    else if (pStop == 0)
-        return E_INVALIDARG;
+        LONGLONG tStop;
 
-    assert(pCurr);  //vetted above
-    LONGLONG& tCurr = *pCurr;
+        if (dwStopPos == AM_SEEKING_AbsolutePositioning)
+            tStop = *pStop;
 
-    if (tCurr == Filter::kNoSeek)
-        return E_INVALIDARG;  //we need a nonce value
+        else if (dwStopPos == AM_SEEKING_IncrementalPositioning)
+            tStop = tCurr + *pStop;
 
-    if (m_pFilter->m_state != State_Stopped)
-    {
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; BEGIN FLUSH: releasing filter lock; STATE="
-           << m_pFilter->m_state
-           << endl;
-#endif
-
-        lock.Release();
-
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; BEGIN FLUSH: released filter lock; "
-           << "connection->calling BeginFlush"
-           << endl;
-#endif
+        else  //relative to the current stop position
+        {
+            tStop = m_pTrack->GetStopTime();
 
-        hr = m_connection->BeginFlush();
-
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; BEGIN FLUSH: released filter lock; "
-           << "connection->called BeginFlush; "
-           << "waiting for thread termination"
-           << endl;
-#endif
+            if ((tStop < 0) && FAILED(m_pTrack->GetDuration(tStop)))
+                return E_FAIL;
 
-        assert(m_hThread);
-
-        const DWORD dw = WaitForSingleObject(m_hThread, 5000);
-        //assert(dw == WAIT_OBJECT_0);
-        if (dw == WAIT_TIMEOUT)
-            return VFW_E_TIMEOUT;
-
-        const BOOL b = CloseHandle(m_hThread);
-        assert(b);
-
-        m_hThread = 0;
-
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; END FLUSH: calling connection->EndFlush"
-           << endl;
-#endif
+            tStop += *pStop;
+        }
 
-        hr = m_connection->EndFlush();
-
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; END FLUSH: called connection->EndFlush; seizing filter lock"
-           << endl;
-#endif
+        //A stop time that is already behind a running thread just means
+        //that the thread sends EOS at its next packet.
 
-        hr = lock.Seize(m_pFilter);
-        assert(SUCCEEDED(hr));  //TODO
-
-#if 0 //def _DEBUG
-        os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-           << dec << (pCurr ? tCurr : -1)
-           << " dwCurr=0x"
-           << hex << dwCurr_
-           << " pStop="
-           << dec << (pStop ? *pStop : -1)
-           << " dwStop=0x"
-           << hex << dwStop_
-           << "; END FLUSH: seized filter lock"
-           << endl;
-#endif
+        m_pTrack->SetStopTime((tStop < 0) ? 0 : tStop);
     }
 
+    if (dwCurrPos != AM_SEEKING_NoPositioning)
+    {
+        if (m_pFilter->m_state != State_Stopped)
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
 
-#if 0 //def _DEBUG
-    os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-       << dec << (pCurr ? tCurr : -1)
-       << " pStop="
-       << dec << (pStop ? *pStop : -1)
-       << "; SET CURR POSN (begin)"
-       << endl;
-#endif
+            StopThread();  //flushes downstream
 
-    m_pFilter->SetCurrPosition(tCurr, dwCurr_, this);
+            hr = lock.Seize(m_pFilter);
+            assert(SUCCEEDED(hr));  //TODO
+        }
 
-    if (dwStopPos == AM_SEEKING_NoPositioning)
-    {
-        //TODO: I still haven't figured what should happen to the
-        //stop position if the user doesn't seek the stop time
-        //too.  For now I assume that that user wants to play
-        //the entire remainder of the stream starting from the
-        //seek time.
+        hr = m_pTrack->Seek(tCurr);
 
-        m_pStream->SetStopPositionEOS();
-    }
-    else
-    {
-        assert(pStop);  //vetted above
-        m_pStream->SetStopPosition(*pStop, dwStop_);
+        if (SUCCEEDED(hr) && (m_pFilter->m_state != State_Stopped))
+            StartThread();
     }
 
-#if 0 //def _DEBUG
-    os << "webmsource::Outpin[" << m_id << "]::SetPos(cont'd): pCurr="
-       << dec << (pCurr ? tCurr : -1)
-       << " pStop="
-       << dec << (pStop ? *pStop : -1)
-       << "; SET CURR POSN (end)"
-       << endl;
-#endif
-
     if (dwCurr_ & AM_SEEKING_ReturnTime)
-    {
-        tCurr = m_pStream->GetCurrTime();
-
-        if (tCurr < 0)  //means "use duration"
-        {
-            hr = GetDuration(&tCurr);
-
-            if (FAILED(hr) || (tCurr < 0))
-                tCurr = 0;  //?
-        }
-    }
+        *pCurr = m_pTrack->GetCurrTime();
 
     if (dwStop_ & AM_SEEKING_ReturnTime)
     {
-        assert(pStop);  //we checked this above
-        *pStop = m_pStream->GetStopTime();
-
-        if (*pStop < 0)  //means "use duration"
-        {
-            hr = GetDuration(pStop);
+        *pStop = m_pTrack->GetStopTime();
 
-            if (FAILED(hr) || (*pStop < 0))
-                *pStop = 0;  //?
-        }
+        if ((*pStop < 0) && FAILED(m_pTrack->GetDuration(*pStop)))
+            *pStop = 0;  //?
     }
 
-    if (m_pFilter->m_state != State_Stopped)
-        StartThread();
-
-#if 0 //def _DEBUG
-    os << "webmsource::Outpin[" << m_id << "]::SetPos(end): pCurr="
-       << dec << (pCurr ? tCurr : -1)
-       << " pStop="
-       << dec << (pStop ? *pStop : -1)
-       << "; DONE\n"
-       << endl;
-#endif
-
-    return S_OK;
+    return FAILED(hr) ? hr : S_OK;
 }
 
 
@@ -1116,7 +816,6 @@ HRESULT Outpin::GetPreroll(LONGLONG* p)
     return S_OK;
 }
 
-#endif
 
 
 HRESULT Outpin::GetName(PIN_INFO& i) const
@@ -1148,8 +847,25 @@ unsigned Outpin::Main()
     assert(m_connection);
     assert(bool(m_pInputPin));
 
-    //TODO: we need duration to send NewSegment
-    //HRESULT hr = m_connection->NewSegment(st, sp, 1);
+    {
+        Filter::Lock lock;
+
+        HRESULT hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return 0;
+
+        const LONGLONG st = m_pTrack->GetCurrTime();
+        LONGLONG sp = m_pTrack->GetStopTime();
+
+        if ((sp < 0) && FAILED(m_pTrack->GetDuration(sp)))
+            sp = std::numeric_limits<LONGLONG>::max();
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        hr = m_connection->NewSegment(st, sp, 1);
+    }
 
     OggTrack::samples_t samples;
 
@@ -15,8 +15,8 @@
 namespace WebmOggSource
 {
 
-class Outpin : public Pin
-               //public IMediaSeeking
+class Outpin : public Pin,
+               public IMediaSeeking
 {
     Outpin(const Outpin&);
     Outpin& operator=(const Outpin&);
@@ -73,8 +73,6 @@ public:
         REFERENCE_TIME,
         double);
 
-#if 0  //TODO
-
     //IMediaSeeking
 
     HRESULT STDMETHODCALLTYPE GetCapabilities(DWORD*);
@@ -112,8 +110,6 @@ public:
     HRESULT STDMETHODCALLTYPE GetRate(double*);
     HRESULT STDMETHODCALLTYPE GetPreroll(LONGLONG*);
 
-#endif  //TODO
-
     OggTrack* const m_pTrack;
 
 private:
@@ -0,0 +1,1071 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <objidl.h>
+#include <shlwapi.h>
+#include "webmreindex.h"
+#include "webmmuxebmlio.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+
+namespace WebmReindex
+{
+
+BufferedReader::BufferedReader() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_length(0),
+    m_base(0),
+    m_len(0),
+    m_cbRead(0)
+{
+}
+
+
+BufferedReader::~BufferedReader()
+{
+    Close();
+}
+
+
+HRESULT BufferedReader::Open(const wchar_t* filename, ULONG window_size)
+{
+    assert(m_hFile == INVALID_HANDLE_VALUE);
+
+    if (window_size == 0)
+        return E_INVALIDARG;
+
+    m_hFile = CreateFile(
+                filename,
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                0,  //security attributes
+                OPEN_EXISTING,
+                FILE_FLAG_SEQUENTIAL_SCAN,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_hFile, &size))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_length = size.QuadPart;
+    assert(m_length >= 0);
+
+    m_window.resize(window_size);
+    m_base = 0;
+    m_len = 0;
+    m_cbRead = 0;
+
+    return S_OK;
+}
+
+
+void BufferedReader::Close()
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    const BOOL b = CloseHandle(m_hFile);
+    b;
+    assert(b);
+
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_len = 0;
+}
+
+
+int BufferedReader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0) || ((pos + len) > m_length))
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    if ((pos >= m_base) && ((pos + len) <= (m_base + m_len)))
+    {
+        memcpy(buf, &m_window[size_t(pos - m_base)], len);
+        return 0;
+    }
+
+    const ULONG window_size = static_cast<ULONG>(m_window.size());
+
+    if (ULONG(len) > window_size)  //a read the window can't hold
+        return ReadAt(pos, len, buf) ? 0 : -1;
+
+    //Refill the window from here.  The walk moves forward, so the rest
+    //of the window is what it reads next.
+
+    const LONGLONG avail = m_length - pos;
+    const ULONG n = static_cast<ULONG>(
+                        (std::min)(avail, LONGLONG(window_size)));
+
+    m_len = 0;
+
+    if (!ReadAt(pos, n, &m_window[0]))
+        return -1;
+
+    m_base = pos;
+    m_len = n;
+
+    memcpy(buf, &m_window[0], len);
+    return 0;
+}
+
+
+int BufferedReader::Length(long long* total, long long* available)
+{
+    if (total)
+        *total = m_length;
+
+    if (available)
+        *available = m_length;
+
+    return 0;
+}
+
+
+LONGLONG BufferedReader::GetBytesRead() const
+{
+    return m_cbRead;
+}
+
+
+bool BufferedReader::ReadAt(LONGLONG pos, ULONG len, BYTE* buf)
+{
+    assert(m_hFile != INVALID_HANDLE_VALUE);
+
+    OVERLAPPED o;
+    memset(&o, 0, sizeof o);
+
+    o.Offset = static_cast<DWORD>(pos);
+    o.OffsetHigh = static_cast<DWORD>(pos >> 32);
+
+    DWORD cbRead;
+
+    const BOOL b = ::ReadFile(m_hFile, buf, len, &cbRead, &o);
+
+    if (!b || (cbRead != len))
+        return false;
+
+    m_cbRead += len;
+    return true;
+}
+
+
+Reindexer::Reindexer() :
+    m_pSegment(0),
+    m_cue_interval(0),
+    m_bForce(false),
+    m_bCheckCrc(false),
+    m_track(-1),
+    m_scale(0),
+    m_segment_pos(-1),
+    m_segment_size_len(0),
+    m_duration_pos(-1),
+    m_duration_size(0),
+    m_file_size(0),
+    m_end(-1),
+    m_bDamaged(false),
+    m_clusters(0),
+    m_max_timecode(0),
+    m_crc_checked(0),
+    m_crc_failed(0),
+    m_crc_failed_pos(-1)
+{
+    m_seek_head.pos = -1;
+    m_seek_head.size = -1;
+
+    m_void.pos = -1;
+    m_void.size = -1;
+}
+
+
+Reindexer::~Reindexer()
+{
+    delete m_pSegment;
+}
+
+
+void Reindexer::SetCueInterval(ULONG ms)
+{
+    m_cue_interval = ms;
+}
+
+
+void Reindexer::SetForce(bool bForce)
+{
+    m_bForce = bForce;
+}
+
+
+void Reindexer::SetCheckCrc(bool b)
+{
+    m_bCheckCrc = b;
+}
+
+
+LONGLONG Reindexer::GetFileSize() const
+{
+    return m_file_size;
+}
+
+
+LONGLONG Reindexer::GetClustersEnd() const
+{
+    return m_end;
+}
+
+
+bool Reindexer::IsDamaged() const
+{
+    return m_bDamaged;
+}
+
+
+ULONG Reindexer::GetClusterCount() const
+{
+    return m_clusters;
+}
+
+
+ULONG Reindexer::GetCueCount() const
+{
+    return m_cues.GetCount();
+}
+
+
+LONGLONG Reindexer::GetBytesRead() const
+{
+    return m_reader.GetBytesRead();
+}
+
+
+ULONG Reindexer::GetCrcCheckedCount() const
+{
+    return m_crc_checked;
+}
+
+
+ULONG Reindexer::GetCrcFailedCount() const
+{
+    return m_crc_failed;
+}
+
+
+LONGLONG Reindexer::GetCrcFailedPos() const
+{
+    return m_crc_failed_pos;
+}
+
+
+HRESULT Reindexer::Scan(const wchar_t* filename)
+{
+    if (filename == 0)
+        return E_POINTER;
+
+    if (m_pSegment)  //one file per reindexer
+        return E_UNEXPECTED;
+
+    HRESULT hr = m_reader.Open(filename);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_reader.Length(&m_file_size, 0);
+
+    hr = ParseHeaders();
+
+    if (FAILED(hr))
+        return hr;
+
+    //The interval is in ms, and the cue index wants timecode units.
+
+    const LONGLONG interval = LONGLONG(m_cue_interval) * 1000000 / m_scale;
+    m_cues.SetMinInterval(static_cast<ULONG>((std::min)(
+                            interval,
+                            LONGLONG(ULONG_MAX))));
+
+    Walk();
+
+    return S_OK;
+}
+
+
+HRESULT Reindexer::ParseHeaders()
+{
+    using namespace mkvparser;
+
+    long long pos = 0;
+
+    EBMLHeader h;
+
+    long long result = h.Parse(&m_reader, pos);
+
+    if (result < 0)
+        return E_FAIL;
+
+    result = Segment::CreateInstance(&m_reader, pos, m_pSegment);
+
+    if ((result != 0) || (m_pSegment == 0))
+        return E_FAIL;
+
+    const long status = m_pSegment->ParseHeaders();
+
+    if (status != 0)
+        return E_FAIL;
+
+    const SegmentInfo* const pInfo = m_pSegment->GetInfo();
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if ((pInfo == 0) || (pTracks == 0))
+        return E_FAIL;
+
+    m_scale = pInfo->GetTimeCodeScale();
+
+    if (m_scale <= 0)
+        return E_FAIL;
+
+    //The cues are for the first video track, as the muxer writes them,
+    //or for the first audio track of a file with no video.
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (long type = 1; (type <= 2) && (m_track < 0); ++type)
+    {
+        for (ULONG i = 0; i < n; ++i)
+        {
+            const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+            if ((pTrack != 0) && (pTrack->GetType() == type))
+            {
+                m_track = pTrack->GetNumber();
+                break;
+            }
+        }
+    }
+
+    if ((m_track <= 0) || (m_track > 255))  //the cue writer's is a byte
+        return E_FAIL;
+
+    m_segment_pos = m_pSegment->m_element_start;
+    m_segment_size_len = LONG(m_pSegment->m_start - m_segment_pos - 4);
+
+    if ((m_segment_size_len < 1) || (m_segment_size_len > 8))
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+void Reindexer::Walk()
+{
+    //The Segment's size is what we're repairing, so the walk goes to the
+    //end of the file.
+
+    const LONGLONG stop = m_file_size;
+
+    LONGLONG pos = m_pSegment->m_start;
+    LONGLONG tail = -1;  //of the Cues and Void elements after the clusters
+
+    m_end = pos;
+
+    while (pos < stop)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(&m_reader, pos, stop, e))
+            break;
+
+        if (e.id == ElementReader::kClusterID)
+        {
+            LONGLONG next;
+
+            if (!ScanCluster(e, stop, next))
+                break;
+
+            ++m_clusters;
+            tail = -1;
+
+            pos = next;
+            m_end = pos;
+
+            continue;
+        }
+
+        if (e.size < 0)  //only a cluster may have an unknown size
+            break;
+
+        const LONGLONG end = e.pos + e.size;
+
+        switch (e.id)
+        {
+            case ElementReader::kSeekHeadID:
+                if ((m_clusters == 0) && (m_seek_head.pos < 0))
+                {
+                    m_seek_head.pos = e.start;
+                    m_seek_head.size = end - e.start;
+
+                    ParseSeekHead(e);
+                }
+
+                break;
+
+            case ElementReader::kVoidID:
+                if (m_clusters > 0)
+                {
+                    if (tail < 0)
+                        tail = e.start;
+                }
+                else if ((m_seek_head.pos >= 0) &&
+                         ((m_seek_head.pos + m_seek_head.size) == e.start))
+                {
+                    m_seek_head.size = end - m_seek_head.pos;
+                }
+                else if (m_void.pos < 0)
+                {
+                    m_void.pos = e.start;
+                    m_void.size = end - e.start;
+                }
+                else if ((m_void.pos + m_void.size) == e.start)
+                    m_void.size = end - m_void.pos;
+
+                break;
+
+            case ElementReader::kInfoID:
+                ParseInfo(e);
+                tail = -1;
+                break;
+
+            case ElementReader::kCuesID:
+            {
+                const Area a = { e.start, end - e.start };
+                m_old_cues.push_back(a);
+
+                if ((m_clusters > 0) && (tail < 0))
+                    tail = e.start;
+
+                break;
+            }
+
+            default:
+                tail = -1;
+                break;
+        }
+
+        pos = end;
+        m_end = pos;
+    }
+
+    if (pos < stop)
+        m_bDamaged = !IsTruncated(pos);
+
+    //An old index after the clusters (and the Void a muxer may have
+    //reserved for it) is replaced by the new one.  One anywhere else is
+    //made void by Write.
+
+    if (tail >= 0)
+    {
+        m_end = tail;
+
+        while (!m_old_cues.empty() && (m_old_cues.back().pos >= tail))
+            m_old_cues.pop_back();
+    }
+}
+
+
+bool Reindexer::IsTruncated(LONGLONG pos)
+{
+    //The walk stopped at an element that the file ends too soon for, or
+    //at something that isn't an element at all.
+
+    if ((m_file_size - pos) < 12)  //not even a full header
+        return true;
+
+    Element e;
+
+    if (!ElementReader::ReadHeader(&m_reader, pos, LLONG_MAX, e))
+        return false;
+
+    if (e.size < 0)
+        return false;
+
+    return ((e.pos + e.size) > m_file_size);
+}
+
+
+void Reindexer::ParseSeekHead(const Element& h)
+{
+    LONGLONG pos = h.pos;
+    const LONGLONG stop = h.pos + h.size;
+
+    while (pos < stop)
+    {
+        Element s;
+
+        if (!ElementReader::ReadHeader(&m_reader, pos, stop, s))
+            return;
+
+        if (s.size < 0)
+            return;
+
+        pos = s.pos + s.size;
+
+        if (s.id != ElementReader::kSeekID)
+            continue;
+
+        SeekEntry entry = { 0, -1 };
+
+        LONGLONG p = s.pos;
+
+        while (p < pos)
+        {
+            Element c;
+
+            if (!ElementReader::ReadHeader(&m_reader, p, pos, c))
+                break;
+
+            if (c.size < 0)
+                break;
+
+            p = c.pos + c.size;
+
+            LONGLONG val;
+
+            if (!ElementReader::ReadUInt(&m_reader, c, val))
+                continue;
+
+            if ((c.id == ElementReader::kSeekIDID) && (c.size <= 4))
+                entry.id = static_cast<ULONG>(val);
+
+            else if (c.id == ElementReader::kSeekPositionID)
+                entry.pos = val;
+        }
+
+        if ((entry.id != 0) && (entry.pos >= 0))
+            m_seeks.push_back(entry);
+    }
+}
+
+
+void Reindexer::ParseInfo(const Element& info)
+{
+    LONGLONG pos = info.pos;
+    const LONGLONG stop = info.pos + info.size;
+
+    while (pos < stop)
+    {
+        Element c;
+
+        if (!ElementReader::ReadHeader(&m_reader, pos, stop, c))
+            return;
+
+        if (c.size < 0)
+            return;
+
+        if ((c.id == ElementReader::kDurationID) &&
+            ((c.size == 4) || (c.size == 8)))
+        {
+            m_duration_pos = c.pos;
+            m_duration_size = c.size;
+        }
+
+        pos = c.pos + c.size;
+    }
+}
+
+
+//Walks the children of the cluster c, timing each block and adding a
+//cue point for each keyframe of the track.  Without a size, the cluster
+//ends at the first element that can't be its child, or at a child that
+//the file ends too soon for.  Gets the position just past the cluster.
+
+bool Reindexer::ScanCluster(
+    const Element& c,
+    LONGLONG stop,
+    LONGLONG& next)
+{
+    const bool bKnown = (c.size >= 0);
+    const LONGLONG end = bKnown ? (c.pos + c.size) : stop;
+
+    LONGLONG pos = c.pos;
+    LONGLONG cluster_timecode = -1;
+    ULONG block = 0;
+
+    //The cues are added once the whole cluster has been walked, so that
+    //a damaged cluster adds none.
+
+    std::vector<WebmMuxLib::CueIndex::CuePoint> keys;
+
+    while (pos < end)
+    {
+        Element e;
+
+        if (!ElementReader::ReadHeader(&m_reader, pos, end, e))
+        {
+            if (bKnown)
+                return false;
+
+            break;  //a truncated child, which is dropped with the tail
+        }
+
+        if (!ElementReader::IsClusterChild(e.id))
+        {
+            if (bKnown)
+                return false;
+
+            break;  //the next level 1 element
+        }
+
+        if (e.size < 0)
+            return false;
+
+        LONGLONG track, timecode;
+        bool bKey;
+
+        if (e.id == ElementReader::kTimecodeID)
+        {
+            if (!ElementReader::ReadUInt(&m_reader, e, cluster_timecode))
+                return false;
+
+            pos = e.pos + e.size;
+            continue;
+        }
+        else if (e.id == ElementReader::kSimpleBlockID)
+        {
+            BYTE flags;
+
+            if (!ElementReader::ReadBlockHeader(
+                    &m_reader,
+                    e,
+                    track,
+                    timecode,
+                    flags))
+            {
+                return false;
+            }
+
+            bKey = (flags & 0x80) != 0;
+        }
+        else if (e.id == ElementReader::kBlockGroupID)
+        {
+            if (!ReadGroup(e, track, timecode, bKey))
+                return false;
+        }
+        else
+        {
+            pos = e.pos + e.size;
+            continue;
+        }
+
+        if (cluster_timecode < 0)  //a block before the cluster's time
+            return false;
+
+        ++block;
+        pos = e.pos + e.size;
+
+        const LONGLONG t = cluster_timecode + timecode;
+
+        if (t > m_max_timecode)
+            m_max_timecode = t;
+
+        if (!bKey || (track != m_track) || (t < 0) || (t > ULONG_MAX))
+            continue;
+
+        WebmMuxLib::CueIndex::CuePoint k;
+
+        k.m_pos = c.start;
+        k.m_timecode = static_cast<ULONG>(t);
+        k.m_block = block;
+        k.m_rel_pos = static_cast<ULONG>(e.start - c.pos);
+
+        keys.push_back(k);
+    }
+
+    //The payload is checked once its headers have been walked, so that
+    //it's read from the window they filled.
+
+    if (m_bCheckCrc && bKnown && !CheckCrc(c))
+        return false;
+
+    typedef std::vector<WebmMuxLib::CueIndex::CuePoint>::const_iterator iter_t;
+
+    for (iter_t i = keys.begin(); i != keys.end(); ++i)
+        m_cues.Add(i->m_pos, i->m_timecode, i->m_block, i->m_rel_pos);
+
+    next = bKnown ? end : pos;
+    return true;
+}
+
+
+//Checks the cluster c against its CRC-32, if it has one.  Returns false
+//if the cluster can't be read.
+
+bool Reindexer::CheckCrc(const Element& c)
+{
+    switch (ElementReader::CheckCrc32(&m_reader, c))
+    {
+        case ElementReader::kCrc32Match:
+            ++m_crc_checked;
+            return true;
+
+        case ElementReader::kCrc32Mismatch:
+            ++m_crc_checked;
+
+            if (m_crc_failed++ == 0)
+                m_crc_failed_pos = c.start;
+
+            return true;
+
+        case ElementReader::kCrc32ReadError:
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+
+//Gets the track and timecode of the Block in the BlockGroup g, which is
+//a keyframe if the group has no ReferenceBlock.
+
+bool Reindexer::ReadGroup(
+    const Element& g,
+    LONGLONG& track,
+    LONGLONG& timecode,
+    bool& bKey)
+{
+    LONGLONG pos = g.pos;
+    const LONGLONG stop = g.pos + g.size;
+
+    bool bBlock = false;
+    bKey = true;
+
+    while (pos < stop)
+    {
+        Element c;
+
+        if (!ElementReader::ReadHeader(&m_reader, pos, stop, c))
+            return false;
+
+        if (c.size < 0)
+            return false;
+
+        if (c.id == ElementReader::kReferenceBlockID)
+            bKey = false;
+
+        else if (c.id == ElementReader::kBlockID)
+        {
+            BYTE flags;
+
+            if (!ElementReader::ReadBlockHeader(
+                    &m_reader,
+                    c,
+                    track,
+                    timecode,
+                    flags))
+            {
+                return false;
+            }
+
+            bBlock = true;
+        }
+
+        pos = c.pos + c.size;
+    }
+
+    return bBlock;
+}
+
+
+HRESULT Reindexer::Write(const wchar_t* filename)
+{
+    if (filename == 0)
+        return E_POINTER;
+
+    if (m_pSegment == 0)  //no Scan
+        return E_UNEXPECTED;
+
+    if (m_bDamaged && !m_bForce)
+        return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+
+    m_reader.Close();  //it keeps out writers
+
+    IStream* pStream;
+
+    HRESULT hr = SHCreateStreamOnFileEx(
+                    filename,
+                    STGM_READWRITE | STGM_SHARE_EXCLUSIVE,
+                    FILE_ATTRIBUTE_NORMAL,
+                    FALSE,  //don't create
+                    0,
+                    &pStream);
+
+    if (FAILED(hr))
+        return hr;
+
+    EbmlIO::File f;
+    f.SetStream(pStream);
+
+    //An old index before the end of the clusters is made void, so that
+    //a reader that walks the file doesn't take it for the new one.
+
+    typedef std::vector<Area>::const_iterator iter_t;
+
+    for (iter_t i = m_old_cues.begin(); i != m_old_cues.end(); ++i)
+        WriteVoid(f, i->pos, i->size);
+
+    LONGLONG cues_pos = -1;  //CuePoint is mandatory, so no empty Cues
+
+    f.SetPosition(m_end);
+
+    if (m_cues.GetCount() > 0)
+    {
+        cues_pos = m_end;
+        m_cues.Write(f, static_cast<BYTE>(m_track), m_pSegment->m_start);
+    }
+
+    const LONGLONG end = f.GetPosition();
+
+    const HRESULT hrSize = WriteSegmentSize(f, end);
+    const HRESULT hrSeek = WriteSeekHead(f, cues_pos);
+
+    WriteDuration(f);
+
+    hr = f.SetSize(end);  //drop what followed the clusters
+
+    f.SetStream(0);
+
+    if (SUCCEEDED(hr))
+        hr = pStream->Commit(STGC_DEFAULT);
+
+    pStream->Release();
+
+    if (FAILED(hr))
+        return hr;
+
+    return ((hrSize == S_OK) && (hrSeek == S_OK)) ? S_OK : S_FALSE;
+}
+
+
+void Reindexer::WriteVoid(EbmlIO::File& f, LONGLONG pos, LONGLONG size)
+{
+    //The shortest size field that leaves the payload representable; a
+    //Void of any size from 2 bytes can be written.
+
+    assert(size >= 2);
+
+    for (ULONG len = 1; len <= 8; ++len)
+    {
+        const LONGLONG payload = size - 1 - len;
+        const LONGLONG max = (LONGLONG(1) << (7 * len)) - 2;
+
+        if ((payload < 0) || (payload > max))
+            continue;
+
+        f.SetPosition(pos);
+        f.WriteID1(BYTE(ElementReader::kVoidID));
+        f.WriteUInt(payload, len);
+
+        return;
+    }
+
+    assert(false);
+}
+
+
+HRESULT Reindexer::WriteSegmentSize(EbmlIO::File& f, LONGLONG end)
+{
+    const LONGLONG size = end - m_pSegment->m_start;
+    assert(size >= 0);
+
+    const ULONG len = m_segment_size_len;
+    const LONGLONG max = (LONGLONG(1) << (7 * len)) - 2;
+
+    f.SetPosition(m_segment_pos + 4);  //past the Segment ID
+
+    if (size <= max)
+    {
+        f.WriteUInt(size, len);
+        return S_OK;
+    }
+
+    //The field the file has is too short for the size, and everything
+    //after it is where it is, so say the size is unknown.
+
+    BYTE buf[8];
+
+    buf[0] = BYTE(0xFF >> (len - 1));  //the length marker, then all 1s
+
+    for (ULONG i = 1; i < len; ++i)
+        buf[i] = 0xFF;
+
+    f.Write(buf, len);
+    return S_FALSE;
+}
+
+
+HRESULT Reindexer::WriteSeekHead(EbmlIO::File& f, LONGLONG cues_pos)
+{
+    const Area& a = (m_seek_head.pos >= 0) ? m_seek_head : m_void;
+
+    if (a.pos < 0)  //nowhere to put it
+        return S_FALSE;
+
+    const LONGLONG segment_start = m_pSegment->m_start;
+
+    //The old entries are kept, except for the old index, and anything
+    //in what was dropped.  A file that had no SeekHead gets entries for
+    //the Info and Tracks too.
+
+    std::vector<SeekEntry> seeks;
+    bool bInfo = false;
+    bool bTracks = false;
+
+    typedef std::vector<SeekEntry>::const_iterator iter_t;
+
+    for (iter_t i = m_seeks.begin(); i != m_seeks.end(); ++i)
+    {
+        if (i->id == ULONG(ElementReader::kCuesID))
+            continue;
+
+        if ((segment_start + i->pos) >= m_end)
+            continue;
+
+        bInfo = bInfo || (i->id == ULONG(ElementReader::kInfoID));
+        bTracks = bTracks || (i->id == ULONG(ElementReader::kTracksID));
+
+        seeks.push_back(*i);
+    }
+
+    if (!bInfo)
+    {
+        const SeekEntry e = {
+            ElementReader::kInfoID,
+            m_pSegment->GetInfo()->m_element_start - segment_start
+        };
+
+        seeks.push_back(e);
+    }
+
+    if (!bTracks)
+    {
+        const SeekEntry e = {
+            ElementReader::kTracksID,
+            m_pSegment->GetTracks()->m_element_start - segment_start
+        };
+
+        seeks.push_back(e);
+    }
+
+    if (cues_pos >= 0)
+    {
+        const SeekEntry e = {
+            ElementReader::kCuesID,
+            cues_pos - segment_start
+        };
+
+        seeks.push_back(e);
+    }
+
+    //Each Seek is its ID (2 bytes), a 1-byte size, a SeekID with the ID
+    //of the element, and an 8-byte SeekPosition.
+
+    LONGLONG payload = 0;
+
+    for (iter_t i = seeks.begin(); i != seeks.end(); ++i)
+    {
+        const ULONG id_len = (i->id > 0xFFFFFF) ? 4 :
+                             (i->id > 0xFFFF) ? 3 :
+                             (i->id > 0xFF) ? 2 : 1;
+
+        payload += 2 + 1 + (2 + 1 + id_len) + (2 + 1 + 8);
+    }
+
+    ULONG size_len = 2;
+    LONGLONG total = 4 + size_len + payload;
+
+    if ((a.size - total) == 1)  //too small for a Void
+    {
+        ++size_len;
+        ++total;
+    }
+
+    if (total > a.size)
+        return S_FALSE;
+
+    f.SetPosition(a.pos);
+
+    f.WriteID4(ElementReader::kSeekHeadID);
+    f.WriteUInt(payload, size_len);
+
+    for (iter_t i = seeks.begin(); i != seeks.end(); ++i)
+    {
+        const ULONG id_len = (i->id > 0xFFFFFF) ? 4 :
+                             (i->id > 0xFFFF) ? 3 :
+                             (i->id > 0xFF) ? 2 : 1;
+
+        f.WriteID2(USHORT(ElementReader::kSeekID));
+        f.Write1UInt(BYTE((2 + 1 + id_len) + (2 + 1 + 8)));
+
+        f.WriteID2(USHORT(ElementReader::kSeekIDID));
+        f.Write1UInt(BYTE(id_len));
+        f.SerializeUInt(i->id, BYTE(id_len));
+
+        f.WriteID2(USHORT(ElementReader::kSeekPositionID));
+        f.Write1UInt(8);
+        f.Serialize8UInt(i->pos);
+    }
+
+    if (total < a.size)
+        WriteVoid(f, a.pos + total, a.size - total);
+
+    return S_OK;
+}
+
+
+void Reindexer::WriteDuration(EbmlIO::File& f)
+{
+    if (m_duration_pos < 0)
+        return;
+
+    //A duration that already covers the clusters is left alone: it may
+    //include the duration of the last frame, which the walk doesn't know.
+
+    const long long ns = m_pSegment->GetInfo()->GetDuration();
+    const double duration = double(m_max_timecode);  //timecode units
+
+    if ((ns >= 0) && ((double(ns) / m_scale) >= duration))
+        return;
+
+    f.SetPosition(m_duration_pos);
+
+    if (m_duration_size == 4)
+        f.Serialize4Float(static_cast<float>(duration));
+    else
+    {
+        __int64 bits;
+        memcpy(&bits, &duration, 8);
+
+        f.Serialize8UInt(bits);
+    }
+}
+
+
+}  //end namespace WebmReindex
@@ -0,0 +1,189 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include "mkvparser.hpp"
+#include "mkvparserelementreader.h"
+#include "webmmuxcues.h"
+#include <vector>
+
+namespace WebmReindex
+{
+
+//An IMkvReader over a local file, for a single pass from front to back.
+//Reads are served from a large window of the file, which is refilled
+//from the position of the first read that falls outside of it, so the
+//file is read in a few large sequential requests however small the
+//parser's reads are.
+
+class BufferedReader : public mkvparser::IMkvReader
+{
+    BufferedReader(const BufferedReader&);
+    BufferedReader& operator=(const BufferedReader&);
+
+public:
+
+    enum { kDefaultWindowSize = 8 * 1024 * 1024 };
+
+    BufferedReader();
+    virtual ~BufferedReader();
+
+    HRESULT Open(const wchar_t*, ULONG window_size = kDefaultWindowSize);
+    void Close();
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+    LONGLONG GetBytesRead() const;  //from the file
+
+private:
+
+    bool ReadAt(LONGLONG pos, ULONG len, BYTE* buf);
+
+    HANDLE m_hFile;
+    LONGLONG m_length;
+
+    std::vector<BYTE> m_window;
+    LONGLONG m_base;  //file pos of m_window[0]
+    ULONG m_len;      //bytes in the window
+
+    LONGLONG m_cbRead;
+
+};
+
+
+//Repairs the index of a WebM file in place.  Scan walks the clusters,
+//reading only their headers and the headers of their blocks, and
+//collects a cue point for each keyframe of the first video track (or
+//of the first audio track, if there is no video).  Write then appends
+//the Cues element after the last complete cluster, dropping whatever
+//follows it (a cluster cut short, or an old index), and patches the
+//header to match: the SeekHead, the size of the Segment and, if it is
+//shorter than the clusters, the Duration.  The clusters themselves are
+//never read back or rewritten.
+//
+//A tail cut short by the end of the file is dropped, but the walk also
+//stops at a cluster that is damaged, and Write won't drop what follows
+//one of those unless it is told to.
+//
+//If told to, Scan also checks each cluster that begins with a CRC-32
+//element against it, which reads the whole of those clusters.  A
+//cluster that fails is counted, but still indexed.
+//
+//Write needs room for the new SeekHead: the old SeekHead with any Void
+//elements that follow it, or a Void before the first cluster.  If there
+//is none, the Cues are still written, but the SeekHead isn't, and the
+//result is S_FALSE.  It is also S_FALSE if the Segment's size field is
+//too short for the new size, which is then written as unknown.
+
+class Reindexer
+{
+    Reindexer(const Reindexer&);
+    Reindexer& operator=(const Reindexer&);
+
+public:
+
+    Reindexer();
+    ~Reindexer();
+
+    //Keyframes closer than this to the previous cue point are not
+    //indexed.  Zero (the default) means every keyframe is indexed.
+    void SetCueInterval(ULONG ms);
+
+    //Whether Write may drop the clusters after a damaged one.
+    void SetForce(bool);
+
+    //Whether Scan checks the CRC-32 of the clusters that have one.
+    void SetCheckCrc(bool);
+
+    //Parses the headers of the file, and walks its clusters.
+    HRESULT Scan(const wchar_t* filename);
+
+    //Writes the Cues and patches the header, as Scan found them.
+    HRESULT Write(const wchar_t* filename);
+
+    LONGLONG GetFileSize() const;
+    LONGLONG GetClustersEnd() const;  //of the last complete cluster
+    bool IsDamaged() const;  //the walk stopped before a truncated tail
+    ULONG GetClusterCount() const;
+    ULONG GetCueCount() const;
+    LONGLONG GetBytesRead() const;
+
+    ULONG GetCrcCheckedCount() const;  //clusters with a CRC-32
+    ULONG GetCrcFailedCount() const;
+    LONGLONG GetCrcFailedPos() const;  //of the first that fails, or -1
+
+private:
+
+    typedef mkvparser::ElementReader ElementReader;
+    typedef ElementReader::Element Element;
+
+    struct SeekEntry
+    {
+        ULONG id;
+        LONGLONG pos;  //relative to the segment's payload
+    };
+
+    //Part of the file that may be overwritten: an element, with any
+    //Void elements that follow it.
+    struct Area
+    {
+        LONGLONG pos;
+        LONGLONG size;  //-1 if there is none
+    };
+
+    HRESULT ParseHeaders();
+    void Walk();
+    bool IsTruncated(LONGLONG pos);
+    void ParseSeekHead(const Element&);
+    void ParseInfo(const Element&);
+    bool ScanCluster(const Element&, LONGLONG stop, LONGLONG& next);
+    bool ReadGroup(const Element&, LONGLONG& track, LONGLONG& timecode,
+                   bool& key);
+    bool CheckCrc(const Element&);
+
+    static void WriteVoid(EbmlIO::File&, LONGLONG pos, LONGLONG size);
+    HRESULT WriteSegmentSize(EbmlIO::File&, LONGLONG end);
+    HRESULT WriteSeekHead(EbmlIO::File&, LONGLONG cues_pos);
+    void WriteDuration(EbmlIO::File&);
+
+    BufferedReader m_reader;
+    mkvparser::Segment* m_pSegment;
+
+    ULONG m_cue_interval;  //ms
+    bool m_bForce;
+    bool m_bCheckCrc;
+    LONGLONG m_track;
+    LONGLONG m_scale;      //timecode scale, in ns
+    LONGLONG m_segment_pos;
+    LONG m_segment_size_len;
+
+    Area m_seek_head;
+    Area m_void;           //before the first cluster
+    std::vector<SeekEntry> m_seeks;
+    std::vector<Area> m_old_cues;
+
+    LONGLONG m_duration_pos;  //of the payload, or -1
+    LONGLONG m_duration_size;
+
+    LONGLONG m_file_size;
+    LONGLONG m_end;
+    bool m_bDamaged;
+    ULONG m_clusters;
+    LONGLONG m_max_timecode;  //of any block, unscaled
+
+    ULONG m_crc_checked;
+    ULONG m_crc_failed;
+    LONGLONG m_crc_failed_pos;
+
+    WebmMuxLib::CueIndex m_cues;
+
+};
+
+}  //end namespace WebmReindex
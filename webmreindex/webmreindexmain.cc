@@ -0,0 +1,155 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "webmreindex.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+
+//Rebuilds the Cues of a WebM file in place: for a file whose muxer
+//stopped before it wrote them, or that was written live, without them.
+//The clusters are walked once, front to back, and only the header and
+//the end of the file are written; the frames are never copied.
+//
+//  webmreindex [-n] [-f] [-c] [-i interval_ms] file.webm
+//
+//  -n  walk the file and report, but don't change it
+//  -f  drop the clusters after a damaged one, too
+//  -c  check the clusters that have a CRC-32 element against it
+//  -i  the least time between cue points (every keyframe by default)
+
+using namespace WebmReindex;
+
+namespace
+{
+
+int Usage()
+{
+    fwprintf(
+        stderr,
+        L"usage: webmreindex [-n] [-f] [-c] [-i interval_ms]"
+        L" file.webm\n");
+
+    return 2;
+}
+
+}  //end anon namespace
+
+
+int wmain(int argc, wchar_t* argv[])
+{
+    bool bDryRun = false;
+    bool bForce = false;
+    bool bCheckCrc = false;
+    int interval = 0;
+    int i = 1;
+
+    while ((i < argc) && (argv[i][0] == L'-'))
+    {
+        const wchar_t* const arg = argv[i++];
+
+        if (wcscmp(arg, L"-n") == 0)
+            bDryRun = true;
+
+        else if (wcscmp(arg, L"-f") == 0)
+            bForce = true;
+
+        else if (wcscmp(arg, L"-c") == 0)
+            bCheckCrc = true;
+
+        else if ((wcscmp(arg, L"-i") == 0) && (i < argc))
+        {
+            interval = _wtoi(argv[i++]);
+
+            if (interval < 0)
+                return Usage();
+        }
+        else
+            return Usage();
+    }
+
+    if ((i + 1) != argc)
+        return Usage();
+
+    const wchar_t* const filename = argv[i];
+
+    Reindexer r;
+
+    r.SetCueInterval(ULONG(interval));
+    r.SetForce(bForce);
+    r.SetCheckCrc(bCheckCrc);
+
+    HRESULT hr = r.Scan(filename);
+
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"%s: not a WebM file (0x%08lX)\n", filename, hr);
+        return 1;
+    }
+
+    const LONGLONG end = r.GetClustersEnd();
+    const LONGLONG dropped = r.GetFileSize() - end;
+
+    wprintf(L"%s: %lu clusters, %lu cue points; clusters end at %lld\n",
+            filename,
+            r.GetClusterCount(),
+            r.GetCueCount(),
+            end);
+
+    if (dropped > 0)
+    {
+        wprintf(L"%s: %lld bytes after the clusters%s\n",
+                filename,
+                dropped,
+                r.IsDamaged() ? L", after a damaged element" : L"");
+    }
+
+    if (bCheckCrc)
+    {
+        const ULONG failed = r.GetCrcFailedCount();
+
+        wprintf(L"%s: %lu clusters checked, %lu failed",
+                filename,
+                r.GetCrcCheckedCount(),
+                failed);
+
+        if (failed > 0)
+            wprintf(L" (the first at %lld)", r.GetCrcFailedPos());
+
+        wprintf(L"\n");
+    }
+
+    wprintf(L"%s: read %lld bytes\n", filename, r.GetBytesRead());
+
+    if (bDryRun)
+        return 0;
+
+    hr = r.Write(filename);
+
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT))
+    {
+        fwprintf(stderr, L"%s: not changed; use -f to drop the clusters"
+                         L" after the damage\n", filename);
+        return 1;
+    }
+
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"%s: write failed (0x%08lX)\n", filename, hr);
+        return 1;
+    }
+
+    if (hr == S_FALSE)
+    {
+        fwprintf(stderr, L"%s: written, but the SeekHead or the Segment"
+                         L" size could not be patched\n", filename);
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "cfactory.h"
+#include "comreg.h"
+#include <cassert>
+#include <comdef.h>
+#include <uuids.h>
+#include "graphutil.h"
+#include "webmtypes.h"
+
+HMODULE g_hModule;
+static ULONG s_cLock;
+
+namespace WebmShmSink
+{
+    HRESULT CreateInstance(
+            IClassFactory*,
+            IUnknown*,
+            const IID&,
+            void**);
+
+}  //end namespace WebmShmSink
+
+namespace WebmShmSource
+{
+    HRESULT CreateInstance(
+            IClassFactory*,
+            IUnknown*,
+            const IID&,
+            void**);
+
+}  //end namespace WebmShmSource
+
+
+static CFactory s_sink_factory(&s_cLock, &WebmShmSink::CreateInstance);
+static CFactory s_source_factory(&s_cLock, &WebmShmSource::CreateInstance);
+
+
+BOOL APIENTRY DllMain(
+    HINSTANCE hModule,
+    DWORD  dwReason,
+    LPVOID)
+{
+    switch (dwReason)
+    {
+        case DLL_PROCESS_ATTACH:
+        {
+            g_hModule = hModule;
+            break;
+        }
+        case DLL_THREAD_ATTACH:
+        case DLL_THREAD_DETACH:
+        case DLL_PROCESS_DETACH:
+        default:
+            break;
+    }
+
+    return TRUE;
+}
+
+
+
+STDAPI DllCanUnloadNow()
+{
+    return s_cLock ? S_FALSE : S_OK;
+}
+
+
+STDAPI DllGetClassObject(
+    const CLSID& clsid,
+    const IID& iid,
+    void** ppv)
+{
+    if (clsid == WebmTypes::CLSID_WebmShmSink)
+        return s_sink_factory.QueryInterface(iid, ppv);
+
+    if (clsid == WebmTypes::CLSID_WebmShmSource)
+        return s_source_factory.QueryInterface(iid, ppv);
+
+    return CLASS_E_CLASSNOTAVAILABLE;
+}
+
+
+STDAPI DllUnregisterServer()
+{
+    const GraphUtil::IFilterMapper2Ptr pMapper(CLSID_FilterMapper2);
+    assert(bool(pMapper));
+
+    HRESULT hr = pMapper->UnregisterFilter(
+                    &CLSID_LegacyAmFilterCategory,
+                    0,
+                    WebmTypes::CLSID_WebmShmSink);
+
+    hr = pMapper->UnregisterFilter(
+                    &CLSID_LegacyAmFilterCategory,
+                    0,
+                    WebmTypes::CLSID_WebmShmSource);
+
+    //TODO
+    //assert(SUCCEEDED(hr));
+
+    hr = ComReg::UnRegisterCoclass(WebmTypes::CLSID_WebmShmSink);
+    hr = ComReg::UnRegisterCoclass(WebmTypes::CLSID_WebmShmSource);
+
+    return S_OK;  //TODO
+}
+
+
+STDAPI DllRegisterServer()
+{
+    std::wstring filename_;
+
+    HRESULT hr = ComReg::ComRegGetModuleFileName(g_hModule, filename_);
+    assert(SUCCEEDED(hr));
+    assert(!filename_.empty());
+
+    const wchar_t* const filename = filename_.c_str();
+
+#if _DEBUG
+    const wchar_t sinkname[] = L"WebM Shared Memory Sink Filter (Debug)";
+    const wchar_t sourcename[] = L"WebM Shared Memory Source Filter (Debug)";
+#else
+    const wchar_t sinkname[] = L"WebM Shared Memory Sink Filter";
+    const wchar_t sourcename[] = L"WebM Shared Memory Source Filter";
+#endif
+
+    hr = DllUnregisterServer();
+    assert(SUCCEEDED(hr));
+
+    hr = ComReg::RegisterCoclass(
+            WebmTypes::CLSID_WebmShmSink,
+            sinkname,
+            filename,
+            L"Webm.ShmSink",
+            L"Webm.ShmSink.1",
+            false,  //not insertable
+            false,  //not a control
+            ComReg::kBoth,  //DShow filters must support "both"
+            GUID_NULL,     //typelib
+            0,    //no version specified
+            0);   //no toolbox bitmap
+
+    assert(SUCCEEDED(hr));
+
+    hr = ComReg::RegisterCoclass(
+            WebmTypes::CLSID_WebmShmSource,
+            sourcename,
+            filename,
+            L"Webm.ShmSource",
+            L"Webm.ShmSource.1",
+            false,  //not insertable
+            false,  //not a control
+            ComReg::kBoth,  //DShow filters must support "both"
+            GUID_NULL,     //typelib
+            0,    //no version specified
+            0);   //no toolbox bitmap
+
+    assert(SUCCEEDED(hr));
+
+    const GraphUtil::IFilterMapper2Ptr pMapper(CLSID_FilterMapper2);
+    assert(bool(pMapper));
+
+    //Either filter carries any type, so neither must be picked by
+    //intelligent connect: the application adds them, and names the
+    //mapping.
+
+    enum { nMediaTypes = 1 };
+    const REGPINTYPES mediaTypes[nMediaTypes] =
+    {
+        { &MEDIATYPE_NULL, &MEDIASUBTYPE_NULL }
+    };
+
+    REGFILTERPINS inpin;
+
+    inpin.strName = 0;              //obsolete
+    inpin.bRendered = TRUE;         //the sink is a renderer
+    inpin.bOutput = FALSE;
+    inpin.bZero = FALSE;
+    inpin.bMany = FALSE;
+    inpin.clsConnectsToFilter = 0;  //obsolete
+    inpin.strConnectsToPin = 0;     //obsolete
+    inpin.nMediaTypes = nMediaTypes;
+    inpin.lpMediaType = mediaTypes;
+
+    REGFILTER2 filter;
+
+    filter.dwVersion = 1;
+    filter.dwMerit = MERIT_DO_NOT_USE;
+    filter.cPins = 1;
+    filter.rgPins = &inpin;
+
+    hr = pMapper->RegisterFilter(
+            WebmTypes::CLSID_WebmShmSink,
+            sinkname,
+            0,
+            &CLSID_LegacyAmFilterCategory,
+            0,
+            &filter);
+
+    if (FAILED(hr))
+        return hr;
+
+    REGFILTERPINS outpin;
+
+    outpin.strName = 0;              //obsolete
+    outpin.bRendered = FALSE;        //always FALSE for outpins
+    outpin.bOutput = TRUE;
+    outpin.bZero = FALSE;
+    outpin.bMany = FALSE;
+    outpin.clsConnectsToFilter = 0;  //obsolete
+    outpin.strConnectsToPin = 0;     //obsolete
+    outpin.nMediaTypes = nMediaTypes;
+    outpin.lpMediaType = mediaTypes;
+
+    filter.rgPins = &outpin;
+
+    hr = pMapper->RegisterFilter(
+            WebmTypes::CLSID_WebmShmSource,
+            sourcename,
+            0,
+            &CLSID_LegacyAmFilterCategory,
+            0,
+            &filter);
+
+    return hr;
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include <string>
+#include "webmshmsinkinpin.h"
+#include "clockable.h"
+
+namespace WebmShmSink
+{
+
+//Renders a stream into a ShmFrameRing, for a WebmShmSource filter in
+//another process (or graph) to deliver.  The "file name" set through
+//IFileSinkFilter is the name of the mapping, which the sink creates when
+//it first pauses.
+
+class Filter : public IBaseFilter,
+               public IFileSinkFilter,
+               public IAMFilterMiscFlags,
+               public CLockable
+{
+    friend HRESULT CreateInstance(
+            IClassFactory*,
+            IUnknown*,
+            const IID&,
+            void**);
+
+    Filter(IClassFactory*, IUnknown*);
+    virtual ~Filter();
+
+    Filter(const Filter&);
+    Filter& operator=(const Filter&);
+
+public:
+
+    //IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IBaseFilter
+
+    HRESULT STDMETHODCALLTYPE GetClassID(CLSID*);
+    HRESULT STDMETHODCALLTYPE Stop();
+    HRESULT STDMETHODCALLTYPE Pause();
+    HRESULT STDMETHODCALLTYPE Run(REFERENCE_TIME);
+    HRESULT STDMETHODCALLTYPE GetState(DWORD, FILTER_STATE*);
+    HRESULT STDMETHODCALLTYPE SetSyncSource(IReferenceClock*);
+    HRESULT STDMETHODCALLTYPE GetSyncSource(IReferenceClock**);
+    HRESULT STDMETHODCALLTYPE EnumPins(IEnumPins**);
+    HRESULT STDMETHODCALLTYPE FindPin(LPCWSTR, IPin**);
+    HRESULT STDMETHODCALLTYPE QueryFilterInfo(FILTER_INFO*);
+    HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
+    HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
+
+    //IFileSinkFilter
+    //
+    //The name is that of the mapping, and may only be set while the
+    //filter is stopped; the media type is ignored.
+
+    HRESULT STDMETHODCALLTYPE SetFileName(LPCOLESTR, const AM_MEDIA_TYPE*);
+    HRESULT STDMETHODCALLTYPE GetCurFile(LPOLESTR*, AM_MEDIA_TYPE*);
+
+    //IAMFilterMiscFlags
+
+    ULONG STDMETHODCALLTYPE GetMiscFlags();
+
+    //local functions
+
+    //Sends EC_COMPLETE, once the inpin has queued the end of the stream
+    //and the filter is running.
+    void OnEndOfStream();
+
+private:
+    class CNondelegating : public IUnknown
+    {
+        CNondelegating(const CNondelegating&);
+        CNondelegating& operator=(const CNondelegating&);
+
+    public:
+
+        Filter* const m_pFilter;
+        LONG m_cRef;
+
+        explicit CNondelegating(Filter*);
+        virtual ~CNondelegating();
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+        ULONG STDMETHODCALLTYPE AddRef();
+        ULONG STDMETHODCALLTYPE Release();
+
+    };
+
+    IClassFactory* const m_pClassFactory;
+    CNondelegating m_nondelegating;
+    IUnknown* const m_pOuter;  //decl must follow m_nondelegating
+    REFERENCE_TIME m_start;
+    IReferenceClock* m_clock;
+
+public:
+    FILTER_INFO m_info;
+    FILTER_STATE m_state;
+    std::wstring m_name;  //of the mapping
+    Inpin m_inpin;
+
+private:
+    bool m_bEndOfStream;  //seen by the inpin, but EC_COMPLETE not sent
+
+};
+
+
+}  //end namespace WebmShmSink
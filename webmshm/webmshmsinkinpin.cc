@@ -0,0 +1,714 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "webmshmsinkfilter.h"
+#include "webmshmsinkinpin.h"
+#include "cshmsample.h"
+#include "mediatypeutil.h"
+#include <vfwmsgs.h>
+#include <uuids.h>
+#include <cassert>
+#ifdef _DEBUG
+#include "odbgstream.h"
+using std::endl;
+#endif
+
+using webmdshow::ShmFrameRing;
+
+namespace WebmShmSink
+{
+
+Inpin::Inpin(Filter* pFilter) :
+    m_pFilter(pFilter),
+    m_id(L"input"),
+    m_bEndOfStream(false),
+    m_bFlush(false)
+{
+}
+
+
+Inpin::~Inpin()
+{
+    assert(!bool(m_pPinConnection));
+}
+
+
+HRESULT Inpin::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IPin*>(this);
+
+    else if (iid == __uuidof(IPin))
+        pUnk = static_cast<IPin*>(this);
+
+    else if (iid == __uuidof(IMemInputPin))
+        pUnk = static_cast<IMemInputPin*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG Inpin::AddRef()
+{
+    return m_pFilter->AddRef();
+}
+
+
+ULONG Inpin::Release()
+{
+    return m_pFilter->Release();
+}
+
+
+HRESULT Inpin::Connect(IPin*, const AM_MEDIA_TYPE*)
+{
+    return E_UNEXPECTED;  //for output pins only
+}
+
+
+HRESULT Inpin::ReceiveConnection(
+    IPin* pin,
+    const AM_MEDIA_TYPE* pmt)
+{
+    if (pin == 0)
+        return E_INVALIDARG;
+
+    if (pmt == 0)
+        return E_INVALIDARG;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pFilter->m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (bool(m_pPinConnection))
+        return VFW_E_ALREADY_CONNECTED;
+
+    m_connection_mtv.Clear();
+
+    hr = QueryAccept(pmt);
+
+    if (hr != S_OK)
+        return VFW_E_TYPE_NOT_ACCEPTED;
+
+    hr = m_connection_mtv.Add(*pmt);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_pPinConnection = pin;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::Disconnect()
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pFilter->m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (!bool(m_pPinConnection))
+        return S_FALSE;
+
+    m_pPinConnection = 0;
+    m_connection_mtv.Clear();
+    m_pAllocator = 0;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::ConnectedTo(IPin** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    IPin*& p = *pp;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    p = m_pPinConnection;
+
+    if (p == 0)
+        return VFW_E_NOT_CONNECTED;
+
+    p->AddRef();
+    return S_OK;
+}
+
+
+HRESULT Inpin::ConnectionMediaType(AM_MEDIA_TYPE* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    const CMediaTypes& mtv = m_connection_mtv;
+    assert(mtv.Size() == 1);
+
+    return mtv.Copy(0, *p);
+}
+
+
+HRESULT Inpin::QueryPinInfo(PIN_INFO* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    PIN_INFO& i = *p;
+
+    i.pFilter = static_cast<IBaseFilter*>(m_pFilter);
+    i.pFilter->AddRef();
+
+    i.dir = PINDIR_INPUT;
+
+    enum { size = sizeof(i.achName)/sizeof(WCHAR) };
+
+    const errno_t e = wcscpy_s(i.achName, size, m_id.c_str());
+    e;
+    assert(e == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::QueryDirection(PIN_DIRECTION* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    *p = PINDIR_INPUT;
+    return S_OK;
+}
+
+
+HRESULT Inpin::QueryId(LPWSTR* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    wchar_t*& id = *p;
+
+    const size_t len = m_id.length();            //wchar strlen
+    const size_t buflen = len + 1;               //wchar strlen + wchar null
+    const size_t cb = buflen * sizeof(wchar_t);  //total bytes
+
+    id = (wchar_t*)CoTaskMemAlloc(cb);
+
+    if (id == 0)
+        return E_OUTOFMEMORY;
+
+    const errno_t e = wcscpy_s(id, buflen, m_id.c_str());
+    e;
+    assert(e == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
+{
+    if (pmt == 0)
+        return E_INVALIDARG;
+
+    const AM_MEDIA_TYPE& mt = *pmt;
+
+    //The type is copied into the header of the mapping, for the source
+    //to offer downstream; the frames themselves are opaque here.
+
+    if (mt.cbFormat > ShmFrameRing::kMaxFormatSize)
+        return S_FALSE;
+
+    if ((mt.cbFormat > 0) && (mt.pbFormat == 0))
+        return S_FALSE;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::EnumMediaTypes(IEnumMediaTypes** pp)
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    return m_connection_mtv.CreateEnum(this, pp);
+}
+
+
+HRESULT Inpin::QueryInternalConnections(
+    IPin** pa,
+    ULONG* pn)
+{
+    if (pn == 0)
+        return E_POINTER;
+
+    ULONG& n = *pn;
+
+    if ((n > 0) && (pa == 0))
+    {
+        n = 0;
+        return E_POINTER;
+    }
+
+    n = 0;  //a renderer has no output pins
+    return S_OK;
+}
+
+
+HRESULT Inpin::EndOfStream()
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "webmshmsink::inpin::EOS" << endl;
+#endif
+
+    if (m_bFlush)
+        return S_FALSE;
+
+    if (m_pFilter->m_state == State_Stopped)
+        return VFW_E_WRONG_STATE;
+
+    if (m_bEndOfStream)
+        return S_OK;
+
+    m_bEndOfStream = true;
+
+    ShmFrameRing* const pRing = CShmSample::GetRing(m_pShmAllocator);
+
+    //The queue has room for every slot and the end of the stream besides,
+    //so this only fails if the consumer never read an earlier end.
+
+    hr = pRing->PublishEndOfStream();
+
+    m_pFilter->OnEndOfStream();
+
+    return hr;
+}
+
+
+HRESULT Inpin::BeginFlush()
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    //Frames already published belong to the consumer, and the flush is
+    //not carried across to it.  Blocking calls to Receive, waiting for
+    //the consumer to free a slot, are released.
+
+    m_bFlush = true;
+
+    if (bool(m_pShmAllocator))
+        CShmSample::SetAbort(m_pShmAllocator, true);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::EndFlush()
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    m_bFlush = false;
+    m_bEndOfStream = false;
+
+    if (bool(m_pShmAllocator) && (m_pFilter->m_state != State_Stopped))
+        CShmSample::SetAbort(m_pShmAllocator, false);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::NewSegment(
+    REFERENCE_TIME,
+    REFERENCE_TIME,
+    double)
+{
+    return S_OK;
+}
+
+
+HRESULT Inpin::GetAllocator(IMemAllocator** p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    *p = 0;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    hr = CreateShmAllocator();
+
+    if (FAILED(hr))
+        return hr;
+
+    *p = m_pShmAllocator;
+    (*p)->AddRef();
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::NotifyAllocator(
+    IMemAllocator* pAllocator,
+    BOOL)
+{
+    if (pAllocator == 0)
+        return E_INVALIDARG;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    ALLOCATOR_PROPERTIES props;
+
+    hr = pAllocator->GetProperties(&props);
+
+    if (FAILED(hr))
+        return hr;
+
+    //Samples of another allocator are copied into a slot each, so a
+    //slot must hold the biggest of them.
+
+    if (props.cbBuffer <= 0)
+        return VFW_E_SIZENOTSET;
+
+    m_pAllocator = pAllocator;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::GetAllocatorRequirements(ALLOCATOR_PROPERTIES* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    ALLOCATOR_PROPERTIES& props = *p;
+
+    props.cBuffers = kDefaultSlots;
+    props.cbBuffer = 0;  //let upstream decide
+    props.cbAlign = 1;
+    props.cbPrefix = 0;
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::Receive(IMediaSample* pSample)
+{
+    if (pSample == 0)
+        return E_INVALIDARG;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    if (m_pFilter->m_state == State_Stopped)
+        return VFW_E_WRONG_STATE;
+
+    if (m_bFlush)
+        return S_FALSE;
+
+    if (m_bEndOfStream)
+        return VFW_E_SAMPLE_REJECTED_EOS;
+
+    //The media type in the mapping is fixed when the ring is created, so
+    //a dynamic format change can't be carried across.
+
+    AM_MEDIA_TYPE* pmt;
+
+    hr = pSample->GetMediaType(&pmt);
+
+    if (hr == S_OK)
+    {
+        const bool bEqual = MediaTypeUtil::Equal(*pmt, m_connection_mtv[0]);
+        MediaTypeUtil::Free(pmt);
+
+        if (!bEqual)
+            return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    const GraphUtil::IMemAllocatorPtr pShmAllocator(m_pShmAllocator);
+    const bool bShm = (m_pAllocator == m_pShmAllocator);
+
+    //Publishing a copy may wait for the consumer to free a slot, which
+    //must not hold up Stop or BeginFlush.
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    if (bShm)
+        return CShmSample::Publish(pSample);
+
+    return CShmSample::PublishCopy(pShmAllocator, pSample);
+}
+
+
+HRESULT Inpin::ReceiveMultiple(
+    IMediaSample** pSamples,
+    long n,    //in
+    long* pm)  //out
+{
+    if (pm == 0)
+        return E_POINTER;
+
+    long& m = *pm;
+    m = 0;
+
+    if (n <= 0)
+        return S_OK;  //weird
+
+    if (pSamples == 0)
+        return E_INVALIDARG;
+
+    for (long i = 0; i < n; ++i)
+    {
+        IMediaSample* const pSample = pSamples[i];
+        assert(pSample);
+
+        const HRESULT hr = Receive(pSample);
+
+        if (hr != S_OK)
+            return hr;
+
+        ++m;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::ReceiveCanBlock()
+{
+    return S_OK;  //until the consumer frees a slot
+}
+
+
+HRESULT Inpin::Start()
+{
+    //Called with the filter locked.
+
+    m_bEndOfStream = false;
+    m_bFlush = false;
+
+    if (!bool(m_pPinConnection))
+        return S_FALSE;
+
+    HRESULT hr = CreateShmAllocator();
+
+    if (FAILED(hr))
+        return hr;
+
+    CShmSample::SetAbort(m_pShmAllocator, false);
+
+    return CreateRing();
+}
+
+
+void Inpin::Stop()
+{
+    //Called with the filter locked.
+
+    if (bool(m_pShmAllocator))
+        CShmSample::SetAbort(m_pShmAllocator, true);
+}
+
+
+void Inpin::Close()
+{
+    //Called with the filter locked, and stopped.
+
+    if (bool(m_pShmAllocator))
+        CShmSample::GetRing(m_pShmAllocator)->Close();
+}
+
+
+HRESULT Inpin::CreateShmAllocator()
+{
+    if (bool(m_pShmAllocator))
+        return S_FALSE;
+
+    IMemAllocator* p;
+
+    const HRESULT hr = CShmSample::CreateAllocator(true, &p);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_pShmAllocator.Attach(p);
+
+    return S_OK;
+}
+
+
+HRESULT Inpin::CreateRing()
+{
+    const std::wstring& name = m_pFilter->m_name;
+
+    if (name.empty())
+        return VFW_E_WRONG_STATE;  //SetFileName first
+
+    //The allocator that upstream settled on says how many frames it
+    //keeps in flight, and how big they get; that is what the ring holds,
+    //whether its slots are that allocator's buffers or copies of them.
+
+    if (!bool(m_pAllocator))
+        return VFW_E_NO_ALLOCATOR;
+
+    ALLOCATOR_PROPERTIES props;
+
+    HRESULT hr = m_pAllocator->GetProperties(&props);
+
+    if (FAILED(hr))
+        return hr;
+
+    long count = props.cBuffers;
+
+    if (count < 2)
+        count = 2;
+    else if (count > ShmFrameRing::kMaxSlots)
+        count = ShmFrameRing::kMaxSlots;
+
+    const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+
+    ShmFrameRing* const pRing = CShmSample::GetRing(m_pShmAllocator);
+
+    //A consumer may still have the mapping open from the last time the
+    //graph ran, so it is kept for as long as the stream still fits.
+
+    if (pRing->is_open())
+    {
+        AM_MEDIA_TYPE ring_mt;
+
+        hr = pRing->GetMediaType(&ring_mt);
+
+        if (SUCCEEDED(hr))
+        {
+            const bool bFits = (pRing->name() == name) &&
+                               (pRing->slot_size() >= props.cbBuffer) &&
+                               MediaTypeUtil::Equal(ring_mt, mt);
+
+            MediaTypeUtil::Destroy(ring_mt);
+
+            if (bFits)
+                return S_OK;
+        }
+
+        pRing->Close();
+    }
+
+    hr = pRing->Create(name.c_str(), count, props.cbBuffer, mt);
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "webmshmsink::inpin::CreateRing: slots=" << count
+       << " size=" << props.cbBuffer
+       << " hr=0x" << std::hex << hr << std::dec
+       << endl;
+#endif
+
+    return hr;
+}
+
+
+}  //end namespace WebmShmSink
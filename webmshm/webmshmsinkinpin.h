@@ -0,0 +1,128 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include <string>
+#include "cmediatypes.h"
+#include "graphutil.h"
+
+namespace WebmShmSink
+{
+
+class Filter;
+
+//Accepts any media type whose format block fits in the ring.  The pin
+//offers an allocator whose samples are slots of the ring, so that an
+//upstream filter that uses it writes each frame straight into shared
+//memory, and Receive only publishes the slot; the frames of any other
+//allocator are copied into a slot first.
+
+class Inpin : public IPin, public IMemInputPin
+{
+    Inpin(const Inpin&);
+    Inpin& operator=(const Inpin&);
+
+public:
+    explicit Inpin(Filter*);
+    ~Inpin();
+
+    enum { kDefaultSlots = 6 };  //as GetAllocatorRequirements asks
+
+    Filter* const m_pFilter;
+    const std::wstring m_id;
+    CMediaTypes m_connection_mtv;  //only one of these
+    GraphUtil::IPinPtr m_pPinConnection;
+
+    //IUnknown interface:
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IPin interface:
+
+    HRESULT STDMETHODCALLTYPE Connect(IPin*, const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE ReceiveConnection(
+        IPin*,
+        const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE Disconnect();
+
+    HRESULT STDMETHODCALLTYPE ConnectedTo(IPin**);
+
+    HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO*);
+
+    HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION*);
+
+    HRESULT STDMETHODCALLTYPE QueryId(LPWSTR*);
+
+    HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes**);
+
+    HRESULT STDMETHODCALLTYPE QueryInternalConnections(
+        IPin**,
+        ULONG*);
+
+    HRESULT STDMETHODCALLTYPE EndOfStream();
+
+    HRESULT STDMETHODCALLTYPE BeginFlush();
+
+    HRESULT STDMETHODCALLTYPE EndFlush();
+
+    HRESULT STDMETHODCALLTYPE NewSegment(
+        REFERENCE_TIME,
+        REFERENCE_TIME,
+        double);
+
+    //IMemInputPin
+
+    HRESULT STDMETHODCALLTYPE GetAllocator(
+        IMemAllocator**);
+
+    HRESULT STDMETHODCALLTYPE NotifyAllocator(
+        IMemAllocator*,
+        BOOL);
+
+    HRESULT STDMETHODCALLTYPE GetAllocatorRequirements(ALLOCATOR_PROPERTIES*);
+
+    HRESULT STDMETHODCALLTYPE Receive(IMediaSample*);
+
+    HRESULT STDMETHODCALLTYPE ReceiveMultiple(
+        IMediaSample**,
+        long,
+        long*);
+
+    HRESULT STDMETHODCALLTYPE ReceiveCanBlock();
+
+    //local functions
+
+    HRESULT Start();  //from stopped to running/paused
+    void Stop();      //from running/paused to stopped
+
+    //Closes the ring, for a new name.
+    void Close();
+
+private:
+    GraphUtil::IMemAllocatorPtr m_pShmAllocator;  //holds the ring
+    GraphUtil::IMemAllocatorPtr m_pAllocator;     //as notified
+
+    bool m_bEndOfStream;
+    bool m_bFlush;
+
+    HRESULT CreateShmAllocator();
+    HRESULT CreateRing();
+
+};
+
+
+}  //end namespace WebmShmSink
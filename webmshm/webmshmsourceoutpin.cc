@@ -0,0 +1,558 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "webmshmsourcefilter.h"
+#include "webmshmsourceoutpin.h"
+#include "cshmsample.h"
+#include "mediatypeutil.h"
+#include <vfwmsgs.h>
+#include <uuids.h>
+#include <cassert>
+#include <process.h>
+#ifdef _DEBUG
+#include "odbgstream.h"
+#include <iomanip>
+using std::endl;
+using std::dec;
+using std::hex;
+#endif
+
+using webmdshow::ShmFrameRing;
+
+namespace WebmShmSource
+{
+
+Outpin::Outpin(Filter* pFilter) :
+    m_pFilter(pFilter),
+    m_id(L"output"),
+    m_hThread(0)
+{
+}
+
+
+Outpin::~Outpin()
+{
+    assert(m_hThread == 0);
+    assert(!bool(m_pInputPin));
+}
+
+
+HRESULT Outpin::Open(const wchar_t* name)
+{
+    //Called with the filter locked.
+
+    assert(!bool(m_pAllocator));
+
+    IMemAllocator* p;
+
+    HRESULT hr = CShmSample::CreateAllocator(false, &p);
+
+    if (FAILED(hr))
+        return hr;
+
+    GraphUtil::IMemAllocatorPtr pAllocator;
+    pAllocator.Attach(p);
+
+    ShmFrameRing* const pRing = CShmSample::GetRing(pAllocator);
+
+    hr = pRing->Open(name);
+
+    if (FAILED(hr))
+        return hr;
+
+    AM_MEDIA_TYPE mt;
+
+    hr = pRing->GetMediaType(&mt);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_preferred_mtv.Clear();
+    hr = m_preferred_mtv.Add(mt);
+
+    MediaTypeUtil::Destroy(mt);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_pAllocator = pAllocator;
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::Start()  //transition from stopped
+{
+    if (m_pPinConnection == 0)
+        return S_FALSE;  //nothing we need to do
+
+    assert(bool(m_pAllocator));
+    assert(bool(m_pInputPin));
+
+    CShmSample::SetAbort(m_pAllocator, false);
+
+    const HRESULT hr = m_pAllocator->Commit();
+
+    if (FAILED(hr))
+        return hr;
+
+    StartThread();
+
+    return S_OK;
+}
+
+
+void Outpin::Stop()  //transition to stopped
+{
+    if (m_pPinConnection == 0)
+        return;  //nothing was done
+
+    assert(bool(m_pAllocator));
+    assert(bool(m_pInputPin));
+
+    //The thread may be waiting for the sink to publish a frame, which
+    //Decommit alone doesn't interrupt.
+
+    CShmSample::SetAbort(m_pAllocator, true);
+
+    const HRESULT hr = m_pAllocator->Decommit();
+    hr;
+    assert(SUCCEEDED(hr));
+
+    StopThread();
+}
+
+
+HRESULT Outpin::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if (iid == __uuidof(IUnknown))
+        pUnk = static_cast<IPin*>(this);
+
+    else if (iid == __uuidof(IPin))
+        pUnk = static_cast<IPin*>(this);
+
+    else
+    {
+        pUnk = 0;
+        return E_NOINTERFACE;
+    }
+
+    pUnk->AddRef();
+    return S_OK;
+}
+
+
+ULONG Outpin::AddRef()
+{
+    return m_pFilter->AddRef();
+}
+
+
+ULONG Outpin::Release()
+{
+    return m_pFilter->Release();
+}
+
+
+HRESULT Outpin::Connect(
+    IPin* pin,
+    const AM_MEDIA_TYPE* pmt)
+{
+    if (pin == 0)
+        return E_POINTER;
+
+    GraphUtil::IMemInputPinPtr pInputPin;
+
+    HRESULT hr = pin->QueryInterface(&pInputPin);
+
+    if (hr != S_OK)
+        return hr;
+
+    Filter::Lock lock;
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pFilter->m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (bool(m_pPinConnection))
+        return VFW_E_ALREADY_CONNECTED;
+
+    if (!bool(m_pAllocator))
+        return VFW_E_NO_TYPES;  //not loaded yet
+
+    if ((pmt != 0) && (QueryAccept(pmt) != S_OK))
+        return VFW_E_TYPE_NOT_ACCEPTED;
+
+    const AM_MEDIA_TYPE& mt = m_preferred_mtv[0];
+
+    hr = pin->ReceiveConnection(this, &mt);
+
+    if (FAILED(hr))
+        return hr;
+
+    //The frames are in the slots already, so downstream gets our
+    //allocator, sized as the sink made the ring, whatever it asks for.
+
+    const ShmFrameRing* const pRing = CShmSample::GetRing(m_pAllocator);
+
+    ALLOCATOR_PROPERTIES props, actual;
+
+    props.cBuffers = pRing->slot_count();
+    props.cbBuffer = pRing->slot_size();
+    props.cbAlign = 1;
+    props.cbPrefix = 0;
+
+    hr = m_pAllocator->SetProperties(&props, &actual);
+
+    if (SUCCEEDED(hr))
+        hr = pInputPin->NotifyAllocator(m_pAllocator, TRUE);  //read-only
+
+    if (FAILED(hr))
+    {
+        const HRESULT hrDisconnect = pin->Disconnect();
+        hrDisconnect;
+
+        return VFW_E_NO_ALLOCATOR;
+    }
+
+    m_connection_mtv.Clear();
+    m_connection_mtv.Add(mt);
+
+    m_pPinConnection = pin;
+    m_pInputPin = pInputPin;
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::ReceiveConnection(
+    IPin*,
+    const AM_MEDIA_TYPE*)
+{
+    return E_UNEXPECTED;  //for input pins only
+}
+
+
+HRESULT Outpin::Disconnect()
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pFilter->m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (!bool(m_pPinConnection))
+        return S_FALSE;
+
+    m_pInputPin = 0;
+    m_pPinConnection = 0;
+    m_connection_mtv.Clear();
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::ConnectedTo(IPin** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    IPin*& p = *pp;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    p = m_pPinConnection;
+
+    if (p == 0)
+        return VFW_E_NOT_CONNECTED;
+
+    p->AddRef();
+    return S_OK;
+}
+
+
+HRESULT Outpin::ConnectionMediaType(AM_MEDIA_TYPE* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    const CMediaTypes& mtv = m_connection_mtv;
+    assert(mtv.Size() == 1);
+
+    return mtv.Copy(0, *p);
+}
+
+
+HRESULT Outpin::QueryPinInfo(PIN_INFO* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    PIN_INFO& i = *p;
+
+    i.pFilter = static_cast<IBaseFilter*>(m_pFilter);
+    i.pFilter->AddRef();
+
+    i.dir = PINDIR_OUTPUT;
+
+    enum { size = sizeof(i.achName)/sizeof(WCHAR) };
+
+    const errno_t e = wcscpy_s(i.achName, size, m_id.c_str());
+    e;
+    assert(e == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::QueryDirection(PIN_DIRECTION* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    *p = PINDIR_OUTPUT;
+    return S_OK;
+}
+
+
+HRESULT Outpin::QueryId(LPWSTR* p)
+{
+    if (p == 0)
+        return E_POINTER;
+
+    wchar_t*& id = *p;
+
+    const size_t len = m_id.length();            //wchar strlen
+    const size_t buflen = len + 1;               //wchar strlen + wchar null
+    const size_t cb = buflen * sizeof(wchar_t);  //total bytes
+
+    id = (wchar_t*)CoTaskMemAlloc(cb);
+
+    if (id == 0)
+        return E_OUTOFMEMORY;
+
+    const errno_t e = wcscpy_s(id, buflen, m_id.c_str());
+    e;
+    assert(e == 0);
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
+{
+    if (pmt == 0)
+        return E_INVALIDARG;
+
+    Filter::Lock lock;
+
+    const HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_preferred_mtv.Empty())
+        return VFW_E_NO_TYPES;
+
+    const AM_MEDIA_TYPE& mt = m_preferred_mtv[0];
+
+    //The frames can't be converted, so the only type is the sink's;
+    //a partial type, as from RenderFile, must match as far as it goes.
+
+    if (pmt->majortype != mt.majortype)
+        return S_FALSE;
+
+    if ((pmt->subtype != GUID_NULL) && (pmt->subtype != mt.subtype))
+        return S_FALSE;
+
+    if (pmt->formattype == GUID_NULL)
+        return S_OK;
+
+    return MediaTypeUtil::Equal(*pmt, mt) ? S_OK : S_FALSE;
+}
+
+
+HRESULT Outpin::EnumMediaTypes(IEnumMediaTypes** pp)
+{
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    return m_preferred_mtv.CreateEnum(this, pp);
+}
+
+
+HRESULT Outpin::QueryInternalConnections(IPin** pa, ULONG* pn)
+{
+    if (pn == 0)
+        return E_POINTER;
+
+    ULONG& n = *pn;
+
+    if ((n > 0) && (pa == 0))
+    {
+        n = 0;
+        return E_POINTER;
+    }
+
+    n = 0;  //a source has no input pins
+    return S_OK;
+}
+
+
+HRESULT Outpin::EndOfStream()
+{
+    return E_UNEXPECTED;  //for inpins only
+}
+
+
+HRESULT Outpin::BeginFlush()
+{
+    return E_UNEXPECTED;  //for inpins only
+}
+
+
+HRESULT Outpin::EndFlush()
+{
+    return E_UNEXPECTED;  //for inpins only
+}
+
+
+HRESULT Outpin::NewSegment(
+    REFERENCE_TIME,
+    REFERENCE_TIME,
+    double)
+{
+    return E_UNEXPECTED;
+}
+
+
+void Outpin::StartThread()
+{
+    assert(m_hThread == 0);
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Outpin::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "webmshmsource::Outpin::StartThread: hThread=0x"
+       << hex << h << dec
+       << endl;
+#endif
+}
+
+
+void Outpin::StopThread()
+{
+    if (m_hThread == 0)
+        return;
+
+    const DWORD dw = WaitForSingleObject(m_hThread, 5000);
+    assert(dw == WAIT_OBJECT_0);
+
+    const BOOL b = CloseHandle(m_hThread);
+    assert(b);
+
+    m_hThread = 0;
+}
+
+
+unsigned Outpin::ThreadProc(void* pv)
+{
+    Outpin* const pPin = static_cast<Outpin*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned Outpin::Main()
+{
+    assert(bool(m_pPinConnection));
+    assert(bool(m_pInputPin));
+
+    //The pointers don't change until the filter stops, which waits for
+    //this thread first, so the filter isn't locked here.
+
+    for (;;)
+    {
+        GraphUtil::IMediaSamplePtr pSample;
+
+        HRESULT hr = m_pAllocator->GetBuffer(&pSample, 0, 0, 0);
+
+        if (hr == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+        {
+#ifdef _DEBUG
+            odbgstream os;
+            os << "webmshmsource::outpin::EOS: calling pin->EOS" << endl;
+#endif
+
+            hr = m_pPinConnection->EndOfStream();
+            return 0;
+        }
+
+        if (FAILED(hr))  //aborted or decommitted
+            return 0;
+
+        hr = m_pInputPin->Receive(pSample);
+
+        if (hr != S_OK)  //downstream is stopping or flushing
+            return 0;
+    }
+}
+
+
+}  //end namespace WebmShmSource
@@ -0,0 +1,107 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <strmif.h>
+#include <string>
+#include "cmediatypes.h"
+#include "graphutil.h"
+
+namespace WebmShmSource
+{
+
+class Filter;
+
+//Offers the media type stored in the mapping, and insists on its own
+//allocator, whose samples are the slots the sink published: each frame
+//is delivered downstream in place, read-only, and its slot is freed
+//when downstream releases the sample.
+
+class Outpin : public IPin
+{
+    Outpin(const Outpin&);
+    Outpin& operator=(const Outpin&);
+
+public:
+    explicit Outpin(Filter*);
+    ~Outpin();
+
+    Filter* const m_pFilter;
+    const std::wstring m_id;
+    CMediaTypes m_preferred_mtv;   //the type in the mapping, once loaded
+    CMediaTypes m_connection_mtv;  //only one of these
+    GraphUtil::IPinPtr m_pPinConnection;
+
+    //IUnknown interface:
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //IPin interface:
+
+    HRESULT STDMETHODCALLTYPE Connect(IPin*, const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE ReceiveConnection(
+        IPin*,
+        const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE Disconnect();
+
+    HRESULT STDMETHODCALLTYPE ConnectedTo(IPin**);
+
+    HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO*);
+
+    HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION*);
+
+    HRESULT STDMETHODCALLTYPE QueryId(LPWSTR*);
+
+    HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE*);
+
+    HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes**);
+
+    HRESULT STDMETHODCALLTYPE QueryInternalConnections(
+        IPin**,
+        ULONG*);
+
+    HRESULT STDMETHODCALLTYPE EndOfStream();
+
+    HRESULT STDMETHODCALLTYPE BeginFlush();
+
+    HRESULT STDMETHODCALLTYPE EndFlush();
+
+    HRESULT STDMETHODCALLTYPE NewSegment(
+        REFERENCE_TIME,
+        REFERENCE_TIME,
+        double);
+
+    //local functions
+
+    //Opens the mapping the sink created, for Filter::Load.
+    HRESULT Open(const wchar_t*);
+
+    HRESULT Start();  //from stopped to running/paused
+    void Stop();      //from running/paused to stopped
+
+private:
+    GraphUtil::IMemAllocatorPtr m_pAllocator;  //holds the ring
+    GraphUtil::IMemInputPinPtr m_pInputPin;
+    HANDLE m_hThread;
+
+    void StartThread();
+    void StopThread();
+
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+
+};
+
+
+}  //end namespace WebmShmSource
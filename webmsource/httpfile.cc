@@ -0,0 +1,971 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <strmif.h>
+#include "httpfile.h"
+#include <vfwmsgs.h>
+#include <winioctl.h>
+#include <process.h>
+#include <algorithm>
+#include <cassert>
+#include <cwchar>
+#include <cstring>
+
+namespace
+{
+
+//The map of the cache file, kept next to it: which blocks it has, and
+//of what (a changed file on the server means a new cache).
+
+const DWORD kMapMagic = 0x31434857;  //"WHC1"
+
+struct MapHeader
+{
+    DWORD magic;
+    DWORD block_size;
+    LONGLONG length;
+    DWORD validator_len;  //in wchar_t, following the header
+};
+
+
+ULONGLONG Hash(const wchar_t* str)
+{
+    //FNV-1a, of the URL as given; it only names the cache file.
+
+    ULONGLONG h = 14695981039346656037ULL;
+
+    while (*str)
+    {
+        h ^= static_cast<ULONGLONG>(towlower(*str++));
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+
+class Lock
+{
+    Lock(const Lock&);
+    Lock& operator=(const Lock&);
+
+    CRITICAL_SECTION* const m_cs;
+
+public:
+    explicit Lock(CRITICAL_SECTION* cs) : m_cs(cs)
+    {
+        EnterCriticalSection(m_cs);
+    }
+
+    ~Lock()
+    {
+        LeaveCriticalSection(m_cs);
+    }
+};
+
+}  //end anon namespace
+
+
+namespace WebmSource
+{
+
+struct HttpFile::Job
+{
+    HttpFile* pFile;
+    LONGLONG begin;
+    LONGLONG end;
+    HRESULT hr;
+};
+
+
+HttpFile::HttpFile() :
+    m_hSession(0),
+    m_hConnect(0),
+    m_request_flags(0),
+    m_length(0),
+    m_hCache(INVALID_HANDLE_VALUE)
+{
+    std::memset(&m_stats, 0, sizeof m_stats);
+
+    InitializeCriticalSection(&m_lock);
+    InitializeCriticalSection(&m_fetch_lock);
+}
+
+
+HttpFile::~HttpFile()
+{
+    const HRESULT hr = Close();
+    hr;
+    assert(SUCCEEDED(hr));
+
+    DeleteCriticalSection(&m_fetch_lock);
+    DeleteCriticalSection(&m_lock);
+}
+
+
+bool HttpFile::IsUrl(const wchar_t* str)
+{
+    if (str == 0)
+        return false;
+
+    if (_wcsnicmp(str, L"http://", 7) == 0)
+        return true;
+
+    if (_wcsnicmp(str, L"https://", 8) == 0)
+        return true;
+
+    return false;
+}
+
+
+HRESULT HttpFile::Open(const wchar_t* url)
+{
+    if (!IsUrl(url))
+        return E_INVALIDARG;
+
+    if (IsOpen())
+        return E_UNEXPECTED;
+
+    HRESULT hr = Connect(url);
+
+    if (SUCCEEDED(hr))
+        hr = QueryLength();
+
+    if (SUCCEEDED(hr))
+        hr = OpenCache(url);
+
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT HttpFile::Connect(const wchar_t* url)
+{
+    URL_COMPONENTS uc;
+    std::memset(&uc, 0, sizeof uc);
+
+    uc.dwStructSize = sizeof uc;
+    uc.dwHostNameLength = DWORD(-1);
+    uc.dwUrlPathLength = DWORD(-1);
+    uc.dwExtraInfoLength = DWORD(-1);
+
+    if (!WinHttpCrackUrl(url, 0, 0, &uc))
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    const std::wstring host(uc.lpszHostName, uc.dwHostNameLength);
+
+    m_path.assign(uc.lpszUrlPath, uc.dwUrlPathLength);
+    m_path.append(uc.lpszExtraInfo, uc.dwExtraInfoLength);
+
+    if (m_path.empty())
+        m_path = L"/";
+
+    if (uc.nScheme == INTERNET_SCHEME_HTTPS)
+        m_request_flags = WINHTTP_FLAG_SECURE;
+
+    m_hSession = WinHttpOpen(
+                    L"webmsource",
+                    WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+                    WINHTTP_NO_PROXY_NAME,
+                    WINHTTP_NO_PROXY_BYPASS,
+                    0);  //synchronous
+
+    if (m_hSession == 0)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    //The parallel requests of a miss each need a connection to
+    //themselves; the default limit would serialize them.
+
+    DWORD max_conns = kMaxRequests;
+
+    WinHttpSetOption(
+        m_hSession,
+        WINHTTP_OPTION_MAX_CONNS_PER_SERVER,
+        &max_conns,
+        sizeof max_conns);
+
+    m_hConnect = WinHttpConnect(m_hSession, host.c_str(), uc.nPort, 0);
+
+    if (m_hConnect == 0)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT HttpFile::SendRequest(
+    LONGLONG begin,
+    LONGLONG end,
+    HINTERNET& hRequest,
+    DWORD& status)
+{
+    assert(begin >= 0);
+    assert(end > begin);
+
+    hRequest = WinHttpOpenRequest(
+                m_hConnect,
+                L"GET",
+                m_path.c_str(),
+                0,  //HTTP/1.1
+                WINHTTP_NO_REFERER,
+                WINHTTP_DEFAULT_ACCEPT_TYPES,
+                m_request_flags);
+
+    if (hRequest == 0)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    wchar_t range[64];
+
+    swprintf_s(range, L"Range: bytes=%I64d-%I64d", begin, end - 1);
+
+    BOOL b = WinHttpSendRequest(
+                hRequest,
+                range,
+                DWORD(-1),  //null-terminated
+                WINHTTP_NO_REQUEST_DATA,
+                0,
+                0,
+                0);
+
+    if (b)
+        b = WinHttpReceiveResponse(hRequest, 0);
+
+    DWORD size = sizeof status;
+
+    if (b)
+        b = WinHttpQueryHeaders(
+                hRequest,
+                WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                WINHTTP_HEADER_NAME_BY_INDEX,
+                &status,
+                &size,
+                WINHTTP_NO_HEADER_INDEX);
+
+    if (!b)
+    {
+        const DWORD e = GetLastError();
+
+        WinHttpCloseHandle(hRequest);
+        hRequest = 0;
+
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    Lock lock(&m_lock);
+    ++m_stats.requests;
+
+    return S_OK;
+}
+
+
+HRESULT HttpFile::QueryLength()
+{
+    //We need the server to honor ranges, and we learn the length of the
+    //file from the Content-Range of the reply ("bytes 0-0/<length>").
+
+    HINTERNET hRequest;
+    DWORD status;
+
+    HRESULT hr = SendRequest(0, 1, hRequest, status);
+
+    if (FAILED(hr))
+        return hr;
+
+    hr = VFW_E_NOT_FOUND;
+
+    wchar_t buf[128];
+    DWORD size = sizeof buf;
+
+    if ((status == 206) &&
+        WinHttpQueryHeaders(
+            hRequest,
+            WINHTTP_QUERY_CONTENT_RANGE,
+            WINHTTP_HEADER_NAME_BY_INDEX,
+            buf,
+            &size,
+            WINHTTP_NO_HEADER_INDEX))
+    {
+        const wchar_t* const slash = wcschr(buf, L'/');
+
+        if (slash && (swscanf_s(slash + 1, L"%I64d", &m_length) == 1))
+            hr = (m_length > 0) ? S_OK : VFW_E_INVALID_FILE_FORMAT;
+    }
+    else if (status == 200)  //no ranges: leave it to the URL reader
+        hr = VFW_E_UNSUPPORTED_STREAM;
+
+    size = sizeof buf;
+
+    if (WinHttpQueryHeaders(
+            hRequest,
+            WINHTTP_QUERY_ETAG,
+            WINHTTP_HEADER_NAME_BY_INDEX,
+            buf,
+            &size,
+            WINHTTP_NO_HEADER_INDEX))
+    {
+        m_validator = buf;
+    }
+    else
+    {
+        size = sizeof buf;
+
+        if (WinHttpQueryHeaders(
+                hRequest,
+                WINHTTP_QUERY_LAST_MODIFIED,
+                WINHTTP_HEADER_NAME_BY_INDEX,
+                buf,
+                &size,
+                WINHTTP_NO_HEADER_INDEX))
+        {
+            m_validator = buf;
+        }
+    }
+
+    WinHttpCloseHandle(hRequest);
+    return hr;
+}
+
+
+HRESULT HttpFile::OpenCache(const wchar_t* url)
+{
+    assert(m_length > 0);
+
+    const LONGLONG count = (m_length + kBlockSize - 1) / kBlockSize;
+    m_blocks.assign(static_cast<size_t>(count), false);
+
+    wchar_t dir[MAX_PATH + 1];
+
+    const DWORD len = GetTempPath(MAX_PATH + 1, dir);
+
+    if ((len > 0) && (len <= MAX_PATH))
+    {
+        wchar_t name[32];
+        swprintf_s(name, L"webmsource-%016I64x.cache", Hash(url));
+
+        m_cache_name = dir;
+        m_cache_name += name;
+
+        //Another filter may have the same URL open; it has the cache,
+        //and we make do with one of our own, below.
+
+        m_hCache = CreateFile(
+                    m_cache_name.c_str(),
+                    GENERIC_READ | GENERIC_WRITE,
+                    0,  //no sharing
+                    0,
+                    OPEN_ALWAYS,
+                    FILE_ATTRIBUTE_NORMAL,
+                    0);
+
+        if (m_hCache == INVALID_HANDLE_VALUE)
+            m_cache_name.clear();
+
+        else if (!LoadMap())
+        {
+            //A new cache, or stale: discard what it has.
+
+            SetFilePointer(m_hCache, 0, 0, FILE_BEGIN);
+            SetEndOfFile(m_hCache);
+        }
+    }
+
+    if (m_hCache == INVALID_HANDLE_VALUE)
+    {
+        wchar_t name[MAX_PATH + 1];
+
+        if ((len == 0) || (len > MAX_PATH) ||
+            (GetTempFileName(dir, L"wms", 0, name) == 0))
+        {
+            return E_FAIL;
+        }
+
+        m_hCache = CreateFile(
+                    name,
+                    GENERIC_READ | GENERIC_WRITE,
+                    0,
+                    0,
+                    CREATE_ALWAYS,
+                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                    0);
+
+        if (m_hCache == INVALID_HANDLE_VALUE)
+        {
+            const DWORD e = GetLastError();
+            return HRESULT_FROM_WIN32(e);
+        }
+    }
+
+    //Sparse, so that a seek to the end doesn't write zeroes up to it.
+    //The file system may not support it, which costs disk, not time.
+
+    DWORD cb;
+
+    DeviceIoControl(m_hCache, FSCTL_SET_SPARSE, 0, 0, 0, 0, &cb, 0);
+
+    return S_OK;
+}
+
+
+bool HttpFile::LoadMap()
+{
+    const std::wstring map_name = m_cache_name + L".map";
+
+    const HANDLE hMap = CreateFile(
+                            map_name.c_str(),
+                            GENERIC_READ,
+                            0,
+                            0,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+
+    if (hMap == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool result = false;
+
+    MapHeader h;
+    DWORD cb;
+
+    if (ReadFile(hMap, &h, sizeof h, &cb, 0) &&
+        (cb == sizeof h) &&
+        (h.magic == kMapMagic) &&
+        (h.block_size == kBlockSize) &&
+        (h.length == m_length) &&
+        (h.validator_len == m_validator.length()) &&
+        !m_validator.empty())  //otherwise we can't tell if it changed
+    {
+        std::vector<wchar_t> validator(h.validator_len + 1);
+        const DWORD validator_cb = h.validator_len * sizeof(wchar_t);
+
+        std::vector<BYTE> bits((m_blocks.size() + 7) / 8);
+        const DWORD bits_cb = static_cast<DWORD>(bits.size());
+
+        if (ReadFile(hMap, &validator[0], validator_cb, &cb, 0) &&
+            (cb == validator_cb) &&
+            (m_validator.compare(0, h.validator_len, &validator[0],
+                                 h.validator_len) == 0) &&
+            ReadFile(hMap, &bits[0], bits_cb, &cb, 0) &&
+            (cb == bits_cb))
+        {
+            for (size_t i = 0; i < m_blocks.size(); ++i)
+            {
+                m_blocks[i] = (bits[i / 8] & (1 << (i % 8))) != 0;
+
+                if (m_blocks[i])
+                    m_stats.bytes_cached += kBlockSize;
+            }
+
+            result = true;
+        }
+    }
+
+    CloseHandle(hMap);
+    return result;
+}
+
+
+void HttpFile::SaveMap() const
+{
+    if (m_cache_name.empty())  //deleted on close
+        return;
+
+    const std::wstring map_name = m_cache_name + L".map";
+
+    const HANDLE hMap = CreateFile(
+                            map_name.c_str(),
+                            GENERIC_WRITE,
+                            0,
+                            0,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+
+    if (hMap == INVALID_HANDLE_VALUE)
+        return;
+
+    MapHeader h;
+
+    h.magic = kMapMagic;
+    h.block_size = kBlockSize;
+    h.length = m_length;
+    h.validator_len = static_cast<DWORD>(m_validator.length());
+
+    std::vector<BYTE> bits((m_blocks.size() + 7) / 8);
+
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (m_blocks[i])
+            bits[i / 8] |= BYTE(1 << (i % 8));
+    }
+
+    DWORD cb;
+
+    BOOL b = WriteFile(hMap, &h, sizeof h, &cb, 0);
+
+    if (b && h.validator_len)
+        b = WriteFile(
+                hMap,
+                m_validator.c_str(),
+                h.validator_len * sizeof(wchar_t),
+                &cb,
+                0);
+
+    if (b && !bits.empty())
+        b = WriteFile(hMap, &bits[0], DWORD(bits.size()), &cb, 0);
+
+    CloseHandle(hMap);
+
+    if (!b)  //a partial map would be worse than none
+        DeleteFile(map_name.c_str());
+}
+
+
+void HttpFile::CloseCache()
+{
+    if (m_hCache == INVALID_HANDLE_VALUE)
+        return;
+
+    SaveMap();
+
+    const BOOL b = CloseHandle(m_hCache);
+    b;
+    assert(b);
+
+    m_hCache = INVALID_HANDLE_VALUE;
+    m_cache_name.clear();
+}
+
+
+HRESULT HttpFile::Close()
+{
+    if (!IsOpen() && (m_hSession == 0))
+        return S_FALSE;
+
+    CloseCache();
+
+    if (m_hConnect)
+    {
+        WinHttpCloseHandle(m_hConnect);
+        m_hConnect = 0;
+    }
+
+    if (m_hSession)
+    {
+        WinHttpCloseHandle(m_hSession);
+        m_hSession = 0;
+    }
+
+    m_path.clear();
+    m_request_flags = 0;
+    m_length = 0;
+    m_validator.clear();
+
+    m_blocks.clear();
+    m_bounds.clear();
+    std::memset(&m_stats, 0, sizeof m_stats);
+
+    return S_OK;
+}
+
+
+bool HttpFile::IsOpen() const
+{
+    return (m_hCache != INVALID_HANDLE_VALUE);
+}
+
+
+void HttpFile::SetClusterBounds(const std::vector<LONGLONG>& bounds)
+{
+    Lock lock(&m_lock);
+
+    m_bounds = bounds;
+    std::sort(m_bounds.begin(), m_bounds.end());  //in case they weren't
+}
+
+
+void HttpFile::GetStats(Stats* pStats) const
+{
+    assert(pStats);
+
+    Lock lock(&m_lock);
+    *pStats = m_stats;
+}
+
+
+int HttpFile::Read(
+    long long pos,
+    long len,
+    unsigned char* buf)
+{
+    if (pos < 0)
+        return -1;
+
+    if (len <= 0)
+        return 0;
+
+    if (!IsOpen())
+        return -1;
+
+    if ((pos + len) > m_length)
+        return -1;
+
+    //A block, once cached, stays cached while we're open, so the cache
+    //is read without the lock.
+
+    const LONGLONG first = pos / kBlockSize;
+    const LONGLONG last = (pos + len - 1) / kBlockSize;
+
+    {
+        Lock lock(&m_lock);
+
+        const bool bHit = HaveBlocks(first, last);
+
+        if (bHit)
+            ++m_stats.cache_hits;
+        else
+            ++m_stats.cache_misses;
+
+        if (bHit)
+            return ReadCache(pos, len, buf);
+    }
+
+    Lock fetch_lock(&m_fetch_lock);
+
+    LONGLONG begin, end;
+
+    {
+        Lock lock(&m_lock);
+
+        GetFetchRange(pos, len, begin, end);
+    }
+
+    //If another read fetched the blocks meanwhile, there's nothing left.
+
+    if (begin < end)
+    {
+        const HRESULT hr = Fetch(begin, end);
+
+        if (FAILED(hr))
+            return -1;
+    }
+
+    return ReadCache(pos, len, buf);
+}
+
+
+bool HttpFile::HaveBlocks(LONGLONG first, LONGLONG last) const
+{
+    //m_lock is held by caller
+
+    for (LONGLONG i = first; i <= last; ++i)
+    {
+        if (!m_blocks[static_cast<size_t>(i)])
+            return false;
+    }
+
+    return true;
+}
+
+
+void HttpFile::GetFetchRange(
+    long long pos,
+    long len,
+    LONGLONG& begin,
+    LONGLONG& end) const
+{
+    //m_lock is held by caller
+
+    //We start at the first block of the read we lack, and go on at least
+    //to the end of the read, and to the end of the cluster it ends in if
+    //we know the clusters, but stop at a block we already have.
+
+    const LONGLONG read_last = (pos + len - 1) / kBlockSize;
+
+    LONGLONG first = pos / kBlockSize;
+
+    while ((first <= read_last) && m_blocks[static_cast<size_t>(first)])
+        ++first;
+
+    if (first > read_last)  //have all of it
+    {
+        begin = end = 0;
+        return;
+    }
+
+    begin = first * kBlockSize;
+    end = pos + len;
+
+    typedef std::vector<LONGLONG>::const_iterator iter_t;
+
+    const iter_t i = std::upper_bound(m_bounds.begin(), m_bounds.end(), end);
+
+    if (i != m_bounds.end())
+        end = (std::max)(end, *i);
+    else if (!m_bounds.empty())  //in the last cluster
+        end = m_length;
+
+    end = (std::min)(end, begin + kMaxFetch);
+    end = (std::max)(end, pos + len);  //a big read is fetched whole
+
+    LONGLONG last = (end - 1) / kBlockSize;
+
+    for (LONGLONG j = read_last + 1; j <= last; ++j)
+    {
+        if (m_blocks[static_cast<size_t>(j)])
+        {
+            last = j - 1;
+            break;
+        }
+    }
+
+    end = (std::min)((last + 1) * kBlockSize, m_length);
+}
+
+
+HRESULT HttpFile::Fetch(LONGLONG begin, LONGLONG end)
+{
+    //The range is split among requests made in parallel, each of whole
+    //blocks, since a single connection rarely fills the pipe.
+
+    assert(begin % kBlockSize == 0);
+    assert(end > begin);
+
+    const LONGLONG blocks = (end - begin + kBlockSize - 1) / kBlockSize;
+    const LONGLONG count = (std::min)(blocks, LONGLONG(kMaxRequests));
+
+    if (count <= 1)
+        return FetchRange(begin, end);
+
+    const LONGLONG per_job = ((blocks + count - 1) / count) * kBlockSize;
+
+    Job jobs[kMaxRequests];
+    HANDLE threads[kMaxRequests];
+    DWORD n = 0;
+
+    for (LONGLONG pos = begin; pos < end; pos += per_job)
+    {
+        Job& job = jobs[n];
+
+        job.pFile = this;
+        job.begin = pos;
+        job.end = (std::min)(pos + per_job, end);
+        job.hr = S_OK;
+
+        threads[n] = 0;
+
+        if (n > 0)  //we do the first one ourselves
+        {
+            const uintptr_t h = _beginthreadex(0, 0, &ThreadProc, &job, 0, 0);
+            threads[n] = reinterpret_cast<HANDLE>(h);
+        }
+
+        ++n;
+    }
+
+    for (DWORD i = 0; i < n; ++i)
+    {
+        if (threads[i] == 0)  //the first, or we couldn't make a thread
+            jobs[i].hr = FetchRange(jobs[i].begin, jobs[i].end);
+    }
+
+    for (DWORD i = 0; i < n; ++i)
+    {
+        if (threads[i] == 0)
+            continue;
+
+        const DWORD dw = WaitForSingleObject(threads[i], INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        CloseHandle(threads[i]);
+    }
+
+    //What was fetched is kept, but the read needs all of it.
+
+    for (DWORD i = 0; i < n; ++i)
+    {
+        if (FAILED(jobs[i].hr))
+            return jobs[i].hr;
+    }
+
+    return S_OK;
+}
+
+
+unsigned HttpFile::ThreadProc(void* pv)
+{
+    Job* const pJob = static_cast<Job*>(pv);
+    assert(pJob);
+
+    pJob->hr = pJob->pFile->FetchRange(pJob->begin, pJob->end);
+    return 0;
+}
+
+
+HRESULT HttpFile::FetchRange(LONGLONG begin, LONGLONG end)
+{
+    HINTERNET hRequest;
+    DWORD status;
+
+    HRESULT hr = SendRequest(begin, end, hRequest, status);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (status != 206)
+    {
+        WinHttpCloseHandle(hRequest);
+        return VFW_E_UNSUPPORTED_STREAM;
+    }
+
+    //We write the reply to the cache as it arrives, a block at a time,
+    //so that what we got is kept even if the connection drops.
+
+    std::vector<BYTE> block(kBlockSize);
+
+    LONGLONG pos = begin;
+    DWORD len = 0;
+
+    hr = S_OK;
+
+    while (pos + len < end)
+    {
+        const DWORD want = static_cast<DWORD>(
+                            (std::min)(LONGLONG(kBlockSize - len),
+                                       end - pos - len));
+
+        DWORD cb;
+
+        if (!WinHttpReadData(hRequest, &block[len], want, &cb))
+        {
+            const DWORD e = GetLastError();
+            hr = HRESULT_FROM_WIN32(e);
+            break;
+        }
+
+        if (cb == 0)  //the server closed early
+        {
+            hr = E_FAIL;
+            break;
+        }
+
+        len += cb;
+
+        {
+            Lock lock(&m_lock);
+            m_stats.bytes_fetched += cb;
+        }
+
+        if ((len < kBlockSize) && (pos + len < end))
+            continue;
+
+        if (!WriteCache(pos, &block[0], len))
+        {
+            hr = E_FAIL;
+            break;
+        }
+
+        pos += len;
+        len = 0;
+    }
+
+    WinHttpCloseHandle(hRequest);
+    return hr;
+}
+
+
+int HttpFile::ReadCache(
+    long long pos,
+    long len,
+    unsigned char* buf)
+{
+    //Positional, as for MkvFile::ReadFromFile, so the handle can be
+    //shared among threads.
+
+    ULARGE_INTEGER off;
+    off.QuadPart = pos;
+
+    OVERLAPPED ov = { 0 };
+    ov.Offset = off.LowPart;
+    ov.OffsetHigh = off.HighPart;
+
+    DWORD cbRead;
+
+    if (!ReadFile(m_hCache, buf, len, &cbRead, &ov))
+        return -1;
+
+    return (cbRead >= ULONG(len)) ? 0 : -1;
+}
+
+
+bool HttpFile::WriteCache(LONGLONG pos, const BYTE* buf, DWORD len)
+{
+    assert(pos % kBlockSize == 0);
+    assert((len == kBlockSize) || (pos + len == m_length));
+
+    ULARGE_INTEGER off;
+    off.QuadPart = pos;
+
+    OVERLAPPED ov = { 0 };
+    ov.Offset = off.LowPart;
+    ov.OffsetHigh = off.HighPart;
+
+    DWORD cb;
+
+    if (!WriteFile(m_hCache, buf, len, &cb, &ov) || (cb != len))
+        return false;
+
+    Lock lock(&m_lock);
+
+    std::vector<bool>::reference have = m_blocks[size_t(pos / kBlockSize)];
+
+    if (!have)
+    {
+        have = true;
+        m_stats.bytes_cached += len;
+    }
+
+    return true;
+}
+
+
+int HttpFile::Length(
+    long long* pTotal,
+    long long* pAvailable)
+{
+    if (!IsOpen())
+        return -1;
+
+    if (pTotal)
+        *pTotal = m_length;
+
+    if (pAvailable)
+        *pAvailable = m_length;
+
+    return 0;  //success
+}
+
+}  //end namespace WebmSource
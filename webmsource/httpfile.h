@@ -0,0 +1,102 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <windows.h>
+#include <winhttp.h>
+#include <string>
+#include <vector>
+#include "mkvparser.hpp"
+#include "mkvparserstreamreader.h"
+#include "ihttpsourcestats.h"
+
+namespace WebmSource
+{
+
+//Reads a WebM file from an HTTP or HTTPS server, with range requests,
+//so that a seek costs only the clusters it needs (the stock URL reader
+//downloads from the start).  What we fetch is kept in a sparse cache
+//file in the temp directory, which survives the filter, so that seeking
+//back and replaying don't go to the network again.
+
+class HttpFile : public mkvparser::IStreamReader
+{
+    HttpFile(const HttpFile&);
+    HttpFile& operator=(const HttpFile&);
+
+public:
+    typedef IHttpSourceStats::HttpStats Stats;
+
+    HttpFile();
+    virtual ~HttpFile();
+
+    static bool IsUrl(const wchar_t*);
+
+    HRESULT Open(const wchar_t* url);
+    HRESULT Close();
+    bool IsOpen() const;
+
+    //The (absolute) positions of the clusters, from the cues.  A miss
+    //fetches up to the end of the cluster it falls in, so that a seek
+    //gets its cluster in one round of requests.
+    void SetClusterBounds(const std::vector<LONGLONG>&);
+
+    //Read may be called from several threads at once, as for MkvFile.
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+    void GetStats(Stats*) const;
+
+private:
+    enum { kBlockSize = 64 * 1024 };  //unit of the cache
+    enum { kMaxFetch = 4 * 1024 * 1024 };  //most bytes fetched per miss
+    enum { kMaxRequests = 4 };  //requests in parallel, per miss
+
+    HINTERNET m_hSession;
+    HINTERNET m_hConnect;  //WinHTTP keeps its connections alive
+    std::wstring m_path;  //and query
+    DWORD m_request_flags;
+    LONGLONG m_length;
+
+    HANDLE m_hCache;
+    std::wstring m_cache_name;  //empty if deleted on close
+    std::wstring m_validator;  //ETag, or else Last-Modified
+
+    //Guards the members below.  Fetches are serialized by m_fetch_lock,
+    //which is taken first, so that two reads that miss the same blocks
+    //fetch them once.
+    mutable CRITICAL_SECTION m_lock;
+    CRITICAL_SECTION m_fetch_lock;
+
+    std::vector<bool> m_blocks;  //whether each block is in the cache
+    std::vector<LONGLONG> m_bounds;  //sorted
+    Stats m_stats;
+
+    HRESULT Connect(const wchar_t* url);
+    HRESULT QueryLength();
+    HRESULT OpenCache(const wchar_t* url);
+    void CloseCache();
+    bool LoadMap();
+    void SaveMap() const;
+
+    bool HaveBlocks(LONGLONG first, LONGLONG last) const;
+    void GetFetchRange(long long pos, long len, LONGLONG&, LONGLONG&) const;
+    HRESULT Fetch(LONGLONG begin, LONGLONG end);
+    HRESULT FetchRange(LONGLONG begin, LONGLONG end);
+    HRESULT SendRequest(LONGLONG begin, LONGLONG end, HINTERNET&, DWORD&);
+
+    struct Job;
+    static unsigned __stdcall ThreadProc(void*);
+
+    int ReadCache(long long pos, long len, unsigned char* buf);
+    bool WriteCache(LONGLONG pos, const BYTE*, DWORD);
+
+};
+
+
+}  //end namespace WebmSource
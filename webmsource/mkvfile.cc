@@ -9,13 +9,27 @@
 #include <strmif.h>
 #include "mkvfile.h"
 #include <cassert>
+#include <cstring>
 
 namespace WebmSource
 {
 
 MkvFile::MkvFile() :
-    m_hFile(INVALID_HANDLE_VALUE)
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_length(0),
+    m_hMap(0),
+    m_pView(0),
+    m_view_pos(0),
+    m_view_len(0)
 {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    //View offsets must be a multiple of this.
+    m_granularity = info.dwAllocationGranularity;
+    assert(m_granularity > 0);
+
+    InitializeCriticalSection(&m_view_lock);
 }
 
 
@@ -24,22 +38,8 @@ MkvFile::~MkvFile()
     const HRESULT hr = Close();
     hr;
     assert(SUCCEEDED(hr));
-}
-
-
-HRESULT MkvFile::SetPosition(LONGLONG pos) const
-{
-    const BOOL b = SetFilePointerEx(
-                    m_hFile,
-                    reinterpret_cast<LARGE_INTEGER&>(pos),
-                    0,
-                    FILE_BEGIN);  //TODO: generalize
 
-    if (b)
-        return S_OK;
-
-    const DWORD e = GetLastError();
-    return HRESULT_FROM_WIN32(e);
+    DeleteCriticalSection(&m_view_lock);
 }
 
 
@@ -80,6 +80,13 @@ HRESULT MkvFile::Open(const wchar_t* strFileName)
     m_length = size.QuadPart;
     assert(m_length >= 0);
 
+    //A file of length 0 can't be mapped; that's OK, since there's
+    //nothing to read anyway.  If mapping fails for any other reason,
+    //we just read the file directly.
+
+    if (m_length > 0)
+        m_hMap = CreateFileMapping(m_hFile, 0, PAGE_READONLY, 0, 0, 0);
+
     return S_OK;
 }
 
@@ -89,6 +96,17 @@ HRESULT MkvFile::Close()
     if (m_hFile == INVALID_HANDLE_VALUE)
         return S_FALSE;
 
+    UnmapView();
+
+    if (m_hMap)
+    {
+        const BOOL b = CloseHandle(m_hMap);
+        b;
+        assert(b);
+
+        m_hMap = 0;
+    }
+
     const BOOL b = CloseHandle(m_hFile);
 
     m_hFile = INVALID_HANDLE_VALUE;
@@ -124,11 +142,32 @@ int MkvFile::Read(
     if (pos >= m_length)
         return -1;  //?
 
-    const HRESULT hr = SetPosition(pos);
-    assert(SUCCEEDED(hr));
+    if (m_hMap)
+        return ReadFromView(pos, len, buf);
+
+    return ReadFromFile(pos, len, buf);
+}
+
+
+int MkvFile::ReadFromFile(
+    long long pos,
+    long len,
+    unsigned char* buf)
+{
+    //The handle isn't opened for overlapped I/O, so this read completes
+    //before ReadFile returns; the OVERLAPPED just gives the position,
+    //which we'd otherwise have to seek to (and so couldn't share the
+    //handle among threads).
+
+    ULARGE_INTEGER off;
+    off.QuadPart = pos;
+
+    OVERLAPPED ov = { 0 };
+    ov.Offset = off.LowPart;
+    ov.OffsetHigh = off.HighPart;
 
     DWORD cbRead;
-    const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, 0);
+    const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, &ov);
 
     if (!b)
     {
@@ -142,6 +181,111 @@ int MkvFile::Read(
 }
 
 
+int MkvFile::ReadFromView(
+    long long pos,
+    long len,
+    unsigned char* buf)
+{
+    if ((pos + len) > m_length)
+        return -1;  //same as a short ReadFile
+
+    EnterCriticalSection(&m_view_lock);
+
+    if ((pos < m_view_pos) || ((pos + len) > (m_view_pos + m_view_len)))
+    {
+        if (!MapView(pos, len))
+        {
+            LeaveCriticalSection(&m_view_lock);
+            return ReadFromFile(pos, len, buf);
+        }
+    }
+
+    const BYTE* const src = m_pView + (pos - m_view_pos);
+
+    const bool b = CopyFromView(buf, src, len);
+
+    LeaveCriticalSection(&m_view_lock);
+
+    return b ? 0 : -1;
+}
+
+
+bool MkvFile::MapView(LONGLONG pos, LONG len)
+{
+    assert(m_hMap);
+    assert(pos >= 0);
+    assert(len > 0);
+
+    const LONGLONG view_pos = pos - (pos % m_granularity);
+    const LONGLONG view_end = pos + len;
+
+    if ((view_end - view_pos) > kViewSize)
+        return false;  //big read: not worth a view of its own
+
+    LONGLONG view_len = kViewSize;
+
+    if ((view_pos + view_len) > m_length)
+        view_len = m_length - view_pos;
+
+    UnmapView();
+
+    ULARGE_INTEGER off;
+    off.QuadPart = view_pos;
+
+    void* const pView = MapViewOfFile(
+                            m_hMap,
+                            FILE_MAP_READ,
+                            off.HighPart,
+                            off.LowPart,
+                            static_cast<SIZE_T>(view_len));
+
+    if (pView == 0)
+        return false;
+
+    m_pView = static_cast<const BYTE*>(pView);
+    m_view_pos = view_pos;
+    m_view_len = view_len;
+
+    return true;
+}
+
+
+void MkvFile::UnmapView()
+{
+    if (m_pView == 0)
+        return;
+
+    const BOOL b = UnmapViewOfFile(m_pView);
+    b;
+    assert(b);
+
+    m_pView = 0;
+    m_view_pos = 0;
+    m_view_len = 0;
+}
+
+
+bool MkvFile::CopyFromView(void* dst, const void* src, size_t len)
+{
+    //Touching a mapped page can fail with an I/O error (e.g. the network
+    //share went away), which is reported as an exception instead of as a
+    //ReadFile failure.
+
+    __try
+    {
+        memcpy(dst, src, len);
+    }
+    __except(GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+             EXCEPTION_EXECUTE_HANDLER :
+             EXCEPTION_CONTINUE_SEARCH)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
 int MkvFile::Length(
     long long* pTotal,
     long long* pAvailable)
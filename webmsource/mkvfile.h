@@ -26,6 +26,10 @@ public:
     HRESULT Close();
     bool IsOpen() const;
 
+    //Read may be called from several threads at once (the outpins read
+    //their frames without the filter lock; see Stream::SetDeferredReads).
+    //ReadFile is given the position in an OVERLAPPED, so it needs no
+    //seek, and the view has a lock of its own.
     int Read(long long pos, long len, unsigned char* buf);
     int Length(long long* total, long long* available);
 
@@ -33,7 +37,25 @@ private:
     HANDLE m_hFile;
     LONGLONG m_length;
 
-    HRESULT SetPosition(LONGLONG) const;
+    //The parser issues many small reads, mostly close to one another, so
+    //we serve them from a view of the file mapped around the read position.
+    //We fall back to ReadFile when the file can't be mapped, and for reads
+    //that don't fit in a view.
+
+    enum { kViewSize = 16 * 1024 * 1024 };
+
+    HANDLE m_hMap;
+    const BYTE* m_pView;
+    LONGLONG m_view_pos;
+    LONGLONG m_view_len;
+    DWORD m_granularity;
+    CRITICAL_SECTION m_view_lock;  //guards the view
+
+    int ReadFromFile(long long pos, long len, unsigned char* buf);
+    int ReadFromView(long long pos, long len, unsigned char* buf);
+    bool MapView(LONGLONG pos, LONG len);
+    void UnmapView();
+    static bool CopyFromView(void*, const void*, size_t);
 
 };
 
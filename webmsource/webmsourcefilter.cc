@@ -13,9 +13,13 @@
 #include "mkvparserstreamvideo.h"
 #include "mkvparserstreamaudio.h"
 #include "webmsourceoutpin.h"
+#include "mkvparserclusterscanner.h"
 #include "webmtypes.h"
+#include "threadutil.h"
 #include <new>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <vfwmsgs.h>
 #include <process.h>
 #include <limits>
@@ -82,10 +86,19 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_pOuter(pOuter ? pOuter : &m_nondelegating),
       m_state(State_Stopped),
       m_clock(0),
+      m_pReader(0),
       m_pSegment(0),
       m_pSeekBase(0),
       m_seekBase_ns(-1),
-      m_currTime(kNoSeek)
+      m_currTime(kNoSeek),
+      m_pNext(0),
+      m_hPrefetch(0),
+      m_bPlaylistBlocked(false),
+      m_splice_ns(0),
+      m_pCurrFile(0),
+      m_pOldSegment(0),
+      m_pOldReader(0),
+      m_pOldFile(0)
 {
     m_pClassFactory->LockServer(TRUE);
 
@@ -111,6 +124,8 @@ Filter::~Filter()
     os << "webmsrc::dtor" << endl;
 #endif
 
+    DiscardNext();
+
     while (!m_pins.empty())
     {
         Outpin* p = m_pins.back();
@@ -120,7 +135,17 @@ Filter::~Filter()
         delete p;
     }
 
+    typedef streams_t::iterator iter_t;
+
+    for (iter_t i = m_next_streams.begin(); i != m_next_streams.end(); ++i)
+        delete *i;
+
+    delete m_pOldSegment;
+    delete m_pOldFile;
+
+    SaveIndex();
     delete m_pSegment;
+    delete m_pCurrFile;
 
     m_pClassFactory->LockServer(FALSE);
 }
@@ -205,6 +230,14 @@ HRESULT Filter::nondelegating_t::QueryInterface(
     {
         pUnk = static_cast<IAMFilterMiscFlags*>(m_pFilter);
     }
+    else if (iid == __uuidof(IHttpSourceStats))
+    {
+        pUnk = static_cast<IHttpSourceStats*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IWebmPlaylist))
+    {
+        pUnk = static_cast<IWebmPlaylist*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -624,40 +657,84 @@ HRESULT Filter::Load(LPCOLESTR filename, const AM_MEDIA_TYPE* pmt)
     if (FAILED(hr))
         return hr;
 
-    if (m_file.IsOpen())
+    if (m_pReader)
         return E_UNEXPECTED;
 
     assert(m_pSegment == 0);
 
-    hr = m_file.Open(filename);
+    //A URL we read with range requests, which the stock URL reader
+    //can't do.  We have no sidecar index for it, and we don't build one,
+    //since scanning the clusters would download the whole file.
+
+    const bool bUrl = HttpFile::IsUrl(filename);
+
+    if (bUrl)
+    {
+        hr = m_http.Open(filename);
+        m_pReader = &m_http;
+    }
+    else
+    {
+        hr = m_file.Open(filename);
+        m_pReader = &m_file;
+    }
 
     if (FAILED(hr))
+    {
+        m_pReader = 0;
         return hr;
+    }
 
     hr = CreateSegment();
 
     if (FAILED(hr))
     {
-        m_file.Close();
+        if (bUrl)
+            m_http.Close();
+        else
+            m_file.Close();
+
+        m_pReader = 0;
         return hr;
     }
 
     m_filename = filename;
 
+    StartPrefetch();  //if files were queued already
+
+    if (bUrl)
+    {
+        SetClusterBounds();
+        return S_OK;
+    }
+
+    //A missing or stale sidecar index just means that we seek
+    //using the cues, or by scanning the clusters.
+
+    hr = m_index.Open(filename);
+
+    if (FAILED(hr))
+        BuildIndex();
+
     return S_OK;
 }
 
 
-HRESULT Filter::CreateSegment()
+HRESULT Filter::OpenSegment(
+    mkvparser::IMkvReader* pReader,
+    mkvparser::Segment*& pResult)
 {
-    assert(m_file.IsOpen());
-    assert(m_pSegment == 0);
+    //Parses the headers of the (first) segment, and its cues, without
+    //touching the filter, so that a playlist can open its next file on
+    //a thread of its own.
+
+    pResult = 0;
 
     __int64 result, pos;
 
     mkvparser::EBMLHeader h;
 
-    result = h.Parse(&m_file, pos);
+    result = h.Parse(pReader, pos);
 
     if (result < 0)  //error
     {
@@ -701,7 +778,7 @@ HRESULT Filter::CreateSegment()
 
     mkvparser::Segment* p;
 
-    result = mkvparser::Segment::CreateInstance(&m_file, pos, p);
+    result = mkvparser::Segment::CreateInstance(pReader, pos, p);
 
     if (result < 0)  //error
     {
@@ -753,6 +830,49 @@ HRESULT Filter::CreateSegment()
     }
 #endif
 
+    if (pSegment->GetCues())
+        __noop;
+    else if (const mkvparser::SeekHead* pSH = pSegment->GetSeekHead())
+    {
+        const int count = pSH->GetCount();
+
+        for (int idx = 0; idx < count; ++idx)
+        {
+            const mkvparser::SeekHead::Entry* const p = pSH->GetEntry(idx);
+
+            if (p->id == 0x0C53BB6B)  //Cues ID
+            {
+                const LONGLONG cues_off = p->pos;  //relative to segment
+                assert(cues_off >= 0);
+
+                long len;
+
+                const long status = pSegment->ParseCues(cues_off, pos, len);
+                status;
+                assert(status >= 0);
+            }
+        }
+    }
+
+    pResult = pSegment.release();
+    return S_OK;
+}
+
+
+HRESULT Filter::CreateSegment()
+{
+    assert(m_pReader);
+    assert(m_pSegment == 0);
+
+    mkvparser::Segment* p;
+
+    const HRESULT hr = OpenSegment(m_pReader, p);
+
+    if (FAILED(hr))
+        return hr;
+
+    std::auto_ptr<mkvparser::Segment> pSegment(p);
+
     const mkvparser::Tracks* const pTracks = pSegment->GetTracks();
 
     if (pTracks == 0)
@@ -807,30 +927,6 @@ HRESULT Filter::CreateSegment()
     m_seekBase_ns = -1;
     m_currTime = kNoSeek;
 
-    if (m_pSegment->GetCues())
-        __noop;
-    else if (const mkvparser::SeekHead* pSH = m_pSegment->GetSeekHead())
-    {
-        const int count = pSH->GetCount();
-
-        for (int idx = 0; idx < count; ++idx)
-        {
-            const mkvparser::SeekHead::Entry* const p = pSH->GetEntry(idx);
-
-            if (p->id == 0x0C53BB6B)  //Cues ID
-            {
-                const LONGLONG cues_off = p->pos;  //relative to segment
-                assert(cues_off >= 0);
-
-                long len;
-
-                const long status = m_pSegment->ParseCues(cues_off, pos, len);
-                status;
-                assert(status >= 0);
-            }
-        }
-    }
-
     return S_OK;
 }
 
@@ -861,7 +957,7 @@ HRESULT Filter::GetCurFile(LPOLESTR* pname, AM_MEDIA_TYPE* pmt)
     if (FAILED(hr))
         return hr;
 
-    if (!m_file.IsOpen())
+    if (m_pReader == 0)
         return S_FALSE;
 
     const size_t len = m_filename.length();
@@ -887,6 +983,432 @@ ULONG Filter::GetMiscFlags()
 }
 
 
+HRESULT Filter::GetHttpStats(HttpStats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pReader != &m_http)
+    {
+        memset(pStats, 0, sizeof(HttpStats));
+        return S_FALSE;
+    }
+
+    m_http.GetStats(pStats);
+    return S_OK;
+}
+
+
+HRESULT Filter::QueueFile(LPCOLESTR filename)
+{
+    if (filename == 0)
+        return E_POINTER;
+
+    if (HttpFile::IsUrl(filename))  //local files only
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    m_playlist.push_back(filename);
+    StartPrefetch();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::ClearQueue()
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    DiscardNext();
+
+    m_playlist.clear();
+    m_bPlaylistBlocked = false;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetQueueLength(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pCount = static_cast<ULONG>(m_playlist.size());
+    return S_OK;
+}
+
+
+void Filter::StartPrefetch()
+{
+    //filter locked by caller
+
+    if (m_pNext || m_playlist.empty() || m_bPlaylistBlocked)
+        return;
+
+    if ((m_pSegment == 0) || m_pOldSegment)  //not now: after the splice
+        return;
+
+    Next* const pNext = new (std::nothrow) Next;
+
+    if (pNext == 0)
+        return;
+
+    pNext->filename = m_playlist.front();
+    pNext->pFile = new (std::nothrow) MkvFile;
+    pNext->pSegment = 0;
+    pNext->hr = E_FAIL;
+
+    if (pNext->pFile == 0)
+    {
+        delete pNext;
+        return;
+    }
+
+    m_pNext = pNext;
+
+    const uintptr_t h = _beginthreadex(0, 0, &PrefetchProc, pNext, 0, 0);
+
+    if (h == 0)
+        PrefetchProc(pNext);  //we'll wait for it here instead
+    else
+        m_hPrefetch = reinterpret_cast<HANDLE>(h);
+}
+
+
+unsigned Filter::PrefetchProc(void* pv)
+{
+    //We don't touch the filter, so we need no lock.  The first cluster
+    //is loaded too, so the pins needn't wait for it after the splice.
+
+    Next* const pNext = static_cast<Next*>(pv);
+    assert(pNext);
+
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmsource.prefetch",
+            WebmMfUtil::kThreadClassBackground);
+
+    HRESULT& hr = pNext->hr;
+
+    hr = pNext->pFile->Open(pNext->filename.c_str());
+
+    if (SUCCEEDED(hr))
+        hr = OpenSegment(pNext->pFile, pNext->pSegment);
+
+    if (SUCCEEDED(hr) && (pNext->pSegment == 0))
+        hr = E_FAIL;
+
+    if (SUCCEEDED(hr) && (pNext->pSegment->LoadCluster() < 0))
+        hr = VFW_E_INVALID_FILE_FORMAT;
+
+    return 0;
+}
+
+
+void Filter::DiscardNext()
+{
+    //filter locked by caller
+
+    if (m_pNext == 0)
+        return;
+
+    if (m_hPrefetch)
+    {
+        const DWORD dw = WaitForSingleObject(m_hPrefetch, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        const BOOL b = CloseHandle(m_hPrefetch);
+        b;
+        assert(b);
+
+        m_hPrefetch = 0;
+    }
+
+    delete m_pNext->pSegment;
+    delete m_pNext->pFile;
+    delete m_pNext;
+
+    m_pNext = 0;
+}
+
+
+bool Filter::CreateNextStreams()
+{
+    //Each pin takes the next track of the same type in the next file,
+    //whose stream must accept the connection the pin has.
+
+    assert(m_pNext);
+    assert(m_pNext->pSegment);
+    assert(m_next_streams.empty());
+
+    using namespace mkvparser;
+
+    const Tracks* const pTracks = m_pNext->pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return false;
+
+    const ULONG n = pTracks->GetTracksCount();
+    ULONG video = 0;
+    ULONG audio = 0;
+
+    typedef pins_t::const_iterator iter_t;
+
+    for (iter_t i = m_pins.begin(); i != m_pins.end(); ++i)
+    {
+        const Outpin* const pPin = *i;
+        const long long type = pPin->m_pStream->m_pTrack->GetType();
+
+        ULONG& idx = (type == 1) ? video : audio;
+        const Track* pTrack = 0;
+
+        while ((pTrack == 0) && (idx < n))
+        {
+            const Track* const t = pTracks->GetTrackByIndex(idx++);
+
+            if (t && (t->GetType() == type))
+                pTrack = t;
+        }
+
+        typedef mkvparser::VideoTrack VT;
+        typedef mkvparser::AudioTrack AT;
+
+        Stream* s = 0;
+
+        if (pTrack == 0)
+            __noop;
+        else if (type == 1)
+            s = VideoStream::CreateInstance(static_cast<const VT*>(pTrack));
+        else
+            s = AudioStream::CreateInstance(static_cast<const AT*>(pTrack));
+
+        if (s && pPin->m_connection)
+        {
+            const AM_MEDIA_TYPE& mt = pPin->m_connection_mtv[0];
+
+            if ((s->QueryAccept(&mt) != S_OK) ||
+                FAILED(s->SetConnectionMediaType(mt)))
+            {
+                delete s;
+                s = 0;
+            }
+        }
+
+        if (s == 0)
+        {
+            typedef streams_t::iterator streams_iter_t;
+
+            streams_iter_t j = m_next_streams.begin();
+
+            while (j != m_next_streams.end())
+                delete *j++;
+
+            m_next_streams.clear();
+            return false;
+        }
+
+        m_next_streams.push_back(s);
+    }
+
+    return true;
+}
+
+
+bool Filter::StartSplice()
+{
+    //filter locked by caller
+
+    assert(m_pOldSegment == 0);
+
+    if (m_pNext == 0)
+        return false;
+
+    if (m_hPrefetch)  //it doesn't need the lock, so we can wait
+    {
+        const DWORD dw = WaitForSingleObject(m_hPrefetch, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        const BOOL b = CloseHandle(m_hPrefetch);
+        b;
+        assert(b);
+
+        m_hPrefetch = 0;
+    }
+
+    if (FAILED(m_pNext->hr) || !CreateNextStreams())
+    {
+        DiscardNext();
+        m_bPlaylistBlocked = true;
+
+        return false;
+    }
+
+    //The next file starts where this one ends.
+
+    LONGLONG duration_ns = m_pSegment->GetDuration();
+
+    if (duration_ns < 0)
+    {
+        const mkvparser::Cluster* const pLast = m_pSegment->GetLast();
+
+        if ((pLast != 0) && !pLast->EOS())
+            duration_ns = pLast->GetLastTime();
+    }
+
+    if (duration_ns > 0)
+        m_splice_ns += duration_ns;
+
+    typedef streams_t::iterator iter_t;
+
+    for (iter_t i = m_next_streams.begin(); i != m_next_streams.end(); ++i)
+        (*i)->SetSpliceTime(m_splice_ns);
+
+    m_pOldSegment = m_pSegment;
+    m_pOldReader = m_pReader;
+    m_pOldFile = m_pCurrFile;
+
+    m_pSegment = m_pNext->pSegment;
+    m_pCurrFile = m_pNext->pFile;
+    m_pReader = m_pCurrFile;
+    m_filename = m_pNext->filename;
+
+    m_pSeekBase = 0;
+    m_seekBase_ns = -1;
+    m_currTime = kNoSeek;
+
+    m_index.Close();
+    m_index_image.clear();
+    m_index.Open(m_filename.c_str());  //we don't build one here
+
+    m_pNext->pSegment = 0;
+    m_pNext->pFile = 0;
+    DiscardNext();
+
+    m_playlist.pop_front();
+
+    //A pin that isn't connected has no thread to get here.
+
+    for (pins_t::size_type i = 0; i < m_pins.size(); ++i)
+    {
+        if (m_pins[i]->m_connection == 0)
+            Splice(i);
+    }
+
+    return true;
+}
+
+
+void Filter::Splice(pins_t::size_type i)
+{
+    //filter locked by caller, and the pin isn't streaming from its old
+    //stream (it's the pin's own thread, or the pin is stopped)
+
+    assert(i < m_next_streams.size());
+
+    mkvparser::Stream*& s = m_next_streams[i];
+
+    if (s == 0)  //moved already
+        return;
+
+    m_pins[i]->Splice(s);
+    s = 0;
+
+    streams_t::const_iterator j = m_next_streams.begin();
+
+    while (j != m_next_streams.end())
+    {
+        if (*j++)
+            return;  //a pin still has to move
+    }
+
+    EndSplice();
+}
+
+
+void Filter::EndSplice()
+{
+    //The last pin has left the old file.
+
+    m_next_streams.clear();
+
+    delete m_pOldSegment;
+    m_pOldSegment = 0;
+
+    if (m_pOldReader == &m_file)
+        m_file.Close();
+    else if (m_pOldReader == &m_http)
+        m_http.Close();
+
+    m_pOldReader = 0;
+
+    delete m_pOldFile;
+    m_pOldFile = 0;
+
+    StartPrefetch();  //the one after
+}
+
+
+void Filter::FinishSplice()
+{
+    //filter locked by caller, and all pins stopped
+
+    if (m_pOldSegment == 0)
+        return;
+
+    for (pins_t::size_type i = 0; i < m_pins.size(); ++i)
+        Splice(i);
+}
+
+
+bool Filter::SpliceNext(Outpin* pPin)
+{
+    //filter locked by caller
+
+    if ((m_pOldSegment == 0) && !StartSplice())
+        return false;
+
+    const pins_t::iterator i = std::find(m_pins.begin(), m_pins.end(), pPin);
+    assert(i != m_pins.end());
+
+    const pins_t::size_type idx = i - m_pins.begin();
+
+    //A pin that reaches the end of the next file before the others are
+    //done with this one has nowhere to go.
+
+    if (m_next_streams[idx] == 0)
+        return false;
+
+    Splice(idx);
+    return true;
+}
+
+
 void Filter::OnStart()
 {
     typedef pins_t::iterator iter_t;
@@ -922,6 +1444,234 @@ void Filter::OnStop()
 
         pPin->Final();
     }
+
+    //The timeline of the playlist starts again at the file playing.
+
+    FinishSplice();
+
+    m_splice_ns = 0;
+
+    for (iter_t k = m_pins.begin(); k != j; ++k)
+        (*k)->m_pStream->SetSpliceTime(0);
+
+    SaveIndex();
+}
+
+
+const mkvparser::BlockEntry* Filter::FindIndexedEntry(
+    const mkvparser::Track* pTrack,
+    LONGLONG ns)
+{
+    using namespace mkvparser;
+
+    if (!m_index.IsOpen())
+        return 0;
+
+    if (pTrack->GetNumber() != m_index.track_number())
+        return 0;
+
+    const webmdshow::WebmIndexEntry* const p = m_index.Find(ns);
+
+    if (p == 0)
+        return 0;
+
+    const Cluster* const pCluster = m_pSegment->FindOrPreloadCluster(p->pos);
+
+    if ((pCluster == 0) || pCluster->EOS())
+        return 0;
+
+    const BlockEntry* const pCurr = pCluster->GetEntry(pTrack, ns);
+
+    if ((pCurr == 0) || pCurr->EOS())
+        return 0;
+
+    return pCurr;
+}
+
+
+const mkvparser::Track* Filter::GetIndexTrack() const
+{
+    //We index the first video track.
+
+    using namespace mkvparser;
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+
+    if (pTracks == 0)
+        return 0;
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack != 0) && (pTrack->GetType() == 1))  //video
+            return pTrack;
+    }
+
+    return 0;
+}
+
+
+void Filter::BuildIndex()
+{
+    //Without cues, seeking means loading the clusters one after another
+    //up to the seek time, which on a large file takes seconds.  Instead
+    //we scan all of the clusters now, on as many threads as there are
+    //processors (MkvFile reads are positional, so they don't contend),
+    //and keep the result as the sidecar, so the next open pays nothing.
+
+    assert(m_pSegment);
+    assert(!m_index.IsOpen());
+
+    if (m_pSegment->GetCues())
+        return;
+
+    const mkvparser::Track* const pTrack = GetIndexTrack();
+
+    if (pTrack == 0)
+        return;
+
+    std::vector<webmdshow::WebmIndexEntry> entries;
+
+    HRESULT hr = mkvparser::ClusterScanner::Scan(
+                    &m_file,
+                    m_pSegment,
+                    pTrack,
+                    0,  //a thread per processor
+                    entries);
+
+    if (hr != S_OK)  //damaged: SaveIndex will index what can be loaded
+        return;
+
+    hr = webmdshow::WebmIndex::Write(
+            m_filename.c_str(),
+            pTrack->GetNumber(),
+            entries);
+
+    if (SUCCEEDED(hr))
+        hr = m_index.Open(m_filename.c_str());
+
+    if (SUCCEEDED(hr))
+        return;
+
+    //We can't write next to the file (it's on a read-only share, say),
+    //so we use the index from memory, for this open only.
+
+    int64_t file_size, file_time;
+
+    hr = webmdshow::WebmIndex::GetFileStamp(
+            m_filename.c_str(),
+            &file_size,
+            &file_time);
+
+    if (FAILED(hr))
+        return;
+
+    webmdshow::WebmIndex::Build(
+        pTrack->GetNumber(),
+        file_size,
+        file_time,
+        entries,
+        &m_index_image);
+
+    const size_t size = m_index_image.size();
+    m_index.Attach(&m_index_image[0], size, file_size, file_time);
+}
+
+
+void Filter::SetClusterBounds()
+{
+    //The cues give the clusters a seek lands on, so that a miss there
+    //fetches its cluster whole, in parallel, instead of block by block
+    //as the parser asks.
+
+    assert(m_pSegment);
+    assert(m_pReader == &m_http);
+
+    using namespace mkvparser;
+
+    const Cues* const pCues = m_pSegment->GetCues();
+
+    if (pCues == 0)
+        return;
+
+    while (!pCues->DoneParsing())
+        pCues->LoadCuePoint();
+
+    std::vector<LONGLONG> bounds;
+
+    const CuePoint* pCP = pCues->GetFirst();
+
+    while (pCP)
+    {
+        const CuePoint::TrackPosition* const tp = pCP->m_track_positions;
+        const size_t count = pCP->m_track_positions_count;
+
+        for (size_t i = 0; i < count; ++i)
+            bounds.push_back(m_pSegment->m_start + tp[i].m_pos);
+
+        pCP = pCues->GetNext(pCP);
+    }
+
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    m_http.SetClusterBounds(bounds);
+}
+
+
+void Filter::SaveIndex()
+{
+    //We index the first video track, once we have seen all of the
+    //clusters (because of a seek near the end, or playback to the end),
+    //so that the next open can seek without scanning.
+
+    if ((m_pSegment == 0) || m_index.IsOpen() || m_filename.empty())
+        return;
+
+    if (m_pReader == &m_http)  //no sidecar for a URL
+        return;
+
+    if (!m_pSegment->DoneParsing())
+        return;
+
+    using namespace mkvparser;
+
+    const Track* const pTrack = GetIndexTrack();
+
+    if (pTrack == 0)
+        return;
+
+    std::vector<webmdshow::WebmIndexEntry> entries;
+
+    const Cluster* pCluster = m_pSegment->GetFirst();
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        const BlockEntry* const pEntry = pCluster->GetEntry(pTrack);  //key
+
+        if ((pEntry != 0) && !pEntry->EOS())
+        {
+            webmdshow::WebmIndexEntry e;
+
+            e.pos = pCluster->GetPosition();
+            e.time_ns = pEntry->GetBlock()->GetTime(pCluster);
+
+            entries.push_back(e);
+        }
+
+        pCluster = m_pSegment->GetNext(pCluster);
+    }
+
+    const HRESULT hr = webmdshow::WebmIndex::Write(
+                        m_filename.c_str(),
+                        pTrack->GetNumber(),
+                        entries);
+
+    if (SUCCEEDED(hr))
+        m_index.Open(m_filename.c_str());  //don't write it again
 }
 
 
@@ -959,6 +1709,21 @@ void Filter::SetCurrPosition(
 
     using namespace mkvparser;
 
+    //A seek is within the file playing, which a pin still on the file
+    //before moves to now, and its times start over (the pin is stopped).
+
+    if (m_pOldSegment)
+    {
+        const pins_t::iterator i =
+            std::find(m_pins.begin(), m_pins.end(), pOutpin);
+
+        assert(i != m_pins.end());
+        Splice(i - m_pins.begin());
+    }
+
+    m_splice_ns = 0;
+    pOutpin->m_pStream->SetSpliceTime(0);
+
     Stream* const pOutpinStream = pOutpin->m_pStream;
     const Track* const pOutpinTrack = pOutpinStream->m_pTrack;
 
@@ -990,6 +1755,17 @@ void Filter::SetCurrPosition(
         bVideo;
         assert(bVideo);
 
+        if (const BlockEntry* const pCurr =
+                FindIndexedEntry(pOutpinTrack, ns))
+        {
+            m_pSeekBase = pCurr->GetCluster();
+            m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
+            m_seekTime_ns = m_seekBase_ns;
+
+            pOutpinStream->SetCurrPosition(m_seekBase_ns, pCurr);
+            return;
+        }
+
         if (const Cues* pCues = m_pSegment->GetCues())
         {
             while (!pCues->DoneParsing())
@@ -1082,6 +1858,22 @@ void Filter::SetCurrPosition(
         const Track* const pVideoTrack = pStream->m_pTrack;
         assert(pVideoTrack->GetType() == 1);  //video
 
+        if (const BlockEntry* pCurr = FindIndexedEntry(pVideoTrack, ns))
+        {
+            m_pSeekBase = pCurr->GetCluster();
+            m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
+            m_seekTime_ns = m_seekBase_ns;  //to find same block later
+
+            pCurr = m_pSeekBase->GetEntry(pOutpinTrack, m_seekBase_ns);
+            assert(pCurr);
+
+            if (!pCurr->EOS())
+                m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
+
+            pOutpinStream->SetCurrPosition(m_seekBase_ns, pCurr);
+            return;
+        }
+
         if (const Cues* pCues = m_pSegment->GetCues())
         {
             while (!pCues->DoneParsing())
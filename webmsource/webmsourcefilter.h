@@ -10,7 +10,12 @@
 #include <strmif.h>
 #include <string>
 #include "mkvfile.h"
+#include "httpfile.h"
+#include "ihttpsourcestats.h"
+#include "iwebmplaylist.h"
 #include "clockable.h"
+#include "webmindex.h"
+#include <list>
 #include <vector>
 
 namespace mkvparser
@@ -28,6 +33,8 @@ class Outpin;
 class Filter : public IBaseFilter,
                public IFileSourceFilter,
                public IAMFilterMiscFlags,
+               public IHttpSourceStats,
+               public IWebmPlaylist,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -74,6 +81,16 @@ public:
 
     ULONG STDMETHODCALLTYPE GetMiscFlags();
 
+    //IHttpSourceStats
+
+    HRESULT STDMETHODCALLTYPE GetHttpStats(HttpStats*);
+
+    //IWebmPlaylist
+
+    HRESULT STDMETHODCALLTYPE QueueFile(LPCOLESTR);
+    HRESULT STDMETHODCALLTYPE ClearQueue();
+    HRESULT STDMETHODCALLTYPE GetQueueLength(ULONG*);
+
 
     //local classes and methods
 
@@ -114,7 +131,11 @@ public:
 
     FILTER_STATE m_state;
     MkvFile m_file;
+    HttpFile m_http;  //when Load is given a URL
+    mkvparser::IStreamReader* m_pReader;  //one of the above, once loaded
     std::wstring m_filename;
+    webmdshow::WebmIndex m_index;
+    std::vector<uint8_t> m_index_image;  //if the sidecar can't be written
     mkvparser::Segment* m_pSegment;
     const mkvparser::Cluster* m_pSeekBase;
     LONGLONG m_seekBase_ns;
@@ -127,12 +148,63 @@ public:
     int GetConnectionCount() const;
     void SetCurrPosition(LONGLONG currTime, DWORD dwCurr, Outpin*);
 
+    //Called by an outpin (with the lock held) whose stream has reached
+    //the end of its file.  Returns true if the pin now has the stream of
+    //the next file queued (see IWebmPlaylist), and false for EOS.
+    bool SpliceNext(Outpin*);
+
 private:
 
     void OnStop();
     void OnStart();
 
+    static HRESULT OpenSegment(mkvparser::IMkvReader*, mkvparser::Segment*&);
     HRESULT CreateSegment();
+    void SetClusterBounds();
+
+    //The next file of the playlist, opened, with its headers and first
+    //cluster parsed, by a thread of its own.
+    struct Next
+    {
+        std::wstring filename;
+        MkvFile* pFile;
+        mkvparser::Segment* pSegment;
+        HRESULT hr;
+    };
+
+    typedef std::list<std::wstring> playlist_t;
+    typedef std::vector<mkvparser::Stream*> streams_t;
+
+    playlist_t m_playlist;  //its front is m_pNext, once that's made
+    Next* m_pNext;
+    HANDLE m_hPrefetch;  //thread that prepares m_pNext
+    bool m_bPlaylistBlocked;  //the front didn't match the connections
+    LONGLONG m_splice_ns;  //where the file playing starts, on the timeline
+    MkvFile* m_pCurrFile;  //m_pReader, after a splice
+
+    //While the pins move to the next file one after another, the file
+    //they leave, and the streams (by pin) of those still to move.
+    mkvparser::Segment* m_pOldSegment;
+    mkvparser::IStreamReader* m_pOldReader;
+    MkvFile* m_pOldFile;
+    streams_t m_next_streams;
+
+    void StartPrefetch();
+    void DiscardNext();
+    static unsigned __stdcall PrefetchProc(void*);
+    bool CreateNextStreams();
+    bool StartSplice();
+    void Splice(pins_t::size_type);
+    void EndSplice();
+    void FinishSplice();
+
+    const mkvparser::BlockEntry* FindIndexedEntry(
+        const mkvparser::Track*,
+        LONGLONG ns);
+
+    const mkvparser::Track* GetIndexTrack() const;
+    void BuildIndex();
+    void SaveIndex();
     void PopulateSamples(const HANDLE*, DWORD);
 
 };
@@ -14,6 +14,7 @@
 #include "webmsourceoutpin.h"
 //#include "cmemallocator.h"
 #include "cmediasample.h"
+#include "threadutil.h"
 #include <vfwmsgs.h>
 #include <cassert>
 #include <sstream>
@@ -41,6 +42,10 @@ Outpin::Outpin(
     m_hThread(0)
 {
     m_pStream->GetMediaTypes(m_preferred_mtv);
+
+    //MkvFile allows concurrent reads, so each outpin reads its frames
+    //without the filter lock (see PopulateSamples).
+    m_pStream->SetDeferredReads(true);
 }
 
 
@@ -54,6 +59,20 @@ Outpin::~Outpin()
 }
 
 
+void Outpin::Splice(mkvparser::Stream* pStream)
+{
+    //filter locked by caller
+
+    assert(pStream);
+
+    m_pStream->Stop();
+    delete m_pStream;
+
+    m_pStream = pStream;
+    m_pStream->SetDeferredReads(true);  //as in the ctor
+}
+
+
 void Outpin::Init()  //transition from stopped
 {
     assert(m_hThread == 0);
@@ -82,7 +101,19 @@ void Outpin::Final()  //transition to stopped
     const HRESULT hr = m_pAllocator->Decommit();
     assert(SUCCEEDED(hr));
 
+    if (bool(m_pLargeAllocator))
+        m_pLargeAllocator->Decommit();
+
     StopThread();
+
+    //The thread may have made another before it stopped.
+
+    if (bool(m_pLargeAllocator))
+    {
+        m_pLargeAllocator->Decommit();
+        m_pLargeAllocator = 0;
+    }
+
     m_pStream->Init();
 }
 
@@ -204,7 +235,7 @@ HRESULT Outpin::Connect(
     if (FAILED(hr))
         return hr;
 
-    assert(m_pFilter->m_file.IsOpen());
+    assert(m_pFilter->m_pReader);
 
     if (m_pFilter->m_state != State_Stopped)
         return VFW_E_NOT_STOPPED;
@@ -1106,6 +1137,10 @@ unsigned Outpin::ThreadProc(void* pv)
     Outpin* const pPin = static_cast<Outpin*>(pv);
     assert(pPin);
 
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmsource",
+            WebmMfUtil::kThreadClassPlayback);
+
     return pPin->Main();
 }
 
@@ -1165,7 +1200,6 @@ unsigned Outpin::Main()
             break;
 
         mkvparser::Stream::Clear(samples);
-        Sleep(0);       //better way to do this?
     }
 
     mkvparser::Stream::Clear(samples);
@@ -1177,7 +1211,7 @@ unsigned Outpin::Main()
 
 HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
 {
-    mkvparser::Segment* const pSegment = m_pStream->m_pTrack->m_pSegment;
+    mkvparser::Segment* pSegment = m_pStream->m_pTrack->m_pSegment;
 
     for (;;)
     {
@@ -1190,11 +1224,11 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
         if (FAILED(hr))
             return hr;
 
-        long count;
+        long count, size;
 
         for (;;)
         {
-            hr = m_pStream->GetSampleCount(count);
+            hr = m_pStream->GetSampleCount(count, size);
 
             if (SUCCEEDED(hr))
                 break;
@@ -1206,31 +1240,42 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
             assert(status >= 0);
         }
 
-        if (hr != S_OK)      //EOS
-            return S_FALSE;  //report EOS
+        if (hr != S_OK)  //EOS, unless a playlist has another file
+        {
+            if (!m_pFilter->SpliceNext(this))
+                return S_FALSE;  //report EOS
+
+            pSegment = m_pStream->m_pTrack->m_pSegment;
+            continue;
+        }
+
+        //Final decommits the large allocator while it holds the lock,
+        //so we only touch our member while we hold it too.
+        GraphUtil::IMemAllocatorPtr pLarge(m_pLargeAllocator);
 
         hr = lock.Release();
         assert(SUCCEEDED(hr));
 
         samples.reserve(count);
 
-        for (long idx = 0; idx < count; ++idx)
-        {
-            IMediaSample* sample;
-
-            hr = m_pAllocator->GetBuffer(&sample, 0, 0, 0);
-
-            if (hr != S_OK)
-                return E_FAIL;  //we're done
+        hr = mkvparser::Stream::GetSamples(
+                m_pAllocator,
+                pLarge,
+                count,
+                size,
+                0,
+                samples);
 
-            samples.push_back(sample);
-        }
+        if (hr != S_OK)
+            return E_FAIL;  //we're done
 
         hr = lock.Seize(m_pFilter);
 
         if (FAILED(hr))
             return hr;
 
+        m_pLargeAllocator = pLarge;
+
         for (;;)
         {
             hr = m_pStream->PopulateSamples(samples);
@@ -1245,8 +1290,20 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
             assert(status >= 0);
         }
 
+        if (hr == S_OK)  //have samples
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            //Only this thread touches the stream's frames while we're
+            //streaming, so their payloads can be read without the lock,
+            //while the other outpins parse and read too.
+
+            return m_pStream->ReadSamples(samples);
+        }
+
         if (hr != 2)
-            return hr;  //either have samples, or EOS
+            return hr;  //EOS
 
         hr = lock.Release();
         assert(SUCCEEDED(hr));
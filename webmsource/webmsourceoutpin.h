@@ -30,6 +30,7 @@ protected:
     HRESULT GetName(PIN_INFO&) const;
 
     GraphUtil::IMemAllocatorPtr m_pAllocator;
+    GraphUtil::IMemAllocatorPtr m_pLargeAllocator;  //see GetSamples
     GraphUtil::IMemInputPinPtr m_pInputPin;
     HANDLE m_hThread;
 
@@ -113,7 +114,11 @@ public:
     HRESULT STDMETHODCALLTYPE GetRate(double*);
     HRESULT STDMETHODCALLTYPE GetPreroll(LONGLONG*);
 
-    mkvparser::Stream* const m_pStream;
+    //The next file of a playlist: the pin takes pStream, and deletes
+    //the one it had (see Filter::SpliceNext).
+    void Splice(mkvparser::Stream* pStream);
+
+    mkvparser::Stream* m_pStream;  //changes only at a splice
 
 private:
     static unsigned __stdcall ThreadProc(void*);
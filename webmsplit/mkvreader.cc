@@ -11,20 +11,305 @@
 #include "mkvreader.h"
 #include <cassert>
 #include <algorithm>
+#include <new>
 #include <vfwmsgs.h>
 #include "clockable.h"
+#include "webmtrace.h"
 #pragma warning(default:4702)
 
 namespace WebmSplit
 {
 
-MkvReader::MkvReader() : m_sync_read(true)
+class MkvReader::Lender
 {
+    Lender(const Lender&);
+    Lender& operator=(const Lender&);
+
+    ~Lender()
+    {
+    }
+
+    LONG m_cRef;
+
+public:
+
+    explicit Lender(long cPages) :
+        m_cRef(1),
+        m_lent(cPages, 0),
+        m_cLent(0),
+        m_cReturned(0)
+    {
+    }
+
+    void AddRef()
+    {
+        InterlockedIncrement(&m_cRef);
+    }
+
+    void Release()
+    {
+        if (InterlockedDecrement(&m_cRef) == 0)
+            delete this;
+    }
+
+    void Lend(long index)
+    {
+        InterlockedIncrement(&m_lent[index]);
+        InterlockedIncrement(&m_cLent);
+    }
+
+    void Return(long index)
+    {
+        if (InterlockedDecrement(&m_lent[index]) == 0)
+            InterlockedIncrement(&m_cReturned);
+
+        InterlockedDecrement(&m_cLent);
+    }
+
+    std::vector<LONG> m_lent;  //frames outstanding, per page
+    LONG m_cLent;              //frames outstanding, over all pages
+    LONG m_cReturned;          //pages whose frames have all come back
+
+};
+
+
+//The frame's bytes are those of the page, whose sample (from the async
+//reader's allocator) we hold, so that they remain valid even if the cache
+//is decommitted while the frame is still downstream.
+
+class MkvReader::FrameSample : public IMediaSample
+{
+    FrameSample(const FrameSample&);
+    FrameSample& operator=(const FrameSample&);
+
+    ~FrameSample()
+    {
+        m_pLender->Return(m_index);
+        m_pLender->Release();
+        m_pPage->Release();
+    }
+
+    LONG m_cRef;
+    Lender* const m_pLender;
+    const long m_index;
+    IMediaSample* const m_pPage;
+    BYTE* const m_ptr;
+    const long m_size;
+
+    long m_len;
+    LONGLONG m_start;
+    LONGLONG m_stop;
+    bool m_bStart;
+    bool m_bStop;
+    bool m_bSyncPoint;
+    bool m_bPreroll;
+    bool m_bDiscontinuity;
+
+public:
+
+    FrameSample(
+        Lender* pLender,
+        long index,
+        IMediaSample* pPage,
+        BYTE* ptr,
+        long len) :
+        m_cRef(1),
+        m_pLender(pLender),
+        m_index(index),
+        m_pPage(pPage),
+        m_ptr(ptr),
+        m_size(len),
+        m_len(len),
+        m_start(0),
+        m_stop(0),
+        m_bStart(false),
+        m_bStop(false),
+        m_bSyncPoint(false),
+        m_bPreroll(false),
+        m_bDiscontinuity(false)
+    {
+        m_pLender->AddRef();
+        m_pLender->Lend(m_index);
+        m_pPage->AddRef();
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID& iid, void** ppv)
+    {
+        if (ppv == 0)
+            return E_POINTER;
+
+        IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+        if ((iid == __uuidof(IUnknown)) || (iid == __uuidof(IMediaSample)))
+            pUnk = static_cast<IMediaSample*>(this);
+        else
+        {
+            pUnk = 0;
+            return E_NOINTERFACE;
+        }
+
+        pUnk->AddRef();
+        return S_OK;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef()
+    {
+        return InterlockedIncrement(&m_cRef);
+    }
+
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        const LONG n = InterlockedDecrement(&m_cRef);
+
+        if (n == 0)
+            delete this;
+
+        return n;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetPointer(BYTE** pp)
+    {
+        if (pp == 0)
+            return E_POINTER;
+
+        *pp = m_ptr;
+        return S_OK;
+    }
+
+    long STDMETHODCALLTYPE GetSize()
+    {
+        return m_size;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetTime(
+        REFERENCE_TIME* pStart,
+        REFERENCE_TIME* pStop)
+    {
+        if (!m_bStart)
+            return VFW_E_SAMPLE_TIME_NOT_SET;
+
+        if (pStart)
+            *pStart = m_start;
+
+        if (!m_bStop)
+            return VFW_S_NO_STOP_TIME;
+
+        if (pStop)
+            *pStop = m_stop;
+
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetTime(
+        REFERENCE_TIME* pStart,
+        REFERENCE_TIME* pStop)
+    {
+        m_bStart = (pStart != 0);
+        m_bStop = m_bStart && (pStop != 0);
+
+        if (m_bStart)
+            m_start = *pStart;
+
+        if (m_bStop)
+            m_stop = *pStop;
+
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE IsSyncPoint()
+    {
+        return m_bSyncPoint ? S_OK : S_FALSE;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetSyncPoint(BOOL b)
+    {
+        m_bSyncPoint = b ? true : false;
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE IsPreroll()
+    {
+        return m_bPreroll ? S_OK : S_FALSE;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetPreroll(BOOL b)
+    {
+        m_bPreroll = b ? true : false;
+        return S_OK;
+    }
+
+    long STDMETHODCALLTYPE GetActualDataLength()
+    {
+        return m_len;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetActualDataLength(long len)
+    {
+        if ((len < 0) || (len > m_size))
+            return VFW_E_BUFFER_OVERFLOW;
+
+        m_len = len;
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetMediaType(AM_MEDIA_TYPE** pp)
+    {
+        if (pp == 0)
+            return E_POINTER;
+
+        *pp = 0;
+        return S_FALSE;  //same as the previous sample
+    }
+
+    HRESULT STDMETHODCALLTYPE SetMediaType(AM_MEDIA_TYPE* pmt)
+    {
+        return pmt ? E_NOTIMPL : S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE IsDiscontinuity()
+    {
+        return m_bDiscontinuity ? S_OK : S_FALSE;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetDiscontinuity(BOOL b)
+    {
+        m_bDiscontinuity = b ? true : false;
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetMediaTime(LONGLONG*, LONGLONG*)
+    {
+        return VFW_E_MEDIA_TIME_NOT_SET;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetMediaTime(LONGLONG*, LONGLONG*)
+    {
+        return S_OK;  //not kept
+    }
+
+};
+
+
+MkvReader::MkvReader() :
+    m_sync_read(true),
+    m_pShared(0),
+    m_bucket_mask(0),
+    m_lru_head(-1),
+    m_lru_tail(-1),
+    m_cPending(0),
+    m_prefetch_window(kDefaultPrefetchWindow),
+    m_cPrefetchCursors(kDefaultPrefetchCursors),
+    m_bFlushing(false),
+    m_pLender(0)
+{
+    ResetCacheStats();
 }
 
 
 MkvReader::~MkvReader()
 {
+    assert(m_pLender == 0);
+    SetSharedFile(0);
 }
 
 
@@ -32,6 +317,9 @@ HRESULT MkvReader::SetSource(IAsyncReader* pSource)
 {
     HRESULT hr;
 
+    SetSharedFile(0);
+    m_follower.Close();
+
     if (pSource == 0)
     {
         hr = Decommit();
@@ -99,6 +387,25 @@ bool MkvReader::IsOpen() const
 }
 
 
+void MkvReader::SetSharedFile(webmdshow::SharedFileCache::File* pFile)
+{
+    webmdshow::SharedFileCache::Close(m_pShared);
+    m_pShared = pFile;
+}
+
+
+bool MkvReader::Follow(const wchar_t* filename)
+{
+    return m_follower.Open(filename);
+}
+
+
+bool MkvReader::IsFollowing() const
+{
+    return m_follower.is_open();
+}
+
+
 HRESULT MkvReader::Commit()
 {
     //This is called by the FGM thread, during the transition to Run/Paused
@@ -106,7 +413,9 @@ HRESULT MkvReader::Commit()
     //no thread synchronization is performed.
 
     assert(m_pages.empty());
-    assert(m_free_pages.empty());
+    assert(m_cPending == 0);
+
+    m_cursors.clear();
 
     if (m_pAllocator == 0)
         return VFW_E_NO_ALLOCATOR;
@@ -119,29 +428,41 @@ HRESULT MkvReader::Commit()
     const long n = m_props.cBuffers;
     assert(n > 0);
 
-    for (long i = 0; i < n; ++i)
-    {
-        Page page;
+    Page page;
 
-        page.cRef = 0;
-        page.pSample = 0;
+    page.pos = -1;
+    page.pSample = 0;
+    page.pData = 0;
+    page.cRef = 0;
+    page.state = kPageEmpty;
+    page.bPrefetched = false;
+    page.hash_next = -1;
+    page.lru_prev = -1;
+    page.lru_next = -1;
+    page.bLinked = false;
 
-        m_pages.push_back(page);
-    }
+    m_pages.assign(n, page);
 
-    typedef pages_list_t::iterator iter_t;
+    //Size the table so that (on average) there is at most one page per
+    //bucket.  Page indexes are consecutive for sequential access, so
+    //they spread perfectly over a power-of-two table.
 
-    iter_t iter = m_pages.begin();
-    const iter_t iter_end = m_pages.end();
+    ULONG cBuckets = 1;
 
-    while (iter != iter_end)
-    {
-        const LONGLONG key = iter->GetPos();
-        const free_pages_t::value_type value(key, iter);
+    while (cBuckets < ULONG(n))
+        cBuckets <<= 1;
 
-        m_free_pages.insert(value);
-        ++iter;
-    }
+    m_buckets.assign(cBuckets, -1);
+    m_bucket_mask = cBuckets - 1;
+
+    m_lru_head = -1;
+    m_lru_tail = -1;
+
+    for (long i = 0; i < n; ++i)
+        LruPushBack(i);
+
+    assert(m_pLender == 0);
+    m_pLender = new (std::nothrow) Lender(n);  //if 0, frames are copied
 
     return S_OK;
 }
@@ -153,11 +474,16 @@ HRESULT MkvReader::Decommit()
     //to stopped, but after any other threads have been destroyed.  Therefore
     //no thread synchronization is performed.
 
-    m_free_pages.clear();
+    CancelPending();
+
+    typedef pages_t::iterator iter_t;
+
+    iter_t iter = m_pages.begin();
+    const iter_t iter_end = m_pages.end();
 
-    while (!m_pages.empty())
+    while (iter != iter_end)
     {
-        Page& page = m_pages.front();
+        Page& page = *iter++;
         assert(page.cRef == 0);
 
         if (page.pSample)
@@ -167,8 +493,19 @@ HRESULT MkvReader::Decommit()
 
             page.pSample = 0;
         }
+    }
+
+    m_pages.clear();
+    m_buckets.clear();
+    m_bucket_mask = 0;
 
-        m_pages.pop_front();
+    m_lru_head = -1;
+    m_lru_tail = -1;
+
+    if (m_pLender)  //frames still lent keep it until they're released
+    {
+        m_pLender->Release();
+        m_pLender = 0;
     }
 
     if (m_pAllocator == 0)
@@ -186,10 +523,24 @@ int MkvReader::Read(
     if (!IsOpen())
         return -1;
 
+    if (m_sync_read && m_follower.is_open())
+    {
+        if (m_follower.Read(pos, len, buf) != len)
+            return -1;
+
+        webmdshow::TraceFrame(webmdshow::kTraceFrameRead, 0, pos, len);
+        return 0;
+    }
+
     if (m_sync_read)
     {
         const HRESULT hr = m_pSource->SyncRead(pos, len, buf);
-        return SUCCEEDED(hr) ? 0 : -1;
+
+        if (FAILED(hr))
+            return -1;
+
+        webmdshow::TraceFrame(webmdshow::kTraceFrameRead, 0, pos, len);
+        return 0;
     }
 
     if (pos < 0)
@@ -201,73 +552,35 @@ int MkvReader::Read(
     if (buf == 0)
         return -1;
 
-    typedef cache_t::iterator iter_t;
-    iter_t next;
-
-    const DWORD page_size = m_props.cbBuffer;
-
-    if (m_cache.empty() || ((*m_cache.front()).GetPos() > pos))
-        next = m_cache.begin();
-    else
-    {
-        const iter_t i = m_cache.begin();
-        const iter_t j = m_cache.end();
-
-        next = std::upper_bound(i, j, pos, PageLess());
-        assert(next != i);
-
-        const cache_t::value_type page_iter = *--iter_t(next);
-        const Page& page = *page_iter;
-        const LONGLONG page_end = page.GetPos() + page_size;
-
-        if (pos < page_end)  //cache hit
-            Read(page_iter, pos, len, &buf);
-    }
+    const long long start_pos = pos;
+    const long start_len = len;
 
     while (len > 0)
     {
-        if ((next == m_cache.end()) || ((*next)->GetPos() > pos))
-        {
-            iter_t curr_iter;
+        long index;
 
-            const int status = InsertPage(next, pos, curr_iter);
+        const int status = GetPage(pos, index);
 
-            if (status < 0)  //error
-                return status;
+        if (status < 0)  //error
+            return status;
 
-            const cache_t::value_type page_iter = *curr_iter;
-            const Page& curr_page = *page_iter;
-
-            next = ++iter_t(curr_iter);
-            assert((next == m_cache.end()) ||
-                   ((*next)->GetPos() > curr_page.GetPos()));
-
-            Read(page_iter, pos, len, &buf);
-        }
-        else
-        {
-            const cache_t::value_type page_iter = *next++;
-            const Page& page = *page_iter;
-            assert(page.GetPos() <= pos);
-            assert(pos < (page.GetPos() + page_size));
-
-            Read(page_iter, pos, len, &buf);
-        }
+        Read(m_pages[index], pos, len, &buf);
     }
 
+    webmdshow::TraceFrame(webmdshow::kTraceFrameRead, 0, start_pos, start_len);
+
     return 0;  //means all requested bytes were read
 }
 
 
 void MkvReader::Read(
-    pages_list_t::const_iterator page_iter,
+    const Page& page,
     long long& pos,
     long& requested_len,
     unsigned char** pdst) const
 {
-    const Page& page = *page_iter;
-
-    const LONGLONG page_pos = page.GetPos();
+    const LONGLONG page_pos = page.pos;
+    assert(page_pos >= 0);
     assert(pos >= page_pos);
 
     const LONG page_size = m_props.cbBuffer;
@@ -284,16 +597,9 @@ void MkvReader::Read(
 
     if (pdst)
     {
-        assert(page.pSample);
-
-        BYTE* ptr;
+        assert(page.pData);
 
-        const HRESULT hr = page.pSample->GetPointer(&ptr);
-        assert(SUCCEEDED(hr));
-        assert(ptr);
-
-        const BYTE* const page_base = ptr;
-        const BYTE* const src = page_base + page_off;
+        const BYTE* const src = page.pData + page_off;
 
         unsigned char*& dst = *pdst;
 
@@ -306,36 +612,55 @@ void MkvReader::Read(
 }
 
 
-int MkvReader::InsertPage(
-    cache_t::iterator next,
-    LONGLONG pos,
-    cache_t::iterator& cache_iter)
+int MkvReader::GetPage(LONGLONG pos, long& index)
 {
-    FreeOne(next);
-
-    if (m_free_pages.empty())  //error: all samples are busy
-        return -1;  //generic error
+    ReclaimLent();
 
     const DWORD page_size = m_props.cbBuffer;
-
     const LONGLONG page_pos = page_size * LONGLONG(pos / page_size);
-    assert((next == m_cache.end()) || ((*next)->GetPos() > page_pos));
 
-    free_pages_t::iterator free_page = m_free_pages.find(page_pos);
+    long i = Lookup(page_pos);
 
-    if (free_page == m_free_pages.end())
-        free_page = m_free_pages.begin();
-
-    const pages_list_t::iterator page_iter = free_page->second;
-    assert(page_iter->cRef == 0);
+    if ((i < 0) || (m_pages[i].state != kPageReady))
+    {
+        PollPending();  //file any read-ahead pages that have arrived
+        i = Lookup(page_pos);
+    }
 
-    if (page_iter->GetPos() == page_pos)
+    if ((i >= 0) && (m_pages[i].state == kPageReady))  //cache hit
     {
-        m_free_pages.erase(free_page);
-        cache_iter = m_cache.insert(next, page_iter);
+        Page& page = m_pages[i];
+
+        ++m_stats.hits;
+
+        if (page.bLinked)
+        {
+            LruUnlink(i);
+            LruPushBack(i);
+        }
+
+        if (page.bPrefetched)  //keep the read-ahead window moving
+        {
+            page.bPrefetched = false;
+            Prefetch(page_pos, i);
+        }
+
+        index = i;
         return 0;  //success
     }
 
+    if (i >= 0)
+    {
+        //There's a read-ahead request outstanding for this page, but we
+        //can't block waiting for it while holding the lock (another thread
+        //might be waiting for its completion).  Read the page synchronously
+        //instead, and orphan the pending page; it gets discarded when the
+        //request completes.
+
+        assert(m_pages[i].state == kPagePending);
+        HashRemove(i);
+    }
+
     LONGLONG total, available;
 
     const int status = Length(&total, &available);
@@ -343,8 +668,8 @@ int MkvReader::InsertPage(
     if (status < 0)
         return status;
 
-    assert(available <= total);
-    assert(page_pos < total);
+    assert((total < 0) || (available <= total));
+    assert((total < 0) || (page_pos < total));
 
     const LONGLONG page_end = page_pos + page_size;
 
@@ -364,13 +689,23 @@ int MkvReader::InsertPage(
     //to manage the fact that the page isn't full.  But that
     //won't work either, because reads must be aligned (you
     //must request and entire page).
+    //
+    //While the total is unknown (we're following a file that is still
+    //being written), the last page is read only once it has been filled.
 
-    if ((page_end <= total) && (page_end > available))
+    if (((total < 0) || (page_end <= total)) && (page_end > available))
         return mkvparser::E_BUFFER_NOT_FULL;
 
-    HRESULT hr;
+    i = GetVictim();
+
+    if (i < 0)  //error: all samples are busy
+        return -1;  //generic error
+
+    ++m_stats.misses;
 
-    Page& page = *page_iter;
+    Page& page = m_pages[i];
+
+    HRESULT hr;
 
     if (page.pSample == 0)
     {
@@ -385,140 +720,269 @@ int MkvReader::InsertPage(
     hr = page.pSample->SetTime(&st, &sp);
     assert(SUCCEEDED(hr));
 
-    hr = m_pSource->SyncReadAligned(page.pSample);
+    const bool bShared = ReadShared(page, page_pos);
 
-    if (FAILED(hr))  //VFW_S_WRONG_STATE
+    if (!bShared)
     {
-        const ULONG cRef = page.pSample->Release();
-        cRef;
-
-        page.pSample = 0;
+        if (m_follower.is_open())
+            hr = ReadFollowed(page.pSample, page_pos);
+        else
+            hr = m_pSource->SyncReadAligned(page.pSample);
 
-        return -1;  //generic error value
+        if (FAILED(hr))  //VFW_S_WRONG_STATE
+        {
+            MakeEmpty(i);
+            return -1;  //generic error value
+        }
     }
 
-    m_free_pages.erase(free_page);
-    cache_iter = m_cache.insert(next, page_iter);
+    BYTE* ptr;
+
+    hr = page.pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+    assert(ptr);
+
+    page.pos = page_pos;
+    page.pData = ptr;
+    page.state = kPageReady;
+    page.bPrefetched = false;
+
+    if (!bShared)
+        WriteShared(page);
+
+    HashInsert(i);
+    LruPushBack(i);
+
+    Prefetch(page_pos, i);
+
+    index = i;
     return 0;  //success
 }
 
 
-int MkvReader::Length(
-    long long* pTotal,
-    long long* pAvailable)
+long MkvReader::GetVictim()
 {
-    if (!IsOpen())
-        return -1;
+    //Detach the least recently used page, which we then own.
 
-#if 0 //def _DEBUG
-    assert(m_total >= 0);
-    assert(m_avail <= m_total);
+    const long i = m_lru_head;
 
-    if (m_avail < m_total)
-    {
-        m_avail += 1024;
+    if (i < 0)
+        return -1;
 
-        if (m_avail > m_total)
-            m_avail = m_total;
-    }
+    LruUnlink(i);
 
-    *pTotal = m_total;
-    *pAvailable = m_avail;
+    Page& page = m_pages[i];
+    assert(page.cRef == 0);
+    assert(page.state != kPagePending);
 
-    return 0;
-#else
-    const HRESULT hr = m_pSource->Length(pTotal, pAvailable);
+    if (page.state == kPageReady)
+    {
+        ++m_stats.evictions;
 
-    if (FAILED(hr))
-        return -1;
+        HashRemove(i);
 
-    return 0;
-#endif
+        page.pos = -1;
+        page.pData = 0;
+        page.state = kPageEmpty;
+        page.bPrefetched = false;
+    }
+
+    return i;
 }
 
 
-void MkvReader::PurgeOne()
+void MkvReader::MakeEmpty(long i)
 {
-    if (m_cache.empty())
-        return;
+    //The page is owned by caller: it's not hashed, and not on the LRU
+    //list.  Return it to the head of the list, so it's the first to be
+    //recycled.
+
+    Page& page = m_pages[i];
+    assert(page.cRef == 0);
+    assert(!page.bLinked);
 
+    if (page.pSample)
     {
-        const cache_t::value_type page_iter = m_cache.front();
-        const Page& page = *page_iter;
+        const ULONG cRef = page.pSample->Release();
+        cRef;
 
-        if (page.cRef <= 0)
-        {
-            m_cache.pop_front();
+        page.pSample = 0;
+    }
 
-            const free_pages_t::value_type value(page.GetPos(), page_iter);
-            m_free_pages.insert(value);
+    page.pos = -1;
+    page.pData = 0;
+    page.state = kPageEmpty;
+    page.bPrefetched = false;
 
-            return;
-        }
-    }
+    LruPushFront(i);
+}
 
-    {
-        const cache_t::value_type page_iter = m_cache.back();
-        const Page& page = *page_iter;
 
-        if (page.cRef <= 0)
-        {
-            m_cache.pop_back();
+ULONG MkvReader::Hash(LONGLONG page_pos) const
+{
+    const LONGLONG page_num = page_pos / m_props.cbBuffer;
+    return static_cast<ULONG>(page_num) & m_bucket_mask;
+}
 
-            const free_pages_t::value_type value(page.GetPos(), page_iter);
-            m_free_pages.insert(value);
 
-            return;
-        }
-    }
+long MkvReader::Lookup(LONGLONG page_pos) const
+{
+    if (m_buckets.empty())
+        return -1;
+
+    long i = m_buckets[Hash(page_pos)];
 
+    while (i >= 0)
     {
-        typedef cache_t::iterator iter_t;
-        iter_t cache_iter = --iter_t(m_cache.end());
+        const Page& page = m_pages[i];
 
-        for (;;)
-        {
-            const cache_t::value_type page_iter = *cache_iter;
-            const Page& page = *page_iter;
+        if (page.pos == page_pos)
+            return i;
 
-            if (page.cRef == 0)
-            {
-                m_cache.erase(cache_iter);
+        i = page.hash_next;
+    }
 
-                const free_pages_t::value_type value(page.GetPos(), page_iter);
-                m_free_pages.insert(value);
+    return -1;
+}
 
-                return;
-            }
 
-            if (cache_iter == m_cache.begin())
-                break;
+void MkvReader::HashInsert(long i)
+{
+    Page& page = m_pages[i];
+    assert(page.pos >= 0);
+    assert(Lookup(page.pos) < 0);
 
-            --cache_iter;
-        }
+    long& head = m_buckets[Hash(page.pos)];
 
-        return;
+    page.hash_next = head;
+    head = i;
+}
+
+
+void MkvReader::HashRemove(long i)
+{
+    Page& page = m_pages[i];
+    assert(page.pos >= 0);
+
+    long* link = &m_buckets[Hash(page.pos)];
+
+    while (*link != i)
+    {
+        assert(*link >= 0);
+        link = &m_pages[*link].hash_next;
     }
+
+    *link = page.hash_next;
+    page.hash_next = -1;
 }
 
 
-LONGLONG MkvReader::Page::GetPos() const
+void MkvReader::LruPushFront(long i)
 {
-    if (pSample == 0)
-        return -1;
+    Page& page = m_pages[i];
+    assert(!page.bLinked);
 
-    LONGLONG st, sp;
+    page.lru_prev = -1;
+    page.lru_next = m_lru_head;
 
-    const HRESULT hr = pSample->GetTime(&st, &sp);
-    assert(SUCCEEDED(hr));
-    assert(st >= 0);
-    assert((st % 10000000) == 0);
+    if (m_lru_head >= 0)
+        m_pages[m_lru_head].lru_prev = i;
+    else
+        m_lru_tail = i;
+
+    m_lru_head = i;
+    page.bLinked = true;
+}
+
+
+void MkvReader::LruPushBack(long i)
+{
+    Page& page = m_pages[i];
+    assert(!page.bLinked);
+
+    page.lru_prev = m_lru_tail;
+    page.lru_next = -1;
+
+    if (m_lru_tail >= 0)
+        m_pages[m_lru_tail].lru_next = i;
+    else
+        m_lru_head = i;
+
+    m_lru_tail = i;
+    page.bLinked = true;
+}
+
+
+void MkvReader::LruUnlink(long i)
+{
+    Page& page = m_pages[i];
+    assert(page.bLinked);
 
-    const LONGLONG pos = st / 10000000;
-    return pos;
+    if (page.lru_prev >= 0)
+        m_pages[page.lru_prev].lru_next = page.lru_next;
+    else
+        m_lru_head = page.lru_next;
+
+    if (page.lru_next >= 0)
+        m_pages[page.lru_next].lru_prev = page.lru_prev;
+    else
+        m_lru_tail = page.lru_prev;
+
+    page.lru_prev = -1;
+    page.lru_next = -1;
+    page.bLinked = false;
 }
 
 
+int MkvReader::Length(
+    long long* pTotal,
+    long long* pAvailable)
+{
+    if (!IsOpen())
+        return -1;
+
+    if (m_follower.is_open())
+    {
+        //Whether the writer is done first, so the size we get is final.
+
+        const bool bFinished = m_follower.IsFinished();
+        const LONGLONG size = m_follower.GetSize();
+
+        if (size < 0)
+            return -1;
+
+        *pTotal = bFinished ? size : -1;
+        *pAvailable = size;
+
+        return 0;
+    }
+
+#if 0 //def _DEBUG
+    assert(m_total >= 0);
+    assert(m_avail <= m_total);
+
+    if (m_avail < m_total)
+    {
+        m_avail += 1024;
+
+        if (m_avail > m_total)
+            m_avail = m_total;
+    }
+
+    *pTotal = m_total;
+    *pAvailable = m_avail;
+
+    return 0;
+#else
+    const HRESULT hr = m_pSource->Length(pTotal, pAvailable);
+
+    if (FAILED(hr))
+        return -1;
+
+    return 0;
+#endif
+}
+
 HRESULT MkvReader::Wait(
     CLockable& lock,
     LONGLONG start_pos,
@@ -530,183 +994,528 @@ HRESULT MkvReader::Wait(
 
     //lock has already been seized
 
-    cache_t::iterator next = m_cache.end();
-
-    FreeOne(next);
+    const LONGLONG stop_pos = start_pos + LONGLONG(size) - 1;  //last byte
 
-    if (m_free_pages.empty())  //all samples are busy
-        return E_FAIL;
+    const DWORD page_size = m_props.cbBuffer;
+    const LONGLONG page_pos = page_size * LONGLONG(stop_pos / page_size);
 
-    free_pages_t::iterator free_page = m_free_pages.begin();
+    if (m_follower.is_open())
+        return WaitFollowed(lock, page_pos + page_size, timeout);
 
-    pages_list_t::iterator page_iter = free_page->second;
+    HRESULT hr;
 
-    m_free_pages.erase(free_page);
+    long i = Lookup(page_pos);
 
-    //We now own this page.
+    if (i < 0)
+    {
+        i = GetVictim();
 
-    Page& page = *page_iter;
-    assert(page.cRef == 0);
+        if (i < 0)  //all samples are busy
+            return E_FAIL;
 
-    HRESULT hr;
+        hr = Request(i, page_pos);
 
-    if (page.pSample == 0)
-    {
-        hr = m_pAllocator->GetBuffer(&page.pSample, 0, 0, 0);
-        assert(SUCCEEDED(hr));
-        assert(page.pSample);
+        if (FAILED(hr))
+            return VFW_E_TIMEOUT;
     }
 
-#if 0
-    LONGLONG total, avail;
+    //Completions are returned in whatever order the source finishes
+    //them, and other threads poll for read-ahead pages while we don't
+    //hold the lock, so we wait in slices and check again (under lock)
+    //whether our page is still outstanding.
 
-    const int status = Length(&total, &avail);
-    assert(status == 0);
-    assert(avail <= total);
-#endif
+    const DWORD kSlice = 100;  //ms
+    const DWORD start_time = GetTickCount();
 
-    const LONGLONG stop_pos = start_pos + LONGLONG(size) - 1;  //last byte
+    for (;;)
+    {
+        i = Lookup(page_pos);
 
-    const DWORD page_size = m_props.cbBuffer;
-    const LONGLONG page_pos = page_size * LONGLONG(stop_pos / page_size);
+        if (i < 0)  //async read request failed, or was cancelled
+            return VFW_E_TIMEOUT;
 
-    LONGLONG st = page_pos * 10000000;
-    LONGLONG sp = (page_pos + page_size) * 10000000;
+        if (m_pages[i].state == kPageReady)
+            break;
 
-    hr = page.pSample->SetTime(&st, &sp);
-    assert(SUCCEEDED(hr));
-    assert(page.GetPos() == page_pos);
+        DWORD wait = kSlice;
 
-    hr = m_pSource->Request(page.pSample, 0);
+        if (timeout != INFINITE)
+        {
+            const DWORD elapsed = GetTickCount() - start_time;
 
-    HRESULT hrWait;
+            if (elapsed >= timeout)
+                return VFW_E_TIMEOUT;  //request remains pending
+
+            if ((timeout - elapsed) < wait)
+                wait = timeout - elapsed;
+        }
 
-    if (SUCCEEDED(hr))
-    {
         IMediaSample* pSample;
         DWORD_PTR token;
 
         hr = lock.Release();
         assert(SUCCEEDED(hr));
 
-        hrWait = m_pSource->WaitForNext(timeout, &pSample, &token);
+        const HRESULT hrWait = m_pSource->WaitForNext(wait, &pSample, &token);
 
         hr = lock.Seize(INFINITE);
         assert(SUCCEEDED(hr));
 
-        if (SUCCEEDED(hrWait))
-        {
-            assert(pSample == page.pSample);
-            assert(token == 0);
-
-            pSample = 0;
+        if (pSample)
+            OnRequestDone(pSample, hrWait, token);
 
-            const free_pages_t::value_type value(page_pos, page_iter);
-            m_free_pages.insert(value);
+        else if (m_bFlushing)  //wait was cancelled
+            return VFW_E_TIMEOUT;
+    }
 
 #if 0 //def _DEBUG
-            const LONGLONG avail = page_pos + page_size;
-            m_avail = (avail >= m_total) ? m_total : avail;
+    const LONGLONG avail = page_pos + page_size;
+    m_avail = (avail >= m_total) ? m_total : avail;
 #endif
 
-            return S_OK;
-        }
+    return S_OK;
+}
 
-        hrWait = E_FAIL;
-    }
 
-    //async read request failed, or was cancelled
+HRESULT MkvReader::BeginFlush()
+{
+    m_bFlushing = true;
+    m_follower.Cancel();  //a thread waiting for the file to grow
 
-    IMediaSample* pSample;
-    DWORD_PTR token;
+    const HRESULT hr = m_pSource->BeginFlush();
 
-    for (;;)
+    //The flush causes outstanding requests to complete (with an error)
+    //immediately, so their pages can be returned to the cache now.
+    PollPending();
+
+    return hr;
+}
+
+
+HRESULT MkvReader::EndFlush()
+{
+    const HRESULT hr = m_pSource->EndFlush();
+
+    m_bFlushing = false;
+    m_follower.Resume();
+    m_cursors.clear();  //a seek follows; re-detect sequential access
+
+    return hr;
+}
+
+
+void MkvReader::SetPrefetchWindow(long pages)
+{
+    m_prefetch_window = (pages > 0) ? pages : 0;
+}
+
+
+long MkvReader::GetPrefetchWindow() const
+{
+    return m_prefetch_window;
+}
+
+
+void MkvReader::SetPrefetchCursors(long count)
+{
+    m_cPrefetchCursors = (count > 1) ? count : 1;
+
+    if (m_cursors.size() > cursors_t::size_type(m_cPrefetchCursors))
+        m_cursors.resize(m_cPrefetchCursors);
+}
+
+
+long MkvReader::GetPrefetchCursors() const
+{
+    return m_cPrefetchCursors;
+}
+
+
+void MkvReader::GetCacheStats(CacheStats& stats) const
+{
+    stats = m_stats;
+}
+
+
+void MkvReader::ResetCacheStats()
+{
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+    m_stats.prefetches = 0;
+    m_stats.shared = 0;
+}
+
+
+void MkvReader::Prefetch(LONGLONG page_pos, long curr)
+{
+    //Called when the parser first touches page_pos, whether that was a
+    //miss or a page we read ahead.  When it immediately follows the page
+    //touched before, the parser is streaming through a cluster, so we
+    //queue requests for the pages that follow, in order that they are
+    //already on hand (or at least in flight) by the time the parser gets
+    //to them.  The page at index curr is about to be read by our caller,
+    //so it must not be recycled.
+    //
+    //The loader and the outpins read from different places in the file
+    //(far apart, when the file is badly interleaved), so we follow a few
+    //streams of reads at once.  A page that follows the page last touched
+    //by one of them continues that stream; any other page begins a new
+    //one, in place of the stream touched least recently.
+
+    //A followed file is read synchronously, and only as far as it has
+    //been written, so there is nothing to read ahead.
+
+    if (m_follower.is_open())
+        return;
+
+    const LONG page_size = m_props.cbBuffer;
+
+    typedef cursors_t::iterator iter_t;
+
+    iter_t iter = m_cursors.begin();
+    const iter_t iter_end = m_cursors.end();
+
+    while ((iter != iter_end) && ((*iter + page_size) != page_pos))
+        ++iter;
+
+    const bool bSequential = (iter != iter_end);
+
+    if (bSequential)
+        m_cursors.erase(iter);
+
+    else if (m_cursors.size() >= cursors_t::size_type(m_cPrefetchCursors))
+        m_cursors.pop_back();
+
+    m_cursors.insert(m_cursors.begin(), page_pos);
+
+    if (!bSequential || m_sync_read || m_bFlushing)
+        return;
+
+    if (m_prefetch_window <= 0)
+        return;
+
+    LONGLONG total, available;
+
+    const int status = Length(&total, &available);
+
+    if (status < 0)
+        return;
+
+    //Leave at least half of the pages for the cache proper, otherwise
+    //read-ahead would starve the pages locked on behalf of the outpins.
+    //That half is shared by the streams of reads we follow.
+    long max_pending = m_props.cBuffers / 2;
+
+    if (max_pending > m_prefetch_window)
+        max_pending = m_prefetch_window;
+
+    const LONGLONG start_pos = page_pos + page_size;
+    const LONGLONG stop_pos = start_pos + m_prefetch_window * LONGLONG(page_size);
+
+    for (LONGLONG pos = start_pos; pos < stop_pos; pos += page_size)
     {
-        hrWait = m_pSource->WaitForNext(0, &pSample, &token);
+        if (pos >= total)
+            break;
 
-        if (pSample == 0)
+        if (m_cPending >= max_pending)
             break;
+
+        if (Lookup(pos) >= 0)  //cached, or in flight
+            continue;
+
+        if (m_lru_head < 0)
+            break;
+
+        //Never recycle a page we have already read ahead.
+
+        if (m_lru_head == curr)
+            break;
+
+        if (m_pages[m_lru_head].bPrefetched)
+            break;
+
+        const long i = GetVictim();
+        assert(i >= 0);
+
+        const HRESULT hr = Request(i, pos);
+
+        if (FAILED(hr))
+            break;
+
+        ++m_stats.prefetches;
     }
+}
 
-    const ULONG cRef = page.pSample->Release();
-    cRef;
 
-    page.pSample = 0;
-    assert(page.GetPos() < 0);
+HRESULT MkvReader::Request(long i, LONGLONG page_pos)
+{
+    //The page has been detached by GetVictim.  On success it stays
+    //pending (hashed, but not on the LRU list) until OnRequestDone;
+    //on failure the page is returned to the LRU list as empty.
+
+    Page& page = m_pages[i];
+    assert(page.cRef == 0);
+    assert(page.state == kPageEmpty);
+    assert(!page.bLinked);
+
+    HRESULT hr;
 
-    const free_pages_t::value_type value(-1, page_iter);
-    m_free_pages.insert(value);
+    if (page.pSample == 0)
+    {
+        hr = m_pAllocator->GetBuffer(&page.pSample, 0, 0, 0);
+        assert(SUCCEEDED(hr));
+        assert(page.pSample);
+    }
+
+    const DWORD page_size = m_props.cbBuffer;
+
+    LONGLONG st = page_pos * 10000000;
+    LONGLONG sp = (page_pos + page_size) * 10000000;
+
+    hr = page.pSample->SetTime(&st, &sp);
+    assert(SUCCEEDED(hr));
+
+    if (ReadShared(page, page_pos))  //on hand already: no request
+    {
+        BYTE* ptr;
+
+        hr = page.pSample->GetPointer(&ptr);
+        assert(SUCCEEDED(hr));
+        assert(ptr);
+
+        page.pos = page_pos;
+        page.pData = ptr;
+        page.state = kPageReady;
+        page.bPrefetched = true;
+
+        HashInsert(i);
+        LruPushBack(i);
+
+        return S_OK;
+    }
+
+    hr = m_pSource->Request(page.pSample, i);
+
+    if (FAILED(hr))
+    {
+        MakeEmpty(i);
+        return hr;
+    }
 
-    return VFW_E_TIMEOUT;
+    page.pos = page_pos;
+    page.state = kPagePending;
+
+    HashInsert(i);
+    ++m_cPending;
+
+    return S_OK;
 }
 
 
-HRESULT MkvReader::BeginFlush()
+HRESULT MkvReader::ReadFollowed(IMediaSample* pSample, LONGLONG page_pos)
 {
-    return m_pSource->BeginFlush();
+    //The page has been written (or it's the last page of a file that
+    //is finished), so its data doesn't change once read.
+
+    BYTE* ptr;
+
+    HRESULT hr = pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+    assert(ptr);
+
+    const long len = m_follower.Read(page_pos, m_props.cbBuffer, ptr);
+
+    if (len < 0)
+        return E_FAIL;
+
+    hr = pSample->SetActualDataLength(len);
+    assert(SUCCEEDED(hr));
+
+    return hr;
 }
 
 
-HRESULT MkvReader::EndFlush()
+HRESULT MkvReader::WaitFollowed(
+    CLockable& lock,
+    LONGLONG end_pos,
+    DWORD timeout)
+{
+    //We wait for the writer without holding the lock, so that the
+    //outpins can keep delivering the clusters already loaded.  A flush
+    //cancels the wait.
+
+    HRESULT hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    typedef webmdshow::TailFollower TF;
+    const TF::WaitResult result = m_follower.WaitForSize(end_pos, timeout);
+
+    hr = lock.Seize(INFINITE);
+    assert(SUCCEEDED(hr));
+
+    switch (result)
+    {
+        case TF::kReached:
+        case TF::kFinished:  //the total is known now
+            return S_OK;
+
+        case TF::kCancelled:
+        case TF::kTimedOut:
+            return VFW_E_TIMEOUT;
+
+        case TF::kFailed:
+        default:
+            return E_FAIL;
+    }
+}
+
+
+bool MkvReader::ReadShared(Page& page, LONGLONG page_pos)
 {
-    return m_pSource->EndFlush();
+    //The page is owned by caller, and has a sample.
+
+    if (m_pShared == 0)
+        return false;
+
+    BYTE* ptr;
+
+    const HRESULT hr = page.pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+    assert(ptr);
+
+    //A page of another size (cached by a splitter whose source gave it
+    //another allocator) is of no use to us.
+
+    const long page_size = m_props.cbBuffer;
+
+    using webmdshow::SharedFileCache;
+    const long len = SharedFileCache::Read(m_pShared, page_pos, ptr, page_size);
+
+    if (len != page_size)
+        return false;
+
+    ++m_stats.shared;
+    return true;
 }
 
 
-void MkvReader::FreeOne(cache_t::iterator& next)
+void MkvReader::WriteShared(const Page& page)
 {
-    if (!m_free_pages.empty())
+    if (m_pShared == 0)
         return;
 
-    LONGLONG next_pos;
+    assert(page.state == kPageReady);
+    assert(page.pData);
 
-    if (next == m_cache.end())
-        next_pos = -1;
-    else
+    const long page_size = m_props.cbBuffer;
+
+    using webmdshow::SharedFileCache;
+    SharedFileCache::Write(m_pShared, page.pos, page.pData, page_size);
+}
+
+
+void MkvReader::PollPending()
+{
+    while (m_cPending > 0)
     {
-        const cache_t::value_type page_iter = *next;
-        Page& page = *page_iter;
+        IMediaSample* pSample;
+        DWORD_PTR token;
+
+        const HRESULT hr = m_pSource->WaitForNext(0, &pSample, &token);
 
-        next_pos = page.GetPos();
-        assert(next_pos >= 0);
+        if (pSample == 0)
+            break;
 
-        ++page.cRef;
+        OnRequestDone(pSample, hr, token);
     }
+}
 
-    PurgeOne();
 
-    if (!m_free_pages.empty())  //success
+void MkvReader::OnRequestDone(
+    IMediaSample* pSample,
+    HRESULT hrRead,
+    DWORD_PTR token)
+{
+    assert(pSample);
+
+    const long i = static_cast<long>(token);
+    assert(i >= 0);
+    assert(i < long(m_pages.size()));
+
+    Page& page = m_pages[i];
+    assert(page.pSample == pSample);
+    assert(page.state == kPagePending);
+    assert(page.cRef == 0);
+    assert(!page.bLinked);
+
+    assert(m_cPending > 0);
+    --m_cPending;
+
+    const bool bOrphan = (Lookup(page.pos) != i);
+
+    if (SUCCEEDED(hrRead) && !bOrphan)
     {
-        if (next_pos < 0)
-            next = m_cache.end();
-        else
-        {
-            typedef cache_t::iterator iter_t;
+        BYTE* ptr;
 
-            const iter_t i = m_cache.begin();
-            const iter_t j = m_cache.end();
+        const HRESULT hr = pSample->GetPointer(&ptr);
+        assert(SUCCEEDED(hr));
+        assert(ptr);
 
-            next = std::lower_bound(i, j, next_pos, PageLess());
-            assert(next != j);
+        page.pData = ptr;
+        page.state = kPageReady;
+        page.bPrefetched = true;
 
-            const cache_t::value_type page_iter = *next;
-            const Page& page = *page_iter;
-            page;
-            assert(page.GetPos() == next_pos);
-            assert(page.cRef > 0);
-        }
+        WriteShared(page);
+
+        LruPushBack(i);
+        return;
     }
 
-    if (next_pos >= 0)
+    //cancelled by flush, the read failed, or the page was superseded
+
+    if (!bOrphan)
+        HashRemove(i);
+
+    MakeEmpty(i);
+}
+
+
+void MkvReader::CancelPending()
+{
+    if (m_cPending <= 0)
+        return;
+
+    HRESULT hr = m_pSource->BeginFlush();
+    assert(SUCCEEDED(hr));
+
+    PollPending();
+    assert(m_cPending == 0);
+
+    hr = m_pSource->EndFlush();
+    assert(SUCCEEDED(hr));
+
+    //Should never happen, but don't leak pages whose request
+    //was not returned to us.
+
+    const long n = static_cast<long>(m_pages.size());
+
+    for (long i = 0; (i < n) && (m_cPending > 0); ++i)
     {
-        assert(next != m_cache.end());
+        Page& page = m_pages[i];
 
-        const cache_t::value_type page_iter = *next;
-        Page& page = *page_iter;
-        assert(page.GetPos() == next_pos);
-        assert(page.cRef > 0);
+        if (page.state != kPagePending)
+            continue;
+
+        if (Lookup(page.pos) == i)
+            HashRemove(i);
+
+        page.pos = -1;
+        page.pData = 0;
+        page.state = kPageEmpty;
 
-        --page.cRef;
+        LruPushFront(i);
+        --m_cPending;
     }
 }
 
@@ -725,71 +1534,21 @@ HRESULT MkvReader::LockPages(const mkvparser::BlockEntry* pBE)
     LONGLONG pos = pBlock->m_start;
     long len = static_cast<long>(pBlock->m_size);
 
-    typedef cache_t::iterator iter_t;
-    iter_t next;
-
-    const DWORD page_size = m_props.cbBuffer;
-
-//    int n = 0;
-
-    if (m_cache.empty() || (pos < (*m_cache.front()).GetPos()))
-        next = m_cache.begin();
-    else
-    {
-        const iter_t i = m_cache.begin();
-        const iter_t j = m_cache.end();
-
-        next = std::upper_bound(i, j, pos, PageLess());
-        assert(next != i);
-
-        const cache_t::value_type page_iter = *--iter_t(next);
-        Page& page = *page_iter;
-        const LONGLONG page_end = page.GetPos() + page_size;
-
-        if (pos < page_end)  //cache hit
-        {
-            Read(page_iter, pos, len, 0);
-            ++page.cRef;
-//            ++n;
-        }
-    }
-
     while (len > 0)
     {
-        if ((next == m_cache.end()) || ((*next)->GetPos() > pos))
-        {
-            iter_t curr_iter;
-
-            const int status = InsertPage(next, pos, curr_iter);
+        long index;
 
-            if (status < 0)  //error
-                return status;
+        const int status = GetPage(pos, index);
 
-            if (curr_iter == m_cache.end())  //async read is req'd
-                return VFW_E_BUFFER_UNDERFLOW;
+        if (status < 0)  //error
+            return status;
 
-            const cache_t::value_type page_iter = *curr_iter;
-            Page& page = *page_iter;
+        Page& page = m_pages[index];
 
-            next = ++iter_t(curr_iter);
-            assert((next == m_cache.end()) ||
-                   ((*next)->GetPos() > page.GetPos()));
+        if ((page.cRef++ == 0) && page.bLinked)  //never recycle locked pages
+            LruUnlink(index);
 
-            Read(page_iter, pos, len, 0);
-            ++page.cRef;
-//            ++n;
-        }
-        else
-        {
-            const cache_t::value_type page_iter = *next++;
-            Page& page = *page_iter;
-            assert(page.GetPos() <= pos);
-            assert(pos < (page.GetPos() + page_size));
-
-            Read(page_iter, pos, len, 0);
-            ++page.cRef;
-//            ++n;
-        }
+        Read(page, pos, len, 0);
     }
 
     return S_OK;
@@ -812,44 +1571,104 @@ void MkvReader::UnlockPages(const mkvparser::BlockEntry* pBE)
 
     const DWORD page_size = m_props.cbBuffer;
 
-    assert(!m_cache.empty());
-    assert((*m_cache.front()).GetPos() <= pos);
-
-    typedef cache_t::iterator iter_t;
+    while (len > 0)
+    {
+        const LONGLONG page_pos = page_size * LONGLONG(pos / page_size);
 
-    const iter_t i = m_cache.begin();
-    const iter_t j = m_cache.end();
+        const long index = Lookup(page_pos);
+        assert(index >= 0);
 
-    iter_t next = std::upper_bound(i, j, pos, PageLess());
-    assert(next != i);
+        Page& page = m_pages[index];
+        assert(page.state == kPageReady);
+        assert(page.cRef > 0);
 
-    {
-        const cache_t::value_type page_iter = *--iter_t(next);
-        Page& page = *page_iter;
-        const LONGLONG page_end = page.GetPos() + page_size;
+        Read(page, pos, len, 0);
 
-        if (pos < page_end)  //cache hit
-        {
-            assert(page.cRef > 0);
+        if (--page.cRef > 0)
+            continue;
 
-            Read(page_iter, pos, len, 0);
-            --page.cRef;
-        }
+        if ((m_pLender == 0) || (m_pLender->m_lent[index] == 0))
+            LruPushBack(index);  //else ReclaimLent does, when they return
     }
+}
 
-    while (len > 0)
+
+HRESULT MkvReader::LendFrame(long long pos, long len, IMediaSample** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = 0;
+
+    if (m_sync_read || (m_pLender == 0) || (pos < 0) || (len <= 0))
+        return S_FALSE;
+
+    const LONGLONG page_size = m_props.cbBuffer;
+    const LONGLONG page_pos = page_size * (pos / page_size);
+
+    if ((pos + len) > (page_pos + page_size))  //spans pages
+        return S_FALSE;
+
+    //Downstream filters may hold on to frames (the muxer keeps a cluster's
+    //worth), and a lent page can't be recycled, so we lend no more than a
+    //quarter of the cache; the rest of the frames are copied.
+
+    const long cMaxLent = static_cast<long>(m_pages.size()) / 4;
+
+    if (m_pLender->m_cLent >= cMaxLent)
+        return S_FALSE;
+
+    const long i = Lookup(page_pos);
+
+    if (i < 0)
+        return S_FALSE;
+
+    Page& page = m_pages[i];
+
+    if ((page.state != kPageReady) || (page.cRef <= 0))  //not locked
+        return S_FALSE;
+
+    assert(page.pSample);
+    assert(page.pData);
+
+    BYTE* const ptr = const_cast<BYTE*>(page.pData) + (pos - page_pos);
+
+    FrameSample* const pSample = new (std::nothrow) FrameSample(
+                                    m_pLender,
+                                    i,
+                                    page.pSample,
+                                    ptr,
+                                    len);
+
+    if (pSample == 0)
+        return S_FALSE;
+
+    *pp = pSample;
+    return S_OK;
+}
+
+
+void MkvReader::ReclaimLent()
+{
+    if ((m_pLender == 0) || (m_pLender->m_cReturned == 0))
+        return;
+
+    InterlockedExchange(&m_pLender->m_cReturned, 0);
+
+    //A page that is ready, unlocked, and yet off the list is one that had
+    //frames lent; any whose frames have all returned go back on the list.
+
+    const long n = static_cast<long>(m_pages.size());
+
+    for (long i = 0; i < n; ++i)
     {
-        assert(next != m_cache.end());
-        assert((*next)->GetPos() <= pos);
+        const Page& page = m_pages[i];
 
-        const cache_t::value_type page_iter = *next++;
-        Page& page = *page_iter;
-        assert(page.GetPos() <= pos);
-        assert(pos < (page.GetPos() + page_size));
-        assert(page.cRef > 0);
+        if ((page.state != kPageReady) || (page.cRef > 0) || page.bLinked)
+            continue;
 
-        Read(page_iter, pos, len, 0);
-        --page.cRef;
+        if (m_pLender->m_lent[i] == 0)
+            LruPushBack(i);
     }
 }
 
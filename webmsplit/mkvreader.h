@@ -10,10 +10,9 @@
 #include "mkvparser.hpp"
 #include "mkvparserstreamreader.h"
 #include "graphutil.h"
-#include <list>
-#include <map>
-//#include <set>
-#include <deque>
+#include "sharedfilecache.h"
+#include "tailfollower.h"
+#include <vector>
 
 class CLockable;
 
@@ -32,72 +31,161 @@ public:
     HRESULT SetSource(IAsyncReader*);
     bool IsOpen() const;
 
+    //The file in the shared cache (see webmdshow::SharedFileCache), or
+    //null.  Pages the cache has are read from it instead of the source,
+    //and the pages read from the source are copied to it.  The reader
+    //closes the file when the source is set again.
+    void SetSharedFile(webmdshow::SharedFileCache::File*);
+
+    //Follows the file of the source, which its writer is still appending
+    //to (see webmdshow::TailFollower).  Until the writer is done, the
+    //total length is unknown (-1), pages are read from the file itself
+    //once they have been written, and Wait blocks until the file grows.
+    //The reader stops following when the source is set again.
+    bool Follow(const wchar_t* filename);
+    bool IsFollowing() const;
+
     int Read(long long pos, long len, unsigned char* buf);
     int Length(long long* total, long long* available);
 
     HRESULT LockPages(const mkvparser::BlockEntry*);
     void UnlockPages(const mkvparser::BlockEntry*);
+    HRESULT LendFrame(long long pos, long len, IMediaSample**);
 
     HRESULT Wait(CLockable&, LONGLONG pos, LONG size, DWORD timeout_ms);
 
     HRESULT BeginFlush();
     HRESULT EndFlush();
 
+    //Number of pages ahead of the parse position for which async read
+    //requests are queued, once sequential access has been detected.
+    //Zero disables read-ahead.
+    void SetPrefetchWindow(long pages);
+    long GetPrefetchWindow() const;
+
+    enum { kDefaultPrefetchWindow = 64 };
+
+    //Number of sequential streams of reads that are followed at once,
+    //each with a window of its own.  The loader parsing ahead is one;
+    //in a badly interleaved file, each outpin reading frames far behind
+    //it is another.  1 follows only the most recent one.
+    void SetPrefetchCursors(long count);
+    long GetPrefetchCursors() const;
+
+    enum { kDefaultPrefetchCursors = 4 };
+
+    struct CacheStats
+    {
+        LONGLONG hits;        //page lookups satisfied from the cache
+        LONGLONG misses;      //pages that had to be read synchronously
+        LONGLONG evictions;   //cached pages recycled to hold another page
+        LONGLONG prefetches;  //read-ahead requests issued
+        LONGLONG shared;      //pages copied from the shared cache
+    };
+
+    void GetCacheStats(CacheStats&) const;
+    void ResetCacheStats();
+
     bool m_sync_read;
 
 private:
     ALLOCATOR_PROPERTIES m_props;
     GraphUtil::IMemAllocatorPtr m_pAllocator;
     GraphUtil::IAsyncReaderPtr m_pSource;
+    webmdshow::SharedFileCache::File* m_pShared;
+    webmdshow::TailFollower m_follower;
+
+    //The cache is a fixed slab of pages, one per allocator buffer, created
+    //during Commit.  A page holding data is found through a hash table
+    //(chained through the pages themselves) keyed by page position.  Pages
+    //that nobody has locked are kept on an intrusive LRU list; the head
+    //of the list is the next page to be recycled, so empty pages go there.
+    //Locked pages, and pages with an async request outstanding, are not
+    //on the list and so are never recycled.
+
+    enum PageState
+    {
+        kPageEmpty,
+        kPageReady,
+        kPagePending
+    };
 
     struct Page
     {
+        LONGLONG pos;  //-1 when empty
+        IMediaSample* pSample;
+        const BYTE* pData;
         int cRef;
-        GraphUtil::IMediaSamplePtr pSample;
-
-        LONGLONG GetPos() const;
+        PageState state;
+        bool bPrefetched;  //read ahead, and not yet used by parser
+        long hash_next;
+        long lru_prev;
+        long lru_next;
+        bool bLinked;  //on the LRU list
     };
 
-    typedef std::list<Page> pages_list_t;
-    pages_list_t m_pages;
+    typedef std::vector<Page> pages_t;
+    pages_t m_pages;
 
-    typedef std::multimap<LONGLONG, pages_list_t::iterator> free_pages_t;
-    free_pages_t m_free_pages;
+    typedef std::vector<long> buckets_t;
+    buckets_t m_buckets;
+    ULONG m_bucket_mask;
 
-    typedef std::deque<pages_list_t::iterator> cache_t;
-    cache_t m_cache;
+    long m_lru_head;  //least recently used
+    long m_lru_tail;  //most recently used
 
-    struct PageLess
-    {
-        bool operator()(cache_t::value_type lhs, LONGLONG pos) const
-        {
-            return (lhs->GetPos() < pos);
-        }
-
-        bool operator()(LONGLONG pos, cache_t::value_type rhs) const
-        {
-            return (pos < rhs->GetPos());
-        }
-
-        bool operator()(cache_t::value_type lhs, cache_t::value_type rhs) const
-        {
-            return (lhs->GetPos() < rhs->GetPos());
-        }
-    };
+    long m_cPending;
+    long m_prefetch_window;
+    long m_cPrefetchCursors;
+    bool m_bFlushing;
 
-    HRESULT Commit();
-    HRESULT Decommit();
+    //The page each stream of reads touched last, most recent first.
+    typedef std::vector<LONGLONG> cursors_t;
+    cursors_t m_cursors;
+
+    CacheStats m_stats;
 
-    void Read(
-        pages_list_t::const_iterator,
-        long long&,
-        long&,
-        unsigned char**) const;
+    //A frame that lies within one page is lent to the stream as it is, in
+    //a sample that refers to the page (see LendFrame).  A page is kept off
+    //the LRU list while any frame on it is lent.  Samples are released on
+    //downstream threads, which don't hold the lock, so the lender counts
+    //them with interlocked operations, and ReclaimLent (called with the
+    //lock held) returns pages whose frames have all come back to the list.
 
-    int InsertPage(cache_t::iterator, LONGLONG, cache_t::iterator&);
+    class Lender;
+    class FrameSample;
+
+    Lender* m_pLender;
+
+    void ReclaimLent();
+
+    HRESULT Commit();
+    HRESULT Decommit();
 
-    void FreeOne(cache_t::iterator&);
-    void PurgeOne();
+    void Read(const Page&, long long&, long&, unsigned char**) const;
+
+    int GetPage(LONGLONG pos, long& index);
+    long GetVictim();
+    void MakeEmpty(long index);
+
+    ULONG Hash(LONGLONG page_pos) const;
+    long Lookup(LONGLONG page_pos) const;
+    void HashInsert(long index);
+    void HashRemove(long index);
+
+    void LruPushFront(long index);
+    void LruPushBack(long index);
+    void LruUnlink(long index);
+
+    void Prefetch(LONGLONG page_pos, long curr);
+    HRESULT Request(long index, LONGLONG page_pos);
+    HRESULT ReadFollowed(IMediaSample*, LONGLONG page_pos);
+    HRESULT WaitFollowed(CLockable&, LONGLONG end_pos, DWORD timeout_ms);
+    bool ReadShared(Page&, LONGLONG page_pos);
+    void WriteShared(const Page&);
+    void PollPending();
+    void OnRequestDone(IMediaSample*, HRESULT, DWORD_PTR);
+    void CancelPending();
 
 #if 0 //def _DEBUG
     LONGLONG m_total;
@@ -11,16 +11,21 @@
 #include "webmsplitfilter.h"
 #include "cenumpins.h"
 #include "mkvparser.hpp"
+#include "mkvparserelementreader.h"
 #include "mkvparserstreamvideo.h"
 #include "mkvparserstreamaudio.h"
+#include "mkvparserstreamtext.h"
 #include "webmsplitoutpin.h"
 #include "webmtypes.h"
+#include "threadutil.h"
 #include <new>
 #include <cassert>
 #include <vfwmsgs.h>
 #include <process.h>
 #include <evcode.h>
 #include <limits>
+#include <algorithm>
+#include <cstring>
 #ifdef _DEBUG
 #include "iidstr.h"
 #include "odbgstream.h"
@@ -91,10 +96,32 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_seekBase_ns(-1),
       m_currTime(kNoSeek),
       m_inpin(this),
-      m_cStarvation(-1)  //means "not starving"
+      m_cStarvation(-1),  //means "not starving"
+      m_cWakeups(0),
+      m_cStarved(0),
+      m_cLookahead(kDefaultLookahead),
+      m_bLoaderWaiting(false),
+      m_bStarving(false),
+      m_bDamaged(false),
+      m_bWideInterleave(false),
+      m_bAccurateSeek(false),
+      m_tail_latency(kDefaultTailLatency),
+      m_scheduler(kSchedulerThreads),
+      m_bLoop(false),
+      m_cPoolIdle(0),
+      m_hPoolWork(0),
+      m_hPoolQuit(0),
+      m_bLoopLoading(false),
+      m_bCheckCrc(false)
 {
     m_pClassFactory->LockServer(TRUE);
 
+    ResetSeekStats();
+    ResetCrcStats();
+
+    m_interleave_stats.max_clusters = 0;
+    m_interleave_stats.warnings = 0;
+
     const HRESULT hr = CLockable::Init();
     hr;
     assert(SUCCEEDED(hr));
@@ -102,6 +129,9 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
     m_hNewCluster = CreateEvent(0, 0, 0, 0);
     assert(m_hNewCluster);  //TODO
 
+    m_hAdvance = CreateEvent(0, 0, 0, 0);
+    assert(m_hAdvance);  //TODO
+
     m_info.pGraph = 0;
     m_info.achName[0] = L'\0';
 
@@ -125,6 +155,9 @@ Filter::~Filter()
 
     assert(m_pSegment == 0);
 
+    CloseHandle(m_hNewCluster);
+    CloseHandle(m_hAdvance);
+
     m_pClassFactory->LockServer(FALSE);
 }
 
@@ -139,6 +172,8 @@ void Filter::Init()
     if (m_pSegment->DoneParsing())
         return;  //nothing for thread to do
 
+    m_bDamaged = false;
+
     const uintptr_t h = _beginthreadex(
                             0,  //security
                             0,  //stack size
@@ -188,6 +223,13 @@ void Filter::Final()
     //HRESULT hr = m_inpin.m_reader.Cancel();
     //assert(SUCCEEDED(hr));
 
+    //The state is already stopped, so if the loader is waiting for the
+    //outpins to catch up, this makes it check, and terminate.
+
+    const BOOL bSet = SetEvent(m_hAdvance);
+    bSet;
+    assert(bSet);
+
     const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
     dw;
     assert(dw == WAIT_OBJECT_0);
@@ -241,6 +283,18 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<IBaseFilter*>(m_pFilter);
     }
+    else if (iid == __uuidof(IPipelineCounters))
+    {
+        pUnk = static_cast<IPipelineCounters*>(m_pFilter);
+    }
+    else if (iid == __uuidof(ISharedFileCache))
+    {
+        pUnk = static_cast<ISharedFileCache*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IWebmDecryption))
+    {
+        pUnk = static_cast<IWebmDecryption*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -901,6 +955,11 @@ HRESULT Filter::Open()
                 CreateOutpin(s);
         }
 #endif
+        else if ((type == 0x11) || (type == 0x21))  //subtitle, metadata
+        {
+            if (TextStream* s = TextStream::CreateInstance(pTrack))
+                CreateOutpin(s);
+        }
     }
 
     if (m_outpins.empty())
@@ -911,6 +970,9 @@ HRESULT Filter::Open()
     m_seekBase_ns = -1;
     m_currTime = kNoSeek;
 
+    m_cluster_index.clear();
+    ResetCrcStats();
+
     return S_OK;
 }
 
@@ -920,6 +982,16 @@ void Filter::CreateOutpin(mkvparser::Stream* s)
     //Outpin* const p = new (std::nothrow) Outpin(this, s);
     Outpin* const p = Outpin::Create(this, s);
     m_outpins.push_back(p);
+
+    typedef keys_t::const_iterator iter_t;
+
+    for (iter_t i = m_keys.begin(); i != m_keys.end(); ++i)
+    {
+        const BYTE* const id = reinterpret_cast<const BYTE*>(i->key_id.data());
+        const ULONG len = static_cast<ULONG>(i->key_id.size());
+
+        s->SetDecryptionKey(id, len, i->key);
+    }
 }
 
 
@@ -928,6 +1000,11 @@ void Filter::OnStart()
 {
     //m_inpin.Start();
 
+    if ((m_currTime == kNoSeek) && m_inpin.m_reader.IsFollowing())
+        SeekTail();
+
+    m_bLoop = (m_scheduler == kSchedulerLoop);  //see Outpin::Start
+
     typedef outpins_t::iterator iter_t;
 
     iter_t i = m_outpins.begin();
@@ -953,13 +1030,36 @@ void Filter::OnStart()
         m_cStarvation = 0;  //temporarily enter starvation mode to force check
     }
 
-    Init();  //create reader thread
+    if (m_bLoop)
+        InitLoop();  //create delivery loop thread
+    else
+        Init();  //create reader thread
 }
 
 
 void Filter::OnStop()
 {
-    Final();  //terminate reader thread
+    if (m_bLoop)
+    {
+        //Flush downstream of each pin, so that the loop and the pool let
+        //go of it, before the loop thread is terminated.
+
+        typedef loop_pins_t::iterator iter_t;
+
+        for (iter_t i = m_loop_pins.begin(); i != m_loop_pins.end(); ++i)
+            SuspendLoopPin(i->pPin);
+
+        FinalLoop();
+    }
+    else
+        Final();  //terminate reader thread
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "WebmSplit::Filter::OnStop: wakeups=" << GetWakeupCount()
+       << " starvations=" << GetStarvationCount()
+       << endl;
+#endif
 
     typedef outpins_t::iterator iter_t;
 
@@ -1015,10 +1115,13 @@ unsigned Filter::Main()
 {
     assert(m_pSegment);
 
+    //There's no need to yield between clusters: we release the lock at the
+    //end of each pass, and the mutex is granted to any streaming thread
+    //already waiting for it.  When the data for the next cluster hasn't
+    //arrived yet we block (in MkvReader::Wait) until it has.
+
     for (;;)
     {
-        Sleep(0);
-
 #if 0
         LONGLONG cluster_pos, new_pos;
 
@@ -1029,7 +1132,7 @@ unsigned Filter::Main()
 
         Lock lock;
 
-        const HRESULT hr = lock.Seize(this);
+        HRESULT hr = lock.Seize(this);
         assert(SUCCEEDED(hr));  //TODO
 
         if (FAILED(hr))
@@ -1066,12 +1169,22 @@ unsigned Filter::Main()
                 break;
 
             if (status != mkvparser::E_BUFFER_NOT_FULL)
+            {
+                //Let the outpins waiting for the next cluster know that
+                //they must find it themselves.
+
+                m_bDamaged = true;
+                OnNewCluster();
+
                 return 1;
+            }
 
             hr = m_inpin.m_reader.Wait(*this, pos, size, INFINITE);
 
             if (FAILED(hr))  //wait was cancelled
                 return 1;
+
+            OnWakeup();
         }
 
         const bool bDone = m_pSegment->DoneParsing();
@@ -1084,239 +1197,1218 @@ unsigned Filter::Main()
 
         if (m_state == State_Stopped)
             return 0;
+
+        //Stay no more than m_cLookahead clusters ahead of the outpins, so
+        //the clusters parsed (and the pages of the reader's cache they
+        //hold onto) are bounded, however far ahead the download is.
+
+        while (IsLookaheadFull())
+        {
+            m_bLoaderWaiting = true;
+
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            const DWORD dw = WaitForSingleObject(m_hAdvance, INFINITE);
+            dw;
+            assert(dw == WAIT_OBJECT_0);
+
+            hr = lock.Seize(this);
+
+            if (FAILED(hr))
+                return 1;
+
+            m_bLoaderWaiting = false;
+
+            if (m_state == State_Stopped)
+                return 0;
+        }
     }
 }
 
 
-void Filter::OnNewCluster()
+void Filter::SetScheduler(Scheduler s)
 {
-    const BOOL b = SetEvent(m_hNewCluster);  //see Filter::GetState
-    b;
-    assert(b);
+    Lock lock;
 
-    typedef outpins_t::iterator iter_t;
+    const HRESULT hr = lock.Seize(this);
 
-    iter_t i = m_outpins.begin();
-    const iter_t j = m_outpins.end();
+    if (FAILED(hr))
+        return;
 
-    while (i != j)
-    {
-        Outpin* const outpin = *i++;
-        assert(outpin);
+    m_scheduler = s;
+}
 
-        outpin->OnNewCluster();
-    }
+
+Filter::Scheduler Filter::GetScheduler() const
+{
+    return m_scheduler;
 }
 
 
-HRESULT Filter::OnDisconnectInpin()
+bool Filter::IsLoopScheduled() const
+{
+    return m_bLoop;
+}
+
+
+void Filter::InitLoop()
 {
     assert(m_hThread == 0);
+    assert(m_loop_pins.empty());
+    assert(m_pool_threads.empty());
 
-    while (!m_outpins.empty())
+    if (!m_inpin.m_reader.IsOpen())
+        return;
+
+    typedef outpins_t::const_iterator iter_t;
+
+    for (iter_t i = m_outpins.begin(); i != m_outpins.end(); ++i)
     {
-        Outpin* const pPin = m_outpins.back();
+        Outpin* const pPin = *i;
         assert(pPin);
 
-        if (IPin* pPinConnection = pPin->m_pPinConnection)
-        {
-            assert(m_info.pGraph);
+        if (!bool(pPin->m_pPinConnection))
+            continue;
 
-            HRESULT hr = m_info.pGraph->Disconnect(pPinConnection);
-            assert(SUCCEEDED(hr));
+        LoopPin e;
 
-            hr = m_info.pGraph->Disconnect(pPin);
-            assert(SUCCEEDED(hr));
-        }
+        e.pPin = pPin;
+        e.bBusy = false;
+        e.bDone = false;
+        e.bSuspended = false;
+        e.bNewSegment = true;
 
-        m_outpins.pop_back();
+        e.hIdle = CreateEvent(0, TRUE, TRUE, 0);
+        assert(e.hIdle);  //TODO
 
-        const ULONG n = pPin->Destroy();
-        n;
+        m_loop_pins.push_back(e);
     }
 
-    m_currTime = kNoSeek;
-    m_pSeekBase = 0;
-    m_seekBase_ns = -1;
+    const LONG n = static_cast<LONG>(m_loop_pins.size());
 
-    delete m_pSegment;
-    m_pSegment = 0;
+    m_hPoolWork = CreateSemaphore(0, 0, (n > 0) ? n : 1, 0);
+    assert(m_hPoolWork);  //TODO
 
-    m_cStarvation = -1;
-    return S_OK;
+    m_hPoolQuit = CreateEvent(0, TRUE, FALSE, 0);
+    assert(m_hPoolQuit);  //TODO
+
+    m_cPoolIdle = 0;
+    m_bLoopLoading = !m_pSegment->DoneParsing();
+    m_bDamaged = false;
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Filter::LoopThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
 }
 
 
-void Filter::OnStarvation(ULONG count)
+void Filter::FinalLoop()
 {
-#ifdef _DEBUG
-    odbgstream os;
-    os << "WebmSplit::Filter::OnStarvation: count=" << count
-       << " m_cStarvation=" << m_cStarvation
-       << endl;
-#endif
+    //The streaming has already been suspended on each pin.
 
-    if (m_cStarvation < 0)
+    if (m_hThread)
     {
-        const GraphUtil::IMediaEventSinkPtr pSink(m_info.pGraph);
-        assert(bool(pSink));
+        const BOOL bSet = SetEvent(m_hAdvance);
+        bSet;
+        assert(bSet);
 
-        const HRESULT hr = pSink->Notify(EC_STARVATION, 0, 0);
-        hr;
-        assert(SUCCEEDED(hr));
+        const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
 
-        m_cStarvation = count;
+        const BOOL b = CloseHandle(m_hThread);
+        b;
+        assert(b);
+
+        m_hThread = 0;
     }
-}
 
+    typedef loop_pins_t::iterator iter_t;
 
-void Filter::SetCurrPosition(
-    LONGLONG currTime,
-    DWORD dwCurr,
-    Outpin* pOutpin)
-{
-    assert(pOutpin);
-    assert(bool(pOutpin->m_pPinConnection));
+    for (iter_t i = m_loop_pins.begin(); i != m_loop_pins.end(); ++i)
+    {
+        mkvparser::Stream::Clear(i->samples);
 
-    using namespace mkvparser;
+        const BOOL b = CloseHandle(i->hIdle);
+        b;
+        assert(b);
+    }
 
-    Stream* const pSeekStream = pOutpin->GetStream();
-    assert(pSeekStream);
+    m_loop_pins.clear();
 
-    if (m_currTime == currTime)
+    if (m_hPoolWork)
     {
-        SetCurrPositionUsingSameTime(pSeekStream);
-        return;
-    }
-
-    m_currTime = currTime;
+        const BOOL b = CloseHandle(m_hPoolWork);
+        b;
+        assert(b);
 
-    if (InCache())
-        m_pSegment->LoadCluster();
+        m_hPoolWork = 0;
+    }
 
-    if (m_pSegment->GetCount() <= 0)  //no clusters loaded yet
+    if (m_hPoolQuit)
     {
-        m_pSeekBase = 0;  //best we can do is to assume first cluster
-        m_seekBase_ns = -1;
-        m_seekTime_ns = -1;
+        const BOOL b = CloseHandle(m_hPoolQuit);
+        b;
+        assert(b);
 
-        pSeekStream->SetCurrPosition(-1, 0);  //lazy init
-        return;
+        m_hPoolQuit = 0;
     }
 
-    const LONGLONG ns = pSeekStream->GetSeekTime(currTime, dwCurr);
-    const Track* const pSeekTrack = pSeekStream->m_pTrack;
-
-    if (pSeekTrack->GetType() == 1)  //video
-        SetCurrPositionVideo(ns, pSeekStream);
-    else
-        SetCurrPositionAudio(ns, pSeekStream);
+    m_bLoop = false;
 }
 
 
-void Filter::SetCurrPositionUsingSameTime(mkvparser::Stream* pStream)
+unsigned Filter::LoopThreadProc(void* pv)
 {
-    const mkvparser::BlockEntry* pCurr;
+    Filter* const pFilter = static_cast<Filter*>(pv);
+    assert(pFilter);
 
-    const mkvparser::Track* const pTrack = pStream->m_pTrack;
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmsplit",
+            WebmMfUtil::kThreadClassPlayback);
 
-    if (m_pSeekBase == 0)  //lazy init
-        pCurr = 0;
+    return pFilter->LoopMain();
+}
 
-    else if (m_pSeekBase->EOS())
-        pCurr = pTrack->GetEOS();
 
-    else
-    {
-        pCurr = m_pSeekBase->GetEntry(pTrack, m_seekTime_ns);
+unsigned Filter::LoopMain()
+{
+    assert(m_pSegment);
 
-#ifdef _DEBUG
-        if (pCurr == 0)
-            __noop;
+    //Each pass gives every pin that isn't busy (in the pool) a turn, then
+    //loads the next cluster if the pins need it and the lookahead allows.
+    //The only waits are for the data of the next cluster, and, when there
+    //is nothing else to do, for the pool to give back a pin or for a pin
+    //to advance far enough for the loader to go on.
 
-        else if (pCurr->EOS())
-            __noop;
+    for (;;)
+    {
+        bool bProgress = false;
 
-        else if (pTrack->GetType() == 1)  //video
+        typedef loop_pins_t::size_type size_type;
+        const size_type n = m_loop_pins.size();
+
+        for (size_type i = 0; i < n; ++i)
         {
-            const mkvparser::Block* const pCurrBlock = pCurr->GetBlock();
-            const LONGLONG ns = pCurrBlock->GetTime(pCurr->GetCluster());
-            assert(ns >= m_seekBase_ns);
-            assert(pCurrBlock->IsKey());
+            if (ServiceLoopPin(i))
+                bProgress = true;
         }
-#endif
-    }
 
-    pStream->SetCurrPosition(m_seekBase_ns, pCurr);
-}
+        Lock lock;
 
+        HRESULT hr = lock.Seize(this);
 
-void Filter::SetCurrPositionVideo(
-    LONGLONG ns,
-    mkvparser::Stream* pStream)
-{
-    using namespace mkvparser;
-    const Track* const pTrack = pStream->m_pTrack;
+        if (FAILED(hr))
+            break;
 
-    const bool bInCache = InCache();
+        if (m_state == State_Stopped)
+            break;
 
-    if (!bInCache)
-        __noop;
-    else if (const Cues* pCues = m_pSegment->GetCues())
-    {
-        while (!pCues->DoneParsing())
+        if (m_bLoopLoading && !IsLookaheadFull())
         {
-            pCues->LoadCuePoint();
+            //While a pin is in the pool, wait for the data in slices, so
+            //we get back to the pin soon after the pool is done with it.
 
-            const CuePoint* const pCP = pCues->GetLast();
-            assert(pCP);
+            bool bPooled = false;
 
-            if (pCP->GetTime(m_pSegment) >= ns)
+            for (size_type i = 0; i < n; ++i)
+            {
+                if (m_loop_pins[i].bBusy)
+                    bPooled = true;
+            }
+
+            const DWORD timeout_ms =
+                (bProgress || bPooled) ? DWORD(kLoopWaitMs) : INFINITE;
+
+            if (LoadLoopCluster(timeout_ms))
+                bProgress = true;
+
+            if (m_state == State_Stopped)
                 break;
         }
 
-        const CuePoint* pCP;
-        const CuePoint::TrackPosition* pTP;
-
-        if (pCues->Find(ns, pTrack, pCP, pTP))
-        {
-            const BlockEntry* const pCurr = pCues->GetBlock(pCP, pTP);
+        if (bProgress)
+            continue;
 
-            if ((pCurr != 0) && !pCurr->EOS())
-            {
-                m_pSeekBase = pCurr->GetCluster();
-                m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
-                m_seekTime_ns = m_seekBase_ns;
+        m_bLoaderWaiting = true;
 
-                pStream->SetCurrPosition(m_seekBase_ns, pCurr);
-                return;
-            }
-        }
-    }
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
 
-    const mkvparser::BlockEntry* pCurr = 0;
+        const DWORD dw = WaitForSingleObject(m_hAdvance, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
 
-    for (;;)
-    {
-        long status = pTrack->Seek(ns, pCurr);
+        hr = lock.Seize(this);
 
-        if ((status >= 0) ||
-            (status != mkvparser::E_BUFFER_NOT_FULL) ||
-            !bInCache)
-        {
+        if (FAILED(hr))
             break;
-        }
 
-        status = m_pSegment->LoadCluster();
+        m_bLoaderWaiting = false;
 
-        if (status < 0)
+        if (m_state == State_Stopped)
             break;
+
+        OnWakeup();
     }
 
-    if ((pCurr == 0) || pCurr->EOS())
-    {
-        m_pSeekBase = &m_pSegment->m_eos;
-        m_seekBase_ns = -1;
+    FinalPool();
+    return 0;
+}
+
+
+bool Filter::ServiceLoopPin(loop_pins_t::size_type index)
+{
+    //Returns whether samples were delivered, or the pin finished.
+
+    LoopPin& e = m_loop_pins[index];
+
+    {
+        Lock lock;
+
+        const HRESULT hr = lock.Seize(this);
+
+        if (FAILED(hr))
+            return false;
+
+        if (m_state == State_Stopped)
+            return false;
+
+        if (e.bBusy || e.bDone || e.bSuspended)
+            return false;
+
+        e.bBusy = true;
+
+        const BOOL b = ResetEvent(e.hIdle);
+        b;
+        assert(b);
+    }
+
+    Outpin* const pPin = e.pPin;
+    HRESULT hr = S_OK;
+
+    if (e.bNewSegment)  //our own, while the pin is busy
+    {
+        e.bNewSegment = false;
+        hr = pPin->BeginSegment();
+    }
+
+    if (SUCCEEDED(hr))
+        hr = pPin->Populate(e.samples, AM_GBF_NOWAIT);
+
+    if (hr == VFW_E_BUFFER_UNDERFLOW)  //wait for the loader
+    {
+        Lock lock;
+
+        hr = lock.Seize(this);
+        assert(SUCCEEDED(hr));
+
+        DoneLoopPin(e, false);
+        return false;
+    }
+
+    if ((hr == E_PENDING) || ((hr == S_OK) && pPin->ReceiveCanBlock()))
+    {
+        Lock lock;
+
+        hr = lock.Seize(this);
+        assert(SUCCEEDED(hr));
+
+        PushPool(index);  //the pool waits, so that we needn't
+        return false;
+    }
+
+    bool bDone = true;
+
+    if (hr == S_OK)
+        bDone = (pPin->Send(e.samples) != S_OK);
+
+    else if (SUCCEEDED(hr))  //EOS
+        pPin->m_pPinConnection->EndOfStream();
+
+    Lock lock;
+
+    hr = lock.Seize(this);
+    assert(SUCCEEDED(hr));
+
+    DoneLoopPin(e, bDone);
+    return true;
+}
+
+
+bool Filter::LoadLoopCluster(DWORD timeout_ms)
+{
+    //We hold the lock.  Returns whether a cluster was loaded, or loading
+    //stopped at a damaged one.
+
+    for (;;)
+    {
+        LONGLONG pos;
+        LONG size;
+
+        const long status = m_pSegment->LoadCluster(pos, size);
+
+        if (status >= 0)
+            break;
+
+        if (status != mkvparser::E_BUFFER_NOT_FULL)
+        {
+            //The outpins resync on the clusters after it (see Main).
+
+            m_bDamaged = true;
+            m_bLoopLoading = false;
+
+            OnNewCluster();
+            return true;
+        }
+
+        const HRESULT hr = m_inpin.m_reader.Wait(*this, pos, size, timeout_ms);
+
+        if (FAILED(hr))
+        {
+            if (timeout_ms == INFINITE)  //wait was cancelled
+                m_bLoopLoading = false;
+
+            return false;  //else the data isn't here yet; try next pass
+        }
+
+        OnWakeup();
+    }
+
+    m_bLoopLoading = !m_pSegment->DoneParsing();
+    OnNewCluster();
+
+    return true;
+}
+
+
+void Filter::PushPool(loop_pins_t::size_type index)
+{
+    //We hold the lock.  Each pin in the pool has a thread of its own, so
+    //that a pin that waits long (for a renderer that is paused, say) can't
+    //hold up another.  A thread is made only when none is idle.
+
+    assert(m_loop_pins[index].bBusy);
+
+    m_pool_queue.push_back(index);
+
+    if (m_cPoolIdle > 0)
+        --m_cPoolIdle;
+    else
+    {
+        const uintptr_t h = _beginthreadex(
+                                0,  //security
+                                0,  //stack size
+                                &Filter::PoolThreadProc,
+                                this,
+                                0,   //run immediately
+                                0);  //thread id
+
+        assert(h);  //TODO
+        m_pool_threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
+
+    const BOOL b = ReleaseSemaphore(m_hPoolWork, 1, 0);
+    b;
+    assert(b);
+}
+
+
+void Filter::DoneLoopPin(LoopPin& e, bool bDone)
+{
+    //We hold the lock.
+
+    assert(e.bBusy);
+
+    mkvparser::Stream::Clear(e.samples);
+
+    e.bBusy = false;
+
+    if (bDone)
+        e.bDone = true;
+
+    const BOOL b = SetEvent(e.hIdle);
+    b;
+    assert(b);
+}
+
+
+Filter::LoopPin* Filter::FindLoopPin(const Outpin* pPin)
+{
+    typedef loop_pins_t::iterator iter_t;
+
+    for (iter_t i = m_loop_pins.begin(); i != m_loop_pins.end(); ++i)
+    {
+        if (i->pPin == pPin)
+            return &*i;
+    }
+
+    return 0;
+}
+
+
+void Filter::SuspendLoopPin(Outpin* pPin)
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return;
+
+    LoopPin* const e = FindLoopPin(pPin);
+
+    if (e == 0)  //not connected when we started
+        return;
+
+    e->bSuspended = true;
+
+    const HANDLE hIdle = e->hIdle;
+    const GraphUtil::IPinPtr pConnection(pPin->m_pPinConnection);
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    //The flush makes the pin's Receive, or its wait for a buffer, return.
+
+    hr = pConnection->BeginFlush();
+    assert(SUCCEEDED(hr));
+
+    const DWORD dw = WaitForSingleObject(hIdle, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    hr = pConnection->EndFlush();
+    assert(SUCCEEDED(hr));
+}
+
+
+void Filter::ResumeLoopPin(Outpin* pPin)
+{
+    //We hold the lock.
+
+    LoopPin* const e = FindLoopPin(pPin);
+
+    if (e == 0)
+        return;
+
+    assert(!e->bBusy);
+
+    e->bSuspended = false;
+    e->bDone = false;
+    e->bNewSegment = true;
+
+    const BOOL b = SetEvent(m_hAdvance);
+    b;
+    assert(b);
+}
+
+
+unsigned Filter::PoolThreadProc(void* pv)
+{
+    Filter* const pFilter = static_cast<Filter*>(pv);
+    assert(pFilter);
+
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmsplit",
+            WebmMfUtil::kThreadClassPlayback);
+
+    return pFilter->PoolMain();
+}
+
+
+unsigned Filter::PoolMain()
+{
+    enum { nh = 2 };
+    const HANDLE hh[nh] = { m_hPoolQuit, m_hPoolWork };
+
+    for (;;)
+    {
+        const DWORD dw = WaitForMultipleObjects(nh, hh, 0, INFINITE);
+
+        if (dw != (WAIT_OBJECT_0 + 1))  //hPoolQuit
+            return 0;
+
+        Lock lock;
+
+        HRESULT hr = lock.Seize(this);
+
+        if (FAILED(hr))
+            return 1;
+
+        if (m_pool_queue.empty())  //taken back by FinalPool
+            continue;
+
+        OnWakeup();
+
+        LoopPin& e = m_loop_pins[m_pool_queue.front()];
+        m_pool_queue.pop_front();
+
+        const bool bSuspended = e.bSuspended;
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        bool bDone = false;
+
+        if (!bSuspended)
+        {
+            Outpin* const pPin = e.pPin;
+
+            hr = S_OK;
+
+            if (e.samples.empty())  //the loop had no buffers for them
+                hr = pPin->Populate(e.samples, 0);
+
+            if (hr == S_OK)
+                bDone = (pPin->Send(e.samples) != S_OK);
+
+            else if (hr == VFW_E_BUFFER_UNDERFLOW)
+                __noop;  //the loop waits for the loader
+
+            else
+            {
+                if (SUCCEEDED(hr))  //EOS
+                    pPin->m_pPinConnection->EndOfStream();
+
+                bDone = true;
+            }
+        }
+
+        hr = lock.Seize(this);
+
+        if (FAILED(hr))
+            return 1;
+
+        DoneLoopPin(e, bDone);
+        ++m_cPoolIdle;
+
+        if (m_bLoaderWaiting)  //the loop can have the pin back
+        {
+            const BOOL b = SetEvent(m_hAdvance);
+            b;
+            assert(b);
+        }
+    }
+}
+
+
+void Filter::FinalPool()
+{
+    //The loop thread is done.  The pins still queued are given back, so
+    //that their suspension can finish; the threads in the middle of a
+    //pin return once it is flushed.
+
+    {
+        Lock lock;
+
+        const HRESULT hr = lock.Seize(this);
+        assert(SUCCEEDED(hr));
+
+        while (!m_pool_queue.empty())
+        {
+            DoneLoopPin(m_loop_pins[m_pool_queue.front()], false);
+            m_pool_queue.pop_front();
+        }
+    }
+
+    const BOOL b = SetEvent(m_hPoolQuit);
+    b;
+    assert(b);
+
+    typedef std::vector<HANDLE>::iterator iter_t;
+
+    for (iter_t i = m_pool_threads.begin(); i != m_pool_threads.end(); ++i)
+    {
+        const DWORD dw = WaitForSingleObject(*i, INFINITE);
+        dw;
+        assert(dw == WAIT_OBJECT_0);
+
+        const BOOL bClosed = CloseHandle(*i);
+        bClosed;
+        assert(bClosed);
+    }
+
+    m_pool_threads.clear();
+    m_cPoolIdle = 0;
+}
+
+
+bool Filter::IsLookaheadFull() const
+{
+    //We hold the lock.
+
+    if (m_cLookahead <= 0)  //no limit
+        return false;
+
+    if (m_bStarving)  //an outpin can't deliver until we load more
+        return false;
+
+    const long count = m_pSegment->GetCount();  //clusters loaded
+
+    long slowest, fastest;
+
+    if (!GetOutpinClusters(slowest, fastest))
+        return false;
+
+    return ((count - 1 - slowest) >= m_cLookahead);
+}
+
+
+bool Filter::GetOutpinClusters(long& slowest, long& fastest) const
+{
+    //We hold the lock.  Gets the indexes of the clusters of the outpins
+    //furthest behind and furthest ahead, among those delivering blocks.
+    //Returns false if none is, or one has been positioned (by a seek) at
+    //a cluster not loaded yet.
+
+    slowest = std::numeric_limits<long>::max();
+    fastest = -1;
+
+    typedef outpins_t::const_iterator iter_t;
+
+    iter_t i = m_outpins.begin();
+    const iter_t j = m_outpins.end();
+
+    while (i != j)
+    {
+        const Outpin* const pPin = *i++;
+        assert(pPin);
+
+        if (!bool(pPin->m_pPinConnection))
+            continue;
+
+        const mkvparser::Stream* const pStream = pPin->GetStream();
+        const mkvparser::Cluster* const pCluster = pStream->GetCurrCluster();
+
+        if (pCluster == 0)  //not started yet, or done
+            continue;
+
+        if (pStream->IsThinning() || pStream->IsReverse())
+            continue;  //finds its keyframes through the cues
+
+        if (pStream->IsSparse())
+            continue;  //its next block may be any number of clusters on
+
+        const long index = pCluster->GetIndex();
+
+        if (index < 0)  //not loaded yet (the target of a seek)
+            return false;
+
+        if (index < slowest)
+            slowest = index;
+
+        if (index > fastest)
+            fastest = index;
+    }
+
+    return (fastest >= 0);
+}
+
+
+void Filter::GetInterleaveStats(InterleaveStats& stats) const
+{
+    stats = m_interleave_stats;
+}
+
+
+void Filter::UpdateInterleave()
+{
+    //We hold the lock.  The clusters between the outpins are parsed and
+    //kept for the pin behind, while the pin ahead reads its frames far
+    //from where the loader is; the reader's prefetch follows each of them
+    //separately (see MkvReader::Prefetch), but a file that is this badly
+    //interleaved is worth knowing about.
+
+    long slowest, fastest;
+
+    if (!GetOutpinClusters(slowest, fastest))
+        return;
+
+    const long distance = fastest - slowest;
+
+    InterleaveStats& s = m_interleave_stats;
+
+    if (distance > s.max_clusters)
+        s.max_clusters = distance;
+
+    const bool bWide = (distance > kInterleaveWarning);
+
+    if (bWide && !m_bWideInterleave)
+    {
+        ++s.warnings;
+
+#ifdef _DEBUG
+        odbgstream os;
+        os << "WebmSplit::Filter: outpins are " << distance
+           << " clusters apart; file is badly interleaved"
+           << endl;
+#endif
+    }
+
+    m_bWideInterleave = bWide;
+}
+
+
+void Filter::SetLookahead(long clusters)
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return;
+
+    m_cLookahead = (clusters > 0) ? clusters : 0;
+
+    if (m_bLoaderWaiting)
+        SetEvent(m_hAdvance);
+}
+
+
+long Filter::GetLookahead() const
+{
+    return m_cLookahead;
+}
+
+
+void Filter::SetAccurateSeek(bool b)
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return;
+
+    m_bAccurateSeek = b;
+    m_currTime = kNoSeek;  //so the next seek isn't taken as the same
+}
+
+
+bool Filter::GetAccurateSeek() const
+{
+    return m_bAccurateSeek;
+}
+
+
+void Filter::SetTailLatency(LONGLONG reftime)
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return;
+
+    m_tail_latency = (reftime > 0) ? reftime : 0;
+}
+
+
+LONGLONG Filter::GetTailLatency() const
+{
+    return m_tail_latency;
+}
+
+
+void Filter::SeekTail()
+{
+    //We hold the lock.  Load the clusters written so far, without waiting
+    //for more, and position the streams the latency behind the last one.
+
+    for (;;)
+    {
+        LONGLONG pos;
+        LONG size;
+
+        const long status = m_pSegment->LoadCluster(pos, size);
+
+        if (status < 0)  //the end of what has been written, or an error
+            break;
+
+        if (m_pSegment->DoneParsing())
+            break;
+    }
+
+    const mkvparser::Cluster* const pLast = m_pSegment->GetLast();
+
+    if ((pLast == 0) || pLast->EOS())
+        return;
+
+    const LONGLONG edge = pLast->GetTime() / 100;  //reftime
+    const LONGLONG currTime = edge - m_tail_latency;
+
+    if (currTime <= 0)  //not that much has been written yet
+        return;
+
+    typedef outpins_t::iterator iter_t;
+
+    iter_t i = m_outpins.begin();
+    const iter_t j = m_outpins.end();
+
+    while (i != j)
+    {
+        Outpin* const pPin = *i++;
+        assert(pPin);
+
+        if (bool(pPin->m_pPinConnection))
+            SetCurrPosition(currTime, AM_SEEKING_AbsolutePositioning, pPin);
+    }
+}
+
+
+void Filter::OnAdvance()
+{
+    //We hold the lock.
+
+    UpdateInterleave();
+
+    if (m_bLoaderWaiting && !IsLookaheadFull())
+    {
+        const BOOL b = SetEvent(m_hAdvance);
+        b;
+        assert(b);
+    }
+}
+
+
+void Filter::OnNewCluster()
+{
+    UpdateClusterIndex();
+
+    m_bStarving = false;
+
+    const BOOL b = SetEvent(m_hNewCluster);  //see Filter::GetState
+    b;
+    assert(b);
+
+    typedef outpins_t::iterator iter_t;
+
+    iter_t i = m_outpins.begin();
+    const iter_t j = m_outpins.end();
+
+    while (i != j)
+    {
+        Outpin* const outpin = *i++;
+        assert(outpin);
+
+        outpin->OnNewCluster();
+    }
+}
+
+
+HRESULT Filter::OnDisconnectInpin()
+{
+    assert(m_hThread == 0);
+
+    while (!m_outpins.empty())
+    {
+        Outpin* const pPin = m_outpins.back();
+        assert(pPin);
+
+        if (IPin* pPinConnection = pPin->m_pPinConnection)
+        {
+            assert(m_info.pGraph);
+
+            HRESULT hr = m_info.pGraph->Disconnect(pPinConnection);
+            assert(SUCCEEDED(hr));
+
+            hr = m_info.pGraph->Disconnect(pPin);
+            assert(SUCCEEDED(hr));
+        }
+
+        m_outpins.pop_back();
+
+        const ULONG n = pPin->Destroy();
+        n;
+    }
+
+    m_currTime = kNoSeek;
+    m_pSeekBase = 0;
+    m_seekBase_ns = -1;
+
+    delete m_pSegment;
+    m_pSegment = 0;
+
+    m_cluster_index.clear();
+    ResetCrcStats();
+
+    m_cStarvation = -1;
+    return S_OK;
+}
+
+
+void Filter::OnWakeup()
+{
+    InterlockedIncrement(&m_cWakeups);
+}
+
+
+LONG Filter::GetWakeupCount() const
+{
+    return m_cWakeups;
+}
+
+
+LONG Filter::GetStarvationCount() const
+{
+    return m_cStarved;
+}
+
+
+bool Filter::IsDamaged() const
+{
+    return m_bDamaged;
+}
+
+
+void Filter::OnStarvation(ULONG count)
+{
+#ifdef _DEBUG
+    odbgstream os;
+    os << "WebmSplit::Filter::OnStarvation: count=" << count
+       << " m_cStarvation=" << m_cStarvation
+       << endl;
+#endif
+
+    //We hold the lock.  The outpin is past the clusters loaded so far, so
+    //if the loader is holding back (because a slower outpin is too far
+    //behind) it must load the next cluster anyway.
+
+    InterlockedIncrement(&m_cStarved);
+
+    m_bStarving = true;
+
+    if (m_bLoaderWaiting)
+    {
+        const BOOL b = SetEvent(m_hAdvance);
+        b;
+        assert(b);
+    }
+
+    if (m_cStarvation < 0)
+    {
+        const GraphUtil::IMediaEventSinkPtr pSink(m_info.pGraph);
+        assert(bool(pSink));
+
+        const HRESULT hr = pSink->Notify(EC_STARVATION, 0, 0);
+        hr;
+        assert(SUCCEEDED(hr));
+
+        m_cStarvation = count;
+    }
+}
+
+
+void Filter::SetCurrPosition(
+    LONGLONG currTime,
+    DWORD dwCurr,
+    Outpin* pOutpin)
+{
+    assert(pOutpin);
+    assert(bool(pOutpin->m_pPinConnection));
+
+    using namespace mkvparser;
+
+    Stream* const pSeekStream = pOutpin->GetStream();
+    assert(pSeekStream);
+
+    if (pSeekStream->IsSparse())
+    {
+        //A sparse stream has too few blocks to seek by.  The seek is
+        //resolved for a stream that isn't sparse, and this one follows.
+
+        if (m_currTime != currTime)
+        {
+            if (Outpin* const pPin = GetSeekOutpin())
+                SetCurrPosition(currTime, dwCurr, pPin);
+            else
+            {
+                m_currTime = currTime;
+                m_pSeekBase = 0;  //nothing else connected: from the start
+                m_seekBase_ns = -1;
+                m_seekTime_ns = -1;
+            }
+        }
+
+        SetCurrPositionUsingSameTime(pSeekStream);
+        return;
+    }
+
+    if (m_currTime == currTime)
+    {
+        SetCurrPositionUsingSameTime(pSeekStream);
+        return;
+    }
+
+    m_currTime = currTime;
+
+    if (InCache())
+        m_pSegment->LoadCluster();
+
+    if (m_pSegment->GetCount() <= 0)  //no clusters loaded yet
+    {
+        m_pSeekBase = 0;  //best we can do is to assume first cluster
+        m_seekBase_ns = -1;
+        m_seekTime_ns = -1;
+
+        pSeekStream->SetCurrPosition(-1, 0);  //lazy init
+        return;
+    }
+
+    const LONGLONG ns = pSeekStream->GetSeekTime(currTime, dwCurr);
+    const Track* const pSeekTrack = pSeekStream->m_pTrack;
+
+    if (pSeekTrack->GetType() == 1)  //video
+        SetCurrPositionVideo(ns, pSeekStream);
+    else
+        SetCurrPositionAudio(ns, pSeekStream);
+}
+
+
+Outpin* Filter::GetSeekOutpin() const
+{
+    typedef outpins_t::const_iterator iter_t;
+
+    iter_t i = m_outpins.begin();
+    const iter_t j = m_outpins.end();
+
+    while (i != j)
+    {
+        Outpin* const pPin = *i++;
+        assert(pPin);
+
+        if (!bool(pPin->m_pPinConnection))
+            continue;
+
+        if (!pPin->GetStream()->IsSparse())
+            return pPin;
+    }
+
+    return 0;
+}
+
+
+void Filter::SetCurrPositionUsingSameTime(mkvparser::Stream* pStream)
+{
+    const mkvparser::BlockEntry* pCurr;
+
+    const mkvparser::Track* const pTrack = pStream->m_pTrack;
+
+    if (m_pSeekBase == 0)  //lazy init
+        pCurr = 0;
+
+    else if (m_pSeekBase->EOS())
+        pCurr = pTrack->GetEOS();
+
+    else if (pStream->IsSparse())
+        pCurr = 0;  //from its first block, dropping those before the base
+
+    else
+    {
+        pCurr = m_pSeekBase->GetEntry(pTrack, m_seekTime_ns);
+
+#ifdef _DEBUG
+        if (pCurr == 0)
+            __noop;
+
+        else if (pCurr->EOS())
+            __noop;
+
+        else if (pTrack->GetType() == 1)  //video
+        {
+            const mkvparser::Block* const pCurrBlock = pCurr->GetBlock();
+            const LONGLONG ns = pCurrBlock->GetTime(pCurr->GetCluster());
+            assert(ns >= m_seekTime_ns);  //the base, if not accurate
+            assert(pCurrBlock->IsKey());
+        }
+#endif
+    }
+
+    pStream->SetCurrPosition(m_seekBase_ns, pCurr);
+}
+
+
+void Filter::SetCurrPositionVideo(
+    LONGLONG ns,
+    mkvparser::Stream* pStream)
+{
+    using namespace mkvparser;
+    const Track* const pTrack = pStream->m_pTrack;
+
+    const bool bInCache = InCache();
+
+    if (!bInCache)
+        __noop;
+    else if (const Cues* pCues = m_pSegment->GetCues())
+    {
+        while (!pCues->DoneParsing())
+        {
+            pCues->LoadCuePoint();
+
+            const CuePoint* const pCP = pCues->GetLast();
+            assert(pCP);
+
+            if (pCP->GetTime(m_pSegment) >= ns)
+                break;
+        }
+
+        const CuePoint* pCP;
+        const CuePoint::TrackPosition* pTP;
+
+        if (pCues->Find(ns, pTrack, pCP, pTP))
+        {
+            const BlockEntry* const pCurr = pCues->GetBlock(pCP, pTP);
+
+            if ((pCurr != 0) && !pCurr->EOS())
+            {
+                m_pSeekBase = pCurr->GetCluster();
+                m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
+                m_seekTime_ns = m_seekBase_ns;
+
+                if (m_bAccurateSeek && (ns > m_seekBase_ns))
+                    m_seekBase_ns = ns;  //preroll from the keyframe
+
+                pStream->SetCurrPosition(m_seekBase_ns, pCurr);
+                return;
+            }
+        }
+    }
+
+    const mkvparser::BlockEntry* pCurr = SeekClusterIndex(pTrack, ns);
+
+    if (pCurr == 0)  //not found among the loaded clusters
+    {
+        for (;;)
+        {
+            long status = pTrack->Seek(ns, pCurr);
+
+            if ((status >= 0) ||
+                (status != mkvparser::E_BUFFER_NOT_FULL) ||
+                !bInCache)
+            {
+                break;
+            }
+
+            status = m_pSegment->LoadCluster();
+
+            if (status < 0)
+                break;
+        }
+    }
+
+    if ((pCurr == 0) || pCurr->EOS())
+    {
+        m_pSeekBase = &m_pSegment->m_eos;
+        m_seekBase_ns = -1;
         m_seekTime_ns = -1;
     }
     else
@@ -1324,6 +2416,9 @@ void Filter::SetCurrPositionVideo(
         m_pSeekBase = pCurr->GetCluster();
         m_seekBase_ns = pCurr->GetBlock()->GetTime(m_pSeekBase);
         m_seekTime_ns = m_seekBase_ns;
+
+        if (m_bAccurateSeek && (ns > m_seekBase_ns))
+            m_seekBase_ns = ns;  //preroll from the keyframe
     }
 
     pStream->SetCurrPosition(m_seekBase_ns, pCurr);
@@ -1367,8 +2462,11 @@ void Filter::SetCurrPositionAudio(
 
     if (pVideoStream == 0)  //no video tracks in this file
     {
-        const mkvparser::BlockEntry* pCurr;
-        const long status = pSeekTrack->Seek(ns, pCurr);
+        const mkvparser::BlockEntry* pCurr = SeekClusterIndex(pSeekTrack, ns);
+        long status = 0;
+
+        if (pCurr == 0)  //not found among the loaded clusters
+            status = pSeekTrack->Seek(ns, pCurr);
 
         if ((status < 0) || (pCurr == 0) || pCurr->EOS())
         {
@@ -1432,23 +2530,26 @@ void Filter::SetCurrPositionAudio(
         }
     }
 
-    const BlockEntry* pCurr = 0;
+    const BlockEntry* pCurr = SeekClusterIndex(pVideoTrack, ns);
 
-    for (;;)
+    if (pCurr == 0)  //not found among the loaded clusters
     {
-        long status = pVideoTrack->Seek(ns, pCurr);
-
-        if ((status >= 0) ||
-            (status != mkvparser::E_BUFFER_NOT_FULL) ||
-            !bInCache)
+        for (;;)
         {
-            break;
-        }
+            long status = pVideoTrack->Seek(ns, pCurr);
+
+            if ((status >= 0) ||
+                (status != mkvparser::E_BUFFER_NOT_FULL) ||
+                !bInCache)
+            {
+                break;
+            }
 
-        status = m_pSegment->LoadCluster();
+            status = m_pSegment->LoadCluster();
 
-        if (status < 0)
-            break;
+            if (status < 0)
+                break;
+        }
     }
 
     if ((pCurr == 0) || pCurr->EOS())
@@ -1476,6 +2577,352 @@ void Filter::SetCurrPositionAudio(
 }
 
 
+bool Filter::CompareTime(LONGLONG ns, const ClusterIndexEntry& e)
+{
+    return (ns < e.time_ns);
+}
+
+
+void Filter::UpdateClusterIndex()
+{
+    if (m_pSegment == 0)
+        return;
+
+    //The clusters in the index are all loaded, so getting the next one
+    //is just a lookup in the segment's cluster array.
+
+    const long count = m_pSegment->GetCount();
+
+    while (long(m_cluster_index.size()) < count)
+    {
+        const mkvparser::Cluster* const pCluster =
+            m_cluster_index.empty() ?
+                m_pSegment->GetFirst() :
+                m_pSegment->GetNext(m_cluster_index.back().pCluster);
+
+        if ((pCluster == 0) || pCluster->EOS())
+            break;
+
+        ClusterIndexEntry e;
+
+        e.time_ns = pCluster->GetTime();
+        e.pCluster = pCluster;
+
+        assert(m_cluster_index.empty() ||
+               (e.time_ns >= m_cluster_index.back().time_ns));
+
+        m_cluster_index.push_back(e);
+
+        if (m_bCheckCrc)
+            CheckClusterCrc(pCluster);
+    }
+}
+
+
+void Filter::CheckClusterCrc(const mkvparser::Cluster* pCluster)
+{
+    //We hold the lock.  A cluster of unknown size has no CRC-32 to check,
+    //and one not yet wholly downloaded goes unchecked, rather than make
+    //the loader wait for it.
+
+    typedef mkvparser::ElementReader ElementReader;
+
+    MkvReader& r = m_inpin.m_reader;
+
+    LONGLONG total, avail;
+
+    if (r.Length(&total, &avail) < 0)
+        return;
+
+    ElementReader::Element c;
+
+    if (!ElementReader::ReadHeader(&r, pCluster->m_element_start, avail, c))
+        return;
+
+    switch (ElementReader::CheckCrc32(&r, c))
+    {
+        case ElementReader::kCrc32Match:
+            ++m_crc_stats.checked;
+            break;
+
+        case ElementReader::kCrc32Mismatch:
+        {
+            ++m_crc_stats.checked;
+            ++m_crc_stats.failed;
+            m_crc_stats.failed_pos = c.start;
+
+#ifdef _DEBUG
+            odbgstream os;
+            os << "WebmSplit::Filter: CRC-32 of cluster at " << c.start
+               << " doesn't match" << endl;
+#endif
+
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+
+void Filter::SetCheckCrc(bool b)
+{
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return;
+
+    m_bCheckCrc = b;
+}
+
+
+bool Filter::GetCheckCrc() const
+{
+    return m_bCheckCrc;
+}
+
+
+void Filter::GetCrcStats(CrcStats& stats) const
+{
+    stats = m_crc_stats;
+}
+
+
+void Filter::ResetCrcStats()
+{
+    m_crc_stats.checked = 0;
+    m_crc_stats.failed = 0;
+    m_crc_stats.failed_pos = -1;
+}
+
+
+const mkvparser::BlockEntry* Filter::SeekClusterIndex(
+    const mkvparser::Track* pTrack,
+    LONGLONG ns)
+{
+    using namespace mkvparser;
+
+    UpdateClusterIndex();
+
+    if (m_cluster_index.empty())
+        return 0;
+
+    typedef cluster_index_t::const_iterator iter_t;
+
+    const iter_t i = m_cluster_index.begin();
+    const iter_t j = m_cluster_index.end();
+
+    const iter_t k = std::upper_bound(i, j, ns, &Filter::CompareTime);
+
+    //If the seek time is past the last loaded cluster, it might be in a
+    //cluster that hasn't been loaded yet; only the linear search knows to
+    //load more.
+
+    if ((k == j) && !m_pSegment->DoneParsing())
+        return 0;
+
+    ++m_seek_stats.seeks;
+
+    const LONGLONG tn = pTrack->GetNumber();
+    const bool bVideo = (pTrack->GetType() == 1);
+
+    //Search back from the cluster holding the seek time for the last
+    //keyframe (or, for audio, the last block) that isn't after it.
+
+    long idx = (k == i) ? 0 : long(k - i) - 1;
+
+    for (long n = 0; (idx >= 0) && (n < kMaxSeekClusters); --idx, ++n)
+    {
+        const Cluster* const pCluster = m_cluster_index[idx].pCluster;
+        const BlockEntry* pResult = 0;
+
+        ++m_seek_stats.clusters;
+
+        for (long index = 0; ; ++index)
+        {
+            const BlockEntry* pEntry;
+
+            const long status = pCluster->GetEntry(index, pEntry);
+
+            if (status < 0)  //underflow: let the linear search handle it
+                return 0;
+
+            if (status == 0)  //no more entries on this cluster
+                break;
+
+            ++m_seek_stats.blocks;
+
+            const Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            if (pBlock->GetTime(pCluster) > ns)
+                break;
+
+            if (pBlock->GetTrackNumber() != tn)
+                continue;
+
+            if (bVideo && !pBlock->IsKey())
+                continue;
+
+            pResult = pEntry;
+        }
+
+        if (pResult)
+            return pResult;
+    }
+
+    return 0;
+}
+
+
+HRESULT Filter::GetStageCount(ULONG* pCount)
+{
+    if (pCount == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pCount = static_cast<ULONG>(m_outpins.size());
+    return S_OK;
+}
+
+
+HRESULT Filter::GetStage(ULONG index, Stats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    //The lock keeps the outpin alive; its counters themselves are
+    //read without it.
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (index >= m_outpins.size())
+        return E_INVALIDARG;
+
+    m_outpins[index]->m_counters.GetStats(pStats);
+    return S_OK;
+}
+
+
+HRESULT Filter::ResetStages()
+{
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    typedef outpins_t::iterator iter_t;
+
+    for (iter_t i = m_outpins.begin(); i != m_outpins.end(); ++i)
+        (*i)->m_counters.Reset();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetSharedCacheLimit(LONGLONG limit)
+{
+    if (limit < 0)
+        return E_INVALIDARG;
+
+    webmdshow::SharedFileCache::SetLimit(limit);
+    return S_OK;
+}
+
+
+HRESULT Filter::GetSharedCacheLimit(LONGLONG* pLimit)
+{
+    if (pLimit == 0)
+        return E_POINTER;
+
+    *pLimit = webmdshow::SharedFileCache::GetLimit();
+    return S_OK;
+}
+
+
+HRESULT Filter::GetSharedCacheStats(SharedCacheStats* pStats)
+{
+    if (pStats == 0)
+        return E_POINTER;
+
+    webmdshow::SharedFileCache::GetStats(pStats);
+    return S_OK;
+}
+
+
+HRESULT Filter::SetDecryptionKey(
+    const BYTE* key_id,
+    ULONG key_id_len,
+    const BYTE* key)
+{
+    if ((key == 0) || ((key_id == 0) && (key_id_len > 0)))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    const char* const id = reinterpret_cast<const char*>(key_id);
+    const std::string id_str(id, id + key_id_len);
+
+    typedef keys_t::iterator key_iter_t;
+
+    key_iter_t k = m_keys.begin();
+
+    while ((k != m_keys.end()) && (k->key_id != id_str))
+        ++k;
+
+    if (k == m_keys.end())
+        k = m_keys.insert(m_keys.end(), DecryptionKey());
+
+    k->key_id = id_str;
+    memcpy(k->key, key, kKeySize);
+
+    typedef outpins_t::iterator iter_t;
+
+    for (iter_t i = m_outpins.begin(); i != m_outpins.end(); ++i)
+        (*i)->m_pStream->SetDecryptionKey(key_id, key_id_len, key);
+
+    return S_OK;
+}
+
+
+void Filter::GetSeekStats(SeekStats& stats) const
+{
+    stats = m_seek_stats;
+}
+
+
+void Filter::ResetSeekStats()
+{
+    m_seek_stats.seeks = 0;
+    m_seek_stats.clusters = 0;
+    m_seek_stats.blocks = 0;
+}
+
+
 bool Filter::InCache()
 {
     LONGLONG total, avail;
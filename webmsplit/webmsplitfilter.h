@@ -10,13 +10,19 @@
 #include <strmif.h>
 #include <string>
 #include <vector>
+#include <deque>
 #include "webmsplitinpin.h"
 #include "clockable.h"
+#include "ipipelinecounters.h"
+#include "isharedfilecache.h"
+#include "iwebmdecryption.h"
 
 namespace mkvparser
 {
 class IMkvReader;
 class Cluster;
+class BlockEntry;
+class Track;
 class Stream;
 }
 
@@ -26,6 +32,9 @@ namespace WebmSplit
 class Outpin;
 
 class Filter : public IBaseFilter,
+               public IPipelineCounters,
+               public ISharedFileCache,
+               public IWebmDecryption,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -63,6 +72,29 @@ public:
     HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
     HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
 
+    //IPipelineCounters
+    //
+    //There is one stage per outpin, in pin order.
+
+    HRESULT STDMETHODCALLTYPE GetStageCount(ULONG*);
+    HRESULT STDMETHODCALLTYPE GetStage(ULONG, Stats*);
+    HRESULT STDMETHODCALLTYPE ResetStages();
+
+    //ISharedFileCache
+    //
+    //The cache belongs to the module; these don't take the filter lock.
+
+    HRESULT STDMETHODCALLTYPE SetSharedCacheLimit(LONGLONG);
+    HRESULT STDMETHODCALLTYPE GetSharedCacheLimit(LONGLONG*);
+    HRESULT STDMETHODCALLTYPE GetSharedCacheStats(SharedCacheStats*);
+
+    //IWebmDecryption
+
+    HRESULT STDMETHODCALLTYPE SetDecryptionKey(
+                                const BYTE* key_id,
+                                ULONG key_id_len,
+                                const BYTE* key);
+
     //local classes and methods
 
 private:
@@ -111,16 +143,226 @@ public:
     HRESULT OnDisconnectInpin();
     void OnStarvation(ULONG);
 
+    //Counts the number of times an outpin reached the end of the loaded
+    //clusters, and had to wait for the loader to parse the next one.
+    LONG GetStarvationCount() const;
+
+    //Whether the loader stopped at a damaged or truncated cluster.  No
+    //more clusters will be loaded, so an outpin past the last one resyncs
+    //on the next cluster it can find (see mkvparser::Stream::Resync)
+    //rather than wait.
+    bool IsDamaged() const;
+
+    //Counts the number of times a streaming thread of this filter was
+    //woken (by the cluster loader, or by arrival of data) to do work.
+    void OnWakeup();
+    LONG GetWakeupCount() const;
+
+    //The loader thread parses clusters ahead of the outpins, but no more
+    //than this many clusters ahead of the one the slowest outpin is in
+    //(0 means no limit).  An outpin that has delivered a block calls
+    //OnAdvance, to let the loader continue if it was waiting.
+    void SetLookahead(long clusters);
+    long GetLookahead() const;
+    void OnAdvance();
+
+    //How far apart (in clusters) the outpins have been.  A warning is
+    //counted each time they drift more than kInterleaveWarning clusters
+    //apart.
+    struct InterleaveStats
+    {
+        long max_clusters;
+        LONGLONG warnings;
+    };
+
+    enum { kInterleaveWarning = 32 };
+
+    void GetInterleaveStats(InterleaveStats&) const;
+
+    //By default a seek starts the streams at the video keyframe before
+    //the requested time, and their times count from the keyframe.  An
+    //accurate seek starts them at the requested time: the video blocks
+    //from the keyframe up to it are sent as preroll, which a decoder
+    //decodes but neither converts nor delivers, and the audio blocks
+    //before it are skipped.
+    void SetAccurateSeek(bool);
+    bool GetAccurateSeek() const;
+
+    //When the filter follows a file that is still being written (see
+    //MkvReader::Follow), and no position has been set, the streams start
+    //this far (in reftime units) behind the last cluster written, rather
+    //than at the start of the file.  The loader then keeps parsing the
+    //clusters as they are appended.  0 starts at the last cluster.
+    void SetTailLatency(LONGLONG);
+    LONGLONG GetTailLatency() const;
+
+    enum { kDefaultTailLatency = 3 * 10000000 };  //3 seconds
+
+    //How the samples get from the clusters to the outpins.  By default
+    //each outpin has a streaming thread of its own, which waits for the
+    //loader thread to signal each new cluster.  With kSchedulerLoop one
+    //thread loads the clusters and populates the samples of all the
+    //outpins, in turn, and delivers those of the outpins whose downstream
+    //Receive doesn't block.  An outpin that has to wait, for the buffers
+    //or for its Receive, is handed to a pool, whose threads are made only
+    //as they are needed (but one for each outpin that waits at once, so
+    //that a renderer holding one stream can't starve another).  It takes
+    //effect at the next transition from stopped.
+    enum Scheduler { kSchedulerThreads, kSchedulerLoop };
+
+    void SetScheduler(Scheduler);
+    Scheduler GetScheduler() const;
+
+    bool IsLoopScheduled() const;  //the scheduler of this run
+
+    //For a seek while the loop runs: SuspendLoopPin flushes downstream of
+    //the pin, and waits until neither the loop nor the pool is servicing
+    //it; it is called without the lock.  ResumeLoopPin, called with the
+    //lock, starts a new segment for it.
+    void SuspendLoopPin(Outpin*);
+    void ResumeLoopPin(Outpin*);
+
     HRESULT Open();
     void CreateOutpin(mkvparser::Stream*);
 
     bool InCache();
 
+    struct SeekStats
+    {
+        LONGLONG seeks;     //seeks resolved through the cluster index
+        LONGLONG clusters;  //clusters searched for the seek block
+        LONGLONG blocks;    //block entries scanned while searching
+    };
+
+    void GetSeekStats(SeekStats&) const;
+    void ResetSeekStats();
+
+    //Whether each cluster that begins with a CRC-32 element is checked
+    //against it, as the cluster is indexed (see UpdateClusterIndex),
+    //once the whole of it is available.  The payload is read once more,
+    //from the reader's cache.  A cluster that fails is still delivered,
+    //but counted.  Off by default.
+    void SetCheckCrc(bool);
+    bool GetCheckCrc() const;
+
+    struct CrcStats
+    {
+        LONGLONG checked;  //clusters with a CRC-32 element
+        LONGLONG failed;
+        LONGLONG failed_pos;  //of the last that failed, or -1
+    };
+
+    void GetCrcStats(CrcStats&) const;
+
 private:
     HANDLE m_hThread;
     mkvparser::Segment* m_pSegment;
     HANDLE m_hNewCluster;
     long m_cStarvation;
+    volatile LONG m_cWakeups;
+    volatile LONG m_cStarved;
+
+    enum { kDefaultLookahead = 16 };
+
+    long m_cLookahead;
+    HANDLE m_hAdvance;       //auto-reset; wakes the loader
+    bool m_bLoaderWaiting;
+    bool m_bStarving;        //an outpin waits for the next cluster
+    bool m_bDamaged;         //the loader stopped on a bad cluster
+
+    InterleaveStats m_interleave_stats;
+    bool m_bWideInterleave;
+    bool m_bAccurateSeek;
+    LONGLONG m_tail_latency;
+
+    struct DecryptionKey
+    {
+        std::string key_id;
+        BYTE key[IWebmDecryption::kKeySize];
+    };
+
+    typedef std::vector<DecryptionKey> keys_t;
+    keys_t m_keys;  //for the streams created after they were set
+
+    Scheduler m_scheduler;
+    bool m_bLoop;  //m_scheduler, as of the last start
+
+    struct LoopPin
+    {
+        Outpin* pPin;
+        std::vector<IMediaSample*> samples;  //populated, not yet sent
+        bool bBusy;        //being serviced by the loop, or the pool
+        bool bDone;        //end of stream, or downstream said stop
+        bool bSuspended;   //for a seek
+        bool bNewSegment;  //to send before the next samples
+        HANDLE hIdle;      //manual-reset; set while not busy
+    };
+
+    typedef std::vector<LoopPin> loop_pins_t;
+    loop_pins_t m_loop_pins;  //the connected outpins, as of the start
+
+    typedef std::deque<loop_pins_t::size_type> pool_queue_t;
+    pool_queue_t m_pool_queue;
+
+    std::vector<HANDLE> m_pool_threads;
+    long m_cPoolIdle;     //threads not reserved for a queued pin
+    HANDLE m_hPoolWork;   //semaphore; one count per queued pin
+    HANDLE m_hPoolQuit;   //manual-reset
+    bool m_bLoopLoading;  //more clusters to load
+
+    enum { kLoopWaitMs = 20 };  //for data, while the pool has pins
+
+    static unsigned __stdcall LoopThreadProc(void*);
+    unsigned LoopMain();
+    bool ServiceLoopPin(loop_pins_t::size_type);
+    bool LoadLoopCluster(DWORD timeout_ms);
+    void PushPool(loop_pins_t::size_type);
+    void DoneLoopPin(LoopPin&, bool bDone);
+    LoopPin* FindLoopPin(const Outpin*);
+    void InitLoop();
+    void FinalLoop();
+    void FinalPool();
+
+    static unsigned __stdcall PoolThreadProc(void*);
+    unsigned PoolMain();
+
+    bool IsLookaheadFull() const;
+    void SeekTail();
+    bool GetOutpinClusters(long& slowest, long& fastest) const;
+    void UpdateInterleave();
+
+    //The loaded clusters, in time order, so that a seek that can't be
+    //resolved using the cues can binary search for its cluster instead
+    //of walking them all.  The index grows as the clusters are loaded.
+
+    struct ClusterIndexEntry
+    {
+        LONGLONG time_ns;
+        const mkvparser::Cluster* pCluster;
+    };
+
+    typedef std::vector<ClusterIndexEntry> cluster_index_t;
+    cluster_index_t m_cluster_index;
+
+    //Limit on the clusters searched back from the seek time for a
+    //keyframe, before giving up and using the linear search.
+
+    enum { kMaxSeekClusters = 64 };
+
+    SeekStats m_seek_stats;
+
+    static bool CompareTime(LONGLONG, const ClusterIndexEntry&);
+    void UpdateClusterIndex();
+
+    bool m_bCheckCrc;
+    CrcStats m_crc_stats;
+
+    void CheckClusterCrc(const mkvparser::Cluster*);
+    void ResetCrcStats();
+
+    const mkvparser::BlockEntry* SeekClusterIndex(
+        const mkvparser::Track*,
+        LONGLONG ns);
 
     static unsigned __stdcall ThreadProc(void*);
     unsigned Main();
@@ -132,6 +374,7 @@ private:
     void OnNewCluster();
     void PopulateSamples(const HANDLE*, DWORD);
 
+    Outpin* GetSeekOutpin() const;  //connected, and not sparse
     void SetCurrPositionUsingSameTime(mkvparser::Stream*);
     void SetCurrPositionVideo(LONGLONG ns, mkvparser::Stream*);
     void SetCurrPositionAudio(LONGLONG ns, mkvparser::Stream*);
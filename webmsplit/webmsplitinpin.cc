@@ -137,6 +137,40 @@ HRESULT Inpin::QueryInternalConnections(
 }
 
 
+namespace
+{
+
+//The name of the file of the source filter of the pin, or null if the
+//source isn't a file source.  Free the result using CoTaskMemFree.
+
+LPOLESTR GetSourceFile(IPin* pin)
+{
+    PIN_INFO info;
+
+    HRESULT hr = pin->QueryPinInfo(&info);
+
+    if (FAILED(hr) || (info.pFilter == 0))
+        return 0;
+
+    const GraphUtil::IFileSourceFilterPtr pSource(info.pFilter);
+    info.pFilter->Release();
+
+    if (!bool(pSource))
+        return 0;
+
+    LPOLESTR name;
+
+    hr = pSource->GetCurFile(&name, 0);
+
+    if (FAILED(hr))
+        return 0;
+
+    return name;
+}
+
+}  //end anon namespace
+
+
 HRESULT Inpin::ReceiveConnection(
     IPin* pin,
     const AM_MEDIA_TYPE* pmt)
@@ -184,6 +218,24 @@ HRESULT Inpin::ReceiveConnection(
     if (FAILED(hr))
         return hr;
 
+    //A file that is still being written (by webmmux in live mode, say)
+    //is followed as it grows.  Its pages aren't shared: the shared cache
+    //knows a file by its size, which keeps changing.
+
+    if (const LPOLESTR name = GetSourceFile(pin))
+    {
+        using webmdshow::TailFollower;
+        using webmdshow::SharedFileCache;
+
+        const bool bFollow =
+            TailFollower::IsBeingWritten(name) && m_reader.Follow(name);
+
+        if (!bFollow && (SharedFileCache::GetLimit() > 0))
+            m_reader.SetSharedFile(SharedFileCache::Open(name));
+
+        CoTaskMemFree(name);
+    }
+
     m_reader.m_sync_read = true;
 
 #if 1
@@ -14,8 +14,11 @@
 #include "webmsplitoutpin.h"
 #include "cmediasample.h"
 #include "mkvparser.hpp"
+#include "webmtrace.h"
+#include "threadutil.h"
 #include <vfwmsgs.h>
 #include <cassert>
+#include <climits>
 #include <sstream>
 #include <iomanip>
 #include <process.h>
@@ -38,7 +41,17 @@ Outpin::Outpin(
     Pin(pFilter, PINDIR_OUTPUT, pStream->GetId().c_str()),
     m_pStream(pStream),
     m_hThread(0),
-    m_cRef(0)
+    m_cRef(0),
+    m_cBatchMax(0),
+    m_bReceiveMultiple(true),
+    m_bLoop(false),
+    m_bReceiveCanBlock(true),
+    m_rate(1),
+    m_segment_start(0),
+    m_segment_stop(0),
+    m_heartbeat(-1),
+    m_drop_time(-1),
+    m_counters((L"webmsplit." + pStream->GetId()).c_str())
 {
     m_pStream->GetMediaTypes(m_preferred_mtv);
 
@@ -91,11 +104,42 @@ HRESULT Outpin::Start()  //transition from stopped
     assert(bool(m_pAllocator));
     assert(bool(m_pInputPin));
 
-    const HRESULT hr = m_pAllocator->Commit();
-    hr;
+    HRESULT hr = m_pAllocator->Commit();
     assert(SUCCEEDED(hr));  //TODO
 
-    StartThread();
+    //Audio streams comprise many small blocks, so the per-call cost of
+    //Receive dominates; batch those.  Video frames are delivered one
+    //block at a time, so the decoder sees each frame as soon as possible.
+
+    m_cBatchMax = 0;
+    m_bReceiveMultiple = true;
+
+    const mkvparser::Track* const pTrack = m_pStream->m_pTrack;
+
+    if (pTrack->GetType() == 2)  //audio
+    {
+        ALLOCATOR_PROPERTIES props;
+
+        hr = m_pAllocator->GetProperties(&props);
+
+        if (SUCCEEDED(hr) && (props.cBuffers > 1))
+            m_cBatchMax = props.cBuffers;
+    }
+
+    m_bLoop = m_pFilter->IsLoopScheduled();
+
+    if (!m_bLoop)
+    {
+        StartThread();
+        return S_OK;
+    }
+
+    //Only a pin whose Receive returns without waiting (for the time to
+    //present the sample, say) can be delivered from the loop itself.
+
+    m_bReceiveCanBlock = (m_pInputPin->ReceiveCanBlock() != S_FALSE);
+
+    PrepareSegment();
 
     return S_OK;
 }
@@ -113,10 +157,40 @@ void Outpin::Stop()  //transition to stopped
     hr;
     assert(SUCCEEDED(hr));
 
+    if (bool(m_pLargeAllocator))
+        m_pLargeAllocator->Decommit();
+
     StopThread();
 
+    //The thread may have made another before it stopped.
+
+    if (bool(m_pLargeAllocator))
+    {
+        m_pLargeAllocator->Decommit();
+        m_pLargeAllocator = 0;
+    }
+
     if (m_pStream)
+    {
+#ifdef _DEBUG
+        mkvparser::Stream::ReadStats stats;
+        m_pStream->GetReadStats(stats);
+
+        if (stats.frames > 0)
+        {
+            wodbgstream os;
+            os << "webmsplit::outpin[" << m_id << "]::stop: reads="
+               << stats.reads
+               << " frames="
+               << stats.frames
+               << " reads/frame="
+               << double(stats.reads) / double(stats.frames)
+               << endl;
+        }
+#endif
+
         m_pStream->Stop();
+    }
 }
 
 
@@ -153,6 +227,7 @@ void Outpin::Final()
 void Outpin::StartThread()
 {
     assert(m_hThread == 0);
+    assert(!m_bLoop);
 
     BOOL b = ResetEvent(m_hStop);
     assert(b);
@@ -160,6 +235,8 @@ void Outpin::StartThread()
     b = ResetEvent(m_hNewCluster);
     assert(b);
 
+    PrepareSegment();
+
     const uintptr_t h = _beginthreadex(
                             0,  //security
                             0,  //stack size
@@ -173,6 +250,27 @@ void Outpin::StartThread()
 }
 
 
+void Outpin::PrepareSegment()
+{
+    //The times of our samples are relative to where the stream was
+    //positioned.  We hold the lock, so get the segment for the run here.
+
+    m_segment_start = m_pStream->GetBaseTime();
+    m_segment_stop = m_pStream->GetStopTime();
+    m_heartbeat = -1;
+
+    InterlockedExchange64(&m_drop_time, -1);  //from before a seek
+
+    if (m_segment_stop < 0)  //means "use duration"
+    {
+        const HRESULT hr = GetDuration(&m_segment_stop);
+
+        if (FAILED(hr) || (m_segment_stop < 0))
+            m_segment_stop = LLONG_MAX;
+    }
+}
+
+
 void Outpin::StopThread()
 {
     if (m_hThread == 0)
@@ -230,6 +328,9 @@ HRESULT Outpin::QueryInterface(const IID& iid, void** ppv)
     else if (iid == __uuidof(IMediaSeeking))
         pUnk = static_cast<IMediaSeeking*>(this);
 
+    else if (iid == __uuidof(IQualityControl))
+        pUnk = static_cast<IQualityControl*>(this);
+
     else
     {
 #if 0
@@ -1171,7 +1272,10 @@ HRESULT Outpin::SetPositions(
     {
         lock.Release();
 
-        StopThread();
+        if (m_bLoop)
+            m_pFilter->SuspendLoopPin(this);
+        else
+            StopThread();
 
         hr = lock.Seize(m_pFilter);
         assert(SUCCEEDED(hr));  //TODO
@@ -1222,9 +1326,18 @@ HRESULT Outpin::SetPositions(
         }
     }
 
-    if (m_pFilter->m_state != State_Stopped)
+    if (m_pFilter->m_state == State_Stopped)
+        __noop;
+
+    else if (!m_bLoop)
         StartThread();
 
+    else
+    {
+        PrepareSegment();
+        m_pFilter->ResumeLoopPin(this);
+    }
+
 #if 0 //def _DEBUG
     os << "Outpin::SetPos(end): pCurr="
        << dec << (pCurr ? *pCurr : -1)
@@ -1275,13 +1388,49 @@ HRESULT Outpin::GetAvailable(
 
 HRESULT Outpin::SetRate(double r)
 {
-    if (r == 1)
-        return S_OK;
-
-    if (r <= 0)
+    if (r == 0)
         return E_INVALIDARG;
 
-    return E_NOTIMPL;  //TODO: better return here?
+    Filter::Lock lock;
+
+    const HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pStream == 0)
+        return E_FAIL;
+
+    //The filter graph manager seeks after it changes the rate, and the
+    //thread's NewSegment gives the new rate downstream.  A renderer can
+    //present a few times as many frames, but not as many as a fast
+    //forward needs, so above kThinRate we send it only the keyframes.
+    //
+    //A negative rate plays a video stream backwards, a group of blocks
+    //at a time (see Stream::SetReverse).  A decoder that understands the
+    //negative rate of our NewSegment (as ours does) presents the frames of
+    //each group in reverse, and sends the positive rate downstream.
+
+    const mkvparser::Track* const pTrack = m_pStream->m_pTrack;
+    const bool bVideo = (pTrack->GetType() == 1);
+
+    if (r < 0)
+    {
+        if (!bVideo)
+            return E_INVALIDARG;
+
+        if (pTrack->m_pSegment->GetCues() == 0)
+            return E_INVALIDARG;  //we can't find the keyframes
+    }
+
+    m_rate = r;
+
+    const double speed = (r < 0) ? -r : r;
+
+    m_pStream->SetReverse(r < 0);
+    m_pStream->SetThinning((bVideo && (speed > kThinRate)) ? speed : 0);
+
+    return S_OK;
 }
 
 
@@ -1290,7 +1439,14 @@ HRESULT Outpin::GetRate(double* p)
     if (p == 0)
         return E_POINTER;
 
-    *p = 1;
+    Filter::Lock lock;
+
+    const HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    *p = m_rate;
     return S_OK;
 }
 
@@ -1305,6 +1461,32 @@ HRESULT Outpin::GetPreroll(LONGLONG* p)
 }
 
 
+HRESULT Outpin::Notify(IBaseFilter*, Quality q)
+{
+    //Called on the renderer's thread, as it renders, so we mustn't wait
+    //for the filter lock, which the streaming thread may hold while it
+    //waits for a buffer the renderer has yet to release.
+
+    if ((q.Type != Famine) || (q.Late <= kDropLate))
+        return S_OK;
+
+    const mkvparser::Track* const pTrack = m_pStream->m_pTrack;
+
+    if (pTrack->GetType() != 1)  //video
+        return S_OK;
+
+    InterlockedExchange64(&m_drop_time, q.TimeStamp + q.Late);
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::SetSink(IQualityControl*)
+{
+    return S_OK;  //we send no quality messages of our own
+}
+
+
 HRESULT Outpin::GetName(PIN_INFO& i) const
 {
     const std::wstring name = m_pStream->GetName();
@@ -1324,6 +1506,10 @@ unsigned Outpin::ThreadProc(void* pv)
     Outpin* const pPin = static_cast<Outpin*>(pv);
     assert(pPin);
 
+    const WebmMfUtil::ThreadPolicyScope policy(
+            L"webmsplit",
+            WebmMfUtil::kThreadClassPlayback);
+
     return pPin->Main();
 }
 
@@ -1335,17 +1521,17 @@ unsigned Outpin::Main()
     assert(bool(m_pInputPin));
     assert(m_pStream);
 
-    //TODO: we need duration to send NewSegment
-    //HRESULT hr = m_connection->NewSegment(st, sp, 1);
-    //UPDATE: but if IMediaSeeking::GetCapabilities does NOT indicate
-    //that it supports segments, then do we still need to send NewSegment?
+    HRESULT hr = BeginSegment();
+
+    if (FAILED(hr))
+        return 0;
 
     typedef mkvparser::Stream::samples_t samples_t;
     samples_t samples;
 
     for (;;)
     {
-        HRESULT hr = PopulateSamples(samples);
+        hr = Populate(samples, 0);
 
         if (FAILED(hr))
             break;
@@ -1356,30 +1542,75 @@ unsigned Outpin::Main()
             break;
         }
 
-        assert(!samples.empty());
+        hr = Send(samples);
 
-        IMediaSample** const pSamples = &samples[0];
+        if (hr != S_OK)  //downstream filter says we're done
+            break;
+    }
 
-        const samples_t::size_type nSamples_ = samples.size();
-        const long nSamples = static_cast<long>(nSamples_);
+    mkvparser::Stream::Clear(samples);
+    return 0;
+}
 
-        long nProcessed;
 
-        hr = m_pInputPin->ReceiveMultiple(pSamples, nSamples, &nProcessed);
+HRESULT Outpin::BeginSegment()
+{
+    //Downstream needs the rate to present the samples at speed, and the
+    //position to convert their times to stream times.
 
-        if (hr != S_OK)  //downstream filter says we're done
-            break;
+    return m_pPinConnection->NewSegment(
+            m_segment_start,
+            m_segment_stop,
+            m_rate);
+}
+
+
+HRESULT Outpin::Populate(
+    mkvparser::Stream::samples_t& samples,
+    DWORD flags)
+{
+    const HRESULT hr = PopulateSamples(samples, flags);
+
+    if (hr != S_OK)  //EOS, or no block yet
+        return hr;
+
+    assert(!samples.empty());
+
+    if (m_cBatchMax > 0)
+        AppendSamples(samples);
+
+    m_counters.SetQueueDepth(static_cast<int>(samples.size()));
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::Send(mkvparser::Stream::samples_t& samples)
+{
+    const HRESULT hr = Deliver(samples);
 
-        mkvparser::Stream::Clear(samples);
-        Sleep(0);
+    if (hr == S_OK)
+    {
+        typedef mkvparser::Stream::samples_t::const_iterator iter_t;
+
+        for (iter_t i = samples.begin(); i != samples.end(); ++i)
+            m_counters.OnSampleOut((*i)->GetActualDataLength());
     }
 
     mkvparser::Stream::Clear(samples);
-    return 0;
+    return hr;
 }
 
 
-HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
+bool Outpin::ReceiveCanBlock() const
+{
+    return m_bReceiveCanBlock;
+}
+
+
+HRESULT Outpin::PopulateSamples(
+    mkvparser::Stream::samples_t& samples,
+    DWORD flags)
 {
     for (;;)
     {
@@ -1392,15 +1623,44 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
         if (FAILED(hr))
             return hr;
 
-        long count;
+        const LONGLONG drop_time = InterlockedExchange64(&m_drop_time, -1);
+
+        if (drop_time >= 0)
+            m_pStream->SetDropTime(drop_time);
+
+        long count, size;
 
-        hr = m_pStream->GetSampleCount(count);
+        hr = m_pStream->GetSampleCount(count, size);
 
         if (SUCCEEDED(hr))
         {
             if (hr != S_OK)  //EOS
                 return hr;
 
+            //A block whose frames each lie within one page of the reader's
+            //cache is delivered in samples that refer to the cache, so
+            //there is no buffer to wait for, and nothing to copy.
+
+            hr = m_pStream->LendSamples(samples);
+
+            if (hr == S_OK)
+            {
+                hr = PopulateBlock(samples);
+
+                if (hr != 2)
+                    return hr;
+
+                hr = lock.Release();
+                assert(SUCCEEDED(hr));
+
+                mkvparser::Stream::Clear(samples);
+                continue;
+            }
+
+            //Stop decommits the large allocator while it holds the lock,
+            //so we only touch our member while we hold it too.
+            GraphUtil::IMemAllocatorPtr pLarge(m_pLargeAllocator);
+
             hr = lock.Release();
             assert(SUCCEEDED(hr));
 
@@ -1408,26 +1668,33 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
 
             samples.reserve(count);
 
-            for (long idx = 0; idx < count; ++idx)
-            {
-                IMediaSample* sample;
-
-                hr = m_pAllocator->GetBuffer(&sample, 0, 0, 0);
+            hr = mkvparser::Stream::GetSamples(
+                    m_pAllocator,
+                    pLarge,
+                    count,
+                    size,
+                    flags,
+                    samples);
 
-                if (hr != S_OK)
-                    return E_FAIL;  //we're done
-
-                samples.push_back(sample);
+            if ((hr == VFW_E_TIMEOUT) && (flags & AM_GBF_NOWAIT))
+            {
+                mkvparser::Stream::Clear(samples);
+                return E_PENDING;  //downstream still holds the buffers
             }
 
+            if (hr != S_OK)
+                return E_FAIL;  //we're done
+
             hr = lock.Seize(m_pFilter);
 
             if (FAILED(hr))
                 return hr;
 
+            m_pLargeAllocator = pLarge;
+
             //We have buffers.  Now populate them.
 
-            hr = m_pStream->PopulateSamples(samples);
+            hr = PopulateBlock(samples);
 
             if (SUCCEEDED(hr))
             {
@@ -1450,7 +1717,30 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
         if (hr != VFW_E_BUFFER_UNDERFLOW)
             return hr;
 
-        m_pFilter->OnStarvation(m_pStream->GetClusterCount());
+        if (m_pFilter->IsDamaged())  //no more clusters are coming
+        {
+            hr = m_pStream->Resync();
+
+            if (FAILED(hr))
+                return hr;
+
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            continue;
+        }
+
+        //A sparse stream is expected to wait: the loader has no reason to
+        //go faster for it.
+
+        if (!m_pStream->IsSparse())
+            m_pFilter->OnStarvation(m_pStream->GetClusterCount());
+
+        else if (GetHeartbeat(samples))
+            return S_OK;
+
+        if (m_bLoop)  //the loop loads the cluster, then comes back to us
+            return VFW_E_BUFFER_UNDERFLOW;
 
         hr = lock.Release();
         assert(SUCCEEDED(hr));
@@ -1466,10 +1756,215 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
             return E_FAIL;  //NOTE: this return here is not an error
 
         assert(dw == (WAIT_OBJECT_0 + 1));  //hNewCluster
+        m_pFilter->OnWakeup();
+    }
+}
+
+
+void Outpin::AppendSamples(mkvparser::Stream::samples_t& samples)
+{
+    //We have already populated the samples for one block.  Add the blocks
+    //that follow, for as long as they have already been parsed and there
+    //are buffers free.  We never wait here: if the next block isn't
+    //available yet, what we have is sent now.
+
+    typedef mkvparser::Stream::samples_t samples_t;
+
+    Filter::Lock lock;
+
+    HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return;
+
+    samples_t block;
+
+    while (long(samples.size()) < m_cBatchMax)
+    {
+        assert(block.empty());
+
+        long count, size;
+
+        hr = m_pStream->GetSampleCount(count, size);
+
+        if (hr != S_OK)  //EOS or underflow: handled on the next pass
+            return;
+
+        if ((long(samples.size()) + count) > m_cBatchMax)
+            return;
+
+        block.reserve(count);
+
+        hr = m_pStream->LendSamples(block);
+
+        if (hr != S_OK)
+            hr = mkvparser::Stream::GetSamples(
+                    m_pAllocator,
+                    m_pLargeAllocator,
+                    count,
+                    size,
+                    AM_GBF_NOWAIT,
+                    block);
+
+        if (hr != S_OK)  //no more buffers free
+        {
+            mkvparser::Stream::Clear(block);
+            return;
+        }
+
+        hr = PopulateBlock(block);
+
+        if (hr == 2)  //block was skipped
+        {
+            mkvparser::Stream::Clear(block);
+            continue;
+        }
+
+        if (hr != S_OK)
+        {
+            mkvparser::Stream::Clear(block);
+            return;
+        }
+
+        samples.insert(samples.end(), block.begin(), block.end());
+        block.clear();  //ownership passed to samples
     }
 }
 
 
+HRESULT Outpin::PopulateBlock(mkvparser::Stream::samples_t& samples)
+{
+    //We hold the lock.
+
+    HRESULT hr;
+
+    {
+        webmdshow::PipelineCounters::Timer timer(m_counters);
+        hr = m_pStream->PopulateSamples(samples);
+    }
+
+    if (hr != S_OK)
+        return hr;
+
+    m_pFilter->OnAdvance();  //the loader may be waiting for us
+
+    const int track = static_cast<int>(m_pStream->m_pTrack->GetNumber());
+
+    typedef mkvparser::Stream::samples_t::const_iterator iter_t;
+
+    for (iter_t i = samples.begin(); i != samples.end(); ++i)
+    {
+        IMediaSample* const pSample = *i;
+
+        m_counters.OnSampleIn(pSample->GetActualDataLength());
+
+        LONGLONG start, stop;
+
+        if (m_pStream->IsSparse() &&
+            SUCCEEDED(pSample->GetTime(&start, &stop)) &&
+            (start > m_heartbeat))
+        {
+            m_heartbeat = start;  //no heartbeat before what we've sent
+        }
+
+        webmdshow::TraceSample(
+            webmdshow::kTraceFramePopulate,
+            track,
+            pSample);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT Outpin::Deliver(mkvparser::Stream::samples_t& samples)
+{
+    assert(!samples.empty());
+
+    IMediaSample** const pSamples = &samples[0];
+
+    const mkvparser::Stream::samples_t::size_type nSamples_ = samples.size();
+    const long nSamples = static_cast<long>(nSamples_);
+
+    if (m_bReceiveMultiple)
+    {
+        long nProcessed;
+
+        const HRESULT hr = m_pInputPin->ReceiveMultiple(
+                            pSamples,
+                            nSamples,
+                            &nProcessed);
+
+        if (hr != E_NOTIMPL)
+            return hr;
+
+        //Downstream pin doesn't implement ReceiveMultiple, so there's
+        //nothing to be gained; use Receive from now on.
+
+        m_bReceiveMultiple = false;
+    }
+
+    for (long i = 0; i < nSamples; ++i)
+    {
+        const HRESULT hr = m_pInputPin->Receive(pSamples[i]);
+
+        if (hr != S_OK)
+            return hr;
+    }
+
+    return S_OK;
+}
+
+
+bool Outpin::GetHeartbeat(mkvparser::Stream::samples_t& samples)
+{
+    //We hold the lock.
+
+    assert(samples.empty());
+
+    LONGLONG t;
+
+    if (!m_pStream->GetIdleTime(t))
+        return false;
+
+    if ((m_heartbeat >= 0) && (t < (m_heartbeat + kHeartbeatInterval)))
+        return false;
+
+    IMediaSample* pSample;
+
+    HRESULT hr = m_pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+    if (FAILED(hr))  //downstream still holds them all: next cluster
+        return false;
+
+    hr = pSample->SetActualDataLength(0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetTime(&t, &t);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetMediaTime(0, 0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetPreroll(FALSE);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetMediaType(0);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetDiscontinuity(FALSE);
+    assert(SUCCEEDED(hr));
+
+    hr = pSample->SetSyncPoint(TRUE);
+    assert(SUCCEEDED(hr));
+
+    samples.push_back(pSample);
+    m_heartbeat = t;
+
+    return true;
+}
+
+
 mkvparser::Stream* Outpin::GetStream() const
 {
     return m_pStream;
@@ -10,6 +10,7 @@
 #include "webmsplitpin.h"
 #include <comdef.h>
 #include "graphutil.h"
+#include "pipelinecounters.h"
 
 namespace mkvparser
 {
@@ -20,7 +21,8 @@ namespace WebmSplit
 {
 
 class Outpin : public Pin,
-               public IMediaSeeking
+               public IMediaSeeking,
+               public IQualityControl
 {
     Outpin(const Outpin&);
     Outpin& operator=(const Outpin&);
@@ -33,16 +35,60 @@ protected:
     HRESULT OnDisconnect();
     HRESULT GetName(PIN_INFO&) const;
 
-    HRESULT PopulateSamples(mkvparser::Stream::samples_t&);
+    HRESULT PopulateSamples(mkvparser::Stream::samples_t&, DWORD flags);
+    void AppendSamples(mkvparser::Stream::samples_t&);
+    HRESULT PopulateBlock(mkvparser::Stream::samples_t&);
+    HRESULT Deliver(mkvparser::Stream::samples_t&);
 
     mkvparser::Stream* m_pStream;
     GraphUtil::IMemAllocatorPtr m_pAllocator;
+    GraphUtil::IMemAllocatorPtr m_pLargeAllocator;  //see GetSamples
     GraphUtil::IMemInputPinPtr m_pInputPin;
     HANDLE m_hThread;
     HANDLE m_hStop;
     HANDLE m_hNewCluster;
     ULONG m_cRef;
 
+    //Batched delivery: when non-zero, blocks that can be populated without
+    //waiting (for data or for buffers) are appended to the current batch,
+    //up to this many samples, and sent downstream in one ReceiveMultiple.
+    long m_cBatchMax;
+    bool m_bReceiveMultiple;
+
+    //Set by Start when the filter's delivery loop services this pin (see
+    //Filter::kSchedulerLoop), instead of a thread of its own.  A pin whose
+    //downstream Receive can block is delivered from the loop's pool.
+    bool m_bLoop;
+    bool m_bReceiveCanBlock;
+
+    //IMediaSeeking::SetRate.  Above kThinRate a video stream is thinned
+    //to its keyframes (see Stream::SetThinning).  Each run of the thread
+    //begins with a NewSegment, whose times StartThread gets.
+    enum { kThinRate = 2 };
+    double m_rate;
+    LONGLONG m_segment_start;
+    LONGLONG m_segment_stop;
+
+    //Heartbeat of a sparse stream (see Stream::IsSparse).  While it waits
+    //for its next block, it sends an empty sample, timed at the last
+    //cluster loaded, each time the loader gets another kHeartbeatInterval
+    //(reftime) into the file, so that a filter that interleaves its
+    //inputs (a muxer, say) can go on with the others without waiting for
+    //this one.  m_heartbeat is the time of the last sample sent.
+    enum { kHeartbeatInterval = 10000000 };
+    LONGLONG m_heartbeat;
+    bool GetHeartbeat(mkvparser::Stream::samples_t&);
+
+    //Catch-up.  When a video renderer reports (through the decoder, by
+    //way of IQualityControl::Notify) that it is more than kDropLate
+    //(reftime) behind, the stream skips to the first keyframe at or after
+    //the time the renderer has got to (see Stream::SetDropTime), without
+    //reading the blocks in between.  Notify is called on the renderer's
+    //thread, so it only leaves the time here, for the streaming thread
+    //to pass to the stream; -1 means there is none.
+    enum { kDropLate = 5000000 };
+    volatile LONGLONG m_drop_time;
+
 public:
     static Outpin* Create(Filter*, mkvparser::Stream*);
     ULONG Destroy();  //when inpin becomes disconnected
@@ -121,15 +167,37 @@ public:
     HRESULT STDMETHODCALLTYPE GetRate(double*);
     HRESULT STDMETHODCALLTYPE GetPreroll(LONGLONG*);
 
+    //IQualityControl
+
+    HRESULT STDMETHODCALLTYPE Notify(IBaseFilter*, Quality);
+    HRESULT STDMETHODCALLTYPE SetSink(IQualityControl*);
+
     mkvparser::Stream* GetStream() const;
     void OnNewCluster();
 
+    //For the filter's delivery loop.  BeginSegment sends the NewSegment
+    //that begins each run.  Populate gets the samples of the next block,
+    //and of the blocks after it when batching, and returns S_FALSE at the
+    //end of the stream.  It never waits for the loader: when the next
+    //block hasn't been loaded yet, it returns VFW_E_BUFFER_UNDERFLOW.
+    //With AM_GBF_NOWAIT it doesn't wait for buffers either, but returns
+    //E_PENDING.  Send delivers the samples, and clears them.
+    HRESULT BeginSegment();
+    HRESULT Populate(mkvparser::Stream::samples_t&, DWORD flags);
+    HRESULT Send(mkvparser::Stream::samples_t&);
+    bool ReceiveCanBlock() const;
+
+    //Frames parsed into samples, and samples delivered; the queue depth
+    //is the size of the batch being delivered.
+    webmdshow::PipelineCounters m_counters;
+
 private:
     static unsigned __stdcall ThreadProc(void*);
     unsigned Main();
 
     void StartThread();
     void StopThread();
+    void PrepareSegment();
 
 };
 
@@ -136,10 +136,11 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS& inpin = pins[0];
 
-    enum { nInpinMediaTypes = 1 };
+    enum { nInpinMediaTypes = 2 };
     const REGPINTYPES inpinMediaTypes[nInpinMediaTypes] =
     {
-        { &MEDIATYPE_Audio, &VorbisTypes::MEDIASUBTYPE_Vorbis2 }
+        { &MEDIATYPE_Audio, &VorbisTypes::MEDIASUBTYPE_Vorbis2 },
+        { &MEDIATYPE_Audio, &VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing }
     };
 
     inpin.strName = 0;              //obsolete
@@ -154,10 +155,11 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS& outpin = pins[1];
 
-    enum { nOutpinMediaTypes = 1 };
+    enum { nOutpinMediaTypes = 2 };
     const REGPINTYPES outpinMediaTypes[nOutpinMediaTypes] =
     {
         { &MEDIATYPE_Audio, &MEDIASUBTYPE_IEEE_FLOAT },
+        { &MEDIATYPE_Audio, &MEDIASUBTYPE_PCM },
     };
 
     outpin.strName = 0;              //obsolete
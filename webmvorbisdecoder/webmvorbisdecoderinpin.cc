@@ -33,7 +33,9 @@ Inpin::Inpin(Filter* p) :
     Pin(p, PINDIR_INPUT, L"input"),
     m_bEndOfStream(false),
     m_bFlush(false),
-    m_bDone(false)
+    m_bDone(false),
+    m_converting(false),
+    m_dither_mode(webmdshow::kPcmDitherTriangular)
 {
     AM_MEDIA_TYPE mt;
 
@@ -49,8 +51,13 @@ Inpin::Inpin(Filter* p) :
 
     m_preferred_mtv.Add(mt);
 
+    mt.subtype = VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing;
+    m_preferred_mtv.Add(mt);
+
     m_packet.packetno = -1;
 
+    webmdshow::InitPcmDitherState(GetTickCount(), &m_dither);
+
     m_hSamples = CreateEvent(0, 0, 0, 0);
     assert(m_hSamples);
 }
@@ -368,16 +375,8 @@ HRESULT Inpin::EndFlush()
             pSample->Release();
     }
 
-    typedef channels_t::iterator iter_t;
-
-    iter_t i = m_channels.begin();
-    const iter_t j = m_channels.end();
-
-    while (i != j)
-    {
-        samples_t& ss = *i++;
-        ss.clear();
-    }
+    m_channels.Clear();
+    m_converter.Reset();
 
     Outpin& outpin = m_pFilter->m_outpin;
 
@@ -434,16 +433,8 @@ void Inpin::OnCompletion()
         pSample->Release();
     }
 
-    typedef channels_t::iterator iter_t;
-
-    iter_t i = m_channels.begin();
-    const iter_t j = m_channels.end();
-
-    while (i != j)
-    {
-        samples_t& ss = *i++;
-        ss.clear();
-    }
+    m_channels.Clear();
+    m_converter.Reset();
 
     m_bDone = true;
 }
@@ -486,7 +477,11 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (mt.majortype != MEDIATYPE_Audio)
         return S_FALSE;
 
-    if (mt.subtype != VorbisTypes::MEDIASUBTYPE_Vorbis2)
+    if (mt.subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2)
+        __noop;
+    else if (mt.subtype == VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing)
+        __noop;
+    else
         return S_FALSE;
 
     if (mt.formattype != VorbisTypes::FORMAT_Vorbis2)
@@ -505,7 +500,7 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (fmt.channels == 0)
         return S_FALSE;
 
-    if (fmt.channels > 2)  //TODO: handle up to 8
+    if (fmt.channels > 8)
         return S_FALSE;
 
     if (fmt.samplesPerSec == 0)
@@ -672,6 +667,7 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
         status;
         assert(status == 0);  //success
 
+        m_converter.Reset();
         m_bDiscontinuity = true;
     }
 
@@ -720,9 +716,42 @@ void Inpin::Decode(IMediaSample* pInSample)
     const long len_in = pInSample->GetActualDataLength();
     assert(len_in >= 0);
 
+    const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
+
+    if (mt.subtype != VorbisTypes::MEDIASUBTYPE_Vorbis2_Xiph_Lacing)
+    {
+        DecodePacket(buf_in, len_in);
+        return;
+    }
+
+    //The splitter batches the frames of many blocks into one sample.  Its
+    //time is that of the first packet; the times of the PCM that follows
+    //are counted from there, so the packets need no times of their own.
+
+    enum { kMaxPackets = 256 };
+
+    const BYTE* packets[kMaxPackets];
+    long lengths[kMaxPackets];
+
+    const long n = VorbisTypes::GetXiphLacedPackets(
+                    buf_in,
+                    len_in,
+                    packets,
+                    lengths,
+                    kMaxPackets);
+
+    assert(n > 0);  //TODO
+
+    for (long i = 0; i < n; ++i)
+        DecodePacket(packets[i], lengths[i]);
+}
+
+
+void Inpin::DecodePacket(const BYTE* buf_in, long len_in)
+{
     ogg_packet& pkt = m_packet;
 
-    pkt.packet = buf_in;
+    pkt.packet = const_cast<BYTE*>(buf_in);
     pkt.bytes = len_in;
     ++pkt.packetno;
 
@@ -751,13 +780,19 @@ void Inpin::Decode(IMediaSample* pInSample)
 
     assert(sv);
 
-    for (DWORD i = 0; i < fmt.channels; ++i)
+    if (m_converting)
     {
-        const float* const first = sv[i];
-        const float* const last = first + pcmout_count;
+        assert(DWORD(m_converter.in_channels()) == fmt.channels);
 
-        samples_t& ss = m_channels[i];
-        ss.insert(ss.end(), first, last);
+        const int count = m_converter.Process(sv, pcmout_count);
+
+        if (count > 0)
+            m_channels.Write(m_converter.output(), count);
+    }
+    else
+    {
+        assert(DWORD(m_channels.channels()) == fmt.channels);
+        m_channels.Write(sv, pcmout_count);
     }
 
     sv = 0;
@@ -777,11 +812,14 @@ void Inpin::PopulateSample(
 
     const DWORD channels = wfx.nChannels;
     assert(channels > 0);
-    assert(channels <= 2);  //TODO
-    assert(channels == m_channels.size());
+    assert(channels == DWORD(m_channels.channels()));
+
+    const bool bInt16 = (wfx.wFormatTag == WAVE_FORMAT_PCM);
+
+    const size_t bytesPerSample = bInt16 ? sizeof(int16_t) : sizeof(float);
 
     const long block_align = wfx.nBlockAlign;
-    assert(size_t(block_align) == (channels * sizeof(float)));
+    assert(size_t(block_align) == (channels * bytesPerSample));
 
     //ALLOCATOR_PROPERTIES props;
 
@@ -812,28 +850,17 @@ void Inpin::PopulateSample(
     assert(SUCCEEDED(hr));
     assert(dst);
 
-    BYTE* const dst_end = dst + len_out;
-    dst_end;
-
-    for (long i = 0; i < samples; ++i)
-    {
-        for (DWORD j = 0; j < channels; ++j)
-        {
-            samples_t& ss = m_channels[j];
-            assert(!ss.empty());
-
-            const float& s = ss.front();
-
-            memcpy(dst, &s, sizeof(float));  //TODO: proper channel mapping
+    assert(samples <= m_channels.size());
 
-            dst += sizeof(float);
-            assert(dst <= dst_end);
+    //TODO: proper channel mapping
 
-            ss.pop_front();  //OK for deque (horrible for vector)
-        }
+    if (bInt16)
+    {
+        int16_t* const dst16 = reinterpret_cast<int16_t*>(dst);
+        m_channels.ReadInt16(samples, m_dither_mode, &m_dither, dst16);
     }
-
-    assert(dst == dst_end);
+    else
+        m_channels.ReadFloat(samples, reinterpret_cast<float*>(dst));
 
     hr = pOutSample->SetActualDataLength(len_out);
     assert(SUCCEEDED(hr));
@@ -921,9 +948,9 @@ HRESULT Inpin::PopulateSamples()
         const WAVEFORMATEX* const pwfx = outpin.GetFormat();
         assert(pwfx);
         assert(pwfx->nChannels > 0);
-        assert(pwfx->nChannels == m_channels.size());
+        assert(pwfx->nChannels == m_channels.channels());
 
-        const long actual = m_channels[0].size();
+        const long actual = m_channels.size();
         const long target = pwfx->nSamplesPerSec / Pin::kSampleRateDivisor;
 
         if (actual < target)
@@ -1134,8 +1161,37 @@ HRESULT Inpin::Start()
     //m_start_reftime
     //m_samples
 
-    m_channels.clear();
-    m_channels.resize(fmt.channels);
+    //Vorbis orders its channels differently from WAVE past stereo, and
+    //the output type can have another layout or rate, so the decoded
+    //samples go through the converter unless it would only copy them.
+
+    const WAVEFORMATEX* const pwfx = outpin.GetFormat();
+    assert(pwfx);
+
+    const int channels = pwfx->nChannels;
+    const int rate = pwfx->nSamplesPerSec;
+
+    const bool init = m_converter.Init(
+                        fmt.channels,
+                        VorbisTypes::GetWaveChannelOrder(fmt.channels),
+                        fmt.samplesPerSec,
+                        channels,
+                        rate);
+    init;
+    assert(init);  //outpin's QueryAccept checked the conversion
+
+    m_converting = !m_converter.passthrough();
+
+    //Room for a full output buffer, plus the largest decoded block at
+    //the output rate.
+
+    const LONGLONG block = vorbis_info_blocksize(&info, 1);
+    const LONGLONG block_out = (block * rate) / fmt.samplesPerSec + 1;
+
+    const int capacity = rate / Pin::kSampleRateDivisor +
+                         static_cast<int>(block_out);
+
+    m_channels.Reset(channels, capacity);
 
     assert(m_buffers.empty());
 
@@ -1157,7 +1213,8 @@ void Inpin::Stop()
     const BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
     assert(b);
 
-    m_channels.clear();
+    m_channels.Reset(0, 0);
+    m_converting = false;
     m_first_reftime = -1;
 
     if (m_packet.packetno < 0)
@@ -9,9 +9,11 @@
 #pragma once
 #include "webmvorbisdecoderpin.h"
 #include "graphutil.h"
+#include "pcmringbuffer.h"
+#include "pcmutil.h"
+#include "pcmconverter.h"
 #include "vorbis/codec.h"
 #include <vector>
-#include <deque>
 #include <list>
 
 namespace WebmVorbisDecoderLib
@@ -111,14 +113,22 @@ private:
     double m_samples;
     bool m_bDiscontinuity;
 
-    typedef std::deque<float> samples_t;
-    typedef std::vector<samples_t> channels_t;
-    channels_t m_channels;
+    webmdshow::PcmRingBuffer m_channels;
+
+    //Maps the decoded channels to WAVE order, and converts them to the
+    //channels and rate of the output type, as they are buffered.
+    webmdshow::PcmConverter m_converter;
+    bool m_converting;
+
+    //Applies when the output is 16-bit PCM.
+    webmdshow::PcmDither m_dither_mode;
+    webmdshow::PcmDitherState m_dither;
 
     typedef std::list<IMediaSample*> buffers_t;
     buffers_t m_buffers;
 
     void Decode(IMediaSample*);
+    void DecodePacket(const BYTE*, long);
     void PopulateSample(IMediaSample*, long, const WAVEFORMATEX&);
     HRESULT PopulateSamples();
 
@@ -14,6 +14,7 @@
 #include "mediatypeutil.h"
 #include "webmtypes.h"
 #include "vorbistypes.h"
+#include "pcmconverter.h"
 #include <vfwmsgs.h>
 #include <mmreg.h>
 #include <uuids.h>
@@ -314,7 +315,20 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (mtOut.majortype != MEDIATYPE_Audio)
         return S_FALSE;
 
-    if (mtOut.subtype != MEDIASUBTYPE_IEEE_FLOAT)
+    WORD format_tag;
+    size_t bytesPerSample;
+
+    if (mtOut.subtype == MEDIASUBTYPE_IEEE_FLOAT)
+    {
+        format_tag = WAVE_FORMAT_IEEE_FLOAT;
+        bytesPerSample = sizeof(float);
+    }
+    else if (mtOut.subtype == MEDIASUBTYPE_PCM)
+    {
+        format_tag = WAVE_FORMAT_PCM;
+        bytesPerSample = sizeof(SHORT);
+    }
+    else
         return S_FALSE;
 
     if (mtOut.formattype != FORMAT_WaveFormatEx)
@@ -328,25 +342,34 @@ HRESULT Outpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
 
     const WAVEFORMATEX& wfxOut = (WAVEFORMATEX&)(*mtOut.pbFormat);
 
-    if (wfxOut.wFormatTag != WAVE_FORMAT_IEEE_FLOAT)
+    if (wfxOut.wFormatTag != format_tag)
         return S_FALSE;
 
     if (wfxOut.cbSize > 0)
         return S_FALSE;
 
+    typedef VorbisTypes::VORBISFORMAT2 FMT;
+
     const AM_MEDIA_TYPE& mtIn = inpin.m_connection_mtv[0];
-    const WAVEFORMATEX& wfxIn = (WAVEFORMATEX&)(*mtIn.pbFormat);
+    const FMT& fmt = (FMT&)(*mtIn.pbFormat);
 
-    if (wfxOut.nChannels != wfxIn.nChannels)
-        return S_FALSE;
+    //The inpin converts to the channels and rate of the output type,
+    //so accept those it can produce (see PcmConverter).
 
-    if (wfxOut.nSamplesPerSec != wfxIn.nSamplesPerSec)
+    const bool supported = webmdshow::PcmConverter::IsSupported(
+                            fmt.channels,
+                            fmt.samplesPerSec,
+                            wfxOut.nChannels,
+                            wfxOut.nSamplesPerSec);
+
+    if (!supported)
         return S_FALSE;
 
-    if (wfxOut.nBlockAlign != wfxIn.nBlockAlign)
+    if (size_t(wfxOut.wBitsPerSample) != 8 * bytesPerSample)
         return S_FALSE;
 
-    //TODO: check bits/sample
+    if (size_t(wfxOut.nBlockAlign) != bytesPerSample * wfxOut.nChannels)
+        return S_FALSE;
 
     return S_OK;
 }
@@ -744,8 +767,14 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn)
     mt.cbFormat = 18;
     mt.pbFormat = (BYTE*)&wfx;
 
+    //A plain WAVEFORMATEX does not say where more than two channels
+    //go, so a surround stream is offered downmixed to stereo; downstream
+    //filters can still propose another layout or rate.
+
+    const DWORD channels = (fmt.channels > 2) ? 2 : fmt.channels;
+
     wfx.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
-    wfx.nChannels = static_cast<WORD>(fmt.channels);
+    wfx.nChannels = static_cast<WORD>(channels);
     wfx.nSamplesPerSec = fmt.samplesPerSec;
 
     const size_t bytesPerSample = sizeof(float);
@@ -760,6 +789,19 @@ void Outpin::OnInpinConnect(const AM_MEDIA_TYPE& mtIn)
     mt.lSampleSize = wfx.nBlockAlign;
 
     m_preferred_mtv.Add(mt);
+
+    //16-bit PCM, for downstream filters that do not take float.
+
+    mt.subtype = MEDIASUBTYPE_PCM;
+
+    wfx.wFormatTag = WAVE_FORMAT_PCM;
+    wfx.wBitsPerSample = 16;
+    wfx.nBlockAlign = static_cast<WORD>(sizeof(SHORT) * wfx.nChannels);
+    wfx.nAvgBytesPerSec = wfx.nBlockAlign * wfx.nSamplesPerSec;
+
+    mt.lSampleSize = wfx.nBlockAlign;
+
+    m_preferred_mtv.Add(mt);
 }
 
 
@@ -802,6 +844,10 @@ void Outpin::SetDefaultMediaTypes()
     mt.pbFormat = 0;
 
     m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_PCM;
+
+    m_preferred_mtv.Add(mt);
 }
 
 
@@ -139,10 +139,11 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS& inpin = pins[0];
 
-    enum { nInpinMediaTypes = 1 };
+    enum { nInpinMediaTypes = 2 };
     const REGPINTYPES inpinMediaTypes[nInpinMediaTypes] =
     {
-        { &MEDIATYPE_Audio, &MEDIASUBTYPE_IEEE_FLOAT }
+        { &MEDIATYPE_Audio, &MEDIASUBTYPE_IEEE_FLOAT },
+        { &MEDIATYPE_Audio, &MEDIASUBTYPE_PCM }
     };
 
     inpin.strName = 0;              //obsolete
@@ -186,10 +187,11 @@ STDAPI DllRegisterServer()
 
     REGFILTERPINS2& inpin = pins[0];
 
-    enum { nInpinMediaTypes = 1 };
+    enum { nInpinMediaTypes = 2 };
     const REGPINTYPES inpinMediaTypes[nInpinMediaTypes] =
     {
-        { &MEDIATYPE_Audio, &MEDIASUBTYPE_IEEE_FLOAT }
+        { &MEDIATYPE_Audio, &MEDIASUBTYPE_IEEE_FLOAT },
+        { &MEDIATYPE_Audio, &MEDIASUBTYPE_PCM }
     };
 
     inpin.dwFlags = 0;
@@ -137,6 +137,10 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<IBaseFilter*>(m_pFilter);
     }
+    else if (iid == __uuidof(IWebmVorbisEncoder))
+    {
+        pUnk = static_cast<IWebmVorbisEncoder*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -236,6 +240,10 @@ HRESULT Filter::Stop()
             //Now stop outpin, to terminate its thread too.
             m_outpin.Stop();
 
+            //The outpin's allocator is decommitted, so the inpin's
+            //analysis thread isn't waiting for a buffer.
+            m_inpin.StopThread();
+
             break;
 
         case State_Stopped:
@@ -519,6 +527,25 @@ HRESULT Filter::QueryVendorInfo(LPWSTR* pstr)
 }
 
 
+HRESULT Filter::GetQueueDepth(
+    ULONG* pPcmFrames,
+    ULONG* pPackets,
+    ULONG* pMaxPackets)
+{
+    if ((pPcmFrames == 0) || (pPackets == 0) || (pMaxPackets == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    return m_inpin.GetQueueDepth(*pPcmFrames, *pPackets, *pMaxPackets);
+}
+
+
 void Filter::OnStart()
 {
     m_inpin.Start();
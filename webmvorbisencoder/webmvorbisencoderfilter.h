@@ -12,11 +12,13 @@
 #include "webmvorbisencoderinpin.h"
 #include "webmvorbisencoderoutpin.h"
 #include "clockable.h"
+#include "webmvorbisencoderidl.h"
 
 namespace WebmVorbisEncoderLib
 {
 
 class Filter : public IBaseFilter,
+               public IWebmVorbisEncoder,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -54,6 +56,10 @@ public:
     HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
     HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
 
+    //IWebmVorbisEncoder
+
+    HRESULT STDMETHODCALLTYPE GetQueueDepth(ULONG*, ULONG*, ULONG*);
+
 private:
     class CNondelegating : public IUnknown
     {
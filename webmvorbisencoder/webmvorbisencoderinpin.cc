@@ -18,6 +18,7 @@
 #include <vfwmsgs.h>
 #include <uuids.h>
 #include <mmreg.h>
+#include <process.h>
 #include <cassert>
 //#include <amvideo.h>
 //#include <evcode.h>
@@ -31,6 +32,224 @@ using std::fixed;
 using std::setprecision;
 #endif
 
+namespace
+{
+
+//Works out whether we can encode the input described by mt.  The
+//WAVEFORMATEXTENSIBLE mask names the speaker of each channel; for the
+//other formats the mask is 0, meaning the default layout for the count.
+
+bool GetInputFormat(
+    const AM_MEDIA_TYPE& mt,
+    webmdshow::PcmFormat& format,
+    DWORD& mask)
+{
+    if (mt.majortype != MEDIATYPE_Audio)
+        return false;
+
+    if (mt.formattype != FORMAT_WaveFormatEx)
+        return false;
+
+    if (mt.pbFormat == 0)
+        return false;
+
+    if (mt.cbFormat < 18)  //WAVEFORMATEX
+        return false;
+
+    const WAVEFORMATEX& wfx = (WAVEFORMATEX&)(*mt.pbFormat);
+
+    if (wfx.nChannels == 0)
+        return false;
+
+    //Vorbis defines the speaker layout for up to 8 channels only.
+
+    if (wfx.nChannels > webmdshow::kMaxReorderedPcmChannels)
+        return false;
+
+    if (wfx.nSamplesPerSec == 0)
+        return false;
+
+    GUID subtype;
+    WORD bits = wfx.wBitsPerSample;
+
+    if (wfx.wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+    {
+        if (mt.cbFormat < sizeof(WAVEFORMATEXTENSIBLE))
+            return false;
+
+        if (wfx.cbSize < 22)
+            return false;
+
+        const WAVEFORMATEXTENSIBLE& wfex =
+            (WAVEFORMATEXTENSIBLE&)(*mt.pbFormat);
+
+        //KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT are the same GUIDs
+        //as the DirectShow subtypes.
+
+        subtype = wfex.SubFormat;
+        mask = wfex.dwChannelMask;
+
+        //A 32-bit container with fewer valid bits is still decoded
+        //as 32-bit PCM: the padding is in the low bits.
+
+        if ((wfex.Samples.wValidBitsPerSample == 0) ||
+            (wfex.Samples.wValidBitsPerSample > bits))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (wfx.cbSize > 0)  //weird
+            return false;
+
+        if (wfx.wFormatTag == WAVE_FORMAT_PCM)
+            subtype = MEDIASUBTYPE_PCM;
+
+        else if (wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
+            subtype = MEDIASUBTYPE_IEEE_FLOAT;
+
+        else
+            return false;
+
+        mask = 0;
+    }
+
+    if (mt.subtype != subtype)
+        return false;
+
+    if (subtype == MEDIASUBTYPE_IEEE_FLOAT)
+    {
+        if (bits != 32)
+            return false;
+
+        format = webmdshow::kPcmFloat32;
+    }
+    else if (subtype == MEDIASUBTYPE_PCM)
+    {
+        if (bits == 16)
+            format = webmdshow::kPcmInt16;
+
+        else if (bits == 24)
+            format = webmdshow::kPcmInt24;
+
+        else if (bits == 32)
+            format = webmdshow::kPcmInt32;
+
+        else
+            return false;
+    }
+    else
+        return false;
+
+    if (wfx.nBlockAlign != wfx.nChannels * (bits / 8))
+        return false;
+
+    return true;
+}
+
+
+//The speakers of each Vorbis channel, for 1 to 8 channels (see section
+//4.3.9 of the Vorbis I specification).  The WAVE layouts with 6 or fewer
+//channels use either the back or the side speakers for the surrounds.
+
+const DWORD kFL = SPEAKER_FRONT_LEFT;
+const DWORD kFR = SPEAKER_FRONT_RIGHT;
+const DWORD kFC = SPEAKER_FRONT_CENTER;
+const DWORD kLFE = SPEAKER_LOW_FREQUENCY;
+const DWORD kBL = SPEAKER_BACK_LEFT;
+const DWORD kBR = SPEAKER_BACK_RIGHT;
+const DWORD kBC = SPEAKER_BACK_CENTER;
+const DWORD kSL = SPEAKER_SIDE_LEFT;
+const DWORD kSR = SPEAKER_SIDE_RIGHT;
+
+const DWORD s_vorbis_speakers[8][8] =
+{
+    { kFC | kFL | kFR },
+    { kFL, kFR },
+    { kFL, kFC, kFR },
+    { kFL, kFR, kBL | kSL, kBR | kSR },
+    { kFL, kFC, kFR, kBL | kSL, kBR | kSR },
+    { kFL, kFC, kFR, kBL | kSL, kBR | kSR, kLFE },
+    { kFL, kFC, kFR, kSL | kBL, kSR | kBR, kBC, kLFE },
+    { kFL, kFC, kFR, kSL, kSR, kBL, kBR, kLFE }
+};
+
+
+//The default masks, as for VorbisDecoder::GetChannelMask.
+
+const DWORD s_default_masks[8] =
+{
+    kFC,
+    kFL | kFR,
+    kFL | kFR | kFC,
+    kFL | kFR | kBL | kBR,
+    kFL | kFR | kFC | kBL | kBR,
+    kFL | kFR | kFC | kLFE | kBL | kBR,
+    kFL | kFR | kFC | kLFE | kBC | kSL | kSR,
+    kFL | kFR | kFC | kLFE | kBL | kBR | kSL | kSR
+};
+
+
+//The most frames ReadPcm moves into the encoder at once, so that the
+//analysis thread hands out packets (and makes room in the ring) as it
+//goes rather than only after a large sample.
+
+const long kMaxReadFrames = 4096;
+
+
+//WAVE channels are the speakers of the mask, in the order of their bits.
+//An input whose speakers don't match the Vorbis layout for its count is
+//encoded in its own order.
+
+void GetChannelOrder(int channels, DWORD mask, int* order)
+{
+    assert(channels > 0);
+    assert(channels <= 8);
+
+    for (int i = 0; i < channels; ++i)
+        order[i] = i;
+
+    if (mask == 0)
+        mask = s_default_masks[channels - 1];
+
+    const DWORD* const speakers = s_vorbis_speakers[channels - 1];
+
+    int temp[8];
+    int used = 0;  //bitmap of Vorbis channels
+    int wave = 0;
+
+    for (DWORD bit = 1; (bit != 0) && (wave < channels); bit <<= 1)
+    {
+        if ((mask & bit) == 0)
+            continue;
+
+        int vorbis = 0;
+
+        while (vorbis < channels)
+        {
+            if ((speakers[vorbis] & bit) && !(used & (1 << vorbis)))
+                break;
+
+            ++vorbis;
+        }
+
+        if (vorbis >= channels)  //no Vorbis channel for this speaker
+            return;
+
+        temp[wave++] = vorbis;
+        used |= 1 << vorbis;
+    }
+
+    if (wave < channels)  //mask names fewer speakers than channels
+        return;
+
+    for (int i = 0; i < channels; ++i)
+        order[i] = temp[i];
+}
+
+}  //end anon namespace
+
 namespace WebmVorbisEncoderLib
 {
 
@@ -41,9 +260,13 @@ Inpin::Inpin(Filter* pFilter) :
     m_bFlush(false),
     m_bDone(false),
     m_bStopped(true),
+    m_pcm_format(webmdshow::kPcmFloat32),
+    m_block_align(0),
     m_first_reftime(-1),
     m_start_reftime(-1),
-    m_start_samples(-1)
+    m_start_samples(-1),
+    m_max_packets(0),
+    m_hThread(0)
 {
     AM_MEDIA_TYPE mt;
 
@@ -62,16 +285,33 @@ Inpin::Inpin(Filter* pFilter) :
 
     m_preferred_mtv.Add(mt);
 
+    mt.subtype = MEDIASUBTYPE_PCM;
+    m_preferred_mtv.Add(mt);
+
     m_info.channels = 0;  //means "not initialized"
 
     m_hSamples = CreateEvent(0, 0, 0, 0);
     assert(m_hSamples);
+
+    m_hPcm = CreateEvent(0, 0, 0, 0);
+    assert(m_hPcm);
+
+    m_hPcmSpace = CreateEvent(0, 0, 0, 0);
+    assert(m_hPcmSpace);
 }
 
 
 Inpin::~Inpin()
 {
-    const BOOL b = CloseHandle(m_hSamples);
+    assert(m_hThread == 0);
+
+    BOOL b = CloseHandle(m_hSamples);
+    assert(b);
+
+    b = CloseHandle(m_hPcm);
+    assert(b);
+
+    b = CloseHandle(m_hPcmSpace);
     assert(b);
 }
 
@@ -214,9 +454,20 @@ HRESULT Inpin::ReceiveConnection(
 
     const WAVEFORMATEX& wfx = (WAVEFORMATEX&)(*mt.pbFormat);
     assert(wfx.nChannels > 0);
-    assert(wfx.nChannels <= 2);  //TODO: proper channel mapping
+    assert(wfx.nChannels <= webmdshow::kMaxReorderedPcmChannels);
     assert(wfx.nSamplesPerSec > 0);
 
+    DWORD mask;
+
+    const bool bAccept = GetInputFormat(mt, m_pcm_format, mask);
+    bAccept;
+    assert(bAccept);
+
+    m_block_align = wfx.nBlockAlign;
+    GetChannelOrder(wfx.nChannels, mask, m_channel_order);
+
+    m_pcm.Reset(m_block_align * wfx.nSamplesPerSec);  //1 second
+
     //Initialize vorbis encoder library, in order to generate
     //the 3 header packets, and thus the output media type.
 
@@ -367,19 +618,16 @@ HRESULT Inpin::EndOfStream()
     if (m_bFlush)
         return S_FALSE;  //?
 
-    m_bEndOfStream = true;
+    //The analysis thread flushes the encoder once it has read the
+    //PCM still in the ring.
 
-    const int status = vorbis_analysis_wrote(&m_dsp_state, 0);  //means "EOS"
-    status;
-    assert(status == 0);
-
-    hr = lock.Release();
-    assert(SUCCEEDED(hr));
+    m_bEndOfStream = true;
 
-    if (FAILED(hr))
-        return hr;
+    const BOOL b = SetEvent(m_hPcm);
+    b;
+    assert(b);
 
-    return PopulateSamples();
+    return S_OK;
 }
 
 
@@ -430,6 +678,18 @@ HRESULT Inpin::BeginFlush()
 
     m_bFlush = true;
 
+    //The analysis thread might be waiting for an output buffer, so give
+    //back the ones we hold.  Wake up the analysis thread, and Receive in
+    //case it's waiting for room in the ring.
+
+    ReleaseBuffers();
+
+    BOOL b = SetEvent(m_hPcm);
+    assert(b);
+
+    b = SetEvent(m_hPcmSpace);
+    assert(b);
+
     Outpin& outpin = m_pFilter->m_outpin;
 
     if (IPin* const pPin = outpin.m_pPinConnection)
@@ -450,7 +710,7 @@ HRESULT Inpin::BeginFlush()
            << endl;
 #endif
 
-        const BOOL b = SetEvent(m_hSamples);  //to terminate thread
+        b = SetEvent(m_hSamples);  //to terminate thread
         assert(b);
 
         hr = lock.Release();
@@ -461,6 +721,13 @@ HRESULT Inpin::BeginFlush()
 
         outpin.StopThread();
     }
+    else
+    {
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+    }
+
+    StopThread();
 
 #ifdef _DEBUG
     os << "webmvorbisencoder::inpin::beginflush(end #2): thread terminated"
@@ -507,14 +774,13 @@ HRESULT Inpin::EndFlush()
     m_first_reftime = -1;
     m_bDone = false;
 
-    while (!m_buffers.empty())
-    {
-        IMediaSample* const pSample = m_buffers.front();
-        m_buffers.pop_front();
+    ReleaseBuffers();
 
-        if (pSample)
-            pSample->Release();
-    }
+    //Both threads are idle now: the streaming thread because upstream
+    //has stopped it, and the analysis thread because BeginFlush stopped
+    //it.
+
+    m_pcm.Clear();
 
     Outpin& outpin = m_pFilter->m_outpin;
 
@@ -537,9 +803,10 @@ HRESULT Inpin::EndFlush()
 #endif
 
             outpin.StartThread();
+            StartThread();
 
 #ifdef _DEBUG
-            os << "webmvorbisencoder::inpin::endflush: started thread"
+            os << "webmvorbisencoder::inpin::endflush: started threads"
                << endl;
 #endif
         }
@@ -572,6 +839,10 @@ void Inpin::OnCompletion()
     }
 
     m_bDone = true;
+
+    const BOOL b = SetEvent(m_hPcmSpace);  //in case Receive is waiting
+    b;
+    assert(b);
 }
 
 
@@ -607,38 +878,10 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     if (pmt == 0)
         return E_INVALIDARG;
 
-    const AM_MEDIA_TYPE& mt = *pmt;
-
-    if (mt.majortype != MEDIATYPE_Audio)
-        return S_FALSE;
-
-    if (mt.subtype != MEDIASUBTYPE_IEEE_FLOAT)
-        return S_FALSE;
-
-    if (mt.formattype != FORMAT_WaveFormatEx)
-        return S_FALSE;
-
-    if (mt.pbFormat == 0)
-        return S_FALSE;
-
-    if (mt.cbFormat < 18)  //WAVEFORMATEX
-        return S_FALSE;
-
-    const WAVEFORMATEX& wfx = (WAVEFORMATEX&)(*mt.pbFormat);
-
-    if (wfx.wFormatTag != WAVE_FORMAT_IEEE_FLOAT)
-        return S_FALSE;
+    webmdshow::PcmFormat format;
+    DWORD mask;
 
-    if (wfx.cbSize > 0)  //weird
-        return S_FALSE;
-
-    if (wfx.nChannels == 0)
-        return S_FALSE;
-
-    if (wfx.nChannels > 2)  //TODO
-        return S_FALSE;
-
-    if (wfx.nSamplesPerSec == 0)
+    if (!GetInputFormat(*pmt, format, mask))
         return S_FALSE;
 
     return S_OK;
@@ -807,66 +1050,148 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     }
 #endif
 
-    Encode(pInSample);
-
     hr = lock.Release();
     assert(SUCCEEDED(hr));
 
     if (FAILED(hr))
         return hr;
 
-    return PopulateSamples();
+    return WritePcm(pInSample);
 }
 
 
-void Inpin::Encode(IMediaSample* s)
+HRESULT Inpin::WritePcm(IMediaSample* pSample)
 {
-    assert(s);
+    //Filter is NOT locked
 
-    const long len = s->GetActualDataLength();
+    const long len = pSample->GetActualDataLength();
 
     if (len <= 0)
-        return;
+        return S_OK;
 
-    const int channels = m_info.channels;
-    assert(channels > 0);
-
-    const long block_align = sizeof(float) * channels;
-    assert(len % block_align == 0);
-
-    const long block_count = len / block_align;
-    assert(block_count > 0);  //distinguished value 0 means "end of stream"
-
-    const long sample_count = len / sizeof(float);
-    assert(sample_count > 0);
+    assert(len % m_block_align == 0);
 
     BYTE* buf;
 
-    HRESULT hr = s->GetPointer(&buf);
+    HRESULT hr = pSample->GetPointer(&buf);
     assert(SUCCEEDED(hr));
     assert(buf);
 
-    const float* const src_begin = reinterpret_cast<float*>(buf);
-    const float* src = src_begin;
+    size_t done = 0;
+
+    for (;;)
+    {
+        const size_t n = m_pcm.Write(buf + done, len - done);
+
+        if (n > 0)
+        {
+            const BOOL b = SetEvent(m_hPcm);
+            b;
+            assert(b);
+
+            done += n;
+        }
+
+        if (done >= size_t(len))
+            return S_OK;
+
+        //The ring is full: wait for the analysis thread to make room.
+
+        const DWORD dw = WaitForSingleObject(m_hPcmSpace, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return E_FAIL;
+
+        assert(dw == WAIT_OBJECT_0);
+
+        Filter::Lock lock;
+
+        hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
 
-    const float* const src_end = src_begin + sample_count;
-    src_end;
+        if (m_pFilter->m_state == State_Stopped)
+            return VFW_E_NOT_RUNNING;
+
+        if (m_bStopped)  //weird
+            return VFW_E_WRONG_STATE;
+
+        if (m_bFlush)
+            return S_FALSE;
+
+        if (m_bDone)
+            return S_FALSE;
+    }
+}
+
+
+long Inpin::ReadPcm()
+{
+    //Filter is NOT locked.  This is the only reader of the ring.
+
+    const long block_align = m_block_align;
+    assert(block_align > 0);
+
+    const BYTE* buf;
+
+    const size_t cb = m_pcm.Peek(&buf);
+    long block_count = static_cast<long>(cb / size_t(block_align));
+
+    if (block_count > 0)
+    {
+        if (block_count > kMaxReadFrames)
+            block_count = kMaxReadFrames;
+
+        Encode(buf, block_count);
+        m_pcm.Consume(block_count * block_align);
+    }
+    else if (m_pcm.size() >= size_t(block_align))
+    {
+        //The next frame straddles the end of the ring.
+
+        BYTE frame[webmdshow::kMaxReorderedPcmChannels * sizeof(float)];
+        assert(size_t(block_align) <= sizeof frame);
+
+        const size_t n = m_pcm.Read(frame, block_align);
+        n;
+        assert(n == size_t(block_align));
+
+        Encode(frame, 1);
+        block_count = 1;
+    }
+    else
+        return 0;
+
+    const BOOL b = SetEvent(m_hPcmSpace);
+    b;
+    assert(b);
+
+    return block_count;
+}
+
+
+void Inpin::Encode(const BYTE* buf, long block_count)
+{
+    assert(buf);
+    assert(block_count > 0);  //distinguished value 0 means "end of stream"
+
+    const int channels = m_info.channels;
+    assert(channels > 0);
 
     float** dst = vorbis_analysis_buffer(&m_dsp_state, block_count);
     assert(dst);
 
-    //TODO: verify left-right channel order issue
-    //TODO: extend to channels > 2
-
-    for (int block = 0; block < block_count; ++block)
-        for (int channel = 0; channel < channels; ++channel)
-        {
-            memcpy(dst[channel] + block, src, sizeof(float));
-            ++src;
-        }
+    //Converts to float and moves each WAVE channel to its Vorbis
+    //channel, four frames at a time where SSE is available.
 
-    assert(src == src_end);
-    assert((src_end - src_begin) / channels == block_count);
+    webmdshow::DeinterleavePcm(
+        buf,
+        m_pcm_format,
+        m_channel_order,
+        channels,
+        block_count,
+        dst);
 
     const int status = vorbis_analysis_wrote(&m_dsp_state, block_count);
     status;
@@ -958,6 +1283,11 @@ HRESULT Inpin::PopulateSamples()
 
         m_buffers.push_back(pOutSample.Detach());
 
+        const ULONG packets = static_cast<ULONG>(m_buffers.size());
+
+        if (packets > m_max_packets)
+            m_max_packets = packets;
+
         if (pkt.e_o_s)
             m_buffers.push_back(0);
 
@@ -1185,6 +1515,7 @@ void Inpin::Start()
     m_first_reftime = -1;
     m_start_reftime = -1;
     m_start_samples = -1;
+    m_max_packets = 0;
 
     if (m_info.channels > 0)  //connected
     {
@@ -1198,11 +1529,40 @@ void Inpin::Start()
 
         result = vorbis_block_init(&m_dsp_state, &m_block);
         assert(result == 0);
+
+        m_pcm.Clear();
+
+        if (bool(m_pFilter->m_outpin.m_pPinConnection))
+            StartThread();
     }
 }
 
 
 void Inpin::Stop()
+{
+    ReleaseBuffers();
+
+    BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
+    assert(b);
+
+    //The filter stops our analysis thread once it has decommitted the
+    //outpin's allocator, in case the thread is waiting for a buffer.
+
+    b = SetEvent(m_hPcm);
+    assert(b);
+
+    b = SetEvent(m_hPcmSpace);
+    assert(b);
+
+    m_bStopped = true;
+
+    //TODO: we really should wait here for the output pin thread
+    //to terminate, in order to ensure that we transition to the
+    //bDone state immediately.
+}
+
+
+void Inpin::ReleaseBuffers()
 {
     while (!m_buffers.empty())
     {
@@ -1212,15 +1572,160 @@ void Inpin::Stop()
         if (pSample)
             pSample->Release();
     }
+}
+
+
+HRESULT Inpin::GetQueueDepth(
+    ULONG& pcm_frames,
+    ULONG& packets,
+    ULONG& max_packets) const
+{
+    if (!bool(m_pPinConnection))
+        return VFW_E_NOT_CONNECTED;
+
+    assert(m_block_align > 0);
+
+    pcm_frames = static_cast<ULONG>(m_pcm.size() / size_t(m_block_align));
+    packets = 0;
+
+    typedef buffers_t::const_iterator iter_t;
+
+    for (iter_t i = m_buffers.begin(); i != m_buffers.end(); ++i)
+    {
+        if (*i)  //not the EOS notification
+            ++packets;
+    }
+
+    max_packets = m_max_packets;
+
+    return S_OK;
+}
+
+
+void Inpin::StartThread()
+{
+    assert(m_hThread == 0);
 
-    const BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Inpin::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+#ifdef _DEBUG
+    odbgstream os;
+    os << "webmvorbisenc::Inpin::StartThread: hThread=0x"
+       << hex << h << dec
+       << endl;
+#endif
+}
+
+
+void Inpin::StopThread()
+{
+    if (m_hThread == 0)
+        return;
+
+    const BOOL b = SetEvent(m_hPcm);
+    b;
     assert(b);
 
-    m_bStopped = true;
+    const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
 
-    //TODO: we really should wait here for the output pin thread
-    //to terminate, in order to ensure that we transition to the
-    //bDone state immediately.
+    const BOOL bClose = CloseHandle(m_hThread);
+    bClose;
+    assert(bClose);
+
+    m_hThread = 0;
+}
+
+
+unsigned Inpin::ThreadProc(void* pv)
+{
+    Inpin* const pPin = static_cast<Inpin*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned Inpin::Main()
+{
+    Analyze();
+
+    //Once we stop reading the ring, Receive must not wait for room.
+
+    Filter::Lock lock;
+
+    const HRESULT hr = lock.Seize(m_pFilter);
+
+    if (SUCCEEDED(hr))
+        m_bDone = true;
+
+    const BOOL b = SetEvent(m_hPcmSpace);
+    b;
+    assert(b);
+
+    return 0;
+}
+
+
+void Inpin::Analyze()
+{
+    for (;;)
+    {
+        Filter::Lock lock;
+
+        HRESULT hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return;
+
+        if (m_bStopped || m_bFlush || m_bDone)
+            return;
+
+        const bool bEndOfStream = m_bEndOfStream;
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        //EndOfStream is called after the last Receive has returned, so
+        //if it has been called, the ring holds all of the PCM.
+
+        if (ReadPcm() > 0)
+        {
+            hr = PopulateSamples();
+
+            if (hr != S_OK)
+                return;
+
+            continue;
+        }
+
+        if (bEndOfStream)
+        {
+            const int status = vorbis_analysis_wrote(&m_dsp_state, 0);
+            status;
+            assert(status == 0);
+
+            PopulateSamples();  //until the packet marked EOS
+            return;
+        }
+
+        const DWORD dw = WaitForSingleObject(m_hPcm, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return;
+
+        assert(dw == WAIT_OBJECT_0);
+    }
 }
 
 }  //end namespace WebmVorbisEncoderLib
@@ -9,6 +9,8 @@
 #pragma once
 #include "webmvorbisencoderpin.h"
 #include "graphutil.h"
+#include "pcmutil.h"
+#include "spscbytering.h"
 #include "vorbis/codec.h"
 #include <vector>
 #include <deque>
@@ -94,11 +96,17 @@ public:
 
     void Start();  //from stopped to running/paused
     void Stop();   //from running/paused to stopped
+    void StopThread();  //call without the filter lock
 
     HANDLE m_hSamples;
     int GetSample(IMediaSample**);
     void OnCompletion();
 
+    HRESULT GetQueueDepth(
+        ULONG& pcm_frames,
+        ULONG& packets,
+        ULONG& max_packets) const;
+
 private:
     GraphUtil::IMemAllocatorPtr m_pAllocator;
 
@@ -107,6 +115,12 @@ private:
     bool m_bDone;
     bool m_bStopped;
 
+    webmdshow::PcmFormat m_pcm_format;
+    long m_block_align;  //bytes per input frame
+
+    //For each channel of the input, the Vorbis channel it is encoded as.
+    int m_channel_order[webmdshow::kMaxReorderedPcmChannels];
+
     vorbis_info m_info;
     vorbis_dsp_state m_dsp_state;
     vorbis_block m_block;
@@ -118,6 +132,24 @@ private:
 
     typedef std::list<IMediaSample*> buffers_t;
     buffers_t m_buffers;
+    ULONG m_max_packets;  //most packets in m_buffers since Start
+
+    //Receive copies the input PCM into the ring, without the filter
+    //lock, and the analysis thread encodes it from there.
+
+    webmdshow::SpscByteRing m_pcm;
+    HANDLE m_hPcm;       //signalled when PCM is written, and to stop
+    HANDLE m_hPcmSpace;  //signalled when PCM is read, and to stop
+    HANDLE m_hThread;
+
+    void StartThread();
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+    void Analyze();
+
+    HRESULT WritePcm(IMediaSample*);
+    long ReadPcm();
+    void ReleaseBuffers();
 
     void OnConnect(
         const WAVEFORMATEX& wfx,
@@ -125,7 +157,7 @@ private:
         const ogg_packet& comment,
         const ogg_packet& code);
 
-    void Encode(IMediaSample*);
+    void Encode(const BYTE*, long block_count);
     HRESULT PopulateSamples();
     void PopulateSample(IMediaSample*, const ogg_packet&);
 